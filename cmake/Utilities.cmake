@@ -187,6 +187,11 @@ function(add_library_wrapper libName fileList testFileList dependencyList)
     #set_property (TARGET ${executableName} APPEND PROPERTY COMPILE_DEFINITIONS "TEST_SRCDIR=\"${CMAKE_CURRENT_SOURCE_DIR}/tests\"")
 
     add_test(${executableName} ${executableName}) 
+    # The performance tests, see src/test/Perf.h. Run only these with
+    # 'ctest -L perf', or skip them with 'ctest -LE perf'.
+    if (filename MATCHES "^TestPerf")
+      set_tests_properties(${executableName} PROPERTIES LABELS perf)
+    endif()
     add_to_custom_test_target(${executableName})  # Add to the verbose test make target.
   endforeach(f)
 
@@ -0,0 +1,175 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+// Microbenchmarks for the camera models, on the sample cameras in
+// Camera/tests. There is no sample of a CSM or ASTER camera there, so
+// the CSM model is the one a DG camera uses internally, and the ASTER
+// model is built from a lattice of rays of the DG camera, as
+// aster2asp does from the sight vectors in ASTER metadata.
+
+#include <test/Benchmark.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/LinescanSpotModel.h>
+#include <asp/Camera/LinescanASTERModel.h>
+#include <asp/Camera/CsmModel.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPC_XML.h>
+
+#include <vw/Cartography/Datum.h>
+#include <vw/Cartography/CameraBBox.h>
+
+#include <xercesc/util/PlatformUtils.hpp>
+
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  // A grid of pixels in a part of the image, and the points on the datum
+  // they see
+  struct CameraData {
+    vw::CamPtr cam;
+    std::vector<Vector2> pixels;
+    std::vector<Vector3> points;
+  };
+
+  const int IMAGE_SIZE = 2000, GRID_SIZE = 10;
+
+  void init_xml() {
+    static bool done = false;
+    if (!done) {
+      xercesc::XMLPlatformUtils::Initialize();
+      done = true;
+    }
+  }
+
+  CameraData make_data(vw::CamPtr cam) {
+    cartography::Datum datum("WGS84");
+    CameraData data;
+    data.cam = cam;
+    for (int row = 0; row < GRID_SIZE; row++) {
+      for (int col = 0; col < GRID_SIZE; col++) {
+        Vector2 pix(col * IMAGE_SIZE / (GRID_SIZE - 1.0),
+                    row * IMAGE_SIZE / (GRID_SIZE - 1.0));
+        data.pixels.push_back(pix);
+        data.points.push_back(cartography::datum_intersection(datum, cam->camera_center(pix),
+                                                              cam->pixel_to_vector(pix)));
+      }
+    }
+    return data;
+  }
+
+  CameraData const& dg_data() {
+    static CameraData data;
+    if (!data.cam) {
+      init_xml();
+      data = make_data(asp::load_dg_camera_model_from_xml("dg_example1.xml"));
+    }
+    return data;
+  }
+
+  boost::shared_ptr<asp::RPCModel> rpc_model() {
+    init_xml();
+    asp::RPCXML xml;
+    xml.read_from_file("dg_example1.xml");
+    return boost::shared_ptr<asp::RPCModel>(new asp::RPCModel(*xml.rpc_ptr()));
+  }
+
+  // The RPC model of the same image as the DG camera, at the same points
+  CameraData const& rpc_data() {
+    static CameraData data;
+    if (!data.cam) {
+      data = dg_data();
+      data.cam = rpc_model();
+    }
+    return data;
+  }
+
+  // The CSM model inside the DG camera
+  CameraData const& csm_data() {
+    static CameraData data;
+    if (!data.cam) {
+      data = dg_data();
+      asp::DGCameraModel const* dg
+        = dynamic_cast<asp::DGCameraModel const*>(data.cam.get());
+      data.cam = dg->m_csm_model;
+    }
+    return data;
+  }
+
+  CameraData const& spot_data() {
+    static CameraData data;
+    if (!data.cam) {
+      init_xml();
+      data = make_data(asp::load_spot5_camera_model_from_xml("spot_example1.xml"));
+    }
+    return data;
+  }
+
+  // An ASTER model with rays and positions from the DG camera on a lattice
+  CameraData const& aster_data() {
+    static CameraData data;
+    if (!data.cam) {
+      vw::CamPtr dg = dg_data().cam;
+      int num = 21, spacing = IMAGE_SIZE / (num - 1);
+      std::vector<std::vector<Vector2>> lattice(num, std::vector<Vector2>(num));
+      std::vector<std::vector<Vector3>> sight(num, std::vector<Vector3>(num));
+      std::vector<Vector3> sat_pos(num);
+      for (int row = 0; row < num; row++) {
+        sat_pos[row] = dg->camera_center(Vector2(0, row * spacing));
+        for (int col = 0; col < num; col++) {
+          lattice[row][col] = Vector2(col * spacing, row * spacing);
+          sight[row][col] = dg->pixel_to_vector(lattice[row][col]);
+        }
+      }
+      vw::CamPtr aster(new asp::ASTERCameraModel(lattice, sight, sight, sat_pos,
+                                                 Vector2(IMAGE_SIZE, IMAGE_SIZE),
+                                                 rpc_model()));
+      data = make_data(aster);
+    }
+    return data;
+  }
+
+  void point_to_pixel(CameraData const& data, asp::bench::State & state) {
+    while (state.keep_running()) {
+      for (size_t it = 0; it < data.points.size(); it++)
+        asp::bench::do_not_optimize(data.cam->point_to_pixel(data.points[it]));
+    }
+    state.set_items_processed(state.iterations() * data.points.size());
+  }
+
+  void pixel_to_vector(CameraData const& data, asp::bench::State & state) {
+    while (state.keep_running()) {
+      for (size_t it = 0; it < data.pixels.size(); it++)
+        asp::bench::do_not_optimize(data.cam->pixel_to_vector(data.pixels[it]));
+    }
+    state.set_items_processed(state.iterations() * data.pixels.size());
+  }
+
+}
+
+ASP_BENCHMARK(DG_point_to_pixel)     { point_to_pixel (dg_data(),    state); }
+ASP_BENCHMARK(DG_pixel_to_vector)    { pixel_to_vector(dg_data(),    state); }
+ASP_BENCHMARK(RPC_point_to_pixel)    { point_to_pixel (rpc_data(),   state); }
+ASP_BENCHMARK(RPC_pixel_to_vector)   { pixel_to_vector(rpc_data(),   state); }
+ASP_BENCHMARK(CSM_point_to_pixel)    { point_to_pixel (csm_data(),   state); }
+ASP_BENCHMARK(CSM_pixel_to_vector)   { pixel_to_vector(csm_data(),   state); }
+ASP_BENCHMARK(SPOT_point_to_pixel)   { point_to_pixel (spot_data(),  state); }
+ASP_BENCHMARK(SPOT_pixel_to_vector)  { pixel_to_vector(spot_data(),  state); }
+ASP_BENCHMARK(ASTER_point_to_pixel)  { point_to_pixel (aster_data(), state); }
+ASP_BENCHMARK(ASTER_pixel_to_vector) { pixel_to_vector(aster_data(), state); }
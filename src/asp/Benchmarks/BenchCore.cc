@@ -0,0 +1,236 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+// Microbenchmarks for image and grid kernels in AspCore. The inputs are
+// synthetic, and the same in each run.
+
+#include <test/Benchmark.h>
+#include <asp/Core/Point2Grid.h>
+#include <asp/Core/SoftwareRenderer.h>
+#include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/MedianFilter.h>
+#include <asp/Core/SfsGpuKernels.h>
+
+#include <vw/Core/Settings.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/Image/Manipulation.h>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  // Scattered points with heights, over a grid of the given size
+  std::vector<Vector3> make_points(int num, int size) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(0.0, size - 1.0);
+    std::vector<Vector3> points(num);
+    for (int it = 0; it < num; it++) {
+      double x = dist(gen), y = dist(gen);
+      points[it] = Vector3(x, y, 100.0 * std::sin(0.05 * x) * std::cos(0.03 * y));
+    }
+    return points;
+  }
+
+  // An image with a smooth pattern, and a no-data border of varying width
+  ImageView<uint8> make_image(int cols, int rows) {
+    ImageView<uint8> img(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      int border = 20 + (row % 37);
+      for (int col = 0; col < cols; col++) {
+        if (col < border || col >= cols - border)
+          img(col, row) = 0;
+        else
+          img(col, row) = 1 + (col * 7 + row * 3) % 255;
+      }
+    }
+    return img;
+  }
+
+  void grid_points(asp::FilterType filter, asp::bench::State & state) {
+    int size = 256, num = 200000;
+    std::vector<Vector3> points = make_points(num, size);
+    ImageView<double> buffer, weights;
+    asp::Point2Grid grid(size, size, buffer, weights, 0.0, 0.0, 1.0, 0.0, 1.5, 0.0,
+                         filter, -1);
+    while (state.keep_running()) {
+      grid.Clear(0.0);
+      for (size_t it = 0; it < points.size(); it++)
+        grid.AddPoint(points[it][0], points[it][1], points[it][2]);
+      asp::bench::do_not_optimize(buffer(size / 2, size / 2));
+    }
+    state.set_items_processed(state.iterations() * num);
+  }
+
+  // A grid of triangles covering the buffer
+  void render_triangles(asp::bench::State & state, bool binned) {
+    int size = 512, cells = 128;
+    ImageView<float> buffer(size, size);
+    std::vector<float> vertices, colors;
+    for (int row = 0; row < cells; row++) {
+      for (int col = 0; col < cells; col++) {
+        float x0 = col, y0 = row, x1 = col + 1, y1 = row + 1;
+        float tri[12] = {x0, y0, x1, y0, x1, y1,   x0, y0, x1, y1, x0, y1};
+        vertices.insert(vertices.end(), tri, tri + 12);
+        for (int v = 0; v < 6; v++)
+          colors.push_back(float(row + col + v));
+      }
+    }
+    int num_tri = vertices.size() / 6;
+    if (binned) {
+      stereo::BinnedSoftwareRenderer renderer(size, size, &buffer(0, 0),
+                                              vw_settings().default_num_threads());
+      renderer.Ortho2D(0, cells, 0, cells);
+      renderer.SetVertexPointer(2, &vertices[0]);
+      renderer.SetColorPointer(1, &colors[0]);
+      while (state.keep_running()) {
+        renderer.Clear(0.0);
+        for (int t = 0; t < num_tri; t++)
+          renderer.DrawPolygon(3 * t, 3);
+        renderer.Finish();
+        asp::bench::do_not_optimize(buffer(size / 2, size / 2));
+      }
+    } else {
+      stereo::SoftwareRenderer renderer(size, size, &buffer(0, 0));
+      renderer.Ortho2D(0, cells, 0, cells);
+      renderer.SetVertexPointer(2, &vertices[0]);
+      renderer.SetColorPointer(1, &colors[0]);
+      while (state.keep_running()) {
+        renderer.Clear(0.0);
+        for (int t = 0; t < num_tri; t++)
+          renderer.DrawPolygon(3 * t, 3);
+        asp::bench::do_not_optimize(buffer(size / 2, size / 2));
+      }
+    }
+    state.set_items_processed(state.iterations() * num_tri);
+  }
+
+  // The reflectance at a range of surface normals, with the sun and the
+  // viewer in fixed positions
+  void reflectance(int type, asp::bench::State & state) {
+    asp::cuda::SfsGpuParams p;
+    std::memset(&p, 0, sizeof(p));
+    p.reflectance_type = type;
+    double coeffs[5] = {0.68, 0.17, 0.62, 0.52, 0.52};
+    for (int c = 0; c < 5; c++)
+      p.model_coeffs[c] = coeffs[c];
+    p.phase_coeff_c1 = 0.1;
+    p.phase_coeff_c2 = 0.2;
+
+    int num = 4096;
+    std::vector<double> normals(3 * num);
+    for (int it = 0; it < num; it++) {
+      double a = 0.3 * std::sin(0.01 * it), b = 0.3 * std::cos(0.013 * it);
+      double n = std::sqrt(1.0 + a * a + b * b);
+      normals[3*it] = a / n; normals[3*it + 1] = b / n; normals[3*it + 2] = 1.0 / n;
+    }
+    double sun[3]  = {1.0e8, 2.0e7, 8.0e7};
+    double view[3] = {1.0e5, -2.0e4, 7.0e5};
+    double xyz[3]  = {0.0, 0.0, 0.0};
+
+    while (state.keep_running()) {
+      double sum = 0.0;
+      for (int it = 0; it < num; it++)
+        sum += asp::cuda::sfs_gpu_reflectance(p, sun, view, xyz, &normals[3*it]);
+      asp::bench::do_not_optimize(sum);
+    }
+    state.set_items_processed(state.iterations() * num);
+  }
+
+}
+
+ASP_BENCHMARK(Point2Grid_AddPoint_WeightedAverage) {
+  grid_points(asp::f_weighted_average, state);
+}
+
+ASP_BENCHMARK(Point2Grid_AddPoint_Median) {
+  grid_points(asp::f_median, state);
+}
+
+ASP_BENCHMARK(SoftwareRenderer_DrawPolygon) {
+  render_triangles(state, false);
+}
+
+ASP_BENCHMARK(BinnedSoftwareRenderer_DrawPolygon) {
+  render_triangles(state, true);
+}
+
+ASP_BENCHMARK(ThreadedEdgeMask) {
+  ImageView<uint8> img = make_image(2048, 2048);
+  while (state.keep_running()) {
+    ImageView<uint8> out = asp::threaded_edge_mask(img, 0);
+    asp::bench::do_not_optimize(out(1024, 1024));
+  }
+  state.set_items_processed(state.iterations() * img.cols() * img.rows());
+}
+
+ASP_BENCHMARK(MedianFilter_Fast) {
+  ImageView<uint8> img = make_image(1024, 1024);
+  while (state.keep_running()) {
+    ImageView<uint8> out = fast_median_filter(img, 7);
+    asp::bench::do_not_optimize(out(512, 512));
+  }
+  state.set_items_processed(state.iterations() * img.cols() * img.rows());
+}
+
+ASP_BENCHMARK(MedianFilter_PerPixel) {
+  ImageView<uint8> img = make_image(512, 512);
+  while (state.keep_running()) {
+    ImageView<uint8> out = my_median_filter(img, 7, 7);
+    asp::bench::do_not_optimize(out(256, 256));
+  }
+  state.set_items_processed(state.iterations() * img.cols() * img.rows());
+}
+
+ASP_BENCHMARK(MedianFilter_ConstantTime) {
+  ImageView<uint8> img = make_image(1024, 1024);
+  while (state.keep_running()) {
+    ImageView<uint8> out = asp::median_filter(img, 3, 1);
+    asp::bench::do_not_optimize(out(512, 512));
+  }
+  state.set_items_processed(state.iterations() * img.cols() * img.rows());
+}
+
+ASP_BENCHMARK(MedianFilter_Float) {
+  ImageView<uint8> src = make_image(1024, 1024);
+  ImageView<float> img(src.cols(), src.rows());
+  for (int col = 0; col < img.cols(); col++)
+    for (int row = 0; row < img.rows(); row++)
+      img(col, row) = src(col, row);
+  while (state.keep_running()) {
+    ImageView<float> out = asp::median_filter(img, 3, 1);
+    asp::bench::do_not_optimize(out(512, 512));
+  }
+  state.set_items_processed(state.iterations() * img.cols() * img.rows());
+}
+
+ASP_BENCHMARK(SfsReflectance_Lambertian) {
+  reflectance(asp::cuda::SFS_GPU_LAMBERT, state);
+}
+
+ASP_BENCHMARK(SfsReflectance_LunarLambertian) {
+  reflectance(asp::cuda::SFS_GPU_LUNAR_LAMBERT, state);
+}
+
+ASP_BENCHMARK(SfsReflectance_Hapke) {
+  reflectance(asp::cuda::SFS_GPU_HAPKE, state);
+}
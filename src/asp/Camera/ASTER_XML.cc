@@ -24,6 +24,7 @@
 #include <asp/Core/FileUtils.h>
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/ASTER_XML.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
 
@@ -100,9 +101,19 @@ DOMElement* ASTERXML::open_xml_file(std::string const& xml_path) {
 }
 
 void ASTERXML::read_xml(std::string const& xml_path) {
+  if (read_camera_cache(xml_path, "aster", *this))
+    return;
+  DOMElement * root = open_xml_file(xml_path);
+  parse_xml(root);
+  write_camera_cache(xml_path, "aster", *this);
+}
 
-  DOMElement * elementRoot = open_xml_file(xml_path);
-  parse_xml(elementRoot);
+void ASTERXML::cache_io(CameraCache & cache) {
+  cache.io(m_lattice_mat);
+  cache.io(m_sight_mat);
+  cache.io(m_world_sight_mat);
+  cache.io(m_sat_pos);
+  cache.io(m_image_size);
 }
 
 void ASTERXML::parse_xml(xercesc::DOMElement* node) {
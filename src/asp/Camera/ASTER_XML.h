@@ -52,6 +52,8 @@ XERCES_CPP_NAMESPACE_END
 
 namespace asp {
 
+  class CameraCache;
+
   class ASTERXML {
   public:
   
@@ -72,6 +74,9 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io(CameraCache & cache);
+
   private: // The various XML data reading sections
   
     /// Just opens the XML file for reading and returns the root node.
@@ -0,0 +1,474 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/ApproxCameraModel.h>
+
+#include <vw/Cartography/CameraBBox.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  // Increment this when the data saved by write() changes
+  const int APPROX_CAMERA_VERSION = 1;
+  const std::string APPROX_CAMERA_MAGIC = "ASP approx camera";
+
+  const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+  // Project a point with the exact camera. NaN on failure.
+  Vector2 exact_pixel(camera::CameraModel const* cam, Vector3 const& xyz) {
+    try {
+      return cam->point_to_pixel(xyz);
+    } catch (...) {}
+    return Vector2(NaN, NaN);
+  }
+
+  // The ray through a pixel of the exact camera. False on failure.
+  bool exact_ray(camera::CameraModel const* cam, Vector2 const& pix,
+                 Vector3 & ctr, Vector3 & dir) {
+    try {
+      ctr = cam->camera_center(pix);
+      dir = cam->pixel_to_vector(pix);
+      return true;
+    } catch (...) {}
+    return false;
+  }
+
+  // Find the cell of a uniform grid with num nodes which has the value,
+  // and where in the cell it is, in [0, 1]. False if outside the grid.
+  bool locate(double val, double v0, double step, int num, int & k, double & w) {
+    double s = (val - v0) / step;
+    if (!(s >= 0.0 && s <= num - 1))
+      return false;
+    k = std::min(int(s), num - 2);
+    w = s - k;
+    return true;
+  }
+
+  // The difference between two rays, as an angle. The error in the
+  // camera center is seen from the ground.
+  double ray_error(Vector3 const& ctr1, Vector3 const& dir1,
+                   Vector3 const& ctr2, Vector3 const& dir2, Vector3 const& ground) {
+    return norm_2(dir1 - dir2) + norm_2(ctr1 - ctr2) / norm_2(ground - ctr1);
+  }
+
+  template <class T>
+  void write_val(std::ostream & os, T const& val) {
+    os.write((char const*)&val, sizeof(T));
+  }
+  template <class T>
+  void read_val(std::istream & is, T & val) {
+    is.read((char*)&val, sizeof(T));
+  }
+  template <class T, size_t N>
+  void write_val(std::ostream & os, Vector<T, N> const& vec) {
+    for (size_t i = 0; i < N; i++)
+      write_val(os, vec[i]);
+  }
+  template <class T, size_t N>
+  void read_val(std::istream & is, Vector<T, N> & vec) {
+    for (size_t i = 0; i < N; i++)
+      read_val(is, vec[i]);
+  }
+  void write_val(std::ostream & os, std::vector<double> const& vec) {
+    boost::uint64_t len = vec.size();
+    write_val(os, len);
+    if (len > 0)
+      os.write((char const*)&vec[0], len * sizeof(double));
+  }
+  void read_val(std::istream & is, std::vector<double> & vec) {
+    boost::uint64_t len = 0;
+    read_val(is, len);
+    if (!is || len > boost::uint64_t(6) * APPROX_CAMERA_MAX_NODES)
+      vw_throw(IOErr() << "Invalid approximate camera table.\n");
+    vec.resize(len);
+    if (len > 0)
+      is.read((char*)&vec[0], len * sizeof(double));
+  }
+
+}
+
+ApproxCameraModel::ApproxCameraModel(boost::shared_ptr<camera::CameraModel> exact_camera,
+                                     cartography::Datum const& datum,
+                                     BBox2 const& lonlat_box,
+                                     double min_height, double max_height,
+                                     BBox2i const& image_box, double pixel_tol):
+  m_exact_camera(exact_camera), m_datum(datum),
+  m_point_error(-1.0), m_ray_error(-1.0) {
+
+  if (!m_exact_camera)
+    vw_throw(ArgumentErr() << "ApproxCameraModel: No camera to approximate.\n");
+
+  build_point_table(lonlat_box, min_height, max_height, pixel_tol);
+
+  // The middle of the region, to see errors in the camera center from
+  Vector2 lonlat = lonlat_box.center();
+  Vector3 ground = m_datum.geodetic_to_cartesian
+    (Vector3(lonlat[0], lonlat[1], (min_height + max_height) / 2.0));
+  build_ray_table(image_box, ground, pixel_tol);
+
+  VW_OUT(DebugMessage, "asp") << "Approximate camera errors at cell centers: "
+                              << m_point_error << " pixels and "
+                              << m_ray_error << " radians.\n";
+}
+
+ApproxCameraModel::ApproxCameraModel(boost::shared_ptr<camera::CameraModel> exact_camera,
+                                     cartography::Datum const& datum,
+                                     BBox2i const& image_box, double pixel_tol):
+  m_exact_camera(exact_camera), m_datum(datum),
+  m_point_error(-1.0), m_ray_error(-1.0) {
+
+  if (!m_exact_camera)
+    vw_throw(ArgumentErr() << "ApproxCameraModel: No camera to approximate.\n");
+
+  Vector2 mid = (Vector2(image_box.min()) + Vector2(image_box.max())) / 2.0;
+  Vector3 ctr, dir;
+  if (!exact_ray(m_exact_camera.get(), mid, ctr, dir))
+    return;
+  Vector3 ground = cartography::datum_intersection(m_datum, ctr, dir);
+  if (ground == Vector3())
+    return; // the ray misses the planet, so there is nothing to measure from
+  build_ray_table(image_box, ground, pixel_tol);
+
+  VW_OUT(DebugMessage, "asp") << "Approximate camera error at cell centers: "
+                              << m_ray_error << " radians.\n";
+}
+
+ApproxCameraModel::ApproxCameraModel(boost::shared_ptr<camera::CameraModel> exact_camera,
+                                     std::string const& file):
+  m_exact_camera(exact_camera), m_point_error(-1.0), m_ray_error(-1.0) {
+
+  if (!m_exact_camera)
+    vw_throw(ArgumentErr() << "ApproxCameraModel: No camera to approximate.\n");
+
+  std::ifstream ifs(file.c_str(), std::ios::binary);
+  std::string magic, wkt;
+  int version = 0;
+  std::getline(ifs, magic);
+  ifs >> version;
+  ifs.ignore(); // the newline
+  std::getline(ifs, wkt);
+  if (!ifs || magic != APPROX_CAMERA_MAGIC || version != APPROX_CAMERA_VERSION)
+    vw_throw(IOErr() << "Not an approximate camera file of the current version: "
+             << file << "\n");
+
+  cartography::GeoReference georef;
+  georef.set_wkt(wkt);
+  m_datum = georef.datum();
+
+  read_val(ifs, m_llh0);
+  read_val(ifs, m_llh_step);
+  read_val(ifs, m_llh_num);
+  read_val(ifs, m_pixels);
+  read_val(ifs, m_point_error);
+  read_val(ifs, m_pix0);
+  read_val(ifs, m_pix_step);
+  read_val(ifs, m_pix_num);
+  read_val(ifs, m_rays);
+  read_val(ifs, m_ray_error);
+  if (!ifs)
+    vw_throw(IOErr() << "Failed reading: " << file << "\n");
+
+  // Check the table sizes, so interpolation cannot go out of bounds
+  bool bad_points = !m_pixels.empty() &&
+    (m_llh_num[0] < 2 || m_llh_num[1] < 2 || m_llh_num[2] < 2 ||
+     m_pixels.size() != 2 * size_t(m_llh_num[0]) * m_llh_num[1] * m_llh_num[2]);
+  bool bad_rays = !m_rays.empty() &&
+    (m_pix_num[0] < 2 || m_pix_num[1] < 2 ||
+     m_rays.size() != 6 * size_t(m_pix_num[0]) * m_pix_num[1]);
+  if (bad_points || bad_rays)
+    vw_throw(IOErr() << "Invalid approximate camera file: " << file << "\n");
+}
+
+void ApproxCameraModel::write(std::string const& file) const {
+  std::ofstream ofs(file.c_str(), std::ios::binary);
+  if (!ofs)
+    vw_throw(IOErr() << "Cannot write: " << file << "\n");
+
+  cartography::GeoReference georef;
+  georef.set_datum(m_datum);
+  ofs << APPROX_CAMERA_MAGIC << "\n" << APPROX_CAMERA_VERSION << "\n"
+      << georef.get_wkt() << "\n";
+
+  write_val(ofs, m_llh0);
+  write_val(ofs, m_llh_step);
+  write_val(ofs, m_llh_num);
+  write_val(ofs, m_pixels);
+  write_val(ofs, m_point_error);
+  write_val(ofs, m_pix0);
+  write_val(ofs, m_pix_step);
+  write_val(ofs, m_pix_num);
+  write_val(ofs, m_rays);
+  write_val(ofs, m_ray_error);
+  if (!ofs)
+    vw_throw(IOErr() << "Failed writing: " << file << "\n");
+}
+
+void ApproxCameraModel::build_point_table(BBox2 const& lonlat_box, double min_height,
+                                          double max_height, double pixel_tol) {
+  m_pixels.clear();
+  m_point_error = -1.0;
+  if (lonlat_box.empty() || lonlat_box.width() <= 0 || lonlat_box.height() <= 0 ||
+      !(max_height >= min_height))
+    return;
+  if (max_height == min_height)
+    max_height = min_height + 1.0; // a grid needs a positive step
+
+  camera::CameraModel const* cam = m_exact_camera.get();
+
+  // The pixel is close to linear in the height, so start with one cell
+  // in height
+  Vector3i cells(32, 32, 1);
+  while (true) {
+
+    Vector3i num = cells + Vector3i(1, 1, 1);
+    if (double(num[0]) * num[1] * num[2] > APPROX_CAMERA_MAX_NODES) {
+      // The camera could not be approximated well enough
+      m_pixels.clear();
+      m_point_error = -1.0;
+      return;
+    }
+
+    m_llh0     = Vector3(lonlat_box.min()[0], lonlat_box.min()[1], min_height);
+    m_llh_step = Vector3(lonlat_box.width()  / cells[0], lonlat_box.height() / cells[1],
+                         (max_height - min_height) / cells[2]);
+    m_llh_num  = num;
+
+    int num_nodes = num[0] * num[1] * num[2];
+    m_pixels.resize(2 * num_nodes);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int n = 0; n < num_nodes; n++) {
+      int i = n % num[0], j = (n / num[0]) % num[1], k = n / (num[0] * num[1]);
+      Vector3 llh = m_llh0 + elem_prod(Vector3(i, j, k), m_llh_step);
+      Vector2 pix = exact_pixel(cam, m_datum.geodetic_to_cartesian(llh));
+      m_pixels[2 * n + 0] = pix[0];
+      m_pixels[2 * n + 1] = pix[1];
+    }
+
+    // Compare with the camera in the middle of the lon-lat cells, at
+    // each height node, and in the middle of the height cells, at each
+    // lon-lat node.
+    int num_xy = cells[0] * cells[1] * num[2];
+    int num_z  = num[0] * num[1] * cells[2];
+    double xy_err = 0.0, z_err = 0.0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(max: xy_err, z_err)
+    for (int n = 0; n < num_xy + num_z; n++) {
+      Vector3 llh;
+      if (n < num_xy) {
+        int i = n % cells[0], j = (n / cells[0]) % cells[1], k = n / (cells[0] * cells[1]);
+        llh = m_llh0 + elem_prod(Vector3(i + 0.5, j + 0.5, k), m_llh_step);
+      } else {
+        int m = n - num_xy;
+        int i = m % num[0], j = (m / num[0]) % num[1], k = m / (num[0] * num[1]);
+        llh = m_llh0 + elem_prod(Vector3(i, j, k + 0.5), m_llh_step);
+      }
+      Vector2 interp;
+      if (!interp_pixel(llh, interp))
+        continue; // the exact camera will be used here
+      Vector2 exact = exact_pixel(cam, m_datum.geodetic_to_cartesian(llh));
+      if (std::isnan(exact[0]) || std::isnan(exact[1]))
+        continue;
+      double err = norm_2(exact - interp);
+      if (n < num_xy)
+        xy_err = std::max(xy_err, err);
+      else
+        z_err = std::max(z_err, err);
+    }
+
+    m_point_error = std::max(xy_err, z_err);
+    if (m_point_error <= pixel_tol)
+      return;
+
+    if (xy_err > pixel_tol) {
+      cells[0] *= 2;
+      cells[1] *= 2;
+    }
+    if (z_err > pixel_tol)
+      cells[2] *= 2;
+  }
+}
+
+void ApproxCameraModel::build_ray_table(BBox2i const& image_box, Vector3 const& ground,
+                                        double pixel_tol) {
+  m_rays.clear();
+  m_ray_error = -1.0;
+  if (image_box.empty() || image_box.width() < 2 || image_box.height() < 2)
+    return;
+
+  camera::CameraModel const* cam = m_exact_camera.get();
+
+  // The angle subtended by pixel_tol pixels, at the middle of the image
+  Vector2 mid = (Vector2(image_box.min()) + Vector2(image_box.max())) / 2.0;
+  Vector3 ctr1, dir1, ctr2, dir2;
+  if (!exact_ray(cam, mid, ctr1, dir1) || !exact_ray(cam, mid + Vector2(1, 0), ctr2, dir2))
+    return;
+  double angle_tol = pixel_tol * norm_2(dir1 - dir2);
+
+  Vector2i cells(32, 32);
+  while (true) {
+
+    Vector2i num = cells + Vector2i(1, 1);
+    if (double(num[0]) * num[1] > APPROX_CAMERA_MAX_NODES) {
+      m_rays.clear();
+      m_ray_error = -1.0;
+      return;
+    }
+
+    m_pix0     = Vector2(image_box.min());
+    m_pix_step = Vector2(double(image_box.width())  / cells[0],
+                         double(image_box.height()) / cells[1]);
+    m_pix_num  = num;
+
+    int num_nodes = num[0] * num[1];
+    m_rays.resize(6 * num_nodes);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int n = 0; n < num_nodes; n++) {
+      Vector2 pix = m_pix0 + elem_prod(Vector2(n % num[0], n / num[0]), m_pix_step);
+      Vector3 ctr(NaN, NaN, NaN), dir(NaN, NaN, NaN);
+      exact_ray(cam, pix, ctr, dir);
+      for (int c = 0; c < 3; c++) {
+        m_rays[6 * n + c]     = ctr[c];
+        m_rays[6 * n + 3 + c] = dir[c];
+      }
+    }
+
+    // Compare with the camera in the middle of the cells
+    int num_cells = cells[0] * cells[1];
+    double err = 0.0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(max: err)
+    for (int n = 0; n < num_cells; n++) {
+      Vector2 pix = m_pix0 + elem_prod(Vector2(n % cells[0] + 0.5, n / cells[0] + 0.5),
+                                       m_pix_step);
+      Vector3 ictr, idir, ectr, edir;
+      if (!interp_ray(pix, ictr, idir) || !exact_ray(cam, pix, ectr, edir))
+        continue;
+      err = std::max(err, ray_error(ectr, edir, ictr, idir, ground));
+    }
+
+    m_ray_error = err;
+    if (m_ray_error <= angle_tol)
+      return;
+
+    // Cells smaller than a pixel would not help
+    if (m_pix_step[0] < 1.0 || m_pix_step[1] < 1.0) {
+      m_rays.clear();
+      m_ray_error = -1.0;
+      return;
+    }
+    cells *= 2;
+  }
+}
+
+bool ApproxCameraModel::interp_pixel(Vector3 const& llh, Vector2 & pix) const {
+  if (m_pixels.empty())
+    return false;
+
+  // The longitude may be off by 360 degrees from the grid
+  int i = 0, j = 0, k = 0;
+  double wx = 0, wy = 0, wz = 0;
+  bool found = false;
+  for (int shift = -1; shift <= 1 && !found; shift++)
+    found = locate(llh[0] + 360.0 * shift, m_llh0[0], m_llh_step[0], m_llh_num[0], i, wx);
+  if (!found ||
+      !locate(llh[1], m_llh0[1], m_llh_step[1], m_llh_num[1], j, wy) ||
+      !locate(llh[2], m_llh0[2], m_llh_step[2], m_llh_num[2], k, wz))
+    return false;
+
+  double x = 0.0, y = 0.0;
+  for (int dk = 0; dk <= 1; dk++) {
+    for (int dj = 0; dj <= 1; dj++) {
+      for (int di = 0; di <= 1; di++) {
+        double w = (di ? wx : 1.0 - wx) * (dj ? wy : 1.0 - wy) * (dk ? wz : 1.0 - wz);
+        size_t n = (size_t(k + dk) * m_llh_num[1] + (j + dj)) * m_llh_num[0] + (i + di);
+        x += w * m_pixels[2 * n + 0];
+        y += w * m_pixels[2 * n + 1];
+      }
+    }
+  }
+
+  // A node which did not project makes the result NaN
+  if (std::isnan(x) || std::isnan(y))
+    return false;
+  pix = Vector2(x, y);
+  return true;
+}
+
+bool ApproxCameraModel::interp_ray(Vector2 const& pix, Vector3 & ctr, Vector3 & dir) const {
+  if (m_rays.empty())
+    return false;
+
+  int i = 0, j = 0;
+  double wx = 0, wy = 0;
+  if (!locate(pix[0], m_pix0[0], m_pix_step[0], m_pix_num[0], i, wx) ||
+      !locate(pix[1], m_pix0[1], m_pix_step[1], m_pix_num[1], j, wy))
+    return false;
+
+  double v[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  for (int dj = 0; dj <= 1; dj++) {
+    for (int di = 0; di <= 1; di++) {
+      double w = (di ? wx : 1.0 - wx) * (dj ? wy : 1.0 - wy);
+      size_t n = size_t(j + dj) * m_pix_num[0] + (i + di);
+      for (int c = 0; c < 6; c++)
+        v[c] += w * m_rays[6 * n + c];
+    }
+  }
+
+  if (std::isnan(v[0]) || std::isnan(v[3]))
+    return false;
+  ctr = Vector3(v[0], v[1], v[2]);
+  dir = normalize(Vector3(v[3], v[4], v[5]));
+  return true;
+}
+
+Vector2 ApproxCameraModel::point_to_pixel(Vector3 const& point) const {
+  Vector2 pix;
+  if (!m_pixels.empty() && interp_pixel(m_datum.cartesian_to_geodetic(point), pix))
+    return pix;
+  return m_exact_camera->point_to_pixel(point);
+}
+
+Vector3 ApproxCameraModel::pixel_to_vector(Vector2 const& pix) const {
+  Vector3 ctr, dir;
+  if (interp_ray(pix, ctr, dir))
+    return dir;
+  return m_exact_camera->pixel_to_vector(pix);
+}
+
+Vector3 ApproxCameraModel::camera_center(Vector2 const& pix) const {
+  Vector3 ctr, dir;
+  if (interp_ray(pix, ctr, dir))
+    return ctr;
+  return m_exact_camera->camera_center(pix);
+}
+
+Quaternion<double> ApproxCameraModel::camera_pose(Vector2 const& pix) const {
+  return m_exact_camera->camera_pose(pix);
+}
+
+} // end namespace asp
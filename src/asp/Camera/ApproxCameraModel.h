@@ -0,0 +1,127 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ApproxCameraModel.h
+///
+/// An approximation of any camera model, for loops which project many
+/// points or pixels, such as in sfs, mapproject, and camera_footprint.
+/// point_to_pixel() is tabulated on a grid of longitude, latitude, and
+/// height, and pixel_to_vector() and camera_center() on a grid of
+/// pixels, and both are interpolated with piecewise-linear tensor-product
+/// splines. The grids are refined until the interpolation error at the
+/// middle of each cell, where it is largest, is within a tolerance.
+/// Outside the tabulated region, or if the tolerance could not be met,
+/// the exact camera is used. All tables are made in the constructor, so
+/// the model can be used from many threads.
+///
+#ifndef __STEREO_CAMERA_APPROX_CAMERA_MODEL_H__
+#define __STEREO_CAMERA_APPROX_CAMERA_MODEL_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The grids are refined up to this many nodes. If the tolerance is
+  /// still not met, that table is not used.
+  const int APPROX_CAMERA_MAX_NODES = 1 << 22;
+
+  class ApproxCameraModel: public vw::camera::CameraModel {
+  public:
+
+    /// Approximate the camera for points with longitude and latitude in
+    /// lonlat_box and height above the datum in [min_height, max_height],
+    /// and for pixels in image_box. The error is at most pixel_tol
+    /// pixels for point_to_pixel(), and the angle subtended by that
+    /// many pixels for the rays of pixel_to_vector() and camera_center().
+    ApproxCameraModel(boost::shared_ptr<vw::camera::CameraModel> exact_camera,
+                      vw::cartography::Datum const& datum,
+                      vw::BBox2 const& lonlat_box, double min_height, double max_height,
+                      vw::BBox2i const& image_box, double pixel_tol = 0.01);
+
+    /// Approximate only pixel_to_vector() and camera_center(), for pixels
+    /// in image_box. The error in the camera center is measured as seen
+    /// from where the ray through the middle of the box meets the datum.
+    /// point_to_pixel() uses the exact camera.
+    ApproxCameraModel(boost::shared_ptr<vw::camera::CameraModel> exact_camera,
+                      vw::cartography::Datum const& datum,
+                      vw::BBox2i const& image_box, double pixel_tol = 0.01);
+
+    /// Read the tables saved with write(). They must have been made for
+    /// the given camera.
+    ApproxCameraModel(boost::shared_ptr<vw::camera::CameraModel> exact_camera,
+                      std::string const& file);
+
+    virtual ~ApproxCameraModel() {}
+    virtual std::string type() const { return "Approx"; }
+
+    virtual vw::Vector2 point_to_pixel (vw::Vector3 const& point) const;
+    virtual vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
+    virtual vw::Vector3 camera_center  (vw::Vector2 const& pix) const;
+    virtual vw::Quaternion<double> camera_pose(vw::Vector2 const& pix) const;
+
+    /// Save the tables, to be read with the constructor from a file
+    void write(std::string const& file) const;
+
+    boost::shared_ptr<vw::camera::CameraModel> exact_camera() const {
+      return m_exact_camera;
+    }
+
+    /// The largest error found when the tables were made, at the middle
+    /// of the cells, in pixels and radians. Negative if the table is not
+    /// used.
+    double point_to_pixel_error()  const { return m_point_error; }
+    double pixel_to_vector_error() const { return m_ray_error;   }
+
+  private:
+    boost::shared_ptr<vw::camera::CameraModel> m_exact_camera;
+    vw::cartography::Datum m_datum;
+
+    // Pixels at the nodes of a lon-lat-height grid, two values per node,
+    // NaN where the point does not project into the camera
+    vw::Vector3 m_llh0, m_llh_step;
+    vw::Vector3i m_llh_num;
+    std::vector<double> m_pixels;
+    double m_point_error;
+
+    // Camera centers and directions at the nodes of a pixel grid, six
+    // values per node
+    vw::Vector2 m_pix0, m_pix_step;
+    vw::Vector2i m_pix_num;
+    std::vector<double> m_rays;
+    double m_ray_error;
+
+    void build_point_table(vw::BBox2 const& lonlat_box, double min_height,
+                           double max_height, double pixel_tol);
+    void build_ray_table(vw::BBox2i const& image_box, vw::Vector3 const& ground,
+                         double pixel_tol);
+
+    /// Interpolate in the tables. Return false if outside them.
+    bool interp_pixel(vw::Vector3 const& llh, vw::Vector2 & pix) const;
+    bool interp_ray(vw::Vector2 const& pix, vw::Vector3 & ctr, vw::Vector3 & dir) const;
+  };
+
+} // end namespace asp
+
+#endif//__STEREO_CAMERA_APPROX_CAMERA_MODEL_H__
@@ -28,6 +28,7 @@
 #include <vw/InterestPoint/Matcher.h>
 #include <vw/FileIO/KML.h>
 #include <asp/Camera/CameraResectioning.h>
+#include <asp/Core/MatchFile.h>
 
 #include <string>
 
@@ -1076,7 +1077,7 @@ void asp::matchFilesProcessing(vw::ba::ControlNetwork       const& cnet,
     // the subset of the IP from the control network which
     // are part of these original ones. 
     std::vector<ip::InterestPoint> orig_left_ip, orig_right_ip;
-    ip::read_binary_match_file(match_file, orig_left_ip, orig_right_ip);
+    asp::read_match_file(match_file, orig_left_ip, orig_right_ip);
 
     // Create a new convergence angle storage struct
     convAngles.push_back(asp::MatchPairStats()); // add an element, will populate it soon
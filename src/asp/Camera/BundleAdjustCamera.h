@@ -54,10 +54,10 @@ namespace asp {
 // Options shared by bundle_adjust and jitter_solve
 struct BaBaseOptions: public vw::GdalWriteOptions {
   std::string out_prefix, stereo_session, input_prefix, match_files_prefix,
-    clean_match_files_prefix, ref_dem, heights_from_dem, mapproj_dem;
+    clean_match_files_prefix, ref_dem, heights_from_dem, mapproj_dem, solver_backend;
   int overlap_limit, min_matches, max_pairwise_matches, num_iterations,
     ip_edge_buffer_percent;
-  bool match_first_to_last, single_threaded_cameras;
+  bool match_first_to_last, single_threaded_cameras, solver_mixed_precision;
   double min_triangulation_angle, max_init_reproj_error, robust_threshold, parameter_tolerance;
   double ref_dem_weight, ref_dem_robust_threshold, heights_from_dem_weight,
     heights_from_dem_robust_threshold, camera_weight, rotation_weight, translation_weight,
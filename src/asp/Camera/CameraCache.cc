@@ -0,0 +1,232 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/CameraCache.h>
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Increment this when the data saved by any cache_io() changes
+  const int CAMERA_CACHE_VERSION = 1;
+
+  bool camera_cache_enabled() {
+    char * ptr = getenv("ASP_CAMERA_CACHE");
+    return ptr == NULL || std::string(ptr) != "0";
+  }
+
+  // FNV-1a hash of the file contents
+  boost::uint64_t file_hash(std::string const& file) {
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs)
+      vw::vw_throw(vw::IOErr() << "Cannot read: " << file << "\n");
+    boost::uint64_t hash = 14695981039346656037ULL;
+    std::vector<char> buf(1 << 20);
+    while (ifs) {
+      ifs.read(&buf[0], buf.size());
+      std::streamsize len = ifs.gcount();
+      for (std::streamsize i = 0; i < len; i++) {
+        hash ^= (unsigned char)buf[i];
+        hash *= 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
+
+  // What identifies the camera file and the format of the cache. The
+  // byte order is recorded too, as the numbers are saved as they are
+  // in memory.
+  std::string cache_header(std::string const& camera_file, std::string const& kind) {
+    boost::uint32_t byte_order = 0x01020304;
+    std::ostringstream os;
+    os << "ASP camera cache " << CAMERA_CACHE_VERSION << "\n"
+       << kind << "\n"
+       << std::string((char const*)&byte_order, sizeof(byte_order)) << "\n"
+       << fs::file_size(camera_file) << " "
+       << fs::last_write_time(camera_file) << " "
+       << file_hash(camera_file) << "\n";
+    return os.str();
+  }
+
+}
+
+std::string camera_cache_file(std::string const& camera_file, std::string const& kind) {
+  return camera_file + "." + kind + ".asp_cache";
+}
+
+CameraCache::CameraCache(std::string const& camera_file, std::string const& kind):
+  m_is_open(false), m_writing(false), m_pos(0) {
+
+  m_cache_file = camera_cache_file(camera_file, kind);
+  if (!camera_cache_enabled() || !fs::exists(m_cache_file) || !fs::exists(camera_file))
+    return;
+
+  std::ifstream ifs(m_cache_file.c_str(), std::ios::binary);
+  std::ostringstream os;
+  os << ifs.rdbuf();
+  m_data = os.str();
+
+  m_header = cache_header(camera_file, kind);
+  if (m_data.size() < m_header.size() ||
+      m_data.compare(0, m_header.size(), m_header) != 0) {
+    m_data.clear();
+    return; // stale, or from a different version
+  }
+
+  m_pos = m_header.size();
+  m_is_open = true;
+  VW_OUT(vw::DebugMessage, "asp") << "Reading camera cache: " << m_cache_file << "\n";
+}
+
+CameraCache::CameraCache(std::string const& camera_file, std::string const& kind,
+                         bool for_writing):
+  m_is_open(false), m_writing(true), m_pos(0) {
+
+  m_cache_file = camera_cache_file(camera_file, kind);
+  if (!for_writing || !camera_cache_enabled() || !fs::exists(camera_file))
+    return;
+
+  m_header  = cache_header(camera_file, kind);
+  m_data    = m_header;
+  m_is_open = true;
+}
+
+void CameraCache::save() {
+  if (!m_is_open || !m_writing)
+    return;
+
+  // Write to a temporary file and rename it, so that processes
+  // reading the cache at the same time never see part of it.
+  try {
+    fs::path tmp_file = fs::path(m_cache_file).parent_path() /
+      fs::unique_path(fs::path(m_cache_file).filename().string() + "-%%%%%%%%");
+    {
+      std::ofstream ofs(tmp_file.string().c_str(), std::ios::binary);
+      ofs.write(m_data.data(), m_data.size());
+      if (!ofs)
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file.string() << "\n");
+    }
+    fs::rename(tmp_file, m_cache_file);
+    VW_OUT(vw::DebugMessage, "asp") << "Wrote camera cache: " << m_cache_file << "\n";
+  } catch (std::exception const& e) {
+    // Likely a read-only directory. The XML file will be parsed each time.
+    VW_OUT(vw::DebugMessage, "asp") << "Could not write camera cache: "
+                                    << m_cache_file << ". " << e.what() << "\n";
+  }
+}
+
+void CameraCache::finish() const {
+  if (!m_writing && m_pos != m_data.size())
+    vw::vw_throw(vw::IOErr() << "Invalid camera cache: " << m_cache_file << "\n");
+}
+
+void CameraCache::raw_io(void * ptr, size_t len) {
+  if (m_writing) {
+    m_data.append((char const*)ptr, len);
+    return;
+  }
+  if (m_pos + len > m_data.size())
+    vw::vw_throw(vw::IOErr() << "Invalid camera cache: " << m_cache_file << "\n");
+  memcpy(ptr, m_data.data() + m_pos, len);
+  m_pos += len;
+}
+
+void CameraCache::check_len(int len) const {
+  if (len < 0 || (!m_writing && size_t(len) > m_data.size()))
+    vw::vw_throw(vw::IOErr() << "Invalid camera cache: " << m_cache_file << "\n");
+}
+
+void CameraCache::io(double & val) {
+  raw_io(&val, sizeof(val));
+}
+
+void CameraCache::io(int & val) {
+  boost::int32_t v = val;
+  raw_io(&v, sizeof(v));
+  val = v;
+}
+
+void CameraCache::io(bool & val) {
+  int v = val;
+  io(v);
+  val = (v != 0);
+}
+
+void CameraCache::io(std::string & val) {
+  int len = val.size();
+  io(len);
+  check_len(len);
+  if (!m_writing)
+    val.resize(len);
+  if (len > 0)
+    raw_io(&val[0], len);
+}
+
+void CameraCache::io(vw::Vector<double> & vec) {
+  int len = vec.size();
+  io(len);
+  check_len(len);
+  if (!m_writing)
+    vec.set_size(len);
+  for (int i = 0; i < len; i++)
+    io(vec[i]);
+}
+
+// The datum is saved in WKT, as cam2rpc does
+void CameraCache::io(vw::cartography::Datum & datum) {
+  vw::cartography::GeoReference georef;
+  std::string wkt;
+  if (m_writing) {
+    georef.set_datum(datum);
+    wkt = georef.get_wkt();
+  }
+  io(wkt);
+  if (!m_writing) {
+    georef.set_wkt(wkt);
+    datum = georef.datum();
+  }
+}
+
+// A time is saved as the number of ticks since an epoch, so it is exact
+void CameraCache::io(boost::posix_time::ptime & val) {
+  boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+  bool is_set = !val.is_special();
+  io(is_set);
+  boost::int64_t ticks = 0;
+  if (m_writing && is_set)
+    ticks = (val - epoch).ticks();
+  raw_io(&ticks, sizeof(ticks));
+  if (!m_writing)
+    val = is_set ? epoch + boost::posix_time::time_duration(0, 0, 0, ticks) :
+      boost::posix_time::ptime();
+}
+
+} // end namespace asp
@@ -0,0 +1,177 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraCache.h
+///
+/// A binary cache of the data parsed from a vendor XML camera file.
+/// Parsing a large XML file with Xerces can take seconds, and it is
+/// done by every process that loads the camera. The first such process
+/// saves what it parsed next to the XML file, as <file>.<kind>.asp_cache,
+/// and the others read that instead. The kind, such as dg or rpc, tells
+/// apart the data different readers take from the same file. A cache is used only if it was
+/// made from a file with the same size, modification time, and
+/// content hash. Set the environment variable ASP_CAMERA_CACHE to 0 to
+/// neither read nor write caches.
+///
+#ifndef __STEREO_CAMERA_CAMERA_CACHE_H__
+#define __STEREO_CAMERA_CAMERA_CACHE_H__
+
+#include <vw/Cartography/Datum.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Quaternion.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/cstdint.hpp>
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  /// A cache file being read or written. The same function, named
+  /// cache_io() in the XML classes, is used for both directions, by
+  /// calling io() on each member in turn.
+  class CameraCache {
+  public:
+
+    /// Open the cache for reading. Check is_open() before use.
+    CameraCache(std::string const& camera_file, std::string const& kind);
+
+    /// Start an empty cache for writing, to be saved with save().
+    CameraCache(std::string const& camera_file, std::string const& kind, bool for_writing);
+
+    bool is_open() const { return m_is_open; }
+    bool is_writing() const { return m_writing; }
+
+    /// Write the cache file. Failure to write is not an error.
+    void save();
+
+    /// When reading, check that all data was read
+    void finish() const;
+
+    void io(double & val);
+    void io(int & val);
+    void io(bool & val);
+    void io(std::string & val);
+    void io(vw::cartography::Datum & datum);
+    void io(boost::posix_time::ptime & val);
+
+    template <class T, size_t N>
+    void io(vw::Vector<T, N> & vec) {
+      for (size_t i = 0; i < N; i++)
+        io(vec[i]);
+    }
+
+    void io(vw::Vector<double> & vec);
+
+    template <class T>
+    void io(vw::math::Quaternion<T> & q) {
+      T w = q.w(), x = q.x(), y = q.y(), z = q.z();
+      io(w); io(x); io(y); io(z);
+      if (!m_writing)
+        q = vw::math::Quaternion<T>(w, x, y, z);
+    }
+
+    template <class T, size_t N>
+    void io(vw::BBox<T, N> & box) {
+      io(box.min());
+      io(box.max());
+    }
+
+    template <class A, class B>
+    void io(std::pair<A, B> & p) {
+      io(p.first);
+      io(p.second);
+    }
+
+    template <class T>
+    void io(std::vector<T> & vec) {
+      int len = vec.size();
+      io(len);
+      check_len(len);
+      if (!m_writing)
+        vec.resize(len);
+      for (int i = 0; i < len; i++)
+        io(vec[i]);
+    }
+
+    template <class T>
+    void io(std::list<T> & lst) {
+      int len = lst.size();
+      io(len);
+      check_len(len);
+      if (!m_writing)
+        lst.resize(len);
+      for (typename std::list<T>::iterator it = lst.begin(); it != lst.end(); it++)
+        io(*it);
+    }
+
+  private:
+    std::string m_cache_file;
+    std::string m_header; // identifies the camera file and its version
+    bool m_is_open, m_writing;
+    std::string m_data;
+    size_t m_pos;
+
+    void raw_io(void * ptr, size_t len);
+
+    /// Throw if a length read from the cache cannot be right
+    void check_len(int len) const;
+  };
+
+  /// The cache file for the data of the given kind read from a camera file
+  std::string camera_cache_file(std::string const& camera_file, std::string const& kind);
+
+  /// If caching is enabled, and a valid cache exists for this file and
+  /// kind of data, read it into data, which must have a cache_io()
+  /// method and be copyable, and return true.
+  template <class T>
+  bool read_camera_cache(std::string const& camera_file, std::string const& kind, T & data) {
+    try {
+      CameraCache cache(camera_file, kind);
+      if (!cache.is_open())
+        return false;
+      // Read into a copy, so the data is untouched if the cache is bad
+      T tmp(data);
+      tmp.cache_io(cache);
+      cache.finish();
+      data = tmp;
+      return true;
+    } catch (...) {}
+    return false;
+  }
+
+  /// If caching is enabled, save the data for the given file. Errors
+  /// are ignored, as the data can always be parsed again.
+  template <class T>
+  void write_camera_cache(std::string const& camera_file, std::string const& kind, T & data) {
+    try {
+      CameraCache cache(camera_file, kind, true);
+      if (!cache.is_open())
+        return;
+      data.cache_io(cache);
+      cache.save();
+    } catch (...) {}
+  }
+
+} // end namespace asp
+
+#endif//__STEREO_CAMERA_CAMERA_CACHE_H__
@@ -18,14 +18,18 @@
 #include <vw/FileIO/FileUtils.h>
 
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/Telemetry.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Camera/CsmModel.h>
 
+#include <boost/cstdint.hpp>
 #include <boost/dll.hpp>
 #include <boost/dll/runtime_symbol_info.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/version.hpp>
 #include <boost/config.hpp>
+#include <boost/weak_ptr.hpp>
 
 // From the CSM base interface library
 #include <csm/csm.h>
@@ -44,6 +48,10 @@
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 
+#include <ctime>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <streambuf>
 
 namespace dll = boost::dll;
@@ -97,6 +105,27 @@ void fromCsmPixel(vw::Vector2 & pix, csm::ImageCoord const& csm) {
   pix[1] = csm.line - ASP_TO_CSM_SHIFT[1];
 }
 
+void points_to_pixels(vw::camera::CameraModel const* cam,
+                      std::vector<vw::Vector3> const& points,
+                      std::vector<vw::Vector2> & pixels) {
+
+  CsmModel const* csm_model = dynamic_cast<CsmModel const*>(cam);
+  if (csm_model != NULL) {
+    csm_model->points_to_pixels(points, pixels);
+    return;
+  }
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  pixels.resize(points.size());
+  for (size_t it = 0; it < points.size(); it++) {
+    try {
+      pixels[it] = cam->point_to_pixel(points[it]);
+    } catch (...) {
+      pixels[it] = vw::Vector2(nan, nan);
+    }
+  }
+}
+
 
 Vector3 ecefCoordToVector(csm::EcefCoord c) {
   Vector3 v;
@@ -128,9 +157,12 @@ CsmModel::CsmModel():m_semi_major_axis(0.0),
                      m_sun_position(vw::Vector3()),
                      // Do not make the precision lower than 1e-8. CSM can give
                      // junk results when it is too low.
-                     m_desired_precision(asp::DEFAULT_CSM_DESIRED_PRECISISON){}
+                     m_desired_precision(asp::DEFAULT_CSM_DESIRED_PRECISISON),
+                     m_model_is_shared(false){}
                                       
-CsmModel::CsmModel(std::string const& isd_path) {
+CsmModel::CsmModel(std::string const& isd_path):
+  m_desired_precision(asp::DEFAULT_CSM_DESIRED_PRECISISON),
+  m_model_is_shared(false) {
   load_model(isd_path);
 }
 
@@ -362,9 +394,101 @@ void CsmModel::read_ellipsoid_from_isd(std::string const& isd_path) {
                  << m_semi_major_axis << ' ' << m_semi_minor_axis);
 }
 
+namespace {
+
+  // Read the sun position from a model state. Will work for USGSCSM
+  // models, but maybe not for others. It is assumed here that the sun
+  // does not move noticeably in the sky during the brief time the
+  // picture is taken.
+  // TODO(oalexan1): Study how important is to compute sun position
+  // at every single time. Likely given that a camera shot takes a
+  // 1-3 seconds, the Sun can't move that much. 
+  void read_sun_position(json const& j, vw::Vector3 & sun_position) {
+    if (j.find("m_sunPosition") != j.end()) {
+      std::vector<double> sun_pos = j["m_sunPosition"].get<std::vector<double>>();
+      if (sun_pos.size() < 3)
+        vw::vw_throw(vw::ArgumentErr() << "The Sun position must be a vector of size >= 3.\n");
+      for (size_t it = 0; it < 3; it++) 
+        sun_position[it] = sun_pos[it];
+    }
+  }
+
+  // The model state made from an ISD file, to be cached
+  struct CsmIsdState {
+    std::string model_state;
+    void cache_io(CameraCache & cache) {
+      cache.io(model_state);
+    }
+  };
+
+  // The sensor models loaded from files in this process, so that
+  // sessions loading the same camera share it. A model is kept only
+  // while some CsmModel uses it.
+  struct CsmRegistryEntry {
+    boost::uintmax_t file_size;
+    std::time_t      mod_time;
+    boost::weak_ptr<csm::RasterGM> model;
+    double semi_major_axis, semi_minor_axis;
+    vw::Vector3 sun_position;
+  };
+  std::map<std::string, CsmRegistryEntry> g_csm_registry;
+  std::mutex g_csm_registry_mutex;
+
+  std::string csm_registry_key(std::string const& path) {
+    return fs::absolute(path).string();
+  }
+}
+
+bool CsmModel::load_shared_model(std::string const& isd_path) {
+  std::lock_guard<std::mutex> lock(g_csm_registry_mutex);
+  auto it = g_csm_registry.find(csm_registry_key(isd_path));
+  if (it == g_csm_registry.end())
+    return false;
+
+  CsmRegistryEntry const& entry = it->second;
+  boost::shared_ptr<csm::RasterGM> model = entry.model.lock();
+  if (!model || fs::file_size(isd_path) != entry.file_size ||
+      fs::last_write_time(isd_path) != entry.mod_time) {
+    g_csm_registry.erase(it);
+    return false;
+  }
+
+  m_gm_model        = model;
+  m_semi_major_axis = entry.semi_major_axis;
+  m_semi_minor_axis = entry.semi_minor_axis;
+  m_sun_position    = entry.sun_position;
+  m_model_is_shared = true;
+  return true;
+}
+
+void CsmModel::share_model(std::string const& isd_path) {
+  CsmRegistryEntry entry;
+  entry.file_size       = fs::file_size(isd_path);
+  entry.mod_time        = fs::last_write_time(isd_path);
+  entry.model           = m_gm_model;
+  entry.semi_major_axis = m_semi_major_axis;
+  entry.semi_minor_axis = m_semi_minor_axis;
+  entry.sun_position    = m_sun_position;
+
+  std::lock_guard<std::mutex> lock(g_csm_registry_mutex);
+  g_csm_registry[csm_registry_key(isd_path)] = entry;
+  m_model_is_shared = true;
+}
+
+void CsmModel::make_model_unique() {
+  if (!m_model_is_shared)
+    return;
+  throw_if_not_init();
+  bool recreate_model = true;
+  setModelFromStateString(m_gm_model->getModelState(), recreate_model);
+}
+
 /// Load the camera model from an ISD file or model state.
 void CsmModel::load_model(std::string const& isd_path) {
 
+  if (load_shared_model(isd_path))
+    return;
+
   std::string line;
   {
     // Peek inside the file to see if it is an isd or a model state.
@@ -377,27 +501,25 @@ void CsmModel::load_model(std::string const& isd_path) {
                          line == UsgsAstroPushFrameSensorModel::_SENSOR_MODEL_NAME ||
                          line == UsgsAstroSarSensorModel::_SENSOR_MODEL_NAME);
 
-  if (!is_model_state) 
-    CsmModel::load_model_from_isd(isd_path);
-  else
+  // This reads the sun position as well
+  bool recreate_model = true;
+  if (is_model_state) {
     CsmModel::loadModelFromStateFile(isd_path);
-
-  // Read the sun position. Will work for USGSCSM models, but maybe
-  // not for others. It is assumed here that the sun does not move
-  // noticeably in the sky during the brief time the picture is taken.
-  // TODO(oalexan1): Study how important is to compute sun position
-  // at every single time. Likely given that a camera shot takes a
-  // 1-3 seconds, the Sun can't move that much. 
-  std::string modelState = m_gm_model->getModelState();
-  nlohmann::json j = stateAsJson(modelState);
-  if (j.find("m_sunPosition") != j.end()) {
-    std::vector<double> sun_pos = j["m_sunPosition"].get<std::vector<double>>();
-    if (sun_pos.size() < 3)
-      vw::vw_throw(vw::ArgumentErr() << "The Sun position must be a vector of size >= 3.\n");
-    for (size_t it = 0; it < 3; it++) 
-      m_sun_position[it] = sun_pos[it];
+  } else {
+    // Making a model from an ISD is slow, so the resulting model state
+    // is cached.
+    CsmIsdState isd_state;
+    if (read_camera_cache(isd_path, "csm", isd_state)) {
+      setModelFromStateString(isd_state.model_state, recreate_model);
+    } else {
+      CsmModel::load_model_from_isd(isd_path);
+      isd_state.model_state = m_gm_model->getModelState();
+      read_sun_position(stateAsJson(isd_state.model_state), m_sun_position);
+      write_camera_cache(isd_path, "csm", isd_state);
+    }
   }
-  
+
+  share_model(isd_path);
 }
   
 void CsmModel::load_model_from_isd(std::string const& isd_path) {
@@ -510,6 +632,11 @@ void setModelFromStateStringAux(bool recreate_model,
 /// and combining its data in a form ready to be used.
 /// Use recreate_model = false if desired to just update an existing model.
 void CsmModel::setModelFromStateString(std::string const& model_state, bool recreate_model) {
+
+  // Do not change a model other objects use
+  if (m_model_is_shared)
+    recreate_model = true;
+  m_model_is_shared = false;
   
   // TODO(oalexan1): Use the usgscsm function
   // constructModelFromState() after that package pushes a new version
@@ -547,6 +674,7 @@ void CsmModel::setModelFromStateString(std::string const& model_state, bool recr
   auto j = stateAsJson(model_state);
   m_semi_major_axis = j["m_majorAxis"];
   m_semi_minor_axis = j["m_minorAxis"];
+  read_sun_position(j, m_sun_position);
 
   // Sanity check
   if (m_semi_major_axis <= 0.0 || m_semi_minor_axis <= 0.0) 
@@ -577,6 +705,9 @@ vw::Vector3 CsmModel::target_radii() const {
 Vector2 CsmModel::point_to_pixel(Vector3 const& point) const {
   throw_if_not_init();
 
+  static TelemetryCounter & num_calls = telemetry().counter("csm.point_to_pixel");
+  num_calls.add();
+
   csm::EcefCoord  ecef = vectorToEcefCoord(point);
 
   double achievedPrecision = -1.0;
@@ -601,9 +732,132 @@ Vector2 CsmModel::point_to_pixel(Vector3 const& point) const {
   return imageCoordToVector(imagePt) - ASP_TO_CSM_SHIFT;
 }
 
+// The difference between the ray at a pixel and the direction from
+// the camera center at that pixel to a point. This is zero at the pixel
+// the point projects into.
+Vector3 projectionResidual(csm::RasterGM const* model, double desired_precision,
+                           Vector2 const& pix, Vector3 const& point) {
+
+  csm::ImageCoord imagePt = vectorToImageCoord(pix + ASP_TO_CSM_SHIFT);
+  Vector3 ctr = ecefCoordToVector(model->getSensorPosition(imagePt));
+  double achievedPrecision = -1.0;
+  double groundHeight      = 0.0;
+  Vector3 groundPt
+    = ecefCoordToVector(model->imageToGround(imagePt, groundHeight, desired_precision,
+                                             &achievedPrecision));
+  return normalize(groundPt - ctr) - normalize(point - ctr);
+}
+
+// The derivatives of projectionResidual() along samples and lines, with
+// a step of one pixel.
+void projectionJacobian(csm::RasterGM const* model, double desired_precision,
+                        Vector2 const& pix, Vector3 const& point,
+                        Vector3 & d_samp, Vector3 & d_line) {
+  Vector3 res = projectionResidual(model, desired_precision, pix, point);
+  d_samp = projectionResidual(model, desired_precision, pix + Vector2(1, 0), point) - res;
+  d_line = projectionResidual(model, desired_precision, pix + Vector2(0, 1), point) - res;
+}
+
+// Find the pixel a linescan camera sees a point at, starting from a
+// nearby pixel. This is a line search in both the samples and lines,
+// with a Jacobian found at an earlier point, which is accurate enough
+// when the points are close. Return false if this does not converge.
+bool refineLinescanPixel(csm::RasterGM const* model, double desired_precision,
+                         Vector3 const& point, Vector3 const& d_samp,
+                         Vector3 const& d_line, Vector2 & pix) {
+
+  // Solve the normal equations for the step
+  double a = dot_prod(d_samp, d_samp), b = dot_prod(d_samp, d_line);
+  double c = dot_prod(d_line, d_line);
+  double det = a * c - b * b;
+  if (!(det > 0))
+    return false;
+
+  // CSM returns the ray with a precision not much better than this
+  double tol = std::max(desired_precision, 1e-6);
+  int max_iter = 10;
+  for (int iter = 0; iter < max_iter; iter++) {
+    Vector3 res = projectionResidual(model, desired_precision, pix, point);
+    double g1 = dot_prod(d_samp, res), g2 = dot_prod(d_line, res);
+    Vector2 step(-(c * g1 - b * g2) / det, -(a * g2 - b * g1) / det);
+    pix += step;
+    if (!(norm_2(step) < 1e6)) // NaN or diverging
+      return false;
+    if (norm_2(step) < tol) {
+      // The rays must meet, rather than be the closest they can be
+      Vector3 left = res + step[0] * d_samp + step[1] * d_line;
+      return norm_2(left) <= 1e-3 * sqrt(std::min(a, c));
+    }
+  }
+
+  return false;
+}
+
+void CsmModel::points_to_pixels(std::vector<Vector3> const& points,
+                                std::vector<Vector2> & pixels) const {
+  throw_if_not_init();
+
+  csm::RasterGM const* model = m_gm_model.get();
+  bool is_linescan = (dynamic_cast<UsgsAstroLsSensorModel const*>(model) != NULL);
+  double nan = std::numeric_limits<double>::quiet_NaN();
+
+  pixels.resize(points.size());
+
+  // For linescan, the pixel of the previous point, and the Jacobian
+  // found when last projecting a point from scratch
+  bool have_guess = false;
+  Vector2 guess;
+  Vector3 d_samp, d_line;
+
+  for (size_t it = 0; it < points.size(); it++) {
+
+    if (have_guess) {
+      Vector2 pix = guess;
+      bool success = false;
+      try {
+        success = refineLinescanPixel(model, m_desired_precision, points[it],
+                                      d_samp, d_line, pix);
+      } catch (...) {}
+      if (success) {
+        pixels[it] = pix;
+        guess = pix;
+        continue;
+      }
+    }
+
+    // Do a full projection
+    try {
+      double achievedPrecision = -1.0;
+      csm::ImageCoord imagePt
+        = model->groundToImage(vectorToEcefCoord(points[it]), m_desired_precision,
+                               &achievedPrecision, NULL);
+      fromCsmPixel(pixels[it], imagePt);
+    } catch (...) {
+      pixels[it] = Vector2(nan, nan);
+      have_guess = false;
+      continue;
+    }
+
+    if (is_linescan) {
+      // Start the next point from here
+      guess = pixels[it];
+      try {
+        projectionJacobian(model, m_desired_precision, guess, points[it],
+                           d_samp, d_line);
+        have_guess = true;
+      } catch (...) {
+        have_guess = false;
+      }
+    }
+  }
+}
+
 Vector3 CsmModel::pixel_to_vector(Vector2 const& pix) const {
   throw_if_not_init();
 
+  static TelemetryCounter & num_calls = telemetry().counter("csm.pixel_to_vector");
+  num_calls.add();
+
   csm::ImageCoord imagePt = vectorToImageCoord(pix + ASP_TO_CSM_SHIFT);
 
   // Camera center
@@ -27,6 +27,8 @@
 #include <vw/Camera/CameraModel.h>
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
 namespace csm {
   // Forward declarations
   class RasterGM; 
@@ -51,14 +53,30 @@ namespace asp {
     virtual ~CsmModel();
     virtual std::string type() const { return "CSM"; }
 
-    /// Load the camera model from an ISD file or model state.
+    /// Load the camera model from an ISD file or model state. If the
+    /// same file, unchanged, is already loaded in this process, its
+    /// sensor model is shared rather than made again. The model state
+    /// made from an ISD file is cached next to it, see CameraCache.h.
     void load_model(std::string const& isd_path);
 
+    /// If the sensor model is shared with other CsmModel objects which
+    /// loaded the same file, replace it with a copy of its own. Call
+    /// this before modifying m_gm_model directly. The functions of this
+    /// class which change the model do that themselves.
+    void make_model_unique();
+
     /// Return the size of the associated image.
     vw::Vector2 get_image_size() const;
 
     virtual vw::Vector2 point_to_pixel (vw::Vector3 const& point) const;
 
+    /// Project many points at once. For linescan cameras, each point is
+    /// found starting from the pixel of the previous one, so this is
+    /// fastest when consecutive points are close, such as along a row
+    /// of a DEM. A point which cannot be projected gets a NaN pixel.
+    void points_to_pixels(std::vector<vw::Vector3> const& points,
+                          std::vector<vw::Vector2> & pixels) const;
+
     virtual vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
 
     virtual vw::Vector3 camera_center(vw::Vector2 const& pix) const;
@@ -146,12 +164,29 @@ namespace asp {
 
     vw::Vector3 m_sun_position;
 
+    // If m_gm_model is shared with other objects which loaded the same file
+    bool m_model_is_shared;
+
+    /// Use the sensor model of an object which loaded this file before,
+    /// if there is one. Return true on success.
+    bool load_shared_model(std::string const& isd_path);
+
+    /// Make this model available to objects loading the same file later
+    void share_model(std::string const& isd_path);
+
   }; // End class CsmModel
 
   // Auxiliary non-member functions to convert a pixel from ASP
   // conventions to what CSM expects and vice versa
   void toCsmPixel(vw::Vector2 const& pix, csm::ImageCoord & csm);
   void fromCsmPixel(vw::Vector2 & pix, csm::ImageCoord const& csm);
+
+  /// Project many points into a camera, with CsmModel::points_to_pixels()
+  /// for CSM cameras, and one point at a time otherwise. A point which
+  /// cannot be projected gets a NaN pixel.
+  void points_to_pixels(vw::camera::CameraModel const* cam,
+                        std::vector<vw::Vector3> const& points,
+                        std::vector<vw::Vector2> & pixels);
   
 }      // namespace asp
 
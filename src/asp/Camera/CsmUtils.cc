@@ -25,6 +25,8 @@
 
 #include <usgscsm/Utilities.h>
 
+#include <algorithm>
+
 namespace asp {
 
 // Normalize quaternions in UsgsAstroLsSensorModel.
@@ -73,15 +75,99 @@ void normalizeQuaternions(UsgsAstroFrameSensorModel * frame_model) {
 // TODO(oalexan1): Call this from LinescanDGModel.cc.
 void interpQuaternions(UsgsAstroLsSensorModel * ls_model, double time,
                       double q[4]) {
-  int nOrder = 8;
-  if (ls_model->m_platformFlag == 0)
-    nOrder = 4;
-  int nOrderQuat = nOrder;
-  if (ls_model->m_numQuaternions/4 < 6 && nOrder == 8)
-    nOrderQuat = 4;
-  
   lagrangeInterp(ls_model->m_numQuaternions / 4, &ls_model->m_quaternions[0],
-                 ls_model->m_t0Quat, ls_model->m_dtQuat, time, 4, nOrderQuat, q);
+                 ls_model->m_t0Quat, ls_model->m_dtQuat, time, 4,
+                 quatInterpOrder(ls_model), q);
+}
+
+// See the .h file for the documentation.
+int quatInterpOrder(UsgsAstroLsSensorModel const* ls_model) {
+  int nOrder = posInterpOrder(ls_model);
+  if (ls_model->m_numQuaternions/4 < 6 && nOrder == 8)
+    nOrder = 4;
+  return nOrder;
+}
+
+// See the .h file for the documentation.
+int posInterpOrder(UsgsAstroLsSensorModel const* ls_model) {
+  if (ls_model->m_platformFlag == 0)
+    return 4;
+  return 8;
+}
+
+// See the .h file for the documentation. The choice of samples and of
+// the order near the ends of the sequence follows lagrangeInterp().
+// The weights are those of the Lagrange polynomial through the samples,
+// which is unique, so they agree with the ones there.
+void lagrangeStencil(int numTimes, double t0, double dt, double time, int order,
+                     LagrangeStencil & stencil) {
+
+  if (numTimes < 2)
+    vw::vw_throw(vw::ArgumentErr()
+                 << "At least 2 points are required to perform Lagrange interpolation.\n");
+
+  double fndex = (time - t0) / dt;
+  int nindex = fndex;
+  if (nindex < 0)
+    nindex = 0;
+  else if (nindex > numTimes - 2)
+    nindex = numTimes - 2;
+
+  int max_order = 8;
+  if (nindex == 2 || nindex == numTimes - 4)
+    max_order = 6;
+  else if (nindex == 1 || nindex == numTimes - 3)
+    max_order = 4;
+  else if (nindex == 0 || nindex == numTimes - 2)
+    max_order = 2;
+  stencil.order = std::min(order, max_order);
+  stencil.beg   = nindex - stencil.order / 2 + 1;
+
+  // The time in units of dt, relative to the first sample used
+  double s = fndex - stencil.beg;
+  for (int i = 0; i < stencil.order; i++) {
+    double w = 1.0;
+    for (int j = 0; j < stencil.order; j++) {
+      if (j != i)
+        w *= (s - j) / double(i - j);
+    }
+    stencil.weights[i] = w;
+  }
+}
+
+// See the .h file for the documentation
+void lagrangeStencils(int numTimes, double t0, double dt, int order,
+                      double t0_out, double dt_out, int num_out,
+                      std::vector<LagrangeStencil> & stencils) {
+  stencils.resize(std::max(num_out, 0));
+  for (int i = 0; i < num_out; i++)
+    lagrangeStencil(numTimes, t0, dt, t0_out + i * dt_out, order, stencils[i]);
+}
+
+// See the .h file for the documentation
+void applyStencil(LagrangeStencil const& stencil, const double *valueArray,
+                  int vectorLength, double *valueVector) {
+  for (int j = 0; j < vectorLength; j++)
+    valueVector[j] = 0.0;
+  for (int i = 0; i < stencil.order; i++) {
+    const double * val = valueArray + vectorLength * (stencil.beg + i);
+    for (int j = 0; j < vectorLength; j++)
+      valueVector[j] += stencil.weights[i] * val[j];
+  }
+}
+
+// The samples in [beg, end) which are in the stencil get its weights
+void lagrangeWeights(int numTimes, double t0, double dt, double time, int order,
+                     int beg, int end, std::vector<double> & weights) {
+
+  weights.assign(std::max(end - beg, 0), 0.0);
+  LagrangeStencil stencil;
+  lagrangeStencil(numTimes, t0, dt, time, order, stencil);
+  for (int i = 0; i < stencil.order; i++) {
+    int it = stencil.beg + i;
+    if (it >= beg && it < end)
+      weights[it - beg] = stencil.weights[i];
+  }
 }
 
 // Get positions. Based on the UsgsAstroLsSensorModel code.
@@ -242,6 +328,10 @@ void orbitInterpExtrap(double t0_in, double dt_in, int platformFlag,
   }
 
   // Now we have enough positions to interpolate at
+  int order = (platformFlag == 0) ? 4 : 8;
+  std::vector<LagrangeStencil> stencils;
+  lagrangeStencils(num_extra, t0_extra, dt_extra, order, t0_out, dt_out, num_out,
+                   stencils);
   positions_out.resize(num_out * NUM_XYZ_PARAMS);
   for (int i = 0; i < num_out; i++) {
     double t = t0_out + i * dt_out;
@@ -260,11 +350,8 @@ void orbitInterpExtrap(double t0_in, double dt_in, int platformFlag,
       continue;
     }
 
-    double P[3];
-    interpPositions(extra_positions, t0_extra, dt_extra, platformFlag, t, P);
-    positions_out[i*NUM_XYZ_PARAMS + 0] = P[0];
-    positions_out[i*NUM_XYZ_PARAMS + 1] = P[1];
-    positions_out[i*NUM_XYZ_PARAMS + 2] = P[2];
+    applyStencil(stencils[i], &extra_positions[0], NUM_XYZ_PARAMS,
+                 &positions_out[i*NUM_XYZ_PARAMS]);
   }
 
   return;
@@ -27,6 +27,7 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
 
 namespace vw {
     namespace cartography {
@@ -54,6 +55,45 @@ void interpPositions(UsgsAstroLsSensorModel * ls_model, double time,
 void interpVelocities(UsgsAstroLsSensorModel * ls_model, double time,
                   double vel[3]);
 
+// The order of the Lagrange interpolation of quaternions and positions.
+// Based on the UsgsAstroLsSensorModel code.
+int quatInterpOrder(UsgsAstroLsSensorModel const* ls_model);
+int posInterpOrder(UsgsAstroLsSensorModel const* ls_model);
+
+// The samples and weights with which Lagrange interpolation, as done by
+// lagrangeInterp() in CSM, finds the value at a given time. The
+// interpolation is linear in the samples, so a stencil can be found
+// once and applied to several sequences sampled at the same times,
+// such as positions and velocities, or to many coordinates.
+struct LagrangeStencil {
+  int beg;            // index of the first sample used
+  int order;          // number of samples used
+  double weights[8];  // the order is at most 8
+};
+
+// The stencil of Lagrange interpolation of the given order at the given
+// time, into numTimes samples starting at t0 with spacing dt.
+void lagrangeStencil(int numTimes, double t0, double dt, double time, int order,
+                     LagrangeStencil & stencil);
+
+// The stencils for num_out times starting at t0_out with spacing dt_out
+void lagrangeStencils(int numTimes, double t0, double dt, int order,
+                      double t0_out, double dt_out, int num_out,
+                      std::vector<LagrangeStencil> & stencils);
+
+// Interpolate with a stencil into a sequence of vectors of length
+// vectorLength, stored one after another in valueArray. Same as
+// lagrangeInterp() in CSM, up to rounding.
+void applyStencil(LagrangeStencil const& stencil, const double *valueArray,
+                  int vectorLength, double *valueVector);
+
+// The weights with which the samples with indices in [beg, end), out of
+// numTimes samples starting at t0 with spacing dt, enter the Lagrange
+// interpolation of the given order at the given time. Samples outside
+// the interpolation window get a weight of 0.
+void lagrangeWeights(int numTimes, double t0, double dt, double time, int order,
+                     int beg, int end, std::vector<double> & weights);
+
 // Nearest neighbor interpolation into a sequence of vectors of length
 // vectorLength, stored one after another in valueArray. The result
 // goes in valueVector. Analogous to lagrangeInterp() in CSM.
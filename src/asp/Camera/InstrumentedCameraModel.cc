@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/InstrumentedCameraModel.h>
+#include <asp/Core/Telemetry.h>
+
+#include <vw/Core/Exception.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  // Add the latency of every this many calls of a thread to the histograms
+  const int LATENCY_SAMPLE_PERIOD = 64;
+
+  // Call the function, and record the call, its time, and if it threw
+  template <class Metrics, class F>
+  auto timed_call(Metrics const& m, F f) -> decltype(f()) {
+    thread_local int num_calls = 0;
+    bool sample = (num_calls++ % LATENCY_SAMPLE_PERIOD == 0);
+    m.calls->add();
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto ans = f();
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      m.nanoseconds->add(std::chrono::duration_cast<std::chrono::nanoseconds>
+                         (elapsed).count());
+      if (sample)
+        m.seconds->add(std::chrono::duration<double>(elapsed).count());
+      return ans;
+    } catch (...) {
+      m.failures->add();
+      throw;
+    }
+  }
+
+} // end anonymous namespace
+
+InstrumentedCameraModel::InstrumentedCameraModel
+(boost::shared_ptr<camera::CameraModel> camera, std::string const& call_site):
+  m_camera(camera) {
+
+  if (!m_camera)
+    vw_throw(ArgumentErr() << "InstrumentedCameraModel: no camera to wrap.\n");
+
+  Telemetry & t = telemetry();
+  std::string p2p = "camera." + call_site + ".point_to_pixel";
+  std::string p2v = "camera." + call_site + ".pixel_to_vector";
+  m_point_to_pixel  = Metrics{&t.counter(p2p), &t.counter(p2p + ".failures"),
+                              &t.counter(p2p + ".nanoseconds"),
+                              &t.histogram(p2p + ".seconds")};
+  m_pixel_to_vector = Metrics{&t.counter(p2v), &t.counter(p2v + ".failures"),
+                              &t.counter(p2v + ".nanoseconds"),
+                              &t.histogram(p2v + ".seconds")};
+}
+
+Vector2 InstrumentedCameraModel::point_to_pixel(Vector3 const& point) const {
+  return timed_call(m_point_to_pixel, [&]() { return m_camera->point_to_pixel(point); });
+}
+
+Vector3 InstrumentedCameraModel::pixel_to_vector(Vector2 const& pix) const {
+  return timed_call(m_pixel_to_vector, [&]() { return m_camera->pixel_to_vector(pix); });
+}
+
+Vector3 InstrumentedCameraModel::camera_center(Vector2 const& pix) const {
+  return m_camera->camera_center(pix);
+}
+
+Quaternion<double> InstrumentedCameraModel::camera_pose(Vector2 const& pix) const {
+  return m_camera->camera_pose(pix);
+}
+
+bool camera_telemetry_enabled() {
+  static const bool enabled = [] {
+    const char * flag = getenv("ASP_CAMERA_TELEMETRY");
+    return flag != NULL && std::string(flag) == "1";
+  }();
+  return enabled;
+}
+
+boost::shared_ptr<camera::CameraModel>
+instrument_camera(boost::shared_ptr<camera::CameraModel> camera,
+                  std::string const& call_site) {
+  if (!camera_telemetry_enabled() || !camera)
+    return camera;
+  return boost::shared_ptr<camera::CameraModel>
+    (new InstrumentedCameraModel(camera, call_site));
+}
+
+} // end namespace asp
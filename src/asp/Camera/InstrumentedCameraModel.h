@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file InstrumentedCameraModel.h
+///
+/// A camera model which forwards all calls to another one, and counts
+/// and times its point_to_pixel() and pixel_to_vector() calls in the
+/// telemetry of the process (asp/Core/Telemetry.h), under the name of
+/// the call site. The counts and the total time cover all calls. The
+/// latency histograms have every 64th call of each thread, to keep the
+/// overhead low.
+///
+/// This is turned on by setting the environment variable
+/// ASP_CAMERA_TELEMETRY to 1. Code which casts a camera to a specific
+/// type must do so before it is wrapped.
+///
+#ifndef __STEREO_CAMERA_INSTRUMENTED_CAMERA_MODEL_H__
+#define __STEREO_CAMERA_INSTRUMENTED_CAMERA_MODEL_H__
+
+#include <vw/Camera/CameraModel.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace asp {
+
+  class TelemetryCounter;
+  class TelemetryHistogram;
+
+  class InstrumentedCameraModel: public vw::camera::CameraModel {
+  public:
+    InstrumentedCameraModel(boost::shared_ptr<vw::camera::CameraModel> camera,
+                            std::string const& call_site);
+
+    virtual ~InstrumentedCameraModel() {}
+    virtual std::string type() const { return m_camera->type(); }
+
+    virtual vw::Vector2 point_to_pixel (vw::Vector3 const& point) const;
+    virtual vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
+    virtual vw::Vector3 camera_center  (vw::Vector2 const& pix) const;
+    virtual vw::Quaternion<double> camera_pose(vw::Vector2 const& pix) const;
+
+    boost::shared_ptr<vw::camera::CameraModel> underlying_camera() const {
+      return m_camera;
+    }
+
+  private:
+    boost::shared_ptr<vw::camera::CameraModel> m_camera;
+
+    // Calls, failed calls (which threw), total time in nanoseconds, and
+    // the sampled latencies in seconds, for each of the two methods
+    struct Metrics {
+      TelemetryCounter   * calls;
+      TelemetryCounter   * failures;
+      TelemetryCounter   * nanoseconds;
+      TelemetryHistogram * seconds;
+    };
+    Metrics m_point_to_pixel, m_pixel_to_vector;
+  };
+
+  /// If ASP_CAMERA_TELEMETRY is set to 1
+  bool camera_telemetry_enabled();
+
+  /// Wrap the camera in an InstrumentedCameraModel with the given call
+  /// site name, if camera telemetry is enabled. Else return it as is.
+  boost::shared_ptr<vw::camera::CameraModel>
+  instrument_camera(boost::shared_ptr<vw::camera::CameraModel> camera,
+                    std::string const& call_site);
+
+} // end namespace asp
+
+#endif//__STEREO_CAMERA_INSTRUMENTED_CAMERA_MODEL_H__
@@ -19,16 +19,63 @@
 // so they are stored in the Camera folder.
 
 #include <asp/Camera/JitterSolveCostFuns.h>
+#include <asp/Camera/CsmUtils.h>
 #include <asp/Core/CameraTransforms.h>
 #include <asp/Core/SatSimBase.h>
 
 #include <vw/Cartography/GeoReferenceUtils.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace asp {
 
+// Project into a linescan camera in the ASP pixel convention
+vw::Vector2 lsProject(UsgsAstroLsSensorModel const& cam, csm::EcefCoord const& P,
+                      double * line_time = NULL) {
+
+  // Project in the camera with high precision. Do not use here
+  // anything lower than 1e-8, as the linescan model will then
+  // return junk.
+  double desired_precision = asp::DEFAULT_CSM_DESIRED_PRECISISON;
+  csm::ImageCoord imagePt = cam.groundToImage(P, desired_precision);
+  if (line_time != NULL)
+    *line_time = cam.getImageTime(imagePt);
+
+  // Convert to what ASP expects
+  vw::Vector2 pix;
+  asp::fromCsmPixel(pix, imagePt);
+  return pix;
+}
+
+// Differentiate the projection numerically with respect to shifting all
+// values in the given sequence, of vectors of length len, at index coord.
+vw::Vector2 lsShiftDerivative(UsgsAstroLsSensorModel & cam, csm::EcefCoord const& P,
+                              std::vector<double> & values, int len, int coord,
+                              double step) {
+
+  int num = values.size() / len;
+  for (int it = 0; it < num; it++)
+    values[len * it + coord] += step;
+  vw::Vector2 pix_plus = lsProject(cam, P);
+  for (int it = 0; it < num; it++)
+    values[len * it + coord] -= 2.0 * step;
+  vw::Vector2 pix_minus = lsProject(cam, P);
+  for (int it = 0; it < num; it++)
+    values[len * it + coord] += step;
+
+  return (pix_plus - pix_minus) / (2.0 * step);
+}
+
+// A step for numerical differentiation relative to the size of a value,
+// as ceres does.
+double diffStep(double val) {
+  return 1e-6 * std::max(1.0, std::abs(val));
+}
+
 // See the .h file for the documentation.
-bool LsPixelReprojErr::operator()(double const * const * parameters, 
-                                  double * residuals) const {
+bool LsPixelReprojErr::Evaluate(double const * const * parameters, 
+                                double * residuals, double ** jacobians) const {
 
   try {
     // Make a copy of the model, as we will update quaternion and position values
@@ -56,27 +103,98 @@ bool LsPixelReprojErr::operator()(double const * const * parameters,
 
     // Move forward in the array of parameters, then recover the triangulated point
     shift += (m_endPosIndex - m_begPosIndex);
+    int point_block = shift;
     csm::EcefCoord P;
-    P.x = parameters[shift][0];
-    P.y = parameters[shift][1];
-    P.z = parameters[shift][2];
-
-    // Project in the camera with high precision. Do not use here
-    // anything lower than 1e-8, as the linescan model will then
-    // return junk.
-    double desired_precision = asp::DEFAULT_CSM_DESIRED_PRECISISON;
-    csm::ImageCoord imagePt = cam.groundToImage(P, desired_precision);
-
-    // Convert to what ASP expects
-    vw::Vector2 pix;
-    asp::fromCsmPixel(pix, imagePt);
+    P.x = parameters[point_block][0];
+    P.y = parameters[point_block][1];
+    P.z = parameters[point_block][2];
 
+    double line_time = 0.0;
+    vw::Vector2 pix = lsProject(cam, P, &line_time);
     residuals[0] = m_weight*(pix[0] - m_observation[0]);
     residuals[1] = m_weight*(pix[1] - m_observation[1]);
+
+    if (jacobians == NULL)
+      return true;
+
+    // The weights of the samples in the interpolated pose at the line time
+    int numQuat = cam.m_quaternions.size() / NUM_QUAT_PARAMS;
+    int numPos  = cam.m_positions.size() / NUM_XYZ_PARAMS;
+    std::vector<double> quatWeights, posWeights;
+    asp::lagrangeWeights(numQuat, cam.m_t0Quat, cam.m_dtQuat, line_time,
+                         asp::quatInterpOrder(&cam), m_begQuatIndex, m_endQuatIndex,
+                         quatWeights);
+    asp::lagrangeWeights(numPos, cam.m_t0Ephem, cam.m_dtEphem, line_time,
+                         asp::posInterpOrder(&cam), m_begPosIndex, m_endPosIndex,
+                         posWeights);
+    double q[NUM_QUAT_PARAMS], pos[NUM_XYZ_PARAMS];
+    asp::interpQuaternions(&cam, line_time, q);
+    asp::interpPositions(&cam, line_time, pos);
+
+    // Derivatives with respect to the interpolated quaternion
+    for (int coord = 0; coord < NUM_QUAT_PARAMS; coord++) {
+      bool need = false;
+      for (int it = 0; it < m_endQuatIndex - m_begQuatIndex; it++)
+        need = need || (jacobians[it] != NULL);
+      if (!need)
+        break;
+      vw::Vector2 d = lsShiftDerivative(cam, P, cam.m_quaternions, NUM_QUAT_PARAMS,
+                                        coord, diffStep(q[coord]));
+      for (int it = 0; it < m_endQuatIndex - m_begQuatIndex; it++) {
+        if (jacobians[it] == NULL)
+          continue;
+        jacobians[it][coord]                   = m_weight * quatWeights[it] * d[0];
+        jacobians[it][NUM_QUAT_PARAMS + coord] = m_weight * quatWeights[it] * d[1];
+      }
+    }
+
+    // Same for the positions
+    int pos_block = m_endQuatIndex - m_begQuatIndex;
+    for (int coord = 0; coord < NUM_XYZ_PARAMS; coord++) {
+      bool need = false;
+      for (int it = 0; it < m_endPosIndex - m_begPosIndex; it++)
+        need = need || (jacobians[pos_block + it] != NULL);
+      if (!need)
+        break;
+      vw::Vector2 d = lsShiftDerivative(cam, P, cam.m_positions, NUM_XYZ_PARAMS,
+                                        coord, diffStep(pos[coord]));
+      for (int it = 0; it < m_endPosIndex - m_begPosIndex; it++) {
+        double * jac = jacobians[pos_block + it];
+        if (jac == NULL)
+          continue;
+        jac[coord]                  = m_weight * posWeights[it] * d[0];
+        jac[NUM_XYZ_PARAMS + coord] = m_weight * posWeights[it] * d[1];
+      }
+    }
+
+    // The triangulated point is differentiated numerically directly
+    if (jacobians[point_block] != NULL) {
+      double xyz[NUM_XYZ_PARAMS] = {P.x, P.y, P.z};
+      for (int coord = 0; coord < NUM_XYZ_PARAMS; coord++) {
+        double step = diffStep(xyz[coord]);
+        double plus[NUM_XYZ_PARAMS] = {P.x, P.y, P.z};
+        double minus[NUM_XYZ_PARAMS] = {P.x, P.y, P.z};
+        plus[coord] += step;
+        minus[coord] -= step;
+        vw::Vector2 d = (lsProject(cam, csm::EcefCoord(plus[0], plus[1], plus[2])) -
+                         lsProject(cam, csm::EcefCoord(minus[0], minus[1], minus[2])))
+          / (2.0 * step);
+        jacobians[point_block][coord]                  = m_weight * d[0];
+        jacobians[point_block][NUM_XYZ_PARAMS + coord] = m_weight * d[1];
+      }
+    }
     
   } catch (std::exception const& e) {
     residuals[0] = g_big_pixel_value;
     residuals[1] = g_big_pixel_value;
+    if (jacobians != NULL) {
+      for (size_t it = 0; it < parameter_block_sizes().size(); it++) {
+        if (jacobians[it] == NULL)
+          continue;
+        for (int c = 0; c < PIXEL_SIZE * parameter_block_sizes()[it]; c++)
+          jacobians[it][c] = 0.0;
+      }
+    }
     return true; // accept the solution anyway
   }
 
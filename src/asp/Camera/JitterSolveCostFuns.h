@@ -36,6 +36,8 @@
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
 
+#include <cstdint>
+
 #include <string>
 #include <map>
 #include <vector>
@@ -48,45 +50,52 @@ const double g_big_pixel_value = 1000.0;  // don't make this too big
 // into a given CSM linescan camera pixel. The variables of optimization are a
 // portion of the position and quaternion variables affected by this, and the 
 // triangulation point.
-struct LsPixelReprojErr {
+//
+// The Jacobian is found semi-analytically. A quaternion or position sample
+// affects the projection only through the interpolated pose at the line
+// time of the pixel, with its Lagrange weight at that time. Since the
+// weights add up to 1, shifting all samples by the same amount shifts the
+// interpolated pose by that amount, so the derivative with respect to a
+// sample is its weight times the derivative with respect to such a shift.
+// The latter is found numerically, which needs a handful of projections
+// per evaluation rather than a few for each sample.
+class LsPixelReprojErr: public ceres::CostFunction {
+public:
   LsPixelReprojErr(vw::Vector2 const& observation, double weight,
                    UsgsAstroLsSensorModel* ls_model,
                    int begQuatIndex, int endQuatIndex, 
                    int begPosIndex, int endPosIndex):
     m_observation(observation), m_weight(weight),
+    m_ls_model(ls_model),
     m_begQuatIndex(begQuatIndex), m_endQuatIndex(endQuatIndex),
-    m_begPosIndex(begPosIndex),   m_endPosIndex(endPosIndex),
-    m_ls_model(ls_model) {}
-
-  // The implementation is in the .cc file
-  bool operator()(double const * const * parameters, double * residuals) const; 
-
-  // Factory to hide the construction of the CostFunction object from the client code.
-  static ceres::CostFunction* Create(vw::Vector2 const& observation, double weight,
-                                     UsgsAstroLsSensorModel* ls_model,
-                                     int begQuatIndex, int endQuatIndex,
-                                     int begPosIndex, int endPosIndex) {
-
-    // TODO(oalexan1): Try using here the analytical cost function
-    ceres::DynamicNumericDiffCostFunction<LsPixelReprojErr>* cost_function =
-      new ceres::DynamicNumericDiffCostFunction<LsPixelReprojErr>
-      (new LsPixelReprojErr(observation, weight, ls_model,
-                                  begQuatIndex, endQuatIndex,
-                                  begPosIndex, endPosIndex));
+    m_begPosIndex(begPosIndex),   m_endPosIndex(endPosIndex) {
 
     // The residual size is always the same.
-    cost_function->SetNumResiduals(PIXEL_SIZE);
+    set_num_residuals(PIXEL_SIZE);
 
     // Add a parameter block for each quaternion and each position
+    std::vector<int32_t> & block_sizes = *mutable_parameter_block_sizes();
     for (int it = begQuatIndex; it < endQuatIndex; it++)
-      cost_function->AddParameterBlock(NUM_QUAT_PARAMS);
+      block_sizes.push_back(NUM_QUAT_PARAMS);
     for (int it = begPosIndex; it < endPosIndex; it++)
-      cost_function->AddParameterBlock(NUM_XYZ_PARAMS);
+      block_sizes.push_back(NUM_XYZ_PARAMS);
 
     // Add a parameter block for the xyz point
-    cost_function->AddParameterBlock(NUM_XYZ_PARAMS);
-    
-    return cost_function;
+    block_sizes.push_back(NUM_XYZ_PARAMS);
+  }
+
+  // The implementation is in the .cc file
+  virtual bool Evaluate(double const * const * parameters, double * residuals,
+                        double ** jacobians) const;
+
+  // Factory to hide the construction of the CostFunction object from the client code.
+  static ceres::CostFunction* Create(vw::Vector2 const& observation, double weight,
+                                     UsgsAstroLsSensorModel* ls_model,
+                                     int begQuatIndex, int endQuatIndex,
+                                     int begPosIndex, int endPosIndex) {
+    return new LsPixelReprojErr(observation, weight, ls_model,
+                                begQuatIndex, endQuatIndex,
+                                begPosIndex, endPosIndex);
   }
 
 private:
@@ -426,7 +426,7 @@ vw::Vector3 DGCameraModel::get_camera_center_at_time(double time) const {
     return vw::Vector3(ecef.x, ecef.y, ecef.z);
   }
   
-  return m_position_func(time);
+  return interp_position(time);
 }
 
 vw::Vector3 DGCameraModel::get_camera_velocity_at_time(double time) const {
@@ -514,7 +514,7 @@ vw::Quat DGCameraModel::get_camera_pose_at_time(double time) const {
     return vw::Quat(q[3], q[0], q[1], q[2]); // go from (x, y, z, w) to (w, x, y, z)
   }
   
-  return m_pose_func(time);
+  return interp_pose(time);
 }
   
 // Gives a pointing vector in the world coordinates.
@@ -636,10 +636,14 @@ vw::Vector2 DGCameraModel::point_to_pixel(vw::Vector3 const& point, double start
                  << "point_to_pixel(point, starty): Cannot be called in CSM mode.\n");
     
   // Use the uncorrected function to get a fast but good starting seed.
-  vw::camera::CameraGenericLMA model(this, point);
-  int status = -1;
   vw::Vector2 start = point_to_pixel_uncorrected(point, starty);
+
+  // Without corrections the uncorrected solution is the answer
+  if (m_uncorrected_is_exact)
+    return start;
   
+  vw::camera::CameraGenericLMA model(this, point);
+  int status = -1;
   // Run the solver
   vw::Vector3 objective(0, 0, 0);
   const double ABS_TOL = 1e-16;
@@ -653,6 +657,26 @@ vw::Vector2 DGCameraModel::point_to_pixel(vw::Vector3 const& point, double start
   return solution;
 }
   
+// Project many points at once
+void DGCameraModel::points_to_pixels(std::vector<vw::Vector3> const& points,
+                                     std::vector<vw::Vector2>      & pixels) const {
+
+  if (!stereo_settings().dg_use_csm) {
+    DGCameraModelBase::points_to_pixels(points, pixels);
+    return;
+  }
+
+  pixels.resize(points.size());
+  for (size_t it = 0; it < points.size(); it++) {
+    try {
+      pixels[it] = point_to_pixel(points[it]);
+    } catch (const vw::camera::PointToPixelErr&) {
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      pixels[it] = vw::Vector2(nan, nan);
+    }
+  }
+}
+  
 // Camera pose
 vw::Quaternion<double> DGCameraModel::camera_pose(vw::Vector2 const& pix) const {
 
@@ -23,7 +23,9 @@
 #ifndef __STEREO_CAMERA_LINESCAN_DG_MODEL_H__
 #define __STEREO_CAMERA_LINESCAN_DG_MODEL_H__
 
+#include <asp/Camera/LinescanPoseTable.h>
 #include <asp/Camera/TimeProcessing.h>
+#include <asp/Core/Telemetry.h>
 
 #include <vw/Camera/CameraSolve.h>
 #include <vw/Camera/LinescanModel.h>
@@ -32,6 +34,10 @@
 #include <vw/Cartography/Datum.h>
 #include <vw/Math/EulerAngles.h>
 
+#include <cmath>
+#include <limits>
+#include <vector>
+
 // Forward declaration
 class UsgsAstroLsSensorModel;
 
@@ -74,8 +80,11 @@ namespace asp {
       m_position_func(position), m_velocity_func(velocity),
       m_pose_func(pose), m_time_func(time),
       m_detector_origin(detector_origin),
-      m_focal_length(focal_length) {
+      m_focal_length(focal_length),
+      m_uncorrected_is_exact(!correct_velocity && !correct_atmosphere) {
       m_mean_surface_elevation = mean_ground_elevation; // Set base class value
+      build_pose_table();
+      build_line_table();
     }
     
     virtual ~LinescanDGModel() {}
@@ -89,7 +98,7 @@ namespace asp {
 
     // Implement the functions from the LinescanModel class using functors
     virtual vw::Vector3 get_camera_center_at_time(double time) const {
-      return m_position_func(time);
+      return interp_position(time);
     }
 
     virtual vw::Vector3 get_camera_velocity_at_time(double time) const {
@@ -98,7 +107,7 @@ namespace asp {
     }
 
     virtual vw::Quat get_camera_pose_at_time(double time) const {
-      return m_pose_func(time);
+      return interp_pose(time);
     }
 
     // Gives a pointing vector in the world coordinates.
@@ -115,10 +124,14 @@ namespace asp {
     // Override this implementation with a faster, more specialized implementation.
     virtual vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const {
       // Use the uncorrected function to get a fast but good starting seed.
-      vw::camera::CameraGenericLMA model(this, point);
-      int status;
       vw::Vector2 start = point_to_pixel_uncorrected(point, starty);
+
+      // Without corrections the uncorrected solution is the answer
+      if (m_uncorrected_is_exact)
+        return start;
       
+      vw::camera::CameraGenericLMA model(this, point);
+      int status;
       // Run the solver
       vw::Vector3 objective(0, 0, 0);
       const double ABS_TOL = 1e-16;
@@ -132,6 +145,24 @@ namespace asp {
       return solution;
     }
     
+    /// Project many points, such as the ones in a tile, at once. The
+    /// line found for each point seeds the solver for the next one. A
+    /// point which cannot be projected gets a NaN pixel.
+    virtual void points_to_pixels(std::vector<vw::Vector3> const& points,
+                                  std::vector<vw::Vector2>      & pixels) const {
+      pixels.resize(points.size());
+      double starty = -1.0;
+      for (size_t it = 0; it < points.size(); it++) {
+        try {
+          pixels[it] = this->point_to_pixel(points[it], starty);
+          starty = pixels[it].y();
+        } catch (const vw::camera::PointToPixelErr&) {
+          double nan = std::numeric_limits<double>::quiet_NaN();
+          pixels[it] = vw::Vector2(nan, nan);
+        }
+      }
+    }
+
     // Camera pose
     virtual vw::Quaternion<double> camera_pose(vw::Vector2 const& pix) const {
       return vw::camera::LinescanModel::camera_pose(pix);
@@ -154,8 +185,8 @@ namespace asp {
     /// by extension at neighboring lines as well.
     vw::camera::PinholeModel linescan_to_pinhole(double y) const {
       double t = this->m_time_func(y);
-      return vw::camera::PinholeModel(this->m_position_func(t),
-                                      this->m_pose_func(t).rotation_matrix(),
+      return vw::camera::PinholeModel(this->interp_position(t),
+                                      this->interp_pose(t).rotation_matrix(),
                                       this->m_focal_length, -this->m_focal_length,
                                       -this->m_detector_origin[0],
                                       y - this->m_detector_origin[1]);
@@ -175,10 +206,173 @@ namespace asp {
     const& get_time_func() const {return m_time_func;} 
 
   protected: // Functions
+
+    /// Sample the position and pose on a uniform grid spanning the
+    /// times of the image lines, with a node every few lines.
+    void build_pose_table() {
+      const double LINES_PER_NODE = 16.0;
+      int num_rows = m_image_size.y();
+      if (num_rows < 2)
+        return;
+      double t0 = m_time_func(0.0), t1 = m_time_func(num_rows - 1.0);
+      double dt = LINES_PER_NODE * std::abs(t1 - t0) / (num_rows - 1.0);
+      m_pose_table.build(t0, t1, dt,
+                         [this](double t) { return vw::Vector3(m_position_func(t)); },
+                         [this](double t) { return vw::Quat(m_pose_func(t)); });
+    }
+
+    /// The position and pose from the table, if the time is in its range,
+    /// and otherwise from the functions.
+    vw::Vector3 interp_position(double t) const {
+      if (m_pose_table.contains(t))
+        return m_pose_table.position(t);
+      return m_position_func(t);
+    }
+    vw::Quat interp_pose(double t) const {
+      if (m_pose_table.contains(t))
+        return m_pose_table.pose(t);
+      return m_pose_func(t);
+    }
+
+    /// Sample the camera center and the normal to the plane through the
+    /// camera center and the detector line at a few lines. The signed
+    /// distance from a point to that plane changes sign at the line the
+    /// point projects into, which gives a good seed for the line solver.
+    void build_line_table() {
+      const int NUM_NODES = 64;
+      m_table_lines.clear();
+      m_table_centers.clear();
+      m_table_normals.clear();
+      int num_rows = m_image_size.y();
+      if (num_rows < 2)
+        return;
+
+      // The detector line is where y/z = d1/f in the camera frame
+      vw::Vector3 local_normal(0, m_focal_length, -m_detector_origin[1]);
+      for (int k = 0; k < NUM_NODES; k++) {
+        double line = double(k) * (num_rows - 1) / (NUM_NODES - 1);
+        double t = m_time_func(line);
+        m_table_lines.push_back(line);
+        m_table_centers.push_back(interp_position(t));
+        m_table_normals.push_back(normalize(interp_pose(t).rotate(local_normal)));
+      }
+    }
+
+    /// The line at which the signed distance to the detector plane,
+    /// interpolated from the table, is zero. If there is more than one
+    /// such line, use the one closest to starty, if starty >= 0.
+    double line_seed(vw::Vector3 const& point, double starty) const {
+      double fallback = (starty >= 0) ? starty : m_image_size.y()/2.0;
+      size_t num = m_table_lines.size();
+      if (num < 2)
+        return fallback;
+
+      std::vector<double> dist(num);
+      for (size_t k = 0; k < num; k++)
+        dist[k] = dot_prod(m_table_normals[k], point - m_table_centers[k]);
+
+      double best_line = -1.0;
+      bool found = false;
+      for (size_t k = 0; k + 1 < num; k++) {
+        if ((dist[k] <= 0) == (dist[k+1] <= 0))
+          continue;
+        double line = m_table_lines[k] + dist[k] * (m_table_lines[k+1] - m_table_lines[k])
+          / (dist[k] - dist[k+1]);
+        if (!found || (starty >= 0 && std::abs(line - starty) < std::abs(best_line - starty)))
+          best_line = line;
+        found = true;
+        if (starty < 0)
+          break;
+      }
+      if (found)
+        return best_line;
+
+      // The point projects outside the image lines. Extrapolate from the
+      // end of the table at which the point is closer to the plane.
+      size_t k0 = 0, k1 = 1;
+      if (std::abs(dist[num-1]) < std::abs(dist[0])) {
+        k0 = num - 1;
+        k1 = num - 2;
+      }
+      if (dist[k0] == dist[k1])
+        return fallback;
+      return m_table_lines[k0] + dist[k0] * (m_table_lines[k1] - m_table_lines[k0])
+        / (dist[k0] - dist[k1]);
+    }
+
+    /// Solve for the line at which the point projects onto the detector,
+    /// without corrections, and the sample at that line. Start with a
+    /// Newton step from the table seed, using the derivative from the
+    /// velocity, then refine with the secant method, which also accounts
+    /// for the change in attitude. Return false if this did not converge.
+    bool point_to_pixel_fast(vw::Vector3 const& point, double starty,
+                             vw::Vector2 & pix) const {
+      const double LINE_TOL = 1e-8;
+      const int    MAX_ITERATIONS = 25;
+      double d = m_detector_origin[1] / m_focal_length;
+
+      // The number of secant steps, for the performance tests
+      static TelemetryCounter & num_steps
+        = telemetry().counter("dg.line_solver.secant_steps");
+
+      double y_prev = line_seed(point, starty);
+      if (!std::isfinite(y_prev))
+        return false;
+      double t = m_time_func(y_prev);
+      vw::Quat inv_pose = inverse(interp_pose(t));
+      vw::Vector3 u = inv_pose.rotate(point - interp_position(t));
+      if (!(u.z() > 0))
+        return false;
+      double f_prev = u.y() / u.z() - d;
+
+      // The derivative of the error with respect to the line, ignoring
+      // the rotation rate of the camera.
+      vw::Vector3 du = -inv_pose.rotate(m_velocity_func(t));
+      double dfdt = (du.y() * u.z() - u.y() * du.z()) / (u.z() * u.z());
+      double dfdy = dfdt * (m_time_func(y_prev + 1.0) - t);
+      if (!(std::abs(dfdy) > 0))
+        return false;
+      double y = y_prev - f_prev / dfdy;
+
+      for (int it = 0; it < MAX_ITERATIONS; it++) {
+        num_steps.add();
+        if (!std::isfinite(y))
+          return false;
+        t = m_time_func(y);
+        u = inverse(interp_pose(t)).rotate(point - interp_position(t));
+        if (!(u.z() > 0))
+          return false;
+        double f = u.y() / u.z() - d;
+
+        if (std::abs(y - y_prev) < LINE_TOL || std::abs(f / dfdy) < LINE_TOL) {
+          pix = vw::Vector2(m_focal_length * u.x() / u.z() - m_detector_origin[0], y);
+          return true;
+        }
+        if (f == f_prev)
+          return false;
+
+        double y_next = y - f * (y - y_prev) / (f - f_prev);
+        y_prev = y;
+        f_prev = f;
+        y      = y_next;
+      }
+      return false;
+    }
   
-    /// Low accuracy function used by point_to_pixel to get a good solver starting seed.
+    /// Low accuracy function used by point_to_pixel to get a good solver
+    /// starting seed. Try the fast solver first, and fall back to the
+    /// Levenberg-Marquardt solver for the line.
     vw::Vector2 point_to_pixel_uncorrected(vw::Vector3 const& point, double starty) const {
+      static TelemetryCounter & num_solves   = telemetry().counter("dg.line_solver.calls");
+      static TelemetryCounter & num_fallback = telemetry().counter("dg.line_solver.lma_fallbacks");
+      num_solves.add();
+
+      vw::Vector2 pix;
+      if (point_to_pixel_fast(point, starty, pix))
+        return pix;
+      
       // Solve for the correct line number to use
+      num_fallback.add();
       LinescanLMA model(this, point);
       int status;
       vw::Vector<double> objective(1), start(1);
@@ -200,7 +394,7 @@ namespace asp {
       // Solve for sample location now that we know the correct line
       double t = m_time_func(solution[0]);
       // TODO(oalexan1): Replace inverse with transpose if it is a rotation matrix?
-      vw::Vector3 pt = inverse(m_pose_func(t)).rotate(point - m_position_func(t));
+      vw::Vector3 pt = inverse(interp_pose(t)).rotate(point - interp_position(t));
       pt *= m_focal_length / pt.z();
 
       return vw::Vector2(pt.x() - m_detector_origin[0], solution[0]);
@@ -213,6 +407,7 @@ namespace asp {
     VelocityFuncT m_velocity_func; ///< Velocity at given time
     PoseFuncT     m_pose_func;     ///< Pose     at given time
     vw::camera::TLCTimeInterpolation m_time_func;     ///< Time at a given line
+    LinescanPoseTable m_pose_table; ///< Position and pose sampled at the image lines
 
     // Intrinsics
     
@@ -222,6 +417,14 @@ namespace asp {
     vw::Vector2  m_detector_origin; 
     double       m_focal_length;  ///< The focal length, also stored in pixels.
 
+    /// If there is no velocity aberration or atmospheric refraction
+    /// correction, the uncorrected projection is exact.
+    bool m_uncorrected_is_exact;
+
+    /// Coarse table of lines, camera centers, and detector plane normals
+    std::vector<double>      m_table_lines;
+    std::vector<vw::Vector3> m_table_centers, m_table_normals;
+
     // The Levenberg-Marquardt solver for linescan number
     //
     // We solve for the line number of the image that position the
@@ -242,9 +445,13 @@ namespace asp {
         m_model(model), m_point(pt) {}
 
         inline result_type operator()(domain_type const& y) const {
+          static TelemetryCounter & num_evals
+            = telemetry().counter("dg.line_solver.lma_evaluations");
+          num_evals.add();
+
           double       t        = m_model->get_time_at_line(y[0]);
           vw::Quat     pose     = m_model->get_camera_pose_at_time(t);
-          vw::Vector3  position = m_model->m_position_func(t);
+          vw::Vector3  position = m_model->interp_position(t);
           
           // Get point in camera's frame and rescale to pixel units
           vw::Vector3 pt = vw::camera::point_to_camera_coord(position, pose, m_point);
@@ -306,6 +513,10 @@ namespace asp {
     // Override this implementation with a faster, more specialized implementation.
     virtual vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const;
     
+    // Project many points at once. In CSM mode each point is projected on its own.
+    virtual void points_to_pixels(std::vector<vw::Vector3> const& points,
+                                  std::vector<vw::Vector2>      & pixels) const;
+
     // Camera pose
     virtual vw::Quaternion<double> camera_pose(vw::Vector2 const& pix) const;
 
@@ -30,6 +30,8 @@
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
 
+#include <asp/Camera/LinescanPoseTable.h>
+
 namespace asp {
 
   /// Specialization of the generic LinescanModel for PeruSat satellites.
@@ -54,7 +56,9 @@ namespace asp {
       m_pose_func(pose), m_time_func(time),
       m_tan_psi_x(tan_psi_x), m_tan_psi_y(tan_psi_y),
       m_inverse_instrument_biases(inverse(instrument_biases)),
-      m_min_time(min_time), m_max_time(max_time) {}
+      m_min_time(min_time), m_max_time(max_time) {
+      build_pose_table();
+    }
     
     virtual ~PeruSatCameraModel() {}
     virtual std::string type() const { return "LinescanPeruSat"; }
@@ -94,6 +98,11 @@ namespace asp {
     /// - Pass the caller location in to get a nice error message.
     void check_time(double time, std::string const& location) const;
 
+    /// Position and pose sampled at the image lines, to avoid evaluating
+    /// the interpolation functions at each call.
+    LinescanPoseTable m_pose_table;
+    void build_pose_table();
+
   }; // End class PeruSatCameraModel
 
 
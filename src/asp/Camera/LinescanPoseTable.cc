@@ -0,0 +1,129 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/LinescanPoseTable.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+LinescanPoseTable::LinescanPoseTable(): m_t0(0), m_dt(0), m_num_nodes(0) {}
+
+void LinescanPoseTable::clear() {
+  m_t0 = 0;
+  m_dt = 0;
+  m_num_nodes = 0;
+  AlignedVec* vecs[] = {&m_px, &m_py, &m_pz, &m_qw, &m_qx, &m_qy, &m_qz};
+  for (AlignedVec* vec: vecs)
+    AlignedVec().swap(*vec);
+}
+
+void LinescanPoseTable::sample(std::function<vw::Vector3(double)> const& position,
+                               std::function<vw::Quat(double)>    const& pose) {
+  AlignedVec* vecs[] = {&m_px, &m_py, &m_pz, &m_qw, &m_qx, &m_qy, &m_qz};
+  for (AlignedVec* vec: vecs)
+    vec->resize(m_num_nodes);
+
+  for (int k = 0; k < m_num_nodes; k++) {
+    double t = m_t0 + k * m_dt;
+    vw::Vector3 P = position(t);
+    vw::Quat    q = pose(t);
+
+    // q and -q are the same rotation. Keep neighbors in the same
+    // hemisphere so interpolating between them is meaningful.
+    if (k > 0 && m_qw[k-1] * q.w() + m_qx[k-1] * q.x() +
+        m_qy[k-1] * q.y() + m_qz[k-1] * q.z() < 0)
+      q = vw::Quat(-q.w(), -q.x(), -q.y(), -q.z());
+
+    m_px[k] = P[0]; m_py[k] = P[1]; m_pz[k] = P[2];
+    m_qw[k] = q.w(); m_qx[k] = q.x(); m_qy[k] = q.y(); m_qz[k] = q.z();
+  }
+}
+
+void LinescanPoseTable::build(double t_begin, double t_end, double dt,
+                              std::function<vw::Vector3(double)> const& position,
+                              std::function<vw::Quat(double)>    const& pose) {
+  clear();
+  if (t_end < t_begin)
+    std::swap(t_begin, t_end);
+  if (!(dt > 0) || !(t_end > t_begin))
+    return;
+
+  int num_cells = std::max(1, int(ceil((t_end - t_begin) / dt)));
+  while (num_cells + 1 <= POSE_TABLE_MAX_NODES) {
+    m_t0 = t_begin;
+    m_dt = (t_end - t_begin) / num_cells;
+    m_num_nodes = num_cells + 1;
+    sample(position, pose);
+
+    // Compare with the functions where interpolation is least accurate
+    bool good = true;
+    for (int k = 0; k < num_cells && good; k++) {
+      double t = m_t0 + (k + 0.5) * m_dt;
+      vw::Vector3 P = position(t);
+      vw::Quat    q = pose(t);
+      vw::Quat    r = this->pose(t);
+      if (q.w() * r.w() + q.x() * r.x() + q.y() * r.y() + q.z() * r.z() < 0)
+        q = vw::Quat(-q.w(), -q.x(), -q.y(), -q.z());
+      // For nearby unit quaternions, the angle between them is about
+      // twice the norm of their difference.
+      double angle = 2.0 * sqrt(pow(q.w() - r.w(), 2) + pow(q.x() - r.x(), 2) +
+                                pow(q.y() - r.y(), 2) + pow(q.z() - r.z(), 2));
+      good = (norm_2(P - this->position(t)) <= POSE_TABLE_POSITION_TOL &&
+              angle <= POSE_TABLE_ANGLE_TOL);
+    }
+    if (good)
+      return;
+
+    num_cells *= 2;
+  }
+
+  // Could not meet the tolerances, so the functions will be used as they are
+  clear();
+}
+
+void LinescanPoseTable::locate(double t, int & k, double & w) const {
+  double s = (t - m_t0) / m_dt;
+  k = std::max(0, std::min(m_num_nodes - 2, int(floor(s))));
+  w = s - k;
+}
+
+vw::Vector3 LinescanPoseTable::position(double t) const {
+  int k = 0;
+  double w = 0;
+  locate(t, k, w);
+  double v = 1.0 - w;
+  return vw::Vector3(v * m_px[k] + w * m_px[k+1],
+                     v * m_py[k] + w * m_py[k+1],
+                     v * m_pz[k] + w * m_pz[k+1]);
+}
+
+vw::Quat LinescanPoseTable::pose(double t) const {
+  int k = 0;
+  double w = 0;
+  locate(t, k, w);
+  double v = 1.0 - w;
+  double qw = v * m_qw[k] + w * m_qw[k+1];
+  double qx = v * m_qx[k] + w * m_qx[k+1];
+  double qy = v * m_qy[k] + w * m_qy[k+1];
+  double qz = v * m_qz[k] + w * m_qz[k+1];
+  double len = sqrt(qw * qw + qx * qx + qy * qy + qz * qz);
+  return vw::Quat(qw / len, qx / len, qy / len, qz / len);
+}
+
+} // end namespace asp
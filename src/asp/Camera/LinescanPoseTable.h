@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file LinescanPoseTable.h
+///
+/// A table of camera positions and orientations sampled on a uniform
+/// grid, for cheap lookup in linescan camera models. The functions
+/// providing these, such as Lagrange or SLERP interpolation of the
+/// ephemeris and attitude, are evaluated only when the table is built.
+///
+#ifndef __STEREO_CAMERA_LINESCAN_POSE_TABLE_H__
+#define __STEREO_CAMERA_LINESCAN_POSE_TABLE_H__
+
+#include <vw/Math/Quaternion.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/align/aligned_allocator.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace asp {
+
+  /// Linear interpolation in the table agrees with the functions it
+  /// is built from to within these, in meters and radians. The angle
+  /// tolerance is about 0.002 pixels for the focal length of WorldView.
+  const double POSE_TABLE_POSITION_TOL = 1e-4;
+  const double POSE_TABLE_ANGLE_TOL    = 1e-9;
+
+  /// The node spacing is halved until the tolerances are met, up to this
+  /// many nodes. If they are still not met, the table stays empty.
+  const int POSE_TABLE_MAX_NODES = 1 << 22;
+
+  class LinescanPoseTable {
+  public:
+    LinescanPoseTable();
+
+    /// Sample the position and pose at times in [t_begin, t_end], with
+    /// spacing of at most dt. The spacing is refined until interpolation
+    /// agrees with the functions at the midpoints between the nodes.
+    void build(double t_begin, double t_end, double dt,
+               std::function<vw::Vector3(double)> const& position,
+               std::function<vw::Quat(double)>    const& pose);
+
+    void clear();
+    bool empty() const { return m_num_nodes == 0; }
+
+    /// If the time is within the range of the table
+    bool contains(double t) const {
+      return m_num_nodes > 0 && t >= m_t0 && t <= m_t0 + (m_num_nodes - 1) * m_dt;
+    }
+
+    /// Linearly interpolated position. The time must be in the table.
+    vw::Vector3 position(double t) const;
+
+    /// Normalized linear interpolation of the quaternions. The time must
+    /// be in the table.
+    vw::Quat pose(double t) const;
+
+  private:
+    // Struct of arrays, with each array aligned to a cache line
+    typedef std::vector<double, boost::alignment::aligned_allocator<double, 64>> AlignedVec;
+
+    double m_t0, m_dt;
+    int m_num_nodes;
+    AlignedVec m_px, m_py, m_pz;       // positions
+    AlignedVec m_qw, m_qx, m_qy, m_qz; // quaternions, with consistent signs
+
+    /// The node to the left of t and the weight of the node to its right
+    void locate(double t, int & k, double & w) const;
+
+    /// Sample the functions at the nodes
+    void sample(std::function<vw::Vector3(double)> const& position,
+                std::function<vw::Quat(double)>    const& pose);
+  };
+
+} // end namespace asp
+
+#endif//__STEREO_CAMERA_LINESCAN_POSE_TABLE_H__
@@ -20,6 +20,9 @@
 #include <asp/Camera/SPOT_XML.h>
 #include <asp/Camera/LinescanSpotModel.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace asp {
 
 using vw::Vector3;
@@ -62,8 +65,26 @@ void SPOTCameraModel::check_time(double time, std::string const& location) const
                  << m_min_time << " <-> "<<m_max_time<<")\n");
 }
 
+// Sample the position and pose at the times of the image lines, with a
+// node every few lines, within the range of the pose data.
+void SPOTCameraModel::build_pose_table() {
+  const double LINES_PER_NODE = 16.0;
+  int num_rows = m_image_size[1];
+  if (num_rows < 2)
+    return;
+  double t0 = m_time_func(0.0), t1 = m_time_func(num_rows - 1.0);
+  double dt = LINES_PER_NODE * std::abs(t1 - t0) / (num_rows - 1.0);
+  double t_begin = std::max(std::min(t0, t1), m_min_time);
+  double t_end   = std::min(std::max(t0, t1), m_max_time);
+  m_pose_table.build(t_begin, t_end, dt,
+                     [this](double t) { return vw::Vector3(m_position_func(t)); },
+                     [this](double t) { return vw::Quat(m_pose_func(t)); });
+}
+
 vw::Vector3 SPOTCameraModel::get_camera_center_at_time(double time) const {
   check_time(time, "get_camera_center_at_time");
+  if (m_pose_table.contains(time))
+    return m_pose_table.position(time);
   return m_position_func(time);
 }
 vw::Vector3 SPOTCameraModel::get_camera_velocity_at_time(double time) const { 
@@ -72,7 +93,9 @@ vw::Vector3 SPOTCameraModel::get_camera_velocity_at_time(double time) const {
 }
 vw::Quat SPOTCameraModel::get_camera_pose_at_time(double time) const {
   check_time(time, "get_camera_pose_at_time");
- return m_pose_func(time); 
+  if (m_pose_table.contains(time))
+    return m_pose_table.pose(time);
+  return m_pose_func(time);
 }
 double SPOTCameraModel::get_time_at_line(double line) const {
   if ((line < 0.0) || (static_cast<int>(line) >= m_image_size[1]))
@@ -29,6 +29,8 @@
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
 
+#include <asp/Camera/LinescanPoseTable.h>
+
 
 namespace asp {
 
@@ -110,7 +112,9 @@ namespace asp {
       m_position_func(position), m_velocity_func(velocity),
       m_pose_func(pose),         m_time_func(time),
       m_look_angles(look_angles),
-      m_min_time(min_time), m_max_time(max_time) {}
+      m_min_time(min_time), m_max_time(max_time) {
+      build_pose_table();
+    }
 		    
     virtual ~SPOTCameraModel() {}
     virtual std::string type() const { return "LinescanSPOT"; }
@@ -174,6 +178,11 @@ namespace asp {
     /// - Pass the caller location in to get a nice error message.
     void check_time(double time, std::string const& location) const;
 
+    /// Position and pose sampled at the image lines, to avoid evaluating
+    /// the interpolation functions at each call.
+    LinescanPoseTable m_pose_table;
+    void build_pose_table();
+
   }; // End class SPOTCameraModel
 
 
@@ -23,6 +23,7 @@
 
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/PeruSatXML.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/TimeProcessing.h>
@@ -98,8 +99,28 @@ DOMElement* PeruSatXML::open_xml_file(std::string const& xml_path) {
 }
 
 void PeruSatXML::read_xml(std::string const& xml_path) {
+  if (read_camera_cache(xml_path, "perusat", *this))
+    return;
   DOMElement * root = open_xml_file(xml_path);
   parse_xml(root);
+  write_camera_cache(xml_path, "perusat", *this);
+}
+
+void PeruSatXML::cache_io(CameraCache & cache) {
+  cache.io(m_image_size);
+  cache.io(m_instrument_biases);
+  cache.io(m_tan_psi_x);
+  cache.io(m_tan_psi_y);
+  cache.io(m_start_time_stamp);
+  cache.io(m_start_time_is_set);
+  cache.io(m_start_time);
+  cache.io(center_time);
+  cache.io(m_line_period);
+  cache.io(m_center_col);
+  cache.io(m_center_row);
+  cache.io(m_positions);
+  cache.io(m_velocities);
+  cache.io(m_poses);
 }
 
 void PeruSatXML::parse_xml(xercesc::DOMElement* root) {
@@ -50,6 +50,8 @@ XERCES_CPP_NAMESPACE_END
 
 namespace asp {
 
+  class CameraCache;
+
   class PeruSatXML {
   public:
 
@@ -66,6 +68,9 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io(CameraCache & cache);
+
     // Functions to setup functors which manage the raw input data.
     vw::camera::LinearTimeInterpolation setup_time_func() const;
     vw::camera::LagrangianInterpolation setup_position_func
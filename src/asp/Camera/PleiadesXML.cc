@@ -26,6 +26,7 @@
 
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/PleiadesXML.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/TimeProcessing.h>
@@ -101,8 +102,35 @@ DOMElement* PleiadesXML::open_xml_file(std::string const& xml_path) {
 }
 
 void PleiadesXML::read_xml(std::string const& xml_path) {
+  if (read_camera_cache(xml_path, "pleiades", *this))
+    return;
   DOMElement * root = open_xml_file(xml_path);
   parse_xml(root);
+  write_camera_cache(xml_path, "pleiades", *this);
+}
+
+void PleiadesXML::cache_io(CameraCache & cache) {
+  cache.io(m_image_size);
+  cache.io(m_coeff_psi_x);
+  cache.io(m_coeff_psi_y);
+  cache.io(m_ref_row);
+  cache.io(m_ref_col);
+  cache.io(m_quat_offset_time);
+  cache.io(m_quat_scale);
+  cache.io(m_quaternion_coeffs);
+  cache.io(m_isNeo);
+  cache.io(m_t0Quat);
+  cache.io(m_dtQuat);
+  cache.io(m_accuracy_stdv);
+  cache.io(m_start_time_str);
+  cache.io(m_start_time_stamp);
+  cache.io(m_start_time_is_set);
+  cache.io(m_start_time);
+  cache.io(m_end_time);
+  cache.io(m_line_period);
+  cache.io(m_positions);
+  cache.io(m_velocities);
+  cache.io(m_poses);
 }
 
 void PleiadesXML::parse_xml(xercesc::DOMElement* root) {
@@ -0,0 +1,199 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file RPCMapTransform.h
+///
+/// A transform from map-projected pixels to pixels of an RPC camera,
+/// which, for each tile, projects all the pixels into the camera at once
+/// with the batched RPC evaluation, rather than one at a time.
+
+#ifndef __ASP_CAMERA_RPC_MAP_TRANSFORM_H__
+#define __ASP_CAMERA_RPC_MAP_TRANSFORM_H__
+
+#include <asp/Camera/RPCModel.h>
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/FileIO/DiskImageUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Transform.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Wrap a Map2CamTrans or Datum2CamTrans whose camera is an RPC model.
+  /// In reverse_bbox() the heights of all pixels in the tile are found
+  /// from the DEM, read once for the tile, or from the datum, and all
+  /// pixels are projected into the camera at once. Other calls are
+  /// passed to the wrapped transform.
+  ///
+  /// Like InterpolatedTransform, this must be copied for each tile,
+  /// which TransformView does.
+  template <class TransformT>
+  class RPCMapTransform:
+    public vw::TransformBase<RPCMapTransform<TransformT>> {
+
+    TransformT   m_trans;
+    RPCModel const* m_rpc;
+    vw::cartography::GeoReference m_image_georef, m_dem_georef;
+    bool         m_use_dem;
+    vw::ImageViewRef<vw::PixelMask<float>> m_dem;
+    double       m_datum_offset;
+    vw::Vector2i m_image_size; // the input image, to tell valid results
+
+    // The reverse transform for the current output tile
+    mutable vw::BBox2i                 m_cached_box;
+    mutable vw::ImageView<vw::Vector2> m_cache;
+
+    // Bilinear interpolation in an in-memory DEM crop. All four neighbors
+    // must be valid.
+    static double interp_height(vw::ImageView<vw::PixelMask<float>> const& dem,
+                                double col, double row) {
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      if (!(col >= 0 && row >= 0 && col < dem.cols() - 1 && row < dem.rows() - 1))
+        return nan;
+      int c0 = int(col), r0 = int(row);
+      double dc = col - c0, dr = row - r0;
+      vw::PixelMask<float> const& v00 = dem(c0,     r0);
+      vw::PixelMask<float> const& v10 = dem(c0 + 1, r0);
+      vw::PixelMask<float> const& v01 = dem(c0,     r0 + 1);
+      vw::PixelMask<float> const& v11 = dem(c0 + 1, r0 + 1);
+      if (!is_valid(v00) || !is_valid(v10) || !is_valid(v01) || !is_valid(v11))
+        return nan;
+      return (1.0 - dr) * ((1.0 - dc) * v00.child() + dc * v10.child()) +
+             dr         * ((1.0 - dc) * v01.child() + dc * v11.child());
+    }
+
+  public:
+    /// If dem_file is empty, the heights are datum_offset above the datum
+    /// of dem_georef.
+    RPCMapTransform(TransformT const& trans, RPCModel const* rpc,
+                    vw::cartography::GeoReference const& image_georef,
+                    vw::cartography::GeoReference const& dem_georef,
+                    std::string const& dem_file, double datum_offset,
+                    vw::Vector2i const& image_size):
+      m_trans(trans), m_rpc(rpc), m_image_georef(image_georef),
+      m_dem_georef(dem_georef), m_use_dem(!dem_file.empty()),
+      m_datum_offset(datum_offset), m_image_size(image_size) {
+      if (m_use_dem) {
+        double nodata = -std::numeric_limits<float>::max();
+        vw::read_nodata_val(dem_file, nodata);
+        m_dem = vw::create_mask(vw::DiskImageView<float>(dem_file), nodata);
+      }
+    }
+
+    /// Compute the reverse transform for all pixels in the box, and
+    /// return the bounding box of the results which are in the input
+    /// image, give or take a pixel.
+    vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const {
+
+      m_cached_box = bbox;
+      // Make a new image, as copies of this object share it
+      m_cache = vw::ImageView<vw::Vector2>(bbox.width(), bbox.height());
+
+      // The geodetic coordinates of the pixels, with the heights found
+      // below, and the DEM pixels they fall in
+      int num = bbox.width() * bbox.height();
+      std::vector<vw::Vector3> llh(num);
+      std::vector<vw::Vector2> dem_pix;
+      if (m_use_dem)
+        dem_pix.resize(num);
+      vw::BBox2 dem_box;
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          int i = row * bbox.width() + col;
+          vw::Vector2 lonlat = m_image_georef.pixel_to_lonlat
+            (vw::Vector2(col + bbox.min().x(), row + bbox.min().y()));
+          llh[i] = vw::Vector3(lonlat[0], lonlat[1], m_datum_offset);
+          if (m_use_dem) {
+            dem_pix[i] = m_dem_georef.lonlat_to_pixel(lonlat);
+            if (dem_pix[i] == dem_pix[i])
+              dem_box.grow(dem_pix[i]);
+          }
+        }
+      }
+
+      if (m_use_dem) {
+        // Read the part of the DEM which is needed, with a margin for the
+        // bilinear stencil
+        vw::BBox2i dem_crop_box;
+        if (!dem_box.empty()) {
+          dem_crop_box = vw::grow_bbox_to_int(dem_box);
+          dem_crop_box.expand(1);
+          dem_crop_box.crop(vw::bounding_box(m_dem));
+        }
+        vw::ImageView<vw::PixelMask<float>> dem_crop;
+        if (!dem_crop_box.empty())
+          dem_crop = vw::crop(m_dem, dem_crop_box);
+        for (int i = 0; i < num; i++)
+          llh[i][2] = interp_height(dem_crop, dem_pix[i][0] - dem_crop_box.min().x(),
+                                    dem_pix[i][1] - dem_crop_box.min().y());
+      }
+
+      // Go through ECEF, as the DEM datum need not be the RPC datum
+      std::vector<vw::Vector3> xyz(num);
+      for (int i = 0; i < num; i++)
+        xyz[i] = m_dem_georef.datum().geodetic_to_cartesian(llh[i]);
+      std::vector<vw::Vector2> pix;
+      m_rpc->points_to_pixels(xyz, pix);
+
+      vw::BBox2 valid_box(-1, -1, m_image_size[0] + 2, m_image_size[1] + 2);
+      vw::BBox2 out_box;
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          int i = row * bbox.width() + col;
+          if (llh[i][2] != llh[i][2] || pix[i] != pix[i]) {
+            m_cache(col, row) = vw::camera::CameraModel::invalid_pixel();
+            continue;
+          }
+          m_cache(col, row) = pix[i];
+          if (valid_box.contains(pix[i]))
+            out_box.grow(pix[i]);
+        }
+      }
+      if (out_box.empty())
+        return vw::BBox2i();
+      return vw::grow_bbox_to_int(out_box);
+    }
+
+    vw::Vector2 reverse(vw::Vector2 const& p) const {
+      int col = (int)round(p[0]) - m_cached_box.min().x();
+      int row = (int)round(p[1]) - m_cached_box.min().y();
+      if (col >= 0 && row >= 0 && col < m_cache.cols() && row < m_cache.rows() &&
+          p[0] == round(p[0]) && p[1] == round(p[1]))
+        return m_cache(col, row);
+      return m_trans.reverse(p);
+    }
+
+    vw::Vector2 forward(vw::Vector2 const& p) const {
+      return m_trans.forward(p);
+    }
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_RPC_MAP_TRANSFORM_H__
@@ -22,6 +22,7 @@
 #include <vw/Cartography/GeoReference.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/Telemetry.h>
 
 #include <gdal.h>
 #include <gdal_priv.h>
@@ -29,6 +30,8 @@
 #include <boost/smart_ptr/scoped_ptr.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
 
+#include <algorithm>
+
 using namespace vw;
 
 namespace asp {
@@ -221,6 +224,8 @@ namespace asp {
   // make that part of the API available. However I believe this is a
   // safe reinterpretation that is safe to distribute.
   Vector2 RPCModel::point_to_pixel(Vector3 const& point) const {
+    static TelemetryCounter & num_calls = telemetry().counter("rpc.point_to_pixel");
+    num_calls.add();
     return geodetic_to_pixel(m_datum.cartesian_to_geodetic(point));
   }
 
@@ -252,6 +257,73 @@ namespace asp {
     return normalized_pixel;
   }
 
+  // The monomials are in the same order as in calculate_terms(), and
+  // summed in the same order as dot_prod(), so the results agree
+  // exactly with normalized_geodetic_to_normalized_pixel().
+  void RPCModel::normalized_geodetic_to_normalized_pixel_block
+  (int n, const double* x, const double* y, const double* z,
+   RPCModel::CoeffVec const& line_num_coeff,
+   RPCModel::CoeffVec const& line_den_coeff,
+   RPCModel::CoeffVec const& sample_num_coeff,
+   RPCModel::CoeffVec const& sample_den_coeff,
+   double* samp, double* line) {
+
+    double sn[20], sd[20], ln[20], ld[20];
+    for (int k = 0; k < 20; k++) {
+      sn[k] = sample_num_coeff[k]; sd[k] = sample_den_coeff[k];
+      ln[k] = line_num_coeff[k];   ld[k] = line_den_coeff[k];
+    }
+
+    for (int i = 0; i < n; i++) {
+      double X = x[i], Y = y[i], Z = z[i];
+      double t[20] = {1.0, X, Y, Z, X*Y, X*Z, Y*Z, X*X, Y*Y, Z*Z,
+                      X*Y*Z, X*X*X, X*Y*Y, X*Z*Z, X*X*Y, Y*Y*Y, Y*Z*Z, X*X*Z, Y*Y*Z, Z*Z*Z};
+      double a = 0.0, b = 0.0, c = 0.0, d = 0.0;
+      for (int k = 0; k < 20; k++) {
+        a += t[k] * sn[k];
+        b += t[k] * sd[k];
+        c += t[k] * ln[k];
+        d += t[k] * ld[k];
+      }
+      samp[i] = a / b;
+      line[i] = c / d;
+    }
+  }
+
+  void RPCModel::geodetics_to_pixels(std::vector<Vector3> const& geodetics,
+                                     std::vector<Vector2>      & pixels) const {
+
+    const int num = geodetics.size();
+    pixels.resize(num);
+
+    double x[RPC_BLOCK_SIZE], y[RPC_BLOCK_SIZE], z[RPC_BLOCK_SIZE];
+    double samp[RPC_BLOCK_SIZE], line[RPC_BLOCK_SIZE];
+    for (int start = 0; start < num; start += RPC_BLOCK_SIZE) {
+      int n = std::min(RPC_BLOCK_SIZE, num - start);
+      for (int i = 0; i < n; i++) {
+        Vector3 const& g = geodetics[start + i];
+        x[i] = (g[0] - m_lonlatheight_offset[0]) / m_lonlatheight_scale[0];
+        y[i] = (g[1] - m_lonlatheight_offset[1]) / m_lonlatheight_scale[1];
+        z[i] = (g[2] - m_lonlatheight_offset[2]) / m_lonlatheight_scale[2];
+      }
+      normalized_geodetic_to_normalized_pixel_block(n, x, y, z,
+                                                    m_line_num_coeff, m_line_den_coeff,
+                                                    m_sample_num_coeff, m_sample_den_coeff,
+                                                    samp, line);
+      for (int i = 0; i < n; i++)
+        pixels[start + i] = Vector2(samp[i] * m_xy_scale[0] + m_xy_offset[0],
+                                    line[i] * m_xy_scale[1] + m_xy_offset[1]);
+    }
+  }
+
+  void RPCModel::points_to_pixels(std::vector<Vector3> const& points,
+                                  std::vector<Vector2>      & pixels) const {
+    std::vector<Vector3> geodetics(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+      geodetics[i] = m_datum.cartesian_to_geodetic(points[i]);
+    geodetics_to_pixels(geodetics, pixels);
+  }
+
   Vector2 RPCModel::normalized_geodetic_to_normalized_pixel
   (Vector3 const& normalized_geodetic) const {
 
@@ -523,6 +595,24 @@ namespace asp {
 
   }
 
+  void RPCModel::image_to_ground(std::vector<Vector2> const& pixels,
+                                 std::vector<double>  const& heights,
+                                 std::vector<Vector2>      & lonlats) const {
+
+    if (pixels.size() != heights.size())
+      vw_throw(ArgumentErr() << "RPCModel::image_to_ground: Expecting as many "
+               << "heights as pixels.\n");
+
+    lonlats.resize(pixels.size());
+    Vector2 guess = subvector(m_lonlatheight_offset, 0, 2);
+    for (size_t i = 0; i < pixels.size(); i++) {
+      lonlats[i] = image_to_ground(pixels[i], heights[i], guess);
+      // Do not let a failed solution spoil the next guess
+      if (lonlats[i] == lonlats[i])
+        guess = lonlats[i];
+    }
+  }
+
   void RPCModel::point_and_dir(Vector2 const& pix, Vector3 & P, Vector3 & dir) const {
 
     // For an RPC model there is no defined origin so it and the ray need to be computed.
@@ -567,6 +657,8 @@ namespace asp {
   }
 
   Vector3 RPCModel::pixel_to_vector(Vector2 const& pix) const {
+    static TelemetryCounter & num_calls = telemetry().counter("rpc.pixel_to_vector");
+    num_calls.add();
     // Find the normalized direction of the ray back-projected through
     // the camera from the current pixel.
     Vector3 P;
@@ -37,6 +37,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -54,6 +55,8 @@ namespace asp {
 
     static const int NUM_RPC_COEFFS = 78; // Total number of RPC coefficients
 
+    static const int RPC_BLOCK_SIZE = 64; // Points evaluated together in batches
+
     typedef vw::Vector<double,20> CoeffVec;
 
     /// Construct from a GDAL image or an .RPB file.
@@ -95,6 +98,25 @@ namespace asp {
 
     vw::Vector2 geodetic_to_pixel( vw::Vector3 const& geodetic ) const;
 
+    /// Project many geodetic points (lon, lat, height) at once. The points are
+    /// processed in blocks of RPC_BLOCK_SIZE, and for each point the
+    /// monomials are formed once and shared by all four polynomials.
+    void geodetics_to_pixels(std::vector<vw::Vector3> const& geodetics,
+                             std::vector<vw::Vector2>      & pixels) const;
+
+    /// As geodetics_to_pixels(), for points in ECEF coordinates
+    void points_to_pixels(std::vector<vw::Vector3> const& points,
+                          std::vector<vw::Vector2>      & pixels) const;
+
+    /// Evaluate the sample and line ratios of polynomials at n normalized
+    /// points, given as separate coordinate arrays. The loop over the
+    /// points has no branches, so that the compiler can vectorize it.
+    static void normalized_geodetic_to_normalized_pixel_block
+      (int n, const double* x, const double* y, const double* z,
+       CoeffVec const& line_num_coeff,   CoeffVec const& line_den_coeff,
+       CoeffVec const& sample_num_coeff, CoeffVec const& sample_den_coeff,
+       double* samp, double* line);
+
     // Access to constants
     vw::cartography::Datum const& datum   () const { return m_datum;               }
     CoeffVec    const& line_num_coeff     () const { return m_line_num_coeff;      }
@@ -127,6 +149,13 @@ namespace asp {
     vw::Vector2 image_to_ground(vw::Vector2 const& pixel, double height,
                                 vw::Vector2 lonlat_guess = vw::Vector2(0.0, 0.0)) const;
 
+    /// Same as above for many pixels, each with its own height. Newton's
+    /// method for each pixel starts from the solution for the previous
+    /// one, so for neighboring pixels it converges in very few iterations.
+    void image_to_ground(std::vector<vw::Vector2> const& pixels,
+                         std::vector<double>      const& heights,
+                         std::vector<vw::Vector2>      & lonlats) const;
+
     /// Find a point which gets projected onto the current pixel,
     /// and the direction of the ray going through that point.
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir ) const;
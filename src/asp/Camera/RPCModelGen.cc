@@ -18,7 +18,11 @@
 
 #include <asp/Camera/RPCModelGen.h>
 #include <asp/Camera/RPCModel.h>
-#include <vw/Math/Geometry.h>
+
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <vector>
 
 using namespace vw;
 
@@ -156,6 +160,101 @@ namespace asp {
     return status;
   }
 
+  void solve_rpc_linear(double penalty_weight,
+                        Vector<double> const& normalized_geodetics,
+                        Vector<double> const& normalized_pixels,
+                        Vector<double>      & solution) {
+
+    const int    NUM_TERMS      = 20; // terms in each RPC polynomial
+    const int    NUM_PARAMS     = 2*NUM_TERMS - 1; // the denominator constant term is 1
+    const int    MAX_ITERATIONS = 5;
+    const double MIN_DEN        = 1e-8;
+
+    int numPts = normalized_geodetics.size()/RPCModel::GEODETIC_COORD_SIZE;
+    if ((int)normalized_pixels.size() < RPCModel::IMAGE_COORD_SIZE*numPts)
+      vw_throw( ArgumentErr() << "Error in " << __FILE__
+                << ". Number of inputs and outputs do not agree.\n");
+
+    // The monomials at each point do not change, so find them once
+    std::vector<RPCModel::CoeffVec> terms(numPts);
+#pragma omp parallel for
+    for (int p = 0; p < numPts; p++)
+      terms[p] = RPCModel::calculate_terms
+        (subvector(normalized_geodetics, RPCModel::GEODETIC_COORD_SIZE*p,
+                   RPCModel::GEODETIC_COORD_SIZE));
+
+    Vector<int,20> coeff_order = RPCModel::get_coeff_order();
+
+    // The normalized pixels store the sample first, then the line. For
+    // each, the unknowns are the 20 numerator coefficients followed by
+    // the last 19 denominator coefficients.
+    Eigen::VectorXd sol[RPCModel::IMAGE_COORD_SIZE];
+    for (int c = 0; c < RPCModel::IMAGE_COORD_SIZE; c++) {
+
+      Eigen::VectorXd x = Eigen::VectorXd::Zero(NUM_PARAMS);
+      for (int iter = 0; iter < MAX_ITERATIONS; iter++) {
+
+        // Accumulate the normal equations, only the lower triangle
+        Eigen::MatrixXd A = Eigen::MatrixXd::Zero(NUM_PARAMS, NUM_PARAMS);
+        Eigen::VectorXd b = Eigen::VectorXd::Zero(NUM_PARAMS);
+#pragma omp parallel
+        {
+          Eigen::MatrixXd A_loc = Eigen::MatrixXd::Zero(NUM_PARAMS, NUM_PARAMS);
+          Eigen::VectorXd b_loc = Eigen::VectorXd::Zero(NUM_PARAMS);
+          Eigen::VectorXd row(NUM_PARAMS);
+#pragma omp for nowait
+          for (int p = 0; p < numPts; p++) {
+            RPCModel::CoeffVec const& T = terms[p];
+            double v = normalized_pixels[RPCModel::IMAGE_COORD_SIZE*p + c];
+
+            double w = 1.0;
+            if (iter > 0) {
+              double den = 1.0;
+              for (int k = 1; k < NUM_TERMS; k++)
+                den += x[NUM_TERMS + k - 1] * T[k];
+              if (std::abs(den) > MIN_DEN)
+                w = 1.0/(den*den);
+            }
+
+            for (int k = 0; k < NUM_TERMS; k++)
+              row[k] = T[k];
+            for (int k = 1; k < NUM_TERMS; k++)
+              row[NUM_TERMS + k - 1] = -v*T[k];
+            A_loc.selfadjointView<Eigen::Lower>().rankUpdate(row, w);
+            b_loc += (w*v)*row;
+          }
+#pragma omp critical
+          {
+            A += A_loc;
+            b += b_loc;
+          }
+        }
+
+        // The penalty on the higher-degree coefficients, see RpcSolveLMA
+        for (int k = 4; k < NUM_TERMS; k++) {
+          double pen = penalty_weight * (coeff_order[k] - 1);
+          A(k, k)                                 += pen*pen;
+          A(NUM_TERMS + k - 1, NUM_TERMS + k - 1) += pen*pen;
+        }
+
+        Eigen::VectorXd x_new = A.selfadjointView<Eigen::Lower>().ldlt().solve(b);
+        double change = (x_new - x).norm();
+        x = x_new;
+        if (iter > 0 && change <= 1e-12 * (1.0 + x.norm()))
+          break;
+      }
+      sol[c] = x;
+    }
+
+    // Same order as in packCoeffs()
+    int samp = 0, line = 1;
+    solution.set_size(RPCModel::NUM_RPC_COEFFS);
+    for (int k = 0; k < NUM_PARAMS; k++) {
+      solution[k]              = sol[line][k];
+      solution[NUM_PARAMS + k] = sol[samp][k];
+    }
+  }
+
   void gen_rpc(// Inputs
                double penalty_weight,
                std::string    const& output_prefix,
@@ -184,13 +283,6 @@ namespace asp {
     VW_OUT(DebugMessage, "math") << "rpc_gen: Computed penalty weight: "
                                  << penalty_adjustment<< std::endl;
 
-    // Initialize a specialized least squares solver object and load the input data
-    RpcSolveLMA lma_model (normalized_geodetics, normalized_pixels, penalty_adjustment);
-
-    Vector<double> solution;
-    double norm_error;
-
-    // As initial guess we use the linear part of the RPC transform.
     int numPts = normalized_geodetics.size()/RPCModel::GEODETIC_COORD_SIZE;
     int numPts2 = (normalized_pixels.size() - asp::RpcSolveLMA::NUM_PENALTY_TERMS)
       / RPCModel::IMAGE_COORD_SIZE;
@@ -198,63 +290,19 @@ namespace asp {
     if (numPts != numPts2) 
       vw_throw( ArgumentErr() << "Error in " << __FILE__
                 << ". Number of inputs and outputs do not agree.\n");
-    std::vector< Vector<double, RPCModel::GEODETIC_COORD_SIZE+1> > in(numPts), out(numPts);
-    for (int p = 0; p < numPts; p++) {
-
-      Vector<double, RPCModel::GEODETIC_COORD_SIZE+1> P;
-      for (int q = 0; q < RPCModel::GEODETIC_COORD_SIZE; q++) 
-        P[q] = normalized_geodetics[p*RPCModel::GEODETIC_COORD_SIZE + q]; // P[0], P[1], P[2]
-      P[RPCModel::GEODETIC_COORD_SIZE] = 1; // P[3]
-      in[p] = P;
-      
-      for (int q = 0; q < RPCModel::IMAGE_COORD_SIZE; q++) 
-        P[q] = normalized_pixels[p*RPCModel::IMAGE_COORD_SIZE + q]; // P[0], P[1]
-      P[RPCModel::IMAGE_COORD_SIZE]   = 0; // P[2]
-      P[RPCModel::IMAGE_COORD_SIZE+1] = 1; // P[3]
-      out[p] = P;
-    }
-    Matrix4x4 T = math::AffineFittingFunctorN<RPCModel::GEODETIC_COORD_SIZE>()(in, out);
-
-    // Put this matrix in the format acceptable for the RPC solver
-    for (int p = 0; p < int(line_num.size()); p++) {
-      samp_num[p] = 0; samp_den[p] = 0; // first coordinate of output is sample
-      line_num[p] = 0; line_den[p] = 0; // second coordinate of output is line
-    }
-
-    // The first coordinate of the output
-    samp_num[0] = T(0, 3); // the d value, the translation, in a*x + b*y + c*z + d
-    samp_num[1] = T(0, 0); samp_num[2] = T(0, 1); samp_num[3] = T(0, 2); // linear part, a, b, c
-    
-    // The second coordinate of the output
-    line_num[0] = T(1, 3); // the d value, the translation, in a*x + b*y + c*z + d
-    line_num[1] = T(1, 0); line_num[2] = T(1, 1); line_num[3] = T(1, 2); // linear part, a, b, c
 
-    // The denominator is just 1 to start
-    samp_den[0] = 1;
-    line_den[0] = 1;
-    
-    // Initialize the model
-    Vector<double> startGuess;
-    startGuess.set_size(RPCModel::NUM_RPC_COEFFS);
-    // for (size_t i = 0; i < startGuess.size(); i++) startGuess[i] = 0.0; // start with zero
-    packCoeffs(line_num, line_den, samp_num, samp_den, startGuess);
+    // The problem is linear once multiplied by the denominators, so there
+    // is no need for Levenberg-Marquardt.
+    Vector<double> solution;
+    solve_rpc_linear(penalty_adjustment, normalized_geodetics, normalized_pixels,
+                     solution);
 
-    VW_OUT(DebugMessage, "asp") << "Initial guess for RPC coeffs: " << startGuess << std::endl;
-    
-    // Use the L-M solver to optimize the RPC model coefficient values.
-    int status = find_solution_from_seed(lma_model, startGuess, normalized_pixels,
-                                         solution, norm_error);
+    // The error in the same terms as for the nonlinear problem
+    RpcSolveLMA lma_model(normalized_geodetics, normalized_pixels, penalty_adjustment);
+    double norm_error = norm_2(lma_model.difference(lma_model(solution), normalized_pixels));
     VW_OUT(DebugMessage, "asp") << "Solved RPC coeffs: " << solution << std::endl;
     VW_OUT(DebugMessage, "asp") << "rpc_gen: norm_error = " << norm_error << std::endl;
 
-    // Dump all the results to disk if the user passed in an output prefix.
-    if (output_prefix != "")
-      write_levmar_solver_results(output_prefix, status, startGuess,
-                                  solution, normalized_pixels, lma_model);
-  
-    // If we ever want to improve our results further we should
-    // experiment with multiple starting seeds!
-
     unpackCoeffs(solution, line_num, line_den, samp_num, samp_den);
   }
   
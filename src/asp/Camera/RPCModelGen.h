@@ -135,6 +135,18 @@ namespace asp {
                               vw::Vector<double>      & final_params,
                               double              & norm_error);
   
+  /// Find the RPC coefficients by linear least squares. With N and D
+  /// the numerator and denominator for a pixel coordinate p, the residual
+  /// p*D - N is linear in the coefficients, so minimizing it amounts to
+  /// solving the normal equations, separately for the line and sample.
+  /// The higher-degree coefficients are penalized as in RpcSolveLMA.
+  /// This is repeated a few times with each residual divided by D from
+  /// the previous solution, which makes it approach the pixel error.
+  void solve_rpc_linear(double penalty_weight,
+                        vw::Vector<double> const& normalized_geodetics,
+                        vw::Vector<double> const& normalized_pixels,
+                        vw::Vector<double>      & solution);
+
   void gen_rpc(// Inputs
                double penalty_weight,
                std::string    const& output_prefix,
@@ -25,16 +25,31 @@
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Core/StereoSettings.h>
 
+#include <xercesc/dom/DOMDocument.hpp>
+#include <xercesc/dom/DOMImplementation.hpp>
+#include <xercesc/dom/DOMImplementationRegistry.hpp>
+#include <xercesc/dom/DOMText.hpp>
 #include <xercesc/parsers/XercesDOMParser.hpp>
 #include <xercesc/sax/HandlerBase.hpp>
+#include <xercesc/sax2/Attributes.hpp>
+#include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <xercesc/util/XMLUni.hpp>
+#include <xercesc/util/XMLUniDefs.hpp>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <cstdlib>
+#include <map>
+
 using namespace vw;
 using namespace vw::cartography;
 using namespace xercesc;
@@ -326,14 +341,38 @@ void asp::GeometricXML::printDebugInfo() const {
 //========================================================================
 // EphemerisXML class
 
+namespace {
+
+  // Read the next number in a whitespace-separated list and move past
+  // it. This is much faster than reading with a stringstream.
+  double next_number(const char* & ptr) {
+    char* end = NULL;
+    double val = strtod(ptr, &end);
+    if (end == ptr)
+      vw_throw(IOErr() << "Failed to parse a number from: " << ptr << "\n");
+    ptr = end;
+    return val;
+  }
+
+  // Read the 1-based index an EPHEMLIST or ATTLIST entry starts with,
+  // and return it 0-based.
+  size_t next_index(const char* & ptr, size_t num_points) {
+    double val = next_number(ptr);
+    if (!(val >= 0.5) || size_t(val + 0.5) > num_points)
+      vw_throw(IOErr() << "Invalid point index: " << val << "\n");
+    return size_t(val + 0.5) - 1;
+  }
+
+}
+
 void asp::EphemerisXML::parse_meta(xercesc::DOMElement* node) {
-  cast_xmlch(get_node<DOMElement>(node, "STARTTIME"   )->getTextContent(), start_time);
-  cast_xmlch(get_node<DOMElement>(node, "TIMEINTERVAL")->getTextContent(), time_interval);
+  std::string start;
+  double interval;
   size_t num_points;
+  cast_xmlch(get_node<DOMElement>(node, "STARTTIME"   )->getTextContent(), start);
+  cast_xmlch(get_node<DOMElement>(node, "TIMEINTERVAL")->getTextContent(), interval);
   cast_xmlch(get_node<DOMElement>(node, "NUMPOINTS"   )->getTextContent(), num_points);
-  satellite_position_vec.resize(num_points);
-  velocity_vec.resize(num_points);
-  satellite_pos_cov.resize(6 * num_points); // see RPC_XML.h
+  set_meta(start, interval, num_points);
 }
 
 void asp::EphemerisXML::parse_eph_list(xercesc::DOMElement* node) {
@@ -345,111 +384,107 @@ void asp::EphemerisXML::parse_eph_list(xercesc::DOMElement* node) {
       DOMElement* element = dynamic_cast<DOMElement*>(children->item(i));
       std::string buffer;
       cast_xmlch(element->getTextContent(), buffer);
-
-      std::istringstream istr(buffer);
-      std::string index_b;
-      istr >> index_b;
-      size_t index;
-      try{
-        index = size_t(boost::lexical_cast<float>(index_b) + 0.5) - 1;
-      } catch (boost::bad_lexical_cast const& e) {
-        vw_throw(ArgumentErr() << "Failed to parse string: " << index_b << "\n");
-      }
-
-      istr >> satellite_position_vec[index][0]
-           >> satellite_position_vec[index][1]
-           >> satellite_position_vec[index][2]
-           >> velocity_vec[index][0]
-           >> velocity_vec[index][1]
-           >> velocity_vec[index][2];
-      istr >> satellite_pos_cov[6*index + 0]
-           >> satellite_pos_cov[6*index + 1]
-           >> satellite_pos_cov[6*index + 2]
-           >> satellite_pos_cov[6*index + 3]
-           >> satellite_pos_cov[6*index + 4]
-           >> satellite_pos_cov[6*index + 5];
-
+      add_point(buffer.c_str());
       count++;
     }
   }
 
+  end_list(count);
+}
+
+void asp::EphemerisXML::set_meta(std::string const& start, double interval,
+                                 size_t num_points) {
+  start_time    = start;
+  time_interval = interval;
+  satellite_position_vec.resize(num_points);
+  velocity_vec.resize(num_points);
+  satellite_pos_cov.resize(6 * num_points); // see RPC_XML.h
+  check_argument(0);
+}
+
+void asp::EphemerisXML::add_point(const char* text) {
+  size_t index = next_index(text, satellite_position_vec.size());
+  for (int c = 0; c < 3; c++)
+    satellite_position_vec[index][c] = next_number(text);
+  for (int c = 0; c < 3; c++)
+    velocity_vec[index][c] = next_number(text);
+  for (int c = 0; c < 6; c++)
+    satellite_pos_cov[6*index + c] = next_number(text);
+}
+
+void asp::EphemerisXML::end_list(size_t count) {
   VW_ASSERT(count == satellite_position_vec.size(),
             IOErr() << "Read incorrect number of points.");
+  check_argument(1);
 }
 
 asp::EphemerisXML::EphemerisXML() : BitChecker(2) {}
 
 void asp::EphemerisXML::parse(xercesc::DOMElement* node) {
   parse_meta(node);
-  check_argument(0);
-
-  // TODO(oalexan1): This is slow to parse
   parse_eph_list(get_node<DOMElement>(node, "EPHEMLISTList"));
-  check_argument(1);
 }
 
 //========================================================================
 // AttitudeXML class
 
 void asp::AttitudeXML::parse_meta(xercesc::DOMElement* node) {
-  cast_xmlch(get_node<DOMElement>(node, "STARTTIME"   )->getTextContent(), start_time);
-  cast_xmlch(get_node<DOMElement>(node, "TIMEINTERVAL")->getTextContent(), time_interval);
+  std::string start;
+  double interval;
   size_t num_points;
+  cast_xmlch(get_node<DOMElement>(node, "STARTTIME"   )->getTextContent(), start);
+  cast_xmlch(get_node<DOMElement>(node, "TIMEINTERVAL")->getTextContent(), interval);
   cast_xmlch(get_node<DOMElement>(node, "NUMPOINTS"   )->getTextContent(), num_points);
-  satellite_quat_vec.resize(num_points);
-  satellite_quat_cov.resize(10 * num_points); // see RPC_XML.h
+  set_meta(start, interval, num_points);
 }
 
 void asp::AttitudeXML::parse_att_list(xercesc::DOMElement* node) {
   DOMNodeList* children = node->getChildNodes();
   size_t count = 0;
-  Vector4 qbuf;
 
   for (XMLSize_t i = 0; i < children->getLength(); i++) {
     if (children->item(i)->getNodeType() == DOMNode::ELEMENT_NODE) {
       DOMElement* element = dynamic_cast<DOMElement*>(children->item(i));
       std::string buffer;
       cast_xmlch(element->getTextContent(), buffer);
-
-      std::istringstream istr(buffer);
-      std::string index_b;
-      istr >> index_b;
-      size_t index;
-      try {
-        index = size_t(boost::lexical_cast<float>(index_b) + 0.5) - 1;
-      } catch (boost::bad_lexical_cast const& e) {
-        vw_throw(ArgumentErr() << "Failed to parse string: " << index_b << "\n");
-      }
-
-      // Read the quaternion values for satellite orientation.
-      istr >> satellite_quat_vec[index][0]
-           >> satellite_quat_vec[index][1]
-           >> satellite_quat_vec[index][2]
-           >> satellite_quat_vec[index][3];
-      // Only the upper-right portion of the 4x4 covariance matrix is saved
-      istr >> satellite_quat_cov[10*index + 0] >> satellite_quat_cov[10*index + 1]
-           >> satellite_quat_cov[10*index + 2] >> satellite_quat_cov[10*index + 3]
-           >> satellite_quat_cov[10*index + 4] >> satellite_quat_cov[10*index + 5]
-           >> satellite_quat_cov[10*index + 6] >> satellite_quat_cov[10*index + 7]
-           >> satellite_quat_cov[10*index + 8] >> satellite_quat_cov[10*index + 9];
-
+      add_point(buffer.c_str());
       count++;
     }
   }
 
+  end_list(count);
+}
+
+void asp::AttitudeXML::set_meta(std::string const& start, double interval,
+                                size_t num_points) {
+  start_time    = start;
+  time_interval = interval;
+  satellite_quat_vec.resize(num_points);
+  satellite_quat_cov.resize(10 * num_points); // see RPC_XML.h
+  check_argument(0);
+}
+
+void asp::AttitudeXML::add_point(const char* text) {
+  size_t index = next_index(text, satellite_quat_vec.size());
+  // The quaternion values for satellite orientation
+  for (int c = 0; c < 4; c++)
+    satellite_quat_vec[index][c] = next_number(text);
+  // Only the upper-right portion of the 4x4 covariance matrix is saved
+  for (int c = 0; c < 10; c++)
+    satellite_quat_cov[10*index + c] = next_number(text);
+}
+
+void asp::AttitudeXML::end_list(size_t count) {
   VW_ASSERT(count == satellite_quat_vec.size(),
             IOErr() << "Read incorrect number of points.");
+  check_argument(1);
 }
 
 asp::AttitudeXML::AttitudeXML() : BitChecker(2) {}
 
 void asp::AttitudeXML::parse(xercesc::DOMElement* node) {
   parse_meta(node);
-  check_argument(0);
-
-  // TODO(oalexan1): This is slow to parse
   parse_att_list(get_node<DOMElement>(node, "ATTLISTList"));
-  check_argument(1);
 }
 
 
@@ -471,6 +506,13 @@ void asp::RPCXML::parse_vector(xercesc::DOMElement* node,
 asp::RPCXML::RPCXML() : BitChecker(2) {}
 
 void asp::RPCXML::read_from_file(std::string const& name) {
+  if (read_camera_cache(name, "rpc", *this))
+    return;
+  parse_file(name);
+  write_camera_cache(name, "rpc", *this);
+}
+
+void asp::RPCXML::parse_file(std::string const& name) {
   boost::scoped_ptr<XercesDOMParser> parser(new XercesDOMParser());
   parser->setValidationScheme(XercesDOMParser::Val_Always);
   parser->setDoNamespaces(true);
@@ -740,6 +782,271 @@ void asp::RPCXML::parse_perusat_model(xercesc::DOMElement* node) {
 
 }
 
+//========================================================================
+// Saving and restoring the parsed values
+
+namespace {
+  void bits_io(asp::BitChecker & checker, asp::CameraCache & cache) {
+    int bits = checker.checked_bits();
+    cache.io(bits);
+    checker.set_checked_bits(bits);
+  }
+}
+
+void asp::ImageXML::cache_io(CameraCache & cache) {
+  bits_io(*this, cache);
+  cache.io(tlc_start_time);
+  cache.io(first_line_start_time);
+  cache.io(tlc_vec);
+  cache.io(sat_id);
+  cache.io(band_id);
+  cache.io(scan_direction);
+  cache.io(tdi);
+  cache.io(tdi_multi);
+  cache.io(avg_line_rate);
+  cache.io(image_size);
+  cache.io(generation_time);
+  cache.io(image_descriptor);
+}
+
+void asp::GeometricXML::cache_io(CameraCache & cache) {
+  bits_io(*this, cache);
+  cache.io(principal_distance);
+  cache.io(optical_polyorder);
+  cache.io(optical_a);
+  cache.io(optical_b);
+  cache.io(perspective_center);
+  cache.io(camera_attitude);
+  cache.io(detector_origin);
+  cache.io(detector_rotation);
+  cache.io(detector_pixel_pitch);
+}
+
+void asp::EphemerisXML::cache_io(CameraCache & cache) {
+  bits_io(*this, cache);
+  cache.io(start_time);
+  cache.io(time_interval);
+  cache.io(satellite_position_vec);
+  cache.io(satellite_pos_cov);
+  cache.io(velocity_vec);
+}
+
+void asp::AttitudeXML::cache_io(CameraCache & cache) {
+  bits_io(*this, cache);
+  cache.io(start_time);
+  cache.io(time_interval);
+  cache.io(satellite_quat_vec);
+  cache.io(satellite_quat_cov);
+}
+
+void asp::RPCXML::cache_io(CameraCache & cache) {
+  bits_io(*this, cache);
+  cache.io(m_lat_lon_height_box);
+
+  bool has_rpc = (m_rpc.get() != NULL);
+  cache.io(has_rpc);
+  if (!has_rpc) {
+    m_rpc.reset();
+    return;
+  }
+
+  vw::cartography::Datum datum;
+  RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
+  Vector2 xy_offset, xy_scale;
+  Vector3 llh_offset, llh_scale;
+  double err_bias = 0.0, err_rand = 0.0;
+  if (cache.is_writing()) {
+    datum      = m_rpc->datum();
+    line_num   = m_rpc->line_num_coeff();
+    line_den   = m_rpc->line_den_coeff();
+    samp_num   = m_rpc->sample_num_coeff();
+    samp_den   = m_rpc->sample_den_coeff();
+    xy_offset  = m_rpc->xy_offset();
+    xy_scale   = m_rpc->xy_scale();
+    llh_offset = m_rpc->lonlatheight_offset();
+    llh_scale  = m_rpc->lonlatheight_scale();
+    err_bias   = m_rpc->m_err_bias;
+    err_rand   = m_rpc->m_err_rand;
+  }
+  cache.io(datum);
+  cache.io(line_num);
+  cache.io(line_den);
+  cache.io(samp_num);
+  cache.io(samp_den);
+  cache.io(xy_offset);
+  cache.io(xy_scale);
+  cache.io(llh_offset);
+  cache.io(llh_scale);
+  cache.io(err_bias);
+  cache.io(err_rand);
+  if (!cache.is_writing())
+    m_rpc.reset(new RPCModel(datum, line_num, line_den, samp_num, samp_den,
+                             xy_offset, xy_scale, llh_offset, llh_scale,
+                             err_bias, err_rand));
+}
+
+namespace {
+
+  // Reads a DigitalGlobe XML file in one pass, as a stream. The EPH and
+  // ATT sections, which are most of the file, are parsed as they go by,
+  // without making a DOM of them, as that takes much time and memory
+  // for WorldView-3 files with many points. The other sections are
+  // small, and are copied to a DOM, which the parse() functions read.
+  class DgXmlHandler: public DefaultHandler {
+  public:
+    DgXmlHandler(asp::EphemerisXML & eph, asp::AttitudeXML & att):
+      m_eph(eph), m_att(att), m_section(NONE), m_depth(0), m_count(0) {
+      XMLCh core[] = {chLatin_C, chLatin_o, chLatin_r, chLatin_e, chNull};
+      m_doc = DOMImplementationRegistry::getDOMImplementation(core)->createDocument();
+    }
+
+    ~DgXmlHandler() { m_doc->release(); }
+
+    /// The root of the DOM of the sections other than EPH and ATT
+    DOMElement* root() const { return m_doc->getDocumentElement(); }
+
+    void startElement(const XMLCh* const uri, const XMLCh* const localname,
+                      const XMLCh* const qname, const Attributes& attrs) {
+      m_depth++;
+      std::string tag = to_string(qname);
+
+      if (m_section == NONE && m_depth == 2 && (tag == "EPH" || tag == "ATT")) {
+        m_section = (tag == "EPH") ? EPH : ATT;
+        m_meta.clear();
+        m_count = 0;
+        return;
+      }
+
+      if (m_section != NONE) {
+        m_text.clear();
+        if (tag == "EPHEMLISTList" || tag == "ATTLISTList")
+          start_list();
+        return;
+      }
+
+      flush_text();
+      DOMElement* elem = m_doc->createElement(qname);
+      for (XMLSize_t i = 0; i < attrs.getLength(); i++)
+        elem->setAttribute(attrs.getQName(i), attrs.getValue(i));
+      if (m_stack.empty())
+        m_doc->appendChild(elem);
+      else
+        m_stack.back()->appendChild(elem);
+      m_stack.push_back(elem);
+    }
+
+    void endElement(const XMLCh* const uri, const XMLCh* const localname,
+                    const XMLCh* const qname) {
+      m_depth--;
+
+      if (m_section != NONE) {
+        if (m_depth == 1) {
+          m_section = NONE; // left EPH or ATT
+          return;
+        }
+        std::string tag = to_string(qname);
+        if (tag == "EPHEMLIST") {
+          m_eph.add_point(m_text.c_str());
+          m_count++;
+        } else if (tag == "ATTLIST") {
+          m_att.add_point(m_text.c_str());
+          m_count++;
+        } else if (tag == "EPHEMLISTList") {
+          m_eph.end_list(m_count);
+        } else if (tag == "ATTLISTList") {
+          m_att.end_list(m_count);
+        } else if (m_depth == 2) {
+          m_meta[tag] = boost::algorithm::trim_copy(m_text);
+        }
+        return;
+      }
+
+      flush_text();
+      m_stack.pop_back();
+    }
+
+    void characters(const XMLCh* const chars, const XMLSize_t length) {
+      if (m_section != NONE) {
+        // The EPH and ATT values are ASCII
+        for (XMLSize_t i = 0; i < length; i++)
+          m_text.push_back(char(chars[i]));
+      } else if (!m_stack.empty()) {
+        m_dom_text.append(chars, length);
+      }
+    }
+
+    void fatalError(const SAXParseException& e) { throw e; }
+
+  private:
+    asp::EphemerisXML & m_eph;
+    asp::AttitudeXML  & m_att;
+    DOMDocument* m_doc;
+    std::vector<DOMElement*> m_stack; // the open DOM elements
+    std::basic_string<XMLCh> m_dom_text;
+
+    enum Section {NONE, EPH, ATT};
+    Section m_section;
+    int m_depth;
+    std::string m_text; // text of the current element in EPH or ATT
+    std::map<std::string, std::string> m_meta; // STARTTIME, etc.
+    size_t m_count;
+
+    static std::string to_string(const XMLCh* ch) {
+      char* text = XMLString::transcode(ch);
+      std::string ans(text);
+      XMLString::release(&text);
+      return ans;
+    }
+
+    void flush_text() {
+      if (m_dom_text.empty() || m_stack.empty())
+        return;
+      m_stack.back()->appendChild(m_doc->createTextNode(m_dom_text.c_str()));
+      m_dom_text.clear();
+    }
+
+    std::string meta(std::string const& tag) const {
+      std::map<std::string, std::string>::const_iterator it = m_meta.find(tag);
+      if (it == m_meta.end())
+        vw_throw(IOErr() << "Couldn't find \"" << tag << "\" tag.");
+      return it->second;
+    }
+
+    // STARTTIME, etc., come before the list
+    void start_list() {
+      double interval = 0;
+      size_t num_points = 0;
+      try {
+        interval   = boost::lexical_cast<double>(meta("TIMEINTERVAL"));
+        num_points = boost::lexical_cast<size_t>(meta("NUMPOINTS"));
+      } catch (boost::bad_lexical_cast const& e) {
+        vw_throw(ArgumentErr() << "Failed to parse TIMEINTERVAL or NUMPOINTS.\n");
+      }
+      if (m_section == EPH)
+        m_eph.set_meta(meta("STARTTIME"), interval, num_points);
+      else
+        m_att.set_meta(meta("STARTTIME"), interval, num_points);
+      m_count = 0;
+    }
+  };
+
+  // All that is read from a DigitalGlobe XML file, to be cached together
+  struct DgXmlData {
+    asp::GeometricXML geo;
+    asp::AttitudeXML  att;
+    asp::EphemerisXML eph;
+    asp::ImageXML     img;
+    asp::RPCXML       rpc;
+    void cache_io(asp::CameraCache & cache) {
+      geo.cache_io(cache);
+      att.cache_io(cache);
+      eph.cache_io(cache);
+      img.cache_io(cache);
+      rpc.cache_io(cache);
+    }
+  };
+}
+
 // Helper functions to allow us to fill the objects
 void asp::read_xml(std::string const& filename,
                    GeometricXML& geo,
@@ -752,17 +1059,31 @@ void asp::read_xml(std::string const& filename,
   if (!fs::exists(filename))
     vw_throw(ArgumentErr() << "XML file \"" << filename << "\" does not exist.");
 
+  DgXmlData data;
+  if (read_camera_cache(filename, "dg", data)) {
+    geo = data.geo;
+    att = data.att;
+    eph = data.eph;
+    img = data.img;
+    rpc = data.rpc;
+    return;
+  }
+
   try{
-    boost::scoped_ptr<XercesDOMParser> parser(new XercesDOMParser());
-    parser->setValidationScheme(XercesDOMParser::Val_Always);
-    parser->setDoNamespaces(true);
-    boost::scoped_ptr<ErrorHandler> errHandler(new HandlerBase());
-    parser->setErrorHandler(errHandler.get());
+    // EPH and ATT are parsed while reading, the rest is in a DOM
+    boost::scoped_ptr<SAX2XMLReader> parser(XMLReaderFactory::createXMLReader());
+    parser->setFeature(XMLUni::fgSAX2CoreValidation, true);
+    parser->setFeature(XMLUni::fgXercesDynamic, false);
+    parser->setFeature(XMLUni::fgSAX2CoreNameSpaces, true);
+    DgXmlHandler handler(eph, att);
+    parser->setContentHandler(&handler);
+    parser->setErrorHandler(&handler);
 
     parser->parse(filename.c_str());
 
-    DOMDocument* xmlDoc = parser->getDocument();
-    DOMElement* elementRoot = xmlDoc->getDocumentElement();
+    DOMElement* elementRoot = handler.root();
+    if (elementRoot == NULL)
+      vw_throw(ArgumentErr() << "Empty XML file.");
 
     try{ // This is optional information, not present in all XML files.
       rpc.parse_bbox(elementRoot); // Load the bounding box information.
@@ -778,10 +1099,6 @@ void asp::read_xml(std::string const& filename,
         std::string tag(XMLString::transcode(curr_element->getTagName()));
         if (tag == "GEO")
           geo.parse(curr_element);
-        else if (tag == "EPH")
-          eph.parse(curr_element);
-        else if (tag == "ATT")
-          att.parse(curr_element);
         else if (tag == "IMD")
           img.parse(curr_element);
         else if (tag == "RPB")
@@ -792,6 +1109,12 @@ void asp::read_xml(std::string const& filename,
     vw_throw(ArgumentErr() << e.what() << " XML file \"" << filename << "\" is invalid.\n");
   }
 
+  data.geo = geo;
+  data.att = att;
+  data.eph = eph;
+  data.img = img;
+  data.rpc = rpc;
+  write_camera_cache(filename, "dg", data);
 }
 
 vw::Vector2i asp::xml_image_size(std::string const& filename){
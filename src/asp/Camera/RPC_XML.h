@@ -49,6 +49,7 @@ namespace asp {
 
   // Forward declaration so we don't need to include this class's header
   class RPCModel;
+  class CameraCache;
   
   /// Objects that represent read data from XML. These also provide a
   /// storage structure for modification later on.
@@ -64,6 +65,9 @@ namespace asp {
 
     void parse( xercesc::DOMElement* node );
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io( CameraCache & cache );
+
     std::string  tlc_start_time;
     std::string  first_line_start_time;
     std::vector<std::pair<double,double> > tlc_vec; // Line -> time offset pairings
@@ -92,6 +96,9 @@ namespace asp {
 
     void parse( xercesc::DOMElement* node );
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io( CameraCache & cache );
+
     double      principal_distance;   // mm
     vw::int32   optical_polyorder;
     vw::Vector<double> optical_a, optical_b; // Don't currently support these
@@ -116,6 +123,17 @@ namespace asp {
 
     void parse( xercesc::DOMElement* node );
 
+    /// The pieces of parse(), for reading the file as a stream. Call
+    /// set_meta(), then add_point() with the text of each EPHEMLIST
+    /// entry, then end_list() with the number of entries.
+    void set_meta( std::string const& start_time, double time_interval,
+                   size_t num_points );
+    void add_point( const char* text );
+    void end_list( size_t count );
+
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io( CameraCache & cache );
+
     std::string start_time;      // UTC
     double time_interval;        // seconds
 
@@ -146,6 +164,16 @@ namespace asp {
 
     void parse( xercesc::DOMElement* node );
 
+    /// The pieces of parse(), for reading the file as a stream, as
+    /// for EphemerisXML.
+    void set_meta( std::string const& start_time, double time_interval,
+                   size_t num_points );
+    void add_point( const char* text );
+    void end_list( size_t count );
+
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io( CameraCache & cache );
+
     std::string start_time;
     double time_interval;
 
@@ -175,11 +203,16 @@ namespace asp {
     void parse_rational_function_model( xercesc::DOMElement* node ); ///< Pleiades / Astrium
     void parse_perusat_model( xercesc::DOMElement* node ); ///< PeruSat-1
 
+    void parse_file( std::string const& name );
+
   public:
     RPCXML();
     void read_from_file( std::string const& name );
     void parse( xercesc::DOMElement* node ) { parse_rpb( node ); }
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io( CameraCache & cache );
+
     // TODO: Why is this function in this class?
     void parse_bbox( xercesc::DOMElement* node ); ///< Read the valid sensor model bounds
 
@@ -23,6 +23,7 @@
 
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
 
@@ -100,9 +101,25 @@ DOMElement* SpotXML::open_xml_file(std::string const& xml_path) {
 }
 
 void SpotXML::read_xml(std::string const& xml_path) {
+  if (read_camera_cache(xml_path, "spot5", *this))
+    return;
+  DOMElement * root = open_xml_file(xml_path);
+  parse_xml(root);
+  write_camera_cache(xml_path, "spot5", *this);
+}
 
-  DOMElement * elementRoot = open_xml_file(xml_path);
-  parse_xml(elementRoot);
+void SpotXML::cache_io(CameraCache & cache) {
+  cache.io(lonlat_corners);
+  cache.io(pixel_corners);
+  cache.io(look_angles);
+  cache.io(pose_logs);
+  cache.io(position_logs);
+  cache.io(velocity_logs);
+  cache.io(image_size);
+  cache.io(line_period);
+  cache.io(center_time);
+  cache.io(center_line);
+  cache.io(center_col);
 }
 
 std::vector<vw::Vector2> SpotXML::get_lonlat_corners(std::string const& xml_path) {
@@ -51,6 +51,8 @@ XERCES_CPP_NAMESPACE_END
 
 namespace asp {
 
+  class CameraCache;
+
   class SpotXML {
   public:
   
@@ -77,6 +79,9 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Save or restore the parsed values, see CameraCache.h
+    void cache_io(CameraCache & cache);
+
     /// Load the estimated image lonlat corners from the XML file
     /// - Corners are returned in clockwise order.
     static std::vector<vw::Vector2> get_lonlat_corners(std::string const& xml_path);
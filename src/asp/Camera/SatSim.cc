@@ -1039,6 +1039,135 @@ void setupCroppedDemAndOrtho(vw::Vector2 const& image_size,
     crop_ortho_georef = crop(ortho_georef, ortho_pixel_box);
 }
 
+// Rasterize a triangle with vertices at pixels p, ground points x, and
+// depths d into the given box. Where the triangle is closer than what is
+// in the z-buffer, save the linearly interpolated ground point.
+void rasterizeTriangle(vw::Vector2 const* p, vw::Vector3 const* x, double const* d,
+                       vw::BBox2i const& bbox,
+                       vw::ImageView<double> & zbuf,
+                       vw::ImageView<vw::Vector3> & ground) {
+
+  double area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1])
+              - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+  if (std::abs(area) < 1e-12)
+    return; // degenerate
+
+  double min_x = std::min(p[0][0], std::min(p[1][0], p[2][0]));
+  double max_x = std::max(p[0][0], std::max(p[1][0], p[2][0]));
+  double min_y = std::min(p[0][1], std::min(p[1][1], p[2][1]));
+  double max_y = std::max(p[0][1], std::max(p[1][1], p[2][1]));
+
+  // A DEM cell should project to a small area. A very large one is
+  // likely a failed projection.
+  if (max_x - min_x > bbox.width() || max_y - min_y > bbox.height())
+    return;
+
+  int beg_col = std::max(bbox.min().x(), int(std::ceil(min_x)));
+  int end_col = std::min(bbox.max().x() - 1, int(std::floor(max_x)));
+  int beg_row = std::max(bbox.min().y(), int(std::ceil(min_y)));
+  int end_row = std::min(bbox.max().y() - 1, int(std::floor(max_y)));
+
+  double eps = 1e-10; // so that pixels on shared edges are not missed
+  for (int row = beg_row; row <= end_row; row++) {
+    for (int col = beg_col; col <= end_col; col++) {
+      // Barycentric coordinates
+      double w0 = ((p[1][0] - col) * (p[2][1] - row)
+                 - (p[1][1] - row) * (p[2][0] - col)) / area;
+      double w1 = ((p[2][0] - col) * (p[0][1] - row)
+                 - (p[2][1] - row) * (p[0][0] - col)) / area;
+      double w2 = 1.0 - w0 - w1;
+      if (w0 < -eps || w1 < -eps || w2 < -eps)
+        continue;
+
+      int c = col - bbox.min().x(), r = row - bbox.min().y();
+      double z = w0 * d[0] + w1 * d[1] + w2 * d[2];
+      if (z >= zbuf(c, r))
+        continue; // occluded
+      zbuf(c, r) = z;
+      ground(c, r) = w0 * x[0] + w1 * x[1] + w2 * x[2];
+    }
+  }
+}
+
+// Find the ground point seen at each pixel in the given box by projecting
+// the DEM pixels into the camera and rasterizing the DEM cells, as two
+// triangles each, with a z-buffer for occlusion. This avoids intersecting
+// a ray from each pixel with the DEM, which needs an iterative solver.
+// Pixels that no cell projects to are set to the zero vector. Return false,
+// without doing anything, if the DEM is much denser than the image, as
+// then projecting it would be slower than intersecting rays.
+bool forwardProjectDem(vw::CamPtr const& cam, vw::BBox2i const& bbox,
+                       vw::ImageView<vw::PixelMask<float>> const& dem,
+                       vw::cartography::GeoReference const& dem_georef,
+                       vw::ImageView<vw::Vector3> & ground) {
+
+  int num_cols = dem.cols(), num_rows = dem.rows();
+  if (double(num_cols) * num_rows > 4.0 * double(bbox.width()) * bbox.height())
+    return false;
+
+  // The depth is measured along the ray through the middle of the box. The
+  // camera is far compared to the extent of the box, so this is enough to
+  // order the points.
+  vw::Vector2 mid = (vw::Vector2(bbox.min()) + vw::Vector2(bbox.max())) / 2.0;
+  vw::Vector3 cam_ctr = cam->camera_center(mid);
+  vw::Vector3 cam_dir = cam->pixel_to_vector(mid);
+
+  // Project the DEM pixels. Mark with NaN those that are invalid, behind
+  // the camera, or fail to project.
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  vw::ImageView<vw::Vector2> pix(num_cols, num_rows);
+  vw::ImageView<vw::Vector3> xyz(num_cols, num_rows);
+  vw::ImageView<double> depth(num_cols, num_rows);
+  for (int col = 0; col < num_cols; col++) {
+    for (int row = 0; row < num_rows; row++) {
+      pix(col, row) = vw::Vector2(nan, nan);
+      if (!is_valid(dem(col, row)))
+        continue;
+      vw::Vector2 lonlat = dem_georef.pixel_to_lonlat(vw::Vector2(col, row));
+      vw::Vector3 llh(lonlat[0], lonlat[1], dem(col, row).child());
+      xyz(col, row) = dem_georef.datum().geodetic_to_cartesian(llh);
+      depth(col, row) = dot_prod(xyz(col, row) - cam_ctr, cam_dir);
+      if (depth(col, row) <= 0)
+        continue;
+      try {
+        pix(col, row) = cam->point_to_pixel(xyz(col, row));
+      } catch (...) {}
+    }
+  }
+
+  vw::ImageView<double> zbuf(bbox.width(), bbox.height());
+  vw::fill(zbuf, std::numeric_limits<double>::max());
+  ground.set_size(bbox.width(), bbox.height());
+  vw::fill(ground, vw::Vector3(0, 0, 0));
+
+  // The two triangles of each cell, as offsets of the corners
+  int tri[2][3][2] = {{{0, 0}, {1, 0}, {1, 1}}, {{0, 0}, {1, 1}, {0, 1}}};
+  for (int col = 0; col < num_cols - 1; col++) {
+    for (int row = 0; row < num_rows - 1; row++) {
+      for (int t = 0; t < 2; t++) {
+        vw::Vector2 p[3];
+        vw::Vector3 x[3];
+        double d[3];
+        bool good = true;
+        for (int v = 0; v < 3; v++) {
+          int c = col + tri[t][v][0], r = row + tri[t][v][1];
+          p[v] = pix(c, r);
+          if (std::isnan(p[v][0])) {
+            good = false;
+            break;
+          }
+          x[v] = xyz(c, r);
+          d[v] = depth(c, r);
+        }
+        if (good)
+          rasterizeTriangle(p, x, d, bbox, zbuf, ground);
+      }
+    }
+  }
+
+  return true;
+}
+
 // Create a synthetic image with multiple threads
 typedef vw::ImageView<vw::PixelMask<float>> ImageT;
 class SynImageView: public vw::ImageViewBase<SynImageView> {
@@ -1127,6 +1256,13 @@ public:
     // if the camera is high, and with a small footprint on the ground.
     vw::Vector3 xyz_guess(0, 0, 0);
 
+    // Unless asked to intersect rays, find the ground points by projecting
+    // the DEM into the image. The rays are intersected only where that fails.
+    vw::ImageView<vw::Vector3> ground;
+    if (!m_opt.ray_trace)
+      forwardProjectDem(m_cam, bbox, crop_dem, crop_dem_georef, ground);
+    bool have_ground = (ground.cols() == bbox.width() && ground.rows() == bbox.height());
+
     vw::ImageView<result_type> tile(bbox.width(), bbox.height());
 
     for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
@@ -1140,31 +1276,36 @@ public:
         tile(c, r) = vw::PixelMask<float>();
         tile(c, r).invalidate();
 
-        // Here use the full image pixel indices
-        vw::Vector2 pix(col, row);
-        // Also use original camera
-        vw::Vector3 cam_ctr = m_cam->camera_center(pix);
-        vw::Vector3 cam_dir = m_cam->pixel_to_vector(pix);
-
-        // Intersect the ray going from the given camera pixel with a DEM
-        // Use xyz_guess as initial guess and overwrite it with the new value
-        bool treat_nodata_as_zero = false;
-        bool has_intersection = false;
-        double max_abs_tol = std::min(m_opt.dem_height_error_tol, 1e-14);
-        double max_rel_tol = max_abs_tol;
-        int num_max_iter = 100;
-        vw::Vector3 xyz = vw::cartography::camera_pixel_to_dem_xyz
-          (cam_ctr, cam_dir, crop_dem,
-            crop_dem_georef, treat_nodata_as_zero,
-            has_intersection, m_opt.dem_height_error_tol, 
-            max_abs_tol, max_rel_tol, 
-            num_max_iter, xyz_guess, m_height_guess);
-
-        if (!has_intersection)
-          continue; // will result in nodata pixels
-
-        // Update the guess for nex time, now that we have a valid intersection point
-        xyz_guess = xyz;
+        vw::Vector3 xyz;
+        if (have_ground && ground(c, r) != vw::Vector3(0, 0, 0)) {
+          xyz = ground(c, r);
+        } else {
+          // Here use the full image pixel indices
+          vw::Vector2 pix(col, row);
+          // Also use original camera
+          vw::Vector3 cam_ctr = m_cam->camera_center(pix);
+          vw::Vector3 cam_dir = m_cam->pixel_to_vector(pix);
+
+          // Intersect the ray going from the given camera pixel with a DEM
+          // Use xyz_guess as initial guess and overwrite it with the new value
+          bool treat_nodata_as_zero = false;
+          bool has_intersection = false;
+          double max_abs_tol = std::min(m_opt.dem_height_error_tol, 1e-14);
+          double max_rel_tol = max_abs_tol;
+          int num_max_iter = 100;
+          xyz = vw::cartography::camera_pixel_to_dem_xyz
+            (cam_ctr, cam_dir, crop_dem,
+              crop_dem_georef, treat_nodata_as_zero,
+              has_intersection, m_opt.dem_height_error_tol, 
+              max_abs_tol, max_rel_tol, 
+              num_max_iter, xyz_guess, m_height_guess);
+
+          if (!has_intersection)
+            continue; // will result in nodata pixels
+
+          // Update the guess for nex time, now that we have a valid intersection point
+          xyz_guess = xyz;
+        }
 
         // Find the texture value at the intersection point by interpolation.
         // This will result in an invalid value if if out of range or if the
@@ -0,0 +1,205 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SolverBackend.cc
+
+#include <asp/Camera/SolverBackend.h>
+#include <asp/Core/MemoryProfile.h>
+#include <asp/Core/Telemetry.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <ceres/version.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+// Features of newer versions of Ceres
+#define ASP_CERES_AT_LEAST(major, minor)                                \
+  (CERES_VERSION_MAJOR > (major) ||                                     \
+   (CERES_VERSION_MAJOR == (major) && CERES_VERSION_MINOR >= (minor)))
+
+#if ASP_CERES_AT_LEAST(2, 1) && !defined(CERES_NO_CUDA)
+#define ASP_HAVE_CERES_CUDA 1
+#else
+#define ASP_HAVE_CERES_CUDA 0
+#endif
+
+#if ASP_HAVE_CERES_CUDA && ASP_CERES_AT_LEAST(2, 3) && !defined(CERES_NO_CUDSS)
+#define ASP_HAVE_CERES_CUDA_SPARSE 1
+#else
+#define ASP_HAVE_CERES_CUDA_SPARSE 0
+#endif
+
+namespace {
+
+  // With fewer cameras than these, the reduced camera system is too
+  // small for the GPU to pay off
+  const int MIN_CAMERAS_FOR_CUDA_DENSE  = 50;
+  const int MIN_CAMERAS_FOR_CUDA_SPARSE = 500;
+
+  void unsupported(std::string const& backend) {
+    vw::vw_throw(vw::ArgumentErr() << "The solver backend " << backend
+                 << " is not supported by the Ceres library this was built with.\n");
+  }
+
+  // Use the GPU for the dense or sparse Schur complement
+  void set_cuda_dense(ceres::Solver::Options & options) {
+#if ASP_HAVE_CERES_CUDA
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+    options.dense_linear_algebra_library_type = ceres::CUDA;
+#else
+    unsupported("cuda_dense_schur");
+#endif
+  }
+
+  void set_cuda_sparse(ceres::Solver::Options & options) {
+#if ASP_HAVE_CERES_CUDA_SPARSE
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+    options.sparse_linear_algebra_library_type = ceres::CUDA_SPARSE;
+#else
+    unsupported("cuda_sparse_schur");
+#endif
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+bool have_cuda_device() {
+#if ASP_HAVE_CERES_CUDA
+  // Respect a request to hide the GPUs
+  const char * visible = getenv("CUDA_VISIBLE_DEVICES");
+  if (visible != NULL && (std::string(visible) == "" || std::string(visible) == "-1"))
+    return false;
+  return fs::exists("/dev/nvidia0");
+#else
+  return false;
+#endif
+}
+
+void set_solver_backend(std::string const& backend, bool mixed_precision,
+                        int num_cameras, ceres::Solver::Options & options) {
+
+  if (backend == "auto") {
+    // Keep the choice of the tool, but move it to the GPU if that helps.
+    // Ceres may still not support the resulting combination, such as for
+    // some preconditioners, so check that.
+    if (have_cuda_device()) {
+      ceres::Solver::Options gpu_options = options;
+      bool use_gpu = false;
+      if (options.linear_solver_type == ceres::DENSE_SCHUR &&
+          num_cameras >= MIN_CAMERAS_FOR_CUDA_DENSE) {
+        set_cuda_dense(gpu_options);
+        use_gpu = true;
+      }
+#if ASP_HAVE_CERES_CUDA_SPARSE
+      if (options.linear_solver_type == ceres::SPARSE_SCHUR &&
+          num_cameras >= MIN_CAMERAS_FOR_CUDA_SPARSE) {
+        set_cuda_sparse(gpu_options);
+        use_gpu = true;
+      }
+#endif
+      std::string error;
+      if (use_gpu && gpu_options.IsValid(&error)) {
+        vw::vw_out() << "Using the GPU for the linear solver.\n";
+        options = gpu_options;
+      }
+    }
+  } else if (backend == "dense_schur") {
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (backend == "sparse_schur") {
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+  } else if (backend == "iterative_schur") {
+    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+  } else if (backend == "iterative_schur_power_series") {
+#if ASP_CERES_AT_LEAST(2, 2)
+    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+    options.preconditioner_type = ceres::SCHUR_POWER_SERIES_EXPANSION;
+#else
+    unsupported(backend);
+#endif
+  } else if (backend == "cuda_dense_schur") {
+    set_cuda_dense(options);
+  } else if (backend == "cuda_sparse_schur") {
+    set_cuda_sparse(options);
+  } else {
+    vw::vw_throw(vw::ArgumentErr() << "Unknown solver backend: " << backend
+                 << ". Use one of: " << SOLVER_BACKENDS << ".\n");
+  }
+
+  if (mixed_precision) {
+#if ASP_CERES_AT_LEAST(2, 1)
+    if (options.linear_solver_type == ceres::ITERATIVE_SCHUR)
+      vw::vw_throw(vw::ArgumentErr() << "Mixed precision solves need a dense "
+                   << "or sparse Schur solver backend.\n");
+    options.use_mixed_precision_solves = true;
+    options.max_num_refinement_iterations = 3;
+#else
+    vw::vw_throw(vw::ArgumentErr() << "Mixed precision solves are not supported "
+                 << "by the Ceres library this was built with.\n");
+#endif
+  }
+
+  std::string error;
+  if (!options.IsValid(&error))
+    vw::vw_throw(vw::ArgumentErr() << "Invalid solver options: " << error << "\n");
+}
+
+void record_problem_size(ceres::Problem & problem) {
+
+  Telemetry & t = telemetry();
+  t.set_value("ceres.residual_blocks",  problem.NumResidualBlocks());
+  t.set_value("ceres.residuals",        problem.NumResiduals());
+  t.set_value("ceres.parameter_blocks", problem.NumParameterBlocks());
+  t.set_value("ceres.parameters",       problem.NumParameters());
+
+  // Going over all residual blocks takes a while, so do it only if asked
+  if (!memory_profile_enabled())
+    return;
+
+  // Each residual has a derivative with respect to each parameter of the
+  // blocks it depends on, which are stored as doubles, once for the
+  // Jacobian and about once more for the Schur complement or the normal
+  // equations.
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+  problem.GetResidualBlocks(&residual_blocks);
+  std::int64_t num_entries = 0;
+  std::vector<double*> blocks;
+  for (auto const& id: residual_blocks) {
+    problem.GetParameterBlocksForResidualBlock(id, &blocks);
+    std::int64_t num_params = 0;
+    for (auto const& b: blocks) {
+      if (!problem.IsParameterBlockConstant(b))
+        num_params += problem.ParameterBlockSize(b);
+    }
+    num_entries += num_params * problem.GetCostFunctionForResidualBlock(id)->num_residuals();
+  }
+
+  // A gauge rather than a value, so that the largest of several
+  // problems solved by a tool is kept
+  static TelemetryGaugeScope jacobian(t.gauge("ceres.jacobian"));
+  jacobian.set(2 * num_entries * std::int64_t(sizeof(double)));
+}
+
+} // end namespace asp
@@ -0,0 +1,54 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SolverBackend.h
+
+// Choose the Ceres linear solver used by bundle_adjust, jitter_solve,
+// and sfs, including the GPU solvers, if Ceres was built with CUDA.
+
+#ifndef __ASP_CAMERA_SOLVER_BACKEND_H__
+#define __ASP_CAMERA_SOLVER_BACKEND_H__
+
+#include <ceres/ceres.h>
+
+#include <string>
+
+namespace asp {
+
+// The values accepted by --solver-backend
+const std::string SOLVER_BACKENDS = "auto, dense_schur, sparse_schur, iterative_schur, "
+  "iterative_schur_power_series, cuda_dense_schur, cuda_sparse_schur";
+
+// If Ceres was built with CUDA and there is a GPU on this machine
+bool have_cuda_device();
+
+// Set the linear solver and preconditioner. The options must already
+// have the default choice of the tool, which is kept for "auto", unless
+// there is a GPU and the problem is large enough to benefit from it.
+// With mixed_precision, the Schur complement is factored in single
+// precision and the solution is refined in double precision.
+void set_solver_backend(std::string const& backend, bool mixed_precision,
+                        int num_cameras, ceres::Solver::Options & options);
+
+// Record the size of the problem in the telemetry of the process. With
+// memory profiling, also estimate the memory of its Jacobian, which is
+// most of what Ceres allocates, as the gauge "ceres.jacobian".
+void record_problem_size(ceres::Problem & problem);
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_SOLVER_BACKEND_H__
@@ -0,0 +1,112 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/ApproxCameraModel.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <vw/Cartography/CameraBBox.h>
+#include <vw/Cartography/Datum.h>
+#include <test/Helpers.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST(ApproxCameraModel, LinescanDG) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr exact = load_dg_camera_model_from_xml("dg_example1.xml");
+  cartography::Datum datum("WGS84");
+
+  // The ground seen by a part of the image
+  BBox2i image_box(0, 0, 2000, 2000);
+  BBox2 lonlat_box;
+  for (int i = 0; i <= 1; i++) {
+    for (int j = 0; j <= 1; j++) {
+      Vector2 pix(i * image_box.width(), j * image_box.height());
+      Vector3 xyz = cartography::datum_intersection(datum, exact->camera_center(pix),
+                                                    exact->pixel_to_vector(pix));
+      lonlat_box.grow(subvector(datum.cartesian_to_geodetic(xyz), 0, 2));
+    }
+  }
+
+  double tol = 0.01;
+  ApproxCameraModel approx(exact, datum, lonlat_box, 0.0, 500.0, image_box, tol);
+  EXPECT_TRUE(approx.point_to_pixel_error()  >= 0.0);
+  EXPECT_TRUE(approx.pixel_to_vector_error() >= 0.0);
+
+  // The error is largest at the middle of the cells, where it was
+  // checked, so anywhere else it is within the tolerance too
+  for (int it = 0; it < 200; it++) {
+    double a = (it % 17) / 17.0, b = (it % 13) / 13.0, c = (it % 7) / 7.0;
+    Vector3 llh(lonlat_box.min()[0] + a * lonlat_box.width(),
+                lonlat_box.min()[1] + b * lonlat_box.height(), 500.0 * c);
+    Vector3 xyz = datum.geodetic_to_cartesian(llh);
+    EXPECT_VECTOR_NEAR(exact->point_to_pixel(xyz), approx.point_to_pixel(xyz), tol);
+
+    Vector2 pix(image_box.width() * b, image_box.height() * a);
+    Vector3 dir = approx.pixel_to_vector(pix);
+    EXPECT_NEAR(1.0, norm_2(dir), 1e-12);
+    EXPECT_VECTOR_NEAR(exact->pixel_to_vector(pix), dir, 1e-7);
+    EXPECT_VECTOR_NEAR(exact->camera_center(pix), approx.camera_center(pix), 1e-2);
+  }
+
+  // Outside the tables the exact camera is used
+  Vector2 far_pix(5000, 5000);
+  EXPECT_VECTOR_NEAR(exact->pixel_to_vector(far_pix), approx.pixel_to_vector(far_pix), 0.0);
+
+  // Save and read back
+  std::string file = "approx_camera_test.bin";
+  approx.write(file);
+  ApproxCameraModel approx2(exact, file);
+  EXPECT_EQ(approx.point_to_pixel_error(), approx2.point_to_pixel_error());
+  for (int it = 0; it < 10; it++) {
+    Vector3 llh(lonlat_box.min()[0] + 0.1 * it * lonlat_box.width(),
+                lonlat_box.min()[1] + 0.05 * it * lonlat_box.height(), 20.0 * it);
+    Vector3 xyz = datum.geodetic_to_cartesian(llh);
+    EXPECT_VECTOR_NEAR(approx.point_to_pixel(xyz), approx2.point_to_pixel(xyz), 0.0);
+    Vector2 pix(100.0 * it, 150.0 * it);
+    EXPECT_VECTOR_NEAR(approx.pixel_to_vector(pix), approx2.pixel_to_vector(pix), 0.0);
+  }
+  boost::filesystem::remove(file);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST(ApproxCameraModel, RaysOnly) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr exact = load_dg_camera_model_from_xml("dg_example1.xml");
+  cartography::Datum datum("WGS84");
+
+  double tol = 0.01;
+  ApproxCameraModel approx(exact, datum, BBox2i(0, 0, 2000, 2000), tol);
+  EXPECT_TRUE(approx.pixel_to_vector_error() >= 0.0);
+  EXPECT_TRUE(approx.point_to_pixel_error()  < 0.0);
+
+  for (int it = 0; it < 50; it++) {
+    Vector2 pix(2000.0 * (it % 11) / 11.0, 2000.0 * (it % 7) / 7.0);
+    EXPECT_VECTOR_NEAR(exact->pixel_to_vector(pix), approx.pixel_to_vector(pix), 1e-7);
+    EXPECT_VECTOR_NEAR(exact->camera_center(pix), approx.camera_center(pix), 1e-2);
+    Vector3 xyz = exact->camera_center(pix) + 5e5 * exact->pixel_to_vector(pix);
+    EXPECT_VECTOR_NEAR(exact->point_to_pixel(xyz), approx.point_to_pixel(xyz), 0.0);
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
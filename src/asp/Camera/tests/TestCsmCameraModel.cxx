@@ -16,6 +16,8 @@
 // __END_LICENSE__
 
 #include <asp/Camera/CsmModel.h>
+#include <asp/Camera/CsmUtils.h>
+#include <usgscsm/Utilities.h>
 #include <boost/scoped_ptr.hpp>
 #include <test/Helpers.h>
 #include <iomanip>
@@ -62,3 +64,29 @@ TEST(CSM_camera, basic_check) {
 
 
 
+
+TEST(CSM_camera, lagrange_stencil) {
+
+  // Stencils agree with lagrangeInterp() everywhere, including near and
+  // beyond the ends of the samples, where it lowers the order.
+  int num = 12, len = 3;
+  double t0 = 10.0, dt = 0.5;
+  std::vector<double> values(num * len);
+  for (size_t it = 0; it < values.size(); it++)
+    values[it] = sin(0.7 * it) + 0.01 * it * it;
+
+  for (int order = 4; order <= 8; order += 4) {
+    std::vector<LagrangeStencil> stencils;
+    int num_out = 60;
+    double t0_out = t0 - 1.0, dt_out = (num * dt + 1.0) / num_out;
+    lagrangeStencils(num, t0, dt, order, t0_out, dt_out, num_out, stencils);
+    ASSERT_EQ(num_out, (int)stencils.size());
+    for (int i = 0; i < num_out; i++) {
+      double expected[3], actual[3];
+      lagrangeInterp(num, &values[0], t0, dt, t0_out + i * dt_out, len, order, expected);
+      applyStencil(stencils[i], &values[0], len, actual);
+      for (int c = 0; c < len; c++)
+        EXPECT_NEAR(expected[c], actual[c], 1e-10);
+    }
+  }
+}
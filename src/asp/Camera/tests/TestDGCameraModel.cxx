@@ -21,6 +21,9 @@
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/RPCModel.h>
 #include <boost/scoped_ptr.hpp>
+#include <xercesc/parsers/XercesDOMParser.hpp>
+
+#include <cstdlib>
 #include <test/Helpers.h>
 
 #include <vw/Stereo/StereoModel.h>
@@ -161,3 +164,96 @@ TEST(DGCameraModel, CreateCamera) {
   XMLPlatformUtils::Terminate();
 }
 
+
+TEST(DGCameraModel, PointsToPixels) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr cam_ptr = load_dg_camera_model_from_xml("dg_example1.xml");
+  DGCameraModel * cam = dynamic_cast<DGCameraModel*>(cam_ptr.get());
+  ASSERT_TRUE(cam != 0);
+
+  // Points seen along rows of a tile, and points projecting above and
+  // below the image lines, which are seeded by extrapolation.
+  std::vector<Vector2> pixels;
+  for (int row = -2000; row < 26000; row += 1000) {
+    for (int col = 0; col < 35000; col += 5000)
+      pixels.push_back(Vector2(col, row + 0.25 * col / 5000.0));
+  }
+  std::vector<Vector3> points;
+  for (size_t it = 0; it < pixels.size(); it++)
+    points.push_back(cam->camera_center(pixels[it]) +
+                     5e5 * cam->pixel_to_vector(pixels[it]));
+
+  std::vector<Vector2> out;
+  cam->points_to_pixels(points, out);
+  ASSERT_EQ(pixels.size(), out.size());
+  for (size_t it = 0; it < pixels.size(); it++) {
+    EXPECT_VECTOR_NEAR(pixels[it], out[it], 1e-4);
+    EXPECT_VECTOR_NEAR(out[it], cam->point_to_pixel(points[it]), 1e-6);
+  }
+
+  XMLPlatformUtils::Terminate();
+}
+
+TEST(DGCameraModel, PoseTable) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr cam_ptr = load_dg_camera_model_from_xml("dg_example1.xml");
+  DGCameraModel * cam = dynamic_cast<DGCameraModel*>(cam_ptr.get());
+  ASSERT_TRUE(cam != 0);
+
+  // The table agrees with the interpolation functions it is built from,
+  // including at lines between its nodes.
+  for (double line = 0; line < cam->get_image_size()[1]; line += 123.4) {
+    double t = cam->get_time_at_line(line);
+    EXPECT_VECTOR_NEAR(cam->get_position_func()(t), cam->get_camera_center_at_time(t),
+                       10 * POSE_TABLE_POSITION_TOL);
+    vw::Quat q = cam->get_pose_func()(t), r = cam->get_camera_pose_at_time(t);
+    vw::Vector3 v(0.3, -0.2, 1.0);
+    EXPECT_VECTOR_NEAR(q.rotate(v), r.rotate(v), 10 * POSE_TABLE_ANGLE_TOL);
+  }
+
+  XMLPlatformUtils::Terminate();
+}
+
+TEST(StereoSessionDG, StreamingMatchesDOM) {
+  XMLPlatformUtils::Initialize();
+
+  // read_xml() parses EPH and ATT as a stream. Compare with parse()
+  // on a DOM of the whole file.
+  setenv("ASP_CAMERA_CACHE", "0", 1);
+  GeometricXML geo;
+  AttitudeXML  att1, att2;
+  EphemerisXML eph1, eph2;
+  ImageXML     img;
+  RPCXML       rpc;
+  read_xml("dg_example1.xml", geo, att1, eph1, img, rpc);
+  unsetenv("ASP_CAMERA_CACHE");
+
+  boost::scoped_ptr<XercesDOMParser> parser(new XercesDOMParser());
+  parser->parse("dg_example1.xml");
+  DOMElement* root = parser->getDocument()->getDocumentElement();
+  eph2.parse(XmlUtils::get_node<DOMElement>(root, "EPH"));
+  att2.parse(XmlUtils::get_node<DOMElement>(root, "ATT"));
+
+  EXPECT_TRUE(eph1.is_good());
+  EXPECT_TRUE(att1.is_good());
+  EXPECT_EQ(eph2.start_time, eph1.start_time);
+  EXPECT_EQ(eph2.time_interval, eph1.time_interval);
+  ASSERT_EQ(eph2.satellite_position_vec.size(), eph1.satellite_position_vec.size());
+  for (size_t i = 0; i < eph1.satellite_position_vec.size(); i++) {
+    EXPECT_VECTOR_NEAR(eph2.satellite_position_vec[i], eph1.satellite_position_vec[i], 0.0);
+    EXPECT_VECTOR_NEAR(eph2.velocity_vec[i], eph1.velocity_vec[i], 0.0);
+  }
+  EXPECT_TRUE(eph2.satellite_pos_cov == eph1.satellite_pos_cov);
+  EXPECT_EQ(att2.start_time, att1.start_time);
+  ASSERT_EQ(att2.satellite_quat_vec.size(), att1.satellite_quat_vec.size());
+  for (size_t i = 0; i < att1.satellite_quat_vec.size(); i++)
+    EXPECT_VECTOR_NEAR(att2.satellite_quat_vec[i], att1.satellite_quat_vec[i], 0.0);
+  EXPECT_TRUE(att2.satellite_quat_cov == att1.satellite_quat_cov);
+
+  parser.reset();
+  XMLPlatformUtils::Terminate();
+}
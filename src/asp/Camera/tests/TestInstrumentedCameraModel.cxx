@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/InstrumentedCameraModel.h>
+#include <asp/Core/Telemetry.h>
+#include <test/Helpers.h>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+namespace {
+
+  // A camera at the origin looking down the z axis, which cannot see
+  // points behind it
+  class TestCamera: public camera::CameraModel {
+  public:
+    virtual std::string type() const { return "Test"; }
+    virtual Vector2 point_to_pixel(Vector3 const& point) const {
+      if (point[2] <= 0)
+        vw_throw(camera::PointToPixelErr() << "Point behind the camera.\n");
+      return Vector2(point[0] / point[2], point[1] / point[2]);
+    }
+    virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
+      return normalize(Vector3(pix[0], pix[1], 1));
+    }
+    virtual Vector3 camera_center(Vector2 const& pix) const {
+      return Vector3();
+    }
+  };
+}
+
+TEST(InstrumentedCameraModel, CountsCalls) {
+
+  vw::CamPtr exact(new TestCamera);
+  InstrumentedCameraModel cam(exact, "test");
+  EXPECT_EQ("Test", cam.type());
+  EXPECT_EQ(exact.get(), cam.underlying_camera().get());
+
+  for (int it = 0; it < 100; it++) {
+    Vector3 xyz(0.01 * it, -0.02 * it, 30);
+    EXPECT_VECTOR_NEAR(exact->point_to_pixel(xyz), cam.point_to_pixel(xyz), 1e-12);
+  }
+  Vector2 pix(100, 200);
+  EXPECT_VECTOR_NEAR(exact->pixel_to_vector(pix), cam.pixel_to_vector(pix), 1e-12);
+  EXPECT_VECTOR_NEAR(exact->camera_center(pix), cam.camera_center(pix), 1e-12);
+
+  // Failures are passed on, and counted
+  EXPECT_THROW(cam.point_to_pixel(Vector3(0, 0, -10)), camera::PointToPixelErr);
+
+  Telemetry & t = telemetry();
+  EXPECT_EQ(101, t.counter("camera.test.point_to_pixel").value());
+  EXPECT_EQ(1, t.counter("camera.test.point_to_pixel.failures").value());
+  EXPECT_EQ(1, t.counter("camera.test.pixel_to_vector").value());
+  // Only some calls are timed individually
+  std::int64_t num_timed = t.histogram("camera.test.point_to_pixel.seconds").count();
+  EXPECT_GE(num_timed, 1);
+  EXPECT_LE(num_timed, 100);
+
+  // Without ASP_CAMERA_TELEMETRY set, cameras are not wrapped
+  if (!camera_telemetry_enabled())
+    EXPECT_EQ(exact.get(), instrument_camera(exact, "test").get());
+}
@@ -0,0 +1,147 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+// Performance tests, see src/test/Perf.h. The budgets are a few times
+// the work done when these were written.
+
+#include <test/Helpers.h>
+#include <test/Perf.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/InstrumentedCameraModel.h>
+#include <asp/Core/InterpolatedTransform.h>
+#include <asp/Core/Telemetry.h>
+
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  std::int64_t count(std::string const& name) {
+    return telemetry().counter(name).value();
+  }
+
+  // A map grid on a flat surface seen by the camera, with pixels of
+  // about the size of the camera pixels, as when mapprojecting. Map
+  // pixel (0, 0) is seen at the given camera pixel.
+  struct FlatMapTransform: public vw::TransformBase<FlatMapTransform> {
+    vw::CamPtr m_cam;
+    Vector3 m_origin, m_dx, m_dy;
+
+    FlatMapTransform(vw::CamPtr cam, Vector2 const& pix): m_cam(cam) {
+      const double step = 100.0;
+      m_origin = ground(pix);
+      m_dx = (ground(pix + Vector2(step, 0)) - m_origin) / step;
+      m_dy = (ground(pix + Vector2(0, step)) - m_origin) / step;
+    }
+    Vector3 ground(Vector2 const& pix) const {
+      return m_cam->camera_center(pix) + 5e5 * m_cam->pixel_to_vector(pix);
+    }
+    Vector2 reverse(Vector2 const& p) const {
+      return m_cam->point_to_pixel(m_origin + p[0] * m_dx + p[1] * m_dy);
+    }
+    Vector2 forward(Vector2 const& p) const { return p; }
+  };
+}
+
+TEST(PerfDGCameraModel, LineSolverWork) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr cam_ptr = load_dg_camera_model_from_xml("dg_example1.xml");
+  DGCameraModel * cam = dynamic_cast<DGCameraModel*>(cam_ptr.get());
+  ASSERT_TRUE(cam != 0);
+
+  // Points seen across the image
+  Vector2i size = cam->get_image_size();
+  std::vector<Vector3> points;
+  for (int row = 0; row < size.y(); row += size.y() / 20) {
+    for (int col = 0; col < size.x(); col += size.x() / 10) {
+      Vector2 pix(col, row);
+      points.push_back(cam->camera_center(pix) + 5e5 * cam->pixel_to_vector(pix));
+    }
+  }
+  std::int64_t num = points.size();
+
+  std::int64_t calls0 = count("dg.line_solver.calls");
+  std::int64_t steps0 = count("dg.line_solver.secant_steps");
+  std::int64_t falls0 = count("dg.line_solver.lma_fallbacks");
+  std::int64_t evals0 = count("dg.line_solver.lma_evaluations");
+
+  const int num_reps = 5;
+  asp::perf::Timer timer;
+  for (int rep = 0; rep < num_reps; rep++) {
+    for (size_t it = 0; it < points.size(); it++)
+      cam->point_to_pixel(points[it]);
+  }
+  double seconds = timer.seconds();
+
+  std::int64_t calls = count("dg.line_solver.calls")          - calls0;
+  std::int64_t steps = count("dg.line_solver.secant_steps")   - steps0;
+  std::int64_t falls = count("dg.line_solver.lma_fallbacks")  - falls0;
+  std::int64_t evals = count("dg.line_solver.lma_evaluations") - evals0;
+
+  // Each projection solves for the line once
+  EXPECT_EQ(num_reps * num, calls);
+
+  // The fast solver converges in a few steps, and the slow one is rarely needed
+  EXPECT_OPS_WITHIN_BUDGET(steps, 6 * calls);
+  EXPECT_OPS_WITHIN_BUDGET(falls, calls / 10);
+  EXPECT_OPS_WITHIN_BUDGET(evals, 10 * calls);
+  EXPECT_TIME_WITHIN_BUDGET(seconds, 1.0);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST(PerfMapproject, CameraCallsPerTile) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  vw::CamPtr cam = load_dg_camera_model_from_xml("dg_example1.xml");
+  Vector2i size = dynamic_cast<DGCameraModel*>(cam.get())->get_image_size();
+
+  // Count the camera calls for a tile, with the transform interpolated
+  // on a grid, as with mapproject --transform-grid-step 16.
+  vw::CamPtr counted(new InstrumentedCameraModel(cam, "perf_mapproject"));
+  FlatMapTransform trans(counted, Vector2(size.x() / 2, size.y() / 2));
+  InterpolatedTransform<FlatMapTransform> interp(trans, 16, 0.01, size);
+
+  std::string name = "camera.perf_mapproject.point_to_pixel";
+  std::int64_t calls0 = count(name);
+  asp::perf::Timer timer;
+
+  BBox2i tile(0, 0, 256, 256);
+  interp.reverse_bbox(tile);
+  for (int row = tile.min().y(); row < tile.max().y(); row++) {
+    for (int col = tile.min().x(); col < tile.max().x(); col++)
+      interp.reverse(Vector2(col, row));
+  }
+  double seconds = timer.seconds();
+  std::int64_t calls = count(name) - calls0;
+
+  // The interpolation is still accurate
+  FlatMapTransform exact(cam, Vector2(size.x() / 2, size.y() / 2));
+  EXPECT_VECTOR_NEAR(exact.reverse(Vector2(101, 57)), interp.reverse(Vector2(101, 57)), 0.01);
+
+  // At least 16 times fewer calls than pixels
+  EXPECT_GT(calls, 0);
+  EXPECT_OPS_WITHIN_BUDGET(calls, tile.width() * tile.height() / 16);
+  EXPECT_TIME_WITHIN_BUDGET(seconds, 2.0);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
@@ -28,9 +28,13 @@
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Camera/LinescanDGModel.h>
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCModelGen.h>
 #include <asp/Camera/RPCStereoModel.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Core/StereoSettings.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
 
 
 using namespace vw;
@@ -192,6 +196,158 @@ TEST( StereoSessionRPC, InstantiateTest ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST( RPCXML, CameraCache ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  // Work on a copy, so the cache files can be removed at the end
+  std::string xml_file = "dg_example1_cache.xml";
+  boost::filesystem::copy_file("dg_example1.xml", xml_file,
+                               boost::filesystem::copy_option::overwrite_if_exists);
+  std::string rpc_cache = camera_cache_file(xml_file, "rpc");
+  std::string dg_cache  = camera_cache_file(xml_file, "dg");
+  boost::filesystem::remove(rpc_cache);
+  boost::filesystem::remove(dg_cache);
+
+  // The first time the XML is parsed and the cache written, then it is read
+  RPCXML xml1, xml2;
+  xml1.read_from_file(xml_file);
+  EXPECT_TRUE(boost::filesystem::exists(rpc_cache));
+  xml2.read_from_file(xml_file);
+  EXPECT_TRUE(xml2.is_good());
+  EXPECT_VECTOR_NEAR(xml1.rpc_ptr()->xy_offset(), xml2.rpc_ptr()->xy_offset(), 0.0);
+  EXPECT_VECTOR_NEAR(xml1.rpc_ptr()->lonlatheight_scale(),
+                     xml2.rpc_ptr()->lonlatheight_scale(), 0.0);
+  for (int i = 0; i < 20; i++) {
+    EXPECT_EQ(xml1.rpc_ptr()->line_num_coeff()[i],   xml2.rpc_ptr()->line_num_coeff()[i]);
+    EXPECT_EQ(xml1.rpc_ptr()->sample_den_coeff()[i], xml2.rpc_ptr()->sample_den_coeff()[i]);
+  }
+  EXPECT_EQ(xml1.rpc_ptr()->datum().semi_major_axis(),
+            xml2.rpc_ptr()->datum().semi_major_axis());
+
+  GeometricXML geo1, geo2;
+  AttitudeXML  att1, att2;
+  EphemerisXML eph1, eph2;
+  ImageXML     img1, img2;
+  RPCXML       rpc1, rpc2;
+  read_xml(xml_file, geo1, att1, eph1, img1, rpc1);
+  EXPECT_TRUE(boost::filesystem::exists(dg_cache));
+  read_xml(xml_file, geo2, att2, eph2, img2, rpc2);
+  EXPECT_EQ(eph1.start_time, eph2.start_time);
+  ASSERT_EQ(eph1.satellite_position_vec.size(), eph2.satellite_position_vec.size());
+  for (size_t i = 0; i < eph1.satellite_position_vec.size(); i++)
+    EXPECT_VECTOR_NEAR(eph1.satellite_position_vec[i], eph2.satellite_position_vec[i], 0.0);
+  ASSERT_EQ(att1.satellite_quat_vec.size(), att2.satellite_quat_vec.size());
+  EXPECT_EQ(img1.tlc_vec, img2.tlc_vec);
+  EXPECT_EQ(img1.image_size, img2.image_size);
+  EXPECT_EQ(geo1.detector_pixel_pitch, geo2.detector_pixel_pitch);
+  EXPECT_EQ(geo1.is_good(), geo2.is_good());
+
+  // A changed XML file makes the cache stale
+  {
+    std::ofstream ofs(xml_file.c_str(), std::ios::app);
+    ofs << "\n";
+  }
+  RPCXML xml3;
+  xml3.read_from_file(xml_file);
+  EXPECT_VECTOR_NEAR(xml1.rpc_ptr()->xy_scale(), xml3.rpc_ptr()->xy_scale(), 0.0);
+
+  boost::filesystem::remove(rpc_cache);
+  boost::filesystem::remove(dg_cache);
+  boost::filesystem::remove(xml_file);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( RPCModel, LinearFit ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  // Samples of an RPC model, in normalized coordinates
+  int num = 10, numPts = num * num * num;
+  Vector<double> geodetics(RPCModel::GEODETIC_COORD_SIZE * numPts);
+  Vector<double> pixels(RPCModel::IMAGE_COORD_SIZE * numPts + RpcSolveLMA::NUM_PENALTY_TERMS);
+  for (size_t it = 0; it < pixels.size(); it++)
+    pixels[it] = 0.0;
+  int count = 0;
+  for (int i = 0; i < num; i++) {
+    for (int j = 0; j < num; j++) {
+      for (int k = 0; k < num; k++) {
+        Vector3 G(-1.0 + 2.0 * i / (num - 1), -1.0 + 2.0 * j / (num - 1),
+                  -1.0 + 2.0 * k / (num - 1));
+        subvector(geodetics, RPCModel::GEODETIC_COORD_SIZE * count,
+                  RPCModel::GEODETIC_COORD_SIZE) = G;
+        subvector(pixels, RPCModel::IMAGE_COORD_SIZE * count, RPCModel::IMAGE_COORD_SIZE)
+          = RPCModel::normalized_geodetic_to_normalized_pixel
+          (G, model.line_num_coeff(), model.line_den_coeff(),
+           model.sample_num_coeff(), model.sample_den_coeff());
+        count++;
+      }
+    }
+  }
+
+  // With no penalty the samples are fit exactly
+  RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
+  gen_rpc(0.0, "", geodetics, pixels, model.lonlatheight_scale(),
+          model.lonlatheight_offset(), model.xy_scale(), model.xy_offset(),
+          line_num, line_den, samp_num, samp_den);
+  EXPECT_EQ(1.0, line_den[0]);
+  EXPECT_EQ(1.0, samp_den[0]);
+  for (int it = 0; it < numPts; it++) {
+    Vector3 G = subvector(geodetics, RPCModel::GEODETIC_COORD_SIZE * it,
+                          RPCModel::GEODETIC_COORD_SIZE);
+    Vector2 pix = RPCModel::normalized_geodetic_to_normalized_pixel
+      (G, line_num, line_den, samp_num, samp_den);
+    EXPECT_VECTOR_NEAR(subvector(pixels, RPCModel::IMAGE_COORD_SIZE * it,
+                                 RPCModel::IMAGE_COORD_SIZE), pix, 1e-8);
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( RPCModel, BatchEvaluation ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  // More points than in a block, so that a partial block is exercised
+  std::vector<Vector3> llh;
+  for (int it = 0; it < 2 * RPCModel::RPC_BLOCK_SIZE + 7; it++)
+    llh.push_back(Vector3(-105.29 + 1e-3 * (it % 13), 39.745 + 1e-3 * (it % 11),
+                          2281 + 5.0 * (it % 7)));
+
+  std::vector<Vector2> pixels;
+  model.geodetics_to_pixels(llh, pixels);
+  ASSERT_EQ(llh.size(), pixels.size());
+  for (size_t it = 0; it < llh.size(); it++)
+    EXPECT_VECTOR_NEAR(model.geodetic_to_pixel(llh[it]), pixels[it], 1e-8);
+
+  std::vector<Vector3> xyz;
+  for (size_t it = 0; it < llh.size(); it++)
+    xyz.push_back(model.datum().geodetic_to_cartesian(llh[it]));
+  model.points_to_pixels(xyz, pixels);
+  ASSERT_EQ(xyz.size(), pixels.size());
+  for (size_t it = 0; it < xyz.size(); it++)
+    EXPECT_VECTOR_NEAR(model.point_to_pixel(xyz[it]), pixels[it], 1e-8);
+
+  // Going back to the ground with the batched version
+  std::vector<double> heights;
+  for (size_t it = 0; it < llh.size(); it++)
+    heights.push_back(llh[it][2]);
+  model.geodetics_to_pixels(llh, pixels);
+  std::vector<Vector2> lonlats;
+  model.image_to_ground(pixels, heights, lonlats);
+  ASSERT_EQ(pixels.size(), lonlats.size());
+  for (size_t it = 0; it < llh.size(); it++)
+    EXPECT_VECTOR_NEAR(subvector(llh[it], 0, 2), lonlats[it], 1e-9);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 TEST( StereoSessionRPC, CheckStereo ) {
 
   xercesc::XMLPlatformUtils::Initialize();
@@ -20,6 +20,7 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/InterestPointMatching.h>  // Slow-to-compile header
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
+#include <asp/Core/Ransac.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/Matrix.h>
 #include <vw/Math/RANSAC.h>
@@ -30,6 +31,10 @@
 
 #include <opencv2/calib3d.hpp>
 
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
 #include <vector>
 
 using namespace vw;
@@ -37,31 +42,93 @@ using namespace vw::math;
 
 namespace asp {
 
+  // The fits below add up products over all matches. That is done in
+  // chunks of this many matches, in parallel, with the chunk sums added
+  // in order, so the result does not depend on the number of threads.
+  const size_t AFFINE_EPI_CHUNK = 16384;
+
+  // Sum the array filled in by func(i, sum) for each i in [0, num).
+  template <int N, class FuncT>
+  std::array<double, N> chunked_sum(size_t num, FuncT const& func) {
+    int num_chunks = (num + AFFINE_EPI_CHUNK - 1) / AFFINE_EPI_CHUNK;
+    std::vector<std::array<double, N>> sums(num_chunks);
+#pragma omp parallel for schedule(static) if (num_chunks > 1)
+    for (int c = 0; c < num_chunks; c++) {
+      sums[c].fill(0.0);
+      size_t end = std::min(num, (c + 1) * AFFINE_EPI_CHUNK);
+      for (size_t i = c * AFFINE_EPI_CHUNK; i < end; i++)
+        func(i, sums[c]);
+    }
+    std::array<double, N> total;
+    total.fill(0.0);
+    for (int c = 0; c < num_chunks; c++) {
+      for (int k = 0; k < N; k++)
+        total[k] += sums[c][k];
+    }
+    return total;
+  }
+
+  // Solve the least squares problem with the given normal equations
+  template <int N>
+  Vector<double> solve_normal_equations(std::array<double, N * N + N> const& sums) {
+    Eigen::Matrix<double, N, N> AtA;
+    Eigen::Matrix<double, N, 1> Atb;
+    for (int r = 0; r < N; r++) {
+      for (int c = 0; c < N; c++)
+        AtA(r, c) = sums[N * r + c];
+      Atb(r) = sums[N * N + r];
+    }
+    Eigen::Matrix<double, N, 1> x = AtA.colPivHouseholderQr().solve(Atb);
+    Vector<double> out(N);
+    for (int r = 0; r < N; r++)
+      out[r] = x(r);
+    return out;
+  }
+
   // Solves for Affine Fundamental Matrix as per instructions in
-  // Multiple View Geometry. Outlier elimination happens later. 
+  // Multiple View Geometry. Outlier elimination happens later. The
+  // normal to the hyperplane best fitting the centered matches is the
+  // eigenvector of their 4 x 4 scatter matrix for the smallest
+  // eigenvalue. That is the same as the left singular vector of the
+  // matrix of matches, but does not need the SVD of a matrix with as
+  // many columns as there are matches.
   Matrix<double>
   linear_affine_fundamental_matrix(std::vector<ip::InterestPoint> const& ip1,
                                    std::vector<ip::InterestPoint> const& ip2) {
 
+    size_t num = ip1.size();
+    auto match = [&](size_t i) {
+      return Eigen::Vector4d(ip2[i].x, ip2[i].y, ip1[i].x, ip1[i].y);
+    };
+
     // (i) Compute the centroid of X and delta X
-    Matrix<double> delta_x(ip1.size(), 4);
-    Vector4 mean_x;
-    for (size_t i = 0; i < ip1.size(); i++) {
-      delta_x(i, 0) = ip2[i].x;
-      delta_x(i, 1) = ip2[i].y;
-      delta_x(i, 2) = ip1[i].x;
-      delta_x(i, 3) = ip1[i].y;
-      mean_x += select_row(delta_x, i) / double(ip1.size());
+    std::array<double, 4> sum
+      = chunked_sum<4>(num, [&](size_t i, std::array<double, 4> & s) {
+          Eigen::Vector4d X = match(i);
+          for (int k = 0; k < 4; k++)
+            s[k] += X[k];
+        });
+    Eigen::Vector4d mean(sum[0], sum[1], sum[2], sum[3]);
+    mean /= double(num);
+
+    std::array<double, 16> scatter
+      = chunked_sum<16>(num, [&](size_t i, std::array<double, 16> & s) {
+          Eigen::Vector4d d = match(i) - mean;
+          for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++)
+              s[4 * r + c] += d[r] * d[c];
+          }
+        });
+    Eigen::Matrix4d S;
+    for (int r = 0; r < 4; r++) {
+      for (int c = 0; c < 4; c++)
+        S(r, c) = scatter[4 * r + c];
     }
-    
-    for (size_t i = 0; i < ip1.size(); i++) 
-      select_row(delta_x,i) -= mean_x;
-
-    Matrix<double> U, VT;
-    Vector<double> S;
-    svd(transpose(delta_x), U, S, VT);
-    Vector<double> N = select_col(U, 3);
-    double e = -transpose(N) * mean_x;
+
+    // The eigenvalues are in increasing order
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> solver(S);
+    Eigen::Vector4d N = solver.eigenvectors().col(0);
+    double e = -N.dot(mean);
     Matrix<double> f(3,3);
     f(0,2) = N(0);
     f(1,2) = N(1);
@@ -72,20 +139,26 @@ namespace asp {
     return f;
   }
 
+  // The affine matrices have the last row (0, 0, 1). The fits below use
+  // their entries directly, rather than multiplying matrices per match.
   void solve_y_scaling(std::vector<ip::InterestPoint> const & ip1,
                        std::vector<ip::InterestPoint> const & ip2,
                        Matrix<double>                       & affine_left,
                        Matrix<double>                       & affine_right) {
-    
-    Matrix<double> a(ip1.size(), 2);
-    Vector<double> b(ip1.size());
-    
-    for (size_t i = 0; i < ip1.size(); i++) {
-      select_row(a, i) = subvector(affine_right*Vector3(ip2[i].x, ip2[i].y, 1), 1, 2);
-      b[i]             = (affine_left*Vector3(ip1[i].x, ip1[i].y, 1))(1);
-    }
 
-    Vector<double> scaling = least_squares(a, b);
+    Matrix<double> const& L = affine_left;
+    Matrix<double> const& R = affine_right;
+    std::array<double, 6> sums
+      = chunked_sum<6>(ip1.size(), [&](size_t i, std::array<double, 6> & s) {
+          double a0 = R(1,0) * ip2[i].x + R(1,1) * ip2[i].y + R(1,2);
+          double a1 = 1.0;
+          double b  = L(1,0) * ip1[i].x + L(1,1) * ip1[i].y + L(1,2);
+          s[0] += a0 * a0; s[1] += a0 * a1;
+          s[2] += a1 * a0; s[3] += a1 * a1;
+          s[4] += a0 * b;  s[5] += a1 * b;
+        });
+
+    Vector<double> scaling = solve_normal_equations<2>(sums);
     submatrix(affine_right,0,0,2,2) *= scaling[0];
     affine_right(1,2) = scaling[1];
   }
@@ -94,16 +167,24 @@ namespace asp {
                      std::vector<ip::InterestPoint> const & ip2,
                      Matrix<double>                       & affine_left,
                      Matrix<double>                       & affine_right) {
-    
-    Matrix<double> a(ip1.size(), 3);
-    Vector<double> b(ip1.size());
-    
-    for (size_t i = 0; i < ip1.size(); i++) {
-      select_row(a, i) = affine_right * Vector3(ip2[i].x, ip2[i].y, 1);
-      b[i] = (affine_left * Vector3(ip1[i].x, ip1[i].y, 1))(0);
-    }
 
-    Vector<double> shear = least_squares(a, b);
+    Matrix<double> const& L = affine_left;
+    Matrix<double> const& R = affine_right;
+    std::array<double, 12> sums
+      = chunked_sum<12>(ip1.size(), [&](size_t i, std::array<double, 12> & s) {
+          double a[3];
+          a[0] = R(0,0) * ip2[i].x + R(0,1) * ip2[i].y + R(0,2);
+          a[1] = R(1,0) * ip2[i].x + R(1,1) * ip2[i].y + R(1,2);
+          a[2] = 1.0;
+          double b = L(0,0) * ip1[i].x + L(0,1) * ip1[i].y + L(0,2);
+          for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++)
+              s[3 * r + c] += a[r] * a[c];
+            s[9 + r] += a[r] * b;
+          }
+        });
+
+    Vector<double> shear = solve_normal_equations<3>(sums);
     Matrix<double> interm = math::identity_matrix<3>();
     interm(0, 1) = -shear[1] / 2.0;
     affine_left = interm * affine_left;
@@ -252,12 +333,11 @@ namespace asp {
                        InterestPointT const& ip1,
                        InterestPointT const& ip2) const {
 
-      Matrix<double> left_matrix  = submatrix(T, 0, 0, 3, 3);
-      Matrix<double> right_matrix = submatrix(T, 0, 3, 3, 3);
-
-      Vector3 L = left_matrix  * Vector3(ip1.x, ip1.y, 1);
-      Vector3 R = right_matrix * Vector3(ip2.x, ip2.y, 1);
-      double diff = L[1] - R[1];
+      // The y components of the left and right matrices times the points.
+      // This is called for each match and model, so avoid making matrices.
+      double L1 = T(1, 0) * ip1.x + T(1, 1) * ip1.y + T(1, 2);
+      double R1 = T(1, 3) * ip2.x + T(1, 4) * ip2.y + T(1, 5);
+      double diff = L1 - R1;
       return std::abs(diff);
     }
   };
@@ -312,10 +392,12 @@ namespace asp {
     BestFitEpipolarAlignment func(left_image_dims, right_image_dims, crop_to_shared_area);
     EpipolarAlignmentError error_metric;
     std::vector<size_t> inlier_indices;
-    RandomSampleConsensus<BestFitEpipolarAlignment, EpipolarAlignmentError> 
+    asp::ParallelRansac<BestFitEpipolarAlignment, EpipolarAlignmentError> 
       ransac(func, error_metric,
              num_ransac_iterations, inlier_threshold,
              min_num_output_inliers, reduce_min_num_output_inliers_if_no_fit);
+    ransac.set_sample_order(descriptor_distance_order(ip1, ip2));
+    ransac.set_local_optimization(true);
     
     T = ransac(ip1, ip2);
     inlier_indices = ransac.inlier_indices(T, ip1, ip2);
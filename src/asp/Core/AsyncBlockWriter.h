@@ -0,0 +1,291 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file AsyncBlockWriter.h
+///
+/// Write an image to a GeoTIFF with its blocks computed in parallel and
+/// written in order by a single thread, so that the compute threads never
+/// wait on the file. The blocks done but not yet written are kept in a
+/// bounded queue, of twice the number of threads, so a thread computes
+/// the next block while the previous one is being written. Compression
+/// is done by a pool of GDAL threads, rather than by whoever writes the
+/// block. This is used by block_write_approx_gdal_image(),
+/// block_write_compact_gdal_image(), and save_with_temp_big_blocks(), in
+/// asp/Core/Common.h.
+///
+/// The blocks written are recorded in a journal (asp/Core/BlockJournal.h),
+/// so that, with --resume, a run which was killed does not compute
+/// them again.
+
+#ifndef __ASP_CORE_ASYNC_BLOCK_WRITER_H__
+#define __ASP_CORE_ASYNC_BLOCK_WRITER_H__
+
+#include <asp/Core/BigTileWriter.h>
+#include <asp/Core/BlockJournal.h>
+#include <asp/Core/ObjectStorage.h>
+#include <asp/Core/Telemetry.h>
+
+#include <vw/Image/PixelMask.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
+
+namespace asp {
+
+  // Pixels with a mask are written by VW, which knows how to turn the
+  // mask into the nodata value
+  template <class ImageT>
+  void async_block_write_gdal_image_impl(std::string const& filename,
+                                         vw::ImageViewBase<ImageT> const& img,
+                                         bool has_georef,
+                                         vw::cartography::GeoReference const& georef,
+                                         bool has_nodata, double nodata,
+                                         vw::GdalWriteOptions const& opt,
+                                         vw::ProgressCallback const& tpc,
+                                         std::map<std::string, std::string> const& keywords,
+                                         std::true_type /*is_masked*/) {
+    vw::cartography::block_write_gdal_image(filename, img.impl(), has_georef, georef,
+                                            has_nodata, nodata, opt, tpc, keywords);
+  }
+
+  /// Read a region of some bands into an image, one channel per band
+  template <class PixelT>
+  void read_bands(std::vector<GDALRasterBand*> const& bands,
+                  vw::ImageView<PixelT> & img, int col, int row) {
+
+    typedef typename vw::CompoundChannelType<PixelT>::type ChannelT;
+    for (size_t c = 0; c < bands.size(); c++) {
+      char * start = (char*)img.data() + c * sizeof(ChannelT);
+      CPLErr err = bands[c]->RasterIO(GF_Read, col, row, img.cols(), img.rows(), start,
+                                      img.cols(), img.rows(), gdal_data_type(ChannelT()),
+                                      sizeof(PixelT), sizeof(PixelT) * img.cols());
+      if (err != CE_None)
+        vw_throw(vw::IOErr() << "Failed to read an image region.\n");
+    }
+  }
+
+  template <class ImageT>
+  void async_block_write_gdal_image_impl(std::string const& filename,
+                                         vw::ImageViewBase<ImageT> const& img,
+                                         bool has_georef,
+                                         vw::cartography::GeoReference const& georef,
+                                         bool has_nodata, double nodata,
+                                         vw::GdalWriteOptions const& opt,
+                                         vw::ProgressCallback const& tpc,
+                                         std::map<std::string, std::string> const& keywords,
+                                         std::false_type /*is_masked*/) {
+
+    typedef typename ImageT::pixel_type PixelT;
+    int cols = img.impl().cols(), rows = img.impl().rows();
+    int block_x = std::max(1, int(opt.raster_tile_size[0]));
+    int block_y = std::max(1, int(opt.raster_tile_size[1]));
+
+    // The blocks already written are recorded in a journal, so that, with
+    // --resume, a run which was killed continues where it stopped
+    std::ostringstream layout;
+    layout << cols << " " << rows << " " << block_x << " " << block_y << " "
+           << sizeof(PixelT) << " " << vw::CompoundNumChannels<PixelT>::value;
+    BlockJournal journal(filename, layout.str(), resume_block_writes());
+
+    // Create the file, with the desired blocks, georef, and nodata value.
+    // Closing it leaves the blocks unwritten.
+    if (!journal.resuming()) {
+      boost::shared_ptr<vw::DiskImageResourceGDAL>
+        rsrc(vw::cartography::build_gdal_rsrc(filename, img, opt));
+      if (has_nodata)
+        rsrc->set_nodata_write(nodata);
+      if (has_georef)
+        vw::cartography::write_georeference(*rsrc, georef);
+    }
+
+    std::vector<vw::BBox2i> blocks;
+    for (int row = 0; row < rows; row += block_y) {
+      for (int col = 0; col < cols; col += block_x) {
+        blocks.push_back(vw::BBox2i(col, row,
+                                    std::min(block_x, cols - col),
+                                    std::min(block_y, rows - row)));
+      }
+    }
+
+    int num_threads = opt.num_threads;
+    if (num_threads <= 0)
+      num_threads = vw::vw_settings().default_num_threads();
+    num_threads = std::max(1, num_threads);
+
+    // The GDAL threads compress the blocks as they are written
+    std::string threads_option = "NUM_THREADS=" + std::to_string(num_threads);
+    const char * open_options[] = {threads_option.c_str(), NULL};
+    GDALDataset * dataset
+      = (GDALDataset*)GDALOpenEx(filename.c_str(), GDAL_OF_RASTER | GDAL_OF_UPDATE,
+                                 NULL, open_options, NULL);
+    if (dataset == NULL)
+      vw_throw(vw::IOErr() << "Cannot open for writing: " << filename << ".\n");
+    for (auto it = keywords.begin(); it != keywords.end(); it++)
+      dataset->SetMetadataItem(it->first.c_str(), it->second.c_str());
+    std::vector<GDALRasterBand*> bands;
+    for (int b = 1; b <= dataset->GetRasterCount(); b++)
+      bands.push_back(dataset->GetRasterBand(b));
+
+    // The blocks to compute. When resuming, those in the journal are
+    // skipped if they read back as they were written.
+    std::vector<size_t> todo;
+    for (size_t it = 0; it < blocks.size(); it++) {
+      std::uint64_t hash = 0;
+      if (journal.find(it, hash)) {
+        vw::ImageView<PixelT> block(blocks[it].width(), blocks[it].height());
+        read_bands(bands, block, blocks[it].min().x(), blocks[it].min().y());
+        if (block_hash(block.data(), sizeof(PixelT) * block.cols() * block.rows()) == hash)
+          continue;
+      }
+      todo.push_back(it);
+    }
+    size_t num_skipped = blocks.size() - todo.size();
+    if (journal.resuming())
+      vw::vw_out() << "Resuming " << filename << ", with " << num_skipped << " of "
+                   << blocks.size() << " blocks already written.\n";
+
+    // The blocks done and not yet written, by position in the list. A
+    // thread does not start a block until it is within the queue size of
+    // the next one to write, which bounds the memory.
+    size_t queue_size = 2 * num_threads;
+    std::map<size_t, vw::ImageView<PixelT>> done;
+    size_t next_block = 0, num_written = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cond;
+    TelemetryGauge & queue_memory = telemetry().gauge("async_writer.queue");
+    std::int64_t block_bytes = std::int64_t(block_x) * block_y * sizeof(PixelT);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min(num_threads, int(todo.size())); t++) {
+      threads.push_back(std::thread([&]() {
+        while (1) {
+          size_t it = 0;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (error || next_block >= todo.size())
+              return;
+            it = next_block++;
+            cond.wait(lock, [&]() { return error || it < num_written + queue_size; });
+            if (error)
+              return;
+          }
+          try {
+            TraceScope trace("compute_block", "task", blocks[todo[it]]);
+            vw::ImageView<PixelT> block = crop(img.impl(), blocks[todo[it]]);
+            std::lock_guard<std::mutex> lock(mutex);
+            done[it] = block;
+            queue_memory.add(block_bytes);
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+              error = std::current_exception();
+          }
+          cond.notify_all();
+        }
+      }));
+    }
+
+    // Write the blocks in order, as they become available. Every few
+    // seconds, flush them to disk and record them in the journal.
+    const double JOURNAL_INTERVAL = 10.0; // seconds
+    auto last_commit = std::chrono::steady_clock::now();
+    for (size_t it = 0; it < todo.size(); it++) {
+      vw::ImageView<PixelT> block;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return error || done.find(it) != done.end(); });
+        if (error)
+          break;
+        block = done[it];
+        done.erase(it);
+      }
+      try {
+        vw::BBox2i const& box = blocks[todo[it]];
+        TraceScope trace("write_block", "write", box);
+        write_bands(bands, block, box.min().x(), box.min().y());
+        journal.add(todo[it],
+                    block_hash(block.data(), sizeof(PixelT) * block.cols() * block.rows()));
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - last_commit).count() > JOURNAL_INTERVAL) {
+          dataset->FlushCache();
+          journal.commit();
+          last_commit = now;
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue_memory.add(-block_bytes);
+        num_written++;
+      }
+      cond.notify_all();
+      tpc.report_fractional_progress(num_skipped + it + 1, blocks.size());
+    }
+
+    for (size_t it = 0; it < threads.size(); it++)
+      threads[it].join();
+    queue_memory.add(-block_bytes * std::int64_t(done.size()));
+    GDALClose(dataset);
+    if (error) {
+      // Keep what was written, for resuming
+      journal.commit();
+      std::rethrow_exception(error);
+    }
+    journal.finish();
+    tpc.report_finished();
+  }
+
+  /// Write an image with its blocks computed in parallel by opt.num_threads
+  /// threads, and written and compressed on other threads. The arguments
+  /// are as for vw::cartography::block_write_gdal_image().
+  template <class ImageT>
+  void async_block_write_gdal_image(std::string const& filename,
+                                    vw::ImageViewBase<ImageT> const& img,
+                                    bool has_georef,
+                                    vw::cartography::GeoReference const& georef,
+                                    bool has_nodata, double nodata,
+                                    vw::GdalWriteOptions const& opt,
+                                    vw::ProgressCallback const& tpc,
+                                    std::map<std::string, std::string> const& keywords =
+                                    std::map<std::string, std::string>()) {
+    // Write an output to object storage locally first, then upload it
+    if (is_object_storage_path(filename)) {
+      ObjectStorageOutput output(filename);
+      async_block_write_gdal_image(output.local_path(), img, has_georef, georef,
+                                   has_nodata, nodata, opt, tpc, keywords);
+      output.upload();
+      return;
+    }
+
+    typedef typename ImageT::pixel_type PixelT;
+    async_block_write_gdal_image_impl(filename, img, has_georef, georef,
+                                      has_nodata, nodata, opt, tpc, keywords,
+                                      std::integral_constant<bool,
+                                      vw::IsMasked<PixelT>::value>());
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_ASYNC_BLOCK_WRITER_H__
@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file AsyncPrefetcher.cc
+///
+
+#include <asp/Core/AsyncPrefetcher.h>
+#include <asp/Core/Trace.h>
+
+#include <vw/Core/Log.h>
+
+namespace asp {
+
+AsyncPrefetcher::AsyncPrefetcher(int max_pending):
+  m_max_pending(std::max(max_pending, 1)), m_stop(false) {
+  m_thread = std::thread(&AsyncPrefetcher::run, this);
+}
+
+AsyncPrefetcher::~AsyncPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_tasks.clear();
+  }
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+bool AsyncPrefetcher::request(int64_t key, std::function<void()> const& task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop || !m_seen.insert(key).second)
+      return false;
+    m_tasks.push_back(task);
+    while (int(m_tasks.size()) > m_max_pending)
+      m_tasks.pop_front();
+  }
+  m_cv.notify_all();
+  return true;
+}
+
+void AsyncPrefetcher::run() {
+  while (1) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]{ return m_stop || !m_tasks.empty(); });
+      if (m_stop)
+        return;
+      task = m_tasks.front();
+      m_tasks.pop_front();
+    }
+
+    try {
+      TraceScope trace("prefetch", "read");
+      task();
+    } catch (std::exception const& e) {
+      vw::vw_out(vw::DebugMessage, "asp") << "Prefetching failed: " << e.what() << "\n";
+    }
+  }
+}
+
+} // end namespace asp
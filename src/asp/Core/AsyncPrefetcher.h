@@ -0,0 +1,86 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file AsyncPrefetcher.h
+///
+/// Read image regions on a background thread before they are needed, so
+/// that their blocks are in the VW block cache when a tile is processed.
+/// This hides file system latency when tiles are accessed in a predictable
+/// order, as in correlation.
+
+#ifndef __ASP_CORE_ASYNC_PREFETCHER_H__
+#define __ASP_CORE_ASYNC_PREFETCHER_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Math/BBox.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace asp {
+
+  /// Runs prefetch tasks in order on one I/O thread. Prefetching is only a
+  /// hint, so when too many tasks are pending the oldest ones are dropped,
+  /// and any exceptions are ignored. The destructor waits for the current
+  /// task and discards the rest.
+  class AsyncPrefetcher {
+  public:
+    AsyncPrefetcher(int max_pending = 4);
+    ~AsyncPrefetcher();
+
+    /// Queue a task. Each key is accepted only once, so concurrent callers
+    /// asking for the same data do not read it twice. Return false if the
+    /// key was seen before.
+    bool request(int64_t key, std::function<void()> const& task);
+
+  private:
+    void run();
+
+    int                               m_max_pending;
+    bool                              m_stop;
+    std::deque<std::function<void()>> m_tasks;
+    std::set<int64_t>                 m_seen;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cv;
+    std::thread                       m_thread;
+  };
+
+  /// Bring a region of an image into the block cache. The region is read in
+  /// strips, so the memory used does not grow with its size. Pixels outside
+  /// the image are skipped.
+  template <class PixelT>
+  void prefetch_region(vw::ImageViewRef<PixelT> const& image, vw::BBox2i box,
+                       int strip_rows = 256) {
+    box.crop(vw::bounding_box(image));
+    for (int row = box.min().y(); row < box.max().y(); row += strip_rows) {
+      int num_rows = std::min(strip_rows, box.max().y() - row);
+      vw::ImageView<PixelT> strip
+        = vw::crop(image, box.min().x(), row, box.width(), num_rows);
+    }
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_ASYNC_PREFETCHER_H__
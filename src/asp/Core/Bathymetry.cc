@@ -133,6 +133,12 @@ namespace asp {
     return ans;
   }
 
+  // The same, with the plane given by its normal and fourth coefficient
+  inline double signed_dist_to_plane(vw::Vector3 const& normal, double offset,
+                                     vw::Vector3 const& point) {
+    return dot_prod(normal, point) + offset;
+  }
+
   // Compute the projected coordinates of an ECEF point
   inline Vector3 proj_point(vw::cartography::GeoReference const& projection,
                             Vector3 const& xyz) {
@@ -147,23 +153,25 @@ namespace asp {
 
   // Given a ECEF point xyz, and two planes, find if xyz is above or below each of the
   // plane by finding the signed distances to them.
+  // The planes are given by their normals and fourth coefficients.
   void signed_distances_to_planes(bool use_curved_water_surface,
                                   std::vector<BathyPlaneSettings> const& bathy_set,
+                                  vw::Vector3 const plane_normal[2],
+                                  double const plane_offset[2],
                                   vw::Vector3 const& xyz,
-                                  std::vector<double> & distances) {
+                                  double distances[2]) {
     
     if (bathy_set.size() != 2) 
       vw_throw(vw::ArgumentErr() << "Two bathy planes expected.\n");
     
-    distances.resize(2);
     for (size_t it = 0; it < 2; it++) {
       // For a curved water surface need to first convert xyz to projected coordinates
       if (use_curved_water_surface)
-        distances[it] = signed_dist_to_plane(bathy_set[it].bathy_plane,
+        distances[it] = signed_dist_to_plane(plane_normal[it], plane_offset[it],
                                              proj_point(bathy_set[it].water_surface_projection,
                                                         xyz));
       else
-        distances[it] = signed_dist_to_plane(bathy_set[it].bathy_plane, xyz);
+        distances[it] = signed_dist_to_plane(plane_normal[it], plane_offset[it], xyz);
     }
   }
 
@@ -219,20 +227,27 @@ namespace asp {
                   std::vector<double> const& plane,
                   double refraction_index, 
                   Vector3 & out_xyz, Vector3 & out_dir) {
+    return snells_law(in_xyz, in_dir, Vector3(plane[0], plane[1], plane[2]), plane[3],
+                      refraction_index, out_xyz, out_dir);
+  }
+  
+  // See the .h file for more info
+  bool snells_law(Vector3 const& in_xyz, Vector3 const& in_dir,
+                  Vector3 const& plane_normal, double plane_offset,
+                  double refraction_index, 
+                  Vector3 & out_xyz, Vector3 & out_dir) {
 
     // The ray is given as in_xyz + alpha * in_dir, where alpha is real.
     // See where it intersects the plane.
-    double cn = 0.0, dn = 0.0; // Dot product of in_xyz and in_dir with plane normal n
-    for (size_t it = 0; it < 3; it++) {
-      cn += plane[it] * in_xyz[it];
-      dn += plane[it] * in_dir[it];
-    }
+    // Dot product of in_xyz and in_dir with plane normal n
+    double cn = dot_prod(plane_normal, in_xyz);
+    double dn = dot_prod(plane_normal, in_dir);
 
     // The ray must descend to the plane, or else something is not right
     if (dn >= 0.0)
       return false;
     
-    double alpha = -(plane[3] + cn)/dn;
+    double alpha = -(plane_offset + cn)/dn;
   
     // The intersection with the plane
     out_xyz = in_xyz + alpha * in_dir;
@@ -281,7 +296,7 @@ namespace asp {
       return false; // must not happen
     
     // The normalized direction after the ray is bent
-    out_dir = -Vector3(plane[0], plane[1], plane[2]) + alpha * in_dir;
+    out_dir = -plane_normal + alpha * in_dir;
     out_dir = out_dir / norm_2(out_dir);
 
     return true;
@@ -341,19 +356,15 @@ namespace asp {
   // a point on the outgoing ray in projected coordinates Find another
   // close point further along it. Undo the projection for these two
   // points. That will give the outgoing direction in ECEF.
+  // The radii of the mean water surface are passed in, as found in
+  // BathyStereoModel::set_bathy().
   bool snells_law_curved(Vector3 const& in_xyz, Vector3 const& in_dir,
-                         std::vector<double> const& plane,
+                         Vector3 const& plane_normal, double plane_offset,
+                         double major_radius, double minor_radius,
                          vw::cartography::GeoReference const& water_surface_projection,
                          double refraction_index, 
                          Vector3 & out_xyz, Vector3 & out_dir) {
         
-    // Find the mean water surface
-    double mean_ht = -plane[3] / plane[2];
-    double major_radius
-      = water_surface_projection.datum().semi_major_axis() + mean_ht;
-    double minor_radius
-      = water_surface_projection.datum().semi_minor_axis() + mean_ht;
-          
     // Intersect the ray with the mean water surface, this will
     // give us the initial guess for intersecting with that
     // surface. The precise value of this is not important, as
@@ -373,7 +384,7 @@ namespace asp {
     // Snell's law in projected coordinates
     Vector3 out_proj_xyz, out_proj_dir;
     bool ans = snells_law(in_proj_xyz, in_proj_dir,
-                          plane, refraction_index,
+                          plane_normal, plane_offset, refraction_index,
                           out_proj_xyz, out_proj_dir);
 
     // If Snell's law failed to work, exit early
@@ -396,6 +407,8 @@ namespace asp {
     // position on the ray changes by under 2.6e-8, so it is not worth
     // it. It is rather slow too.  Then one would need to still
     // recompute out_dir somehow, if doing things this way.
+    std::vector<double> plane = {plane_normal[0], plane_normal[1], plane_normal[2],
+                                 plane_offset};
     SolveCurvedPlaneIntersection model(in_xyz, in_dir, water_surface_projection, plane);
     vw::Vector<double> objective(1), start(1);
     start[0] = norm_2(out_xyz - in_xyz);
@@ -408,7 +421,7 @@ namespace asp {
     
 #if 0
     // Sanity check
-    test_snells_law(plane,  
+    test_snells_law({plane_normal[0], plane_normal[1], plane_normal[2], plane_offset},
                     water_surface_projection,  
                     refraction_index,
                     out_xyz, in_dir, out_dir,
@@ -452,6 +465,22 @@ namespace asp {
        m_single_bathy_plane = false;
     if (m_bathy_set[0].bathy_plane != m_bathy_set[1].bathy_plane)
       m_single_bathy_plane = false;
+
+    // Unpack the planes and find the mean water surfaces once
+    for (int it = 0; it < 2; it++) {
+      std::vector<double> const& plane = m_bathy_set[it].bathy_plane;
+      m_plane_normal[it] = Vector3(plane[0], plane[1], plane[2]);
+      m_plane_offset[it] = plane[3];
+      m_water_major_radius[it] = 0.0;
+      m_water_minor_radius[it] = 0.0;
+      if (m_bathy_set[it].use_curved_water_surface) {
+        double mean_ht = -plane[3] / plane[2];
+        vw::cartography::Datum const& datum
+          = m_bathy_set[it].water_surface_projection.datum();
+        m_water_major_radius[it] = datum.semi_major_axis() + mean_ht;
+        m_water_minor_radius[it] = datum.semi_minor_axis() + mean_ht;
+      }
+    }
   }
 
   // Compute the rays intersection. Note that even if we are in
@@ -542,7 +571,8 @@ namespace asp {
       
         if (!use_curved_water_surface) {
           
-          double ht_val = signed_dist_to_plane(m_bathy_set[0].bathy_plane, uncorr_tri_pt);
+          double ht_val = signed_dist_to_plane(m_plane_normal[0], m_plane_offset[0],
+                                               uncorr_tri_pt);
           if (ht_val >= 0) {
             // the rays intersect above the water surface, no need to go on
             did_bathy = false;
@@ -551,7 +581,8 @@ namespace asp {
           
           // The simple case, when the water surface is a plane in ECEF
           for (size_t it = 0; it < 2; it++) {
-            bool ans = snells_law(camCtrs[it], camDirs[it], m_bathy_set[it].bathy_plane,
+            bool ans = snells_law(camCtrs[it], camDirs[it],
+                                  m_plane_normal[it], m_plane_offset[it],
                                   m_refraction_index, 
                                   waterCtrs[it], waterDirs[it]);
             // If Snell's law failed to work, return the result before it
@@ -566,7 +597,7 @@ namespace asp {
           // The more complex case, the water surface is curved. It is
           // however flat (a plane) if we switch to proj coordinates.
           Vector3 proj_pt = proj_point(m_bathy_set[0].water_surface_projection, uncorr_tri_pt);
-          double ht_val = signed_dist_to_plane(m_bathy_set[0].bathy_plane, proj_pt);
+          double ht_val = signed_dist_to_plane(m_plane_normal[0], m_plane_offset[0], proj_pt);
           if (ht_val >= 0) {
             // the rays intersect above the water surface
             did_bathy = false;
@@ -576,7 +607,8 @@ namespace asp {
           for (size_t it = 0; it < 2; it++) {
             // Bend each ray at the surface according to Snell's law.
             bool ans = snells_law_curved(camCtrs[it], camDirs[it],
-                                         m_bathy_set[it].bathy_plane,  
+                                         m_plane_normal[it], m_plane_offset[it],
+                                         m_water_major_radius[it], m_water_minor_radius[it],
                                          m_bathy_set[it].water_surface_projection,
                                          m_refraction_index,
                                          waterCtrs[it], waterDirs[it]);
@@ -600,7 +632,7 @@ namespace asp {
       if (!use_curved_water_surface) {
         for (size_t it = 0; it < 2; it++) {
           bool ans = snells_law(camCtrs[it], camDirs[it],
-                                m_bathy_set[it].bathy_plane,  
+                                m_plane_normal[it], m_plane_offset[it],
                                 m_refraction_index,
                                 waterCtrs[it], waterDirs[it]);
           if (!ans)
@@ -610,7 +642,8 @@ namespace asp {
         for (size_t it = 0; it < 2; it++) {
           // Bend each ray at the surface according to Snell's law.
           bool ans = snells_law_curved(camCtrs[it], camDirs[it],
-                                       m_bathy_set[it].bathy_plane,  
+                                       m_plane_normal[it], m_plane_offset[it],
+                                       m_water_major_radius[it], m_water_minor_radius[it],
                                        m_bathy_set[it].water_surface_projection,
                                        m_refraction_index,
                                        waterCtrs[it], waterDirs[it]);
@@ -626,11 +659,12 @@ namespace asp {
       // rays. Handle all these with much care. 
 
       Vector3 err, tri_pt;
-      std::vector<double> signed_dists;
+      double signed_dists[2];
 
       // See if the unbent portions intersect above their planes
       tri_pt = triangulate_pair(camDirs[0], camCtrs[0], camDirs[1], camCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set,
+                                 m_plane_normal, m_plane_offset, tri_pt, signed_dists);
       if (signed_dists[0] >= 0 && signed_dists[1] >= 0) {
         did_bathy = false; // since the rays did not reach the bathy plane
         errorVec = err;
@@ -639,7 +673,8 @@ namespace asp {
       
       // See if the bent portions intersect below their planes
       tri_pt = triangulate_pair(waterDirs[0], waterCtrs[0], waterDirs[1], waterCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set,
+                                 m_plane_normal, m_plane_offset, tri_pt, signed_dists);
       if (signed_dists[0] <= 0 && signed_dists[1] <= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -649,7 +684,8 @@ namespace asp {
       // See if the left unbent portion intersects the right bent portion,
       // above left's water plane and below right's water plane
       tri_pt = triangulate_pair(camDirs[0], camCtrs[0], waterDirs[1], waterCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set,
+                                 m_plane_normal, m_plane_offset, tri_pt, signed_dists);
       if (signed_dists[0] >= 0 && signed_dists[1] <= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -659,7 +695,8 @@ namespace asp {
       // See if the left bent portion intersects the right unbent portion,
       // below left's water plane and above right's water plane
       tri_pt = triangulate_pair(waterDirs[0], waterCtrs[0], camDirs[1], camCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set,
+                                 m_plane_normal, m_plane_offset, tri_pt, signed_dists);
       if (signed_dists[0] <= 0 && signed_dists[1] >= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -51,6 +51,14 @@ namespace asp {
   bool snells_law(vw::Vector3 const& in_xyz, vw::Vector3 const& in_dir,
                   std::vector<double> const& plane, double refraction_index,
                            vw::Vector3 & out_xyz, vw::Vector3 & out_dir);
+
+  // The same, with the plane given by its normal (the first three
+  // coefficients) and the fourth coefficient. This avoids unpacking the
+  // plane for each ray.
+  bool snells_law(vw::Vector3 const& in_xyz, vw::Vector3 const& in_dir,
+                  vw::Vector3 const& plane_normal, double plane_offset,
+                  double refraction_index,
+                  vw::Vector3 & out_xyz, vw::Vector3 & out_dir);
   
   class BathyStereoModel: public vw::stereo::StereoModel {
   public:
@@ -99,6 +107,13 @@ namespace asp {
     bool m_single_bathy_plane;                   // if the left and right images use same plane 
     double m_refraction_index;                   // Water refraction index
     std::vector<BathyPlaneSettings> m_bathy_set; // Bathy plane settings
+
+    // Found from m_bathy_set in set_bathy(), rather than for each ray.
+    // For a curved water surface, the planes are in projected coordinates,
+    // and the mean water surface is a spheroid with the given radii.
+    vw::Vector3 m_plane_normal[2];
+    double m_plane_offset[2];
+    double m_water_major_radius[2], m_water_minor_radius[2];
   };
   
 } // end namespace asp
@@ -0,0 +1,294 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BigTileWriter.h
+///
+/// Write an image which must be computed in big tiles, such as a mosaic
+/// which needs to blend over a large neighborhood, to a file with the
+/// usual small blocks. The big tiles are computed in parallel and written
+/// as they are done, so the image is written only once, rather than
+/// first with big blocks and then again with small ones, as
+/// save_with_temp_big_blocks() does. Optionally, internal overviews are
+/// made at the same time, so the result is ready for viewing over the
+/// network without running gdaladdo.
+
+#ifndef __ASP_CORE_BIG_TILE_WRITER_H__
+#define __ASP_CORE_BIG_TILE_WRITER_H__
+
+#include <asp/Core/ObjectStorage.h>
+#include <asp/Core/ProgressStatus.h>
+#include <asp/Core/Trace.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Core/Settings.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+#include <vw/FileIO/GdalWriteOptions.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMath.h>
+#include <vw/Image/PixelTypeInfo.h>
+
+#include <gdal.h>
+#include <gdal_priv.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace asp {
+
+  /// The GDAL type for each channel type the tools write
+  inline GDALDataType gdal_data_type(vw::uint8 )  { return GDT_Byte;    }
+  inline GDALDataType gdal_data_type(vw::uint16)  { return GDT_UInt16;  }
+  inline GDALDataType gdal_data_type(vw::int16 )  { return GDT_Int16;   }
+  inline GDALDataType gdal_data_type(vw::uint32)  { return GDT_UInt32;  }
+  inline GDALDataType gdal_data_type(vw::int32 )  { return GDT_Int32;   }
+  inline GDALDataType gdal_data_type(float     )  { return GDT_Float32; }
+  inline GDALDataType gdal_data_type(double    )  { return GDT_Float64; }
+
+  /// Convert an average back to the channel type, rounding and
+  /// clamping for integer types.
+  template <class ChannelT>
+  ChannelT average_to_channel(double val) {
+    if (std::numeric_limits<ChannelT>::is_integer)
+      return vw::round_and_clamp<ChannelT>(val);
+    return ChannelT(val);
+  }
+
+  /// Halve the size of an image, averaging the valid values of each
+  /// 2x2 block, for each channel. A pixel with no valid values gets
+  /// the nodata value.
+  template <class PixelT>
+  vw::ImageView<PixelT> downsample_by_two(vw::ImageView<PixelT> const& img,
+                                          bool has_nodata, double nodata) {
+
+    typedef typename vw::CompoundChannelType<PixelT>::type ChannelT;
+    const int num_channels = vw::CompoundNumChannels<PixelT>::value;
+
+    vw::ImageView<PixelT> out((img.cols() + 1)/2, (img.rows() + 1)/2);
+    for (int row = 0; row < out.rows(); row++) {
+      for (int col = 0; col < out.cols(); col++) {
+        for (int c = 0; c < num_channels; c++) {
+          double sum = 0.0;
+          int count = 0;
+          for (int r = 2*row; r < std::min(2*row + 2, img.rows()); r++) {
+            for (int k = 2*col; k < std::min(2*col + 2, img.cols()); k++) {
+              double val = vw::compound_select_channel<ChannelT const&>(img(k, r), c);
+              if (has_nodata && (val == nodata || std::isnan(val)))
+                continue;
+              sum += val;
+              count++;
+            }
+          }
+          vw::compound_select_channel<ChannelT&>(out(col, row), c)
+            = (count > 0) ? average_to_channel<ChannelT>(sum/count) : ChannelT(nodata);
+        }
+      }
+    }
+    return out;
+  }
+
+  /// Write an image to a region of some bands, one per channel
+  template <class PixelT>
+  void write_bands(std::vector<GDALRasterBand*> const& bands,
+                   vw::ImageView<PixelT> const& img, int col, int row) {
+
+    typedef typename vw::CompoundChannelType<PixelT>::type ChannelT;
+    if (bands.empty())
+      return;
+    // The last tile of an overview may extend a bit beyond it
+    int cols = std::min(img.cols(), bands[0]->GetXSize() - col);
+    int rows = std::min(img.rows(), bands[0]->GetYSize() - row);
+    if (cols <= 0 || rows <= 0)
+      return;
+    for (size_t c = 0; c < bands.size(); c++) {
+      char * start = (char*)img.data() + c * sizeof(ChannelT);
+      CPLErr err = bands[c]->RasterIO(GF_Write, col, row, cols, rows, start,
+                                      cols, rows, gdal_data_type(ChannelT()),
+                                      sizeof(PixelT), sizeof(PixelT) * img.cols());
+      if (err != CE_None)
+        vw_throw(vw::IOErr() << "Failed to write an image region.\n");
+    }
+  }
+
+  /// Save an image which is computed in tiles of size big_tile_size.
+  /// That is rounded up to a multiple of the block size of the file, so
+  /// that each block is written once. Up to opt.num_threads tiles are
+  /// computed at the same time.
+  ///
+  /// If add_overviews is true, also make internal overviews, each half
+  /// the size of the previous one, until they fit in a block. They are
+  /// found by averaging the tiles as they are written, so the image is
+  /// not read back. For that, the tile size is also rounded up to a
+  /// multiple of the factor of the smallest overview.
+  template <class ImageT>
+  void save_in_big_tiles(int big_tile_size,
+                         std::string const& filename,
+                         vw::ImageViewBase<ImageT> const& img,
+                         bool has_georef,
+                         vw::cartography::GeoReference const& georef,
+                         bool has_nodata, double nodata,
+                         vw::GdalWriteOptions const& opt,
+                         vw::ProgressCallback const& tpc,
+                         bool add_overviews = false,
+                         std::map<std::string, std::string> const& keywords =
+                         std::map<std::string, std::string>()) {
+
+    // Write an output to object storage locally first, then upload it
+    if (is_object_storage_path(filename)) {
+      ObjectStorageOutput output(filename);
+      save_in_big_tiles(big_tile_size, output.local_path(), img, has_georef, georef,
+                        has_nodata, nodata, opt, tpc, add_overviews, keywords);
+      output.upload();
+      return;
+    }
+
+    typedef typename ImageT::pixel_type PixelT;
+    int cols = img.impl().cols(), rows = img.impl().rows();
+    set_progress_total(tpc, double(cols) * rows);
+
+    // Create the file, with the desired blocks, georef, and nodata value.
+    // Closing it leaves the blocks unwritten.
+    {
+      boost::shared_ptr<vw::DiskImageResourceGDAL>
+        rsrc(vw::cartography::build_gdal_rsrc(filename, img, opt));
+      if (has_nodata)
+        rsrc->set_nodata_write(nodata);
+      if (has_georef)
+        vw::cartography::write_georeference(*rsrc, georef);
+    }
+
+    int block_x = std::max(1, int(opt.raster_tile_size[0]));
+    int block_y = std::max(1, int(opt.raster_tile_size[1]));
+    int num_levels = 0;
+    while (add_overviews && std::max(cols, rows) > (std::max(block_x, block_y) << num_levels))
+      num_levels++;
+
+    // The tile size must be a multiple of both the block size and of
+    // the factor of the smallest overview
+    int factor = 1 << num_levels;
+    int mult_x = block_x, mult_y = block_y;
+    while (mult_x % factor != 0) mult_x += block_x;
+    while (mult_y % factor != 0) mult_y += block_y;
+    int tile_x  = mult_x * std::max(1, (big_tile_size + mult_x - 1) / mult_x);
+    int tile_y  = mult_y * std::max(1, (big_tile_size + mult_y - 1) / mult_y);
+
+    std::vector<vw::BBox2i> tiles;
+    for (int row = 0; row < rows; row += tile_y) {
+      for (int col = 0; col < cols; col += tile_x) {
+        tiles.push_back(vw::BBox2i(col, row,
+                                   std::min(tile_x, cols - col),
+                                   std::min(tile_y, rows - row)));
+      }
+    }
+
+    int num_threads = opt.num_threads;
+    if (num_threads <= 0)
+      num_threads = vw::vw_settings().default_num_threads();
+    num_threads = std::max(1, std::min(num_threads, int(tiles.size())));
+
+    GDALDataset * dataset = (GDALDataset*)GDALOpen(filename.c_str(), GA_Update);
+    if (dataset == NULL)
+      vw_throw(vw::IOErr() << "Cannot open for writing: " << filename << ".\n");
+    for (auto it = keywords.begin(); it != keywords.end(); it++)
+      dataset->SetMetadataItem(it->first.c_str(), it->second.c_str());
+
+    if (num_levels > 0) {
+      // Make empty overviews, to be filled in below
+      std::vector<int> levels;
+      for (int level = 1; level <= num_levels; level++)
+        levels.push_back(1 << level);
+      if (dataset->BuildOverviews("NONE", num_levels, &levels[0], 0, NULL,
+                                  NULL, NULL) != CE_None) {
+        GDALClose(dataset);
+        vw_throw(vw::IOErr() << "Failed to create overviews for: " << filename << ".\n");
+      }
+      vw::vw_out() << "Adding " << num_levels << " overviews.\n";
+    }
+
+    // The bands of the image, and of each overview
+    std::vector<std::vector<GDALRasterBand*>> bands(num_levels + 1);
+    for (int b = 1; b <= dataset->GetRasterCount(); b++) {
+      GDALRasterBand * band = dataset->GetRasterBand(b);
+      bands[0].push_back(band);
+      for (int level = 1; level <= num_levels; level++)
+        bands[level].push_back(band->GetOverview(level - 1));
+    }
+
+    // Compute a batch of tiles and their overviews in parallel, then
+    // write them in order
+    std::vector<std::vector<vw::ImageView<PixelT>>> data(num_threads);
+    for (size_t start = 0; start < tiles.size(); start += num_threads) {
+      tpc.report_fractional_progress(start, tiles.size());
+      size_t end = std::min(tiles.size(), start + num_threads);
+
+      std::vector<std::exception_ptr> errors(end - start);
+      std::vector<std::thread> threads;
+      for (size_t it = start; it < end; it++) {
+        threads.push_back(std::thread([&, it]() {
+          try {
+            TraceScope trace("compute_tile", "task", tiles[it]);
+            std::vector<vw::ImageView<PixelT>> & levels = data[it - start];
+            levels.resize(num_levels + 1);
+            levels[0] = crop(img.impl(), tiles[it]);
+            for (int level = 1; level <= num_levels; level++)
+              levels[level] = downsample_by_two(levels[level - 1], has_nodata, nodata);
+          } catch (...) {
+            errors[it - start] = std::current_exception();
+          }
+        }));
+      }
+      for (size_t it = 0; it < threads.size(); it++)
+        threads[it].join();
+
+      try {
+        for (size_t it = 0; it < errors.size(); it++) {
+          if (errors[it])
+            std::rethrow_exception(errors[it]);
+        }
+        for (size_t it = start; it < end; it++) {
+          TraceScope trace("write_tile", "write", tiles[it]);
+          for (int level = 0; level <= num_levels; level++)
+            write_bands(bands[level], data[it - start][level],
+                        tiles[it].min().x() >> level, tiles[it].min().y() >> level);
+        }
+      } catch (...) {
+        GDALClose(dataset);
+        throw;
+      }
+    }
+    tpc.report_finished();
+
+    GDALClose(dataset);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BIG_TILE_WRITER_H__
@@ -0,0 +1,384 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlobRemoval.cc
+///
+
+#include <asp/Core/BlobRemoval.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/Manipulation.h>
+
+#include <algorithm>
+
+namespace asp {
+
+namespace {
+
+  int local_find(std::vector<int> & parent, int label) {
+    while (parent[label] != label) {
+      parent[label] = parent[parent[label]];
+      label = parent[label];
+    }
+    return label;
+  }
+
+  // Label the 4-connected components of the valid pixels, as 0, 1, ...,
+  // with -1 for invalid pixels, in two passes with a union-find. Return
+  // the area of each component. The labels are the same each time for
+  // the same input.
+  std::vector<std::int64_t> label_tile(vw::ImageView<vw::uint8> const& valid,
+                                       std::vector<int> & labels) {
+    int nc = valid.cols(), nr = valid.rows();
+    labels.assign(size_t(nc) * nr, -1);
+    std::vector<int> parent;
+
+    for (int row = 0; row < nr; row++) {
+      for (int col = 0; col < nc; col++) {
+        if (!valid(col, row))
+          continue;
+        int left = (col > 0) ? labels[size_t(row) * nc + col - 1] : -1;
+        int up   = (row > 0) ? labels[size_t(row - 1) * nc + col] : -1;
+        int label = -1;
+        if (left < 0 && up < 0) {
+          label = parent.size();
+          parent.push_back(label);
+        } else if (left < 0) {
+          label = up;
+        } else if (up < 0) {
+          label = left;
+        } else {
+          int a = local_find(parent, left), b = local_find(parent, up);
+          label = std::min(a, b);
+          parent[std::max(a, b)] = label;
+        }
+        labels[size_t(row) * nc + col] = label;
+      }
+    }
+
+    // Make the labels consecutive, in order of first appearance
+    std::vector<int> compact(parent.size(), -1);
+    std::vector<std::int64_t> areas;
+    for (size_t it = 0; it < labels.size(); it++) {
+      if (labels[it] < 0)
+        continue;
+      int root = local_find(parent, labels[it]);
+      if (compact[root] < 0) {
+        compact[root] = areas.size();
+        areas.push_back(0);
+      }
+      labels[it] = compact[root];
+      areas[labels[it]]++;
+    }
+    return areas;
+  }
+
+  // The disparity with the pixels in small blobs made invalid. The blobs
+  // are found per tile of the index, which is read from the input.
+  class SmallBlobRemovalView:
+    public vw::ImageViewBase<SmallBlobRemovalView> {
+    typedef vw::PixelMask<vw::Vector2f> PixelT;
+    vw::DiskImageView<PixelT> m_img;
+    TiledBlobIndex const& m_index;
+    int m_max_area;
+
+  public:
+    SmallBlobRemovalView(std::string const& file, TiledBlobIndex const& index,
+                         int max_area):
+      m_img(file), m_index(index), m_max_area(max_area) {}
+
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<SmallBlobRemovalView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline pixel_type operator()(double /*i*/, double /*j*/, vw::int32 /*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "SmallBlobRemovalView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> out(bbox.width(), bbox.height());
+
+      // The index tiles overlapping this box. These are the same as the
+      // write blocks if the sizes agree.
+      std::vector<int> tiles = m_index.overlapping_tiles(bbox);
+      for (size_t t = 0; t < tiles.size(); t++) {
+        int it = tiles[t];
+        vw::BBox2i tile = m_index.tile(it);
+        vw::BBox2i overlap = tile;
+        overlap.crop(bbox);
+        if (overlap.empty())
+          continue;
+
+        vw::ImageView<pixel_type> data = vw::crop(m_img, tile);
+        vw::ImageView<vw::uint8> valid(data.cols(), data.rows());
+        for (int col = 0; col < data.cols(); col++)
+          for (int row = 0; row < data.rows(); row++)
+            valid(col, row) = is_valid(data(col, row));
+        m_index.remove_small(it, valid, m_max_area);
+
+        for (int col = overlap.min().x(); col < overlap.max().x(); col++) {
+          for (int row = overlap.min().y(); row < overlap.max().y(); row++) {
+            pixel_type pix = data(col - tile.min().x(), row - tile.min().y());
+            if (!valid(col - tile.min().x(), row - tile.min().y()))
+              pix.invalidate();
+            out(col - bbox.min().x(), row - bbox.min().y()) = pix;
+          }
+        }
+      }
+
+      return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // end anonymous namespace
+
+TiledBlobIndex::TiledBlobIndex(int cols, int rows, int tile_size):
+  m_cols(cols), m_rows(rows), m_tile_size(std::max(tile_size, 1)) {
+  m_tiles_x = (m_cols + m_tile_size - 1) / m_tile_size;
+  m_tiles_y = (m_rows + m_tile_size - 1) / m_tile_size;
+  m_info.resize(num_tiles());
+}
+
+vw::BBox2i TiledBlobIndex::tile(int index) const {
+  int tx = index % m_tiles_x, ty = index / m_tiles_x;
+  int col = tx * m_tile_size, row = ty * m_tile_size;
+  return vw::BBox2i(col, row, std::min(m_tile_size, m_cols - col),
+                    std::min(m_tile_size, m_rows - row));
+}
+
+std::vector<int> TiledBlobIndex::overlapping_tiles(vw::BBox2i const& box) const {
+  std::vector<int> tiles;
+  if (box.empty())
+    return tiles;
+  int tx0 = std::max(box.min().x(), 0) / m_tile_size;
+  int ty0 = std::max(box.min().y(), 0) / m_tile_size;
+  int tx1 = std::min((box.max().x() - 1) / m_tile_size, m_tiles_x - 1);
+  int ty1 = std::min((box.max().y() - 1) / m_tile_size, m_tiles_y - 1);
+  for (int ty = ty0; ty <= ty1; ty++)
+    for (int tx = tx0; tx <= tx1; tx++)
+      tiles.push_back(ty * m_tiles_x + tx);
+  return tiles;
+}
+
+void TiledBlobIndex::add_tile(int index, vw::ImageView<vw::uint8> const& valid) {
+  vw::BBox2i box = tile(index);
+  if (valid.cols() != box.width() || valid.rows() != box.height())
+    vw::vw_throw(vw::ArgumentErr() << "TiledBlobIndex: wrong tile size.\n");
+
+  std::vector<int> labels;
+  TileInfo & info = m_info[index];
+  info.areas = label_tile(valid, labels);
+
+  int nc = valid.cols(), nr = valid.rows();
+  info.boxes.assign(info.areas.size(), vw::BBox2i());
+  for (int row = 0; row < nr; row++) {
+    for (int col = 0; col < nc; col++) {
+      int label = labels[size_t(row) * nc + col];
+      if (label >= 0)
+        info.boxes[label].grow(vw::Vector2i(box.min().x() + col, box.min().y() + row));
+    }
+  }
+
+  info.left.resize(nr);
+  info.right.resize(nr);
+  for (int row = 0; row < nr; row++) {
+    info.left[row]  = labels[size_t(row) * nc];
+    info.right[row] = labels[size_t(row) * nc + nc - 1];
+  }
+  info.top.resize(nc);
+  info.bottom.resize(nc);
+  for (int col = 0; col < nc; col++) {
+    info.top[col]    = labels[col];
+    info.bottom[col] = labels[size_t(nr - 1) * nc + col];
+  }
+}
+
+std::int64_t TiledBlobIndex::find(std::int64_t label) {
+  while (m_parent[label] != label) {
+    m_parent[label] = m_parent[m_parent[label]];
+    label = m_parent[label];
+  }
+  return label;
+}
+
+void TiledBlobIndex::merge() {
+
+  m_offset.assign(num_tiles() + 1, 0);
+  for (int it = 0; it < num_tiles(); it++)
+    m_offset[it + 1] = m_offset[it] + m_info[it].areas.size();
+
+  std::int64_t total = m_offset.back();
+  m_parent.resize(total);
+  for (std::int64_t it = 0; it < total; it++)
+    m_parent[it] = it;
+
+  auto join = [this](std::int64_t a, std::int64_t b) {
+    a = find(a);
+    b = find(b);
+    if (a != b)
+      m_parent[std::max(a, b)] = std::min(a, b);
+  };
+
+  // Join the labels facing each other across the seams
+  for (int ty = 0; ty < m_tiles_y; ty++) {
+    for (int tx = 0; tx < m_tiles_x; tx++) {
+      int index = ty * m_tiles_x + tx;
+      TileInfo const& info = m_info[index];
+      if (tx + 1 < m_tiles_x) {
+        TileInfo const& right = m_info[index + 1];
+        for (size_t row = 0; row < info.right.size(); row++)
+          if (info.right[row] >= 0 && right.left[row] >= 0)
+            join(m_offset[index] + info.right[row], m_offset[index + 1] + right.left[row]);
+      }
+      if (ty + 1 < m_tiles_y) {
+        TileInfo const& below = m_info[index + m_tiles_x];
+        for (size_t col = 0; col < info.bottom.size(); col++)
+          if (info.bottom[col] >= 0 && below.top[col] >= 0)
+            join(m_offset[index] + info.bottom[col],
+                 m_offset[index + m_tiles_x] + below.top[col]);
+      }
+    }
+  }
+
+  // Point each label to its root, and sum the areas and boxes. The
+  // boxes are grown by pixel, so they include the last row and column.
+  m_area.assign(total, 0);
+  m_box.assign(total, vw::BBox2i());
+  for (int it = 0; it < num_tiles(); it++) {
+    for (size_t label = 0; label < m_info[it].areas.size(); label++) {
+      std::int64_t global = m_offset[it] + label;
+      m_parent[global] = find(global);
+      m_area[m_parent[global]] += m_info[it].areas[label];
+      m_box[m_parent[global]].grow(m_info[it].boxes[label]);
+    }
+  }
+  for (std::int64_t it = 0; it < total; it++) {
+    if (m_parent[it] == it)
+      m_box[it].max() += vw::Vector2i(1, 1);
+  }
+}
+
+std::int64_t TiledBlobIndex::num_blobs() const {
+  std::int64_t count = 0;
+  for (size_t it = 0; it < m_parent.size(); it++)
+    count += (m_parent[it] == std::int64_t(it));
+  return count;
+}
+
+std::int64_t TiledBlobIndex::num_small_blobs(std::int64_t max_area) const {
+  std::int64_t count = 0;
+  for (size_t it = 0; it < m_parent.size(); it++)
+    count += (m_parent[it] == std::int64_t(it) && m_area[it] <= max_area);
+  return count;
+}
+
+void TiledBlobIndex::blob_ids(int index, vw::ImageView<vw::uint8> const& valid,
+                              std::vector<std::int64_t> & ids) const {
+  if (m_offset.empty())
+    vw::vw_throw(vw::LogicErr() << "TiledBlobIndex: merge() was not called.\n");
+
+  std::vector<int> labels;
+  label_tile(valid, labels);
+  ids.resize(labels.size());
+  for (size_t it = 0; it < labels.size(); it++)
+    ids[it] = (labels[it] < 0) ? -1 : m_parent[m_offset[index] + labels[it]];
+}
+
+std::int64_t TiledBlobIndex::remove_small(int index, vw::ImageView<vw::uint8> & valid,
+                                          std::int64_t max_area) const {
+  if (m_offset.empty())
+    vw::vw_throw(vw::LogicErr() << "TiledBlobIndex: merge() was not called.\n");
+
+  std::vector<int> labels;
+  label_tile(valid, labels);
+
+  std::int64_t count = 0;
+  int nc = valid.cols();
+  for (size_t it = 0; it < labels.size(); it++) {
+    if (labels[it] < 0)
+      continue;
+    std::int64_t root = m_parent[m_offset[index] + labels[it]];
+    if (m_area[root] <= max_area) {
+      valid(it % nc, it / nc) = 0;
+      count++;
+    }
+  }
+  return count;
+}
+
+void remove_small_disparity_blobs(std::string const& in_file,
+                                  std::string const& out_file,
+                                  int max_area,
+                                  bool has_georef,
+                                  vw::cartography::GeoReference const& georef,
+                                  vw::GdalWriteOptions const& opt,
+                                  vw::ProgressCallback const& tpc) {
+
+  typedef vw::PixelMask<vw::Vector2f> PixelT;
+  vw::DiskImageView<PixelT> img(in_file);
+
+  // Label the tiles in parallel. Use the block size of the output, so
+  // that each index tile is read once when writing.
+  int tile_size = std::max(opt.raster_tile_size[0], opt.raster_tile_size[1]);
+  if (tile_size <= 0)
+    tile_size = vw::vw_settings().default_tile_size();
+  TiledBlobIndex index(img.cols(), img.rows(), tile_size);
+
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw::vw_settings().default_num_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int it = 0; it < index.num_tiles(); it++) {
+    vw::ImageView<PixelT> data = vw::crop(img, index.tile(it));
+    vw::ImageView<vw::uint8> valid(data.cols(), data.rows());
+    for (int col = 0; col < data.cols(); col++)
+      for (int row = 0; row < data.rows(); row++)
+        valid(col, row) = is_valid(data(col, row));
+    index.add_tile(it, valid);
+  }
+  index.merge();
+  vw::vw_out() << "\t    * Eroding " << index.num_small_blobs(max_area)
+               << " islands out of " << index.num_blobs() << "\n";
+
+  bool has_nodata = false;
+  double nodata = -32768.0;
+  vw::cartography::block_write_gdal_image(out_file,
+                                          SmallBlobRemovalView(in_file, index, max_area),
+                                          has_georef, georef, has_nodata, nodata,
+                                          opt, tpc);
+}
+
+} // end namespace asp
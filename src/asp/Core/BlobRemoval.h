@@ -0,0 +1,112 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlobRemoval.h
+///
+/// Removal of small blobs of valid pixels from a large image, tile by
+/// tile. Each tile is labeled on its own, and the labels which touch
+/// across tile seams are merged with a union-find, so the blobs are the
+/// same as if the whole image were labeled at once, without it being in
+/// memory. Pixels are connected to their 4 neighbors. Used also to find
+/// the holes to fill (asp/Core/HoleFilling.h).
+
+#ifndef __ASP_CORE_BLOB_REMOVAL_H__
+#define __ASP_CORE_BLOB_REMOVAL_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/FileIO/GdalWriteOptions.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  class TiledBlobIndex {
+  public:
+    TiledBlobIndex(int cols, int rows, int tile_size);
+
+    int num_tiles() const { return m_tiles_x * m_tiles_y; }
+    vw::BBox2i tile(int index) const;
+
+    /// The indices of the tiles which overlap a box
+    std::vector<int> overlapping_tiles(vw::BBox2i const& box) const;
+
+    /// Label the valid (non-zero) pixels of a tile, and keep the blob
+    /// areas and the labels on the tile edges. Can be called for
+    /// different tiles from different threads.
+    void add_tile(int index, vw::ImageView<vw::uint8> const& valid);
+
+    /// Merge the blobs across the tile seams. Call once all tiles were added.
+    void merge();
+
+    /// The number of blobs in the image, after merging
+    std::int64_t num_blobs() const;
+
+    /// The number of blobs with no more than this many pixels
+    std::int64_t num_small_blobs(std::int64_t max_area) const;
+
+    /// The blob of each pixel of a tile, as an index into the blob
+    /// areas and boxes, or -1 for pixels not in a blob. The tile must be
+    /// as given to add_tile().
+    void blob_ids(int index, vw::ImageView<vw::uint8> const& valid,
+                  std::vector<std::int64_t> & ids) const;
+
+    /// The number of pixels of a blob, and its bounding box in the image
+    std::int64_t blob_area(std::int64_t id) const { return m_area[id]; }
+    vw::BBox2i blob_box(std::int64_t id) const { return m_box[id]; }
+
+    /// Set to zero the pixels of a tile which are in blobs with no more
+    /// than max_area pixels. The tile must be as given to add_tile().
+    /// Return the number of such pixels.
+    std::int64_t remove_small(int index, vw::ImageView<vw::uint8> & valid,
+                              std::int64_t max_area) const;
+
+  private:
+    struct TileInfo {
+      std::vector<std::int64_t> areas;          // per local label
+      std::vector<vw::BBox2i> boxes;            // per local label, in the image
+      std::vector<int> left, right, top, bottom; // local labels on the edges, or -1
+    };
+
+    std::int64_t find(std::int64_t label);
+
+    int m_cols, m_rows, m_tile_size, m_tiles_x, m_tiles_y;
+    std::vector<TileInfo> m_info;
+    std::vector<std::int64_t> m_offset; // of the labels of each tile
+    std::vector<std::int64_t> m_parent; // after merge(), the root of each label
+    std::vector<std::int64_t> m_area;   // after merge(), the area of each root
+    std::vector<vw::BBox2i>   m_box;    // after merge(), the box of each root
+  };
+
+  /// Read a disparity and write it with the small blobs of valid pixels
+  /// removed, using a TiledBlobIndex. Used by stereo_fltr.
+  void remove_small_disparity_blobs(std::string const& in_file,
+                                    std::string const& out_file,
+                                    int max_area,
+                                    bool has_georef,
+                                    vw::cartography::GeoReference const& georef,
+                                    vw::GdalWriteOptions const& opt,
+                                    vw::ProgressCallback const& tpc);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BLOB_REMOVAL_H__
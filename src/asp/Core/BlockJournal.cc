@@ -0,0 +1,121 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file BlockJournal.cc
+///
+
+#include <asp/Core/BlockJournal.h>
+#include <asp/Core/IpCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+  const std::string JOURNAL_MAGIC = "ASP_BLOCK_JOURNAL 1";
+  std::atomic<bool> g_resume_block_writes(false);
+}
+
+void set_resume_block_writes(bool resume) {
+  g_resume_block_writes = resume;
+}
+
+bool resume_block_writes() {
+  return g_resume_block_writes;
+}
+
+std::string block_journal_file(std::string const& image_file) {
+  return image_file + ".journal";
+}
+
+std::uint64_t block_hash(const void * data, size_t num_bytes) {
+  return fnv1a_hash(data, num_bytes);
+}
+
+BlockJournal::BlockJournal(std::string const& image_file, std::string const& layout,
+                           bool resume):
+  m_file(block_journal_file(image_file)), m_resuming(false) {
+
+  if (resume && fs::exists(image_file) && fs::exists(m_file)) {
+    std::ifstream ifs(m_file.c_str());
+    std::string magic, file_layout, line;
+    std::getline(ifs, magic);
+    std::getline(ifs, file_layout);
+    if (magic == JOURNAL_MAGIC && file_layout == layout) {
+      m_resuming = true;
+      // A partial last line, from a run killed while writing it, is skipped
+      while (std::getline(ifs, line)) {
+        std::istringstream is(line);
+        size_t block = 0;
+        std::uint64_t hash = 0;
+        if (is >> block >> hash)
+          m_loaded[block] = hash;
+      }
+    } else {
+      vw::vw_out(vw::WarningMessage) << "Cannot resume from: " << m_file
+                                     << ", as it is for a different image layout.\n";
+    }
+  }
+  if (m_resuming)
+    return;
+
+  std::ofstream ofs(m_file.c_str());
+  if (!ofs)
+    vw::vw_throw(vw::IOErr() << "Cannot write: " << m_file << ".\n");
+  ofs << JOURNAL_MAGIC << "\n" << layout << "\n";
+}
+
+bool BlockJournal::find(size_t block, std::uint64_t & hash) const {
+  auto it = m_loaded.find(block);
+  if (it == m_loaded.end())
+    return false;
+  hash = it->second;
+  return true;
+}
+
+void BlockJournal::add(size_t block, std::uint64_t hash) {
+  m_pending.push_back(std::make_pair(block, hash));
+}
+
+void BlockJournal::commit() {
+  if (m_pending.empty())
+    return;
+  std::ofstream ofs(m_file.c_str(), std::ios::app);
+  for (auto const& p: m_pending)
+    ofs << p.first << " " << p.second << "\n";
+  ofs.flush();
+  if (!ofs)
+    vw::vw_throw(vw::IOErr() << "Failed writing: " << m_file << ".\n");
+  m_pending.clear();
+}
+
+void BlockJournal::finish() {
+  m_pending.clear();
+  boost::system::error_code ec;
+  fs::remove(m_file, ec);
+}
+
+} // end namespace asp
@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlockJournal.h
+///
+/// A journal of the blocks of an image which were written to disk, so
+/// that a run which is killed halfway can be restarted with --resume
+/// and skip them. It is kept next to the image, with the extension
+/// .journal appended, and is removed once the image is complete. Each
+/// line has the index of a block and a hash of its pixels, and the
+/// blocks are added only after they are flushed to disk. On resuming,
+/// a block is read back and used only if its hash agrees.
+///
+/// The first line describes the layout of the image. If it does not
+/// match, the journal is ignored. The options which produced the pixels
+/// are not recorded, so a run should be resumed with the same options.
+
+#ifndef __ASP_CORE_BLOCK_JOURNAL_H__
+#define __ASP_CORE_BLOCK_JOURNAL_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// If the block writers should resume from a journal. Set by --resume.
+  void set_resume_block_writes(bool resume);
+  bool resume_block_writes();
+
+  /// The journal file for an image
+  std::string block_journal_file(std::string const& image_file);
+
+  /// The hash of the pixels of a block
+  std::uint64_t block_hash(const void * data, size_t num_bytes);
+
+  class BlockJournal {
+  public:
+
+    /// Start a journal for this image. If resume is true, and both the
+    /// image and a journal with the same layout exist, load the blocks
+    /// recorded in the journal. Otherwise start a new journal.
+    BlockJournal(std::string const& image_file, std::string const& layout,
+                 bool resume);
+
+    /// If the blocks of an earlier run were loaded
+    bool resuming() const { return m_resuming; }
+
+    /// The hash of a block written by an earlier run. Return false if
+    /// the block is not in the journal.
+    bool find(size_t block, std::uint64_t & hash) const;
+
+    /// Note that a block was written. It is saved with commit().
+    void add(size_t block, std::uint64_t hash);
+
+    /// Save the blocks added so far. Must be called only after these
+    /// are flushed to the image.
+    void commit();
+
+    /// Remove the journal, once the image is complete
+    void finish();
+
+  private:
+    std::string m_file;
+    bool m_resuming;
+    std::map<size_t, std::uint64_t> m_loaded;
+    std::vector<std::pair<size_t, std::uint64_t>> m_pending;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BLOCK_JOURNAL_H__
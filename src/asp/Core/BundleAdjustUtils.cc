@@ -27,7 +27,12 @@
 #include <vw/Cartography/CameraBBox.h>
 #include <vw/BundleAdjustment/CameraRelation.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/CameraFootprint.h>
+#include <asp/Core/CameraRayCache.h>
 
+#include <algorithm>
+#include <limits>
+#include <set>
 #include <string>
 
 using namespace vw;
@@ -215,9 +220,9 @@ vw::BBox2 asp::camera_bbox_with_cache(std::string const& dem_file,
     DiskImageView<float> img(image_file);
     float auto_res = -1.0;  // Will be updated
     bool quick = false;     // Do a thorough job
-    box = vw::cartography::camera_bbox(dem, dem_georef, dem_georef,
-                                       camera_model, img.cols(), img.rows(),
-                                       auto_res, quick);
+    box = asp::fast_camera_bbox(dem_file, dem, dem_georef, dem_georef,
+                                camera_model, img.cols(), img.rows(),
+                                auto_res, quick);
   } catch (std::exception const& e) {
     vw_throw( ArgumentErr() << e.what() << "\n"
               << "Failed to compute the footprint of camera image: " << image_file
@@ -413,6 +418,63 @@ void asp::determine_image_pairs(// Inputs
     all_pairs.push_back(*it);
 }
 
+// See the .h file for the documentation.
+void asp::partition_cameras(int num_cameras,
+                            std::vector<std::pair<int,int>> const& pairs,
+                            int num_partitions,
+                            std::vector<int> & partition) {
+
+  if (num_partitions <= 0)
+    vw_throw(ArgumentErr() << "The number of partitions must be positive.\n");
+
+  std::vector<std::set<int>> neighbors(num_cameras);
+  for (size_t it = 0; it < pairs.size(); it++) {
+    int i = pairs[it].first, j = pairs[it].second;
+    if (i < 0 || j < 0 || i >= num_cameras || j >= num_cameras || i == j)
+      continue;
+    neighbors[i].insert(j);
+    neighbors[j].insert(i);
+  }
+
+  // Visit the cameras with fewer neighbors first, breaking ties by index,
+  // so the result does not depend on the order of the pairs.
+  auto fewer_neighbors = [&neighbors](int a, int b) {
+    if (neighbors[a].size() != neighbors[b].size())
+      return neighbors[a].size() < neighbors[b].size();
+    return a < b;
+  };
+  std::vector<int> start_order(num_cameras);
+  for (int it = 0; it < num_cameras; it++)
+    start_order[it] = it;
+  std::sort(start_order.begin(), start_order.end(), fewer_neighbors);
+
+  std::vector<int> order;
+  std::vector<bool> visited(num_cameras, false);
+  for (size_t s = 0; s < start_order.size(); s++) {
+    if (visited[start_order[s]])
+      continue;
+    // Traverse a connected component
+    size_t beg = order.size();
+    order.push_back(start_order[s]);
+    visited[start_order[s]] = true;
+    for (size_t k = beg; k < order.size(); k++) {
+      std::vector<int> next;
+      for (auto it = neighbors[order[k]].begin(); it != neighbors[order[k]].end(); it++) {
+        if (!visited[*it]) {
+          visited[*it] = true;
+          next.push_back(*it);
+        }
+      }
+      std::sort(next.begin(), next.end(), fewer_neighbors);
+      order.insert(order.end(), next.begin(), next.end());
+    }
+  }
+
+  partition.assign(num_cameras, 0);
+  for (int k = 0; k < num_cameras; k++)
+    partition[order[k]] = (long(k) * num_partitions) / num_cameras;
+}
+
 /// Load a DEM from disk to use for interpolation.
 void asp::create_interp_dem(std::string const& dem_file,
                        vw::cartography::GeoReference & dem_georef,
@@ -438,6 +500,41 @@ void asp::create_interp_dem(std::string const& dem_file,
   }
 }
 
+/// Load a DEM in memory, as float, if not too large, to use for interpolation.
+void asp::create_in_memory_interp_dem(std::string const& dem_file, double memory_limit_mb,
+                                      vw::cartography::GeoReference & dem_georef,
+                                      ImageViewRef<PixelMask<double>> & interp_dem) {
+
+  DiskImageView<float> disk_dem(dem_file);
+  double dem_mb = double(disk_dem.cols()) * double(disk_dem.rows()) * sizeof(float)
+    / (1024.0 * 1024.0);
+  if (dem_mb > memory_limit_mb) {
+    vw_out() << "The DEM needs " << dem_mb << " MB of memory, which is more than "
+             << memory_limit_mb << " MB. It will be read from disk as needed.\n";
+    asp::create_interp_dem(dem_file, dem_georef, interp_dem);
+    return;
+  }
+
+  vw_out() << "Loading DEM in memory: " << dem_file << std::endl;
+
+  // Read the no-data
+  double nodata_val = -std::numeric_limits<float>::max(); // note we use a float nodata
+  if (vw::read_nodata_val(dem_file, nodata_val))
+    vw_out() << "Found DEM nodata value: " << nodata_val << std::endl;
+
+  // The view shares the pixels, so they live as long as it does
+  ImageView<float> dem = disk_dem;
+  interp_dem = interpolate(pixel_cast<PixelMask<double>>(create_mask(dem, nodata_val)),
+                           BilinearInterpolation(), ConstantEdgeExtension());
+
+  // Read the georef
+  bool is_good = vw::cartography::read_georeference(dem_georef, dem_file);
+  if (!is_good) {
+    vw_throw(ArgumentErr() << "Error: Cannot read a georeference from DEM: "
+             << dem_file << ".\n");
+  }
+}
+
 // Given an xyz point in ECEF coordinates, update its height above datum
 // by interpolating into a DEM. The user must check the return status.
 bool asp::update_point_height_from_dem(vw::cartography::GeoReference const& dem_georef,
@@ -545,6 +642,9 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
   std::vector<int> dem_xyz_count(num_tri_points, 0);
   
   for (int icam = 0; icam < (int)crn.size(); icam++) {
+
+    // Many rays are shot from each image, so approximate them
+    asp::CameraRayCache ray_cache(camera_models[icam]);
     
     for (auto fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
         
@@ -577,10 +677,10 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
       double max_rel_tol      = 1e-14;
       int num_max_iter        = 25;   // Using many iterations can be very slow
 
+      Vector3 ctr, dir;
+      ray_cache.ray(observation, ctr, dir);
       Vector3 dem_xyz = vw::cartography::camera_pixel_to_dem_xyz
-        (camera_models[icam]->camera_center(observation),
-         camera_models[icam]->pixel_to_vector(observation),
-         interp_dem, dem_georef, treat_nodata_as_zero, has_intersection,
+        (ctr, dir, interp_dem, dem_georef, treat_nodata_as_zero, has_intersection,
          height_error_tol, max_abs_tol, max_rel_tol, num_max_iter, xyz_guess);
 
       if (!has_intersection) 
@@ -619,6 +719,10 @@ void asp::flag_initial_outliers(vw::ba::ControlNetwork const& cnet,
 
   for (int icam = 0; icam < (int)crn.size(); icam++) {
 
+    // Approximate the reprojection errors, and find them exactly
+    // only when close to the threshold
+    asp::CameraRayCache ray_cache(camera_models[icam]);
+
     for (auto fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
       
       // The index of the triangulated point
@@ -644,6 +748,18 @@ void asp::flag_initial_outliers(vw::ba::ControlNetwork const& cnet,
         continue;
       }
       
+      // The bounds are not exact, so use them only with a margin
+      double low = 0.0, high = std::numeric_limits<double>::max();
+      try {
+        ray_cache.reprojection_error_bounds(observation, tri_point, low, high);
+      } catch (...) {}
+      if (high <= 0.5 * max_init_reproj_error)
+        continue; // an inlier
+      if (low > 2.0 * max_init_reproj_error) {
+        outliers.insert(ipt);
+        continue;
+      }
+      
       vw::Vector2 pix;
       try {
         pix = camera_models[icam]->point_to_pixel(tri_point);
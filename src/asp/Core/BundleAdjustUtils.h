@@ -135,11 +135,30 @@ namespace asp{
                              // Output
                              std::vector<std::pair<int,int>> & all_pairs);
 
+  /// Split the cameras into the given number of groups of about the same
+  /// size, so that cameras which see each other, per the given pairs, tend
+  /// to be in the same group. This orders the cameras by a breadth-first
+  /// traversal of the overlap graph (Cuthill-McKee), so that neighbors
+  /// are close, then cuts that order into chunks. The output has the
+  /// group index for each camera.
+  void partition_cameras(int num_cameras,
+                         std::vector<std::pair<int,int>> const& pairs,
+                         int num_partitions,
+                         std::vector<int> & partition);
+
   /// Load a DEM from disk to use for interpolation.
   void create_interp_dem(std::string const& dem_file,
                          vw::cartography::GeoReference & dem_georef,
                          vw::ImageViewRef<vw::PixelMask<double>> & interp_dem);
 
+  /// As create_interp_dem(), but if the DEM takes at most this many
+  /// megabytes as float, read it into memory first. Then interpolation
+  /// needs no disk access or cache locking, so it is fast when done many
+  /// times, and the result can be shared by many threads.
+  void create_in_memory_interp_dem(std::string const& dem_file, double memory_limit_mb,
+                                   vw::cartography::GeoReference & dem_georef,
+                                   vw::ImageViewRef<vw::PixelMask<double>> & interp_dem);
+
   // Given an xyz point in ECEF coordinates, update its height above datum
   // by interpolating into a DEM. The user must check the return status.
   bool update_point_height_from_dem(vw::cartography::GeoReference const& dem_georef,
@@ -0,0 +1,127 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CameraFootprint.cc
+///
+
+#include <asp/Core/CameraFootprint.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
+#include <vw/Cartography/CameraBBox.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/MaskViews.h>
+
+#include <cmath>
+#include <limits>
+#include <map>
+
+using namespace vw;
+
+namespace asp {
+
+boost::shared_ptr<CoarseDem> coarse_dem(std::string const& dem_file) {
+
+  static vw::Mutex mutex;
+  static std::map<std::string, boost::shared_ptr<CoarseDem>> cache;
+  {
+    vw::Mutex::Lock lock(mutex);
+    auto it = cache.find(dem_file);
+    if (it != cache.end())
+      return it->second;
+  }
+
+  // Compute without holding the lock. If two threads get here for the
+  // same DEM, they will get the same result.
+  cartography::GeoReference georef;
+  if (!cartography::read_georeference(georef, dem_file))
+    vw_throw(ArgumentErr() << "There is no georeference information in: "
+             << dem_file << ".\n");
+
+  DiskImageView<float> dem(dem_file);
+  boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(dem_file));
+  float nodata = -std::numeric_limits<float>::max();
+  if (rsrc->has_nodata_read())
+    nodata = rsrc->nodata_read();
+
+  boost::shared_ptr<CoarseDem> coarse(new CoarseDem);
+  coarse->factor = std::max(1, int(ceil(double(std::max(dem.cols(), dem.rows())) /
+                                        COARSE_DEM_MAX_SIZE)));
+  vw_out() << "Subsampling the DEM by a factor of " << coarse->factor
+           << " to find camera footprints.\n";
+  coarse->dem    = subsample(create_mask(dem, nodata), coarse->factor);
+  coarse->georef = cartography::resample(georef, 1.0 / coarse->factor);
+
+  vw::Mutex::Lock lock(mutex);
+  cache[dem_file] = coarse;
+  return coarse;
+}
+
+BBox2 fast_camera_bbox(std::string const& dem_file,
+                       ImageViewRef<PixelMask<float>> const& dem,
+                       cartography::GeoReference const& dem_georef,
+                       cartography::GeoReference const& target_georef,
+                       boost::shared_ptr<camera::CameraModel> const& camera_model,
+                       int image_cols, int image_rows, float & mean_gsd, bool quick,
+                       std::vector<Vector3> * coords) {
+
+  if (std::max(dem.cols(), dem.rows()) <= COARSE_DEM_MAX_SIZE)
+    return cartography::camera_bbox(dem, dem_georef, target_georef, camera_model,
+                                    image_cols, image_rows, mean_gsd, quick, coords);
+
+  // Find the footprint on the coarse DEM, in DEM pixels. If this fails,
+  // such as when the camera sees only a sliver of the DEM that the
+  // coarse DEM misses, do the full computation.
+  BBox2i dem_box;
+  try {
+    boost::shared_ptr<CoarseDem> coarse = coarse_dem(dem_file);
+    float coarse_gsd = -1.0;
+    BBox2 coarse_box = cartography::camera_bbox(coarse->dem, coarse->georef, coarse->georef,
+                                                camera_model, image_cols, image_rows,
+                                                coarse_gsd, quick);
+    if (!coarse_box.empty()) {
+      dem_box = grow_bbox_to_int(dem_georef.point_to_pixel_bbox(coarse_box));
+      // The coarse DEM is off by up to a coarse pixel, and its heights
+      // differ from the full-resolution ones, so leave a margin.
+      int margin = std::max(4 * coarse->factor,
+                            int(0.1 * std::max(dem_box.width(), dem_box.height())));
+      dem_box.expand(margin);
+      dem_box.crop(bounding_box(dem));
+    }
+  } catch (std::exception const& e) {
+    vw_out(WarningMessage) << "Could not find the camera footprint on the coarse DEM. "
+                           << "Using the full DEM.\n";
+    dem_box = BBox2i();
+  }
+
+  if (dem_box.empty())
+    return cartography::camera_bbox(dem, dem_georef, target_georef, camera_model,
+                                    image_cols, image_rows, mean_gsd, quick, coords);
+
+  // Refine using only the full-resolution DEM near the footprint
+  cartography::GeoReference crop_georef
+    = cartography::crop(dem_georef, dem_box.min().x(), dem_box.min().y());
+  ImageViewRef<PixelMask<float>> crop_dem = crop(dem, dem_box);
+  return cartography::camera_bbox(crop_dem, crop_georef, target_georef, camera_model,
+                                  image_cols, image_rows, mean_gsd, quick, coords);
+}
+
+} // end namespace asp
@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraFootprint.h
+///
+/// Find the footprint of a camera on a DEM. For a large DEM, intersecting
+/// rays with it is slow, so first the footprint is found on a coarse
+/// version of the DEM, and then it is refined using only the part of the
+/// full-resolution DEM around it.
+
+#ifndef __ASP_CORE_CAMERA_FOOTPRINT_H__
+#define __ASP_CORE_CAMERA_FOOTPRINT_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The coarse DEM has at most this many pixels on a side
+  const int COARSE_DEM_MAX_SIZE = 1024;
+
+  /// A subsampled DEM and its georeference
+  struct CoarseDem {
+    vw::ImageView<vw::PixelMask<float>> dem;
+    vw::cartography::GeoReference       georef;
+    int                                 factor; // the subsampling factor
+  };
+
+  /// The coarse version of a DEM. It is computed once per DEM file and
+  /// then kept in memory, as usually many cameras see the same DEM.
+  boost::shared_ptr<CoarseDem> coarse_dem(std::string const& dem_file);
+
+  /// Compute the bounding box of the footprint of a camera on a DEM, in
+  /// the projection of target_georef, and the mean ground sample
+  /// distance, as vw::cartography::camera_bbox() does. If the DEM has
+  /// more than COARSE_DEM_MAX_SIZE pixels on a side, the footprint is
+  /// found first on the coarse DEM, and then the full-resolution DEM,
+  /// cropped to a neighborhood of that footprint, is used to refine it.
+  vw::BBox2 fast_camera_bbox(std::string const& dem_file,
+                             vw::ImageViewRef<vw::PixelMask<float>> const& dem,
+                             vw::cartography::GeoReference const& dem_georef,
+                             vw::cartography::GeoReference const& target_georef,
+                             boost::shared_ptr<vw::camera::CameraModel> const& camera_model,
+                             int image_cols, int image_rows, float & mean_gsd, bool quick,
+                             std::vector<vw::Vector3> * coords = NULL);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CAMERA_FOOTPRINT_H__
@@ -0,0 +1,136 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CameraRayCache.cc
+///
+
+#include <asp/Core/CameraRayCache.h>
+
+#include <vw/Camera/CameraModel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  // The angle between two normalized vectors, accurate also for small angles
+  double angle(Vector3 const& a, Vector3 const& b) {
+    return 2.0 * atan2(norm_2(a - b), norm_2(a + b));
+  }
+
+} // end anonymous namespace
+
+CameraRayCache::CameraRayCache(boost::shared_ptr<camera::CameraModel> camera,
+                               int tile_size, double max_pixel_error,
+                               double max_center_error):
+  m_camera(camera), m_tile_size(std::max(tile_size, 2)),
+  m_max_pixel_error(max_pixel_error), m_max_center_error(max_center_error) {}
+
+CameraRayCache::Tile const& CameraRayCache::tile(Vector2 const& pix) {
+
+  std::pair<int, int> key(int(floor(pix[0] / m_tile_size)),
+                          int(floor(pix[1] / m_tile_size)));
+  auto it = m_tiles.find(key);
+  if (it != m_tiles.end())
+    return it->second;
+
+  Tile & t = m_tiles[key];
+  t.exact = true;
+  t.min_pixel_angle = 0.0;
+  t.max_pixel_angle = 0.0;
+  try {
+    for (int k = 0; k < 4; k++) {
+      Vector2 corner((key.first  + k % 2) * double(m_tile_size),
+                     (key.second + k / 2) * double(m_tile_size));
+      t.ctr[k] = m_camera->camera_center(corner);
+      t.dir[k] = m_camera->pixel_to_vector(corner);
+    }
+    double col_angle = angle(t.dir[0], t.dir[1]) / m_tile_size;
+    double row_angle = angle(t.dir[0], t.dir[2]) / m_tile_size;
+    t.min_pixel_angle = std::min(col_angle, row_angle);
+    t.max_pixel_angle = std::max(col_angle, row_angle);
+
+    // Check the interpolation at the tile center, where it is the least accurate
+    Vector2 mid((key.first + 0.5) * m_tile_size, (key.second + 0.5) * m_tile_size);
+    Vector3 ctr = m_camera->camera_center(mid);
+    Vector3 dir = m_camera->pixel_to_vector(mid);
+    Vector3 interp_ctr = 0.25 * (t.ctr[0] + t.ctr[1] + t.ctr[2] + t.ctr[3]);
+    Vector3 interp_dir = normalize(t.dir[0] + t.dir[1] + t.dir[2] + t.dir[3]);
+    t.exact = !(t.min_pixel_angle > 0 &&
+                angle(dir, interp_dir) <= m_max_pixel_error * t.min_pixel_angle &&
+                norm_2(ctr - interp_ctr) <= m_max_center_error);
+  } catch (...) {
+    // Use the camera directly, which may fail for this pixel too
+    t.exact = true;
+  }
+
+  return t;
+}
+
+void CameraRayCache::ray(Vector2 const& pix, Vector3 & ctr, Vector3 & dir) {
+
+  Tile const& t = tile(pix);
+  if (t.exact) {
+    ctr = m_camera->camera_center(pix);
+    dir = m_camera->pixel_to_vector(pix);
+    return;
+  }
+
+  double x = pix[0] / m_tile_size - floor(pix[0] / m_tile_size);
+  double y = pix[1] / m_tile_size - floor(pix[1] / m_tile_size);
+  double w[4] = {(1 - x) * (1 - y), x * (1 - y), (1 - x) * y, x * y};
+  ctr = Vector3();
+  dir = Vector3();
+  for (int k = 0; k < 4; k++) {
+    ctr += w[k] * t.ctr[k];
+    dir += w[k] * t.dir[k];
+  }
+  dir = normalize(dir);
+}
+
+void CameraRayCache::reprojection_error_bounds(Vector2 const& pix, Vector3 const& xyz,
+                                               double & low, double & high) {
+
+  Tile const& t = tile(pix);
+  Vector3 ctr, dir;
+  ray(pix, ctr, dir);
+
+  double min_angle = t.min_pixel_angle, max_angle = t.max_pixel_angle;
+  if (t.exact) {
+    // Find the angles between rays of neighboring pixels here
+    Vector3 ctr2, col_dir, row_dir;
+    ray(pix + Vector2(1, 0), ctr2, col_dir);
+    ray(pix + Vector2(0, 1), ctr2, row_dir);
+    min_angle = std::min(angle(dir, col_dir), angle(dir, row_dir));
+    max_angle = std::max(angle(dir, col_dir), angle(dir, row_dir));
+  }
+
+  double err_angle = angle(dir, normalize(xyz - ctr));
+  low  = err_angle / max_angle;
+  high = err_angle / min_angle;
+  if (!(low >= 0) || !(high >= 0)) { // NaN, or no spread of the rays
+    low  = 0.0;
+    high = std::numeric_limits<double>::max();
+  }
+}
+
+} // end namespace asp
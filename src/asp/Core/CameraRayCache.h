@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraRayCache.h
+///
+/// A fast approximation of the rays of a camera, for preparing and
+/// filtering many interest points. The camera center and ray direction
+/// are found exactly at the corners of square image tiles, and
+/// interpolated bilinearly inside. A tile is used only if the
+/// interpolated ray at its center agrees with the exact one to within a
+/// given fraction of a pixel. Otherwise the exact camera is used in that
+/// tile. Tiles are created as they are needed.
+
+#ifndef __ASP_CORE_CAMERA_RAY_CACHE_H__
+#define __ASP_CORE_CAMERA_RAY_CACHE_H__
+
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <utility>
+
+namespace vw {
+  namespace camera {
+    class CameraModel;
+  }
+}
+
+namespace asp {
+
+  class CameraRayCache {
+  public:
+
+    /// Tiles have the given size, in pixels. The interpolated ray
+    /// must be within max_pixel_error of the exact one, and the
+    /// interpolated camera center within max_center_error meters.
+    CameraRayCache(boost::shared_ptr<vw::camera::CameraModel> camera,
+                   int tile_size = 256, double max_pixel_error = 0.01,
+                   double max_center_error = 0.01);
+
+    /// The camera center and the normalized ray direction at this pixel.
+    /// This can throw, as the camera can.
+    void ray(vw::Vector2 const& pix, vw::Vector3 & ctr, vw::Vector3 & dir);
+
+    /// Bounds on the reprojection error, in pixels, of a point which was
+    /// observed at the given pixel. These are the angle between the ray
+    /// at the pixel and the direction to the point, divided by the
+    /// largest and smallest angle between the rays of neighboring
+    /// pixels, along columns and rows. This can throw.
+    void reprojection_error_bounds(vw::Vector2 const& pix, vw::Vector3 const& xyz,
+                                   double & low, double & high);
+
+  private:
+
+    struct Tile {
+      bool exact;       // If the interpolation is not accurate enough here
+      // The smallest and largest angle between rays of neighboring pixels
+      double min_pixel_angle, max_pixel_angle;
+      vw::Vector3 ctr[4], dir[4]; // At the corners, in the order of (col, row)
+    };
+
+    Tile const& tile(vw::Vector2 const& pix);
+
+    boost::shared_ptr<vw::camera::CameraModel> m_camera;
+    int m_tile_size;
+    double m_max_pixel_error, m_max_center_error;
+    std::map<std::pair<int, int>, Tile> m_tiles;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CAMERA_RAY_CACHE_H__
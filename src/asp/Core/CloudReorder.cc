@@ -0,0 +1,87 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CloudReorder.cc
+///
+
+#include <asp/Core/CloudReorder.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+// Spread the bits of a 32-bit value to the even positions of a 64-bit one
+static std::uint64_t spread_bits(std::uint32_t v) {
+  std::uint64_t x = v;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+  x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+  x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x << 2))  & 0x3333333333333333ULL;
+  x = (x | (x << 1))  & 0x5555555555555555ULL;
+  return x;
+}
+
+std::uint64_t morton_code(std::uint32_t x, std::uint32_t y) {
+  return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+vw::Vector2 spherical_lonlat(vw::Vector3 const& xyz) {
+  double lon = atan2(xyz[1], xyz[0]) * 180.0 / M_PI;
+  double lat = atan2(xyz[2], sqrt(xyz[0] * xyz[0] + xyz[1] * xyz[1])) * 180.0 / M_PI;
+  return Vector2(lon, lat);
+}
+
+CloudOrderGrid::CloudOrderGrid(vw::BBox2 const& lonlat_box, bool use_360):
+  m_box(lonlat_box), m_use_360(use_360) {}
+
+std::uint64_t CloudOrderGrid::code(vw::Vector3 const& xyz) const {
+  Vector2 ll = spherical_lonlat(xyz);
+  if (m_use_360 && ll[0] < 0)
+    ll[0] += 360.0;
+
+  // Scale each coordinate to the full 32-bit range
+  std::uint32_t q[2];
+  for (int i = 0; i < 2; i++) {
+    double len = m_box.max()[i] - m_box.min()[i];
+    double t = (len > 0) ? (ll[i] - m_box.min()[i]) / len : 0.0;
+    t = std::max(0.0, std::min(t, 1.0));
+    q[i] = std::uint32_t(std::min(t * 4294967296.0, 4294967295.0));
+  }
+
+  return morton_code(q[0], q[1]);
+}
+
+int partition_cloud_cells(std::vector<std::int64_t> const& cell_counts,
+                          std::int64_t max_points, std::vector<int> & cell_to_run) {
+  cell_to_run.resize(cell_counts.size());
+  int run = 0;
+  std::int64_t run_points = 0;
+  for (size_t cell = 0; cell < cell_counts.size(); cell++) {
+    if (run_points > 0 && run_points + cell_counts[cell] > max_points) {
+      run++;
+      run_points = 0;
+    }
+    cell_to_run[cell] = run;
+    run_points += cell_counts[cell];
+  }
+  return cell_counts.empty() ? 0 : run + 1;
+}
+
+} // end namespace asp
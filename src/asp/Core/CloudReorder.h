@@ -0,0 +1,142 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CloudReorder.h
+///
+/// Reorder the points of an ASP point cloud so that points close on the
+/// ground are close in the image, used by pc_merge --spatial-order. The
+/// points are sorted along the Morton (Z-order) curve over their
+/// longitude and latitude, out of core, and laid out so that each block
+/// of the output image holds consecutive points along the curve. Then
+/// point2dem, which processes the cloud by block, needs to read few
+/// blocks for each of its tiles.
+
+#ifndef __ASP_CORE_CLOUD_REORDER_H__
+#define __ASP_CORE_CLOUD_REORDER_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/BlockRasterize.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The points are bucketed into cells along the curve, with this many
+  /// bits for the cell index in each of longitude and latitude.
+  const int CLOUD_ORDER_CELL_BITS = 8;
+
+  /// Interleave the bits of two values, with those of x in the even positions
+  std::uint64_t morton_code(std::uint32_t x, std::uint32_t y);
+
+  /// The cell, among 2^(2*CLOUD_ORDER_CELL_BITS), of a position along the curve
+  inline int cloud_order_cell(std::uint64_t code) {
+    return int(code >> (64 - 2 * CLOUD_ORDER_CELL_BITS));
+  }
+
+  /// The longitude and latitude, in degrees, of a cartesian point as seen
+  /// from the planet center. This needs no datum, and is enough to order
+  /// the points. The longitude is in [-180, 180].
+  vw::Vector2 spherical_lonlat(vw::Vector3 const& xyz);
+
+  /// Maps a cartesian point to its position along the Morton curve over
+  /// a longitude-latitude box.
+  class CloudOrderGrid {
+  public:
+    /// If use_360 is true, the longitudes in the box are in [0, 360).
+    CloudOrderGrid(vw::BBox2 const& lonlat_box, bool use_360);
+    std::uint64_t code(vw::Vector3 const& xyz) const;
+  private:
+    vw::BBox2 m_box;
+    bool m_use_360;
+  };
+
+  /// Split the cells, in curve order, into consecutive runs having at most
+  /// max_points points in total. A cell with more points is a run by itself.
+  /// Returns the number of runs, and for each cell its run.
+  int partition_cloud_cells(std::vector<std::int64_t> const& cell_counts,
+                            std::int64_t max_points, std::vector<int> & cell_to_run);
+
+  /// Sort the valid points of a cloud along the curve. The points are
+  /// bucketed into runs which fit in memory_limit_mb megabytes, each run
+  /// is written to a temporary file starting with tmp_prefix, and then the
+  /// runs are sorted one at a time and appended to sorted_file, in raw
+  /// binary form. The first three channels must be cartesian coordinates,
+  /// with a zero point being invalid. Returns the number of valid points.
+  template <class PixelT>
+  std::int64_t sort_cloud_spatially(vw::ImageViewRef<PixelT> const& cloud,
+                                    double memory_limit_mb,
+                                    std::string const& tmp_prefix,
+                                    std::string const& sorted_file);
+
+  /// A view of the points in a file written by sort_cloud_spatially().
+  /// Each block_size x block_size block, in row-major order, holds the
+  /// next consecutive points, row by row. The pixels after the last point
+  /// are zero, which is invalid.
+  template <class PixelT>
+  class SortedCloudView: public vw::ImageViewBase<SortedCloudView<PixelT>> {
+    std::string  m_file;
+    std::int64_t m_num_points;
+    int m_block_size, m_blocks_x, m_blocks_y;
+
+  public:
+    SortedCloudView(std::string const& file, std::int64_t num_points, int block_size);
+
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<SortedCloudView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_blocks_x * m_block_size; }
+    inline vw::int32 rows  () const { return m_blocks_y * m_block_size; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(double/*i*/, double/*j*/, vw::int32/*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "SortedCloudView::operator()(...) is not implemented.");
+      return result_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // end namespace asp
+
+#include <asp/Core/CloudReorder.tcc>
+
+#endif // __ASP_CORE_CLOUD_REORDER_H__
@@ -0,0 +1,359 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CloudReorder.tcc
+///
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace asp {
+
+namespace cloud_reorder_private {
+
+  // The input cloud is read in tiles of this size
+  const int CLOUD_TILE_SIZE = 256;
+
+  template <class PixelT>
+  bool is_valid_point(PixelT const& p) {
+    return subvector(p, 0, 3) != vw::Vector3();
+  }
+
+  // The name of the temporary file for a run
+  inline std::string run_file(std::string const& tmp_prefix, int run) {
+    std::ostringstream os;
+    os << tmp_prefix << "-run-" << run << ".bin";
+    return os.str();
+  }
+
+  // Find the longitude-latitude box of the valid points in a tile, with
+  // the longitudes in [-180, 180] and in [0, 360), and count the points.
+  template <class PixelT>
+  class CloudLonLatBoxTask: public vw::Task, private boost::noncopyable {
+    vw::ImageViewRef<PixelT> const& m_cloud;
+    vw::BBox2i m_box;
+    vw::BBox2 & m_box_180, & m_box_360;
+    std::int64_t & m_num_points;
+    vw::Mutex & m_mutex;
+    vw::ProgressCallback const& m_progress;
+    double m_inc_amt;
+  public:
+    CloudLonLatBoxTask(vw::ImageViewRef<PixelT> const& cloud, vw::BBox2i const& box,
+                       vw::BBox2 & box_180, vw::BBox2 & box_360, std::int64_t & num_points,
+                       vw::Mutex & mutex, vw::ProgressCallback const& progress, double inc_amt):
+      m_cloud(cloud), m_box(box), m_box_180(box_180), m_box_360(box_360),
+      m_num_points(num_points), m_mutex(mutex), m_progress(progress), m_inc_amt(inc_amt) {}
+
+    void operator()() {
+      vw::ImageView<PixelT> points = crop(m_cloud, m_box);
+      vw::BBox2 box_180, box_360;
+      std::int64_t num_points = 0;
+      for (int row = 0; row < points.rows(); row++) {
+        for (int col = 0; col < points.cols(); col++) {
+          if (!is_valid_point(points(col, row)))
+            continue;
+          vw::Vector2 ll = spherical_lonlat(subvector(points(col, row), 0, 3));
+          box_180.grow(ll);
+          if (ll[0] < 0)
+            ll[0] += 360.0;
+          box_360.grow(ll);
+          num_points++;
+        }
+      }
+
+      vw::Mutex::Lock lock(m_mutex);
+      m_box_180.grow(box_180);
+      m_box_360.grow(box_360);
+      m_num_points += num_points;
+      m_progress.report_incremental_progress(m_inc_amt);
+    }
+  };
+
+  // Count the valid points of a tile in each cell
+  template <class PixelT>
+  class CloudCellCountTask: public vw::Task, private boost::noncopyable {
+    vw::ImageViewRef<PixelT> const& m_cloud;
+    vw::BBox2i m_box;
+    CloudOrderGrid const& m_grid;
+    std::vector<std::int64_t> & m_cell_counts;
+    vw::Mutex & m_mutex;
+    vw::ProgressCallback const& m_progress;
+    double m_inc_amt;
+  public:
+    CloudCellCountTask(vw::ImageViewRef<PixelT> const& cloud, vw::BBox2i const& box,
+                       CloudOrderGrid const& grid, std::vector<std::int64_t> & cell_counts,
+                       vw::Mutex & mutex, vw::ProgressCallback const& progress, double inc_amt):
+      m_cloud(cloud), m_box(box), m_grid(grid), m_cell_counts(cell_counts),
+      m_mutex(mutex), m_progress(progress), m_inc_amt(inc_amt) {}
+
+    void operator()() {
+      vw::ImageView<PixelT> points = crop(m_cloud, m_box);
+      std::map<int, std::int64_t> counts;
+      for (int row = 0; row < points.rows(); row++) {
+        for (int col = 0; col < points.cols(); col++) {
+          if (is_valid_point(points(col, row)))
+            counts[cloud_order_cell(m_grid.code(subvector(points(col, row), 0, 3)))]++;
+        }
+      }
+
+      vw::Mutex::Lock lock(m_mutex);
+      for (auto const& c: counts)
+        m_cell_counts[c.first] += c.second;
+      m_progress.report_incremental_progress(m_inc_amt);
+    }
+  };
+
+  // Append the valid points of a tile, each preceded by its position
+  // along the curve, to the files of their runs
+  template <class PixelT>
+  class CloudScatterTask: public vw::Task, private boost::noncopyable {
+    vw::ImageViewRef<PixelT> const& m_cloud;
+    vw::BBox2i m_box;
+    CloudOrderGrid const& m_grid;
+    std::vector<int> const& m_cell_to_run;
+    std::string m_tmp_prefix;
+    vw::Mutex & m_mutex;
+    vw::ProgressCallback const& m_progress;
+    double m_inc_amt;
+  public:
+    CloudScatterTask(vw::ImageViewRef<PixelT> const& cloud, vw::BBox2i const& box,
+                     CloudOrderGrid const& grid, std::vector<int> const& cell_to_run,
+                     std::string const& tmp_prefix,
+                     vw::Mutex & mutex, vw::ProgressCallback const& progress, double inc_amt):
+      m_cloud(cloud), m_box(box), m_grid(grid), m_cell_to_run(cell_to_run),
+      m_tmp_prefix(tmp_prefix), m_mutex(mutex), m_progress(progress), m_inc_amt(inc_amt) {}
+
+    void operator()() {
+      const int num_channels = vw::math::VectorSize<PixelT>::value;
+      vw::ImageView<PixelT> points = crop(m_cloud, m_box);
+      std::map<int, std::vector<char>> records;
+      for (int row = 0; row < points.rows(); row++) {
+        for (int col = 0; col < points.cols(); col++) {
+          PixelT const& p = points(col, row);
+          if (!is_valid_point(p))
+            continue;
+          std::uint64_t code = m_grid.code(subvector(p, 0, 3));
+          std::vector<char> & buf = records[m_cell_to_run[cloud_order_cell(code)]];
+          size_t pos = buf.size();
+          buf.resize(pos + sizeof(code) + num_channels * sizeof(double));
+          std::memcpy(&buf[pos], &code, sizeof(code));
+          for (int ch = 0; ch < num_channels; ch++) {
+            double v = p[ch];
+            std::memcpy(&buf[pos + sizeof(code) + ch * sizeof(double)], &v, sizeof(double));
+          }
+        }
+      }
+
+      vw::Mutex::Lock lock(m_mutex);
+      for (auto const& r: records) {
+        std::string file = run_file(m_tmp_prefix, r.first);
+        std::ofstream ofs(file.c_str(), std::ios::binary | std::ios::app);
+        ofs.write(&r.second[0], r.second.size());
+        if (!ofs.good())
+          vw::vw_throw(vw::IOErr() << "Failed writing: " << file << "\n");
+      }
+      m_progress.report_incremental_progress(m_inc_amt);
+    }
+  };
+
+  // Run the tasks made by a factory for each tile of the cloud
+  template <class FactoryT>
+  void for_each_cloud_tile(vw::BBox2i const& cloud_box, std::string const& tag,
+                           FactoryT const& make_task) {
+    std::vector<vw::BBox2i> boxes = subdivide_bbox(cloud_box, CLOUD_TILE_SIZE, CLOUD_TILE_SIZE);
+    vw::TerminalProgressCallback tpc("asp", tag);
+    double inc_amt = 1.0 / std::max(boxes.size(), size_t(1));
+    tpc.report_progress(0);
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (size_t it = 0; it < boxes.size(); it++)
+      queue.add_task(make_task(boxes[it], tpc, inc_amt));
+    queue.join_all();
+    tpc.report_finished();
+  }
+
+} // end namespace cloud_reorder_private
+
+template <class PixelT>
+std::int64_t sort_cloud_spatially(vw::ImageViewRef<PixelT> const& cloud,
+                                  double memory_limit_mb,
+                                  std::string const& tmp_prefix,
+                                  std::string const& sorted_file) {
+
+  using namespace cloud_reorder_private;
+  typedef boost::shared_ptr<vw::Task> TaskPtr;
+  const int num_channels = vw::math::VectorSize<PixelT>::value;
+  const size_t record_size = sizeof(std::uint64_t) + num_channels * sizeof(double);
+  vw::BBox2i cloud_box = bounding_box(cloud);
+  vw::Mutex mutex;
+
+  // Find the extent of the points. Use longitudes in [0, 360) if that
+  // makes the box narrower, as when the cloud straddles 180 degrees.
+  vw::vw_out() << "Finding the extent of the point cloud.\n";
+  vw::BBox2 box_180, box_360;
+  std::int64_t num_points = 0;
+  for_each_cloud_tile(cloud_box, "\t--> Extent: ",
+                      [&](vw::BBox2i const& box, vw::ProgressCallback const& tpc, double inc) {
+                        return TaskPtr(new CloudLonLatBoxTask<PixelT>
+                                       (cloud, box, box_180, box_360, num_points,
+                                        mutex, tpc, inc));
+                      });
+  if (num_points == 0)
+    vw::vw_throw(vw::ArgumentErr() << "No valid points found in the input clouds.\n");
+  bool use_360 = (box_360.width() < box_180.width());
+  CloudOrderGrid grid(use_360 ? box_360 : box_180, use_360);
+
+  // Count the points in each cell, and group consecutive cells into runs
+  // which can be sorted in memory
+  vw::vw_out() << "Counting the points in each cell.\n";
+  std::vector<std::int64_t> cell_counts(1 << (2 * CLOUD_ORDER_CELL_BITS), 0);
+  for_each_cloud_tile(cloud_box, "\t--> Counting: ",
+                      [&](vw::BBox2i const& box, vw::ProgressCallback const& tpc, double inc) {
+                        return TaskPtr(new CloudCellCountTask<PixelT>
+                                       (cloud, box, grid, cell_counts, mutex, tpc, inc));
+                      });
+  // Sorting a run needs the records and a key and index for each
+  std::int64_t max_points
+    = std::max(std::int64_t(1), std::int64_t(memory_limit_mb * 1024.0 * 1024.0 /
+                                             (record_size + 16)));
+  std::vector<int> cell_to_run;
+  int num_runs = partition_cloud_cells(cell_counts, max_points, cell_to_run);
+
+  // Remove any run files left over from an earlier run
+  for (int run = 0; run < num_runs; run++)
+    std::remove(run_file(tmp_prefix, run).c_str());
+
+  vw::vw_out() << "Writing " << num_points << " points to " << num_runs
+               << " temporary file(s).\n";
+  for_each_cloud_tile(cloud_box, "\t--> Bucketing: ",
+                      [&](vw::BBox2i const& box, vw::ProgressCallback const& tpc, double inc) {
+                        return TaskPtr(new CloudScatterTask<PixelT>
+                                       (cloud, box, grid, cell_to_run, tmp_prefix,
+                                        mutex, tpc, inc));
+                      });
+
+  // Sort each run and append it to the output, then delete it
+  vw::vw_out() << "Sorting the points.\n";
+  std::ofstream ofs(sorted_file.c_str(), std::ios::binary | std::ios::trunc);
+  if (!ofs.good())
+    vw::vw_throw(vw::IOErr() << "Cannot write: " << sorted_file << "\n");
+  vw::TerminalProgressCallback tpc("asp", "\t--> Sorting: ");
+  std::int64_t num_written = 0;
+  for (int run = 0; run < num_runs; run++) {
+    tpc.report_fractional_progress(run, num_runs);
+    std::string file = run_file(tmp_prefix, run);
+    std::vector<char> records;
+    {
+      std::ifstream ifs(file.c_str(), std::ios::binary | std::ios::ate);
+      if (!ifs.good())
+        continue; // a run with no points
+      records.resize(ifs.tellg());
+      ifs.seekg(0);
+      ifs.read(records.data(), records.size());
+    }
+    std::remove(file.c_str());
+
+    std::int64_t num_records = records.size() / record_size;
+    std::vector<std::pair<std::uint64_t, std::int64_t>> keys(num_records);
+    for (std::int64_t it = 0; it < num_records; it++) {
+      std::memcpy(&keys[it].first, &records[it * record_size], sizeof(std::uint64_t));
+      keys[it].second = it;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<char> sorted(num_records * num_channels * sizeof(double));
+    for (std::int64_t it = 0; it < num_records; it++)
+      std::memcpy(&sorted[it * num_channels * sizeof(double)],
+                  &records[keys[it].second * record_size + sizeof(std::uint64_t)],
+                  num_channels * sizeof(double));
+    ofs.write(sorted.data(), sorted.size());
+    num_written += num_records;
+  }
+  tpc.report_finished();
+
+  if (!ofs.good())
+    vw::vw_throw(vw::IOErr() << "Failed writing: " << sorted_file << "\n");
+  if (num_written != num_points)
+    vw::vw_throw(vw::LogicErr() << "Expected to sort " << num_points << " points, but got "
+                 << num_written << ".\n");
+
+  return num_points;
+}
+
+template <class PixelT>
+SortedCloudView<PixelT>::SortedCloudView(std::string const& file, std::int64_t num_points,
+                                         int block_size):
+  m_file(file), m_num_points(num_points), m_block_size(block_size) {
+
+  // Arrange the blocks in a roughly square image
+  std::int64_t block_area = std::int64_t(block_size) * block_size;
+  std::int64_t num_blocks = std::max(std::int64_t(1), (num_points + block_area - 1) / block_area);
+  m_blocks_x = int(std::ceil(std::sqrt(double(num_blocks))));
+  m_blocks_y = int((num_blocks + m_blocks_x - 1) / m_blocks_x);
+}
+
+template <class PixelT>
+typename SortedCloudView<PixelT>::prerasterize_type
+SortedCloudView<PixelT>::prerasterize(vw::BBox2i const& bbox) const {
+
+  const int num_channels = vw::math::VectorSize<PixelT>::value;
+  const std::int64_t block_area = std::int64_t(m_block_size) * m_block_size;
+
+  // Pixels not covered by any point stay zero, so invalid
+  vw::ImageView<PixelT> out(bbox.width(), bbox.height());
+  fill(out, PixelT());
+
+  std::ifstream ifs(m_file.c_str(), std::ios::binary);
+  if (!ifs.good())
+    vw::vw_throw(vw::IOErr() << "Cannot read: " << m_file << "\n");
+
+  std::vector<double> buf;
+  for (int by = bbox.min().y() / m_block_size; by <= (bbox.max().y() - 1) / m_block_size; by++) {
+    for (int bx = bbox.min().x() / m_block_size; bx <= (bbox.max().x() - 1) / m_block_size; bx++) {
+
+      // The points in this block
+      std::int64_t start = (std::int64_t(by) * m_blocks_x + bx) * block_area;
+      if (start >= m_num_points)
+        continue;
+      std::int64_t count = std::min(block_area, m_num_points - start);
+      buf.resize(count * num_channels);
+      ifs.seekg(start * num_channels * sizeof(double));
+      ifs.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(double));
+      if (!ifs.good())
+        vw::vw_throw(vw::IOErr() << "Failed reading: " << m_file << "\n");
+
+      for (std::int64_t k = 0; k < count; k++) {
+        int col = bx * m_block_size + int(k % m_block_size);
+        int row = by * m_block_size + int(k / m_block_size);
+        if (!bbox.contains(vw::Vector2i(col, row)))
+          continue;
+        PixelT & p = out(col - bbox.min().x(), row - bbox.min().y());
+        for (int ch = 0; ch < num_channels; ch++)
+          p[ch] = buf[k * num_channels + ch];
+      }
+    }
+  }
+
+  return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), this->cols(), this->rows());
+}
+
+} // end namespace asp
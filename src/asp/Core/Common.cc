@@ -21,6 +21,11 @@
 #include <vw/FileIO/DiskImageResource.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/BlockJournal.h>
+#include <asp/Core/MemoryBudget.h>
+#include <asp/Core/MemoryProfile.h>
+#include <asp/Core/ObjectStorage.h>
+#include <asp/Core/Telemetry.h>
 
 #include <asp/asp_date_config.h>
 
@@ -322,7 +327,7 @@ bool asp::parse_multiview_cmd_files(std::vector<std::string> const &filesIn,
 
   // Verify that the images and cameras exist, otherwise GDAL prints funny messages later.
   for (int i = 0; i < (int)image_paths.size(); i++){
-    if (!fs::exists(image_paths[i])) {
+    if (!asp::path_exists(image_paths[i])) {
       vw_throw( ArgumentErr() << "Cannot find the image file: " << image_paths[i] << ".\n");
       return false;
     }
@@ -409,6 +414,10 @@ void asp::log_to_file(int argc, char *argv[],
   if (out_prefix == "")
     vw::vw_throw( vw::ArgumentErr() << "Output prefix was not set.\n");
 
+  // The log is not written to object storage
+  if (asp::is_object_storage_path(out_prefix))
+    return;
+
   // Create the output directory if not present
   vw::create_out_dir(out_prefix);
 
@@ -426,6 +435,12 @@ void asp::log_to_file(int argc, char *argv[],
      << clean_timestamp << "-" << pid << ".txt";
   std::string log_file = os.str();
   vw_out() << "Writing log info to: " << log_file << std::endl;
+
+  // The telemetry summary goes next to the log, and is written at exit
+  std::ostringstream ts;
+  ts << out_prefix << "-telemetry-" << prog_name << "-"
+     << clean_timestamp << "-" << pid << ".json";
+  asp::telemetry().enable_summary_at_exit(prog_name, ts.str());
   std::ofstream lg(log_file.c_str());
 
   // Write the version
@@ -618,15 +633,38 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
   usage_comment = ostr.str();
 
   set_asp_env_vars();
+  asp::set_object_storage_options();
+
+  // Write a telemetry summary at exit, if requested via ASP_TELEMETRY_DIR.
+  // log_to_file() also puts one next to the log.
+  asp::telemetry().enable_summary_at_exit(extract_prog_name(argv[0]), "");
+
+  // Sample the memory in the background, if ASP_MEMORY_PROFILE is 1
+  asp::start_memory_sampling();
   
   // We distinguish between all_public_options, which is all the
   // options we must parse, even if we don't need some of them, and
   // public_options, which are the options specifically used by the
   // current tool, and for which we also print the help message.
+  // Options which all tools accept. The memory budget is shared by the VW
+  // cache and the large structures of the tool.
+  double memory_limit_mb = 0.0;
+  bool resume = false;
+  po::options_description common_options;
+  common_options.add_options()
+    ("memory-limit-mb", po::value(&memory_limit_mb)->default_value(0.0),
+     "Keep the VW block cache and the large buffers of the tool within this "
+     "memory, in MB. The cache shrinks as the buffers grow, and this overrides "
+     "--cache-size-mb. Set to 0 to not use a limit.")
+    ("resume", po::bool_switch(&resume)->default_value(false)->implicit_value(true),
+     "If a previous run with the same options was killed while writing an image, "
+     "keep the blocks it wrote, as recorded in the .journal file next to the image, "
+     "and compute only the rest.");
+
   po::variables_map vm;
   try {
     po::options_description all_options;
-    all_options.add(all_public_options).add(positional_options);
+    all_options.add(all_public_options).add(common_options).add(positional_options);
 
     if (allow_unregistered) {
       po::parsed_options parsed = po::command_line_parser(argc, argv).options(all_options).allow_unregistered().style(po::command_line_style::unix_style).run();
@@ -639,7 +677,8 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
     po::notify(vm);
   } catch (po::error const& e) {
     vw::vw_throw(vw::ArgumentErr() << "Error parsing input:\n"
-                  << e.what() << "\n" << usage_comment << public_options);
+                  << e.what() << "\n" << usage_comment << public_options
+                  << common_options);
   }
 
   // We really don't want to use BIGTIFF unless we have to. It's
@@ -651,7 +690,7 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
   }
 
   if ( vm.count("help") )
-    vw::vw_throw(vw::ArgumentErr() << usage_comment << public_options);
+    vw::vw_throw(vw::ArgumentErr() << usage_comment << public_options << common_options);
 
   if ( vm.count("version") ) {
     std::ostringstream ostr;
@@ -675,6 +714,12 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
   }
 
   opt.setVwSettingsFromOpt();
+
+  if (memory_limit_mb < 0.0)
+    vw::vw_throw(vw::ArgumentErr() << "The value of --memory-limit-mb must be non-negative.\n");
+  if (memory_limit_mb > 0.0)
+    asp::set_memory_limit_mb(memory_limit_mb);
+  asp::set_resume_block_writes(resume);
   
   return vm;
 }
@@ -848,6 +893,14 @@ bool asp::BitChecker::is_good() const {
   return (m_good == m_checksum);
 }
 
+unsigned long asp::BitChecker::checked_bits() const {
+  return m_checksum.to_ulong();
+}
+
+void asp::BitChecker::set_checked_bits(unsigned long bits) {
+  m_checksum = std::bitset<32>(bits);
+}
+
 
 namespace boost {
 namespace program_options {
@@ -42,11 +42,17 @@
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 
+#include <asp/Core/AsyncBlockWriter.h>
+#include <asp/Core/ProgressStatus.h>
+
 #include <boost/program_options.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <iomanip>
+#include <limits>
 #include <map>
+#include <sstream>
 #include <string>
 
 namespace vw {
@@ -203,6 +209,76 @@ namespace asp {
   }
 
 
+  /// Tags recording the sizes of the integer steps in a compact point
+  /// cloud, for the first three channels and for the others.
+  const std::string ASP_POINT_SCALE_TAG_STR = "POINT_SCALE";
+  const std::string ASP_ERROR_SCALE_TAG_STR = "ERROR_SCALE";
+
+  /// Store a shifted point cloud pixel as integer multiples of given
+  /// steps, for the points and for the errors. A valid point which
+  /// rounds to the zero vector, and a nonzero error which rounds to
+  /// zero, are moved one step away, as zero means no data.
+  template <class VecT>
+  struct QuantizeCloudPixels:
+    public vw::ReturnFixedType<vw::Vector<vw::int32, vw::math::VectorSize<VecT>::value>> {
+    typedef vw::Vector<vw::int32, vw::math::VectorSize<VecT>::value> QuantT;
+    double m_point_scale, m_error_scale;
+    QuantizeCloudPixels(double point_scale, double error_scale):
+      m_point_scale(point_scale), m_error_scale(error_scale){
+      VW_ASSERT(m_point_scale > 0.0 && m_error_scale > 0.0,
+                vw::ArgumentErr() << "Quantization steps must be positive.");
+    }
+    QuantT operator() (VecT const& pt) const {
+      QuantT q;
+      bool is_zero = true;
+      for (size_t c = 0; c < pt.size(); c++) {
+        double scale = (c < 3) ? m_point_scale : m_error_scale;
+        double val = round(pt[c]/scale);
+        if (std::abs(val) > double(std::numeric_limits<vw::int32>::max()))
+          vw::vw_throw(vw::ArgumentErr() << "A point cloud value of " << pt[c]
+                       << " does not fit in a compact point cloud with a step of "
+                       << scale << ". Increase the step or do not use "
+                       << "--compact-point-cloud.\n");
+        q[c] = vw::int32(val);
+        if (c >= 3 && q[c] == 0 && pt[c] != 0)
+          q[c] = (pt[c] > 0) ? 1 : -1;
+        if (c < 3 && pt[c] != 0)
+          is_zero = false;
+      }
+      if (!is_zero && q[0] == 0 && q[1] == 0 && q[2] == 0)
+        q[0] = 1;
+      return q;
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, QuantizeCloudPixels<typename ImageT::pixel_type> >
+  inline quantize_cloud_pixels(vw::ImageViewBase<ImageT> const& image,
+                               double point_scale, double error_scale) {
+    return vw::UnaryPerPixelView<ImageT, QuantizeCloudPixels<typename ImageT::pixel_type> >
+      (image.impl(), QuantizeCloudPixels<typename ImageT::pixel_type>(point_scale, error_scale));
+  }
+
+  /// The inverse of QuantizeCloudPixels, on pixels already converted to double
+  template <class VecT>
+  struct ScaleCloudPixels: public vw::ReturnFixedType<VecT> {
+    double m_point_scale, m_error_scale;
+    ScaleCloudPixels(double point_scale, double error_scale):
+      m_point_scale(point_scale), m_error_scale(error_scale){}
+    VecT operator() (VecT const& pt) const {
+      VecT lpt = pt;
+      for (size_t c = 0; c < lpt.size(); c++)
+        lpt[c] *= (c < 3) ? m_point_scale : m_error_scale;
+      return lpt;
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, ScaleCloudPixels<typename ImageT::pixel_type> >
+  inline scale_cloud_pixels(vw::ImageViewBase<ImageT> const& image,
+                            double point_scale, double error_scale) {
+    return vw::UnaryPerPixelView<ImageT, ScaleCloudPixels<typename ImageT::pixel_type> >
+      (image.impl(), ScaleCloudPixels<typename ImageT::pixel_type>(point_scale, error_scale));
+  }
+
   /// To help with compression, round to about 1mm, but
   /// use for rounding a number with few digits in binary.
   const double APPROX_ONE_MM = 1.0/1024.0;
@@ -250,6 +326,40 @@ namespace asp {
                                std::map<std::string, std::string>() );
 
 
+  /// Block write a point cloud in the compact format. The given shift
+  /// is subtracted from the points, then all values are stored as
+  /// 32-bit integer multiples of point_scale (for the first three
+  /// channels) and of error_scale (for the others). The TIFF predictor
+  /// is set to difference neighboring pixels, so each row of a tile is
+  /// stored as small steps from its first pixel. Read the cloud with
+  /// read_asp_point_cloud().
+  template <class ImageT>
+  void block_write_compact_gdal_image(const std::string &filename,
+                                      vw::Vector3 const& shift,
+                                      double point_scale, double error_scale,
+                                      vw::ImageViewBase<ImageT> const& image,
+                                      bool has_georef,
+                                      vw::cartography::GeoReference const& georef,
+                                      vw::GdalWriteOptions const& opt,
+                                      vw::ProgressCallback const& progress_callback
+                                      = vw::ProgressCallback::dummy_instance(),
+                                      std::map<std::string, std::string> const& keywords =
+                                      std::map<std::string, std::string>() );
+
+  /// Single-threaded version of block_write_compact_gdal_image().
+  template <class ImageT>
+  void write_compact_gdal_image(const std::string &filename,
+                                vw::Vector3 const& shift,
+                                double point_scale, double error_scale,
+                                vw::ImageViewBase<ImageT> const& image,
+                                bool has_georef,
+                                vw::cartography::GeoReference const& georef,
+                                vw::GdalWriteOptions const& opt,
+                                vw::ProgressCallback const& progress_callback
+                                = vw::ProgressCallback::dummy_instance(),
+                                std::map<std::string, std::string> const& keywords =
+                                std::map<std::string, std::string>() );
+
   /// Often times, we'd like to save an image to disk by using big
   /// blocks, for performance reasons, then re-write it with desired blocks.
   template <class ImageT>
@@ -280,6 +390,11 @@ namespace asp {
     BitChecker( vw::uint8 num_arguments );
 
     bool is_good() const; ///< Return true if all arguments have been checked.
+
+    /// The arguments checked so far, as bits, to be saved and restored
+    /// along with the values that were read.
+    unsigned long checked_bits() const;
+    void set_checked_bits(unsigned long bits);
   }; // End class BitChecker
 
 } // end namespace asp
@@ -40,6 +40,7 @@ namespace asp {
                                      vw::ProgressCallback const& progress_callback,
                                      std::map<std::string, std::string> const& keywords) {
 
+    set_progress_total(progress_callback, double(image.impl().cols()) * image.impl().rows());
 
     if (norm_2(shift) > 0){
 
@@ -47,17 +48,17 @@ namespace asp {
       std::map<std::string, std::string> local_keywords = keywords;
       local_keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
 
-      block_write_gdal_image(filename,
-                             vw::channel_cast<float>
-                             (round_image_pixels(subtract_shift(image.impl(), shift),
-                                                 get_rounding_error(shift, rounding_error))),
-                             has_georef, georef, has_nodata, nodata,
-                             opt, progress_callback, local_keywords);
+      async_block_write_gdal_image(filename,
+                                   vw::channel_cast<float>
+                                   (round_image_pixels(subtract_shift(image.impl(), shift),
+                                                       get_rounding_error(shift, rounding_error))),
+                                   has_georef, georef, has_nodata, nodata,
+                                   opt, progress_callback, local_keywords);
 
     }else{
-      block_write_gdal_image(filename, image, has_georef, georef,
-                             has_nodata, nodata, opt,
-                             progress_callback, keywords);
+      async_block_write_gdal_image(filename, image, has_georef, georef,
+                                   has_nodata, nodata, opt,
+                                   progress_callback, keywords);
     }
 
   }
@@ -76,6 +77,8 @@ namespace asp {
                                vw::ProgressCallback const& progress_callback,
                                std::map<std::string, std::string> const& keywords){
 
+    set_progress_total(progress_callback, double(image.impl().cols()) * image.impl().rows());
+
     if (norm_2(shift) > 0){
       // Add the point shift to keywords
       std::map<std::string, std::string> local_keywords = keywords;
@@ -92,6 +95,73 @@ namespace asp {
     }
   }
 
+  // Set up the options and keywords for a compact point cloud
+  inline void compact_cloud_write_setup(vw::Vector3 const& shift,
+                                        double point_scale, double error_scale,
+                                        vw::GdalWriteOptions & opt,
+                                        std::map<std::string, std::string> & keywords) {
+    // Horizontal differencing turns the slowly changing integers into
+    // small numbers, which compress well
+    opt.gdal_options["PREDICTOR"] = "2";
+    keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
+    std::ostringstream point_os, error_os;
+    point_os << std::setprecision(17) << point_scale;
+    error_os << std::setprecision(17) << error_scale;
+    keywords[ASP_POINT_SCALE_TAG_STR]  = point_os.str();
+    keywords[ASP_ERROR_SCALE_TAG_STR]  = error_os.str();
+  }
+
+  template <class ImageT>
+  void block_write_compact_gdal_image(const std::string &filename,
+                                      vw::Vector3 const& shift,
+                                      double point_scale, double error_scale,
+                                      vw::ImageViewBase<ImageT> const& image,
+                                      bool has_georef,
+                                      vw::cartography::GeoReference const& georef,
+                                      vw::GdalWriteOptions const& opt,
+                                      vw::ProgressCallback const& progress_callback,
+                                      std::map<std::string, std::string> const& keywords) {
+
+    set_progress_total(progress_callback, double(image.impl().cols()) * image.impl().rows());
+    vw::GdalWriteOptions local_opt = opt;
+    std::map<std::string, std::string> local_keywords = keywords;
+    compact_cloud_write_setup(shift, point_scale, error_scale, local_opt, local_keywords);
+
+    // Zero is no-data by convention, there is no need for a separate value
+    bool has_nodata = false;
+    double nodata = 0.0;
+    async_block_write_gdal_image(filename,
+                                 quantize_cloud_pixels(subtract_shift(image.impl(), shift),
+                                                       point_scale, error_scale),
+                                 has_georef, georef, has_nodata, nodata,
+                                 local_opt, progress_callback, local_keywords);
+  }
+
+  template <class ImageT>
+  void write_compact_gdal_image(const std::string &filename,
+                                vw::Vector3 const& shift,
+                                double point_scale, double error_scale,
+                                vw::ImageViewBase<ImageT> const& image,
+                                bool has_georef,
+                                vw::cartography::GeoReference const& georef,
+                                vw::GdalWriteOptions const& opt,
+                                vw::ProgressCallback const& progress_callback,
+                                std::map<std::string, std::string> const& keywords) {
+
+    set_progress_total(progress_callback, double(image.impl().cols()) * image.impl().rows());
+    vw::GdalWriteOptions local_opt = opt;
+    std::map<std::string, std::string> local_keywords = keywords;
+    compact_cloud_write_setup(shift, point_scale, error_scale, local_opt, local_keywords);
+
+    bool has_nodata = false;
+    double nodata = 0.0;
+    write_gdal_image(filename,
+                     quantize_cloud_pixels(subtract_shift(image.impl(), shift),
+                                           point_scale, error_scale),
+                     has_georef, georef, has_nodata, nodata,
+                     local_opt, progress_callback, local_keywords);
+  }
+
   // Often times, we'd like to save an image to disk by using big
   // blocks, for performance reasons, then re-write it with desired blocks.
   template <class ImageT>
@@ -104,9 +174,20 @@ namespace asp {
                                  vw::GdalWriteOptions & opt,
                                  vw::ProgressCallback const& tpc){
 
+    // The temporary file is renamed, so this cannot be done in object storage
+    if (is_object_storage_path(filename)) {
+      ObjectStorageOutput output(filename);
+      save_with_temp_big_blocks(big_block_size, output.local_path(), img, has_georef,
+                                georef, has_nodata, nodata, opt, tpc);
+      output.upload();
+      return;
+    }
+
+    set_progress_total(tpc, double(img.impl().cols()) * img.impl().rows());
     vw::Vector2 orig_block_size = opt.raster_tile_size;
     opt.raster_tile_size = vw::Vector2(big_block_size, big_block_size);
-    block_write_gdal_image(filename, img, has_georef, georef, has_nodata, nodata, opt, tpc);
+    async_block_write_gdal_image(filename, img, has_georef, georef, has_nodata, nodata,
+                                 opt, tpc);
 
     if (opt.raster_tile_size != orig_block_size){
       std::string tmp_file
@@ -116,8 +197,8 @@ namespace asp {
       opt.raster_tile_size = orig_block_size;
       vw::vw_out() << "Re-writing with blocks of size: "
                    << opt.raster_tile_size[0] << " x " << opt.raster_tile_size[1] << ".\n";
-      vw::cartography::block_write_gdal_image(filename, tmp_img, has_georef, georef,
-                                  has_nodata, nodata, opt, tpc);
+      async_block_write_gdal_image(filename, tmp_img, has_georef, georef,
+                                   has_nodata, nodata, opt, tpc);
       boost::filesystem::remove(tmp_file);
     }
     return;
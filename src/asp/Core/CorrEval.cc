@@ -0,0 +1,320 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CorrEval.cc
+///
+
+#include <asp/Core/CorrEval.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace vw;
+
+namespace asp {
+
+// Integral images of the values, squared values, and valid pixel count
+// of a masked image. Entry (col, row) has the sums over the pixels with
+// smaller column and row.
+struct IntegralSums {
+  int m_cols, m_rows;
+  std::vector<double> m_sum, m_sum2;
+  std::vector<int> m_count;
+
+  explicit IntegralSums(ImageView<PixelMask<float>> const& img):
+    m_cols(img.cols()), m_rows(img.rows()) {
+    int num = (m_cols + 1) * (m_rows + 1);
+    m_sum.assign(num, 0.0);
+    m_sum2.assign(num, 0.0);
+    m_count.assign(num, 0);
+    for (int row = 0; row < m_rows; row++) {
+      double row_sum = 0.0, row_sum2 = 0.0;
+      int row_count = 0;
+      for (int col = 0; col < m_cols; col++) {
+        PixelMask<float> const& pix = img(col, row);
+        if (is_valid(pix)) {
+          double val = pix.child();
+          row_sum  += val;
+          row_sum2 += val * val;
+          row_count++;
+        }
+        int curr = index(col + 1, row + 1), prev = index(col + 1, row);
+        m_sum[curr]   = m_sum[prev]   + row_sum;
+        m_sum2[curr]  = m_sum2[prev]  + row_sum2;
+        m_count[curr] = m_count[prev] + row_count;
+      }
+    }
+  }
+
+  int index(int col, int row) const { return row * (m_cols + 1) + col; }
+
+  // The sums over the box with given corner and dimensions, which must be
+  // within the image
+  void box_sums(int col, int row, int width, int height,
+                double & sum, double & sum2, int & count) const {
+    int a = index(col, row),         b = index(col + width, row);
+    int c = index(col, row + height), d = index(col + width, row + height);
+    sum   = m_sum[d]   - m_sum[b]   - m_sum[c]   + m_sum[a];
+    sum2  = m_sum2[d]  - m_sum2[b]  - m_sum2[c]  + m_sum2[a];
+    count = m_count[d] - m_count[b] - m_count[c] + m_count[a];
+  }
+};
+
+// Bilinear interpolation in a masked image. The result is invalid if
+// any of the pixels it uses is invalid or out of range.
+inline PixelMask<float> masked_bilinear(ImageView<PixelMask<float>> const& img,
+                                        double x, double y) {
+  int x0 = floor(x), y0 = floor(y);
+  if (x0 < 0 || y0 < 0 || x0 + 1 >= img.cols() || y0 + 1 >= img.rows())
+    return PixelMask<float>();
+  PixelMask<float> const& p00 = img(x0, y0);
+  PixelMask<float> const& p10 = img(x0 + 1, y0);
+  PixelMask<float> const& p01 = img(x0, y0 + 1);
+  PixelMask<float> const& p11 = img(x0 + 1, y0 + 1);
+  if (!is_valid(p00) || !is_valid(p10) || !is_valid(p01) || !is_valid(p11))
+    return PixelMask<float>();
+  double dx = x - x0, dy = y - y0;
+  double val = (1.0 - dx) * ((1.0 - dy) * p00.child() + dy * p01.child())
+    + dx * ((1.0 - dy) * p10.child() + dy * p11.child());
+  return PixelMask<float>(val);
+}
+
+// Find the metric from the sums over the pixels valid in both patches.
+// Return false if it cannot be found.
+inline bool metric_from_sums(bool is_ncc, int count,
+                             double sum_l, double sum_l2,
+                             double sum_r, double sum_r2, double sum_lr,
+                             float & val) {
+  if (count <= 0)
+    return false;
+  if (is_ncc) {
+    double den = sum_l2 * sum_r2;
+    if (den <= 0.0)
+      return false;
+    val = sum_lr / sqrt(den);
+    return true;
+  }
+  double mean_l = sum_l / count, mean_r = sum_r / count;
+  double var_l = std::max(sum_l2 / count - mean_l * mean_l, 0.0);
+  double var_r = std::max(sum_r2 / count - mean_r * mean_r, 0.0);
+  val = 0.5 * (sqrt(var_l) + sqrt(var_r));
+  return true;
+}
+
+class CorrEvalView: public ImageViewBase<CorrEvalView> {
+  ImageViewRef<PixelMask<float>> m_left, m_right;
+  ImageViewRef<PixelMask<Vector2f>> m_disparity;
+  Vector2i m_kernel_size;
+  bool m_is_ncc;
+  int m_sample_rate;
+  bool m_round_to_int;
+
+public:
+  CorrEvalView(ImageViewRef<PixelMask<float>> const& left,
+               ImageViewRef<PixelMask<float>> const& right,
+               ImageViewRef<PixelMask<Vector2f>> const& disparity,
+               Vector2i const& kernel_size, std::string const& metric,
+               int sample_rate, bool round_to_int):
+    m_left(left), m_right(right), m_disparity(disparity),
+    m_kernel_size(kernel_size), m_is_ncc(metric == "ncc"),
+    m_sample_rate(sample_rate), m_round_to_int(round_to_int) {
+
+    if (m_kernel_size[0] <= 0 || m_kernel_size[1] <= 0 ||
+        m_kernel_size[0] % 2 == 0 || m_kernel_size[1] % 2 == 0)
+      vw_throw(ArgumentErr() << "The kernel dimensions must be positive and odd.\n");
+    if (metric != "ncc" && metric != "stddev")
+      vw_throw(ArgumentErr() << "Unknown metric: " << metric << ".\n");
+    if (m_sample_rate < 1)
+      vw_throw(ArgumentErr() << "The sample rate must be positive.\n");
+    if (m_left.cols() != m_disparity.cols() || m_left.rows() != m_disparity.rows())
+      vw_throw(ArgumentErr() << "The left image and disparity must have the same size.\n");
+  }
+
+  typedef PixelMask<float> pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<CorrEvalView> pixel_accessor;
+
+  inline int32 cols  () const { return m_left.cols(); }
+  inline int32 rows  () const { return m_left.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline pixel_type operator()(double/*i*/, double/*j*/, int32/*p*/ = 0) const {
+    vw_throw(NoImplErr() << "CorrEvalView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    ImageView<pixel_type> out(bbox.width(), bbox.height());
+    for (int col = 0; col < out.cols(); col++)
+      for (int row = 0; row < out.rows(); row++)
+        out(col, row).invalidate();
+
+    int hx = m_kernel_size[0] / 2, hy = m_kernel_size[1] / 2;
+    int kx = m_kernel_size[0],     ky = m_kernel_size[1];
+
+    // The disparity in this tile, and the region of the right image it needs
+    ImageView<PixelMask<Vector2f>> disp = crop(m_disparity, bbox);
+    BBox2i right_box;
+    for (int col = 0; col < disp.cols(); col++) {
+      for (int row = 0; row < disp.rows(); row++) {
+        if (!is_valid(disp(col, row)))
+          continue;
+        Vector2 rpix = Vector2(col + bbox.min().x(), row + bbox.min().y())
+          + Vector2(disp(col, row).child());
+        right_box.grow(Vector2i(floor(rpix.x()), floor(rpix.y())));
+        right_box.grow(Vector2i(ceil(rpix.x()), ceil(rpix.y())));
+      }
+    }
+    if (right_box.empty())
+      return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+
+    // Grow by the kernel. Beyond the image the pixels are invalid, so
+    // there is no need to read more than the image has.
+    right_box.max() += Vector2i(1, 1);
+    right_box.expand(std::max(hx, hy) + 1);
+    BBox2i right_image_box = bounding_box(m_right);
+    right_image_box.expand(std::max(hx, hy) + 1);
+    right_box.crop(right_image_box);
+
+    BBox2i left_box = bbox;
+    left_box.min() -= Vector2i(hx, hy);
+    left_box.max() += Vector2i(hx, hy);
+
+    PixelMask<float> no_data;
+    no_data.invalidate();
+    ImageView<PixelMask<float>> left_tile
+      = crop(edge_extend(m_left, ValueEdgeExtension<PixelMask<float>>(no_data)), left_box);
+    ImageView<PixelMask<float>> right_tile
+      = crop(edge_extend(m_right, ValueEdgeExtension<PixelMask<float>>(no_data)), right_box);
+
+    // Window sums in constant time. With interpolation the right window
+    // sums are not those of the right image, so only the left ones are used.
+    IntegralSums left_sums(left_tile), right_sums(right_tile);
+    int full_count = kx * ky;
+
+    for (int col = 0; col < out.cols(); col++) {
+      int gcol = col + bbox.min().x();
+      if (gcol % m_sample_rate != 0)
+        continue;
+      for (int row = 0; row < out.rows(); row++) {
+        int grow = row + bbox.min().y();
+        if (grow % m_sample_rate != 0)
+          continue;
+        if (!is_valid(disp(col, row)) || !is_valid(left_tile(col + hx, row + hy)))
+          continue;
+
+        // The upper-left corners of the two patches in the tiles
+        int lx = col, ly = row;
+        Vector2 rpix = Vector2(gcol, grow) + Vector2(disp(col, row).child());
+        if (m_round_to_int)
+          rpix = Vector2(round(rpix.x()), round(rpix.y()));
+        double rx = rpix.x() - hx - right_box.min().x();
+        double ry = rpix.y() - hy - right_box.min().y();
+
+        double sum_l = 0, sum_l2 = 0, sum_r = 0, sum_r2 = 0, sum_lr = 0;
+        int count = 0;
+
+        // See if both patches are fully valid, then only the cross term
+        // needs a loop, and only for ncc.
+        int left_count = 0;
+        left_sums.box_sums(lx, ly, kx, ky, sum_l, sum_l2, left_count);
+        bool full = (left_count == full_count);
+        if (full && m_round_to_int) {
+          int irx = rx, iry = ry;
+          int right_count = 0;
+          full = (irx >= 0 && iry >= 0 &&
+                  irx + kx <= right_tile.cols() && iry + ky <= right_tile.rows());
+          if (full)
+            right_sums.box_sums(irx, iry, kx, ky, sum_r, sum_r2, right_count);
+          full = full && (right_count == full_count);
+          if (full) {
+            count = full_count;
+            if (m_is_ncc) {
+              for (int dy = 0; dy < ky; dy++)
+                for (int dx = 0; dx < kx; dx++)
+                  sum_lr += double(left_tile(lx + dx, ly + dy).child())
+                    * right_tile(irx + dx, iry + dy).child();
+            }
+          }
+        } else {
+          full = false;
+        }
+
+        if (!full) {
+          // Go over the patches and use the pixels valid in both
+          sum_l = sum_l2 = sum_r = sum_r2 = sum_lr = 0;
+          count = 0;
+          for (int dy = 0; dy < ky; dy++) {
+            for (int dx = 0; dx < kx; dx++) {
+              PixelMask<float> const& lval = left_tile(lx + dx, ly + dy);
+              if (!is_valid(lval))
+                continue;
+              PixelMask<float> rval;
+              if (m_round_to_int) {
+                int ix = int(rx) + dx, iy = int(ry) + dy;
+                if (ix < 0 || iy < 0 || ix >= right_tile.cols() || iy >= right_tile.rows())
+                  continue;
+                rval = right_tile(ix, iy);
+              } else {
+                rval = masked_bilinear(right_tile, rx + dx, ry + dy);
+              }
+              if (!is_valid(rval))
+                continue;
+              double l = lval.child(), r = rval.child();
+              sum_l += l; sum_l2 += l * l;
+              sum_r += r; sum_r2 += r * r;
+              sum_lr += l * r;
+              count++;
+            }
+          }
+        }
+
+        float val = 0.0;
+        if (metric_from_sums(m_is_ncc, count, sum_l, sum_l2, sum_r, sum_r2, sum_lr, val))
+          out(col, row) = pixel_type(val);
+      }
+    }
+
+    return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+}; // End class CorrEvalView
+
+vw::ImageViewRef<vw::PixelMask<float>>
+corr_eval(vw::ImageViewRef<vw::PixelMask<float>> const& left,
+          vw::ImageViewRef<vw::PixelMask<float>> const& right,
+          vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& disparity,
+          vw::Vector2i const& kernel_size, std::string const& metric,
+          int sample_rate, bool round_to_int) {
+  return CorrEvalView(left, right, disparity, kernel_size, metric,
+                      sample_rate, round_to_int);
+}
+
+} // end namespace asp
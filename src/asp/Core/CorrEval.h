@@ -0,0 +1,56 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CorrEval.h
+///
+/// Evaluate the quality of a disparity, for the corr_eval tool.
+///
+#ifndef __ASP_CORE_CORR_EVAL_H__
+#define __ASP_CORE_CORR_EVAL_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+
+namespace asp {
+
+  /// For each left image pixel, compare the patch of given size around it
+  /// with the patch in the right image around where the disparity takes
+  /// it. Only the pixels valid in both patches are used. The metric is
+  /// either "ncc", the normalized cross-correlation sum(l * r) /
+  /// sqrt(sum(l^2) * sum(r^2)), with no mean subtraction, or "stddev",
+  /// the average of the standard deviations of the two patches. With
+  /// round_to_int, the disparity is rounded, else bilinear interpolation
+  /// is used in the right image. The result is computed only at pixels
+  /// whose row and column are multiples of sample_rate.
+  ///
+  /// Per output tile, the window sums are found with integral images
+  /// where the patches have no invalid pixels, so the stddev metric with
+  /// round_to_int costs a constant time per pixel, and ncc needs only
+  /// the cross term per pixel.
+  vw::ImageViewRef<vw::PixelMask<float>>
+  corr_eval(vw::ImageViewRef<vw::PixelMask<float>> const& left,
+            vw::ImageViewRef<vw::PixelMask<float>> const& right,
+            vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& disparity,
+            vw::Vector2i const& kernel_size, std::string const& metric,
+            int sample_rate, bool round_to_int);
+
+} // end namespace asp
+
+#endif//__ASP_CORE_CORR_EVAL_H__
@@ -0,0 +1,426 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file CsvParse.cc
+///
+
+#include <asp/Core/CsvParse.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Cartography/GeoReference.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Powers of ten which are exact as doubles
+  const double CSV_POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const int CSV_MAX_EXACT_POW10 = 22;
+
+  // Each thread parses this many bytes of a file at a time
+  const std::size_t CSV_CHUNK_SIZE = 8 * 1024 * 1024;
+
+  // Each thread converts this many records to Cartesian at a time
+  const std::size_t CSV_CONVERT_BATCH = 65536;
+
+  inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  // Parse with strtod(), which needs a null-terminated string
+  const char* parse_double_slow(const char* begin, const char* end, double & val) {
+    char buf[128];
+    std::size_t len = std::min(std::size_t(end - begin), sizeof(buf) - 1);
+    std::memcpy(buf, begin, len);
+    buf[len] = '\0';
+    char * stop = NULL;
+    val = std::strtod(buf, &stop);
+    return begin + (stop - buf);
+  }
+
+  // Find the line starting at begin. Return its end, without the newline.
+  inline const char* csv_line_end(const char* begin, const char* end) {
+    const void* nl = std::memchr(begin, '\n', end - begin);
+    return (nl == NULL) ? end : static_cast<const char*>(nl);
+  }
+
+  boost::shared_ptr<boost::iostreams::mapped_file_source>
+  map_csv_file(std::string const& file) {
+    boost::shared_ptr<boost::iostreams::mapped_file_source> mapped;
+    if (!fs::exists(file))
+      vw::vw_throw(vw::IOErr() << "Unable to open file \"" << file << "\"");
+    if (fs::file_size(file) == 0)
+      return mapped; // An empty file cannot be mapped
+
+    mapped.reset(new boost::iostreams::mapped_file_source(file));
+    if (!mapped->is_open())
+      vw::vw_throw(vw::IOErr() << "Unable to open file \"" << file << "\"");
+    return mapped;
+  }
+
+  // Count the valid lines in a chunk of a file
+  class CountCsvLinesTask: public vw::Task, private boost::noncopyable {
+    const char*    m_begin;
+    const char*    m_end;
+    std::int64_t & m_count;
+
+  public:
+    CountCsvLinesTask(const char* begin, const char* end, std::int64_t & count):
+      m_begin(begin), m_end(end), m_count(count) {}
+
+    void operator()() {
+      m_count = 0;
+      const char* line = m_begin;
+      while (line < m_end) {
+        const char* line_end = csv_line_end(line, m_end);
+        if (is_valid_csv_chars(line, line_end))
+          m_count++;
+        line = line_end + 1;
+      }
+    }
+  };
+
+  // Parse a chunk of a file. Failed lines are kept so they can be
+  // printed in the order they are in the file.
+  class ParseCsvChunkTask: public vw::Task, private boost::noncopyable {
+    CsvConv const& m_csv_conv;
+    const char*    m_begin;
+    const char*    m_end;
+    bool           m_first_chunk;
+    double         m_load_ratio;
+    std::uint32_t  m_seed;
+    CsvColumns               & m_columns;
+    std::vector<std::string> & m_failed;
+
+  public:
+    ParseCsvChunkTask(CsvConv const& csv_conv, const char* begin, const char* end,
+                      bool first_chunk, double load_ratio, std::uint32_t seed,
+                      CsvColumns & columns, std::vector<std::string> & failed):
+      m_csv_conv(csv_conv), m_begin(begin), m_end(end), m_first_chunk(first_chunk),
+      m_load_ratio(load_ratio), m_seed(seed), m_columns(columns), m_failed(failed) {}
+
+    void operator()() {
+      std::mt19937 gen(m_seed);
+      std::uniform_real_distribution<double> dist(0.0, 1.0);
+      bool has_file = m_csv_conv.has_file_column();
+      bool is_first_line = m_first_chunk;
+      CsvConv::CsvRecord record;
+
+      const char* line = m_begin;
+      while (line < m_end) {
+        const char* line_end = csv_line_end(line, m_end);
+        const char* line_begin = line;
+        line = line_end + 1;
+
+        if (!is_valid_csv_chars(line_begin, line_end))
+          continue;
+
+        // The first line of the file may be a header, so do not complain about it
+        bool may_be_header = is_first_line;
+        is_first_line = false;
+
+        // Randomly skip a percentage of points
+        if (m_load_ratio < 1.0 && dist(gen) > m_load_ratio)
+          continue;
+
+        if (m_csv_conv.parse_csv_chars(line_begin, line_end, record)) {
+          m_columns.push_back(record, has_file);
+        } else if (!may_be_header) {
+          while (line_end > line_begin && line_end[-1] == '\r')
+            line_end--;
+          m_failed.push_back(std::string(line_begin, line_end));
+        }
+      }
+    }
+  };
+
+  // Convert a range of records to Cartesian and lon-lat
+  class CsvToCartesianTask: public vw::Task, private boost::noncopyable {
+    CsvConv    const& m_csv_conv;
+    CsvColumns const& m_columns;
+    vw::cartography::GeoReference const& m_geo;
+    std::size_t m_begin, m_end;
+    std::vector<vw::Vector3> & m_xyz;
+    std::vector<vw::Vector2> & m_lonlat;
+
+  public:
+    CsvToCartesianTask(CsvConv const& csv_conv, CsvColumns const& columns,
+                       vw::cartography::GeoReference const& geo,
+                       std::size_t begin, std::size_t end,
+                       std::vector<vw::Vector3> & xyz, std::vector<vw::Vector2> & lonlat):
+      m_csv_conv(csv_conv), m_columns(columns), m_geo(geo), m_begin(begin), m_end(end),
+      m_xyz(xyz), m_lonlat(lonlat) {}
+
+    void operator()() {
+      CsvConv::CsvRecord record; // only the numbers are needed
+      for (std::size_t i = m_begin; i < m_end; i++) {
+        for (int c = 0; c < 3; c++)
+          record.point_data[c] = m_columns.point_data[c][i];
+        m_xyz[i]    = m_csv_conv.csv_to_cartesian(record, m_geo);
+        m_lonlat[i] = m_csv_conv.csv_to_lonlat(record, m_geo);
+      }
+    }
+  };
+
+} // end anonymous namespace
+
+const char* parse_csv_double(const char* begin, const char* end, double & val) {
+
+  const char* p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  // Accumulate up to 19 significant digits, which fit in 64 bits
+  std::uint64_t mantissa = 0;
+  int num_sig = 0, exp10 = 0;
+  bool has_digits = false, truncated = false;
+  for (; p < end && is_digit(*p); p++) {
+    has_digits = true;
+    if (num_sig < 19) {
+      mantissa = 10 * mantissa + (*p - '0');
+      if (mantissa != 0)
+        num_sig++;
+    } else {
+      exp10++;
+      truncated = true;
+    }
+  }
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && is_digit(*p); p++) {
+      has_digits = true;
+      if (num_sig < 19) {
+        mantissa = 10 * mantissa + (*p - '0');
+        if (mantissa != 0)
+          num_sig++;
+        exp10--;
+      } else {
+        truncated = true;
+      }
+    }
+  }
+  if (has_digits && p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool exp_negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      exp_negative = (*q == '-');
+      q++;
+    }
+    if (q < end && is_digit(*q)) {
+      int e = 0;
+      for (; q < end && is_digit(*q); q++) {
+        if (e < 100000)
+          e = 10 * e + (*q - '0');
+      }
+      exp10 += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+
+  // If the mantissa and the power of ten are exact as doubles, a single
+  // multiplication or division is correctly rounded.
+  if (has_digits && p == end && !truncated && num_sig <= 15 &&
+      exp10 >= -CSV_MAX_EXACT_POW10 && exp10 <= CSV_MAX_EXACT_POW10) {
+    double v = double(mantissa);
+    v = (exp10 < 0) ? v / CSV_POW10[-exp10] : v * CSV_POW10[exp10];
+    val = negative ? -v : v;
+    return p;
+  }
+
+  return parse_double_slow(begin, end, val);
+}
+
+bool is_valid_csv_chars(const char* begin, const char* end) {
+  if (begin == end || *begin == '#')
+    return false;
+  for (const char* p = begin; p < end; p++) {
+    if (!is_csv_separator(*p))
+      return true;
+  }
+  return false;
+}
+
+void csv_chunk_offsets(const char* data, std::size_t size, std::size_t chunk_size,
+                       std::vector<std::size_t> & offsets) {
+  offsets.clear();
+  offsets.push_back(0);
+  chunk_size = std::max(chunk_size, std::size_t(1));
+
+  std::size_t pos = 0;
+  while (size - pos > chunk_size) {
+    std::size_t start = pos + chunk_size;
+    const void* nl = std::memchr(data + start, '\n', size - start);
+    if (nl == NULL)
+      break;
+    pos = static_cast<const char*>(nl) - data + 1;
+    if (pos >= size)
+      break;
+    offsets.push_back(pos);
+  }
+  offsets.push_back(size);
+}
+
+void CsvColumns::clear() {
+  for (int c = 0; c < 3; c++)
+    point_data[c].clear();
+  file.clear();
+}
+
+void CsvColumns::push_back(CsvConv::CsvRecord const& record, bool has_file) {
+  for (int c = 0; c < 3; c++)
+    point_data[c].push_back(record.point_data[c]);
+  if (has_file)
+    file.push_back(record.file);
+}
+
+void CsvColumns::append(CsvColumns const& other) {
+  for (int c = 0; c < 3; c++)
+    point_data[c].insert(point_data[c].end(), other.point_data[c].begin(),
+                         other.point_data[c].end());
+  file.insert(file.end(), other.file.begin(), other.file.end());
+}
+
+void CsvColumns::resize(std::size_t num) {
+  for (int c = 0; c < 3; c++)
+    point_data[c].resize(num);
+  if (!file.empty())
+    file.resize(num);
+}
+
+CsvConv::CsvRecord CsvColumns::record(std::size_t i) const {
+  CsvConv::CsvRecord record;
+  for (int c = 0; c < 3; c++)
+    record.point_data[c] = point_data[c][i];
+  if (i < file.size())
+    record.file = file[i];
+  return record;
+}
+
+std::int64_t csv_count_valid_lines(std::string const& file) {
+
+  boost::shared_ptr<boost::iostreams::mapped_file_source> mapped = map_csv_file(file);
+  if (!mapped)
+    return 0;
+
+  std::vector<std::size_t> offsets;
+  csv_chunk_offsets(mapped->data(), mapped->size(), CSV_CHUNK_SIZE, offsets);
+  std::size_t num_chunks = offsets.size() - 1;
+
+  std::vector<std::int64_t> counts(num_chunks, 0);
+  vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+  for (std::size_t it = 0; it < num_chunks; it++) {
+    boost::shared_ptr<CountCsvLinesTask>
+      task(new CountCsvLinesTask(mapped->data() + offsets[it],
+                                 mapped->data() + offsets[it + 1], counts[it]));
+    queue.add_task(task);
+  }
+  queue.join_all();
+
+  std::int64_t count = 0;
+  for (std::size_t it = 0; it < num_chunks; it++)
+    count += counts[it];
+  return count;
+}
+
+std::int64_t read_csv_columns(std::string const& file, CsvConv const& csv_conv,
+                              double load_ratio, std::int64_t max_num_records,
+                              CsvColumns & columns) {
+  columns.clear();
+
+  boost::shared_ptr<boost::iostreams::mapped_file_source> mapped = map_csv_file(file);
+  if (!mapped)
+    return 0;
+
+  // The chunks do not depend on the number of threads, and each has its
+  // own random number generator, so the sampled records do not either.
+  const char* data = mapped->data();
+  std::vector<std::size_t> offsets;
+  csv_chunk_offsets(data, mapped->size(), CSV_CHUNK_SIZE, offsets);
+  std::size_t num_chunks = offsets.size() - 1;
+
+  // Parse the chunks in batches, so that not much more memory than the
+  // output is used, and the reading can stop early.
+  int num_threads = std::max(vw::vw_settings().default_num_threads(), 1);
+  std::size_t batch_size = 4 * num_threads;
+  for (std::size_t start = 0; start < num_chunks; start += batch_size) {
+    std::size_t end = std::min(start + batch_size, num_chunks);
+    std::vector<CsvColumns> chunk_columns(end - start);
+    std::vector<std::vector<std::string>> failed(end - start);
+    vw::FifoWorkQueue queue(num_threads);
+    for (std::size_t it = start; it < end; it++) {
+      boost::shared_ptr<ParseCsvChunkTask>
+        task(new ParseCsvChunkTask(csv_conv, data + offsets[it], data + offsets[it + 1],
+                                   it == 0, load_ratio, it, chunk_columns[it - start],
+                                   failed[it - start]));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    for (std::size_t it = 0; it < chunk_columns.size(); it++) {
+      for (std::size_t line = 0; line < failed[it].size(); line++)
+        vw::vw_out() << "Failed to read line: " << failed[it][line] << "\n";
+
+      columns.append(chunk_columns[it]);
+      if (max_num_records > 0 && std::int64_t(columns.size()) >= max_num_records) {
+        columns.resize(max_num_records);
+        return columns.size();
+      }
+    }
+  }
+
+  return columns.size();
+}
+
+void csv_columns_to_cartesian(CsvConv const& csv_conv, CsvColumns const& columns,
+                              vw::cartography::GeoReference const& geo,
+                              std::vector<vw::Vector3> & xyz,
+                              std::vector<vw::Vector2> & lonlat) {
+  std::size_t num = columns.size();
+  xyz.resize(num);
+  lonlat.resize(num);
+
+  vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+  for (std::size_t begin = 0; begin < num; begin += CSV_CONVERT_BATCH) {
+    std::size_t end = std::min(begin + CSV_CONVERT_BATCH, num);
+    boost::shared_ptr<CsvToCartesianTask>
+      task(new CsvToCartesianTask(csv_conv, columns, geo, begin, end, xyz, lonlat));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
+} // end namespace asp
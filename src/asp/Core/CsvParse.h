@@ -0,0 +1,114 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CsvParse.h
+///
+/// Fast reading of large CSV files. The file is memory-mapped and split
+/// into chunks on line boundaries, the chunks are parsed in parallel
+/// with a locale-independent number parser, and the records are stored
+/// column by column rather than as a list of CsvRecord objects. The
+/// conversion of the records to Cartesian coordinates is also done in
+/// parallel, in batches.
+
+#ifndef __ASP_CORE_CSV_PARSE_H__
+#define __ASP_CORE_CSV_PARSE_H__
+
+#include <asp/Core/PointUtils.h>
+
+#include <vw/Math/Vector.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vw {
+  namespace cartography {
+    class GeoReference;
+  }
+}
+
+namespace asp {
+
+  /// Parse a floating-point number making up all of [begin, end). Return
+  /// the position after the parsed characters, or begin on failure. Simple
+  /// decimal numbers are parsed directly, with correct rounding. Anything
+  /// else, such as long mantissas, large exponents, or nan, is passed to
+  /// strtod(), so a prefix of the token may be parsed, as with sscanf().
+  const char* parse_csv_double(const char* begin, const char* end, double & val);
+
+  /// Return true if this character separates values on a CSV line. This
+  /// matches csv_separator(), and also a carriage return, so files with
+  /// Windows line endings are handled.
+  inline bool is_csv_separator(char c) {
+    return c == ',' || c == ' ' || c == '\t' || c == '\r';
+  }
+
+  /// Return true if the line in [begin, end) should be parsed, so it is
+  /// not empty, does not start with '#', and does not have only separators.
+  bool is_valid_csv_chars(const char* begin, const char* end);
+
+  /// Split a buffer into pieces of about chunk_size bytes, each starting
+  /// at the beginning of a line. The first offset is 0 and the last one is
+  /// size. The pieces do not depend on the number of threads.
+  void csv_chunk_offsets(const char* data, std::size_t size, std::size_t chunk_size,
+                         std::vector<std::size_t> & offsets);
+
+  /// The records read from a CSV file, stored column by column. The
+  /// numbers on each line are in the order they appear in the file, as
+  /// for CsvConv::CsvRecord.
+  struct CsvColumns {
+    std::vector<double>      point_data[3];
+    std::vector<std::string> file; ///< Only filled if the format has a file column
+
+    std::size_t size() const { return point_data[0].size(); }
+    void clear();
+    void push_back(CsvConv::CsvRecord const& record, bool has_file);
+    void append(CsvColumns const& other);
+    void resize(std::size_t num);
+
+    /// Put together the values on one line
+    CsvConv::CsvRecord record(std::size_t i) const;
+  };
+
+  /// Count the lines in a CSV file that are not empty or comments, using
+  /// multiple threads.
+  std::int64_t csv_count_valid_lines(std::string const& file);
+
+  /// Read the records in a CSV file in the format given by csv_conv,
+  /// using multiple threads. If load_ratio is less than 1, each valid line
+  /// is kept with that probability, with the same result no matter the
+  /// number of threads. Stop after max_num_records are read, if that is
+  /// positive. Lines that fail to parse are printed and skipped, except
+  /// for the first line, which may be a header. Return the number of
+  /// records read.
+  std::int64_t read_csv_columns(std::string const& file, CsvConv const& csv_conv,
+                                double load_ratio, std::int64_t max_num_records,
+                                CsvColumns & columns);
+
+  /// Convert the records to Cartesian coordinates and to lon-lat, in
+  /// batches, using multiple threads. The lon-lat values are computed as
+  /// by CsvConv::csv_to_lonlat().
+  void csv_columns_to_cartesian(CsvConv const& csv_conv, CsvColumns const& columns,
+                                vw::cartography::GeoReference const& geo,
+                                std::vector<vw::Vector3> & xyz,
+                                std::vector<vw::Vector2> & lonlat);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CSV_PARSE_H__
@@ -0,0 +1,197 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DemDiff.cc
+///
+
+#include <asp/Core/DemDiff.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace asp {
+
+namespace {
+
+  // The sketch bin for a magnitude of at least DIFF_SKETCH_MIN
+  int diff_sketch_bin(double mag) {
+    int bin = int(floor(DIFF_SKETCH_BINS_PER_DECADE * log10(mag / DIFF_SKETCH_MIN)));
+    return std::max(0, std::min(DIFF_SKETCH_NUM_BINS - 1, bin));
+  }
+
+  // The magnitude standing for all values in a bin
+  double diff_sketch_value(int bin) {
+    return DIFF_SKETCH_MIN * pow(10.0, (bin + 0.5) / DIFF_SKETCH_BINS_PER_DECADE);
+  }
+
+}
+
+DiffStats::DiffStats(): m_count(0), m_num_zero(0), m_min(0), m_max(0), m_sum(0), m_sum2(0),
+                        m_pos_bins(DIFF_SKETCH_NUM_BINS, 0),
+                        m_neg_bins(DIFF_SKETCH_NUM_BINS, 0) {}
+
+void DiffStats::add(double diff) {
+  if (m_count == 0) {
+    m_min = diff;
+    m_max = diff;
+  }
+  m_min = std::min(m_min, diff);
+  m_max = std::max(m_max, diff);
+  m_sum  += diff;
+  m_sum2 += diff * diff;
+  m_count++;
+
+  double mag = std::abs(diff);
+  if (mag < DIFF_SKETCH_MIN)
+    m_num_zero++;
+  else if (diff > 0)
+    m_pos_bins[diff_sketch_bin(mag)]++;
+  else
+    m_neg_bins[diff_sketch_bin(mag)]++;
+}
+
+void DiffStats::merge(DiffStats const& other) {
+  if (other.m_count == 0)
+    return;
+  if (m_count == 0) {
+    m_min = other.m_min;
+    m_max = other.m_max;
+  }
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+  m_sum      += other.m_sum;
+  m_sum2     += other.m_sum2;
+  m_count    += other.m_count;
+  m_num_zero += other.m_num_zero;
+  for (int bin = 0; bin < DIFF_SKETCH_NUM_BINS; bin++) {
+    m_pos_bins[bin] += other.m_pos_bins[bin];
+    m_neg_bins[bin] += other.m_neg_bins[bin];
+  }
+}
+
+double DiffStats::min() const {
+  return m_min;
+}
+
+double DiffStats::max() const {
+  return m_max;
+}
+
+double DiffStats::mean() const {
+  if (m_count == 0)
+    return 0.0;
+  return m_sum / m_count;
+}
+
+double DiffStats::std_dev() const {
+  if (m_count == 0)
+    return 0.0;
+  double m = mean();
+  double var = m_sum2 / m_count - m * m;
+  if (var < 0)
+    var = 0; // just in case, for numerical noise
+  return sqrt(var);
+}
+
+// The values standing for the bins are kept within the exact range
+template <class F>
+void DiffStats::for_each_bin(F f) const {
+  auto clamp = [this](double val) { return std::max(m_min, std::min(m_max, val)); };
+  for (int bin = DIFF_SKETCH_NUM_BINS - 1; bin >= 0; bin--) {
+    if (m_neg_bins[bin] > 0)
+      f(clamp(-diff_sketch_value(bin)), m_neg_bins[bin]);
+  }
+  if (m_num_zero > 0)
+    f(clamp(0.0), m_num_zero);
+  for (int bin = 0; bin < DIFF_SKETCH_NUM_BINS; bin++) {
+    if (m_pos_bins[bin] > 0)
+      f(clamp(diff_sketch_value(bin)), m_pos_bins[bin]);
+  }
+}
+
+double DiffStats::percentile(double pct) const {
+  if (m_count == 0)
+    return 0.0;
+
+  // The index of the value in sorted order, so the median of n values
+  // is the one with index n/2.
+  vw::int64 target = std::min(m_count - 1, vw::int64(pct / 100.0 * m_count));
+  vw::int64 seen = 0;
+  bool found = false;
+  double result = m_max;
+  for_each_bin([&](double val, vw::int64 count) {
+      if (found)
+        return;
+      seen += count;
+      if (seen > target) {
+        result = val;
+        found = true;
+      }
+    });
+  return result;
+}
+
+double DiffStats::nmad() const {
+  if (m_count == 0)
+    return 0.0;
+
+  // The deviations from the median of the values standing for the bins
+  double med = median();
+  std::vector<std::pair<double, vw::int64>> devs;
+  for_each_bin([&](double val, vw::int64 count) {
+      devs.push_back(std::make_pair(std::abs(val - med), count));
+    });
+  std::sort(devs.begin(), devs.end());
+
+  vw::int64 target = m_count / 2, seen = 0;
+  for (size_t it = 0; it < devs.size(); it++) {
+    seen += devs[it].second;
+    if (seen > target)
+      return 1.4826 * devs[it].first;
+  }
+  return 1.4826 * devs.back().first;
+}
+
+void DiffStats::histogram(int num_bins, std::vector<vw::int64> & counts) const {
+  counts.assign(std::max(num_bins, 0), 0);
+  if (m_count == 0 || num_bins <= 0)
+    return;
+
+  double width = (m_max - m_min) / num_bins;
+  for_each_bin([&](double val, vw::int64 count) {
+      int bin = 0;
+      if (width > 0)
+        bin = std::max(0, std::min(num_bins - 1, int((val - m_min) / width)));
+      counts[bin] += count;
+    });
+}
+
+void DiffStatsCollector::add(vw::BBox2i const& tile, DiffStats const& stats) {
+  std::vector<int> key = {tile.min().x(), tile.min().y(), tile.max().x(), tile.max().y()};
+  vw::Mutex::Lock lock(m_mutex);
+  if (!m_seen.insert(key).second)
+    return;
+  m_stats.merge(stats);
+}
+
+DiffStats DiffStatsCollector::stats() {
+  vw::Mutex::Lock lock(m_mutex);
+  return m_stats;
+}
+
+} // end namespace asp
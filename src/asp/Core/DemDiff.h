@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemDiff.h
+///
+/// Logic for differencing DEMs with other DEMs or with points. The
+/// statistics of the differences are accumulated while the differences
+/// are found, tile by tile, so no second pass over the output is needed.
+
+#ifndef __ASP_CORE_DEM_DIFF_H__
+#define __ASP_CORE_DEM_DIFF_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <set>
+#include <vector>
+
+namespace asp {
+
+  /// The magnitudes of the differences are put in bins of a sketch with
+  /// this many bins per decade, starting at DIFF_SKETCH_MIN meters.
+  /// Smaller magnitudes count as zero, and larger ones go to the last bin.
+  const int    DIFF_SKETCH_BINS_PER_DECADE = 200;
+  const int    DIFF_SKETCH_NUM_BINS        = 2000;
+  const double DIFF_SKETCH_MIN             = 1e-4;
+
+  /// Statistics of signed differences, added one at a time, and which
+  /// can be merged across tiles. The count, range, mean, and standard
+  /// deviation are exact. The percentiles, NMAD, and histogram are found
+  /// from the sketch, so they are accurate to about 0.6% of the value,
+  /// or to DIFF_SKETCH_MIN.
+  class DiffStats {
+  public:
+    DiffStats();
+
+    void add(double diff);
+    void merge(DiffStats const& other);
+
+    vw::int64 count() const { return m_count; }
+    double min    () const; ///< 0 if there are no values
+    double max    () const;
+    double mean   () const;
+    double std_dev() const;
+
+    /// A percentile in [0, 100]
+    double percentile(double pct) const;
+    double median() const { return percentile(50.0); }
+
+    /// The normalized median absolute deviation, 1.4826 * median(|x - median|)
+    double nmad() const;
+
+    /// Counts of the values in num_bins equal bins spanning [min(), max()]
+    void histogram(int num_bins, std::vector<vw::int64> & counts) const;
+
+  private:
+    vw::int64 m_count, m_num_zero;
+    double    m_min, m_max, m_sum, m_sum2;
+    std::vector<vw::int64> m_pos_bins, m_neg_bins;
+
+    /// Call f(value, count) for the nonempty bins, in increasing order of value
+    template <class F> void for_each_bin(F f) const;
+  };
+
+  /// Gathers the statistics of tiles from several threads. A tile that
+  /// is seen again is skipped, so a tile which is rasterized twice is not
+  /// counted twice.
+  class DiffStatsCollector {
+    vw::Mutex m_mutex;
+    std::set<std::vector<int>> m_seen;
+    DiffStats m_stats;
+  public:
+    void add(vw::BBox2i const& tile, DiffStats const& stats);
+    DiffStats stats();
+  };
+
+  /// Bilinearly interpolate a masked, non-interpolated DEM at many pixel
+  /// locations at once. The locations are binned by DEM tile, and each tile is
+  /// read into memory once and sampled in parallel, rather than fetching the
+  /// DEM pixel by pixel. The output height is NaN where a location is outside
+  /// the DEM or any of its four neighbors is invalid.
+  template <class PixelT>
+  void interp_dem_heights(vw::ImageViewRef< vw::PixelMask<PixelT> > const& masked_dem,
+                          std::vector<vw::Vector2> const& pixels,
+                          std::vector<double>           & dem_heights);
+
+} // end namespace asp
+
+#include <asp/Core/DemDiff.tcc>
+
+#endif // __ASP_CORE_DEM_DIFF_H__
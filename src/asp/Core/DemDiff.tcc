@@ -0,0 +1,103 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemDiff.tcc
+///
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+
+#include <cstdint>
+#include <limits>
+
+namespace asp {
+
+template <class PixelT>
+void interp_dem_heights(vw::ImageViewRef< vw::PixelMask<PixelT> > const& masked_dem,
+                        std::vector<vw::Vector2> const& pixels,
+                        std::vector<double>           & dem_heights) {
+
+  const std::int64_t num_pts = pixels.size();
+  dem_heights.resize(num_pts);
+
+  // Bin the locations by tile. A location whose bilinear stencil is not
+  // fully inside the DEM gets no tile.
+  const int tile_size = 256;
+  const int num_cols = masked_dem.cols(), num_rows = masked_dem.rows();
+  const std::int64_t num_tiles_x = (num_cols + tile_size - 1) / tile_size;
+  const std::int64_t num_tiles_y = (num_rows + tile_size - 1) / tile_size;
+  std::vector<std::int64_t> tile_start(num_tiles_x * num_tiles_y + 1, 0);
+  std::vector<std::int64_t> tile_id(num_pts, -1);
+  for (std::int64_t i = 0; i < num_pts; i++) {
+    double c = pixels[i][0], r = pixels[i][1];
+    dem_heights[i] = std::numeric_limits<double>::quiet_NaN();
+    if (!(c >= 0 && c < num_cols - 1 && r >= 0 && r < num_rows - 1))
+      continue;
+    tile_id[i] = (std::int64_t(r) / tile_size) * num_tiles_x + std::int64_t(c) / tile_size;
+    tile_start[tile_id[i] + 1]++;
+  }
+  for (size_t t = 1; t < tile_start.size(); t++)
+    tile_start[t] += tile_start[t - 1];
+
+  // Counting sort of the location indices by tile
+  std::vector<std::int64_t> order(tile_start.back());
+  {
+    std::vector<std::int64_t> pos(tile_start.begin(), tile_start.end() - 1);
+    for (std::int64_t i = 0; i < num_pts; i++) {
+      if (tile_id[i] >= 0)
+        order[pos[tile_id[i]]++] = i;
+    }
+  }
+
+  // Each thread reads one tile at a time, with a one-pixel margin on the
+  // right and bottom for the bilinear stencil, into its own buffer.
+  const std::int64_t num_tiles = num_tiles_x * num_tiles_y;
+#pragma omp parallel
+  {
+    vw::ImageView< vw::PixelMask<PixelT> > tile;
+#pragma omp for schedule(dynamic)
+    for (std::int64_t t = 0; t < num_tiles; t++) {
+      if (tile_start[t] == tile_start[t + 1])
+        continue;
+
+      vw::BBox2i box((t % num_tiles_x) * tile_size, (t / num_tiles_x) * tile_size,
+                     tile_size + 1, tile_size + 1);
+      box.crop(vw::bounding_box(masked_dem));
+      tile = vw::crop(masked_dem, box);
+
+      for (std::int64_t k = tile_start[t]; k < tile_start[t + 1]; k++) {
+        std::int64_t i = order[k];
+        double c = pixels[i][0] - box.min().x(), r = pixels[i][1] - box.min().y();
+        int c0 = int(c), r0 = int(r);
+        double dc = c - c0, dr = r - r0;
+
+        vw::PixelMask<PixelT> const& v00 = tile(c0,     r0);
+        vw::PixelMask<PixelT> const& v10 = tile(c0 + 1, r0);
+        vw::PixelMask<PixelT> const& v01 = tile(c0,     r0 + 1);
+        vw::PixelMask<PixelT> const& v11 = tile(c0 + 1, r0 + 1);
+        if (!is_valid(v00) || !is_valid(v10) || !is_valid(v01) || !is_valid(v11))
+          continue;
+
+        dem_heights[i] = (1.0 - dr) * ((1.0 - dc) * v00.child() + dc * v10.child()) +
+                         dr         * ((1.0 - dc) * v01.child() + dc * v11.child());
+      }
+    }
+  }
+}
+
+} // end namespace asp
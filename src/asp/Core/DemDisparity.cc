@@ -34,6 +34,9 @@
 #include <boost/filesystem/operations.hpp>
 namespace fs = boost::filesystem;
 
+#include <algorithm>
+#include <vector>
+
 using namespace vw;
 using namespace vw::cartography;
 
@@ -52,6 +55,7 @@ namespace asp {
     Matrix<double>  m_align_left_matrix, m_align_right_matrix;
     int             m_pixel_sample;
     ImageView<PixelMask<Vector2i> > & m_disparity_spread;
+    BatchPointToPixel m_right_batch_point_to_pixel;
 
   public:
     DemDisparity( ImageViewBase<ImageT> const& left_image,
@@ -62,7 +66,8 @@ namespace asp {
                   boost::shared_ptr<camera::CameraModel> right_camera_model,
                   bool do_align,
                   Matrix<double> const& align_left_matrix, Matrix<double> const& align_right_matrix,
-                  int pixel_sample, ImageView<PixelMask<Vector2i> > & disparity_spread)
+                  int pixel_sample, ImageView<PixelMask<Vector2i> > & disparity_spread,
+                  BatchPointToPixel const& right_batch_point_to_pixel)
       :m_left_image(left_image.impl()),
        m_dem_error(dem_error),
        m_dem_georef(dem_georef),
@@ -74,7 +79,8 @@ namespace asp {
        m_align_left_matrix(align_left_matrix),
        m_align_right_matrix(align_right_matrix),
        m_pixel_sample(pixel_sample),
-       m_disparity_spread(disparity_spread){}
+       m_disparity_spread(disparity_spread),
+       m_right_batch_point_to_pixel(right_batch_point_to_pixel){}
 
     // Image View interface
     typedef PixelMask<Vector2i> pixel_type;
@@ -172,19 +178,29 @@ namespace asp {
       GeoReference georef_crop = crop(m_dem_georef, dem_box);
       ImageView <PixelMask<float> > dem_crop = crop(m_dem, dem_box);
 
-      // Compute the DEM disparity. Use one in every 'm_pixel_sample' pixels.
-
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        if (row%m_pixel_sample != 0) continue;
+      // Find the disparity on a grid of nodes, one in every
+      // 'm_pixel_sample' pixels, in the coordinates of the whole low-res
+      // image. The grid covers the tile and reaches one node past its
+      // end, so neighboring tiles share their nodes on the boundary and the
+      // pixels between the nodes can be interpolated without seams.
+      int ps = m_pixel_sample;
+      int start_col = ps * (bbox.min().x() / ps);
+      int start_row = ps * (bbox.min().y() / ps);
+      int num_cols  = (bbox.max().x() - 1 - start_col + ps - 1) / ps + 1;
+      int num_rows  = (bbox.max().y() - 1 - start_row + ps - 1) / ps + 1;
+      int num_nodes = num_cols * num_rows;
+
+      // Intersect the left camera rays with the DEM at the nodes
+      std::vector<Vector3> node_xyz(num_nodes), node_dir(num_nodes);
+      std::vector<char> node_valid(num_nodes, 0);
+      for (int r = 0; r < num_rows; r++) {
 
         // Must wipe the previous guess since we are now too far from it
         prev_xyz = Vector3();
 
-        for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-          if (col%m_pixel_sample != 0) continue;
-
-          Vector2 left_lowres_pix = Vector2(col, row);
+        for (int c = 0; c < num_cols; c++) {
 
+          Vector2 left_lowres_pix(start_col + c * ps, start_row + r * ps);
           Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
           if (m_do_align){
             // Need to go to the image pixel in the untransformed image
@@ -210,44 +226,104 @@ namespace asp {
           if ( !has_intersection || xyz == Vector3() ) continue;
           prev_xyz = xyz;
 
-          // Since our DEM is only known approximately, the true
-          // intersection point of the ray coming from the left camera
-          // with the DEM could be anywhere within m_dem_error from
-          // xyz. Use that to get an estimate of the disparity
-          // error.
-
-          ImageView< PixelMask<Vector2> > curr_pixel_disp_range(3, 1);
-          double bias[] = {-1.0, 1.0, 0.0};
-          int success[] = {0, 0, 0};
-
-          for (int k = 0; k < curr_pixel_disp_range.cols(); k++){
-
-            Vector2 right_fullres_pix;
-            try {
-              right_fullres_pix = m_right_camera_model->point_to_pixel(xyz + bias[k]*m_dem_error*left_camera_vec);
-            } catch (...) {
-              curr_pixel_disp_range(k, 0).invalidate();
-              continue;
-            }
-            if (m_do_align){
-              right_fullres_pix = HomographyTransform(m_align_right_matrix).forward(right_fullres_pix);
-            }
-
-            Vector2 right_lowres_pix = elem_prod(right_fullres_pix, m_downsample_scale);
-            curr_pixel_disp_range(k, 0) = right_lowres_pix - left_lowres_pix;
-            success[k] = 1;
-
-            // If the disparities at the endpoints of the range were successful,
-            // don't bother with the middle estimate.
-            if (k == 1 && success[0] && success[1]) break;
+          int k = r * num_cols + c;
+          node_xyz[k]   = xyz;
+          node_dir[k]   = left_camera_vec;
+          node_valid[k] = 1;
+        }
+      }
+
+      // Since our DEM is only known approximately, the true
+      // intersection point of the ray coming from the left camera
+      // with the DEM could be anywhere within m_dem_error from
+      // xyz. Use that to get an estimate of the disparity
+      // error. Project the endpoints of that segment and its middle
+      // into the right camera, for all nodes at once.
+      const int num_bias = 3;
+      double bias[num_bias] = {-1.0, 1.0, 0.0};
+      std::vector<int> node_to_point(num_nodes, -1);
+      std::vector<Vector3> right_points;
+      for (int k = 0; k < num_nodes; k++) {
+        if (!node_valid[k]) continue;
+        node_to_point[k] = right_points.size();
+        for (int b = 0; b < num_bias; b++)
+          right_points.push_back(node_xyz[k] + bias[b]*m_dem_error*node_dir[k]);
+      }
+
+      std::vector<Vector2> right_fullres_pix(right_points.size());
+      std::vector<char> right_valid(right_points.size(), 1);
+      if (m_right_batch_point_to_pixel) {
+        m_right_batch_point_to_pixel(right_points, right_fullres_pix);
+      } else {
+        for (size_t it = 0; it < right_points.size(); it++) {
+          try {
+            right_fullres_pix[it] = m_right_camera_model->point_to_pixel(right_points[it]);
+          } catch (...) {
+            right_valid[it] = 0;
           }
+        }
+      }
+
+      // The disparity at the nodes is the middle of the range of the
+      // projections, and the spread is half its extent. The middle
+      // projection is used only if one of the endpoints failed.
+      std::vector<Vector2> node_disp(num_nodes);
+      std::vector<Vector2i> node_spread(num_nodes);
+      for (int k = 0; k < num_nodes; k++) {
+        if (!node_valid[k]) continue;
+        node_valid[k] = 0;
+
+        Vector2 left_lowres_pix(start_col + (k % num_cols) * ps,
+                                start_row + (k / num_cols) * ps);
+        int p = node_to_point[k];
+        int num_used = (right_valid[p] && right_valid[p + 1]) ? 2 : num_bias;
+
+        BBox2 search_range;
+        for (int b = 0; b < num_used; b++) {
+          if (!right_valid[p + b]) continue;
+          Vector2 right_pix = right_fullres_pix[p + b];
+          if (m_do_align)
+            right_pix = HomographyTransform(m_align_right_matrix).forward(right_pix);
+          Vector2 right_lowres_pix = elem_prod(right_pix, m_downsample_scale);
+          search_range.grow(right_lowres_pix - left_lowres_pix);
+          node_valid[k] = 1;
+        }
+        if (!node_valid[k]) continue;
 
-          BBox2f search_range = stereo::get_disparity_range(curr_pixel_disp_range);
-          if (search_range ==  BBox2f(0,0,0,0)) continue;
+        node_disp[k]   = (search_range.min() + search_range.max())/2.0;
+        node_spread[k] = Vector2i(ceil((search_range.max() - search_range.min())/2.0));
+      }
 
-          lowres_disparity(col, row) = round( (search_range.min() + search_range.max())/2.0 );
-          m_disparity_spread(col, row) = ceil( (search_range.max() - search_range.min())/2.0 );
+      // Interpolate bilinearly between the nodes. Nodes without a
+      // disparity are skipped and the weights of the others renormalized.
+      // The spread is the largest of the nodes used, to stay conservative.
+      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
+        for (int col = bbox.min().x(); col < bbox.max().x(); col++){
+
+          int c0 = (col - start_col) / ps, r0 = (row - start_row) / ps;
+          double wx = double(col - start_col - c0 * ps) / ps;
+          double wy = double(row - start_row - r0 * ps) / ps;
+          int    cs[] = {c0, c0 + 1, c0, c0 + 1};
+          int    rs[] = {r0, r0, r0 + 1, r0 + 1};
+          double ws[] = {(1.0 - wx) * (1.0 - wy), wx * (1.0 - wy),
+                         (1.0 - wx) * wy, wx * wy};
+
+          double wsum = 0.0;
+          Vector2 disp;
+          Vector2i spread;
+          for (int q = 0; q < 4; q++) {
+            if (ws[q] <= 0.0 || cs[q] >= num_cols || rs[q] >= num_rows) continue;
+            int k = rs[q] * num_cols + cs[q];
+            if (!node_valid[k]) continue;
+            wsum += ws[q];
+            disp += ws[q] * node_disp[k];
+            spread[0] = std::max(spread[0], node_spread[k][0]);
+            spread[1] = std::max(spread[1], node_spread[k][1]);
+          }
+          if (wsum <= 0.0) continue;
 
+          lowres_disparity(col, row)   = round(disp/wsum);
+          m_disparity_spread(col, row) = spread;
         }
       }
 
@@ -272,7 +348,8 @@ namespace asp {
                  Matrix<double> const& align_left_matrix,
                  Matrix<double> const& align_right_matrix,
                  int pixel_sample,
-                 ImageView<PixelMask<Vector2i> > & disparity_spread
+                 ImageView<PixelMask<Vector2i> > & disparity_spread,
+                 BatchPointToPixel const& right_batch_point_to_pixel
                  ) {
     typedef DemDisparity<ImageT, DEMImageT> return_type;
     return return_type( left.impl(),
@@ -280,14 +357,16 @@ namespace asp {
                         dem, downsample_scale,
                         left_camera_model, right_camera_model,
                         do_align, align_left_matrix, align_right_matrix,
-                        pixel_sample, disparity_spread
+                        pixel_sample, disparity_spread,
+                        right_batch_point_to_pixel
                         );
   }
 
   void produce_dem_disparity( ASPGlobalOptions & opt,
                               boost::shared_ptr<camera::CameraModel> left_camera_model,
                               boost::shared_ptr<camera::CameraModel> right_camera_model,
-                              std::string session_name
+                              std::string session_name,
+                              BatchPointToPixel const& right_batch_point_to_pixel
                               ) {
 
     if (stereo_settings().is_search_defined())
@@ -361,7 +440,8 @@ namespace asp {
                                                        left_camera_model, right_camera_model,
                                                        do_align,
                                                        align_left_matrix, align_right_matrix,
-                                                       pixel_sample, disparity_spread
+                                                       pixel_sample, disparity_spread,
+                                                       right_batch_point_to_pixel
                                                        ));
     std::string disparity_file = opt.out_prefix + "-D_sub.tif";
     vw_out() << "Writing low-resolution disparity: " << disparity_file << "\n";
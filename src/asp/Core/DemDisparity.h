@@ -22,8 +22,14 @@
 #ifndef __DEM_DISPARITY_H__
 #define __DEM_DISPARITY_H__
 
+#include <vw/Math/Vector.h>
+
 #include <boost/smart_ptr/shared_ptr.hpp>
 
+#include <functional>
+#include <string>
+#include <vector>
+
 // Forward declaration
 namespace asp {
   struct ASPGlobalOptions;
@@ -36,11 +42,20 @@ namespace vw {
 
 namespace asp {
 
-  /// Use a DEM to get the low-res disparity
+  /// Project many ECEF points into a camera at once, for camera models
+  /// which can do that faster than one point at a time.
+  typedef std::function<void(std::vector<vw::Vector3> const&,
+                             std::vector<vw::Vector2> &)> BatchPointToPixel;
+
+  /// Use a DEM to get the low-res disparity. It is found on a grid of
+  /// every other pixel and interpolated in between. If given, the batched
+  /// projection is used instead of the right camera's point_to_pixel().
   void produce_dem_disparity(ASPGlobalOptions & opt,
                              boost::shared_ptr<vw::camera::CameraModel> left_camera_model,
                              boost::shared_ptr<vw::camera::CameraModel> right_camera_model,
-                             std::string session_name
+                             std::string session_name,
+                             BatchPointToPixel const& right_batch_point_to_pixel
+                             = BatchPointToPixel()
                              );
 
 }
@@ -27,6 +27,8 @@
 #include <vw/Cartography/Map2CamTrans.h>
 #include <vw/InterestPoint/InterestData.h>
 
+#include <algorithm>
+
 using namespace vw;
 using namespace vw::cartography;
 
@@ -172,7 +174,15 @@ void filter_D_sub(ASPGlobalOptions const& opt,
   ImageView<float> tri_err(sub_disp.cols(), sub_disp.rows());
   ImageView<float> height(sub_disp.cols(), sub_disp.rows());
 
-  for (int col = 0; col < sub_disp.cols(); col++) {
+  // Triangulate the columns in parallel. Each pixel is independent. The
+  // transforms for map-projected images cache data as they go, so they
+  // cannot be shared among threads.
+  bool multithreaded
+    = (dynamic_cast<vw::cartography::Map2CamTrans*>(tx_left.get())  == NULL &&
+       dynamic_cast<vw::cartography::Map2CamTrans*>(tx_right.get()) == NULL);
+  int num_cols = sub_disp.cols();
+#pragma omp parallel for schedule(dynamic, 1) if (multithreaded)
+  for (int col = 0; col < num_cols; col++) {
     for (int row = 0; row < sub_disp.rows(); row++) {
       vw::PixelMask<vw::Vector2f> disp = sub_disp(col, row);
       
@@ -193,7 +203,7 @@ void filter_D_sub(ASPGlobalOptions const& opt,
       left_pix = tx_left->reverse(left_pix);
       right_pix = tx_right->reverse(right_pix);
 
-      double err;
+      double err = 0.0;
       Vector3 xyz;
       try {
         xyz = model(left_pix, right_pix, err);
@@ -359,9 +369,10 @@ void filter_D_sub_using_spread(ASPGlobalOptions const& opt, std::string const& d
   if (dx.empty())
     vw_throw(ArgumentErr() << "Empty disparity.");
   
-  std::sort(dx.begin(), dx.end());
-  std::sort(dy.begin(), dy.end());
-  double mid_x = dx[dx.size()/2]; // median
+  // The median. Only it is needed, so the values need not be fully sorted.
+  std::nth_element(dx.begin(), dx.begin() + dx.size()/2, dx.end());
+  std::nth_element(dy.begin(), dy.begin() + dy.size()/2, dy.end());
+  double mid_x = dx[dx.size()/2];
   double mid_y = dy[dy.size()/2];
   
   double half = max_disp_spread / 2.0;
@@ -414,7 +425,13 @@ class UnalignDisparityView: public ImageViewBase<UnalignDisparityView>{
   ASPGlobalOptions const& m_opt;
   int m_num_cols, m_num_rows;
   bool m_is_map_projected;
-  std::map <std::pair<int, int>, Vector2> m_unaligned_trans;
+
+  // For map-projected images, the disparity pixels sampled when finding
+  // the output size, bucketed by where they go in the output image. For
+  // each output cell, the box of these disparity pixels. This way a tile
+  // looks up only the cells it overlaps.
+  static const int UNALIGN_CELL_SIZE = 64;
+  std::map<std::pair<int, int>, BBox2i> m_unaligned_cells;
 public:
   UnalignDisparityView(bool is_map_projected,
                        DispImageType    const& disparity,
@@ -477,8 +494,10 @@ public:
 	  }
           img_box.grow(left_pix);
 
-	  // Save this lookup map for the future
-	  m_unaligned_trans[std::make_pair(col, row)] = left_pix;
+	  // Save this lookup for the future
+	  std::pair<int, int> cell(floor(left_pix[0] / UNALIGN_CELL_SIZE),
+                                   floor(left_pix[1] / UNALIGN_CELL_SIZE));
+	  m_unaligned_cells[cell].grow(Vector2i(col, row));
         }
 
 	tpc.report_incremental_progress(inc_amount);
@@ -576,18 +595,18 @@ public:
 	}
       }
     }else{
-      for (int col = 0; col < m_disparity.cols(); col++) {
-	for (int row = 0; row < m_disparity.rows(); row++) {
-	  
-	  std::pair<int, int> pix = std::make_pair(col, row);
-	  std::map <std::pair<int, int>, Vector2>::const_iterator it = m_unaligned_trans.find(pix);
-	  if (it == m_unaligned_trans.end())
+      // Look up the cells overlapping this tile, rather than going over
+      // all sampled disparity pixels
+      int beg_x = floor(double(curr_bbox.min().x()) / UNALIGN_CELL_SIZE);
+      int end_x = floor(double(curr_bbox.max().x()) / UNALIGN_CELL_SIZE);
+      int beg_y = floor(double(curr_bbox.min().y()) / UNALIGN_CELL_SIZE);
+      int end_y = floor(double(curr_bbox.max().y()) / UNALIGN_CELL_SIZE);
+      for (int cx = beg_x; cx <= end_x; cx++) {
+	for (int cy = beg_y; cy <= end_y; cy++) {
+	  auto it = m_unaligned_cells.find(std::make_pair(cx, cy));
+	  if (it == m_unaligned_cells.end())
 	    continue;
-
-	  Vector2 rev = it->second;
-	  if (curr_bbox.contains(rev)) {
-	    disp_bbox.grow(Vector2(col, row));
-	  }
+	  disp_bbox.grow(it->second);
 	}
       }
 
@@ -730,41 +749,59 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
     int lenx = round(disp.cols()/bin_len); lenx = std::max(1, lenx);
     int leny = round(disp.rows()/bin_len); leny = std::max(1, leny);
 
-    // Iterate over bins.
+    // Iterate over bins. Each column of bins reads only the disparity
+    // column through the bin centers. The columns are done in parallel,
+    // unless the transforms are for map-projected images, as those cache
+    // data as they go. The matches are kept in the order of the bins.
 
     vw_out() << "Computing interest point matches based on disparity.\n";
     vw::TerminalProgressCallback tpc("asp", "\t--> ");
     double inc_amount = 1.0 / double(lenx);
     tpc.report_progress(0);
 
+    typedef typename DispImageType::pixel_type DispPixelT;
+    std::vector<std::vector<ip::InterestPoint>> left_bin_ip(lenx), right_bin_ip(lenx);
+#pragma omp parallel for schedule(dynamic, 1) if (!is_map_projected)
     for (int binx = 0; binx < lenx; binx++) {
 
       // Pick the disparity at the center of the bin
       int posx = round((binx+0.5)*bin_len);
+      if (posx < disp.cols()) {
+        ImageView<DispPixelT> disp_col = crop(disp, BBox2i(posx, 0, 1, disp.rows()));
+        for (int biny = 0; biny < leny; biny++) {
 
-      for (int biny = 0; biny < leny; biny++) {
-
-        int posy = round((biny+0.5)*bin_len);
+          int posy = round((biny+0.5)*bin_len);
 
-        if (posx >= disp.cols() || posy >= disp.rows()) 
-          continue;
-        typedef typename DispImageType::pixel_type DispPixelT;
-        DispPixelT dpix = disp(posx, posy);
-        if (!is_valid(dpix))
-          continue;
+          if (posy >= disp.rows()) 
+            continue;
+          DispPixelT dpix = disp_col(0, posy);
+          if (!is_valid(dpix))
+            continue;
 
-        // De-warp left and right pixels to be in the camera coordinate system
-        Vector2 left_pix  = left_trans->reverse (Vector2(posx, posy));
-        Vector2 right_pix = right_trans->reverse(Vector2(posx, posy) + stereo::DispHelper(dpix));
+          // De-warp left and right pixels to be in the camera coordinate system
+          Vector2 left_pix, right_pix;
+          try {
+            left_pix  = left_trans->reverse (Vector2(posx, posy));
+            right_pix = right_trans->reverse(Vector2(posx, posy) + stereo::DispHelper(dpix));
+          } catch(...) {
+            continue;
+          }
 
-        left_ip.push_back(ip::InterestPoint(left_pix.x(), left_pix.y()));
-        right_ip.push_back(ip::InterestPoint(right_pix.x(), right_pix.y()));
+          left_bin_ip[binx].push_back(ip::InterestPoint(left_pix.x(), left_pix.y()));
+          right_bin_ip[binx].push_back(ip::InterestPoint(right_pix.x(), right_pix.y()));
+        }
       }
 
+#pragma omp critical
       tpc.report_incremental_progress(inc_amount);
     }
     tpc.report_finished();
 
+    for (int binx = 0; binx < lenx; binx++) {
+      left_ip.insert(left_ip.end(), left_bin_ip[binx].begin(), left_bin_ip[binx].end());
+      right_ip.insert(right_ip.end(), right_bin_ip[binx].begin(), right_bin_ip[binx].end());
+    }
+
   } else{
 
     // First create ip with left_ip being at integer multiple of bin size.
@@ -873,52 +910,76 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
       int bin_len = round(sqrt(num_pixels/std::min(double(max_num_matches), num_pixels)));
       VW_ASSERT(bin_len >= 1, vw::ArgumentErr() << "Expecting bin_len >= 1.\n");
 
-      // Iterate over disparity.
-
-      vw_out() << "Doing a second pass. This will be very slow.\n";
+      // Read the disparity in strips of columns, and find in parallel
+      // the pixels whose right pixel is at a multiple of the bin size.
+      // Map-projected images are not supported here, so the transforms
+      // can be shared. The candidates are then added in the same order as
+      // before, as which of the duplicates is kept depends on it.
+      vw_out() << "Doing a second pass. This will be slow.\n";
       vw::TerminalProgressCallback tpc("asp", "\t--> ");
-      double inc_amount = 1.0 / double(disp.cols());
+      int strip_width = 64;
+      int num_strips = (disp.cols() + strip_width - 1) / strip_width;
+      double inc_amount = 1.0 / double(num_strips);
       tpc.report_progress(0);
 
-      for (int col = 0; col < disp.cols(); col++) {
-        for (int row = 0; row < disp.rows(); row++) {
-
-          Vector2 trans_left_pix(col, row);
-          Vector2 left_pix, trans_right_pix, right_pix;
+      std::vector<std::vector<std::pair<Vector2, Vector2>>> candidates(num_strips);
+#pragma omp parallel for schedule(dynamic, 1)
+      for (int strip = 0; strip < num_strips; strip++) {
+        int beg_col = strip * strip_width;
+        BBox2i strip_box(beg_col, 0, std::min(strip_width, disp.cols() - beg_col),
+                         disp.rows());
+        ImageView<DispPixelT> disp_strip = crop(disp, strip_box);
+        for (int c = 0; c < disp_strip.cols(); c++) {
+          for (int row = 0; row < disp_strip.rows(); row++) {
+
+            DispPixelT dpix = disp_strip(c, row);
+            if (!is_valid(dpix))
+              continue;
+
+            // Compute the left and right pixels. 
+            Vector2 trans_left_pix(beg_col + c, row);
+            Vector2 left_pix, right_pix;
+            try {
+              left_pix  = left_trans->reverse(trans_left_pix);
+              right_pix = right_trans->reverse(trans_left_pix + stereo::DispHelper(dpix));
+            } catch(...) {
+              continue;
+            }
+
+            // If the right pixel is a multiple of the bin size, keep
+            // it.
+            right_pix = round(right_pix); // very important
+            if (int(right_pix[0]) % bin_len != 0) continue;
+            if (int(right_pix[1]) % bin_len != 0) continue;
+
+            candidates[strip].push_back(std::make_pair(left_pix, right_pix));
+          }
+        }
 
-          DispPixelT dpix = disp(trans_left_pix[0], trans_left_pix[1]);
-          if (!is_valid(dpix))
-            continue;
+#pragma omp critical
+        tpc.report_incremental_progress(inc_amount);
+      }
+      tpc.report_finished();
 
-          // Compute the left and right pixels. 
-          left_pix        = left_trans->reverse(trans_left_pix);
-          trans_right_pix = trans_left_pix + stereo::DispHelper(dpix);
-          right_pix       = right_trans->reverse(trans_right_pix);
+      for (int strip = 0; strip < num_strips; strip++) {
+        for (size_t it = 0; it < candidates[strip].size(); it++) {
 
-          // If the right pixel is a multiple of the bin size, keep
-          // it.
-          right_pix = round(right_pix); // very important
-          if (int(right_pix[0]) % bin_len != 0) continue;
-          if (int(right_pix[1]) % bin_len != 0) continue;
+          Vector2 const& left_pix  = candidates[strip][it].first;
+          Vector2 const& right_pix = candidates[strip][it].second;
 
           // Add this ip unless found already. This is clumsy, but we
           // can't use a set since there is no ordering for pairs.
-          std::map<double, double>::iterator it;
-          it = left_done.find(left_pix.x());
-          if (it != left_done.end() && it->second == left_pix.y()) continue; 
-          it = right_done.find(right_pix.x());
-          if (it != right_done.end() && it->second == right_pix.y()) continue; 
+          std::map<double, double>::iterator map_it;
+          map_it = left_done.find(left_pix.x());
+          if (map_it != left_done.end() && map_it->second == left_pix.y()) continue; 
+          map_it = right_done.find(right_pix.x());
+          if (map_it != right_done.end() && map_it->second == right_pix.y()) continue; 
           left_done[left_pix.x()] = left_pix.y();
           right_done[right_pix.x()] = right_pix.y();
-          ip::InterestPoint lip(left_pix.x(), left_pix.y());
-          ip::InterestPoint rip(right_pix.x(), right_pix.y());
-          left_ip.push_back(lip); 
-          right_ip.push_back(rip);
+          left_ip.push_back(ip::InterestPoint(left_pix.x(), left_pix.y()));
+          right_ip.push_back(ip::InterestPoint(right_pix.x(), right_pix.y()));
         }
-        
-        tpc.report_incremental_progress(inc_amount);
       }
-      tpc.report_finished();
     }
     
   } // end considering multi-image friendly ip
@@ -929,5 +990,108 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
   vw_out() << "Writing: " << match_file << std::endl;
   ip::write_binary_match_file(match_file, left_ip, right_ip);
 }
+
+// For each tile estimate the valid fraction and search range size from D_sub
+bool estimate_tile_costs(ASPGlobalOptions         const& opt,
+                         std::vector<vw::BBox2i> const& tiles,
+                         std::vector<double>          & valid_fraction,
+                         std::vector<vw::Vector2>     & search_size) {
+
+  valid_fraction.assign(tiles.size(), 1.0);
+  search_size.assign(tiles.size(), Vector2(1.0, 1.0));
+
+  std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+  if (!boost::filesystem::exists(d_sub_file)) {
+    vw_out(WarningMessage) << "Cannot estimate the tile costs, as D_sub "
+                           << "does not exist.\n";
+    return false;
+  }
+
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> sub_disp_ref;
+  vw::Vector2 upsample_scale;
+  asp::load_D_sub_and_scale(opt, d_sub_file, sub_disp_ref, upsample_scale);
+
+  // D_sub is small, so read it fully in memory
+  vw::ImageView<vw::PixelMask<vw::Vector2f>> sub_disp = sub_disp_ref;
+  BBox2i sub_box = bounding_box(sub_disp);
+
+  for (size_t it = 0; it < tiles.size(); it++) {
+
+    // The tile footprint in D_sub. Grow it to contain any partially
+    // covered low-res pixel.
+    BBox2 tile = tiles[it];
+    BBox2i box(Vector2i(floor(tile.min().x() / upsample_scale.x()),
+                        floor(tile.min().y() / upsample_scale.y())),
+               Vector2i(ceil(tile.max().x() / upsample_scale.x()),
+                        ceil(tile.max().y() / upsample_scale.y())));
+    box.crop(sub_box);
+
+    if (box.empty()) {
+      valid_fraction[it] = 0.0;
+      continue;
+    }
+
+    int num_valid = 0;
+    BBox2 disp_range;
+    for (int col = box.min().x(); col < box.max().x(); col++) {
+      for (int row = box.min().y(); row < box.max().y(); row++) {
+        PixelMask<Vector2f> const& d = sub_disp(col, row);
+        if (!is_valid(d))
+          continue;
+        num_valid++;
+        disp_range.grow(Vector2(d.child()));
+      }
+    }
+
+    valid_fraction[it] = double(num_valid) / double(box.area());
+    if (num_valid == 0)
+      continue;
+
+    // The search range size at full resolution
+    search_size[it] = Vector2(disp_range.width()  * upsample_scale.x() + 1.0,
+                              disp_range.height() * upsample_scale.y() + 1.0);
+  }
+
+  return true;
+}
+
+// The images are float and the masks are uint8, so 5 bytes per pixel, and
+// the pyramid adds a third to that. The disparity has 12 bytes per pixel,
+// and it is kept both as the correlation result and as the cropped output.
+double corr_tile_memory_mb(vw::stereo::CorrelationAlgorithm alg, bool using_gpu,
+                           vw::Vector2i const& tile_size,
+                           vw::Vector2  const& search_size,
+                           int collar_size, int memory_limit_mb) {
+
+  const double mb = 1024.0 * 1024.0;
+  double cols = tile_size.x() + 2.0 * collar_size;
+  double rows = tile_size.y() + 2.0 * collar_size;
+  double num_disp   = std::max(search_size.x(), 1.0) * std::max(search_size.y(), 1.0);
+  double left_pix   = cols * rows;
+  double right_pix  = (cols + search_size.x()) * (rows + search_size.y());
+  double image_mem  = (left_pix + right_pix) * 5.0 * 4.0 / 3.0;
+  double disp_mem   = left_pix * 12.0 * 2.0;
+
+  double cost_mem = 0.0;
+  if (alg == vw::stereo::VW_CORRELATION_BM) {
+    // Block matching keeps the best cost and disparity per pixel
+    cost_mem = left_pix * 8.0;
+  } else if (alg == vw::stereo::VW_CORRELATION_OTHER) {
+    // External programs search along rows only
+    cost_mem = left_pix * std::max(search_size.x(), 1.0);
+  } else if (using_gpu) {
+    // The cost volume is on the device. The host has copies of the
+    // images and masks, and the output disparity before conversion.
+    cost_mem = (left_pix + right_pix) * 5.0 + left_pix * 9.0;
+  } else {
+    // SGM has a uint8 cost and a uint16 accumulated cost per pixel and
+    // disparity. MGM has another accumulation buffer.
+    double bytes_per_disp = (alg == vw::stereo::VW_CORRELATION_SGM) ? 3.0 : 5.0;
+    cost_mem = std::min(left_pix * num_disp * bytes_per_disp,
+                        double(memory_limit_mb) * mb);
+  }
+
+  return (image_mem + disp_mem + cost_mem) / mb;
+}
   
 } // end namespace asp
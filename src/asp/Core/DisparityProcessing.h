@@ -24,6 +24,7 @@
 #include <vw/Camera/CameraModel.h>
 #include <vw/Math/Transform.h>
 #include <vw/Cartography/Datum.h>
+#include <vw/Stereo/CorrelationAlgorithms.h>
 
 namespace asp {
 
@@ -78,6 +79,28 @@ namespace asp {
                                  std::string      const& match_file,
                                  int max_num_matches,
                                  bool gen_triplets, bool is_map_projected);
+
+  /// For each tile in L.tif, estimate from the low-res disparity the fraction
+  /// of valid pixels and the dimensions of the full-res search range. The cost
+  /// of correlating the tile is roughly proportional to the valid fraction
+  /// times the search range area times the tile area. If D_sub does not
+  /// exist, the tiles are assumed fully valid, with a search range of size
+  /// 1 x 1, and false is returned.
+  bool estimate_tile_costs(ASPGlobalOptions         const& opt,
+                           std::vector<vw::BBox2i> const& tiles,
+                           std::vector<double>          & valid_fraction,
+                           std::vector<vw::Vector2>     & search_size);
+
+  /// Rough estimate of the peak memory, in MB, used by stereo_corr for a tile
+  /// of given size, not including the collar, and a given full-res search
+  /// range size. It accounts for the images, masks, and their pyramids, and
+  /// the output disparity. For SGM and MGM, it adds the cost volume, which
+  /// is capped at memory_limit_mb (--corr-memory-limit-mb). For external
+  /// algorithms, a cost volume of one byte per pixel and disparity is assumed.
+  double corr_tile_memory_mb(vw::stereo::CorrelationAlgorithm alg, bool using_gpu,
+                             vw::Vector2i const& tile_size,
+                             vw::Vector2  const& search_size,
+                             int collar_size, int memory_limit_mb);
   
 } // End namespace asp
 
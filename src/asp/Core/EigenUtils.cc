@@ -20,12 +20,24 @@
 ///
 
 #include <asp/Core/EigenUtils.h>
+#include <asp/Core/CsvParse.h>
+
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/BlockRasterize.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <random>
 
 using namespace vw;
 using namespace vw::cartography;
 
 namespace asp {
 
+// The seed for the random sampling of points, for repeatable results
+const std::uint32_t RANDOM_SUBSAMPLE_SEED = 1;
+
 vw::Vector3 cartesian_to_geodetic_adj(vw::cartography::GeoReference const&
                                       geo, vw::Vector3 xyz){
 
@@ -44,46 +56,28 @@ void null_check(const char* token, std::string const& line){
     vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
 }
 
-// Out of the elements 0, 1,..., n - 1, pick m unique
-// random elements and sort them in increasing order.
-// TODO(oalexan1): See the newly added pick_random_subset() function in VW,
-// but note that that one does not sort the elements.  
-void pick_at_most_m_unique_elems_from_n_elems(std::int64_t m, std::int64_t n,
-                                              std::vector<std::int64_t>& elems){
-
-  elems.clear();
-
-  if (m < 1 || n < 1) return;
-  if (m > n) m = n;
-
-  std::vector<std::int64_t> all(n);
-  for (std::int64_t i = 0; i < n; i++) all[i] = i;
-
-  // Swap a randomly selected element from index 0 to j with the one
-  // at index j. Then decrement j. Done after m elements are
-  // processed.
-  for (std::int64_t j = n-1; j >= n-m; j--){
-    std::int64_t r = rand()%(j+1); // 0 <= r <= j
-    std::swap(all[r], all[j]);
-  }
-
-  elems.resize(m);
-  for (std::int64_t i = 0; i < m; i++) elems[i] = all[n-m+i];
-  std::sort(elems.begin(), elems.end());
-
-}
-
-// Return at most m random points out of the input point cloud.
+// Return at most m random points out of the input point cloud. This is
+// selection sampling (Knuth's Algorithm S): the points are visited in
+// order and each is kept with probability (points left to keep) / (points
+// left), which keeps exactly m of them. The kept points are moved to the
+// front in place, so no memory beyond the cloud is used, and a fixed seed
+// makes the result repeatable.
 void random_pc_subsample(std::int64_t m, DoubleMatrix& points){
 
   std::int64_t n = points.cols();
-  std::vector<std::int64_t> elems;
-  pick_at_most_m_unique_elems_from_n_elems(m, n, elems);
-  m = elems.size();
+  if (m >= n)
+    return;
+  m = std::max(m, std::int64_t(0));
 
-  for (std::int64_t col = 0; col < m; col++){
-    for (std::int64_t row = 0; row < DIM; row++)
-      points(row, col) = points(row, elems[col]);
+  std::mt19937 gen(RANDOM_SUBSAMPLE_SEED);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::int64_t k = 0;
+  for (std::int64_t i = 0; i < n && k < m; i++) {
+    if (uniform(gen) * double(n - i) >= double(m - k))
+      continue;
+    if (k != i)
+      points.col(k) = points.col(i);
+    k++;
   }
   points.conservativeResize(Eigen::NoChange, m);
 }
@@ -163,171 +157,184 @@ std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_
   bool is_first_line  = true;
   std::int64_t points_count = 0;
   std::vector<double> longitudes;
-  line = "";
-  while (getline(file, line, '\n')) {
+  std::mt19937 gen(RANDOM_SUBSAMPLE_SEED);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
 
-    if (!is_first_line && !line.empty() && line[0] == '#' && verbose) {
-      vw::vw_out() << "Ignoring line starting with comment: " << line << std::endl;
-      continue;
+  // Append a point to the output, and check its lon and lat
+  auto add_point = [&](vw::Vector3 const& xyz, double lon, double lat) {
+    if (calc_shift && !shift_was_calc){
+      shift = xyz;
+      shift_was_calc = true;
     }
-    
-    if (points_count >= num_points_to_load)
-      break;
 
-    if (!is_valid_csv_line(line))
-      continue;
+    for (std::int64_t row = 0; row < DIM; row++)
+      data(row, points_count) = xyz[row] - shift[row];
+    data(DIM, points_count) = 1;
 
-    // Randomly skip a percentage of points
-    double r = (double)std::rand()/(double)RAND_MAX;
-    if (r > load_ratio)
-      continue;
+    points_count++;
+    longitudes.push_back(lon);
+
+    // Throw an error if the lon and lat are not within bounds.
+    // Note that we allow some slack for lon, perhaps the point
+    // cloud is say from 350 to 370 degrees.
+    if (std::abs(lat) > 90.0)
+      vw_throw(vw::ArgumentErr() << "Invalid latitude value: "
+               << lat << " in " << file_name << "\n");
+    if (lon < -360.0 || lon > 2*360.0)
+      vw_throw(vw::ArgumentErr() << "Invalid longitude value: "
+               << lon << " in " << file_name << "\n");
+  };
 
-    // We went with C-style file reading instead of C++ in this instance
-    // because we found it to be significantly faster on large files.
+  if (csv_conv.is_configured()) {
 
-    vw::Vector3 xyz;
-    double lon = 0.0, lat = 0.0;
+    // Parse the file with multiple threads, and convert the records to
+    // Cartesian in batches. If there is a box, the records outside of
+    // it are removed below, so they cannot count towards the limit.
+    std::int64_t max_num_records = lonlat_box.empty() ? num_points_to_load : 0;
+    CsvColumns columns;
+    read_csv_columns(file_name, csv_conv, load_ratio, max_num_records, columns);
+    std::vector<vw::Vector3> xyz;
+    std::vector<vw::Vector2> lonlat;
+    csv_columns_to_cartesian(csv_conv, columns, geo, xyz, lonlat);
 
-    if (csv_conv.is_configured()){
+    for (size_t it = 0; it < xyz.size(); it++) {
+      if (points_count >= num_points_to_load)
+        break;
 
-      // Parse custom CSV file with given format string
-      bool success;
-      CsvConv::CsvRecord vals = csv_conv.parse_csv_line(is_first_line, success, line);
-      if (!success)
+      // TODO: We really need a lonlat bbox function that handles wraparound!!!!!!
+      // Skip points outside the given box
+      vw::Vector2 const& ll = lonlat[it];
+      if (!lonlat_box.empty() && !lonlat_box.contains(ll)
+                              && !lonlat_box.contains(ll + vw::Vector2(360,0))
+                              && !lonlat_box.contains(ll - vw::Vector2(360,0)))
         continue;
 
-      xyz = csv_conv.csv_to_cartesian(vals, geo);
+      add_point(xyz[it], ll[0], ll[1]);
+    }
 
-      // Decide if the point is in the box. Also save for the future
-      // the longitude of the point, we'll use it to compute the mean longitude.
-      vw::Vector2 lonlat = csv_conv.csv_to_lonlat(vals, geo);
-      lon = lonlat[0]; // Needed for mean calculation below
-      lat = lonlat[1];
+  } else {
 
-      // TODO: We really need a lonlat bbox function that handles wraparound!!!!!!
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(lonlat)
-                              && !lonlat_box.contains(lonlat+vw::Vector2(360,0))
-                              && !lonlat_box.contains(lonlat-vw::Vector2(360,0))) {
+    line = "";
+    while (getline(file, line, '\n')) {
+
+      if (!is_first_line && !line.empty() && line[0] == '#' && verbose) {
+        vw::vw_out() << "Ignoring line starting with comment: " << line << std::endl;
         continue;
       }
+    
+      if (points_count >= num_points_to_load)
+        break;
 
-    }else if (!is_lola_rdr_format){
+      if (!is_valid_csv_line(line))
+        continue;
 
-      // lat,lon,height format
-      double height;
+      // Randomly skip a percentage of points
+      if (uniform(gen) > load_ratio)
+        continue;
 
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
-      std::int64_t ret = sscanf(token, "%lg", &lat);
+      // We went with C-style file reading instead of C++ in this instance
+      // because we found it to be significantly faster on large files.
 
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
+      vw::Vector3 xyz;
+      double lon = 0.0, lat = 0.0;
 
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &height);
+      if (!is_lola_rdr_format){
 
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 3){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
-        }
-      }
-      is_first_line = false;
+        // lat,lon,height format
+        double height;
 
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
-        continue;
+        strncpy(temp, line.c_str(), bufSize);
+        const char* token = strtok(temp, sep); null_check(token, line);
+        std::int64_t ret = sscanf(token, "%lg", &lat);
 
-      vw::Vector3 llh( lon, lat, height );
-      xyz = geo.datum().geodetic_to_cartesian( llh );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) ) continue; // invalid and NaN check
+        token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &lon);
 
-    }else{
+        token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &height);
+
+        // Be prepared for the fact that the first line may be the header.
+        if (ret != 3){
+          if (!is_first_line){
+            vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
+          }else{
+            is_first_line = false;
+            continue;
+          }
+        }
+        is_first_line = false;
 
-      // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
-      // copied from Ara Nefian's lidar2dem tool.
-      // We will ignore lines which do not start with year (or a value that
-      // cannot be converted into an integer greater than zero, specifically).
+        // Skip points outside the given box
+        if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
+          continue;
 
-      std::int64_t year, month, day, hour, min;
-      double lat, rad, sec, is_invalid;
+        vw::Vector3 llh( lon, lat, height );
+        xyz = geo.datum().geodetic_to_cartesian( llh );
+        if ( xyz == vw::Vector3() || !(xyz == xyz) ) continue; // invalid and NaN check
 
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
+      }else{
 
-      std::int64_t ret = sscanf(token, "%lld-%lld-%lldT%lld:%lld:%lg", &year, &month, &day, &hour,
-                       &min, &sec);
-      if( year <= 0 )
-        continue;
+        // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
+        // copied from Ara Nefian's lidar2dem tool.
+        // We will ignore lines which do not start with year (or a value that
+        // cannot be converted into an integer greater than zero, specifically).
 
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
+        std::int64_t year, month, day, hour, min;
+        double lat, rad, sec, is_invalid;
 
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lat);
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &rad);
-      rad *= 1000; // km to m
+        strncpy(temp, line.c_str(), bufSize);
+        const char* token = strtok(temp, sep); null_check(token, line);
 
-      // Scan 7 more fields, until we get to the is_invalid flag.
-      for (std::int64_t i = 0; i < 7; i++)
-        token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &is_invalid);
-
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 10){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
+        std::int64_t ret = sscanf(token, "%lld-%lld-%lldT%lld:%lld:%lg", &year, &month, &day, &hour,
+                         &min, &sec);
+        if( year <= 0 )
           continue;
-        }
-      }
-      is_first_line = false;
 
-      if (is_invalid)
-        continue;
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
-        continue;
+        token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &lon);
 
-      vw::Vector3 lonlatrad( lon, lat, 0 );
+        token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &lat);
+        token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &rad);
+        rad *= 1000; // km to m
+
+        // Scan 7 more fields, until we get to the is_invalid flag.
+        for (std::int64_t i = 0; i < 7; i++)
+          token = strtok(NULL, sep); null_check(token, line);
+        ret += sscanf(token, "%lg", &is_invalid);
+
+        // Be prepared for the fact that the first line may be the header.
+        if (ret != 10){
+          if (!is_first_line){
+            vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
+          }else{
+            is_first_line = false;
+            continue;
+          }
+        }
+        is_first_line = false;
 
-      xyz = geo.datum().geodetic_to_cartesian( lonlatrad );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
+        if (is_invalid)
+          continue;
 
-      // Adjust the point so that it is at the right distance from
-      // planet center.
-      xyz = rad*(xyz/norm_2(xyz));
-    }
+        // Skip points outside the given box
+        if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
+          continue;
 
-    if (calc_shift && !shift_was_calc){
-      shift = xyz;
-      shift_was_calc = true;
-    }
+        vw::Vector3 lonlatrad( lon, lat, 0 );
 
-    for (std::int64_t row = 0; row < DIM; row++)
-      data(row, points_count) = xyz[row] - shift[row];
-    data(DIM, points_count) = 1;
+        xyz = geo.datum().geodetic_to_cartesian( lonlatrad );
+        if ( xyz == vw::Vector3() || !(xyz == xyz) )
+          continue; // invalid and NaN check
 
-    points_count++;
-    longitudes.push_back(lon);
+        // Adjust the point so that it is at the right distance from
+        // planet center.
+        xyz = rad*(xyz/norm_2(xyz));
+      }
 
-    // Throw an error if the lon and lat are not within bounds.
-    // Note that we allow some slack for lon, perhaps the point
-    // cloud is say from 350 to 370 degrees.
-    if (std::abs(lat) > 90.0)
-      vw_throw(vw::ArgumentErr() << "Invalid latitude value: "
-               << lat << " in " << file_name << "\n");
-    if (lon < -360.0 || lon > 2*360.0)
-      vw_throw(vw::ArgumentErr() << "Invalid longitude value: "
-               << lon << " in " << file_name << "\n");
+      add_point(xyz, lon, lat);
+    }
   }
   data.conservativeResize(Eigen::NoChange, points_count);
 
@@ -375,6 +382,104 @@ void load_csv(std::string const& file_name,
   return;
 }
 
+// Given a tile, a sampling ratio, and a random number generator, append
+// to a list the sampled valid points in the tile.
+typedef std::function<void(vw::BBox2i const& tile, double load_ratio, std::mt19937 & gen,
+                           std::vector<vw::Vector3> & points)> TileSampler;
+
+// Sample the points in one tile
+class SampleTileTask: public vw::Task, private boost::noncopyable {
+  TileSampler const& m_sampler;
+  vw::BBox2i m_tile;
+  double m_load_ratio;
+  std::uint32_t m_seed;
+  std::vector<vw::Vector3> & m_points;
+
+public:
+  SampleTileTask(TileSampler const& sampler, vw::BBox2i const& tile, double load_ratio,
+                 std::uint32_t seed, std::vector<vw::Vector3> & points):
+    m_sampler(sampler), m_tile(tile), m_load_ratio(load_ratio), m_seed(seed),
+    m_points(points) {}
+
+  void operator()() {
+    std::mt19937 gen(m_seed);
+    m_sampler(m_tile, m_load_ratio, gen, m_points);
+  }
+};
+
+// Load points from a gridded input, such as a DEM or a point cloud, in
+// parallel, tile by tile. Each pixel is kept with probability
+// load_ratio. The tiles are done in batches, and their points are
+// streamed in order into the output, which grows at most to
+// num_points_to_load points. Past that, each further point replaces a
+// random one with the probability that keeps the sample uniform
+// (reservoir sampling). So the result does not depend on the number of
+// threads, and not much more memory than the output is used.
+void load_tiles(vw::BBox2i const& pix_box, std::int64_t num_points_to_load,
+                double load_ratio, TileSampler const& sampler,
+                bool calc_shift, vw::Vector3 & shift,
+                bool verbose, DoubleMatrix & data) {
+
+  const int tile_size = 512;
+  std::vector<vw::BBox2i> tiles = subdivide_bbox(pix_box, tile_size, tile_size);
+  int num_threads = vw_settings().default_num_threads();
+  size_t batch_size = 4 * std::max(num_threads, 1);
+
+  vw::TerminalProgressCallback tpc("asp", "\t--> ");
+  double inc_amount = 1.0 / double(std::max(tiles.size(), size_t(1)));
+  if (verbose)
+    tpc.report_progress(0);
+
+  num_points_to_load = std::max(num_points_to_load, std::int64_t(0));
+  std::int64_t num_seen = 0;
+  std::mt19937 gen(RANDOM_SUBSAMPLE_SEED);
+  data.conservativeResize(DIM + 1, std::min(num_points_to_load, std::int64_t(1000000)));
+  bool shift_was_calc = false;
+  for (size_t start = 0; start < tiles.size(); start += batch_size) {
+    size_t end = std::min(start + batch_size, tiles.size());
+    std::vector<std::vector<vw::Vector3>> points(end - start);
+    FifoWorkQueue queue(num_threads);
+    for (size_t it = start; it < end; it++) {
+      boost::shared_ptr<SampleTileTask>
+        task(new SampleTileTask(sampler, tiles[it], load_ratio, it, points[it - start]));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    for (size_t it = 0; it < points.size(); it++) {
+      for (size_t p = 0; p < points[it].size(); p++) {
+        vw::Vector3 const& xyz = points[it][p];
+        if (calc_shift && !shift_was_calc) {
+          shift = xyz;
+          shift_was_calc = true;
+        }
+
+        std::int64_t col = num_seen;
+        num_seen++;
+        if (col >= num_points_to_load) {
+          col = std::uniform_int_distribution<std::int64_t>(0, col)(gen);
+          if (col >= num_points_to_load)
+            continue;
+        } else if (col >= data.cols()) {
+          data.conservativeResize(Eigen::NoChange,
+                                  std::min(2 * data.cols() + 1, num_points_to_load));
+        }
+
+        for (std::int64_t row = 0; row < DIM; row++)
+          data(row, col) = xyz[row] - shift[row];
+        data(DIM, col) = 1; // Extend to be a homogenous coordinate
+      }
+      points[it] = std::vector<vw::Vector3>(); // release the memory
+      if (verbose)
+        tpc.report_incremental_progress(inc_amount);
+    }
+  }
+  if (verbose)
+    tpc.report_finished();
+
+  data.conservativeResize(Eigen::NoChange, std::min(num_seen, num_points_to_load));
+}
+
 // Load a DEM
 template<typename DemPixelType>
 void load_dem_pixel_type(std::string const& file_name,
@@ -382,8 +487,6 @@ void load_dem_pixel_type(std::string const& file_name,
                          bool calc_shift, vw::Vector3 & shift,
                          bool verbose, DoubleMatrix & data){
   
-  data.conservativeResize(DIM+1, num_points_to_load);
-
   vw::cartography::GeoReference dem_geo;
   bool has_georef = vw::cartography::read_georeference( dem_geo, file_name );
   if (!has_georef)
@@ -423,59 +526,39 @@ void load_dem_pixel_type(std::string const& file_name,
   std::int64_t num_points = std::int64_t(pix_box.width()) * std::int64_t(pix_box.height());
   double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_points);
 
-  bool shift_was_calc = false;
-  std::int64_t  points_count   = 0;
+  TileSampler sampler = [&](vw::BBox2i const& tile, double ratio, std::mt19937 & gen,
+                            std::vector<vw::Vector3> & points) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    vw::ImageView<DemPixelType> dem_tile = crop(dem, tile);
+    for (std::int64_t i = 0; i < dem_tile.cols(); i++) {
+      for (std::int64_t j = 0; j < dem_tile.rows(); j++) {
 
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / double(pix_box.width() );
-  if (verbose)
-    tpc.report_progress(0);
-
-  for (std::int64_t i = pix_box.min().x(); i < pix_box.max().x(); i++ ) {
-
-    for (std::int64_t j = pix_box.min().y(); j < pix_box.max().y(); j++ ) {
-      if (points_count >= num_points_to_load)
-        break;
+        if (ratio < 1.0 && uniform(gen) > ratio)
+          continue;
 
-      double r = (double)std::rand()/(double)RAND_MAX;
-      if (r > load_ratio)
-        continue;
+        DemPixelType h = dem_tile(i, j);
+        if ( h == nodata || std::isnan(h) || std::isinf(h) )
+          continue;
 
-      DemPixelType h = dem(i, j);
-      if ( h == nodata || std::isnan(h) || std::isinf(h) )
-        continue;
-      
-      vw::Vector2 lonlat = dem_geo.pixel_to_lonlat( vw::Vector2(i,j) );
+        vw::Vector2 pix(i + tile.min().x(), j + tile.min().y());
+        vw::Vector2 lonlat = dem_geo.pixel_to_lonlat(pix);
 
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(lonlat))
-        continue;
+        // Skip points outside the given box
+        if (!lonlat_box.empty() && !lonlat_box.contains(lonlat))
+          continue;
 
-      vw::Vector3 llh( lonlat.x(), lonlat.y(), h );
-      vw::Vector3 xyz = dem_geo.datum().geodetic_to_cartesian( llh );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
+        vw::Vector3 llh( lonlat.x(), lonlat.y(), h );
+        vw::Vector3 xyz = dem_geo.datum().geodetic_to_cartesian( llh );
+        if ( xyz == vw::Vector3() || !(xyz == xyz) )
+          continue; // invalid and NaN check
 
-      if (calc_shift && !shift_was_calc){
-        shift = xyz;
-        shift_was_calc = true;
+        points.push_back(xyz);
       }
+    }
+  };
 
-      for (std::int64_t row = 0; row < DIM; row++)
-        data(row, points_count) = xyz[row] - shift[row];
-      data(DIM, points_count) = 1; // Extend to be a homogenous coordinate
-
-      points_count++;
-    } // end y loop
-
-    if (verbose)
-      tpc.report_incremental_progress( inc_amount );
-  } // end x loop
-  if (verbose)
-    tpc.report_finished();
-
-  data.conservativeResize(Eigen::NoChange, points_count);
-
+  load_tiles(pix_box, num_points_to_load, load_ratio, sampler,
+             calc_shift, shift, verbose, data);
 }
 
 // Load a DEM
@@ -510,9 +593,6 @@ vw::int64 load_pc_aux(std::string const& file_name,
                       vw::cartography::GeoReference const& geo,
                       bool verbose, DoubleMatrix & data){
 
-  data.conservativeResize(DIM+1, num_points_to_load);
-
-  // To do: Is it faster to to do for_each?
   vw::ImageViewRef<vw::Vector3> point_cloud = read_asp_point_cloud<DIM>(file_name);
 
   // We will randomly pick or not a point with probability load_ratio
@@ -520,51 +600,36 @@ vw::int64 load_pc_aux(std::string const& file_name,
   vw::int64 num_total_points = std::int64_t(point_cloud.cols()) * std::int64_t(point_cloud.rows());
   double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_total_points);
 
-  bool shift_was_calc = false;
-  vw::int64 points_count = 0;
-
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / double(point_cloud.rows() );
-  if (verbose) tpc.report_progress(0);
-
-  for (std::int64_t j = 0; j < point_cloud.rows(); j++ ) {
-
-    for ( std::int64_t i = 0; i < point_cloud.cols(); i++ ) {
-
-      if (points_count >= num_points_to_load)
-        break;
+  // A point cloud has no georeference, so all tiles must be read, but
+  // the lon-lat box is checked only for the sampled points.
+  TileSampler sampler = [&](vw::BBox2i const& tile, double ratio, std::mt19937 & gen,
+                            std::vector<vw::Vector3> & points) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    vw::ImageView<vw::Vector3> pc_tile = crop(point_cloud, tile);
+    for (std::int64_t j = 0; j < pc_tile.rows(); j++ ) {
+      for (std::int64_t i = 0; i < pc_tile.cols(); i++ ) {
 
-      double r = (double)std::rand()/(double)RAND_MAX;
-      if (r > load_ratio)
-        continue;
+        if (ratio < 1.0 && uniform(gen) > ratio)
+          continue;
 
-      vw::Vector3 xyz = point_cloud(i, j);
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
+        vw::Vector3 xyz = pc_tile(i, j);
+        if ( xyz == vw::Vector3() || !(xyz == xyz) )
+          continue; // invalid and NaN check
 
-      if (calc_shift && !shift_was_calc){
-        shift = xyz;
-        shift_was_calc = true;
-      }
+        // Skip points outside the given box
+        if (!lonlat_box.empty()){
+          vw::Vector3 llh = geo.datum().cartesian_to_geodetic(xyz);
+          if ( !lonlat_box.contains(subvector(llh, 0, 2)))
+            continue;
+        }
 
-      // Skip points outside the given box
-      if (!lonlat_box.empty()){
-        vw::Vector3 llh = geo.datum().cartesian_to_geodetic(xyz);
-        if ( !lonlat_box.contains(subvector(llh, 0, 2)))
-          continue;
+        points.push_back(xyz);
       }
-
-      for (std::int64_t row = 0; row < DIM; row++)
-        data(row, points_count) = xyz[row] - shift[row];
-      data(DIM, points_count) = 1;
-
-      points_count++;
     }
-    if (verbose) tpc.report_incremental_progress( inc_amount );
-  }
-  if (verbose) tpc.report_finished();
+  };
 
-  data.conservativeResize(Eigen::NoChange, points_count);
+  load_tiles(bounding_box(point_cloud), num_points_to_load, load_ratio, sampler,
+             calc_shift, shift, verbose, data);
 
   return num_total_points;
 }
@@ -43,7 +43,8 @@ typedef Eigen::Matrix<RealT, Eigen::Dynamic, Eigen::Dynamic> DoubleMatrix;
 // work with 2D point clouds. There are some Vector3's all over the place.
 const int DIM = 3;
 
-// Return at most m random points out of the input point cloud.
+// Return at most m random points out of the input point cloud, in their
+// original order. This is done in place, and is repeatable.
 void random_pc_subsample(std::int64_t m, DoubleMatrix& points);
   
 // Load a csv file, perhaps sub-sampling it along the way
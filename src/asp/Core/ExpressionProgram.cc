@@ -0,0 +1,189 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ExpressionProgram.cc
+///
+
+#include <asp/Core/ExpressionProgram.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace asp {
+
+void ExpressionProgram::push_const(double value) {
+  Instruction ins = {OP_CONST, 0, value};
+  m_code.push_back(ins);
+  m_stack_size++;
+  m_max_stack_size = std::max(m_max_stack_size, m_stack_size);
+}
+
+void ExpressionProgram::push_var(int index) {
+  if (index < 0)
+    vw::vw_throw(vw::ArgumentErr() << "Invalid variable index: " << index << ".\n");
+  Instruction ins = {OP_VAR, index, 0.0};
+  m_code.push_back(ins);
+  m_num_vars = std::max(m_num_vars, index + 1);
+  m_stack_size++;
+  m_max_stack_size = std::max(m_max_stack_size, m_stack_size);
+}
+
+void ExpressionProgram::push_op(OpCode op, int num_inputs) {
+  int expected = 0;
+  switch (op) {
+    case OP_NEGATE: case OP_ABS: case OP_SIGN:
+      expected = 1; break;
+    case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_POWER:
+      expected = 2; break;
+    case OP_LT: case OP_GT: case OP_LTE: case OP_GTE: case OP_EQ:
+      expected = 4; break;
+    case OP_MIN: case OP_MAX:
+      expected = std::max(num_inputs, 1); break;
+    default:
+      vw::vw_throw(vw::LogicErr() << "Unexpected operation type.\n");
+  }
+  if (num_inputs != expected || m_stack_size < num_inputs)
+    vw::vw_throw(vw::ArgumentErr() << "Wrong number of inputs for an operation. Expected "
+                 << expected << ", got " << num_inputs << ".\n");
+
+  Instruction ins = {op, num_inputs, 0.0};
+  m_code.push_back(ins);
+  m_stack_size -= num_inputs - 1;
+}
+
+void ExpressionProgram::validate(int num_vars) const {
+  if (m_stack_size != 1)
+    vw::vw_throw(vw::ArgumentErr() << "The expression does not produce a single value.\n");
+  if (m_num_vars > num_vars)
+    vw::vw_throw(vw::ArgumentErr() << "Unrecognized variable var_" << m_num_vars - 1
+                 << ". Note that the first variable is var_0.\n");
+}
+
+void ExpressionProgram::evaluate(std::vector<const double*> const& vars, int n,
+                                 double * out, std::vector<double> & scratch) const {
+
+  validate(int(vars.size()));
+  if (n <= 0)
+    return;
+
+  // The stack is made of spans of n values each
+  scratch.resize(size_t(m_max_stack_size) * n);
+  double * stack = scratch.data();
+  int sp = 0;
+
+  for (size_t k = 0; k < m_code.size(); k++) {
+    Instruction const& ins = m_code[k];
+
+    // Past the last value pushed
+    double * top = stack + size_t(sp) * n;
+
+    switch (ins.op) {
+      case OP_CONST:
+        std::fill(top, top + n, ins.value);
+        sp++;
+        break;
+      case OP_VAR:
+        std::memcpy(top, vars[ins.arg], n * sizeof(double));
+        sp++;
+        break;
+
+      case OP_NEGATE: {
+        double * a = top - n;
+        for (int i = 0; i < n; i++) a[i] = -a[i];
+        break;
+      }
+      case OP_ABS: {
+        double * a = top - n;
+        for (int i = 0; i < n; i++) a[i] = std::abs(a[i]);
+        break;
+      }
+      case OP_SIGN: {
+        double * a = top - n;
+        for (int i = 0; i < n; i++)
+          a[i] = (a[i] == 0) ? 0.0 : (std::signbit(a[i]) ? -1.0 : 1.0);
+        break;
+      }
+
+      case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_POWER: {
+        double * y = top - n, * x = y - n;
+        if (ins.op == OP_ADD)
+          for (int i = 0; i < n; i++) x[i] += y[i];
+        else if (ins.op == OP_SUBTRACT)
+          for (int i = 0; i < n; i++) x[i] -= y[i];
+        else if (ins.op == OP_MULTIPLY)
+          for (int i = 0; i < n; i++) x[i] *= y[i];
+        else if (ins.op == OP_DIVIDE)
+          for (int i = 0; i < n; i++) x[i] /= y[i];
+        else
+          for (int i = 0; i < n; i++) x[i] = std::pow(x[i], y[i]);
+        sp--;
+        break;
+      }
+
+      case OP_MIN: case OP_MAX: {
+        // Fold the inputs into the first one, keeping the earlier value on ties
+        double * x = stack + size_t(sp - ins.arg) * n;
+        for (int j = 1; j < ins.arg; j++) {
+          double * y = x + size_t(j) * n;
+          if (ins.op == OP_MIN)
+            for (int i = 0; i < n; i++) x[i] = (y[i] < x[i]) ? y[i] : x[i];
+          else
+            for (int i = 0; i < n; i++) x[i] = (y[i] > x[i]) ? y[i] : x[i];
+        }
+        sp -= ins.arg - 1;
+        break;
+      }
+
+      default: {
+        // Comparisons. The result is the third input if the comparison of
+        // the first two holds, and the fourth otherwise.
+        double * x = stack + size_t(sp - 4) * n;
+        double * y = x + n, * c = y + n, * d = c + n;
+        if (ins.op == OP_LT)
+          for (int i = 0; i < n; i++) x[i] = (x[i] <  y[i]) ? c[i] : d[i];
+        else if (ins.op == OP_GT)
+          for (int i = 0; i < n; i++) x[i] = (x[i] >  y[i]) ? c[i] : d[i];
+        else if (ins.op == OP_LTE)
+          for (int i = 0; i < n; i++) x[i] = (x[i] <= y[i]) ? c[i] : d[i];
+        else if (ins.op == OP_GTE)
+          for (int i = 0; i < n; i++) x[i] = (x[i] >= y[i]) ? c[i] : d[i];
+        else
+          for (int i = 0; i < n; i++) x[i] = (x[i] == y[i]) ? c[i] : d[i];
+        sp -= 3;
+        break;
+      }
+    }
+  }
+
+  std::memcpy(out, stack, n * sizeof(double));
+}
+
+double ExpressionProgram::evaluate(std::vector<double> const& vars) const {
+  std::vector<const double*> ptrs(vars.size());
+  for (size_t k = 0; k < vars.size(); k++)
+    ptrs[k] = &vars[k];
+  std::vector<double> scratch;
+  double out = 0.0;
+  evaluate(ptrs, 1, &out, scratch);
+  return out;
+}
+
+} // end namespace asp
@@ -0,0 +1,82 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ExpressionProgram.h
+///
+/// An arithmetic expression compiled to a flat list of instructions, in
+/// postfix order, for evaluation over many pixels at once. Each
+/// instruction works on a whole span of values, such as an image row,
+/// in a simple loop that the compiler can vectorize, rather than a
+/// tree being walked for each pixel. Used by image_calc.
+
+#ifndef __ASP_CORE_EXPRESSION_PROGRAM_H__
+#define __ASP_CORE_EXPRESSION_PROGRAM_H__
+
+#include <vector>
+
+namespace asp {
+
+  class ExpressionProgram {
+  public:
+
+    enum OpCode {
+      OP_CONST,     // Push a number
+      OP_VAR,       // Push a variable
+      OP_NEGATE, OP_ABS, OP_SIGN,
+      OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_POWER,
+      OP_MIN, OP_MAX, // Of any number of values
+      OP_LT, OP_GT, OP_LTE, OP_GTE, OP_EQ // a op b ? c : d
+    };
+
+    ExpressionProgram(): m_stack_size(0), m_max_stack_size(0), m_num_vars(0) {}
+
+    /// Append instructions, in postfix order. Each operation takes its
+    /// inputs from the top of the stack. Throws if there are too few.
+    void push_const(double value);
+    void push_var(int index);
+    void push_op(OpCode op, int num_inputs);
+
+    /// Check that the program leaves a single value, and uses no more
+    /// than the given number of variables. Throws if not.
+    void validate(int num_vars) const;
+
+    /// The number of variables used, which is the largest index plus one
+    int num_vars() const { return m_num_vars; }
+
+    /// Evaluate for a span of n values. The k-th variable is read from
+    /// vars[k][0], ..., vars[k][n-1]. The scratch buffer is resized as
+    /// needed, and can be kept between calls to avoid allocations.
+    void evaluate(std::vector<const double*> const& vars, int n, double * out,
+                  std::vector<double> & scratch) const;
+
+    /// Evaluate for a single set of values of the variables
+    double evaluate(std::vector<double> const& vars) const;
+
+  private:
+    struct Instruction {
+      OpCode op;
+      int    arg;   // The variable index, or the number of inputs
+      double value; // For OP_CONST
+    };
+    std::vector<Instruction> m_code;
+    int m_stack_size, m_max_stack_size, m_num_vars;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_EXPRESSION_PROGRAM_H__
@@ -0,0 +1,168 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file GridInterpolation.h
+///
+/// Evaluate a smooth function of the pixel, such as the geoid height or
+/// the height change between datums, for all pixels of a tile, with the
+/// exact, expensive, computation done only on a sparse grid. This is the
+/// same scheme as InterpolatedTransform, for values rather than pixels.
+
+#ifndef __ASP_CORE_GRID_INTERPOLATION_H__
+#define __ASP_CORE_GRID_INTERPOLATION_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  /// The largest absolute difference, per component. NaN if any is NaN.
+  inline double max_abs_diff(double a, double b) {
+    return std::abs(a - b);
+  }
+  inline double max_abs_diff(vw::Vector2 const& a, vw::Vector2 const& b) {
+    double d0 = std::abs(a[0] - b[0]), d1 = std::abs(a[1] - b[1]);
+    if (std::isnan(d0) || std::isnan(d1))
+      return d0 + d1;
+    return std::max(d0, d1);
+  }
+
+  namespace detail {
+
+    template <class ValueT, class FuncT>
+    class GridFiller {
+      vw::BBox2i const&       m_box;
+      double                  m_tol;
+      FuncT const&            m_func;
+      vw::ImageView<ValueT> & m_out;
+      vw::ImageView<char>     m_has_exact;
+
+    public:
+      GridFiller(vw::BBox2i const& box, double tol, FuncT const& func,
+                 vw::ImageView<ValueT> & out):
+        m_box(box), m_tol(tol), m_func(func), m_out(out),
+        m_has_exact(box.width(), box.height()) {
+        for (int row = 0; row < box.height(); row++)
+          for (int col = 0; col < box.width(); col++)
+            m_has_exact(col, row) = 0;
+      }
+
+      // Evaluate a pixel exactly, relative to the box
+      ValueT exact(int col, int row) {
+        if (!m_has_exact(col, row)) {
+          m_out(col, row) = m_func(col + m_box.min().x(), row + m_box.min().y());
+          m_has_exact(col, row) = 1;
+        }
+        return m_out(col, row);
+      }
+
+      static ValueT bilinear(ValueT const& v00, ValueT const& v10,
+                             ValueT const& v01, ValueT const& v11,
+                             int c0, int r0, int c1, int r1, int col, int row) {
+        double a = (c1 > c0) ? double(col - c0)/double(c1 - c0) : 0.0;
+        double b = (r1 > r0) ? double(row - r0)/double(r1 - r0) : 0.0;
+        return (1-a)*(1-b)*v00 + a*(1-b)*v10 + (1-a)*b*v01 + a*b*v11;
+      }
+
+      // Fill the cell with corners (c0, r0) and (c1, r1), inclusive
+      void fill_cell(int c0, int r0, int c1, int r1) {
+
+        ValueT v00 = exact(c0, r0), v10 = exact(c1, r0);
+        ValueT v01 = exact(c0, r1), v11 = exact(c1, r1);
+
+        bool split = (c1 - c0 > 1 || r1 - r0 > 1);
+        if (split) {
+          // Test the center and the edge midpoints
+          int cm = (c0 + c1)/2, rm = (r0 + r1)/2;
+          int test_cols[] = {cm, cm, cm, c0, c1};
+          int test_rows[] = {rm, r0, r1, rm, rm};
+          split = false;
+          for (int it = 0; it < 5 && !split; it++) {
+            ValueT interp = bilinear(v00, v10, v01, v11, c0, r0, c1, r1,
+                                     test_cols[it], test_rows[it]);
+            double diff = max_abs_diff(interp, exact(test_cols[it], test_rows[it]));
+            split = !(diff <= m_tol); // catch NaN
+          }
+        }
+
+        if (split) {
+          int cm = (c0 + c1)/2, rm = (r0 + r1)/2;
+          if (c1 - c0 > 1 && r1 - r0 > 1) {
+            fill_cell(c0, r0, cm, rm); fill_cell(cm, r0, c1, rm);
+            fill_cell(c0, rm, cm, r1); fill_cell(cm, rm, c1, r1);
+          } else if (c1 - c0 > 1) {
+            fill_cell(c0, r0, cm, r1); fill_cell(cm, r0, c1, r1);
+          } else {
+            fill_cell(c0, r0, c1, rm); fill_cell(c0, rm, c1, r1);
+          }
+          return;
+        }
+
+        for (int row = r0; row <= r1; row++) {
+          for (int col = c0; col <= c1; col++) {
+            if (!m_has_exact(col, row))
+              m_out(col, row) = bilinear(v00, v10, v01, v11, c0, r0, c1, r1, col, row);
+          }
+        }
+      }
+    };
+
+  } // end namespace detail
+
+  /// Set out(col, row) to func(col + box.min().x(), row + box.min().y())
+  /// for all pixels in the box. The function is found exactly only at the
+  /// corners of cells of size grid_step, and interpolated bilinearly inside
+  /// the cells. A cell is split in four, down to single pixels, if at its
+  /// center or the midpoints of its edges the interpolated value differs
+  /// from the exact one by more than the tolerance. This also handles the
+  /// borders of the region where the function is valid, if the function
+  /// returns NaN outside of it. With grid_step at most 1, each pixel is
+  /// found exactly. The function value type must support adding and
+  /// scaling, as for double and vw::Vector2.
+  template <class ValueT, class FuncT>
+  void interpolate_on_grid(vw::BBox2i const& box, int grid_step, double tol,
+                           FuncT const& func, vw::ImageView<ValueT> & out) {
+
+    out.set_size(box.width(), box.height());
+    if (box.width() <= 0 || box.height() <= 0)
+      return;
+
+    if (grid_step <= 1) {
+      for (int row = 0; row < box.height(); row++)
+        for (int col = 0; col < box.width(); col++)
+          out(col, row) = func(col + box.min().x(), row + box.min().y());
+      return;
+    }
+
+    detail::GridFiller<ValueT, FuncT> filler(box, tol, func, out);
+    for (int r0 = 0; r0 < box.height(); r0 += grid_step) {
+      int r1 = std::min(r0 + grid_step, box.height() - 1);
+      for (int c0 = 0; c0 < box.width(); c0 += grid_step) {
+        int c1 = std::min(c0 + grid_step, box.width() - 1);
+        filler.fill_cell(c0, r0, c1, r1);
+      }
+    }
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_GRID_INTERPOLATION_H__
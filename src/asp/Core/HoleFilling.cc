@@ -0,0 +1,261 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file HoleFilling.cc
+///
+
+#include <asp/Core/HoleFilling.h>
+#include <asp/Core/BlobRemoval.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+namespace {
+
+  // The pixels of a DEM, with a nodata value
+  struct DemPixels {
+    typedef float        PixelT;
+    typedef double       ValueT;
+    double nodata;
+    explicit DemPixels(double nodata_in): nodata(nodata_in) {}
+    bool   valid(PixelT p) const { return p != nodata && !std::isnan(p); }
+    ValueT value(PixelT p) const { return p; }
+    PixelT make (ValueT v) const { return v; }
+  };
+
+  // The pixels of a disparity
+  struct DispPixels {
+    typedef vw::PixelMask<vw::Vector2f> PixelT;
+    typedef vw::Vector2                 ValueT;
+    bool   valid(PixelT const& p) const { return is_valid(p); }
+    ValueT value(PixelT const& p) const { return ValueT(p.child()[0], p.child()[1]); }
+    PixelT make (ValueT const& v) const { return PixelT(vw::Vector2f(v[0], v[1])); }
+  };
+
+  // The tile size and number of threads for the index
+  int index_tile_size(vw::GdalWriteOptions const& opt) {
+    int tile_size = std::max(opt.raster_tile_size[0], opt.raster_tile_size[1]);
+    if (tile_size <= 0)
+      tile_size = vw::vw_settings().default_tile_size();
+    return tile_size;
+  }
+  int index_num_threads(vw::GdalWriteOptions const& opt) {
+    int num_threads = opt.num_threads;
+    if (num_threads <= 0)
+      num_threads = vw::vw_settings().default_num_threads();
+    return std::max(num_threads, 1);
+  }
+
+  template <class PixT>
+  class HoleFillView: public vw::ImageViewBase<HoleFillView<PixT>> {
+    typedef typename PixT::PixelT PixelT;
+    typedef typename PixT::ValueT ValueT;
+    vw::DiskImageView<PixelT> m_img;
+    TiledBlobIndex const& m_index;
+    HoleFillParams m_params;
+    PixT m_pix;
+
+    // If a hole is to be filled
+    bool fillable(std::int64_t id) const {
+      if (id < 0)
+        return false;
+      vw::BBox2i box = m_index.blob_box(id);
+      if (box.min().x() <= 0 || box.min().y() <= 0 ||
+          box.max().x() >= cols() || box.max().y() >= rows())
+        return false;
+      if (m_params.max_area > 0 && m_index.blob_area(id) > m_params.max_area)
+        return false;
+      if (m_params.max_dim > 0 &&
+          (box.width() > m_params.max_dim || box.height() > m_params.max_dim))
+        return false;
+      return true;
+    }
+
+    // The weighted average of the nearest valid pixels in 8 directions.
+    // The region has the whole hole and the valid pixels around it.
+    bool fill_value(vw::ImageView<PixelT> const& region, int col, int row,
+                    PixelT & result) const {
+      static const int dx[8] = {1, -1, 0,  0, 1,  1, -1, -1};
+      static const int dy[8] = {0,  0, 1, -1, 1, -1,  1, -1};
+      ValueT sum = ValueT();
+      double wsum = 0.0;
+      for (int k = 0; k < 8; k++) {
+        int x = col, y = row;
+        for (int step = 1; ; step++) {
+          x += dx[k];
+          y += dy[k];
+          if (x < 0 || y < 0 || x >= region.cols() || y >= region.rows())
+            break;
+          if (m_pix.valid(region(x, y))) {
+            double d2 = double(step) * step * (k < 4 ? 1.0 : 2.0);
+            sum += m_pix.value(region(x, y)) / d2;
+            wsum += 1.0 / d2;
+            break;
+          }
+        }
+      }
+      if (wsum <= 0.0)
+        return false;
+      result = m_pix.make(sum / wsum);
+      return true;
+    }
+
+  public:
+    HoleFillView(std::string const& file, TiledBlobIndex const& index,
+                 HoleFillParams const& params, PixT const& pix):
+      m_img(file), m_index(index), m_params(params), m_pix(pix) {}
+
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<HoleFillView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline pixel_type operator()(double /*i*/, double /*j*/, vw::int32 /*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "HoleFillView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> out(bbox.width(), bbox.height());
+
+      std::vector<int> tiles = m_index.overlapping_tiles(bbox);
+      std::vector<std::int64_t> ids;
+      for (size_t t = 0; t < tiles.size(); t++) {
+        vw::BBox2i tile = m_index.tile(tiles[t]);
+        vw::BBox2i overlap = tile;
+        overlap.crop(bbox);
+
+        vw::ImageView<pixel_type> data = vw::crop(m_img, tile);
+        vw::ImageView<vw::uint8> hole(data.cols(), data.rows());
+        for (int col = 0; col < data.cols(); col++)
+          for (int row = 0; row < data.rows(); row++)
+            hole(col, row) = !m_pix.valid(data(col, row));
+        m_index.blob_ids(tiles[t], hole, ids);
+
+        // The region with the holes to fill in this part of the tile, and
+        // the valid pixels around them
+        vw::BBox2i region_box;
+        std::int64_t prev_id = -1;
+        for (int row = overlap.min().y(); row < overlap.max().y(); row++) {
+          for (int col = overlap.min().x(); col < overlap.max().x(); col++) {
+            std::int64_t id = ids[size_t(row - tile.min().y()) * tile.width()
+                                  + col - tile.min().x()];
+            if (id >= 0 && id != prev_id && fillable(id)) {
+              vw::BBox2i box = m_index.blob_box(id);
+              box.expand(1);
+              region_box.grow(box);
+              prev_id = id;
+            }
+          }
+        }
+        vw::ImageView<pixel_type> region;
+        if (!region_box.empty())
+          region = vw::crop(m_img, region_box);
+
+        for (int row = overlap.min().y(); row < overlap.max().y(); row++) {
+          for (int col = overlap.min().x(); col < overlap.max().x(); col++) {
+            int tc = col - tile.min().x(), tr = row - tile.min().y();
+            pixel_type pix = data(tc, tr);
+            std::int64_t id = ids[size_t(tr) * tile.width() + tc];
+            if (id >= 0 && fillable(id))
+              fill_value(region, col - region_box.min().x(), row - region_box.min().y(), pix);
+            out(col - bbox.min().x(), row - bbox.min().y()) = pix;
+          }
+        }
+      }
+
+      return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class PixT>
+  void fill_holes(std::string const& in_file, std::string const& out_file,
+                  PixT const& pix, HoleFillParams const& params,
+                  bool has_georef, vw::cartography::GeoReference const& georef,
+                  bool has_nodata, double nodata,
+                  vw::GdalWriteOptions const& opt, vw::ProgressCallback const& tpc) {
+
+    typedef typename PixT::PixelT PixelT;
+    vw::DiskImageView<PixelT> img(in_file);
+
+    // Find the holes, with the tiles done in parallel
+    TiledBlobIndex index(img.cols(), img.rows(), index_tile_size(opt));
+    int num_threads = index_num_threads(opt);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+    for (int it = 0; it < index.num_tiles(); it++) {
+      vw::ImageView<PixelT> data = vw::crop(img, index.tile(it));
+      vw::ImageView<vw::uint8> hole(data.cols(), data.rows());
+      for (int col = 0; col < data.cols(); col++)
+        for (int row = 0; row < data.rows(); row++)
+          hole(col, row) = !pix.valid(data(col, row));
+      index.add_tile(it, hole);
+    }
+    index.merge();
+    vw::vw_out() << "\t    * Identified " << index.num_blobs() << " holes\n";
+
+    vw::cartography::block_write_gdal_image(out_file,
+                                            HoleFillView<PixT>(in_file, index, params, pix),
+                                            has_georef, georef, has_nodata, nodata,
+                                            opt, tpc);
+  }
+
+} // end anonymous namespace
+
+void fill_dem_holes(std::string const& in_file, std::string const& out_file,
+                    double nodata, HoleFillParams const& params,
+                    bool has_georef, vw::cartography::GeoReference const& georef,
+                    vw::GdalWriteOptions const& opt, vw::ProgressCallback const& tpc) {
+  bool has_nodata = true;
+  fill_holes(in_file, out_file, DemPixels(nodata), params, has_georef, georef,
+             has_nodata, nodata, opt, tpc);
+}
+
+void fill_disparity_holes(std::string const& in_file, std::string const& out_file,
+                          HoleFillParams const& params,
+                          bool has_georef, vw::cartography::GeoReference const& georef,
+                          vw::GdalWriteOptions const& opt,
+                          vw::ProgressCallback const& tpc) {
+  bool has_nodata = false;
+  double nodata = -32768.0;
+  fill_holes(in_file, out_file, DispPixels(), params, has_georef, georef,
+             has_nodata, nodata, opt, tpc);
+}
+
+} // end namespace asp
@@ -0,0 +1,68 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file HoleFilling.h
+///
+/// Filling of holes in large DEMs and disparities, tile by tile, in
+/// bounded memory. The holes are the connected components of invalid
+/// pixels, found over the whole image with TiledBlobIndex
+/// (asp/Core/BlobRemoval.h), so a hole spanning many tiles is treated as
+/// one. Holes touching the image boundary are not filled, as they are
+/// outside of the data rather than inside it.
+///
+/// A pixel in a hole is given the average of the nearest valid pixels
+/// along the 8 horizontal, vertical, and diagonal directions from it,
+/// with weights inversely proportional to the squared distance. Only the
+/// bounding box of each hole, grown by one pixel, is read to fill it.
+
+#ifndef __ASP_CORE_HOLE_FILLING_H__
+#define __ASP_CORE_HOLE_FILLING_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/FileIO/GdalWriteOptions.h>
+
+#include <cstdint>
+#include <string>
+
+namespace asp {
+
+  /// Which holes to fill. A limit which is not positive is not used.
+  struct HoleFillParams {
+    std::int64_t max_area; // Fill holes with no more pixels than this
+    int          max_dim;  // Fill holes with width and height no more than this
+    HoleFillParams(): max_area(0), max_dim(0) {}
+  };
+
+  /// Fill the holes in a single-band DEM with the given nodata value.
+  /// Read in_file and write out_file.
+  void fill_dem_holes(std::string const& in_file, std::string const& out_file,
+                      double nodata, HoleFillParams const& params,
+                      bool has_georef, vw::cartography::GeoReference const& georef,
+                      vw::GdalWriteOptions const& opt, vw::ProgressCallback const& tpc);
+
+  /// Fill the holes in a disparity. Read in_file and write out_file.
+  void fill_disparity_holes(std::string const& in_file, std::string const& out_file,
+                            HoleFillParams const& params,
+                            bool has_georef, vw::cartography::GeoReference const& georef,
+                            vw::GdalWriteOptions const& opt,
+                            vw::ProgressCallback const& tpc);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_HOLE_FILLING_H__
@@ -16,6 +16,7 @@
 // __END_LICENSE__
 
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/Ransac.h>
 #include <vw/Math/GaussianClustering.h>
 #include <vw/Math/RANSAC.h>
 #include <vw/Cartography/CameraBBox.h>
@@ -24,12 +25,41 @@
 #include <vw/Image/AlgorithmFunctions.h>
 #include <vw/Core/Stopwatch.h>
 
+#include <sstream>
+#include <algorithm>
+
 // Some of the implementation is in InterestPointMatching2.cc
 
 using namespace vw;
 
 namespace asp {
 
+// Keep this in sync with the choices made in detect_ip(). Only the
+// settings that change the detected interest points belong here.
+std::string ip_detector_desc(int points_per_tile, double nodata) {
+
+  std::ostringstream os;
+  os.precision(17);
+  os << "v1 method " << stereo_settings().ip_matching_method
+     << " points_per_tile " << points_per_tile;
+  
+  if (stereo_settings().ip_matching_method == DETECT_IP_METHOD_INTEGRAL) {
+    int num_scales = stereo_settings().num_scales;
+    if (num_scales <= 0)
+      num_scales = vw::ip::IntegralInterestPointDetector
+        <vw::ip::OBALoGInterestOperator>::IP_DEFAULT_SCALES;
+    os << " num_scales " << num_scales;
+  } else {
+    os << " normalize " << (stereo_settings().skip_image_normalization ||
+                            stereo_settings().ip_normalize_tiles);
+  }
+
+  if (!boost::math::isnan(nodata))
+    os << " nodata " << nodata << " nodata_radius " << stereo_settings().ip_nodata_radius;
+
+  return os.str();
+}
+
 void check_homography_matrix(Matrix<double>       const& H,
                              std::vector<Vector3> const& left_points,
                              std::vector<Vector3> const& right_points,
@@ -127,7 +157,7 @@ rough_homography_fit(camera::CameraModel* cam1,
   Stopwatch sw;
   sw.start();
   double inlier_thresh = norm_2(Vector2(box1.width(),box1.height())) * (1.5*thresh_factor);
-  math::RandomSampleConsensus<hfit_func, math::InterestPointErrorMetric>
+  asp::ParallelRansac<hfit_func, math::InterestPointErrorMetric>
     ransac(hfit_func(), math::InterestPointErrorMetric(),
            asp::stereo_settings().ip_num_ransac_iterations,
            inlier_thresh, min_num_inliers);
@@ -143,6 +173,29 @@ rough_homography_fit(camera::CameraModel* cam1,
   return H;
 }
 
+// Rank the matches by descriptor distance, for RANSAC
+std::vector<size_t> descriptor_distance_order(std::vector<ip::InterestPoint> const& ip1,
+                                              std::vector<ip::InterestPoint> const& ip2) {
+  std::vector<size_t> order;
+  if (ip1.size() != ip2.size())
+    return order;
+
+  std::vector<double> dists(ip1.size());
+  for (size_t it = 0; it < ip1.size(); it++) {
+    if (ip1[it].descriptor.size() == 0 ||
+        ip1[it].descriptor.size() != ip2[it].descriptor.size())
+      return order;
+    dists[it] = norm_2(ip1[it].descriptor - ip2[it].descriptor);
+  }
+
+  order.resize(ip1.size());
+  for (size_t it = 0; it < order.size(); it++)
+    order[it] = it;
+  std::stable_sort(order.begin(), order.end(),
+                   [&dists](size_t a, size_t b) { return dists[a] < dists[b]; });
+  return order;
+}
+
 Vector2i homography_rectification(bool adjust_left_image_size,
                                   Vector2i const& left_size,
                                   Vector2i const& right_size,
@@ -159,11 +212,12 @@ Vector2i homography_rectification(bool adjust_left_image_size,
   // Use RANSAC to determine a good homography transform between the images
   int min_inliers = left_copy.size()*2/3;
   double inlier_th = norm_2(Vector2(left_size.x(),left_size.y())) * (1.5*thresh_factor);
-  math::RandomSampleConsensus<math::HomographyFittingFunctor, math::InterestPointErrorMetric>
+  asp::ParallelRansac<math::HomographyFittingFunctor, math::InterestPointErrorMetric>
     ransac(math::HomographyFittingFunctor(),
             math::InterestPointErrorMetric(),
             stereo_settings().ip_num_ransac_iterations,
             inlier_th, min_inliers);
+  ransac.set_sample_order(descriptor_distance_order(left_ip, right_ip));
   Matrix<double> H = ransac(right_copy, left_copy);
   std::vector<size_t> indices = ransac.inlier_indices(H, right_copy, left_copy);
   check_homography_matrix(H, left_copy, right_copy, indices);
@@ -676,7 +730,7 @@ size_t filter_ip_homog(std::vector<ip::InterestPoint> const& ip1_in,
     vw_out() << "\t    Inlier threshold:                     " << inlier_threshold << "\n";
     vw_out() << "\t    RANSAC iterations:                    "
              << stereo_settings().ip_num_ransac_iterations << "\n";
-    typedef math::RandomSampleConsensus<math::HomographyFittingFunctor,
+    typedef asp::ParallelRansac<math::HomographyFittingFunctor,
       math::InterestPointErrorMetric> RansacT;
     const int    MIN_NUM_OUTPUT_INLIERS = ransac_ip1.size()/2;
     RansacT ransac(math::HomographyFittingFunctor(),
@@ -684,6 +738,7 @@ size_t filter_ip_homog(std::vector<ip::InterestPoint> const& ip1_in,
                    stereo_settings().ip_num_ransac_iterations,
                    inlier_threshold,
                    MIN_NUM_OUTPUT_INLIERS, true);
+    ransac.set_sample_order(descriptor_distance_order(ip1_in, ip2_in));
     Matrix<double> H(ransac(ransac_ip2,ransac_ip1)); // 2 then 1 is used here for legacy reasons
     //vw_out() << "\t--> Homography: " << H << "\n";
     indices = ransac.inlier_indices(H,ransac_ip2,ransac_ip1);
@@ -903,7 +958,7 @@ vw::Matrix<double> translation_ip_matching(vw::ImageView<vw::PixelGray<float>> c
   std::vector<size_t> indices;
   try {
 
-    vw::math::RandomSampleConsensus<vw::math::TranslationScaleFittingFunctor, vw::math::InterestPointErrorMetric>
+    asp::ParallelRansac<vw::math::TranslationScaleFittingFunctor, vw::math::InterestPointErrorMetric>
       ransac(vw::math::TranslationScaleFittingFunctor(),
              vw::math::InterestPointErrorMetric(),
              stereo_settings().ip_num_ransac_iterations,
@@ -19,6 +19,7 @@
 #define __ASP_CORE_INTEREST_POINT_MATCHING_H__
 
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Image/ImageViewBase.h>
 #include <vw/Image/MaskViews.h>
 #include <vw/Camera/CameraModel.h>
@@ -32,9 +33,12 @@
 #include <vw/FileIO/FileUtils.h>
 
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/IpCache.h>
 #include <boost/foreach.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
 
+#include <map>
+
 namespace asp {
 
 // Debug utility to write out a matches on top of the images
@@ -162,6 +166,13 @@ void write_match_image(std::string const& out_file_name,
             vw::BBox2i const& box1, vw::BBox2i const& box2,
             vw::cartography::Datum const& datum);
 
+  /// Rank the matches by the distance between their descriptors, from
+  /// closest to farthest, as the sample order for asp::ParallelRansac.
+  /// Return an empty order if the descriptors are not available.
+  std::vector<size_t>
+  descriptor_distance_order(std::vector<vw::ip::InterestPoint> const& ip1,
+                            std::vector<vw::ip::InterestPoint> const& ip2);
+
   /// Homography rectification that aligns the right image to the left
   /// image via a homography transform. It returns a vector2i of the
   /// ideal cropping size to use for the left and right image. The left
@@ -215,6 +226,66 @@ void match_ip_pair(vw::ip::InterestPointList const& ip1,
                        DETECT_IP_METHOD_ORB      = 2};
 
 
+/// Describe the detector that detect_ip() will use with the current
+/// settings. This is what makes an ip cache entry for an image unique.
+std::string ip_detector_desc(int points_per_tile, double nodata);
+
+/// Build the descriptors of the interest points in one image tile
+template <class ImageT>
+class DescribeIpTileTask: public vw::Task, private boost::noncopyable {
+  ImageT m_image;
+  vw::ip::InterestPointList & m_ip;
+public:
+  DescribeIpTileTask(ImageT const& image, vw::ip::InterestPointList & ip):
+    m_image(image), m_ip(ip) {}
+  void operator()() {
+    vw::ip::SGradDescriptorGenerator descriptor;
+    describe_interest_points(m_image, descriptor, m_ip);
+  }
+};
+
+/// Build the SGrad descriptors of interest points. VW does this on one
+/// thread, so here the points are grouped by image tile and the tiles
+/// are done in parallel, each reading only its part of the image. The
+/// order of the points is kept.
+template <class ImageT>
+void describe_ip_in_tiles(vw::ImageViewBase<ImageT> const& image,
+                          vw::ip::InterestPointList & ip) {
+
+  const int TILE_SIZE = 1024;
+  std::map<std::pair<int, int>, std::vector<size_t>> tile_indices;
+  std::vector<vw::ip::InterestPointList::iterator> ip_iters;
+  for (auto it = ip.begin(); it != ip.end(); it++) {
+    std::pair<int, int> tile(int(floor(it->x / TILE_SIZE)), int(floor(it->y / TILE_SIZE)));
+    tile_indices[tile].push_back(ip_iters.size());
+    ip_iters.push_back(it);
+  }
+
+  std::vector<vw::ip::InterestPointList> tile_ip(tile_indices.size());
+  vw::FifoWorkQueue queue;
+  size_t count = 0;
+  for (auto const& tile: tile_indices) {
+    for (size_t index: tile.second)
+      tile_ip[count].push_back(*ip_iters[index]);
+    boost::shared_ptr<vw::Task>
+      task(new DescribeIpTileTask<ImageT>(image.impl(), tile_ip[count]));
+    queue.add_task(task);
+    count++;
+  }
+  queue.join_all();
+
+  // Put the described points back in place
+  count = 0;
+  for (auto const& tile: tile_indices) {
+    auto tile_it = tile_ip[count].begin();
+    for (size_t index: tile.second) {
+      *ip_iters[index] = *tile_it;
+      tile_it++;
+    }
+    count++;
+  }
+}
+
 /// Detect interest points
 ///
 /// This is not meant to be used directly. Use ip_matching() or
@@ -264,6 +335,18 @@ void detect_ip(vw::ip::InterestPointList& ip,
   vw::vw_out() << "\t    Using " << points_per_tile 
     << " interest points per tile (1024^2 px).\n";
 
+  // See if these interest points were detected before, by any tool
+  std::string cache_key;
+  std::string const& cache_dir = stereo_settings().ip_cache_dir;
+  if (cache_dir != "") {
+    cache_key = ip_cache_key(image_hash(image.impl()), ip_detector_desc(points_per_tile, nodata));
+    if (ip_cache_read(cache_dir, cache_key, ip)) {
+      if (file_path != "")
+        vw::ip::write_binary_ip_file(file_path, ip);
+      return;
+    }
+  }
+
   const bool has_nodata = !boost::math::isnan(nodata);
   
   // Load the detection method from stereo_settings.
@@ -337,11 +420,10 @@ void detect_ip(vw::ip::InterestPointList& ip,
   if (detect_method == DETECT_IP_METHOD_INTEGRAL) {
     sw.start();
     vw::vw_out() << "\t    Building descriptors" << std::endl;
-    vw::ip::SGradDescriptorGenerator descriptor;
     if (!has_nodata)
-      describe_interest_points(image.impl(), descriptor, ip);
+      describe_ip_in_tiles(image.impl(), ip);
     else
-      describe_interest_points(apply_mask(create_mask_less_or_equal(image.impl(),nodata)), descriptor, ip);
+      describe_ip_in_tiles(apply_mask(create_mask_less_or_equal(image.impl(),nodata)), ip);
 
     vw::vw_out(vw::DebugMessage,"asp") << "Building descriptors elapsed time: "
                                << sw.elapsed_seconds() << " s." << std::endl;
@@ -349,6 +431,9 @@ void detect_ip(vw::ip::InterestPointList& ip,
 
   vw::vw_out() << "\t    Found interest points: " << ip.size() << std::endl;
 
+  if (cache_dir != "")
+    ip_cache_write(cache_dir, cache_key, ip);
+
   // If a file path was provided, record the IP to disk.
   if (file_path != "") {
     vw::vw_out() << "\t    Recording interest points to file: " << file_path << std::endl;
@@ -573,13 +573,18 @@ void pick_subset(int max_pairwise_matches,
 }
 
 // Match ip without a datum, cameras, epipolar lines.
-void match_ip_no_datum(std::vector<vw::ip::InterestPoint> const& ip1_copy,
-                       std::vector<vw::ip::InterestPoint> const& ip2_copy,
-                       DetectIpMethod detect_method, double uniqueness_threshold, 
-                       bool quiet,
-                       // Outputs
-                       std::vector<vw::ip::InterestPoint>& matched_ip1,
-                       std::vector<vw::ip::InterestPoint>& matched_ip2) {
+void match_ip_no_datum_serial(std::vector<vw::ip::InterestPoint> const& ip1_copy,
+                              std::vector<vw::ip::InterestPoint> const& ip2_copy,
+                              DetectIpMethod detect_method, double uniqueness_threshold, 
+                              bool quiet,
+                              // Outputs
+                              std::vector<vw::ip::InterestPoint>& matched_ip1,
+                              std::vector<vw::ip::InterestPoint>& matched_ip2) {
+
+  // A terminal progress bar must not be shared among threads
+  TerminalProgressCallback tpc("asp", "\t   Matching: ");
+  ProgressCallback const& progress
+    = quiet ? ProgressCallback::dummy_instance() : tpc;
 
   // TODO: Should probably unify the ip::InterestPointMatcher class
   // with the EpipolarLinePointMatcher class!
@@ -587,14 +592,93 @@ void match_ip_no_datum(std::vector<vw::ip::InterestPoint> const& ip1_copy,
     // For all L2Norm distance metrics
     vw::ip::InterestPointMatcher<vw::ip::L2NormMetric,ip::NullConstraint> 
       matcher(uniqueness_threshold);
-    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-	    TerminalProgressCallback("asp", "\t   Matching: "), quiet);
+    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2, progress, quiet);
   } else {
     // For Hamming distance metrics
     vw::ip::InterestPointMatcher<ip::HammingMetric,ip::NullConstraint> 
       matcher(uniqueness_threshold);
-    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-	    TerminalProgressCallback("asp", "\t   Matching: "), quiet);
+    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2, progress, quiet);
+  }
+
+  return;
+}
+
+// Match a range of left ip against all right ip. The ratio test for a
+// left ip depends only on its two nearest right ip, so matching ranges
+// separately gives the same result as matching all at once.
+class NoDatumMatchTask: public Task, private boost::noncopyable {
+  std::vector<vw::ip::InterestPoint> m_ip1;
+  std::vector<vw::ip::InterestPoint> const& m_ip2;
+  DetectIpMethod m_detect_method;
+  double m_uniqueness_threshold;
+  // Outputs
+  std::vector<vw::ip::InterestPoint> & m_matched_ip1;
+  std::vector<vw::ip::InterestPoint> & m_matched_ip2;
+public:
+  NoDatumMatchTask(std::vector<vw::ip::InterestPoint>::const_iterator start,
+                   std::vector<vw::ip::InterestPoint>::const_iterator end,
+                   std::vector<vw::ip::InterestPoint> const& ip2,
+                   DetectIpMethod detect_method, double uniqueness_threshold,
+                   std::vector<vw::ip::InterestPoint> & matched_ip1,
+                   std::vector<vw::ip::InterestPoint> & matched_ip2):
+    m_ip1(start, end), m_ip2(ip2), m_detect_method(detect_method),
+    m_uniqueness_threshold(uniqueness_threshold),
+    m_matched_ip1(matched_ip1), m_matched_ip2(matched_ip2) {}
+
+  void operator()() {
+    bool quiet = true;
+    match_ip_no_datum_serial(m_ip1, m_ip2, m_detect_method, m_uniqueness_threshold,
+                             quiet, m_matched_ip1, m_matched_ip2); // outputs
+  }
+};
+
+// Match ip without a datum, cameras, epipolar lines. The left ip are
+// split among the given number of jobs, each matching against all
+// right ip.
+void match_ip_no_datum(std::vector<vw::ip::InterestPoint> const& ip1_copy,
+                       std::vector<vw::ip::InterestPoint> const& ip2_copy,
+                       DetectIpMethod detect_method, double uniqueness_threshold, 
+                       bool quiet, size_t number_of_jobs,
+                       // Outputs
+                       std::vector<vw::ip::InterestPoint>& matched_ip1,
+                       std::vector<vw::ip::InterestPoint>& matched_ip2) {
+
+  // Each job builds its own tree of the right ip, so with few left ip
+  // per job it is not worth splitting them.
+  const size_t MIN_IP_PER_JOB = 1000;
+  number_of_jobs = std::min(number_of_jobs, ip1_copy.size() / MIN_IP_PER_JOB);
+  if (number_of_jobs <= 1 || ip2_copy.empty()) {
+    match_ip_no_datum_serial(ip1_copy, ip2_copy, detect_method, uniqueness_threshold,
+                             quiet, matched_ip1, matched_ip2); // outputs
+    return;
+  }
+
+  if (!quiet)
+    vw_out() << "\t   Matching with " << number_of_jobs << " jobs.\n";
+
+  // The matches of each job, put together in order at the end, so the
+  // result does not depend on the number of jobs.
+  std::vector<std::vector<vw::ip::InterestPoint>> job_ip1(number_of_jobs),
+    job_ip2(number_of_jobs);
+
+  FifoWorkQueue matching_queue; // Create a thread pool object
+  size_t ip1_size = ip1_copy.size();
+  for (size_t job = 0; job < number_of_jobs; job++) {
+    auto start_it = ip1_copy.begin() + (job * ip1_size) / number_of_jobs;
+    auto end_it   = ip1_copy.begin() + ((job + 1) * ip1_size) / number_of_jobs;
+    boost::shared_ptr<Task>
+      match_task(new NoDatumMatchTask(start_it, end_it, ip2_copy, detect_method,
+                                      uniqueness_threshold,
+                                      job_ip1[job], job_ip2[job]));
+    matching_queue.add_task(match_task);
+  }
+  matching_queue.join_all(); // Wait for all the jobs to finish.
+
+  matched_ip1.clear();
+  matched_ip2.clear();
+  for (size_t job = 0; job < number_of_jobs; job++) {
+    matched_ip1.insert(matched_ip1.end(), job_ip1[job].begin(), job_ip1[job].end());
+    matched_ip2.insert(matched_ip2.end(), job_ip2[job].begin(), job_ip2[job].end());
   }
 
   return;
@@ -697,8 +781,9 @@ public:
               m_datum, quiet, m_cam1, m_cam2, ip1_list, ip2_list,
               local_matched_ip1, local_matched_ip2); // outputs
         } else {
+          int local_number_of_jobs = 1;
           match_ip_no_datum(tile_ip1, tile_ip2, m_detect_method, m_uniqueness_threshold, 
-            quiet, local_matched_ip1, local_matched_ip2); // outputs
+            quiet, local_number_of_jobs, local_matched_ip1, local_matched_ip2); // outputs
         }
       } catch(...) {
         // This need not succeed
@@ -1088,7 +1173,7 @@ void match_ip_pair(vw::ip::InterestPointList const& ip1,
   vw::Stopwatch sw1;
   sw1.start();
   match_ip_no_datum(ip1_copy, ip2_copy, detect_method, uniqueness_threshold, quiet,
-    matched_ip1, matched_ip2); // outputs
+    number_of_jobs, matched_ip1, matched_ip2); // outputs
   sw1.stop();
   vw_out() << "Elapsed time in ip matching: " << sw1.elapsed_seconds() << " s.\n";
 
@@ -0,0 +1,179 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file InterpolatedTransform.h
+///
+/// A transform which evaluates another transform exactly only on a
+/// sparse grid, and interpolates bilinearly in between. This is much
+/// faster when the exact transform is expensive, such as projecting into
+/// a linescan camera, and smooth, as is the case when mapprojecting.
+
+#ifndef __ASP_CORE_INTERPOLATED_TRANSFORM_H__
+#define __ASP_CORE_INTERPOLATED_TRANSFORM_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Transform.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  /// Wrap a transform so that, for each tile, its reverse is computed
+  /// exactly at the corners of cells of the given size, and interpolated
+  /// bilinearly inside the cells. A cell is split in four, down to
+  /// single pixels, if at its center or the midpoints of its edges the
+  /// interpolated value differs from the exact one by more than the
+  /// tolerance, in pixels. This also handles the borders of the valid
+  /// region, where the exact transform jumps to an invalid value.
+  ///
+  /// Like VW transforms which cache the values for the current tile,
+  /// this must be copied for each tile, which TransformView does.
+  template <class TransformT>
+  class InterpolatedTransform:
+    public vw::TransformBase<InterpolatedTransform<TransformT>> {
+
+    TransformT   m_trans;
+    int          m_grid_step;
+    double       m_tol;
+    vw::Vector2i m_image_size; // the input image, to tell valid results
+
+    // The reverse transform for the current output tile
+    mutable vw::BBox2i                 m_cached_box;
+    mutable vw::ImageView<vw::Vector2> m_cache;
+    mutable vw::ImageView<char>        m_has_exact; // which pixels are computed exactly
+
+    // Evaluate a pixel exactly, relative to the cached box
+    vw::Vector2 exact(int col, int row) const {
+      if (!m_has_exact(col, row)) {
+        m_cache(col, row) = m_trans.reverse(vw::Vector2(col + m_cached_box.min().x(),
+                                                        row + m_cached_box.min().y()));
+        m_has_exact(col, row) = 1;
+      }
+      return m_cache(col, row);
+    }
+
+    // Fill the cell with corners (c0, r0) and (c1, r1), inclusive
+    void fill_cell(int c0, int r0, int c1, int r1) const {
+
+      vw::Vector2 v00 = exact(c0, r0), v10 = exact(c1, r0);
+      vw::Vector2 v01 = exact(c0, r1), v11 = exact(c1, r1);
+
+      bool split = (c1 - c0 > 1 || r1 - r0 > 1);
+      if (split) {
+        // Test the center and the edge midpoints
+        int cm = (c0 + c1)/2, rm = (r0 + r1)/2;
+        int test_cols[] = {cm, cm, cm, c0, c1};
+        int test_rows[] = {rm, r0, r1, rm, rm};
+        split = false;
+        for (int it = 0; it < 5 && !split; it++) {
+          vw::Vector2 interp = bilinear(v00, v10, v01, v11, c0, r0, c1, r1,
+                                        test_cols[it], test_rows[it]);
+          vw::Vector2 diff = interp - exact(test_cols[it], test_rows[it]);
+          split = !(std::abs(diff[0]) <= m_tol && std::abs(diff[1]) <= m_tol); // catch NaN
+        }
+      }
+
+      if (split) {
+        int cm = (c0 + c1)/2, rm = (r0 + r1)/2;
+        if (c1 - c0 > 1 && r1 - r0 > 1) {
+          fill_cell(c0, r0, cm, rm); fill_cell(cm, r0, c1, rm);
+          fill_cell(c0, rm, cm, r1); fill_cell(cm, rm, c1, r1);
+        } else if (c1 - c0 > 1) {
+          fill_cell(c0, r0, cm, r1); fill_cell(cm, r0, c1, r1);
+        } else {
+          fill_cell(c0, r0, c1, rm); fill_cell(c0, rm, c1, r1);
+        }
+        return;
+      }
+
+      for (int row = r0; row <= r1; row++) {
+        for (int col = c0; col <= c1; col++) {
+          if (!m_has_exact(col, row))
+            m_cache(col, row) = bilinear(v00, v10, v01, v11, c0, r0, c1, r1, col, row);
+        }
+      }
+    }
+
+    static vw::Vector2 bilinear(vw::Vector2 const& v00, vw::Vector2 const& v10,
+                                vw::Vector2 const& v01, vw::Vector2 const& v11,
+                                int c0, int r0, int c1, int r1, int col, int row) {
+      double a = (c1 > c0) ? double(col - c0)/double(c1 - c0) : 0.0;
+      double b = (r1 > r0) ? double(row - r0)/double(r1 - r0) : 0.0;
+      return (1-a)*(1-b)*v00 + a*(1-b)*v10 + (1-a)*b*v01 + a*b*v11;
+    }
+
+  public:
+    InterpolatedTransform(TransformT const& trans, int grid_step, double tol,
+                          vw::Vector2i const& image_size):
+      m_trans(trans), m_grid_step(std::max(grid_step, 1)), m_tol(tol),
+      m_image_size(image_size) {}
+
+    /// Compute the reverse transform for all pixels in the box, and
+    /// return the bounding box of the results which are in the input
+    /// image, give or take a pixel.
+    vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const {
+
+      m_cached_box = bbox;
+      // Make new images, as copies of this object share them
+      m_cache     = vw::ImageView<vw::Vector2>(bbox.width(), bbox.height());
+      m_has_exact = vw::ImageView<char>(bbox.width(), bbox.height());
+      for (int row = 0; row < bbox.height(); row++)
+        for (int col = 0; col < bbox.width(); col++)
+          m_has_exact(col, row) = 0;
+
+      for (int r0 = 0; r0 < bbox.height(); r0 += m_grid_step) {
+        int r1 = std::min(r0 + m_grid_step, bbox.height() - 1);
+        for (int c0 = 0; c0 < bbox.width(); c0 += m_grid_step) {
+          int c1 = std::min(c0 + m_grid_step, bbox.width() - 1);
+          fill_cell(c0, r0, c1, r1);
+        }
+      }
+
+      vw::BBox2 valid_box(-1, -1, m_image_size[0] + 2, m_image_size[1] + 2);
+      vw::BBox2 out_box;
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          if (valid_box.contains(m_cache(col, row)))
+            out_box.grow(m_cache(col, row));
+        }
+      }
+      if (out_box.empty())
+        return vw::BBox2i();
+      return vw::grow_bbox_to_int(out_box);
+    }
+
+    vw::Vector2 reverse(vw::Vector2 const& p) const {
+      int col = (int)round(p[0]) - m_cached_box.min().x();
+      int row = (int)round(p[1]) - m_cached_box.min().y();
+      if (col >= 0 && row >= 0 && col < m_cache.cols() && row < m_cache.rows() &&
+          p[0] == round(p[0]) && p[1] == round(p[1]))
+        return m_cache(col, row);
+      return m_trans.reverse(p);
+    }
+
+    vw::Vector2 forward(vw::Vector2 const& p) const {
+      return m_trans.forward(p);
+    }
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_INTERPOLATED_TRANSFORM_H__
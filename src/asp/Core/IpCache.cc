@@ -0,0 +1,122 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file IpCache.cc
+///
+
+#include <asp/Core/IpCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/InterestPoint/InterestData.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+uint64_t fnv1a_hash(const void* data, size_t num_bytes, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t it = 0; it < num_bytes; it++) {
+    hash ^= bytes[it];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t image_file_hash(std::string const& image_file) {
+  return image_hash(vw::DiskImageView<float>(image_file));
+}
+
+std::string ip_cache_key(uint64_t image_hash, std::string const& detector) {
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%016llx%016llx",
+           (unsigned long long)image_hash,
+           (unsigned long long)fnv1a_hash(detector.data(), detector.size()));
+  return std::string(buf);
+}
+
+std::string ip_cache_file(std::string const& cache_dir, std::string const& key) {
+  return (fs::path(cache_dir) / key.substr(0, 2) / (key + ".vwip")).string();
+}
+
+bool ip_cache_read(std::string const& cache_dir, std::string const& key,
+                   vw::ip::InterestPointList & ip) {
+  std::string file = ip_cache_file(cache_dir, key);
+  if (!fs::exists(file))
+    return false;
+
+  try {
+    ip = vw::ip::read_binary_ip_file_list(file);
+  } catch (std::exception const& e) {
+    vw::vw_out(vw::WarningMessage) << "Ignoring unreadable cached interest point file: "
+                                   << file << ". " << e.what() << "\n";
+    return false;
+  }
+  vw::vw_out() << "\t    Read " << ip.size() << " cached interest points from: "
+               << file << std::endl;
+  return true;
+}
+
+// Create the entry under a temporary name, then rename it into place
+void ip_cache_write(std::string const& cache_dir, std::string const& key,
+                    vw::ip::InterestPointList const& ip) {
+  std::string file = ip_cache_file(cache_dir, key);
+  try {
+    fs::create_directories(fs::path(file).parent_path());
+    std::string tmp_file = fs::unique_path(file + ".%%%%-%%%%.tmp").string();
+    vw::ip::write_binary_ip_file(tmp_file, ip);
+    fs::rename(tmp_file, file);
+  } catch (std::exception const& e) {
+    // Failing to cache is not fatal
+    vw::vw_out(vw::WarningMessage) << "Could not add interest points to the cache: "
+                                   << file << ". " << e.what() << "\n";
+    return;
+  }
+  vw::vw_out() << "\t    Cached interest points in: " << file << std::endl;
+}
+
+bool ip_cache_fetch_file(std::string const& cache_dir, std::string const& key,
+                         std::string const& vwip_file) {
+  std::string file = ip_cache_file(cache_dir, key);
+  if (!fs::exists(file))
+    return false;
+
+  vw::vw_out() << "Using cached interest points: " << file << std::endl;
+  fs::copy_file(file, vwip_file, fs::copy_option::overwrite_if_exists);
+  return true;
+}
+
+void ip_cache_store_file(std::string const& cache_dir, std::string const& key,
+                         std::string const& vwip_file) {
+  std::string file = ip_cache_file(cache_dir, key);
+  try {
+    fs::create_directories(fs::path(file).parent_path());
+    std::string tmp_file = fs::unique_path(file + ".%%%%-%%%%.tmp").string();
+    fs::copy_file(vwip_file, tmp_file);
+    fs::rename(tmp_file, file);
+  } catch (std::exception const& e) {
+    vw::vw_out(vw::WarningMessage) << "Could not add interest points to the cache: "
+                                   << file << ". " << e.what() << "\n";
+  }
+}
+
+} // end namespace asp
@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file IpCache.h
+///
+/// A content-addressed cache of detected interest points. An entry is keyed
+/// by a hash of the pixels the detector sees and a description of the
+/// detector and its options, so that stereo, bundle_adjust and pc_align
+/// can reuse each other's detections no matter how their match files are
+/// named. Entries are stored as binary .vwip files under the cache
+/// directory, in subdirectories named after the first two key characters.
+
+#ifndef __ASP_CORE_IP_CACHE_H__
+#define __ASP_CORE_IP_CACHE_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/InterestPoint/InterestData.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace asp {
+
+  const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+  /// Continue the 64-bit FNV-1a hash of a sequence of bytes.
+  uint64_t fnv1a_hash(const void* data, size_t num_bytes,
+                      uint64_t hash = FNV_OFFSET_BASIS);
+
+  /// Hash of an image's dimensions and pixel values. Blocks of rows are
+  /// rasterized one at a time, so large images are not loaded into memory.
+  template <class ImageT>
+  uint64_t image_hash(vw::ImageViewBase<ImageT> const& image) {
+    typedef typename ImageT::pixel_type PixelT;
+    ImageT const& img = image.impl();
+    int32_t dims[2] = {int32_t(img.cols()), int32_t(img.rows())};
+    uint64_t hash = fnv1a_hash(dims, sizeof(dims));
+
+    const int block_rows = std::max(1, int((1 << 24) / (sizeof(PixelT) * std::max(1, dims[0]))));
+    for (int row = 0; row < img.rows(); row += block_rows) {
+      int num_rows = std::min(block_rows, int(img.rows()) - row);
+      vw::ImageView<PixelT> block = vw::crop(img, 0, row, img.cols(), num_rows);
+      hash = fnv1a_hash(block.data(), sizeof(PixelT) * block.cols() * block.rows(), hash);
+    }
+    return hash;
+  }
+
+  /// Hash of a single-channel image on disk, as read by DiskImageView<float>.
+  uint64_t image_file_hash(std::string const& image_file);
+
+  /// Form the cache key from an image hash and the detector description.
+  std::string ip_cache_key(uint64_t image_hash, std::string const& detector);
+
+  /// The file where the interest points with this key are stored
+  std::string ip_cache_file(std::string const& cache_dir, std::string const& key);
+
+  /// Read the interest points for this key. Return false if not cached.
+  bool ip_cache_read(std::string const& cache_dir, std::string const& key,
+                     vw::ip::InterestPointList & ip);
+
+  /// Add interest points to the cache. The file is written under a
+  /// temporary name and then renamed, so concurrent processes never see
+  /// a partial entry.
+  void ip_cache_write(std::string const& cache_dir, std::string const& key,
+                      vw::ip::InterestPointList const& ip);
+
+  /// Variants for tools that produce or consume .vwip files directly.
+  /// Return false if not cached.
+  bool ip_cache_fetch_file(std::string const& cache_dir, std::string const& key,
+                           std::string const& vwip_file);
+  void ip_cache_store_file(std::string const& cache_dir, std::string const& key,
+                           std::string const& vwip_file);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_IP_CACHE_H__
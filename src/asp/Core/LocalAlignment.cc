@@ -30,6 +30,8 @@
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
 #include <asp/Core/OpenCVUtils.h>
 #include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/StereoPluginApi.h>
+#include <asp/Core/MatchFile.h>
 
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -38,6 +40,9 @@
 #include <boost/dll.hpp>
 #include <limits>
 #include <cctype>
+#include <fstream>
+#include <sstream>
+#include <mutex>
 
 using namespace vw;
 namespace fs = boost::filesystem;
@@ -112,7 +117,7 @@ namespace asp {
       vw_throw(ArgumentErr() << "Missing IP file: " << match_filename);
 
     vw_out() << "\t    * Loading match file: " << match_filename << "\n";
-    vw::ip::read_binary_match_file(match_filename, left_unaligned_ip, right_unaligned_ip);
+    asp::read_match_file(match_filename, left_unaligned_ip, right_unaligned_ip);
 
     right_trans_crop_win = BBox2i(); // wipe the output
     size_t min_num_ip = 20;
@@ -333,6 +338,143 @@ namespace asp {
     
   }
 
+  // Append to a key the name, size, and modification time of a file, so
+  // the key changes if the file is changed. Missing files are noted too.
+  void append_file_stamp(std::ostringstream & os, std::string const& file) {
+    os << file;
+    boost::system::error_code ec;
+    if (file.empty() || !fs::exists(file, ec)) {
+      os << " missing\n";
+      return;
+    }
+    os << ' ' << fs::file_size(file, ec) << ' ' << fs::last_write_time(file, ec) << "\n";
+  }
+
+  // The version of the local alignment cache format. Increment it if the
+  // cached quantities or how they are found change.
+  const int LOCAL_ALIGNMENT_CACHE_VERSION = 1;
+
+  // A string which changes if any of the inputs or options the local
+  // alignment of a tile depends on are changed. The choice of stereo
+  // algorithm does not matter, as it affects only the aligned images,
+  // which are always written anew.
+  std::string local_alignment_cache_key(ASPGlobalOptions const& opt,
+                                        std::string      const& session_name,
+                                        int                     max_tile_size,
+                                        double                  left_extra_factor,
+                                        double                  right_extra_factor,
+                                        vw::BBox2i       const& left_trans_crop_win,
+                                        std::string      const& left_unaligned_file,
+                                        std::string      const& right_unaligned_file) {
+    std::ostringstream os;
+    os.precision(17);
+    os << "version " << LOCAL_ALIGNMENT_CACHE_VERSION << "\n"
+       << "session " << session_name << "\n"
+       << "crop_win " << left_trans_crop_win.min().x() << ' ' << left_trans_crop_win.min().y()
+       << ' ' << left_trans_crop_win.max().x() << ' ' << left_trans_crop_win.max().y() << "\n"
+       << "tile " << max_tile_size << ' ' << left_extra_factor << ' '
+       << right_extra_factor << "\n"
+       << "ip_per_tile " << stereo_settings().ip_per_tile << "\n"
+       << "threshold " << stereo_settings().local_alignment_threshold << ' '
+       << stereo_settings().alignment_num_ransac_iterations << "\n"
+       << "outlier_removal " << stereo_settings().outlier_removal_params[0] << ' '
+       << stereo_settings().outlier_removal_params[1] << "\n"
+       << "disp_range " << stereo_settings().disparity_range_expansion_percent << ' '
+       << stereo_settings().max_disp_spread << ' ' << stereo_settings().seed_mode << "\n";
+
+    append_file_stamp(os, opt.in_file1);
+    append_file_stamp(os, opt.in_file2);
+    append_file_stamp(os, opt.cam_file1);
+    append_file_stamp(os, opt.cam_file2);
+    append_file_stamp(os, left_unaligned_file);
+    append_file_stamp(os, right_unaligned_file);
+    append_file_stamp(os, opt.out_prefix + "-L.tif");
+    append_file_stamp(os, opt.out_prefix + "-R.tif");
+    append_file_stamp(os, opt.out_prefix + "-align-L.exr");
+    append_file_stamp(os, opt.out_prefix + "-align-R.exr");
+    append_file_stamp(os, opt.out_prefix + "-D_sub.tif");
+    append_file_stamp(os, vw::ip::match_filename(opt.out_prefix, left_unaligned_file,
+                                                 right_unaligned_file));
+    return os.str();
+  }
+
+  // Read the cached local alignment of a tile. Return false if the cache
+  // does not exist, cannot be parsed, or was made with a different key.
+  bool read_local_alignment_cache(std::string const& cache_file,
+                                  std::string const& cache_key,
+                                  vw::BBox2i & right_trans_crop_win,
+                                  vw::Matrix<double> & left_local_mat,
+                                  vw::Matrix<double> & right_local_mat,
+                                  vw::Vector2i & local_trans_aligned_size,
+                                  int & min_disp, int & max_disp) {
+
+    std::ifstream ifs(cache_file.c_str());
+    if (!ifs.good())
+      return false;
+
+    // The key is stored first, followed by an empty line
+    std::string line, key;
+    while (std::getline(ifs, line) && !line.empty())
+      key += line + "\n";
+    if (key != cache_key)
+      return false;
+
+    Matrix<double> left_mat(3, 3), right_mat(3, 3);
+    int min_x, min_y, max_x, max_y;
+    if (!(ifs >> min_x >> min_y >> max_x >> max_y))
+      return false;
+    for (int row = 0; row < 3; row++)
+      for (int col = 0; col < 3; col++)
+        if (!(ifs >> left_mat(row, col)))
+          return false;
+    for (int row = 0; row < 3; row++)
+      for (int col = 0; col < 3; col++)
+        if (!(ifs >> right_mat(row, col)))
+          return false;
+    Vector2i aligned_size;
+    int min_d, max_d;
+    if (!(ifs >> aligned_size[0] >> aligned_size[1] >> min_d >> max_d))
+      return false;
+
+    right_trans_crop_win     = BBox2i(Vector2i(min_x, min_y), Vector2i(max_x, max_y));
+    left_local_mat           = left_mat;
+    right_local_mat          = right_mat;
+    local_trans_aligned_size = aligned_size;
+    min_disp                 = min_d;
+    max_disp                 = max_d;
+    return true;
+  }
+
+  // Save the local alignment of a tile, to be reused if the tile is
+  // processed again with the same inputs and options. Failure to write
+  // is not fatal.
+  void write_local_alignment_cache(std::string const& cache_file,
+                                   std::string const& cache_key,
+                                   vw::BBox2i const& right_trans_crop_win,
+                                   vw::Matrix<double> const& left_local_mat,
+                                   vw::Matrix<double> const& right_local_mat,
+                                   vw::Vector2i const& local_trans_aligned_size,
+                                   int min_disp, int max_disp) {
+
+    std::ofstream ofs(cache_file.c_str());
+    if (!ofs.good()) {
+      vw_out(WarningMessage) << "Could not write: " << cache_file << "\n";
+      return;
+    }
+    ofs.precision(17);
+    ofs << cache_key << "\n";
+    ofs << right_trans_crop_win.min().x() << ' ' << right_trans_crop_win.min().y() << ' '
+        << right_trans_crop_win.max().x() << ' ' << right_trans_crop_win.max().y() << "\n";
+    for (int row = 0; row < 3; row++)
+      ofs << left_local_mat(row, 0) << ' ' << left_local_mat(row, 1) << ' '
+          << left_local_mat(row, 2) << "\n";
+    for (int row = 0; row < 3; row++)
+      ofs << right_local_mat(row, 0) << ' ' << right_local_mat(row, 1) << ' '
+          << right_local_mat(row, 2) << "\n";
+    ofs << local_trans_aligned_size[0] << ' ' << local_trans_aligned_size[1] << "\n";
+    ofs << min_disp << ' ' << max_disp << "\n";
+  }
+
   // Algorithm to perform local alignment. Approach:
   //  - Given the global interest points and the left crop window, find
   //    the right crop window.
@@ -417,59 +559,178 @@ namespace asp {
     vw::HomographyTransform left_global_trans(left_global_mat);
     vw::HomographyTransform right_global_trans(right_global_mat);
 
-    // Estimate the region in the right image corresponding
-    // to left_trans_crop_win based on ip in the current box and
-    // also by creating ip from D_sub.
-    estimate_right_trans_crop_win(opt, left_unaligned_file, right_unaligned_file,
-                                  left_global_trans, right_global_trans,
-                                  right_globally_aligned_image,  
-                                  max_tile_size, right_extra_factor, left_trans_crop_win,
-                                  // Output
-                                  right_trans_crop_win);
-
-    // TODO(oalexan1): May want to increase here the number of ip per image,
-    // from the default of 5000 in InterestPointMatching.cc.
-    // But do not introduced hard-coded values.
+    // The names of the locally aligned tiles
+    std::string left_tile = "left-aligned-tile.tif";
+    std::string right_tile = "right-aligned-tile.tif";
+
+    // Finding the local alignment is the expensive part, as it needs
+    // interest point matching. The result is saved, and reused by the next
+    // run in this tile, with any stereo algorithm, if the inputs and the
+    // options it depends on are the same.
+    std::string cache_file = opt.out_prefix + "-local-alignment.txt";
+    std::string cache_key = local_alignment_cache_key(opt, session_name, max_tile_size,
+                                                      left_extra_factor, right_extra_factor,
+                                                      left_trans_crop_win,
+                                                      left_unaligned_file,
+                                                      right_unaligned_file);
+    Vector2i local_trans_aligned_size;
+    bool cached = (!stereo_settings().local_alignment_debug &&
+                   read_local_alignment_cache(cache_file, cache_key,
+                                              right_trans_crop_win,
+                                              left_local_mat, right_local_mat,
+                                              local_trans_aligned_size,
+                                              min_disp, max_disp));
+    if (cached) {
+      vw_out() << "Reusing the local alignment from: " << cache_file << "\n";
+    } else {
+
+      // Estimate the region in the right image corresponding
+      // to left_trans_crop_win based on ip in the current box and
+      // also by creating ip from D_sub.
+      estimate_right_trans_crop_win(opt, left_unaligned_file, right_unaligned_file,
+                                    left_global_trans, right_global_trans,
+                                    right_globally_aligned_image,  
+                                    max_tile_size, right_extra_factor, left_trans_crop_win,
+                                    // Output
+                                    right_trans_crop_win);
+
+      // TODO(oalexan1): May want to increase here the number of ip per image,
+      // from the default of 5000 in InterestPointMatching.cc.
+      // But do not introduced hard-coded values.
     
-    // Redo ip matching in the current tile. It should be more accurate after alignment
-    // and cropping.
-    std::vector<vw::ip::InterestPoint> left_local_ip, right_local_ip;
-    size_t number_of_jobs = 1;
-    detect_match_ip(left_local_ip, right_local_ip,
-                    crop(left_globally_aligned_image, left_trans_crop_win),
-                    crop(right_globally_aligned_image, right_trans_crop_win), 
-                    stereo_settings().ip_per_tile, number_of_jobs,
-                    "", "", // do not save any results to disk  
-                    left_nodata_value, right_nodata_value,
-                    "" // do not save any match file to disk
-                    );
+      // Redo ip matching in the current tile. It should be more accurate after alignment
+      // and cropping.
+      std::vector<vw::ip::InterestPoint> left_local_ip, right_local_ip;
+      size_t number_of_jobs = 1;
+      detect_match_ip(left_local_ip, right_local_ip,
+                      crop(left_globally_aligned_image, left_trans_crop_win),
+                      crop(right_globally_aligned_image, right_trans_crop_win), 
+                      stereo_settings().ip_per_tile, number_of_jobs,
+                      "", "", // do not save any results to disk  
+                      left_nodata_value, right_nodata_value,
+                      "" // do not save any match file to disk
+                      );
 
-    if (stereo_settings().local_alignment_debug) {
-      // These clips have global but not local alignment
-      vw::cartography::GeoReference georef;
-      bool has_georef = false, has_nodata = true;
-      float nan_nodata = std::numeric_limits<float>::quiet_NaN();
-
-      std::string left_crop = opt.out_prefix + "-" + "left-crop.tif";
-      vw_out() << "\t--> Writing: " << left_crop << "\n";
-      block_write_gdal_image(left_crop, crop(left_globally_aligned_image,
-                                             left_trans_crop_win),
-                             has_georef, georef,
-                             has_nodata, left_nodata_value, opt,
-                             TerminalProgressCallback("asp","\t  Left:  "));
+      if (stereo_settings().local_alignment_debug) {
+        // These clips have global but not local alignment
+        vw::cartography::GeoReference georef;
+        bool has_georef = false, has_nodata = true;
+        float nan_nodata = std::numeric_limits<float>::quiet_NaN();
+
+        std::string left_crop = opt.out_prefix + "-" + "left-crop.tif";
+        vw_out() << "\t--> Writing: " << left_crop << "\n";
+        block_write_gdal_image(left_crop, crop(left_globally_aligned_image,
+                                               left_trans_crop_win),
+                               has_georef, georef,
+                               has_nodata, left_nodata_value, opt,
+                               TerminalProgressCallback("asp","\t  Left:  "));
       
-      std::string right_crop = opt.out_prefix + "-" + "right-crop.tif";
-      vw_out() << "\t--> Writing: " << right_crop << "\n";
-      block_write_gdal_image(right_crop, crop(right_globally_aligned_image,
-                                             right_trans_crop_win),
-                             has_georef, georef,
-                             has_nodata, right_nodata_value, opt,
-                             TerminalProgressCallback("asp","\t  Right:  "));
-
-      std::string local_match_filename = vw::ip::match_filename(opt.out_prefix,
-                                                                left_crop, right_crop);
-      vw_out() << "Writing match file: " << local_match_filename << "\n";
-      vw::ip::write_binary_match_file(local_match_filename, left_local_ip, right_local_ip);
+        std::string right_crop = opt.out_prefix + "-" + "right-crop.tif";
+        vw_out() << "\t--> Writing: " << right_crop << "\n";
+        block_write_gdal_image(right_crop, crop(right_globally_aligned_image,
+                                               right_trans_crop_win),
+                               has_georef, georef,
+                               has_nodata, right_nodata_value, opt,
+                               TerminalProgressCallback("asp","\t  Right:  "));
+
+        std::string local_match_filename = vw::ip::match_filename(opt.out_prefix,
+                                                                  left_crop, right_crop);
+        vw_out() << "Writing match file: " << local_match_filename << "\n";
+        vw::ip::write_binary_match_file(local_match_filename, left_local_ip, right_local_ip);
+      }
+
+      // Find the local alignment
+      // TODO(oalexan1): May want to do do an initial affine epipolar alignment
+      // based on d_sub and preexisting match points, with a bigger outlier factor,
+      // then do an initial rectification, then redo it as below. 
+      std::vector<size_t> ip_inlier_indices;
+      bool crop_to_shared_area = false;
+      local_trans_aligned_size =
+        affine_epipolar_rectification(left_trans_crop_win.size(), right_trans_crop_win.size(),
+                                      stereo_settings().local_alignment_threshold,
+                                      stereo_settings().alignment_num_ransac_iterations,
+                                      left_local_ip, right_local_ip,
+                                      crop_to_shared_area,
+                                      left_local_mat, right_local_mat, &ip_inlier_indices);
+
+      Vector2 outlier_removal_params = stereo_settings().outlier_removal_params;
+
+      // Filter outliers using cameras among the ip in the tile which have the global alignment
+      // applied to them. 
+      if (outlier_removal_params[0] < 100.0)
+        filter_local_ip_using_cameras(opt, outlier_removal_params,  
+                                      left_global_trans, right_global_trans,  
+                                      left_trans_crop_win, right_trans_crop_win,  
+                                      left_camera_model, right_camera_model, datum,
+                                      // These get modified
+                                      left_local_ip, right_local_ip, ip_inlier_indices);
+
+      // Apply the local alignment transform to ip in the tile
+      std::vector<vw::ip::InterestPoint> left_trans_local_ip;
+      std::vector<vw::ip::InterestPoint> right_trans_local_ip;
+      apply_transforms_to_ip(left_local_ip, right_local_ip, ip_inlier_indices,  
+                             left_local_mat, right_local_mat,  
+                             // Outputs
+                             left_trans_local_ip, right_trans_local_ip);
+
+      // Filter outliers among locally aligned ip, this can reduce the search range
+      bool quiet = false;
+      if (outlier_removal_params[0] < 100.0)
+        asp::filter_ip_by_disparity(outlier_removal_params[0], outlier_removal_params[1], quiet,
+                                    left_trans_local_ip, right_trans_local_ip);
+    
+      //  Find the disparity search range
+      BBox2 disp_range;
+      for (size_t it = 0; it < left_trans_local_ip.size(); it++) {
+        Vector2 left_pt (left_trans_local_ip [it].x, left_trans_local_ip [it].y);
+        Vector2 right_pt(right_trans_local_ip[it].x, right_trans_local_ip[it].y);
+        disp_range.grow(right_pt - left_pt);
+      }
+    
+      if (stereo_settings().local_alignment_debug) {
+        std::string local_aligned_match_filename
+          = vw::ip::match_filename(opt.out_prefix, left_tile, right_tile);
+        vw_out() << "Writing match file: " << local_aligned_match_filename << "\n";
+        vw::ip::write_binary_match_file(local_aligned_match_filename, left_trans_local_ip,
+                                        right_trans_local_ip);
+      }
+    
+      // Expand the disparity search range a bit
+      double disp_width = disp_range.width();
+      double disp_extra = disp_width * stereo_settings().disparity_range_expansion_percent / 100.0;
+    
+      min_disp = floor(disp_range.min().x() - disp_extra/2.0);
+      max_disp = ceil(disp_range.max().x()  + disp_extra/2.0);
+
+      // TODO(oalexan1): Make this into a function.
+      if (stereo_settings().max_disp_spread > 0) {
+      
+        vw_out() << "Min and max disparities before invoking the --max-disp-spread option: "
+                 << min_disp << ' ' << max_disp << ".\n";
+      
+        std::vector<double> diff;
+        for (size_t it = 0; it < left_trans_local_ip.size(); it++) 
+          diff.push_back(right_trans_local_ip[it].x - left_trans_local_ip[it].x);
+      
+        if (diff.empty()) 
+          vw_throw(ArgumentErr() << "No interest points left.");
+      
+        std::sort(diff.begin(), diff.end());
+        double mid_x = diff[diff.size()/2]; // median
+      
+        double len = stereo_settings().max_disp_spread;
+        double half = len / 2.0;
+        min_disp = std::max(min_disp, (int)floor(mid_x - half));
+        max_disp = std::min(max_disp, (int)ceil (mid_x + half));
+
+        // The resulting range of disparities will be printed later.
+      }
+
+      write_local_alignment_cache(cache_file, cache_key,
+                                  right_trans_crop_win,
+                                  left_local_mat, right_local_mat,
+                                  local_trans_aligned_size,
+                                  min_disp, max_disp);
     }
 
     // The matrices which take care of the crop to the current tile
@@ -481,20 +742,6 @@ namespace asp {
     right_crop_mat(0, 2) = -right_trans_crop_win.min().x();
     right_crop_mat(1, 2) = -right_trans_crop_win.min().y();
 
-    // Find the local alignment
-    // TODO(oalexan1): May want to do do an initial affine epipolar alignment
-    // based on d_sub and preexisting match points, with a bigger outlier factor,
-    // then do an initial rectification, then redo it as below. 
-    std::vector<size_t> ip_inlier_indices;
-    bool crop_to_shared_area = false;
-    Vector2i local_trans_aligned_size =
-      affine_epipolar_rectification(left_trans_crop_win.size(), right_trans_crop_win.size(),
-                                    stereo_settings().local_alignment_threshold,
-                                    stereo_settings().alignment_num_ransac_iterations,
-                                    left_local_ip, right_local_ip,
-                                    crop_to_shared_area,
-                                    left_local_mat, right_local_mat, &ip_inlier_indices);
-
     // Combination of global alignment, crop to current tile, and local alignment
     Matrix<double> combined_left_mat  = left_local_mat * left_crop_mat * left_global_mat;
     Matrix<double> combined_right_mat = right_local_mat * right_crop_mat * right_global_mat;
@@ -602,8 +849,6 @@ namespace asp {
     // Write the locally aligned images to disk
     vw::cartography::GeoReference georef;
     bool has_georef = false, has_aligned_nodata = write_nodata;
-    std::string left_tile = "left-aligned-tile.tif";
-    std::string right_tile = "right-aligned-tile.tif";
     left_aligned_file = opt.out_prefix + "-" + left_tile; 
     vw_out() << "\t--> Writing: " << left_aligned_file << "\n";
     block_write_gdal_image(left_aligned_file, left_trans_clip,
@@ -618,78 +863,6 @@ namespace asp {
                            has_aligned_nodata, nan_nodata, opt,
                            TerminalProgressCallback("asp","\t  Right:  "));
     
-    Vector2 outlier_removal_params = stereo_settings().outlier_removal_params;
-
-    // Filter outliers using cameras among the ip in the tile which have the global alignment
-    // applied to them. 
-    if (outlier_removal_params[0] < 100.0)
-      filter_local_ip_using_cameras(opt, outlier_removal_params,  
-                                    left_global_trans, right_global_trans,  
-                                    left_trans_crop_win, right_trans_crop_win,  
-                                    left_camera_model, right_camera_model, datum,
-                                    // These get modified
-                                    left_local_ip, right_local_ip, ip_inlier_indices);
-
-    // Apply the local alignment transform to ip in the tile
-    std::vector<vw::ip::InterestPoint> left_trans_local_ip;
-    std::vector<vw::ip::InterestPoint> right_trans_local_ip;
-    apply_transforms_to_ip(left_local_ip, right_local_ip, ip_inlier_indices,  
-                           left_local_mat, right_local_mat,  
-                           // Outputs
-                           left_trans_local_ip, right_trans_local_ip);
-
-    // Filter outliers among locally aligned ip, this can reduce the search range
-    bool quiet = false;
-    if (outlier_removal_params[0] < 100.0)
-      asp::filter_ip_by_disparity(outlier_removal_params[0], outlier_removal_params[1], quiet,
-                                  left_trans_local_ip, right_trans_local_ip);
-    
-    //  Find the disparity search range
-    BBox2 disp_range;
-    for (size_t it = 0; it < left_trans_local_ip.size(); it++) {
-      Vector2 left_pt (left_trans_local_ip [it].x, left_trans_local_ip [it].y);
-      Vector2 right_pt(right_trans_local_ip[it].x, right_trans_local_ip[it].y);
-      disp_range.grow(right_pt - left_pt);
-    }
-    
-    if (stereo_settings().local_alignment_debug) {
-      std::string local_aligned_match_filename
-        = vw::ip::match_filename(opt.out_prefix, left_tile, right_tile);
-      vw_out() << "Writing match file: " << local_aligned_match_filename << "\n";
-      vw::ip::write_binary_match_file(local_aligned_match_filename, left_trans_local_ip,
-                                      right_trans_local_ip);
-    }
-    
-    // Expand the disparity search range a bit
-    double disp_width = disp_range.width();
-    double disp_extra = disp_width * stereo_settings().disparity_range_expansion_percent / 100.0;
-    
-    min_disp = floor(disp_range.min().x() - disp_extra/2.0);
-    max_disp = ceil(disp_range.max().x()  + disp_extra/2.0);
-
-    // TODO(oalexan1): Make this into a function.
-    if (stereo_settings().max_disp_spread > 0) {
-      
-      vw_out() << "Min and max disparities before invoking the --max-disp-spread option: "
-               << min_disp << ' ' << max_disp << ".\n";
-      
-      std::vector<double> diff;
-      for (size_t it = 0; it < left_trans_local_ip.size(); it++) 
-        diff.push_back(right_trans_local_ip[it].x - left_trans_local_ip[it].x);
-      
-      if (diff.empty()) 
-        vw_throw(ArgumentErr() << "No interest points left.");
-      
-      std::sort(diff.begin(), diff.end());
-      double mid_x = diff[diff.size()/2]; // median
-      
-      double len = stereo_settings().max_disp_spread;
-      double half = len / 2.0;
-      min_disp = std::max(min_disp, (int)floor(mid_x - half));
-      max_disp = std::min(max_disp, (int)ceil (mid_x + half));
-
-      // The resulting range of disparities will be printed later.
-    }
 
     // TODO(oalexan1): If just small slivers of valid data
     // are left in the tiles without the padding, this tile better
@@ -816,6 +989,16 @@ namespace asp {
   // Also implement for unalign_2d_disparity.
   
   // DO the same for unalign_2d_disparity.
+
+  // Apply a homography to a pixel. This is what HomographyTransform::forward()
+  // does, without the virtual call and the conversions, as it is done for
+  // each pixel of a tile below.
+  inline vw::Vector2 apply_homography(vw::Matrix3x3 const& H, double x, double y) {
+    double w = H(2, 0) * x + H(2, 1) * y + H(2, 2);
+    return vw::Vector2((H(0, 0) * x + H(0, 1) * y + H(0, 2)) / w,
+                       (H(1, 0) * x + H(1, 1) * y + H(1, 2)) / w);
+  }
+
   // Go from 1D disparity of images with affine epipolar alignment to the 2D
   // disparity by undoing the transforms that applied this alignment.
   void unalign_1d_disparity(// Inputs
@@ -827,28 +1010,34 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<vw::Vector2f>> & unaligned_disp_2d) {
 
-    vw::HomographyTransform left_align_trans (left_align_mat);
-    vw::HomographyTransform right_align_trans(right_align_mat);
+    // The right transform is undone, so its inverse is found once for the tile
+    vw::Matrix3x3 left_H = left_align_mat;
+    vw::Matrix3x3 right_H_inv = vw::math::inverse(vw::Matrix3x3(right_align_mat));
 
     float nan_nodata = std::numeric_limits<float>::quiet_NaN(); // NaN value
     PixelMask<float> nodata_mask = PixelMask<float>(); // invalid value for a PixelMask
 
-    ImageViewRef<PixelMask<float>> masked_aligned_disp_1d
+    // Bring the tile in memory once, rather than going through the
+    // ImageViewRef for each interpolated pixel
+    ImageView<PixelMask<float>> masked_aligned_disp_1d
       = create_mask(aligned_disp_1d, nan_nodata);
 
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<PixelMask<float>> interp_aligned_disp_1d
+    auto interp_aligned_disp_1d
       = interpolate(masked_aligned_disp_1d, BilinearInterpolation(),
                     ValueEdgeExtension<PixelMask<float>>(nodata_mask));
     
     unaligned_disp_2d.set_size(left_crop_win.width(), left_crop_win.height());
 
-    for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
-      for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
+    // Adjust for the fact that the two tiles before alignment
+    // were crops from larger images
+    Vector2 crop_diff = right_crop_win.min() - left_crop_win.min();
+
+    for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
+      for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
+        Vector2 left_trans_pix = apply_homography(left_H, col, row);
         PixelMask<float> interp_disp
           = interp_aligned_disp_1d(left_trans_pix.x(), left_trans_pix.y());
 
@@ -859,19 +1048,13 @@ namespace asp {
         }
 
         // Since the disparity is 1D, the y value (row) is the same
-        // as for the input.
-        Vector2 right_trans_pix(left_trans_pix.x() + interp_disp.child(), left_trans_pix.y());
-
-        // Undo the transform
-        Vector2 right_pix = right_align_trans.reverse(right_trans_pix);
+        // as for the input. Then undo the transform.
+        Vector2 right_pix = apply_homography(right_H_inv,
+                                             left_trans_pix.x() + interp_disp.child(),
+                                             left_trans_pix.y());
 
         // Un-transformed disparity
-        Vector2 disp_pix = right_pix - left_pix;
-
-        // Adjust for the fact that the two tiles before alignment
-        // were crops from larger images
-        disp_pix += (right_crop_win.min() - left_crop_win.min());
-      
+        Vector2 disp_pix = right_pix - Vector2(col, row) + crop_diff;
         unaligned_disp_2d(col, row).child() = Vector2f(disp_pix.x(), disp_pix.y());
         unaligned_disp_2d(col, row).validate();
       }   
@@ -890,8 +1073,9 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<vw::Vector2f>> & unaligned_disp_2d) {
     
-    vw::HomographyTransform left_align_trans (left_align_mat);
-    vw::HomographyTransform right_align_trans(right_align_mat);
+    // The right transform is undone, so its inverse is found once for the tile
+    vw::Matrix3x3 left_H = left_align_mat;
+    vw::Matrix3x3 right_H_inv = vw::math::inverse(vw::Matrix3x3(right_align_mat));
 
     PixelMask<vw::Vector2f> nodata_pix;
     nodata_pix.invalidate();
@@ -899,16 +1083,19 @@ namespace asp {
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<vw::PixelMask<vw::Vector2f>> interp_aligned_disp_2d
+    auto interp_aligned_disp_2d
       = interpolate(aligned_disp_2d, BilinearInterpolation(),
                     ValueEdgeExtension<PixelMask<vw::Vector2f>>(nodata_pix));
     
     unaligned_disp_2d.set_size(left_crop_win.width(), left_crop_win.height());
 
-    for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
-      for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
+    // Adjust for the fact that the two tiles before alignment
+    // were crops from larger images
+    Vector2 crop_diff = right_crop_win.min() - left_crop_win.min();
+
+    for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
+      for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
+        Vector2 left_trans_pix = apply_homography(left_H, col, row);
         PixelMask<vw::Vector2f> interp_disp
           = interp_aligned_disp_2d(left_trans_pix.x(), left_trans_pix.y());
         
@@ -919,19 +1106,13 @@ namespace asp {
         }
 
         // Do the math with doubles rather than with floats, so cast
-        // Vector2f to Vector2.
+        // Vector2f to Vector2. Then undo the transform.
         Vector2 right_trans_pix = left_trans_pix + Vector2(interp_disp.child());
-
-        // Undo the transform
-        Vector2 right_pix = right_align_trans.reverse(right_trans_pix);
+        Vector2 right_pix = apply_homography(right_H_inv, right_trans_pix.x(),
+                                             right_trans_pix.y());
 
         // Un-transformed disparity
-        Vector2 disp_pix = right_pix - left_pix;
-
-        // Adjust for the fact that the two tiles before alignment
-        // were crops from larger images
-        disp_pix += (right_crop_win.min() - left_crop_win.min());
-      
+        Vector2 disp_pix = right_pix - Vector2(col, row) + crop_diff;
         unaligned_disp_2d(col, row).child() = Vector2f(disp_pix.x(), disp_pix.y());
         unaligned_disp_2d(col, row).validate();
       }   
@@ -949,7 +1130,7 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<float>> & unaligned_image) {
     
-    vw::HomographyTransform left_align_trans(left_align_mat);
+    vw::Matrix3x3 left_H = left_align_mat;
 
     PixelMask<float> nodata_pix;
     nodata_pix.invalidate();
@@ -957,19 +1138,16 @@ namespace asp {
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<vw::PixelMask<float>> interp_aligned_image
+    auto interp_aligned_image
       = interpolate(aligned_image, BilinearInterpolation(),
                     ValueEdgeExtension<PixelMask<float>>(nodata_pix));
     
     unaligned_image.set_size(left_crop_win.width(), left_crop_win.height());
-    for (int col = 0; col < unaligned_image.cols(); col++) {
-      for (int row = 0; row < unaligned_image.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
-        PixelMask<float> interp_val
+    for (int row = 0; row < unaligned_image.rows(); row++) {
+      for (int col = 0; col < unaligned_image.cols(); col++) {
+        Vector2 left_trans_pix = apply_homography(left_H, col, row);
+        unaligned_image(col, row)
           = interp_aligned_image(left_trans_pix.x(), left_trans_pix.y());
-        
-        unaligned_image(col, row) = interp_val;
       }
     }
   }
@@ -1060,6 +1238,82 @@ namespace asp {
     boost::to_lower(alg_name);
   }
 
+  // Return true if a stereo plugin is a shared library, to be loaded
+  // with call_stereo_plugin_library(), rather than a program
+  bool is_stereo_plugin_library(std::string const& plugin_path) {
+    std::string ext = fs::path(plugin_path).extension().string();
+    boost::to_lower(ext);
+    return (ext == ".so" || ext == ".dylib");
+  }
+
+  // Run a stereo plugin which is a shared library on images in memory,
+  // per the interface in StereoPluginApi.h. A library is loaded once per
+  // process and is kept loaded.
+  void call_stereo_plugin_library(std::string const& plugin_path,
+                                  std::string const& options,
+                                  vw::ImageView<float> const& left_image,
+                                  vw::ImageView<float> const& right_image,
+                                  vw::ImageView<float> & disparity) {
+
+    if (left_image.cols() != right_image.cols() || left_image.rows() != right_image.rows())
+      vw_throw(ArgumentErr() << "The locally aligned images must have the same size.\n");
+
+    static std::mutex plugin_mutex;
+    static std::map<std::string, boost::shared_ptr<boost::dll::shared_library>> plugin_libs;
+    asp_stereo_plugin_correlate_fn correlate = NULL;
+    {
+      std::lock_guard<std::mutex> lock(plugin_mutex);
+      auto it = plugin_libs.find(plugin_path);
+      if (it == plugin_libs.end()) {
+        vw_out() << "Loading stereo plugin: " << plugin_path << "\n";
+        boost::shared_ptr<boost::dll::shared_library> lib;
+        try {
+          lib.reset(new boost::dll::shared_library(plugin_path));
+        } catch (std::exception const& e) {
+          vw_throw(ArgumentErr() << "Cannot load stereo plugin: " << plugin_path
+                   << ". " << e.what() << "\n");
+        }
+        if (!lib->has(ASP_STEREO_PLUGIN_VERSION_SYMBOL) ||
+            !lib->has(ASP_STEREO_PLUGIN_CORRELATE_SYMBOL))
+          vw_throw(ArgumentErr() << "The stereo plugin " << plugin_path
+                   << " does not export the functions "
+                   << ASP_STEREO_PLUGIN_VERSION_SYMBOL << " and "
+                   << ASP_STEREO_PLUGIN_CORRELATE_SYMBOL << ".\n");
+        asp_stereo_plugin_version_fn version
+          = lib->get<int()>(ASP_STEREO_PLUGIN_VERSION_SYMBOL);
+        if (version() != ASP_STEREO_PLUGIN_API_VERSION)
+          vw_throw(ArgumentErr() << "The stereo plugin " << plugin_path
+                   << " was built for interface version " << version()
+                   << ", while the expected version is "
+                   << ASP_STEREO_PLUGIN_API_VERSION << ".\n");
+        it = plugin_libs.insert(std::make_pair(plugin_path, lib)).first;
+      }
+      correlate = &it->second->get<int(int, const char * const *, const float *,
+                                        const float *, int, int, float *)>
+        (ASP_STEREO_PLUGIN_CORRELATE_SYMBOL);
+    }
+
+    // Split the options into words, as for the command line of a program
+    std::vector<std::string> words;
+    std::istringstream iss(options);
+    std::string word;
+    while (iss >> word)
+      words.push_back(word);
+    std::vector<const char*> argv;
+    for (size_t it = 0; it < words.size(); it++)
+      argv.push_back(words[it].c_str());
+
+    // ImageView stores the pixels row after row, as expected by the plugin
+    disparity.set_size(left_image.cols(), left_image.rows());
+    int ret = correlate(argv.size(), argv.empty() ? NULL : &argv[0],
+                        left_image.data(), right_image.data(),
+                        left_image.cols(), left_image.rows(),
+                        disparity.data());
+    if (ret != 0)
+      vw_throw(ArgumentErr() << "The stereo plugin " << plugin_path
+               << " failed with code " << ret << ".\n");
+  }
+
   // Return true for an option name, which is a dash followed by a non-integer
   bool is_option_name(std::string const& val) {
     return ( val.size() >= 2 && val[0] == '-' && (val[1] < '0' || val[1] > '9') );
@@ -112,6 +112,18 @@ namespace asp {
   void parse_plugins_list(std::map<std::string, std::string> & plugins,
                           std::map<std::string, std::string> & plugin_libs);
 
+  // Return true if a stereo plugin is a shared library, to be loaded
+  // with call_stereo_plugin_library(), rather than a program
+  bool is_stereo_plugin_library(std::string const& plugin_path);
+
+  // Run a stereo plugin which is a shared library on images in memory,
+  // per the interface in StereoPluginApi.h
+  void call_stereo_plugin_library(std::string const& plugin_path,
+                                  std::string const& options,
+                                  vw::ImageView<float> const& left_image,
+                                  vw::ImageView<float> const& right_image,
+                                  vw::ImageView<float> & disparity);
+
   // Given a string like "mgm -O 8 -s vfit", separate the name,
   // which is the first word, from the options, which is the rest.
   void parse_stereo_alg_name_and_opts(std::string const& stereo_alg,
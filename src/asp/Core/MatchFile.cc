@@ -0,0 +1,242 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MatchFile.cc
+///
+
+#include <asp/Core/MatchFile.h>
+
+#include <vw/Core/Exception.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cstring>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  const char MATCH_FILE_MAGIC[8] = {'A', 'S', 'P', 'M', 'A', 'T', 'C', 'H'};
+  const std::int64_t MATCH_FILE_VERSION = 2;
+
+  // The file starts with this. It is followed by the columns, each
+  // first for the left and then for the right image: the x and y
+  // pixels, the ix and iy pixels, the orientation, scale, and interest,
+  // the octave and scale level, the descriptors, and the polarity. This
+  // keeps all arrays aligned.
+  struct MatchFileHeader {
+    char         magic[8];
+    std::int64_t version;
+    std::int64_t num_matches, desc_len;
+  };
+
+  std::size_t data_size(std::size_t num, std::size_t desc_len) {
+    return sizeof(MatchFileHeader)
+      + 2 * num * (2 * sizeof(float) + 2 * sizeof(std::int32_t) + 3 * sizeof(float)
+                   + 2 * sizeof(std::uint32_t) + desc_len * sizeof(float)
+                   + sizeof(std::uint8_t));
+  }
+
+  bool read_header(std::string const& file, MatchFileHeader & header) {
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.read((char*)&header, sizeof(header)))
+      return false;
+    return std::memcmp(header.magic, MATCH_FILE_MAGIC, sizeof(header.magic)) == 0;
+  }
+
+} // end anonymous namespace
+
+bool is_match_file_v2(std::string const& file) {
+  MatchFileHeader header;
+  return read_header(file, header);
+}
+
+void write_match_file_v2(std::string const& file,
+                         std::vector<vw::ip::InterestPoint> const& ip1,
+                         std::vector<vw::ip::InterestPoint> const& ip2,
+                         bool save_descriptors) {
+
+  if (ip1.size() != ip2.size())
+    vw::vw_throw(vw::ArgumentErr() << "Cannot write: " << file
+                 << ". The left and right interest points differ in number.\n");
+
+  std::size_t num = ip1.size();
+  std::size_t desc_len = 0;
+  if (save_descriptors && num > 0)
+    desc_len = ip1[0].descriptor.size();
+  for (std::size_t i = 0; i < num && desc_len > 0; i++) {
+    if (ip1[i].descriptor.size() != desc_len || ip2[i].descriptor.size() != desc_len)
+      vw::vw_throw(vw::ArgumentErr() << "Cannot write: " << file
+                   << ". The interest point descriptors differ in length.\n");
+  }
+
+  MatchFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MATCH_FILE_MAGIC, sizeof(header.magic));
+  header.version     = MATCH_FILE_VERSION;
+  header.num_matches = num;
+  header.desc_len    = desc_len;
+
+  std::vector<std::vector<vw::ip::InterestPoint> const*> sides = {&ip1, &ip2};
+  std::vector<float> fbuf;
+  std::vector<std::int32_t> ibuf;
+  std::vector<std::uint32_t> ubuf;
+  std::vector<std::uint8_t> pbuf;
+
+  // Write to a temporary file and rename it, so that an interrupted
+  // run does not leave behind a partial file.
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+    ofs.write((const char*)&header, sizeof(header));
+
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      fbuf.resize(2 * num);
+      for (std::size_t i = 0; i < num; i++) {
+        fbuf[2*i] = ip[i].x; fbuf[2*i + 1] = ip[i].y;
+      }
+      ofs.write((const char*)fbuf.data(), fbuf.size() * sizeof(float));
+    }
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      ibuf.resize(2 * num);
+      for (std::size_t i = 0; i < num; i++) {
+        ibuf[2*i] = ip[i].ix; ibuf[2*i + 1] = ip[i].iy;
+      }
+      ofs.write((const char*)ibuf.data(), ibuf.size() * sizeof(std::int32_t));
+    }
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      fbuf.resize(3 * num);
+      for (std::size_t i = 0; i < num; i++) {
+        fbuf[3*i] = ip[i].orientation; fbuf[3*i + 1] = ip[i].scale;
+        fbuf[3*i + 2] = ip[i].interest;
+      }
+      ofs.write((const char*)fbuf.data(), fbuf.size() * sizeof(float));
+    }
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      ubuf.resize(2 * num);
+      for (std::size_t i = 0; i < num; i++) {
+        ubuf[2*i] = ip[i].octave; ubuf[2*i + 1] = ip[i].scale_lvl;
+      }
+      ofs.write((const char*)ubuf.data(), ubuf.size() * sizeof(std::uint32_t));
+    }
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      fbuf.resize(num * desc_len);
+      for (std::size_t i = 0; i < num; i++) {
+        for (std::size_t d = 0; d < desc_len; d++)
+          fbuf[i * desc_len + d] = ip[i].descriptor[d];
+      }
+      ofs.write((const char*)fbuf.data(), fbuf.size() * sizeof(float));
+    }
+    for (int s = 0; s < 2; s++) {
+      auto const& ip = *sides[s];
+      pbuf.resize(num);
+      for (std::size_t i = 0; i < num; i++)
+        pbuf[i] = ip[i].polarity;
+      ofs.write((const char*)pbuf.data(), pbuf.size());
+    }
+
+    if (!ofs)
+      vw::vw_throw(vw::IOErr() << "Failed to write: " << tmp_file << ".\n");
+  }
+  fs::rename(tmp_file, file);
+}
+
+MappedMatchFile::MappedMatchFile(std::string const& file):
+  m_num_matches(0), m_desc_len(0) {
+
+  MatchFileHeader header;
+  if (!read_header(file, header))
+    vw::vw_throw(vw::IOErr() << "Not a match file in format version 2: " << file << ".\n");
+
+  m_file.reset(new boost::iostreams::mapped_file_source(file));
+  if (!m_file->is_open() || header.version != MATCH_FILE_VERSION ||
+      header.num_matches < 0 || header.desc_len < 0 ||
+      m_file->size() != data_size(header.num_matches, header.desc_len))
+    vw::vw_throw(vw::IOErr() << "Invalid or truncated match file: " << file << ".\n");
+
+  m_num_matches = header.num_matches;
+  m_desc_len    = header.desc_len;
+  std::size_t num = m_num_matches;
+
+  const char * ptr = m_file->data() + sizeof(MatchFileHeader);
+  for (int s = 0; s < 2; s++) {
+    m_xy[s] = (const float*)ptr; ptr += 2 * num * sizeof(float);
+  }
+  for (int s = 0; s < 2; s++) {
+    m_ixy[s] = (const std::int32_t*)ptr; ptr += 2 * num * sizeof(std::int32_t);
+  }
+  for (int s = 0; s < 2; s++) {
+    m_attr[s] = (const float*)ptr; ptr += 3 * num * sizeof(float);
+  }
+  for (int s = 0; s < 2; s++) {
+    m_level[s] = (const std::uint32_t*)ptr; ptr += 2 * num * sizeof(std::uint32_t);
+  }
+  for (int s = 0; s < 2; s++) {
+    m_desc[s] = (const float*)ptr; ptr += num * m_desc_len * sizeof(float);
+  }
+  for (int s = 0; s < 2; s++) {
+    m_polarity[s] = (const std::uint8_t*)ptr; ptr += num;
+  }
+}
+
+void MappedMatchFile::to_ip(std::vector<vw::ip::InterestPoint> & ip1,
+                            std::vector<vw::ip::InterestPoint> & ip2) const {
+
+  std::vector<vw::ip::InterestPoint> * sides[2] = {&ip1, &ip2};
+  for (int s = 0; s < 2; s++) {
+    auto & ip = *sides[s];
+    ip.resize(m_num_matches);
+    for (std::size_t i = 0; i < m_num_matches; i++) {
+      vw::ip::InterestPoint & p = ip[i];
+      p.x           = m_xy[s][2*i];
+      p.y           = m_xy[s][2*i + 1];
+      p.ix          = m_ixy[s][2*i];
+      p.iy          = m_ixy[s][2*i + 1];
+      p.orientation = m_attr[s][3*i];
+      p.scale       = m_attr[s][3*i + 1];
+      p.interest    = m_attr[s][3*i + 2];
+      p.octave      = m_level[s][2*i];
+      p.scale_lvl   = m_level[s][2*i + 1];
+      p.polarity    = m_polarity[s][i];
+      p.descriptor.set_size(m_desc_len);
+      const float * desc = descriptor(s, i);
+      for (std::size_t d = 0; d < m_desc_len; d++)
+        p.descriptor[d] = desc[d];
+    }
+  }
+}
+
+void read_match_file(std::string const& file,
+                     std::vector<vw::ip::InterestPoint> & ip1,
+                     std::vector<vw::ip::InterestPoint> & ip2) {
+  if (is_match_file_v2(file))
+    MappedMatchFile(file).to_ip(ip1, ip2);
+  else
+    vw::ip::read_binary_match_file(file, ip1, ip2);
+}
+
+} // end namespace asp
@@ -0,0 +1,106 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MatchFile.h
+///
+/// A compact version 2 of the binary match file. It has the same content
+/// as the format written by vw::ip::write_binary_match_file(), but is
+/// laid out by column, with the pixel coordinates of all matches first
+/// and the descriptors, which are optional, last. The file is
+/// memory-mapped on reading, so a tool which needs only the pixels reads
+/// only those from disk, with no copies.
+///
+/// asp::read_match_file() reads either format, so it can be used
+/// wherever vw::ip::read_binary_match_file() was used.
+
+#ifndef __ASP_CORE_MATCH_FILE_H__
+#define __ASP_CORE_MATCH_FILE_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/InterestPoint/InterestData.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace boost {
+  namespace iostreams {
+    class mapped_file_source;
+  }
+}
+
+namespace asp {
+
+  /// If the file is a match file in format version 2
+  bool is_match_file_v2(std::string const& file);
+
+  /// Write the matches in format version 2, with or without descriptors.
+  /// The two lists must have the same size.
+  void write_match_file_v2(std::string const& file,
+                           std::vector<vw::ip::InterestPoint> const& ip1,
+                           std::vector<vw::ip::InterestPoint> const& ip2,
+                           bool save_descriptors = true);
+
+  /// Read a match file in either format
+  void read_match_file(std::string const& file,
+                       std::vector<vw::ip::InterestPoint> & ip1,
+                       std::vector<vw::ip::InterestPoint> & ip2);
+
+  /// A memory-mapped match file in format version 2. The accessors read
+  /// straight from the mapped file.
+  class MappedMatchFile {
+  public:
+    /// Map the file. Throws if it is not a valid match file in format 2.
+    explicit MappedMatchFile(std::string const& file);
+
+    std::size_t num_matches() const { return m_num_matches; }
+    bool has_descriptors() const { return m_desc_len > 0; }
+    std::size_t descriptor_size() const { return m_desc_len; }
+
+    /// The pixel of match i in the left (side 0) or right (side 1) image
+    vw::Vector2 pixel(int side, std::size_t i) const {
+      return vw::Vector2(m_xy[side][2*i], m_xy[side][2*i + 1]);
+    }
+
+    /// The descriptor of match i, of length descriptor_size()
+    const float * descriptor(int side, std::size_t i) const {
+      return m_desc[side] + i * m_desc_len;
+    }
+
+    /// Convert to interest points, with descriptors if present
+    void to_ip(std::vector<vw::ip::InterestPoint> & ip1,
+               std::vector<vw::ip::InterestPoint> & ip2) const;
+
+  private:
+    boost::shared_ptr<boost::iostreams::mapped_file_source> m_file;
+    std::size_t m_num_matches, m_desc_len;
+
+    // The columns, for the left and right image
+    const float        * m_xy[2];       // x, y interleaved
+    const std::int32_t * m_ixy[2];      // ix, iy interleaved
+    const float        * m_attr[2];     // orientation, scale, interest
+    const std::uint32_t* m_level[2];    // octave, scale_lvl
+    const float        * m_desc[2];
+    const std::uint8_t * m_polarity[2];
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MATCH_FILE_H__
@@ -22,6 +22,7 @@
 #include <vw/InterestPoint/Matcher.h> // Needed for vw::ip::match_filename
 
 #include <asp/Core/MatchList.h>
+#include <asp/Core/MatchFile.h>
 
 using namespace vw;
 
@@ -298,7 +299,7 @@ bool MatchList::loadPointsFromMatchFiles(std::vector<std::string> const& matchFi
     std::vector<vw::ip::InterestPoint> left, right;
     try {
       vw_out() << "Reading binary match file: " << match_file << std::endl;
-      ip::read_binary_match_file(match_file, left, right);
+      asp::read_match_file(match_file, left, right);
     }catch(...){
       vw_out() << "IP load failed, leaving default invalid IP\n";
       continue;
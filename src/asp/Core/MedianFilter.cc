@@ -17,12 +17,18 @@
 
 
 #include <asp/Core/MedianFilter.h>
+#include <vw/Core/Settings.h>
 #include <vw/Math/Vector.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
 using namespace vw;
 
-uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
-                               int kernSize) {
+uint8 vw::find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
+                                   int kernSize) {
   int acc = 0;
   int acc_limit = kernSize * kernSize / 2;
 
@@ -39,3 +45,186 @@ uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
 
   return i;
 }
+
+namespace asp {
+
+namespace {
+
+  const int NUM_BINS = 256;
+
+  // The rows are split into this many bands per thread, each done by
+  // sliding the window down
+  const int BANDS_PER_THREAD = 4;
+
+  // The median of an 8-bit image over the given rows
+  void median_filter_band(ImageView<uint8> const& img, int half,
+                          int row_beg, int row_end, ImageView<uint8> & out) {
+
+    int nc = img.cols(), nr = img.rows();
+
+    // The histogram of each column over the rows of the window, and of
+    // the window
+    std::vector<int> col_hist(size_t(nc) * NUM_BINS, 0);
+    std::vector<int> hist(NUM_BINS);
+
+    for (int row = std::max(row_beg - half, 0); row < std::min(row_beg + half, nr - 1) + 1;
+         row++) {
+      for (int col = 0; col < nc; col++)
+        col_hist[size_t(col) * NUM_BINS + img(col, row)]++;
+    }
+
+    for (int row = row_beg; row < row_end; row++) {
+
+      // Slide the column histograms down
+      if (row > row_beg) {
+        int out_row = row - half - 1, in_row = row + half;
+        if (out_row >= 0)
+          for (int col = 0; col < nc; col++)
+            col_hist[size_t(col) * NUM_BINS + img(col, out_row)]--;
+        if (in_row < nr)
+          for (int col = 0; col < nc; col++)
+            col_hist[size_t(col) * NUM_BINS + img(col, in_row)]++;
+      }
+      int num_rows = std::min(row + half, nr - 1) - std::max(row - half, 0) + 1;
+
+      std::fill(hist.begin(), hist.end(), 0);
+      for (int col = 0; col < std::min(half, nc - 1) + 1; col++) {
+        const int * h = &col_hist[size_t(col) * NUM_BINS];
+        for (int b = 0; b < NUM_BINS; b++)
+          hist[b] += h[b];
+      }
+
+      for (int col = 0; col < nc; col++) {
+
+        // Slide the window right by adding and removing whole columns
+        if (col > 0) {
+          int out_col = col - half - 1, in_col = col + half;
+          if (out_col >= 0) {
+            const int * h = &col_hist[size_t(out_col) * NUM_BINS];
+            for (int b = 0; b < NUM_BINS; b++)
+              hist[b] -= h[b];
+          }
+          if (in_col < nc) {
+            const int * h = &col_hist[size_t(in_col) * NUM_BINS];
+            for (int b = 0; b < NUM_BINS; b++)
+              hist[b] += h[b];
+          }
+        }
+
+        int num_cols = std::min(col + half, nc - 1) - std::max(col - half, 0) + 1;
+        int limit = (num_rows * num_cols + 1) / 2, acc = 0, b = 0;
+        for (; b < NUM_BINS - 1; b++) {
+          acc += hist[b];
+          if (acc >= limit)
+            break;
+        }
+        out(col, row) = b;
+      }
+    }
+  }
+
+  // Remove one value from a sorted list
+  template <class T>
+  void sorted_erase(std::vector<T> & vals, T val) {
+    typename std::vector<T>::iterator it = std::lower_bound(vals.begin(), vals.end(), val);
+    if (it != vals.end() && *it == val)
+      vals.erase(it);
+  }
+
+  int get_num_threads(int num_threads) {
+    if (num_threads <= 0)
+      num_threads = vw_settings().default_num_threads();
+    return std::max(num_threads, 1);
+  }
+
+  template <class T>
+  ImageView<T> median_filter_nan(ImageView<T> const& img, int half, int num_threads) {
+
+    int nc = img.cols(), nr = img.rows();
+    ImageView<T> out(nc, nr);
+    if (half <= 0) {
+      out = copy(img);
+      return out;
+    }
+    T nan = std::numeric_limits<T>::quiet_NaN();
+    num_threads = get_num_threads(num_threads);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+    for (int row = 0; row < nr; row++) {
+      int r0 = std::max(row - half, 0), r1 = std::min(row + half, nr - 1);
+
+      // The valid values in the window, sorted
+      std::vector<T> vals;
+      vals.reserve(size_t(2 * half + 1) * (2 * half + 1));
+      for (int col = 0; col < std::min(half, nc - 1) + 1; col++) {
+        for (int r = r0; r <= r1; r++)
+          if (!std::isnan(img(col, r)))
+            vals.push_back(img(col, r));
+      }
+      std::sort(vals.begin(), vals.end());
+
+      for (int col = 0; col < nc; col++) {
+
+        if (col > 0) {
+          int out_col = col - half - 1, in_col = col + half;
+          if (out_col >= 0) {
+            for (int r = r0; r <= r1; r++)
+              if (!std::isnan(img(out_col, r)))
+                sorted_erase(vals, img(out_col, r));
+          }
+          if (in_col < nc) {
+            for (int r = r0; r <= r1; r++) {
+              T val = img(in_col, r);
+              if (!std::isnan(val))
+                vals.insert(std::upper_bound(vals.begin(), vals.end(), val), val);
+            }
+          }
+        }
+
+        size_t len = vals.size();
+        if (len == 0)
+          out(col, row) = nan;
+        else if (len % 2 == 1)
+          out(col, row) = vals[len / 2];
+        else
+          out(col, row) = (vals[len / 2 - 1] + vals[len / 2]) / 2.0;
+      }
+    }
+
+    return out;
+  }
+
+} // end anonymous namespace
+
+ImageView<uint8> median_filter(ImageView<uint8> const& img, int half, int num_threads) {
+
+  int nr = img.rows();
+  ImageView<uint8> out(img.cols(), nr);
+  if (half <= 0) {
+    out = copy(img);
+    return out;
+  }
+
+  // Each band starts by filling the column histograms, which takes about
+  // 2*half+1 rows of work, so bands are kept much taller than that
+  num_threads = get_num_threads(num_threads);
+  int num_bands = BANDS_PER_THREAD * num_threads;
+  int band_rows = std::max((nr + num_bands - 1) / num_bands, 8 * (2 * half + 1));
+  num_bands = (nr + band_rows - 1) / band_rows;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int band = 0; band < num_bands; band++)
+    median_filter_band(img, half, band * band_rows, std::min((band + 1) * band_rows, nr), out);
+
+  return out;
+}
+
+ImageView<float> median_filter(ImageView<float> const& img, int half, int num_threads) {
+  return median_filter_nan(img, half, num_threads);
+}
+
+ImageView<double> median_filter(ImageView<double> const& img, int half, int num_threads) {
+  return median_filter_nan(img, half, num_threads);
+}
+
+} // end namespace asp
@@ -18,6 +18,14 @@
 
 /// \file MedianFilter.h
 ///
+/// Median filters. The ones in namespace asp take time per pixel which
+/// does not grow, or grows slowly, with the window size. For 8-bit
+/// images, each column keeps a histogram of the values in the window
+/// rows, and the window histogram is updated by adding and removing
+/// whole column histograms, as in Perreault and Hebert, "Median
+/// Filtering in Constant Time", 2007. For floating-point images, such as
+/// DEMs, the valid values in the window are kept sorted as the window
+/// slides along a row. Rows are done in parallel.
 
 #ifndef __MEDIAN_FILTER_H__
 #define __MEDIAN_FILTER_H__
@@ -142,4 +150,26 @@ namespace vw {
 
 }
 
+namespace asp {
+
+  /// Median filter of an 8-bit image with a window of size 2*half+1,
+  /// clipped at the image boundary. If the window has an even number of
+  /// values, the lower of the two middle ones is used. If the number of
+  /// threads is 0, the default number of threads is used. Use 1 when
+  /// called for a tile which is already processed in parallel.
+  vw::ImageView<vw::uint8> median_filter(vw::ImageView<vw::uint8> const& img, int half,
+                                         int num_threads = 0);
+
+  /// The median of the values in the window of size 2*half+1 around each
+  /// pixel, clipped at the image boundary, with NaN values skipped. If
+  /// there is an even number of values, the mean of the two middle ones
+  /// is used, as by vw::math::destructive_median(). The result is NaN if
+  /// the window has no valid values.
+  vw::ImageView<float>  median_filter(vw::ImageView<float>  const& img, int half,
+                                      int num_threads = 0);
+  vw::ImageView<double> median_filter(vw::ImageView<double> const& img, int half,
+                                      int num_threads = 0);
+
+} // end namespace asp
+
 #endif // __MEDIAN_FILTER_H__
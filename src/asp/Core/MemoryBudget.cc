@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file MemoryBudget.cc
+///
+
+#include <asp/Core/MemoryBudget.h>
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+namespace asp {
+
+namespace {
+
+  const std::int64_t BYTES_PER_MB = 1024 * 1024;
+
+  struct MemoryBudget {
+    std::atomic<std::int64_t> limit, used;
+    std::mutex mutex;           // guards the fields below
+    std::int64_t cache_size;    // the cache size set last
+    bool warned;
+    MemoryBudget(): limit(0), used(0), cache_size(-1), warned(false) {}
+  };
+
+  // Never destroyed, as gauges can change during static destruction
+  MemoryBudget & budget() {
+    static MemoryBudget * b = new MemoryBudget;
+    return *b;
+  }
+
+  // Resize the VW cache for the memory used now. To not resize it on
+  // each small change, which costs a lock in VW and can evict blocks,
+  // that is done only if the size changes by more than 1/16 of the limit.
+  void update_cache(bool force) {
+    MemoryBudget & b = budget();
+    std::int64_t limit = b.limit.load(std::memory_order_relaxed);
+    if (limit <= 0)
+      return;
+
+    std::int64_t used = b.used.load(std::memory_order_relaxed);
+    std::int64_t size = budget_cache_size(limit, used);
+
+    std::lock_guard<std::mutex> lock(b.mutex);
+    if (!force && b.cache_size >= 0 && std::abs(size - b.cache_size) <= limit / 16)
+      return;
+    b.cache_size = size;
+    vw::vw_settings().set_system_cache_size(size);
+
+    if (used + size > limit && !b.warned) {
+      b.warned = true;
+      vw::vw_out(vw::WarningMessage)
+        << "The memory in use, " << used / BYTES_PER_MB << " MB, together with "
+        << "the minimum cache size, exceeds --memory-limit-mb "
+        << limit / BYTES_PER_MB << ".\n";
+    }
+  }
+
+} // end anonymous namespace
+
+std::int64_t budget_cache_size(std::int64_t limit_bytes, std::int64_t used_bytes) {
+  return std::max(limit_bytes - std::max(used_bytes, std::int64_t(0)),
+                  MIN_BUDGET_CACHE_MB * BYTES_PER_MB);
+}
+
+void set_memory_limit_mb(double limit_mb) {
+  MemoryBudget & b = budget();
+  b.limit = std::int64_t(std::max(limit_mb, 0.0) * BYTES_PER_MB);
+  {
+    std::lock_guard<std::mutex> lock(b.mutex);
+    b.warned = false;
+  }
+  update_cache(true);
+}
+
+double memory_limit_mb() {
+  return double(budget().limit.load(std::memory_order_relaxed)) / BYTES_PER_MB;
+}
+
+void memory_budget_add(std::int64_t bytes) {
+  if (bytes == 0)
+    return;
+  budget().used.fetch_add(bytes, std::memory_order_relaxed);
+  update_cache(false);
+}
+
+std::int64_t memory_budget_used() {
+  return budget().used.load(std::memory_order_relaxed);
+}
+
+} // end namespace asp
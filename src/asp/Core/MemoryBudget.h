@@ -0,0 +1,59 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MemoryBudget.h
+///
+/// A memory budget for the whole process, shared between the VW block
+/// cache and the large structures of a tool. It is set with the option
+/// --memory-limit-mb, which all tools accept. The structures which
+/// report their size in telemetry gauges (asp/Core/Telemetry.h), such as
+/// the Point2Grid buffers, the dem_mosaic tile stack, the sfs images,
+/// and the Ceres Jacobian, are counted against it. The VW cache is then
+/// given what is left, but no less than a small floor. So the cache
+/// shrinks when the tool needs more memory and grows back when it is
+/// freed. Without a limit, the cache size is set by --cache-size-mb, as
+/// before.
+
+#ifndef __ASP_CORE_MEMORY_BUDGET_H__
+#define __ASP_CORE_MEMORY_BUDGET_H__
+
+#include <cstdint>
+
+namespace asp {
+
+  /// The VW cache is never made smaller than this, in MB
+  const std::int64_t MIN_BUDGET_CACHE_MB = 256;
+
+  /// Set the memory limit, in MB, and resize the VW cache to fit it.
+  /// A value of 0 turns the budget off and leaves the cache alone.
+  void set_memory_limit_mb(double limit_mb);
+  double memory_limit_mb();
+
+  /// Count memory in the budget, or give it back if negative. Done by
+  /// each TelemetryGauge, so large structures need not call it directly.
+  void memory_budget_add(std::int64_t bytes);
+
+  /// The memory counted in the budget now, in bytes
+  std::int64_t memory_budget_used();
+
+  /// The VW cache size for the given limit and memory used, in bytes
+  std::int64_t budget_cache_size(std::int64_t limit_bytes, std::int64_t used_bytes);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MEMORY_BUDGET_H__
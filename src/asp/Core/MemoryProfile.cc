@@ -0,0 +1,130 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MemoryProfile.cc
+///
+
+#include <asp/Core/MemoryProfile.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace asp {
+
+namespace {
+
+  struct MemoryProfile {
+    std::mutex mutex;
+    std::map<std::string, int> active_stages; // the number of runs of each
+    std::map<std::string, double> stage_peaks;
+    double peak;
+    std::atomic<bool> sampling;
+    MemoryProfile(): peak(0), sampling(false) {}
+  };
+
+  // Never destroyed, as the sampling thread runs until the process ends
+  MemoryProfile & profile() {
+    static MemoryProfile * p = new MemoryProfile;
+    return *p;
+  }
+
+  void record_sample(double rss_mb) {
+    MemoryProfile & p = profile();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.peak = std::max(p.peak, rss_mb);
+    for (auto const& s: p.active_stages) {
+      double & peak = p.stage_peaks[s.first];
+      peak = std::max(peak, rss_mb);
+    }
+  }
+
+  void sample_loop() {
+    while (true) {
+      record_sample(current_rss_mb());
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+
+} // end anonymous namespace
+
+bool memory_profile_enabled() {
+  const char * flag = getenv("ASP_MEMORY_PROFILE");
+  return flag != NULL && std::string(flag) == "1";
+}
+
+double current_rss_mb() {
+  // The second field is the number of resident pages
+  std::ifstream ifs("/proc/self/statm");
+  long long size = 0, resident = 0;
+  if (!(ifs >> size >> resident))
+    return 0.0;
+  return double(resident) * double(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+void start_memory_sampling() {
+  if (!memory_profile_enabled())
+    return;
+  bool expected = false;
+  if (!profile().sampling.compare_exchange_strong(expected, true))
+    return;
+  std::thread(sample_loop).detach();
+}
+
+void memory_stage_begin(std::string const& stage) {
+  if (!memory_profile_enabled())
+    return;
+  {
+    MemoryProfile & p = profile();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.active_stages[stage]++;
+  }
+  // Also sample now, so that a short stage gets a value
+  record_sample(current_rss_mb());
+}
+
+void memory_stage_end(std::string const& stage) {
+  if (!memory_profile_enabled())
+    return;
+  record_sample(current_rss_mb());
+  MemoryProfile & p = profile();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  auto it = p.active_stages.find(stage);
+  if (it != p.active_stages.end() && --it->second <= 0)
+    p.active_stages.erase(it);
+}
+
+std::map<std::string, double> stage_peak_rss_mb() {
+  MemoryProfile & p = profile();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return p.stage_peaks;
+}
+
+double sampled_peak_rss_mb() {
+  MemoryProfile & p = profile();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return p.peak;
+}
+
+} // end namespace asp
@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MemoryProfile.h
+///
+/// Opt-in profiling of the memory of a tool, to find which stage and
+/// which structure make it run out of memory. It is turned on by
+/// setting the environment variable ASP_MEMORY_PROFILE to 1. Then a
+/// thread samples the resident memory (RSS) of the process every 50 ms,
+/// and each stage timed with TelemetryTimer (asp/Core/Telemetry.h) is
+/// given the peak RSS seen while it ran. Stages can run in parallel, and
+/// then a sample counts for all of them.
+///
+/// The large structures, such as the Point2Grid buffers, the values
+/// kept by dem_mosaic for the median, and the Ceres problem, report their
+/// size in telemetry gauges. These are always kept, as they are cheap.
+///
+/// At exit, a report is written next to the telemetry summary, with
+/// "-memory-" in place of "-telemetry-" in the file name, and the
+/// extension .txt.
+
+#ifndef __ASP_CORE_MEMORY_PROFILE_H__
+#define __ASP_CORE_MEMORY_PROFILE_H__
+
+#include <map>
+#include <string>
+
+namespace asp {
+
+  /// If ASP_MEMORY_PROFILE is set to 1
+  bool memory_profile_enabled();
+
+  /// The resident memory of the process now, in MB, or 0 if not known
+  double current_rss_mb();
+
+  /// Start the sampling thread, if profiling is enabled and it is not
+  /// running yet
+  void start_memory_sampling();
+
+  /// Mark the start and end of a run of a stage. Done by TelemetryTimer.
+  void memory_stage_begin(std::string const& stage);
+  void memory_stage_end(std::string const& stage);
+
+  /// The peak RSS in MB seen in the samples during each stage, and over
+  /// the whole run
+  std::map<std::string, double> stage_peak_rss_mb();
+  double sampled_peak_rss_mb();
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MEMORY_PROFILE_H__
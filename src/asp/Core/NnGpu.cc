@@ -0,0 +1,144 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file NnGpu.cc
+///
+
+#include <asp/Core/Common.h> // for ASP_HAVE_PKG_CUDA
+#include <asp/Core/NnGpu.h>
+#include <asp/Core/NnGpuKernels.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace asp {
+
+#if defined(ASP_HAVE_PKG_CUDA) && ASP_HAVE_PKG_CUDA == 1
+
+bool nn_gpu_available(std::string & reason) {
+  return asp::cuda::nn_gpu_device_available(reason);
+}
+
+#else // Not built with CUDA
+
+bool nn_gpu_available(std::string & reason) {
+  reason = "ASP was not built with CUDA support. Reconfigure with -DASP_ENABLE_CUDA=ON.";
+  return false;
+}
+
+namespace cuda {
+  bool nn_gpu_device_available(std::string & reason) {
+    return asp::nn_gpu_available(reason);
+  }
+  NnGpuSearch * nn_gpu_new_search(std::string & error) {
+    nn_gpu_device_available(error);
+    return NULL;
+  }
+}
+
+#endif
+
+namespace {
+  // Copy the first three rows of a matrix to a float buffer, a point at a time
+  void to_float_xyz(Eigen::MatrixXd const& points, std::vector<float> & xyz) {
+    xyz.resize(3 * points.cols());
+    for (Eigen::Index col = 0; col < points.cols(); col++) {
+      for (int row = 0; row < 3; row++)
+        xyz[3 * col + row] = points(row, col);
+    }
+  }
+}
+
+GpuNearestNeighbors::GpuNearestNeighbors() {}
+
+bool GpuNearestNeighbors::set_reference(Eigen::MatrixXd const& points, std::string & error) {
+  if (points.rows() < 3) {
+    error = "Expecting at least three rows for the reference points.";
+    return false;
+  }
+
+  if (!m_search) {
+    m_search.reset(cuda::nn_gpu_new_search(error));
+    if (!m_search)
+      return false;
+  }
+
+  std::vector<float> xyz;
+  to_float_xyz(points, xyz);
+  if (!m_search->set_reference(xyz.empty() ? NULL : &xyz[0], points.cols(), error))
+    return false;
+
+  m_ref = points.topRows(3);
+  return true;
+}
+
+bool GpuNearestNeighbors::find(Eigen::MatrixXd const& points, int knn, double max_dist,
+                               Eigen::MatrixXd & dists2, Eigen::MatrixXi & ids,
+                               std::string & error) const {
+  if (!m_search) {
+    error = "The reference points were not set.";
+    return false;
+  }
+  if (points.rows() < 3) {
+    error = "Expecting at least three rows for the query points.";
+    return false;
+  }
+
+  // Pad the float search radius a little, so that no point within
+  // max_dist is lost to rounding. The radius is enforced exactly below.
+  const double inf = std::numeric_limits<double>::infinity();
+  double max_dist2 = max_dist * max_dist;
+  float search_dist2 = std::isfinite(max_dist2) ?
+    float(max_dist2 * (1.0 + 1.0e-5) + 1.0e-6) : std::numeric_limits<float>::infinity();
+
+  std::vector<float> xyz;
+  to_float_xyz(points, xyz);
+  std::vector<float> out_dists2(std::size_t(knn) * points.cols());
+  std::vector<int> out_ids(out_dists2.size());
+  if (!m_search->find(xyz.empty() ? NULL : &xyz[0], points.cols(), knn, search_dist2,
+                      out_dists2.empty() ? NULL : &out_dists2[0],
+                      out_ids.empty()    ? NULL : &out_ids[0], error))
+    return false;
+
+  // Recompute the distances in double precision. The matrices are column
+  // major, so each column has the neighbors of a query point, as returned.
+  dists2.resize(knn, points.cols());
+  ids.resize(knn, points.cols());
+  for (Eigen::Index col = 0; col < points.cols(); col++) {
+    int num_found = 0;
+    for (int k = 0; k < knn; k++) {
+      int id = out_ids[knn * col + k];
+      if (id < 0)
+        continue;
+      double d2 = (m_ref.col(id) - points.col(col).head<3>()).squaredNorm();
+      if (d2 > max_dist2)
+        continue;
+      dists2(num_found, col) = d2;
+      ids(num_found, col)    = id;
+      num_found++;
+    }
+    for (int k = num_found; k < knn; k++) {
+      dists2(k, col) = inf;
+      ids(k, col)    = -1;
+    }
+  }
+
+  return true;
+}
+
+} // end namespace asp
@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file NnGpu.h
+///
+/// Nearest-neighbor search on the GPU, used by pc_align --nn-backend gpu
+/// for the matching step of ICP. The search is brute force, with the
+/// reference points kept on the device. The CUDA kernels are compiled only
+/// if ASP was configured with -DASP_ENABLE_CUDA=ON. Otherwise these
+/// functions report that no GPU is available.
+
+#ifndef __ASP_CORE_NN_GPU_H__
+#define __ASP_CORE_NN_GPU_H__
+
+#include <Eigen/Dense>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace asp {
+
+  namespace cuda {
+    class NnGpuSearch;
+  }
+
+  /// Return true if ASP was built with CUDA and a device was found.
+  /// Otherwise populate the reason.
+  bool nn_gpu_available(std::string & reason);
+
+  /// Find the k nearest reference points to each query point on the GPU.
+  /// Points are the columns of a matrix, with the first three rows being
+  /// the coordinates, as for libpointmatcher clouds. The candidates are
+  /// found in single precision, so the points should be centered near the
+  /// origin, and their distances are then recomputed in double precision.
+  class GpuNearestNeighbors {
+  public:
+    GpuNearestNeighbors();
+
+    /// Copy the reference points to the device. Returns false and sets
+    /// the error message on failure.
+    bool set_reference(Eigen::MatrixXd const& points, std::string & error);
+
+    /// For each query point find the knn closest reference points no
+    /// farther than max_dist, in increasing order of distance. The outputs
+    /// have knn rows and a column per query point, and contain the squared
+    /// distances and the reference point indices. Where fewer neighbors
+    /// are found, the squared distance is infinity and the index is -1.
+    bool find(Eigen::MatrixXd const& points, int knn, double max_dist,
+              Eigen::MatrixXd & dists2, Eigen::MatrixXi & ids, std::string & error) const;
+
+  private:
+    boost::shared_ptr<cuda::NnGpuSearch> m_search;
+    Eigen::MatrixXd m_ref;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_NN_GPU_H__
@@ -0,0 +1,214 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file NnGpuKernels.cu
+///
+/// CUDA implementation of brute-force k nearest neighbor search. Each
+/// thread handles a query point. The threads in a block load the
+/// reference points one tile at a time into shared memory, and each
+/// compares its query point with all points in the tile, keeping the knn
+/// best candidates in registers. The queries are processed in batches to
+/// keep each kernel launch short.
+
+#include <asp/Core/NnGpuKernels.h>
+
+#include <cuda_runtime.h>
+#include <math_constants.h>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace asp {
+namespace cuda {
+
+namespace {
+
+  const int NN_THREADS = 256;
+
+  // Number of query points per kernel launch
+  const std::int64_t NN_BATCH = 32768;
+
+  // Convenience macro to bail out on a CUDA error
+#define ASP_CUDA_CHECK(call)                                               \
+  do {                                                                     \
+    cudaError_t status = (call);                                           \
+    if (status != cudaSuccess) {                                           \
+      std::ostringstream os;                                               \
+      os << "CUDA error in " << #call << ": " << cudaGetErrorString(status); \
+      error = os.str();                                                    \
+      return false;                                                        \
+    }                                                                      \
+  } while (0)
+
+  // A RAII holder for device memory, which can be resized
+  template <class T>
+  struct DeviceBuffer {
+    T * ptr;
+    std::size_t count;
+    DeviceBuffer(): ptr(NULL), count(0) {}
+    ~DeviceBuffer() { if (ptr != NULL) cudaFree(ptr); }
+    cudaError_t alloc(std::size_t n) {
+      if (n == count && ptr != NULL)
+        return cudaSuccess;
+      if (ptr != NULL)
+        cudaFree(ptr);
+      ptr = NULL;
+      count = n;
+      return cudaMalloc((void**)&ptr, std::max(n, std::size_t(1)) * sizeof(T));
+    }
+    cudaError_t upload(T const* host, std::size_t n) {
+      cudaError_t status = alloc(n);
+      if (status != cudaSuccess)
+        return status;
+      return cudaMemcpy(ptr, host, n * sizeof(T), cudaMemcpyHostToDevice);
+    }
+  private:
+    DeviceBuffer(DeviceBuffer const&);
+    DeviceBuffer& operator=(DeviceBuffer const&);
+  };
+
+  __global__ void knn_kernel(float const* ref, int num_ref,
+                             float const* query, int num_query,
+                             int knn, float max_dist2,
+                             float * dists2, int * ids) {
+    __shared__ float tile[3 * NN_THREADS];
+
+    int q = blockIdx.x * blockDim.x + threadIdx.x;
+    bool active = (q < num_query);
+    float qx = 0.0f, qy = 0.0f, qz = 0.0f;
+    if (active) {
+      qx = query[3 * q + 0];
+      qy = query[3 * q + 1];
+      qz = query[3 * q + 2];
+    }
+
+    float best_d2[NN_GPU_MAX_KNN];
+    int   best_ids[NN_GPU_MAX_KNN];
+    for (int k = 0; k < knn; k++) {
+      best_d2[k]  = max_dist2;
+      best_ids[k] = -1;
+    }
+
+    for (int start = 0; start < num_ref; start += NN_THREADS) {
+      // All threads help load the tile, including those with no query point
+      int r = start + threadIdx.x;
+      if (r < num_ref) {
+        tile[3 * threadIdx.x + 0] = ref[3 * r + 0];
+        tile[3 * threadIdx.x + 1] = ref[3 * r + 1];
+        tile[3 * threadIdx.x + 2] = ref[3 * r + 2];
+      }
+      __syncthreads();
+
+      int len = min(NN_THREADS, num_ref - start);
+      if (active) {
+        for (int j = 0; j < len; j++) {
+          float dx = tile[3 * j + 0] - qx;
+          float dy = tile[3 * j + 1] - qy;
+          float dz = tile[3 * j + 2] - qz;
+          nn_gpu_insert(dx * dx + dy * dy + dz * dz, start + j, knn, best_d2, best_ids);
+        }
+      }
+      __syncthreads();
+    }
+
+    if (!active)
+      return;
+    for (int k = 0; k < knn; k++) {
+      bool found = (best_ids[k] >= 0);
+      dists2[std::size_t(q) * knn + k] = found ? best_d2[k] : CUDART_INF_F;
+      ids   [std::size_t(q) * knn + k] = best_ids[k];
+    }
+  }
+
+  class NnCudaSearch: public NnGpuSearch {
+  public:
+    NnCudaSearch(): m_num_ref(0) {}
+
+    virtual bool set_reference(float const* xyz, std::int64_t num_points,
+                               std::string & error) {
+      if (num_points > std::numeric_limits<int>::max()) {
+        error = "Too many reference points for the GPU nearest-neighbor search.";
+        return false;
+      }
+      m_num_ref = num_points;
+      ASP_CUDA_CHECK(m_ref.upload(xyz, 3 * num_points));
+      return true;
+    }
+
+    virtual bool find(float const* xyz, std::int64_t num_points, int knn, float max_dist2,
+                      float * dists2, int * ids, std::string & error) {
+      if (knn < 1 || knn > NN_GPU_MAX_KNN) {
+        std::ostringstream os;
+        os << "The GPU nearest-neighbor search supports between 1 and "
+           << NN_GPU_MAX_KNN << " neighbors, but " << knn << " were requested.";
+        error = os.str();
+        return false;
+      }
+
+      std::int64_t batch = std::min(NN_BATCH, std::max(num_points, std::int64_t(1)));
+      ASP_CUDA_CHECK(m_query.alloc(3 * batch));
+      ASP_CUDA_CHECK(m_dists2.alloc(knn * batch));
+      ASP_CUDA_CHECK(m_ids.alloc(knn * batch));
+
+      for (std::int64_t start = 0; start < num_points; start += batch) {
+        int len = int(std::min(batch, num_points - start));
+        ASP_CUDA_CHECK(cudaMemcpy(m_query.ptr, xyz + 3 * start, 3 * len * sizeof(float),
+                                  cudaMemcpyHostToDevice));
+        int num_blocks = (len + NN_THREADS - 1) / NN_THREADS;
+        knn_kernel<<<num_blocks, NN_THREADS>>>(m_ref.ptr, int(m_num_ref), m_query.ptr, len,
+                                               knn, max_dist2, m_dists2.ptr, m_ids.ptr);
+        ASP_CUDA_CHECK(cudaGetLastError());
+        ASP_CUDA_CHECK(cudaMemcpy(dists2 + knn * start, m_dists2.ptr,
+                                  std::size_t(knn) * len * sizeof(float),
+                                  cudaMemcpyDeviceToHost));
+        ASP_CUDA_CHECK(cudaMemcpy(ids + knn * start, m_ids.ptr,
+                                  std::size_t(knn) * len * sizeof(int),
+                                  cudaMemcpyDeviceToHost));
+      }
+
+      return true;
+    }
+
+  private:
+    std::int64_t        m_num_ref;
+    DeviceBuffer<float> m_ref, m_query, m_dists2;
+    DeviceBuffer<int>   m_ids;
+  };
+
+} // end anonymous namespace
+
+bool nn_gpu_device_available(std::string & reason) {
+  int count = 0;
+  cudaError_t status = cudaGetDeviceCount(&count);
+  if (status != cudaSuccess || count <= 0) {
+    reason = (status != cudaSuccess) ? cudaGetErrorString(status) : "No CUDA device found.";
+    return false;
+  }
+  return true;
+}
+
+NnGpuSearch * nn_gpu_new_search(std::string & error) {
+  if (!nn_gpu_device_available(error))
+    return NULL;
+  return new NnCudaSearch();
+}
+
+} // end namespace cuda
+} // end namespace asp
@@ -0,0 +1,89 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file NnGpuKernels.h
+///
+/// Plain interface to the CUDA nearest-neighbor search used by pc_align
+/// --nn-backend gpu. This header must not depend on VW, Boost, or Eigen, as
+/// it is included by nvcc. The host-facing API is in NnGpu.h.
+
+#ifndef __ASP_CORE_NN_GPU_KERNELS_H__
+#define __ASP_CORE_NN_GPU_KERNELS_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#if defined(__CUDACC__)
+#define NN_GPU_HD __host__ __device__
+#else
+#define NN_GPU_HD
+#endif
+
+namespace asp {
+namespace cuda {
+
+  // Largest number of neighbors per query point. The list of best
+  // candidates is kept in registers.
+  const int NN_GPU_MAX_KNN = 16;
+
+  /// Brute-force k nearest neighbor search. The reference points stay on
+  /// the device between queries. Points are given as x, y, z triplets.
+  class NnGpuSearch {
+  public:
+    virtual ~NnGpuSearch() {}
+
+    /// Copy the reference points to the device
+    virtual bool set_reference(float const* xyz, std::int64_t num_points,
+                               std::string & error) = 0;
+
+    /// For each query point find the knn closest reference points within
+    /// max_dist2 squared distance, in increasing order of distance. The
+    /// outputs have knn values per query point. Where fewer than knn
+    /// neighbors are found, the squared distance is infinity and the
+    /// index is -1.
+    virtual bool find(float const* xyz, std::int64_t num_points, int knn, float max_dist2,
+                      float * dists2, int * ids, std::string & error) = 0;
+  };
+
+  /// Returns true if a CUDA device is present. Otherwise populates the reason.
+  bool nn_gpu_device_available(std::string & reason);
+
+  /// Create a search object running on the device. Returns NULL and sets
+  /// the error message on failure.
+  NnGpuSearch * nn_gpu_new_search(std::string & error);
+
+  /// Insert a candidate into a list of knn best squared distances and
+  /// indices sorted in increasing order, if it is closer than the last one.
+  NN_GPU_HD inline void nn_gpu_insert(float d2, int id, int knn, float * best_d2, int * best_ids) {
+    if (!(d2 < best_d2[knn - 1]))
+      return;
+    int k = knn - 1;
+    while (k > 0 && best_d2[k - 1] > d2) {
+      best_d2[k]  = best_d2[k - 1];
+      best_ids[k] = best_ids[k - 1];
+      k--;
+    }
+    best_d2[k]  = d2;
+    best_ids[k] = id;
+  }
+
+} // end namespace cuda
+} // end namespace asp
+
+#endif // __ASP_CORE_NN_GPU_KERNELS_H__
@@ -19,12 +19,224 @@
 #include <vw/Core/Exception.h>
 #include <vw/Core/Log.h>
 #include <vw/FileIO/FileUtils.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
+namespace fs = boost::filesystem;
+
 namespace asp {
 
+namespace {
+
+  // Parse whitespace-separated values from a memory-mapped NVM file.
+  // This avoids the overhead of stream operators, which dominates
+  // reading files with millions of measurements.
+  class NvmParser {
+  public:
+    explicit NvmParser(std::string const& file): m_file(file) {
+      if (!fs::exists(file) || fs::file_size(file) == 0)
+        vw::vw_throw(vw::ArgumentErr() << "Cannot read the NVM file: " << file << "\n");
+      m_mapped.open(file);
+      if (!m_mapped.is_open())
+        vw::vw_throw(vw::ArgumentErr() << "Cannot read the NVM file: " << file << "\n");
+      m_ptr = m_mapped.data();
+      m_end = m_ptr + m_mapped.size();
+    }
+
+    // The rest of the current line
+    std::string line() {
+      const char * beg = m_ptr;
+      while (m_ptr < m_end && *m_ptr != '\n')
+        m_ptr++;
+      std::string ans(beg, m_ptr);
+      if (m_ptr < m_end)
+        m_ptr++;
+      return ans;
+    }
+
+    std::string token() {
+      const char * beg;
+      std::size_t len;
+      next(beg, len);
+      return std::string(beg, len);
+    }
+
+    std::int64_t read_int() {
+      const char * beg;
+      std::size_t len;
+      next(beg, len);
+      std::size_t pos = 0;
+      bool neg = (beg[0] == '-');
+      if (beg[0] == '-' || beg[0] == '+')
+        pos++;
+      if (pos == len)
+        bad_value(beg, len);
+      std::int64_t val = 0;
+      for (; pos < len; pos++) {
+        if (beg[pos] < '0' || beg[pos] > '9')
+          bad_value(beg, len);
+        val = 10 * val + (beg[pos] - '0');
+      }
+      return neg ? -val : val;
+    }
+
+    double read_double() {
+      const char * beg;
+      std::size_t len;
+      next(beg, len);
+      // strtod() needs a null-terminated string, and the mapped file is not
+      char buf[64];
+      if (len >= sizeof(buf))
+        bad_value(beg, len);
+      std::memcpy(buf, beg, len);
+      buf[len] = '\0';
+      char * stop = NULL;
+      double val = std::strtod(buf, &stop);
+      if (stop != buf + len)
+        bad_value(beg, len);
+      return val;
+    }
+
+  private:
+    void next(const char *& beg, std::size_t & len) {
+      while (m_ptr < m_end && std::isspace((unsigned char)*m_ptr))
+        m_ptr++;
+      if (m_ptr == m_end)
+        vw::vw_throw(vw::ArgumentErr() << "Unexpected end of NVM file: " << m_file << "\n");
+      beg = m_ptr;
+      while (m_ptr < m_end && !std::isspace((unsigned char)*m_ptr))
+        m_ptr++;
+      len = m_ptr - beg;
+    }
+
+    void bad_value(const char * beg, std::size_t len) {
+      vw::vw_throw(vw::ArgumentErr() << "Invalid value: '" << std::string(beg, len)
+                   << "' in NVM file: " << m_file << "\n");
+    }
+
+    std::string m_file;
+    boost::iostreams::mapped_file_source m_mapped;
+    const char * m_ptr;
+    const char * m_end;
+  };
+
+  // Read the header and the cameras. Return the number of points, with
+  // the parser positioned at the first point.
+  std::int64_t read_nvm_cameras(NvmParser & parser,
+                                std::vector<std::string> & cid_to_filename,
+                                std::vector<Eigen::Affine3d> & cid_to_cam_t_global) {
+
+    // Assert that we start with our NVM token
+    std::string token = parser.line();
+    if (token.compare(0, 6, "NVM_V3") != 0)
+      vw::vw_throw(vw::ArgumentErr() << "File doesn't start with NVM token.");
+
+    // Read the number of cameras
+    std::int64_t number_of_cid = parser.read_int();
+    if (number_of_cid < 1)
+      vw::vw_throw(vw::ArgumentErr() << "NVM file is missing cameras.");
+
+    cid_to_filename.resize(number_of_cid);
+    cid_to_cam_t_global.resize(number_of_cid);
+    for (std::int64_t cid = 0; cid < number_of_cid; cid++) {
+      // Read the line that contains camera information. The focal length
+      // and distortion are not used.
+      cid_to_filename[cid] = parser.token();
+      parser.read_double(); // focal length
+      Eigen::Quaterniond q;
+      q.w() = parser.read_double();
+      q.x() = parser.read_double();
+      q.y() = parser.read_double();
+      q.z() = parser.read_double();
+      Eigen::Vector3d c;
+      for (int it = 0; it < 3; it++)
+        c[it] = parser.read_double();
+      parser.read_double(); // distortion
+      parser.read_double(); // always zero
+
+      // Solve for t, which is part of the affine transform
+      Eigen::Matrix3d r = q.matrix();
+      cid_to_cam_t_global[cid].linear() = r;
+      cid_to_cam_t_global[cid].translation() = -r * c;
+    }
+
+    // Read the number of points
+    std::int64_t number_of_pid = parser.read_int();
+    if (number_of_pid < 1)
+      vw::vw_throw(vw::ArgumentErr() << "The NVM file has no triangulated points.");
+
+    return number_of_pid;
+  }
+
+  // If a filename having extension _offsets.txt instead of .nvm exists,
+  // read from it the optical center offsets, for each camera. Return
+  // false if there is no such file.
+  bool read_nvm_offsets(std::string const& input_filename,
+                        std::vector<std::string> const& cid_to_filename,
+                        std::vector<Eigen::Vector2d> & cid_to_offset,
+                        std::vector<bool> & cid_has_offset) {
+
+    int file_len = input_filename.size(); // cast to int to make subtraction safe
+    std::string offset_path = input_filename.substr(0, std::max(file_len - 4, 0))
+      + "_offsets.txt";
+    std::ifstream offset_fh(offset_path.c_str());
+    if (!offset_fh.good())
+      return false;
+
+    std::cout << "Read and apply optical offsets from: " << offset_path << std::endl;
+    std::map<std::string, Eigen::Vector2d> offsets;
+    std::string name;
+    double x, y;
+    while (offset_fh >> name >> x >> y)
+      offsets[name] = Eigen::Vector2d(x, y);
+
+    // Look up the offsets once per camera rather than per measurement
+    cid_to_offset.assign(cid_to_filename.size(), Eigen::Vector2d(0, 0));
+    cid_has_offset.assign(cid_to_filename.size(), false);
+    for (size_t cid = 0; cid < cid_to_filename.size(); cid++) {
+      auto map_it = offsets.find(cid_to_filename[cid]);
+      if (map_it != offsets.end()) {
+        cid_to_offset[cid] = map_it->second;
+        cid_has_offset[cid] = true;
+      }
+    }
+    return true;
+  }
+
+  // Read a measurement of a point. Validate it and apply the offset.
+  void read_nvm_measure(NvmParser & parser, std::int64_t pid, std::int64_t num_cid,
+                        bool have_offsets,
+                        std::vector<std::string> const& cid_to_filename,
+                        std::vector<Eigen::Vector2d> const& cid_to_offset,
+                        std::vector<bool> const& cid_has_offset,
+                        std::int64_t & cid, std::int64_t & fid, Eigen::Vector2d & pt) {
+    cid = parser.read_int();
+    fid = parser.read_int();
+    pt[0] = parser.read_double();
+    pt[1] = parser.read_double();
+
+    if (cid < 0 || cid >= num_cid || fid < 0)
+      vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+
+    if (have_offsets) {
+      if (!cid_has_offset[cid])
+        vw::vw_throw(vw::ArgumentErr() << "Cannot find optical offset for image "
+                     << cid_to_filename[cid] << "\n");
+      pt += cid_to_offset[cid];
+    }
+  }
+
+} // end anonymous namespace
+
 // A wrapper to carry fewer things around
 void ReadNVM(std::string const& input_filename, nvmData & nvm) {
   ReadNVM(input_filename,
@@ -46,103 +258,101 @@ void ReadNVM(std::string const& input_filename,
              std::vector<Eigen::Vector3d> * pid_to_xyz,
              std::vector<Eigen::Affine3d> * cid_to_cam_t_global) {
 
-  int file_len = input_filename.size(); // cast to int to make subtraction safe
-  std::string offset_path = input_filename.substr(0, std::max(file_len - 4, 0)) + "_offsets.txt";
-  std::ifstream offset_fh(offset_path.c_str());
-  std::map<std::string, Eigen::Vector2d> offsets;
-  bool have_offsets = false;
-  if (offset_fh.good()) {
-    std::cout << "Read and apply optical offsets from: " << offset_path << std::endl;
-    std::string name;
-    double x, y;
-    while (offset_fh >> name >> x >> y) {
-      offsets[name] = Eigen::Vector2d(x, y);
-    }
-    have_offsets = true;
-  }
-  
-  std::ifstream f(input_filename, std::ios::in);
-  std::string token;
-  std::getline(f, token);
-  
-  // Assert that we start with our NVM token
-  if (token.compare(0, 6, "NVM_V3") != 0) {
-    vw::vw_throw(vw::ArgumentErr() << "File doesn't start with NVM token.");
-  }
-
-  // Read the number of cameras
-  ptrdiff_t number_of_cid;
-  f >> number_of_cid;
-  if (number_of_cid < 1) {
-    vw::vw_throw(vw::ArgumentErr() << "NVM file is missing cameras.");
-  }
+  NvmParser parser(input_filename);
+  std::int64_t number_of_pid = read_nvm_cameras(parser, *cid_to_filename,
+                                                *cid_to_cam_t_global);
+  std::int64_t number_of_cid = cid_to_filename->size();
 
-  // Resize all our structures to support the number of cameras we now expect
-  cid_to_keypoint_map->resize(number_of_cid);
-  cid_to_filename->resize(number_of_cid);
-  cid_to_cam_t_global->resize(number_of_cid);
-  for (ptrdiff_t cid = 0; cid < number_of_cid; cid++) {
-    // Clear keypoints from map. We'll read these in shortly
-    cid_to_keypoint_map->at(cid).resize(Eigen::NoChange_t(), 2);
-
-    // Read the line that contains camera information
-    double focal, dist1, dist2;
-    Eigen::Quaterniond q;
-    Eigen::Vector3d c;
-    f >> token >> focal;
-    f >> q.w() >> q.x() >> q.y() >> q.z();
-    f >> c[0] >> c[1] >> c[2] >> dist1 >> dist2;
-    cid_to_filename->at(cid) = token;
-
-    // Solve for t, which is part of the affine transform
-    Eigen::Matrix3d r = q.matrix();
-    cid_to_cam_t_global->at(cid).linear() = r;
-    cid_to_cam_t_global->at(cid).translation() = -r * c;
-  }
+  std::vector<Eigen::Vector2d> cid_to_offset;
+  std::vector<bool> cid_has_offset;
+  bool have_offsets = read_nvm_offsets(input_filename, *cid_to_filename,
+                                       cid_to_offset, cid_has_offset);
 
-  // Read the number of points
-  ptrdiff_t number_of_pid;
-  f >> number_of_pid;
-  if (number_of_pid < 1)
-    vw::vw_throw(vw::ArgumentErr() << "The NVM file has no triangulated points.");
+  // The keypoints of each camera, as x and y interleaved. These grow by
+  // amortized doubling, rather than by a resize of a matrix for each
+  // new keypoint.
+  std::vector<std::vector<double>> keypoints(number_of_cid);
 
-  // Read the point
+  pid_to_cid_fid->clear();
   pid_to_cid_fid->resize(number_of_pid);
   pid_to_xyz->resize(number_of_pid);
-  Eigen::Vector3d xyz;
-  Eigen::Vector3i color;
   Eigen::Vector2d pt;
-  ptrdiff_t cid, fid;
-  for (ptrdiff_t pid = 0; pid < number_of_pid; pid++) {
-    pid_to_cid_fid->at(pid).clear();
-
-    ptrdiff_t number_of_measures;
-    f >> xyz[0] >> xyz[1] >> xyz[2] >>
-      color[0] >> color[1] >> color[2] >> number_of_measures;
-    pid_to_xyz->at(pid) = xyz;
-    for (ptrdiff_t m = 0; m < number_of_measures; m++) {
-      f >> cid >> fid >> pt[0] >> pt[1];
-
-      if (have_offsets) {
-        auto map_it = offsets.find(cid_to_filename->at(cid));
-        if (map_it == offsets.end()) {
-          vw::vw_throw(vw::ArgumentErr() << "Cannot find optical offset for image "
-                       << cid_to_filename->at(cid) << "\n");
-        }
-        pt[0] += (map_it->second)[0];
-        pt[1] += (map_it->second)[1];
-      }
-      
-      pid_to_cid_fid->at(pid)[cid] = fid;
+  std::int64_t cid, fid;
+  for (std::int64_t pid = 0; pid < number_of_pid; pid++) {
 
-      if (cid_to_keypoint_map->at(cid).cols() <= fid) {
-        cid_to_keypoint_map->at(cid).conservativeResize(Eigen::NoChange_t(), fid + 1);
-      }
-      cid_to_keypoint_map->at(cid).col(fid) = pt;
+    Eigen::Vector3d & xyz = (*pid_to_xyz)[pid];
+    for (int it = 0; it < 3; it++)
+      xyz[it] = parser.read_double();
+    for (int it = 0; it < 3; it++)
+      parser.read_int(); // color, not used
+    std::int64_t number_of_measures = parser.read_int();
+    if (number_of_measures < 0)
+      vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+
+    std::map<int, int> & cid_fid = (*pid_to_cid_fid)[pid];
+    for (std::int64_t m = 0; m < number_of_measures; m++) {
+      read_nvm_measure(parser, pid, number_of_cid, have_offsets, *cid_to_filename,
+                       cid_to_offset, cid_has_offset, cid, fid, pt);
+      cid_fid[cid] = fid;
+      std::vector<double> & kp = keypoints[cid];
+      if (kp.size() < 2 * size_t(fid + 1))
+        kp.resize(2 * size_t(fid + 1), 0.0);
+      kp[2*fid] = pt[0];
+      kp[2*fid + 1] = pt[1];
     }
+  }
+
+  cid_to_keypoint_map->resize(number_of_cid);
+  for (std::int64_t cid = 0; cid < number_of_cid; cid++) {
+    (*cid_to_keypoint_map)[cid]
+      = Eigen::Map<const Eigen::Matrix2Xd>(keypoints[cid].data(), 2,
+                                           keypoints[cid].size() / 2);
+    std::vector<double>().swap(keypoints[cid]); // free the memory as we go
+  }
+}
+
+// Read an NVM file directly into a control network, with no keypoint
+// maps for each camera. Each point becomes a tie point, with a measure
+// of unit sigma in each of its cameras.
+void ReadNVM(std::string const& input_filename,
+             std::vector<std::string> * cid_to_filename,
+             std::vector<Eigen::Affine3d> * cid_to_cam_t_global,
+             vw::ba::ControlNetwork * cnet) {
+
+  NvmParser parser(input_filename);
+  std::int64_t number_of_pid = read_nvm_cameras(parser, *cid_to_filename,
+                                                *cid_to_cam_t_global);
+  std::int64_t number_of_cid = cid_to_filename->size();
+
+  std::vector<Eigen::Vector2d> cid_to_offset;
+  std::vector<bool> cid_has_offset;
+  bool have_offsets = read_nvm_offsets(input_filename, *cid_to_filename,
+                                       cid_to_offset, cid_has_offset);
 
-    if (!f.good())
+  *cnet = vw::ba::ControlNetwork("nvm");
+  cnet->get_image_list() = *cid_to_filename;
+
+  Eigen::Vector2d pt;
+  std::int64_t cid, fid;
+  for (std::int64_t pid = 0; pid < number_of_pid; pid++) {
+
+    vw::Vector3 xyz;
+    for (int it = 0; it < 3; it++)
+      xyz[it] = parser.read_double();
+    for (int it = 0; it < 3; it++)
+      parser.read_int(); // color, not used
+    std::int64_t number_of_measures = parser.read_int();
+    if (number_of_measures < 0)
       vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+
+    vw::ba::ControlPoint cp(vw::ba::ControlPoint::TiePoint);
+    cp.set_position(xyz);
+    for (std::int64_t m = 0; m < number_of_measures; m++) {
+      read_nvm_measure(parser, pid, number_of_cid, have_offsets, *cid_to_filename,
+                       cid_to_offset, cid_has_offset, cid, fid, pt);
+      cp.add_measure(vw::ba::ControlMeasure(pt[0], pt[1], 1.0, 1.0, cid));
+    }
+    cnet->add_control_point(cp);
   }
 }
 
@@ -161,19 +371,43 @@ void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
 
   vw::vw_out() << "Writing: " << output_filename << std::endl;
   
-  std::fstream f(output_filename, std::ios::out);
-  f.precision(17); // double precision
-  f << "NVM_V3\n";
-
   if (cid_to_filename.size() != cid_to_keypoint_map.size())
     vw::vw_throw(vw::ArgumentErr() << "Unequal number of filenames and keypoints.");
   if (pid_to_cid_fid.size() != pid_to_xyz.size())
     vw::vw_throw(vw::ArgumentErr() << "Unequal number of pid_to_cid_fid and xyz measurements.");
   if (cid_to_filename.size() != cid_to_cam_t_global.size())
     vw::vw_throw(vw::ArgumentErr() << "Unequal number of filename and camera transforms.");
-  
+
+  std::ofstream f(output_filename.c_str(), std::ios::out | std::ios::binary);
+  if (!f)
+    vw::vw_throw(vw::IOErr() << "Cannot write: " << output_filename << "\n");
+
+  // Format the text into a buffer and write it in large chunks. Values
+  // are written with 17 digits, so they are read back exactly.
+  const std::size_t CHUNK_SIZE = 1 << 20;
+  std::string buf;
+  buf.reserve(CHUNK_SIZE + 1024);
+  char num[64];
+  auto add_double = [&](double val) {
+    int len = std::snprintf(num, sizeof(num), "%.17g", val);
+    buf.append(num, len);
+  };
+  auto add_int = [&](long long val) {
+    int len = std::snprintf(num, sizeof(num), "%lld", val);
+    buf.append(num, len);
+  };
+  auto flush_buf = [&](bool force) {
+    if (force || buf.size() >= CHUNK_SIZE) {
+      f.write(buf.data(), buf.size());
+      buf.clear();
+    }
+  };
+
+  buf += "NVM_V3\n";
+
   // Write camera information
-  f << cid_to_filename.size() << std::endl;
+  add_int(cid_to_filename.size());
+  buf += "\n";
   for (size_t cid = 0; cid < cid_to_filename.size(); cid++) {
 
     // World-to-camera rotation quaternion
@@ -184,35 +418,51 @@ void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
     Eigen::Vector3d camera_center =
       - cid_to_cam_t_global[cid].rotation().inverse() * t;
 
-    f << cid_to_filename[cid] << " " << focal_lengths[cid]
-      << " " << q.w() << " " << q.x() << " " << q.y() << " " << q.z() << " "
-      << camera_center[0] << " " << camera_center[1] << " "
-      << camera_center[2] << " " << "0 0\n"; // zero distortion, not used
+    buf += cid_to_filename[cid];
+    for (double val: {focal_lengths[cid], q.w(), q.x(), q.y(), q.z(),
+                      camera_center[0], camera_center[1], camera_center[2]}) {
+      buf += " ";
+      add_double(val);
+    }
+    buf += " 0 0\n"; // zero distortion, not used
+    flush_buf(false);
   }
 
   // Write the number of points
-  f << pid_to_cid_fid.size() << std::endl;
+  add_int(pid_to_cid_fid.size());
+  buf += "\n";
 
   for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
-    f << pid_to_xyz[pid][0] << " " << pid_to_xyz[pid][1] << " "
-      << pid_to_xyz[pid][2] << " 0 0 0 "
-      << pid_to_cid_fid[pid].size();
 
     if (pid_to_cid_fid[pid].size() <= 1)
       vw::vw_throw(vw::ArgumentErr() << "PID " << pid << " has "
                    << pid_to_cid_fid[pid].size() << " measurements.");
-    
+
+    for (int it = 0; it < 3; it++) {
+      add_double(pid_to_xyz[pid][it]);
+      buf += " ";
+    }
+    buf += "0 0 0 ";
+    add_int(pid_to_cid_fid[pid].size());
+
     for (std::map<int, int>::const_iterator it = pid_to_cid_fid[pid].begin();
          it != pid_to_cid_fid[pid].end(); it++) {
-      f << " " << it->first << " " << it->second << " "
-        << cid_to_keypoint_map[it->first].col(it->second)[0] << " "
-        << cid_to_keypoint_map[it->first].col(it->second)[1];
+      buf += " ";
+      add_int(it->first);
+      buf += " ";
+      add_int(it->second);
+      buf += " ";
+      add_double(cid_to_keypoint_map[it->first].col(it->second)[0]);
+      buf += " ";
+      add_double(cid_to_keypoint_map[it->first].col(it->second)[1]);
     }
-    f << std::endl;
+    buf += "\n";
+    flush_buf(false);
   }
+  flush_buf(true);
 
-  // Close the file
-  f.flush();
+  if (!f)
+    vw::vw_throw(vw::IOErr() << "Failed to write: " << output_filename << "\n");
   f.close();
 }
 
@@ -28,6 +28,12 @@
 #include <vector>
 #include <string>
 
+namespace vw {
+  namespace ba {
+    class ControlNetwork;
+  }
+}
+
 namespace asp {
 
 struct nvmData {
@@ -52,6 +58,15 @@ void ReadNVM(std::string const& input_filename,
              std::vector<Eigen::Vector3d> * pid_to_xyz,
              std::vector<Eigen::Affine3d> * cid_to_cam_t_global);
 
+// Read an NVM file directly into a control network, with a tie point for
+// each triangulated point. This skips the keypoint maps of each camera,
+// which is faster and uses less memory for large reconstructions.
+// Optical offsets are applied as above.
+void ReadNVM(std::string const& input_filename,
+             std::vector<std::string> * cid_to_filename,
+             std::vector<Eigen::Affine3d> * cid_to_cam_t_global,
+             vw::ba::ControlNetwork * cnet);
+
 void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
               std::vector<std::string> const& cid_to_filename,
               std::vector<double> const& focal_lengths,
@@ -0,0 +1,112 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ObjectStorage.cc
+///
+
+#include <asp/Core/ObjectStorage.h>
+#include <asp/Core/IpCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <cpl_conv.h>
+#include <cpl_vsi.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+bool is_object_storage_path(std::string const& path) {
+  const char * prefixes[] = {"/vsis3/", "/vsigs/", "/vsiaz/", "/vsiadls/",
+                             "/vsioss/", "/vsiswift/", "/vsicurl/"};
+  for (auto const& prefix: prefixes) {
+    if (path.compare(0, std::string(prefix).size(), prefix) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool path_exists(std::string const& path) {
+  if (!is_object_storage_path(path))
+    return fs::exists(path);
+  VSIStatBufL stat;
+  return VSIStatL(path.c_str(), &stat) == 0;
+}
+
+void create_out_dir(std::string const& out_prefix) {
+  if (!is_object_storage_path(out_prefix))
+    vw::create_out_dir(out_prefix);
+}
+
+void set_object_storage_options() {
+
+  // Each option, and why. The user's environment takes precedence.
+  const char * options[][2] = {
+    // Do not list the bucket when opening a file, which is slow for big buckets
+    {"GDAL_DISABLE_READDIR_ON_OPEN", "EMPTY_DIR"},
+    // Read in 1 MB chunks rather than 16 KB, as each request has a high latency
+    {"CPL_VSIL_CURL_CHUNK_SIZE",     "1048576"},
+    // Keep 512 MB of the chunks read, shared among the files
+    {"CPL_VSIL_CURL_CACHE_SIZE",     "536870912"},
+    // Fetch the ranges needed for a read in parallel, merging adjacent ones
+    {"GDAL_HTTP_MULTIRANGE",         "PARALLEL"},
+    {"GDAL_HTTP_MERGE_CONSECUTIVE_RANGES", "YES"},
+    // Retry on the transient errors of object storage
+    {"GDAL_HTTP_MAX_RETRY",          "5"},
+    {"GDAL_HTTP_RETRY_DELAY",        "1"},
+    // Upload in 50 MB parts
+    {"VSIS3_CHUNK_SIZE",             "50"}};
+
+  for (auto const& opt: options) {
+    if (getenv(opt[0]) == NULL && CPLGetConfigOption(opt[0], NULL) == NULL)
+      CPLSetConfigOption(opt[0], opt[1]);
+  }
+}
+
+ObjectStorageOutput::ObjectStorageOutput(std::string const& path): m_path(path) {
+
+  std::string dir;
+  const char * staging_dir = getenv("ASP_STAGING_DIR");
+  if (staging_dir != NULL && std::string(staging_dir) != "")
+    dir = staging_dir;
+  else
+    dir = fs::temp_directory_path().string();
+
+  char hash[32];
+  snprintf(hash, sizeof(hash), "%016llx",
+           (unsigned long long)fnv1a_hash(path.data(), path.size()));
+  m_local_path = (fs::path(dir) / (std::string("asp-staging-") + hash + "-" +
+                                   fs::path(path).filename().string())).string();
+}
+
+void ObjectStorageOutput::upload() {
+  vw::vw_out() << "Uploading: " << m_path << "\n";
+  if (CPLCopyFile(m_path.c_str(), m_local_path.c_str()) != 0)
+    vw::vw_throw(vw::IOErr() << "Failed to upload: " << m_local_path << " to "
+                 << m_path << ".\n");
+  boost::system::error_code ec;
+  fs::remove(m_local_path, ec);
+}
+
+} // end namespace asp
@@ -0,0 +1,76 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ObjectStorage.h
+///
+/// Read and write images in cloud object storage, such as S3 or Google
+/// Cloud Storage, with the GDAL virtual file systems. An input is given
+/// by a path such as /vsis3/bucket/dir/image.tif, and DiskImageView and
+/// the other readers use it as a local file. GDAL then fetches only the
+/// byte ranges it needs, with the caching and range merging set in
+/// set_object_storage_options().
+///
+/// GDAL cannot write a tiled GeoTIFF directly to object storage, as the
+/// blocks are not written in order. So an output there is written to a
+/// local staging file first, and then uploaded. The block writers in
+/// asp/Core/AsyncBlockWriter.h and asp/Core/BigTileWriter.h do this on
+/// their own. The staging file name depends only on the output path, so
+/// that --resume works for such outputs too.
+
+#ifndef __ASP_CORE_OBJECT_STORAGE_H__
+#define __ASP_CORE_OBJECT_STORAGE_H__
+
+#include <string>
+
+namespace asp {
+
+  /// If a path is in one of the GDAL virtual file systems for object
+  /// storage or network access, such as /vsis3/, /vsigs/, /vsiaz/,
+  /// or /vsicurl/
+  bool is_object_storage_path(std::string const& path);
+
+  /// If a file exists, locally or in object storage
+  bool path_exists(std::string const& path);
+
+  /// Create the directory of an output prefix, unless in object storage,
+  /// where there are no directories
+  void create_out_dir(std::string const& out_prefix);
+
+  /// Set the GDAL options for reading from object storage, unless the
+  /// user set them already in the environment. Done by check_command_line().
+  void set_object_storage_options();
+
+  /// A local file where an output to object storage is written, and which
+  /// is uploaded with upload(). The staging directory is ASP_STAGING_DIR
+  /// if set, and otherwise the system temporary directory. If not
+  /// uploaded, the local file is kept, for --resume.
+  class ObjectStorageOutput {
+  public:
+    explicit ObjectStorageOutput(std::string const& path);
+    std::string const& local_path() const { return m_local_path; }
+
+    /// Copy the local file to object storage, and remove it
+    void upload();
+
+  private:
+    std::string m_path, m_local_path;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_OBJECT_STORAGE_H__
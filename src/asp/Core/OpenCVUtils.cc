@@ -21,6 +21,7 @@
 
 #include <Eigen/Core>
 #include <opencv2/core/eigen.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include <iostream>
 
@@ -109,4 +110,30 @@ namespace asp {
                                     cv::Range(extra_x, extra_x + input_image.cols)));
   }
   
+
+  // Find the shift of the second image relative to the first by phase correlation
+  vw::Vector2 phaseCorrelationShift(vw::ImageView<double> const& image1,
+                                    vw::ImageView<double> const& image2,
+                                    double & response) {
+
+    if (image1.cols() != image2.cols() || image1.rows() != image2.rows())
+      vw::vw_throw(vw::ArgumentErr() << "phaseCorrelationShift: the images "
+                   << "must have the same size.\n");
+
+    cv::Mat mat1(image1.rows(), image1.cols(), CV_64FC1);
+    cv::Mat mat2(image2.rows(), image2.cols(), CV_64FC1);
+    for (int row = 0; row < image1.rows(); row++) {
+      for (int col = 0; col < image1.cols(); col++) {
+        mat1.at<double>(row, col) = image1(col, row);
+        mat2.at<double>(row, col) = image2(col, row);
+      }
+    }
+
+    // Taper the borders, as the images are not periodic
+    cv::Mat window;
+    cv::createHanningWindow(window, mat1.size(), CV_64FC1);
+    cv::Point2d shift = cv::phaseCorrelate(mat1, mat2, window, &response);
+    return vw::Vector2(shift.x, shift.y);
+  }
+
 } // end namespace asp
@@ -25,6 +25,8 @@
 #include <string>
 
 #include <vw/Math/Matrix.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewRef.h>
 #include <opencv2/core.hpp>
 
@@ -44,6 +46,15 @@ namespace asp {
   // Insert an image as a block at a desired location in a bigger image
   void cvInsertBlock(cv::Mat const& input_image, int extra_x,
                      int extra_y, cv::Mat& output_image);
+
+  // Find the shift of the second image relative to the first by phase
+  // correlation, so that a feature at pixel p in the first image is at
+  // p + shift in the second. The images must be of the same size, with
+  // no invalid pixels. The response, between 0 and 1, is larger when
+  // the images agree better after the shift.
+  vw::Vector2 phaseCorrelationShift(vw::ImageView<double> const& image1,
+                                    vw::ImageView<double> const& image2,
+                                    double & response);
 }
 
 #endif //__ASP_CORE_OPENCVUTILS_H__
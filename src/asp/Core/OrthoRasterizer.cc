@@ -34,10 +34,13 @@
 #include <vw/Image/Filter.h>
 #include <vw/Image/InpaintView.h>
 
+#include <asp/Core/MedianFilter.h>
 #include <asp/Core/SoftwareRenderer.h>
 #include <asp/Core/PointUtils.h>
 #include <boost/foreach.hpp>
 #include <boost/math/special_functions/next.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
 #include <asp/Core/OrthoRasterizer.h>
 #include <valarray>
 
@@ -45,6 +48,21 @@ namespace asp{
 
   using namespace vw;
 
+  namespace bg  = boost::geometry;
+  namespace bgi = boost::geometry::index;
+
+  // The x-y extent of a point cloud boundary, and its index
+  typedef bg::model::point<double, 2, bg::cs::cartesian> IndexPoint;
+  typedef bg::model::box<IndexPoint>                     IndexBox;
+  typedef std::pair<IndexBox, size_t>                    IndexValue;
+
+  struct BoundaryIndex {
+    bgi::rtree<IndexValue, bgi::rstar<16>> tree;
+    
+    // Use the packing constructor, as all boxes are known upfront
+    BoundaryIndex(std::vector<IndexValue> const& values): tree(values.begin(), values.end()) {}
+  };
+
   class compare_bboxes { // simple comparison function
   public:
     bool operator()(const BBox2i A, const BBox2i B) const {
@@ -276,30 +294,22 @@ namespace asp{
     int nc = image.cols(), nr = image.rows(); // shorten
     double nan = std::numeric_limits<double>::quiet_NaN();
 
-    ImageView<Vector3> image_out = copy(image);
-
-    for (int col = 0; col < image.cols(); col++){
-      for (int row = 0; row < image.rows(); row++){
-
-        if (boost::math::isnan(image(col, row).z()))
+    // The median of the valid heights in each window. The tiles are
+    // already rasterized in parallel, so use one thread.
+    ImageView<double> heights(nc, nr);
+    for (int col = 0; col < nc; col++)
+      for (int row = 0; row < nr; row++)
+        heights(col, row) = image(col, row).z();
+    ImageView<double> median = asp::median_filter(heights, half, 1);
+
+    for (int col = 0; col < nc; col++){
+      for (int row = 0; row < nr; row++){
+        if (boost::math::isnan(heights(col, row)))
           continue;
-
-        std::vector<double> vals;
-        for (int c = std::max(col-half, 0); c <= std::min(col+half, nc-1); c++){
-          for (int r = std::max(row-half, 0); r <= std::min(row+half, nr-1); r++){
-            if (boost::math::isnan(image(c, r).z()))
-              continue;
-            vals.push_back(image(c, r).z());
-          }
-        }
-        double median = vw::math::destructive_median(vals);
-        if (fabs(median - image(col, row).z()) > thresh){
-          image_out(col, row).z() = nan;
-        }
+        if (fabs(median(col, row) - heights(col, row)) > thresh)
+          image(col, row).z() = nan;
       }
     }
-
-    image = copy(image_out);
   }
 
   // TODO: This function should live somewhere else!
@@ -417,6 +427,7 @@ namespace asp{
     m_projwin(projwin),
     m_error_image(error_image), m_error_cutoff(-1.0),
     m_median_filter_params(median_filter_params), m_erode_len(erode_len),
+    m_max_cell_values(0),
     m_default_grid_size_multiplier(default_grid_size_multiplier),
     m_num_invalid_pixels(num_invalid_pixels),
     m_count_mutex(count_mutex){
@@ -575,9 +586,38 @@ namespace asp{
       }
     }
 
+    // Index the boundaries. Those with no points cannot intersect anything.
+    std::vector<IndexValue> values;
+    values.reserve(m_point_image_boundaries.size());
+    for (size_t i = 0; i < m_point_image_boundaries.size(); i++) {
+      BBox3 const& b = m_point_image_boundaries[i].first;
+      if (b.min().x() > b.max().x() || b.min().y() > b.max().y())
+        continue;
+      values.push_back(IndexValue(IndexBox(IndexPoint(b.min().x(), b.min().y()),
+                                           IndexPoint(b.max().x(), b.max().y())), i));
+    }
+    m_boundary_index.reset(new BoundaryIndex(values));
+
     return;
   } // End OrthoRasterizerView Constructor
 
+  void OrthoRasterizerView::find_boundaries(BBox3 const& box,
+                                            std::vector<size_t> & indices) const {
+    indices.clear();
+
+    IndexBox query(IndexPoint(box.min().x(), box.min().y()),
+                   IndexPoint(box.max().x(), box.max().y()));
+    std::vector<IndexValue> found;
+    m_boundary_index->tree.query(bgi::intersects(query), std::back_inserter(found));
+
+    // Also check the z range, and keep the original order
+    for (size_t i = 0; i < found.size(); i++) {
+      if (box.intersects(m_point_image_boundaries[found[i].second].first))
+        indices.push_back(found[i].second);
+    }
+    std::sort(indices.begin(), indices.end());
+  }
+
 
   // This is kind of like part 2 of the constructor
   // - This function finalizes the spacing and generates a spacing-snapped BBox.
@@ -659,9 +699,20 @@ namespace asp{
       render_buffer.set_size(bbox_1.width(), bbox_1.height());
     }
 
-    // Setup a software renderer and the orthographic view matrix
-    vw::stereo::SoftwareRenderer renderer(bbox_1.width(), bbox_1.height(),
-                                          &render_buffer(0,0) );
+    // Setup a software renderer and the orthographic view matrix. The
+    // tiles are rendered in parallel already, so the renderer uses
+    // more threads only if there are fewer tiles than threads.
+    int num_render_threads = 1;
+    if (m_use_surface_sampling) {
+      std::int64_t num_tiles
+        = std::int64_t(ceil(cols()/double(bbox.width()))) *
+          std::int64_t(ceil(rows()/double(bbox.height())));
+      num_render_threads
+        = std::max(std::int64_t(1),
+                   std::int64_t(vw_settings().default_num_threads())/num_tiles);
+    }
+    vw::stereo::BinnedSoftwareRenderer renderer(bbox_1.width(), bbox_1.height(),
+                                                &render_buffer(0,0), num_render_threads);
     renderer.Ortho2D(local_3d_bbox.min().x(), local_3d_bbox.max().x(),
                      local_3d_bbox.min().y(), local_3d_bbox.max().y());
 
@@ -683,7 +734,7 @@ namespace asp{
                                local_3d_bbox.min().y(),
                                m_spacing, m_default_spacing,
                                search_radius, m_sigma_factor,
-                               m_filter, m_percentile);
+                               m_filter, m_percentile, m_max_cell_values);
     
     // Set up the default color value
     double min_val = 0.0;
@@ -716,11 +767,10 @@ namespace asp{
     typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
     typedef BlockMapType::iterator MapIterType;
     BlockMapType blocks_map;
-    BOOST_FOREACH( BBoxPair const& boundary, m_point_image_boundaries ) {
-      if (! local_3d_bbox.intersects(boundary.first) )
-        continue;
-
-      BBox2i pc_block = boundary.second;
+    std::vector<size_t> boundary_indices;
+    find_boundaries(local_3d_bbox, boundary_indices);
+    for (size_t b = 0; b < boundary_indices.size(); b++) {
+      BBox2i pc_block = m_point_image_boundaries[boundary_indices[b]].second;
 
       BBox2i snapped_block;
       snapped_block.min() = m_block_size*floor(pc_block.min()/double(m_block_size));
@@ -756,6 +806,9 @@ namespace asp{
     // pixel we need to see its next up and right neighbors.
     int d = (int)m_use_surface_sampling;
 
+    // The points of a block to grid, as (x, y, texture) values
+    std::vector<Vector3> grid_points;
+
     for (MapIterType it = blocks_map.begin(); it != blocks_map.end(); it++){
 
       BBox2i block = it->second;
@@ -825,12 +878,12 @@ namespace asp{
             }
 
           }else{
-            // The new engine
+            // The new engine. Collect the points and add them at once.
             if ( !boost::math::isnan(point_copy(col, row).z()) &&
                  local_3d_bbox.contains(point_copy(col, row))){
-              point2grid.AddPoint(point_copy(col, row).x(),
-                                  point_copy(col, row).y(),
-                                  texture_copy(col,  row));
+              grid_points.push_back(Vector3(point_copy(col, row).x(),
+                                            point_copy(col, row).y(),
+                                            texture_copy(col,  row)));
             }
           }
           point_ul.next_col();
@@ -838,9 +891,15 @@ namespace asp{
         row_acc.next_row();
       } // End row loop
 
+      if (!m_use_surface_sampling) {
+        point2grid.AddPoints(grid_points);
+        grid_points.clear();
+      }
     }
 
-    if (!m_use_surface_sampling)
+    if (m_use_surface_sampling)
+      renderer.Finish();
+    else
       point2grid.normalize();
 
     // The software renderer returns an image which will render
@@ -31,6 +31,9 @@
 #include <vw/Math/Vector.h>
 #include <vw/Math/BBox.h>
 #include <asp/Core/Point2Grid.h>
+#include <asp/Core/Trace.h>
+
+#include <boost/shared_ptr.hpp>
 
 namespace asp{
 
@@ -41,6 +44,8 @@ namespace asp{
 
   typedef std::pair<BBox3, BBox2i> BBoxPair;
 
+  struct BoundaryIndex; // Defined in the .cc file
+
   /// Given a point image and corresponding texture, this class
   /// bins and averages the point cloud on a regular grid over the [x,y]
   /// plane of the point image; producing an evenly sampled ortho-image
@@ -68,18 +73,25 @@ namespace asp{
     int     m_erode_len;
     asp::FilterType m_filter;
     double m_percentile;
+    int    m_max_cell_values;
     double m_default_grid_size_multiplier;
     std::int64_t * m_num_invalid_pixels; ///< Keep a count of nodata output pixels, needs to be pointer due to VW weirdness.
     vw::Mutex  *m_count_mutex;        ///< A lock for m_num_invalid_pixels, needs to be pointer due to C++ weirdness.
 
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     std::vector<BBoxPair> m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
     // their location in the the point cloud image. These boxes are
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // An R-tree over the x-y extents of m_point_image_boundaries, so that
+    // each output tile finds the boundaries it intersects without scanning
+    // all of them. Shared among the copies of this view.
+    boost::shared_ptr<BoundaryIndex> m_boundary_index;
+
+    // Indices in m_point_image_boundaries of the boundaries intersecting this box
+    void find_boundaries(BBox3 const& box, std::vector<size_t> & indices) const;
+
     // Function to convert pixel coordinates to the point domain
     BBox3 pixel_to_point_bbox( BBox2 const& px ) const;
 
@@ -144,6 +156,7 @@ namespace asp{
     prerasterize_type prerasterize( BBox2i const& bbox ) const;
 
     template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
+      TraceScope trace("rasterize_dem_tile", "task", bbox);
       vw::rasterize( prerasterize(bbox), dest, bbox );
     }
     /// \endcond
@@ -151,6 +164,7 @@ namespace asp{
     void set_use_alpha          (bool   val) { m_use_alpha       = val; }
     void set_use_minz_as_default(bool   val) { m_minz_as_default = val; }
     void set_default_value      (double val) { m_default_value   = val; }
+    void set_max_cell_values    (int    val) { m_max_cell_values = val; }
     double default_value() {
       if (m_minz_as_default) return m_bbox.min().z();
       else return m_default_value;
@@ -20,6 +20,12 @@
 #include <vw/Image/Statistics.h>
 #include <vw/Math/Statistics.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/BlockRasterize.h>
+
+#include <boost/noncopyable.hpp>
 
 using namespace vw;
 
@@ -60,10 +66,10 @@ void estimate_inliers_bbox(double pct_factor_x, double pct_factor_y, double pct_
   inliers_bbox.grow(Vector3(ex, ey, ez));
 }
 
-// Get a generous estimate of the bounding box of the current set
-// while excluding outliers
-void estimate_points_bdbox(vw::ImageViewRef<vw::Vector3> const& proj_points,
-                           vw::ImageViewRef<double> const& error_image,
+// Get a generous estimate of the bounding box of the current set of
+// valid points while excluding outliers
+void estimate_points_bdbox(std::vector<Vector3> const& points,
+                           std::vector<double> const& point_errors,
                            vw::Vector2 const& remove_outliers_params,
                            double estim_max_error,
                            vw::BBox3 & inliers_bbox) {
@@ -72,22 +78,15 @@ void estimate_points_bdbox(vw::ImageViewRef<vw::Vector3> const& proj_points,
   // outliers, then estimate the box from the remaining points, etc.
   
   std::vector<double> x_vals, y_vals, z_vals;
-  for (int col = 0; col < proj_points.cols(); col++){
-    for (int row = 0; row < proj_points.rows(); row++){
-
-      // Avoid points marked as not valid
-      Vector3 P = proj_points(col, row);
-      if (P != P)
-        continue;
+  for (size_t it = 0; it < points.size(); it++) {
 
-      // Make use of the estimated error, if available
-      if (estim_max_error > 0 && error_image(col, row) > estim_max_error) 
-        continue;
+    // Make use of the estimated error, if available
+    if (estim_max_error > 0 && point_errors[it] > estim_max_error) 
+      continue;
 
-      x_vals.push_back(P.x());
-      y_vals.push_back(P.y());
-      z_vals.push_back(P.z());
-    }
+    x_vals.push_back(points[it].x());
+    y_vals.push_back(points[it].y());
+    z_vals.push_back(points[it].z());
   }
 
   double pct_factor     = remove_outliers_params[0]/100.0; // e.g., 0.75
@@ -112,6 +111,98 @@ void estimate_points_bdbox(vw::ImageViewRef<vw::Vector3> const& proj_points,
   return;
 }
 
+// Collect from a block of the (subsampled) cloud the valid points with
+// their errors, and all the positive errors. The results of all blocks
+// are appended to shared vectors. Their order depends on the order in
+// which the blocks finish, but the estimates made from them do not, as
+// they are based on sorting.
+class CollectSamplesTask: public Task, private boost::noncopyable {
+  ImageViewRef<Vector3> m_points;
+  ImageViewRef<double>  m_errors;
+  BBox2i m_box;
+  std::vector<Vector3> & m_valid_points;
+  std::vector<double>  & m_valid_point_errors;
+  std::vector<double>  & m_positive_errors;
+  Mutex & m_mutex;
+  const ProgressCallback & m_progress;
+  float m_inc_amt;
+
+public:
+  CollectSamplesTask(ImageViewRef<Vector3> const& points,
+                     ImageViewRef<double> const& errors,
+                     BBox2i const& box,
+                     std::vector<Vector3> & valid_points,
+                     std::vector<double>  & valid_point_errors,
+                     std::vector<double>  & positive_errors,
+                     Mutex & mutex, const ProgressCallback & progress, float inc_amt):
+    m_points(points), m_errors(errors), m_box(box),
+    m_valid_points(valid_points), m_valid_point_errors(valid_point_errors),
+    m_positive_errors(positive_errors),
+    m_mutex(mutex), m_progress(progress), m_inc_amt(inc_amt) {}
+
+  void operator()() {
+    ImageView<Vector3> points = crop(m_points, m_box);
+    ImageView<double>  errors = crop(m_errors, m_box);
+
+    std::vector<Vector3> valid_points;
+    std::vector<double>  valid_point_errors, positive_errors;
+    for (int row = 0; row < points.rows(); row++) {
+      for (int col = 0; col < points.cols(); col++) {
+        double err = errors(col, row);
+
+        // Don't add zero errors, those most likely came from invalid points
+        if (err > 0)
+          positive_errors.push_back(err);
+
+        // Avoid points marked as not valid
+        Vector3 P = points(col, row);
+        if (P != P)
+          continue;
+        valid_points.push_back(P);
+        valid_point_errors.push_back(err);
+      }
+    }
+
+    Mutex::Lock lock(m_mutex);
+    m_valid_points.insert(m_valid_points.end(), valid_points.begin(), valid_points.end());
+    m_valid_point_errors.insert(m_valid_point_errors.end(),
+                                valid_point_errors.begin(), valid_point_errors.end());
+    m_positive_errors.insert(m_positive_errors.end(),
+                             positive_errors.begin(), positive_errors.end());
+    m_progress.report_incremental_progress(m_inc_amt);
+  }
+};
+
+// Read the samples in parallel, block by block
+void collect_samples(ImageViewRef<Vector3> const& points,
+                     ImageViewRef<double> const& errors,
+                     std::vector<Vector3> & valid_points,
+                     std::vector<double>  & valid_point_errors,
+                     std::vector<double>  & positive_errors,
+                     const ProgressCallback & progress) {
+
+  valid_points.clear();
+  valid_point_errors.clear();
+  positive_errors.clear();
+
+  const int block_size = 256;
+  std::vector<BBox2i> blocks = subdivide_bbox(points, block_size, block_size);
+
+  progress.report_progress(0);
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  Mutex mutex;
+  float inc_amt = 1.0 / float(std::max(size_t(1), blocks.size()));
+  for (size_t it = 0; it < blocks.size(); it++) {
+    boost::shared_ptr<CollectSamplesTask>
+      task(new CollectSamplesTask(points, errors, blocks[it], valid_points,
+                                  valid_point_errors, positive_errors,
+                                  mutex, progress, inc_amt));
+    queue.add_task(task);
+  }
+  queue.join_all();
+  progress.report_finished();
+}
+
 // A class to pick some samples to estimate the range of values
 // of a given dataset
 class ErrorRangeEstimAccum: public ReturnFixedType<void> {
@@ -182,21 +273,28 @@ double estim_max_tri_error_and_proj_box(vw::ImageViewRef<vw::Vector3> const& pro
     
     Stopwatch sw2;
     sw2.start();
-    PixelAccumulator<asp::ErrorRangeEstimAccum> error_accum;
-    for_each_pixel(subsample(error_image, subsample_amt),
-                   error_accum,
-                   TerminalProgressCallback
-                   ("asp","Bounding box and triangulation error range estimation: ") );
+
+    // Read the samples once, in parallel
+    std::vector<Vector3> valid_points;
+    std::vector<double>  valid_point_errors, positive_errors;
+    collect_samples(subsample(proj_points, subsample_amt),
+                    subsample(error_image, subsample_amt),
+                    valid_points, valid_point_errors, positive_errors,
+                    TerminalProgressCallback
+                    ("asp","Bounding box and triangulation error range estimation: "));
+    
+    asp::ErrorRangeEstimAccum error_accum;
+    for (size_t it = 0; it < positive_errors.size(); it++)
+      error_accum(positive_errors[it]);
     if (error_accum.size() > 0){
       success = true;
       estim_max_error = error_accum.value(remove_outliers_params);
     }
-    sw2.stop();
 
-    asp::estimate_points_bdbox(subsample(proj_points, subsample_amt),
-                               subsample(error_image, subsample_amt),
+    asp::estimate_points_bdbox(valid_points, valid_point_errors,
                                remove_outliers_params,  estim_max_error,
                                estim_proj_box);
+    sw2.stop();
     
     if (estim_proj_box.empty()) 
       success = false;
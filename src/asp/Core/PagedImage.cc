@@ -0,0 +1,230 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PagedImage.cc
+///
+
+#include <asp/Core/PagedImage.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace asp {
+
+namespace {
+
+  // The largest finite float16 value
+  const float MAX_HALF = 65504.0f;
+
+  // How many decoded blocks each thread keeps
+  const int NUM_CACHED_BLOCKS = 32;
+
+  struct CachedBlock {
+    std::uint64_t id; // The store id, or 0 if unused
+    int block;
+    std::vector<float> vals;
+    CachedBlock(): id(0), block(-1) {}
+  };
+
+  struct BlockCache {
+    CachedBlock blocks[NUM_CACHED_BLOCKS];
+    int last, next; // The last one used, and the next one to replace
+    BlockCache(): last(0), next(0) {}
+  };
+
+  thread_local BlockCache g_block_cache;
+  std::atomic<std::uint64_t> g_next_store_id(1);
+
+  // All float16 values as floats, to decode blocks quickly
+  std::vector<float> const& half_table() {
+    static std::vector<float> table = []() {
+      std::vector<float> vals(65536);
+      for (int it = 0; it < 65536; it++)
+        vals[it] = half_to_float(std::uint16_t(it));
+      return vals;
+    }();
+    return table;
+  }
+
+  bool same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+  }
+
+} // end anonymous namespace
+
+std::uint16_t float_to_half(float val) {
+
+  std::uint32_t bits;
+  std::memcpy(&bits, &val, sizeof(bits));
+  std::uint16_t sign = (bits >> 16) & 0x8000;
+  int exp = (bits >> 23) & 0xff;
+  std::uint32_t mant = bits & 0x7fffff;
+
+  if (exp == 255) // Infinity or NaN
+    return sign | 0x7c00 | (mant != 0 ? 0x200 : 0);
+
+  int half_exp = exp - 127 + 15;
+  if (half_exp >= 31) // Too large
+    return sign | 0x7c00;
+
+  if (half_exp <= 0) {
+    // A subnormal float16, or zero
+    if (half_exp < -10)
+      return sign;
+    mant |= 0x800000;
+    int shift = 14 - half_exp;
+    std::uint32_t half_mant = mant >> shift;
+    std::uint32_t rem = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (half_mant & 1)))
+      half_mant++;
+    return sign | half_mant;
+  }
+
+  // Round to nearest even. A carry goes into the exponent, as it should.
+  std::uint16_t half = sign | (half_exp << 10) | (mant >> 13);
+  std::uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+    half++;
+  return half;
+}
+
+float half_to_float(std::uint16_t val) {
+
+  std::uint32_t sign = std::uint32_t(val & 0x8000) << 16;
+  int exp = (val >> 10) & 0x1f;
+  std::uint32_t mant = val & 0x3ff;
+
+  std::uint32_t bits;
+  if (exp == 0) {
+    // Zero or subnormal
+    float f = std::ldexp(float(mant), -24);
+    return sign ? -f : f;
+  } else if (exp == 31) {
+    bits = sign | 0x7f800000 | (mant << 13);
+  } else {
+    bits = sign | (std::uint32_t(exp - 15 + 127) << 23) | (mant << 13);
+  }
+
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+PagedImageStore::PagedImageStore(vw::ImageView<float> const& img, int block_size):
+  m_id(g_next_store_id++), m_cols(img.cols()), m_rows(img.rows()),
+  m_block_size(block_size) {
+
+  if (block_size <= 0)
+    vw::vw_throw(vw::ArgumentErr() << "The block size must be positive.\n");
+
+  m_num_block_cols = (m_cols + block_size - 1) / block_size;
+  int num_block_rows = (m_rows + block_size - 1) / block_size;
+  m_blocks.resize(m_num_block_cols * num_block_rows);
+
+  for (int brow = 0; brow < num_block_rows; brow++) {
+    for (int bcol = 0; bcol < m_num_block_cols; bcol++) {
+
+      Block & block = m_blocks[brow * m_num_block_cols + bcol];
+      int col0 = bcol * block_size, row0 = brow * block_size;
+      int cols = std::min(block_size, m_cols - col0);
+      int rows = std::min(block_size, m_rows - row0);
+
+      block.constant = img(col0, row0);
+      bool is_constant = true, fits_half = true;
+      for (int row = row0; row < row0 + rows; row++) {
+        for (int col = col0; col < col0 + cols; col++) {
+          float val = img(col, row);
+          is_constant = is_constant && same_bits(val, block.constant);
+          fits_half = fits_half && !(std::abs(val) > MAX_HALF && std::isfinite(val));
+        }
+      }
+      if (is_constant)
+        continue;
+
+      // The unused part of a block at the image edge is left as zero
+      if (fits_half)
+        block.half.resize(block_size * block_size, 0);
+      else
+        block.full.resize(block_size * block_size, 0.0f);
+      for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+          float val = img(col0 + col, row0 + row);
+          if (fits_half)
+            block.half[row * block_size + col] = float_to_half(val);
+          else
+            block.full[row * block_size + col] = val;
+        }
+      }
+    }
+  }
+}
+
+float const* PagedImageStore::decoded(int block) const {
+
+  BlockCache & cache = g_block_cache;
+  CachedBlock * cached = &cache.blocks[cache.last];
+  if (cached->id == m_id && cached->block == block)
+    return &cached->vals[0];
+
+  for (int it = 0; it < NUM_CACHED_BLOCKS; it++) {
+    cached = &cache.blocks[it];
+    if (cached->id == m_id && cached->block == block) {
+      cache.last = it;
+      return &cached->vals[0];
+    }
+  }
+
+  // Replace the oldest one
+  cache.last = cache.next;
+  cache.next = (cache.next + 1) % NUM_CACHED_BLOCKS;
+  cached = &cache.blocks[cache.last];
+  cached->id = m_id;
+  cached->block = block;
+
+  std::vector<std::uint16_t> const& half = m_blocks[block].half;
+  std::vector<float> const& table = half_table();
+  cached->vals.resize(half.size());
+  for (std::size_t it = 0; it < half.size(); it++)
+    cached->vals[it] = table[half[it]];
+
+  return &cached->vals[0];
+}
+
+float PagedImageStore::value(int col, int row) const {
+  int bcol = col / m_block_size, brow = row / m_block_size;
+  int block = brow * m_num_block_cols + bcol;
+  Block const& b = m_blocks[block];
+  int index = (row - brow * m_block_size) * m_block_size + (col - bcol * m_block_size);
+  if (!b.half.empty())
+    return decoded(block)[index];
+  if (!b.full.empty())
+    return b.full[index];
+  return b.constant;
+}
+
+std::size_t PagedImageStore::memory_usage() const {
+  std::size_t size = sizeof(Block) * m_blocks.size();
+  for (std::size_t it = 0; it < m_blocks.size(); it++)
+    size += sizeof(std::uint16_t) * m_blocks[it].half.size()
+      + sizeof(float) * m_blocks[it].full.size();
+  return size;
+}
+
+} // end namespace asp
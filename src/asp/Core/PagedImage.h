@@ -0,0 +1,167 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PagedImage.h
+///
+/// A compact in-memory store of a float image, for tools such as sfs
+/// which keep many image crops in memory and read them at random
+/// locations. The image is split into small square blocks. A block
+/// where all values are the same is kept as a single value, and other
+/// blocks are kept as float16 values, unless some values do not fit in
+/// float16. Blocks are converted back to float as they are accessed,
+/// and each thread keeps a few of the most recently used ones, so the
+/// memory for float data grows with the number of threads rather than
+/// with the number of images. Invalid pixels are stored as NaN.
+
+#ifndef __ASP_CORE_PAGED_IMAGE_H__
+#define __ASP_CORE_PAGED_IMAGE_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/PixelMask.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace asp {
+
+  /// Convert between float and IEEE 754 half precision, rounding to
+  /// the nearest value. Values too large for float16 become infinite.
+  std::uint16_t float_to_half(float val);
+  float half_to_float(std::uint16_t val);
+
+  class PagedImageStore {
+  public:
+
+    /// Store this image, in blocks of the given size
+    PagedImageStore(vw::ImageView<float> const& img, int block_size = 64);
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    /// The value at this pixel. This is thread-safe.
+    float value(int col, int row) const;
+
+    /// The memory used by the stored blocks, in bytes
+    std::size_t memory_usage() const;
+
+  private:
+
+    struct Block {
+      float constant;                  // Used if there is no other data
+      std::vector<std::uint16_t> half; // If the values fit in float16
+      std::vector<float> full;         // Otherwise
+    };
+
+    // The values of a block, as floats, from the cache of this thread
+    float const* decoded(int block) const;
+
+    std::uint64_t m_id; // To identify the cached blocks of this store
+    int m_cols, m_rows, m_block_size, m_num_block_cols;
+    std::vector<Block> m_blocks;
+  };
+
+  /// Convert a stored value to a pixel of the view. NaN is invalid.
+  inline void paged_to_pixel(float val, float & pix) { pix = val; }
+  inline void paged_to_pixel(float val, double & pix) { pix = val; }
+  inline void paged_to_pixel(float val, vw::PixelMask<float> & pix) {
+    pix = vw::PixelMask<float>(val);
+    if (std::isnan(val)) {
+      pix = 0.0;
+      pix.invalidate();
+    }
+  }
+
+  /// An image view of a paged image store
+  template <class PixelT>
+  class PagedImageView: public vw::ImageViewBase<PagedImageView<PixelT>> {
+    boost::shared_ptr<PagedImageStore> m_store;
+
+  public:
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<PagedImageView<PixelT>> pixel_accessor;
+
+    PagedImageView(boost::shared_ptr<PagedImageStore> store): m_store(store) {}
+
+    boost::shared_ptr<PagedImageStore> store() const { return m_store; }
+
+    inline vw::int32 cols  () const { return m_store->cols(); }
+    inline vw::int32 rows  () const { return m_store->rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 col, vw::int32 row, vw::int32 p = 0) const {
+      result_type pix;
+      paged_to_pixel(m_store->value(col, row), pix);
+      return pix;
+    }
+
+    typedef vw::CropView<vw::ImageView<PixelT>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<PixelT> tile(bbox.width(), bbox.height());
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++)
+          tile(col, row) = operator()(col + bbox.min().x(), row + bbox.min().y());
+      }
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Store a masked image, with invalid pixels as NaN
+  template <class ImageT>
+  PagedImageView<vw::PixelMask<float>>
+  paged_masked_image(vw::ImageViewBase<ImageT> const& img) {
+    vw::ImageView<float> vals(img.impl().cols(), img.impl().rows());
+    for (int row = 0; row < vals.rows(); row++) {
+      for (int col = 0; col < vals.cols(); col++) {
+        auto pix = img.impl()(col, row);
+        vals(col, row) = is_valid(pix) ? float(pix.child())
+          : std::numeric_limits<float>::quiet_NaN();
+      }
+    }
+    boost::shared_ptr<PagedImageStore> store(new PagedImageStore(vals));
+    return PagedImageView<vw::PixelMask<float>>(store);
+  }
+
+  /// Store an image with no mask
+  template <class PixelT, class ImageT>
+  PagedImageView<PixelT> paged_image(vw::ImageViewBase<ImageT> const& img) {
+    vw::ImageView<float> vals(img.impl().cols(), img.impl().rows());
+    for (int row = 0; row < vals.rows(); row++) {
+      for (int col = 0; col < vals.cols(); col++)
+        vals(col, row) = img.impl()(col, row);
+    }
+    boost::shared_ptr<PagedImageStore> store(new PagedImageStore(vals));
+    return PagedImageView<PixelT>(store);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PAGED_IMAGE_H__
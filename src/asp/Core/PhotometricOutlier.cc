@@ -36,57 +36,127 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Stereo/DisparityMap.h>
 
-namespace fs = boost::filesystem;
+#include <cmath>
+#include <vector>
 
 using namespace vw;
 using namespace asp;
 
+namespace {
+
+  // Tiles of the left image on which the difference is found
+  const int PHOTOMETRIC_TILE_SIZE = 256;
+
+  // Warp the right image block by the disparity onto the given tile of
+  // the left image, with bilinear interpolation, and store the absolute
+  // difference with the left image. It is invalid where the disparity is
+  // invalid or the warped pixel is outside the right image or zero, as
+  // the zero edge extension made it before.
+  void photometric_diff_tile(DiskImageView<PixelGray<float>> const& left_image,
+                             DiskImageView<PixelGray<float>> const& right_image,
+                             DiskImageView<PixelMask<Vector2f>> const& disparity,
+                             BBox2i const& tile,
+                             ImageView<PixelMask<PixelGray<float>>> & diff) {
+
+    ImageView<PixelMask<Vector2f>> disp = crop(disparity, tile);
+    ImageView<PixelGray<float>> left = crop(left_image, tile);
+
+    // The right image region the tile maps into, read once
+    BBox2i right_box;
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+        if (!is_valid(disp(col, row)))
+          continue;
+        Vector2 pix = Vector2(col + tile.min().x(), row + tile.min().y())
+          + Vector2(disp(col, row).child());
+        right_box.grow(Vector2i(floor(pix.x()), floor(pix.y())));
+      }
+    }
+    right_box.max() += Vector2i(2, 2); // for the bilinear neighbors
+    right_box.crop(bounding_box(right_image));
+
+    ImageView<PixelGray<float>> right;
+    if (!right_box.empty())
+      right = crop(right_image, right_box);
+
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+
+        PixelMask<PixelGray<float>> & out = diff(col + tile.min().x(), row + tile.min().y());
+        out = PixelMask<PixelGray<float>>(0.0f);
+        out.invalidate();
+        if (!is_valid(disp(col, row)) || right_box.empty())
+          continue;
+
+        double x = col + tile.min().x() + disp(col, row).child()[0] - right_box.min().x();
+        double y = row + tile.min().y() + disp(col, row).child()[1] - right_box.min().y();
+        int x0 = int(floor(x)), y0 = int(floor(y));
+        if (x0 < 0 || y0 < 0 || x0 + 1 >= right.cols() || y0 + 1 >= right.rows())
+          continue;
+
+        float wx = float(x - x0), wy = float(y - y0);
+        float val = (1.0f - wy) * ((1.0f - wx) * right(x0, y0)[0]     + wx * right(x0 + 1, y0)[0])
+          +                wy * ((1.0f - wx) * right(x0, y0 + 1)[0] + wx * right(x0 + 1, y0 + 1)[0]);
+        if (val == 0.0f)
+          continue;
+
+        out = PixelMask<PixelGray<float>>(std::abs(left(col, row)[0] - val));
+      }
+    }
+  }
+
+} // end anonymous namespace
+
 void asp::photometric_outlier_rejection(vw::GdalWriteOptions const& opt,
                                         std::string const& prefix,
                                         std::string const& input_disparity,
                                         std::string & output_disparity,
                                         int kernel_size) {
-  // Projecting right into perspective of left
-  DiskImageView<PixelGray<float>> right_disk_image(prefix+"-R.tif");
-  DiskImageView<PixelMask<Vector2f>> disparity_disk_image( input_disparity );
-  stereo::DisparityTransform trans( disparity_disk_image );
-
-  std::string cache_dir = "/tmp"; // modify here to use a different cache dir if needed
-  if (!fs::is_directory(cache_dir)) {
-    vw_out() << "\nCreating cache directory: " << cache_dir << std::endl;
-    fs::create_directories(cache_dir);
+
+  DiskImageView<PixelGray<float>> left_image(prefix + "-L.tif");
+  DiskImageView<PixelGray<float>> right_image(prefix + "-R.tif");
+  DiskImageView<PixelMask<Vector2f>> disparity_disk_image(input_disparity);
+
+  // Difference the left image and the right one projected into the
+  // perspective of the left one. This is done in one pass over tiles, in
+  // parallel, and kept in memory, as are the images derived from it below.
+  ImageView<PixelMask<PixelGray<float>>> diff(disparity_disk_image.cols(), disparity_disk_image.rows());
+  std::vector<BBox2i> tiles = subdivide_bbox(disparity_disk_image,
+                                             PHOTOMETRIC_TILE_SIZE, PHOTOMETRIC_TILE_SIZE);
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  TerminalProgressCallback tpc("asp", "\tDifference:");
+  int num_done = 0;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int it = 0; it < int(tiles.size()); it++) {
+    photometric_diff_tile(left_image, right_image, disparity_disk_image, tiles[it], diff);
+#pragma omp critical
+    {
+      num_done++;
+      tpc.report_fractional_progress(num_done, tiles.size());
+    }
   }
+  tpc.report_finished();
 
-  DiskCacheImageView<PixelGray<float>>
-    right_proj( transform( right_disk_image, trans, ZeroEdgeExtension()),
-                "tif", TerminalProgressCallback("asp","Projecting R:"), cache_dir);
-
-  // Differencing Left and Projected Right
-  ImageViewRef<PixelMask<PixelGray<float32>>> right_mask =
-    create_mask(right_proj);
-  DiskImageView<PixelGray<float32>> left_image(prefix+"-L.tif");
-  DiskCacheImageView<PixelGray<float>>
-    diff( abs(apply_mask(copy_mask(left_image,right_mask))-right_proj),
-          "tif", TerminalProgressCallback("asp","\tDifference:"),
-          cache_dir);
   ChannelAccumulator<math::CDFAccumulator<float32>> cdf;
   cdf.resize(8000,2001);
-  for_each_pixel(diff, cdf);
+  for_each_pixel(apply_mask(diff), cdf);
   float thresh = cdf.quantile(0.99985); // Pulling out last bin of CDF
   vw_out() << "\t  Using threshold: " << thresh << "\n";
 
   // Thresholding image and dilating
-  ImageView<PixelGray<float>> dust =
-    threshold(apply_mask(copy_mask(diff,right_mask)),thresh,1.0,0.0);
+  ImageView<PixelGray<float>> dust = threshold(apply_mask(diff), thresh, 1.0, 0.0);
   ImageView<PixelGray<float>> grass;
   grassfire(dust,grass);
   dust = gaussian_filter(grass,kernel_size/3);
 
   ImageViewRef<PixelMask<Vector2f>> cleaned_disparity =
     intersect_mask(disparity_disk_image,
-                   intersect_mask(create_mask(threshold(dust,kernel_size,0.0,1.0)),right_mask));
+                   intersect_mask(create_mask(threshold(dust,kernel_size,0.0,1.0)), diff));
 
-  vw::cartography::block_write_gdal_image(prefix + "-FDust.tif",
+  output_disparity = prefix + "-FDust.tif";
+  vw::cartography::block_write_gdal_image(output_disparity,
                           cleaned_disparity, opt,
                           TerminalProgressCallback("asp", "Dust Removal:") );
 }
@@ -37,11 +37,15 @@ Point2Grid::Point2Grid(int width, int height,
                        ImageView<double> & buffer, ImageView<double> & weights,
                        double x0, double y0, double grid_size, double min_spacing,
                        double radius, double sigma_factor,
-                       FilterType filter, double percentile):
+                       FilterType filter, double percentile,
+                       int max_cell_values):
   m_width(width), m_height(height),
-  m_buffer(buffer), m_weights(weights),
+  m_buffer(buffer), m_weights(weights), m_keep_vals(false),
+  m_max_cell_values(max_cell_values), m_rand_state(0x853c49e6748fea9bULL),
+  m_clear_value(0.0),
   m_x0(x0), m_y0(y0), m_grid_size(grid_size),
-  m_radius(radius), m_filter(filter), m_percentile(percentile){
+  m_radius(radius), m_filter(filter), m_percentile(percentile),
+  m_memory(telemetry().gauge("point2grid.buffers")) {
   
   if (m_grid_size <= 0)
     vw_throw( ArgumentErr() << "Point2Grid: Grid size must be > 0.\n" );
@@ -82,20 +86,53 @@ Point2Grid::Point2Grid(int width, int height,
 void Point2Grid::Clear(const float value) {
   m_buffer.set_size (m_width, m_height);
   m_weights.set_size (m_width, m_height);
+
+  // For the averaging filters start with zero sums, so that points can be
+  // added without checking if a grid point was seen before. Grid points
+  // with no values are set to the given value in normalize().
+  m_clear_value = value;
+  double start_value = value;
+  if (m_filter == f_weighted_average || m_filter == f_mean)
+    start_value = 0.0;
+  
   for (int c = 0; c < m_buffer.cols(); c++){
     for (int r = 0; r < m_buffer.rows(); r++){
-      m_buffer (c, r) = value; // usually this is the no-data value
+      m_buffer (c, r) = start_value; // usually this is the no-data value
       m_weights(c, r) = 0.0;
     }
   }
 
   // For these we need to keep all values (in fact, for stddev we could get away with less,
   // but it is not worth trying so hard).
-  if (m_filter == f_median || m_filter == f_stddev ||
-      m_filter == f_nmad   || m_filter == f_percentile) {
-    m_vals.set_size(m_width, m_height);
+  m_keep_vals = (m_filter == f_median || m_filter == f_stddev ||
+                 m_filter == f_nmad   || m_filter == f_percentile);
+  if (m_keep_vals) {
+    m_arena.clear();
+    m_next_chunk.clear();
+    m_first_chunk.set_size(m_width, m_height);
+    m_last_chunk.set_size(m_width, m_height);
+    m_num_kept.set_size(m_width, m_height);
+    m_num_vals.set_size(m_width, m_height);
+    for (int c = 0; c < m_width; c++) {
+      for (int r = 0; r < m_height; r++) {
+        m_first_chunk(c, r) = -1;
+        m_last_chunk(c, r)  = -1;
+        m_num_kept(c, r)    = 0;
+        m_num_vals(c, r)    = 0;
+      }
+    }
   }
-  
+
+  update_memory();
+}
+
+void Point2Grid::update_memory() {
+  std::int64_t num = std::int64_t(m_buffer.cols()) * m_buffer.rows();
+  std::int64_t bytes = 2 * num * sizeof(double);
+  if (m_keep_vals)
+    bytes += m_arena.capacity() * sizeof(double) + m_next_chunk.capacity() * sizeof(int)
+      + num * (3 * sizeof(int) + sizeof(vw::int64));
+  m_memory.set(bytes);
 }
 
 void Point2Grid::AddPoint(double x, double y, double z){
@@ -150,9 +187,8 @@ void Point2Grid::AddPoint(double x, double y, double z){
         }else
           m_weights(ix, iy) += 1;
         
-      }else if (m_filter == f_stddev || m_filter == f_median ||
-                m_filter == f_nmad   || m_filter == f_percentile){
-        m_vals(ix, iy).push_back(z); // not strictly needed for stddev
+      }else if (m_keep_vals){
+        add_val(ix, iy, z); // not strictly needed for stddev
       }
       
     }
@@ -160,45 +196,146 @@ void Point2Grid::AddPoint(double x, double y, double z){
   }
 }
 
+void Point2Grid::AddPoints(std::vector<vw::Vector3> const& points){
+
+  if (m_filter != f_weighted_average && m_filter != f_mean) {
+    for (size_t it = 0; it < points.size(); it++)
+      AddPoint(points[it][0], points[it][1], points[it][2]);
+    return;
+  }
+
+  bool   use_gauss = (m_filter == f_weighted_average);
+  double radius2   = m_radius*m_radius;
+  int    num_gauss = m_sampled_gauss.size();
+  const double * gauss = use_gauss ? &m_sampled_gauss[0] : NULL;
+  
+  for (size_t it = 0; it < points.size(); it++) {
+    double x = points[it][0], y = points[it][1], z = points[it][2];
+    
+    int miny = std::max( (int)ceil( (y - m_radius - m_y0)/m_grid_size ), 0 );
+    int maxy = std::min( (int)floor( (y + m_radius - m_y0)/m_grid_size ), m_buffer.rows() - 1 );
+
+    // Visit the grid points row by row, as they are stored. In each row
+    // only the span of the circle is visited, and the inner loop has no
+    // branches, so that the compiler can vectorize it.
+    for (int iy = miny; iy <= maxy; iy++){
+      double gy  = m_y0 + iy*m_grid_size;
+      double dy2 = (y-gy)*(y-gy);
+      if (dy2 > radius2)
+        continue;
+      double half_width = sqrt(radius2 - dy2);
+      int minx = std::max( (int)ceil( (x - half_width - m_x0)/m_grid_size ), 0 );
+      int maxx = std::min( (int)floor( (x + half_width - m_x0)/m_grid_size ),
+                           m_buffer.cols() - 1 );
+      if (minx > maxx)
+        continue;
+
+      double * buf = &m_buffer(minx, iy);
+      double * wts = &m_weights(minx, iy);
+      int len = maxx - minx + 1;
+      for (int k = 0; k < len; k++) {
+        double gx   = m_x0 + (minx + k)*m_grid_size;
+        double dist2 = (x-gx)*(x-gx) + dy2;
+        double wt = (dist2 <= radius2) ? 1.0 : 0.0; // guard against rounding
+        if (use_gauss) {
+          int index = std::min((int)round(sqrt(dist2)/m_dx), num_gauss - 1);
+          wt *= gauss[index];
+        }
+        buf[k] += z*wt;
+        wts[k] += wt;
+      }
+    }
+  }
+}
+
+void Point2Grid::add_val(int ix, int iy, double z) {
+
+  int & num_kept = m_num_kept(ix, iy); // alias
+  vw::int64 & num_vals = m_num_vals(ix, iy); // alias
+  num_vals++;
+
+  if (m_max_cell_values <= 0 || num_kept < m_max_cell_values) {
+    // Append, starting a new chunk if the last one is full
+    if (num_kept % CHUNK_SIZE == 0) {
+      int chunk = m_next_chunk.size();
+      size_t capacity = m_arena.capacity();
+      m_next_chunk.push_back(-1);
+      m_arena.resize(m_arena.size() + CHUNK_SIZE);
+      if (m_arena.capacity() != capacity)
+        update_memory();
+      if (m_last_chunk(ix, iy) < 0)
+        m_first_chunk(ix, iy) = chunk;
+      else
+        m_next_chunk[m_last_chunk(ix, iy)] = chunk;
+      m_last_chunk(ix, iy) = chunk;
+    }
+    m_arena[m_last_chunk(ix, iy) * CHUNK_SIZE + num_kept % CHUNK_SIZE] = z;
+    num_kept++;
+    return;
+  }
+
+  // Keep each of the values seen so far with equal probability. Use an
+  // xorshift generator, as this is called very many times.
+  m_rand_state ^= m_rand_state << 13;
+  m_rand_state ^= m_rand_state >> 7;
+  m_rand_state ^= m_rand_state << 17;
+  vw::uint64 pos = m_rand_state % vw::uint64(num_vals);
+  if (pos >= vw::uint64(m_max_cell_values))
+    return;
+  int chunk = m_first_chunk(ix, iy);
+  for (vw::uint64 it = 0; it < pos / CHUNK_SIZE; it++)
+    chunk = m_next_chunk[chunk];
+  m_arena[chunk * CHUNK_SIZE + pos % CHUNK_SIZE] = z;
+}
+
+void Point2Grid::get_vals(int ix, int iy, std::vector<double> & vals) const {
+  vals.clear();
+  int num_left = m_num_kept(ix, iy);
+  for (int chunk = m_first_chunk(ix, iy); chunk >= 0; chunk = m_next_chunk[chunk]) {
+    int len = std::min(num_left, int(CHUNK_SIZE));
+    const double * beg = &m_arena[chunk * CHUNK_SIZE];
+    vals.insert(vals.end(), beg, beg + len);
+    num_left -= len;
+  }
+}
+
 void Point2Grid::normalize(){
+
+  // Reused for each grid point, so it is allocated only a few times
+  std::vector<double> vals;
+  
   for (int c = 0; c < m_buffer.cols(); c++){
     for (int r = 0; r < m_buffer.rows(); r++){
 
       if (m_filter == f_weighted_average || m_filter == f_mean) {
         if (m_weights(c, r) > 0)
           m_buffer (c, r) /= m_weights(c, r);
+        else
+          m_buffer (c, r) = m_clear_value;
 
       }else if (m_filter == f_count)
         m_buffer(c, r) = m_weights(c, r); // hence instead of no-data we will have always 0
 
-      else if (m_filter == f_stddev){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
-        vw::math::StdDevAccumulator<double> V;
-        for (size_t it = 0; it < m_vals(c, r).size(); it++) 
-          V(m_vals(c, r)[it]);
-        m_buffer(c, r) = V.value();
-      }
-      
-      else if (m_filter == f_median){
-        if (m_vals(c, r).empty())
+      else if (m_keep_vals) {
+        get_vals(c, r, vals);
+        if (vals.empty())
           continue; // nothing to compute
-        vw::math::MedianAccumulator<double> V;
-        for (size_t it = 0; it < m_vals(c, r).size(); it++) 
-          V(m_vals(c, r)[it]);
-        m_buffer(c, r) = V.value();
-      }
 
-      else if (m_filter == f_nmad){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
-        m_buffer(c, r) = vw::math::destructive_nmad(m_vals(c, r));
-      }
-      
-      else if (m_filter == f_percentile){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
-        m_buffer(c, r) = vw::math::destructive_percentile(m_vals(c, r), m_percentile);
+        if (m_filter == f_stddev) {
+          vw::math::StdDevAccumulator<double> V;
+          for (size_t it = 0; it < vals.size(); it++) 
+            V(vals[it]);
+          m_buffer(c, r) = V.value();
+        } else if (m_filter == f_median) {
+          vw::math::MedianAccumulator<double> V;
+          for (size_t it = 0; it < vals.size(); it++) 
+            V(vals[it]);
+          m_buffer(c, r) = V.value();
+        } else if (m_filter == f_nmad) {
+          m_buffer(c, r) = vw::math::destructive_nmad(vals);
+        } else if (m_filter == f_percentile) {
+          m_buffer(c, r) = vw::math::destructive_percentile(vals, m_percentile);
+        }
       }
       
     }
@@ -22,7 +22,12 @@
 #ifndef __VW_POINT2GRID_H__
 #define __VW_POINT2GRID_H__
 
+#include <asp/Core/Telemetry.h>
 #include <vw/Image/ImageView.h>
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Math/Vector.h>
+
+#include <vector>
 
 namespace asp {
 
@@ -33,6 +38,13 @@ namespace asp {
   /// Given a set of xyz points, create an xy grid. For every node in the
   /// grid, combine all points within given radius of the grid point and
   /// calculate a single z value at the grid point.
+  ///
+  /// The median, stddev, nmad, and percentile filters need all values at a
+  /// grid point. These are stored in one flat arena, in chunks of a few
+  /// values chained per grid point, rather than in a vector per grid point,
+  /// to avoid very many small allocations. If max_cell_values is positive,
+  /// at most that many are kept, as a uniform random sample of all of them
+  /// (reservoir sampling), which bounds the memory use for dense clouds.
   class Point2Grid {
 
   public:
@@ -41,17 +53,40 @@ namespace asp {
                double x0, double y0,
                double grid_size, double min_spacing, double radius,
                double sigma_factor,
-               FilterType filter, double percentile);
+               FilterType filter, double percentile,
+               int max_cell_values = 0);
     ~Point2Grid(){}
     void Clear    (const float val);
     void AddPoint (double x, double y, double z);
+
+    /// Add many points at once, as (x, y, z) values. This is faster than
+    /// adding them one at a time for the weighted average and mean filters.
+    void AddPoints(std::vector<vw::Vector3> const& points);
     void normalize();
 
   private:
+    // Store a value for a grid point, and get all values for it
+    void add_val(int ix, int iy, double z);
+    void get_vals(int ix, int iy, std::vector<double> & vals) const;
+
+    // Report the memory of the buffers, for memory profiling
+    void update_memory();
+
     int m_width, m_height; // DEM dimensions
     vw::ImageView<double> & m_buffer;
     vw::ImageView<double> & m_weights;
-    vw::ImageView< std::vector<double> > m_vals; // when need to keep all individual values
+
+    // When need to keep all individual values
+    static const int CHUNK_SIZE = 8;
+    bool                 m_keep_vals;
+    std::vector<double>  m_arena;      // CHUNK_SIZE values per chunk
+    std::vector<int>     m_next_chunk; // next chunk for the same grid point, or -1
+    vw::ImageView<int>   m_first_chunk, m_last_chunk; // -1 if no values
+    vw::ImageView<int>   m_num_kept;   // number of values stored
+    vw::ImageView<vw::int64> m_num_vals; // number of values seen, when sampling them
+    int        m_max_cell_values;
+    vw::uint64 m_rand_state; // for reproducible sampling
+    double     m_clear_value; // for grid points with no values
     double     m_x0, m_y0; // lower-left corner
     double     m_grid_size;  // spacing between output DEM pixels
     double     m_radius;   // how far to search for cloud points
@@ -59,6 +94,7 @@ namespace asp {
     std::vector<double> m_sampled_gauss;
     FilterType m_filter;
     double     m_percentile; // The actual value of the percentile to use if in that mode
+    TelemetryGaugeScope m_memory; // the bytes in the buffers
 
   };
 
@@ -0,0 +1,176 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+/// \file PointCloudCache.cc
+///
+
+#include <asp/Core/PointCloudCache.h>
+#include <asp/Core/TrackStore.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Cartography/Datum.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  const char POINT_CLOUD_CACHE_MAGIC[8] = {'A', 'S', 'P', 'C', 'L', 'O', 'U', 'D'};
+  const std::int64_t POINT_CLOUD_CACHE_VERSION = 1;
+
+  // The file starts with this, followed by the shifted xyz of all
+  // points, then by their lon-lat.
+  struct PointCloudCacheHeader {
+    char          magic[8];
+    std::int64_t  version;
+    std::uint64_t key;
+    std::int64_t  num_points;
+    std::int64_t  is_lola_rdr_format;
+    double        shift[3];
+    double        median_longitude;
+  };
+
+  std::size_t data_size(std::int64_t num_points) {
+    return sizeof(PointCloudCacheHeader) + sizeof(double) * 5 * num_points;
+  }
+
+} // end anonymous namespace
+
+PointCloudCache::PointCloudCache(): m_num_points(0), m_median_longitude(0.0),
+                                    m_is_lola_rdr_format(false),
+                                    m_xyz(NULL), m_lonlat(NULL) {}
+
+std::uint64_t PointCloudCache::make_key(std::string const& cloud_file,
+                                        std::string const& options) {
+  std::uint64_t key = TrackStore::hash(0, fs::absolute(cloud_file).string());
+  key = TrackStore::hash(key, std::to_string(fs::file_size(cloud_file)));
+  key = TrackStore::hash(key, std::to_string(fs::last_write_time(cloud_file)));
+  return TrackStore::hash(key, options);
+}
+
+void PointCloudCache::write(std::string const& file, std::uint64_t key,
+                            DoubleMatrix const& points, vw::Vector3 const& shift,
+                            vw::cartography::Datum const& datum,
+                            double median_longitude, bool is_lola_rdr_format) {
+
+  PointCloudCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, POINT_CLOUD_CACHE_MAGIC, sizeof(header.magic));
+  header.version            = POINT_CLOUD_CACHE_VERSION;
+  header.key                = key;
+  header.num_points         = points.cols();
+  header.is_lola_rdr_format = is_lola_rdr_format;
+  header.median_longitude   = median_longitude;
+  for (int c = 0; c < 3; c++)
+    header.shift[c] = shift[c];
+
+  std::int64_t num_points = points.cols();
+  std::vector<double> xyz(3 * num_points), lonlat(2 * num_points);
+  for (std::int64_t it = 0; it < num_points; it++) {
+    vw::Vector3 p;
+    for (int c = 0; c < 3; c++) {
+      xyz[3 * it + c] = points(c, it);
+      p[c] = points(c, it) + shift[c];
+    }
+    vw::Vector3 llh = datum.cartesian_to_geodetic(p);
+    llh[0] += 360.0 * round((median_longitude - llh[0]) / 360.0); // 360 deg adjust
+    lonlat[2 * it] = llh[0];
+    lonlat[2 * it + 1] = llh[1];
+  }
+
+  // Write to a temporary file and rename it, so that an interrupted
+  // run does not leave behind a partial file.
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+    ofs.write((const char*)&header, sizeof(header));
+    if (num_points > 0) {
+      ofs.write((const char*)&xyz[0], sizeof(double) * xyz.size());
+      ofs.write((const char*)&lonlat[0], sizeof(double) * lonlat.size());
+    }
+    if (!ofs)
+      vw::vw_throw(vw::IOErr() << "Failed to write: " << tmp_file << ".\n");
+  }
+  fs::rename(tmp_file, file);
+}
+
+bool PointCloudCache::read(std::string const& file, std::uint64_t key) {
+
+  if (!fs::exists(file))
+    return false;
+
+  boost::shared_ptr<boost::iostreams::mapped_file_source>
+    mapped(new boost::iostreams::mapped_file_source(file));
+  if (!mapped->is_open() || mapped->size() < sizeof(PointCloudCacheHeader))
+    return false;
+
+  PointCloudCacheHeader header;
+  std::memcpy(&header, mapped->data(), sizeof(header));
+  if (std::memcmp(header.magic, POINT_CLOUD_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != POINT_CLOUD_CACHE_VERSION || header.key != key ||
+      header.num_points < 0 || mapped->size() != data_size(header.num_points)) {
+    vw::vw_out() << "Ignoring: " << file << ", as it does not match the inputs.\n";
+    return false;
+  }
+
+  m_file = mapped;
+  m_num_points         = header.num_points;
+  m_is_lola_rdr_format = (header.is_lola_rdr_format != 0);
+  m_median_longitude   = header.median_longitude;
+  m_shift              = vw::Vector3(header.shift[0], header.shift[1], header.shift[2]);
+  m_xyz                = (const double*)(m_file->data() + sizeof(PointCloudCacheHeader));
+  m_lonlat             = m_xyz + 3 * m_num_points;
+  return true;
+}
+
+void PointCloudCache::load(vw::BBox2 const& lonlat_box, std::int64_t num_points_to_load,
+                           vw::Vector3 & shift, DoubleMatrix & data) const {
+
+  shift = m_shift;
+
+  // Find the points in the box first, to allocate the output once
+  std::vector<std::int64_t> indices;
+  for (std::int64_t it = 0; it < m_num_points; it++) {
+    vw::Vector2 ll(m_lonlat[2 * it], m_lonlat[2 * it + 1]);
+    if (!lonlat_box.empty() && !lonlat_box.contains(ll)
+        && !lonlat_box.contains(ll + vw::Vector2(360, 0))
+        && !lonlat_box.contains(ll - vw::Vector2(360, 0)))
+      continue;
+    indices.push_back(it);
+  }
+
+  data.resize(DIM + 1, indices.size());
+  for (std::int64_t col = 0; col < std::int64_t(indices.size()); col++) {
+    const double * p = m_xyz + 3 * indices[col];
+    for (int row = 0; row < DIM; row++)
+      data(row, col) = p[row];
+    data(DIM, col) = 1; // Extend to be a homogenous coordinate
+  }
+
+  if (data.cols() > num_points_to_load)
+    random_pc_subsample(num_points_to_load, data);
+}
+
+} // end namespace asp
@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+/// \file PointCloudCache.h
+///
+/// A sample of a point cloud, saved to disk with the longitude and
+/// latitude of each point, so that later runs can memory-map it rather
+/// than read and sample the original cloud again. This is used by
+/// pc_align when many clouds are aligned to the same large reference.
+
+#ifndef __ASP_CORE_POINT_CLOUD_CACHE_H__
+#define __ASP_CORE_POINT_CLOUD_CACHE_H__
+
+#include <asp/Core/EigenUtils.h>
+
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace boost {
+  namespace iostreams {
+    class mapped_file_source;
+  }
+}
+
+namespace vw {
+  namespace cartography {
+    class Datum;
+  }
+}
+
+namespace asp {
+
+  class PointCloudCache {
+  public:
+    PointCloudCache();
+
+    /// A key identifying a cloud file, by its name, size, and
+    /// modification time, and the options it was loaded with
+    static std::uint64_t make_key(std::string const& cloud_file,
+                                  std::string const& options);
+
+    /// Save points stored as in load_cloud(), with the given shift
+    /// already subtracted. The longitudes are made to be within 180
+    /// degrees of the median longitude.
+    static void write(std::string const& file, std::uint64_t key,
+                      DoubleMatrix const& points, vw::Vector3 const& shift,
+                      vw::cartography::Datum const& datum,
+                      double median_longitude, bool is_lola_rdr_format);
+
+    /// Memory-map a file saved with write(). Return false, leaving this
+    /// unchanged, if the file does not exist, or if is not valid or was
+    /// saved with a different key.
+    bool read(std::string const& file, std::uint64_t key);
+
+    /// Copy the points within the lon-lat box, or all if it is empty,
+    /// in the format of load_cloud(), picking at most the given number
+    /// of them at random. The points are relative to the returned shift.
+    void load(vw::BBox2 const& lonlat_box, std::int64_t num_points_to_load,
+              vw::Vector3 & shift, DoubleMatrix & data) const;
+
+    std::int64_t num_points        () const { return m_num_points;         }
+    double       median_longitude  () const { return m_median_longitude;   }
+    bool         is_lola_rdr_format() const { return m_is_lola_rdr_format; }
+
+  private:
+    boost::shared_ptr<boost::iostreams::mapped_file_source> m_file;
+    std::int64_t m_num_points;
+    double m_median_longitude;
+    bool m_is_lola_rdr_format;
+    vw::Vector3 m_shift;
+    const double * m_xyz;
+    const double * m_lonlat;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_POINT_CLOUD_CACHE_H__
@@ -0,0 +1,205 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PointCloudStats.cc
+///
+
+#include <asp/Core/PointCloudStats.h>
+
+#include <vw/Core/Log.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iomanip>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+int error_hist_bin(double err) {
+  int bin = int(floor(ERROR_HIST_BINS_PER_DECADE * log10(err / ERROR_HIST_MIN)));
+  return std::max(0, std::min(ERROR_HIST_NUM_BINS - 1, bin));
+}
+
+vw::int64 CloudStats::num_valid() const {
+  vw::int64 count = 0;
+  for (size_t it = 0; it < tiles.size(); it++)
+    count += tiles[it].num_valid;
+  return count;
+}
+
+vw::BBox3 CloudStats::point_box() const {
+  vw::BBox3 box;
+  for (size_t it = 0; it < tiles.size(); it++)
+    if (tiles[it].num_valid > 0)
+      box.grow(tiles[it].point_box);
+  return box;
+}
+
+vw::Vector3 CloudStats::mean_point() const {
+  vw::Vector3 sum;
+  for (size_t it = 0; it < tiles.size(); it++)
+    sum += tiles[it].point_sum;
+  vw::int64 count = num_valid();
+  if (count == 0)
+    return vw::Vector3();
+  return sum / double(count);
+}
+
+// Use the middle of the bin in log scale
+double CloudStats::error_percentile(double pct) const {
+  vw::int64 total = 0;
+  for (size_t it = 0; it < error_hist.size(); it++)
+    total += error_hist[it];
+  if (total == 0)
+    return 0.0;
+
+  double target = pct / 100.0 * double(total);
+  vw::int64 count = 0;
+  for (size_t it = 0; it < error_hist.size(); it++) {
+    count += error_hist[it];
+    if (double(count) >= target)
+      return ERROR_HIST_MIN * pow(10.0, (it + 0.5) / ERROR_HIST_BINS_PER_DECADE);
+  }
+  return ERROR_HIST_MIN * pow(10.0, (error_hist.size() - 0.5) / ERROR_HIST_BINS_PER_DECADE);
+}
+
+std::string cloud_stats_file(std::string const& pc_file) {
+  return fs::path(pc_file).replace_extension("").string() + "-stats.txt";
+}
+
+void write_cloud_stats(std::string const& stats_file, CloudStats const& stats) {
+
+  vw::vw_out() << "Writing: " << stats_file << std::endl;
+  std::ofstream ofs(stats_file.c_str());
+  if (!ofs) {
+    // The statistics are only an optimization
+    vw::vw_out(vw::WarningMessage) << "Cannot write: " << stats_file << "\n";
+    return;
+  }
+  ofs << std::setprecision(17);
+
+  ofs << "# ASP point cloud statistics\n";
+  ofs << "image_size " << stats.image_size[0] << " " << stats.image_size[1] << "\n";
+
+  ofs << "error_hist " << ERROR_HIST_MIN << " " << ERROR_HIST_BINS_PER_DECADE << " "
+      << stats.error_hist.size();
+  for (size_t it = 0; it < stats.error_hist.size(); it++)
+    ofs << " " << stats.error_hist[it];
+  ofs << "\n";
+
+  // One line per tile: pixel box, count, point box, point sum, lon range, max error
+  ofs << "num_tiles " << stats.tiles.size() << "\n";
+  for (size_t it = 0; it < stats.tiles.size(); it++) {
+    CloudTileStats const& t = stats.tiles[it];
+    ofs << t.pixel_box.min().x() << " " << t.pixel_box.min().y() << " "
+        << t.pixel_box.width()   << " " << t.pixel_box.height()  << " "
+        << t.num_valid;
+    vw::BBox3 box = t.point_box;
+    if (t.num_valid == 0)
+      box = vw::BBox3(vw::Vector3(), vw::Vector3()); // avoid writing infinities
+    for (int c = 0; c < 3; c++) ofs << " " << box.min()[c];
+    for (int c = 0; c < 3; c++) ofs << " " << box.max()[c];
+    for (int c = 0; c < 3; c++) ofs << " " << t.point_sum[c];
+    ofs << " " << t.min_lon << " " << t.max_lon << " " << t.max_error << "\n";
+  }
+
+  if (!ofs)
+    vw::vw_out(vw::WarningMessage) << "Failed writing: " << stats_file << "\n";
+}
+
+bool read_cloud_stats(std::string const& pc_file, CloudStats & stats) {
+
+  stats = CloudStats();
+  std::string stats_file = cloud_stats_file(pc_file);
+  if (!fs::exists(stats_file) || !fs::exists(pc_file) ||
+      fs::last_write_time(stats_file) < fs::last_write_time(pc_file))
+    return false;
+
+  std::ifstream ifs(stats_file.c_str());
+  std::string line, key;
+  std::getline(ifs, line); // comment
+
+  size_t num_bins = 0, num_tiles = 0;
+  double hist_min = 0;
+  int bins_per_decade = 0;
+  if (!(ifs >> key >> stats.image_size[0] >> stats.image_size[1]) || key != "image_size")
+    return false;
+  if (!(ifs >> key >> hist_min >> bins_per_decade >> num_bins) || key != "error_hist" ||
+      hist_min != ERROR_HIST_MIN || bins_per_decade != ERROR_HIST_BINS_PER_DECADE)
+    return false;
+  stats.error_hist.resize(num_bins);
+  for (size_t it = 0; it < num_bins; it++)
+    if (!(ifs >> stats.error_hist[it]))
+      return false;
+
+  if (!(ifs >> key >> num_tiles) || key != "num_tiles")
+    return false;
+  stats.tiles.resize(num_tiles);
+  for (size_t it = 0; it < num_tiles; it++) {
+    CloudTileStats & t = stats.tiles[it];
+    int x, y, w, h;
+    vw::Vector3 min_pt, max_pt;
+    if (!(ifs >> x >> y >> w >> h >> t.num_valid
+          >> min_pt[0] >> min_pt[1] >> min_pt[2] >> max_pt[0] >> max_pt[1] >> max_pt[2]
+          >> t.point_sum[0] >> t.point_sum[1] >> t.point_sum[2]
+          >> t.min_lon >> t.max_lon >> t.max_error))
+      return false;
+    t.pixel_box = vw::BBox2i(x, y, w, h);
+    if (t.num_valid > 0) {
+      t.point_box.grow(min_pt);
+      t.point_box.grow(max_pt);
+    }
+  }
+
+  // The cloud must not have been replaced by one of a different size
+  try {
+    boost::shared_ptr<vw::DiskImageResource> rsrc(new vw::DiskImageResourceGDAL(pc_file));
+    if (rsrc->cols() != stats.image_size[0] || rsrc->rows() != stats.image_size[1])
+      return false;
+  } catch (...) {
+    return false;
+  }
+
+  return true;
+}
+
+void CloudStatsCollector::add(CloudTileStats const& tile,
+                              std::vector<vw::int64> const& error_hist) {
+  std::vector<int> key = {tile.pixel_box.min().x(), tile.pixel_box.min().y(),
+                          tile.pixel_box.max().x(), tile.pixel_box.max().y()};
+  vw::Mutex::Lock lock(m_mutex);
+  m_tiles[key] = std::make_pair(tile, error_hist);
+}
+
+CloudStats CloudStatsCollector::stats(vw::Vector2i const& image_size) {
+  vw::Mutex::Lock lock(m_mutex);
+  CloudStats stats;
+  stats.image_size = image_size;
+  stats.error_hist.resize(ERROR_HIST_NUM_BINS, 0);
+  for (auto it = m_tiles.begin(); it != m_tiles.end(); it++) {
+    stats.tiles.push_back(it->second.first);
+    std::vector<vw::int64> const& hist = it->second.second;
+    for (size_t b = 0; b < hist.size() && b < stats.error_hist.size(); b++)
+      stats.error_hist[b] += hist[b];
+  }
+  return stats;
+}
+
+} // end namespace asp
@@ -0,0 +1,204 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PointCloudStats.h
+///
+/// Statistics of a point cloud, collected per tile while the cloud is
+/// written, and saved in a small text file next to it. Tools which need
+/// the number of points, their bounding box, the average location, or
+/// the distribution of triangulation errors can read this file instead
+/// of scanning the cloud.
+
+#ifndef __ASP_CORE_POINT_CLOUD_STATS_H__
+#define __ASP_CORE_POINT_CLOUD_STATS_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The error histogram has this many bins per decade, starting at
+  /// ERROR_HIST_MIN meters. Errors outside the range go to the end bins.
+  const int    ERROR_HIST_BINS_PER_DECADE = 10;
+  const int    ERROR_HIST_NUM_BINS        = 100;
+  const double ERROR_HIST_MIN             = 1e-4;
+
+  /// The histogram bin for a positive error
+  int error_hist_bin(double err);
+
+  /// Statistics of the valid points in one tile of a cloud. The points
+  /// are in the coordinates of the cloud (usually ECEF). Longitudes are
+  /// in degrees, in [-180, 180].
+  struct CloudTileStats {
+    vw::BBox2i   pixel_box;
+    vw::int64    num_valid;
+    vw::BBox3    point_box;
+    vw::Vector3  point_sum;
+    double       min_lon, max_lon;
+    double       max_error; // 0 if the cloud has no error channel
+    CloudTileStats(): num_valid(0), min_lon(0), max_lon(0), max_error(0) {}
+  };
+
+  /// Statistics of a whole cloud
+  struct CloudStats {
+    vw::Vector2i                image_size;
+    std::vector<CloudTileStats> tiles;
+    std::vector<vw::int64>      error_hist; // counts of positive errors
+
+    vw::int64   num_valid()  const;
+    vw::BBox3   point_box()  const;
+    vw::Vector3 mean_point() const; // the zero vector if there are no points
+
+    /// Approximate a percentile (in [0, 100]) of the errors from the
+    /// histogram. Return 0 if there are no errors.
+    double error_percentile(double pct) const;
+  };
+
+  /// The statistics file for a cloud, such as run/run-PC-stats.txt for
+  /// run/run-PC.tif.
+  std::string cloud_stats_file(std::string const& pc_file);
+
+  /// Write the statistics. Failure is not fatal, as they are only an
+  /// optimization.
+  void write_cloud_stats(std::string const& stats_file, CloudStats const& stats);
+
+  /// Read the statistics of a cloud. Return false if there is no
+  /// statistics file, or it is older than the cloud, or it does not
+  /// match the size of the cloud.
+  bool read_cloud_stats(std::string const& pc_file, CloudStats & stats);
+
+  /// Gathers the statistics of the tiles of a cloud from several threads.
+  /// A tile that is seen again replaces the earlier record, so a tile
+  /// which is rasterized twice is not counted twice.
+  class CloudStatsCollector {
+    vw::Mutex m_mutex;
+    std::map<std::vector<int>, std::pair<CloudTileStats, std::vector<vw::int64>>> m_tiles;
+  public:
+    void add(CloudTileStats const& tile, std::vector<vw::int64> const& error_hist);
+    CloudStats stats(vw::Vector2i const& image_size);
+  };
+
+  /// The triangulation error of a cloud pixel
+  inline double cloud_error(vw::Vector3 const& p, bool error_is_vector) {
+    return 0.0;
+  }
+  inline double cloud_error(vw::Vector4 const& p, bool error_is_vector) {
+    return p[3];
+  }
+  inline double cloud_error(vw::Vector6 const& p, bool error_is_vector) {
+    if (error_is_vector)
+      return norm_2(subvector(p, 3, 3));
+    return p[3];
+  }
+
+  /// Pass a cloud through unchanged, while recording the statistics of
+  /// each tile that is rasterized. The first three channels are the
+  /// point and the zero point is invalid. The error is the fourth
+  /// channel, or, if error_is_vector is true, the norm of the channels
+  /// four to six.
+  template <class ImageT>
+  class CloudStatsView: public vw::ImageViewBase<CloudStatsView<ImageT>> {
+    ImageT m_cloud;
+    bool   m_error_is_vector;
+    boost::shared_ptr<CloudStatsCollector> m_collector;
+
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef typename ImageT::result_type result_type;
+    typedef typename ImageT::pixel_accessor pixel_accessor;
+
+    CloudStatsView(vw::ImageViewBase<ImageT> const& cloud, bool error_is_vector,
+                   boost::shared_ptr<CloudStatsCollector> collector):
+      m_cloud(cloud.impl()), m_error_is_vector(error_is_vector), m_collector(collector) {}
+
+    inline vw::int32 cols  () const { return m_cloud.cols(); }
+    inline vw::int32 rows  () const { return m_cloud.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return m_cloud.origin(); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p=0) const {
+      return m_cloud(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      vw::ImageView<pixel_type> tile = crop(m_cloud, bbox);
+
+      CloudTileStats stats;
+      stats.pixel_box = bbox;
+      std::vector<vw::int64> error_hist(ERROR_HIST_NUM_BINS, 0);
+      for (int row = 0; row < tile.rows(); row++) {
+        for (int col = 0; col < tile.cols(); col++) {
+          pixel_type const& p = tile(col, row);
+          vw::Vector3 xyz(p[0], p[1], p[2]);
+          if (xyz == vw::Vector3())
+            continue;
+
+          double lon = atan2(xyz[1], xyz[0]) * 180.0 / M_PI;
+          if (stats.num_valid == 0) {
+            stats.min_lon = lon;
+            stats.max_lon = lon;
+          }
+          stats.min_lon = std::min(stats.min_lon, lon);
+          stats.max_lon = std::max(stats.max_lon, lon);
+          stats.num_valid++;
+          stats.point_box.grow(xyz);
+          stats.point_sum += xyz;
+
+          double err = cloud_error(p, m_error_is_vector);
+          if (err > 0) {
+            error_hist[error_hist_bin(err)]++;
+            stats.max_error = std::max(stats.max_error, err);
+          }
+        }
+      }
+      m_collector->add(stats, error_hist);
+
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  CloudStatsView<ImageT>
+  collect_cloud_stats(vw::ImageViewBase<ImageT> const& cloud, bool error_is_vector,
+                      boost::shared_ptr<CloudStatsCollector> collector) {
+    return CloudStatsView<ImageT>(cloud, error_is_vector, collector);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_POINT_CLOUD_STATS_H__
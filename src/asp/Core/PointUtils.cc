@@ -30,10 +30,15 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/PointUtils.h>
+#include <asp/Core/CsvParse.h>
+#include <asp/Core/PointCloudStats.h>
 #include <vw/Cartography/Chipper.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/BlockRasterize.h>
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/math/special_functions/next.hpp>
+#include <boost/noncopyable.hpp>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -467,6 +472,12 @@ void asp::CsvConv::parse_csv_format(std::string const& csv_format_str,
     this->col2name[col]  = name;
   }
   this->num_fields = this->name2col.size();
+
+  // A table of the columns to read, for parse_csv_chars()
+  if (!this->col2name.empty())
+    this->col_kinds.resize(this->col2name.rbegin()->first + 1, CSV_SKIP_COL);
+  for (auto it = this->col2name.begin(); it != this->col2name.end(); it++)
+    this->col_kinds[it->first] = (it->second == "file") ? CSV_FILE_COL : CSV_NUMBER_COL;
   const int MAX_NUM_FIELDS = 4; // Location and a file
   if ((this->num_fields < min_num_fields) || (this->num_fields > MAX_NUM_FIELDS))
     vw_throw(ArgumentErr() << "Invalid number of column indices in: '" << csv_format_str << "'\n");
@@ -626,6 +637,51 @@ asp::CsvConv::CsvRecord asp::CsvConv::parse_csv_line(bool & is_first_line, bool
   return values;
 }
 
+bool asp::CsvConv::parse_csv_chars(const char* begin, const char* end,
+                                   CsvRecord & record) const {
+
+  if (!asp::is_valid_csv_chars(begin, end))
+    return false;
+
+  record.file.clear();
+  int num_floats_read = 0;
+  int num_values_read = 0;
+  size_t col_index = 0;
+  const char* ptr = begin;
+  while (num_values_read < this->num_fields && col_index < this->col_kinds.size()) {
+
+    // Find the next token. Repeated separators count as one, as with strtok().
+    while (ptr < end && asp::is_csv_separator(*ptr))
+      ptr++;
+    if (ptr >= end)
+      break; // no more tokens
+    const char* token_end = ptr;
+    while (token_end < end && !asp::is_csv_separator(*token_end))
+      token_end++;
+
+    char kind = this->col_kinds[col_index];
+    if (kind == CSV_FILE_COL) {
+      record.file.assign(ptr, token_end);
+      num_values_read++;
+    } else if (kind == CSV_NUMBER_COL) {
+      if (num_floats_read >= 3)
+        return false; // only a point is stored
+      double val = 0.0;
+      if (asp::parse_csv_double(ptr, token_end, val) == ptr)
+        return false;
+      record.point_data[num_floats_read] = val;
+      num_floats_read++;
+      num_values_read++;
+    }
+
+    ptr = token_end;
+    col_index++;
+  }
+
+  // Check if enough values were read and for NaN values
+  return num_values_read == this->num_fields && record.point_data == record.point_data;
+}
+
 // Search for "color = red" and find "red". Return false on failure.
 // Can handle uppercase strings, also "color=red" and "color red".
 bool parse_color(std::string const& line, std::string & color) {
@@ -971,6 +1027,16 @@ Vector3 asp::CsvConv::cartesian_to_csv(Vector3 const& xyz,
 
 // End class CsvConv functions
 
+namespace {
+  // We will fetch a chunk of the las file of area LAS_TILE_LEN x
+  // LAS_TILE_LEN, split it into bins of spatially close points, and
+  // store it as a tile in a vector image. The bigger the tile size, the
+  // more likely the binning will be more efficient. But big tiles use a
+  // lot of memory.
+  // To do: Study performance for large files when this number changes
+  const int LAS_TILE_LEN = 2048;
+}
+
 void asp::las_or_csv_to_tif(std::string const& in_file,
                             std::string const& out_file,
                             int num_rows, int block_size,
@@ -978,14 +1044,8 @@ void asp::las_or_csv_to_tif(std::string const& in_file,
                             vw::cartography::GeoReference const& csv_georef,
                             asp::CsvConv const& csv_conv) {
 
-  // We will fetch a chunk of the las file of area TILE_LEN x
-  // TILE_LEN, split it into bins of spatially close points, and write
-  // it to disk as a tile in a vector tif image. The bigger the tile
-  // size, the more likely the binning will be more efficient. But big
-  // tiles use a lot of memory.
-
-  // To do: Study performance for large files when this number changes
-  const int TILE_LEN = 2048;
+  // See LAS_TILE_LEN for how the points are stored
+  const int TILE_LEN = LAS_TILE_LEN;
   Vector2 tile_size(TILE_LEN, TILE_LEN);
 
   vw_out() << "Writing temporary file: " << out_file << std::endl;
@@ -1037,6 +1097,84 @@ std::int64_t asp::las_file_size(std::string const& las_file){
   return header.GetPointRecordsCount();
 }
 
+asp::LasCloudView::LasCloudView(std::string const& las_file, int tile_len, int block_size):
+  m_las_file(las_file), m_tile_len(tile_len), m_block_size(block_size) {
+
+  m_num_points = asp::las_file_size(las_file);
+
+  // Same layout as for the tif files made from LAS files
+  // when there are no other tif files.
+  int num_rows = std::max(1, (int)ceil(sqrt(double(m_num_points))));
+  int num_row_tiles = std::max(1, (int)ceil(double(num_rows)/m_tile_len));
+  m_rows = m_tile_len*num_row_tiles;
+
+  int points_per_row = (int)ceil(double(m_num_points)/m_rows);
+  int num_col_tiles  = std::max(1, (int)ceil(double(points_per_row)/m_tile_len));
+  m_cols = m_tile_len*num_col_tiles;
+}
+
+// Read the chunk of points for the given tile and bin them. Each call
+// opens its own reader, so this is thread-safe.
+void asp::LasCloudView::read_tile(std::int64_t tile_index,
+                                  ImageView<Vector3> & tile) const {
+
+  std::int64_t tile_area = std::int64_t(m_tile_len) * m_tile_len;
+  std::int64_t start     = tile_index * tile_area;
+
+  std::ifstream ifs;
+  ifs.open(m_las_file.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs)
+    vw_throw(IOErr() << "Unable to open file: " << m_las_file << "\n");
+  liblas::ReaderFactory las_reader_factory;
+  liblas::Reader laslib_reader = las_reader_factory.CreateWithStream(ifs);
+  asp::LasReader reader(laslib_reader);
+
+  PointBuffer in;
+  if (start < m_num_points) {
+    if (!laslib_reader.Seek(start))
+      vw_throw(IOErr() << "Cannot seek to point " << start << " in: " << m_las_file << "\n");
+    std::int64_t count = 0;
+    while (count < tile_area && reader.ReadNextPoint()) {
+      in.push_back(reader.GetPoint());
+      count++;
+    }
+  }
+
+  Chipper(in, m_block_size, reader.m_has_georef, reader.m_georef,
+          m_tile_len, m_tile_len, tile);
+
+  VW_ASSERT(tile.cols() == m_tile_len && tile.rows() == m_tile_len,
+            ArgumentErr() << "LasCloudView: Size mis-match.\n");
+}
+
+asp::LasCloudView::prerasterize_type
+asp::LasCloudView::prerasterize(BBox2i const& bbox) const {
+
+  ImageView<Vector3> out(bbox.width(), bbox.height());
+  int num_col_tiles = m_cols / m_tile_len;
+
+  for (int ty = bbox.min().y()/m_tile_len; ty <= (bbox.max().y() - 1)/m_tile_len; ty++) {
+    for (int tx = bbox.min().x()/m_tile_len; tx <= (bbox.max().x() - 1)/m_tile_len; tx++) {
+      ImageView<Vector3> tile;
+      read_tile(std::int64_t(ty) * num_col_tiles + tx, tile);
+
+      Vector2i tile_corner(tx*m_tile_len, ty*m_tile_len);
+      BBox2i tile_box(tile_corner, tile_corner + Vector2i(m_tile_len, m_tile_len));
+      tile_box.crop(bbox);
+      crop(out, tile_box - bbox.min()) = crop(tile, tile_box - tile_corner);
+    }
+  }
+
+  return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+}
+
+ImageViewRef<Vector3> asp::read_las_cloud(std::string const& las_file) {
+  // For efficiency later, the blocks must not be smaller than what
+  // OrthoRasterizerView will use.
+  return block_cache(asp::LasCloudView(las_file, LAS_TILE_LEN, ASP_MAX_SUBBLOCK_SIZE),
+                     Vector2i(LAS_TILE_LEN, LAS_TILE_LEN));
+}
+
 bool asp::georef_from_las(std::string const& las_file,
                           vw::cartography::GeoReference & georef){
 
@@ -1178,19 +1316,7 @@ bool asp::is_valid_csv_line(std::string const& line) {
 }
 
 std::int64_t asp::csv_file_size(std::string const& file){
-
-  std::ifstream fh(file.c_str());
-  if (!fh)
-    vw_throw( vw::IOErr() << "Unable to open file \"" << file << "\"" );
-
-  std::int64_t num_total_points = 0;
-  std::string line;
-  while (getline(fh, line, '\n')){
-    if (!asp::is_valid_csv_line(line)) continue;
-    num_total_points++;
-  }
-
-  return num_total_points;
+  return asp::csv_count_valid_lines(file);
 }
 
 // Peek at the first valid line in a file to find how many columns it has
@@ -1262,6 +1388,45 @@ std::string asp::prefix_from_pointcloud_filename(std::string const& filename) {
 // that means a cloud of raw xyz cartesian values, then Vector3()
 // signifies no-data. If is_geodetic is true, no-data is suggested
 // by having the z component of the point be NaN.
+namespace {
+
+// Grow the bounding box of the valid points in a tile of the cloud
+class CloudBoxTask: public vw::Task, private boost::noncopyable {
+  vw::ImageViewRef<vw::Vector3> const& m_point_image;
+  vw::BBox2i m_box;
+  bool m_is_geodetic;
+  vw::BBox3 & m_result;
+  vw::Mutex & m_mutex;
+  vw::ProgressCallback const& m_progress;
+  double m_inc_amt;
+
+public:
+  CloudBoxTask(vw::ImageViewRef<vw::Vector3> const& point_image, vw::BBox2i const& box,
+               bool is_geodetic, vw::BBox3 & result, vw::Mutex & mutex,
+               vw::ProgressCallback const& progress, double inc_amt):
+    m_point_image(point_image), m_box(box), m_is_geodetic(is_geodetic),
+    m_result(result), m_mutex(mutex), m_progress(progress), m_inc_amt(inc_amt) {}
+
+  void operator()() {
+    vw::ImageView<vw::Vector3> points = crop(m_point_image, m_box);
+    vw::BBox3 box;
+    for (int row = 0; row < points.rows(); row++) {
+      for (int col = 0; col < points.cols(); col++) {
+        vw::Vector3 const& pt = points(col, row);
+        if ( (!m_is_geodetic && pt != vw::Vector3()) ||
+             (m_is_geodetic  &&  !boost::math::isnan(pt.z())) )
+          box.grow(pt);
+      }
+    }
+
+    vw::Mutex::Lock lock(m_mutex);
+    m_result.grow(box);
+    m_progress.report_incremental_progress(m_inc_amt);
+  }
+};
+
+} // end anonymous namespace
+
 vw::BBox3 asp::pointcloud_bbox(vw::ImageViewRef<vw::Vector3> const& point_image,
                                bool is_geodetic) {
 
@@ -1269,15 +1434,19 @@ vw::BBox3 asp::pointcloud_bbox(vw::ImageViewRef<vw::Vector3> const& point_image,
   vw::vw_out() << "Computing the point cloud bounding box.\n";
   vw::TerminalProgressCallback progress_bar("asp", "\t--> ");
 
-  for (int row=0; row < point_image.rows(); ++row ) {
-    progress_bar.report_fractional_progress(row, point_image.rows());
-    for (int col=0; col < point_image.cols(); ++col ) {
-      vw::Vector3 pt = point_image(col, row);
-      if ( (!is_geodetic && pt != vw::Vector3()) ||
-           (is_geodetic  &&  !boost::math::isnan(pt.z())) )
-        result.grow(pt);
-    }
+  // Process the cloud by tile, with multiple threads
+  const int tile_size = 256;
+  std::vector<vw::BBox2i> boxes = subdivide_bbox(point_image, tile_size, tile_size);
+  double inc_amt = 1.0 / std::max(boxes.size(), size_t(1));
+  vw::Mutex mutex;
+  vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    boost::shared_ptr<CloudBoxTask>
+      task(new CloudBoxTask(point_image, boxes[i], is_geodetic, result, mutex,
+                            progress_bar, inc_amt));
+    queue.add_task(task);
   }
+  queue.join_all();
   progress_bar.report_finished();
 
   return result;
@@ -1305,6 +1474,21 @@ double asp::find_avg_lon(ImageViewRef<Vector3> const& point_image){
 }
 
 
+double asp::find_avg_lon(ImageViewRef<Vector3> const& point_image,
+                         std::vector<std::string> const& pc_files){
+
+  // Only the sign of the sum of the points is needed
+  Vector3 sum;
+  for (size_t i = 0; i < pc_files.size(); i++) {
+    asp::CloudStats stats;
+    if (!asp::read_cloud_stats(pc_files[i], stats))
+      return asp::find_avg_lon(point_image);
+    sum += stats.mean_point() * double(stats.num_valid());
+  }
+  vw_out(DebugMessage,"asp") << "Found the average longitude from the cloud statistics.\n";
+  return sum.x() >= 0 ? 0 : 180;
+}
+
 /// Analyze a file name to determine the file type
 std::string asp::get_cloud_type(std::string const& file_name){
 
@@ -1337,10 +1521,11 @@ int asp::num_channels(std::vector<std::string> const& pc_files) {
 
   VW_ASSERT(pc_files.size() >= 1, ArgumentErr() << "Expecting at least one point cloud file.\n");
 
-  int num_channels0 = get_num_channels(pc_files[0]);
+  // LAS files read directly have only the points
+  int num_channels0 = asp::is_las(pc_files[0]) ? 3 : get_num_channels(pc_files[0]);
   int min_num_channels = num_channels0;
   for (int i = 1; i < (int)pc_files.size(); i++){
-    int num_channels = get_num_channels(pc_files[i]);
+    int num_channels = asp::is_las(pc_files[i]) ? 3 : get_num_channels(pc_files[i]);
     min_num_channels = std::min(min_num_channels, num_channels);
     if (num_channels != num_channels0)
       min_num_channels = std::min(min_num_channels, 3);
@@ -1355,6 +1540,8 @@ bool asp::has_stddev(std::vector<std::string> const& pc_files) {
 
   bool has_sd = true;
   for (size_t i = 0; i < pc_files.size(); i++) {
+    if (asp::is_las(pc_files[i]))
+      return false;
     std::string val;
     std::string adj_key = "BAND5";
     boost::shared_ptr<vw::DiskImageResource> rsrc(new vw::DiskImageResourceGDAL(pc_files[i]));
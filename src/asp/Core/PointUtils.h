@@ -24,11 +24,13 @@
 #define __ASP_CORE_POINT_UTILS_H__
 
 #include <string>
+#include <vector>
 #include <vw/Core/Functors.h>
 #include <vw/Image/PerPixelViews.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/Matrix.h>
 #include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
 #include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
 
@@ -95,6 +97,14 @@ namespace asp {
     CsvRecord parse_csv_line(bool & is_first_line, bool & success,
                               std::string const& line) const;
 
+    /// A faster version of parse_csv_line(), for the characters in [begin, end)
+    /// of a line without the newline. Nothing is printed on failure. The file
+    /// field of the record is reused, to avoid allocating memory for each line.
+    bool parse_csv_chars(const char* begin, const char* end, CsvRecord & record) const;
+
+    /// Return true if one of the columns is the file name
+    bool has_file_column() const {return name2col.count("file") > 0;}
+
     /// Reads an entire CSV file and stores a record for each line.
     /// - Intended for use with smaller files.
     size_t read_csv_file(std::string const    & file_path,
@@ -146,9 +156,14 @@ namespace asp {
     vw::Vector3 unsort_vector3(vw::Vector3 const& v) const;
 
   private: // Variables
+
+    /// The kinds of columns, for col_kinds
+    enum CsvColKind {CSV_SKIP_COL = 0, CSV_NUMBER_COL = 1, CSV_FILE_COL = 2};
+
     std::map<std::string,int>  name2col; ///< Target names -> Column index in input csv
     std::map<int, std::string> col2name; ///< Target column in input csv -> Name
     std::map<int, int>         col2sort; ///< Which input columns went in which vector indices (numbers only)
+    std::vector<char>          col_kinds; ///< Input columns to skip, or which hold a number or a file
 
     std::string csv_format_str;
     std::string csv_proj4_str;
@@ -194,6 +209,52 @@ namespace asp {
   /// Returns the number of points stored in a LAS
   std::int64_t las_file_size(std::string const& las_file);
 
+  /// A point cloud image formed directly from a LAS or LAZ file, without
+  /// first converting it to a tif file. The points are laid out as by
+  /// las_or_csv_to_tif(). Each tile holds the next chunk of points in the
+  /// file, with the points binned by location into blocks, so that point2dem
+  /// needs to read only the blocks near the area it grids. A tile is read
+  /// by seeking to its first point, so tiles can be read in any order and
+  /// in parallel. This is slow to access one pixel at a time, so use
+  /// read_las_cloud(), which caches the tiles.
+  class LasCloudView: public vw::ImageViewBase<LasCloudView> {
+    std::string  m_las_file;
+    std::int64_t m_num_points;
+    int m_tile_len, m_block_size;
+    int m_cols, m_rows; // These are pixel sizes, not tile counts.
+
+    void read_tile(std::int64_t tile_index, vw::ImageView<vw::Vector3> & tile) const;
+
+  public:
+    typedef vw::Vector3 pixel_type;
+    typedef vw::Vector3 result_type;
+    typedef vw::ProceduralPixelAccessor<LasCloudView> pixel_accessor;
+
+    LasCloudView(std::string const& las_file, int tile_len, int block_size);
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+    inline result_type operator()(size_t i, size_t j, size_t p=0) const {
+      vw_throw(vw::NoImplErr() << "LasCloudView::operator(...) has not been implemented.\n");
+      return result_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<vw::Vector3>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Read a LAS or LAZ file as a point cloud image, with its tiles cached
+  vw::ImageViewRef<vw::Vector3> read_las_cloud(std::string const& las_file);
+
   /// Builds a datum object out of the input arguments
   bool read_user_datum(double semi_major, double semi_minor,
                        std::string const& reference_spheroid,
@@ -234,6 +295,7 @@ namespace asp {
   /// Given a point cloud with n channels, return the first m channels.
   /// We must have 1 <= m <= n <= 6.
   /// If the image was written by subtracting a shift, put that shift back.
+  /// A compact cloud, with the values stored as integers, is scaled back first.
   template<int m>
   vw::ImageViewRef<vw::Vector<double, m>> read_asp_point_cloud(std::string const& filename);
 
@@ -249,10 +311,23 @@ namespace asp {
     read_point_cloud_compatible_file(std::string const& file){
       return vw::DiskImageView<PixelT>(file);
     }
+    /// LAS files can be read directly, but they have only the point channels
+    template<class PixelT>
+    vw::ImageViewRef<PixelT> read_las_compatible_file(std::string const& file){
+      vw_throw(vw::ArgumentErr() << "Cannot read error channels from LAS file: " << file << "\n");
+      return vw::ImageViewRef<PixelT>();
+    }
+    template<>
+    inline vw::ImageViewRef<vw::Vector3> read_las_compatible_file<vw::Vector3>(std::string const& file){
+      return asp::read_las_cloud(file);
+    }
+
     /// Read a point cloud file
     template<class PixelT>
     typename boost::disable_if<boost::is_same<PixelT, vw::PixelGray<float>>, vw::ImageViewRef<PixelT>>::type
     read_point_cloud_compatible_file(std::string const& file){
+      if (asp::is_las(file))
+        return read_las_compatible_file<PixelT>(file);
       return asp::read_asp_point_cloud<vw::math::VectorSize<PixelT>::value >(file);
     }
 
@@ -386,10 +461,24 @@ vw::ImageViewRef<vw::Vector<double, m>> read_asp_point_cloud(std::string const&
     shift = vw::str_to_vec<vw::Vector3>(shift_str);
   }
 
+  // A compact cloud stores integer multiples of these steps
+  double point_scale = 0.0, error_scale = 0.0;
+  std::string point_scale_str, error_scale_str;
+  if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_SCALE_TAG_STR,
+                                          point_scale_str) &&
+      vw::cartography::read_header_string(*rsrc.get(), asp::ASP_ERROR_SCALE_TAG_STR,
+                                          error_scale_str)) {
+    point_scale = atof(point_scale_str.c_str());
+    error_scale = atof(error_scale_str.c_str());
+  }
+
   // Read the first m channels
   vw::ImageViewRef<vw::Vector<double, m>> out_image
     = vw::read_channels<m, double>(filename, 0);
 
+  if (point_scale > 0.0 && error_scale > 0.0)
+    out_image = scale_cloud_pixels(out_image, point_scale, error_scale);
+
   // Add the shift back to the first several channels.
   if (shift != vw::Vector3())
     out_image = subtract_shift(out_image, -shift);
@@ -435,6 +524,11 @@ vw::ImageViewRef<PixelT> form_point_cloud_composite(std::vector<std::string> con
 // Find the average longitude for a given point image with lon, lat, height values
 double find_avg_lon(vw::ImageViewRef<vw::Vector3> const& point_image);
 
+// The same, for the composite of the given ECEF point clouds. Use the
+// statistics files of the clouds if all exist, and scan the image otherwise.
+double find_avg_lon(vw::ImageViewRef<vw::Vector3> const& point_image,
+                    std::vector<std::string> const& pc_files);
+
 std::string get_cloud_type(std::string const& file_name);
   
 // Find the number of channels in the point clouds.
@@ -0,0 +1,119 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PreprocCache.cc
+///
+
+#include <asp/Core/PreprocCache.h>
+#include <asp/Core/IpCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Increment when the products or their naming change, so old entries are ignored
+  const int PREPROC_CACHE_VERSION = 1;
+
+  // Hard-link the file if on the same file system, otherwise copy it
+  void link_or_copy(std::string const& src, std::string const& dst) {
+    boost::system::error_code ec;
+    fs::create_hard_link(src, dst, ec);
+    if (ec)
+      fs::copy_file(src, dst, fs::copy_option::overwrite_if_exists);
+  }
+
+} // end anonymous namespace
+
+std::string preproc_cache_key(std::string const& description) {
+  std::ostringstream os;
+  os << "ASP preprocessing cache " << PREPROC_CACHE_VERSION << "\n" << description;
+  std::string str = os.str();
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx",
+           (unsigned long long)fnv1a_hash(str.data(), str.size()));
+  return std::string(buf);
+}
+
+std::string preproc_cache_image_description(std::string const& image_file) {
+  std::ostringstream os;
+  os << fs::canonical(image_file).string() << " " << fs::file_size(image_file)
+     << " " << fs::last_write_time(image_file) << "\n";
+  return os.str();
+}
+
+std::string preproc_cache_entry(std::string const& cache_dir, std::string const& key) {
+  return (fs::path(cache_dir) / key).string();
+}
+
+bool preproc_cache_fetch(std::string const& cache_dir, std::string const& key,
+                         std::vector<std::string> const& names,
+                         std::vector<std::string> const& out_files) {
+  VW_ASSERT(names.size() == out_files.size(),
+            vw::ArgumentErr() << "Expecting as many output files as cached names.\n");
+
+  fs::path entry(preproc_cache_entry(cache_dir, key));
+  for (size_t it = 0; it < names.size(); it++) {
+    if (!fs::exists(entry / names[it]))
+      return false;
+  }
+
+  for (size_t it = 0; it < names.size(); it++) {
+    std::string src = (entry / names[it]).string();
+    vw::vw_out() << "\t--> Using cached preprocessed file: " << src << "\n";
+    if (fs::exists(out_files[it]) || fs::is_symlink(out_files[it]))
+      fs::remove(out_files[it]);
+    link_or_copy(src, out_files[it]);
+    fs::last_write_time(out_files[it], std::time(0));
+  }
+  return true;
+}
+
+void preproc_cache_store(std::string const& cache_dir, std::string const& key,
+                         std::vector<std::string> const& names,
+                         std::vector<std::string> const& files) {
+  VW_ASSERT(names.size() == files.size(),
+            vw::ArgumentErr() << "Expecting as many files as cached names.\n");
+
+  fs::path entry(preproc_cache_entry(cache_dir, key));
+  try {
+    fs::create_directories(entry);
+    for (size_t it = 0; it < names.size(); it++) {
+      std::string file = (entry / names[it]).string();
+      std::string tmp_file = fs::unique_path(file + ".%%%%-%%%%.tmp").string();
+      link_or_copy(files[it], tmp_file);
+      fs::rename(tmp_file, file);
+    }
+  } catch (std::exception const& e) {
+    vw::vw_out(vw::WarningMessage) << "Could not add preprocessed files to the cache: "
+                                   << entry.string() << ". " << e.what() << "\n";
+    return;
+  }
+  vw::vw_out() << "\t    Cached preprocessed files in: " << entry.string() << "\n";
+}
+
+} // end namespace asp
@@ -0,0 +1,61 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PreprocCache.h
+///
+/// A cache of the stereo preprocessing products which depend on only one
+/// image, such as the normalized left image and its mask, so that stereo
+/// runs sharing a left image, as in multiview stereo or when processing
+/// a list of pairs, make them once. An entry is a directory named after
+/// its key, holding copies or hard links of the product files.
+
+#ifndef __ASP_CORE_PREPROC_CACHE_H__
+#define __ASP_CORE_PREPROC_CACHE_H__
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Form the cache key from a description of the image and of the
+  /// options that the products depend on.
+  std::string preproc_cache_key(std::string const& description);
+
+  /// Describe an image file by its full path, size, and modification time
+  std::string preproc_cache_image_description(std::string const& image_file);
+
+  /// The directory holding the entry with this key
+  std::string preproc_cache_entry(std::string const& cache_dir, std::string const& key);
+
+  /// Put in place the cached files with the given names, such as "L.tif",
+  /// as the given output files. Return false, and produce nothing, unless
+  /// all of them are cached. The outputs get the current time as their
+  /// modification time, so they are not seen as stale.
+  bool preproc_cache_fetch(std::string const& cache_dir, std::string const& key,
+                           std::vector<std::string> const& names,
+                           std::vector<std::string> const& out_files);
+
+  /// Add files to the cache under the given names. Each is linked or copied
+  /// under a temporary name and then renamed, so concurrent processes never
+  /// see a partial file. Failing to cache is not an error.
+  void preproc_cache_store(std::string const& cache_dir, std::string const& key,
+                           std::vector<std::string> const& names,
+                           std::vector<std::string> const& files);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PREPROC_CACHE_H__
@@ -0,0 +1,279 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ProgressStatus.cc
+///
+
+#include <asp/Core/ProgressStatus.h>
+#include <asp/Core/Telemetry.h>
+
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Print the time left as 1h02m, 5m07s, or 12s
+  std::string format_duration(double seconds) {
+    long s = std::lround(std::max(seconds, 0.0));
+    std::ostringstream os;
+    os << std::setfill('0');
+    if (s >= 3600)
+      os << s / 3600 << "h" << std::setw(2) << (s % 3600) / 60 << "m";
+    else if (s >= 60)
+      os << s / 60 << "m" << std::setw(2) << s % 60 << "s";
+    else
+      os << s << "s";
+    return os.str();
+  }
+
+  // Print a rate such as 1.25e+06 as 1.25 M
+  std::string format_rate(double rate) {
+    std::ostringstream os;
+    os << std::setprecision(3);
+    if (rate >= 1e9)
+      os << rate / 1e9 << " G";
+    else if (rate >= 1e6)
+      os << rate / 1e6 << " M";
+    else if (rate >= 1e3)
+      os << rate / 1e3 << " k";
+    else
+      os << rate << " ";
+    return os.str();
+  }
+
+  // The stage name is the text before the bar, without the
+  // decorations, such as "\t--> Correlation: "
+  std::string stage_name(std::string const& text) {
+    size_t beg = text.find_first_not_of(" \t->");
+    if (beg == std::string::npos)
+      return "";
+    size_t end = text.find_last_not_of(" \t:");
+    return text.substr(beg, end - beg + 1);
+  }
+
+  std::string json_str(std::string const& s) {
+    std::string out = "\"";
+    for (char c: s) {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      if ((unsigned char)c >= 0x20)
+        out += c;
+    }
+    return out + "\"";
+  }
+
+} // end anonymous namespace
+
+std::string status_file() {
+  const char * file = getenv("ASP_STATUS_FILE");
+  if (file == NULL)
+    return "";
+  std::string out = file;
+  std::string tag = "{pid}";
+  size_t pos = out.find(tag);
+  if (pos != std::string::npos)
+    out.replace(pos, tag.size(), std::to_string(getpid()));
+  return out;
+}
+
+StatusProgressCallback::StatusProgressCallback(std::string const& log_namespace,
+                                               std::string const& pre_progress_text,
+                                               double total_units,
+                                               std::string const& units):
+  vw::TerminalProgressCallback(log_namespace, pre_progress_text),
+  m_namespace(log_namespace), m_pre_progress_text(pre_progress_text),
+  m_stage(stage_name(pre_progress_text)),
+  m_total_units(total_units), m_fraction(0), m_last_printed(-1), m_units(units),
+  m_started(false) {}
+
+void StatusProgressCallback::set_total(double total_units,
+                                       std::string const& units) const {
+  std::lock_guard<std::mutex> lock(m_status_mutex);
+  m_total_units = total_units;
+  m_units = units;
+}
+
+double StatusProgressCallback::total_units() const {
+  std::lock_guard<std::mutex> lock(m_status_mutex);
+  return m_total_units;
+}
+
+double StatusProgressCallback::rate() const {
+  std::lock_guard<std::mutex> lock(m_status_mutex);
+  if (!m_started)
+    return 0;
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                 - m_start).count();
+  if (elapsed <= 0)
+    return 0;
+  double done = m_fraction;
+  if (m_total_units > 0)
+    done *= m_total_units;
+  return done / elapsed;
+}
+
+double StatusProgressCallback::eta_seconds() const {
+  std::lock_guard<std::mutex> lock(m_status_mutex);
+  if (!m_started || m_fraction <= 0)
+    return -1;
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                 - m_start).count();
+  return elapsed * (1.0 - m_fraction) / m_fraction;
+}
+
+// Print the bar as vw::TerminalProgressCallback does, followed by the rate
+// and the time left. This is printed each time the progress grows by 1%.
+void StatusProgressCallback::report_progress(double progress) const {
+  vw::ProgressCallback::report_progress(progress);
+
+  bool print = false, write = false;
+  {
+    std::lock_guard<std::mutex> lock(m_status_mutex);
+    auto now = std::chrono::steady_clock::now();
+    if (!m_started) {
+      m_started = true;
+      m_start = now;
+      m_last_write = now;
+      write = true;
+    }
+    m_fraction = std::max(0.0, std::min(1.0, progress));
+    if (m_fraction - m_last_printed >= 0.01) {
+      m_last_printed = m_fraction;
+      print = true;
+    }
+    if (std::chrono::duration<double>(now - m_last_write).count() >= 1.0) {
+      m_last_write = now;
+      write = true;
+    }
+  }
+
+  if (print) {
+    double p = progress;
+    int pi = static_cast<int>(p * 60);
+    std::ostringstream os;
+    os << "\r" << m_pre_progress_text << "[";
+    for (int i = 0; i < 60; i++)
+      os << (i < pi ? "*" : ".");
+    os << "] " << std::fixed << std::setprecision(0) << p * 100 << "%";
+    double r = rate(), eta = eta_seconds();
+    if (r > 0 && eta >= 0) {
+      std::string units;
+      {
+        std::lock_guard<std::mutex> lock(m_status_mutex);
+        units = m_total_units > 0 ? m_units : "";
+      }
+      if (units.empty())
+        os << " ETA " << format_duration(eta) << "   ";
+      else
+        os << " " << format_rate(r) << units << "/s, ETA "
+           << format_duration(eta) << "   ";
+    }
+    vw::vw_out(vw::InfoMessage, m_namespace) << os.str() << std::flush;
+  }
+
+  if (write)
+    write_status(false);
+}
+
+void StatusProgressCallback::report_finished() const {
+  report_progress(1.0);
+  vw::vw_out(vw::InfoMessage, m_namespace) << "\n";
+
+  double r = rate();
+  std::string units;
+  {
+    std::lock_guard<std::mutex> lock(m_status_mutex);
+    units = m_total_units > 0 ? m_units : "";
+  }
+  if (!m_stage.empty() && !units.empty())
+    telemetry().set_value(m_stage + "." + units + "_per_sec", r);
+
+  write_status(true);
+}
+
+void StatusProgressCallback::write_status(bool finished) const {
+  std::string file = status_file();
+  if (file.empty())
+    return;
+
+  double r = rate(), eta = eta_seconds();
+  std::ostringstream os;
+  {
+    std::lock_guard<std::mutex> lock(m_status_mutex);
+    double elapsed = 0;
+    if (m_started)
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                              - m_start).count();
+    os << std::setprecision(6);
+    os << "{\n";
+    os << "  \"program\": " << json_str(telemetry().prog_name()) << ",\n";
+    os << "  \"pid\": " << getpid() << ",\n";
+    os << "  \"stage\": " << json_str(m_stage) << ",\n";
+    os << "  \"state\": " << json_str(finished ? "done" : "running") << ",\n";
+    os << "  \"fraction\": " << m_fraction << ",\n";
+    if (m_total_units > 0) {
+      os << "  \"units\": " << json_str(m_units) << ",\n";
+      os << "  \"units_done\": " << std::fixed << std::setprecision(0)
+         << m_fraction * m_total_units << ",\n";
+      os << "  \"units_total\": " << m_total_units << ",\n";
+      os.unsetf(std::ios::floatfield);
+      os << std::setprecision(6);
+    }
+    os << "  \"rate_per_sec\": " << r << ",\n";
+    if (eta >= 0)
+      os << "  \"eta_sec\": " << eta << ",\n";
+    os << "  \"elapsed_sec\": " << elapsed << ",\n";
+    os << "  \"updated\": " << std::time(NULL) << "\n";
+    os << "}\n";
+  }
+
+  // Failing to write the status must not stop the tool
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream ofs(tmp_file.c_str());
+    if (!ofs)
+      return;
+    ofs << os.str();
+  }
+  boost::system::error_code ec;
+  fs::rename(tmp_file, file, ec);
+}
+
+void set_progress_total(vw::ProgressCallback const& callback, double total_units,
+                        std::string const& units) {
+  StatusProgressCallback const* status
+    = dynamic_cast<StatusProgressCallback const*>(&callback);
+  if (status != NULL && status->total_units() <= 0)
+    status->set_total(total_units, units);
+}
+
+} // end namespace asp
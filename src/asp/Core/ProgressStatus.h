@@ -0,0 +1,96 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ProgressStatus.h
+///
+/// A progress callback for the long-running stages, which also reports
+/// the throughput, such as pixels or points per second, and an estimate
+/// of the time left. It prints like vw::TerminalProgressCallback, with
+/// the rate and time left appended.
+///
+/// If the environment variable ASP_STATUS_FILE is set, the progress is
+/// also written to that file in JSON, at most once a second, so that a
+/// workflow manager can poll it. The string "{pid}" in the file name is
+/// replaced with the process id, so that many processes, as run by
+/// parallel_stereo, do not overwrite each other's status. The file is
+/// written to a temporary file first and then renamed, so it is never
+/// seen partially written.
+
+#ifndef __ASP_CORE_PROGRESS_STATUS_H__
+#define __ASP_CORE_PROGRESS_STATUS_H__
+
+#include <vw/Core/ProgressCallback.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace asp {
+
+  /// The status file from ASP_STATUS_FILE, with "{pid}" replaced, or empty
+  std::string status_file();
+
+  class StatusProgressCallback: public vw::TerminalProgressCallback {
+  public:
+    /// The total is the number of units of work, such as pixels, for the
+    /// whole stage. If not known, it can be set later with set_total(), and
+    /// until then only the fraction done per second is reported.
+    StatusProgressCallback(std::string const& log_namespace,
+                           std::string const& pre_progress_text,
+                           double total_units = 0,
+                           std::string const& units = "pixels");
+
+    /// Set the amount of work. The block write functions in
+    /// asp/Core/Common.h do this, given the image size.
+    void set_total(double total_units, std::string const& units = "pixels") const;
+
+    /// The amount of work, or 0 if not known
+    double total_units() const;
+
+    virtual void report_progress(double progress) const;
+    virtual void report_finished() const;
+
+    /// The units done per second so far, or the fraction done per second
+    /// if the total is not known
+    double rate() const;
+
+    /// The estimated seconds left, or a negative value if not known yet
+    double eta_seconds() const;
+
+    /// The stage name, from the text shown before the progress bar
+    std::string stage() const { return m_stage; }
+
+  private:
+    void write_status(bool finished) const;
+
+    std::string m_namespace, m_pre_progress_text, m_stage;
+    mutable std::mutex m_status_mutex;
+    mutable double m_total_units, m_fraction, m_last_printed;
+    mutable std::string m_units;
+    mutable bool m_started;
+    mutable std::chrono::steady_clock::time_point m_start, m_last_write;
+  };
+
+  /// If the callback is a StatusProgressCallback and its total is not
+  /// known yet, set it
+  void set_progress_total(vw::ProgressCallback const& callback, double total_units,
+                          std::string const& units = "pixels");
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PROGRESS_STATUS_H__
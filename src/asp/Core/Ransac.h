@@ -0,0 +1,289 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Ransac.h
+///
+/// A RANSAC engine with the interface of vw::math::RandomSampleConsensus,
+/// so it can be used with the same fitting functors and error metrics.
+/// The hypotheses are evaluated on multiple threads, in batches, and the
+/// iterations stop early once enough were done for the inlier ratio
+/// found so far. Optionally, the samples are drawn first from the
+/// best-ranked matches, as in PROSAC, and each new best model is
+/// refined by fitting it to its inliers, as in LO-RANSAC.
+///
+/// Each iteration draws its sample with its own random generator, seeded
+/// by the iteration index, and ties among hypotheses go to the earlier
+/// iteration, so the result does not depend on the number of threads.
+
+#ifndef __ASP_CORE_RANSAC_H__
+#define __ASP_CORE_RANSAC_H__
+
+#include <vw/Core/Log.h>
+#include <vw/Math/RANSAC.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  template <class FittingFuncT, class ErrorFuncT>
+  class ParallelRansac {
+  public:
+
+    /// The arguments are as for vw::math::RandomSampleConsensus. The
+    /// number of iterations is an upper bound.
+    ParallelRansac(FittingFuncT const& fitting_func, ErrorFuncT const& error_func,
+                   int num_iterations, double inlier_threshold,
+                   int min_num_output_inliers,
+                   bool reduce_min_num_output_inliers_if_no_fit = false):
+      m_fitting_func(fitting_func), m_error_func(error_func),
+      m_num_iterations(num_iterations), m_inlier_threshold(inlier_threshold),
+      m_min_num_output_inliers(min_num_output_inliers),
+      m_reduce_min_num_output_inliers_if_no_fit(reduce_min_num_output_inliers_if_no_fit),
+      m_confidence(0.999), m_local_optimization(false), m_num_iterations_done(0) {}
+
+    /// Stop once the probability of having drawn at least one sample with
+    /// only inliers reaches this value. Use 1 to always do all iterations.
+    void set_confidence(double confidence) { m_confidence = confidence; }
+
+    /// Rank the matches, from best to worst, for example by descriptor
+    /// distance. The samples are then drawn from the best few matches
+    /// first, with the pool growing to all matches over the first half of
+    /// the iterations. An empty order means uniform sampling.
+    void set_sample_order(std::vector<size_t> const& order) { m_order = order; }
+
+    /// Refit each new best model to its inliers, and keep the result if
+    /// it has more inliers. This needs fewer iterations when the matches
+    /// are noisy, at the cost of a fit to many points per new best model.
+    void set_local_optimization(bool local_optimization) {
+      m_local_optimization = local_optimization;
+    }
+
+    /// The number of iterations done in the last call
+    int num_iterations_done() const { return m_num_iterations_done; }
+
+    /// The number of matches that agree with the given model
+    template <class ContainerT1, class ContainerT2>
+    size_t num_inliers(typename FittingFuncT::result_type const& H,
+                       std::vector<ContainerT1> const& p1,
+                       std::vector<ContainerT2> const& p2) const {
+      long long count = 0;
+#pragma omp parallel for schedule(static) reduction(+: count)
+      for (long long it = 0; it < (long long)p1.size(); it++) {
+        if (m_error_func(H, p1[it], p2[it]) < m_inlier_threshold)
+          count++;
+      }
+      return count;
+    }
+
+    /// The indices of the matches that agree with the given model
+    template <class ContainerT1, class ContainerT2>
+    std::vector<size_t> inlier_indices(typename FittingFuncT::result_type const& H,
+                                       std::vector<ContainerT1> const& p1,
+                                       std::vector<ContainerT2> const& p2) const {
+      std::vector<size_t> indices;
+      for (size_t it = 0; it < p1.size(); it++) {
+        if (m_error_func(H, p1[it], p2[it]) < m_inlier_threshold)
+          indices.push_back(it);
+      }
+      return indices;
+    }
+
+    /// Find the model which best fits the matches, then refit it to its
+    /// inliers. Throws vw::math::RANSACErr if there is no such model.
+    template <class ContainerT1, class ContainerT2>
+    typename FittingFuncT::result_type operator()(std::vector<ContainerT1> const& p1,
+                                                  std::vector<ContainerT2> const& p2) {
+
+      typedef typename FittingFuncT::result_type ModelT;
+
+      m_num_iterations_done = 0;
+      if (p1.size() != p2.size())
+        vw::vw_throw(vw::math::RANSACErr() << "RANSAC: the inputs have different sizes.\n");
+      if (p1.empty())
+        vw::vw_throw(vw::math::RANSACErr() << "RANSAC: no matches to fit.\n");
+
+      size_t num = p1.size();
+      size_t sample_size = m_fitting_func.min_elements_needed_for_fit(p1[0]);
+      if (num < sample_size)
+        vw::vw_throw(vw::math::RANSACErr() << "RANSAC: need at least " << sample_size
+                     << " matches to fit a model, but got " << num << ".\n");
+
+      std::vector<size_t> order = m_order;
+      if (order.size() != num) {
+        order.resize(num);
+        for (size_t it = 0; it < num; it++)
+          order[it] = it;
+      }
+      bool use_prosac = !m_order.empty() && m_order.size() == num;
+
+      // Iterations are done in batches. After each batch, the best model
+      // so far decides if more are needed. The batch size does not depend
+      // on the number of threads.
+      const int BATCH_SIZE = 64;
+      int max_iterations = std::max(m_num_iterations, 1);
+      int prosac_iterations = std::max(max_iterations / 2, 1);
+      size_t best_count = 0;
+      int best_iter = -1;
+      ModelT best_model;
+      std::vector<size_t> batch_counts(BATCH_SIZE);
+      std::vector<ModelT> batch_models(BATCH_SIZE);
+
+      int iter = 0;
+      while (iter < max_iterations) {
+        int batch_len = std::min(BATCH_SIZE, max_iterations - iter);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < batch_len; b++) {
+          int this_iter = iter + b;
+          batch_counts[b] = 0;
+
+          // The pool to sample from. With PROSAC it starts with the best
+          // ranked matches.
+          size_t pool = num;
+          if (use_prosac && this_iter < prosac_iterations)
+            pool = sample_size + ((num - sample_size) * size_t(this_iter)) / prosac_iterations;
+
+          std::mt19937 gen(this_iter);
+          std::uniform_int_distribution<size_t> dist(0, pool - 1);
+          std::vector<size_t> sample;
+          while (sample.size() < sample_size) {
+            size_t index = order[dist(gen)];
+            if (std::find(sample.begin(), sample.end(), index) == sample.end())
+              sample.push_back(index);
+          }
+
+          std::vector<ContainerT1> s1(sample_size);
+          std::vector<ContainerT2> s2(sample_size);
+          for (size_t it = 0; it < sample_size; it++) {
+            s1[it] = p1[sample[it]];
+            s2[it] = p2[sample[it]];
+          }
+
+          // A degenerate sample can make the fit fail. Then skip it.
+          try {
+            ModelT H = m_fitting_func(s1, s2);
+            size_t count = 0;
+            for (size_t it = 0; it < num; it++) {
+              if (m_error_func(H, p1[it], p2[it]) < m_inlier_threshold)
+                count++;
+            }
+            batch_counts[b] = count;
+            batch_models[b] = H;
+          } catch (...) {}
+        }
+
+        bool improved = false;
+        for (int b = 0; b < batch_len; b++) {
+          if (batch_counts[b] > best_count) {
+            best_count = batch_counts[b];
+            best_iter = iter + b;
+            best_model = batch_models[b];
+            improved = true;
+          }
+        }
+        iter += batch_len;
+
+        // Local optimization. Refit to the inliers while that helps.
+        const int MAX_LO_STEPS = 4;
+        for (int step = 0; m_local_optimization && improved && step < MAX_LO_STEPS;
+             step++) {
+          improved = false;
+          std::vector<size_t> inliers = inlier_indices(best_model, p1, p2);
+          if (inliers.size() < sample_size)
+            break;
+          std::vector<ContainerT1> in1(inliers.size());
+          std::vector<ContainerT2> in2(inliers.size());
+          for (size_t it = 0; it < inliers.size(); it++) {
+            in1[it] = p1[inliers[it]];
+            in2[it] = p2[inliers[it]];
+          }
+          try {
+            ModelT H = m_fitting_func(in1, in2, best_model);
+            size_t count = num_inliers(H, p1, p2);
+            if (count > best_count) {
+              best_count = count;
+              best_model = H;
+              improved = true;
+            }
+          } catch (...) {}
+        }
+
+        // The number of iterations needed to draw a sample of only inliers
+        // with the desired confidence, given the inlier ratio so far
+        if (best_count > 0 && m_confidence < 1.0) {
+          double ratio = double(best_count) / double(num);
+          double all_in = std::pow(ratio, double(sample_size));
+          double needed = max_iterations;
+          if (all_in >= 1.0)
+            needed = 0;
+          else if (all_in > 0.0)
+            needed = std::log(1.0 - m_confidence) / std::log(1.0 - all_in);
+          if (iter >= needed)
+            break;
+        }
+      }
+      m_num_iterations_done = iter;
+
+      int min_inliers = m_min_num_output_inliers;
+      if (m_reduce_min_num_output_inliers_if_no_fit) {
+        while (min_inliers > int(sample_size) && int(best_count) < min_inliers)
+          min_inliers = std::max(min_inliers / 2, int(sample_size));
+      }
+
+      if (best_iter < 0 || best_count < sample_size || int(best_count) < min_inliers)
+        vw::vw_throw(vw::math::RANSACErr()
+                     << "RANSAC was unable to find a fit that matched the supplied data. "
+                     << "Best number of inliers: " << best_count
+                     << ", needed: " << min_inliers << ".\n");
+
+      // Refit to the inliers, as vw::math::RandomSampleConsensus does
+      std::vector<size_t> inliers = inlier_indices(best_model, p1, p2);
+      std::vector<ContainerT1> in1(inliers.size());
+      std::vector<ContainerT2> in2(inliers.size());
+      for (size_t it = 0; it < inliers.size(); it++) {
+        in1[it] = p1[inliers[it]];
+        in2[it] = p2[inliers[it]];
+      }
+      ModelT H = m_fitting_func(in1, in2, best_model);
+
+      vw::vw_out(vw::DebugMessage, "asp") << "RANSAC: " << iter << " iterations, "
+                                          << inliers.size() << " / " << num << " inliers.\n";
+      return H;
+    }
+
+  private:
+    FittingFuncT m_fitting_func;
+    ErrorFuncT m_error_func;
+    int m_num_iterations;
+    double m_inlier_threshold;
+    int m_min_num_output_inliers;
+    bool m_reduce_min_num_output_inliers_if_no_fit;
+    double m_confidence;
+    bool m_local_optimization;
+    std::vector<size_t> m_order;
+    int m_num_iterations_done;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_RANSAC_H__
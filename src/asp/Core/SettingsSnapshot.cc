@@ -0,0 +1,242 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SettingsSnapshot.cc
+///
+
+#include <asp/Core/SettingsSnapshot.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Increment when the layout changes, so old snapshots are ignored
+  const char    SNAPSHOT_MAGIC[8] = {'A', 'S', 'P', 'S', 'N', 'A', 'P', '\0'};
+  const int32_t SNAPSHOT_VERSION  = 1;
+
+  // Refuse absurd lengths from a corrupted file
+  const uint32_t MAX_STRING_LEN = 1u << 20;
+  const uint32_t MAX_NUM_ITEMS  = 1u << 16;
+
+  template <class T>
+  void write_pod(std::ostream & os, T const& val) {
+    os.write(reinterpret_cast<const char*>(&val), sizeof(T));
+  }
+
+  template <class T>
+  void read_pod(std::istream & is, T & val) {
+    is.read(reinterpret_cast<char*>(&val), sizeof(T));
+    if (!is)
+      vw::vw_throw(vw::IOErr() << "Truncated file.");
+  }
+
+  void write_string(std::ostream & os, std::string const& str) {
+    write_pod(os, uint32_t(str.size()));
+    os.write(str.data(), str.size());
+  }
+
+  void read_string(std::istream & is, std::string & str) {
+    uint32_t len = 0;
+    read_pod(is, len);
+    if (len > MAX_STRING_LEN)
+      vw::vw_throw(vw::IOErr() << "Invalid string length.");
+    str.resize(len);
+    if (len > 0)
+      is.read(&str[0], len);
+    if (!is)
+      vw::vw_throw(vw::IOErr() << "Truncated file.");
+  }
+
+  void write_strings(std::ostream & os, std::vector<std::string> const& vec) {
+    write_pod(os, uint32_t(vec.size()));
+    for (size_t it = 0; it < vec.size(); it++)
+      write_string(os, vec[it]);
+  }
+
+  void read_strings(std::istream & is, std::vector<std::string> & vec) {
+    uint32_t num = 0;
+    read_pod(is, num);
+    if (num > MAX_NUM_ITEMS)
+      vw::vw_throw(vw::IOErr() << "Invalid number of items.");
+    vec.resize(num);
+    for (size_t it = 0; it < vec.size(); it++)
+      read_string(is, vec[it]);
+  }
+
+  void write_vec(std::ostream & os, vw::Vector2i const& v) {
+    write_pod(os, int32_t(v[0]));
+    write_pod(os, int32_t(v[1]));
+  }
+
+  void read_vec(std::istream & is, vw::Vector2i & v) {
+    int32_t x = 0, y = 0;
+    read_pod(is, x);
+    read_pod(is, y);
+    v = vw::Vector2i(x, y);
+  }
+
+  void write_bool(std::ostream & os, bool val) {
+    write_pod(os, uint8_t(val));
+  }
+
+  void read_bool(std::istream & is, bool & val) {
+    uint8_t v = 0;
+    read_pod(is, v);
+    val = (v != 0);
+  }
+
+} // end anonymous namespace
+
+SettingsSnapshot::SettingsSnapshot():
+  valid(false), stereo_default_time(-1),
+  left_size(0, 0), right_size(0, 0), left_channels(0), right_channels(0),
+  has_georef1(false), has_georef2(false),
+  L_size(-1, -1), has_L_cropped(false), has_R_cropped(false) {}
+
+std::string settings_snapshot_file(std::string const& out_prefix) {
+  return out_prefix + "-settings.bin";
+}
+
+int64_t stereo_default_time(std::string const& stereo_default_filename) {
+  boost::system::error_code ec;
+  std::time_t t = fs::last_write_time(stereo_default_filename, ec);
+  if (ec)
+    return -1;
+  return int64_t(t);
+}
+
+void write_settings_snapshot(std::string const& file, SettingsSnapshot const& snap) {
+
+  std::string tmp_file = fs::unique_path(file + ".%%%%-%%%%.tmp").string();
+  {
+    std::ofstream os(tmp_file.c_str(), std::ios::binary);
+    if (!os)
+      vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+
+    os.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    write_pod(os, SNAPSHOT_VERSION);
+
+    write_strings(os, snap.input_files);
+    write_string(os, snap.stereo_default_filename);
+    write_pod(os, snap.stereo_default_time);
+    write_string(os, snap.in_file1);
+    write_string(os, snap.in_file2);
+    write_string(os, snap.cam_file1);
+    write_string(os, snap.cam_file2);
+    write_string(os, snap.input_dem);
+
+    write_pod(os, uint32_t(snap.config_options.size()));
+    for (size_t it = 0; it < snap.config_options.size(); it++) {
+      write_string(os, snap.config_options[it].first);
+      write_strings(os, snap.config_options[it].second);
+    }
+
+    write_vec(os, snap.left_size);
+    write_vec(os, snap.right_size);
+    write_pod(os, int32_t(snap.left_channels));
+    write_pod(os, int32_t(snap.right_channels));
+    write_bool(os, snap.has_georef1);
+    write_bool(os, snap.has_georef2);
+    write_string(os, snap.proj4_str1);
+    write_string(os, snap.proj4_str2);
+    write_string(os, snap.left_cam_type);
+    write_string(os, snap.right_cam_type);
+
+    write_vec(os, snap.L_size);
+    write_bool(os, snap.has_L_cropped);
+    write_bool(os, snap.has_R_cropped);
+
+    if (!os)
+      vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+  }
+  fs::rename(tmp_file, file);
+}
+
+bool read_settings_snapshot(std::string const& file, SettingsSnapshot & snap) {
+
+  snap = SettingsSnapshot();
+
+  std::ifstream is(file.c_str(), std::ios::binary);
+  if (!is)
+    return false;
+
+  try {
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    is.read(magic, sizeof(magic));
+    int32_t version = 0;
+    read_pod(is, version);
+    if (!std::equal(magic, magic + sizeof(magic), SNAPSHOT_MAGIC) ||
+        version != SNAPSHOT_VERSION)
+      return false;
+
+    read_strings(is, snap.input_files);
+    read_string(is, snap.stereo_default_filename);
+    read_pod(is, snap.stereo_default_time);
+    read_string(is, snap.in_file1);
+    read_string(is, snap.in_file2);
+    read_string(is, snap.cam_file1);
+    read_string(is, snap.cam_file2);
+    read_string(is, snap.input_dem);
+
+    uint32_t num = 0;
+    read_pod(is, num);
+    if (num > MAX_NUM_ITEMS)
+      vw::vw_throw(vw::IOErr() << "Invalid number of options.");
+    snap.config_options.resize(num);
+    for (size_t it = 0; it < snap.config_options.size(); it++) {
+      read_string(is, snap.config_options[it].first);
+      read_strings(is, snap.config_options[it].second);
+    }
+
+    int32_t left_channels = 0, right_channels = 0;
+    read_vec(is, snap.left_size);
+    read_vec(is, snap.right_size);
+    read_pod(is, left_channels);
+    read_pod(is, right_channels);
+    snap.left_channels  = left_channels;
+    snap.right_channels = right_channels;
+    read_bool(is, snap.has_georef1);
+    read_bool(is, snap.has_georef2);
+    read_string(is, snap.proj4_str1);
+    read_string(is, snap.proj4_str2);
+    read_string(is, snap.left_cam_type);
+    read_string(is, snap.right_cam_type);
+
+    read_vec(is, snap.L_size);
+    read_bool(is, snap.has_L_cropped);
+    read_bool(is, snap.has_R_cropped);
+  } catch (std::exception const& e) {
+    vw::vw_out(vw::WarningMessage) << "Ignoring unreadable settings snapshot: "
+                                   << file << ". " << e.what() << "\n";
+    snap = SettingsSnapshot();
+    return false;
+  }
+
+  return true;
+}
+
+} // end namespace asp
@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SettingsSnapshot.h
+///
+/// What a stereo run resolves at startup, saved by stereo_pprc to a binary
+/// file at the output prefix. The later stages, and each of their tiles,
+/// load it instead of parsing stereo.default and opening the input images
+/// to check their sizes, georeferences and the outputs of preprocessing.
+/// The settings themselves are kept as the parsed stereo.default options,
+/// as the command line, which takes precedence, can differ among stages.
+
+#ifndef __ASP_CORE_SETTINGS_SNAPSHOT_H__
+#define __ASP_CORE_SETTINGS_SNAPSHOT_H__
+
+#include <vw/Math/Vector.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  struct SettingsSnapshot {
+
+    // Set when loaded from disk and found to match the current run
+    bool valid;
+
+    // The positional arguments, without the output prefix, the
+    // stereo.default file, and its modification time (-1 if missing).
+    // These must agree with the current run for the snapshot to be used.
+    std::vector<std::string> input_files;
+    std::string stereo_default_filename;
+    int64_t stereo_default_time;
+
+    // The images, cameras, and input DEM, as resolved from input_files
+    std::string in_file1, in_file2, cam_file1, cam_file2, input_dem;
+
+    // The options read from stereo.default, as keys and value tokens
+    std::vector<std::pair<std::string, std::vector<std::string>>> config_options;
+
+    // The input images
+    vw::Vector2i left_size, right_size;
+    int left_channels, right_channels;
+    bool has_georef1, has_georef2;
+    std::string proj4_str1, proj4_str2;
+    std::string left_cam_type, right_cam_type; // as used for mapprojection
+
+    // The outputs of preprocessing. The size of L.tif is (-1, -1) if missing.
+    vw::Vector2i L_size;
+    bool has_L_cropped, has_R_cropped;
+
+    SettingsSnapshot();
+  };
+
+  /// The snapshot file for the given output prefix
+  std::string settings_snapshot_file(std::string const& out_prefix);
+
+  /// The modification time of stereo.default, or -1 if it does not exist
+  int64_t stereo_default_time(std::string const& stereo_default_filename);
+
+  /// Write the snapshot. It is written under a temporary name and then
+  /// renamed, so processes starting meanwhile never see a partial file.
+  void write_settings_snapshot(std::string const& file, SettingsSnapshot const& snap);
+
+  /// Read the snapshot. Return false if missing, unreadable, or written
+  /// by a different version. The valid flag is not set here.
+  bool read_settings_snapshot(std::string const& file, SettingsSnapshot & snap);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_SETTINGS_SNAPSHOT_H__
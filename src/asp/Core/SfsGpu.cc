@@ -0,0 +1,335 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SfsGpu.cc
+///
+
+#include <asp/Core/Common.h> // for ASP_HAVE_PKG_CUDA
+#include <asp/Core/SfsGpu.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <thread>
+#include <vector>
+
+using namespace vw;
+
+namespace asp {
+
+#if defined(ASP_HAVE_PKG_CUDA) && ASP_HAVE_PKG_CUDA == 1
+
+bool sfs_gpu_available(std::string & reason) {
+  return asp::cuda::sfs_gpu_device_available(reason);
+}
+
+#else // Not built with CUDA
+
+bool sfs_gpu_available(std::string & reason) {
+  reason = "ASP was not built with CUDA support. Reconfigure with -DASP_ENABLE_CUDA=ON.";
+  return false;
+}
+
+namespace cuda {
+  bool sfs_gpu_device_available(std::string & reason) {
+    return asp::sfs_gpu_available(reason);
+  }
+  SfsGpuSolver * sfs_gpu_new_solver(std::string & error) {
+    sfs_gpu_device_available(error);
+    return NULL;
+  }
+}
+
+#endif
+
+namespace {
+
+  using namespace asp::cuda;
+
+  // Apply a function to each row of an image, with the rows split among
+  // threads
+  template <class FunctorT>
+  void for_each_row(int num_threads, int rows, FunctorT const& func) {
+    num_threads = std::max(1, std::min(num_threads, rows));
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+    for (int it = 0; it < num_threads; it++) {
+      threads.push_back(std::thread([&, it]() {
+        try {
+          for (int row = it; row < rows; row += num_threads)
+            func(row);
+        } catch (...) {
+          errors[it] = std::current_exception();
+        }
+      }));
+    }
+    for (size_t it = 0; it < threads.size(); it++)
+      threads[it].join();
+    for (size_t it = 0; it < errors.size(); it++) {
+      if (errors[it])
+        std::rethrow_exception(errors[it]);
+    }
+  }
+
+  // The same operations as the CUDA solver, with CPU threads. The
+  // reductions are done per row, then summed in order, so the results
+  // do not depend on the number of threads.
+  class SfsCpuSolver: public SfsGpuSolver {
+  public:
+    SfsCpuSolver(int num_threads): m_num_threads(num_threads) {}
+
+    virtual bool set_problem(SfsGpuProblem const& prob, std::string & error) {
+      m_prob = prob;
+      std::size_t num = std::size_t(prob.params.cols) * prob.params.rows;
+      m_M.assign(SFS_GPU_SYM_SIZE * num, 0.0);
+      m_b.assign(SFS_GPU_STENCIL * num, 0.0);
+      m_grad.assign(num, 0.0);
+      m_diag.assign(num, 0.0);
+      m_trial.assign(num, 0.0);
+      return true;
+    }
+
+    virtual bool linearize(double & cost, std::string & error) {
+      int cols = m_prob.params.cols, rows = m_prob.params.rows;
+      std::vector<double> row_cost(rows, 0.0);
+      for_each_row(m_num_threads, rows, [&](int row) {
+        for (int col = 0; col < cols; col++) {
+          if (sfs_gpu_is_fixed(cols, rows, col, row))
+            continue;
+          std::size_t idx = std::size_t(row) * cols + col;
+          sfs_gpu_setup_pixel(m_prob, col, row, &m_M[SFS_GPU_SYM_SIZE * idx],
+                              &m_b[SFS_GPU_STENCIL * idx]);
+          row_cost[row] += sfs_gpu_pixel_cost(m_prob, m_prob.heights, col, row);
+        }
+      });
+      for_each_row(m_num_threads, rows, [&](int row) {
+        for (int col = 0; col < cols; col++) {
+          std::size_t idx = std::size_t(row) * cols + col;
+          sfs_gpu_gather_pixel(m_prob, &m_M[0], &m_b[0], col, row, m_grad[idx], m_diag[idx]);
+        }
+      });
+      cost = sum(row_cost);
+      return true;
+    }
+
+    virtual bool gradient(double * grad, std::string & error) {
+      std::copy(m_grad.begin(), m_grad.end(), grad);
+      return true;
+    }
+
+    virtual bool solve(double lambda, double * delta, int & num_iterations,
+                       std::string & error) {
+      int cols = m_prob.params.cols, rows = m_prob.params.rows;
+      std::size_t num = std::size_t(cols) * rows;
+      std::vector<double> r(num), z(num), d(num), q(num), t(SFS_GPU_STENCIL * num, 0.0);
+      std::vector<double> row_sum(rows);
+
+      // Jacobi preconditioner. The diagonal is zero at fixed pixels.
+      auto precondition = [&](std::vector<double> const& in, std::vector<double> & out) {
+        for (std::size_t idx = 0; idx < num; idx++)
+          out[idx] = (m_diag[idx] > 0) ? in[idx] / ((1.0 + lambda) * m_diag[idx]) : 0.0;
+      };
+      auto dot = [&](std::vector<double> const& a, std::vector<double> const& b) {
+        for_each_row(m_num_threads, rows, [&](int row) {
+          double s = 0.0;
+          for (std::size_t idx = std::size_t(row) * cols; idx < std::size_t(row + 1) * cols; idx++)
+            s += a[idx] * b[idx];
+          row_sum[row] = s;
+        });
+        return sum(row_sum);
+      };
+      auto apply = [&](std::vector<double> const& x, std::vector<double> & y) {
+        for_each_row(m_num_threads, rows, [&](int row) {
+          for (int col = 0; col < cols; col++) {
+            if (sfs_gpu_is_fixed(cols, rows, col, row))
+              continue;
+            std::size_t idx = std::size_t(row) * cols + col;
+            sfs_gpu_apply_block(m_prob.params, &m_M[SFS_GPU_SYM_SIZE * idx], &x[0],
+                                col, row, &t[SFS_GPU_STENCIL * idx]);
+          }
+        });
+        for_each_row(m_num_threads, rows, [&](int row) {
+          for (int col = 0; col < cols; col++)
+            y[std::size_t(row) * cols + col]
+              = sfs_gpu_apply_pixel(m_prob, &t[0], &m_diag[0], lambda, &x[0], col, row);
+        });
+      };
+
+      for (std::size_t idx = 0; idx < num; idx++) {
+        r[idx] = -m_grad[idx];
+        delta[idx] = 0.0;
+      }
+      precondition(r, z);
+      d = z;
+      double rz = dot(r, z), r0 = sqrt(dot(r, r));
+      num_iterations = 0;
+      while (num_iterations < m_prob.params.max_cg_iterations && r0 > 0) {
+        apply(d, q);
+        double dq = dot(d, q);
+        if (dq <= 0)
+          break;
+        double alpha = rz / dq;
+        for (std::size_t idx = 0; idx < num; idx++) {
+          delta[idx] += alpha * d[idx];
+          r[idx]     -= alpha * q[idx];
+        }
+        num_iterations++;
+        if (sqrt(dot(r, r)) <= m_prob.params.cg_tolerance * r0)
+          break;
+        precondition(r, z);
+        double rz_new = dot(r, z);
+        double beta = rz_new / rz;
+        rz = rz_new;
+        for (std::size_t idx = 0; idx < num; idx++)
+          d[idx] = z[idx] + beta * d[idx];
+      }
+      return true;
+    }
+
+    virtual bool cost(double const* delta, double & cost, std::string & error) {
+      int cols = m_prob.params.cols, rows = m_prob.params.rows;
+      for (std::size_t idx = 0; idx < m_trial.size(); idx++)
+        m_trial[idx] = m_prob.heights[idx] + delta[idx];
+      std::vector<double> row_cost(rows, 0.0);
+      for_each_row(m_num_threads, rows, [&](int row) {
+        for (int col = 0; col < cols; col++) {
+          if (!sfs_gpu_is_fixed(cols, rows, col, row))
+            row_cost[row] += sfs_gpu_pixel_cost(m_prob, &m_trial[0], col, row);
+        }
+      });
+      cost = sum(row_cost);
+      return true;
+    }
+
+  private:
+    static double sum(std::vector<double> const& vals) {
+      double s = 0.0;
+      for (size_t it = 0; it < vals.size(); it++)
+        s += vals[it];
+      return s;
+    }
+
+    int m_num_threads;
+    SfsGpuProblem m_prob;
+    std::vector<double> m_M, m_b, m_grad, m_diag, m_trial;
+  };
+
+} // end anonymous namespace
+
+SfsMatrixFreeSolver::SfsMatrixFreeSolver(bool use_gpu, int num_threads) {
+
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+
+  std::string error;
+  if (use_gpu) {
+    m_solver.reset(asp::cuda::sfs_gpu_new_solver(error));
+    if (m_solver)
+      vw_out() << "Solving on the GPU.\n";
+    else
+      vw_out(WarningMessage) << "Cannot use the GPU: " << error
+                             << " Using " << num_threads << " CPU thread(s).\n";
+  }
+  if (!m_solver)
+    m_solver.reset(new SfsCpuSolver(num_threads));
+
+  // The initial damping. This is the inverse of the initial trust region
+  // radius Ceres uses.
+  m_lambda = 1.0e-4;
+}
+
+void SfsMatrixFreeSolver::gradient(LinearizeFun const& linearize, double * grad) {
+  SfsGpuProblem prob;
+  linearize(prob);
+  double cost = 0.0;
+  std::string error;
+  if (!m_solver->set_problem(prob, error) || !m_solver->linearize(cost, error) ||
+      !m_solver->gradient(grad, error))
+    vw_throw(ArgumentErr() << "SfsMatrixFreeSolver: " << error << "\n");
+}
+
+double SfsMatrixFreeSolver::cost(LinearizeFun const& linearize) {
+  SfsGpuProblem prob;
+  linearize(prob);
+  double cost = 0.0;
+  std::string error;
+  if (!m_solver->set_problem(prob, error) || !m_solver->linearize(cost, error))
+    vw_throw(ArgumentErr() << "SfsMatrixFreeSolver: " << error << "\n");
+  return cost;
+}
+
+void SfsMatrixFreeSolver::solve(int num_iterations, double * heights,
+                                LinearizeFun const& linearize,
+                                std::function<void()> const& iteration_done) {
+
+  const double min_lambda = 1.0e-12, max_lambda = 1.0e+16;
+  const int max_num_attempts = 10;
+  std::string error;
+
+  for (int iter = 0; iter < num_iterations; iter++) {
+
+    SfsGpuProblem prob;
+    linearize(prob);
+    if (prob.heights != heights)
+      vw_throw(ArgumentErr() << "SfsMatrixFreeSolver: The problem must use "
+               << "the heights being optimized.\n");
+
+    double cost = 0.0;
+    if (!m_solver->set_problem(prob, error) || !m_solver->linearize(cost, error))
+      vw_throw(ArgumentErr() << "SfsMatrixFreeSolver: " << error << "\n");
+
+    std::size_t num = std::size_t(prob.params.cols) * prob.params.rows;
+    std::vector<double> delta(num, 0.0);
+    double new_cost = cost;
+    int num_cg_iterations = 0;
+    bool accepted = false;
+    for (int attempt = 0; attempt < max_num_attempts; attempt++) {
+      if (!m_solver->solve(m_lambda, &delta[0], num_cg_iterations, error) ||
+          !m_solver->cost(&delta[0], new_cost, error))
+        vw_throw(ArgumentErr() << "SfsMatrixFreeSolver: " << error << "\n");
+      if (new_cost < cost) {
+        accepted = true;
+        break;
+      }
+      m_lambda = std::min(max_lambda, 4.0 * m_lambda);
+    }
+
+    vw_out() << "Iteration " << iter << ": cost " << cost << " -> " << new_cost
+             << ", conjugate gradient iterations: " << num_cg_iterations
+             << ", damping: " << m_lambda << "\n";
+    if (!accepted) {
+      vw_out() << "Could not decrease the cost. Stopping.\n";
+      break;
+    }
+
+    for (std::size_t idx = 0; idx < num; idx++)
+      heights[idx] += delta[idx];
+    m_lambda = std::max(min_lambda, m_lambda / 3.0);
+    iteration_done();
+
+    // Same stopping criterion as the function tolerance in sfs. With
+    // the linear term of multigrid the cost can be negative.
+    if (cost - new_cost <= 1.0e-16 * std::abs(cost))
+      break;
+  }
+}
+
+} // end namespace asp
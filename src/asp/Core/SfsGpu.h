@@ -0,0 +1,79 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SfsGpu.h
+///
+/// A matrix-free solver for shape-from-shading when only the DEM is
+/// floated, used by sfs --use-gpu-solver. The residuals, their
+/// derivatives, and the products with the Gauss-Newton matrix are
+/// evaluated pixel by pixel, without assembling a sparse matrix, and the
+/// linear systems are solved with conjugate gradient. This runs on the GPU
+/// if ASP was configured with -DASP_ENABLE_CUDA=ON and a device is found,
+/// and with CPU threads otherwise.
+
+#ifndef __ASP_CORE_SFS_GPU_H__
+#define __ASP_CORE_SFS_GPU_H__
+
+#include <asp/Core/SfsGpuKernels.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <functional>
+#include <string>
+
+namespace asp {
+
+  /// Return true if ASP was built with CUDA and a device was found.
+  /// Otherwise populate the reason.
+  bool sfs_gpu_available(std::string & reason);
+
+  /// Minimize the sfs cost function over the DEM heights with
+  /// Levenberg-Marquardt. The device data and the damping are kept
+  /// between calls, so an object should be kept for each DEM, and reused
+  /// when solving repeatedly for it, as done by multigrid.
+  class SfsMatrixFreeSolver {
+  public:
+    typedef std::function<void(asp::cuda::SfsGpuProblem &)> LinearizeFun;
+
+    /// Use the GPU if use_gpu is true and one is available, and
+    /// num_threads CPU threads otherwise.
+    SfsMatrixFreeSolver(bool use_gpu, int num_threads);
+
+    /// Do the given number of iterations. Before each, linearize() must
+    /// fill in the problem at the current heights, with the heights
+    /// pointing to the given array, which has the size of the DEM. The
+    /// data it points to must stay valid until the next call. After each
+    /// accepted step, iteration_done() is called.
+    void solve(int num_iterations, double * heights, LinearizeFun const& linearize,
+               std::function<void()> const& iteration_done);
+
+    /// The gradient of the cost at the problem filled in by linearize(),
+    /// of the size of the DEM. It is zero at the fixed pixels.
+    void gradient(LinearizeFun const& linearize, double * grad);
+
+    /// The cost at the problem filled in by linearize()
+    double cost(LinearizeFun const& linearize);
+
+  private:
+    boost::shared_ptr<asp::cuda::SfsGpuSolver> m_solver;
+    double m_lambda;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_SFS_GPU_H__
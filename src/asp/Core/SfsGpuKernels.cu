@@ -0,0 +1,398 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SfsGpuKernels.cu
+///
+/// CUDA implementation of the matrix-free shape-from-shading solver. Each
+/// thread handles a DEM pixel, using the per-pixel functions in
+/// SfsGpuKernels.h. The Gauss-Newton blocks, the gradient, and the
+/// conjugate gradient vectors stay on the device. Only the camera data,
+/// which changes each iteration, is copied over, and dot products are
+/// reduced per block and summed on the host.
+
+#include <asp/Core/SfsGpuKernels.h>
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace asp {
+namespace cuda {
+
+namespace {
+
+  const int BLOCK_X = 16, BLOCK_Y = 16;
+  const int VEC_THREADS = 256;
+
+  // Convenience macro to bail out on a CUDA error
+#define ASP_CUDA_CHECK(call)                                               \
+  do {                                                                     \
+    cudaError_t status = (call);                                           \
+    if (status != cudaSuccess) {                                           \
+      std::ostringstream os;                                               \
+      os << "CUDA error in " << #call << ": " << cudaGetErrorString(status); \
+      error = os.str();                                                    \
+      return false;                                                        \
+    }                                                                      \
+  } while (0)
+
+  // A RAII holder for device memory, which can be resized
+  template <class T>
+  struct DeviceBuffer {
+    T * ptr;
+    std::size_t count;
+    DeviceBuffer(): ptr(NULL), count(0) {}
+    ~DeviceBuffer() { if (ptr != NULL) cudaFree(ptr); }
+    cudaError_t alloc(std::size_t n) {
+      if (n == count && ptr != NULL)
+        return cudaSuccess;
+      if (ptr != NULL)
+        cudaFree(ptr);
+      ptr = NULL;
+      count = n;
+      return cudaMalloc((void**)&ptr, std::max(n, std::size_t(1)) * sizeof(T));
+    }
+    cudaError_t upload(T const* host, std::size_t n) {
+      cudaError_t status = alloc(n);
+      if (status != cudaSuccess)
+        return status;
+      return cudaMemcpy(ptr, host, n * sizeof(T), cudaMemcpyHostToDevice);
+    }
+  private:
+    DeviceBuffer(DeviceBuffer const&);
+    DeviceBuffer& operator=(DeviceBuffer const&);
+  };
+
+  __device__ inline bool pixel_index(SfsGpuParams const& p, int & col, int & row) {
+    col = blockIdx.x * blockDim.x + threadIdx.x;
+    row = blockIdx.y * blockDim.y + threadIdx.y;
+    return col < p.cols && row < p.rows;
+  }
+
+  __global__ void setup_kernel(SfsGpuProblem p, double * M, double * b, double * cost) {
+    int col, row;
+    if (!pixel_index(p.params, col, row))
+      return;
+    std::size_t idx = std::size_t(row) * p.params.cols + col;
+    cost[idx] = 0.0;
+    if (sfs_gpu_is_fixed(p.params.cols, p.params.rows, col, row))
+      return;
+    sfs_gpu_setup_pixel(p, col, row, M + SFS_GPU_SYM_SIZE * idx, b + SFS_GPU_STENCIL * idx);
+    cost[idx] = sfs_gpu_pixel_cost(p, p.heights, col, row);
+  }
+
+  __global__ void gather_kernel(SfsGpuProblem p, double const* M, double const* b,
+                                double * grad, double * diag) {
+    int col, row;
+    if (!pixel_index(p.params, col, row))
+      return;
+    std::size_t idx = std::size_t(row) * p.params.cols + col;
+    sfs_gpu_gather_pixel(p, M, b, col, row, grad[idx], diag[idx]);
+  }
+
+  __global__ void cost_kernel(SfsGpuProblem p, double const* hs, double * cost) {
+    int col, row;
+    if (!pixel_index(p.params, col, row))
+      return;
+    std::size_t idx = std::size_t(row) * p.params.cols + col;
+    cost[idx] = 0.0;
+    if (!sfs_gpu_is_fixed(p.params.cols, p.params.rows, col, row))
+      cost[idx] = sfs_gpu_pixel_cost(p, hs, col, row);
+  }
+
+  __global__ void apply_block_kernel(SfsGpuParams p, double const* M, double const* x,
+                                     double * t) {
+    int col, row;
+    if (!pixel_index(p, col, row) || sfs_gpu_is_fixed(p.cols, p.rows, col, row))
+      return;
+    std::size_t idx = std::size_t(row) * p.cols + col;
+    sfs_gpu_apply_block(p, M + SFS_GPU_SYM_SIZE * idx, x, col, row, t + SFS_GPU_STENCIL * idx);
+  }
+
+  __global__ void apply_pixel_kernel(SfsGpuProblem p, double const* t, double const* diag,
+                                     double lambda, double const* x, double * y) {
+    int col, row;
+    if (!pixel_index(p.params, col, row))
+      return;
+    y[std::size_t(row) * p.params.cols + col]
+      = sfs_gpu_apply_pixel(p, t, diag, lambda, x, col, row);
+  }
+
+  // Start conjugate gradient: r = -grad, x = 0
+  __global__ void cg_init_kernel(std::size_t n, double const* grad, double * r, double * x) {
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (i >= n)
+      return;
+    r[i] = -grad[i];
+    x[i] = 0.0;
+  }
+
+  // Jacobi preconditioner. The diagonal is zero at fixed pixels.
+  __global__ void precondition_kernel(std::size_t n, double const* diag, double lambda,
+                                      double const* r, double * z) {
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (i >= n)
+      return;
+    z[i] = (diag[i] > 0) ? r[i] / ((1.0 + lambda) * diag[i]) : 0.0;
+  }
+
+  // x += alpha * d, r -= alpha * q
+  __global__ void cg_step_kernel(std::size_t n, double alpha, double const* d,
+                                 double const* q, double * x, double * r) {
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (i >= n)
+      return;
+    x[i] += alpha * d[i];
+    r[i] -= alpha * q[i];
+  }
+
+  // d = z + beta * d
+  __global__ void cg_direction_kernel(std::size_t n, double beta, double const* z, double * d) {
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (i >= n)
+      return;
+    d[i] = z[i] + beta * d[i];
+  }
+
+  // out = a + b
+  __global__ void add_kernel(std::size_t n, double const* a, double const* b, double * out) {
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (i >= n)
+      return;
+    out[i] = a[i] + b[i];
+  }
+
+  // Partial sums of a[i] * b[i], or of a[i] if b is NULL, one per block
+  __global__ void dot_kernel(std::size_t n, double const* a, double const* b, double * partial) {
+    __shared__ double vals[VEC_THREADS];
+    std::size_t i = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+    double v = 0.0;
+    if (i < n)
+      v = (b != NULL) ? a[i] * b[i] : a[i];
+    vals[threadIdx.x] = v;
+    __syncthreads();
+    for (int s = blockDim.x / 2; s > 0; s /= 2) {
+      if (threadIdx.x < s)
+        vals[threadIdx.x] += vals[threadIdx.x + s];
+      __syncthreads();
+    }
+    if (threadIdx.x == 0)
+      partial[blockIdx.x] = vals[0];
+  }
+
+  class SfsCudaSolver: public SfsGpuSolver {
+  public:
+
+    virtual bool set_problem(SfsGpuProblem const& prob, std::string & error) {
+      m_prob = prob;
+      m_num = std::size_t(prob.params.cols) * prob.params.rows;
+      int num_images = prob.num_images;
+
+      ASP_CUDA_CHECK(m_heights.upload(prob.heights,      m_num));
+      ASP_CUDA_CHECK(m_orig.upload   (prob.orig_heights, m_num));
+      if (prob.linear_term != NULL)
+        ASP_CUDA_CHECK(m_linear.upload(prob.linear_term, m_num));
+      ASP_CUDA_CHECK(m_albedo.upload (prob.albedo,       m_num));
+      ASP_CUDA_CHECK(m_xyz0.upload   (prob.xyz0,         3 * m_num));
+      ASP_CUDA_CHECK(m_up.upload     (prob.up,           3 * m_num));
+
+      // The image values do not change between iterations, so copy
+      // them only if not seen before
+      if (int(m_vals.size()) != num_images) {
+        m_vals.clear(); m_lin.clear(); m_shadow.clear();
+        m_host_vals.assign(num_images, NULL);
+        for (int k = 0; k < num_images; k++) {
+          m_vals.push_back  (new_buffer<float>());
+          m_lin.push_back   (new_buffer<float>());
+          m_shadow.push_back(new_buffer<std::uint8_t>());
+        }
+      }
+      std::vector<SfsGpuImage> images(prob.images, prob.images + num_images);
+      for (int k = 0; k < num_images; k++) {
+        SfsGpuImage const& img = prob.images[k];
+        std::size_t num_vals = std::size_t(img.cols) * img.rows;
+        if (m_host_vals[k] != img.vals || m_vals[k]->count != num_vals) {
+          ASP_CUDA_CHECK(m_vals[k]->upload(img.vals, num_vals));
+          m_host_vals[k] = img.vals;
+        }
+        ASP_CUDA_CHECK(m_lin[k]->upload(img.lin, SFS_GPU_LIN_SIZE * m_num));
+        images[k].vals = m_vals[k]->ptr;
+        images[k].lin  = m_lin[k]->ptr;
+        images[k].shadow = NULL;
+        if (img.shadow != NULL) {
+          ASP_CUDA_CHECK(m_shadow[k]->upload(img.shadow, m_num));
+          images[k].shadow = m_shadow[k]->ptr;
+        }
+      }
+      ASP_CUDA_CHECK(m_images.upload(images.empty() ? NULL : &images[0], num_images));
+
+      ASP_CUDA_CHECK(m_M.alloc(SFS_GPU_SYM_SIZE * m_num));
+      ASP_CUDA_CHECK(m_b.alloc(SFS_GPU_STENCIL  * m_num));
+      ASP_CUDA_CHECK(m_t.alloc(SFS_GPU_STENCIL  * m_num));
+      DeviceBuffer<double> * vecs[] = {&m_grad, &m_diag, &m_cost, &m_x, &m_r, &m_z,
+                                       &m_d, &m_q, &m_trial};
+      for (size_t it = 0; it < sizeof(vecs) / sizeof(vecs[0]); it++)
+        ASP_CUDA_CHECK(vecs[it]->alloc(m_num));
+      ASP_CUDA_CHECK(m_partial.alloc(num_vec_blocks()));
+      ASP_CUDA_CHECK(cudaMemset(m_M.ptr, 0, SFS_GPU_SYM_SIZE * m_num * sizeof(double)));
+      ASP_CUDA_CHECK(cudaMemset(m_b.ptr, 0, SFS_GPU_STENCIL  * m_num * sizeof(double)));
+      ASP_CUDA_CHECK(cudaMemset(m_t.ptr, 0, SFS_GPU_STENCIL  * m_num * sizeof(double)));
+
+      // The problem as seen from the device
+      m_dev = prob;
+      m_dev.heights      = m_heights.ptr;
+      m_dev.orig_heights = m_orig.ptr;
+      m_dev.linear_term  = (prob.linear_term != NULL) ? m_linear.ptr : NULL;
+      m_dev.albedo       = m_albedo.ptr;
+      m_dev.xyz0         = m_xyz0.ptr;
+      m_dev.up           = m_up.ptr;
+      m_dev.images       = m_images.ptr;
+      return true;
+    }
+
+    virtual bool linearize(double & cost, std::string & error) {
+      setup_kernel<<<grid(), block()>>>(m_dev, m_M.ptr, m_b.ptr, m_cost.ptr);
+      ASP_CUDA_CHECK(cudaGetLastError());
+      gather_kernel<<<grid(), block()>>>(m_dev, m_M.ptr, m_b.ptr, m_grad.ptr, m_diag.ptr);
+      ASP_CUDA_CHECK(cudaGetLastError());
+      return sum(m_cost.ptr, NULL, cost, error);
+    }
+
+    virtual bool gradient(double * grad, std::string & error) {
+      ASP_CUDA_CHECK(cudaMemcpy(grad, m_grad.ptr, m_num * sizeof(double),
+                                cudaMemcpyDeviceToHost));
+      return true;
+    }
+
+    virtual bool solve(double lambda, double * delta, int & num_iterations,
+                       std::string & error) {
+      std::size_t n = m_num;
+      int nb = num_vec_blocks();
+      cg_init_kernel<<<nb, VEC_THREADS>>>(n, m_grad.ptr, m_r.ptr, m_x.ptr);
+      precondition_kernel<<<nb, VEC_THREADS>>>(n, m_diag.ptr, lambda, m_r.ptr, m_z.ptr);
+      ASP_CUDA_CHECK(cudaMemcpy(m_d.ptr, m_z.ptr, n * sizeof(double),
+                                cudaMemcpyDeviceToDevice));
+      double rz = 0.0, rr = 0.0;
+      if (!sum(m_r.ptr, m_z.ptr, rz, error) || !sum(m_r.ptr, m_r.ptr, rr, error))
+        return false;
+      double r0 = sqrt(rr);
+
+      num_iterations = 0;
+      while (num_iterations < m_prob.params.max_cg_iterations && r0 > 0) {
+        apply_block_kernel<<<grid(), block()>>>(m_dev.params, m_M.ptr, m_d.ptr, m_t.ptr);
+        apply_pixel_kernel<<<grid(), block()>>>(m_dev, m_t.ptr, m_diag.ptr, lambda,
+                                                m_d.ptr, m_q.ptr);
+        ASP_CUDA_CHECK(cudaGetLastError());
+        double dq = 0.0;
+        if (!sum(m_d.ptr, m_q.ptr, dq, error))
+          return false;
+        if (dq <= 0)
+          break;
+        double alpha = rz / dq;
+        cg_step_kernel<<<nb, VEC_THREADS>>>(n, alpha, m_d.ptr, m_q.ptr, m_x.ptr, m_r.ptr);
+        num_iterations++;
+        if (!sum(m_r.ptr, m_r.ptr, rr, error))
+          return false;
+        if (sqrt(rr) <= m_prob.params.cg_tolerance * r0)
+          break;
+        precondition_kernel<<<nb, VEC_THREADS>>>(n, m_diag.ptr, lambda, m_r.ptr, m_z.ptr);
+        double rz_new = 0.0;
+        if (!sum(m_r.ptr, m_z.ptr, rz_new, error))
+          return false;
+        double beta = rz_new / rz;
+        rz = rz_new;
+        cg_direction_kernel<<<nb, VEC_THREADS>>>(n, beta, m_z.ptr, m_d.ptr);
+      }
+      ASP_CUDA_CHECK(cudaGetLastError());
+      ASP_CUDA_CHECK(cudaMemcpy(delta, m_x.ptr, n * sizeof(double), cudaMemcpyDeviceToHost));
+      return true;
+    }
+
+    virtual bool cost(double const* delta, double & cost, std::string & error) {
+      ASP_CUDA_CHECK(cudaMemcpy(m_q.ptr, delta, m_num * sizeof(double),
+                                cudaMemcpyHostToDevice));
+      add_kernel<<<num_vec_blocks(), VEC_THREADS>>>(m_num, m_heights.ptr, m_q.ptr, m_trial.ptr);
+      cost_kernel<<<grid(), block()>>>(m_dev, m_trial.ptr, m_cost.ptr);
+      ASP_CUDA_CHECK(cudaGetLastError());
+      return sum(m_cost.ptr, NULL, cost, error);
+    }
+
+  private:
+
+    // Device buffers are not copyable, so they are kept in vectors by pointer
+    template <class T>
+    static std::shared_ptr<DeviceBuffer<T>> new_buffer() {
+      return std::shared_ptr<DeviceBuffer<T>>(new DeviceBuffer<T>());
+    }
+
+    int num_vec_blocks() const {
+      return int((m_num + VEC_THREADS - 1) / VEC_THREADS);
+    }
+    dim3 block() const { return dim3(BLOCK_X, BLOCK_Y); }
+    dim3 grid() const {
+      return dim3((m_prob.params.cols + BLOCK_X - 1) / BLOCK_X,
+                  (m_prob.params.rows + BLOCK_Y - 1) / BLOCK_Y);
+    }
+
+    // Sum over all pixels of a[i] * b[i], or of a[i] if b is NULL
+    bool sum(double const* a, double const* b, double & result, std::string & error) {
+      int nb = num_vec_blocks();
+      dot_kernel<<<nb, VEC_THREADS>>>(m_num, a, b, m_partial.ptr);
+      ASP_CUDA_CHECK(cudaGetLastError());
+      std::vector<double> partial(nb);
+      ASP_CUDA_CHECK(cudaMemcpy(&partial[0], m_partial.ptr, nb * sizeof(double),
+                                cudaMemcpyDeviceToHost));
+      result = 0.0;
+      for (int it = 0; it < nb; it++)
+        result += partial[it];
+      return true;
+    }
+
+    SfsGpuProblem m_prob, m_dev;
+    std::size_t m_num;
+    DeviceBuffer<double> m_heights, m_orig, m_linear, m_albedo, m_xyz0, m_up;
+    DeviceBuffer<double> m_M, m_b, m_t, m_grad, m_diag, m_cost;
+    DeviceBuffer<double> m_x, m_r, m_z, m_d, m_q, m_trial, m_partial;
+    DeviceBuffer<SfsGpuImage> m_images;
+    std::vector<float const*> m_host_vals;
+    std::vector<std::shared_ptr<DeviceBuffer<float>>>        m_vals, m_lin;
+    std::vector<std::shared_ptr<DeviceBuffer<std::uint8_t>>> m_shadow;
+  };
+
+} // end anonymous namespace
+
+bool sfs_gpu_device_available(std::string & reason) {
+  int count = 0;
+  cudaError_t status = cudaGetDeviceCount(&count);
+  if (status != cudaSuccess || count <= 0) {
+    reason = (status != cudaSuccess) ? cudaGetErrorString(status) : "No CUDA device found.";
+    return false;
+  }
+  return true;
+}
+
+SfsGpuSolver * sfs_gpu_new_solver(std::string & error) {
+  if (!sfs_gpu_device_available(error))
+    return NULL;
+  return new SfsCudaSolver();
+}
+
+} // end namespace cuda
+} // end namespace asp
@@ -0,0 +1,568 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SfsGpuKernels.h
+///
+/// Plain interface to the matrix-free shape-from-shading solver, and the
+/// per-pixel functions it is made of. These are shared by the CPU
+/// implementation in SfsGpu.cc and the CUDA one in SfsGpuKernels.cu, so
+/// the two give the same results. This header must not depend on VW or
+/// Boost, as it is included by nvcc. The VW-facing API is in SfsGpu.h.
+///
+/// Only the DEM heights are optimized. The cameras are linearized on the
+/// host at the current heights before each iteration: for each DEM pixel
+/// and image the projection of the DEM point into the image, and its
+/// derivative with respect to the height, are given. Then the residuals
+/// and their derivatives can be evaluated on the device.
+
+#ifndef __ASP_CORE_SFS_GPU_KERNELS_H__
+#define __ASP_CORE_SFS_GPU_KERNELS_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#if defined(__CUDACC__)
+#define SFS_GPU_HD __host__ __device__
+#else
+#define SFS_GPU_HD
+#endif
+
+namespace asp {
+namespace cuda {
+
+  const int SFS_GPU_NUM_MODEL_COEFFS = 16;
+  const int SFS_GPU_NUM_HAZE_COEFFS  = 6;
+
+  // Camera data per DEM pixel: the image pixel, relative to the image
+  // crop, at the linearization height, its derivative with respect to
+  // the height, the camera center relative to cam_ref, and the weight
+  // (zero if the point does not project into the image).
+  const int SFS_GPU_LIN_SIZE = 8;
+
+  // The heights in the stencil of an intensity residual, in the order
+  // of the parameter blocks of IntensityErrorFloatDemOnly in sfs.
+  const int SFS_GPU_STENCIL = 5; // left, center, right, bottom, top
+
+  // The packed upper triangle of a symmetric 5x5 matrix
+  const int SFS_GPU_SYM_SIZE = 15;
+
+  // The same values as the reflectance types in sfs
+  enum { SFS_GPU_LAMBERT = 1, SFS_GPU_LUNAR_LAMBERT = 2, SFS_GPU_HAPKE = 3 };
+
+  struct SfsGpuParams {
+    int cols, rows;                 // DEM dimensions
+    int reflectance_type;
+    double model_coeffs[SFS_GPU_NUM_MODEL_COEFFS];
+    double phase_coeff_c1, phase_coeff_c2;
+    int num_haze_coeffs;
+    double steepness_factor;
+    double gridx, gridy;
+    double smoothness_weight, gradient_weight;
+    double initial_dem_constraint_weight;
+    double robust_threshold;        // use the Cauchy loss if positive
+    double unreliable_intensity_threshold;
+    int max_cg_iterations;
+    double cg_tolerance;            // relative to the initial residual
+  };
+
+  // An image crop and its camera data for each DEM pixel
+  struct SfsGpuImage {
+    int cols, rows;
+    float        const* vals;   // row-major, NaN where invalid
+    float        const* lin;    // SFS_GPU_LIN_SIZE values per DEM pixel
+    std::uint8_t const* shadow; // non-zero where in shadow, or NULL
+    double sun[3];              // the sun position, already scaled
+    double cam_ref[3];
+    double exposure;
+    double haze[SFS_GPU_NUM_HAZE_COEFFS];
+  };
+
+  // All arrays are row-major, of the size of the DEM, and in host memory.
+  // A DEM point is xyz0 + height * up, as geodetic_to_cartesian() is
+  // linear in the height. If the linear term is not NULL, its dot
+  // product with the heights is subtracted from the cost. This is the
+  // coarse grid correction of multigrid.
+  struct SfsGpuProblem {
+    SfsGpuParams params;
+    double const* heights;      // the linearization point
+    double const* orig_heights; // for the initial DEM constraint
+    double const* linear_term;  // or NULL
+    double const* albedo;
+    double const* xyz0;         // three values per DEM pixel
+    double const* up;           // three values per DEM pixel
+    int num_images;
+    SfsGpuImage const* images;
+  };
+
+  /// The Gauss-Newton operations the solver is made of. Only the pixels
+  /// in the DEM interior are optimized, the rest are kept fixed.
+  class SfsGpuSolver {
+  public:
+    virtual ~SfsGpuSolver() {}
+
+    /// Copy the problem data. The image values are copied only if they
+    /// were not seen before, as these do not change between iterations.
+    virtual bool set_problem(SfsGpuProblem const& prob, std::string & error) = 0;
+
+    /// Find the Gauss-Newton blocks and the gradient at the heights of
+    /// the problem, and the cost there.
+    virtual bool linearize(double & cost, std::string & error) = 0;
+
+    /// Copy the gradient found by linearize(). It has the size of the DEM,
+    /// and is zero at the fixed pixels.
+    virtual bool gradient(double * grad, std::string & error) = 0;
+
+    /// Solve (J^T J + lambda * diag(J^T J)) delta = -J^T r with
+    /// preconditioned conjugate gradient. The delta has the size of the DEM.
+    virtual bool solve(double lambda, double * delta, int & num_iterations,
+                       std::string & error) = 0;
+
+    /// The cost at the heights of the problem plus delta, with the
+    /// cameras linearized.
+    virtual bool cost(double const* delta, double & cost, std::string & error) = 0;
+  };
+
+  /// Returns true if a CUDA device is present. Otherwise populates the reason.
+  bool sfs_gpu_device_available(std::string & reason);
+
+  /// Create a solver running on the device. Returns NULL and sets the
+  /// error message on failure.
+  SfsGpuSolver * sfs_gpu_new_solver(std::string & error);
+
+  // The per-pixel functions below are used by both implementations.
+
+  SFS_GPU_HD inline bool sfs_gpu_is_fixed(int cols, int rows, int col, int row) {
+    return col <= 0 || row <= 0 || col >= cols - 1 || row >= rows - 1;
+  }
+
+  // The offset of the given stencil point relative to the center
+  SFS_GPU_HD inline void sfs_gpu_offset(int a, int & dx, int & dy) {
+    dx = (a == 0) ? -1 : ((a == 2) ? 1 : 0);
+    dy = (a == 3) ?  1 : ((a == 4) ? -1 : 0);
+  }
+
+  // Index of element (a, b), with a <= b, in the packed upper triangle
+  SFS_GPU_HD inline int sfs_gpu_sym_index(int a, int b) {
+    return a * SFS_GPU_STENCIL - a * (a - 1) / 2 + (b - a);
+  }
+
+  SFS_GPU_HD inline double sfs_gpu_dot(double const* a, double const* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  SFS_GPU_HD inline void sfs_gpu_normalize(double * a) {
+    double len = sqrt(sfs_gpu_dot(a, a));
+    for (int c = 0; c < 3; c++)
+      a[c] /= len;
+  }
+
+  SFS_GPU_HD inline void sfs_gpu_point(SfsGpuProblem const& p, int col, int row,
+                                       double h, double * xyz) {
+    std::size_t idx = 3 * (std::size_t(row) * p.params.cols + col);
+    for (int c = 0; c < 3; c++)
+      xyz[c] = p.xyz0[idx + c] + h * p.up[idx + c];
+  }
+
+  // See nonlin_reflectance() in sfs
+  SFS_GPU_HD inline double sfs_gpu_nonlin_reflectance(double r, double exposure,
+                                                      double steepness_factor,
+                                                      double const* haze,
+                                                      int num_haze_coeffs) {
+    exposure /= steepness_factor;
+    double num = exposure * r, den = 1.0;
+    if (num_haze_coeffs >= 1) num += haze[0];
+    if (num_haze_coeffs >= 2) den += haze[1] * r;
+    if (num_haze_coeffs >= 3) num += haze[2] * r * r;
+    if (num_haze_coeffs >= 4) den += haze[3] * r * r;
+    if (num_haze_coeffs >= 5) num += haze[4] * r * r * r;
+    if (num_haze_coeffs >= 6) den += haze[5] * r * r * r;
+    return num / den;
+  }
+
+  // The Lambertian, Lunar-Lambertian, and Hapke models, as in sfs
+  SFS_GPU_HD inline double sfs_gpu_reflectance(SfsGpuParams const& p,
+                                               double const* sun, double const* view,
+                                               double const* xyz, double const* normal) {
+    double sun_dir[3], view_dir[3];
+    for (int c = 0; c < 3; c++) {
+      sun_dir[c]  = sun[c]  - xyz[c];
+      view_dir[c] = view[c] - xyz[c];
+    }
+    sfs_gpu_normalize(sun_dir);
+    double mu_0 = sfs_gpu_dot(sun_dir, normal);
+    if (p.reflectance_type == SFS_GPU_LAMBERT)
+      return mu_0;
+
+    sfs_gpu_normalize(view_dir);
+    double mu    = sfs_gpu_dot(view_dir, normal);
+    double cos_g = sfs_gpu_dot(sun_dir, view_dir);
+    double const* k = p.model_coeffs;
+
+    if (p.reflectance_type == SFS_GPU_LUNAR_LAMBERT) {
+      double alpha = acos(cos_g);
+      double deg_alpha = alpha * 180.0 / M_PI;
+      double L = k[0] + deg_alpha * (k[1] + deg_alpha * (k[2] + deg_alpha * k[3]));
+      double r = 2 * L * mu_0 / (mu_0 + mu) + (1 - L) * mu_0;
+      if (mu_0 + mu == 0 || r != r)
+        return 0.0;
+      return r * (exp(-p.phase_coeff_c1 * alpha) + p.phase_coeff_c2);
+    }
+
+    // Hapke
+    double omega = fabs(k[0]), b = fabs(k[1]), c = fabs(k[2]);
+    double B0 = fabs(k[3]), h = fabs(k[4]);
+    double Pp = 1.0 + 2.0 * b * cos_g + b * b, Pm = 1.0 - 2.0 * b * cos_g + b * b;
+    double Pg = (1.0 - c) * (1.0 - b * b) / (Pp * sqrt(Pp))
+      + c * (1.0 - b * b) / (Pm * sqrt(Pm));
+    double tan_half_g = sqrt((1.0 - cos_g) / (1.0 + cos_g));
+    double Bg = B0 / (1.0 + (1.0 / h) * tan_half_g);
+    double s = sqrt(1.0 - omega);
+    double H_mu0 = (1.0 + 2 * mu_0) / (1.0 + 2 * mu_0 * s);
+    double H_mu  = (1.0 + 2 * mu  ) / (1.0 + 2 * mu   * s);
+    return (omega / 4.0 / M_PI) * (mu_0 / (mu_0 + mu)) * ((1.0 + Bg) * Pg + H_mu0 * H_mu - 1.0);
+  }
+
+  // The intensity residual for an image at an interior DEM pixel, given
+  // the heights in the stencil. As in sfs, it is zero where the point
+  // projects outside the image or at invalid image pixels.
+  SFS_GPU_HD inline double sfs_gpu_intensity_residual(SfsGpuProblem const& p,
+                                                      SfsGpuImage const& img,
+                                                      int col, int row, double const* h) {
+    int cols = p.params.cols;
+    std::size_t idx = std::size_t(row) * cols + col;
+    float const* lin = img.lin + SFS_GPU_LIN_SIZE * idx;
+    double weight = lin[7];
+    if (weight == 0)
+      return 0.0;
+
+    double dh = h[1] - p.heights[idx];
+    double px = lin[0] + lin[2] * dh, py = lin[1] + lin[3] * dh;
+    if (!(px >= 0 && px < img.cols - 1 && py >= 0 && py < img.rows - 1))
+      return 0.0;
+
+    // Bilinear interpolation. As with masked pixels, the result is
+    // invalid if any of the four pixels is.
+    int ix = int(px), iy = int(py);
+    double fx = px - ix, fy = py - iy;
+    float const* v = img.vals + std::size_t(iy) * img.cols + ix;
+    double intensity = (1 - fx) * (1 - fy) * v[0] + fx * (1 - fy) * v[1]
+      + (1 - fx) * fy * v[img.cols] + fx * fy * v[img.cols + 1];
+    if (intensity != intensity)
+      return 0.0;
+
+    // The normal, from the four neighbors
+    double base[3], left[3], right[3], bottom[3], top[3];
+    sfs_gpu_point(p, col - 1, row,     h[0], left);
+    sfs_gpu_point(p, col,     row,     h[1], base);
+    sfs_gpu_point(p, col + 1, row,     h[2], right);
+    sfs_gpu_point(p, col,     row + 1, h[3], bottom);
+    sfs_gpu_point(p, col,     row - 1, h[4], top);
+    double dx[3], dy[3], normal[3];
+    for (int c = 0; c < 3; c++) {
+      dx[c] = right[c]  - left[c];
+      dy[c] = bottom[c] - top[c];
+    }
+    normal[0] = -(dx[1] * dy[2] - dx[2] * dy[1]);
+    normal[1] = -(dx[2] * dy[0] - dx[0] * dy[2]);
+    normal[2] = -(dx[0] * dy[1] - dx[1] * dy[0]);
+    sfs_gpu_normalize(normal);
+
+    // In shadow the reflectance is zero
+    double reflectance = 0.0;
+    if (img.shadow == NULL || img.shadow[idx] == 0) {
+      double view[3];
+      for (int c = 0; c < 3; c++)
+        view[c] = img.cam_ref[c] + lin[4 + c];
+      reflectance = sfs_gpu_reflectance(p.params, img.sun, view, base, normal);
+    }
+
+    double t = p.params.unreliable_intensity_threshold;
+    if (t > 0 && intensity <= t && intensity >= 0)
+      weight *= (intensity / t) * (intensity / t);
+
+    return weight * (intensity - p.albedo[idx] *
+                     sfs_gpu_nonlin_reflectance(reflectance, img.exposure,
+                                                p.params.steepness_factor,
+                                                img.haze, p.params.num_haze_coeffs));
+  }
+
+  // The residual and its derivatives with respect to the stencil
+  // heights, with central differences, using the step Ceres uses.
+  SFS_GPU_HD inline double sfs_gpu_intensity_jacobian(SfsGpuProblem const& p,
+                                                      SfsGpuImage const& img,
+                                                      int col, int row, double const* h,
+                                                      double * jac) {
+    double hh[SFS_GPU_STENCIL];
+    for (int a = 0; a < SFS_GPU_STENCIL; a++)
+      hh[a] = h[a];
+    for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+      double step = 1.0e-6 * fabs(h[a]);
+      if (step == 0.0)
+        step = 1.0e-6;
+      hh[a] = h[a] + step;
+      double rp = sfs_gpu_intensity_residual(p, img, col, row, hh);
+      hh[a] = h[a] - step;
+      double rm = sfs_gpu_intensity_residual(p, img, col, row, hh);
+      hh[a] = h[a];
+      jac[a] = (rp - rm) / (2.0 * step);
+    }
+    return sfs_gpu_intensity_residual(p, img, col, row, hh);
+  }
+
+  // The cost of a residual, and the weight of its Gauss-Newton terms
+  SFS_GPU_HD inline double sfs_gpu_loss(double robust_threshold, double r, double & weight) {
+    double s = r * r;
+    if (robust_threshold <= 0) {
+      weight = 1.0;
+      return 0.5 * s;
+    }
+    double a2 = robust_threshold * robust_threshold;
+    weight = 1.0 / (1.0 + s / a2);
+    return 0.5 * a2 * log1p(s / a2);
+  }
+
+  SFS_GPU_HD inline void sfs_gpu_stencil_heights(SfsGpuParams const& p, double const* hs,
+                                                 int col, int row, double * h) {
+    for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+      int dx, dy;
+      sfs_gpu_offset(a, dx, dy);
+      h[a] = hs[std::size_t(row + dy) * p.cols + col + dx];
+    }
+  }
+
+  // Sum over the images the Gauss-Newton blocks of the intensity
+  // residuals at an interior pixel: the packed 5x5 matrix and the
+  // 5-vector. Return the cost of these residuals.
+  SFS_GPU_HD inline double sfs_gpu_setup_pixel(SfsGpuProblem const& p, int col, int row,
+                                               double * M, double * b) {
+    double h[SFS_GPU_STENCIL], jac[SFS_GPU_STENCIL];
+    sfs_gpu_stencil_heights(p.params, p.heights, col, row, h);
+    for (int k = 0; k < SFS_GPU_SYM_SIZE; k++)
+      M[k] = 0.0;
+    for (int a = 0; a < SFS_GPU_STENCIL; a++)
+      b[a] = 0.0;
+
+    double cost = 0.0;
+    for (int k = 0; k < p.num_images; k++) {
+      double r = sfs_gpu_intensity_jacobian(p, p.images[k], col, row, h, jac);
+      double w = 1.0;
+      cost += sfs_gpu_loss(p.params.robust_threshold, r, w);
+      for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+        b[a] += w * jac[a] * r;
+        for (int c = a; c < SFS_GPU_STENCIL; c++)
+          M[sfs_gpu_sym_index(a, c)] += w * jac[a] * jac[c];
+      }
+    }
+    return cost;
+  }
+
+  // The regularization residuals centered at an interior pixel are
+  // linear in the heights. Each is given by its taps, as offsets and
+  // weights. These are the SmoothnessError and GradientError terms.
+  const int SFS_GPU_MAX_TERMS = 8;
+  const int SFS_GPU_MAX_TAPS  = 4;
+  struct SfsGpuTerm {
+    int num_taps;
+    int dx[SFS_GPU_MAX_TAPS], dy[SFS_GPU_MAX_TAPS];
+    double w[SFS_GPU_MAX_TAPS];
+  };
+
+  SFS_GPU_HD inline void sfs_gpu_add_tap(SfsGpuTerm & t, int dx, int dy, double w) {
+    t.dx[t.num_taps] = dx;
+    t.dy[t.num_taps] = dy;
+    t.w[t.num_taps]  = w;
+    t.num_taps++;
+  }
+
+  SFS_GPU_HD inline int sfs_gpu_reg_terms(SfsGpuParams const& p, SfsGpuTerm * terms) {
+    int n = 0;
+    double gx = p.gridx, gy = p.gridy;
+    double sw = p.smoothness_weight, gw = p.gradient_weight;
+    if (sw > 0) {
+      // u_xx, u_xy twice, and u_yy
+      SfsGpuTerm & t0 = terms[n++]; t0.num_taps = 0;
+      sfs_gpu_add_tap(t0, -1, 0, sw / (gx * gx));
+      sfs_gpu_add_tap(t0,  1, 0, sw / (gx * gx));
+      sfs_gpu_add_tap(t0,  0, 0, -2.0 * sw / (gx * gx));
+      for (int it = 0; it < 2; it++) {
+        SfsGpuTerm & t = terms[n++]; t.num_taps = 0;
+        double w = sw / (4.0 * gx * gy);
+        sfs_gpu_add_tap(t,  1,  1,  w); // bottom right
+        sfs_gpu_add_tap(t, -1, -1,  w); // top left
+        sfs_gpu_add_tap(t, -1,  1, -w); // bottom left
+        sfs_gpu_add_tap(t,  1, -1, -w); // top right
+      }
+      SfsGpuTerm & t3 = terms[n++]; t3.num_taps = 0;
+      sfs_gpu_add_tap(t3, 0,  1, sw / (gy * gy));
+      sfs_gpu_add_tap(t3, 0, -1, sw / (gy * gy));
+      sfs_gpu_add_tap(t3, 0,  0, -2.0 * sw / (gy * gy));
+    }
+    if (gw > 0) {
+      // Forward and backward differences in x and y
+      int dxs[4] = {1, -1, 0, 0}, dys[4] = {0, 0, -1, 1};
+      for (int it = 0; it < 4; it++) {
+        SfsGpuTerm & t = terms[n++]; t.num_taps = 0;
+        double g = (dxs[it] != 0) ? gx : gy;
+        double sign = (it % 2 == 0) ? 1.0 : -1.0;
+        sfs_gpu_add_tap(t, dxs[it], dys[it],  sign * gw / g);
+        sfs_gpu_add_tap(t, 0, 0,             -sign * gw / g);
+      }
+    }
+    return n;
+  }
+
+  SFS_GPU_HD inline double sfs_gpu_term_value(SfsGpuTerm const& t, int cols,
+                                              double const* x, int col, int row) {
+    double v = 0.0;
+    for (int i = 0; i < t.num_taps; i++)
+      v += t.w[i] * x[std::size_t(row + t.dy[i]) * cols + col + t.dx[i]];
+    return v;
+  }
+
+  // The cost of all residuals centered at an interior pixel, at the
+  // heights hs, with the cameras linearized
+  SFS_GPU_HD inline double sfs_gpu_pixel_cost(SfsGpuProblem const& p, double const* hs,
+                                              int col, int row) {
+    double h[SFS_GPU_STENCIL];
+    sfs_gpu_stencil_heights(p.params, hs, col, row, h);
+    double cost = 0.0, w = 1.0;
+    for (int k = 0; k < p.num_images; k++)
+      cost += sfs_gpu_loss(p.params.robust_threshold,
+                           sfs_gpu_intensity_residual(p, p.images[k], col, row, h), w);
+
+    SfsGpuTerm terms[SFS_GPU_MAX_TERMS];
+    int num_terms = sfs_gpu_reg_terms(p.params, terms);
+    for (int it = 0; it < num_terms; it++) {
+      double r = sfs_gpu_term_value(terms[it], p.params.cols, hs, col, row);
+      cost += 0.5 * r * r;
+    }
+    std::size_t idx = std::size_t(row) * p.params.cols + col;
+    double cw = p.params.initial_dem_constraint_weight;
+    if (cw > 0) {
+      double r = cw * (hs[idx] - p.orig_heights[idx]);
+      cost += 0.5 * r * r;
+    }
+    if (p.linear_term != NULL)
+      cost -= p.linear_term[idx] * hs[idx];
+    return cost;
+  }
+
+  // The gradient and the diagonal of the Gauss-Newton matrix at a pixel,
+  // gathered from the blocks of the residuals whose stencils contain it.
+  SFS_GPU_HD inline void sfs_gpu_gather_pixel(SfsGpuProblem const& p,
+                                              double const* M, double const* b,
+                                              int col, int row,
+                                              double & grad, double & diag) {
+    int cols = p.params.cols, rows = p.params.rows;
+    grad = 0.0;
+    diag = 0.0;
+    if (sfs_gpu_is_fixed(cols, rows, col, row))
+      return;
+
+    for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+      int dx, dy;
+      sfs_gpu_offset(a, dx, dy);
+      int qc = col - dx, qr = row - dy;
+      if (sfs_gpu_is_fixed(cols, rows, qc, qr))
+        continue;
+      std::size_t q = std::size_t(qr) * cols + qc;
+      grad += b[SFS_GPU_STENCIL * q + a];
+      diag += M[SFS_GPU_SYM_SIZE * q + sfs_gpu_sym_index(a, a)];
+    }
+
+    SfsGpuTerm terms[SFS_GPU_MAX_TERMS];
+    int num_terms = sfs_gpu_reg_terms(p.params, terms);
+    for (int it = 0; it < num_terms; it++) {
+      SfsGpuTerm const& t = terms[it];
+      for (int i = 0; i < t.num_taps; i++) {
+        int qc = col - t.dx[i], qr = row - t.dy[i];
+        if (sfs_gpu_is_fixed(cols, rows, qc, qr))
+          continue;
+        grad += t.w[i] * sfs_gpu_term_value(t, cols, p.heights, qc, qr);
+        diag += t.w[i] * t.w[i];
+      }
+    }
+
+    double cw = p.params.initial_dem_constraint_weight;
+    std::size_t idx = std::size_t(row) * cols + col;
+    grad += cw * cw * (p.heights[idx] - p.orig_heights[idx]);
+    diag += cw * cw;
+    if (p.linear_term != NULL)
+      grad -= p.linear_term[idx];
+
+    // As Ceres does, bound the diagonal used for damping from below
+    if (diag < 1.0e-6)
+      diag = 1.0e-6;
+  }
+
+  // The first stage of the product of the Gauss-Newton matrix with a
+  // vector: apply the block of an interior pixel to the vector values
+  // in its stencil.
+  SFS_GPU_HD inline void sfs_gpu_apply_block(SfsGpuParams const& p, double const* M,
+                                             double const* x, int col, int row, double * t) {
+    double xs[SFS_GPU_STENCIL];
+    sfs_gpu_stencil_heights(p, x, col, row, xs);
+    for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+      double v = 0.0;
+      for (int c = 0; c < SFS_GPU_STENCIL; c++)
+        v += M[(a <= c) ? sfs_gpu_sym_index(a, c) : sfs_gpu_sym_index(c, a)] * xs[c];
+      t[a] = v;
+    }
+  }
+
+  // The second stage: gather the block products and add the
+  // regularization and damping terms. Zero at fixed pixels.
+  SFS_GPU_HD inline double sfs_gpu_apply_pixel(SfsGpuProblem const& p, double const* t,
+                                               double const* diag, double lambda,
+                                               double const* x, int col, int row) {
+    int cols = p.params.cols, rows = p.params.rows;
+    if (sfs_gpu_is_fixed(cols, rows, col, row))
+      return 0.0;
+
+    double y = 0.0;
+    for (int a = 0; a < SFS_GPU_STENCIL; a++) {
+      int dx, dy;
+      sfs_gpu_offset(a, dx, dy);
+      int qc = col - dx, qr = row - dy;
+      if (!sfs_gpu_is_fixed(cols, rows, qc, qr))
+        y += t[SFS_GPU_STENCIL * (std::size_t(qr) * cols + qc) + a];
+    }
+
+    SfsGpuTerm terms[SFS_GPU_MAX_TERMS];
+    int num_terms = sfs_gpu_reg_terms(p.params, terms);
+    for (int it = 0; it < num_terms; it++) {
+      SfsGpuTerm const& term = terms[it];
+      for (int i = 0; i < term.num_taps; i++) {
+        int qc = col - term.dx[i], qr = row - term.dy[i];
+        if (!sfs_gpu_is_fixed(cols, rows, qc, qr))
+          y += term.w[i] * sfs_gpu_term_value(term, cols, x, qc, qr);
+      }
+    }
+
+    std::size_t idx = std::size_t(row) * cols + col;
+    double cw = p.params.initial_dem_constraint_weight;
+    y += (cw * cw + lambda * diag[idx]) * x[idx];
+    return y;
+  }
+
+} // end namespace cuda
+} // end namespace asp
+
+#endif // __ASP_CORE_SFS_GPU_KERNELS_H__
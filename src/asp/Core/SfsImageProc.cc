@@ -33,6 +33,11 @@
 
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <string>
 
 namespace fs = boost::filesystem;
@@ -448,6 +453,113 @@ bool isInShadow(int col, int row, Vector3 const& sunPos,
   return false;
 }
 
+// Find the shadows by sweeping the DEM from the side facing the sun,
+// propagating the height of the shadow cast by the points seen so far.
+// The sun direction is found at the DEM center, and the DEM is treated
+// as flat, so the result is approximate. Where the DEM is not clearly
+// above or below the shadow height, use isInShadow(). Return false if
+// the sun is too low or too high for this to work.
+bool sweepShadows(Vector3 const& sunPos, ImageView<double> const& dem,
+                  double max_dem_height, double gridx, double gridy,
+                  cartography::GeoReference const& geo,
+                  ImageView<float> & shadow) {
+
+  int cols = dem.cols(), rows = dem.rows();
+  if (cols < 2 || rows < 2)
+    return false;
+
+  auto xyz_at = [&](double col, double row, double ht) {
+    Vector2 ll = geo.pixel_to_lonlat(Vector2(col, row));
+    return geo.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], ht));
+  };
+
+  // The local frame at the DEM center
+  int c0 = cols/2, r0 = rows/2;
+  double h0 = dem(c0, r0);
+  Vector3 xyz0 = xyz_at(c0, r0, h0);
+  Vector3 up   = xyz_at(c0, r0, h0 + 1.0) - xyz0;
+  Vector3 ex   = xyz_at(c0 + 1, r0, h0) - xyz0;
+  Vector3 ey   = xyz_at(c0, r0 + 1, h0) - xyz0;
+  up = up/norm_2(up);
+
+  Vector3 dir = sunPos - xyz0;
+  if (dir == Vector3())
+    return false;
+  dir = dir/norm_2(dir);
+  double sin_elev = dot_prod(dir, up);
+  Vector3 horiz = dir - sin_elev * up;
+  double cos_elev = norm_2(horiz);
+  if (sin_elev <= 0.0 || cos_elev < 1e-6)
+    return false;
+  double tan_elev = sin_elev/cos_elev;
+
+  // The horizontal direction to the sun in pixels, solving
+  // horiz = a * ex + b * ey in the least squares sense
+  double exx = dot_prod(ex, ex), exy = dot_prod(ex, ey), eyy = dot_prod(ey, ey);
+  double hx = dot_prod(horiz, ex), hy = dot_prod(horiz, ey);
+  double det = exx * eyy - exy * exy;
+  if (det <= 0.0)
+    return false;
+  double a = (hx * eyy - hy * exy)/det, b = (hy * exx - hx * exy)/det;
+
+  // Step by one pixel along the dominant axis, called "i" below, towards
+  // the sun. The other axis is "j".
+  bool major_x = (std::abs(a) >= std::abs(b));
+  int    ni   = major_x ? cols : rows, nj = major_x ? rows : cols;
+  int    si   = major_x ? (a > 0 ? 1 : -1) : (b > 0 ? 1 : -1);
+  double tj   = major_x ? b/std::abs(a) : a/std::abs(b);
+  double len  = major_x ? norm_2(si * ex + tj * ey) : norm_2(tj * ex + si * ey);
+  double drop = len * tan_elev;
+
+  // How much the height of the shadow may be off. This is due to the
+  // curvature of the planet and the change in the sun elevation over
+  // the DEM, and to the interpolation.
+  double diag = norm_2(xyz_at(0, 0, h0) - xyz_at(cols - 1, rows - 1, h0));
+  double margin = 2.0 * diag * diag / geo.datum().semi_major_axis() + drop;
+
+  // The height of the shadow cast by upstream points, and that or the
+  // DEM height, whichever is larger
+  ImageView<double> shadow_ht(cols, rows), top_ht(cols, rows);
+  auto at = [major_x](ImageView<double> & img, int i, int j) -> double& {
+    return major_x ? img(i, j) : img(j, i);
+  };
+  double lowest = -std::numeric_limits<double>::max();
+  for (int k = 0; k < ni; k++) {
+    int i = (si > 0) ? ni - 1 - k : k;
+    int up_i = i + si;
+    for (int j = 0; j < nj; j++) {
+      double ht = lowest;
+      double up_j = j + tj;
+      if (up_i >= 0 && up_i < ni && up_j >= 0 && up_j <= nj - 1) {
+        int j0 = std::min(int(floor(up_j)), nj - 2);
+        double w = up_j - j0;
+        ht = (1.0 - w) * at(top_ht, up_i, j0) + w * at(top_ht, up_i, j0 + 1) - drop;
+      }
+      double dem_ht = major_x ? dem(i, j) : dem(j, i);
+      at(shadow_ht, i, j) = ht;
+      at(top_ht, i, j) = std::max(dem_ht, ht);
+    }
+  }
+
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++) {
+      double ht = shadow_ht(col, row);
+      if (ht < dem(col, row) - margin) {
+        shadow(col, row) = 0;
+      } else if (ht > dem(col, row) + margin) {
+        shadow(col, row) = 1;
+      } else {
+        shadow(col, row) = isInShadow(col, row, sunPos, dem,
+                                      max_dem_height, gridx, gridy, geo);
+      }
+    }
+  }
+  return true;
+}
+
+// Find the points of a DEM which are in shadow. First sweep the DEM
+// to find the points clearly in shadow or lit, then invoke
+// isInShadow() for the rest.
 void areInShadow(Vector3 const& sunPos, ImageView<double> const& dem,
                  double gridx, double gridy,
                  cartography::GeoReference const& geo,
@@ -464,6 +576,9 @@ void areInShadow(Vector3 const& sunPos, ImageView<double> const& dem,
   }
 
   shadow.set_size(dem.cols(), dem.rows());
+  if (sweepShadows(sunPos, dem, max_dem_height, gridx, gridy, geo, shadow))
+    return;
+
   for (int col = 0; col < dem.cols(); col++) {
     for (int row = 0; row < dem.rows(); row++) {
       shadow(col, row) = isInShadow(col, row, sunPos, dem,
@@ -471,5 +586,186 @@ void areInShadow(Vector3 const& sunPos, ImageView<double> const& dem,
     }
   }
 }
+
+namespace {
+  const char CACHED_IMAGE_MAGIC[8] = {'A', 'S', 'P', 'C', 'A', 'C', 'H', 'E'};
+  const std::int64_t CACHED_IMAGE_VERSION = 1;
+
+  struct CachedImageHeader {
+    char          magic[8];
+    std::int64_t  version;
+    std::uint64_t key;
+    std::int64_t  cols, rows;
+  };
+}
+
+std::uint64_t hashBytes(std::uint64_t seed, const void * data, size_t size) {
+  // FNV-1a
+  std::uint64_t h = seed ^ 14695981039346656037ULL;
+  const unsigned char * ptr = (const unsigned char *)data;
+  for (size_t it = 0; it < size; it++) {
+    h ^= ptr[it];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void writeCachedImage(std::string const& file, std::uint64_t key,
+                      ImageView<double> const& img) {
+
+  CachedImageHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, CACHED_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = CACHED_IMAGE_VERSION;
+  header.key     = key;
+  header.cols    = img.cols();
+  header.rows    = img.rows();
+
+  // Write to a temporary file and rename it, so that an interrupted
+  // run does not leave behind a partial file.
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+    ofs.write((const char*)&header, sizeof(header));
+    ofs.write((const char*)img.data(), sizeof(double) * img.cols() * img.rows());
+    if (!ofs)
+      vw::vw_throw(vw::IOErr() << "Failed to write: " << tmp_file << ".\n");
+  }
+  fs::rename(tmp_file, file);
+}
+
+bool readCachedImage(std::string const& file, std::uint64_t key,
+                     ImageView<double> & img) {
+
+  std::ifstream ifs(file.c_str(), std::ios::binary);
+  if (!ifs)
+    return false;
+
+  CachedImageHeader header;
+  ifs.read((char*)&header, sizeof(header));
+  if (!ifs || std::memcmp(header.magic, CACHED_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CACHED_IMAGE_VERSION || header.key != key ||
+      header.cols < 0 || header.rows < 0)
+    return false;
+
+  ImageView<double> cached(header.cols, header.rows);
+  ifs.read((char*)cached.data(), sizeof(double) * header.cols * header.rows);
+  if (!ifs)
+    return false;
+
+  img = cached;
+  return true;
+}
+
+// The weights of full weighting are the products of 1/4, 1/2, 1/4 in
+// each direction. Neighbors outside the image are clamped to the edge.
+// This is the transpose of bilinear interpolation, divided by four, so
+// the multigrid coarse grid correction is consistent with the fine
+// grid problem.
+void restrictToCoarseGrid(ImageView<double> const& fine,
+                          ImageView<double> & coarse) {
+
+  int cols = fine.cols(), rows = fine.rows();
+  const double w[3] = {0.25, 0.5, 0.25};
+  for (int row = 0; row < coarse.rows(); row++) {
+    for (int col = 0; col < coarse.cols(); col++) {
+      double sum = 0.0;
+      for (int dy = -1; dy <= 1; dy++) {
+        int r = std::min(std::max(2 * row + dy, 0), rows - 1);
+        for (int dx = -1; dx <= 1; dx++) {
+          int c = std::min(std::max(2 * col + dx, 0), cols - 1);
+          sum += w[dx + 1] * w[dy + 1] * fine(c, r);
+        }
+      }
+      coarse(col, row) = sum;
+    }
+  }
+}
+
+void addCoarseGridCorrection(ImageView<double> const& coarse,
+                             ImageView<double> & fine) {
+
+  int cols = coarse.cols(), rows = coarse.rows();
+  for (int row = 1; row < fine.rows() - 1; row++) {
+    for (int col = 1; col < fine.cols() - 1; col++) {
+      int c0 = std::min(col / 2, cols - 1), c1 = std::min(c0 + col % 2, cols - 1);
+      int r0 = std::min(row / 2, rows - 1), r1 = std::min(r0 + row % 2, rows - 1);
+      fine(col, row) += 0.25 * (coarse(c0, r0) + coarse(c1, r0) +
+                                coarse(c0, r1) + coarse(c1, r1));
+    }
+  }
+}
+
+namespace {
+
+// The lower envelope of the parabolas (x - q)^2 + f(q), which is the
+// squared distance transform of f in 1D (Felzenszwalb and Huttenlocher).
+void squaredDistance1D(std::vector<double> const& f, std::vector<double> & d,
+                       std::vector<int> & v, std::vector<double> & z) {
+
+  int n = f.size();
+  double inf = std::numeric_limits<double>::infinity();
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+  for (int q = 1; q < n; q++) {
+    double s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k]))
+      / (2.0 * (q - v[k]));
+    while (s <= z[k]) {
+      k--;
+      s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k])) / (2.0 * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = inf;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    d[q] = double(q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+} // end anonymous namespace
+
+// The exact distance transform, done with a pass over the columns and
+// then over the rows, in time linear in the number of pixels.
+void distanceToNonzero(ImageView<unsigned char> const& sites, double max_dist,
+                       ImageView<float> & dist) {
+
+  int cols = sites.cols(), rows = sites.rows();
+  dist.set_size(cols, rows);
+  if (cols == 0 || rows == 0)
+    return;
+
+  // A large value rather than infinity, so differences are finite
+  const double big = 1e+20;
+  ImageView<double> sq(cols, rows);
+  int n = std::max(cols, rows);
+  std::vector<double> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+
+  f.resize(rows); d.resize(rows);
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++)
+      f[row] = (sites(col, row) != 0) ? 0.0 : big;
+    squaredDistance1D(f, d, v, z);
+    for (int row = 0; row < rows; row++)
+      sq(col, row) = d[row];
+  }
+
+  f.resize(cols); d.resize(cols);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++)
+      f[col] = sq(col, row);
+    squaredDistance1D(f, d, v, z);
+    for (int col = 0; col < cols; col++)
+      dist(col, row) = std::min(std::sqrt(d[col]), max_dist);
+  }
+}
   
 } // end namespace asp
@@ -31,6 +31,8 @@ namespace vw {
   }
 }
 
+#include <cstdint>
+#include <string>
 #include <vector>
 namespace asp {
 
@@ -59,10 +61,41 @@ bool isInShadow(int col, int row, vw::Vector3 const& sunPos,
                 double gridx, double gridy,
                 vw::cartography::GeoReference const& geo);
 
+// See the .cc file for the documentation.
 void areInShadow(vw::Vector3 const& sunPos, vw::ImageView<double> const& dem,
                  double gridx, double gridy,
                  vw::cartography::GeoReference const& geo,
                  vw::ImageView<float> & shadow);
+
+// Accumulate a hash of some bytes, to make a key for a cached image
+std::uint64_t hashBytes(std::uint64_t seed, const void * data, size_t size);
+
+// Save an image, with a key identifying the inputs it was made from
+void writeCachedImage(std::string const& file, std::uint64_t key,
+                      vw::ImageView<double> const& img);
+
+// Read an image saved with writeCachedImage(). Return false if the
+// file does not exist, is not valid, or was saved with another key.
+bool readCachedImage(std::string const& file, std::uint64_t key,
+                     vw::ImageView<double> & img);
+
+// Restrict an image to the grid coarser by a factor of two, with full
+// weighting. Coarse pixel (col, row) is at fine pixel (2*col, 2*row).
+// The coarse image must be allocated.
+void restrictToCoarseGrid(vw::ImageView<double> const& fine,
+                          vw::ImageView<double> & coarse);
+
+// Add to the interior of an image the bilinear interpolation of a
+// correction on the grid coarser by a factor of two. The boundary,
+// which is kept fixed in sfs, is not changed.
+void addCoarseGridCorrection(vw::ImageView<double> const& coarse,
+                             vw::ImageView<double> & fine);
+
+// Find the Euclidean distance from each pixel to the nearest pixel
+// with a nonzero value in the input, capped at max_dist. The output
+// is resized.
+void distanceToNonzero(vw::ImageView<unsigned char> const& sites, double max_dist,
+                       vw::ImageView<float> & dist);
   
 } // end namespace asp
 
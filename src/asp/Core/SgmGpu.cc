@@ -0,0 +1,180 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SgmGpu.cc
+///
+
+#include <asp/Core/Common.h> // for ASP_HAVE_PKG_CUDA
+#include <asp/Core/SgmGpu.h>
+
+#if defined(ASP_HAVE_PKG_CUDA) && ASP_HAVE_PKG_CUDA == 1
+#include <asp/Core/SgmGpuKernels.h>
+#endif
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+using namespace vw;
+
+namespace asp {
+
+bool is_sgm_gpu_alg(std::string const& alg) {
+  std::string lalg = boost::to_lower_copy(alg);
+  return lalg.rfind("asp_sgm_gpu", 0) == 0;
+}
+
+#if defined(ASP_HAVE_PKG_CUDA) && ASP_HAVE_PKG_CUDA == 1
+
+namespace {
+  // Only one tile at a time can use the device, as each one allocates a cost
+  // volume that is comparable to the device memory.
+  boost::mutex g_sgm_gpu_mutex;
+}
+
+bool sgm_gpu_available(std::string & reason) {
+  std::size_t free_mem = 0;
+  return asp::cuda::sgm_gpu_device_available(reason, free_mem);
+}
+
+bool sgm_gpu_correlate(ImageView<PixelGray<float>> const& left,
+                       ImageView<PixelGray<float>> const& right,
+                       ImageView<uint8>            const& left_mask,
+                       ImageView<uint8>            const& right_mask,
+                       BBox2i const& search_range,
+                       Vector2i const& kernel_size,
+                       int cost_mode, int num_paths, bool subpixel,
+                       int lr_threshold,
+                       ImageView<PixelMask<Vector2f>> & disparity,
+                       std::string & error) {
+
+  asp::cuda::SgmGpuParams p;
+  p.cols              = left.cols();
+  p.rows              = left.rows();
+  p.disp_cols         = search_range.width()  + 1;
+  p.disp_rows         = search_range.height() + 1;
+  p.kernel_cols       = kernel_size[0];
+  p.kernel_rows       = kernel_size[1];
+  p.ternary           = (cost_mode == 4);
+  p.ternary_threshold = 0.01; // the images are normalized to [0, 1]
+  p.num_paths         = num_paths;
+  p.subpixel          = subpixel;
+  p.lr_threshold      = lr_threshold;
+
+  if (right.cols() != p.cols + p.disp_cols - 1 || right.rows() != p.rows + p.disp_rows - 1 ||
+      left_mask.cols() != left.cols() || left_mask.rows() != left.rows() ||
+      right_mask.cols() != right.cols() || right_mask.rows() != right.rows())
+    vw_throw(ArgumentErr() << "sgm_gpu_correlate: Inconsistent input image sizes.\n");
+
+  // Penalties scaled by the number of census bits. These are the values
+  // commonly used with a 9x7 census window (62 bits), which is the size
+  // the GPU SGM literature was tuned on.
+  int census_bits = (p.kernel_cols * p.kernel_rows - 1) * (p.ternary ? 2 : 1);
+  p.p1 = std::max(1, int(round(10.0 * census_bits / 62.0)));
+  p.p2 = std::max(p.p1 + 1, int(round(120.0 * census_bits / 62.0)));
+
+  if (p.disp_cols * p.disp_rows > asp::cuda::sgm_gpu_max_disparities()) {
+    std::ostringstream os;
+    os << "Search range " << search_range << " has more than "
+       << asp::cuda::sgm_gpu_max_disparities() << " disparities.";
+    error = os.str();
+    return false;
+  }
+
+  boost::mutex::scoped_lock lock(g_sgm_gpu_mutex);
+
+  std::size_t free_mem = 0;
+  if (!asp::cuda::sgm_gpu_device_available(error, free_mem))
+    return false;
+  std::size_t needed = asp::cuda::sgm_gpu_memory_needed(p);
+  if (needed > free_mem) {
+    std::ostringstream os;
+    os << "Need " << needed / (1024 * 1024) << " MB of GPU memory but only "
+       << free_mem / (1024 * 1024) << " MB are available.";
+    error = os.str();
+    return false;
+  }
+
+  // Copy the data to contiguous buffers
+  std::vector<float> left_buf(p.cols * p.rows), right_buf(right.cols() * right.rows());
+  std::vector<uint8> left_mask_buf(left_buf.size()), right_mask_buf(right_buf.size());
+  for (int row = 0; row < left.rows(); row++) {
+    for (int col = 0; col < left.cols(); col++) {
+      left_buf     [row * left.cols() + col] = left(col, row);
+      left_mask_buf[row * left.cols() + col] = left_mask(col, row);
+    }
+  }
+  for (int row = 0; row < right.rows(); row++) {
+    for (int col = 0; col < right.cols(); col++) {
+      right_buf     [row * right.cols() + col] = right(col, row);
+      right_mask_buf[row * right.cols() + col] = right_mask(col, row);
+    }
+  }
+
+  std::vector<float> disp_x(left_buf.size()), disp_y(left_buf.size());
+  std::vector<uint8> valid(left_buf.size());
+  if (!asp::cuda::sgm_gpu_run(p, &left_buf[0], &left_mask_buf[0],
+                              &right_buf[0], &right_mask_buf[0],
+                              &disp_x[0], &disp_y[0], &valid[0], error))
+    return false;
+
+  // Convert from disparity index to actual disparity
+  disparity.set_size(p.cols, p.rows);
+  for (int row = 0; row < p.rows; row++) {
+    for (int col = 0; col < p.cols; col++) {
+      int pix = row * p.cols + col;
+      PixelMask<Vector2f> d(Vector2f(disp_x[pix] + search_range.min().x(),
+                                     disp_y[pix] + search_range.min().y()));
+      if (!valid[pix])
+        d.invalidate();
+      disparity(col, row) = d;
+    }
+  }
+
+  return true;
+}
+
+#else // Not built with CUDA
+
+bool sgm_gpu_available(std::string & reason) {
+  reason = "ASP was not built with CUDA support. Reconfigure with -DASP_ENABLE_CUDA=ON.";
+  return false;
+}
+
+bool sgm_gpu_correlate(ImageView<PixelGray<float>> const& left,
+                       ImageView<PixelGray<float>> const& right,
+                       ImageView<uint8>            const& left_mask,
+                       ImageView<uint8>            const& right_mask,
+                       BBox2i const& search_range,
+                       Vector2i const& kernel_size,
+                       int cost_mode, int num_paths, bool subpixel,
+                       int lr_threshold,
+                       ImageView<PixelMask<Vector2f>> & disparity,
+                       std::string & error) {
+  sgm_gpu_available(error);
+  return false;
+}
+
+#endif
+
+} // end namespace asp
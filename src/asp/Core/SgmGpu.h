@@ -0,0 +1,68 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SgmGpu.h
+///
+/// Semi-global matching on the GPU, used by the asp_sgm_gpu algorithm.
+/// The CUDA kernels are compiled only if ASP was configured with
+/// -DASP_ENABLE_CUDA=ON. Otherwise these functions report that no GPU
+/// is available.
+
+#ifndef __ASP_CORE_SGM_GPU_H__
+#define __ASP_CORE_SGM_GPU_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+
+namespace asp {
+
+  /// Return true if the stereo algorithm name asks for the GPU engine
+  bool is_sgm_gpu_alg(std::string const& alg);
+
+  /// Return true if ASP was built with CUDA and a device was found.
+  /// Otherwise populate the reason.
+  bool sgm_gpu_available(std::string & reason);
+
+  /// Run SGM on the GPU for a left image region. The right image must cover
+  /// the left image region shifted by all disparities in the search range, so
+  /// its size must be the left size plus the search range size. Its upper-left
+  /// corner corresponds to search_range.min(). The census window is given by
+  /// kernel_size. The cost_mode is 3 (census) or 4 (ternary census). The
+  /// num_paths is 8 or 16. A negative lr_threshold skips the left-right check.
+  /// Returns false and sets the error message if the problem cannot be solved
+  /// on the device (too little memory or too many disparities). Then the caller
+  /// is expected to fall back to the CPU.
+  bool sgm_gpu_correlate(vw::ImageView<vw::PixelGray<float>> const& left,
+                         vw::ImageView<vw::PixelGray<float>> const& right,
+                         vw::ImageView<vw::uint8>            const& left_mask,
+                         vw::ImageView<vw::uint8>            const& right_mask,
+                         vw::BBox2i const& search_range,
+                         vw::Vector2i const& kernel_size,
+                         int cost_mode, int num_paths, bool subpixel,
+                         int lr_threshold,
+                         vw::ImageView<vw::PixelMask<vw::Vector2f>> & disparity,
+                         std::string & error);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_SGM_GPU_H__
@@ -0,0 +1,524 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SgmGpuKernels.cu
+///
+/// CUDA implementation of semi-global matching with a 2D search range.
+/// The cost volume is computed with a (ternary) census transform, costs are
+/// aggregated along 8 or 16 directions, and the winner-take-all disparity is
+/// refined with a parabola fit, all on the device. The cost volume is stored
+/// with the disparity index being the fastest-varying one, so that threads in
+/// a block, each handling a disparity, access memory contiguously.
+
+#include <asp/Core/SgmGpuKernels.h>
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace asp {
+namespace cuda {
+
+namespace {
+
+  // Up to 9x9 windows, two bits per pixel for the ternary census
+  const int CENSUS_WORDS = 4;
+  struct Census {
+    unsigned long long w[CENSUS_WORDS];
+  };
+
+  const int AGG_THREADS = 256;
+  const int WARP_SIZE   = 32;
+  const int WTA_WARPS   = 8;
+
+  // Max shared memory used by the aggregation kernel (two rows of uint16 costs)
+  const int MAX_SHARED_BYTES = 48 * 1024;
+
+  // The aggregated costs are stored as uint16. This bounds the penalties.
+  const int MAX_P2 = 3072;
+
+  // Convenience macro to bail out on a CUDA error
+#define ASP_CUDA_CHECK(call)                                               \
+  do {                                                                     \
+    cudaError_t status = (call);                                           \
+    if (status != cudaSuccess) {                                           \
+      std::ostringstream os;                                               \
+      os << "CUDA error in " << #call << ": " << cudaGetErrorString(status); \
+      error = os.str();                                                    \
+      return false;                                                        \
+    }                                                                      \
+  } while (0)
+
+  __device__ inline int clamp_int(int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+  }
+
+  // Census transform. Out-of-image neighbors are clamped to the edge.
+  __global__ void census_kernel(float const* img, int cols, int rows,
+                                int kcols, int krows, bool ternary, float thresh,
+                                Census * out) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= cols || y >= rows)
+      return;
+
+    Census c;
+    for (int k = 0; k < CENSUS_WORDS; k++)
+      c.w[k] = 0ULL;
+
+    float center = img[y * cols + x];
+    int hc = kcols / 2, hr = krows / 2;
+    int bit = 0;
+    for (int dy = -hr; dy <= hr; dy++) {
+      int yy = clamp_int(y + dy, 0, rows - 1);
+      for (int dx = -hc; dx <= hc; dx++) {
+        if (dx == 0 && dy == 0)
+          continue;
+        int xx = clamp_int(x + dx, 0, cols - 1);
+        float val = img[yy * cols + xx];
+        if (!ternary) {
+          if (val > center)
+            c.w[bit / 64] |= (1ULL << (bit % 64));
+          bit++;
+        } else {
+          // Two bits per pixel: one for brighter, one for darker, none if similar
+          if (val - center > thresh)
+            c.w[bit / 64] |= (1ULL << (bit % 64));
+          bit++;
+          if (center - val > thresh)
+            c.w[bit / 64] |= (1ULL << (bit % 64));
+          bit++;
+        }
+      }
+    }
+    out[y * cols + x] = c;
+  }
+
+  // Matching cost for each pixel and disparity. One block per left pixel,
+  // threads in the block iterate over disparities.
+  __global__ void cost_kernel(Census const* lc, std::uint8_t const* lmask,
+                              Census const* rc, std::uint8_t const* rmask,
+                              int cols, int rows, int rcols,
+                              int dcols, int num_disp, int max_cost,
+                              std::uint8_t * cost) {
+    int pix = blockIdx.x;
+    if (pix >= cols * rows)
+      return;
+    int x = pix % cols, y = pix / cols;
+    std::size_t base = std::size_t(pix) * num_disp;
+
+    Census const& l = lc[pix];
+    bool left_valid = (lmask[pix] != 0);
+    for (int d = threadIdx.x; d < num_disp; d += blockDim.x) {
+      int i = d % dcols, j = d / dcols;
+      int rpix = (y + j) * rcols + (x + i);
+      int val = max_cost;
+      if (left_valid && rmask[rpix] != 0) {
+        Census const& r = rc[rpix];
+        val = 0;
+        for (int k = 0; k < CENSUS_WORDS; k++)
+          val += __popcll(l.w[k] ^ r.w[k]);
+      }
+      cost[base + d] = (std::uint8_t)val;
+    }
+  }
+
+  __device__ inline unsigned int warp_min(unsigned int v) {
+    for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+      v = min(v, __shfl_down_sync(0xffffffff, v, offset));
+    return v;
+  }
+
+  // Aggregate costs along one direction. Each block walks one path, starting
+  // at the given pixel, with threads handling disparities. Within a launch each
+  // pixel is visited by exactly one block, so the accumulation needs no atomics.
+  __global__ void aggregate_kernel(std::uint8_t const* cost, unsigned short * agg,
+                                   int2 const* starts, int num_starts,
+                                   int step_x, int step_y, int cols, int rows,
+                                   int dcols, int drows, int p1, int p2) {
+    extern __shared__ unsigned short shared_costs[];
+    __shared__ unsigned int warp_mins[AGG_THREADS / WARP_SIZE];
+    __shared__ unsigned int prev_min;
+
+    if (blockIdx.x >= num_starts)
+      return;
+
+    int num_disp = dcols * drows;
+    unsigned short * prev = shared_costs;
+    unsigned short * cur  = shared_costs + num_disp;
+
+    int x = starts[blockIdx.x].x, y = starts[blockIdx.x].y;
+    bool first = true;
+    while (x >= 0 && x < cols && y >= 0 && y < rows) {
+
+      std::size_t base = (std::size_t(y) * cols + x) * num_disp;
+      for (int d = threadIdx.x; d < num_disp; d += blockDim.x) {
+        unsigned int c = cost[base + d];
+        if (first) {
+          cur[d] = c;
+          continue;
+        }
+        // Small penalty for neighbors in the 2D disparity space, large otherwise
+        int i = d % dcols, j = d / dcols;
+        unsigned int v = prev[d];
+        if (i > 0)         v = min(v, (unsigned int)prev[d - 1]     + p1);
+        if (i < dcols - 1) v = min(v, (unsigned int)prev[d + 1]     + p1);
+        if (j > 0)         v = min(v, (unsigned int)prev[d - dcols] + p1);
+        if (j < drows - 1) v = min(v, (unsigned int)prev[d + dcols] + p1);
+        v = min(v, prev_min + p2);
+        cur[d] = (unsigned short)(c + v - prev_min);
+      }
+      __syncthreads();
+
+      // Accumulate, copy to prev, and find the min for the next step
+      unsigned int local_min = 0xffffffff;
+      for (int d = threadIdx.x; d < num_disp; d += blockDim.x) {
+        unsigned short v = cur[d];
+        agg[base + d] += v;
+        prev[d] = v;
+        local_min = min(local_min, (unsigned int)v);
+      }
+      local_min = warp_min(local_min);
+      if (threadIdx.x % WARP_SIZE == 0)
+        warp_mins[threadIdx.x / WARP_SIZE] = local_min;
+      __syncthreads();
+      if (threadIdx.x == 0) {
+        unsigned int m = warp_mins[0];
+        for (int w = 1; w < blockDim.x / WARP_SIZE; w++)
+          m = min(m, warp_mins[w]);
+        prev_min = m;
+      }
+      __syncthreads();
+
+      first = false;
+      x += step_x;
+      y += step_y;
+    }
+  }
+
+  // Find the min cost and its index within a warp
+  __device__ inline void warp_argmin(unsigned int & val, int & index) {
+    for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+      unsigned int other_val = __shfl_down_sync(0xffffffff, val, offset);
+      int          other_idx = __shfl_down_sync(0xffffffff, index, offset);
+      if (other_val < val || (other_val == val && other_idx < index)) {
+        val   = other_val;
+        index = other_idx;
+      }
+    }
+  }
+
+  // Winner-take-all with an optional parabola fit. One warp per left pixel.
+  __global__ void wta_kernel(unsigned short const* agg, std::uint8_t const* lmask,
+                             int cols, int rows, int dcols, int drows, bool subpixel,
+                             int * best, float * disp_x, float * disp_y,
+                             std::uint8_t * valid) {
+    int warp = (blockIdx.x * blockDim.x + threadIdx.x) / WARP_SIZE;
+    int lane = threadIdx.x % WARP_SIZE;
+    if (warp >= cols * rows)
+      return;
+
+    int num_disp = dcols * drows;
+    std::size_t base = std::size_t(warp) * num_disp;
+    unsigned int val = 0xffffffff;
+    int index = -1;
+    for (int d = lane; d < num_disp; d += WARP_SIZE) {
+      unsigned int v = agg[base + d];
+      if (v < val) {
+        val   = v;
+        index = d;
+      }
+    }
+    warp_argmin(val, index);
+    if (lane != 0)
+      return;
+
+    if (lmask[warp] == 0 || index < 0) {
+      best[warp]   = -1;
+      valid[warp]  = 0;
+      disp_x[warp] = 0.0f;
+      disp_y[warp] = 0.0f;
+      return;
+    }
+
+    int i = index % dcols, j = index / dcols;
+    float dx = float(i), dy = float(j);
+    if (subpixel) {
+      float c0 = float(val);
+      if (i > 0 && i < dcols - 1) {
+        float cm = agg[base + index - 1], cp = agg[base + index + 1];
+        float den = 2.0f * (cm - 2.0f * c0 + cp);
+        if (den > 0.0f)
+          dx += fminf(fmaxf((cm - cp) / den, -0.5f), 0.5f);
+      }
+      if (j > 0 && j < drows - 1) {
+        float cm = agg[base + index - dcols], cp = agg[base + index + dcols];
+        float den = 2.0f * (cm - 2.0f * c0 + cp);
+        if (den > 0.0f)
+          dy += fminf(fmaxf((cm - cp) / den, -0.5f), 0.5f);
+      }
+    }
+    best[warp]   = index;
+    valid[warp]  = 1;
+    disp_x[warp] = dx;
+    disp_y[warp] = dy;
+  }
+
+  // Right-to-left winner-take-all, reusing the left-to-right aggregated volume.
+  // One warp per right pixel.
+  __global__ void wta_right_kernel(unsigned short const* agg,
+                                   int cols, int rows, int rcols, int rrows,
+                                   int dcols, int drows, int * rbest) {
+    int warp = (blockIdx.x * blockDim.x + threadIdx.x) / WARP_SIZE;
+    int lane = threadIdx.x % WARP_SIZE;
+    if (warp >= rcols * rrows)
+      return;
+
+    int xr = warp % rcols, yr = warp / rcols;
+    int num_disp = dcols * drows;
+    unsigned int val = 0xffffffff;
+    int index = -1;
+    for (int d = lane; d < num_disp; d += WARP_SIZE) {
+      int x = xr - d % dcols, y = yr - d / dcols;
+      if (x < 0 || x >= cols || y < 0 || y >= rows)
+        continue;
+      unsigned int v = agg[(std::size_t(y) * cols + x) * num_disp + d];
+      if (v < val) {
+        val   = v;
+        index = d;
+      }
+    }
+    warp_argmin(val, index);
+    if (lane == 0)
+      rbest[warp] = index;
+  }
+
+  // Invalidate left pixels whose match does not point back to them
+  __global__ void lr_check_kernel(int const* best, int const* rbest,
+                                  int cols, int rows, int rcols, int dcols,
+                                  int threshold, std::uint8_t * valid) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= cols || y >= rows)
+      return;
+    int pix = y * cols + x;
+    int d = best[pix];
+    if (d < 0)
+      return;
+    int i = d % dcols, j = d / dcols;
+    int rd = rbest[(y + j) * rcols + (x + i)];
+    if (rd < 0 || abs(rd % dcols - i) > threshold || abs(rd / dcols - j) > threshold)
+      valid[pix] = 0;
+  }
+
+  // The pixels at which a path in given direction enters the image
+  void path_starts(int cols, int rows, int step_x, int step_y,
+                   std::vector<int2> & starts) {
+    starts.clear();
+    for (int y = 0; y < rows; y++) {
+      for (int x = 0; x < cols; x++) {
+        int px = x - step_x, py = y - step_y;
+        if (px >= 0 && px < cols && py >= 0 && py < rows)
+          continue;
+        starts.push_back(make_int2(x, y));
+      }
+    }
+  }
+
+  // A RAII holder for device memory
+  template <class T>
+  struct DeviceBuffer {
+    T * ptr;
+    DeviceBuffer(): ptr(NULL) {}
+    ~DeviceBuffer() { if (ptr != NULL) cudaFree(ptr); }
+    cudaError_t alloc(std::size_t count) { return cudaMalloc((void**)&ptr, count * sizeof(T)); }
+  };
+
+} // end anonymous namespace
+
+std::size_t sgm_gpu_memory_needed(SgmGpuParams const& p) {
+  std::size_t num_pix  = std::size_t(p.cols) * p.rows;
+  std::size_t num_rpix = std::size_t(p.cols + p.disp_cols - 1) * (p.rows + p.disp_rows - 1);
+  std::size_t num_disp = std::size_t(p.disp_cols) * p.disp_rows;
+  std::size_t mem = 0;
+  mem += (num_pix + num_rpix) * (sizeof(float) + sizeof(std::uint8_t) + sizeof(Census));
+  mem += num_pix * num_disp * (sizeof(std::uint8_t) + sizeof(unsigned short));
+  mem += num_pix * (2 * sizeof(float) + sizeof(std::uint8_t) + sizeof(int));
+  mem += num_rpix * sizeof(int);
+  mem += 4 * (std::size_t(p.cols) + p.rows) * sizeof(int2); // path starting points
+  return mem;
+}
+
+int sgm_gpu_max_disparities() {
+  return MAX_SHARED_BYTES / (2 * sizeof(unsigned short));
+}
+
+bool sgm_gpu_device_available(std::string & reason, std::size_t & free_mem) {
+  free_mem = 0;
+  int count = 0;
+  cudaError_t status = cudaGetDeviceCount(&count);
+  if (status != cudaSuccess || count <= 0) {
+    reason = (status != cudaSuccess) ? cudaGetErrorString(status) : "No CUDA device found.";
+    return false;
+  }
+  std::size_t total_mem = 0;
+  status = cudaMemGetInfo(&free_mem, &total_mem);
+  if (status != cudaSuccess) {
+    reason = cudaGetErrorString(status);
+    return false;
+  }
+  return true;
+}
+
+bool sgm_gpu_run(SgmGpuParams const& p,
+                 float        const* left,  std::uint8_t const* left_mask,
+                 float        const* right, std::uint8_t const* right_mask,
+                 float * disp_x, float * disp_y, std::uint8_t * valid,
+                 std::string & error) {
+
+  int cols = p.cols, rows = p.rows;
+  int rcols = cols + p.disp_cols - 1, rrows = rows + p.disp_rows - 1;
+  int num_disp = p.disp_cols * p.disp_rows;
+  std::size_t num_pix = std::size_t(cols) * rows, num_rpix = std::size_t(rcols) * rrows;
+
+  if (num_disp > sgm_gpu_max_disparities()) {
+    std::ostringstream os;
+    os << "The search range has " << num_disp << " disparities, more than the "
+       << sgm_gpu_max_disparities() << " supported by the GPU SGM implementation.";
+    error = os.str();
+    return false;
+  }
+
+  int census_bits = (p.kernel_cols * p.kernel_rows - 1) * (p.ternary ? 2 : 1);
+  if (census_bits > CENSUS_WORDS * 64) {
+    error = "The census window is too large for the GPU SGM implementation.";
+    return false;
+  }
+  int p2 = std::min(p.p2, MAX_P2);
+  int p1 = std::min(p.p1, p2);
+
+  DeviceBuffer<float> d_left, d_right, d_disp_x, d_disp_y;
+  DeviceBuffer<std::uint8_t> d_lmask, d_rmask, d_cost, d_valid;
+  DeviceBuffer<Census> d_lcensus, d_rcensus;
+  DeviceBuffer<unsigned short> d_agg;
+  DeviceBuffer<int> d_best, d_rbest;
+  DeviceBuffer<int2> d_starts;
+
+  ASP_CUDA_CHECK(d_left.alloc(num_pix));
+  ASP_CUDA_CHECK(d_right.alloc(num_rpix));
+  ASP_CUDA_CHECK(d_lmask.alloc(num_pix));
+  ASP_CUDA_CHECK(d_rmask.alloc(num_rpix));
+  ASP_CUDA_CHECK(d_lcensus.alloc(num_pix));
+  ASP_CUDA_CHECK(d_rcensus.alloc(num_rpix));
+  ASP_CUDA_CHECK(d_cost.alloc(num_pix * num_disp));
+  ASP_CUDA_CHECK(d_agg.alloc(num_pix * num_disp));
+  ASP_CUDA_CHECK(d_best.alloc(num_pix));
+  ASP_CUDA_CHECK(d_rbest.alloc(num_rpix));
+  ASP_CUDA_CHECK(d_disp_x.alloc(num_pix));
+  ASP_CUDA_CHECK(d_disp_y.alloc(num_pix));
+  ASP_CUDA_CHECK(d_valid.alloc(num_pix));
+
+  ASP_CUDA_CHECK(cudaMemcpy(d_left.ptr,  left,       num_pix  * sizeof(float),
+                            cudaMemcpyHostToDevice));
+  ASP_CUDA_CHECK(cudaMemcpy(d_right.ptr, right,      num_rpix * sizeof(float),
+                            cudaMemcpyHostToDevice));
+  ASP_CUDA_CHECK(cudaMemcpy(d_lmask.ptr, left_mask,  num_pix,  cudaMemcpyHostToDevice));
+  ASP_CUDA_CHECK(cudaMemcpy(d_rmask.ptr, right_mask, num_rpix, cudaMemcpyHostToDevice));
+
+  // Census transform of both images
+  dim3 block2d(16, 16);
+  dim3 lgrid((cols  + block2d.x - 1) / block2d.x, (rows  + block2d.y - 1) / block2d.y);
+  dim3 rgrid((rcols + block2d.x - 1) / block2d.x, (rrows + block2d.y - 1) / block2d.y);
+  census_kernel<<<lgrid, block2d>>>(d_left.ptr, cols, rows, p.kernel_cols, p.kernel_rows,
+                                    p.ternary, p.ternary_threshold, d_lcensus.ptr);
+  census_kernel<<<rgrid, block2d>>>(d_right.ptr, rcols, rrows, p.kernel_cols, p.kernel_rows,
+                                    p.ternary, p.ternary_threshold, d_rcensus.ptr);
+  ASP_CUDA_CHECK(cudaGetLastError());
+
+  // The cost volume
+  int cost_threads = std::min(AGG_THREADS, ((num_disp + WARP_SIZE - 1)/WARP_SIZE) * WARP_SIZE);
+  cost_kernel<<<(unsigned int)num_pix, cost_threads>>>(d_lcensus.ptr, d_lmask.ptr,
+                                                       d_rcensus.ptr, d_rmask.ptr,
+                                                       cols, rows, rcols, p.disp_cols,
+                                                       num_disp, census_bits, d_cost.ptr);
+  ASP_CUDA_CHECK(cudaGetLastError());
+
+  // Path aggregation, one direction at a time
+  ASP_CUDA_CHECK(cudaMemset(d_agg.ptr, 0, num_pix * num_disp * sizeof(unsigned short)));
+  const int dirs8[8][2]  = {{1, 0}, {-1, 0}, {0, 1}, {0, -1},
+                            {1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+  const int dirs16[8][2] = {{2, 1}, {-2, -1}, {2, -1}, {-2, 1},
+                            {1, 2}, {-1, -2}, {1, -2}, {-1, 2}};
+  std::vector<std::pair<int, int>> dirs;
+  for (int k = 0; k < 8; k++)
+    dirs.push_back(std::make_pair(dirs8[k][0], dirs8[k][1]));
+  if (p.num_paths >= 16) {
+    for (int k = 0; k < 8; k++)
+      dirs.push_back(std::make_pair(dirs16[k][0], dirs16[k][1]));
+  }
+
+  // At most |step_x| columns and |step_y| rows of starting points per direction
+  std::size_t max_starts = 4 * (std::size_t(cols) + rows);
+  ASP_CUDA_CHECK(d_starts.alloc(max_starts));
+  std::size_t shared_bytes = 2 * num_disp * sizeof(unsigned short);
+  std::vector<int2> starts;
+  for (std::size_t k = 0; k < dirs.size(); k++) {
+    path_starts(cols, rows, dirs[k].first, dirs[k].second, starts);
+    if (starts.empty() || starts.size() > max_starts) {
+      error = "Unexpected number of SGM path starting points.";
+      return false;
+    }
+    ASP_CUDA_CHECK(cudaMemcpy(d_starts.ptr, &starts[0], starts.size() * sizeof(int2),
+                              cudaMemcpyHostToDevice));
+    aggregate_kernel<<<(unsigned int)starts.size(), AGG_THREADS, shared_bytes>>>
+      (d_cost.ptr, d_agg.ptr, d_starts.ptr, (int)starts.size(),
+       dirs[k].first, dirs[k].second, cols, rows, p.disp_cols, p.disp_rows, p1, p2);
+    ASP_CUDA_CHECK(cudaGetLastError());
+  }
+
+  // Winner-take-all and subpixel fit
+  int wta_threads = WTA_WARPS * WARP_SIZE;
+  unsigned int wta_blocks = (unsigned int)((num_pix + WTA_WARPS - 1) / WTA_WARPS);
+  wta_kernel<<<wta_blocks, wta_threads>>>(d_agg.ptr, d_lmask.ptr, cols, rows,
+                                          p.disp_cols, p.disp_rows, p.subpixel,
+                                          d_best.ptr, d_disp_x.ptr, d_disp_y.ptr,
+                                          d_valid.ptr);
+  ASP_CUDA_CHECK(cudaGetLastError());
+
+  // Left-right consistency check
+  if (p.lr_threshold >= 0) {
+    unsigned int rwta_blocks = (unsigned int)((num_rpix + WTA_WARPS - 1) / WTA_WARPS);
+    wta_right_kernel<<<rwta_blocks, wta_threads>>>(d_agg.ptr, cols, rows, rcols, rrows,
+                                                   p.disp_cols, p.disp_rows, d_rbest.ptr);
+    lr_check_kernel<<<lgrid, block2d>>>(d_best.ptr, d_rbest.ptr, cols, rows, rcols,
+                                        p.disp_cols, p.lr_threshold, d_valid.ptr);
+    ASP_CUDA_CHECK(cudaGetLastError());
+  }
+
+  ASP_CUDA_CHECK(cudaMemcpy(disp_x, d_disp_x.ptr, num_pix * sizeof(float),
+                            cudaMemcpyDeviceToHost));
+  ASP_CUDA_CHECK(cudaMemcpy(disp_y, d_disp_y.ptr, num_pix * sizeof(float),
+                            cudaMemcpyDeviceToHost));
+  ASP_CUDA_CHECK(cudaMemcpy(valid, d_valid.ptr, num_pix, cudaMemcpyDeviceToHost));
+
+  return true;
+}
+
+} // end namespace cuda
+} // end namespace asp
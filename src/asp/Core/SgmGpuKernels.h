@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SgmGpuKernels.h
+///
+/// Plain interface to the CUDA SGM kernels. This header must not depend on
+/// VW or Boost, as it is included by nvcc. The VW-facing API is in SgmGpu.h.
+
+#ifndef __ASP_CORE_SGM_GPU_KERNELS_H__
+#define __ASP_CORE_SGM_GPU_KERNELS_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace asp {
+namespace cuda {
+
+  // Parameters for one SGM run on the device. The left image has size
+  // cols x rows. The right image has size (cols + disp_cols - 1) x (rows +
+  // disp_rows - 1), and its upper-left corner corresponds to the smallest
+  // disparity in the search range, so disparity index (i, j) for left
+  // pixel (x, y) corresponds to right pixel (x + i, y + j).
+  struct SgmGpuParams {
+    int cols, rows;           // left image dimensions
+    int disp_cols, disp_rows; // search range dimensions
+    int kernel_cols, kernel_rows; // census window, each dimension odd
+    bool ternary;             // ternary census if true, regular census otherwise
+    float ternary_threshold;  // used only for ternary census
+    int num_paths;            // 8 or 16
+    int p1, p2;               // smoothness penalties
+    bool subpixel;            // fit a parabola around the best disparity
+    int lr_threshold;         // max left-right disagreement, negative to skip the check
+  };
+
+  /// Number of bytes of device memory needed for given parameters
+  std::size_t sgm_gpu_memory_needed(SgmGpuParams const& params);
+
+  /// Largest number of disparities that can be handled by the path
+  /// aggregation kernels, which keep two rows of costs in shared memory.
+  int sgm_gpu_max_disparities();
+
+  /// Returns true if a CUDA device is present. Otherwise populates the reason.
+  bool sgm_gpu_device_available(std::string & reason, std::size_t & free_mem);
+
+  /// Run SGM on the device. All pointers are to host memory. The masks are
+  /// non-zero for valid pixels. The outputs have size cols x rows and
+  /// contain the full-range disparity index (not offset by the search range
+  /// minimum). Returns false and sets the error message on failure.
+  bool sgm_gpu_run(SgmGpuParams const& params,
+                   float        const* left,  std::uint8_t const* left_mask,
+                   float        const* right, std::uint8_t const* right_mask,
+                   float * disp_x, float * disp_y, std::uint8_t * valid,
+                   std::string & error);
+
+} // end namespace cuda
+} // end namespace asp
+
+#endif // __ASP_CORE_SGM_GPU_KERNELS_H__
@@ -0,0 +1,253 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ShmBlockCache.cc
+///
+
+#include <asp/Core/ShmBlockCache.h>
+#include <asp/Core/IpCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/Image/PixelTypeInfo.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  const int MIN_CACHE_BLOCK = 512;
+
+  // The stamp identifying the version of an image whose blocks are cached
+  std::string image_stamp(std::string const& filename, vw::Vector2i const& block_size) {
+    std::ostringstream os;
+    os << filename << "\n" << fs::last_write_time(filename) << " "
+       << fs::file_size(filename) << " " << block_size[0] << " " << block_size[1] << "\n";
+    return os.str();
+  }
+
+  std::string read_file(std::string const& file) {
+    std::ifstream ifs(file.c_str());
+    std::stringstream buf;
+    buf << ifs.rdbuf();
+    return buf.str();
+  }
+
+  // Write a file under a temporary name and rename it, so that other
+  // processes see either the whole file or none of it. Failures only
+  // mean that the cache is not used, so they are ignored.
+  void write_atomic(std::string const& file, const void * data, size_t size) {
+    std::ostringstream os;
+    os << file << "." << getpid() << ".tmp";
+    std::string tmp = os.str();
+    FILE * fp = fopen(tmp.c_str(), "wb");
+    if (fp == NULL)
+      return;
+    bool ok = (fwrite(data, 1, size, fp) == size);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0)
+      unlink(tmp.c_str());
+  }
+
+  // If there is room in /dev/shm for this many more bytes, leaving a quarter free
+  bool have_room(std::string const& dir, size_t size) {
+    struct statvfs st;
+    if (statvfs(dir.c_str(), &st) != 0)
+      return false;
+    double total = double(st.f_blocks) * st.f_frsize;
+    double avail = double(st.f_bavail) * st.f_frsize;
+    return avail - double(size) > 0.25 * total;
+  }
+
+  // Remove the cached blocks of images which changed or are gone
+  void remove_stale(std::string const& root) {
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+      std::string stamp_file = (it->path() / "stamp").string();
+      if (!fs::exists(stamp_file))
+        continue; // being created
+      std::string stamp = read_file(stamp_file);
+      std::string image = stamp.substr(0, stamp.find('\n'));
+      std::istringstream is(stamp.substr(stamp.find('\n') + 1));
+      std::time_t mtime = 0;
+      if (!fs::exists(image) || !(is >> mtime) || fs::last_write_time(image) != mtime)
+        fs::remove_all(it->path(), ec);
+    }
+  }
+
+  // A block, either mapped from the cache, or read from the image
+  struct CachedBlock {
+    const vw::uint8 * data;
+    size_t size;
+    void * mapped;
+    std::vector<vw::uint8> buffer;
+    CachedBlock(): data(NULL), size(0), mapped(NULL) {}
+    ~CachedBlock() {
+      if (mapped != NULL)
+        munmap(mapped, size);
+    }
+  };
+
+  // Map a block file, if it exists and has the expected size
+  bool map_block(std::string const& file, size_t size, CachedBlock & block) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    void * ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) == size && size > 0)
+      ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+      return false;
+    block.mapped = ptr;
+    block.size   = size;
+    block.data   = (const vw::uint8*)ptr;
+    return true;
+  }
+
+  // The part of an image buffer in the given box
+  vw::ImageBuffer crop_buffer(vw::ImageBuffer const& buf, vw::BBox2i const& box) {
+    vw::ImageBuffer out = buf;
+    out.data = (vw::uint8*)buf.data + box.min().x() * buf.cstride + box.min().y() * buf.rstride;
+    out.format.cols = box.width();
+    out.format.rows = box.height();
+    return out;
+  }
+
+} // end anonymous namespace
+
+std::string shm_block_cache_root() {
+  if (!fs::is_directory("/dev/shm"))
+    return "";
+  std::ostringstream os;
+  os << "/dev/shm/asp-block-cache-" << getuid();
+  return os.str();
+}
+
+DiskImageResourceShm::DiskImageResourceShm(std::string const& filename):
+  vw::DiskImageResourceGDAL(filename) {
+
+  m_pixel_bytes = vw::channel_size(m_format.channel_type) *
+    vw::num_channels(m_format.pixel_format);
+
+  // Whole numbers of the blocks of the file, so each is read once
+  vw::Vector2i native = vw::DiskImageResourceGDAL::block_read_size();
+  for (int c = 0; c < 2; c++) {
+    int b = std::max(1, native[c]);
+    m_block_size[c] = b * std::max(1, (MIN_CACHE_BLOCK + b - 1) / b);
+  }
+  m_block_size[0] = std::min(m_block_size[0], std::max(1, cols()));
+  m_block_size[1] = std::min(m_block_size[1], std::max(1, rows()));
+
+  std::string root = shm_block_cache_root();
+  std::string abs_path = fs::absolute(filename).string();
+  char hash[32];
+  snprintf(hash, sizeof(hash), "%016llx",
+           (unsigned long long)fnv1a_hash(abs_path.data(), abs_path.size()));
+  m_dir = root + "/" + hash;
+
+  boost::system::error_code ec;
+  fs::create_directories(root, ec);
+  chmod(root.c_str(), 0700);
+  remove_stale(root);
+
+  // Start a new directory if the image changed since it was cached
+  std::string stamp = image_stamp(abs_path, m_block_size);
+  std::string stamp_file = m_dir + "/stamp";
+  if (read_file(stamp_file) != stamp) {
+    std::ostringstream os;
+    os << m_dir << ".old." << getpid();
+    fs::rename(m_dir, os.str(), ec);
+    fs::remove_all(os.str(), ec);
+    fs::create_directories(m_dir, ec);
+    write_atomic(stamp_file, stamp.data(), stamp.size());
+  }
+}
+
+void DiskImageResourceShm::read_block(int bx, int by, vw::ImageBuffer const& dest,
+                                      vw::BBox2i const& bbox) const {
+
+  vw::BBox2i block_box(bx * m_block_size[0], by * m_block_size[1],
+                       m_block_size[0], m_block_size[1]);
+  block_box.crop(vw::BBox2i(0, 0, cols(), rows()));
+  vw::BBox2i inter = block_box;
+  inter.crop(bbox);
+
+  // The block in the layout of the file
+  vw::ImageBuffer src;
+  src.format = m_format;
+  src.format.cols = block_box.width();
+  src.format.rows = block_box.height();
+  src.cstride = m_pixel_bytes;
+  src.rstride = src.cstride * block_box.width();
+  src.pstride = src.rstride * block_box.height();
+  size_t size = src.pstride * std::max(1, int(m_format.planes));
+
+  std::ostringstream os;
+  os << m_dir << "/" << bx << "_" << by;
+  std::string block_file = os.str();
+
+  CachedBlock block;
+  if (!map_block(block_file, size, block)) {
+    block.buffer.resize(size);
+    src.data = &block.buffer[0];
+    vw::DiskImageResourceGDAL::read(src, block_box);
+    block.data = &block.buffer[0];
+    if (have_room(m_dir, size))
+      write_atomic(block_file, block.data, size);
+  }
+  src.data = (void*)block.data;
+
+  vw::convert(crop_buffer(dest, inter - bbox.min()),
+              crop_buffer(src, inter - block_box.min()));
+}
+
+void DiskImageResourceShm::read(vw::ImageBuffer const& dest, vw::BBox2i const& bbox) const {
+  if (bbox.empty())
+    return;
+  int bx0 = bbox.min().x() / m_block_size[0], bx1 = (bbox.max().x() - 1) / m_block_size[0];
+  int by0 = bbox.min().y() / m_block_size[1], by1 = (bbox.max().y() - 1) / m_block_size[1];
+  for (int by = by0; by <= by1; by++) {
+    for (int bx = bx0; bx <= bx1; bx++)
+      read_block(bx, by, dest, bbox);
+  }
+}
+
+boost::shared_ptr<vw::DiskImageResource>
+open_with_shm_cache(std::string const& filename, bool use_cache) {
+  if (use_cache && shm_block_cache_root() != "")
+    return boost::shared_ptr<vw::DiskImageResource>(new DiskImageResourceShm(filename));
+  return boost::shared_ptr<vw::DiskImageResource>(vw::DiskImageResourcePtr(filename));
+}
+
+} // end namespace asp
@@ -0,0 +1,78 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ShmBlockCache.h
+///
+/// A cache of image blocks in node-local shared memory (/dev/shm), so
+/// that the processes on one machine which read overlapping regions of
+/// the same image, such as the parallel_stereo correlation tiles reading
+/// L.tif and R.tif, fetch each block from a network file system only
+/// once. There is no daemon. Each block is a file, which the first
+/// process to need it writes, under a temporary name and then renamed,
+/// and the others map into memory and convert from directly.
+///
+/// The blocks of an image are in a directory named from a hash of its
+/// path, with a stamp file recording its modification time and size. A
+/// directory for a file which changed or no longer exists is removed
+/// when another image is opened. Blocks are not added when /dev/shm is
+/// more than 3/4 full, and then are just read from the image.
+
+#ifndef __ASP_CORE_SHM_BLOCK_CACHE_H__
+#define __ASP_CORE_SHM_BLOCK_CACHE_H__
+
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace asp {
+
+  /// The directory of the cache for the current user, or an empty string
+  /// if there is no /dev/shm
+  std::string shm_block_cache_root();
+
+  /// A GDAL image which reads its blocks through the cache
+  class DiskImageResourceShm: public vw::DiskImageResourceGDAL {
+  public:
+    explicit DiskImageResourceShm(std::string const& filename);
+
+    /// The blocks of the cache. These are whole numbers of the blocks of
+    /// the file, and at least 512 x 512 pixels, unless the image is smaller.
+    virtual vw::Vector2i block_read_size() const { return m_block_size; }
+
+    virtual void read(vw::ImageBuffer const& dest, vw::BBox2i const& bbox) const;
+
+  private:
+    std::string  m_dir;
+    vw::Vector2i m_block_size;
+    size_t       m_pixel_bytes;
+
+    // Copy the part of a block which overlaps with the requested region
+    void read_block(int bx, int by, vw::ImageBuffer const& dest,
+                    vw::BBox2i const& bbox) const;
+  };
+
+  /// Open an image through the cache, if use_cache is true and there is
+  /// /dev/shm, and otherwise as usual
+  boost::shared_ptr<vw::DiskImageResource>
+  open_with_shm_cache(std::string const& filename, bool use_cache);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_SHM_BLOCK_CACHE_H__
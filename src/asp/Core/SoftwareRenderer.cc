@@ -46,7 +46,12 @@
 #include <vw/Core/FundamentalTypes.h>
 #include <asp/Core/SoftwareRenderer.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace vw;
@@ -761,50 +766,197 @@ SoftwareRenderer::SetColorPointer(const int numComponents, float * const colors)
   m_colorPointer = colors;
 }
 
-void
-SoftwareRenderer::DrawPolygon(const int startIndex, const int numVertices) {
-  if (m_vertexPointer == 0)
-    return;
-
-  if ((m_colorPointer == 0) && (m_shadeMode != eShadeFlat))
-    return;
-
+// Fan triangulate a polygon, map its vertices to window coordinates,
+// and pass each triangle to the given function.
+template <class DrawT>
+static void
+ForEachTriangle(float *vertexPointer, int numVertexComponents, int triangleVertexStep,
+                float *colorPointer, int numColorComponents, int triangleColorStep,
+                const double transformNDC[3][2], int bufferWidth, int bufferHeight,
+                const int startIndex, const int numVertices, DrawT draw)
+{
   // NOTE: we assume polygons are convex! This allows one to easily
   // fan triangulate them.
   int numTriangles = numVertices - 2;
-  float *vertices = &m_vertexPointer[startIndex * m_numVertexComponents];
-  float *colors = &m_colorPointer[startIndex * m_numColorComponents];
-  int vertexIndex1 = m_numVertexComponents;
-  int vertexIndex2 = vertexIndex1 + m_numVertexComponents;
-  int colorIndex1 = m_numColorComponents;
-  int colorIndex2 = colorIndex1 + m_numColorComponents;
-  ::Color color0(&colors[0], m_numColorComponents);
+  float *vertices = &vertexPointer[startIndex * numVertexComponents];
+  float *colors = &colorPointer[startIndex * numColorComponents];
+  int vertexIndex1 = numVertexComponents;
+  int vertexIndex2 = vertexIndex1 + numVertexComponents;
+  int colorIndex1 = numColorComponents;
+  int colorIndex2 = colorIndex1 + numColorComponents;
+  ::Color color0(&colors[0], numColorComponents);
   Vertex vertex0(vertices, color0);
 
-  MapToWindow(vertex0.window, m_transformNDC,
-              0.0, 0.0, double(m_bufferWidth), double(m_bufferHeight),
+  MapToWindow(vertex0.window, transformNDC,
+              0.0, 0.0, double(bufferWidth), double(bufferHeight),
               vertex0.window);
 
   for (int i = 0; i < numTriangles; i++)
   {
-    ::Color color1(&colors[colorIndex1], m_numColorComponents);
-    ::Color color2(&colors[colorIndex2], m_numColorComponents);
+    ::Color color1(&colors[colorIndex1], numColorComponents);
+    ::Color color2(&colors[colorIndex2], numColorComponents);
 
     Vertex vertex1(&vertices[vertexIndex1], color1);
     Vertex vertex2(&vertices[vertexIndex2], color2);
 
-    MapToWindow(vertex1.window, m_transformNDC,
-                0.0, 0.0, double(m_bufferWidth), double(m_bufferHeight),
+    MapToWindow(vertex1.window, transformNDC,
+                0.0, 0.0, double(bufferWidth), double(bufferHeight),
                 vertex1.window);
-    MapToWindow(vertex2.window, m_transformNDC,
-                0.0, 0.0, double(m_bufferWidth), double(m_bufferHeight),
+    MapToWindow(vertex2.window, transformNDC,
+                0.0, 0.0, double(bufferWidth), double(bufferHeight),
                 vertex2.window);
 
-    FillTriangle((GraphicsState *) m_graphicsState, &vertex0, &vertex1, &vertex2);
+    draw(vertex0, vertex1, vertex2);
 
-    vertexIndex1 += m_triangleVertexStep;
-    vertexIndex2 += m_triangleVertexStep;
-    colorIndex1 += m_triangleColorStep;
-    colorIndex2 += m_triangleColorStep;
+    vertexIndex1 += triangleVertexStep;
+    vertexIndex2 += triangleVertexStep;
+    colorIndex1 += triangleColorStep;
+    colorIndex2 += triangleColorStep;
   }
 }
+
+void
+SoftwareRenderer::DrawPolygon(const int startIndex, const int numVertices) {
+  if (m_vertexPointer == 0)
+    return;
+
+  if ((m_colorPointer == 0) && (m_shadeMode != eShadeFlat))
+    return;
+
+  GraphicsState *gc = (GraphicsState *) m_graphicsState;
+  ForEachTriangle(m_vertexPointer, m_numVertexComponents, m_triangleVertexStep,
+                  m_colorPointer, m_numColorComponents, m_triangleColorStep,
+                  m_transformNDC, m_bufferWidth, m_bufferHeight,
+                  startIndex, numVertices,
+                  [gc](Vertex v0, Vertex v1, Vertex v2) {
+                    FillTriangle(gc, &v0, &v1, &v2);
+                  });
+}
+
+// ===========================================================================
+// Binned renderer
+// ===========================================================================
+
+struct BinnedTriangle {
+  BinnedTriangle(Vertex const& a_in, Vertex const& b_in, Vertex const& c_in):
+    a(a_in), b(b_in), c(c_in) {}
+  Vertex a, b, c;
+};
+
+namespace vw { namespace stereo {
+  struct BinnedTriangles {
+    std::vector<BinnedTriangle> triangles;
+  };
+}}
+
+BinnedSoftwareRenderer::BinnedSoftwareRenderer(const int width, const int height,
+                                               float *buffer, int numThreads,
+                                               int bandHeight):
+  m_renderer(width, height, buffer),
+  m_numThreads(std::max(numThreads, 1)), m_bandHeight(std::max(bandHeight, 1)),
+  m_triangles(new BinnedTriangles) {}
+
+BinnedSoftwareRenderer::~BinnedSoftwareRenderer() {
+  delete m_triangles;
+}
+
+void
+BinnedSoftwareRenderer::Ortho2D(const double left, const double right,
+                                const double bottom, const double top) {
+  m_renderer.Ortho2D(left, right, bottom, top);
+}
+
+void
+BinnedSoftwareRenderer::Clear(const float value) {
+  m_renderer.Clear(value);
+}
+
+void
+BinnedSoftwareRenderer::SetVertexPointer(const int numComponents, float * const vertices) {
+  m_renderer.SetVertexPointer(numComponents, vertices);
+}
+
+void
+BinnedSoftwareRenderer::SetColorPointer(const int numComponents, float * const colors) {
+  m_renderer.SetColorPointer(numComponents, colors);
+}
+
+void
+BinnedSoftwareRenderer::DrawPolygon(const int startIndex, const int numVertices) {
+  SoftwareRenderer const& r = m_renderer;
+  if (r.m_vertexPointer == 0)
+    return;
+
+  if ((r.m_colorPointer == 0) && (r.m_shadeMode != eShadeFlat))
+    return;
+
+  // The vertex and color arrays may be overwritten after this call,
+  // so keep copies of the mapped vertices.
+  std::vector<BinnedTriangle> & triangles = m_triangles->triangles;
+  ForEachTriangle(r.m_vertexPointer, r.m_numVertexComponents, r.m_triangleVertexStep,
+                  r.m_colorPointer, r.m_numColorComponents, r.m_triangleColorStep,
+                  r.m_transformNDC, r.m_bufferWidth, r.m_bufferHeight,
+                  startIndex, numVertices,
+                  [&triangles](Vertex const& v0, Vertex const& v1, Vertex const& v2) {
+                    triangles.push_back(BinnedTriangle(v0, v1, v2));
+                  });
+}
+
+void
+BinnedSoftwareRenderer::Finish() {
+
+  std::vector<BinnedTriangle> & triangles = m_triangles->triangles;
+  int height = m_renderer.m_bufferHeight;
+  int numBands = (height + m_bandHeight - 1) / m_bandHeight;
+  if (triangles.empty() || numBands <= 0) {
+    triangles.clear();
+    return;
+  }
+
+  // List the triangles overlapping each band, keeping their order, as
+  // where triangles overlap the last one drawn wins. A triangle's
+  // spans start at the row of its lowest vertex and stop before the
+  // row of its highest one.
+  std::vector<std::vector<int>> bins(numBands);
+  for (size_t it = 0; it < triangles.size(); it++) {
+    BinnedTriangle const& t = triangles[it];
+    RealT minY = std::min(t.a.window.y, std::min(t.b.window.y, t.c.window.y));
+    RealT maxY = std::max(t.a.window.y, std::max(t.b.window.y, t.c.window.y));
+    if (!(maxY >= 0 && minY < height)) // also skips NaN
+      continue;
+    minY = std::max(minY, RealT(0));
+    maxY = std::min(maxY, RealT(height));
+    int beg = int(floor(minY)) / m_bandHeight;
+    int end = std::min(numBands - 1, int(ceil(maxY)) / m_bandHeight);
+    for (int b = beg; b <= end; b++)
+      bins[b].push_back(it);
+  }
+
+  // Each band clips the spans to its rows. Clipping does not change
+  // how the spans are stepped, so each pixel gets the same value as
+  // when drawing the whole buffer at once.
+  GraphicsState const& base = *(GraphicsState *) m_renderer.m_graphicsState;
+  std::atomic<int> nextBand(0);
+  auto drawBands = [&]() {
+    GraphicsState gc = base;
+    int b;
+    while ((b = nextBand++) < numBands) {
+      gc.clipY0 = b * m_bandHeight;
+      gc.clipY1 = std::min(height, (b + 1) * m_bandHeight);
+      for (size_t it = 0; it < bins[b].size(); it++) {
+        BinnedTriangle t = triangles[bins[b][it]];
+        FillTriangle(&gc, &t.a, &t.b, &t.c);
+      }
+    }
+  };
+
+  int numThreads = std::min(m_numThreads, numBands);
+  std::vector<std::thread> threads;
+  for (int it = 1; it < numThreads; it++)
+    threads.push_back(std::thread(drawBands));
+  drawBands();
+  for (size_t it = 0; it < threads.size(); it++)
+    threads[it].join();
+
+  triangles.clear();
+}
@@ -25,6 +25,8 @@
 namespace vw {
 namespace stereo {
 
+  struct BinnedSoftwareRenderer;
+
   struct SoftwareRenderer {
 
       SoftwareRenderer(int bufferWidth, int bufferHeight, float *buffer = 0);
@@ -37,6 +39,7 @@ namespace stereo {
       void DrawPolygon(const int startIndex, const int numVertices);
 
     private:
+      friend struct BinnedSoftwareRenderer;
       int m_numVertexComponents;
       float *m_vertexPointer;
       int m_triangleVertexStep;
@@ -51,6 +54,35 @@ namespace stereo {
       double m_transformViewport[3][2];
       void *m_graphicsState;
     };
+
+  struct BinnedTriangles;
+
+  /// A renderer with the same interface as SoftwareRenderer, which only
+  /// records the triangles in DrawPolygon(), and draws them all in
+  /// Finish(). The buffer is split into bands of rows, which are drawn
+  /// in parallel, and each band draws only the triangles overlapping
+  /// it, in the order they were given. The result is identical to that
+  /// of SoftwareRenderer.
+  struct BinnedSoftwareRenderer {
+
+      BinnedSoftwareRenderer(int bufferWidth, int bufferHeight, float *buffer = 0,
+                             int numThreads = 1, int bandHeight = 64);
+      ~BinnedSoftwareRenderer();
+      void Ortho2D(const double left, const double right,
+                   const double bottom, const double top);
+      void Clear(const float val);
+      void SetVertexPointer(const int numComponents, float * const vertices);
+      void SetColorPointer(const int numComponents, float * const colors);
+      void DrawPolygon(const int startIndex, const int numVertices);
+
+      /// Draw the recorded triangles, then forget them
+      void Finish();
+
+    private:
+      SoftwareRenderer m_renderer; // holds the state and maps the vertices
+      int m_numThreads, m_bandHeight;
+      BinnedTriangles *m_triangles;
+    };
   }
 }
 
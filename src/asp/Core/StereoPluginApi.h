@@ -0,0 +1,61 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StereoPluginApi.h
+///
+/// The interface for stereo correlation plugins which are shared
+/// libraries loaded by stereo_corr, rather than programs it invokes. Such
+/// a library receives the locally aligned tiles in memory and fills in
+/// the disparity in memory, so no files are written and no process is
+/// started per tile. This header has no dependencies, and only C types
+/// cross it, so a plugin can be built with any compiler.
+///
+#ifndef __ASP_CORE_STEREO_PLUGIN_API_H__
+#define __ASP_CORE_STEREO_PLUGIN_API_H__
+
+/// Increment this if the signature below changes
+#define ASP_STEREO_PLUGIN_API_VERSION 1
+
+/// The names of the functions a plugin library must export
+#define ASP_STEREO_PLUGIN_VERSION_SYMBOL   "asp_stereo_plugin_version"
+#define ASP_STEREO_PLUGIN_CORRELATE_SYMBOL "asp_stereo_plugin_correlate"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /// Must return ASP_STEREO_PLUGIN_API_VERSION
+  typedef int (*asp_stereo_plugin_version_fn)(void);
+
+  /// Find the 1D disparity from the left to the right image. Both images
+  /// have the given size, are stored row after row, and have NaN as
+  /// no-data. The options are as they would be passed to a plugin
+  /// program, such as {"-r", "-10", "-R", "10"}. The disparity has the
+  /// same size as the images, and is NaN where it is not found. It may be
+  /// called from several threads at the same time. Return 0 on success.
+  typedef int (*asp_stereo_plugin_correlate_fn)(int num_options,
+                                                const char * const * options,
+                                                const float * left_image,
+                                                const float * right_image,
+                                                int cols, int rows,
+                                                float * disparity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ASP_CORE_STEREO_PLUGIN_API_H__
@@ -140,6 +140,8 @@ namespace asp {
        "Min percentage distance between closest and second closest IP descriptors, a larger value allows more IP matches.")
       ("ip-nodata-radius",          po::value(&global.ip_nodata_radius)->default_value(4),
        "Remove IP near nodata with this radius, in pixels.")
+      ("ip-cache-dir",          po::value(&global.ip_cache_dir)->default_value(""),
+       "Store detected interest points in this directory, keyed by the image pixels and the detection options, and reuse them whenever the same image is processed with the same options, including by bundle_adjust and pc_align.")
       ("ip-triangulation-max-error", po::value(&global.ip_triangulation_max_error)->default_value(-1),
        "When matching IP, filter out any pairs with a triangulation error higher than this.")
       ("ip-num-ransac-iterations", po::value(&global.ip_num_ransac_iterations)->default_value(100),
@@ -164,6 +166,8 @@ namespace asp {
        "Do not assume a reliable datum exists, such as for potato-shaped bodies.")
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
        "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images. This is a speedup option which helps (and works mostly with) mapprojected input images with no alignment.")
+      ("preprocess-cache-dir", po::value(&global.preprocess_cache_dir)->default_value(""),
+       "Store the normalized left image, its mask, and their subsampled versions in this directory, keyed by the left image and the preprocessing options, and reuse them in other stereo runs with the same left image, such as the pairs of a multiview run. Only used with --individually-normalize and alignment method none, or homography for multiview stereo.")
       ("force-reuse-match-files", po::bool_switch(&global.force_reuse_match_files)->default_value(false)->implicit_value(true),
        "Force reusing the match files even if older than the images or cameras.")
       ("part-of-multiview-run", po::bool_switch(&global.part_of_multiview_run)->default_value(false)->implicit_value(true),
@@ -201,6 +205,8 @@ namespace asp {
        "Turn on atmospheric refraction correction for Optical Bar and non-ISIS linescan cameras. This option impairs the convergence of bundle adjustment.")
       ("dg-use-csm", po::bool_switch(&global.dg_use_csm)->default_value(false)->implicit_value(true),
        "Use the CSM model with DigitalGlobe linescan cameras (-t dg). No corrections are done for velocity aberration or atmospheric refraction.")
+      ("isis-exact-linescan", po::bool_switch(&global.isis_exact_linescan)->default_value(false)->implicit_value(true),
+       "When projecting into ISIS linescan cameras, find the camera position and orientation with SPICE at each trial time, rather than interpolating them from values sampled once per image line.")
 
       // For bathymetry correction
       ("left-bathy-mask", po::value(&global.left_bathy_mask),
@@ -276,7 +282,7 @@ namespace asp {
       ("corr-timeout",           po::value(&global.corr_timeout)->default_value(global.default_corr_timeout),
                      "Correlation timeout for an image tile, in seconds.")
       ("stereo-algorithm",       po::value(&global.stereo_algorithm)->default_value("asp_bm"),
-                     "Stereo algorithm to use. Options: asp_bm, asp_sgm, asp_mgm, asp_final_mgm, mgm (original author implementation), opencv_sgbm, libelas, msmw, msmw2, and opencv_bm.")
+                     "Stereo algorithm to use. Options: asp_bm, asp_sgm, asp_sgm_gpu, asp_mgm, asp_final_mgm, mgm (original author implementation), opencv_sgbm, libelas, msmw, msmw2, and opencv_bm.")
       ("corr-blob-filter",       po::value(&global.corr_blob_filter_area)->default_value(0),
                      "Filter blobs this size or less in correlation pyramid step.")
       ("corr-tile-size",         po::value(&global.corr_tile_size_ovr)->default_value(ASPGlobalOptions::corr_tile_size()),
@@ -287,6 +293,12 @@ namespace asp {
                      "Search range expansion for SGM down stereo pyramid levels.  Smaller values are faster, but greater change of blunders.")
       ("corr-memory-limit-mb",     po::value(&global.corr_memory_limit_mb)->default_value(4*1024),
        "Keep correlation memory usage (per tile) close to this limit.  Important for SGM/MGM.")
+      ("disable-corr-prefetch", po::bool_switch(&global.disable_corr_prefetch)->default_value(false)->implicit_value(true),
+       "Do not read ahead on a separate thread the image regions needed by upcoming correlation tiles.")
+      ("shm-block-cache", po::bool_switch(&global.shm_block_cache)->default_value(false)->implicit_value(true),
+       "Keep the blocks of L.tif and R.tif read by correlation in shared memory (/dev/shm), so that the processes on a machine read each block from disk only once.")
+      ("sgm-gpu-num-paths",        po::value(&global.sgm_gpu_num_paths)->default_value(8),
+       "The number of directions (8 or 16) along which to aggregate the costs with the asp_sgm_gpu algorithm.")
       ("correlator-mode", po::bool_switch(&global.correlator_mode)->default_value(false)->implicit_value(true),
        "Function as an image correlator only (including with subpixel refinement). Assume no cameras, aligned input images, and stop before triangulation, so at filtered disparity.")
 
@@ -312,15 +324,19 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("subpixel-mode",       po::value(&global.subpixel_mode)->default_value(1),
-  "Subpixel algorithm. [0 None, 1 Parabola, 2 Bayes EM, 3 Affine, 4 Phase Correlation 5 LK, 6 Bayes EM w/gamma, 7 SGM None 8 SGM Linear, 9 SGM Poly4, 10 SGM Cos, 11 SGM Parabola 12 SGM Blend]")
+  "Subpixel algorithm. [0 None, 1 Parabola, 2 Bayes EM, 3 Affine, 4 Phase Correlation 5 LK, 6 Bayes EM w/gamma, 7 SGM None 8 SGM Linear, 9 SGM Poly4, 10 SGM Cos, 11 SGM Parabola 12 SGM Blend, 13 ALSC]")
       ("subpix-from-blend",   po::bool_switch(&global.subpix_from_blend)->default_value(false)->implicit_value(true),
                               "For the input to subpixel, use the -B.tif file instead of the -D.tif file.")
+      ("blend-all-tiles",     po::bool_switch(&global.blend_all_tiles)->default_value(false)->implicit_value(true),
+                              "In stereo_blend, blend the seams of all parallel_stereo tiles in one pass, with each tile read once. Used by parallel_stereo.")
       ("subpixel-kernel",     po::value(&global.subpixel_kernel)->default_value(Vector2i(35,35), "35 35"),
                               "Kernel size used for subpixel method.")
       ("disable-h-subpixel",  po::bool_switch(&global.disable_h_subpixel)->default_value(false)->implicit_value(true),
                               "Disable calculation of subpixel in horizontal direction.")
       ("disable-v-subpixel",  po::bool_switch(&global.disable_v_subpixel)->default_value(false)->implicit_value(true),
                               "Disable calculation of subpixel in vertical direction.")
+      ("disable-subpixel-simd", po::bool_switch(&global.disable_subpixel_simd)->default_value(false)->implicit_value(true),
+                              "Do not use the AVX2, AVX-512, or NEON instructions for parabola subpixel refinement (subpixel-mode 1), even if the CPU has them. Then the slower generic implementation is used.")
       ("subpixel-max-levels", po::value(&global.subpixel_max_levels)->default_value(2),
                               "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).")
       ("phase-subpixel-accuracy", po::value(&global.phase_subpixel_accuracy)->default_value(20),
@@ -379,7 +395,9 @@ namespace asp {
       ("casp-go-param-file", po::value(&global.casp_go_param_file)->default_value(""),
        "The parameter file to use with Gotcha (and in the future other CASP-GO functionality) when invoking the 'gotcha-disparity-refinement' option. The default is to use the file 'share/CASP-GO_params.xml' shipped with ASP.")
       ("mask-flatfield",      po::bool_switch(&global.mask_flatfield)->default_value(false)->implicit_value(true),
-                              "Mask dust found on the sensor or film. (For use with Apollo Metric Cameras only.)");
+                              "Mask dust found on the sensor or film. (For use with Apollo Metric Cameras only.)")
+      ("fuse-refinement-and-filtering", po::bool_switch(&global.fuse_refinement_and_filtering)->default_value(false)->implicit_value(true),
+                              "Do subpixel refinement inside stereo_fltr and keep the refined disparity in memory instead of writing and reading back RD.tif. The stereo_rfne step is then skipped. Needs enough RAM for the full disparity (12 bytes per pixel). Not supported with parallel_stereo or --mask-flatfield.");
 
     po::options_description backwards_compat_options("Aliased backwards compatibility options");
     // Do not add default values here. They may override the values set
@@ -429,6 +447,11 @@ namespace asp {
        "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies, unless error propagation happens, when it is set by default to 1e-8 meters, to avoid introducing step artifacts in these errors.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
        "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
+      ("compact-point-cloud", po::bool_switch(&global.compact_point_cloud)->default_value(false)->implicit_value(true),
+       "Save the final point cloud as 32-bit integer multiples of the rounding error, relative to the cloud center. This compresses several times better than the default. The cloud is read back as before by all ASP tools.")
+      ("compact-point-cloud-error-rounding",
+       po::value(&global.compact_point_cloud_error_rounding)->default_value(0.0),
+       "With --compact-point-cloud, round the triangulation error and the propagated errors to this many meters. Default: same as the rounding of the points.")
       
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
                                             "Only compute the center of triangulated point cloud and exit.")
@@ -442,6 +465,8 @@ namespace asp {
        "Skip computing the piecewise adjustments for jitter, they should have been done by now.")
       ("use-least-squares",                 po::bool_switch(&global.use_least_squares)->default_value(false)->implicit_value(true),
        "Use rigorous least squares triangulation process. This is slow for ISIS processes.")      
+      ("approx-rays-tol", po::value(&global.approx_rays_tol)->default_value(0.01),
+       "When triangulating with cameras other than pinhole, such as linescan, interpolate the camera rays on a grid in each image, with the error at most this many pixels. Set to 0 to find each ray with the exact camera.")
       ;
   }
 
@@ -479,6 +504,10 @@ namespace asp {
         "Start with all images turned off (if all images are in the same window, useful with a large number of images).")
       ("delete-temporary-files-on-exit",   po::bool_switch(&global.delete_temporary_files_on_exit)->default_value(false)->implicit_value(true),
        "Delete any subsampled and other files created by the GUI when exiting.")
+      ("pyramid-cache-dir", po::value(&global.pyramid_cache_dir)->default_value(""),
+       "Build the multi-resolution pyramids of the input images in this directory rather than next to the images. It can be shared among users and sessions. A pyramid is then built once per image, and reused while the image is unchanged.")
+      ("tile-server-port", po::value(&global.tile_server_port)->default_value(0),
+       "Without starting the GUI, serve the input images over HTTP on this port, for viewing with stereo_gui on another machine. Only the visible portions of the images, at the resolution being shown, are sent.")
       ("create-image-pyramids-only",   po::bool_switch(&global.create_image_pyramids_only)->default_value(false)->implicit_value(true),
        "Without starting the GUI, build multi-resolution pyramids for the inputs, to be able to load them fast later.")
       ("pairwise-matches",   po::bool_switch(&global.pairwise_matches)->default_value(false)->implicit_value(true), "Show images side-by-side. If just two of them are selected, load their corresponding match file, determined by the output prefix. Also accessible from the menu.")
@@ -513,7 +542,9 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("tile-at-location", po::value(&global.tile_at_loc)->default_value(""),
-       "Find the tile in the current parallel_stereo run which generated the DEM portion having this lon-lat-height location. Specify as a string in quotes: 'lon lat height'. Use this option with stereo_parse and the rest of options used in parallel_stereo, including cameras, output prefix, etc. (except for those needed for tiling and parallelization). This does not work with mapprojected images.");
+       "Find the tile in the current parallel_stereo run which generated the DEM portion having this lon-lat-height location. Specify as a string in quotes: 'lon lat height'. Use this option with stereo_parse and the rest of options used in parallel_stereo, including cameras, output prefix, etc. (except for those needed for tiling and parallelization). This does not work with mapprojected images.")
+      ("estimate-tile-costs", po::value(&global.tile_cost_list)->default_value(""),
+       "Read from this file a list of tiles in L.tif, one per line, as 'xoff yoff xsize ysize'. For each tile, estimate from the low-resolution disparity D_sub the fraction of valid pixels and the area of the full-resolution search range, and save these to <output prefix>-tile-costs.txt, together with whether the tile has any valid data. Used by parallel_stereo to schedule the most expensive tiles first.");
   }
 
   // Options for parallel_stereo. These are not used by the stereo
@@ -555,7 +586,9 @@ namespace asp {
     (*this).add_options()
       ("trans-crop-win", po::value(&global.trans_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Left image crop window in respect to L.tif. This is an internal option. [default: use the entire image].")
       ("attach-georeference-to-lowres-disparity", po::bool_switch(&global.attach_georeference_to_lowres_disparity)->default_value(false)->implicit_value(true),
-       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.");
+       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.")
+      ("worker-mode", po::bool_switch(&global.worker_mode)->default_value(false)->implicit_value(true),
+       "Stay alive and process tiles read from standard input, one per line, as 'tile_prefix xoff yoff xsize ysize'. This is an internal option, used by parallel_stereo --persistent-workers.");
   }
 
   // This handles options which are not in stereo_settings(), but
@@ -26,6 +26,7 @@
 #include <boost/program_options/detail/config_file.hpp>
 #include <vw/FileIO/GdalWriteOptions.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/SettingsSnapshot.h>
 
 namespace asp {
 
@@ -43,6 +44,7 @@ namespace asp {
     std::string stereo_session,
                 stereo_default_filename;
     boost::shared_ptr<asp::StereoSession> session; // Used to extract cameras
+    asp::SettingsSnapshot snapshot; // Saved by stereo_pprc, loaded by later stages
     // Output
     std::string out_prefix;
     
@@ -115,6 +117,7 @@ namespace asp {
     double ip_inlier_factor;                /// General scaling factor for IP finding, a larger value allows more IPs to match.
     double ip_uniqueness_thresh;            /// Min percentage distance between closest and second closest IP descriptors.
     double ip_nodata_radius;                /// Remove IP near nodata with this radius, in pixels.
+    std::string ip_cache_dir;               ///< Directory for the shared interest point cache.
     double ip_triangulation_max_error;      ///< Remove IP matches with triangulation error higher than this.
     int    ip_num_ransac_iterations;        ///< How many ransac iterations to do in ip matching.
     bool   disable_tri_filtering;           ///< Turn of tri-ip filtering.
@@ -133,6 +136,7 @@ namespace asp {
     bool   skip_rough_homography;           ///< Use this if datum-based rough homography fails. 
     bool   no_datum;                        ///< Do not assume a reliable datum exists
     bool   skip_image_normalization;        ///< Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
+    std::string preprocess_cache_dir;       ///< Directory for the shared cache of left image preprocessing products.
     bool   force_reuse_match_files;         ///< Force reusing the match files even if older than the images or cameras
     bool   part_of_multiview_run;           ///< If this run is part of a larger multiview run
     std::string datum;                      ///< The datum to use with RPC camera models
@@ -150,6 +154,7 @@ namespace asp {
     int disparity_range_expansion_percent; ///< Expand the estimated disparity range by this percentage before computing the stereo correlation with local alignment
 
     bool dg_use_csm; // Use the CSM camera model with Digital Globe images.
+    bool isis_exact_linescan; // Do not sample the ISIS linescan camera state.
     
     // Correlation options
     
@@ -198,6 +203,9 @@ namespace asp {
     int    sgm_collar_size;           // Extra tile padding used for SGM calculation.
     vw::Vector2i sgm_search_buffer;   // Search padding in SGM around previous pyramid level disparity value.
     size_t corr_memory_limit_mb;      // Correlation memory limit, only important for SGM/MGM.
+    bool   disable_corr_prefetch;     // Do not read ahead the images for later tiles
+    bool   shm_block_cache;           // Share the blocks of L.tif and R.tif in /dev/shm
+    int    sgm_gpu_num_paths;         // Number of aggregation directions for asp_sgm_gpu.
     bool   correlator_mode;           // Use the correlation logic only (including subpixel rfne). 
     bool   stereo_debug;              // Write stereo debug images and messages
     bool   local_alignment_debug;     // Debug local alignment
@@ -205,6 +213,7 @@ namespace asp {
     // Subpixel options
 
     bool subpix_from_blend;           // Read from -B.tif instead of -D.tif
+    bool blend_all_tiles;             // Blend all parallel_stereo tiles in one pass
     
     vw::uint16 subpixel_mode;         // 0 = none
                                       // 1 = parabola fitting
@@ -214,6 +223,7 @@ namespace asp {
                                       // 5 = affine, bayes EM weighting
     vw::Vector2i subpixel_kernel;     // Subpixel correlation kernel
     bool disable_h_subpixel, disable_v_subpixel;
+    bool disable_subpixel_simd;       // Use the generic parabola subpixel code
     vw::uint16 subpixel_max_levels;   // Max pyramid levels to process. 0 hits only once.
     vw::uint16 phase_subpixel_accuracy;  // Phase subpixel is accurate to 1/this pixels
 
@@ -245,6 +255,7 @@ namespace asp {
     double disp_smooth_texture;        // Adaptive disparity smoothing max texture value    
     bool  gotcha_disparity_refinement;
     std::string casp_go_param_file;
+    bool  fuse_refinement_and_filtering; // Refine in memory in stereo_fltr, skip RD.tif
 
     // Triangulation options
     std::string universe_center;      // Center for the radius clipping
@@ -273,8 +284,11 @@ namespace asp {
     double min_triangulation_angle;           // min angle for valid triangulation
     double max_valid_triangulation_error;
     bool   use_least_squares;                 // Use a more rigorous triangulation
+    double approx_rays_tol;                   // Interpolate the camera rays to this many pixels
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    bool   compact_point_cloud;               // Save the point cloud as integers
+    double compact_point_cloud_error_rounding; // How much to round the errors in a compact cloud
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
     bool   unalign_disparity;                 // Compute disparity between unaligned images
@@ -290,6 +304,8 @@ namespace asp {
     bool view_matches, view_several_side_by_side, colorize, preview;
     std::string match_file, gcp_file, dem_file, csv_datum, csv_format_str, csv_proj4, nvm;
     bool delete_temporary_files_on_exit;
+    std::string pyramid_cache_dir;
+    int tile_server_port;
     bool create_image_pyramids_only, hide_all;
     bool pairwise_matches, pairwise_clean_matches, no_georef;
     std::vector<std::string> vwip_files;
@@ -299,6 +315,7 @@ namespace asp {
     
     // stereo_parse options
     std::string tile_at_loc;
+    std::string tile_cost_list; // tiles for which to estimate the correlation cost
 
     // Options for parallel_stereo. These are not used, but accept
     // them quietly so that when stereo_gui or stereo_parse is invoked
@@ -309,6 +326,7 @@ namespace asp {
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
     bool attach_georeference_to_lowres_disparity;
+    bool worker_mode;                 // Process tiles read from stdin with one process
 
     // Internal variable, to ensure we always initialize this class before using it
     bool initialized_stereo_settings;
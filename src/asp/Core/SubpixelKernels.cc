@@ -0,0 +1,238 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file SubpixelKernels.cc
+///
+
+#include <asp/Core/SubpixelKernels.h>
+
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ASP_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define ASP_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace asp {
+
+namespace {
+
+float window_sad_plain(float const* left,  int left_stride,
+                       float const* right, int right_stride,
+                       int cols, int rows) {
+  float sum = 0.0f;
+  for (int row = 0; row < rows; row++) {
+    float const* l = left  + row * left_stride;
+    float const* r = right + row * right_stride;
+    for (int col = 0; col < cols; col++)
+      sum += std::abs(l[col] - r[col]);
+  }
+  return sum;
+}
+
+#if defined(ASP_SIMD_X86)
+
+__attribute__((target("avx2")))
+float window_sad_avx2(float const* left,  int left_stride,
+                      float const* right, int right_stride,
+                      int cols, int rows) {
+
+  // Clearing the sign bit gives the absolute value
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 acc = _mm256_setzero_ps();
+  float tail = 0.0f;
+  int num_vec = cols - cols % 8;
+  for (int row = 0; row < rows; row++) {
+    float const* l = left  + row * left_stride;
+    float const* r = right + row * right_stride;
+    int col = 0;
+    for (; col < num_vec; col += 8) {
+      __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(l + col), _mm256_loadu_ps(r + col));
+      acc = _mm256_add_ps(acc, _mm256_andnot_ps(sign, diff));
+    }
+    for (; col < cols; col++)
+      tail += std::abs(l[col] - r[col]);
+  }
+
+  // Horizontal sum
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s) + tail;
+}
+
+__attribute__((target("avx512f")))
+float window_sad_avx512(float const* left,  int left_stride,
+                        float const* right, int right_stride,
+                        int cols, int rows) {
+
+  __m512 acc = _mm512_setzero_ps();
+  // The last partial vector of each row is handled with a mask
+  int num_vec = cols - cols % 16;
+  __mmask16 tail_mask = (__mmask16)((1u << (cols % 16)) - 1u);
+  for (int row = 0; row < rows; row++) {
+    float const* l = left  + row * left_stride;
+    float const* r = right + row * right_stride;
+    int col = 0;
+    for (; col < num_vec; col += 16) {
+      __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(l + col), _mm512_loadu_ps(r + col));
+      acc = _mm512_add_ps(acc, _mm512_abs_ps(diff));
+    }
+    if (tail_mask != 0) {
+      __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail_mask, l + col),
+                                  _mm512_maskz_loadu_ps(tail_mask, r + col));
+      acc = _mm512_add_ps(acc, _mm512_abs_ps(diff));
+    }
+  }
+  // Horizontal sum
+  float vals[16];
+  _mm512_storeu_ps(vals, acc);
+  float sum = 0.0f;
+  for (int it = 0; it < 16; it++)
+    sum += vals[it];
+  return sum;
+}
+
+#endif // ASP_SIMD_X86
+
+#if defined(ASP_SIMD_NEON)
+
+float window_sad_neon(float const* left,  int left_stride,
+                      float const* right, int right_stride,
+                      int cols, int rows) {
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  float tail = 0.0f;
+  int num_vec = cols - cols % 4;
+  for (int row = 0; row < rows; row++) {
+    float const* l = left  + row * left_stride;
+    float const* r = right + row * right_stride;
+    int col = 0;
+    for (; col < num_vec; col += 4)
+      acc = vaddq_f32(acc, vabdq_f32(vld1q_f32(l + col), vld1q_f32(r + col)));
+    for (; col < cols; col++)
+      tail += std::abs(l[col] - r[col]);
+  }
+  return vaddvq_f32(acc) + tail;
+}
+
+#endif // ASP_SIMD_NEON
+
+SimdLevel find_simd_level() {
+#if defined(ASP_SIMD_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+#endif
+#if defined(ASP_SIMD_NEON)
+  return SIMD_NEON;
+#endif
+  return SIMD_NONE;
+}
+
+} // end anonymous namespace
+
+SimdLevel simd_level() {
+  static const SimdLevel level = find_simd_level();
+  return level;
+}
+
+bool simd_level_supported(SimdLevel level) {
+  if (level == SIMD_NONE)
+    return true;
+#if defined(ASP_SIMD_NEON)
+  return level == SIMD_NEON;
+#else
+  // On x86 an instruction set is supported if the best one is at least as good
+  return level != SIMD_NEON && level <= simd_level();
+#endif
+}
+
+std::string simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SIMD_NEON:   return "NEON";
+  case SIMD_AVX2:   return "AVX2";
+  case SIMD_AVX512: return "AVX-512";
+  default:          return "none";
+  }
+}
+
+float window_sad(float const* left,  int left_stride,
+                 float const* right, int right_stride,
+                 int cols, int rows, SimdLevel level) {
+  switch (level) {
+#if defined(ASP_SIMD_X86)
+  case SIMD_AVX512:
+    return window_sad_avx512(left, left_stride, right, right_stride, cols, rows);
+  case SIMD_AVX2:
+    return window_sad_avx2(left, left_stride, right, right_stride, cols, rows);
+#endif
+#if defined(ASP_SIMD_NEON)
+  case SIMD_NEON:
+    return window_sad_neon(left, left_stride, right, right_stride, cols, rows);
+#endif
+  default:
+    return window_sad_plain(left, left_stride, right, right_stride, cols, rows);
+  }
+}
+
+// On a 3x3 grid the basis functions x^2 - 2/3, y^2 - 2/3, x*y, x, y, 1 are
+// orthogonal, so each least squares coefficient is a separate weighted sum.
+bool parabola_minimum(float const costs[9], float & dx, float & dy) {
+
+  dx = 0.0f;
+  dy = 0.0f;
+
+  double a = 0.0, b = 0.0, d = 0.0, e = 0.0;
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      double z = costs[3*(y+1) + x+1];
+      a += z * (x*x - 2.0/3.0);
+      b += z * (y*y - 2.0/3.0);
+      d += z * x;
+      e += z * y;
+    }
+  }
+  a /= 2.0;
+  b /= 2.0;
+  d /= 6.0;
+  e /= 6.0;
+  double c = (costs[8] - costs[6] - costs[2] + costs[0]) / 4.0;
+
+  // The surface a*x^2 + b*y^2 + c*x*y + d*x + e*y + f has a minimum
+  // if its Hessian is positive definite.
+  double det = 4.0*a*b - c*c;
+  if (a <= 0.0 || det <= 0.0)
+    return false;
+
+  double x = (c*e - 2.0*b*d) / det;
+  double y = (c*d - 2.0*a*e) / det;
+  if (std::abs(x) > 1.0 || std::abs(y) > 1.0)
+    return false;
+
+  dx = x;
+  dy = y;
+  return true;
+}
+
+} // end namespace asp
@@ -0,0 +1,60 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SubpixelKernels.h
+///
+/// Vectorized kernels for parabola subpixel refinement. The AVX2 and AVX-512
+/// versions are compiled with per-function target attributes, so no special
+/// compiler flags are needed, and the one to use is picked at run time. On
+/// ARM the NEON version is used. These do not depend on VW, so they operate
+/// on raw pointers to contiguous rows of floats.
+
+#ifndef __ASP_CORE_SUBPIXEL_KERNELS_H__
+#define __ASP_CORE_SUBPIXEL_KERNELS_H__
+
+#include <string>
+
+namespace asp {
+
+  /// The instruction sets the kernels can use
+  enum SimdLevel { SIMD_NONE = 0, SIMD_NEON = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3 };
+
+  /// The best instruction set supported by this CPU. Found once, at run time.
+  SimdLevel simd_level();
+
+  /// Return true if the kernels can use this instruction set on this CPU
+  bool simd_level_supported(SimdLevel level);
+
+  std::string simd_level_name(SimdLevel level);
+
+  /// Sum of absolute differences between two windows of floats with given
+  /// number of columns and rows. Row r of a window starts at ptr + r * stride.
+  /// The instruction set must be supported. SIMD_NONE gives the plain loop.
+  float window_sad(float const* left,  int left_stride,
+                   float const* right, int right_stride,
+                   int cols, int rows, SimdLevel level);
+
+  /// Fit a quadratic surface in the least squares sense to 9 costs at
+  /// disparity offsets (dx, dy) in [-1, 1] x [-1, 1], stored as
+  /// costs[3*(dy+1) + dx+1], and find its minimum. Return false if the
+  /// surface has no minimum, or it is more than one pixel away.
+  bool parabola_minimum(float const costs[9], float & dx, float & dy);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_SUBPIXEL_KERNELS_H__
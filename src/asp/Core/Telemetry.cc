@@ -0,0 +1,479 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Telemetry.cc
+///
+
+#include <asp/Core/Telemetry.h>
+#include <asp/Core/MemoryProfile.h>
+#include <asp/Core/Trace.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace asp {
+
+namespace {
+
+  // Assign to each thread a slot in the counters, round-robin
+  std::atomic<int> g_next_slot(0);
+
+  // Escape a string for JSON
+  std::string json_str(std::string const& s) {
+    std::string out = "\"";
+    for (char c: s) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if ((unsigned char)c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+
+  std::string json_num(double val) {
+    if (!std::isfinite(val))
+      return "null";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", val);
+    return buf;
+  }
+
+  // The bytes read and written by the process, from /proc/self/io. This
+  // is not available on all systems. The rchar and wchar fields count
+  // all reads and writes, including from the page cache, and read_bytes
+  // and write_bytes only the ones which went to storage.
+  bool read_proc_io(std::map<std::string, std::int64_t> & io) {
+    std::ifstream ifs("/proc/self/io");
+    std::string key;
+    std::int64_t val = 0;
+    while (ifs >> key >> val) {
+      if (!key.empty() && key.back() == ':')
+        key.pop_back();
+      io[key] = val;
+    }
+    return !io.empty();
+  }
+
+  // The peak resident memory of the process, as reported by the system
+  double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0); // in bytes
+#else
+    return usage.ru_maxrss / 1024.0; // in kilobytes
+#endif
+  }
+
+  const double BYTES_PER_MB = 1024.0 * 1024.0;
+
+  // Failing to write these must not change how a tool exits
+  void write_summary_at_exit() {
+    std::string file = telemetry().summary_file();
+    if (!file.empty()) {
+      try {
+        telemetry().write_summary(file);
+      } catch (...) {}
+    }
+
+    file = telemetry().output_file("trace");
+    if (trace_enabled() && !file.empty()) {
+      try {
+        write_trace(file);
+      } catch (...) {}
+    }
+
+    file = telemetry().output_file("memory");
+    if (memory_profile_enabled() && !file.empty()) {
+      std::string ext = ".json";
+      if (file.size() >= ext.size() &&
+          file.compare(file.size() - ext.size(), ext.size(), ext) == 0)
+        file.replace(file.size() - ext.size(), ext.size(), ".txt");
+      try {
+        telemetry().write_memory_report(file);
+      } catch (...) {}
+    }
+  }
+
+} // end anonymous namespace
+
+TelemetryCounter::TelemetryCounter() {
+  for (int it = 0; it < NUM_SLOTS; it++)
+    m_slots[it].val.store(0);
+}
+
+int TelemetryCounter::slot_index() {
+  thread_local int slot = g_next_slot.fetch_add(1) % NUM_SLOTS;
+  return slot;
+}
+
+std::int64_t TelemetryCounter::value() const {
+  std::int64_t sum = 0;
+  for (int it = 0; it < NUM_SLOTS; it++)
+    sum += m_slots[it].val.load(std::memory_order_relaxed);
+  return sum;
+}
+
+TelemetryHistogram::TelemetryHistogram():
+  m_count(0), m_sum(0), m_min(std::numeric_limits<double>::max()),
+  m_max(-std::numeric_limits<double>::max()) {
+  for (int it = 0; it < NUM_BUCKETS; it++)
+    m_buckets[it].store(0);
+}
+
+void TelemetryHistogram::add(double val) {
+  if (std::isnan(val))
+    return;
+
+  int bucket = 0;
+  if (val > 0) {
+    int exp = 0;
+    std::frexp(val, &exp); // val = f * 2^exp, with 0.5 <= f < 1
+    bucket = std::min(std::max(exp - 1 - MIN_EXP, 0), NUM_BUCKETS - 1);
+  }
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_sum += val;
+  m_min = std::min(m_min, val);
+  m_max = std::max(m_max, val);
+}
+
+double TelemetryHistogram::bucket_lower(int bucket) {
+  if (bucket <= 0)
+    return 0.0;
+  return std::ldexp(1.0, bucket + MIN_EXP);
+}
+
+double TelemetryHistogram::sum() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_sum;
+}
+
+double TelemetryHistogram::min() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_count.load() > 0 ? m_min : 0.0;
+}
+
+double TelemetryHistogram::max() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_count.load() > 0 ? m_max : 0.0;
+}
+
+Telemetry::Telemetry(): m_at_exit(false), m_start(std::chrono::steady_clock::now()) {}
+
+TelemetryCounter & Telemetry::counter(std::string const& name) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto & ptr = m_counters[name];
+  if (!ptr)
+    ptr.reset(new TelemetryCounter);
+  return *ptr;
+}
+
+TelemetryHistogram & Telemetry::histogram(std::string const& name) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto & ptr = m_histograms[name];
+  if (!ptr)
+    ptr.reset(new TelemetryHistogram);
+  return *ptr;
+}
+
+TelemetryGauge & Telemetry::gauge(std::string const& name) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto & ptr = m_gauges[name];
+  if (!ptr)
+    ptr.reset(new TelemetryGauge);
+  return *ptr;
+}
+
+void Telemetry::add_stage_time(std::string const& name, double wall_time,
+                               double cpu_time) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  TelemetryStage & stage = m_stages[name];
+  stage.count++;
+  stage.wall_time += wall_time;
+  stage.cpu_time  += cpu_time;
+  stage.max_wall_time = std::max(stage.max_wall_time, wall_time);
+}
+
+void Telemetry::set_value(std::string const& name, double value) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_values[name] = value;
+}
+
+void Telemetry::enable_summary_at_exit(std::string const& prog_name,
+                                       std::string const& file) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_prog_name = prog_name;
+  if (!file.empty())
+    m_file = file;
+  if (!m_at_exit) {
+    std::atexit(write_summary_at_exit);
+    m_at_exit = true;
+  }
+}
+
+std::string Telemetry::prog_name() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_prog_name;
+}
+
+std::string Telemetry::summary_file() const {
+  const char * flag = getenv("ASP_TELEMETRY");
+  if (flag != NULL && std::string(flag) == "0")
+    return "";
+  return output_file("telemetry");
+}
+
+std::string Telemetry::output_file(std::string const& kind) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const char * dir = getenv("ASP_TELEMETRY_DIR");
+  if (dir != NULL && std::string(dir) != "") {
+    std::ostringstream os;
+    os << dir << "/" << m_prog_name << "-" << kind << "-" << getpid() << ".json";
+    return os.str();
+  }
+
+  // The file set by log_to_file() has "-telemetry-" in its name
+  std::string file = m_file;
+  std::string tag = "-telemetry-";
+  size_t pos = file.rfind(tag);
+  if (pos != std::string::npos)
+    file.replace(pos, tag.size(), "-" + kind + "-");
+  return file;
+}
+
+void Telemetry::write_summary(std::string const& file) const {
+
+  double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                   - m_start).count();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double user_time = usage.ru_utime.tv_sec + 1e-6 * usage.ru_utime.tv_usec;
+  double sys_time  = usage.ru_stime.tv_sec + 1e-6 * usage.ru_stime.tv_usec;
+  std::map<std::string, double> stage_peaks = stage_peak_rss_mb();
+
+  std::ostringstream os;
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  os << "{\n";
+  os << "  \"program\": " << json_str(m_prog_name) << ",\n";
+  os << "  \"pid\": " << getpid() << ",\n";
+  os << "  \"wall_time_sec\": " << json_num(wall_time) << ",\n";
+  os << "  \"user_time_sec\": " << json_num(user_time) << ",\n";
+  os << "  \"system_time_sec\": " << json_num(sys_time) << ",\n";
+  os << "  \"peak_rss_mb\": " << json_num(peak_rss_mb()) << ",\n";
+
+  std::map<std::string, std::int64_t> io;
+  if (read_proc_io(io)) {
+    os << "  \"bytes_read\": " << io["rchar"] << ",\n";
+    os << "  \"bytes_written\": " << io["wchar"] << ",\n";
+    os << "  \"storage_bytes_read\": " << io["read_bytes"] << ",\n";
+    os << "  \"storage_bytes_written\": " << io["write_bytes"] << ",\n";
+  }
+
+  os << "  \"stages\": {";
+  bool first = true;
+  for (auto const& s: m_stages) {
+    os << (first ? "\n" : ",\n") << "    " << json_str(s.first) << ": {"
+       << "\"count\": " << s.second.count
+       << ", \"wall_time_sec\": "     << json_num(s.second.wall_time)
+       << ", \"cpu_time_sec\": "      << json_num(s.second.cpu_time)
+       << ", \"max_wall_time_sec\": " << json_num(s.second.max_wall_time);
+    auto peak = stage_peaks.find(s.first);
+    if (peak != stage_peaks.end())
+      os << ", \"peak_rss_mb\": " << json_num(peak->second);
+    os << "}";
+    first = false;
+  }
+  os << (first ? "" : "\n  ") << "},\n";
+
+  os << "  \"memory\": {";
+  first = true;
+  for (auto const& g: m_gauges) {
+    os << (first ? "\n" : ",\n") << "    " << json_str(g.first) << ": {"
+       << "\"current_mb\": " << json_num(g.second->current() / BYTES_PER_MB)
+       << ", \"peak_mb\": "  << json_num(g.second->peak() / BYTES_PER_MB) << "}";
+    first = false;
+  }
+  os << (first ? "" : "\n  ") << "},\n";
+
+  os << "  \"values\": {";
+  first = true;
+  for (auto const& v: m_values) {
+    os << (first ? "\n" : ",\n") << "    " << json_str(v.first) << ": "
+       << json_num(v.second);
+    first = false;
+  }
+  os << (first ? "" : "\n  ") << "},\n";
+
+  os << "  \"counters\": {";
+  first = true;
+  for (auto const& c: m_counters) {
+    os << (first ? "\n" : ",\n") << "    " << json_str(c.first) << ": "
+       << c.second->value();
+    first = false;
+  }
+  os << (first ? "" : "\n  ") << "},\n";
+
+  // Only the non-empty buckets are written, each with its lower bound
+  os << "  \"histograms\": {";
+  first = true;
+  for (auto const& h: m_histograms) {
+    TelemetryHistogram const& hist = *h.second;
+    os << (first ? "\n" : ",\n") << "    " << json_str(h.first) << ": {"
+       << "\"count\": " << hist.count()
+       << ", \"sum\": " << json_num(hist.sum())
+       << ", \"min\": " << json_num(hist.min())
+       << ", \"max\": " << json_num(hist.max())
+       << ", \"buckets\": [";
+    bool first_bucket = true;
+    for (int b = 0; b < TelemetryHistogram::NUM_BUCKETS; b++) {
+      std::int64_t count = hist.bucket_count(b);
+      if (count == 0)
+        continue;
+      os << (first_bucket ? "" : ", ") << "[" << json_num(TelemetryHistogram::bucket_lower(b))
+         << ", " << count << "]";
+      first_bucket = false;
+    }
+    os << "]}";
+    first = false;
+  }
+  os << (first ? "" : "\n  ") << "}\n";
+  os << "}\n";
+
+  std::ofstream ofs(file.c_str());
+  ofs << os.str();
+  if (!ofs)
+    vw::vw_throw(vw::IOErr() << "Failed to write: " << file << ".\n");
+}
+
+void Telemetry::write_memory_report(std::string const& file) const {
+
+  std::map<std::string, double> stage_peaks = stage_peak_rss_mb();
+  std::string prog_name;
+  std::vector<std::pair<std::int64_t, std::string>> gauges;
+  std::map<std::string, std::int64_t> current;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    prog_name = m_prog_name;
+    for (auto const& g: m_gauges) {
+      gauges.push_back(std::make_pair(g.second->peak(), g.first));
+      current[g.first] = g.second->current();
+    }
+  }
+
+  std::ostringstream os;
+  char buf[256];
+  os << "Memory report for " << prog_name << ", in MB.\n";
+  snprintf(buf, sizeof(buf), "Peak resident memory: %.1f\n", peak_rss_mb());
+  os << buf;
+  snprintf(buf, sizeof(buf), "VW block cache limit: %.1f\n",
+           vw::vw_settings().system_cache_size() / BYTES_PER_MB);
+  os << buf;
+
+  // Largest first
+  std::vector<std::pair<double, std::string>> stages;
+  for (auto const& s: stage_peaks)
+    stages.push_back(std::make_pair(s.second, s.first));
+  std::sort(stages.rbegin(), stages.rend());
+  os << "\nPeak resident memory while each stage ran:\n";
+  if (stages.empty())
+    os << "  none\n";
+  for (auto const& s: stages) {
+    snprintf(buf, sizeof(buf), "  %-40s %12.1f\n", s.second.c_str(), s.first);
+    os << buf;
+  }
+
+  std::sort(gauges.rbegin(), gauges.rend());
+  os << "\nTracked structures:\n";
+  snprintf(buf, sizeof(buf), "  %-40s %12s %12s\n", "name", "peak", "at exit");
+  os << buf;
+  for (auto const& g: gauges) {
+    snprintf(buf, sizeof(buf), "  %-40s %12.1f %12.1f\n", g.second.c_str(),
+             g.first / BYTES_PER_MB, current[g.second] / BYTES_PER_MB);
+    os << buf;
+  }
+
+  std::ofstream ofs(file.c_str());
+  ofs << os.str();
+  if (!ofs)
+    vw::vw_throw(vw::IOErr() << "Failed to write: " << file << ".\n");
+}
+
+Telemetry & telemetry() {
+  // Never destroyed, so it can be used by other static objects and at exit
+  static Telemetry * t = new Telemetry;
+  return *t;
+}
+
+double process_cpu_time() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + 1e-6 * usage.ru_utime.tv_usec
+    + usage.ru_stime.tv_sec + 1e-6 * usage.ru_stime.tv_usec;
+}
+
+TelemetryTimer::TelemetryTimer(std::string const& stage):
+  m_stage(stage), m_running(true), m_cpu_start(process_cpu_time()), m_wall(0),
+  m_start(std::chrono::steady_clock::now()) {
+  memory_stage_begin(m_stage);
+}
+
+TelemetryTimer::~TelemetryTimer() {
+  stop();
+}
+
+void TelemetryTimer::stop() {
+  if (!m_running)
+    return;
+  m_running = false;
+  m_wall = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                         - m_start).count();
+  telemetry().add_stage_time(m_stage, m_wall, process_cpu_time() - m_cpu_start);
+  memory_stage_end(m_stage);
+}
+
+double TelemetryTimer::elapsed_seconds() const {
+  if (!m_running)
+    return m_wall;
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                       - m_start).count();
+}
+
+} // end namespace asp
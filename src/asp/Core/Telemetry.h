@@ -0,0 +1,227 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Telemetry.h
+///
+/// Instrumentation shared by the tools: timers for processing stages,
+/// counters, histograms, and gauges of the memory used by some
+/// structures. All of these can be updated from many
+/// threads. At exit, a tool writes a summary in JSON with the time
+/// spent in each stage, the counters and histograms, and the time, bytes
+/// read and written, and peak memory of the process, as reported by the
+/// operating system.
+///
+/// The summary is written next to the log file of tools which call
+/// log_to_file(). If the environment variable ASP_TELEMETRY_DIR is set,
+/// it is written in that directory instead, for any tool which calls
+/// check_command_line(). Setting ASP_TELEMETRY to 0 turns this off.
+
+#ifndef __ASP_CORE_TELEMETRY_H__
+#define __ASP_CORE_TELEMETRY_H__
+
+#include <asp/Core/MemoryBudget.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace asp {
+
+  /// A counter which many threads can add to with little contention.
+  /// Each thread adds to one of several slots, which are summed on reading.
+  class TelemetryCounter {
+  public:
+    TelemetryCounter();
+    void add(std::int64_t val = 1) {
+      m_slots[slot_index()].val.fetch_add(val, std::memory_order_relaxed);
+    }
+    std::int64_t value() const;
+
+  private:
+    static const int NUM_SLOTS = 16;
+    static int slot_index();
+    // Each slot is on its own cache line
+    struct Slot {
+      std::atomic<std::int64_t> val;
+      char pad[64 - sizeof(std::atomic<std::int64_t>)];
+    };
+    Slot m_slots[NUM_SLOTS];
+  };
+
+  /// A histogram of non-negative values, with buckets [2^k, 2^(k+1)).
+  /// The first bucket also has all values below 2^MIN_EXP, and the last
+  /// one all values of at least 2^MAX_EXP.
+  class TelemetryHistogram {
+  public:
+    static const int MIN_EXP = -20, MAX_EXP = 44;
+    static const int NUM_BUCKETS = MAX_EXP - MIN_EXP + 1;
+
+    TelemetryHistogram();
+    void add(double val);
+
+    std::int64_t count() const { return m_count.load(); }
+    std::int64_t bucket_count(int bucket) const { return m_buckets[bucket].load(); }
+    /// The smallest value of a bucket, which is 0 for the first one
+    static double bucket_lower(int bucket);
+    double sum() const;
+    double min() const;
+    double max() const;
+
+  private:
+    std::atomic<std::int64_t> m_buckets[NUM_BUCKETS];
+    std::atomic<std::int64_t> m_count;
+    mutable std::mutex m_mutex; // for the sum, min, and max
+    double m_sum, m_min, m_max;
+  };
+
+  /// The memory used by a kind of structure, in bytes, and the most it
+  /// reached. The code which allocates such a structure adds its size,
+  /// and subtracts it when freeing it. This is also counted in the
+  /// memory budget (asp/Core/MemoryBudget.h).
+  class TelemetryGauge {
+  public:
+    TelemetryGauge(): m_current(0), m_peak(0) {}
+    void add(std::int64_t bytes) {
+      memory_budget_add(bytes);
+      std::int64_t now = m_current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+      std::int64_t peak = m_peak.load(std::memory_order_relaxed);
+      while (now > peak &&
+             !m_peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    }
+    std::int64_t current() const { return m_current.load(std::memory_order_relaxed); }
+    std::int64_t peak()    const { return m_peak.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<std::int64_t> m_current, m_peak;
+  };
+
+  /// Hold an amount of memory in a gauge, which can be changed with
+  /// set(), and is given back on destruction. Can be a member of the
+  /// structure whose memory it tracks.
+  class TelemetryGaugeScope {
+  public:
+    explicit TelemetryGaugeScope(TelemetryGauge & gauge): m_gauge(gauge), m_bytes(0) {}
+    ~TelemetryGaugeScope() { m_gauge.add(-m_bytes); }
+    void set(std::int64_t bytes) {
+      m_gauge.add(bytes - m_bytes);
+      m_bytes = bytes;
+    }
+
+  private:
+    TelemetryGaugeScope(TelemetryGaugeScope const&);
+    TelemetryGaugeScope & operator=(TelemetryGaugeScope const&);
+    TelemetryGauge & m_gauge;
+    std::int64_t m_bytes;
+  };
+
+  /// The time spent in a stage, over all the times it was run
+  struct TelemetryStage {
+    std::int64_t count;
+    double wall_time, cpu_time, max_wall_time;
+    TelemetryStage(): count(0), wall_time(0), cpu_time(0), max_wall_time(0) {}
+  };
+
+  class Telemetry {
+  public:
+    Telemetry();
+
+    /// The counter or histogram with this name, created if needed. The
+    /// reference stays valid, so it can be kept in a static variable.
+    TelemetryCounter   & counter  (std::string const& name);
+    TelemetryHistogram & histogram(std::string const& name);
+    TelemetryGauge     & gauge    (std::string const& name);
+
+    /// Add the wall and CPU time of a run of a stage
+    void add_stage_time(std::string const& name, double wall_time, double cpu_time);
+
+    /// Set a value describing the run, such as the search range. The
+    /// last value set is kept.
+    void set_value(std::string const& name, double value);
+
+    /// Write the summary. The program name is set on enabling the summary.
+    void write_summary(std::string const& file) const;
+
+    /// Write a report of the peak memory, over the run and during each
+    /// stage, and of the memory of the tracked structures, largest first
+    void write_memory_report(std::string const& file) const;
+
+    /// Write the summary at exit, for the given program. If the file name
+    /// is empty, use ASP_TELEMETRY_DIR, if set. Can be called more than once,
+    /// and the last file name is used.
+    void enable_summary_at_exit(std::string const& prog_name, std::string const& file);
+
+    /// The program name set on enabling the summary, or empty
+    std::string prog_name() const;
+
+    /// The summary file, after the environment is taken into account. Empty
+    /// if there is none.
+    std::string summary_file() const;
+
+    /// Where to write other outputs at exit, such as "trace", next to
+    /// the summary, with this kind in place of "telemetry" in the name.
+    /// Empty if there is no place.
+    std::string output_file(std::string const& kind) const;
+
+  private:
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<TelemetryCounter>>   m_counters;
+    std::map<std::string, std::unique_ptr<TelemetryHistogram>> m_histograms;
+    std::map<std::string, std::unique_ptr<TelemetryGauge>>     m_gauges;
+    std::map<std::string, TelemetryStage> m_stages;
+    std::map<std::string, double> m_values;
+    std::string m_prog_name, m_file;
+    bool m_at_exit;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+  /// The instance shared by all code in a process. It is never destroyed,
+  /// so it can be used at exit.
+  Telemetry & telemetry();
+
+  /// The CPU time used so far by the process, over all threads, in seconds
+  double process_cpu_time();
+
+  /// Add the wall time from construction to stop() or destruction to a
+  /// stage, and the CPU time used by the process meanwhile. Can be used
+  /// as vw::Stopwatch, to also print the time. With memory profiling,
+  /// the stage is also given the peak memory while it runs.
+  class TelemetryTimer {
+  public:
+    explicit TelemetryTimer(std::string const& stage);
+    ~TelemetryTimer();
+
+    /// Stop the timer and record the time. Later calls do nothing.
+    void stop();
+
+    /// The elapsed wall time, until now, or until the timer was stopped
+    double elapsed_seconds() const;
+
+  private:
+    std::string m_stage;
+    bool m_running;
+    double m_cpu_start, m_wall;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TELEMETRY_H__
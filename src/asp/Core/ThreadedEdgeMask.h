@@ -19,6 +19,7 @@
 #include <vw/Core/ThreadPool.h>
 #include <vw/Image/MaskViews.h>
 #include <boost/foreach.hpp>
+#include <asp/Core/Trace.h>
 
 #ifndef __ASP_CORE_THREADEDEDGEMASK_H__
 #define __ASP_CORE_THREADEDEDGEMASK_H__
@@ -42,122 +43,70 @@ namespace asp {
         return false;
     }
 
-    // Task that checks individual blocks for edges
+    // Task that finds the edges of the valid region in one block. The
+    // block is read once and scanned once, row by row. The results are
+    // kept in the task and merged into the global arrays after all tasks
+    // are done, as the tasks in the same row or column of blocks would
+    // otherwise update the same entries.
     class EdgeMaskTask : public vw::Task, private boost::noncopyable {
       ViewT m_view;
       typename ViewT::pixel_type m_mask_value;
       vw::BBox2i m_bbox;   // Region of image we're working in
       typedef std::vector<vw::int32> Array;
-      typedef boost::shared_array<vw::int32> SharedArray;
-      SharedArray g_left, g_right, g_top, g_bottom;
-      Array       m_left, m_right, m_top, m_bottom;
-      // This how much we increment after we test a pixel. Set to 1 if
-      // you wish to test every pixel.
-      const vw::int32 STEP_SIZE;
+      // The first and last valid pixel in each row and column, or -1
+      Array m_row_beg, m_row_end, m_col_beg, m_col_end;
     public:
       EdgeMaskTask(ViewT const& view,
                    typename ViewT::pixel_type mask_value,
-                   vw::int32 search_step,
-                   vw::BBox2i bbox, SharedArray left, SharedArray right,
-                   SharedArray top, SharedArray bottom ) :
+                   vw::BBox2i bbox) :
         m_view(view), m_mask_value(mask_value), m_bbox(bbox), 
-        g_left(left), g_right(right), g_top(top), g_bottom(bottom), 
-        m_left( m_bbox.height() ), m_right( m_bbox.height() ), 
-        m_top( m_bbox.width() ), m_bottom( m_bbox.width() ), STEP_SIZE(search_step) {
-
-        std::fill( m_left.begin  (), m_left.end  (), -1 );
-        std::fill( m_right.begin (), m_right.end (), -1 );
-        std::fill( m_top.begin   (), m_top.end   (), -1 );
-        std::fill( m_bottom.begin(), m_bottom.end(), -1 );
-      }
+        m_row_beg( m_bbox.height(), -1 ), m_row_end( m_bbox.height(), -1 ), 
+        m_col_beg( m_bbox.width(), -1 ), m_col_end( m_bbox.width(), -1 ) {}
 
       void operator()() {
         using namespace vw;
 
+        TraceScope trace("edge_mask", "task", m_bbox);
+
         // Rasterizing local tile
-        ImageView<typename ViewT::pixel_type> copy( crop(m_view, m_bbox ) );
-
-        { // Detecting Edges
-          // Search left and right side
-          for ( int32 j = 0; j < copy.rows(); ++j ) { // Loop up through the rows in the local tile
-            int32 i = 0;
-            while ( i < copy.cols() && copy(i,j) == m_mask_value ) // Move from left to right in row by STEP_SIZE
-              i += STEP_SIZE;                                      //    until we hit an invalid pixel
-            if ( i > 0 ) i -= STEP_SIZE;                           // Walk back one step if we are not at col 0
-            while ( i < copy.cols() && copy(i,j) == m_mask_value ) // Now do the same thing but in steps of 1
-              ++i;
-            if ( i > 0 ) --i;
-            // Early exit condition if entire row was nodata
-            if ( i == copy.cols() -1 )
-              continue; // We're keeping left and right as -1
-            m_left[j] = i;                                         // Now we have the left-most valid column in the row
-
-            i = copy.cols() - 1;                                   // Do the same thing going right to left
-            while ( i >= 0 && copy(i,j) == m_mask_value )
-              i -= STEP_SIZE;
-            if ( i < copy.cols() - 1 )
-              i += STEP_SIZE;
-            while ( i >= 0 && copy(i,j) == m_mask_value )
-              --i;
-            if ( i < copy.cols() - 1 )
-              ++i;
-            m_right[j] = i;
-          }
-                                                                   // Now find the first valid rows from the bottom
-          for ( int32 i = 0; i < copy.cols(); ++i ) {
-            int32 j = 0;
-            while ( j < copy.rows() && copy(i,j) == m_mask_value )
-              j += STEP_SIZE;
-            if ( j > 0 )
-              j -= STEP_SIZE;
-            while ( j < copy.rows() && copy(i,j) == m_mask_value )
-              ++j;
-            if ( j > 0 )
-              --j;
-            // Early exit condition if entire column was nodata
-            if ( j == copy.rows() - 1 )
-              continue; // We're keeping top and bottom as -1
-            m_top[i] = j;
-
-            j = copy.rows()-1;                                     // And the first valid rows from the top
-            while ( j >= 0 && copy(i,j) == m_mask_value )
-              j -= STEP_SIZE;
-            if ( j < copy.rows()-1 )
-              j += STEP_SIZE;
-            while ( j >= 0 && copy(i,j) == m_mask_value )
-              --j;
-            if ( j < copy.rows()-1 )
-              ++j;
-            m_bottom[i] = j;
-          }
+        ImageView<typename ViewT::pixel_type> copy;
+        {
+          TraceScope read_trace("edge_mask_read", "read", m_bbox);
+          copy = crop(m_view, m_bbox);
         }
 
-        { // Merging result back into global perspective
-          int32 l = 0;
-          for ( int32 j = m_bbox.min()[1];                      // Loop through rows
-                j < m_bbox.max()[1]; j++ ) {
-            if ( m_left[l] == -1 ) {                            // Skip rows with no pixels
-              l++; continue;
-            }
-            g_left[j] = std::min( m_left[l] + m_bbox.min()[0],  // Add in the bounding box column
-                                  g_left[j] );
-            g_right[j] = std::max( m_right[l] + m_bbox.min()[0],
-                                   g_right[j] );
-            l++;
+        for ( int32 j = 0; j < copy.rows(); ++j ) {
+          for ( int32 i = 0; i < copy.cols(); ++i ) {
+            if ( copy(i,j) == m_mask_value )
+              continue;
+            if ( m_row_beg[j] < 0 )
+              m_row_beg[j] = i;
+            m_row_end[j] = i;
+            if ( m_col_beg[i] < 0 )
+              m_col_beg[i] = j;
+            m_col_end[i] = j;
           }
+        }
+      }
 
-          l = 0;
-          for ( int32 i = m_bbox.min()[0];                       // Loop through columns
-                i < m_bbox.max()[0]; i++ ) {
-            if ( m_top[l] == -1 ) {                              // Skip columns with no pixels
-              l++; continue;
-            }
-            g_top[i] = std::min( m_top[l] + m_bbox.min()[1],     // Add in the bounding box row
-                                 g_top[i] );
-            g_bottom[i] = std::max( m_bottom[l] + m_bbox.min()[1],
-                                    g_bottom[i] );
-            l++;
-          }
+      // Merge the result into the global arrays. The edges are one pixel
+      // outside of the valid region.
+      void merge(SharedArray g_left, SharedArray g_right,
+                 SharedArray g_top, SharedArray g_bottom) const {
+        using namespace vw;
+        for ( int32 l = 0; l < m_bbox.height(); l++ ) {         // Loop through rows
+          if ( m_row_beg[l] < 0 )                               // Skip rows with no pixels
+            continue;
+          int32 j = l + m_bbox.min()[1];
+          g_left[j]  = std::min( m_row_beg[l] - 1 + m_bbox.min()[0], g_left[j]  );
+          g_right[j] = std::max( m_row_end[l] + 1 + m_bbox.min()[0], g_right[j] );
+        }
+        for ( int32 l = 0; l < m_bbox.width(); l++ ) {          // Loop through columns
+          if ( m_col_beg[l] < 0 )                               // Skip columns with no pixels
+            continue;
+          int32 i = l + m_bbox.min()[0];
+          g_top[i]    = std::min( m_col_beg[l] - 1 + m_bbox.min()[1], g_top[i]    );
+          g_bottom[i] = std::max( m_col_end[l] + 1 + m_bbox.min()[1], g_bottom[i] );
         }
       }
     };
@@ -218,25 +167,17 @@ namespace asp {
 
       std::vector<BBox2i> bboxes = subdivide_bbox( m_view, block_size, block_size );
 
-      // Figure out an ideal search step size. Smaller means we're
-      // more likely to catch small features. Bigger step size means
-      // will move a lot faster.
-      int32 search_step = norm_2(Vector2i(m_view.cols(),m_view.rows())) / 500;
-      if (search_step < 1 )
-        search_step = 1;
-      if ( search_step > 10 ) 
-        search_step = 10;
-      VW_OUT(DebugMessage, "threadededgemask") << "Setting search step to "
-                                               << search_step << std::endl;
-
       // Find the outermost valid pixel coming in from each line/direction.
+      std::vector<boost::shared_ptr<EdgeMaskTask>> tasks;
       BOOST_FOREACH( BBox2i const& box, bboxes ) {
         VW_OUT(DebugMessage, "threadededgemask") << "Created EdgeMaskTask for " << box << std::endl;
-        boost::shared_ptr<EdgeMaskTask> task(new EdgeMaskTask(m_view, mask_value, search_step, box, 
-                                                              m_left, m_right, m_top, m_bottom ) );
+        boost::shared_ptr<EdgeMaskTask> task(new EdgeMaskTask(m_view, mask_value, box));
+        tasks.push_back(task);
         queue.add_task(task);
       }
       queue.join_all(); // Wait for all tasks to complete
+      for ( size_t it = 0; it < tasks.size(); it++ )
+        tasks[it]->merge( m_left, m_right, m_top, m_bottom );
 
       // Erode the valid area by mask_buffer size on each side.
       std::for_each( m_left.get(), m_left.get()+view.rows(),
@@ -0,0 +1,161 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Trace.cc
+///
+
+#include <asp/Core/Trace.h>
+
+#include <vw/Core/Exception.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace asp {
+
+namespace {
+
+  const size_t MAX_EVENTS_PER_THREAD = 1000000;
+
+  struct TraceEvent {
+    const char * name;
+    const char * category;
+    double start_us, duration_us;
+    vw::BBox2i tile;
+  };
+
+  // The events of one thread. Only that thread adds to it, but the
+  // trace may be written while it runs, hence the lock.
+  struct TraceThread {
+    int tid;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::int64_t num_dropped;
+    TraceThread(int id): tid(id), num_dropped(0) {}
+  };
+
+  // All threads which recorded events. Never destroyed, as threads may
+  // still record at exit.
+  struct TraceRecorder {
+    std::mutex mutex;
+    std::vector<TraceThread*> threads;
+    std::chrono::steady_clock::time_point start;
+    TraceRecorder(): start(std::chrono::steady_clock::now()) {}
+  };
+
+  TraceRecorder & recorder() {
+    static TraceRecorder * r = new TraceRecorder;
+    return *r;
+  }
+
+  TraceThread & this_thread_events() {
+    thread_local TraceThread * t = NULL;
+    if (t == NULL) {
+      TraceRecorder & r = recorder();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      t = new TraceThread(r.threads.size() + 1);
+      r.threads.push_back(t);
+    }
+    return *t;
+  }
+
+} // end anonymous namespace
+
+bool trace_enabled() {
+  static const bool enabled = [] {
+    const char * flag = getenv("ASP_TRACE");
+    bool ans = (flag != NULL && std::string(flag) == "1");
+    if (ans)
+      recorder(); // start the clock
+    return ans;
+  }();
+  return enabled;
+}
+
+double trace_now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()
+                                                   - recorder().start).count();
+}
+
+void trace_event(const char * name, const char * category, double start_us,
+                 double duration_us, vw::BBox2i const& tile) {
+  TraceThread & t = this_thread_events();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  if (t.events.size() >= MAX_EVENTS_PER_THREAD) {
+    t.num_dropped++;
+    return;
+  }
+  t.events.push_back(TraceEvent{name, category, start_us, duration_us, tile});
+}
+
+void write_trace(std::string const& file) {
+
+  std::ofstream ofs(file.c_str());
+  ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+  int pid = getpid();
+  bool first = true;
+  char buf[512];
+  TraceRecorder & r = recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (TraceThread * t: r.threads) {
+    std::lock_guard<std::mutex> thread_lock(t->mutex);
+
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+             "\"args\": {\"name\": \"thread %d\"}}",
+             first ? "" : ",\n", pid, t->tid, t->tid);
+    ofs << buf;
+    first = false;
+
+    for (TraceEvent const& e: t->events) {
+      snprintf(buf, sizeof(buf),
+               ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, "
+               "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+               e.name, e.category, pid, t->tid, e.start_us, e.duration_us);
+      ofs << buf;
+      if (!e.tile.empty()) {
+        snprintf(buf, sizeof(buf),
+                 ", \"args\": {\"x\": %d, \"y\": %d, \"width\": %d, \"height\": %d}",
+                 e.tile.min().x(), e.tile.min().y(), e.tile.width(), e.tile.height());
+        ofs << buf;
+      }
+      ofs << "}";
+    }
+
+    if (t->num_dropped > 0) {
+      snprintf(buf, sizeof(buf),
+               ",\n{\"name\": \"dropped_events\", \"ph\": \"C\", \"pid\": %d, \"tid\": %d, "
+               "\"ts\": 0, \"args\": {\"count\": %lld}}",
+               pid, t->tid, (long long)t->num_dropped);
+      ofs << buf;
+    }
+  }
+  ofs << "\n]}\n";
+
+  if (!ofs)
+    vw::vw_throw(vw::IOErr() << "Failed to write: " << file << ".\n");
+}
+
+} // end namespace asp
@@ -0,0 +1,86 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Trace.h
+///
+/// A recorder of what each thread does over time, saved in the Chrome
+/// trace event format. The file can be opened in chrome://tracing or
+/// https://ui.perfetto.dev to see, for each thread, when tiles were
+/// processed, read, and written, and where threads were idle.
+///
+/// Recording is turned on by setting the environment variable ASP_TRACE
+/// to 1. Then, at exit, the trace is written next to the telemetry
+/// summary (asp/Core/Telemetry.h), with "-trace-" in place of
+/// "-telemetry-" in the file name. When recording is off, a TraceScope
+/// costs only a check of a flag.
+///
+/// Each thread records to its own buffer, so threads do not wait on each
+/// other. A thread keeps at most a million events, and the rest are
+/// counted as dropped.
+
+#ifndef __ASP_CORE_TRACE_H__
+#define __ASP_CORE_TRACE_H__
+
+#include <vw/Math/BBox.h>
+
+#include <chrono>
+#include <string>
+
+namespace asp {
+
+  /// If ASP_TRACE is set to 1
+  bool trace_enabled();
+
+  /// Record one event, with the times in microseconds since the trace
+  /// started. The name and category must be string literals, or
+  /// otherwise outlive the process, as only the pointers are kept. An
+  /// empty box means no tile.
+  void trace_event(const char * name, const char * category, double start_us,
+                   double duration_us, vw::BBox2i const& tile);
+
+  /// Microseconds since the trace started
+  double trace_now_us();
+
+  /// Write the events recorded so far
+  void write_trace(std::string const& file);
+
+  /// Record an event lasting as long as this object. Categories in use
+  /// are "task" for computation, "read", and "write".
+  class TraceScope {
+  public:
+    TraceScope(const char * name, const char * category,
+               vw::BBox2i const& tile = vw::BBox2i()):
+      m_enabled(trace_enabled()), m_name(name), m_category(category), m_tile(tile),
+      m_start(m_enabled ? trace_now_us() : 0.0) {}
+
+    ~TraceScope() {
+      if (m_enabled)
+        trace_event(m_name, m_category, m_start, trace_now_us() - m_start, m_tile);
+    }
+
+  private:
+    bool m_enabled;
+    const char * m_name;
+    const char * m_category;
+    vw::BBox2i m_tile;
+    double m_start;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TRACE_H__
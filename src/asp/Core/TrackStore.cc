@@ -0,0 +1,223 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file TrackStore.cc
+///
+
+#include <asp/Core/TrackStore.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  const char TRACK_STORE_MAGIC[8] = {'A', 'S', 'P', 'T', 'R', 'A', 'C', 'K'};
+  const std::int64_t TRACK_STORE_VERSION = 1;
+
+  // The file starts with this, followed by the camera offsets, pixels,
+  // sigmas, point positions, and point indices, so that all arrays are
+  // aligned.
+  struct TrackStoreHeader {
+    char          magic[8];
+    std::int64_t  version;
+    std::uint64_t key;
+    std::int64_t  num_cameras, num_points, num_obs;
+  };
+
+  std::size_t data_size(std::int64_t num_cameras, std::int64_t num_points,
+                        std::int64_t num_obs) {
+    return sizeof(TrackStoreHeader)
+      + sizeof(std::int64_t) * (num_cameras + 1)
+      + sizeof(double) * (4 * num_obs + 3 * num_points)
+      + sizeof(std::int32_t) * num_obs;
+  }
+
+} // end anonymous namespace
+
+TrackStore::TrackStore(): m_num_cameras(0), m_num_points(0), m_num_obs(0) {
+  TrackStoreHeader header;
+  std::memset(&header, 0, sizeof(header));
+  m_buffer.resize(data_size(0, 0, 0));
+  std::memcpy(&m_buffer[0], &header, sizeof(header));
+  set_arrays(&m_buffer[0]);
+}
+
+void TrackStore::set_arrays(const char * data) {
+  TrackStoreHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  m_num_cameras = header.num_cameras;
+  m_num_points  = header.num_points;
+  m_num_obs     = header.num_obs;
+
+  const char * ptr = data + sizeof(TrackStoreHeader);
+  m_cam_offsets = (const std::int64_t*)ptr; ptr += sizeof(std::int64_t) * (m_num_cameras + 1);
+  m_pixels      = (const double*)ptr;       ptr += sizeof(double) * 2 * m_num_obs;
+  m_sigmas      = (const double*)ptr;       ptr += sizeof(double) * 2 * m_num_obs;
+  m_xyz         = (const double*)ptr;       ptr += sizeof(double) * 3 * m_num_points;
+  m_point_ids   = (const std::int32_t*)ptr;
+}
+
+void TrackStore::from_cnet(vw::ba::ControlNetwork const& cnet, int num_cameras) {
+
+  std::int64_t num_points = cnet.size(), num_obs = 0;
+  std::vector<std::int64_t> offsets(num_cameras + 1, 0);
+  for (std::int64_t ipt = 0; ipt < num_points; ipt++) {
+    for (auto m = cnet[ipt].begin(); m != cnet[ipt].end(); m++) {
+      if (m->image_id() >= size_t(num_cameras))
+        vw::vw_throw(vw::ArgumentErr() << "Out of bounds camera index in the "
+                     << "control network.\n");
+      offsets[m->image_id() + 1]++;
+      num_obs++;
+    }
+  }
+  for (int icam = 0; icam < num_cameras; icam++)
+    offsets[icam + 1] += offsets[icam];
+
+  TrackStoreHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, TRACK_STORE_MAGIC, sizeof(header.magic));
+  header.version     = TRACK_STORE_VERSION;
+  header.num_cameras = num_cameras;
+  header.num_points  = num_points;
+  header.num_obs     = num_obs;
+
+  m_file.reset();
+  m_buffer.assign(data_size(num_cameras, num_points, num_obs), 0);
+  char * data = &m_buffer[0];
+  std::memcpy(data, &header, sizeof(header));
+  set_arrays(data);
+
+  // Fill in the arrays in place. Observations of each camera are in the
+  // order of the points, as in vw::ba::CameraRelationNetwork.
+  std::int64_t * cam_offsets = const_cast<std::int64_t*>(m_cam_offsets);
+  double       * pixels      = const_cast<double*>(m_pixels);
+  double       * sigmas      = const_cast<double*>(m_sigmas);
+  double       * xyz         = const_cast<double*>(m_xyz);
+  std::int32_t * point_ids   = const_cast<std::int32_t*>(m_point_ids);
+  std::copy(offsets.begin(), offsets.end(), cam_offsets);
+
+  for (std::int64_t ipt = 0; ipt < num_points; ipt++) {
+    vw::Vector3 pos = cnet[ipt].position();
+    for (int c = 0; c < 3; c++)
+      xyz[3*ipt + c] = pos[c];
+    for (auto m = cnet[ipt].begin(); m != cnet[ipt].end(); m++) {
+      std::int64_t obs = offsets[m->image_id()]++;
+      point_ids[obs] = ipt;
+      vw::Vector2 pix = m->position(), sig = m->sigma();
+      pixels[2*obs] = pix[0]; pixels[2*obs + 1] = pix[1];
+      sigmas[2*obs] = sig[0]; sigmas[2*obs + 1] = sig[1];
+    }
+  }
+}
+
+void TrackStore::to_cnet(vw::ba::ControlNetwork & cnet) const {
+
+  // Group the observations by point
+  std::vector<std::vector<std::size_t>> point_obs(m_num_points);
+  for (int icam = 0; icam < m_num_cameras; icam++) {
+    for (std::size_t obs = cam_begin(icam); obs < cam_end(icam); obs++)
+      point_obs[m_point_ids[obs]].push_back(obs);
+  }
+
+  for (int ipt = 0; ipt < m_num_points; ipt++) {
+    vw::ba::ControlPoint cp(vw::ba::ControlPoint::TiePoint);
+    cp.set_position(point(ipt));
+    for (std::size_t k = 0; k < point_obs[ipt].size(); k++) {
+      std::size_t obs = point_obs[ipt][k];
+      // Find the camera for this observation
+      int icam = std::upper_bound(m_cam_offsets, m_cam_offsets + m_num_cameras + 1,
+                                  std::int64_t(obs)) - m_cam_offsets - 1;
+      vw::Vector2 pix = pixel(obs), sig = sigma(obs);
+      cp.add_measure(vw::ba::ControlMeasure(pix[0], pix[1], sig[0], sig[1], icam));
+    }
+    cnet.add_control_point(cp);
+  }
+}
+
+void TrackStore::write(std::string const& file, std::uint64_t key) const {
+
+  const char * data = m_file ? m_file->data() : &m_buffer[0];
+  TrackStoreHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  header.key = key;
+
+  // Write to a temporary file and rename it, so that an interrupted
+  // run does not leave behind a partial file.
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+    ofs.write((const char*)&header, sizeof(header));
+    std::size_t size = data_size(m_num_cameras, m_num_points, m_num_obs);
+    ofs.write(data + sizeof(header), size - sizeof(header));
+    if (!ofs)
+      vw::vw_throw(vw::IOErr() << "Failed to write: " << tmp_file << ".\n");
+  }
+  fs::rename(tmp_file, file);
+}
+
+bool TrackStore::read(std::string const& file, std::uint64_t key) {
+
+  if (!fs::exists(file))
+    return false;
+
+  boost::shared_ptr<boost::iostreams::mapped_file_source>
+    mapped(new boost::iostreams::mapped_file_source(file));
+  if (!mapped->is_open() || mapped->size() < sizeof(TrackStoreHeader))
+    return false;
+
+  TrackStoreHeader header;
+  std::memcpy(&header, mapped->data(), sizeof(header));
+  if (std::memcmp(header.magic, TRACK_STORE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACK_STORE_VERSION || header.key != key ||
+      header.num_cameras < 0 || header.num_points < 0 || header.num_obs < 0 ||
+      mapped->size() != data_size(header.num_cameras, header.num_points,
+                                  header.num_obs)) {
+    vw::vw_out() << "Ignoring: " << file << ", as it does not match the inputs.\n";
+    return false;
+  }
+
+  m_buffer.clear();
+  m_file = mapped;
+  set_arrays(m_file->data());
+  return true;
+}
+
+std::uint64_t TrackStore::hash(std::uint64_t seed, std::string const& str) {
+  std::uint64_t h = seed ^ 14695981039346656037ULL;
+  for (std::size_t it = 0; it < str.size(); it++) {
+    h ^= (unsigned char)str[it];
+    h *= 1099511628211ULL;
+  }
+  // Mark the end of the string, so "ab" + "c" differs from "a" + "bc"
+  h ^= 0xff;
+  h *= 1099511628211ULL;
+  return h;
+}
+
+} // end namespace asp
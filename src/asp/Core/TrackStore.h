@@ -0,0 +1,119 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TrackStore.h
+///
+/// A compact store of the observations of triangulated points in
+/// cameras. The observations are grouped by camera, and kept as flat
+/// arrays of point indices, pixels, and pixel sigmas, rather than as an
+/// object for each observation, as vw::ba::ControlNetwork does. This is
+/// much faster to build and to iterate over when there are millions of
+/// observations. The store can be saved to disk and memory-mapped later,
+/// so that a control network need not be built from match files again.
+
+#ifndef __ASP_CORE_TRACK_STORE_H__
+#define __ASP_CORE_TRACK_STORE_H__
+
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace boost {
+  namespace iostreams {
+    class mapped_file_source;
+  }
+}
+
+namespace vw {
+  namespace ba {
+    class ControlNetwork;
+  }
+}
+
+namespace asp {
+
+  class TrackStore {
+  public:
+    TrackStore();
+
+    /// Copy the observations and point positions of a control network
+    void from_cnet(vw::ba::ControlNetwork const& cnet, int num_cameras);
+
+    /// Create a control network of tie points with these observations
+    /// and point positions
+    void to_cnet(vw::ba::ControlNetwork & cnet) const;
+
+    /// Save to disk, with a key identifying the inputs the store was made from
+    void write(std::string const& file, std::uint64_t key) const;
+
+    /// Memory-map a file saved with write(). Return false, leaving this
+    /// unchanged, if the file does not exist, or if is not valid or was
+    /// saved with a different key.
+    bool read(std::string const& file, std::uint64_t key);
+
+    int         num_cameras     () const { return m_num_cameras; }
+    int         num_points      () const { return m_num_points;  }
+    std::size_t num_observations() const { return m_num_obs;     }
+
+    /// The observations in camera icam have indices in [cam_begin(icam),
+    /// cam_end(icam)), in the order of the points.
+    std::size_t cam_begin(int icam) const { return m_cam_offsets[icam];     }
+    std::size_t cam_end  (int icam) const { return m_cam_offsets[icam + 1]; }
+
+    int point_index(std::size_t obs) const { return m_point_ids[obs]; }
+    vw::Vector2 pixel(std::size_t obs) const {
+      return vw::Vector2(m_pixels[2*obs], m_pixels[2*obs + 1]);
+    }
+    vw::Vector2 sigma(std::size_t obs) const {
+      return vw::Vector2(m_sigmas[2*obs], m_sigmas[2*obs + 1]);
+    }
+    vw::Vector3 point(int ipt) const {
+      return vw::Vector3(m_xyz[3*ipt], m_xyz[3*ipt + 1], m_xyz[3*ipt + 2]);
+    }
+
+    /// Accumulate a hash of a string, to make a key, with FNV-1a
+    static std::uint64_t hash(std::uint64_t seed, std::string const& str);
+
+  private:
+    // The arrays point into the buffer, so this cannot be copied
+    TrackStore(TrackStore const&) = delete;
+    TrackStore& operator=(TrackStore const&) = delete;
+
+    // Point the arrays to the data in the given buffer
+    void set_arrays(const char * data);
+
+    // The data, either owned or memory-mapped
+    std::vector<char> m_buffer;
+    boost::shared_ptr<boost::iostreams::mapped_file_source> m_file;
+
+    int          m_num_cameras, m_num_points;
+    std::size_t  m_num_obs;
+    const std::int64_t * m_cam_offsets;
+    const std::int32_t * m_point_ids;
+    const double       * m_pixels;
+    const double       * m_sigmas;
+    const double       * m_xyz;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TRACK_STORE_H__
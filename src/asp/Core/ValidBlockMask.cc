@@ -0,0 +1,215 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ValidBlockMask.cc
+///
+
+#include <asp/Core/ValidBlockMask.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/FileIO/DiskImageView.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+std::string valid_block_mask_file(std::string const& out_prefix) {
+  return out_prefix + "-lValidBlocks.tif";
+}
+
+ValidBlockMaskView::ValidBlockMaskView(ImageViewRef<PixelGray<float>> const& image,
+                                       ImageViewRef<uint8> const& mask,
+                                       int block_size):
+  m_image(image), m_mask(mask), m_block_size(block_size) {
+
+  if (m_block_size <= 0)
+    vw_throw(ArgumentErr() << "The block size must be positive.\n");
+  if (m_image.cols() != m_mask.cols() || m_image.rows() != m_mask.rows())
+    vw_throw(ArgumentErr() << "The image and its mask must have the same size.\n");
+}
+
+ValidBlockMaskView::prerasterize_type
+ValidBlockMaskView::prerasterize(BBox2i const& bbox) const {
+
+  // The region in the input image covering the output blocks
+  BBox2i full_box(bbox.min() * m_block_size, bbox.max() * m_block_size);
+  full_box.crop(bounding_box(m_image));
+
+  ImageView<PixelGray<float>> image = crop(m_image, full_box);
+  ImageView<uint8>            mask  = crop(m_mask,  full_box);
+
+  ImageView<pixel_type> out(bbox.width(), bbox.height());
+  for (int col = 0; col < out.cols(); col++) {
+    for (int row = 0; row < out.rows(); row++) {
+
+      // The block in the cropped image
+      BBox2i block(Vector2i(col, row) * m_block_size,
+                   Vector2i(col + 1, row + 1) * m_block_size);
+      block.crop(bounding_box(image));
+
+      // A block is on if it has at least two distinct valid values. A
+      // textureless block, such as saturated or filled, cannot correlate.
+      bool has_val = false, has_texture = false;
+      float val = 0.0;
+      for (int c = block.min().x(); c < block.max().x() && !has_texture; c++) {
+        for (int r = block.min().y(); r < block.max().y(); r++) {
+          if (mask(c, r) == 0)
+            continue;
+          float v = image(c, r)[0];
+          if (std::isnan(v))
+            continue;
+          if (!has_val) {
+            has_val = true;
+            val = v;
+          } else if (v != val) {
+            has_texture = true;
+            break;
+          }
+        }
+      }
+
+      out(col, row) = has_texture ? 255 : 0;
+    }
+  }
+
+  return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+}
+
+ValidBlockAccumulator::ValidBlockAccumulator(int cols, int rows, int block_size):
+  m_block_size(block_size) {
+
+  if (m_block_size <= 0)
+    vw_throw(ArgumentErr() << "The block size must be positive.\n");
+
+  int num_cols = (cols + m_block_size - 1) / m_block_size;
+  int num_rows = (rows + m_block_size - 1) / m_block_size;
+  m_min.set_size(num_cols, num_rows);
+  m_max.set_size(num_cols, num_rows);
+  fill(m_min, std::numeric_limits<float>::max());
+  fill(m_max, -std::numeric_limits<float>::max());
+}
+
+void ValidBlockAccumulator::add(BBox2i const& bbox,
+                                ImageView<PixelMask<PixelGray<float>>> const& tile) {
+
+  // The blocks overlapping with the tile
+  BBox2i blocks(bbox.min() / m_block_size,
+                (bbox.max() + Vector2i(m_block_size - 1, m_block_size - 1)) / m_block_size);
+  ImageView<float> tile_min(blocks.width(), blocks.height());
+  ImageView<float> tile_max(blocks.width(), blocks.height());
+  fill(tile_min, std::numeric_limits<float>::max());
+  fill(tile_max, -std::numeric_limits<float>::max());
+
+  for (int col = 0; col < tile.cols(); col++) {
+    int bc = (bbox.min().x() + col) / m_block_size - blocks.min().x();
+    for (int row = 0; row < tile.rows(); row++) {
+      if (!is_valid(tile(col, row)))
+        continue;
+      float v = tile(col, row).child()[0];
+      if (std::isnan(v))
+        continue;
+      int br = (bbox.min().y() + row) / m_block_size - blocks.min().y();
+      tile_min(bc, br) = std::min(tile_min(bc, br), v);
+      tile_max(bc, br) = std::max(tile_max(bc, br), v);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int col = 0; col < blocks.width(); col++) {
+    for (int row = 0; row < blocks.height(); row++) {
+      float & mn = m_min(col + blocks.min().x(), row + blocks.min().y());
+      float & mx = m_max(col + blocks.min().x(), row + blocks.min().y());
+      mn = std::min(mn, tile_min(col, row));
+      mx = std::max(mx, tile_max(col, row));
+    }
+  }
+}
+
+ImageView<uint8> ValidBlockAccumulator::mask() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // A block is on if it has at least two distinct valid values
+  ImageView<uint8> out(m_min.cols(), m_min.rows());
+  for (int col = 0; col < out.cols(); col++) {
+    for (int row = 0; row < out.rows(); row++)
+      out(col, row) = (m_min(col, row) < m_max(col, row)) ? 255 : 0;
+  }
+  return out;
+}
+
+MaskWithValidBlocksView::prerasterize_type
+MaskWithValidBlocksView::prerasterize(BBox2i const& bbox) const {
+
+  ImageView<PixelMask<PixelGray<float>>> tile = crop(m_masked_image, bbox);
+  m_accum.add(bbox, tile);
+
+  ImageView<pixel_type> out(bbox.width(), bbox.height());
+  for (int col = 0; col < out.cols(); col++) {
+    for (int row = 0; row < out.rows(); row++)
+      out(col, row) = is_valid(tile(col, row)) ? 255 : 0;
+  }
+
+  return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+}
+
+void tiles_with_data(std::string const& out_prefix,
+                     std::vector<BBox2i> const& tiles,
+                     std::vector<bool> & has_data) {
+
+  has_data.assign(tiles.size(), true);
+
+  std::string mask_file = valid_block_mask_file(out_prefix);
+  if (!boost::filesystem::exists(mask_file))
+    return;
+
+  // This mask is small, so read it fully in memory
+  ImageView<uint8> mask = DiskImageView<uint8>(mask_file);
+  BBox2i mask_box = bounding_box(mask);
+
+  for (size_t it = 0; it < tiles.size(); it++) {
+
+    // All blocks that overlap with the tile
+    BBox2i tile = tiles[it];
+    BBox2i box(Vector2i(tile.min().x() / VALID_BLOCK_SIZE,
+                        tile.min().y() / VALID_BLOCK_SIZE),
+               Vector2i((tile.max().x() + VALID_BLOCK_SIZE - 1) / VALID_BLOCK_SIZE,
+                        (tile.max().y() + VALID_BLOCK_SIZE - 1) / VALID_BLOCK_SIZE));
+    box.crop(mask_box);
+
+    bool found = false;
+    for (int col = box.min().x(); col < box.max().x() && !found; col++) {
+      for (int row = box.min().y(); row < box.max().y(); row++) {
+        if (mask(col, row) != 0) {
+          found = true;
+          break;
+        }
+      }
+    }
+
+    has_data[it] = found;
+  }
+}
+
+} // end namespace asp
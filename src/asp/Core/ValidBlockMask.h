@@ -0,0 +1,157 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ValidBlockMask.h
+///
+/// A coarse mask of the left aligned image, L.tif, in which each pixel
+/// corresponds to a square block of L.tif and is on if the block has any
+/// valid pixels with some texture. It is created by stereo_pprc from L.tif
+/// and lMask.tif (the latter being produced with threaded_edge_mask()),
+/// and used by parallel_stereo to skip tiles having no data.
+///
+/// The mask can also be accumulated while lMask.tif is written, with
+/// MaskWithValidBlocksView, so that L.tif is not read again for it.
+
+#ifndef __ASP_CORE_VALID_BLOCK_MASK_H__
+#define __ASP_CORE_VALID_BLOCK_MASK_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Math/BBox.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Each pixel of the valid block mask covers this many pixels of L.tif
+  /// in each direction.
+  const int VALID_BLOCK_SIZE = 64;
+
+  /// The file name of the valid block mask for given output prefix
+  std::string valid_block_mask_file(std::string const& out_prefix);
+
+  /// A view having a pixel for each block of the input image. The value is
+  /// 255 if the block has valid pixels (according to the mask) which are
+  /// not all equal, and 0 otherwise.
+  class ValidBlockMaskView: public vw::ImageViewBase<ValidBlockMaskView> {
+    vw::ImageViewRef<vw::PixelGray<float>> m_image;
+    vw::ImageViewRef<vw::uint8> m_mask;
+    int m_block_size;
+
+  public:
+    ValidBlockMaskView(vw::ImageViewRef<vw::PixelGray<float>> const& image,
+                       vw::ImageViewRef<vw::uint8> const& mask,
+                       int block_size);
+
+    typedef vw::uint8 pixel_type;
+    typedef vw::uint8 result_type;
+    typedef vw::ProceduralPixelAccessor<ValidBlockMaskView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return (m_image.cols() + m_block_size - 1) / m_block_size; }
+    inline vw::int32 rows  () const { return (m_image.rows() + m_block_size - 1) / m_block_size; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(double/*i*/, double/*j*/, vw::int32/*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "ValidBlockMaskView::operator()(...) is not implemented.");
+      return result_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Finds the valid block mask from tiles of the masked image, given in
+  /// any order and from any thread. The result is the same as with
+  /// ValidBlockMaskView, once all the image was added.
+  class ValidBlockAccumulator {
+  public:
+    ValidBlockAccumulator(int cols, int rows, int block_size);
+
+    /// Add a tile of the masked image, with the given box in the image
+    void add(vw::BBox2i const& bbox,
+             vw::ImageView<vw::PixelMask<vw::PixelGray<float>>> const& tile);
+
+    /// The valid block mask of the tiles added so far
+    vw::ImageView<vw::uint8> mask() const;
+
+  private:
+    int m_block_size;
+    // The smallest and largest valid value in each block
+    vw::ImageView<float> m_min, m_max;
+    mutable std::mutex m_mutex;
+  };
+
+  /// The mask of the masked image, with 255 for valid and 0 for invalid
+  /// pixels, as written to lMask.tif. Each tile is also added to the
+  /// accumulator as it is rasterized.
+  class MaskWithValidBlocksView: public vw::ImageViewBase<MaskWithValidBlocksView> {
+    vw::ImageViewRef<vw::PixelMask<vw::PixelGray<float>>> m_masked_image;
+    ValidBlockAccumulator & m_accum;
+
+  public:
+    MaskWithValidBlocksView(vw::ImageViewRef<vw::PixelMask<vw::PixelGray<float>>> const&
+                            masked_image, ValidBlockAccumulator & accum):
+      m_masked_image(masked_image), m_accum(accum) {}
+
+    typedef vw::uint8 pixel_type;
+    typedef vw::uint8 result_type;
+    typedef vw::ProceduralPixelAccessor<MaskWithValidBlocksView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_masked_image.cols(); }
+    inline vw::int32 rows  () const { return m_masked_image.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(double/*i*/, double/*j*/, vw::int32/*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "MaskWithValidBlocksView::operator()(...) is not implemented.");
+      return result_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// For each tile in L.tif, find if it overlaps with any on pixel in the
+  /// valid block mask for this output prefix. If this mask does not exist,
+  /// all tiles are assumed to have data.
+  void tiles_with_data(std::string const& out_prefix,
+                       std::vector<vw::BBox2i> const& tiles,
+                       std::vector<bool> & has_data);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_VALID_BLOCK_MASK_H__
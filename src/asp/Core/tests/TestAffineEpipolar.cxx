@@ -0,0 +1,53 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/AffineEpipolar.h>
+#include <vw/InterestPoint/InterestData.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST(AffineEpipolar, AlignsRowsWithOutliers) {
+
+  // The right image is shifted vertically and has varying horizontal
+  // disparity. Every fifth match is an outlier.
+  std::vector<ip::InterestPoint> ip1, ip2;
+  for (int it = 0; it < 500; it++) {
+    double x = 7.0 * (it % 37), y = 5.0 * (it % 41);
+    ip::InterestPoint p1(x, y), p2(x + 0.1 * y + (it % 7), y + 3.0);
+    if (it % 5 == 4)
+      p2.y += 40.0 + it % 11;
+    ip1.push_back(p1);
+    ip2.push_back(p2);
+  }
+
+  Matrix<double> left_matrix, right_matrix;
+  std::vector<size_t> inliers;
+  affine_epipolar_rectification(Vector2i(300, 300), Vector2i(300, 300),
+                                1.0, 1000, ip1, ip2, false,
+                                left_matrix, right_matrix, &inliers);
+
+  EXPECT_EQ(400u, inliers.size());
+  for (size_t it = 0; it < inliers.size(); it++) {
+    size_t i = inliers[it];
+    EXPECT_NE(4u, i % 5);
+    Vector3 L = left_matrix  * Vector3(ip1[i].x, ip1[i].y, 1);
+    Vector3 R = right_matrix * Vector3(ip2[i].x, ip2[i].y, 1);
+    EXPECT_NEAR(L[1], R[1], 1e-6);
+  }
+}
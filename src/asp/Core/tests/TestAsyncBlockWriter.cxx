@@ -0,0 +1,127 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/AsyncBlockWriter.h>
+#include <asp/Core/BlockJournal.h>
+
+#include <vw/FileIO/DiskImageView.h>
+
+#include <boost/filesystem.hpp>
+
+#include <sstream>
+
+using namespace asp;
+
+// The blocks are written in order and compressed, whatever the order in
+// which the threads finish them, including the partial blocks at the edges
+TEST(AsyncBlockWriter, WriteInOrder) {
+
+  vw::ImageView<float> img(150, 70);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = col + 1000 * row;
+  img(5, 5) = -1;
+
+  vw::GdalWriteOptions opt;
+  opt.num_threads = 4;
+  opt.raster_tile_size = vw::Vector2i(32, 16);
+  opt.gdal_options["COMPRESS"] = "LZW";
+  opt.gdal_options["TILED"] = "YES";
+
+  std::string file = "async_block_writer_test.tif";
+  vw::cartography::GeoReference georef;
+  std::map<std::string, std::string> keywords;
+  keywords["TEST_KEY"] = "test_value";
+  async_block_write_gdal_image(file, img, false, georef, true, -1, opt,
+                               vw::ProgressCallback::dummy_instance(), keywords);
+
+  vw::DiskImageResourceGDAL rsrc(file);
+  ASSERT_TRUE(rsrc.has_nodata_read());
+  EXPECT_EQ(-1, rsrc.nodata_read());
+
+  vw::DiskImageView<float> out(file);
+  ASSERT_EQ(img.cols(), out.cols());
+  ASSERT_EQ(img.rows(), out.rows());
+  vw::ImageView<float> out_img = out;
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      EXPECT_EQ(img(col, row), out_img(col, row));
+
+  GDALDataset * dataset = (GDALDataset*)GDALOpen(file.c_str(), GA_ReadOnly);
+  ASSERT_TRUE(dataset != NULL);
+  const char * val = dataset->GetMetadataItem("TEST_KEY");
+  ASSERT_TRUE(val != NULL);
+  EXPECT_EQ(std::string("test_value"), std::string(val));
+  GDALClose(dataset);
+
+  EXPECT_EQ(0, telemetry().gauge("async_writer.queue").current());
+  boost::filesystem::remove(file);
+}
+
+// A run killed halfway is resumed from the journal, and only the blocks
+// not recorded in it, or which do not read back as recorded, are computed
+TEST(AsyncBlockWriter, Resume) {
+
+  vw::ImageView<float> img(64, 48);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = col + 100 * row;
+
+  vw::GdalWriteOptions opt;
+  opt.num_threads = 2;
+  opt.raster_tile_size = vw::Vector2i(16, 16);
+  opt.gdal_options["TILED"] = "YES";
+
+  std::string file = "async_block_writer_resume.tif";
+  std::string journal_file = block_journal_file(file);
+  vw::cartography::GeoReference georef;
+  async_block_write_gdal_image(file, img, false, georef, false, 0, opt,
+                               vw::ProgressCallback::dummy_instance());
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  // Pretend that a run wrote only the first two blocks, and the second
+  // one got corrupted
+  std::ostringstream layout;
+  layout << img.cols() << " " << img.rows() << " 16 16 " << sizeof(float) << " 1";
+  {
+    BlockJournal journal(file, layout.str(), false);
+    vw::ImageView<float> block = crop(img, vw::BBox2i(0, 0, 16, 16));
+    journal.add(0, block_hash(block.data(), sizeof(float) * 16 * 16));
+    journal.add(1, 0);
+    journal.commit();
+  }
+
+  // Now the image is different, so the blocks computed again differ from
+  // the ones kept
+  vw::ImageView<float> img2 = img;
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img2(col, row) = -1;
+
+  set_resume_block_writes(true);
+  async_block_write_gdal_image(file, img2, false, georef, false, 0, opt,
+                               vw::ProgressCallback::dummy_instance());
+  set_resume_block_writes(false);
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  vw::ImageView<float> out = vw::DiskImageView<float>(file);
+  EXPECT_EQ(img(5, 5), out(5, 5));    // block 0, kept
+  EXPECT_EQ(-1, out(20, 5));          // block 1, hash mismatch, redone
+  EXPECT_EQ(-1, out(40, 30));         // not in the journal, redone
+
+  boost::filesystem::remove(file);
+}
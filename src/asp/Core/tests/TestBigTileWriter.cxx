@@ -0,0 +1,51 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/BigTileWriter.h>
+
+using namespace asp;
+
+TEST(BigTileWriter, DownsampleByTwo) {
+
+  // A 3x3 image, with one nodata value
+  double nodata = -1;
+  vw::ImageView<float> img(3, 3);
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 3; col++)
+      img(col, row) = col + 3*row;
+  img(1, 0) = nodata;
+
+  vw::ImageView<float> out = downsample_by_two(img, true, nodata);
+  ASSERT_EQ(out.cols(), 2);
+  ASSERT_EQ(out.rows(), 2);
+  EXPECT_NEAR(out(0, 0), (0 + 3 + 4)/3.0, 1e-6); // the nodata value is skipped
+  EXPECT_NEAR(out(1, 0), (2 + 5)/2.0, 1e-6);     // the last column
+  EXPECT_NEAR(out(1, 1), 8, 1e-6);               // the corner
+
+  // All values invalid
+  vw::ImageView<vw::uint8> bytes(2, 2);
+  for (int row = 0; row < 2; row++)
+    for (int col = 0; col < 2; col++)
+      bytes(col, row) = 0;
+  vw::ImageView<vw::uint8> out_bytes = downsample_by_two(bytes, true, 0);
+  EXPECT_EQ(int(out_bytes(0, 0)), 0);
+
+  // Integer averages are rounded
+  bytes(0, 0) = 1; bytes(1, 0) = 2;
+  out_bytes = downsample_by_two(bytes, false, 0);
+  EXPECT_EQ(int(out_bytes(0, 0)), 1); // 3/4 rounds to 1
+}
@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/BlobRemoval.h>
+
+using namespace vw;
+
+TEST(BlobRemoval, MergesAcrossSeams) {
+
+  // A 10 x 9 image in tiles of size 4. A U-shaped blob of 9 pixels
+  // crosses two seams and is joined only at its bottom, a blob of 2
+  // pixels straddles a seam, and a single pixel touches another blob
+  // only diagonally, so it is separate.
+  ImageView<uint8> img(10, 9);
+  for (int col = 0; col < 10; col++)
+    for (int row = 0; row < 9; row++)
+      img(col, row) = 0;
+  int u[9][2] = {{2, 2}, {2, 3}, {2, 4}, {3, 4}, {4, 4}, {5, 4}, {5, 3}, {5, 2}, {5, 1}};
+  for (int it = 0; it < 9; it++)
+    img(u[it][0], u[it][1]) = 1;
+  img(7, 7) = 1; img(8, 7) = 1;
+  img(6, 5) = 1;
+
+  asp::TiledBlobIndex index(img.cols(), img.rows(), 4);
+  ASSERT_EQ(9, index.num_tiles());
+  for (int it = 0; it < index.num_tiles(); it++)
+    index.add_tile(it, crop(img, index.tile(it)));
+  index.merge();
+  EXPECT_EQ(3, index.num_blobs());
+  EXPECT_EQ(2, index.num_small_blobs(2));
+  EXPECT_EQ(3, index.num_small_blobs(9));
+
+  // Remove the blobs of up to 2 pixels
+  int removed = 0;
+  ImageView<uint8> out = copy(img);
+  for (int it = 0; it < index.num_tiles(); it++) {
+    BBox2i box = index.tile(it);
+    ImageView<uint8> tile = crop(img, box);
+    removed += index.remove_small(it, tile, 2);
+    crop(out, box) = tile;
+  }
+  EXPECT_EQ(3, removed);
+  EXPECT_EQ(0, out(8, 7));
+  EXPECT_EQ(0, out(6, 5));
+  EXPECT_EQ(1, out(2, 2));
+  EXPECT_EQ(1, out(5, 1));
+
+  std::vector<int> tiles = index.overlapping_tiles(BBox2i(3, 3, 2, 2));
+  ASSERT_EQ(4u, tiles.size());
+  EXPECT_EQ(0, tiles[0]);
+  EXPECT_EQ(4, tiles[3]);
+}
+
+TEST(BlobRemoval, BlobIdsAndBoxes) {
+
+  // The same U-shaped blob, whose parts are in different tiles
+  ImageView<uint8> img(10, 9);
+  for (int col = 0; col < 10; col++)
+    for (int row = 0; row < 9; row++)
+      img(col, row) = 0;
+  int u[9][2] = {{2, 2}, {2, 3}, {2, 4}, {3, 4}, {4, 4}, {5, 4}, {5, 3}, {5, 2}, {5, 1}};
+  for (int it = 0; it < 9; it++)
+    img(u[it][0], u[it][1]) = 1;
+
+  asp::TiledBlobIndex index(img.cols(), img.rows(), 4);
+  for (int it = 0; it < index.num_tiles(); it++)
+    index.add_tile(it, crop(img, index.tile(it)));
+  index.merge();
+
+  std::vector<std::int64_t> ids0, ids1;
+  index.blob_ids(0, crop(img, index.tile(0)), ids0);
+  index.blob_ids(1, crop(img, index.tile(1)), ids1);
+  ASSERT_EQ(16u, ids0.size());
+  EXPECT_EQ(-1, ids0[0]);
+  std::int64_t id = ids0[2 * 4 + 2]; // pixel (2, 2)
+  ASSERT_GE(id, 0);
+  EXPECT_EQ(id, ids1[1 * 4 + 1]);    // pixel (5, 1)
+  EXPECT_EQ(9, index.blob_area(id));
+  EXPECT_EQ(BBox2i(2, 1, 4, 4), index.blob_box(id));
+}
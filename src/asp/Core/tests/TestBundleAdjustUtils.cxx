@@ -0,0 +1,58 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/BundleAdjustUtils.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace asp;
+
+// Two strips of cameras, each one a chain, given with the cameras shuffled,
+// must end up in different partitions.
+TEST(BundleAdjustUtils, PartitionCameras) {
+
+  int num_cameras = 20;
+  std::vector<int> perm(num_cameras);
+  for (int it = 0; it < num_cameras; it++)
+    perm[it] = (7 * it) % num_cameras;
+
+  std::vector<std::pair<int,int>> pairs;
+  for (int strip = 0; strip < 2; strip++) {
+    for (int it = 0; it < 9; it++) {
+      int i = perm[10 * strip + it], j = perm[10 * strip + it + 1];
+      pairs.push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+    }
+  }
+
+  std::vector<int> partition;
+  partition_cameras(num_cameras, pairs, 2, partition);
+  ASSERT_EQ(num_cameras, int(partition.size()));
+
+  std::vector<int> count(2, 0);
+  for (int it = 0; it < num_cameras; it++) {
+    count[partition[it]]++;
+    EXPECT_EQ(partition[perm[it]], partition[perm[10 * (it / 10)]]);
+  }
+  EXPECT_EQ(10, count[0]);
+  EXPECT_EQ(10, count[1]);
+
+  // Neighbors in a chain split in four are in the same or adjacent groups
+  partition_cameras(num_cameras, pairs, 4, partition);
+  for (size_t it = 0; it < pairs.size(); it++)
+    EXPECT_LE(std::abs(partition[pairs[it].first] - partition[pairs[it].second]), 1);
+}
@@ -0,0 +1,103 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/CloudReorder.h>
+
+#include <cstdio>
+
+using namespace asp;
+
+TEST(CloudReorder, MortonCode) {
+  EXPECT_EQ(0u, morton_code(0, 0));
+  EXPECT_EQ(1u, morton_code(1, 0));
+  EXPECT_EQ(2u, morton_code(0, 1));
+  EXPECT_EQ(3u, morton_code(1, 1));
+  EXPECT_EQ(0x30u, morton_code(4, 4));
+  EXPECT_EQ(0xFFFFFFFFFFFFFFFFULL, morton_code(0xFFFFFFFFu, 0xFFFFFFFFu));
+}
+
+TEST(CloudReorder, PartitionCells) {
+  std::vector<std::int64_t> counts = {3, 0, 2, 7, 1, 1};
+  std::vector<int> cell_to_run;
+  int num_runs = partition_cloud_cells(counts, 5, cell_to_run);
+  EXPECT_EQ(3, num_runs);
+  // The cell with 7 points is a run by itself
+  EXPECT_EQ(0, cell_to_run[0]);
+  EXPECT_EQ(0, cell_to_run[1]);
+  EXPECT_EQ(0, cell_to_run[2]);
+  EXPECT_EQ(1, cell_to_run[3]);
+  EXPECT_EQ(2, cell_to_run[4]);
+  EXPECT_EQ(2, cell_to_run[5]);
+}
+
+TEST(CloudReorder, SortRoundTrip) {
+
+  // Points on a sphere along a diagonal, in reverse order and with gaps
+  int cols = 300, rows = 2;
+  vw::ImageView<vw::Vector4> cloud(cols, rows);
+  int num_valid = 0;
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++) {
+      if ((col + row) % 7 == 0)
+        continue; // invalid
+      double t = double(cols - col) / cols + 0.001 * row;
+      double lon = -10.0 + 20.0 * t, lat = -5.0 + 10.0 * t;
+      double R = 1.0e6;
+      lon *= M_PI / 180.0;
+      lat *= M_PI / 180.0;
+      cloud(col, row) = vw::Vector4(R * cos(lat) * cos(lon), R * cos(lat) * sin(lon),
+                                    R * sin(lat), col + 1000.0 * row);
+      num_valid++;
+    }
+  }
+
+  // A tiny memory limit to have several runs
+  std::string prefix = "TestCloudReorder", sorted_file = prefix + "-sorted.bin";
+  vw::ImageViewRef<vw::Vector4> cloud_ref = cloud;
+  std::int64_t num_points = sort_cloud_spatially(cloud_ref, 0.001, prefix, sorted_file);
+  ASSERT_EQ(num_valid, num_points);
+
+  int block_size = 8;
+  SortedCloudView<vw::Vector4> sorted(sorted_file, num_points, block_size);
+  vw::ImageView<vw::Vector4> out = sorted;
+  EXPECT_EQ(0, out.cols() % block_size);
+
+  // Traverse the points in storage order. Along the diagonal the
+  // longitude increases with the curve position.
+  std::int64_t count = 0;
+  double prev_lon = -1.0e100;
+  int blocks_x = out.cols() / block_size;
+  for (std::int64_t k = 0; k < std::int64_t(blocks_x) * (out.rows() / block_size) *
+         block_size * block_size; k++) {
+    std::int64_t block = k / (block_size * block_size), in_block = k % (block_size * block_size);
+    int col = (block % blocks_x) * block_size + in_block % block_size;
+    int row = (block / blocks_x) * block_size + in_block / block_size;
+    vw::Vector4 p = out(col, row);
+    if (k >= num_points) {
+      EXPECT_EQ(vw::Vector4(), p);
+      continue;
+    }
+    double lon = spherical_lonlat(subvector(p, 0, 3))[0];
+    EXPECT_GE(lon, prev_lon - 1e-9);
+    prev_lon = lon;
+    count++;
+  }
+  EXPECT_EQ(num_points, count);
+
+  std::remove(sorted_file.c_str());
+}
@@ -143,3 +143,28 @@ TEST( Common, StereoMultiCmdCheck ) {
   EXPECT_EQ("dem.tif" , dem_path);
 
 } // End test StereoMultiCmdCheck
+
+TEST( Common, QuantizeCloudPixels ) {
+
+  double point_scale = 1.0/1024.0, error_scale = 1.0/256.0;
+  QuantizeCloudPixels<Vector4> quantize(point_scale, error_scale);
+  ScaleCloudPixels<Vector4>    scale(point_scale, error_scale);
+
+  // A point survives the round trip to within half a step
+  Vector4 pt(1234.5678, -98.7654, 0.1, 0.25);
+  Vector4 out = scale(Vector4(quantize(pt)));
+  for (int c = 0; c < 3; c++)
+    EXPECT_NEAR(pt[c], out[c], point_scale/2.0);
+  EXPECT_NEAR(pt[3], out[3], error_scale/2.0);
+
+  // No-data stays no-data
+  EXPECT_EQ(Vector4(), Vector4(quantize(Vector4())));
+
+  // A valid point near the origin, and a small error, do not become no-data
+  Vector<int32, 4> q = quantize(Vector4(1e-6, 0, 0, 1e-6));
+  EXPECT_TRUE(q[0] != 0 || q[1] != 0 || q[2] != 0);
+  EXPECT_NE(0, q[3]);
+
+  // Out of range values are an error
+  EXPECT_THROW(quantize(Vector4(1e+7, 0, 0, 0)), ArgumentErr);
+}
@@ -0,0 +1,121 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/CorrEval.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A textured image, with a few invalid pixels
+  ImageView<PixelMask<float>> make_image(int cols, int rows, int shift) {
+    ImageView<PixelMask<float>> img(cols, rows);
+    for (int col = 0; col < cols; col++) {
+      for (int row = 0; row < rows; row++) {
+        int x = col + shift;
+        img(col, row) = PixelMask<float>(10.0 + sin(0.7 * x) + cos(0.3 * row + 0.1 * x * x));
+        if ((x * 7 + row * 13) % 41 == 0)
+          img(col, row).invalidate();
+      }
+    }
+    return img;
+  }
+
+  // The metric found by going over the patches, with integer disparity
+  PixelMask<float> brute_force(ImageView<PixelMask<float>> const& left,
+                               ImageView<PixelMask<float>> const& right,
+                               int col, int row, Vector2i const& d, int h, bool is_ncc) {
+    if (!is_valid(left(col, row)))
+      return PixelMask<float>();
+    double sl = 0, sl2 = 0, sr = 0, sr2 = 0, slr = 0;
+    int count = 0;
+    for (int dx = -h; dx <= h; dx++) {
+      for (int dy = -h; dy <= h; dy++) {
+        int lc = col + dx, lr = row + dy, rc = lc + d[0], rr = lr + d[1];
+        if (lc < 0 || lr < 0 || lc >= left.cols() || lr >= left.rows())
+          continue;
+        if (rc < 0 || rr < 0 || rc >= right.cols() || rr >= right.rows())
+          continue;
+        if (!is_valid(left(lc, lr)) || !is_valid(right(rc, rr)))
+          continue;
+        double l = left(lc, lr).child(), r = right(rc, rr).child();
+        sl += l; sl2 += l * l; sr += r; sr2 += r * r; slr += l * r;
+        count++;
+      }
+    }
+    if (count == 0)
+      return PixelMask<float>();
+    if (is_ncc)
+      return PixelMask<float>(slr / sqrt(sl2 * sr2));
+    double ml = sl / count, mr = sr / count;
+    return PixelMask<float>(0.5 * (sqrt(std::max(sl2 / count - ml * ml, 0.0)) +
+                                   sqrt(std::max(sr2 / count - mr * mr, 0.0))));
+  }
+}
+
+TEST(CorrEval, IntegralSumsMatchBruteForce) {
+
+  int cols = 60, rows = 50, h = 3, shift = 4;
+  ImageView<PixelMask<float>> left  = make_image(cols, rows, 0);
+  ImageView<PixelMask<float>> right = make_image(cols, rows, -shift);
+
+  // The right image is the left one moved by 'shift' columns
+  ImageView<PixelMask<Vector2f>> disp(cols, rows);
+  for (int col = 0; col < cols; col++)
+    for (int row = 0; row < rows; row++)
+      disp(col, row) = PixelMask<Vector2f>(Vector2f(shift, 0));
+  disp(10, 10).invalidate();
+
+  for (int m = 0; m < 2; m++) {
+    bool is_ncc = (m == 0);
+    ImageView<PixelMask<float>> out
+      = asp::corr_eval(left, right, disp, Vector2i(2 * h + 1, 2 * h + 1),
+                       is_ncc ? "ncc" : "stddev", 1, true);
+    ASSERT_EQ(cols, out.cols());
+    ASSERT_EQ(rows, out.rows());
+
+    for (int col = 0; col < cols; col++) {
+      for (int row = 0; row < rows; row++) {
+        if (col == 10 && row == 10) {
+          EXPECT_FALSE(is_valid(out(col, row)));
+          continue;
+        }
+        PixelMask<float> expected
+          = brute_force(left, right, col, row, Vector2i(shift, 0), h, is_ncc);
+        EXPECT_EQ(is_valid(expected), is_valid(out(col, row)));
+        if (is_valid(expected))
+          EXPECT_NEAR(expected.child(), out(col, row).child(), 1e-5);
+      }
+    }
+  }
+
+  // With the correct disparity the patches agree
+  ImageView<PixelMask<float>> ncc
+    = asp::corr_eval(left, right, disp, Vector2i(5, 5), "ncc", 1, false);
+  EXPECT_NEAR(1.0, ncc(30, 25).child(), 1e-6);
+
+  // With a sample rate only some pixels are found
+  ImageView<PixelMask<float>> sampled
+    = asp::corr_eval(left, right, disp, Vector2i(5, 5), "ncc", 2, true);
+  EXPECT_TRUE(is_valid(sampled(30, 24)));
+  EXPECT_FALSE(is_valid(sampled(31, 24)));
+}
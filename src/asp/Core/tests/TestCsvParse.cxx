@@ -0,0 +1,124 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/CsvParse.h>
+
+#include <vw/Cartography/GeoReference.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace asp;
+
+namespace {
+  double parse_str(std::string const& str, bool & success) {
+    double val = 0.0;
+    const char* begin = str.c_str();
+    const char* end = begin + str.size();
+    success = (parse_csv_double(begin, end, val) != begin);
+    return val;
+  }
+}
+
+TEST(CsvParse, ParseDouble) {
+
+  // Must agree exactly with strtod()
+  const char* tokens[] = {"0", "-0.5", "+12", "3.14159", "1e3", "-2.5E-3", ".25",
+                          "7.", "123456789012345", "-118.123456789", "6378137.000001",
+                          "1.2345678901234567890123", "1e-30", "4.9e300", "1e",
+                          "nan", "-inf"};
+  for (const char* token: tokens) {
+    bool success = false;
+    double val = parse_str(token, success);
+    EXPECT_TRUE(success) << token;
+    double expected = std::strtod(token, NULL);
+    if (expected == expected)
+      EXPECT_EQ(expected, val) << token;
+    else
+      EXPECT_FALSE(val == val) << token;
+  }
+
+  bool success = true;
+  parse_str("abc", success);
+  EXPECT_FALSE(success);
+  parse_str("-", success);
+  EXPECT_FALSE(success);
+  parse_str("", success);
+  EXPECT_FALSE(success);
+}
+
+TEST(CsvParse, ChunkOffsets) {
+  std::string text = "a,1\nbb,2\nccc,3\nd,4\n";
+  std::vector<std::size_t> offsets;
+  csv_chunk_offsets(text.c_str(), text.size(), 5, offsets);
+  ASSERT_GE(offsets.size(), 2u);
+  EXPECT_EQ(0u, offsets.front());
+  EXPECT_EQ(text.size(), offsets.back());
+  for (std::size_t it = 1; it + 1 < offsets.size(); it++)
+    EXPECT_EQ('\n', text[offsets[it] - 1]); // Each chunk starts a line
+
+  csv_chunk_offsets(text.c_str(), 0, 5, offsets);
+  ASSERT_EQ(2u, offsets.size());
+  EXPECT_EQ(0u, offsets[1]);
+}
+
+TEST(CsvParse, ReadColumns) {
+
+  CsvConv conv;
+  conv.parse_csv_format("1:file 4:x 2:z 3:y", "");
+
+  CsvConv::CsvRecord record;
+  std::string line = "name.tif, 2, 3,4 ,5\r";
+  ASSERT_TRUE(conv.parse_csv_chars(line.c_str(), line.c_str() + line.size(), record));
+  EXPECT_EQ("name.tif", record.file);
+  EXPECT_EQ(2, record.point_data[0]);
+  EXPECT_EQ(3, record.point_data[1]);
+  EXPECT_EQ(4, record.point_data[2]);
+  line = "name.tif, 2, 3";
+  EXPECT_FALSE(conv.parse_csv_chars(line.c_str(), line.c_str() + line.size(), record));
+
+  // A header, a comment, a bad line, and points
+  std::string file = "TestCsvParse.csv";
+  int num_points = 1000;
+  {
+    std::ofstream ofs(file.c_str());
+    ofs << "file, z, y, x\n# comment\n\nimg.tif, bad, 1, 2\n";
+    for (int it = 0; it < num_points; it++)
+      ofs << "img" << it << ".tif, " << 0.5 * it << ", " << -it << ", " << it << "\n";
+  }
+  EXPECT_EQ(num_points + 2, csv_count_valid_lines(file));
+
+  CsvColumns columns;
+  EXPECT_EQ(num_points, read_csv_columns(file, conv, 1.0, 0, columns));
+  ASSERT_EQ(std::size_t(num_points), columns.file.size());
+  EXPECT_EQ("img7.tif", columns.record(7).file);
+
+  vw::cartography::GeoReference geo;
+  std::vector<vw::Vector3> xyz;
+  std::vector<vw::Vector2> lonlat;
+  csv_columns_to_cartesian(conv, columns, geo, xyz, lonlat);
+  ASSERT_EQ(std::size_t(num_points), xyz.size());
+  EXPECT_VECTOR_NEAR(vw::Vector3(9, -9, 4.5), xyz[9], 1e-12);
+
+  // Subsampling, and a limit on the number of records
+  EXPECT_EQ(100, read_csv_columns(file, conv, 0.5, 100, columns));
+
+  std::remove(file.c_str());
+}
@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/DemDiff.h>
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/MaskViews.h>
+
+#include <cmath>
+
+using namespace asp;
+
+TEST(DemDiff, DiffStats) {
+
+  // Values from -2 to 7.9, in two halves merged later
+  DiffStats stats1, stats2;
+  int num = 100;
+  for (int it = 0; it < num; it++) {
+    double val = -2.0 + 0.1 * it;
+    if (it % 2 == 0)
+      stats1.add(val);
+    else
+      stats2.add(val);
+  }
+  DiffStats stats;
+  stats.merge(stats1);
+  stats.merge(stats2);
+
+  EXPECT_EQ(num, stats.count());
+  EXPECT_NEAR(-2.0, stats.min(), 1e-12);
+  EXPECT_NEAR(7.9, stats.max(), 1e-12);
+  EXPECT_NEAR(2.95, stats.mean(), 1e-12);
+  EXPECT_NEAR(sqrt((num * num - 1) / 12.0) * 0.1, stats.std_dev(), 1e-10);
+
+  // The sketch is accurate to well within 1%. The exact median is 3.0,
+  // and the exact NMAD is 1.4826 * 2.5.
+  EXPECT_NEAR(3.0, stats.median(), 0.01 * 3.0);
+  EXPECT_NEAR(1.4826 * 2.5, stats.nmad(), 0.02 * 1.4826 * 2.5);
+  EXPECT_NEAR(-2.0, stats.percentile(0), 0.01 * 2.0);
+  EXPECT_NEAR(7.9, stats.percentile(100), 0.01 * 7.9);
+
+  std::vector<vw::int64> counts;
+  stats.histogram(10, counts);
+  ASSERT_EQ(10u, counts.size());
+  vw::int64 total = 0;
+  for (size_t it = 0; it < counts.size(); it++) {
+    EXPECT_NEAR(10, counts[it], 2);
+    total += counts[it];
+  }
+  EXPECT_EQ(num, total);
+
+  // A tile seen twice is counted once
+  DiffStatsCollector collector;
+  collector.add(vw::BBox2i(0, 0, 4, 4), stats1);
+  collector.add(vw::BBox2i(0, 0, 4, 4), stats1);
+  collector.add(vw::BBox2i(4, 0, 4, 4), stats2);
+  EXPECT_EQ(num, collector.stats().count());
+}
+
+TEST(DemDiff, InterpDemHeights) {
+
+  // A plane, with one invalid pixel
+  int cols = 300, rows = 280;
+  vw::ImageView<vw::PixelMask<float>> dem(cols, rows);
+  for (int col = 0; col < cols; col++)
+    for (int row = 0; row < rows; row++)
+      dem(col, row) = vw::PixelMask<float>(2.0 * col + 0.5 * row);
+  dem(100, 100).invalidate();
+
+  std::vector<vw::Vector2> pixels;
+  pixels.push_back(vw::Vector2(10.25, 20.5));
+  pixels.push_back(vw::Vector2(270.5, 260.75)); // in another tile
+  pixels.push_back(vw::Vector2(99.5, 99.5));    // next to the invalid pixel
+  pixels.push_back(vw::Vector2(-1, 5));         // outside
+  pixels.push_back(vw::Vector2(cols - 0.5, 5)); // no right neighbor
+
+  std::vector<double> heights;
+  interp_dem_heights(vw::ImageViewRef<vw::PixelMask<float>>(dem), pixels, heights);
+  ASSERT_EQ(pixels.size(), heights.size());
+  EXPECT_NEAR(2.0 * 10.25 + 0.5 * 20.5, heights[0], 1e-4);
+  EXPECT_NEAR(2.0 * 270.5 + 0.5 * 260.75, heights[1], 1e-3);
+  EXPECT_TRUE(std::isnan(heights[2]));
+  EXPECT_TRUE(std::isnan(heights[3]));
+  EXPECT_TRUE(std::isnan(heights[4]));
+}
@@ -0,0 +1,61 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/EigenUtils.h>
+
+using namespace asp;
+
+namespace {
+
+  // A cloud whose first coordinate is the index of the point
+  DoubleMatrix make_cloud(int num) {
+    DoubleMatrix points(DIM + 1, num);
+    for (int col = 0; col < num; col++) {
+      points(0, col) = col;
+      points(1, col) = 2.0 * col;
+      points(2, col) = -col;
+      points(DIM, col) = 1;
+    }
+    return points;
+  }
+}
+
+// Exactly m distinct points are kept, intact and in their original order
+TEST(EigenUtils, RandomSubsample) {
+  DoubleMatrix points = make_cloud(1000);
+  random_pc_subsample(137, points);
+  ASSERT_EQ(137, points.cols());
+  for (int col = 0; col < points.cols(); col++) {
+    double index = points(0, col);
+    EXPECT_EQ(2.0 * index, points(1, col));
+    EXPECT_EQ(-index, points(2, col));
+    EXPECT_EQ(1.0, points(DIM, col));
+    if (col > 0)
+      EXPECT_LT(points(0, col - 1), index);
+  }
+
+  // The same points are picked each time
+  DoubleMatrix again = make_cloud(1000);
+  random_pc_subsample(137, again);
+  EXPECT_TRUE(points == again);
+
+  // Nothing changes if there are not more points than asked for
+  DoubleMatrix all = make_cloud(50);
+  random_pc_subsample(50, all);
+  EXPECT_TRUE(all == make_cloud(50));
+}
@@ -0,0 +1,69 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/ExpressionProgram.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST(ExpressionProgram, EvaluatesSpans) {
+
+  // lt(var_0, 2, max(var_0, var_1, 3), -abs(var_1 - var_0)) / 2
+  ExpressionProgram p;
+  p.push_var(0);
+  p.push_const(2);
+  p.push_var(0);
+  p.push_var(1);
+  p.push_const(3);
+  p.push_op(ExpressionProgram::OP_MAX, 3);
+  p.push_var(1);
+  p.push_var(0);
+  p.push_op(ExpressionProgram::OP_SUBTRACT, 2);
+  p.push_op(ExpressionProgram::OP_ABS, 1);
+  p.push_op(ExpressionProgram::OP_NEGATE, 1);
+  p.push_op(ExpressionProgram::OP_LT, 4);
+  p.push_const(2);
+  p.push_op(ExpressionProgram::OP_DIVIDE, 2);
+  EXPECT_EQ(2, p.num_vars());
+
+  std::vector<double> x = {0, 1, 2, 5}, y = {7, -1, 4, 1};
+  std::vector<const double*> vars = {x.data(), y.data()};
+  std::vector<double> out(x.size()), scratch;
+  p.evaluate(vars, x.size(), out.data(), scratch);
+  EXPECT_NEAR(3.5, out[0], 1e-12);
+  EXPECT_NEAR(1.5, out[1], 1e-12);
+  EXPECT_NEAR(-1.0, out[2], 1e-12);
+  EXPECT_NEAR(-2.0, out[3], 1e-12);
+
+  // A single set of values gives the same
+  EXPECT_NEAR(-2.0, p.evaluate(std::vector<double>{5, 1}), 1e-12);
+}
+
+TEST(ExpressionProgram, RejectsBadPrograms) {
+
+  ExpressionProgram p;
+  p.push_var(0);
+  EXPECT_THROW(p.push_op(ExpressionProgram::OP_ADD, 2), ArgumentErr);
+
+  // Uses var_2, but only two variables are given
+  ExpressionProgram q;
+  q.push_var(2);
+  q.push_op(ExpressionProgram::OP_SIGN, 1);
+  EXPECT_THROW(q.validate(2), ArgumentErr);
+  EXPECT_NEAR(1.0, q.evaluate(std::vector<double>{0, 0, 3}), 1e-12);
+}
@@ -0,0 +1,82 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/GridInterpolation.h>
+
+#include <limits>
+
+using namespace asp;
+
+namespace {
+
+  // A smooth height, except that it is invalid in a disk, as for a geoid
+  // which does not cover the whole DEM. Count the calls.
+  struct WavyHeight {
+    int * m_num_calls;
+    WavyHeight(int * num_calls): m_num_calls(num_calls) {}
+    double operator()(int col, int row) const {
+      (*m_num_calls)++;
+      if ((col - 100) * (col - 100) + (row - 60) * (row - 60) < 15 * 15)
+        return std::numeric_limits<double>::quiet_NaN();
+      return 5.0 * sin(col/200.0) + 0.01 * row;
+    }
+  };
+
+  struct WavyPair {
+    vw::Vector2 operator()(int col, int row) const {
+      return vw::Vector2(2.0 * cos(row/50.0), 0.5 * col);
+    }
+  };
+}
+
+TEST(GridInterpolation, CloseToExact) {
+
+  int num_calls = 0, num_exact_calls = 0;
+  double tol = 0.01;
+  WavyHeight func(&num_calls), exact(&num_exact_calls);
+
+  vw::BBox2i box(3, 5, 190, 117);
+  vw::ImageView<double> out;
+  interpolate_on_grid(box, 16, tol, func, out);
+  ASSERT_EQ(box.width(),  out.cols());
+  ASSERT_EQ(box.height(), out.rows());
+  EXPECT_LT(num_calls, box.width() * box.height() / 4);
+
+  for (int row = 0; row < box.height(); row++) {
+    for (int col = 0; col < box.width(); col++) {
+      double val = exact(col + box.min().x(), row + box.min().y());
+      if (std::isnan(val)) {
+        EXPECT_TRUE(std::isnan(out(col, row))) << col << " " << row;
+        continue;
+      }
+      EXPECT_NEAR(val, out(col, row), tol) << col << " " << row;
+    }
+  }
+
+  // Vector values, and each pixel found exactly with a grid step of 1
+  vw::ImageView<vw::Vector2> out2, out3;
+  interpolate_on_grid(box, 8, tol, WavyPair(), out2);
+  interpolate_on_grid(box, 1, tol, WavyPair(), out3);
+  for (int row = 0; row < box.height(); row++) {
+    for (int col = 0; col < box.width(); col++) {
+      vw::Vector2 val = WavyPair()(col + box.min().x(), row + box.min().y());
+      EXPECT_VECTOR_NEAR(val, out2(col, row), tol);
+      EXPECT_VECTOR_NEAR(val, out3(col, row), 1e-12);
+    }
+  }
+}
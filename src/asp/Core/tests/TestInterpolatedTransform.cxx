@@ -0,0 +1,60 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/InterpolatedTransform.h>
+
+using namespace asp;
+
+// A smooth transform, except that it is invalid to the left of a line,
+// as happens at the DEM boundary. Count the calls.
+struct WavyTransform: public vw::TransformBase<WavyTransform> {
+  int * m_num_calls;
+  WavyTransform(int * num_calls): m_num_calls(num_calls) {}
+  vw::Vector2 reverse(vw::Vector2 const& p) const {
+    (*m_num_calls)++;
+    if (p[0] < 20)
+      return vw::Vector2(-1e6, -1e6);
+    return vw::Vector2(2*p[0] + 2*sin(p[1]/60.0), 0.5*p[1] + 2*cos(p[0]/60.0));
+  }
+  vw::Vector2 forward(vw::Vector2 const& p) const { return p; }
+};
+
+TEST(InterpolatedTransform, CloseToExact) {
+
+  int num_calls = 0, num_exact_calls = 0;
+  double tol = 0.01;
+  InterpolatedTransform<WavyTransform> interp(WavyTransform(&num_calls), 16, tol,
+                                              vw::Vector2i(1000, 1000));
+  WavyTransform exact(&num_exact_calls);
+
+  vw::BBox2i box(3, 5, 150, 100);
+  vw::BBox2i in_box = interp.reverse_bbox(box);
+  EXPECT_LT(num_calls, box.width() * box.height() / 4);
+
+  for (int row = box.min().y(); row < box.max().y(); row++) {
+    for (int col = box.min().x(); col < box.max().x(); col++) {
+      vw::Vector2 p(col, row);
+      vw::Vector2 diff = interp.reverse(p) - exact.reverse(p);
+      EXPECT_LE(std::abs(diff[0]), tol) << col << " " << row;
+      EXPECT_LE(std::abs(diff[1]), tol) << col << " " << row;
+    }
+  }
+
+  // The invalid values do not enlarge the box
+  EXPECT_GT(in_box.min().x(), -10);
+  EXPECT_LT(in_box.max().x(), 400);
+}
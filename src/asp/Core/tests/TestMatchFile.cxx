@@ -0,0 +1,73 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/MatchFile.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  std::vector<ip::InterestPoint> make_ip(int num, float shift) {
+    std::vector<ip::InterestPoint> ip(num);
+    for (int i = 0; i < num; i++) {
+      ip[i].x = 10.5 * i + shift; ip[i].y = 3.25 * i;
+      ip[i].ix = i; ip[i].iy = 2 * i;
+      ip[i].orientation = 0.1 * i; ip[i].scale = 1.5; ip[i].interest = i + shift;
+      ip[i].polarity = (i % 2 == 0);
+      ip[i].octave = i % 3; ip[i].scale_lvl = i % 5;
+      ip[i].descriptor.set_size(4);
+      for (int d = 0; d < 4; d++)
+        ip[i].descriptor[d] = i + 0.25 * d + shift;
+    }
+    return ip;
+  }
+}
+
+TEST(MatchFile, RoundTrip) {
+
+  std::string file = "match_file_v2_test.match";
+  std::vector<ip::InterestPoint> ip1 = make_ip(7, 0), ip2 = make_ip(7, 100);
+  write_match_file_v2(file, ip1, ip2);
+  EXPECT_TRUE(is_match_file_v2(file));
+
+  std::vector<ip::InterestPoint> out1, out2;
+  read_match_file(file, out1, out2);
+  ASSERT_EQ(ip1.size(), out1.size());
+  ASSERT_EQ(ip2.size(), out2.size());
+  for (size_t i = 0; i < ip1.size(); i++) {
+    EXPECT_EQ(ip1[i].x, out1[i].x);
+    EXPECT_EQ(ip2[i].y, out2[i].y);
+    EXPECT_EQ(ip1[i].iy, out1[i].iy);
+    EXPECT_EQ(ip2[i].interest, out2[i].interest);
+    EXPECT_EQ(ip1[i].polarity, out1[i].polarity);
+    EXPECT_EQ(ip2[i].scale_lvl, out2[i].scale_lvl);
+    ASSERT_EQ(4u, out2[i].descriptor.size());
+    EXPECT_EQ(ip2[i].descriptor[3], out2[i].descriptor[3]);
+  }
+
+  // Without descriptors, only the pixels are needed
+  write_match_file_v2(file, ip1, ip2, false);
+  MappedMatchFile mapped(file);
+  EXPECT_EQ(7u, mapped.num_matches());
+  EXPECT_FALSE(mapped.has_descriptors());
+  EXPECT_VECTOR_NEAR(Vector2(ip2[5].x, ip2[5].y), mapped.pixel(1, 5), 1e-6);
+
+  boost::filesystem::remove(file);
+}
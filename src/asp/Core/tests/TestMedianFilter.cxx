@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/MedianFilter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace {
+
+  // The median of the valid values in the clipped window, by sorting
+  template <class T>
+  double brute_median(ImageView<T> const& img, int col, int row, int half,
+                      bool lower) {
+    std::vector<double> vals;
+    for (int c = std::max(col - half, 0); c <= std::min(col + half, img.cols() - 1); c++) {
+      for (int r = std::max(row - half, 0); r <= std::min(row + half, img.rows() - 1); r++) {
+        if (!std::isnan(double(img(c, r))))
+          vals.push_back(img(c, r));
+      }
+    }
+    if (vals.empty())
+      return std::numeric_limits<double>::quiet_NaN();
+    std::sort(vals.begin(), vals.end());
+    size_t len = vals.size();
+    if (len % 2 == 1 || lower)
+      return vals[(len - 1) / 2];
+    return (vals[len / 2 - 1] + vals[len / 2]) / 2.0;
+  }
+}
+
+TEST(MedianFilter, Uint8MatchesSorting) {
+
+  ImageView<uint8> img(37, 29);
+  for (int col = 0; col < img.cols(); col++)
+    for (int row = 0; row < img.rows(); row++)
+      img(col, row) = (col * 37 + row * row * 11 + col * row) % 256;
+
+  for (int half = 1; half <= 4; half += 3) {
+    ImageView<uint8> out = asp::median_filter(img, half, 3);
+    for (int col = 0; col < img.cols(); col++)
+      for (int row = 0; row < img.rows(); row++)
+        EXPECT_EQ(brute_median(img, col, row, half, true), out(col, row));
+  }
+}
+
+TEST(MedianFilter, FloatSkipsNaN) {
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  ImageView<double> img(23, 19);
+  for (int col = 0; col < img.cols(); col++) {
+    for (int row = 0; row < img.rows(); row++) {
+      img(col, row) = std::sin(0.7 * col) * 10 + 0.1 * row * row;
+      if ((col + 2 * row) % 7 == 0 || (col < 5 && row < 5))
+        img(col, row) = nan;
+    }
+  }
+
+  ImageView<double> out = asp::median_filter(img, 2, 2);
+  for (int col = 0; col < img.cols(); col++) {
+    for (int row = 0; row < img.rows(); row++) {
+      double expected = brute_median(img, col, row, 2, false);
+      if (std::isnan(expected))
+        EXPECT_TRUE(std::isnan(out(col, row)));
+      else
+        EXPECT_NEAR(expected, out(col, row), 1e-12);
+    }
+  }
+
+  // The corner of invalid values is too big for a window of size 3
+  ImageView<float> small(5, 5);
+  for (int col = 0; col < 5; col++)
+    for (int row = 0; row < 5; row++)
+      small(col, row) = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_TRUE(std::isnan(asp::median_filter(small, 1)(2, 2)));
+}
@@ -0,0 +1,58 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/MemoryBudget.h>
+#include <asp/Core/Telemetry.h>
+
+#include <vw/Core/Settings.h>
+
+using namespace asp;
+
+TEST(MemoryBudget, CacheSize) {
+  std::int64_t mb = 1024 * 1024;
+  EXPECT_EQ(3000 * mb, budget_cache_size(4000 * mb, 1000 * mb));
+  EXPECT_EQ(4000 * mb, budget_cache_size(4000 * mb, -5));
+  EXPECT_EQ(MIN_BUDGET_CACHE_MB * mb, budget_cache_size(4000 * mb, 3900 * mb));
+}
+
+TEST(MemoryBudget, CacheShrinksAndGrows) {
+
+  std::int64_t mb = 1024 * 1024;
+  std::size_t orig_cache = vw::vw_settings().system_cache_size();
+
+  set_memory_limit_mb(4096);
+  std::int64_t used = memory_budget_used();
+  EXPECT_EQ(budget_cache_size(4096 * mb, used),
+            std::int64_t(vw::vw_settings().system_cache_size()));
+
+  // A structure counted in a gauge takes memory from the cache, and
+  // gives it back when freed
+  {
+    TelemetryGaugeScope buffer(telemetry().gauge("test.budget"));
+    buffer.set(2048 * mb);
+    EXPECT_EQ(used + 2048 * mb, memory_budget_used());
+    EXPECT_EQ(budget_cache_size(4096 * mb, used + 2048 * mb),
+              std::int64_t(vw::vw_settings().system_cache_size()));
+  }
+  EXPECT_EQ(used, memory_budget_used());
+  EXPECT_EQ(budget_cache_size(4096 * mb, used),
+            std::int64_t(vw::vw_settings().system_cache_size()));
+
+  set_memory_limit_mb(0);
+  EXPECT_EQ(0.0, memory_limit_mb());
+  vw::vw_settings().set_system_cache_size(orig_cache);
+}
@@ -0,0 +1,93 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/Nvm.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+
+TEST(Nvm, RoundTrip) {
+
+  int num_cams = 2, num_pts = 3;
+  std::vector<Eigen::Matrix2Xd> keypoints(num_cams);
+  std::vector<std::string> filenames = {"a.tif", "b.tif"};
+  std::vector<double> focal_lengths = {1000.0, 1000.0};
+  std::vector<Eigen::Affine3d> cams(num_cams);
+  for (int cid = 0; cid < num_cams; cid++) {
+    keypoints[cid].resize(2, num_pts);
+    for (int fid = 0; fid < num_pts; fid++)
+      keypoints[cid].col(fid) = Eigen::Vector2d(10.25 * fid + cid, 0.1 * fid - cid);
+    cams[cid].linear() = Eigen::AngleAxisd(0.3 * cid + 0.1, Eigen::Vector3d(0, 0, 1))
+      .toRotationMatrix();
+    cams[cid].translation() = Eigen::Vector3d(1.0 + cid, -2.0, 3.5);
+  }
+  std::vector<std::map<int, int>> pid_to_cid_fid(num_pts);
+  std::vector<Eigen::Vector3d> xyz(num_pts);
+  for (int pid = 0; pid < num_pts; pid++) {
+    // The second camera sees the points in reverse order
+    pid_to_cid_fid[pid][0] = pid;
+    pid_to_cid_fid[pid][1] = num_pts - 1 - pid;
+    xyz[pid] = Eigen::Vector3d(pid, 1.0 / 3.0, -7.5 * pid);
+  }
+
+  std::string file = "nvm_test.nvm";
+  WriteNVM(keypoints, filenames, focal_lengths, pid_to_cid_fid, xyz, cams, file);
+
+  nvmData nvm;
+  ReadNVM(file, nvm);
+  ASSERT_EQ(filenames, nvm.cid_to_filename);
+  ASSERT_EQ(size_t(num_pts), nvm.pid_to_xyz.size());
+  for (int cid = 0; cid < num_cams; cid++) {
+    EXPECT_TRUE(keypoints[cid].isApprox(nvm.cid_to_keypoint_map[cid], 1e-15));
+    EXPECT_TRUE(cams[cid].matrix().isApprox(nvm.cid_to_cam_t_global[cid].matrix(), 1e-12));
+  }
+  for (int pid = 0; pid < num_pts; pid++) {
+    EXPECT_EQ(pid_to_cid_fid[pid], nvm.pid_to_cid_fid[pid]);
+    EXPECT_EQ(xyz[pid], nvm.pid_to_xyz[pid]); // written with full precision
+  }
+
+  // Directly to a control network
+  std::vector<std::string> cnet_filenames;
+  std::vector<Eigen::Affine3d> cnet_cams;
+  ba::ControlNetwork cnet("test");
+  ReadNVM(file, &cnet_filenames, &cnet_cams, &cnet);
+  EXPECT_EQ(filenames, cnet_filenames);
+  ASSERT_EQ(size_t(num_pts), cnet.size());
+  EXPECT_EQ(2u, cnet[2].size());
+  EXPECT_VECTOR_NEAR(Vector3(2, 1.0 / 3.0, -15), cnet[2].position(), 1e-15);
+  EXPECT_VECTOR_NEAR(Vector2(1, -1), cnet[2][1].position(), 1e-15);
+  EXPECT_EQ(1u, cnet[2][1].image_id());
+
+  boost::filesystem::remove(file);
+}
+
+TEST(Nvm, BadFile) {
+  std::string file = "nvm_test_bad.nvm";
+  {
+    std::ofstream ofs(file.c_str());
+    ofs << "NVM_V3\n1\na.tif 1000 1 0 0 0 0 0 0 0 0\n1\n0 0 0 0 0 0 1 5 0 1.0 2.0\n";
+  }
+  nvmData nvm;
+  EXPECT_THROW(ReadNVM(file, nvm), ArgumentErr); // camera index out of range
+  boost::filesystem::remove(file);
+}
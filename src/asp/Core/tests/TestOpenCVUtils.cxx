@@ -0,0 +1,51 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/OpenCVUtils.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // A few smooth blobs, shifted by the given amount
+  double blobs(double x, double y, Vector2 const& shift) {
+    x -= shift.x(); y -= shift.y();
+    return std::exp(-((x - 20) * (x - 20) + (y - 30) * (y - 30)) / 40.0)
+      + 0.5 * std::exp(-((x - 40) * (x - 40) + (y - 15) * (y - 15)) / 20.0)
+      + 0.8 * std::exp(-((x - 35) * (x - 35) + (y - 45) * (y - 45)) / 60.0);
+  }
+}
+
+TEST(OpenCVUtils, PhaseCorrelationShift) {
+
+  Vector2 shift(3, -2);
+  ImageView<double> image1(64, 64), image2(64, 64);
+  for (int col = 0; col < 64; col++) {
+    for (int row = 0; row < 64; row++) {
+      image1(col, row) = blobs(col, row, Vector2());
+      image2(col, row) = blobs(col, row, shift);
+    }
+  }
+
+  double response = 0.0;
+  Vector2 found = phaseCorrelationShift(image1, image2, response);
+  EXPECT_VECTOR_NEAR(shift, found, 0.2);
+  EXPECT_GT(response, 0.1);
+}
@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/PagedImage.h>
+#include <vw/Image/MaskViews.h>
+
+#include <thread>
+
+using namespace asp;
+
+TEST(PagedImage, Half) {
+  // Every float16 value other than NaN converts back to itself
+  for (int it = 0; it < 65536; it++) {
+    float val = half_to_float(std::uint16_t(it));
+    if (!std::isnan(val))
+      EXPECT_EQ(it, int(float_to_half(val)));
+  }
+  EXPECT_TRUE(std::isnan(half_to_float(float_to_half(std::nanf("")))));
+  EXPECT_EQ(65504.0f, half_to_float(float_to_half(65519.0f)));
+  EXPECT_TRUE(std::isinf(half_to_float(float_to_half(1e6f))));
+}
+
+TEST(PagedImage, Values) {
+
+  // A constant region, a smooth region, some invalid pixels, and a
+  // large value that does not fit in float16. The blocks do not
+  // divide the image evenly.
+  int cols = 50, rows = 37;
+  vw::ImageView<vw::PixelMask<float>> img(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      img(col, row) = (col < 16 && row < 16) ? 1.0f : 0.25f * col + 3.0f * row;
+      if ((col + row) % 7 == 0)
+        img(col, row).invalidate();
+    }
+  }
+  img(40, 30) = 1e6;
+
+  vw::ImageView<float> vals = vw::apply_mask(img, std::numeric_limits<float>::quiet_NaN());
+  boost::shared_ptr<PagedImageStore> store(new PagedImageStore(vals, 16));
+  EXPECT_LT(store->memory_usage(), sizeof(float) * cols * rows);
+  PagedImageView<vw::PixelMask<float>> paged(store);
+  ASSERT_EQ(cols, paged.cols());
+  ASSERT_EQ(rows, paged.rows());
+
+  // Check from several threads, which decode blocks separately
+  std::vector<int> num_bad(4, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&, t]() {
+      for (int row = t; row < rows; row += 4) {
+        for (int col = 0; col < cols; col++) {
+          vw::PixelMask<float> pix = paged(col, row);
+          if (is_valid(pix) != is_valid(img(col, row)) ||
+              (is_valid(pix) &&
+               std::abs(pix.child() - img(col, row).child()) > 1e-3 * img(col, row).child()))
+            num_bad[t]++;
+        }
+      }
+    }));
+  }
+  for (int t = 0; t < 4; t++) {
+    threads[t].join();
+    EXPECT_EQ(0, num_bad[t]);
+  }
+
+  EXPECT_EQ(1e6, paged(40, 30).child());
+  vw::ImageView<vw::PixelMask<float>> copied = crop(paged, vw::BBox2i(10, 5, 20, 20));
+  EXPECT_EQ(paged(12, 9).child(), copied(2, 4).child());
+}
@@ -0,0 +1,91 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/Point2Grid.h>
+
+using namespace asp;
+
+// Grid a single cell with many points at the same location. The median
+// must not depend on how the values are stored, and with a cap on the
+// number of values it must stay within the range of the inputs.
+TEST(Point2Grid, MedianWithManyValues) {
+
+  int num = 1001;
+  for (int max_vals = 0; max_vals <= 2000; max_vals += 100) {
+    vw::ImageView<double> buffer, weights;
+    Point2Grid grid(1, 1, buffer, weights, 0.0, 0.0, 1.0, 1.0, 0.5, 0.0,
+                    f_median, -1, max_vals);
+    grid.Clear(-1.0);
+    for (int it = 0; it < num; it++)
+      grid.AddPoint(0.0, 0.0, (it * 37) % num);
+    grid.normalize();
+
+    if (max_vals == 0 || max_vals >= num) {
+      EXPECT_EQ(buffer(0, 0), (num - 1) / 2);
+    } else {
+      EXPECT_GE(buffer(0, 0), 0);
+      EXPECT_LE(buffer(0, 0), num - 1);
+    }
+  }
+}
+
+// Values for neighboring cells are kept apart
+TEST(Point2Grid, SeparateCells) {
+
+  vw::ImageView<double> buffer, weights;
+  Point2Grid grid(3, 1, buffer, weights, 0.0, 0.0, 1.0, 1.0, 0.4, 0.0,
+                  f_median, -1);
+  grid.Clear(-1.0);
+  for (int it = 0; it <= 50; it++) {
+    grid.AddPoint(0.0, 0.0, it);
+    grid.AddPoint(2.0, 0.0, 100 + it);
+  }
+  grid.normalize();
+
+  EXPECT_EQ(buffer(0, 0), 25);
+  EXPECT_EQ(buffer(1, 0), -1);
+  EXPECT_EQ(buffer(2, 0), 125);
+}
+
+// Adding points at once gives the same result as adding them one at a time
+TEST(Point2Grid, AddPoints) {
+
+  std::vector<vw::Vector3> points;
+  for (int it = 0; it < 200; it++)
+    points.push_back(vw::Vector3((it * 7) % 23 * 0.37, (it * 11) % 17 * 0.41, it % 13));
+
+  FilterType filters[] = {f_weighted_average, f_mean, f_max};
+  for (int f = 0; f < 3; f++) {
+    vw::ImageView<double> buffer1, weights1, buffer2, weights2;
+    Point2Grid grid1(12, 10, buffer1, weights1, -0.5, -0.5, 1.0, 1.0, 1.5, 0.0,
+                     filters[f], -1);
+    Point2Grid grid2(12, 10, buffer2, weights2, -0.5, -0.5, 1.0, 1.0, 1.5, 0.0,
+                     filters[f], -1);
+    grid1.Clear(-1.0);
+    grid2.Clear(-1.0);
+    for (size_t it = 0; it < points.size(); it++)
+      grid1.AddPoint(points[it][0], points[it][1], points[it][2]);
+    grid2.AddPoints(points);
+    grid1.normalize();
+    grid2.normalize();
+
+    for (int c = 0; c < buffer1.cols(); c++) {
+      for (int r = 0; r < buffer1.rows(); r++)
+        EXPECT_NEAR(buffer1(c, r), buffer2(c, r), 1e-10);
+    }
+  }
+}
@@ -0,0 +1,65 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/PointCloudCache.h>
+#include <vw/Cartography/Datum.h>
+
+#include <cstdio>
+#include <fstream>
+
+using namespace asp;
+
+TEST(PointCloudCache, RoundTrip) {
+
+  // Points along the equator, at longitudes 0, 1, ..., 9
+  vw::cartography::Datum datum("WGS84");
+  int num_points = 10;
+  vw::Vector3 shift = datum.geodetic_to_cartesian(vw::Vector3(0, 0, 0));
+  DoubleMatrix points(DIM + 1, num_points);
+  for (int it = 0; it < num_points; it++) {
+    vw::Vector3 xyz = datum.geodetic_to_cartesian(vw::Vector3(it, 0, 100)) - shift;
+    for (int row = 0; row < DIM; row++)
+      points(row, it) = xyz[row];
+    points(DIM, it) = 1;
+  }
+
+  std::string file = "TestPointCloudCache.bin";
+  PointCloudCache::write(file, 42, points, shift, datum, 5.0, false);
+  PointCloudCache cache;
+  EXPECT_FALSE(cache.read(file, 43));
+  ASSERT_TRUE(cache.read(file, 42));
+  EXPECT_EQ(num_points, cache.num_points());
+  EXPECT_NEAR(5.0, cache.median_longitude(), 1e-12);
+
+  // Pick the points with longitude in [2.5, 6.5]
+  DoubleMatrix data;
+  vw::Vector3 loaded_shift;
+  cache.load(vw::BBox2(2.5, -1, 4, 2), num_points, loaded_shift, data);
+  EXPECT_VECTOR_NEAR(shift, loaded_shift, 1e-6);
+  ASSERT_EQ(4, data.cols());
+  for (int col = 0; col < data.cols(); col++) {
+    for (int row = 0; row < DIM; row++)
+      EXPECT_NEAR(points(row, col + 3), data(row, col), 1e-6);
+    EXPECT_EQ(1, data(DIM, col));
+  }
+
+  // Subsample all the points
+  cache.load(vw::BBox2(), 3, loaded_shift, data);
+  EXPECT_EQ(3, data.cols());
+
+  std::remove(file.c_str());
+}
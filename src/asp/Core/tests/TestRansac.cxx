@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/Ransac.h>
+#include <vw/Math/Geometry.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Points related by a translation, with every fourth one an outlier
+  void make_points(int num, std::vector<Vector3> & p1, std::vector<Vector3> & p2) {
+    p1.clear();
+    p2.clear();
+    for (int it = 0; it < num; it++) {
+      Vector3 P(3.0 * it, 7.0 * (it % 13), 1);
+      Vector3 Q = P + Vector3(5, -2, 0);
+      if (it % 4 == 3)
+        Q += Vector3(100 + it, 50, 0);
+      p1.push_back(P);
+      p2.push_back(Q);
+    }
+  }
+}
+
+TEST(Ransac, FindsTranslationWithOutliers) {
+
+  std::vector<Vector3> p1, p2;
+  make_points(200, p1, p2);
+
+  typedef ParallelRansac<math::TranslationFittingFunctor, math::InterestPointErrorMetric>
+    RansacT;
+  RansacT ransac(math::TranslationFittingFunctor(), math::InterestPointErrorMetric(),
+                 1000, 1.0, 100);
+  Matrix<double> T = ransac(p1, p2);
+  EXPECT_NEAR(5.0,  T(0, 2), 1e-8);
+  EXPECT_NEAR(-2.0, T(1, 2), 1e-8);
+  EXPECT_EQ(150u, ransac.inlier_indices(T, p1, p2).size());
+
+  // With most matches inliers, far fewer iterations than allowed are needed
+  EXPECT_LT(ransac.num_iterations_done(), 1000);
+
+  // Ranking the inliers first gives the same model
+  std::vector<size_t> order;
+  for (size_t it = 0; it < p1.size(); it++)
+    if (it % 4 != 3) order.push_back(it);
+  for (size_t it = 0; it < p1.size(); it++)
+    if (it % 4 == 3) order.push_back(it);
+  ransac.set_sample_order(order);
+  Matrix<double> T2 = ransac(p1, p2);
+  EXPECT_NEAR(5.0,  T2(0, 2), 1e-8);
+  EXPECT_NEAR(-2.0, T2(1, 2), 1e-8);
+
+  // Same with local optimization
+  ransac.set_local_optimization(true);
+  Matrix<double> T3 = ransac(p1, p2);
+  EXPECT_NEAR(5.0,  T3(0, 2), 1e-8);
+  EXPECT_NEAR(-2.0, T3(1, 2), 1e-8);
+  EXPECT_EQ(150u, ransac.num_inliers(T3, p1, p2));
+}
+
+TEST(Ransac, FailsWithTooFewInliers) {
+
+  std::vector<Vector3> p1, p2;
+  make_points(40, p1, p2);
+
+  ParallelRansac<math::TranslationFittingFunctor, math::InterestPointErrorMetric>
+    ransac(math::TranslationFittingFunctor(), math::InterestPointErrorMetric(),
+           100, 1.0, 35);
+  EXPECT_THROW(ransac(p1, p2), math::RANSACErr);
+
+  // Unless the minimum number of inliers can be reduced
+  ParallelRansac<math::TranslationFittingFunctor, math::InterestPointErrorMetric>
+    ransac2(math::TranslationFittingFunctor(), math::InterestPointErrorMetric(),
+            100, 1.0, 35, true);
+  Matrix<double> T = ransac2(p1, p2);
+  EXPECT_NEAR(5.0, T(0, 2), 1e-8);
+}
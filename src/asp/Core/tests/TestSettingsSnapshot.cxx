@@ -0,0 +1,106 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/SettingsSnapshot.h>
+
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+
+TEST(SettingsSnapshot, RoundTrip) {
+
+  SettingsSnapshot snap;
+  snap.input_files.push_back("left.tif");
+  snap.input_files.push_back("right.tif");
+  snap.input_files.push_back("left.xml");
+  snap.input_files.push_back("right.xml");
+  snap.stereo_default_filename = "./stereo.default";
+  snap.stereo_default_time = 1234567;
+  snap.in_file1  = "left.tif";
+  snap.in_file2  = "right.tif";
+  snap.cam_file1 = "left.xml";
+  snap.cam_file2 = "right.xml";
+  std::vector<std::string> tokens;
+  tokens.push_back("affineepipolar");
+  snap.config_options.push_back(std::make_pair("alignment-method", tokens));
+  tokens.clear();
+  tokens.push_back("3");
+  tokens.push_back("3");
+  snap.config_options.push_back(std::make_pair("corr-kernel", tokens));
+  snap.left_size  = Vector2i(1000, 2000);
+  snap.right_size = Vector2i(1100, 2100);
+  snap.left_channels  = 1;
+  snap.right_channels = 1;
+  snap.has_georef1 = true;
+  snap.proj4_str1  = "+proj=longlat +datum=WGS84";
+  snap.left_cam_type = "rpc";
+  snap.L_size = Vector2i(990, 1980);
+  snap.has_R_cropped = true;
+
+  UnlinkName file("settings.bin");
+  write_settings_snapshot(file, snap);
+
+  SettingsSnapshot out;
+  ASSERT_TRUE(read_settings_snapshot(file, out));
+  EXPECT_FALSE(out.valid);
+  EXPECT_EQ(snap.input_files, out.input_files);
+  EXPECT_EQ(snap.stereo_default_filename, out.stereo_default_filename);
+  EXPECT_EQ(snap.stereo_default_time, out.stereo_default_time);
+  EXPECT_EQ("right.xml", out.cam_file2);
+  EXPECT_EQ("", out.input_dem);
+  ASSERT_EQ(2u, out.config_options.size());
+  EXPECT_EQ("corr-kernel", out.config_options[1].first);
+  EXPECT_EQ(tokens, out.config_options[1].second);
+  EXPECT_VECTOR_EQ(snap.left_size,  out.left_size);
+  EXPECT_VECTOR_EQ(snap.right_size, out.right_size);
+  EXPECT_EQ(1, out.right_channels);
+  EXPECT_TRUE(out.has_georef1);
+  EXPECT_FALSE(out.has_georef2);
+  EXPECT_EQ(snap.proj4_str1, out.proj4_str1);
+  EXPECT_EQ("rpc", out.left_cam_type);
+  EXPECT_VECTOR_EQ(snap.L_size, out.L_size);
+  EXPECT_FALSE(out.has_L_cropped);
+  EXPECT_TRUE(out.has_R_cropped);
+}
+
+TEST(SettingsSnapshot, RejectsBadFiles) {
+
+  SettingsSnapshot snap;
+  EXPECT_FALSE(read_settings_snapshot("no-such-settings.bin", snap));
+
+  UnlinkName file("bad-settings.bin");
+  {
+    std::ofstream os(file.c_str());
+    os << "stereo.default contents, not a snapshot";
+  }
+  EXPECT_FALSE(read_settings_snapshot(file, snap));
+
+  // A truncated snapshot
+  SettingsSnapshot in;
+  in.input_files.push_back("left.tif");
+  write_settings_snapshot(file, in);
+  std::ifstream is(file.c_str(), std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+  is.close();
+  {
+    std::ofstream os(file.c_str(), std::ios::binary);
+    os.write(bytes.data(), bytes.size() / 2);
+  }
+  EXPECT_FALSE(read_settings_snapshot(file, snap));
+}
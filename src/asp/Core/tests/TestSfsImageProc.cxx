@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/SfsImageProc.h>
+#include <vw/Image/Algorithms.h>
+
+using namespace asp;
+using namespace vw;
+
+TEST(SfsImageProc, CoarseGridTransfer) {
+
+  // Restriction with full weighting keeps linear functions, away from
+  // the edges, where the neighbors are clamped
+  int cols = 11, rows = 9;
+  ImageView<double> fine(cols, rows), coarse(6, 5);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      fine(col, row) = 3.0 * col - 2.0 * row + 1.0;
+  restrictToCoarseGrid(fine, coarse);
+  for (int row = 1; row < coarse.rows() - 1; row++)
+    for (int col = 1; col < coarse.cols() - 1; col++)
+      EXPECT_NEAR(fine(2 * col, 2 * row), coarse(col, row), 1e-12);
+
+  // A constant is kept everywhere
+  fill(fine, 5.0);
+  restrictToCoarseGrid(fine, coarse);
+  for (int row = 0; row < coarse.rows(); row++)
+    for (int col = 0; col < coarse.cols(); col++)
+      EXPECT_NEAR(5.0, coarse(col, row), 1e-12);
+
+  // The correction is interpolated bilinearly in the interior, and the
+  // boundary is not changed
+  for (int row = 0; row < coarse.rows(); row++)
+    for (int col = 0; col < coarse.cols(); col++)
+      coarse(col, row) = col + 10.0 * row;
+  fill(fine, 0.0);
+  addCoarseGridCorrection(coarse, fine);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      bool boundary = (col == 0 || row == 0 || col == cols - 1 || row == rows - 1);
+      double expected = boundary ? 0.0 : (col / 2.0 + 10.0 * row / 2.0);
+      EXPECT_NEAR(expected, fine(col, row), 1e-12);
+    }
+  }
+}
+
+TEST(SfsImageProc, DistanceToNonzero) {
+
+  // Compare with brute force, including rows and columns with no sites
+  int cols = 23, rows = 17;
+  double max_dist = 9.5;
+  ImageView<unsigned char> sites(cols, rows);
+  fill(sites, 0);
+  sites(3, 4) = 1;
+  sites(15, 2) = 1;
+  sites(12, 13) = 1;
+  sites(13, 13) = 1;
+  ImageView<float> dist;
+  distanceToNonzero(sites, max_dist, dist);
+  ASSERT_EQ(cols, dist.cols());
+  ASSERT_EQ(rows, dist.rows());
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double expected = max_dist;
+      for (int r = 0; r < rows; r++)
+        for (int c = 0; c < cols; c++)
+          if (sites(c, r) != 0)
+            expected = std::min(expected, std::sqrt(double(c - col) * (c - col) +
+                                                    double(r - row) * (r - row)));
+      EXPECT_NEAR(expected, dist(col, row), 1e-5);
+    }
+  }
+
+  // No sites at all
+  fill(sites, 0);
+  distanceToNonzero(sites, max_dist, dist);
+  EXPECT_NEAR(max_dist, dist(5, 5), 1e-5);
+}
@@ -0,0 +1,67 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/ShmBlockCache.h>
+#include <asp/Core/IpCache.h>
+
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/ImageView.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+
+// Reading through the cache gives the same pixels as reading the image,
+// the first time, when the blocks are read from the image, and the
+// second time, when they are mapped from shared memory
+TEST(ShmBlockCache, ReadThrough) {
+
+  std::string root = asp::shm_block_cache_root();
+  if (root == "")
+    return; // no /dev/shm
+
+  ImageView<float> img(700, 600);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = col + 0.5 * row;
+
+  std::string file = "shm_block_cache_test.tif";
+  vw::GdalWriteOptions opt;
+  cartography::GeoReference georef;
+  bool has_georef = false, has_nodata = false;
+  double nodata = 0;
+  vw::cartography::write_gdal_image(file, img, has_georef, georef, has_nodata, nodata, opt,
+                                    ProgressCallback::dummy_instance());
+
+  for (int pass = 0; pass < 2; pass++) {
+    boost::shared_ptr<DiskImageResource> rsrc(asp::open_with_shm_cache(file, true));
+    EXPECT_EQ(512, rsrc->block_read_size()[0]);
+    ImageView<float> out = crop(DiskImageView<float>(rsrc), BBox2i(100, 450, 500, 150));
+    for (int row = 0; row < out.rows(); row++)
+      for (int col = 0; col < out.cols(); col++)
+        EXPECT_EQ(img(col + 100, row + 450), out(col, row));
+  }
+
+  std::string abs_path = boost::filesystem::absolute(file).string();
+  char hash[32];
+  snprintf(hash, sizeof(hash), "%016llx",
+           (unsigned long long)asp::fnv1a_hash(abs_path.data(), abs_path.size()));
+  EXPECT_TRUE(boost::filesystem::exists(root + "/" + hash + "/0_0"));
+  boost::filesystem::remove_all(root + "/" + hash);
+  boost::filesystem::remove(file);
+}
@@ -191,3 +191,44 @@ TEST_F( SoftwareRenderTest, ExtremelyLargeTriangle ) {
 }
 
 #endif
+
+// The binned renderer must give exactly the same result as the plain one
+TEST( BinnedSoftwareRenderer, SameAsSoftwareRenderer ) {
+
+  const int width = 100, height = 130;
+  ImageView<float> buffer(width, height), binned_buffer(width, height);
+  stereo::SoftwareRenderer renderer(width, height, &buffer(0,0));
+  int num_threads = 4, band_height = 7;
+  stereo::BinnedSoftwareRenderer binned_renderer(width, height, &binned_buffer(0,0),
+                                                 num_threads, band_height);
+
+  std::vector<float> vertices(6), colors(3);
+  renderer.Ortho2D(0, 10, 0, 13);
+  renderer.SetVertexPointer(2, &vertices[0]);
+  renderer.SetColorPointer(1, &colors[0]);
+  renderer.Clear(-1.0);
+  binned_renderer.Ortho2D(0, 10, 0, 13);
+  binned_renderer.SetVertexPointer(2, &vertices[0]);
+  binned_renderer.SetColorPointer(1, &colors[0]);
+  binned_renderer.Clear(-1.0);
+
+  // Overlapping triangles of both orientations, some partially outside
+  srand(0);
+  for (int it = 0; it < 500; it++) {
+    for (size_t v = 0; v < vertices.size(); v += 2) {
+      vertices[v]   = -1.0 + 12.0 * rand()/double(RAND_MAX);
+      vertices[v+1] = -1.0 + 15.0 * rand()/double(RAND_MAX);
+    }
+    for (size_t c = 0; c < colors.size(); c++)
+      colors[c] = rand()/double(RAND_MAX);
+    renderer.DrawPolygon(0, 3);
+    binned_renderer.DrawPolygon(0, 3);
+  }
+  binned_renderer.Finish();
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      EXPECT_EQ(buffer(col, row), binned_buffer(col, row)) << col << "," << row;
+    }
+  }
+}
@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/SubpixelKernels.h>
+
+#include <cstdlib>
+#include <vector>
+
+using namespace asp;
+
+// Each supported instruction set must agree with the plain loop, including
+// for windows whose width is not a multiple of the vector length.
+TEST(SubpixelKernels, WindowSad) {
+
+  int stride = 64, rows = 40;
+  std::vector<float> left(stride * rows), right(stride * rows);
+  srand(0);
+  for (size_t it = 0; it < left.size(); it++) {
+    left [it] = double(rand()) / RAND_MAX;
+    right[it] = double(rand()) / RAND_MAX;
+  }
+
+  int widths[] = {1, 5, 8, 13, 16, 21, 35};
+  for (int width: widths) {
+    float expected = window_sad(&left[3], stride, &right[7], stride,
+                                width, 21, SIMD_NONE);
+    for (int level = SIMD_NEON; level <= SIMD_AVX512; level++) {
+      if (!simd_level_supported(SimdLevel(level)))
+        continue;
+      float result = window_sad(&left[3], stride, &right[7], stride,
+                                width, 21, SimdLevel(level));
+      EXPECT_NEAR(expected, result, 1e-4 * expected);
+    }
+  }
+}
+
+TEST(SubpixelKernels, ParabolaMinimum) {
+
+  // Sample a quadratic with a known minimum
+  double x0 = 0.3, y0 = -0.2;
+  float costs[9];
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      double dx = x - x0, dy = y - y0;
+      costs[3*(y+1) + x+1] = 2.0*dx*dx + 3.0*dy*dy + 0.5*dx*dy + 1.0;
+    }
+  }
+
+  float sx = 0, sy = 0;
+  EXPECT_TRUE(parabola_minimum(costs, sx, sy));
+  EXPECT_NEAR(x0, sx, 1e-5);
+  EXPECT_NEAR(y0, sy, 1e-5);
+
+  // A maximum is rejected
+  for (int it = 0; it < 9; it++)
+    costs[it] = -costs[it];
+  EXPECT_FALSE(parabola_minimum(costs, sx, sy));
+}
@@ -0,0 +1,142 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/MemoryProfile.h>
+#include <asp/Core/Telemetry.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace asp;
+
+TEST(Telemetry, CounterFromManyThreads) {
+
+  TelemetryCounter & counter = telemetry().counter("test.counter");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++)
+    threads.push_back(std::thread([&counter]() {
+          for (int it = 0; it < 1000; it++)
+            counter.add();
+        }));
+  for (auto & t: threads)
+    t.join();
+  EXPECT_EQ(8000, counter.value());
+
+  // The same name gives the same counter
+  EXPECT_EQ(&counter, &telemetry().counter("test.counter"));
+}
+
+TEST(Telemetry, Histogram) {
+
+  TelemetryHistogram hist;
+  hist.add(0.0);
+  hist.add(3.0);  // in [2, 4)
+  hist.add(3.5);
+  hist.add(1e30); // goes to the last bucket
+  EXPECT_EQ(4, hist.count());
+  EXPECT_EQ(0.0, hist.min());
+  EXPECT_EQ(1e30, hist.max());
+  EXPECT_NEAR(6.5 + 1e30, hist.sum(), 1e15);
+
+  EXPECT_EQ(1, hist.bucket_count(0));
+  int b = 1 - TelemetryHistogram::MIN_EXP;
+  EXPECT_EQ(2.0, TelemetryHistogram::bucket_lower(b));
+  EXPECT_EQ(2, hist.bucket_count(b));
+  EXPECT_EQ(1, hist.bucket_count(TelemetryHistogram::NUM_BUCKETS - 1));
+}
+
+TEST(Telemetry, Summary) {
+
+  {
+    TelemetryTimer timer("test.stage");
+    EXPECT_GE(timer.elapsed_seconds(), 0.0);
+  }
+  TelemetryTimer timer("test.stage");
+  timer.stop();
+  double elapsed = timer.elapsed_seconds();
+  timer.stop(); // does nothing
+  EXPECT_EQ(elapsed, timer.elapsed_seconds());
+
+  telemetry().histogram("test.hist").add(0.25);
+  telemetry().set_value("test.value", 3.0);
+  telemetry().set_value("test.value", 2.5);
+
+  std::string file = "telemetry_test.json";
+  telemetry().write_summary(file);
+  std::ifstream ifs(file.c_str());
+  std::stringstream buf;
+  buf << ifs.rdbuf();
+  std::string text = buf.str();
+  EXPECT_NE(std::string::npos, text.find("\"test.stage\": {\"count\": 2"));
+  EXPECT_NE(std::string::npos, text.find("\"peak_rss_mb\""));
+  EXPECT_NE(std::string::npos, text.find("\"buckets\": [[0.25, 1]]"));
+  EXPECT_NE(std::string::npos, text.find("\"test.value\": 2.5"));
+
+  boost::filesystem::remove(file);
+}
+
+TEST(Telemetry, Gauge) {
+
+  TelemetryGauge & gauge = telemetry().gauge("test.gauge");
+  {
+    TelemetryGaugeScope a(gauge), b(gauge);
+    a.set(100);
+    b.set(50);
+    a.set(30);
+    EXPECT_EQ(80, gauge.current());
+    EXPECT_EQ(150, gauge.peak());
+  }
+  EXPECT_EQ(0, gauge.current());
+  EXPECT_EQ(150, gauge.peak());
+}
+
+TEST(Telemetry, MemoryProfile) {
+
+  setenv("ASP_MEMORY_PROFILE", "1", 1);
+  EXPECT_TRUE(memory_profile_enabled());
+  EXPECT_GT(current_rss_mb(), 0.0);
+
+  // A stage which allocates and touches 64 MB is seen to use at least that
+  {
+    TelemetryTimer timer("test.memory_stage");
+    std::vector<char> buf(64 * 1024 * 1024, 1);
+    timer.stop();
+    EXPECT_EQ(1, buf[buf.size() / 2]);
+  }
+  std::map<std::string, double> peaks = stage_peak_rss_mb();
+  ASSERT_TRUE(peaks.find("test.memory_stage") != peaks.end());
+  EXPECT_GE(peaks["test.memory_stage"], 64.0);
+  EXPECT_GE(sampled_peak_rss_mb(), 64.0);
+
+  telemetry().gauge("test.structure").add(2 * 1024 * 1024);
+  std::string file = "memory_report_test.txt";
+  telemetry().write_memory_report(file);
+  std::ifstream ifs(file.c_str());
+  std::stringstream buf;
+  buf << ifs.rdbuf();
+  std::string text = buf.str();
+  EXPECT_NE(std::string::npos, text.find("test.memory_stage"));
+  EXPECT_NE(std::string::npos, text.find("test.structure"));
+
+  boost::filesystem::remove(file);
+  unsetenv("ASP_MEMORY_PROFILE");
+}
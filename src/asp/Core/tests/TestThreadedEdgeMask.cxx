@@ -24,6 +24,7 @@
 #include <asp/Core/ThreadedEdgeMask.h>
 
 #include <algorithm>
+#include <cstdlib>
 #include <vector>
 
 using namespace vw;
@@ -54,3 +55,24 @@ TEST( ThreadedEdgeMask, active_area ) {
   output = threaded_edge_mask(input,0);
   EXPECT_EQ( input, output );
 }
+
+// The edges found from many small blocks must agree with those from one
+// block, including for rows and columns split among several blocks.
+TEST( ThreadedEdgeMask, many_blocks ) {
+  ImageView<uint8> input(17,15);
+  fill(input,0);
+  for (int row = 0; row < input.rows(); row++) {
+    for (int col = 0; col < input.cols(); col++) {
+      if (std::abs(col - 8) + std::abs(row - 7) <= 5)
+        input(col, row) = 255;
+    }
+  }
+
+  EXPECT_EQ( BBox2i(3,2,11,11),
+             threaded_edge_mask(input,0,0,4).active_area() );
+  EXPECT_EQ( threaded_edge_mask(input,0,0,64).active_area(),
+             threaded_edge_mask(input,0,0,4).active_area() );
+
+  ImageView<uint8> output = threaded_edge_mask(input,0,0,4);
+  EXPECT_EQ( input, output );
+}
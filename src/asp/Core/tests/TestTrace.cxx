@@ -0,0 +1,54 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/Trace.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace asp;
+
+TEST(Trace, WritesEvents) {
+
+  // Events can be recorded directly even if tracing is not enabled
+  double start = trace_now_us();
+  trace_event("test_tile", "task", start, 5.0, vw::BBox2i(10, 20, 30, 40));
+  std::thread t([]() {
+      trace_event("test_read", "read", trace_now_us(), 1.0, vw::BBox2i());
+    });
+  t.join();
+
+  std::string file = "trace_test.json";
+  write_trace(file);
+  std::ifstream ifs(file.c_str());
+  std::stringstream buf;
+  buf << ifs.rdbuf();
+  std::string text = buf.str();
+  EXPECT_NE(std::string::npos, text.find("\"traceEvents\""));
+  EXPECT_NE(std::string::npos, text.find("\"name\": \"test_tile\", \"cat\": \"task\""));
+  EXPECT_NE(std::string::npos, text.find("\"x\": 10, \"y\": 20, \"width\": 30, \"height\": 40"));
+  EXPECT_NE(std::string::npos, text.find("\"name\": \"test_read\", \"cat\": \"read\""));
+  // Two threads, each with its name
+  EXPECT_NE(std::string::npos, text.find("\"thread 1\""));
+  EXPECT_NE(std::string::npos, text.find("\"thread 2\""));
+
+  boost::filesystem::remove(file);
+}
@@ -0,0 +1,69 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/Core/TrackStore.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+
+#include <cstdio>
+
+using namespace asp;
+using namespace vw::ba;
+
+TEST(TrackStore, RoundTrip) {
+
+  // Three points seen by some of three cameras
+  int num_cameras = 3;
+  ControlNetwork cnet("test");
+  for (int ipt = 0; ipt < 3; ipt++) {
+    ControlPoint cp(ControlPoint::TiePoint);
+    cp.set_position(vw::Vector3(ipt, 2.0 * ipt, 1e6 + ipt));
+    for (int icam = ipt % 2; icam < num_cameras; icam++)
+      cp.add_measure(ControlMeasure(10 * ipt + icam, 0.5 + icam, 1, 2, icam));
+    cnet.add_control_point(cp);
+  }
+
+  TrackStore tracks;
+  tracks.from_cnet(cnet, num_cameras);
+  EXPECT_EQ(3, tracks.num_points());
+  EXPECT_EQ(8u, tracks.num_observations());
+
+  // Camera 0 sees points 0 and 2, in this order
+  ASSERT_EQ(2u, tracks.cam_end(0) - tracks.cam_begin(0));
+  EXPECT_EQ(0, tracks.point_index(tracks.cam_begin(0)));
+  EXPECT_EQ(2, tracks.point_index(tracks.cam_begin(0) + 1));
+  EXPECT_VECTOR_NEAR(vw::Vector2(20, 0.5), tracks.pixel(tracks.cam_begin(0) + 1), 1e-6);
+  EXPECT_VECTOR_NEAR(vw::Vector2(1, 2), tracks.sigma(tracks.cam_begin(0)), 1e-6);
+
+  std::string file = "TestTrackStore.bin";
+  tracks.write(file, 42);
+  TrackStore loaded;
+  EXPECT_FALSE(loaded.read(file, 43));
+  ASSERT_TRUE(loaded.read(file, 42));
+
+  ControlNetwork cnet2("loaded");
+  loaded.to_cnet(cnet2);
+  ASSERT_EQ(cnet.size(), cnet2.size());
+  for (size_t ipt = 0; ipt < cnet.size(); ipt++) {
+    EXPECT_VECTOR_NEAR(cnet[ipt].position(), cnet2[ipt].position(), 1e-10);
+    ASSERT_EQ(cnet[ipt].size(), cnet2[ipt].size());
+    for (size_t m = 0; m < cnet[ipt].size(); m++) {
+      EXPECT_EQ(cnet[ipt][m].image_id(), cnet2[ipt][m].image_id());
+      EXPECT_VECTOR_NEAR(cnet[ipt][m].position(), cnet2[ipt][m].position(), 1e-6);
+    }
+  }
+  std::remove(file.c_str());
+}
@@ -0,0 +1,62 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/MaskViews.h>
+#include <asp/Core/ValidBlockMask.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST(ValidBlockMask, AccumulatedSameAsView) {
+
+  // Blocks with texture, constant blocks, and blocks with no valid data
+  int cols = 50, rows = 37, block_size = 8;
+  ImageView<PixelGray<float>> image(cols, rows);
+  ImageView<uint8> mask(cols, rows);
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++) {
+      image(col, row) = (col < 20) ? float(col * row % 7) : 3.0f;
+      mask(col, row)  = (row < 30) ? 255 : 0;
+    }
+  }
+
+  ImageView<uint8> expected = ValidBlockMaskView(image, mask, block_size);
+
+  // Write the mask in tiles not aligned with the blocks
+  ValidBlockAccumulator accum(cols, rows, block_size);
+  MaskWithValidBlocksView mask_view(copy_mask(image, create_mask(mask)), accum);
+  ImageView<uint8> out_mask(cols, rows);
+  for (int col = 0; col < cols; col += 13) {
+    for (int row = 0; row < rows; row += 11) {
+      BBox2i tile(col, row, 13, 11);
+      tile.crop(bounding_box(image));
+      crop(out_mask, tile) = crop(mask_view, tile);
+    }
+  }
+
+  EXPECT_EQ(mask, out_mask);
+  ImageView<uint8> found = accum.mask();
+  ASSERT_EQ(expected.cols(), found.cols());
+  ASSERT_EQ(expected.rows(), found.rows());
+  EXPECT_EQ(expected, found);
+  EXPECT_EQ(255, found(0, 0));
+  EXPECT_EQ(0,   found(5, 0));
+  EXPECT_EQ(0,   found(0, 4));
+}
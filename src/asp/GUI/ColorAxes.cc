@@ -181,25 +181,14 @@ void calcLowResMinMax(imageData const& image, double nodata_val,
   
   // TODO(oalexan1): How about removing a small percentile of intensity from ends?
 
-  // Get the lowest-resolution image version from the pyramid
+  // Use the lowest-resolution image version from the pyramid
   bool poly_or_xyz = (image.m_isPoly || image.m_isCsv);
   if (poly_or_xyz) // will not get here
     vw_throw(ArgumentErr() << "Expecting an image, not scattered points.\n");
   
-  ImageView<double> lowres_img = image.img.m_img_ch1_double.pyramid().back();
-  min_val = std::numeric_limits<double>::max();
-  max_val = -min_val;
-  for (int col = 0; col < lowres_img.cols(); col++) {
-    for (int row = 0; row < lowres_img.rows(); row++) {
-      
-      double val = lowres_img(col, row);
-      if (val == nodata_val) 
-        continue;
-      
-      min_val = std::min(min_val, val);
-      max_val = std::max(max_val, val);
-    }
-  }
+  // These were found when the pyramid was built
+  min_val = image.img.m_lowres_bounds[0];
+  max_val = image.img.m_lowres_bounds[1];
 
   if (min_val > max_val) {
     // If the image turned out to be empty
@@ -16,10 +16,21 @@
 // __END_LICENSE__
 
 #include <asp/GUI/DiskImagePyramidMultiChannel.h>
+#include <asp/GUI/TileServer.h>
 #include <asp/Core/StereoSettings.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Image/Manipulation.h>
 #include <QtWidgets>
 
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -38,16 +49,95 @@ TemporaryFiles& temporary_files() {
   temporary_files_once.run( init_temporary_files);
   return *temporary_files_ptr;
 }
+
+// Images may be read on several threads, so guard adding to the
+// list of temporary files
+std::mutex temporary_files_mutex;
+template<class ContainerT>
+void add_temporary_files(ContainerT const& files) {
+  std::lock_guard<std::mutex> lock(temporary_files_mutex);
+  temporary_files().files.insert(files.begin(), files.end());
+}
+  
+// The 64-bit FNV-1a hash of a string. Unlike std::hash, this is the same
+// for every build, which matters for a cache shared among users.
+std::uint64_t fnv1a_hash(std::string const& str) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (size_t it = 0; it < str.size(); it++) {
+    hash ^= static_cast<unsigned char>(str[it]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// With --pyramid-cache-dir, the pyramid of an image is built in a
+// subdirectory of the cache named by a hash of the image path, size, and
+// modification time. That subdirectory has a link to the image, which is
+// what the pyramid is built from, so the pyramid files end up next to it.
+// Return the path to the link.
+std::string cached_pyramid_source(std::string const& image_file,
+                                  std::string const& cache_dir) {
+  namespace fs = boost::filesystem;
+  
+  fs::path image_path = fs::canonical(image_file);
+  std::ostringstream key;
+  key << image_path.string() << ' ' << fs::file_size(image_path) << ' '
+      << fs::last_write_time(image_path);
+  std::ostringstream hash;
+  hash << std::hex << std::setw(16) << std::setfill('0') << fnv1a_hash(key.str());
+  
+  fs::path dir = fs::path(cache_dir) / hash.str();
+  fs::create_directories(dir);
+  fs::path link = dir / image_path.filename();
+  if (!fs::exists(fs::symlink_status(link))) {
+    // Another process may be creating the same link, so ignore failure
+    boost::system::error_code ec;
+    fs::create_symlink(image_path, link, ec);
+  }
+  if (!fs::exists(link))
+    vw_throw(IOErr() << "Could not create: " << link.string() << "\n");
   
+  return link.string();
+}
+
+// Hold a lock on a file in given directory, if not empty, so that only
+// one process at a time builds the pyramid there.
+class PyramidCacheLock {
+public:
+  PyramidCacheLock(std::string const& dir) {
+    if (dir.empty())
+      return;
+    std::string lock_file = dir + "/lock";
+    std::ofstream(lock_file.c_str(), std::ios::app); // the lock file must exist
+    m_lock.reset(new boost::interprocess::file_lock(lock_file.c_str()));
+    m_lock->lock();
+  }
+  ~PyramidCacheLock() {
+    if (m_lock)
+      m_lock->unlock();
+  }
+private:
+  boost::shared_ptr<boost::interprocess::file_lock> m_lock;
+};
+
 DiskImagePyramidMultiChannel::
 DiskImagePyramidMultiChannel(std::string const& image_file,
  vw::GdalWriteOptions const& opt,
                              int top_image_max_pix, int subsample):
-  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT) {
+  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT),
+  m_lowres_bounds(std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()),
+  m_remote_nodata_val(std::numeric_limits<double>::quiet_NaN()) {
   
   if (image_file == "")
     return;
 
+  // The pyramid of a remote image is on the tile server
+  if (isTileServerUrl(image_file)) {
+    m_remote_url = image_file;
+    fetchRemoteImageInfo(m_remote_url, m_cols, m_rows, m_num_channels, m_remote_nodata_val);
+    return;
+  }
+
   // alias
   int & lowres_size = asp::stereo_settings().lowest_resolution_subimage_num_pixels;
   if (lowres_size <= 0) // bug fix, longer term need to improve the workflow
@@ -57,6 +147,18 @@ DiskImagePyramidMultiChannel(std::string const& image_file,
     = vw::DiskImageResourcePtr(image_file);
   ImageFormat image_fmt = image_rsrc->format();
 
+  // The file the pyramid is built from. With a shared cache, the pyramid
+  // files are not temporary, as other sessions will use them.
+  std::string pyramid_file = image_file;
+  std::string cache_subdir;
+  bool use_cache = !asp::stereo_settings().pyramid_cache_dir.empty();
+  if (use_cache) {
+    pyramid_file = cached_pyramid_source(image_file,
+                                         asp::stereo_settings().pyramid_cache_dir);
+    cache_subdir = boost::filesystem::path(pyramid_file).parent_path().string();
+  }
+  PyramidCacheLock cache_lock(cache_subdir);
+
   // Redirect to the correctly typed function to perform the actual map projection.
   // - Must correspond to the type of the input image.
   // Instantiate the correct DiskImagePyramid then record information including
@@ -74,42 +176,55 @@ DiskImagePyramidMultiChannel(std::string const& image_file,
       // Single channel image with float pixels.
 
       m_img_ch1_double =
-        vw::mosaic::DiskImagePyramid<double>(image_file, m_opt, lowres_size);
+        vw::mosaic::DiskImagePyramid<double>(pyramid_file, m_opt, lowres_size);
       m_rows = m_img_ch1_double.rows();
       m_cols = m_img_ch1_double.cols();
       m_type = CH1_DOUBLE;
-      temporary_files().files.insert(m_img_ch1_double.get_temporary_files().begin(), 
-                                     m_img_ch1_double.get_temporary_files().end());
+      if (!use_cache)
+        add_temporary_files(m_img_ch1_double.get_temporary_files());
+
+      // The lowest-resolution level is small, and is read here anyway
+      double nodata_val = m_img_ch1_double.get_nodata_val();
+      ImageView<double> lowres_img = m_img_ch1_double.pyramid().back();
+      for (int row = 0; row < lowres_img.rows(); row++) {
+        for (int col = 0; col < lowres_img.cols(); col++) {
+          double val = lowres_img(col, row);
+          if (val == nodata_val || val != val)
+            continue;
+          m_lowres_bounds[0] = std::min(m_lowres_bounds[0], val);
+          m_lowres_bounds[1] = std::max(m_lowres_bounds[1], val);
+        }
+      }
     }else if (m_num_channels == 2) {
       // uint8 image with an alpha channel.
       m_img_ch2_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 2>>
-        (image_file, m_opt, lowres_size);
+        (pyramid_file, m_opt, lowres_size);
       m_num_channels = 2; // we read only 1 channel
       m_rows = m_img_ch2_uint8.rows();
       m_cols = m_img_ch2_uint8.cols();
       m_type = CH2_UINT8;
-      temporary_files().files.insert(m_img_ch2_uint8.get_temporary_files().begin(), 
-                                     m_img_ch2_uint8.get_temporary_files().end());
+      if (!use_cache)
+        add_temporary_files(m_img_ch2_uint8.get_temporary_files());
     } else if (m_num_channels == 3) {
       // RGB image with three uint8 channels.
       m_img_ch3_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 3>>
-        (image_file, m_opt, lowres_size);
+        (pyramid_file, m_opt, lowres_size);
       m_num_channels = 3;
       m_rows = m_img_ch3_uint8.rows();
       m_cols = m_img_ch3_uint8.cols();
       m_type = CH3_UINT8;
-      temporary_files().files.insert(m_img_ch3_uint8.get_temporary_files().begin(), 
-                                     m_img_ch3_uint8.get_temporary_files().end());
+      if (!use_cache)
+        add_temporary_files(m_img_ch3_uint8.get_temporary_files());
     } else if (m_num_channels == 4) {
       // RGB image with three uint8 channels and an alpha channel
       m_img_ch4_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 4>>
-        (image_file, m_opt, lowres_size);
+        (pyramid_file, m_opt, lowres_size);
       m_num_channels = 4;
       m_rows = m_img_ch4_uint8.rows();
       m_cols = m_img_ch4_uint8.cols();
       m_type = CH4_UINT8;
-      temporary_files().files.insert(m_img_ch4_uint8.get_temporary_files().begin(), 
-                                     m_img_ch4_uint8.get_temporary_files().end());
+      if (!use_cache)
+        add_temporary_files(m_img_ch4_uint8.get_temporary_files());
     }else{
       vw_throw(ArgumentErr() << "Unsupported image with " << m_num_channels
                << " bands.\n");
@@ -122,6 +237,9 @@ DiskImagePyramidMultiChannel(std::string const& image_file,
 }
 
 double DiskImagePyramidMultiChannel::get_nodata_val() const {
+
+  if (is_remote())
+    return m_remote_nodata_val;
   
   // Extract the clip, then convert it from VW format to QImage format.
   if (m_type == CH1_DOUBLE) {
@@ -141,6 +259,12 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
                   bool highlight_nodata,
                   QImage & qimg, double & scale_out, vw::BBox2i & region_out) const{
 
+  if (is_remote()) {
+    fetchRemoteImageClip(m_remote_url, scale_in, region_in, highlight_nodata,
+                         qimg, scale_out, region_out);
+    return;
+  }
+
   bool scale_pixels = (m_type == CH1_DOUBLE);
   vw::Vector2 approx_bounds;
 
@@ -227,6 +351,70 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
   }
 }
 
+void DiskImagePyramidMultiChannel::get_hillshade_clip(double scale_in, vw::BBox2i region_in,
+                                                      double azimuth, double elevation,
+                                                      vw::Vector2 const& pixel_size,
+                                                      QImage & qimg, double & scale_out,
+                                                      vw::BBox2i & region_out) const {
+  if (m_type != CH1_DOUBLE)
+    vw_throw(ArgumentErr() << "Hill-shading makes sense only for single-channel images.\n");
+
+  // Only the pixels being shown are read, from the pyramid level
+  // at this scale, so the hillshade is cheap to recompute.
+  ImageView<double> dem;
+  m_img_ch1_double.get_image_clip(scale_in, region_in, dem, scale_out, region_out);
+  double nodata_val = m_img_ch1_double.get_nodata_val();
+
+  // The pixel size at this level
+  double dx = pixel_size[0] * scale_out, dy = pixel_size[1] * scale_out;
+
+  // The direction towards the light, in the East-North-Up frame
+  double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+  vw::Vector3 light(sin(a) * cos(e), cos(a) * cos(e), sin(e));
+
+  int cols = dem.cols(), rows = dem.rows();
+  qimg = QImage(cols, rows, QImage::Format_ARGB32_Premultiplied);
+  uchar * bits = qimg.bits();
+  int bytes_per_line = qimg.bytesPerLine();
+#pragma omp parallel for
+  for (int row = 0; row < rows; row++) {
+    QRgb * line = qimage_row(bits, bytes_per_line, row);
+    for (int col = 0; col < cols; col++) {
+
+      double h = dem(col, row);
+      if (h == nodata_val || h != h) {
+        line[col] = qRgba(0, 0, 0, 0); // transparent
+        continue;
+      }
+
+      // Central differences, or one-sided ones at the clip boundary
+      // and next to no-data. The rows go South.
+      int c0 = col, c1 = col, r0 = row, r1 = row;
+      if (col > 0 && dem(col - 1, row) != nodata_val && dem(col - 1, row) == dem(col - 1, row))
+        c0 = col - 1;
+      if (col < cols - 1 && dem(col + 1, row) != nodata_val &&
+          dem(col + 1, row) == dem(col + 1, row))
+        c1 = col + 1;
+      if (row > 0 && dem(col, row - 1) != nodata_val && dem(col, row - 1) == dem(col, row - 1))
+        r0 = row - 1;
+      if (row < rows - 1 && dem(col, row + 1) != nodata_val &&
+          dem(col, row + 1) == dem(col, row + 1))
+        r1 = row + 1;
+
+      double dh_de = 0.0, dh_dn = 0.0;
+      if (c1 > c0)
+        dh_de = (dem(c1, row) - dem(c0, row)) / ((c1 - c0) * dx);
+      if (r1 > r0)
+        dh_dn = -(dem(col, r1) - dem(col, r0)) / ((r1 - r0) * dy);
+
+      vw::Vector3 normal(-dh_de, -dh_dn, 1.0);
+      double v = std::max(0.0, dot_prod(normal, light) / norm_2(normal));
+      int g = round(255.0 * std::min(v, 1.0));
+      line[col] = qRgba(g, g, g, 255);
+    }
+  }
+}
+
 std::string DiskImagePyramidMultiChannel::get_value_as_str(int32 x, int32 y) const {
 
   // Below we cast from Vector<uint8> to Vector<double>, as the former
@@ -258,4 +446,42 @@ double DiskImagePyramidMultiChannel::get_value_as_double(int32 x, int32 y) const
   return 0;
 }
 
+void DiskImagePyramidMultiChannel::get_values_as_double(std::vector<vw::Vector2i> const& pixels,
+                                                        std::vector<double> & vals) const {
+  if (m_type != CH1_DOUBLE && m_type != CH2_UINT8)
+    vw_throw(ArgumentErr() << "Unsupported image with " << m_num_channels << " bands\n");
+  
+  vals.resize(pixels.size());
+  
+  // Group the pixels by the block they fall in
+  int block_size = 256;
+  std::map<std::pair<int, int>, std::vector<size_t>> blocks;
+  for (size_t it = 0; it < pixels.size(); it++)
+    blocks[std::make_pair(pixels[it].x() / block_size,
+                          pixels[it].y() / block_size)].push_back(it);
+
+  // Read only the extent of the pixels in each block
+  for (auto const& block: blocks) {
+    std::vector<size_t> const& indices = block.second;
+    BBox2i box;
+    for (size_t it = 0; it < indices.size(); it++)
+      box.grow(pixels[indices[it]]);
+    box.max() += Vector2i(1, 1); // because box.max() is exclusive
+    
+    if (m_type == CH1_DOUBLE) {
+      ImageView<double> clip = crop(m_img_ch1_double.bottom(), box);
+      for (size_t it = 0; it < indices.size(); it++) {
+        Vector2i pix = pixels[indices[it]] - box.min();
+        vals[indices[it]] = clip(pix.x(), pix.y());
+      }
+    } else {
+      ImageView<Vector<vw::uint8, 2>> clip = crop(m_img_ch2_uint8.bottom(), box);
+      for (size_t it = 0; it < indices.size(); it++) {
+        Vector2i pix = pixels[indices[it]] - box.min();
+        vals[indices[it]] = clip(pix.x(), pix.y())[0];
+      }
+    }
+  }
+}
+
 }} // namespace vw::gui
@@ -67,6 +67,17 @@ namespace vw { namespace gui {
   // and handle the nodata val. For two channel images, interpret the
   // second channel as mask. If there are 3 or more channels,
   // interpret those as RGB.
+  //
+  // The clip is traversed row by row, as it is stored, and the pixels
+  // are written straight into the QImage buffer, rather than with
+  // QImage::setPixel(), which does a format lookup and a detach check
+  // per pixel and is not meant to be called from several threads.
+  
+  // The first pixel of a row in the QImage buffer. The buffer must have been
+  // detached before, with qimg.bits().
+  inline QRgb * qimage_row(uchar * bits, int bytes_per_line, int row) {
+    return reinterpret_cast<QRgb*>(bits + static_cast<size_t>(row) * bytes_per_line);
+  }
   
   template<class PixelT>
   typename boost::enable_if<boost::is_same<PixelT,double>, void>::type
@@ -78,8 +89,8 @@ namespace vw { namespace gui {
     double max_val = -std::numeric_limits<double>::max();
     if (scale_pixels) {
       // No multi-threading here since we modify shared values
-      for (int col = 0; col < clip.cols(); col++){
-        for (int row = 0; row < clip.rows(); row++){
+      for (int row = 0; row < clip.rows(); row++){
+        for (int col = 0; col < clip.cols(); col++){
           if (clip(col, row) == nodata_val) continue;
           if (clip(col, row) < min_val) min_val = clip(col, row);
           if (clip(col, row) > max_val) max_val = clip(col, row);
@@ -99,32 +110,30 @@ namespace vw { namespace gui {
       if (min_val >= max_val)
         max_val = min_val + 1.0;
     }
+    double factor = 255.0/(max_val - min_val);
 
+    // Nodata is either transparent or highlighted in red
+    QRgb nodata_color = highlight_nodata ? qRgb(255, 0, 0) : qRgba(0, 0, 0, 0);
+    
     qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    uchar * bits = qimg.bits();
+    int bytes_per_line = qimg.bytesPerLine();
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
+    for (int row = 0; row < clip.rows(); row++){
+      QRgb * line = qimage_row(bits, bytes_per_line, row);
+      for (int col = 0; col < clip.cols(); col++){
 
         double v = clip(col, row);
+        if (v == nodata_val || std::isnan(v)) {
+          line[col] = nodata_color;
+          continue;
+        }
+        
         if (scale_pixels) 
-          v = round(255*(std::max(v, min_val) - min_val)/(max_val-min_val));
+          v = round(factor*(std::max(v, min_val) - min_val));
      
-        v = std::min(std::max(0.0, v), 255.0);
-      
-        if (clip(col, row) == nodata_val || std::isnan(clip(col, row)) ){
-        
-          if (!highlight_nodata){
-            // transparent
-            qimg.setPixel(col, row, Qt::transparent);
-          }else{
-            // highlight in red
-            qimg.setPixel(col, row, qRgb(255, 0, 0));
-          }
-        
-        }else{
-          // opaque
-          qimg.setPixel(col, row, QColor(v, v, v, 255).rgba());
-        }
+        int g = std::min(std::max(0.0, v), 255.0);
+        line[col] = qRgba(g, g, g, 255); // opaque
       }
     }
   }
@@ -136,16 +145,19 @@ namespace vw { namespace gui {
              ImageView<PixelT> const& clip, QImage & qimg){
 
     qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    uchar * bits = qimg.bits();
+    int bytes_per_line = qimg.bytesPerLine();
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
+    for (int row = 0; row < clip.rows(); row++){
+      QRgb * line = qimage_row(bits, bytes_per_line, row);
+      for (int col = 0; col < clip.cols(); col++){
         Vector<vw::uint8, 2> v = clip(col, row);
         if ( v[1] > 0 && v == v){ // need the latter for NaN
           // opaque grayscale
-          qimg.setPixel(col, row, QColor(v[0], v[0], v[0], 255).rgba());
+          line[col] = qRgba(v[0], v[0], v[0], 255);
         }else{
           // transparent
-          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
+          line[col] = qRgba(0, 0, 0, 0);
         }
       }
     }
@@ -159,18 +171,21 @@ namespace vw { namespace gui {
              ImageView<PixelT> const& clip, QImage & qimg){
 
     qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    uchar * bits = qimg.bits();
+    int bytes_per_line = qimg.bytesPerLine();
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
+    for (int row = 0; row < clip.rows(); row++){
+      QRgb * line = qimage_row(bits, bytes_per_line, row);
+      for (int col = 0; col < clip.cols(); col++){
         PixelT v = clip(col, row);
         if (v != v) // NaN, set to transparent
-          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
+          line[col] = qRgba(0, 0, 0, 0);
         else if (v.size() == 3) // color
-          qimg.setPixel(col, row, QColor(v[0], v[1], v[2], 255).rgba());
+          line[col] = qRgba(v[0], v[1], v[2], 255);
         else if (v.size() > 3) // color or transparent
-          qimg.setPixel(col, row, QColor(v[0], v[1], v[2], 255*(v[3] > 0)).rgba());
+          line[col] = (v[3] > 0) ? qRgba(v[0], v[1], v[2], 255) : qRgba(0, 0, 0, 0);
         else // grayscale 
-          qimg.setPixel(col, row, QColor(v[0], v[0], v[0], 255).rgba());
+          line[col] = qRgba(v[0], v[0], v[0], 255);
       }
     }
   }
@@ -191,6 +206,17 @@ namespace vw { namespace gui {
     int m_rows, m_cols;
     ImgType m_type; // keeps track of which of the above images we use
 
+    // For a single-channel image, the range of the valid values at the
+    // lowest-resolution level, found once when the pyramid is built, so
+    // that the colorbar does not need to read that level again. The min
+    // is bigger than the max if there are no valid values.
+    vw::Vector2 m_lowres_bounds;
+
+    // For an image on a tile server, its URL and nodata value. Then
+    // none of the pyramids above is used.
+    std::string m_remote_url;
+    double m_remote_nodata_val;
+
     // Constructor
     DiskImagePyramidMultiChannel(std::string const& image_file = "",
                                  vw::GdalWriteOptions const&
@@ -203,8 +229,21 @@ namespace vw { namespace gui {
     void get_image_clip(double scale_in, vw::BBox2i region_in, bool highlight_nodata,
                         QImage & qimg, double & scale_out,
                         vw::BBox2i & region_out) const;
+
+    // Hillshade a clip of a single-channel image, which is a DEM, at
+    // the pyramid level for the given scale. The DEM pixel size in
+    // meters is at full resolution. The azimuth is measured clockwise
+    // from North and the elevation from the horizon, in degrees.
+    void get_hillshade_clip(double scale_in, vw::BBox2i region_in,
+                            double azimuth, double elevation,
+                            vw::Vector2 const& pixel_size,
+                            QImage & qimg, double & scale_out,
+                            vw::BBox2i & region_out) const;
     double get_nodata_val() const;
     
+    // If the image is on a tile server. Then only get_image_clip() works.
+    bool is_remote() const { return !m_remote_url.empty(); }
+    
     int32 cols  () const { return m_cols;  }
     int32 rows  () const { return m_rows;  }
     int32 planes() const { return m_num_channels; }
@@ -213,6 +252,13 @@ namespace vw { namespace gui {
     /// - Only works for single channel pyramids!
     double get_value_as_double( int32 x, int32 y) const;
 
+    /// Return the elements at several pixels (at the lowest level) cast to
+    /// double. The pixels are grouped by block and each block is read
+    /// once, which is much faster than reading them one at a time.
+    /// - Only works for single channel pyramids!
+    void get_values_as_double(std::vector<vw::Vector2i> const& pixels,
+                              std::vector<double> & vals) const;
+
     // Return value as string
     std::string get_value_as_str( int32 x, int32 y) const;
   };
@@ -104,20 +104,20 @@ namespace vw { namespace gui {
   /// A class to keep all data associated with an image file
   class imageData{
   public:
-    std::string      name, hillshaded_name, thresholded_name, colorized_name;
+    std::string      name, thresholded_name, colorized_name;
     vw::GdalWriteOptions m_opt;
     bool             has_georef;
     vw::cartography::GeoReference georef;
     vw::BBox2        image_bbox;
     vw::Vector2      val_range;
-    bool             loaded_regular, loaded_hillshaded,
-      loaded_thresholded, loaded_colorized; // if the image was loaded
+    bool             loaded_regular, loaded_thresholded,
+      loaded_colorized; // if the image was loaded
     // There are several display modes. The one being shown is
     // determined by m_display_mode. Store the corresponding
-    // image in one of the structures below
+    // image in one of the structures below. The hillshaded
+    // image is found on the fly from img.
     DisplayMode m_display_mode;
     DiskImagePyramidMultiChannel img;
-    DiskImagePyramidMultiChannel hillshaded_img;
     DiskImagePyramidMultiChannel thresholded_img;
     DiskImagePyramidMultiChannel colorized_img;
     
@@ -132,8 +132,8 @@ namespace vw { namespace gui {
     std::vector<vw::Vector3> scattered_data;
     
     imageData(): m_display_mode(REGULAR_VIEW), has_georef(false),
-                 loaded_regular(false), loaded_hillshaded(false),
-                 loaded_thresholded(false), loaded_colorized(false),
+                 loaded_regular(false), loaded_thresholded(false),
+                 loaded_colorized(false),
                  m_isPoly(false), m_isCsv(false), colorbar(false) {}
     
     /// Read an image from disk into img and set the other variables.
@@ -163,12 +163,10 @@ private:
   /// Convert a BBox2 object to a QRect object.
   QRect bbox2qrect(BBox2 const& B);
 
-  /// Save a hillshaded file
-  bool write_hillshade(vw::GdalWriteOptions const& opt,
-                       bool have_gui,
-                       double azimuth, double elevation,
-                       std::string const& input_file,
-                       std::string      & output_file);
+  /// The size of a DEM pixel in meters, for hillshading. For a
+  /// georeference in degrees, this is found at the image center.
+  vw::Vector2 dem_pixel_size(vw::cartography::GeoReference const& georef,
+                             vw::BBox2 const& image_bbox);
 
   // Given an image, and an input file name, modify the filename using
   // a prefix. Write the image to that filename. If that fails, create
@@ -660,6 +660,12 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
 
       if (m_images[image_iter].m_isPoly || m_images[image_iter].m_isCsv)
         continue;
+
+      if (m_images[image_iter].img.is_remote()) {
+        popUp("Thresholding is not supported for images on a tile server.");
+        m_images[image_iter].m_display_mode = REGULAR_VIEW;
+        return;
+      }
       
       double nodata_val = -std::numeric_limits<double>::max();
       vw::read_nodata_val(input_file, nodata_val);
@@ -706,8 +712,9 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
 
     int num_images = m_images.size();
 
-    // Create the hillshaded images and save them to disk. We have to do
-    // it each time as perhaps the hillshade parameters changed.
+    // Check which images can be hillshaded. The hillshade itself is
+    // found when drawing, from the pyramid level being shown, so changing
+    // the azimuth and elevation needs only a redraw.
     for (int image_iter = m_beg_image_id; image_iter < m_end_image_id; image_iter++) {
 
       if (m_images[image_iter].m_display_mode != HILLSHADED_VIEW)
@@ -730,7 +737,6 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
         return;
       }
 
-      std::string input_file = m_images[image_iter].name;
       int num_channels = m_images[image_iter].img.planes();
       if (num_channels != 1) {
         // Turn off hillshade mode for all images which don't support it,
@@ -748,23 +754,6 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
         popUp("Hill-shading makes sense only for single-channel images.");
         continue;
       }
-
-      // Save the hillshaded images to disk (unless it already exists)
-      std::string hillshaded_file;
-      bool have_gui = true;
-      bool success = write_hillshade(m_opt,
-                                     have_gui,
-                                     m_hillshade_azimuth,
-                                     m_hillshade_elevation,
-                                     input_file, hillshaded_file);
-
-      if (!success) {
-        m_images[image_iter].m_display_mode = REGULAR_VIEW;
-        return;
-      }
-
-      m_images[image_iter].read(hillshaded_file, m_opt, HILLSHADED_VIEW);
-      temporary_files().files.insert(hillshaded_file);
     }
   }
 
@@ -1017,13 +1006,25 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
     //Stopwatch sw1;
     //sw1.start();
 
-    // Draw the images in the desired order
+    // What is needed to draw an image clip
+    struct ClipToDraw {
+      int image_index;
+      BBox2i screen_box;
+      BBox2 image_box;
+      double scale;
+      bool highlight_nodata;
+      Vector2 pixel_size; // for hillshading
+      QImage qimg;
+      double scale_out;
+      BBox2i region_out;
+    };
+    
+    // First find which portion of each image is seen. Images with no
+    // clip to fetch get an entry too, so that the drawing order is kept.
+    std::vector<ClipToDraw> clips;
     for (int j = m_beg_image_id; j < m_end_image_id; j++) {
       int i = m_filesOrder[j]; // image index
 
-      //Stopwatch sw2;
-      //sw2.start();
-
       // Don't show files the user wants hidden
       if (m_chooseFiles && m_chooseFiles->isHidden(m_images[i].name))
         continue;
@@ -1041,8 +1042,22 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
       if (curr_world_box.empty())
         continue;
 
+      if (m_images[i].m_isPoly)
+        continue; // those will be always drawn on top of images, to be done later
+      
+      ClipToDraw c;
+      c.image_index = i;
+      c.scale = 1.0;
+      c.highlight_nodata = false;
+      c.scale_out = 1.0; // will be modified by get_image_clip()
+      
+      if (m_images[i].m_isCsv) {
+        clips.push_back(c); // there is no image, only the data will be drawn
+        continue;
+      }
+      
       // See where it fits on the screen
-      BBox2i screen_box;
+      BBox2i & screen_box = c.screen_box;
       screen_box.grow(floor(world2screen(curr_world_box.min())));
       screen_box.grow(ceil(world2screen(curr_world_box.max())));
 
@@ -1053,63 +1068,87 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
         screen_box.max().y() = screen_box.min().y() + 1;
 
       // Go from world coordinates to pixels in the second image.
-      BBox2 image_box = MainWidget::world2image(curr_world_box, i);
+      BBox2 & image_box = c.image_box;
+      image_box = MainWidget::world2image(curr_world_box, i);
 
       // Grow a bit to integer, as otherwise we get strange results
       // if zooming too close.
       image_box.min() = floor(image_box.min());
       image_box.max() = ceil(image_box.max());
 
-      if (m_images[i].m_isPoly)
-        continue; // those will be always drawn on top of images, to be done later
-      
-      if (m_images[i].m_isCsv) {
-        MainWidget::drawScatteredData(paint, i);
-        continue; // there is no image, so no point going on
-      }
-
-      QImage qimg;
       // Since the image portion contained in image_box could be huge,
       // but the screen area small, render a sub-sampled version of
       // the image for speed.
       // Convert to double before multiplication, to avoid overflow
       // when multiplying large integers.
-      double scale = sqrt((1.0*image_box.width()) * image_box.height())/
+      c.scale = sqrt((1.0*image_box.width()) * image_box.height())/
         std::max(1.0, sqrt((1.0*screen_box.width()) * screen_box.height()));
       // Increase the scale a little. This will make the image a little blurrier
       // but will be faster to render. One can always zoom in more for detail.
       // Same logic is used in ColorAxes.cc
-      scale *= 1.3;
-      double scale_out = 1.0; // will be modified by get_image_clip()
-      BBox2i region_out;
-      bool highlight_nodata = (m_images[i].m_display_mode == THRESHOLDED_VIEW);
+      c.scale *= 1.3;
+      if (m_images[i].m_display_mode == HILLSHADED_VIEW)
+        c.pixel_size = dem_pixel_size(m_images[i].georef, m_images[i].image_bbox);
+      c.highlight_nodata = (m_images[i].m_display_mode == THRESHOLDED_VIEW);
       if (!std::isnan(asp::stereo_settings().nodata_value)) {
         // When the user specifies --nodata-value, we will show
         // nodata pixels as transparent.
-        highlight_nodata = false;
+        c.highlight_nodata = false;
       }
       
-      //sw2.stop();
-      //vw_out() << "Render time 2 (seconds): " << sw2.elapsed_seconds() << std::endl;
-
-      //Stopwatch sw3;
-      //sw3.start();
-      if (m_images[i].m_display_mode == THRESHOLDED_VIEW) {
-        m_images[i].thresholded_img.get_image_clip(scale, image_box,
-                                                   highlight_nodata,
-                                                   qimg, scale_out, region_out);
-      }else if (m_images[i].m_display_mode == HILLSHADED_VIEW){
-        m_images[i].hillshaded_img.get_image_clip(scale, image_box,
-                                                  highlight_nodata,
-                                                  qimg, scale_out, region_out);
-      }else{
-        // Original images
-        m_images[i].img.get_image_clip(scale, image_box,
-                                       highlight_nodata,
-                                       qimg, scale_out, region_out);
+      clips.push_back(c);
+    }
+
+    // Fetch the clips. Each image has its own pyramid on disk, so with
+    // many overlaid images these are read in parallel rather than one
+    // after another. Only the painting below must happen in this thread.
+    int num_clips = clips.size();
+    std::vector<std::string> clip_errors(num_clips);
+#pragma omp parallel for schedule(dynamic) if (num_clips > 1)
+    for (int k = 0; k < num_clips; k++) {
+      ClipToDraw & c = clips[k];
+      int i = c.image_index;
+      if (m_images[i].m_isCsv)
+        continue;
+      try {
+        if (m_images[i].m_display_mode == THRESHOLDED_VIEW) {
+          m_images[i].thresholded_img.get_image_clip(c.scale, c.image_box,
+                                                     c.highlight_nodata,
+                                                     c.qimg, c.scale_out, c.region_out);
+        }else if (m_images[i].m_display_mode == HILLSHADED_VIEW){
+          m_images[i].img.get_hillshade_clip(c.scale, c.image_box,
+                                             m_hillshade_azimuth, m_hillshade_elevation,
+                                             c.pixel_size,
+                                             c.qimg, c.scale_out, c.region_out);
+        }else{
+          // Original images
+          m_images[i].img.get_image_clip(c.scale, c.image_box,
+                                         c.highlight_nodata,
+                                         c.qimg, c.scale_out, c.region_out);
+        }
+      } catch (std::exception const& e) {
+        // Exceptions must not leave a thread
+        clip_errors[k] = e.what();
       }
-      //sw3.stop();
-      //vw_out() << "Render time 3 (seconds): " << sw3.elapsed_seconds() << std::endl;
+    }
+    for (int k = 0; k < num_clips; k++) {
+      if (!clip_errors[k].empty())
+        vw_throw(ArgumentErr() << clip_errors[k]);
+    }
+    
+    // Draw the images in the desired order
+    for (int k = 0; k < num_clips; k++) {
+      int i = clips[k].image_index;
+
+      if (m_images[i].m_isCsv) {
+        MainWidget::drawScatteredData(paint, i);
+        continue; // there is no image, so no point going on
+      }
+
+      BBox2i const& screen_box = clips[k].screen_box;
+      QImage const& qimg       = clips[k].qimg;
+      double scale_out         = clips[k].scale_out;
+      BBox2i const& region_out = clips[k].region_out;
 
       // Draw on image screen
       if (!m_use_georef) {
@@ -1134,11 +1173,9 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
                               QImage::Format_ARGB32_Premultiplied);
 
         // Initialize all pixels to transparent
-        for (int col = 0; col < qimg2.width(); col++) {
-          for (int row = 0; row < qimg2.height(); row++) {
-            qimg2.setPixel(col, row,  QColor(0, 0, 0, 0).rgba());
-          }
-        }
+        qimg2.fill(Qt::transparent);
+        uchar * bits2 = qimg2.bits();
+        int bytes_per_line2 = qimg2.bytesPerLine();
         //sw5.stop();
         //vw_out() << "Render time 5 (seconds): " << sw5.elapsed_seconds() << std::endl;
         //Stopwatch sw6;
@@ -1177,9 +1214,9 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
               vw_out() << "Book-keeping failure!";
               vw_throw(ArgumentErr() << "Book-keeping failure.\n");
             }
-            qimg2.setPixel(x-screen_box.min().x(), // Fill the temp QImage object
-                           y-screen_box.min().y(),
-                           qimg.pixel(px, py));
+            // Fill the temp QImage object
+            qimage_row(bits2, bytes_per_line2, y - screen_box.min().y())
+              [x - screen_box.min().x()] = qimg.pixel(px, py);
           }
         } // End loop through pixels
 
@@ -1258,12 +1295,46 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
       }
     }
 
-    // Iterate over interest points
+    // Find the points on screen. The ones which are highlighted are
+    // drawn last, so they are on top.
+    std::vector<Vector2> screen_pts(ip_vec.size());
+    std::vector<size_t> highlighted;
+    std::vector<Vector2> highlighted_pts;
+    Vector2 nan_pt(std::numeric_limits<double>::quiet_NaN(),
+                   std::numeric_limits<double>::quiet_NaN());
     for (size_t ip_iter = 0; ip_iter < ip_vec.size(); ip_iter++) {
       // Generate the pixel coord of the point
-      Vector2 pt    = ip_vec[ip_iter];
-      Vector2 world = MainWidget::image2world(pt, m_base_image_id);
-      Vector2 P     = world2screen(world);
+      Vector2 world = MainWidget::image2world(ip_vec[ip_iter], m_base_image_id);
+      screen_pts[ip_iter] = world2screen(world);
+
+      if (asp::stereo_settings().view_matches &&
+          (!m_matchlist.isPointValid(m_beg_image_id, ip_iter) ||
+           (highlight_last && (ip_iter == m_matchlist.getNumPoints(m_beg_image_id)-1)) ||
+           static_cast<int>(ip_iter) == m_editMatchPointVecIndex)) {
+        highlighted.push_back(ip_iter);
+        highlighted_pts.push_back(screen_pts[ip_iter]);
+        screen_pts[ip_iter] = nan_pt; // such points are not decimated
+      }
+    }
+
+    // With very many points, draw at most one per point size on screen.
+    // Points that are outside the viewing area are not drawn.
+    int ip_radius = 2;
+    BBox2 screen_box(0, 0, m_window_width, m_window_height);
+    std::vector<size_t> to_draw = decimateScreenPoints(screen_pts, screen_box, ip_radius);
+    
+    paint->setPen(ipColor); // The default IP color
+    paint->setBrush(ipColor); // make the point filled
+    for (size_t it = 0; it < to_draw.size(); it++) {
+      Vector2 const& P = screen_pts[to_draw[it]];
+      QPoint Q(P.x(), P.y());
+      paint->drawEllipse(Q, ip_radius, ip_radius); // Draw the point
+    }
+    
+    // Draw the highlighted points
+    for (size_t it = 0; it < highlighted.size(); it++) {
+      size_t ip_iter = highlighted[it];
+      Vector2 const& P = highlighted_pts[it];
 
       // Do not draw points that are outside the viewing area
       if (P.x() < 0 || P.x() > m_window_width ||
@@ -1271,30 +1342,20 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
         continue;
       }
       
-      paint->setPen(ipColor); // The default IP color
-      paint->setBrush(ipColor); // make the point filled
-
-      if (asp::stereo_settings().view_matches) {
-        // Some special handling for when we add matches
-        if (!m_matchlist.isPointValid(m_beg_image_id, ip_iter)) {
-          paint->setPen(ipInvalidColor);
-          paint->setBrush(ipInvalidColor);
-        }
-        
-        // Highlighting the last point
-        if (highlight_last && (ip_iter == m_matchlist.getNumPoints(m_beg_image_id)-1)) {
-          paint->setPen(ipAddHighlightColor);
-          paint->setBrush(ipAddHighlightColor);
-        }
-        
-        if (static_cast<int>(ip_iter) == m_editMatchPointVecIndex) {
-          paint->setPen(ipMoveHighlightColor);
-          paint->setBrush(ipMoveHighlightColor);
-        }
-      }
+      // Some special handling for when we add matches
+      QColor color = ipInvalidColor;
       
+      // Highlighting the last point
+      if (highlight_last && (ip_iter == m_matchlist.getNumPoints(m_beg_image_id)-1))
+        color = ipAddHighlightColor;
+        
+      if (static_cast<int>(ip_iter) == m_editMatchPointVecIndex)
+        color = ipMoveHighlightColor;
+
+      paint->setPen(color);
+      paint->setBrush(color);
       QPoint Q(P.x(), P.y());
-      paint->drawEllipse(Q, 2, 2); // Draw the point
+      paint->drawEllipse(Q, ip_radius, ip_radius); // Draw the point
 
     } // End loop through points
   } // End function drawInterestPoints
@@ -1321,12 +1382,25 @@ BBox2 MainWidget::expand_box_to_keep_aspect_ratio(BBox2 const& box) {
       vw::cm::parse_color_style(m_images[image_index].colormap, lut_map);
     }
     vw::cm::Colormap colormap(lut_map);
-      
-    for (size_t pt_it = 0; pt_it < m_images[image_index].scattered_data.size(); pt_it++) {
-      auto const& P = m_images[image_index].scattered_data[pt_it];
 
-      vw::Vector2 world_P = projpoint2world(subvector(P, 0, 2), image_index);
-      Vector2 screen_P = world2screen(world_P);
+    // Find the points on screen
+    auto const& scattered_data = m_images[image_index].scattered_data; // alias
+    std::vector<Vector2> screen_pts(scattered_data.size());
+    for (size_t pt_it = 0; pt_it < scattered_data.size(); pt_it++) {
+      vw::Vector2 world_P = projpoint2world(subvector(scattered_data[pt_it], 0, 2),
+                                            image_index);
+      screen_pts[pt_it] = world2screen(world_P);
+    }
+
+    // Skip the points which are not seen, and with very many points
+    // draw at most one per point size on screen.
+    BBox2 screen_box(0, 0, m_window_width, m_window_height);
+    screen_box.expand(r);
+    std::vector<size_t> to_draw = decimateScreenPoints(screen_pts, screen_box, r);
+    
+    for (size_t it = 0; it < to_draw.size(); it++) {
+      auto const& P = scattered_data[to_draw[it]];
+      Vector2 const& screen_P = screen_pts[to_draw[it]];
       QPoint Q(screen_P.x(), screen_P.y());
 
       // Scale the intensity to [0, 1]
@@ -1648,7 +1722,9 @@ void MainWidget::paintEvent(QPaintEvent * /* event */) {
     double nodata_val = images[imgInd].img.get_nodata_val();
     
     m_valsX.clear(); m_valsY.clear();
-    int count = 0;
+    
+    // The pixels along the profile. They will be read all at once.
+    std::vector<Vector2i> pixels;
     
     int num_pts = profileX.size();
     for (int pt_iter = 0; pt_iter < num_pts; pt_iter++) {
@@ -1680,18 +1756,19 @@ void MainWidget::paintEvent(QPaintEvent * /* event */) {
         if (!is_in)
           continue;
 
-        double pixel_val = images[imgInd].img.get_value_as_double(x, y);
-
-        // TODO: Deal with this NAN
-        if (pixel_val == nodata_val)
-          pixel_val = std::numeric_limits<double>::quiet_NaN();
-        m_valsX.push_back(count);
-        m_valsY.push_back(pixel_val);
-        count++;
+        pixels.push_back(Vector2i(x, y));
       }
 
     }
 
+    images[imgInd].img.get_values_as_double(pixels, m_valsY);
+    for (size_t count = 0; count < m_valsY.size(); count++) {
+      // TODO: Deal with this NAN
+      if (m_valsY[count] == nodata_val)
+        m_valsY[count] = std::numeric_limits<double>::quiet_NaN();
+      m_valsX.push_back(count);
+    }
+
     if (num_pts == 1) {
       // Just one point, really
       m_valsX.resize(1);
@@ -2571,11 +2648,18 @@ void MainWidget::paintEvent(QPaintEvent * /* event */) {
         signedArea = signedPolyArea(pSize, xv + start, yv + start, counter_cc);
       }
 
-      QPolygon pa(pSize);
+      // When zoomed out, many consecutive vertices land on the same
+      // screen pixel. Keep only one of them, so that the cost of drawing
+      // the edges is bounded by the screen size rather than by the number
+      // of vertices. The vertices themselves, if shown, are drawn as before.
+      QPolygon pa;
+      pa.reserve(pSize);
       for (int vIter = 0; vIter < pSize; vIter++){
 
         Vector2 P = world2screen(Vector2(xv[start + vIter], yv[start + vIter]));
-        pa[vIter] = QPoint(P.x(), P.y());
+        QPoint Q(P.x(), P.y());
+        if (pa.empty() || pa.back() != Q)
+          pa << Q;
 
         // Qt's built in points are too small. Instead of drawing a point
         // draw a small shape.
@@ -2617,15 +2701,11 @@ void MainWidget::paintEvent(QPaintEvent * /* event */) {
             paint.drawPolygon(pa);
           } else {
             // In some versions of Qt, drawPolygon is buggy when not
-            // called to fill polygons. Don't use it, just draw the
-            // edges one by one.
-            int n = pa.size();
-            for (int k = 0; k < n; k++){
-              QPolygon pb;
-              int x0, y0; pa.point(k, &x0, &y0);       pb << QPoint(x0, y0);
-              int x1, y1; pa.point((k+1)%n, &x1, &y1); pb << QPoint(x1, y1);
-              paint.drawPolyline(pb);
-            }
+            // called to fill polygons. Don't use it, rather draw the
+            // edges as a polyline going back to the first vertex.
+            QPolygon pb = pa;
+            pb << pa[0];
+            paint.drawPolyline(pb);
           }
         } else {
           paint.drawPolyline(pa); // don't join the last vertex to the first
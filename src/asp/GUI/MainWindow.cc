@@ -26,8 +26,10 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/Nvm.h>
 #include <asp/GUI/chooseFilesDlg.h>
+#include <asp/GUI/TileServer.h>
 #include <asp/GUI/ColorAxes.h>
 #include <asp/Core/GCP.h>
+#include <asp/Core/MatchFile.h>
 
 using namespace asp;
 using namespace vw::gui;
@@ -50,6 +52,9 @@ namespace fs = boost::filesystem;
 // See MainWidget.h for what this id does
 int BASE_IMAGE_ID = 0;
 
+// How many images to read at the same time on startup
+const int MAX_PARALLEL_IMAGE_READS = 4;
+
 namespace asp {
 
 // TODO(oalexan1): Move to utils
@@ -285,10 +290,11 @@ MainWindow::MainWindow(vw::GdalWriteOptions const& opt,
       is_image = false;
     }
     
-    // Accept shape files and csv files alongside images
+    // Accept shape files, csv files, and images on a tile server
     if (!is_image &&
         !asp::has_shp_extension(local_images[i]) &&
-        !vw::gui::hasCsv(local_images[i]))
+        !vw::gui::hasCsv(local_images[i]) &&
+        !vw::gui::isTileServerUrl(local_images[i]))
       continue;
 
     m_image_files.push_back(local_images[i]);
@@ -315,13 +321,31 @@ MainWindow::MainWindow(vw::GdalWriteOptions const& opt,
   std::vector<int> propertyIndices;
   asp::lookupPropertyIndices(properties, m_image_files, propertyIndices);
 
+  // Read the images. Creating the pyramid of a large image takes a while,
+  // so several images are read at the same time, unless their loading is
+  // delayed. Each pyramid level is still written with multiple threads,
+  // so only a few images are read at once.
+  std::vector<std::string> read_errors(m_image_files.size());
+  int num_images = m_image_files.size();
+  int num_readers = std::max(1, std::min(num_images, MAX_PARALLEL_IMAGE_READS));
+#pragma omp parallel for schedule(dynamic) num_threads(num_readers) if (!delay)
+  for (int i = 0; i < num_images; i++) {
+    try {
+      m_images[i].read(m_image_files[i], m_opt, REGULAR_VIEW,
+                       properties[propertyIndices[i]],
+                       delay);
+    } catch (std::exception const& e) {
+      read_errors[i] = e.what();
+    }
+  }
+  for (size_t i = 0; i < read_errors.size(); i++) {
+    if (!read_errors[i].empty())
+      vw_throw(ArgumentErr() << read_errors[i]);
+  }
+
   // TODO(oalexan1): How will the preview mode play along with georeferences?
   bool has_georef = true;
   for (size_t i = 0; i < m_image_files.size(); i++) {
-    m_images[i].read(m_image_files[i], m_opt, REGULAR_VIEW,
-                     properties[propertyIndices[i]],
-                     delay);
-    
     // Above we read the image in regular mode. If plan to display hillshade,
     // for now set the flag for that, and the hillshaded image will be created
     // and set later. (Something more straightforward could be done.)
@@ -1293,7 +1317,7 @@ void MainWindow::viewMatches() {
 					       m_image_files[i]);
           leftIndex = i-1;
           //vw_out() << "     - Trying location " << trial_match << std::endl;
-          ip::read_binary_match_file(trial_match, left, right);
+          asp::read_match_file(trial_match, left, right);
 
         }catch(...){
           // Look in default location 2, match from first file to this file.
@@ -1302,7 +1326,7 @@ void MainWindow::viewMatches() {
 						 m_image_files[i]);
             leftIndex   = 0;
             //vw_out() << "     - Trying location " << trial_match << std::endl;
-            ip::read_binary_match_file(trial_match, left, right);
+            asp::read_match_file(trial_match, left, right);
 
           }catch(...){
             // Default locations failed, Start with a blank match file.
@@ -1504,7 +1528,7 @@ void MainWindow::viewPairwiseMatchesOrCleanMatches() {
     try {
       // Load it
       vw_out() << "Loading match file: " << match_file << std::endl;
-      ip::read_binary_match_file(match_file, left_ip, right_ip);
+      asp::read_match_file(match_file, left_ip, right_ip);
     } catch(...) {
       // Having this pop-up for a large number of images is annoying
       vw_out() << "Cannot find the match file with given images and output prefix.\n";
@@ -0,0 +1,338 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/GUI/TileServer.h>
+#include <asp/GUI/DiskImagePyramidMultiChannel.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <QBuffer>
+#include <QHostInfo>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+namespace vw { namespace gui {
+
+namespace {
+
+  // How long to wait for the other side, in milliseconds
+  const int TILE_SERVER_TIMEOUT_MS = 60000;
+
+  // Parse http://<host>:<port>/image/<i>. The port defaults to 80.
+  bool parseTileServerUrl(std::string const& url,
+                          std::string & host, int & port, int & index) {
+    std::string prefix = "http://";
+    if (url.compare(0, prefix.size(), prefix) != 0)
+      return false;
+
+    std::string rest = url.substr(prefix.size());
+    size_t slash = rest.find('/');
+    if (slash == std::string::npos)
+      return false;
+    std::string host_port = rest.substr(0, slash), path = rest.substr(slash);
+
+    size_t colon = host_port.rfind(':');
+    host = host_port.substr(0, colon);
+    port = 80;
+    if (colon != std::string::npos)
+      port = atoi(host_port.substr(colon + 1).c_str());
+    if (host.empty() || port <= 0)
+      return false;
+
+    std::string image_prefix = "/image/";
+    if (path.compare(0, image_prefix.size(), image_prefix) != 0)
+      return false;
+    std::string index_str = path.substr(image_prefix.size());
+    if (index_str.empty() ||
+        index_str.find_first_not_of("0123456789") != std::string::npos)
+      return false;
+    index = atoi(index_str.c_str());
+
+    return true;
+  }
+
+  // Do an HTTP/1.0 GET request. Return the body, and the headers with
+  // lowercase names. Throw an exception unless the status is 200. This uses
+  // the blocking socket functions, which need no event loop, so it can be
+  // called from any thread.
+  void httpGet(std::string const& host, int port, std::string const& path,
+               std::map<std::string, std::string> & headers, QByteArray & body) {
+
+    headers.clear();
+    body.clear();
+
+    QTcpSocket socket;
+    socket.connectToHost(QString::fromStdString(host), port);
+    if (!socket.waitForConnected(TILE_SERVER_TIMEOUT_MS))
+      vw_throw(IOErr() << "Cannot connect to " << host << ":" << port << ": "
+               << socket.errorString().toStdString() << "\n");
+
+    std::string request = "GET " + path + " HTTP/1.0\r\nHost: " + host + "\r\n\r\n";
+    socket.write(request.c_str(), request.size());
+    socket.waitForBytesWritten(TILE_SERVER_TIMEOUT_MS);
+
+    // With HTTP/1.0 the server closes the connection when done
+    QByteArray data;
+    while (socket.waitForReadyRead(TILE_SERVER_TIMEOUT_MS))
+      data += socket.readAll();
+    data += socket.readAll();
+
+    int header_end = data.indexOf("\r\n\r\n");
+    if (header_end < 0)
+      vw_throw(IOErr() << "Invalid response from " << host << ":" << port << path << "\n");
+    body = data.mid(header_end + 4);
+
+    std::istringstream is(data.left(header_end).toStdString());
+    std::string line, version;
+    int status = 0;
+    std::getline(is, line);
+    std::istringstream(line) >> version >> status;
+    while (std::getline(is, line)) {
+      size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        continue;
+      std::string name = QString::fromStdString(line.substr(0, colon)).toLower().toStdString();
+      std::string value = QString::fromStdString(line.substr(colon + 1)).trimmed().toStdString();
+      headers[name] = value;
+    }
+
+    if (status != 200)
+      vw_throw(IOErr() << "Request " << host << ":" << port << path << " failed with status "
+               << status << ": " << body.toStdString() << "\n");
+  }
+
+  void sendResponse(QTcpSocket & socket, std::string const& status,
+                    std::string const& content_type,
+                    std::string const& extra_headers, QByteArray const& body) {
+    std::ostringstream os;
+    os << "HTTP/1.0 " << status << "\r\n"
+       << "Content-Type: " << content_type << "\r\n"
+       << "Content-Length: " << body.size() << "\r\n"
+       << extra_headers
+       << "\r\n";
+    std::string header = os.str();
+    socket.write(header.c_str(), header.size());
+    socket.write(body);
+    socket.waitForBytesWritten(TILE_SERVER_TIMEOUT_MS);
+  }
+
+  void sendText(QTcpSocket & socket, std::string const& status, std::string const& text) {
+    sendResponse(socket, status, "text/plain", "", QByteArray(text.c_str(), text.size()));
+  }
+
+  // Answer one request
+  void serveRequest(QTcpSocket & socket, std::string const& base_url,
+                    std::vector<std::string> const& images,
+                    std::vector<DiskImagePyramidMultiChannel> const& pyramids) {
+
+    // Read the request line and the headers
+    QByteArray request;
+    while (request.indexOf("\r\n\r\n") < 0) {
+      if (!socket.waitForReadyRead(TILE_SERVER_TIMEOUT_MS) || request.size() > 65536)
+        return;
+      request += socket.readAll();
+    }
+
+    std::string method, target;
+    std::istringstream(request.toStdString()) >> method >> target;
+    if (method != "GET") {
+      sendText(socket, "405 Method Not Allowed", "Only GET is supported.\n");
+      return;
+    }
+
+    // Split the target into the path and the query parameters
+    std::string path = target, query;
+    size_t question = target.find('?');
+    if (question != std::string::npos) {
+      path  = target.substr(0, question);
+      query = target.substr(question + 1);
+    }
+    std::map<std::string, std::string> params;
+    std::istringstream qs(query);
+    std::string pair;
+    while (std::getline(qs, pair, '&')) {
+      size_t eq = pair.find('=');
+      if (eq != std::string::npos)
+        params[pair.substr(0, eq)] = pair.substr(eq + 1);
+    }
+
+    if (path == "/") {
+      std::ostringstream os;
+      for (size_t it = 0; it < images.size(); it++)
+        os << base_url << "/image/" << it << " " << images[it] << "\n";
+      sendText(socket, "200 OK", os.str());
+      return;
+    }
+
+    // Parse /image/<i>/info and /image/<i>/tile
+    int index = -1;
+    char op[16];
+    if (sscanf(path.c_str(), "/image/%d/%15s", &index, op) != 2 ||
+        index < 0 || index >= int(pyramids.size())) {
+      sendText(socket, "404 Not Found", "Not found: " + path + "\n");
+      return;
+    }
+
+    std::string action = op;
+    DiskImagePyramidMultiChannel const& img = pyramids[index];
+    if (action == "info") {
+      std::ostringstream os;
+      os.precision(17);
+      os << img.cols() << " " << img.rows() << " " << img.planes() << " "
+         << img.get_nodata_val() << "\n";
+      sendText(socket, "200 OK", os.str());
+      return;
+    }
+
+    if (action != "tile" || params["scale"].empty() || params["w"].empty() ||
+        params["h"].empty()) {
+      sendText(socket, "400 Bad Request", "Invalid request: " + target + "\n");
+      return;
+    }
+
+    try {
+      double scale_in = atof(params["scale"].c_str());
+      vw::BBox2i region_in(atoi(params["x"].c_str()), atoi(params["y"].c_str()),
+                           atoi(params["w"].c_str()), atoi(params["h"].c_str()));
+      bool highlight_nodata = (params["nodata"] == "1");
+
+      QImage qimg;
+      double scale_out = 1.0;
+      vw::BBox2i region_out;
+      img.get_image_clip(scale_in, region_in, highlight_nodata, qimg, scale_out, region_out);
+
+      // PNG is lossless and compresses well the nodata areas
+      QByteArray png;
+      QBuffer buffer(&png);
+      buffer.open(QIODevice::WriteOnly);
+      qimg.save(&buffer, "PNG");
+
+      std::ostringstream os;
+      os.precision(17);
+      os << "X-Scale-Out: " << scale_out << "\r\n"
+         << "X-Region-Out: " << region_out.min().x() << " " << region_out.min().y() << " "
+         << region_out.width() << " " << region_out.height() << "\r\n";
+      sendResponse(socket, "200 OK", "image/png", os.str(), png);
+    } catch (std::exception const& e) {
+      sendText(socket, "500 Internal Server Error", e.what());
+    }
+  }
+
+} // end anonymous namespace
+
+bool isTileServerUrl(std::string const& name) {
+  std::string host;
+  int port = 0, index = 0;
+  return parseTileServerUrl(name, host, port, index);
+}
+
+void runTileServer(std::vector<std::string> const& images, int port,
+                   vw::GdalWriteOptions const& opt) {
+
+  // Build the pyramids, or load them if they exist
+  std::vector<DiskImagePyramidMultiChannel> pyramids(images.size());
+  for (size_t it = 0; it < images.size(); it++) {
+    vw_out() << "Reading: " << images[it] << std::endl;
+    pyramids[it] = DiskImagePyramidMultiChannel(images[it], opt);
+  }
+
+  QTcpServer server;
+  if (!server.listen(QHostAddress::Any, port))
+    vw_throw(IOErr() << "Cannot listen on port " << port << ": "
+             << server.errorString().toStdString() << "\n");
+
+  std::ostringstream os;
+  os << "http://" << QHostInfo::localHostName().toStdString() << ":" << port;
+  std::string base_url = os.str();
+  for (size_t it = 0; it < images.size(); it++)
+    vw_out() << "Serving " << images[it] << " as: " << base_url << "/image/" << it << "\n";
+
+  // Answer the requests one at a time. The blocking functions are used,
+  // so no event loop is needed.
+  while (true) {
+    if (!server.waitForNewConnection(-1))
+      continue;
+    QTcpSocket * socket = server.nextPendingConnection();
+    if (socket == NULL)
+      continue;
+    serveRequest(*socket, base_url, images, pyramids);
+    socket->disconnectFromHost();
+    if (socket->state() != QAbstractSocket::UnconnectedState)
+      socket->waitForDisconnected(TILE_SERVER_TIMEOUT_MS);
+    delete socket;
+  }
+}
+
+void fetchRemoteImageInfo(std::string const& url,
+                          int & cols, int & rows, int & channels, double & nodata_val) {
+  std::string host;
+  int port = 0, index = 0;
+  if (!parseTileServerUrl(url, host, port, index))
+    vw_throw(ArgumentErr() << "Not a tile server image: " << url << "\n");
+
+  std::map<std::string, std::string> headers;
+  QByteArray body;
+  std::ostringstream path;
+  path << "/image/" << index << "/info";
+  httpGet(host, port, path.str(), headers, body);
+
+  std::istringstream is(body.toStdString());
+  std::string nodata_str;
+  if (!(is >> cols >> rows >> channels >> nodata_str))
+    vw_throw(IOErr() << "Invalid image info from: " << url << "\n");
+  // This may be nan, which operator>> does not parse
+  nodata_val = atof(nodata_str.c_str());
+}
+
+void fetchRemoteImageClip(std::string const& url,
+                          double scale_in, vw::BBox2i const& region_in,
+                          bool highlight_nodata,
+                          QImage & qimg, double & scale_out, vw::BBox2i & region_out) {
+  std::string host;
+  int port = 0, index = 0;
+  if (!parseTileServerUrl(url, host, port, index))
+    vw_throw(ArgumentErr() << "Not a tile server image: " << url << "\n");
+
+  std::ostringstream path;
+  path.precision(17);
+  path << "/image/" << index << "/tile?scale=" << scale_in
+       << "&x=" << region_in.min().x() << "&y=" << region_in.min().y()
+       << "&w=" << region_in.width()   << "&h=" << region_in.height()
+       << "&nodata=" << int(highlight_nodata);
+
+  std::map<std::string, std::string> headers;
+  QByteArray body;
+  httpGet(host, port, path.str(), headers, body);
+
+  int x = 0, y = 0, w = 0, h = 0;
+  std::istringstream region_is(headers["x-region-out"]);
+  if (!(std::istringstream(headers["x-scale-out"]) >> scale_out) ||
+      !(region_is >> x >> y >> w >> h))
+    vw_throw(IOErr() << "Missing the clip scale and region from: " << url << "\n");
+  region_out = vw::BBox2i(x, y, w, h);
+
+  if (!qimg.loadFromData(body, "PNG"))
+    vw_throw(IOErr() << "Could not decode the clip from: " << url << "\n");
+  qimg = qimg.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+}} // namespace vw::gui
@@ -0,0 +1,71 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileServer.h
+///
+/// Serve image clips rendered from image pyramids over HTTP, and fetch
+/// them. Then stereo_gui can run next to the data on a remote machine,
+/// with only the visible portions of the images, at the resolution being
+/// shown, sent to the machine where they are displayed.
+///
+/// The server answers these requests:
+///   /                    A list of the served images and their URLs
+///   /image/<i>/info      The columns, rows, channels, and nodata value
+///   /image/<i>/tile?scale=<s>&x=<x>&y=<y>&w=<w>&h=<h>&nodata=<0 or 1>
+///                        A PNG of the clip, as in
+///                        DiskImagePyramidMultiChannel::get_image_clip().
+///                        The headers X-Scale-Out and X-Region-Out have
+///                        the scale and region of the clip.
+///
+#ifndef __STEREO_GUI_TILE_SERVER_H__
+#define __STEREO_GUI_TILE_SERVER_H__
+
+#include <vw/FileIO/GdalWriteOptions.h>
+#include <vw/Math/BBox.h>
+
+#include <QImage>
+
+#include <string>
+#include <vector>
+
+namespace vw { namespace gui {
+
+  /// If this is the URL of an image on a tile server, of the form
+  /// http://<host>:<port>/image/<i>.
+  bool isTileServerUrl(std::string const& name);
+
+  /// Build the pyramids of the given images and serve them on the given
+  /// port. This does not return.
+  void runTileServer(std::vector<std::string> const& images, int port,
+                     vw::GdalWriteOptions const& opt);
+
+  /// Fetch the dimensions of an image on a tile server
+  void fetchRemoteImageInfo(std::string const& url,
+                            int & cols, int & rows, int & channels, double & nodata_val);
+
+  /// Fetch a clip of an image on a tile server. The arguments are as for
+  /// DiskImagePyramidMultiChannel::get_image_clip(). Can be called from
+  /// several threads at the same time.
+  void fetchRemoteImageClip(std::string const& url,
+                            double scale_in, vw::BBox2i const& region_in,
+                            bool highlight_nodata,
+                            QImage & qimg, double & scale_out, vw::BBox2i & region_out);
+
+}} // namespace vw::gui
+
+#endif  // __STEREO_GUI_TILE_SERVER_H__
@@ -20,6 +20,8 @@
 #include <asp/GUI/WidgetBase.h>
 #include <vw/Math/Statistics.h>
 
+#include <algorithm>
+
 namespace vw { namespace gui {
 
 WidgetBase::WidgetBase(int beg_image_id, int end_image_id,
@@ -78,4 +80,38 @@ void findRobustBounds(std::vector<vw::Vector3> const& scattered_data,
   return;
 }
 
+// Find which points to draw, with at most one per screen cell
+std::vector<size_t> decimateScreenPoints(std::vector<vw::Vector2> const& screen_pts,
+                                         vw::BBox2 const& screen_box, double cell_size) {
+
+  std::vector<size_t> kept;
+  if (screen_box.empty())
+    return kept;
+  
+  cell_size = std::max(cell_size, 1.0);
+  int num_cols = int(screen_box.width()  / cell_size) + 1;
+  int num_rows = int(screen_box.height() / cell_size) + 1;
+
+  // The index of the last point in each cell. -1 means no point.
+  std::vector<long long> cells(size_t(num_cols) * num_rows, -1);
+  for (size_t it = 0; it < screen_pts.size(); it++) {
+    vw::Vector2 const& P = screen_pts[it];
+    // This also skips NaN
+    if (!(P.x() >= screen_box.min().x() && P.x() <= screen_box.max().x() &&
+          P.y() >= screen_box.min().y() && P.y() <= screen_box.max().y()))
+      continue;
+    int col = std::min(int((P.x() - screen_box.min().x()) / cell_size), num_cols - 1);
+    int row = std::min(int((P.y() - screen_box.min().y()) / cell_size), num_rows - 1);
+    cells[size_t(row) * num_cols + col] = it;
+  }
+
+  for (size_t c = 0; c < cells.size(); c++) {
+    if (cells[c] >= 0)
+      kept.push_back(cells[c]);
+  }
+  std::sort(kept.begin(), kept.end());
+  
+  return kept;
+}
+
 }} // namespace vw::gui
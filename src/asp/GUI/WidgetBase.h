@@ -89,6 +89,15 @@ public:
 void findRobustBounds(std::vector<vw::Vector3> const& scattered_data,
   double & min_val, double & max_val);
 
+// Find which points to draw. Points outside the given screen box are
+// skipped, and of the points falling in the same screen cell of given
+// size only the last one is kept, as it would be drawn on top of the
+// others anyway. Return the indices of the kept points in increasing
+// order. This way the cost of drawing is bounded by the screen size
+// rather than by the number of points.
+std::vector<size_t> decimateScreenPoints(std::vector<vw::Vector2> const& screen_pts,
+                                         vw::BBox2 const& screen_box, double cell_size);
+
 }} // namespace vw::gui
 
 #endif  // __STEREO_GUI_WIDGET_BASE_H__
\ No newline at end of file
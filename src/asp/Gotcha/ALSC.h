@@ -18,22 +18,18 @@
 #ifndef ASP_GOTCHA_ALSC_H
 #define ASP_GOTCHA_ALSC_H
 
+#include <asp/Gotcha/ALSCKernel.h>
 #include <asp/Gotcha/CALSCParam.h>
 #include <asp/Gotcha/CTiePt.h>
 
 #include <opencv2/opencv.hpp>
-#include <opencv2/highgui/highgui.hpp>
 
-#include <Eigen/Dense>
-#include <Eigen/SVD>
-
-#include <iostream>
-#include <math.h>
-#include <fstream>
 #include <vector>
 
 namespace gotcha {
 
+// ALSC of lists of points in a pair of images, with ALSCKernel, which
+// reads 8-bit or float images.
 class ALSC {
 public:
     ALSC();
@@ -47,61 +43,17 @@ public:
 
     enum{NO_ERR, OB_ERR};
 
-private:
-    bool isIntersecting(cv::Rect rectA, cv::Rect rectB);
-    void getGradientX(Eigen::Ref<Eigen::MatrixXf> matSrc);
-    void getGradientY(Eigen::Ref<Eigen::MatrixXf> matSrc);
-    void distortPatch(const cv::Mat& matImg, const cv::Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, cv::Point2f* pptUpdated = NULL);
-    bool doMatching(cv::Point2f ptStartL, cv::Point2f ptStartR, CTiePt& tp, const float* pfAffInt = NULL);
-    void affineTransform(double x, double y, const cv::Point2f ptCentre, const float *pfAff, double *dNewX, double *dNewY);
-    float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
-
 private:
     // inputs
     cv::Mat m_imgL;
     cv::Mat m_imgR;
-    CALSCParam m_paramALSC;
-    cv::Mat m_imgR_resize;
-
-    int nMaxIter;
-    int nPatchRadius;
-    float fDisplacementThr;
-    float fAffineThr;
-    float fEigenThr;
-    bool bNeedW;
-
-    int nRowPatch;
-    int nColPatch;
-    int nSystemMatrixRows;
-
-    std::vector<std::vector<float> > pfGx;
-    std::vector<std::vector<float> > pfGy;
-
-    Eigen::MatrixXf matPatchL;
-    Eigen::MatrixXf matPatchR;
-
-    Eigen::Matrix2f matC;
-
-    Eigen::MatrixXf emA;
-    Eigen::VectorXf emB;
-
-    int nParam;
+    ALSCKernel m_kernel;
 
     // outputs:
     std::vector<CTiePt> m_pvecRefTP;
     std::vector<int> m_vecPassList; // index list which passes ALSC test
 };
 
-class ALSCU16 : public ALSC
-{
-    float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
-};
-
-class ALSCF32 : public ALSC
-{
-    float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
-};
-
 } // end namespace gotcha
 
 #endif // ASP_GOTCHA_ALSC_H
@@ -0,0 +1,260 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Gotcha/ALSCKernel.h>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+namespace gotcha {
+
+namespace {
+
+  // The normal equations have up to 7 unknowns: the shift and linear part
+  // of the affine transform in x and y, and the intensity offset.
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, 7, 7> NormalMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, 7, 1>              NormalVector;
+
+  // Bilinear resampling of one patch row, from (dX, dY) with the steps
+  // (dStepX, dStepY) per pixel. Pixels outside the image are 0.
+  template <class T>
+  void sampleRow(Mat const& img, double dX, double dY, double dStepX, double dStepY,
+                 int nLen, float* pfOut) {
+    double dMaxX = img.cols - 1, dMaxY = img.rows - 1;
+    for (int i = 0; i < nLen; i++, dX += dStepX, dY += dStepY) {
+      if (!(dX >= 0 && dY >= 0 && dX <= dMaxX && dY <= dMaxY)) {
+        pfOut[i] = 0.0f;
+        continue;
+      }
+      int x1 = std::min((int)dX, img.cols - 2);
+      int y1 = std::min((int)dY, img.rows - 2);
+      float fx = dX - x1, fy = dY - y1;
+      const T* r1 = img.ptr<T>(y1);
+      const T* r2 = img.ptr<T>(y1 + 1);
+      float top    = r1[x1] + fx * (float(r1[x1 + 1]) - float(r1[x1]));
+      float bottom = r2[x1] + fx * (float(r2[x1 + 1]) - float(r2[x1]));
+      pfOut[i] = top + fy * (bottom - top);
+    }
+  }
+
+} // end anonymous namespace
+
+ALSCKernel::ALSCKernel(): m_nRadius(0), m_nSize(0), m_nParam(0) {
+  setParameters(CALSCParam());
+}
+
+ALSCKernel::ALSCKernel(CALSCParam const& paramALSC): m_nRadius(0), m_nSize(0), m_nParam(0) {
+  setParameters(paramALSC);
+}
+
+void ALSCKernel::setParameters(CALSCParam const& paramALSC) {
+  m_paramALSC = paramALSC;
+  m_nRadius = m_paramALSC.m_nPatch;
+  m_nSize = 2 * m_nRadius + 1;
+  m_nParam = m_paramALSC.m_bIntOffset ? 7 : 6;
+  int nLen = m_nSize * m_nSize;
+  m_patchL.assign(nLen, 0.0f);
+  m_patchR.assign(nLen, 0.0f);
+  // The gradients on the patch border are not computed, and stay 0
+  m_gx.assign(nLen, 0.0f);
+  m_gy.assign(nLen, 0.0f);
+}
+
+void ALSCKernel::samplePatch(Mat const& img, Point2f ptCentre, const float* pfAff,
+                             float* pfPatch) const {
+
+  // A pixel (x, y) of the patch, relative to its centre, is at
+  // ptCentre + (x + a0 x + a1 y, y + a2 x + a3 y) in the image.
+  double dStepX = 1.0 + pfAff[0], dStepY = pfAff[2];
+  for (int j = 0; j < m_nSize; j++) {
+    double y = j - m_nRadius;
+    double dX = ptCentre.x + pfAff[1] * y - m_nRadius * dStepX;
+    double dY = ptCentre.y + (1.0 + pfAff[3]) * y - m_nRadius * dStepY;
+    float* pfRow = pfPatch + j * m_nSize;
+    if (img.depth() == CV_8U)
+      sampleRow<unsigned char>(img, dX, dY, dStepX, dStepY, m_nSize, pfRow);
+    else
+      sampleRow<float>(img, dX, dY, dStepX, dStepY, m_nSize, pfRow);
+  }
+}
+
+bool ALSCKernel::match(Mat const& imgL, Mat const& imgR, Point2f ptStartL, Point2f ptStartR,
+                       CTiePt& tp, const float* pfAffStart) {
+
+  if (imgL.channels() != 1 || imgR.channels() != 1 ||
+      (imgL.depth() != CV_8U && imgL.depth() != CV_32F) || imgL.depth() != imgR.depth())
+    CV_Error(Error::StsBadArg, "ALSC needs single-channel 8-bit or float images.");
+  if (imgL.cols < 2 || imgL.rows < 2 || imgR.cols < 2 || imgR.rows < 2)
+    return false;
+
+  // The starting points must be in the images
+  Rect_<float> rectL(0, 0, imgL.cols, imgL.rows);
+  Rect_<float> rectR(0, 0, imgR.cols, imgR.rows);
+  if (!rectL.contains(ptStartL) || !rectR.contains(ptStartR))
+    return false;
+
+  float pfAffine[4] = {0, 0, 0, 0}; // these are actually parameters for dA not A
+  samplePatch(imgL, ptStartL, pfAffine, &m_patchL[0]);
+
+  if (pfAffStart != NULL){
+    for (int k = 0; k < 4; k++)
+      pfAffine[k] = pfAffStart[k];
+    ptStartR.x += pfAffStart[4];
+    ptStartR.y += pfAffStart[5];
+  }
+  samplePatch(imgR, ptStartR, pfAffine, &m_patchR[0]);
+
+  Point2f ptUpdatedR(ptStartR);
+  bool bNeed2Stop = false;
+  double dEigenVal = 1E20;
+  Point2f ptBestR(0, 0);
+  double dBestEig = 1E20;
+  float pfAffBest[4] = {0, 0, 0, 0};
+
+  int nRows = m_nSize * m_nSize;
+  NormalMatrix emAS(m_nParam, m_nParam);
+  NormalVector emATB(m_nParam), emS(m_nParam);
+  double pdA[7];
+  pdA[6] = 1.0;
+
+  for (int nIter = 0; nIter < m_paramALSC.m_nMaxIter; nIter++) {
+
+    // gradients of the right patch
+    for (int y = 1; y < m_nSize - 1; y++) {
+      for (int x = 1; x < m_nSize - 1; x++) {
+        int k = y * m_nSize + x;
+        m_gx[k] = m_patchR[k + 1] - m_patchR[k];
+        m_gy[k] = m_patchR[k + m_nSize] - m_patchR[k];
+      }
+    }
+
+    // Accumulate the normal equations. The system matrix, with a row
+    // per patch pixel, is never formed.
+    emAS.setZero();
+    emATB.setZero();
+    double dBTB = 0.0;
+    for (int y = 0; y < m_nSize; y++) {
+      double yOffset = y - m_nRadius;
+      for (int x = 0; x < m_nSize; x++) {
+        double xOffset = x - m_nRadius;
+        int k = y * m_nSize + x;
+        pdA[0] = m_gx[k];
+        pdA[1] = m_gx[k] * xOffset;
+        pdA[2] = m_gx[k] * yOffset;
+        pdA[3] = m_gy[k];
+        pdA[4] = m_gy[k] * xOffset;
+        pdA[5] = m_gy[k] * yOffset;
+        double dB = double(m_patchL[k]) - double(m_patchR[k]);
+        for (int r = 0; r < m_nParam; r++) {
+          for (int c = 0; c <= r; c++)
+            emAS(r, c) += pdA[r] * pdA[c];
+          emATB(r) += pdA[r] * dB;
+        }
+        dBTB += dB * dB;
+      }
+    }
+    emAS.triangularView<Eigen::StrictlyUpper>() = emAS.transpose();
+
+    // get LMS solution, with Cholesky decomposition
+    emS = emAS.llt().solve(emATB);
+
+    // The sum of squared residuals, from the normal equations
+    double dErrorSum = emS.dot(emAS * emS) - 2.0 * emS.dot(emATB) + dBTB;
+    dErrorSum = std::max(dErrorSum, 0.0);
+    double dSTDResidual = dErrorSum / (double(nRows) - m_nParam);
+
+    // maximum eigenvalue of the shift covariance matrix, the inverse of
+    // [a b; b d], which is symmetric
+    double a = emAS(0, 0), b = emAS(3, 0), d = emAS(3, 3);
+    double dDet = a * d - b * b;
+    double p = d / dDet, q = -b / dDet, r = a / dDet;
+    double dMean = 0.5 * (p + r);
+    double dRad = std::sqrt(0.25 * (p - r) * (p - r) + q * q);
+    dEigenVal = std::max(std::abs(dMean + dRad), std::abs(dMean - dRad));
+    dEigenVal *= 10000.0 * dSTDResidual; // scaling
+
+    // check the validity of solution
+    float fShiftX = emS(0);
+    float fShiftY = emS(3);
+    float fDist = std::sqrt(fShiftX * fShiftX + fShiftY * fShiftY);
+    float fAffThr = m_paramALSC.m_fAffThr;
+    if (fDist > m_paramALSC.m_fDriftThr)
+      bNeed2Stop = true;
+    for (int k = 1; k < 6; k++) {
+      if (k == 3)
+        continue;
+      if (std::abs(emS(k)) > fAffThr || std::isnan(emS(k)))
+        bNeed2Stop = true;
+    }
+    if (bNeed2Stop)
+      break;
+
+    // update parameters
+    pfAffine[0] = emS(1);
+    pfAffine[1] = emS(2);
+    pfAffine[2] = emS(4);
+    pfAffine[3] = emS(5);
+    ptUpdatedR.x += fShiftX;
+    ptUpdatedR.y += fShiftY;
+
+    if (dEigenVal < m_paramALSC.m_fEigThr && dBestEig > dEigenVal) {
+      dBestEig = dEigenVal;
+      ptBestR = ptUpdatedR;
+      for (int m = 0; m < 4; m++)
+        pfAffBest[m] = pfAffine[m];
+    }
+
+    // get distorted patch
+    samplePatch(imgR, ptUpdatedR, pfAffine, &m_patchR[0]);
+  }
+
+  if (dBestEig > m_paramALSC.m_fEigThr && !bNeed2Stop) bNeed2Stop = true;
+  if (std::isnan(dEigenVal)) bNeed2Stop = true;
+  if (bNeed2Stop)
+    return false;
+
+  tp.m_ptL = ptStartL;
+  tp.m_ptR = ptBestR;
+  tp.m_fSimVal = dBestEig;
+  for (int i = 0; i < 4; i++)
+    tp.m_pfAffine[i] = pfAffBest[i];
+  tp.m_ptOffset = ptBestR - ptStartR;
+  if (pfAffStart != NULL){
+    tp.m_ptOffset.x += pfAffStart[4];
+    tp.m_ptOffset.y += pfAffStart[5];
+  }
+  return true;
+}
+
+void ALSCKernel::matchBatch(Mat const& imgL, Mat const& imgR,
+                            vector<CTiePt> const& vecTpts, const float* pfAffStart,
+                            vector<CTiePt> & vecRefTP, vector<int> & vecPass) {
+  for (int i = 0; i < (int)vecTpts.size(); i++) {
+    CTiePt tp;
+    if (match(imgL, imgR, vecTpts[i].m_ptL, vecTpts[i].m_ptR, tp, pfAffStart)) {
+      vecRefTP.push_back(tp);
+      vecPass.push_back(i);
+    }
+  }
+}
+
+} // end namespace gotcha
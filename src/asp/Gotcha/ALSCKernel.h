@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ALSCKernel.h
+///
+/// Adaptive least-squares correlation (ALSC) of single points, with the
+/// buffers allocated once and reused for all points. The normal equations
+/// are accumulated directly from the patches into fixed-size matrices, so
+/// no per-point or per-iteration memory is allocated. The right patch is
+/// resampled row by row, with the affine-warped coordinates updated
+/// incrementally along each row. Used by ALSC (and so by CDensify) and by
+/// ALSC subpixel refinement in stereo_rfne.
+
+#ifndef ASP_GOTCHA_ALSC_KERNEL_H
+#define ASP_GOTCHA_ALSC_KERNEL_H
+
+#include <asp/Gotcha/CALSCParam.h>
+#include <asp/Gotcha/CTiePt.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+namespace gotcha {
+
+class ALSCKernel {
+public:
+  ALSCKernel();
+  explicit ALSCKernel(CALSCParam const& paramALSC);
+
+  /// Set the parameters, and size the buffers for the patch size
+  void setParameters(CALSCParam const& paramALSC);
+
+  /// Refine the match of ptStartL in imgL to ptStartR in imgR. The
+  /// images must have a single channel, of type 8-bit or float. If
+  /// pfAffStart is set, it has the starting affine parameters and then
+  /// the offset of the right point. Returns false if the match fails.
+  bool match(cv::Mat const& imgL, cv::Mat const& imgR,
+             cv::Point2f ptStartL, cv::Point2f ptStartR, CTiePt & tp,
+             const float* pfAffStart = NULL);
+
+  /// Refine many matches, with the same buffers. Append the refined
+  /// matches which pass to vecRefTP, and their indices to vecPass.
+  void matchBatch(cv::Mat const& imgL, cv::Mat const& imgR,
+                  std::vector<CTiePt> const& vecTpts, const float* pfAffStart,
+                  std::vector<CTiePt> & vecRefTP, std::vector<int> & vecPass);
+
+private:
+  // Resample the patch around a point, with the affine parameters
+  void samplePatch(cv::Mat const& img, cv::Point2f ptCentre, const float* pfAff,
+                   float* pfPatch) const;
+
+  CALSCParam m_paramALSC;
+  int m_nRadius, m_nSize, m_nParam;
+  std::vector<float> m_patchL, m_patchR, m_gx, m_gy;
+};
+
+} // end namespace gotcha
+
+#endif // ASP_GOTCHA_ALSC_KERNEL_H
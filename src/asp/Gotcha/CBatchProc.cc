@@ -53,7 +53,8 @@ CBatchProc::CBatchProc(std::string          const & strMetaFile,
                        vw::ImageView<float> const & imgL,
                        vw::ImageView<float> const & imgR, 
                        vw::ImageView<float> const & input_dispX,
-                       vw::ImageView<float> const & input_dispY) {
+                       vw::ImageView<float> const & input_dispY,
+                       int num_threads) {
 
   // Sanity checks
   if (bounding_box(imgL)        != bounding_box(imgR) ||
@@ -63,6 +64,7 @@ CBatchProc::CBatchProc(std::string          const & strMetaFile,
   
   // initialize
   m_strMetaFile = strMetaFile;
+  m_nNumThreads = num_threads;
   
 #if 0
   m_strImgL = strLeftImagePath;
@@ -482,6 +484,7 @@ void CBatchProc::refinement(std::vector<CTiePt> const& vecTPs,
   //Mat matDummy = imread(m_strImgL, CV_LOAD_IMAGE_ANYDEPTH);
   paramDense.m_paramGotcha.m_nMinTile = m_imgL.cols + m_imgL.rows;
   paramDense.m_paramGotcha.m_nNeiType = (int)tl["nNeiType"];
+  paramDense.m_paramGotcha.m_nNumThreads = m_nNumThreads;
 
   paramDense.m_paramGotcha.m_paramALSC.m_bIntOffset = (int)tl["bIntOffset"];
   paramDense.m_paramGotcha.m_paramALSC.m_bWeighting = (int)tl["bWeight"];
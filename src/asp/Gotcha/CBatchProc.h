@@ -41,7 +41,8 @@ public:
              vw::ImageView<float> const & imgL,
              vw::ImageView<float> const & imgR, 
              vw::ImageView<float> const & input_dispX,
-             vw::ImageView<float> const & input_dispY);
+             vw::ImageView<float> const & input_dispY,
+             int num_threads = 1);
 
   ~CBatchProc();
   
@@ -79,13 +80,14 @@ protected:
   cv::Mat m_imgL, m_imgR;
   cv::Mat m_input_dispX, m_input_dispY;
   cv::Mat m_Mask;
+  int m_nNumThreads; // for growing the regions concurrently
 };
 
 // Apply Gotcha refinement to each padded tile
 class GotchaPerBlockView: public vw::ImageViewBase<GotchaPerBlockView>{
   vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> m_input_disp;
   vw::ImageViewRef<float> m_left_img, m_right_img;
-  int m_padding;
+  int m_padding, m_num_threads;
   std::string m_casp_go_param_file;
   
   typedef vw::PixelMask<vw::Vector2f> PixelT;
@@ -94,9 +96,11 @@ public:
   GotchaPerBlockView(vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> input_disp,
                      vw::ImageViewRef<float> left_img,
                      vw::ImageViewRef<float> right_img,
-                     int padding, std::string const& casp_go_param_file):
+                     int padding, std::string const& casp_go_param_file,
+                     int num_threads = 1):
     m_input_disp(input_disp), m_left_img(left_img), m_right_img(right_img),
-    m_padding(padding), m_casp_go_param_file(casp_go_param_file){}
+    m_padding(padding), m_num_threads(num_threads),
+    m_casp_go_param_file(casp_go_param_file){}
   
   typedef PixelT pixel_type;
   typedef PixelT result_type;
@@ -129,7 +133,8 @@ public:
                          crop(m_left_img, biased_box), 
                          crop(m_right_img, biased_box), 
                          vw::select_channel(cropped_disp, 0),
-                         vw::select_channel(cropped_disp, 1));
+                         vw::select_channel(cropped_disp, 1),
+                         m_num_threads);
     batchProc.doBatchProcessing(output_dispX, output_dispY);
     
     // Integrate back the processed bands.
@@ -149,8 +154,10 @@ public:
 GotchaPerBlockView gotcha_refine(vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> input_disp,
                                  vw::ImageViewRef<float> left_img,
                                  vw::ImageViewRef<float> right_img,
-                                 int padding, std::string const& casp_go_param_file){
-  return GotchaPerBlockView(input_disp, left_img, right_img, padding, casp_go_param_file);
+                                 int padding, std::string const& casp_go_param_file,
+                                 int num_threads = 1){
+  return GotchaPerBlockView(input_disp, left_img, right_img, padding, casp_go_param_file,
+                            num_threads);
 }
 
 } // end namespace gotcha
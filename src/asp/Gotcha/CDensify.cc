@@ -21,6 +21,7 @@
 #include <fstream>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 using namespace cv;
@@ -671,7 +672,7 @@ void CDensify::removeOutsideImage(vector<CTiePt>& vecNeiTp, const Rect_<float> r
 
 }
 
-void CDensify::removePtInLUT(vector<CTiePt>& vecNeiTp, const vector<bool>& pLUT, const int nWidth){
+void CDensify::removePtInLUT(vector<CTiePt>& vecNeiTp, const vector<unsigned char>& pLUT, const int nWidth){
     vector<CTiePt>::iterator iter;
 
     for (iter = vecNeiTp.begin(); iter < vecNeiTp.end(); ){        
@@ -750,14 +751,10 @@ bool CDensify::doGotcha(const Mat& matImgL, const Mat& matImgR, vector<CTiePt>&
     Size szImgL(matImgL.cols, matImgL.rows);
     // cout << "CASP-GO INFO: initialising pixel LUT" << endl;
 
-    // IMARS bool pLUT[szImgL.area()]; // if true it indicates the pixel has already processed
-    vector<bool> pLUT; //IMARS
-
-    // initialise
-    for (int i = 0; i< szImgL.area(); i++){
-        bool bpLUT = false; //IMARS
-        pLUT.push_back(bpLUT); //IMARS
-    } //IMARS
+    // If true it indicates the pixel has already been processed. Not a
+    // vector<bool>, so that tiles grown on different threads do not
+    // write to the same word.
+    vector<unsigned char> pLUT(szImgL.area(), 0);
 
     vector< Rect_<float> > vecRectTiles;
     vecRectTiles.push_back(Rect(0., 0., matImgL.cols, matImgL.rows));
@@ -804,9 +801,20 @@ bool CDensify::doGotcha(const Mat& matImgL, const Mat& matImgR, vector<CTiePt>&
     vectpAdded.clear();
     //cout << "CASP-GO INFO: Desifying disparity... ..." << endl;
 
+    if (paramGotcha.m_nNumThreads > 1)
+        return doConcurrentGotcha(matImgL, matImgR, vectpSeeds, paramGotcha, vectpAdded,
+                                  matSimMap, pLUT);
+
     for (int i = 0 ; i < (int)vecRectTiles.size(); i++){
+          // the seeds in this tile
+          vector<CTiePt> vecTileSeeds;
+          for (int k = 0 ; k < (int)vectpSeeds.size(); k++){
+              if (vecRectTiles.at(i).contains(vectpSeeds.at(k).m_ptL))
+                  vecTileSeeds.push_back(vectpSeeds.at(k));
+          }
+
           vector<CTiePt> vecRes;
-          bRes = bRes && doTileGotcha(matImgL, matImgR, vectpSeeds, paramGotcha, vecRes, vecRectTiles.at(i), matSimMap, pLUT);
+          bRes = bRes && doTileGotcha(matImgL, matImgR, vecTileSeeds, paramGotcha, vecRes, vecRectTiles.at(i), matSimMap, pLUT);
           // collect result
           vectpAdded.insert(vectpAdded.end(), vecRes.begin(), vecRes.end());
 
@@ -817,60 +825,133 @@ bool CDensify::doGotcha(const Mat& matImgL, const Mat& matImgR, vector<CTiePt>&
     return bRes;
 }
 
+// Grow the regions on a grid of tiles, with the tiles done in parallel.
+// The growth in a tile stays in it. The tiles are colored like a 2 x 2
+// checkerboard, and the tiles of one color are done at the same time,
+// so a tile and its 8 neighbors are never grown at once. As the tiles
+// are larger than the diffusion neighborhood, a tile only reads the
+// similarity map and pixel LUT of itself and its neighbors, with no
+// races. The points whose neighbors are in another tile are queued as
+// seeds for that tile, and the colors are swept until no tile has
+// seeds left. The result does not depend on the number of threads.
+bool CDensify::doConcurrentGotcha(const Mat& matImgL, const Mat& matImgR,
+                                  const vector<CTiePt>& vectpSeeds,
+                                  const CGOTCHAParam& paramGotcha, vector<CTiePt>& vectpAdded,
+                                  Mat& matSimMap, vector<unsigned char>& pLUT){
+
+    int nTile = std::max(paramGotcha.m_nTileSize, 2*paramGotcha.m_paramALSC.m_nPatch + 2);
+    int nTilesX = (matImgL.cols + nTile - 1) / nTile;
+    int nTilesY = (matImgL.rows + nTile - 1) / nTile;
+    int nNumTiles = nTilesX * nTilesY;
+
+    // the seeds of each tile, to be grown when the tile is next visited
+    vector< vector<CTiePt> > vecPending(nNumTiles);
+    for (int i = 0 ; i < (int)vectpSeeds.size(); i++){
+        int nX = (int)floor(vectpSeeds.at(i).m_ptL.x) / nTile;
+        int nY = (int)floor(vectpSeeds.at(i).m_ptL.y) / nTile;
+        if (nX >= 0 && nY >= 0 && nX < nTilesX && nY < nTilesY)
+            vecPending[nY*nTilesX + nX].push_back(vectpSeeds.at(i));
+    }
+
+    bool bRes = true;
+    bool bHavePending = true;
+    while (bHavePending){
+        for (int nColor = 0; nColor < 4; nColor++){
+
+            vector<int> vecTiles;
+            for (int nY = nColor / 2; nY < nTilesY; nY += 2){
+                for (int nX = nColor % 2; nX < nTilesX; nX += 2){
+                    if (!vecPending[nY*nTilesX + nX].empty())
+                        vecTiles.push_back(nY*nTilesX + nX);
+                }
+            }
+
+            int nLen = vecTiles.size();
+            vector< vector<CTiePt> > vecRes(nLen);
+            vector< vector< pair<int, CTiePt> > > vecOutbox(nLen);
+            vector<char> vecOk(nLen, 1);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(paramGotcha.m_nNumThreads)
+            for (int k = 0; k < nLen; k++){
+                int nIdx = vecTiles[k];
+                int nX = (nIdx % nTilesX) * nTile, nY = (nIdx / nTilesX) * nTile;
+                Rect_<float> rectTile(nX, nY, std::min(nTile, matImgL.cols - nX),
+                                      std::min(nTile, matImgL.rows - nY));
+                vecOk[k] = doTileGotcha(matImgL, matImgR, vecPending[nIdx], paramGotcha,
+                                        vecRes[k], rectTile, matSimMap, pLUT,
+                                        nTile, &vecOutbox[k]);
+            }
+
+            // collect the results and pass on the seeds, in tile order
+            for (int k = 0; k < nLen; k++){
+                bRes = bRes && vecOk[k];
+                vecPending[vecTiles[k]].clear();
+                vectpAdded.insert(vectpAdded.end(), vecRes[k].begin(), vecRes[k].end());
+                for (int i = 0; i < (int)vecOutbox[k].size(); i++)
+                    vecPending[vecOutbox[k][i].first].push_back(vecOutbox[k][i].second);
+            }
+        }
+
+        bHavePending = false;
+        for (int i = 0; i < nNumTiles; i++)
+            bHavePending = bHavePending || !vecPending[i].empty();
+    }
+
+    return bRes;
+}
+
 
 bool CDensify::doTileGotcha(const Mat& matImgL, const Mat& matImgR, const
                             vector<CTiePt>& vectpSeeds,
                             const CGOTCHAParam& paramGotcha, vector<CTiePt>& vectpAdded,
-                            const Rect_<float> rectTileL, Mat& matSimMap, vector<bool>& pLUT){
+                            const Rect_<float> rectTileL, Mat& matSimMap,
+                            vector<unsigned char>& pLUT,
+                            int nGridTile, vector< pair<int, CTiePt> >* pvecOutbox){
 
-    vector<CTiePt> vectpSeedTPs; //= vectpSeeds;                // need this hard copy for sorting
+    // the seeds, then the added points, in the order they are grown
+    vector<CTiePt> vectpSeedTPs = vectpSeeds;
 
     Size szImgL(matImgL.cols, matImgL.rows);
+    Rect_<float> rectImgL (0, 0, matImgL.cols, matImgL.rows);
     Rect_<float> rectImgR (0, 0, matImgR.cols, matImgR.rows);
+    int nGridTilesX = (nGridTile > 0) ? (matImgL.cols + nGridTile - 1) / nGridTile : 0;
+    int nTileIdx = (nGridTile > 0) ?
+      ((int)rectTileL.y / nGridTile) * nGridTilesX + (int)rectTileL.x / nGridTile : -1;
     vectpAdded.clear(); //clear output tp list
 
-    // set indicator buffer
-    for (int i = 0 ; i < (int)vectpSeeds.size(); i++){
-        CTiePt tp = vectpSeeds.at(i);
+    // One matcher for the tile, so its buffers are reused for all points
+    ALSC alsc(matImgL, matImgR, paramGotcha.m_paramALSC);
 
-        if (rectTileL.contains(tp.m_ptL)){
-            vectpSeedTPs.push_back(tp);
-        }
+    /////////////////////////////////////////////////////////////////////
+    // stereo region growing
+    for (size_t nHead = 0; nHead < vectpSeedTPs.size(); nHead++) {
+        // get a point from seed. Copy it, as the list grows below.
+        CTiePt tp = vectpSeedTPs[nHead];
 
-    }
-    //std::cout << "Reading mask: " << paramGotcha.m_strMask << std::endl;
-    //Mat Mask = imread(paramGotcha.m_strMask, CV_LOAD_IMAGE_ANYDEPTH);
-    Mat imgL = matImgL;
-    Mat imgR = matImgR;
-    imgL.convertTo(imgL, CV_8UC1);
-    imgR.convertTo(imgR, CV_8UC1);
+        vector<CTiePt> vecNeiTp;
+        getNeighbour(tp, vecNeiTp, paramGotcha.m_nNeiType, matSimMap);
 
-    unsigned int nGapSize = 0;
-    for (int i=0; i<m_Mask.rows; i++){
-        for (int j=0; j< m_Mask.cols; j++){
-          if (m_Mask.at<uchar>(i,j)==1 &&
-              imgL.at<uchar>(i,j)!=0 &&imgR.at<uchar>(i,j)!=0)
-                nGapSize+=1;
+        // Queue a point with neighbours in other tiles as a seed for
+        // those tiles, once per tile. Only points in this tile are
+        // passed on, so seeds do not go back and forth.
+        if (pvecOutbox != NULL && rectTileL.contains(tp.m_ptL)){
+            vector<int> vecSent;
+            for (int i = 0; i < (int)vecNeiTp.size(); i++){
+                CTiePt const& tpNei = vecNeiTp[i];
+                if (rectTileL.contains(tpNei.m_ptL) || !rectImgL.contains(tpNei.m_ptL) ||
+                    !rectImgR.contains(tpNei.m_ptR))
+                    continue;
+                int nX = (int)floor(tpNei.m_ptL.x), nY = (int)floor(tpNei.m_ptL.y);
+                if (pLUT[nY*szImgL.width + nX])
+                    continue;
+                int nIdx = (nY / nGridTile) * nGridTilesX + nX / nGridTile;
+                if (nIdx == nTileIdx ||
+                    std::find(vecSent.begin(), vecSent.end(), nIdx) != vecSent.end())
+                    continue;
+                vecSent.push_back(nIdx);
+                pvecOutbox->push_back(make_pair(nIdx, tp));
+            }
         }
-    }
 
-    //sort(vectpSeedTPs.begin(), vectpSeedTPs.end(), compareTP); // sorted in ascending order
-    /////////////////////////////////////////////////////////////////////
-    // stereo region growing
-    //int nCount = 0; // for debug
-#if 0
-      // Hide the verbose messages
-      cout << "[--------------------]  0% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-#endif
-      
-    while (vectpSeedTPs.size() > 0) {
-        // get a point from seed
-        CTiePt tp = vectpSeedTPs.at(0);
-
-//        mvectpAdded.push_back(tp);
-        vectpSeedTPs.erase(vectpSeedTPs.begin());
-        vector<CTiePt> vecNeiTp;        
-        getNeighbour(tp, vecNeiTp, paramGotcha.m_nNeiType, matSimMap);
         removeOutsideImage(vecNeiTp, rectTileL, rectImgR);
         removePtInLUT(vecNeiTp, pLUT, matImgL.cols);
 
@@ -883,15 +964,12 @@ bool CDensify::doTileGotcha(const Mat& matImgL, const Mat& matImgR, const
             pfData[4] = tp.m_ptOffset.x;
             pfData[5] = tp.m_ptOffset.y;
 
-            ALSC alsc(matImgL, matImgR, paramGotcha.m_paramALSC);
-
             alsc.performALSC(&vecNeiTp, (float*) pfData);
             const vector<CTiePt>* pvecRefTPtemp = alsc.getRefinedTps();
 
             int nLen = pvecRefTPtemp->size();
             if( nLen > 0){
                 // append survived neighbours to the seed point list and the seed LUT
-                // vector<CRefinedTP>::iterator iterNei;
                 for (int i = 0 ; i < nLen; i++){
                     CTiePt tpNei = pvecRefTPtemp->at(i);
 
@@ -905,60 +983,10 @@ bool CDensify::doTileGotcha(const Mat& matImgL, const Mat& matImgR, const
                     vectpSeedTPs.push_back(tpNei);
                     vectpAdded.push_back(tpNei);
                 }
-
-                //sort(vectpSeedTPs.begin(), vectpSeedTPs.end(), compareTP);
             } 
         }
-#if 0
-        // Hide the verbose messages
-        if (vectpAdded.size()>0){
-        if (vectpAdded.size() >= (nGapSize)/20 && vectpAdded.size() < 2*(nGapSize)/20)
-            cout << "[*-------------------]  5% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 2*(nGapSize)/20 && vectpAdded.size() < 3*(nGapSize)/20)
-            cout << "[**------------------] 10% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 3*(nGapSize)/20 && vectpAdded.size() < 4*(nGapSize)/20)
-            cout << "[***-----------------] 15% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 4*(nGapSize)/20 && vectpAdded.size() < 5*(nGapSize)/20)
-            cout << "[****----------------] 20% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 5*(nGapSize)/20 && vectpAdded.size() < 6*(nGapSize)/20)
-            cout << "[*****---------------] 25% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 6*(nGapSize)/20 && vectpAdded.size() < 7*(nGapSize)/20)
-            cout << "[******--------------] 30% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 7*(nGapSize)/20 && vectpAdded.size() < 8*(nGapSize)/20)
-            cout << "[*******-------------] 35% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 8*(nGapSize)/20 && vectpAdded.size() < 9*(nGapSize)/20)
-            cout << "[********------------] 40% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 9*(nGapSize)/20 && vectpAdded.size() < 10*(nGapSize)/20)
-            cout << "[*********-----------] 45% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 10*(nGapSize)/20 && vectpAdded.size() < 11*(nGapSize)/20)
-            cout << "[**********----------] 50% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 11*(nGapSize)/20 && vectpAdded.size() < 12*(nGapSize)/20)
-            cout << "[***********---------] 55% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 12*(nGapSize)/20 && vectpAdded.size() < 13*(nGapSize)/20)
-            cout << "[************--------] 60% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 13*(nGapSize)/20 && vectpAdded.size() < 14*(nGapSize)/20)
-            cout << "[*************-------] 65% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 14*(nGapSize)/20 && vectpAdded.size() < 15*(nGapSize)/20)
-            cout << "[**************------] 70% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 15*(nGapSize)/20 && vectpAdded.size() < 16*(nGapSize)/20)
-            cout << "[***************-----] 75% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 16*(nGapSize)/20 && vectpAdded.size() < 17*(nGapSize)/20)
-            cout << "[****************----] 80% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 17*(nGapSize)/20 && vectpAdded.size() < 18*(nGapSize)/20)
-            cout << "[*****************---] 85% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 18*(nGapSize)/20 && vectpAdded.size() < 19*(nGapSize)/20)
-            cout << "[******************--] 90% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 19*(nGapSize)/20 && vectpAdded.size() < 20*(nGapSize)/20)
-            cout << "[*******************-] 95% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() == nGapSize)
-          cout << "[********************]100% OF THE GAP AREA HAS BEEN DENSIFIED";
-        }
-#endif
     }
-#if 0
-    cout << endl;
-#endif
-    
+
     return true;
 }
 
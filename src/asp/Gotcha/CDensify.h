@@ -60,10 +60,19 @@ private:
     std::vector<CTiePt> getIntToFloatSeed(std::vector<CTiePt>& vecTPSrc); // get integer Seed point pairs from a float seed point pair
     bool doGotcha(const cv::Mat& matImgL, const cv::Mat& matImgR, std::vector<CTiePt>& vectpSeeds,
                   const CGOTCHAParam& paramGotcha, std::vector<CTiePt>& vectpAdded);
+    bool doConcurrentGotcha(const cv::Mat& matImgL, const cv::Mat& matImgR,
+                            const std::vector<CTiePt>& vectpSeeds,
+                            const CGOTCHAParam& paramGotcha, std::vector<CTiePt>& vectpAdded,
+                            cv::Mat& matSimMap, std::vector<unsigned char>& pLUT);
+    // Grow from the given seeds within a tile. If pvecOutbox is set, the
+    // points with neighbours in other tiles of the grid of size nGridTile
+    // are added to it, with the index of the tile.
     bool doTileGotcha(const cv::Mat& matImgL, const cv::Mat& matImgR, const std::vector<CTiePt>& vectpSeeds,
                       const CGOTCHAParam& paramGotcha, std::vector<CTiePt>& mvectpAdded,
-                      const cv::Rect_<float> rectTileL, cv::Mat& matSimMap, std::vector<bool>& pLUT); //IMARS
-    void removePtInLUT(std::vector<CTiePt>& vecNeiTp, const std::vector<bool>& pLUT, const int nWidth); //IMARS
+                      const cv::Rect_<float> rectTileL, cv::Mat& matSimMap,
+                      std::vector<unsigned char>& pLUT, int nGridTile = 0,
+                      std::vector< std::pair<int, CTiePt> >* pvecOutbox = NULL); //IMARS
+    void removePtInLUT(std::vector<CTiePt>& vecNeiTp, const std::vector<unsigned char>& pLUT, const int nWidth); //IMARS
     void removeOutsideImage(std::vector<CTiePt>& vecNeiTp, const cv::Rect_<float> rectTileL, const cv::Rect_<float> rectImgR);
     void getNeighbour(const CTiePt tp, std::vector<CTiePt>& vecNeiTp, const int nNeiType, const cv::Mat& matSim);
     void getDisffusedNei(std::vector<CTiePt>& vecNeiTp, const CTiePt tp, const cv::Mat& matSim);
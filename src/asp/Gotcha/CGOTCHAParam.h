@@ -26,7 +26,8 @@ namespace gotcha {
 class CGOTCHAParam {
 
 public:
-    CGOTCHAParam():m_nNeiType(NEI_4),m_fDiffCoef(0.05),m_fDiffThr(0.1),m_nDiffIter(5), m_bNeedInitALSC(true){ m_nMinTile = 1000000000;}
+    CGOTCHAParam():m_nNeiType(NEI_4),m_fDiffCoef(0.05),m_fDiffThr(0.1),m_nDiffIter(5), m_bNeedInitALSC(true),
+                   m_nNumThreads(1), m_nTileSize(256){ m_nMinTile = 1000000000;}
 
     std::string getNeiType(){if (m_nNeiType == NEI_X) return "NEI_X";
                         else if (m_nNeiType == NEI_Y) return "NEI_Y";
@@ -46,6 +47,11 @@ public:
     CALSCParam m_paramALSC;
     bool m_bNeedInitALSC; // set true if initial alsc on seed points are required
 
+    // With more than one thread, the regions are grown concurrently on a
+    // grid of tiles of this size, rather than on the tiles of m_nMinTile
+    int m_nNumThreads;
+    int m_nTileSize;
+
     enum {NEI_X, NEI_Y, NEI_4, NEI_8, NEI_DIFF};
 };
 
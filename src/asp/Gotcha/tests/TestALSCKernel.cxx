@@ -0,0 +1,71 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Gotcha/ALSCKernel.h>
+
+#include <cmath>
+
+using namespace gotcha;
+
+namespace {
+  // A smooth texture, shifted by (sx, sy)
+  float texture(double x, double y, double sx, double sy) {
+    x -= sx;
+    y -= sy;
+    return 128.0 + 60.0 * std::sin(0.31 * x) * std::cos(0.23 * y)
+      + 30.0 * std::sin(0.17 * x + 0.11 * y);
+  }
+}
+
+TEST(ALSCKernel, FindsSubpixelShift) {
+
+  double sx = 2.3, sy = -1.6;
+  cv::Mat left(80, 90, CV_32F), right(80, 90, CV_32F);
+  for (int row = 0; row < left.rows; row++) {
+    for (int col = 0; col < left.cols; col++) {
+      left.at<float>(row, col)  = texture(col, row, 0, 0);
+      right.at<float>(row, col) = texture(col, row, sx, sy);
+    }
+  }
+
+  CALSCParam param;
+  param.m_nPatch = 8;
+  ALSCKernel kernel(param);
+
+  // Start from the rounded shift
+  cv::Point2f ptL(40, 35), ptR(42, 33);
+  CTiePt tp;
+  ASSERT_TRUE(kernel.match(left, right, ptL, ptR, tp));
+  EXPECT_NEAR(ptL.x + sx, tp.m_ptR.x, 0.05);
+  EXPECT_NEAR(ptL.y + sy, tp.m_ptR.y, 0.05);
+
+  // The same in a batch, with 8-bit images, and with a point which
+  // cannot be matched as it is outside the right image
+  cv::Mat left8, right8;
+  left.convertTo(left8, CV_8U);
+  right.convertTo(right8, CV_8U);
+  std::vector<CTiePt> in(2), out;
+  std::vector<int> pass;
+  in[0].m_ptL = ptL; in[0].m_ptR = ptR;
+  in[1].m_ptL = ptL; in[1].m_ptR = cv::Point2f(200, 33);
+  kernel.matchBatch(left8, right8, in, NULL, out, pass);
+  ASSERT_EQ(1u, out.size());
+  EXPECT_EQ(0, pass[0]);
+  EXPECT_NEAR(ptL.x + sx, out[0].m_ptR.x, 0.2);
+  EXPECT_NEAR(ptL.y + sy, out[0].m_ptR.y, 0.2);
+}
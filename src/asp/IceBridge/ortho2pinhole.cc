@@ -31,9 +31,12 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/MatchFile.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Cartography/GeoTransform.h>
+#include <vw/Core/ThreadPool.h>
 #include <boost/core/null_deleter.hpp>
+#include <boost/noncopyable.hpp>
 
 
 // Turn off warnings from eigen
@@ -70,18 +73,42 @@ typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
 
 
 struct Options : public vw::GdalWriteOptions {
-  std::string raw_image, ortho_image, input_cam, output_cam, reference_dem, camera_estimate;
+  std::string raw_image, ortho_image, input_cam, output_cam, reference_dem, camera_estimate,
+    frame_list;
   double camera_height, orthoimage_height, ip_inlier_factor, max_translation;
-  int    ip_per_tile, ip_detect_method, min_ip;
+  int    ip_per_tile, ip_detect_method, min_ip, num_parallel_frames;
   bool   individually_normalize, keep_match_file, write_gcp_file, skip_image_normalization, 
     show_error, short_circuit, crop_reference_dem;
 
   // Make sure all values are initialized, even though they will be
   // over-written later.
   Options(): camera_height(-1), orthoimage_height(0), ip_per_tile(0),
-             ip_detect_method(0), individually_normalize(false), keep_match_file(false){}
+             ip_detect_method(0), num_parallel_frames(1),
+             individually_normalize(false), keep_match_file(false){}
 };
 
+/// The reference DEM, opened once and shared by all frames
+struct RefDem {
+  float dem_nodata;
+  vw::cartography::GeoReference dem_georef;
+  ImageViewRef<float> dem;
+  RefDem(): dem_nodata(-std::numeric_limits<float>::max()) {}
+};
+
+/// Open the reference DEM and read its georeference and no-data value.
+void open_reference_dem(std::string const& reference_dem, RefDem & ref_dem) {
+
+  bool is_good = vw::cartography::read_georeference(ref_dem.dem_georef, reference_dem);
+  if (!is_good) {
+    vw_throw(ArgumentErr() << "Error: Cannot read georeference from: "
+                           << reference_dem << ".\n");
+  }
+
+  boost::shared_ptr<DiskImageResource> rsrc(vw::DiskImageResourcePtr(reference_dem));
+  if (rsrc->has_nodata_read()) ref_dem.dem_nodata = rsrc->nodata_read();
+  ref_dem.dem = DiskImageView<float>(rsrc);
+}
+
 /// Record a set of IP results as ground control points
 void write_gcp_file(Options const& opt, 
                     std::vector<Vector3> const& llh_pts,
@@ -282,24 +309,13 @@ int solve_for_cam_adjust(boost::shared_ptr<PinholeModel> camera_model,
 /// Load the DEM and adjust some options depending on DEM statistics.
 void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const& rsrc_ortho,
                         vw::cartography::GeoReference const& ortho_georef,
+                        RefDem const& ref_dem,
                         ImageViewRef< PixelMask<float> > &dem,
                         vw::cartography::GeoReference &dem_georef,
                         bool &elevation_change_present) {
 
-  // Set up the DEM if it was provided.
-  float dem_nodata = -std::numeric_limits<float>::max();
-
-  bool is_good = vw::cartography::read_georeference(dem_georef, opt.reference_dem);
-  if (!is_good) {
-    vw_throw(ArgumentErr() << "Error: Cannot read georeference from: "
-                           << opt.reference_dem << ".\n");
-  }
-
-  {
-    // Read the no-data
-    DiskImageResourceGDAL rsrc(opt.reference_dem);
-    if (rsrc.has_nodata_read()) dem_nodata = rsrc.nodata_read();
-  }
+  float dem_nodata = ref_dem.dem_nodata;
+  dem_georef = ref_dem.dem_georef;
 
 
   bool crop_is_success = false;
@@ -310,8 +326,7 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
     DiskImageView<float> tmp_ortho(rsrc_ortho);
     BBox2 ortho_bbox = bounding_box(tmp_ortho);
 
-    DiskImageView<float> tmp_dem(opt.reference_dem);
-    BBox2 dem_bbox = bounding_box(tmp_dem);
+    BBox2 dem_bbox = bounding_box(ref_dem.dem);
     
     // The GeoTransform will hide the messy details of conversions
     vw::cartography::GeoTransform geotrans(dem_georef, ortho_georef, dem_bbox, ortho_bbox);
@@ -331,7 +346,7 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
       crop_box.crop(dem_bbox);
       
       if (!crop_box.empty()) {
-        ImageView<float> cropped_dem = crop(DiskImageView<float>(opt.reference_dem), crop_box);
+        ImageView<float> cropped_dem = crop(ref_dem.dem, crop_box);
         dem = create_mask(cropped_dem, dem_nodata);
         dem_georef = crop(dem_georef, crop_box);
         crop_is_success = true;
@@ -343,7 +358,7 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
   
   // Default behavior  
   if (!crop_is_success)
-    dem = create_mask(DiskImageView<float>(opt.reference_dem), dem_nodata);
+    dem = create_mask(ref_dem.dem, dem_nodata);
 
   
   // Get an estimate of the elevation range in the input image
@@ -407,14 +422,20 @@ void load_camera_and_find_ip(Options const& opt,
   std::string out_prefix = "tmp-prefix";
   std::string stereo_session = "pinhole";
   float nodata1, nodata2;
-  SessionPtr session(asp::StereoSessionFactory::create(stereo_session, opt,
-                                                       opt.raw_image, opt.ortho_image,
-                                                       opt.input_cam, opt.input_cam,
-                                                       out_prefix));
+  SessionPtr session;
+  {
+    // Creating a session and loading cameras can touch the global stereo
+    // settings, so do not do it for several frames at the same time.
+    static vw::Mutex session_mutex;
+    vw::Mutex::Lock lock(session_mutex);
+    session.reset(asp::StereoSessionFactory::create(stereo_session, opt,
+                                                    opt.raw_image, opt.ortho_image,
+                                                    opt.input_cam, opt.input_cam,
+                                                    out_prefix));
+    cam = session->camera_model(opt.raw_image, opt.input_cam);
+  }
   asp::get_nodata_values(rsrc_raw, rsrc_ortho, nodata1, nodata2);
   
-  cam = session->camera_model(opt.raw_image, opt.input_cam);
-  
   // Skip IP finding if the match file exists since the code will re-use it anyways.
   if (boost::filesystem::exists(match_filename)) {
     vw_out() << "Using existing match filename " << match_filename << std::endl;
@@ -431,9 +452,9 @@ void load_camera_and_find_ip(Options const& opt,
     ImageViewRef< PixelMask<float> > masked_image2
       = create_mask_less_or_equal(image2_view, nodata2);
     vw::Vector<vw::float32,6> image1_stats 
-      = asp::gather_stats(masked_image1, "raw", "", opt.raw_image);
+      = asp::gather_stats(masked_image1, "raw", "", opt.raw_image, nodata1);
     vw::Vector<vw::float32,6> image2_stats 
-      = asp::gather_stats(masked_image2, "ortho", "", opt.ortho_image);
+      = asp::gather_stats(masked_image2, "ortho", "", opt.ortho_image, nodata2);
     
     session->ip_matching(opt.raw_image, opt.ortho_image,
                          Vector2(masked_image1.cols(), masked_image1.rows()),
@@ -635,8 +656,22 @@ double refine_camera_with_dem_pts(Options const& opt,
 } // End function refine_camera_with_dem_pts
 
 
-// Primary task-solving function.
-void ortho2pinhole(Options & opt){
+/// When significant elevation change is present, the homography IP filter is not
+/// accurate and we need to compensate by relaxing our inlier threshold.
+void relax_inlier_threshold() {
+  // TODO: Decouple threshold from other params!
+  const double ELEVATION_INLIER_SCALE = 10;
+  asp::stereo_settings().epipolar_threshold
+    = 150*asp::stereo_settings().ip_inlier_factor * ELEVATION_INLIER_SCALE;
+  vw_out() << "Due to elevation change, increasing the inlier threshold to " 
+           << asp::stereo_settings().epipolar_threshold << std::endl;
+}
+
+// Primary task-solving function. Return false, without solving, if
+// significant elevation change is present and allow_elevation_change is
+// not set. Then the caller must call relax_inlier_threshold(), which
+// changes a global setting, and try again.
+bool ortho2pinhole(Options & opt, RefDem const& ref_dem, bool allow_elevation_change){
 
   // Input image handles
   boost::shared_ptr<DiskImageResource>
@@ -659,21 +694,12 @@ void ortho2pinhole(Options & opt){
   bool has_ref_dem = (opt.reference_dem != "");
   bool elevation_change_present = false;
   if (has_ref_dem) {
-    load_reference_dem(opt, rsrc_ortho, ortho_georef, dem, dem_georef, elevation_change_present);
+    load_reference_dem(opt, rsrc_ortho, ortho_georef, ref_dem, dem, dem_georef,
+                       elevation_change_present);
   }
   
-
-  // When significant elevation change is present, the homography IP filter is not
-  //  accurate and we need to compensate by relaxing our inlier threshold.
-  const double ELEVATION_INLIER_SCALE = 10;
-  if (elevation_change_present) {
-    // TODO: Decouple threshold from other params!
-    asp::stereo_settings().epipolar_threshold = 150*asp::stereo_settings().ip_inlier_factor * ELEVATION_INLIER_SCALE;
-    //asp::stereo_settings().ip_inlier_factor *= ELEVATION_INLIER_SCALE;
-    
-    vw_out() << "Due to elevation change, increasing ip_inlier_factor to " 
-             << asp::stereo_settings().ip_inlier_factor << std::endl;
-  }
+  if (elevation_change_present && !allow_elevation_change)
+    return false;
 
   // Load camera and find IP
   std::string match_filename = opt.output_cam + ".match";
@@ -686,7 +712,7 @@ void ortho2pinhole(Options & opt){
   vw_out() << "Using estimated cam height: " << cam_height << std::endl;
 
   std::vector<vw::ip::InterestPoint> raw_ip, ortho_ip;
-  ip::read_binary_match_file(match_filename, raw_ip, ortho_ip);
+  asp::read_match_file(match_filename, raw_ip, ortho_ip);
   vw::camera::PinholeModel *pcam = dynamic_cast<vw::camera::PinholeModel*>(cam.get());
   if (pcam == NULL) {
     vw_throw(ArgumentErr() << "Expecting a pinhole camera model.\n");
@@ -875,6 +901,8 @@ void ortho2pinhole(Options & opt){
     vw_out() << "Removing: " << match_filename << std::endl;
     boost::filesystem::remove(match_filename);
   }
+
+  return true;
 }  
 
 /// If an rgb input image was passed in, convert to a temporary grayscale
@@ -907,6 +935,127 @@ std::string handle_rgb_input(std::string const& input_path, Options const& opt)
 
 }
 
+/// Copy the position and pose of the estimated camera to the input camera
+/// and write it out, without using the ortho image.
+void short_circuit_camera(Options const& opt) {
+  vw_out() << "Creating camera without using ortho image.\n";
+
+  // Load input camera files
+  vw_out() << "Loading: " << opt.input_cam << std::endl;
+  PinholeModel input_cam(opt.input_cam);
+  vw_out() << "Loading: " << opt.camera_estimate << std::endl;
+  PinholeModel est_cam(opt.camera_estimate);
+
+  // Copy camera position and pose from estimate camera to input camera
+  input_cam.set_camera_center(est_cam.camera_center());
+  input_cam.set_camera_pose  (est_cam.camera_pose  ());
+
+  // Write to output camera
+  vw_out() << "Writing: " << opt.output_cam << std::endl;
+  input_cam.write(opt.output_cam);
+}
+
+/// Create the camera for one frame. The gray versions of rgb images
+/// replace the inputs in opt, so they are made only once if the frame
+/// is tried again. See ortho2pinhole() for the return value.
+bool process_frame(Options & opt, RefDem const& ref_dem, bool allow_elevation_change) {
+
+  if (opt.short_circuit) {
+    short_circuit_camera(opt);
+    return true;
+  }
+
+  opt.raw_image   = handle_rgb_input(opt.raw_image,   opt);
+  opt.ortho_image = handle_rgb_input(opt.ortho_image, opt);
+
+  return ortho2pinhole(opt, ref_dem, allow_elevation_change);
+}
+
+/// The status of a frame in a batch
+enum FrameStatus {FRAME_NOT_DONE, FRAME_DONE, FRAME_DEFERRED, FRAME_FAILED};
+
+/// Create the camera for one frame of a batch. A failure is recorded
+/// rather than thrown, so it does not stop the other frames.
+class FrameTask: public vw::Task, private boost::noncopyable {
+  Options      & m_opt;
+  RefDem const & m_ref_dem;
+  bool           m_allow_elevation_change;
+  FrameStatus  & m_status;
+
+public:
+  FrameTask(Options & opt, RefDem const& ref_dem, bool allow_elevation_change,
+            FrameStatus & status):
+    m_opt(opt), m_ref_dem(ref_dem), m_allow_elevation_change(allow_elevation_change),
+    m_status(status) {}
+
+  void operator()() {
+    try {
+      if (process_frame(m_opt, m_ref_dem, m_allow_elevation_change))
+        m_status = FRAME_DONE;
+      else
+        m_status = FRAME_DEFERRED;
+    } catch (std::exception const& e) {
+      vw_out() << "Failed to create camera " << m_opt.output_cam << ": "
+               << e.what() << std::endl;
+      m_status = FRAME_FAILED;
+    }
+  }
+};
+
+/// Read the frames to process. Each line has the raw image, ortho image,
+/// input camera, output camera, and optionally the estimated camera.
+void read_frame_list(Options const& opt, std::vector<Options> & frames) {
+
+  std::ifstream ifs(opt.frame_list.c_str());
+  if (!ifs.good())
+    vw_throw(ArgumentErr() << "Cannot read: " << opt.frame_list << "\n");
+
+  frames.clear();
+  std::string line;
+  while (getline(ifs, line)) {
+    std::istringstream iss(line);
+    Options frame = opt;
+    if (!(iss >> frame.raw_image >> frame.ortho_image >> frame.input_cam >> frame.output_cam))
+      continue; // Skip empty or malformed lines
+    if (!(iss >> frame.camera_estimate))
+      frame.camera_estimate = "";
+    vw::create_out_dir(frame.output_cam);
+    frames.push_back(frame);
+  }
+  vw_out() << "Read " << frames.size() << " frames from " << opt.frame_list << std::endl;
+}
+
+/// Process a batch of frames, several at a time, sharing the reference
+/// DEM. Frames with significant elevation change need a global setting
+/// changed, so they are deferred to a second pass.
+void process_frames(std::vector<Options> & frames, RefDem const& ref_dem) {
+
+  std::vector<FrameStatus> status(frames.size(), FRAME_NOT_DONE);
+  for (int pass = 0; pass < 2; pass++) {
+
+    bool allow_elevation_change = (pass == 1);
+    if (allow_elevation_change) {
+      if (std::find(status.begin(), status.end(), FRAME_DEFERRED) == status.end())
+        break;
+      relax_inlier_threshold();
+    }
+
+    FifoWorkQueue queue(frames[0].num_parallel_frames);
+    for (size_t it = 0; it < frames.size(); it++) {
+      if (status[it] != FRAME_NOT_DONE && status[it] != FRAME_DEFERRED)
+        continue;
+      boost::shared_ptr<FrameTask>
+        task(new FrameTask(frames[it], ref_dem, allow_elevation_change, status[it]));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+
+  int num_failed = std::count(status.begin(), status.end(), FRAME_FAILED);
+  vw_out() << "Created " << frames.size() - num_failed << " out of "
+           << frames.size() << " cameras.\n";
+}
+
 void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description general_options("");
   general_options.add_options()
@@ -941,7 +1090,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("reference-dem",             po::value(&opt.reference_dem)->default_value(""),
      "If provided, extract from this DEM the heights above the ground rather than assuming the value in --orthoimage-height.")
     ("crop-reference-dem", po::bool_switch(&opt.crop_reference_dem)->default_value(false)->implicit_value(true),
-     "Crop the reference DEM to a generous area to make it faster to load.");
+     "Crop the reference DEM to a generous area to make it faster to load.")
+    ("frame-list", po::value(&opt.frame_list)->default_value(""),
+     "Process many frames in one run, sharing the reference DEM. Each line of this file has the raw image, ortho image, input camera, output camera, and optionally the estimated camera. Then these are not passed on the command line.")
+    ("num-parallel-frames", po::value(&opt.num_parallel_frames)->default_value(1),
+     "With --frame-list, process this many frames at the same time. The threads are split among them.");
 
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
   
@@ -973,6 +1126,18 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   asp::stereo_settings().ip_inlier_factor         = opt.ip_inlier_factor;
   asp::stereo_settings().ip_per_tile              = opt.ip_per_tile;
 
+  if (opt.num_parallel_frames < 1)
+    vw_throw( ArgumentErr() << "The value of --num-parallel-frames must be positive.\n"
+              << usage << general_options );
+
+  if (opt.frame_list != "") {
+    // The frames are read later. Split the threads among parallel frames.
+    int num_threads = vw_settings().default_num_threads();
+    vw_settings().set_default_num_threads(std::max(1, num_threads / opt.num_parallel_frames));
+    asp::log_to_file(argc, argv, "", opt.frame_list);
+    return;
+  }
+
   if (opt.raw_image.empty())
     vw_throw( ArgumentErr() << "Missing input raw image.\n" << usage << general_options );
 
@@ -1008,30 +1173,24 @@ int main(int argc, char* argv[]) {
   Options opt;
   try {
     handle_arguments( argc, argv, opt );
-   
-    if (opt.short_circuit) {
-      vw_out() << "Creating camera without using ortho image.\n";
-  
-      // Load input camera files
-      vw_out() << "Loading: " << opt.input_cam << std::endl;
-      PinholeModel input_cam(opt.input_cam);
-      vw_out() << "Loading: " << opt.camera_estimate << std::endl;
-      PinholeModel est_cam(opt.camera_estimate);
-    
-      // Copy camera position and pose from estimate camera to input camera
-      input_cam.set_camera_center(est_cam.camera_center());
-      input_cam.set_camera_pose  (est_cam.camera_pose  ());
-    
-      // Write to output camera
-      vw_out() << "Writing: " << opt.output_cam << std::endl;
-      input_cam.write(opt.output_cam);
+
+    // The reference DEM is opened once, even for many frames
+    RefDem ref_dem;
+    if (opt.reference_dem != "" && !opt.short_circuit)
+      open_reference_dem(opt.reference_dem, ref_dem);
+
+    if (opt.frame_list != "") {
+      std::vector<Options> frames;
+      read_frame_list(opt, frames);
+      if (!frames.empty())
+        process_frames(frames, ref_dem);
       return 0;
     }
-  
-    opt.raw_image   = handle_rgb_input(opt.raw_image,   opt);
-    opt.ortho_image = handle_rgb_input(opt.ortho_image, opt);
-  
-    ortho2pinhole(opt);
+
+    if (!process_frame(opt, ref_dem, false)) {
+      relax_inlier_threshold();
+      process_frame(opt, ref_dem, true);
+    }
   } ASP_STANDARD_CATCHES;
   return 0;
 }
@@ -31,10 +31,18 @@
 #include <vw/Image/PixelTypeInfo.h>
 #include <asp/IsisIO/DiskImageResourceIsis.h>
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <Cube.h>
+#include <IString.h>
 #include <Portal.h>
+#include <Pvl.h>
 #include <SpecialPixel.h>
 
 using namespace std;
@@ -42,6 +50,34 @@ using namespace boost;
 
 namespace vw {
 
+  namespace {
+
+    // Read exactly this many bytes at this offset, or throw
+    void pread_all(int fd, uint8 * data, size_t len, int64 offset,
+                   std::string const& filename) {
+      while (len > 0) {
+        ssize_t count = ::pread(fd, data, len, offset);
+        if (count <= 0)
+          vw_throw(IOErr() << "DiskImageResourceIsis: Could not read from: "
+                   << filename << ".\n");
+        data   += count;
+        len    -= count;
+        offset += count;
+      }
+    }
+
+    bool host_is_lsb() {
+      uint16 val = 1;
+      return *(reinterpret_cast<uint8*>(&val)) == 1;
+    }
+
+  } // end anonymous namespace
+
+  DiskImageResourceIsis::~DiskImageResourceIsis() {
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+
   // We use a fixed tile size of 2048x2048 pixels here.  Although this
   // may not be the native tile size of the ISIS cube, it seems to be
   // much faster to let the ISIS driver aggregate smaller blocks by
@@ -60,6 +96,8 @@ namespace vw {
   /// Bind the resource to a file for reading.  Confirm that we can open
   /// the file and that it has a sane pixel format.
   void DiskImageResourceIsis::open(std::string const& filename) {
+    m_direct_read = false;
+    m_fd          = -1;
     m_cube     = boost::shared_ptr<Isis::Cube>(new Isis::Cube());
     m_filename = filename;
     m_cube->open(QString::fromStdString(m_filename));
@@ -102,6 +140,145 @@ namespace vw {
       default:
         vw_throw(IOErr() << "DiskImageResourceIsis: Unknown pixel type.");
     }
+
+    m_num_bands = m_cube->bandCount();
+    init_direct_read();
+  }
+
+  /// Parse the label once, to see if the pixels can be read directly
+  void DiskImageResourceIsis::init_direct_read() {
+
+    Isis::Pvl & label = *m_cube->label();
+    if (!label.hasObject("IsisCube"))
+      return;
+    Isis::PvlObject & core = label.findObject("IsisCube").findObject("Core");
+
+    // Pixels in a separate file, or not stored as such
+    if (core.hasKeyword("^Core") || core.hasKeyword("^DnFile") ||
+        !core.hasKeyword("StartByte") || !core.hasKeyword("Format") ||
+        !core.hasGroup("Pixels"))
+      return;
+
+    std::string format = core["Format"][0].toStdString();
+    if (format == "Tile") {
+      if (!core.hasKeyword("TileSamples") || !core.hasKeyword("TileLines"))
+        return;
+      m_tiled = true;
+      m_tile_size = Vector2i(Isis::toInt(core["TileSamples"][0]),
+                             Isis::toInt(core["TileLines"][0]));
+      if (m_tile_size.x() <= 0 || m_tile_size.y() <= 0)
+        return;
+    } else if (format == "BandSequential") {
+      m_tiled = false;
+    } else {
+      return;
+    }
+
+    Isis::PvlGroup & pixels = core.findGroup("Pixels");
+    if (!pixels.hasKeyword("ByteOrder"))
+      return;
+    std::string byte_order = pixels["ByteOrder"][0].toStdString();
+    if (byte_order != "Lsb" && byte_order != "Msb")
+      return;
+    m_swap_bytes = ((byte_order == "Lsb") != host_is_lsb());
+
+    // StartByte is 1-based
+    m_start_byte = Isis::toBigInt(core["StartByte"][0]) - 1;
+    if (m_start_byte < 0)
+      return;
+
+    m_fd = ::open(m_filename.c_str(), O_RDONLY);
+    if (m_fd < 0)
+      return;
+
+    m_direct_read = true;
+  }
+
+  /// Read the pixels in the box from the file, for all bands, without
+  /// going through the ISIS API. The pixels are kept as stored, including
+  /// the ISIS special pixel values, as the ISIS API read does.
+  void DiskImageResourceIsis::read_direct(ImageBuffer const& dest,
+                                          BBox2i const& bbox) const {
+
+    int    cols = m_format.cols, rows = m_format.rows;
+    int    w = bbox.width(), h = bbox.height(), bpp = m_bytes_per_pixel;
+    if (!BBox2i(0, 0, cols, rows).contains(bbox) || bbox.empty())
+      vw_throw(IOErr() << "DiskImageResourceIsis: requested bbox " << bbox
+               << " is not within the image dimensions [" << cols << " " << rows << "]");
+    size_t band_bytes = size_t(w) * h * bpp;
+    std::vector<uint8> data(band_bytes * m_num_bands);
+
+    for (int band = 0; band < m_num_bands; band++) {
+      uint8 * band_data = &data[band * band_bytes];
+
+      if (!m_tiled) {
+        // Each line of the box is contiguous in the file
+        for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+          int64 offset = m_start_byte
+            + ((int64(band) * rows + row) * cols + bbox.min().x()) * bpp;
+          pread_all(m_fd, band_data + size_t(row - bbox.min().y()) * w * bpp,
+                    size_t(w) * bpp, offset, m_filename);
+        }
+        continue;
+      }
+
+      // Tiled. The edge tiles are padded to the full size. The tiles
+      // in a row of tiles are contiguous, so each row is one read.
+      int   ts = m_tile_size.x(), tl = m_tile_size.y();
+      int64 tiles_per_row = (cols + ts - 1) / ts, tiles_per_col = (rows + tl - 1) / tl;
+      int64 tile_bytes = int64(ts) * tl * bpp;
+      int   tc0 = bbox.min().x() / ts, tc1 = (bbox.max().x() - 1) / ts;
+      int   tr0 = bbox.min().y() / tl, tr1 = (bbox.max().y() - 1) / tl;
+      std::vector<uint8> run((tc1 - tc0 + 1) * tile_bytes);
+      for (int tr = tr0; tr <= tr1; tr++) {
+        int64 offset = m_start_byte
+          + ((int64(band) * tiles_per_col + tr) * tiles_per_row + tc0) * tile_bytes;
+        pread_all(m_fd, run.data(), run.size(), offset, m_filename);
+
+        int row_beg = std::max(bbox.min().y(), tr * tl);
+        int row_end = std::min(bbox.max().y(), (tr + 1) * tl);
+        for (int row = row_beg; row < row_end; row++) {
+          for (int tc = tc0; tc <= tc1; tc++) {
+            int col_beg = std::max(bbox.min().x(), tc * ts);
+            int col_end = std::min(bbox.max().x(), (tc + 1) * ts);
+            const uint8 * src = run.data() + (tc - tc0) * tile_bytes
+              + (int64(row - tr * tl) * ts + (col_beg - tc * ts)) * bpp;
+            uint8 * dst = band_data
+              + (size_t(row - bbox.min().y()) * w + (col_beg - bbox.min().x())) * bpp;
+            std::memcpy(dst, src, size_t(col_end - col_beg) * bpp);
+          }
+        }
+      }
+    }
+
+    if (m_swap_bytes && bpp > 1) {
+      for (size_t it = 0; it < data.size(); it += bpp)
+        std::reverse(data.begin() + it, data.begin() + it + bpp);
+    }
+
+    // With 2 to 4 bands the bands are the channels of one plane, so
+    // they must be interleaved.
+    ImageBuffer src;
+    src.format = m_format;
+    src.format.cols = w;
+    src.format.rows = h;
+    if (m_format.planes == 1 && m_num_bands > 1) {
+      std::vector<uint8> interleaved(data.size());
+      for (int band = 0; band < m_num_bands; band++) {
+        for (size_t pix = 0; pix < size_t(w) * h; pix++)
+          std::memcpy(&interleaved[(pix * m_num_bands + band) * bpp],
+                      &data[band * band_bytes + pix * bpp], bpp);
+      }
+      data.swap(interleaved);
+      src.cstride = bpp * m_num_bands;
+    } else {
+      src.cstride = bpp;
+    }
+    src.data    = data.data();
+    src.rstride = src.cstride * w;
+    src.pstride = src.rstride * h;
+
+    convert(dest, src);
   }
 
   /// Read the disk image into the given buffer.
@@ -112,6 +289,11 @@ namespace vw {
               << " exceeds image dimensions [" << m_cube->sampleCount()
               << " " << m_cube->lineCount() << "]");
 
+    if (m_direct_read) {
+      read_direct(dest, bbox);
+      return;
+    }
+
     // Read in the requested tile from the cube file.  Note that ISIS
     // cube pixel indices appear to be 1-based.
     Isis::Portal buffer(bbox.width(), bbox.height(), m_cube->pixelType());
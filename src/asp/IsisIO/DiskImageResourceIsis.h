@@ -45,7 +45,7 @@ namespace vw {
       create(filename, format);
     }
 
-    virtual ~DiskImageResourceIsis() {}
+    virtual ~DiskImageResourceIsis();
 
     /// Returns the type of disk image resource.
     static std::string type_static() { return "ISIS"; }
@@ -85,6 +85,20 @@ namespace vw {
     std::string m_filename;
     int         m_bytes_per_pixel;
     Vector2i    m_native_block_size;
+
+    // For cubes with the pixels in the same file as the label, in the
+    // tiled or band sequential layout, the pixels are read directly
+    // with pread(), rather than through the ISIS API. Such reads share
+    // no state, so they are safe from multiple threads.
+    bool        m_direct_read;
+    int         m_fd;
+    int         m_num_bands;
+    bool        m_tiled, m_swap_bytes;
+    int64       m_start_byte;
+    Vector2i    m_tile_size;
+
+    void init_direct_read();
+    void read_direct(ImageBuffer const& dest, BBox2i const& bbox) const;
   };
 
 } // namespace vw
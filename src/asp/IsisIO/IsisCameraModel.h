@@ -31,19 +31,66 @@
 // ASP
 #include <asp/IsisIO/IsisInterface.h>
 
+#include <boost/shared_ptr.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
 namespace vw {
 namespace camera {
 
   // This is largely just a shortened reimplementation of ISIS's
   // Camera.cpp.
+  //
+  // An ISIS camera keeps the state of the last computation, so it
+  // cannot be shared among threads. Instead, this keeps a pool of
+  // interfaces to the same cube, and each call borrows one which is not
+  // in use, making a new one if none is free. So there are as many
+  // interfaces as threads using this camera at the same time.
   class IsisCameraModel : public CameraModel {
 
+    // Borrow an interface from the pool for the lifetime of this object
+    class InterfaceLock {
+    public:
+      InterfaceLock(IsisCameraModel const& model): m_model(model) {
+        {
+          std::lock_guard<std::mutex> lock(m_model.m_pool_mutex);
+          if (!m_model.m_pool.empty()) {
+            m_interface = m_model.m_pool.back();
+            m_model.m_pool.pop_back();
+          }
+        }
+        if (!m_interface)
+          m_interface = m_model.make_interface();
+      }
+      ~InterfaceLock() {
+        std::lock_guard<std::mutex> lock(m_model.m_pool_mutex);
+        m_model.m_pool.push_back(m_interface);
+      }
+      asp::isis::IsisInterface* operator->() const { return m_interface.get(); }
+    private:
+      IsisCameraModel const& m_model;
+      boost::shared_ptr<asp::isis::IsisInterface> m_interface;
+    };
+
+    // Loading an ISIS camera reads SPICE data with NAIF routines, which
+    // are not thread-safe, so only one interface is made at a time.
+    boost::shared_ptr<asp::isis::IsisInterface> make_interface() const {
+      static std::mutex open_mutex;
+      std::lock_guard<std::mutex> lock(open_mutex);
+      return boost::shared_ptr<asp::isis::IsisInterface>
+        (asp::isis::IsisInterface::open(m_cube_filename));
+    }
+
   public:
     //------------------------------------------------------------------
     // Constructors / Destructors
     //------------------------------------------------------------------
-    IsisCameraModel(std::string cube_filename) :
-      m_interface(asp::isis::IsisInterface::open( cube_filename )) {}
+    IsisCameraModel(std::string cube_filename): m_cube_filename(cube_filename) {
+      m_interface = make_interface();
+      m_pool.push_back(m_interface);
+    }
     virtual std::string type() const { return "Isis"; }
 
     //------------------------------------------------------------------
@@ -54,60 +101,65 @@ namespace camera {
     //  image plane.  Returns a pixel location (col, row) where the
     //  point appears in the image.
     virtual Vector2 point_to_pixel(Vector3 const& point) const {
-      return m_interface->point_to_pixel( point ); }
+      return InterfaceLock(*this)->point_to_pixel( point ); }
 
     // Returns a (normalized) pointing vector from the camera center
     //  through the position of the pixel 'pix' on the image plane.
     virtual Vector3 pixel_to_vector (Vector2 const& pix) const {
-      return m_interface->pixel_to_vector( pix ); }
+      return InterfaceLock(*this)->pixel_to_vector( pix ); }
 
 
     // Returns the position of the focal point of the camera
     virtual Vector3 camera_center(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_center( pix ); }
+      return InterfaceLock(*this)->camera_center( pix ); }
 
     // Pose is a rotation which moves a vector in camera coordinates
     // into world coordinates.
     virtual Quat camera_pose(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_pose( pix ); }
+      return InterfaceLock(*this)->camera_pose( pix ); }
 
     // Returns the number of lines is the ISIS cube
-    int lines() const { return m_interface->lines(); }
+    int lines() const { return InterfaceLock(*this)->lines(); }
 
     // Returns the number of samples in the ISIS cube
-    int samples() const{ return m_interface->samples(); }
+    int samples() const{ return InterfaceLock(*this)->samples(); }
 
     // Returns the serial number of the ISIS cube
     std::string serial_number() const {
-      return m_interface->serial_number(); }
+      return InterfaceLock(*this)->serial_number(); }
 
     // Returns the ephemeris time for a pixel
     double ephemeris_time( Vector2 const& pix = Vector2() ) const {
-      return m_interface->ephemeris_time( pix );
+      return InterfaceLock(*this)->ephemeris_time( pix );
     }
 
     // Sun position in the target frame's inertial frame
     Vector3 sun_position( Vector2 const& pix = Vector2() ) const {
-      return m_interface->sun_position( pix );
+      return InterfaceLock(*this)->sun_position( pix );
     }
 
     // The three main radii that make up the spheroid. Z is out the polar region
     Vector3 target_radii() const {
-      return m_interface->target_radii();
+      return InterfaceLock(*this)->target_radii();
     }
 
     // The spheroid name
     std::string target_name() const {
-      return m_interface->target_name();
+      return InterfaceLock(*this)->target_name();
     }
 
     // The datum
     vw::cartography::Datum get_datum(bool use_sphere_for_non_earth) const {
-      return m_interface->get_datum(use_sphere_for_non_earth);
+      return InterfaceLock(*this)->get_datum(use_sphere_for_non_earth);
     }
     
   protected:
-    boost::shared_ptr<asp::isis::IsisInterface> m_interface;
+    std::string m_cube_filename;
+    boost::shared_ptr<asp::isis::IsisInterface> m_interface; // the first one, for printing
+
+    // The interfaces not in use
+    mutable std::mutex m_pool_mutex;
+    mutable std::vector<boost::shared_ptr<asp::isis::IsisInterface>> m_pool;
 
     friend std::ostream& operator<<( std::ostream&, IsisCameraModel const& );
   };
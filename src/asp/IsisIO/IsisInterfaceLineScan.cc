@@ -19,6 +19,7 @@
 #include <vw/Math/Matrix.h>
 #include <vw/Camera/CameraModel.h>
 #include <asp/IsisIO/IsisInterfaceLineScan.h>
+#include <asp/Core/StereoSettings.h>
 
 // Isis headers
 #include <Camera.h>
@@ -32,6 +33,8 @@
 #include <Angle.h>
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 #include <boost/smart_ptr/scoped_ptr.hpp>
 
@@ -46,6 +49,87 @@ IsisInterfaceLineScan::IsisInterfaceLineScan(std::string const& filename): IsisI
   m_distortmap = m_camera->DistortionMap();
   m_focalmap   = m_camera->FocalPlaneMap();
   m_detectmap  = m_camera->DetectorMap();
+
+  m_use_state_table = !asp::stereo_settings().isis_exact_linescan;
+  m_middle_et = 0.0;
+}
+
+void LineScanStateTable::set(double start_et, double et_step,
+                             std::vector<Vector3> const& centers,
+                             std::vector<Quat> const& poses) {
+  m_start_et = start_et;
+  m_et_step  = et_step;
+  m_centers  = centers;
+  m_poses    = poses;
+
+  // Keep consecutive quaternions in the same hemisphere, so that
+  // interpolating them does not go the long way around
+  for (size_t it = 1; it < m_poses.size(); it++) {
+    double dot = 0.0;
+    for (int c = 0; c < 4; c++)
+      dot += m_poses[it - 1][c] * m_poses[it][c];
+    if (dot < 0)
+      m_poses[it] = -1.0 * m_poses[it];
+  }
+}
+
+bool LineScanStateTable::interpolate(double et, Vector3 & center, Quat & pose) const {
+  if (m_centers.size() < 2 || m_et_step <= 0)
+    return false;
+
+  double pos = (et - m_start_et) / m_et_step;
+  if (!(pos >= 0.0) || pos > double(m_centers.size() - 1))
+    return false;
+
+  size_t i0 = std::min(size_t(pos), m_centers.size() - 2);
+  double t  = pos - double(i0);
+  center = (1.0 - t) * m_centers[i0] + t * m_centers[i0 + 1];
+  pose   = normalize((1.0 - t) * m_poses[i0] + t * m_poses[i0 + 1]);
+  return true;
+}
+
+// Sample the camera state uniformly in time, from the first to the last
+// image line, with as many samples as lines, but no more than a bound.
+// The orbit and pointing are smooth on the scale of a line.
+void IsisInterfaceLineScan::build_state_table() const {
+
+  const int MAX_NUM_SAMPLES = 100000;
+
+  m_detectmap->SetParent(1, m_alphacube.AlphaLine(1));
+  double first_et = m_camera->time().Et();
+  m_detectmap->SetParent(1, m_alphacube.AlphaLine(lines()));
+  double last_et = m_camera->time().Et();
+  m_detectmap->SetParent(1, m_alphacube.AlphaLine(lines() / 2));
+  m_middle_et = m_camera->time().Et();
+
+  // The detector map was moved
+  m_c_location = Vector2(std::numeric_limits<double>::quiet_NaN(),
+                         std::numeric_limits<double>::quiet_NaN());
+
+  double start_et = std::min(first_et, last_et), end_et = std::max(first_et, last_et);
+  int num_samples = std::max(std::min(lines(), MAX_NUM_SAMPLES), 2);
+  double et_step = (end_et - start_et) / double(num_samples - 1);
+  if (!(et_step > 0.0)) {
+    // A degenerate time range. Use the exact approach.
+    m_use_state_table = false;
+    return;
+  }
+
+  std::vector<Vector3> centers(num_samples);
+  std::vector<Quat>    poses(num_samples);
+  for (int it = 0; it < num_samples; it++) {
+    m_camera->setTime(Isis::iTime(start_et + it * et_step));
+    m_camera->instrumentPosition(&centers[it][0]);
+    centers[it] *= 1000; // Spice gives in km
+
+    std::vector<double> rot_inst = m_camera->instrumentRotation()->Matrix();
+    std::vector<double> rot_body = m_camera->bodyRotation()->Matrix();
+    MatrixProxy<double,3,3> R_inst(&(rot_inst[0]));
+    MatrixProxy<double,3,3> R_body(&(rot_body[0]));
+    poses[it] = Quat(R_body*transpose(R_inst));
+  }
+
+  m_state_table.set(start_et, et_step, centers, poses);
 }
 
 // Custom function to help avoid over invoking the deeply buried
@@ -75,6 +159,7 @@ class EphemerisLMA : public vw::math::LeastSquaresModelBase<EphemerisLMA> {
   Isis::Camera* m_camera;
   Isis::CameraDistortionMap *m_distortmap;
   Isis::CameraFocalPlaneMap *m_focalmap;
+  LineScanStateTable const* m_state_table; // may be null
 public:
   typedef vw::Vector<double> result_type; // Back project result
   typedef vw::Vector<double> domain_type; // Ephemeris time
@@ -83,7 +168,8 @@ public:
   inline EphemerisLMA(vw::Vector3 const& point,
                       Isis::Camera* camera,
                       Isis::CameraDistortionMap* distortmap,
-                      Isis::CameraFocalPlaneMap* focalmap) : m_point(point), m_camera(camera), m_distortmap(distortmap), m_focalmap(focalmap) {}
+                      Isis::CameraFocalPlaneMap* focalmap,
+                      LineScanStateTable const* state_table = NULL) : m_point(point), m_camera(camera), m_distortmap(distortmap), m_focalmap(focalmap), m_state_table(state_table) {}
 
   inline result_type operator()(domain_type const& x) const;
 };
@@ -93,20 +179,26 @@ public:
 EphemerisLMA::result_type
 EphemerisLMA::operator()(EphemerisLMA::domain_type const& x) const {
 
-  // Setting Ephemeris Time
-  m_camera->setTime(Isis::iTime(x[0]));
-
-  // Calculating the look direction in camera frame
-  Vector3 instru;
-  m_camera->instrumentPosition(&instru[0]);
-  instru *= 1000;  // Spice gives in km
-  Vector3 lookB = normalize(m_point - instru);
-  std::vector<double> lookB_copy(3);
-  std::copy(lookB.begin(), lookB.end(), lookB_copy.begin());
-  std::vector<double> lookJ = m_camera->bodyRotation()->J2000Vector(lookB_copy);
-  std::vector<double> lookC = m_camera->instrumentRotation()->ReferenceVector(lookJ);
-  Vector3 look;
-  std::copy(lookC.begin(), lookC.end(), look.begin());
+  // Calculating the look direction in camera frame, from the sampled
+  // camera state if available, which is much faster than SPICE
+  Vector3 look, center;
+  Quat pose;
+  if (m_state_table != NULL && m_state_table->interpolate(x[0], center, pose)) {
+    look = inverse(pose).rotate(normalize(m_point - center));
+  } else {
+    // Setting Ephemeris Time
+    m_camera->setTime(Isis::iTime(x[0]));
+
+    Vector3 instru;
+    m_camera->instrumentPosition(&instru[0]);
+    instru *= 1000;  // Spice gives in km
+    Vector3 lookB = normalize(m_point - instru);
+    std::vector<double> lookB_copy(3);
+    std::copy(lookB.begin(), lookB.end(), lookB_copy.begin());
+    std::vector<double> lookJ = m_camera->bodyRotation()->J2000Vector(lookB_copy);
+    std::vector<double> lookC = m_camera->instrumentRotation()->ReferenceVector(lookJ);
+    std::copy(lookC.begin(), lookC.end(), look.begin());
+  }
 
   // Projecting to mm focal plane
   look = m_camera->FocalLength() * (look / look[2]);
@@ -124,13 +216,22 @@ Vector2
 IsisInterfaceLineScan::point_to_pixel(Vector3 const& point) const {
 
 #if 1
-   // First seed LMA with an ephemeris time in the middle of the image
-  double middle = lines() / 2;
-  m_detectmap->SetParent(1, m_alphacube.AlphaLine(middle));
-  double start_e = m_camera->time().Et();
+  if (m_use_state_table && m_state_table.empty())
+    build_state_table();
+
+  // First seed LMA with an ephemeris time in the middle of the image
+  double start_e = m_middle_et;
+  if (!m_use_state_table) {
+    double middle = lines() / 2;
+    m_detectmap->SetParent(1, m_alphacube.AlphaLine(middle));
+    start_e = m_camera->time().Et();
+  }
 
-  // Build LMA
-  EphemerisLMA model(point, m_camera.get(), m_distortmap, m_focalmap);
+  // Build LMA. The trial times are evaluated with the sampled camera
+  // state. The pixel at the solution time is found below with the
+  // exact state.
+  EphemerisLMA model(point, m_camera.get(), m_distortmap, m_focalmap,
+                     m_use_state_table ? &m_state_table : NULL);
   int status;
   Vector<double> objective(1), start(1);
   start[0] = start_e;
@@ -28,6 +28,7 @@
 #include <asp/IsisIO/IsisInterface.h>
 
 #include <string>
+#include <vector>
 
 #include <AlphaCube.h>
 
@@ -40,6 +41,27 @@ namespace Isis {
 namespace asp {
 namespace isis {
 
+  /// The camera center and pose sampled uniformly in time, and
+  /// interpolated linearly in between.
+  class LineScanStateTable {
+  public:
+    LineScanStateTable(): m_start_et(0.0), m_et_step(0.0) {}
+
+    bool empty() const { return m_centers.empty(); }
+
+    void set(double start_et, double et_step,
+             std::vector<vw::Vector3> const& centers,
+             std::vector<vw::Quat> const& poses);
+
+    /// Return false if the time is out of range
+    bool interpolate(double et, vw::Vector3 & center, vw::Quat & pose) const;
+
+  private:
+    double m_start_et, m_et_step;
+    std::vector<vw::Vector3> m_centers;
+    std::vector<vw::Quat>    m_poses;
+  };
+
   class IsisInterfaceLineScan : public IsisInterface {
 
   public:
@@ -72,6 +94,14 @@ namespace isis {
     mutable vw::Vector3 m_center;
     mutable vw::Quat    m_pose;
     void SetTime(vw::Vector2 const& px, bool calc_pose = false) const;
+
+    // The camera state over the time range of the image, built on first
+    // use, so that point_to_pixel() does not go through SPICE for each
+    // trial time. Not used with --isis-exact-linescan.
+    mutable bool               m_use_state_table;
+    mutable LineScanStateTable m_state_table;
+    mutable double             m_middle_et;
+    void build_state_table() const;
   };
 
 }}
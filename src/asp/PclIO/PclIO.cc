@@ -18,16 +18,134 @@
 // Interface with PCL.
 
 #include <vw/Image/ImageViewRef.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/FileIO/FileUtils.h>
 #include <asp/PclIO/PclIO.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 
-#include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sstream>
+
 namespace asp {
+
+// The fields of each point in the binary PCD file. This is the layout of
+// pcl::PointNormal as written by PCL, without the padding.
+const int PCD_FIELDS_PER_POINT = 7;
+
+// The header of a binary PCD file with the given number of points
+std::string pcdHeader(std::int64_t num_points) {
+  std::ostringstream os;
+  os << "# .PCD v0.7 - Point Cloud Data file format\n"
+     << "VERSION 0.7\n"
+     << "FIELDS x y z normal_x normal_y normal_z curvature\n"
+     << "SIZE 4 4 4 4 4 4 4\n"
+     << "TYPE F F F F F F F\n"
+     << "COUNT 1 1 1 1 1 1 1\n"
+     << "WIDTH " << num_points << "\n"
+     << "HEIGHT 1\n"
+     << "VIEWPOINT 0 0 0 1 0 0 0\n"
+     << "POINTS " << num_points << "\n"
+     << "DATA binary\n";
+  return os.str();
+}
+
+// A point is written if it is not the zero point and has positive weight
+inline bool isValidPoint(vw::Vector<double, 4> const& Q, float wt) {
+  return subvector(Q, 0, 3) != vw::Vector3() && wt > 0;
+}
+
+// Write a binary PCD file tile by tile. A first pass counts the points in
+// each tile, which gives the header and the offset of each tile in the
+// file. A second pass packs the points of each tile and writes them at
+// that offset. Tiles are processed in parallel, and the full cloud is
+// never held in memory.
+void writePcdStreaming(vw::ImageViewRef<vw::Vector<double, 4>> cloud,
+                       vw::ImageViewRef<float> out_texture,
+                       vw::ImageViewRef<float> weight,
+                       std::string const& cloud_file) {
+
+  const int tile_size = 256;
+  std::vector<vw::BBox2i> tiles = subdivide_bbox(cloud, tile_size, tile_size);
+  int num_tiles = tiles.size();
+
+  // Count the points in each tile
+  std::vector<std::int64_t> counts(num_tiles, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int it = 0; it < num_tiles; it++) {
+    vw::ImageView<vw::Vector<double, 4>> pts = crop(cloud, tiles[it]);
+    vw::ImageView<float> wts = crop(weight, tiles[it]);
+    std::int64_t count = 0;
+    for (int col = 0; col < pts.cols(); col++) {
+      for (int row = 0; row < pts.rows(); row++) {
+        if (isValidPoint(pts(col, row), wts(col, row)))
+          count++;
+      }
+    }
+    counts[it] = count;
+  }
+
+  // The offset of each tile, in points
+  std::vector<std::int64_t> offsets(num_tiles + 1, 0);
+  for (int it = 0; it < num_tiles; it++)
+    offsets[it + 1] = offsets[it] + counts[it];
+
+  std::string header = pcdHeader(offsets[num_tiles]);
+  const std::int64_t point_size = PCD_FIELDS_PER_POINT * sizeof(float);
+
+  int fd = ::open(cloud_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    vw::vw_throw(vw::IOErr() << "Cannot write: " << cloud_file << "\n");
+
+  bool success = (::pwrite(fd, header.data(), header.size(), 0) == ssize_t(header.size()));
+
+  // Pack and write the points of each tile
+#pragma omp parallel for schedule(dynamic)
+  for (int it = 0; it < num_tiles; it++) {
+    if (counts[it] == 0)
+      continue;
+    vw::ImageView<vw::Vector<double, 4>> pts = crop(cloud, tiles[it]);
+    vw::ImageView<float> wts = crop(weight, tiles[it]);
+    vw::ImageView<float> tex = crop(out_texture, tiles[it]);
+
+    std::vector<float> buf(counts[it] * PCD_FIELDS_PER_POINT);
+    std::int64_t pos = 0;
+    for (int col = 0; col < pts.cols(); col++) {
+      for (int row = 0; row < pts.rows(); row++) {
+        vw::Vector<double, 4> const& Q = pts(col, row); // alias
+        if (!isValidPoint(Q, wts(col, row)))
+          continue;
+        buf[pos++] = Q[0];
+        buf[pos++] = Q[1];
+        buf[pos++] = Q[2];
+        // As expected by VoxBlox
+        buf[pos++] = tex(col, row); // intensity
+        buf[pos++] = wts(col, row); // weight
+        buf[pos++] = Q[3];          // intersection error
+        buf[pos++] = 0;             // curvature
+      }
+    }
+
+    std::int64_t num_bytes = buf.size() * sizeof(float);
+    off_t file_pos = header.size() + offsets[it] * point_size;
+    if (::pwrite(fd, &buf[0], num_bytes, file_pos) != ssize_t(num_bytes)) {
+#pragma omp critical
+      success = false;
+    }
+  }
+
+  if (::close(fd) != 0)
+    success = false;
+  if (!success)
+    vw::vw_throw(vw::IOErr() << "Failed writing: " << cloud_file << "\n");
+}
   
 void writeCloud(vw::ImageViewRef<vw::Vector<double, 4>> cloud,
                 vw::ImageViewRef<float> out_texture,
@@ -75,36 +193,8 @@ void writeCloud(vw::ImageViewRef<vw::Vector<double, 4>> cloud,
     pcl::io::savePLYFileBinary(cloud_file, pc);
 
   } else {
-        
     // Write pcd
-    pcl::PointCloud<pcl::PointNormal> pc;
-
-    pc.width = std::int64_t(cloud.cols()) * std::int64_t(cloud.rows()); 
-    pc.height = 1;
-    pc.points.resize(pc.width * pc.height);
-      
-    std::int64_t count = 0;
-    for (std::int64_t col = 0; col < cloud.cols(); col++) {
-      for (std::int64_t row = 0; row < cloud.rows(); row++) {
-        vw::Vector<double, 4> const& Q = cloud(col, row); // alias
-        if (subvector(Q, 0, 3) != vw::Vector3() && weight(col, row) > 0) {
-          pc.points[count].x         = Q[0];
-          pc.points[count].y         = Q[1];
-          pc.points[count].z         = Q[2];
-          // As expected by VoxBlox
-          pc.points[count].normal_x  = out_texture(col, row);  // intensity
-          pc.points[count].normal_y  = weight(col, row); // weight
-          pc.points[count].normal_z  = Q[3]; // intersection error
-          pc.points[count].curvature = 0;  // ensure initialization
-          count++;
-        }
-      }
-    }
-
-    pc.width = count;
-    pc.points.resize(pc.width * pc.height);
-    
-    pcl::io::savePCDFileBinary(cloud_file, pc);
+    writePcdStreaming(cloud, out_texture, weight, cloud_file);
   }
   
   return;
@@ -0,0 +1,69 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+#include <test/Helpers.h>
+#include <asp/PclIO/PclIO.h>
+
+#include <vw/Image/ImageView.h>
+
+#include <pcl/io/pcd_io.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace asp;
+
+// The streamed PCD file is read by PCL, with the valid points of all
+// tiles, including the partial tiles at the edges, and nothing else
+TEST(PclIO, StreamedPcd) {
+
+  vw::ImageView<vw::Vector<double, 4>> cloud(300, 270);
+  vw::ImageView<float> texture(cloud.cols(), cloud.rows());
+  vw::ImageView<float> weight(cloud.cols(), cloud.rows());
+  int num_valid = 0;
+  double sum_x = 0;
+  for (int row = 0; row < cloud.rows(); row++) {
+    for (int col = 0; col < cloud.cols(); col++) {
+      cloud(col, row) = vw::Vector<double, 4>(col + 1, row, 1.5, 0.25);
+      texture(col, row) = 2.0;
+      weight(col, row) = ((col + row) % 3 == 0) ? 0.0 : 0.5;
+      if (row == 7)
+        cloud(col, row) = vw::Vector<double, 4>();
+      if (weight(col, row) > 0 && row != 7) {
+        num_valid++;
+        sum_x += col + 1;
+      }
+    }
+  }
+
+  std::string file = "pclio_test.pcd";
+  writeCloud(cloud, texture, weight, file);
+
+  pcl::PointCloud<pcl::PointNormal> pc;
+  ASSERT_EQ(0, pcl::io::loadPCDFile(file, pc));
+  ASSERT_EQ(size_t(num_valid), pc.points.size());
+
+  double out_sum_x = 0;
+  for (size_t it = 0; it < pc.points.size(); it++) {
+    EXPECT_EQ(1.5,  pc.points[it].z);
+    EXPECT_EQ(2.0,  pc.points[it].normal_x);
+    EXPECT_EQ(0.5,  pc.points[it].normal_y);
+    EXPECT_EQ(0.25, pc.points[it].normal_z);
+    out_sum_x += pc.points[it].x;
+  }
+  EXPECT_EQ(sum_x, out_sum_x);
+
+  boost::filesystem::remove(file);
+}
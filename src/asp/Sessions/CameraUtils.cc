@@ -24,10 +24,13 @@
 #include <asp/Camera/CsmModel.h>
 
 #include <vw/Core/Exception.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/InterestPoint/InterestData.h>
 
+#include <boost/noncopyable.hpp>
+
 #include <string>
 #include <iostream>
 
@@ -37,7 +40,96 @@ using namespace vw;
 
 namespace asp {
 
-// Load cameras from given image and camera files
+namespace {
+
+// Load one camera, with a session of its own. The session name may
+// be refined. Set single_threaded if the camera cannot be used from
+// multiple threads.
+boost::shared_ptr<vw::camera::CameraModel>
+load_camera(std::string const& image_file, std::string const& camera_file,
+            std::string const& out_prefix, vw::GdalWriteOptions const& opt,
+            bool approximate_pinhole_intrinsics,
+            std::string & stereo_session, // may change
+            bool & single_threaded, bool & parallel_load) {
+
+  vw_out(DebugMessage,"asp") << "Loading: " << image_file << ' ' << camera_file << "\n";
+    
+  // The same camera is double-loaded into the same session instance.
+  // TODO: One day replace this with a simpler camera model loader class.
+  // But note that this call also refines the stereo session name.
+  SessionPtr session
+    (asp::StereoSessionFactory::create(stereo_session, opt,
+                                       image_file, image_file,
+                                       camera_file, camera_file,
+                                       out_prefix));
+    
+  boost::shared_ptr<vw::camera::CameraModel> cam
+    = session->camera_model(image_file, camera_file);
+    
+  // The ISIS session is not multi-threaded, as ISIS cameras are not.
+  // But the ISIS camera models used here keep an ISIS camera for each
+  // thread using them, and the session may also load CSM cameras, so
+  // those can be used from multiple threads.
+  std::string cam_type = cam->type();
+  single_threaded = (!session->supports_multi_threading() &&
+                     cam_type != "Isis" && cam_type != "CSM");
+
+  // Loading ISIS cameras is not thread-safe, and loading cameras for
+  // mapprojected images changes the global bundle adjust prefix.
+  parallel_load = (session->supports_multi_threading() && !session->isMapProjected());
+    
+  if (approximate_pinhole_intrinsics) {
+    boost::shared_ptr<vw::camera::PinholeModel> pinhole_ptr = 
+      boost::dynamic_pointer_cast<vw::camera::PinholeModel>(cam);
+    // Replace lens distortion with fast approximation
+    vw::camera::update_pinhole_for_fast_point2pixel<vw::camera::TsaiLensDistortion>
+      (*(pinhole_ptr.get()), file_image_size(image_file));
+  }
+
+  return cam;
+}
+
+// Load a camera on a thread. An error is recorded rather than thrown.
+class LoadCameraTask: public vw::Task, private boost::noncopyable {
+  std::string const& m_image_file;
+  std::string const& m_camera_file;
+  std::string const& m_out_prefix;
+  vw::GdalWriteOptions const& m_opt;
+  bool m_approximate_pinhole_intrinsics;
+  std::string m_stereo_session;
+  boost::shared_ptr<vw::camera::CameraModel> & m_cam;
+  char & m_single_threaded;
+  std::string & m_error;
+
+public:
+  LoadCameraTask(std::string const& image_file, std::string const& camera_file,
+                 std::string const& out_prefix, vw::GdalWriteOptions const& opt,
+                 bool approximate_pinhole_intrinsics, std::string const& stereo_session,
+                 boost::shared_ptr<vw::camera::CameraModel> & cam,
+                 char & single_threaded, std::string & error):
+    m_image_file(image_file), m_camera_file(camera_file), m_out_prefix(out_prefix),
+    m_opt(opt), m_approximate_pinhole_intrinsics(approximate_pinhole_intrinsics),
+    m_stereo_session(stereo_session), m_cam(cam), m_single_threaded(single_threaded),
+    m_error(error) {}
+
+  void operator()() {
+    try {
+      bool single_threaded = false, parallel_load = false;
+      m_cam = load_camera(m_image_file, m_camera_file, m_out_prefix, m_opt,
+                          m_approximate_pinhole_intrinsics, m_stereo_session,
+                          single_threaded, parallel_load);
+      m_single_threaded = single_threaded;
+    } catch (std::exception const& e) {
+      m_error = e.what();
+    }
+  }
+};
+
+} // end anonymous namespace
+
+// Load cameras from given image and camera files. The first camera
+// determines the session. If that session supports multi-threading, the
+// other cameras are loaded on multiple threads.
 void load_cameras(std::vector<std::string> const& image_files,
                   std::vector<std::string> const& camera_files,
                   std::string const& out_prefix, 
@@ -54,35 +146,52 @@ void load_cameras(std::vector<std::string> const& image_files,
   
   if (image_files.size() != camera_files.size()) 
     vw_throw(ArgumentErr() << "Expecting as many images as cameras.\n");  
-  
-  for (size_t i = 0; i < image_files.size(); i++) {
-    vw_out(DebugMessage,"asp") << "Loading: " << image_files [i] << ' '
-                               << camera_files[i] << "\n";
-    
-    // The same camera is double-loaded into the same session instance.
-    // TODO: One day replace this with a simpler camera model loader class.
-    // But note that this call also refines the stereo session name.
-    SessionPtr session
-      (asp::StereoSessionFactory::create(stereo_session, opt,
-                                         image_files [i], image_files [i],
-                                         camera_files[i], camera_files[i],
-                                         out_prefix));
-    
-    camera_models.push_back(session->camera_model(image_files [i],
-                                                  camera_files[i]));
-    
-    // This is necessary to avoid a crash with ISIS cameras which is single-threaded
-    if (!session->supports_multi_threading())
-      single_threaded_cameras = true;
-    
-    if (approximate_pinhole_intrinsics) {
-      boost::shared_ptr<vw::camera::PinholeModel> pinhole_ptr = 
-        boost::dynamic_pointer_cast<vw::camera::PinholeModel>(camera_models.back());
-      // Replace lens distortion with fast approximation
-      vw::camera::update_pinhole_for_fast_point2pixel<vw::camera::TsaiLensDistortion>
-        (*(pinhole_ptr.get()), file_image_size(image_files[i]));
+
+  size_t num_cams = image_files.size();
+  if (num_cams == 0)
+    return;
+
+  camera_models.resize(num_cams);
+  std::vector<char> single_threaded(num_cams, false);
+  bool single = false, parallel_load = false;
+  camera_models[0] = load_camera(image_files[0], camera_files[0], out_prefix, opt,
+                                 approximate_pinhole_intrinsics, stereo_session,
+                                 single, parallel_load);
+  single_threaded[0] = single;
+
+  if (!parallel_load || num_cams == 1) {
+    for (size_t i = 1; i < num_cams; i++) {
+      camera_models[i] = load_camera(image_files[i], camera_files[i], out_prefix, opt,
+                                     approximate_pinhole_intrinsics, stereo_session,
+                                     single, parallel_load);
+      single_threaded[i] = single;
     }
-  } // End loop through images loading all the camera models
+  } else {
+    int num_threads = vw_settings().default_num_threads();
+    vw_out() << "Loading " << num_cams << " cameras using "
+             << num_threads << " threads.\n";
+    std::vector<std::string> errors(num_cams);
+    FifoWorkQueue queue(num_threads);
+    for (size_t i = 1; i < num_cams; i++) {
+      boost::shared_ptr<LoadCameraTask>
+        task(new LoadCameraTask(image_files[i], camera_files[i], out_prefix, opt,
+                                approximate_pinhole_intrinsics, stereo_session,
+                                camera_models[i], single_threaded[i], errors[i]));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    for (size_t i = 1; i < num_cams; i++) {
+      if (errors[i] != "")
+        vw_throw(ArgumentErr() << "Failed to load the camera for image "
+                 << image_files[i] << ": " << errors[i] << "\n");
+    }
+  }
+
+  for (size_t i = 0; i < num_cams; i++) {
+    if (single_threaded[i])
+      single_threaded_cameras = true;
+  }
   
   return;
 }
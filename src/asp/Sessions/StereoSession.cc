@@ -22,7 +22,9 @@
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Camera/AdjustedLinescanDGModel.h>
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/InstrumentedCameraModel.h>
 #include <asp/Core/AspStringUtils.h>
+#include <asp/Core/PreprocCache.h>
 
 #include <vw/Core/Exception.h>
 #include <vw/Core/Log.h>
@@ -39,11 +41,17 @@
 #include <vw/Core/Stopwatch.h>
 #include <boost/filesystem/operations.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <map>
 #include <utility>
 #include <string>
+#include <sstream>
 #include <ostream>
 #include <limits>
+#include <mutex>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -78,12 +86,6 @@ namespace asp {
     if (!isMapProjected()) // Nothing to do for non map-projected types.
       return;
 
-    // Back up the bundle-adjust prefix that should be used only with the
-    // original camera model, not with the model used in mapprojection
-    // (e.g., the original camera model could have been DG, but in
-    // map-projection we could have used RPC).
-    std::string ba_pref_bk = stereo_settings().bundle_adjust_prefix;
-
     // Load the name of the camera model, session, and DEM used in mapprojection
     // based on the record in that image. Load the bundle adjust prefix from the
     // mapprojected image. It can be empty, when such a prefix was not used in
@@ -154,9 +156,46 @@ namespace asp {
           << "Command line DEM: " << m_input_dem << "\n");
     }
 
+    m_left_map_proj_info.cam_type    = l_cam_type;
+    m_left_map_proj_info.adj_prefix  = l_adj_prefix;
+    m_left_map_proj_info.cam_file    = curr_left_camera_file;
+    m_right_map_proj_info.cam_type   = r_cam_type;
+    m_right_map_proj_info.adj_prefix = r_adj_prefix;
+    m_right_map_proj_info.cam_file   = curr_right_camera_file;
+
+    // Double check that we can read the DEM and that it has cartographic information.
+    VW_ASSERT(!m_input_dem.empty(), InputErr() << "StereoSession: Require input DEM." );
+    if (!boost::filesystem::exists(m_input_dem))
+      vw_throw(ArgumentErr() << "StereoSession: DEM '" << m_input_dem << "' does not exist.");
+  }
+
+  // Load the cameras used in mapprojection. Loading some cameras, such
+  // as ISIS ones, is slow, so this is done only by the steps which need
+  // them, and only once.
+  void StereoSession::load_map_proj_models() const {
+
+    // This temporarily changes the global bundle adjust prefix
+    static std::mutex load_mutex;
+    std::lock_guard<std::mutex> lock(load_mutex);
+    if (m_left_map_proj_model && m_right_map_proj_model)
+      return;
+
+    // Back up the bundle-adjust prefix that should be used only with the
+    // original camera model, not with the model used in mapprojection
+    // (e.g., the original camera model could have been DG, but in
+    // map-projection we could have used RPC).
+    std::string ba_pref_bk = stereo_settings().bundle_adjust_prefix;
+
     // When loading camera models from the image files, we either use the sensor model for
     // the current session type or else the RPC model which is often used as an approximation.
     const Vector2 zero_pixel_offset(0,0);
+    std::string const& l_adj_prefix = m_left_map_proj_info.adj_prefix;
+    std::string const& r_adj_prefix = m_right_map_proj_info.adj_prefix;
+    std::string const& l_cam_type   = m_left_map_proj_info.cam_type;
+    std::string const& r_cam_type   = m_right_map_proj_info.cam_type;
+    std::string const& curr_left_camera_file  = m_left_map_proj_info.cam_file;
+    std::string const& curr_right_camera_file = m_right_map_proj_info.cam_file;
+
     stereo_settings().bundle_adjust_prefix = "";
     if (l_adj_prefix != "" && l_adj_prefix != "NONE")
       stereo_settings().bundle_adjust_prefix = l_adj_prefix;
@@ -196,11 +235,6 @@ namespace asp {
     VW_ASSERT( m_left_map_proj_model.get() && m_right_map_proj_model.get(),
               ArgumentErr() << "StereoSession: Unable to locate map "
               << "projection camera model inside input files!" );
-
-    // Double check that we can read the DEM and that it has cartographic information.
-    VW_ASSERT(!m_input_dem.empty(), InputErr() << "StereoSession: Require input DEM." );
-    if (!boost::filesystem::exists(m_input_dem))
-      vw_throw(ArgumentErr() << "StereoSession: DEM '" << m_input_dem << "' does not exist.");
   }
 
   // Peek inside the images and camera models and return the datum and projection,
@@ -260,6 +294,15 @@ namespace asp {
     cam2 = camera_model(m_right_image_file, m_right_camera_file);
   }
 
+  void StereoSession::instrumented_camera_models
+  (boost::shared_ptr<vw::camera::CameraModel> &cam1,
+   boost::shared_ptr<vw::camera::CameraModel> &cam2,
+   std::string const& call_site) {
+    this->camera_models(cam1, cam2);
+    cam1 = asp::instrument_camera(cam1, call_site + ".left");
+    cam2 = asp::instrument_camera(cam2, call_site + ".right");
+  }
+
 boost::shared_ptr<vw::camera::CameraModel>
 StereoSession::camera_model(std::string const& image_file, std::string const& camera_file,
                             bool quiet) {
@@ -304,6 +347,39 @@ StereoSession::camera_model(std::string const& image_file, std::string const& ca
   return m_camera_model[image_cam_pair];
 }
 
+// The products of preprocessing the left image do not depend on the right
+// image when the images are normalized individually, the left image is not
+// transformed by the alignment, and its mask is not intersected with the
+// right one. With homography alignment the left image is left as it is
+// only when its size is not adjusted, as for multiview stereo.
+std::string StereoSession::left_preprocessing_cache_key(bool adjust_left_image_size) const {
+
+  std::string const& alignment_method = stereo_settings().alignment_method;
+  bool left_not_aligned = (alignment_method == "none" ||
+                           (alignment_method == "homography" && !adjust_left_image_size));
+  bool crop_left = (stereo_settings().left_image_crop_win != BBox2i(0, 0, 0, 0));
+
+  if (stereo_settings().preprocess_cache_dir == ""    ||
+      !this->supports_preprocessing_cache()           ||
+      !stereo_settings().individually_normalize        ||
+      !left_not_aligned || crop_left || !m_input_dem.empty() ||
+      this->do_bathymetry()                            ||
+      (stereo_settings().nodata_stddev_kernel > 0 &&
+       stereo_settings().nodata_stddev_thresh < 0)) // writes debug images instead
+    return "";
+
+  std::ostringstream os;
+  os.precision(17);
+  os << asp::preproc_cache_image_description(m_left_image_file)
+     << this->name() << " " << alignment_method << " "
+     << stereo_settings().force_use_entire_range << " "
+     << stereo_settings().nodata_value << " "
+     << stereo_settings().nodata_pixel_percentage << " "
+     << stereo_settings().nodata_stddev_kernel << " "
+     << stereo_settings().nodata_stddev_thresh << "\n";
+  return asp::preproc_cache_key(os.str());
+}
+
 // Default preprocessing hook. Some sessions may override it.
 void StereoSession::preprocessing_hook(bool adjust_left_image_size,
                                        std::string const& left_input_file,
@@ -347,13 +423,15 @@ void StereoSession::preprocessing_hook(bool adjust_left_image_size,
   vw::Stopwatch sw1;
   sw1.start();
   Vector6f left_stats  = gather_stats(left_masked_image,  "left",
-                                      this->m_out_prefix, left_cropped_file);
+                                      this->m_out_prefix, left_cropped_file,
+                                      left_nodata_value);
   sw1.stop();  
   vw_out() << "Left image stats time: " << sw1.elapsed_seconds() << std::endl;
   vw::Stopwatch sw2;
   sw2.start();  
   Vector6f right_stats = gather_stats(right_masked_image, "right",
-                                      this->m_out_prefix, right_cropped_file);
+                                      this->m_out_prefix, right_cropped_file,
+                                      right_nodata_value);
   sw2.stop();
   vw_out() << "Right image stats time: " << sw2.elapsed_seconds() << std::endl;
   ImageViewRef<PixelMask<float>> Limg, Rimg;
@@ -433,15 +511,30 @@ void StereoSession::preprocessing_hook(bool adjust_left_image_size,
   bool has_nodata = true;
   float output_nodata = -32768.0;
   vw_out() << "\t--> Writing pre-aligned images.\n";
-  vw_out() << "\t--> Writing: " << left_output_file << ".\n";
-  vw::Stopwatch sw3;
-  sw3.start();
-  block_write_gdal_image(left_output_file, apply_mask(Limg, output_nodata),
-                         has_left_georef, left_georef,
-                         has_nodata, output_nodata, options,
-                         TerminalProgressCallback("asp","\t  L:  "));
-  sw3.stop();
-  vw_out() << "Time to write left image: " << sw3.elapsed_seconds() << std::endl;
+
+  // The left image may be shared with other stereo runs
+  std::string cache_dir = stereo_settings().preprocess_cache_dir;
+  std::string left_cache_key = this->left_preprocessing_cache_key(adjust_left_image_size);
+  std::vector<std::string> left_cache_names(1, "L.tif"),
+    left_cache_files(1, left_output_file);
+  if (left_cache_key != "" &&
+      asp::preproc_cache_fetch(cache_dir, left_cache_key, left_cache_names,
+                               left_cache_files)) {
+    vw_out() << "\t--> Using cached left image: " << left_output_file << ".\n";
+  } else {
+    vw_out() << "\t--> Writing: " << left_output_file << ".\n";
+    vw::Stopwatch sw3;
+    sw3.start();
+    block_write_gdal_image(left_output_file, apply_mask(Limg, output_nodata),
+                           has_left_georef, left_georef,
+                           has_nodata, output_nodata, options,
+                           TerminalProgressCallback("asp","\t  L:  "));
+    sw3.stop();
+    vw_out() << "Time to write left image: " << sw3.elapsed_seconds() << std::endl;
+    if (left_cache_key != "")
+      asp::preproc_cache_store(cache_dir, left_cache_key, left_cache_names,
+                               left_cache_files);
+  }
     
   vw_out() << "\t--> Writing: " << right_output_file << ".\n";
   vw::Stopwatch sw4;
@@ -1050,6 +1143,7 @@ StereoSession::tx_identity() const {
 typename StereoSession::tx_type
 StereoSession::tx_left_map_trans() const {
   std::string left_map_proj_image = this->left_cropped_image();
+  load_map_proj_models();
   if (!m_left_map_proj_model)
     vw_throw( ArgumentErr() << "Map projection model not loaded for image "
               << left_map_proj_image);
@@ -1058,6 +1152,7 @@ StereoSession::tx_left_map_trans() const {
 typename StereoSession::tx_type
 StereoSession::tx_right_map_trans() const {
   std::string right_map_proj_image = this->right_cropped_image();
+  load_map_proj_models();
   if (!m_right_map_proj_model)
     vw_throw( ArgumentErr() << "Map projection model not loaded for image "
               << right_map_proj_image);
@@ -1303,19 +1398,164 @@ void for_each_pixel_columnwise(const vw::ImageViewBase<ViewT> &view_, FuncT &fun
   return;
 }
 
+namespace fs = boost::filesystem;
+
+namespace {
+
+  // Increment this when the format of the stats sidecar file changes
+  const int IMAGE_STATS_CACHE_VERSION = 1;
+
+  bool image_stats_cache_enabled() {
+    char * ptr = getenv("ASP_IMAGE_STATS_CACHE");
+    return ptr == NULL || std::string(ptr) != "0";
+  }
+
+  // What identifies the image and the masking. The statistics depend on
+  // the nodata value, so that is part of it.
+  std::string image_stats_header(std::string const& image_path, double nodata) {
+    std::ostringstream os;
+    os.precision(17);
+    os << "ASP image stats " << IMAGE_STATS_CACHE_VERSION << "\n"
+       << fs::file_size(image_path) << " " << fs::last_write_time(image_path) << " "
+       << nodata << "\n";
+    return os.str();
+  }
+
+  // The stats saved next to the image, ending in .stats.asp_cache. Unlike the
+  // stats file in the output directory, these can be reused by any run with
+  // this image, such as for other stereo pairs or a rerun with a new prefix.
+  bool read_image_stats_cache(std::string const& image_path, double nodata,
+                              vw::Vector6f & result) {
+    std::string cache_file = image_path + ".stats.asp_cache";
+    if (!fs::exists(cache_file))
+      return false;
+    std::ifstream ifs(cache_file.c_str());
+    std::ostringstream os;
+    os << ifs.rdbuf();
+    std::string data = os.str();
+    std::string header = image_stats_header(image_path, nodata);
+    if (data.compare(0, header.size(), header) != 0)
+      return false; // stale, or for a different nodata value
+    std::istringstream is(data.substr(header.size()));
+    for (size_t it = 0; it < result.size(); it++) {
+      if (!(is >> result[it]))
+        return false;
+    }
+    vw::vw_out() << "\t--> Reading statistics from file " + cache_file << std::endl;
+    return true;
+  }
+
+  void write_image_stats_cache(std::string const& image_path, double nodata,
+                               vw::Vector6f const& result) {
+    std::string cache_file = image_path + ".stats.asp_cache";
+    try {
+      fs::path tmp_file = fs::path(cache_file).parent_path() /
+        fs::unique_path(fs::path(cache_file).filename().string() + "-%%%%%%%%");
+      {
+        std::ofstream ofs(tmp_file.string().c_str());
+        ofs.precision(17);
+        ofs << image_stats_header(image_path, nodata);
+        for (size_t it = 0; it < result.size(); it++)
+          ofs << result[it] << "\n";
+        if (!ofs)
+          vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file.string() << "\n");
+      }
+      fs::rename(tmp_file, cache_file);
+    } catch (std::exception const& e) {
+      // Likely a read-only directory. The stats will be computed each time.
+      VW_OUT(vw::DebugMessage, "asp") << "Could not write image stats cache: "
+                                      << cache_file << ". " << e.what() << "\n";
+    }
+  }
+
+  // Estimate the stats from a grid of small windows spread evenly over
+  // the image, rather than from every n-th pixel. A window is read in one
+  // go, so only the disk blocks it overlaps are read, and the windows
+  // are read in parallel. A small image is read in full.
+  vw::Vector6f sampled_stats(vw::ImageViewRef<vw::PixelMask<float>> image) {
+
+    using namespace vw;
+    const int WIN = 64, GRID = 16; // 16 x 16 windows, about 1M pixels
+    std::vector<BBox2i> windows;
+    if (double(image.cols()) * image.rows() <= double(GRID * GRID) * WIN * WIN) {
+      for (int row = 0; row < image.rows(); row += WIN) {
+        for (int col = 0; col < image.cols(); col += WIN)
+          windows.push_back(BBox2i(col, row, std::min(WIN, image.cols() - col),
+                                   std::min(WIN, image.rows() - row)));
+      }
+    } else {
+      int win_cols = std::min(WIN, image.cols()), win_rows = std::min(WIN, image.rows());
+      for (int r = 0; r < GRID; r++) {
+        int row = ((2 * r + 1) * (image.rows() - win_rows)) / (2 * GRID);
+        for (int c = 0; c < GRID; c++) {
+          int col = ((2 * c + 1) * (image.cols() - win_cols)) / (2 * GRID);
+          windows.push_back(BBox2i(col, row, win_cols, win_rows));
+        }
+      }
+    }
+
+    std::vector<std::vector<float>> window_vals(windows.size());
+    vw::TerminalProgressCallback tp("asp", "\t  stats:  ");
+    int num_done = 0;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int w = 0; w < int(windows.size()); w++) {
+      ImageView<PixelMask<float>> tile = crop(image, windows[w]);
+      std::vector<float> & vals = window_vals[w];
+      for (int row = 0; row < tile.rows(); row++) {
+        for (int col = 0; col < tile.cols(); col++) {
+          if (is_valid(tile(col, row)))
+            vals.push_back(tile(col, row).child());
+        }
+      }
+#pragma omp critical
+      {
+        num_done++;
+        tp.report_fractional_progress(num_done, windows.size());
+      }
+    }
+    tp.report_finished();
+
+    std::vector<float> vals;
+    for (size_t w = 0; w < window_vals.size(); w++)
+      vals.insert(vals.end(), window_vals[w].begin(), window_vals[w].end());
+    if (vals.empty())
+      vw_throw(ArgumentErr() << "Cannot compute image statistics, "
+               << "as there are no valid pixels.\n");
+
+    double sum = 0.0, sum2 = 0.0;
+    for (size_t it = 0; it < vals.size(); it++) {
+      sum  += vals[it];
+      sum2 += double(vals[it]) * vals[it];
+    }
+    double mean = sum / vals.size();
+
+    Vector6f result;
+    result[0] = *std::min_element(vals.begin(), vals.end());
+    result[1] = *std::max_element(vals.begin(), vals.end());
+    result[2] = mean;
+    result[3] = sqrt(std::max(sum2 / vals.size() - mean * mean, 0.0));
+    size_t lo = size_t(0.02 * (vals.size() - 1)), hi = size_t(0.98 * (vals.size() - 1));
+    std::nth_element(vals.begin(), vals.begin() + lo, vals.end());
+    result[4] = vals[lo];
+    std::nth_element(vals.begin() + lo, vals.begin() + hi, vals.end());
+    result[5] = vals[hi];
+    return result;
+  }
+
 // Compute the min, max, mean, and standard deviation of an image object and
 // write them to a log. This is not a member function.
 // - "tag" is only used to make the log messages more descriptive.
 // - If prefix and image_path is set, will cache the results to a file.
-// For efficiency, the image must be traversed either rowwise or columnwise,
-// depending on how it is stored on disk.
-vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image, 
-                          std::string const& tag,
-                          std::string const& prefix, 
-                          std::string const& image_path) {
+// - If cache_next_to_image is set, the results are also cached next to
+//   the image, keyed by the nodata value, for reuse by other runs.
+// The statistics are estimated from a sample of the pixels.
+vw::Vector6f gather_stats_impl(vw::ImageViewRef<vw::PixelMask<float>> image, 
+                               std::string const& tag,
+                               std::string const& prefix, 
+                               std::string const& image_path,
+                               bool cache_next_to_image, double nodata) {
 
   using namespace vw;
-  namespace fs = boost::filesystem;
   Vector6f result;
 
   vw_out(InfoMessage) << "Computing statistics for " + tag << std::endl;
@@ -1333,6 +1573,8 @@ vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image,
       cache_path = prefix + '-' + fs::path(image_path).stem().string() + "-stats.tif";
     }
   }
+  const bool use_image_cache = (cache_next_to_image && image_path != "" &&
+                                image_stats_cache_enabled() && fs::exists(image_path));
   
   // Check if this stats file was computed after any image modifications.
   if ((use_cache && asp::is_latest_timestamp(cache_path, image_path)) ||
@@ -1342,46 +1584,31 @@ vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image,
     read_vector(stats, cache_path); // Just fetch the stats from the file on disk.
     result = stats;
 
-  } else { // Compute the results
+  } else { // Compute the results, or read them from next to the image
 
-    // Read the resource and determine the block structure on disk. Use a boost shared ptr.
-    vw::Vector2i block_size;
-    {
-      boost::shared_ptr<DiskImageResource> rsrc (DiskImageResourcePtr(image_path));
-      block_size  = rsrc->block_read_size();
-    }
-    // print a warning that procesing can be slow if any of the block size coords are bigger than 5120
-    if (block_size[0] > 5120 || block_size[1] > 5120) {
-      vw_out(WarningMessage) << "Image " << image_path 
-        << " has block sizes of dimensions " << block_size[0] << " x " << block_size[1] 
-        << " (as shown by gdalinfo). This can make processing slow. Consider converting "
-        << "it to tile format, using the command:\n" 
-        << "gdal_translate -co TILED=yes -co BLOCKXSIZE=256 -co BLOCKYSIZE=256 " 
-        << "input.tif output.tif\n";
-    }
+    bool have_stats = use_image_cache && read_image_stats_cache(image_path, nodata, result);
+    if (!have_stats) {
+      // Read the resource and determine the block structure on disk. Use a boost shared ptr.
+      vw::Vector2i block_size;
+      {
+        boost::shared_ptr<DiskImageResource> rsrc (DiskImageResourcePtr(image_path));
+        block_size  = rsrc->block_read_size();
+      }
+      // print a warning that procesing can be slow if any of the block size coords are bigger than 5120
+      if (block_size[0] > 5120 || block_size[1] > 5120) {
+        vw_out(WarningMessage) << "Image " << image_path 
+          << " has block sizes of dimensions " << block_size[0] << " x " << block_size[1] 
+          << " (as shown by gdalinfo). This can make processing slow. Consider converting "
+          << "it to tile format, using the command:\n" 
+          << "gdal_translate -co TILED=yes -co BLOCKXSIZE=256 -co BLOCKYSIZE=256 " 
+          << "input.tif output.tif\n";
+      }
 
-    // Compute statistics at a reduced resolution
-    const float TARGET_NUM_PIXELS = 1000000;
-    float num_pixels = float(image.cols())*float(image.rows());
-    int   stat_scale = int(ceil(sqrt(num_pixels / TARGET_NUM_PIXELS)));
-
-    vw_out(InfoMessage) << "Using downsample scale: " << stat_scale << std::endl;
-
-    ChannelAccumulator<vw::math::CDFAccumulator<float> > accumulator;
-    vw::TerminalProgressCallback tp("asp","\t  stats:  ");
-    if (block_size[0] >= block_size[1]) // Rows are long, so go row by row
-     for_each_pixel_rowwise(subsample( edge_extend(image, ConstantEdgeExtension()),
-                               stat_scale), accumulator, tp);
-    else // Columns are long, so go column by column
-     for_each_pixel_columnwise(subsample( edge_extend(image, ConstantEdgeExtension()),
-                                  stat_scale), accumulator, tp);
-
-    result[0] = accumulator.quantile(0); // Min
-    result[1] = accumulator.quantile(1); // Max
-    result[2] = accumulator.approximate_mean();
-    result[3] = accumulator.approximate_stddev();
-    result[4] = accumulator.quantile(0.02); // Percentile values
-    result[5] = accumulator.quantile(0.98);
+      result = sampled_stats(image);
+
+      if (use_image_cache)
+        write_image_stats_cache(image_path, nodata, result);
+    }
 
     // Cache the results to disk
     if (use_cache) {
@@ -1398,4 +1625,21 @@ vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image,
   return result;
 }
 
+} // end anonymous namespace
+
+vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image, 
+                          std::string const& tag,
+                          std::string const& prefix, 
+                          std::string const& image_path) {
+  return gather_stats_impl(image, tag, prefix, image_path, false, 0.0);
+}
+
+vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image, 
+                          std::string const& tag,
+                          std::string const& prefix, 
+                          std::string const& image_path,
+                          double nodata) {
+  return gather_stats_impl(image, tag, prefix, image_path, true, nodata);
+}
+
 } // End namespace asp
@@ -77,11 +77,29 @@ namespace asp {
     virtual bool supports_multi_threading () const {
       return true;
     }
+    /// If the preprocessing hook can take the normalized left image from
+    /// the cache set with --preprocess-cache-dir
+    virtual bool supports_preprocessing_cache() const {
+      return true;
+    }
+
+    /// The key in the preprocessing cache for the products which depend
+    /// only on the left image, or an empty string if the cache is not set,
+    /// or these products depend on the right image for the current options.
+    std::string left_preprocessing_cache_key(bool adjust_left_image_size) const;
 
     /// Helper function that retrieves both cameras.
     virtual void camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
                                boost::shared_ptr<vw::camera::CameraModel> &cam2);
 
+    /// Both cameras, wrapped to count and time their projections under the
+    /// given call site name if ASP_CAMERA_TELEMETRY is set
+    /// (asp/Camera/InstrumentedCameraModel.h). Use only where the cameras
+    /// are not cast to a specific camera type.
+    void instrumented_camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
+                                    boost::shared_ptr<vw::camera::CameraModel> &cam2,
+                                    std::string const& call_site);
+
     /// Method that produces a Camera Model from input files.
     virtual boost::shared_ptr<vw::camera::CameraModel>
     camera_model(std::string const& image_file,
@@ -209,13 +227,25 @@ namespace asp {
 
     /// Storage for the camera models used to map project the input images.
     /// - Not used in non map-projected sessions.
-    boost::shared_ptr<vw::camera::CameraModel> m_left_map_proj_model, m_right_map_proj_model;
+    /// - Loaded on first use, as many stereo steps do not need them.
+    mutable boost::shared_ptr<vw::camera::CameraModel> m_left_map_proj_model,
+      m_right_map_proj_model;
 
   private:
 
-    /// Handles init required for map projected session types.
+    /// How a mapprojected image was made, as read from its header
+    struct MapProjCameraInfo {
+      std::string cam_type, adj_prefix, cam_file;
+    };
+    MapProjCameraInfo m_left_map_proj_info, m_right_map_proj_info;
+
+    /// Handles init required for map projected session types. Only reads
+    /// and checks the image headers. The cameras are loaded later.
     void init_disk_transform();
 
+    /// Load the camera models used in mapprojection, if not loaded yet
+    void load_map_proj_models() const;
+
   protected:
 
     // Factor out here all functionality shared among the preprocessing hooks
@@ -307,6 +337,15 @@ vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image,
                           std::string const& prefix, 
                           std::string const& image_path);
 
+// As above, but the image was masked with this nodata value (which can be
+// NaN), so the results can also be cached next to the image, for reuse
+// by other runs.
+vw::Vector6f gather_stats(vw::ImageViewRef<vw::PixelMask<float>> image, 
+                          std::string const& tag,
+                          std::string const& prefix, 
+                          std::string const& image_path,
+                          double nodata);
+
 } // end namespace asp
 
 #endif // __STEREO_SESSION_H__
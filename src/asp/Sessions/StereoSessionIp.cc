@@ -37,6 +37,7 @@
 #include <asp/Core/IpMatchingAlgs.h>        // Lightweight ip header
 #include <asp/Core/AffineEpipolar.h>
 #include <asp/Camera/RPCModel.h>
+#include <asp/Core/MatchFile.h>
 
 #include <boost/filesystem/operations.hpp>
 
@@ -351,7 +352,7 @@ void StereoSession::determine_image_alignment(// Inputs
   
   // Load the interest points results from the file we just wrote
   std::vector<ip::InterestPoint> left_ip, right_ip;
-  ip::read_binary_match_file(match_filename, left_ip, right_ip);
+  asp::read_match_file(match_filename, left_ip, right_ip);
   
   // Compute the appropriate alignment matrix based on the input points
   if (stereo_settings().alignment_method == "homography") {
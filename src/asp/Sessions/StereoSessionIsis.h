@@ -43,6 +43,9 @@ namespace asp {
     virtual vw::cartography::Datum get_datum(const vw::camera::CameraModel* cam,
                                              bool use_sphere_for_non_earth) const;
 
+    /// The ISIS preprocessing hook does not use the preprocessing cache
+    virtual bool supports_preprocessing_cache() const { return false; }
+
     /// Stage 1: Preprocessing
     ///
     // Pre file is a pair of images.            ( ImageView<PixelT> )
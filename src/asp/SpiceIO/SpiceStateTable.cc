@@ -0,0 +1,153 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SpiceStateTable.cc
+///
+
+#include <asp/SpiceIO/SpiceStateTable.h>
+#include <asp/SpiceIO/SpiceUtilities.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Thread.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+namespace spice {
+
+namespace {
+
+  // Spherical linear interpolation between unit quaternions, along the
+  // shorter arc
+  Quat slerp_quat(double alpha, Quat const& a, Quat const& b_in) {
+    Quat b = b_in;
+    double d = a.w()*b.w() + a.x()*b.x() + a.y()*b.y() + a.z()*b.z();
+    if (d < 0) {
+      b = Quat(-b.w(), -b.x(), -b.y(), -b.z());
+      d = -d;
+    }
+
+    double wa = 1.0 - alpha, wb = alpha;
+    if (d < 0.9995) { // Otherwise the quaternions are close, and lerp is accurate
+      double theta = acos(d);
+      double s = sin(theta);
+      wa = sin(wa * theta) / s;
+      wb = sin(wb * theta) / s;
+    }
+
+    double w = wa*a.w() + wb*b.w(), x = wa*a.x() + wb*b.x();
+    double y = wa*a.y() + wb*b.y(), z = wa*a.z() + wb*b.z();
+    double n = sqrt(w*w + x*x + y*y + z*z);
+    return Quat(w/n, x/n, y/n, z/n);
+  }
+
+} // end anonymous namespace
+
+SpiceStateTable::SpiceStateTable(double begin_time, double interval,
+                                 std::vector<Vector3> const& position,
+                                 std::vector<Vector3> const& velocity,
+                                 std::vector<Quat> const& pose):
+  m_begin_time(begin_time), m_interval(interval),
+  m_position(position), m_velocity(velocity), m_pose(pose) {
+
+  if (interval <= 0)
+    vw_throw(ArgumentErr() << "The sampling interval must be positive.\n");
+  if (m_position.size() < 2 || m_velocity.size() != m_position.size() ||
+      m_pose.size() != m_position.size())
+    vw_throw(ArgumentErr() << "Expecting at least two samples of each of "
+             << "the position, velocity, and pose.\n");
+}
+
+double SpiceStateTable::end_time() const {
+  return m_begin_time + (m_position.size() - 1) * m_interval;
+}
+
+void SpiceStateTable::state(double time, Vector3 & position, Vector3 & velocity,
+                            Quat & pose) const {
+
+  double u = (time - m_begin_time) / m_interval;
+  int last = int(m_position.size()) - 1;
+  if (!(u >= 0 && u <= last))
+    vw_throw(ArgumentErr() << "Time " << time << " is outside the sampled range ["
+             << m_begin_time << ", " << end_time() << "].\n");
+
+  int i = std::min(int(floor(u)), last - 1);
+  double s = u - i, h = m_interval;
+  double s2 = s*s, s3 = s2*s;
+
+  // The cubic Hermite basis and its derivative
+  double h00 =  2*s3 - 3*s2 + 1, d00 =  6*s2 - 6*s;
+  double h10 =    s3 - 2*s2 + s, d10 =  3*s2 - 4*s + 1;
+  double h01 = -2*s3 + 3*s2,     d01 = -6*s2 + 6*s;
+  double h11 =    s3 -   s2,     d11 =  3*s2 - 2*s;
+
+  Vector3 const& p0 = m_position[i];
+  Vector3 const& p1 = m_position[i+1];
+  Vector3 const& v0 = m_velocity[i];
+  Vector3 const& v1 = m_velocity[i+1];
+  position = h00*p0 + h10*h*v0 + h01*p1 + h11*h*v1;
+  velocity = (d00*p0 + d10*h*v0 + d01*p1 + d11*h*v1) / h;
+  pose = slerp_quat(s, m_pose[i], m_pose[i+1]);
+}
+
+boost::shared_ptr<SpiceStateTable>
+body_state_table(double begin_time, double end_time, double interval,
+                 std::string const& spacecraft,
+                 std::string const& reference_frame,
+                 std::string const& planet,
+                 std::string const& instrument) {
+
+  // Tables made so far, by their arguments
+  static Mutex table_mutex;
+  static std::map<std::string, boost::shared_ptr<SpiceStateTable>> tables;
+
+  std::ostringstream os;
+  os.precision(17);
+  os << begin_time << ' ' << end_time << ' ' << interval << ' ' << spacecraft << ' '
+     << reference_frame << ' ' << planet << ' ' << instrument;
+  std::string key = os.str();
+
+  // SPICE is not thread-safe, so the lock is held while sampling
+  Mutex::Lock lock(table_mutex);
+  auto it = tables.find(key);
+  if (it != tables.end())
+    return it->second;
+
+  // Pad the range, so that times at its ends are interpolated as well as
+  // those inside
+  const int PAD = 2;
+  double sample_begin = begin_time - PAD * interval;
+  int num_samples = int(ceil((end_time - begin_time) / interval)) + 2 * PAD + 1;
+  std::vector<Vector3> position(num_samples), velocity(num_samples);
+  std::vector<Quat> pose(num_samples);
+  for (int i = 0; i < num_samples; i++)
+    body_state(sample_begin + i * interval, position[i], velocity[i], pose[i],
+               spacecraft, reference_frame, planet, instrument);
+
+  boost::shared_ptr<SpiceStateTable>
+    table(new SpiceStateTable(sample_begin, interval, position, velocity, pose));
+  tables[key] = table;
+  return table;
+}
+
+}} // namespace asp::spice
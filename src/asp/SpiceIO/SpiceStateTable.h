@@ -0,0 +1,79 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SpiceStateTable.h
+///
+/// The position, velocity and pose of a body, sampled from the SPICE
+/// kernels once, at uniform times over the time range of an image, and
+/// then interpolated from memory. This replaces a SPICE query per image
+/// line or per camera evaluation. The tables are shared by all consumers
+/// in the process which ask for the same body, frame and time range.
+
+#ifndef __ASP_SPICEIO_SPICE_STATE_TABLE_H__
+#define __ASP_SPICEIO_SPICE_STATE_TABLE_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Quaternion.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+namespace spice {
+
+  class SpiceStateTable {
+  public:
+
+    /// Make a table from samples at begin_time + i * interval. There must
+    /// be at least two samples.
+    SpiceStateTable(double begin_time, double interval,
+                    std::vector<vw::Vector3> const& position,
+                    std::vector<vw::Vector3> const& velocity,
+                    std::vector<vw::Quaternion<double>> const& pose);
+
+    double begin_time() const { return m_begin_time; }
+    double end_time  () const;
+
+    /// The state at the given time. The position and velocity are
+    /// interpolated with a cubic Hermite spline, which uses the sampled
+    /// velocities, and the pose with spherical linear interpolation.
+    /// Throws if the time is outside the sampled range.
+    void state(double time, vw::Vector3 & position, vw::Vector3 & velocity,
+               vw::Quaternion<double> & pose) const;
+
+  private:
+    double m_begin_time, m_interval;
+    std::vector<vw::Vector3> m_position, m_velocity;
+    std::vector<vw::Quaternion<double>> m_pose;
+  };
+
+  /// Sample the state of the body from the loaded SPICE kernels, with the
+  /// same arguments as body_state(), over a range padded by two intervals
+  /// on each side. A table already made for the same arguments is reused.
+  boost::shared_ptr<SpiceStateTable>
+  body_state_table(double begin_time, double end_time, double interval,
+                   std::string const& spacecraft,
+                   std::string const& reference_frame,
+                   std::string const& planet,
+                   std::string const& instrument);
+
+}} // namespace asp::spice
+
+#endif // __ASP_SPICEIO_SPICE_STATE_TABLE_H__
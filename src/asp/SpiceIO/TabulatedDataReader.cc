@@ -25,8 +25,6 @@
 
 using namespace std;
 
-#define LINE_MAXSIZE 4096
-
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /*               TabulatedDataReader Class Methods               */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -39,45 +37,37 @@ namespace spice {
                                             const std::string &delimeters = ",") {
     m_delimeters = delimeters;
 
-    m_file.open(filename.c_str());
-    if ( !m_file.is_open() ) {
+    std::ifstream file(filename.c_str());
+    if ( !file.is_open() ) {
       throw vw::IOErr() << "Failed to open tabulated data record: " << filename << ".";
     }
+
+    std::string line;
+    while (std::getline(file, line))
+      m_lines.push_back(line);
   }
 
 
   // Returns 1 on success, 0 on failure
   int TabulatedDataReader::find_line_with_text(std::string query,
                                                std::vector<std::string> &result) {
-    // Reset file pointer to the top of the file
-    m_file.seekg(0);
 
-    int found = 0;
-    char line[LINE_MAXSIZE];
-
-    // Read through the lines until the search returns a match
-    while ( !found && !m_file.eof() ) {
-      m_file.getline(line, LINE_MAXSIZE);
+    // Search through the lines until the search returns a match
+    for (size_t it = 0; it < m_lines.size(); it++) {
+      string const& str_line = m_lines[it];
 
       // If the text is found, cut up this line using the delimeters
       // and return true.
-      if(boost::find_first(line, query)) {
-        string str_line(line);
+      if (boost::find_first(str_line, query)) {
         cout << str_line << endl;
         boost::split( result, str_line, boost::is_any_of(m_delimeters) );
-        vector<string>::iterator iter = result.begin();
-
-        //      unsigned int c = 0;
-        for (iter = result.begin(); iter != result.end(); iter++) {
+        for (vector<string>::iterator iter = result.begin(); iter != result.end(); iter++)
           boost::trim(*iter);
-          //      cout << c << ":   " << *iter << "\n";
-          //      c++;
-        }
-        found = 1;
+        return 1;
       }
     }
 
-    return found;
+    return 0;
   }
 
 }} //end namespace asp::spice
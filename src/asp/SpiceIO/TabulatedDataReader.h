@@ -27,6 +27,8 @@
 namespace asp {
 namespace spice {
 
+  // The file is read into memory once, on construction, and the queries
+  // search the lines in memory.
   class TabulatedDataReader {
   public:
     /* Constructor / Destructor */
@@ -34,9 +36,7 @@ namespace spice {
     ~TabulatedDataReader() { close(); }
 
     void close() {
-      if (m_file.is_open()) {
-        m_file.close();
-      }
+      m_lines.clear();
     }
 
     /* Accessors */
@@ -46,7 +46,7 @@ namespace spice {
   private:
     std::string m_delimeters;
 
-    std::ifstream m_file;
+    std::vector<std::string> m_lines;
   };
 
 }} // end namespace asp::spice
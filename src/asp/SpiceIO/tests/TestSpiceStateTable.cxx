@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/SpiceIO/SpiceStateTable.h>
+
+using namespace vw;
+using namespace asp::spice;
+
+// A circular orbit, with the pose rotating about the z axis with it
+namespace {
+  const double R = 3.5e6, W = 1e-3;
+  Vector3 orbit_pos(double t) { return Vector3(R*cos(W*t), R*sin(W*t), 1000.0); }
+  Vector3 orbit_vel(double t) { return Vector3(-R*W*sin(W*t), R*W*cos(W*t), 0.0); }
+  Quat orbit_pose(double t) { return Quat(cos(W*t/2), 0, 0, sin(W*t/2)); }
+}
+
+// Sampling every 10 seconds, the interpolated states between the samples
+// agree with the exact ones to within a millimeter
+TEST(SpiceStateTable, Interpolate) {
+
+  double begin = 100.0, interval = 10.0;
+  int num = 50;
+  std::vector<Vector3> pos(num), vel(num);
+  std::vector<Quat> pose(num);
+  for (int i = 0; i < num; i++) {
+    double t = begin + i * interval;
+    pos[i]  = orbit_pos(t);
+    vel[i]  = orbit_vel(t);
+    pose[i] = orbit_pose(t);
+    if (i % 2 == 1) // SPICE may return either sign
+      pose[i] = Quat(-pose[i].w(), -pose[i].x(), -pose[i].y(), -pose[i].z());
+  }
+  SpiceStateTable table(begin, interval, pos, vel, pose);
+  EXPECT_EQ(begin + (num - 1) * interval, table.end_time());
+
+  for (double t = begin; t <= table.end_time(); t += 3.7) {
+    Vector3 p, v;
+    Quat q;
+    table.state(t, p, v, q);
+    EXPECT_LT(norm_2(p - orbit_pos(t)), 1e-3);
+    EXPECT_LT(norm_2(v - orbit_vel(t)), 1e-4);
+    Quat e = orbit_pose(t);
+    double d = std::abs(q.w()*e.w() + q.x()*e.x() + q.y()*e.y() + q.z()*e.z());
+    EXPECT_NEAR(1.0, d, 1e-12);
+  }
+
+  Vector3 p, v;
+  Quat q;
+  EXPECT_THROW(table.state(begin - 1.0, p, v, q), vw::ArgumentErr);
+  EXPECT_THROW(table.state(table.end_time() + 1.0, p, v, q), vw::ArgumentErr);
+}
@@ -31,7 +31,6 @@
 #include <vw/Math/RANSAC.h>
 #include <vw/Camera/CameraModel.h>
 #include <vw/Cartography/CameraBBox.h>
-#include <vw/Core/ThreadPool.h>
 #include <vw/Math/RandomSet.h>
 
 #include <Eigen/Dense>
@@ -100,144 +99,95 @@ void find_projection(// Inputs
   }
 }
 
-// This is not used for now, it could be used to make the logic
-// of processing mask boundary points multi-threaded.
-class MaskBoundaryTask : public vw::Task, private boost::noncopyable {
-  vw::BBox2i m_bbox; // Region of image we're working in
-
-  ImageViewRef<float>                   m_mask;
-  float                                 m_mask_nodata_val;
-  boost::shared_ptr<CameraModel>        m_camera_model;
-  vw::cartography::GeoReference         m_shape_georef;
-  vw::cartography::GeoReference         m_dem_georef;
-  ImageViewRef<PixelMask<float>>        m_masked_dem;
-  
-  // Note how all of these are aliases
-  Mutex                        & m_mutex;
-  std::vector<Eigen::Vector3d> & m_point_vec;
-  std::vector<vw::Vector3>     & m_llh_vec;
-  std::vector<vw::Vector2>     & m_used_vertices;
-  
-public:
-  MaskBoundaryTask(vw::BBox2i                            bbox,
-                   ImageViewRef<float>                   mask,
-                   float                                 mask_nodata_val,
-                   boost::shared_ptr<CameraModel>        camera_model,
-                   vw::cartography::GeoReference const & shape_georef,
-                   vw::cartography::GeoReference const & dem_georef,
-                   ImageViewRef<PixelMask<float>>        masked_dem,
-                   Mutex                               & mutex,
-                   std::vector<Eigen::Vector3d>        & point_vec,
-                   std::vector<vw::Vector3>            & llh_vec,
-                   std::vector<vw::Vector2>            & used_vertices):
-    m_bbox(bbox), m_mask(mask), m_mask_nodata_val(mask_nodata_val),
-    m_camera_model(camera_model), m_shape_georef(shape_georef),
-    m_dem_georef(dem_georef), m_masked_dem(masked_dem),
-    m_mutex(mutex), m_point_vec(point_vec),
-    m_llh_vec(llh_vec), m_used_vertices(used_vertices) {}
-  
-  void operator()() {
+// Find the mask boundary pixels in a tile, so mask pixels above the
+// threshold with a neighbor not above it. Only the tile, grown by one
+// pixel to see the neighbors, is kept in memory.
+void find_mask_boundary_in_tile(ImageViewRef<float> const& mask,
+                                float mask_nodata_val,
+                                vw::BBox2i const& bbox,
+                                std::vector<vw::Vector2i> & boundary_pix) {
 
-    // Grow the box by 1 pixel as we need to look at the immediate neighbors
-    BBox2i extra_box = m_bbox;
-    extra_box.expand(1); 
-    extra_box.crop(bounding_box(m_mask));
+  boundary_pix.clear();
 
-    // Make a local copy of the tile
-    ImageView<float> mask_tile = crop(m_mask, extra_box);
+  BBox2i extra_box = bbox;
+  extra_box.expand(1); 
+  extra_box.crop(bounding_box(mask));
+  ImageView<float> mask_tile = crop(mask, extra_box);
 
+  for (int row = 0; row < mask_tile.rows(); row++) {
     for (int col = 0; col < mask_tile.cols(); col++) {
-      for (int row = 0; row < mask_tile.rows(); row++) {
 
-        // Look at pixels above threshold which have neighbors <= threshold
-        if (mask_tile(col, row) <= m_mask_nodata_val) 
-          continue;
+      // Look at pixels above threshold which have neighbors <= threshold
+      if (mask_tile(col, row) <= mask_nodata_val) 
+        continue;
 
-        // The four neighbors
-        int col_vals[4] = {-1, 0, 0, 1};
-        int row_vals[4] = {0, -1, 1, 0};
-          
-        bool border_pix = false;
-        for (int it = 0; it < 4; it++) {
-            
-          int icol = col + col_vals[it];
-          int irow = row + row_vals[it];
+      // Create the pixel in the full image coordinates. Only work on
+      // pixels in the current box (earlier had a bigger box to be able
+      // to examine neighbors).
+      Vector2i pix = Vector2i(col, row) + extra_box.min();
+      if (!bbox.contains(pix))
+        continue;
 
-          if (icol < 0 || irow < 0 || icol >= mask_tile.cols() || irow >= mask_tile.rows()) 
-            continue;
-            
-          if (mask_tile(icol, irow) <= m_mask_nodata_val) {
-            border_pix = true;
-            break;
-          }
-        }
+      // The four neighbors
+      int col_vals[4] = {-1, 0, 0, 1};
+      int row_vals[4] = {0, -1, 1, 0};
           
-        if (!border_pix) 
-          continue;
-
-        // Create the pixel in the full image coordinates
-        Vector2 pix = Vector2(col, row) + extra_box.min();
+      bool border_pix = false;
+      for (int it = 0; it < 4; it++) {
+            
+        int icol = col + col_vals[it];
+        int irow = row + row_vals[it];
 
-        // Only work on pixels in the current box (earlier had a
-        // bigger box to be able to examine neighbors).
-        if (!m_bbox.contains(pix))
+        if (icol < 0 || irow < 0 || icol >= mask_tile.cols() || irow >= mask_tile.rows()) 
           continue;
-        
-        // The ray going to the ground
-        // Here we assume that the camera model is thread-safe, which is
-        // true for all cameras except ISIS, and this code will be used
-        // on Earth only.
-        Vector3 cam_ctr = m_camera_model->camera_center(pix);
-        Vector3 cam_dir = m_camera_model->pixel_to_vector(pix);
-
-        // Intersect the ray going from the given camera pixel with a DEM.
-        bool treat_nodata_as_zero = false;
-        bool has_intersection = false;
-        double height_error_tol = 0.001; // in meters
-        double max_abs_tol = 1e-14;
-        double max_rel_tol = 1e-14;
-        int num_max_iter = 100;
-        Vector3 xyz_guess(0, 0, 0);
-        Vector3 xyz = vw::cartography::camera_pixel_to_dem_xyz
-          (cam_ctr, cam_dir, m_masked_dem,
-           m_dem_georef, treat_nodata_as_zero,
-           has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
-           num_max_iter, xyz_guess);
-          
-        if (!has_intersection) 
-          continue;
-
-        Vector3 llh = m_dem_georef.datum().cartesian_to_geodetic(xyz);
-
-        Eigen::Vector3d eigen_xyz;
-        for (size_t coord = 0; coord < 3; coord++) 
-          eigen_xyz[coord] = xyz[coord];
-
-        // TODO(oalexan1): This is fragile due to the 360 degree
-        // uncertainty in latitude
-        Vector2 proj_pt = m_shape_georef.lonlat_to_point(Vector2(llh[0], llh[1]));
-
-        {
-          // Need to make sure to lock the shared resource
-          Mutex::Lock lock(m_mutex);
-          m_point_vec.push_back(eigen_xyz);
-          m_used_vertices.push_back(proj_pt);
-          m_llh_vec.push_back(llh);
+            
+        if (mask_tile(icol, irow) <= mask_nodata_val) {
+          border_pix = true;
+          break;
         }
       }
-      
+          
+      if (border_pix) 
+        boundary_pix.push_back(pix);
     }
-    
   }
-  
-};
+}
+
+// Intersect the ray from a camera pixel with the DEM
+bool intersect_with_dem(boost::shared_ptr<CameraModel> const& camera_model,
+                        vw::cartography::GeoReference const& dem_georef,
+                        ImageViewRef<PixelMask<float>> const& masked_dem,
+                        Vector2 const& pix, Vector3 & xyz) {
+
+  Vector3 cam_ctr = camera_model->camera_center(pix);
+  Vector3 cam_dir = camera_model->pixel_to_vector(pix);
+
+  bool treat_nodata_as_zero = false;
+  bool has_intersection = false;
+  double height_error_tol = 0.001; // in meters
+  double max_abs_tol = 1e-14;
+  double max_rel_tol = 1e-14;
+  int num_max_iter = 100;
+  Vector3 xyz_guess(0, 0, 0);
+  xyz = vw::cartography::camera_pixel_to_dem_xyz
+    (cam_ctr, cam_dir, masked_dem,
+     dem_georef, treat_nodata_as_zero,
+     has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
+     num_max_iter, xyz_guess);
+
+  return has_intersection;
+}
 
 // Find the mask boundary (points where the points in the mask have
 // neighbors not in the mask), shoot points from there onto the DEM,
-// and return the obtained points.
+// and return the obtained points. The mask is processed in tiles, in
+// parallel. Then a random subset of the boundary pixels, of size
+// num_samples, is intersected with the DEM, in parallel, with more
+// pixels picked if some rays miss the DEM.
 void find_points_at_mask_boundary(ImageViewRef<float> mask,
                                   float mask_nodata_val,
                                   boost::shared_ptr<CameraModel> camera_model,
+                                  bool single_threaded_camera,
                                   vw::cartography::GeoReference const& shape_georef,
                                   vw::cartography::GeoReference const& dem_georef,
                                   ImageViewRef<PixelMask<float>> masked_dem,
@@ -251,94 +201,70 @@ void find_points_at_mask_boundary(ImageViewRef<float> mask,
   llh_vec.clear();
   used_vertices.clear();
 
-#if 0
-
-  // For some reason parallel processing is slower than serial processing.
-  // Likely it is because the DEM is shared. Need extra heuristics to cut
-  // that one as appropriate for each task.
-  
-  // Subdivide the box for parallel processing
+  vw_out() << "Processing points at mask boundary.\n";
   int block_size = vw::vw_settings().default_tile_size();
-  FifoWorkQueue queue(vw_settings().default_num_threads());
   std::vector<BBox2i> bboxes = subdivide_bbox(mask, block_size, block_size);
-  
-  for (size_t it = 0; it < bboxes.size(); it++) {
-    std::cout << "Box is " << bboxes[it] << std::endl;
-  }
-
-  Mutex mutex;
-  for (size_t it = 0; it < bboxes.size(); it++) {
-    boost::shared_ptr<MaskBoundaryTask>
-      task(new MaskBoundaryTask(bboxes[it],  mask, mask_nodata_val, camera_model,
-                                shape_georef, dem_georef, masked_dem, mutex,
-                                point_vec, llh_vec, used_vertices));
-    queue.add_task(task);
-  }
-  
-  queue.join_all();
-  
-#else
-
-  // Let the mask boundary be the mask pixels whose value
-  // is above threshold and which border pixels whose values
-  // is not above threshold.
-
-  vw_out() << "Processing points at mask boundary.\n";
+  int num_tiles = bboxes.size();
+  std::vector<std::vector<vw::Vector2i>> tile_pix(num_tiles);
   vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / mask.cols();
   tpc.report_progress(0);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int it = 0; it < num_tiles; it++) {
+    find_mask_boundary_in_tile(mask, mask_nodata_val, bboxes[it], tile_pix[it]);
+#pragma omp critical
+    tpc.report_incremental_progress(1.0 / num_tiles);
+  }
+  tpc.report_finished();
 
-  for (int col = 0; col < mask.cols(); col++) {
-    for (int row = 0; row < mask.rows(); row++) {
-
-      // Look at pixels above threshold which have neighbors <= threshold
-      if (mask(col, row) <= mask_nodata_val) 
-        continue;
-
-      // The four neighbors
-      int col_vals[4] = {-1, 0, 0, 1};
-      int row_vals[4] = {0, -1, 1, 0};
-          
-      bool border_pix = false;
-      for (int it = 0; it < 4; it++) {
-            
-        int icol = col + col_vals[it];
-        int irow = row + row_vals[it];
+  std::vector<vw::Vector2i> boundary_pix;
+  for (int it = 0; it < num_tiles; it++)
+    boundary_pix.insert(boundary_pix.end(), tile_pix[it].begin(), tile_pix[it].end());
+  int num_pix = boundary_pix.size();
+  if (num_pix > num_samples)
+    vw_out() << "Found " << num_pix << " pixels at mask boundary, but only "
+             << num_samples << " samples are desired. Picking a random subset "
+             << "of this size.\n";
 
-        if (icol < 0 || irow < 0 || icol >= mask.cols() || irow >= mask.rows()) 
-          continue;
-            
-        if (mask(icol, irow) <= mask_nodata_val) {
-          border_pix = true;
-          break;
-        }
+  // Pick random pixels among those not tried yet, and intersect them with
+  // the DEM, until enough samples are found or no pixels are left.
+  std::vector<int> remaining(num_pix);
+  for (int it = 0; it < num_pix; it++)
+    remaining[it] = it;
+  while (int(point_vec.size()) < num_samples && !remaining.empty()) {
+
+    int num_to_pick = std::min(num_samples - int(point_vec.size()), int(remaining.size()));
+    std::vector<int> picked;
+    if (num_to_pick < int(remaining.size())) {
+      std::vector<int> w;
+      vw::math::pick_random_indices_in_range(remaining.size(), num_to_pick, w);
+      std::vector<bool> is_picked(remaining.size(), false);
+      for (size_t it = 0; it < w.size(); it++)
+        is_picked[w[it]] = true;
+      std::vector<int> not_picked;
+      for (size_t it = 0; it < remaining.size(); it++) {
+        if (is_picked[it])
+          picked.push_back(remaining[it]);
+        else
+          not_picked.push_back(remaining[it]);
       }
-          
-      if (!border_pix) 
-        continue;
+      remaining.swap(not_picked);
+    } else {
+      picked.swap(remaining);
+    }
 
-      // The ray going to the ground
-      Vector2 pix(col, row);
-      Vector3 cam_ctr = camera_model->camera_center(pix);
-      Vector3 cam_dir = camera_model->pixel_to_vector(pix);
-
-      // Intersect the ray going from the given camera pixel with a DEM.
-      bool treat_nodata_as_zero = false;
-      bool has_intersection = false;
-      double height_error_tol = 0.001; // in meters
-      double max_abs_tol = 1e-14;
-      double max_rel_tol = 1e-14;
-      int num_max_iter = 100;
-      Vector3 xyz_guess(0, 0, 0);
-      Vector3 xyz = vw::cartography::camera_pixel_to_dem_xyz
-        (cam_ctr, cam_dir, masked_dem,
-         dem_georef, treat_nodata_as_zero,
-         has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
-         num_max_iter, xyz_guess);
-          
-      if (!has_intersection) 
+    // Some cameras must be used from a single thread
+    int num_picked = picked.size();
+    std::vector<Vector3> xyz_vec(num_picked);
+    std::vector<char> has_xyz(num_picked, 0);
+#pragma omp parallel for schedule(dynamic, 64) if (!single_threaded_camera)
+    for (int it = 0; it < num_picked; it++)
+      has_xyz[it] = intersect_with_dem(camera_model, dem_georef, masked_dem,
+                                       Vector2(boundary_pix[picked[it]]), xyz_vec[it]);
+
+    for (int it = 0; it < num_picked; it++) {
+      if (!has_xyz[it])
         continue;
-
+      Vector3 const& xyz = xyz_vec[it];
       Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz);
 
       Eigen::Vector3d eigen_xyz;
@@ -348,39 +274,13 @@ void find_points_at_mask_boundary(ImageViewRef<float> mask,
       // TODO(oalexan1): This is fragile due to the 360 degree
       // uncertainty in latitude
       Vector2 proj_pt = shape_georef.lonlat_to_point(Vector2(llh[0], llh[1]));
-          
+
       point_vec.push_back(eigen_xyz);
       used_vertices.push_back(proj_pt);
       llh_vec.push_back(llh);
     }
-
-    tpc.report_incremental_progress(inc_amount);
   }
 
-  tpc.report_finished();
-  
-#endif
-  
-  int num_pts = point_vec.size();
-  if (num_pts > num_samples) {
-    vw_out() << "Found " << num_pts << " samples at mask boundary, points but only "
-             << num_samples << " samples are desired. Picking a random subset "
-             << "of this size.\n";
-
-    // Select a subset
-    std::vector<int> w;
-    vw::math::pick_random_indices_in_range(num_pts, num_samples, w);
-    std::vector<Eigen::Vector3d> big_point_vec     = point_vec;     point_vec.clear();
-    std::vector<vw::Vector3>     big_llh_vec       = llh_vec;       llh_vec.clear();
-    std::vector<vw::Vector2>     big_used_vertices = used_vertices; used_vertices.clear();
-    for (size_t it = 0; it < w.size(); it++) {
-      int random_index = w[it];
-      point_vec.push_back(big_point_vec[random_index]);
-      llh_vec.push_back(big_llh_vec[random_index]);
-      used_vertices.push_back(big_used_vertices[random_index]);
-    }
-  }
-  
   return;
 }
 
@@ -623,13 +523,114 @@ double dist_to_plane(vw::Matrix<double, 1, 4> const& plane, Vec3 const& point) {
   return std::abs(ans);
 }
 
-// The value p2 is needed by the interface but we don't use it
-struct BestFitPlaneErrorMetric {
-  template <class RelationT, class ContainerT>
-  double operator() (RelationT const& plane, ContainerT const& p1, ContainerT const& p2) const {
-    return dist_to_plane(plane, p1);
+// Fit a plane with RANSAC. The iterations are done in parallel, in
+// batches, and each draws its points with its own seed, so the result
+// does not depend on the number of threads. Stop early once enough
+// iterations are done to have, with high confidence, drawn a sample of
+// inliers only, given the largest fraction of inliers seen so far. The
+// best plane is refit to its inliers. Throws RANSACErr if no plane has
+// at least min_num_output_inliers inliers, unless that number may be
+// reduced down to the minimum needed for a fit.
+vw::Matrix<double> ransac_plane(BestFitPlaneFunctor const& func,
+                                std::vector<Eigen::Vector3d> const& point_vec,
+                                int max_num_iterations, double inlier_threshold,
+                                int min_num_output_inliers,
+                                bool reduce_min_num_output_inliers_if_no_fit,
+                                std::vector<size_t> & inlier_indices) {
+
+  inlier_indices.clear();
+  int num_pts = point_vec.size();
+  int num_needed = func.min_elements_needed_for_fit(point_vec);
+  if (num_pts < num_needed)
+    vw_throw(vw::math::RANSACErr() << "Not enough points to fit a plane.\n");
+
+  // The probability of having drawn at least one sample of inliers only
+  double confidence = 0.999;
+
+  int batch_size = 256;
+  int best_count = -1, best_iter = -1;
+  vw::Matrix<double> best_plane;
+  int num_done = 0, num_iterations = max_num_iterations;
+  while (num_done < num_iterations) {
+
+    int num_curr = std::min(batch_size, num_iterations - num_done);
+    std::vector<vw::Matrix<double>> planes(num_curr);
+    std::vector<int> counts(num_curr, -1);
+#pragma omp parallel for schedule(dynamic, 8)
+    for (int it = 0; it < num_curr; it++) {
+      std::mt19937 gen(num_done + it);
+      std::uniform_int_distribution<int> dist(0, num_pts - 1);
+      std::set<int> ids;
+      while (int(ids.size()) < num_needed)
+        ids.insert(dist(gen));
+      std::vector<Eigen::Vector3d> sample;
+      for (auto id: ids)
+        sample.push_back(point_vec[id]);
+      try {
+        planes[it] = func(sample, sample);
+      } catch (...) {
+        continue; // a degenerate sample
+      }
+      vw::Matrix<double, 1, 4> plane = planes[it];
+      int count = 0;
+      for (int ip = 0; ip < num_pts; ip++) {
+        if (dist_to_plane(plane, point_vec[ip]) < inlier_threshold)
+          count++;
+      }
+      counts[it] = count;
+    }
+
+    for (int it = 0; it < num_curr; it++) {
+      if (counts[it] > best_count) {
+        best_count = counts[it];
+        best_iter  = num_done + it;
+        best_plane = planes[it];
+      }
+    }
+    num_done += num_curr;
+
+    // The number of iterations needed given the inliers found so far
+    double ratio = double(std::max(best_count, 0)) / num_pts;
+    double prob_good = std::pow(ratio, num_needed);
+    if (prob_good >= 1.0) {
+      num_iterations = num_done;
+    } else if (prob_good > 0.0) {
+      double needed = std::log(1.0 - confidence) / std::log(1.0 - prob_good);
+      if (needed < num_iterations)
+        num_iterations = std::max(num_done, int(std::ceil(needed)));
+    }
+  }
+
+  if (best_iter < 0)
+    vw_throw(vw::math::RANSACErr() << "Could not fit a plane.\n");
+  vw_out() << "RANSAC stopped after " << num_done << " iterations.\n";
+
+  // Refit to the inliers of the best plane, and find the inliers again
+  for (int pass = 0; pass < 2; pass++) {
+    vw::Matrix<double, 1, 4> plane = best_plane;
+    inlier_indices.clear();
+    for (int ip = 0; ip < num_pts; ip++) {
+      if (dist_to_plane(plane, point_vec[ip]) < inlier_threshold)
+        inlier_indices.push_back(ip);
+    }
+    if (pass > 0 || int(inlier_indices.size()) < num_needed)
+      break;
+    std::vector<Eigen::Vector3d> inliers;
+    for (size_t it = 0; it < inlier_indices.size(); it++)
+      inliers.push_back(point_vec[inlier_indices[it]]);
+    best_plane = func(inliers, inliers);
   }
-};
+
+  int min_inliers = min_num_output_inliers;
+  if (reduce_min_num_output_inliers_if_no_fit)
+    min_inliers = std::min(min_inliers, num_needed);
+  if (int(inlier_indices.size()) < min_inliers)
+    vw_throw(vw::math::RANSACErr() << "Found only " << inlier_indices.size()
+             << " inliers, while at least " << min_num_output_inliers
+             << " are needed.\n");
+
+  return best_plane;
+}
 
 void calc_plane_properties(bool use_proj_water_surface,
                            std::vector<Eigen::Vector3d> const& point_vec,
@@ -1069,8 +1070,10 @@ int main( int argc, char *argv[] ) {
       DiskImageView<float> mask(opt.mask);
       
       shape_georef = dem_georef;
+      bool single_threaded_camera = (opt.stereo_session == "isis");
       find_points_at_mask_boundary(mask, mask_nodata_val,  
-                                   camera_model, shape_georef,  
+                                   camera_model, single_threaded_camera,
+                                   shape_georef,  
                                    dem_georef, masked_dem,
                                    opt.num_samples,
                                    point_vec, llh_vec,  
@@ -1112,7 +1115,6 @@ int main( int argc, char *argv[] ) {
                       point_vec);
 
     // Compute the water surface using RANSAC
-    std::vector<Eigen::Vector3d> dummy_vec(point_vec.size()); // Required by the interface
     std::vector<size_t> inlier_indices;
     double inlier_threshold = opt.outlier_threshold;
     int    min_num_output_inliers = std::max(point_vec.size()/2, size_t(3));
@@ -1120,19 +1122,10 @@ int main( int argc, char *argv[] ) {
     vw::Matrix<double> plane;
     vw_out() << "Starting RANSAC.\n";
     try {
-      // Must first create the functor and metric, then pass these to ransac. If
-      // created as inline arguments to ransac, these may go go out
-      // of scope prematurely, which will result in incorrect behavior.
       BestFitPlaneFunctor func(use_proj_water_surface);
-      BestFitPlaneErrorMetric error_metric;
-      math::RandomSampleConsensus<BestFitPlaneFunctor, BestFitPlaneErrorMetric> 
-        ransac(func, error_metric,
-               opt.num_ransac_iterations, inlier_threshold,
-               min_num_output_inliers, reduce_min_num_output_inliers_if_no_fit);
-    
-      plane = ransac(point_vec, dummy_vec);
-      
-      inlier_indices = ransac.inlier_indices(plane, point_vec, dummy_vec);
+      plane = ransac_plane(func, point_vec, opt.num_ransac_iterations, inlier_threshold,
+                           min_num_output_inliers, reduce_min_num_output_inliers_if_no_fit,
+                           inlier_indices);
     } catch (const vw::math::RANSACErr& e ) {
       vw_out() << "RANSAC failed: " << e.what() << "\n";
     }
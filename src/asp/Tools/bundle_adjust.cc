@@ -32,13 +32,24 @@
 #include <asp/Core/IpMatchingAlgs.h> // Lightweight header for ip matching
 #include <asp/Tools/bundle_adjust.h>
 #include <asp/Camera/CsmModel.h>
+#include <asp/Camera/SolverBackend.h>
+#include <asp/Core/Telemetry.h>
 #include <asp/Core/OutlierProcessing.h>
 #include <asp/Core/DataLoader.h>
+#include <asp/Core/TrackStore.h>
+#include <asp/Core/MatchFile.h>
 
 #include <vw/InterestPoint/Matcher.h>
 
 #include <xercesc/util/PlatformUtils.hpp>
 
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
@@ -169,6 +180,11 @@ void saveResults(Options const& opt, asp::BAParams const& param_storage) {
 
   for (int icam = 0; icam < num_cameras; icam++){
 
+    // When solving for one partition, the other cameras are not solved for
+    if (!opt.camera_partition.empty() &&
+        opt.camera_partition[icam] != opt.partition_index)
+      continue;
+
     switch(opt.camera_type) {
     case BaCameraType_Pinhole:
       write_pinhole_output_file(opt, icam, param_storage);
@@ -196,6 +212,100 @@ void saveResults(Options const& opt, asp::BAParams const& param_storage) {
   
 }
 
+/// Find the covariance of the position and orientation of each camera,
+/// marginalized over all other variables, and save it. Only the
+/// diagonal blocks for the cameras are computed, using a sparse QR
+/// factorization of the Jacobian, rather than the full dense covariance.
+void saveCameraCovariances(Options const& opt, asp::BAParams & param_storage,
+                           ceres::Problem & problem) {
+
+  std::vector<int> cams;
+  std::vector<std::pair<const double*, const double*>> blocks;
+  for (int icam = 0; icam < int(param_storage.num_cameras()); icam++) {
+    if (!opt.camera_partition.empty() &&
+        opt.camera_partition[icam] != opt.partition_index)
+      continue;
+    double * cam_ptr = param_storage.get_camera_ptr(icam);
+    if (!problem.HasParameterBlock(cam_ptr))
+      continue;
+    cams.push_back(icam);
+    blocks.push_back(std::make_pair(cam_ptr, cam_ptr));
+  }
+
+  ceres::Covariance::Options options;
+  options.algorithm_type = ceres::SPARSE_QR;
+  if (opt.single_threaded_cameras)
+    options.num_threads = 1; // some cameras must be single threaded
+  else
+    options.num_threads = opt.num_threads;
+
+  vw_out() << "Computing the camera covariances.\n";
+  ceres::Covariance covariance(options);
+  if (!covariance.Compute(blocks, &problem)) {
+    vw_out(WarningMessage) << "Could not compute the camera covariances. The problem "
+                           << "may be rank-deficient, such as when nothing ties it "
+                           << "to the ground. Try a positive --camera-weight.\n";
+    return;
+  }
+
+  const int n = asp::BAParams::NUM_CAMERA_PARAMS;
+  std::string cov_file = opt.out_prefix + "-camera_covariance.txt";
+  vw_out() << "Writing: " << cov_file << std::endl;
+  std::ofstream ofs(cov_file.c_str());
+  ofs.precision(17);
+  ofs << "# camera, covariance of position (x, y, z) and rotation (axis-angle), "
+      << "by rows\n";
+  std::vector<double> cov(n * n);
+  for (size_t it = 0; it < cams.size(); it++) {
+    covariance.GetCovarianceBlock(blocks[it].first, blocks[it].second, &cov[0]);
+    ofs << opt.camera_files[cams[it]];
+    for (int k = 0; k < n * n; k++)
+      ofs << " " << cov[k];
+    ofs << "\n";
+  }
+}
+
+// Run a task, such as writing the residual logs, on a background
+// thread. Only one task runs at a time. An exception in the task is
+// thrown by wait().
+class AsyncResidualLogs {
+public:
+  AsyncResidualLogs() {}
+
+  ~AsyncResidualLogs() {
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void start(std::function<void()> task) {
+    wait();
+    m_thread = std::thread([this, task]() {
+      try {
+        task();
+      } catch (...) {
+        m_error = std::current_exception();
+      }
+    });
+  }
+
+  void wait() {
+    if (m_thread.joinable())
+      m_thread.join();
+    if (m_error) {
+      std::exception_ptr error = m_error;
+      m_error = std::exception_ptr();
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  AsyncResidualLogs(AsyncResidualLogs const&) = delete;
+  AsyncResidualLogs& operator=(AsyncResidualLogs const&) = delete;
+
+  std::thread m_thread;
+  std::exception_ptr m_error;
+};
+
 // A callback to invoke at each iteration if desiring to save the cameras
 // at that time.
 class BaCallback: public ceres::IterationCallback {
@@ -205,7 +315,10 @@ public:
     m_opt(opt), m_param_storage(param_storage){}
 
   virtual ceres::CallbackReturnType operator() (const ceres::IterationSummary& summary) {
-    saveResults(m_opt, m_param_storage);
+    // With --checkpoint-every, save only every that many iterations
+    if (m_opt.save_intermediate_cameras ||
+        (summary.iteration > 0 && summary.iteration % m_opt.checkpoint_every == 0))
+      saveResults(m_opt, m_param_storage);
     return ceres::SOLVER_CONTINUE;
   }
   
@@ -375,6 +488,42 @@ void add_disparity_residual_block(Vector3 const& reference_xyz,
 //----------------------------------------------------------------
 // Residuals functions
 
+/// Write the text for items in [0, num_items) to a file, in order.
+/// The text is formatted in parallel, with format(item, stream), in
+/// batches, so that not all of it is in memory at the same time.
+template <class FormatFun>
+void write_in_parallel(std::ofstream & ofs, size_t num_items, int num_threads,
+                       FormatFun format) {
+
+  if (num_threads <= 0)
+    num_threads = vw::vw_settings().default_num_threads();
+  num_threads = std::max(1, num_threads);
+  const size_t batch_size = 100000 * num_threads;
+
+  for (size_t batch_beg = 0; batch_beg < num_items; batch_beg += batch_size) {
+    size_t batch_end = std::min(num_items, batch_beg + batch_size);
+    size_t chunk = (batch_end - batch_beg + num_threads - 1) / num_threads;
+    std::vector<std::string> text(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      size_t beg = batch_beg + t * chunk, end = std::min(batch_end, beg + chunk);
+      if (beg >= end)
+        break;
+      threads.push_back(std::thread([&text, &format, t, beg, end]() {
+        std::ostringstream os;
+        os.precision(17);
+        for (size_t it = beg; it < end; it++)
+          format(it, os);
+        text[t] = os.str();
+      }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+    for (size_t t = 0; t < text.size(); t++)
+      ofs << text[t];
+  }
+}
+
 /// Compute the residuals
 void compute_residuals(bool apply_loss_function,
                        Options const& opt,
@@ -384,6 +533,7 @@ void compute_residuals(bool apply_loss_function,
                        size_t num_tri_residuals,
                        std::vector<vw::Vector3> const& reference_vec,
                        ceres::Problem & problem,
+                       std::vector<ceres::ResidualBlockId> const& residual_blocks,
                        // Output
                        std::vector<double> & residuals) {
   // TODO: Associate residuals with cameras!
@@ -392,9 +542,12 @@ void compute_residuals(bool apply_loss_function,
   ceres::Problem::EvaluateOptions eval_options;
   eval_options.apply_loss_function = apply_loss_function;
   if (opt.single_threaded_cameras)
-    eval_options.num_threads = 1; // ISIS must be single threaded!
+    eval_options.num_threads = 1; // some cameras must be single threaded
   else
     eval_options.num_threads = opt.num_threads;
+  // Evaluate the blocks in the order they were added, skipping the ones
+  // removed since then, as the bookkeeping below expects.
+  eval_options.residual_blocks = residual_blocks;
 
   problem.Evaluate(eval_options, &cost, &residuals, 0, 0);
   const size_t num_residuals = residuals.size();
@@ -507,10 +660,11 @@ void write_residual_map(std::string const& output_prefix,
   file << "# " << opt.datum << std::endl;
   
   // Now write all the points to the file
-  for (size_t i = 0; i < param_storage.num_points(); i++) {
+  write_in_parallel(file, param_storage.num_points(), opt.num_threads,
+                    [&](size_t i, std::ostream & os) {
 
     if (param_storage.get_point_outlier(i))
-      continue; // skip outliers
+      return; // skip outliers
     
       // The final GCC coordinate of this point
       const double * point = param_storage.get_point_ptr(i);
@@ -524,17 +678,18 @@ void write_residual_map(std::string const& output_prefix,
       else if (cnet[i].type() == ControlPoint::PointFromDem)
         comment = " # from DEM";
       
-      file << llh[0] <<", "<< llh[1] <<", "<< llh[2] <<", "<< mean_residuals[i] <<", "
-           << num_point_observations[i] << comment << std::endl;
-  }
+      os << llh[0] <<", "<< llh[1] <<", "<< llh[2] <<", "<< mean_residuals[i] <<", "
+         << num_point_observations[i] << comment << "\n";
+  });
   file.close();
 
 } // End function write_residual_map
 
 
-/// Write log files describing all residual errors. The order of data stored
-/// in residuals must mirror perfectly the way residuals were created. 
-void write_residual_logs(std::string const& residual_prefix, bool apply_loss_function,
+/// Write log files describing all residual errors, as found by
+/// compute_residuals(). The order of data stored in residuals must
+/// mirror perfectly the way residuals were created. 
+void write_residual_logs(std::string const& residual_prefix,
                          Options const& opt,
                          asp::BAParams const& param_storage,
                          std::vector<size_t> const& cam_residual_counts,
@@ -542,15 +697,8 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
                          size_t num_tri_residuals,
                          std::vector<vw::Vector3> const& reference_vec,
                          ControlNetwork const& cnet, CRNJ & crn, 
-                         ceres::Problem &problem) {
+                         std::vector<double> const& residuals) {
   
-  std::vector<double> residuals;
-  compute_residuals(apply_loss_function, opt, param_storage,
-                    cam_residual_counts, num_gcp_or_dem_residuals, num_tri_residuals,
-                    reference_vec, problem,
-                    // Output
-                    residuals);
-    
   const size_t num_residuals = residuals.size();
 
   const std::string residual_path               = residual_prefix + "_stats.txt";
@@ -580,18 +728,26 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
     residual_file_reference_xyz.precision(17);
   }
   
-  size_t index = 0;
-  // For each camera, average together all the point observation residuals
-  residual_file << "Mean and median norm of residual error and point count for cameras:\n";
-  for (size_t c = 0; c < param_storage.num_cameras(); c++) {
+  // Where the residuals of each camera start
+  const size_t num_cameras = param_storage.num_cameras();
+  std::vector<size_t> cam_start(num_cameras + 1, 0);
+  for (size_t c = 0; c < num_cameras; c++)
+    cam_start[c + 1] = cam_start[c] + PIXEL_SIZE * cam_residual_counts[c];
+
+  // For each camera, average together all the point observation
+  // residuals. This is done in parallel, as is writing the raw file.
+  std::vector<double> mean_residuals(num_cameras), median_residuals(num_cameras);
+  write_in_parallel(residual_file_raw_pixels, num_cameras, opt.num_threads,
+                    [&](size_t c, std::ostream & os) {
     size_t num_this_cam_residuals = cam_residual_counts[c];
+    size_t index = cam_start[c];
     
     // Write header for the raw file
     std::string name = opt.camera_files[c];
     if (name == "")
       name = opt.image_files[c];
     
-    residual_file_raw_pixels << name << ", " << num_this_cam_residuals << std::endl;
+    os << name << ", " << num_this_cam_residuals << "\n";
 
     // All residuals are for inliers, as we do not even add a residual
     // for an outlier
@@ -606,21 +762,30 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
       double residual_norm = std::sqrt(ex * ex + ey * ey);
       mean_residual += residual_norm;
       residual_norms.push_back(residual_norm);
-      residual_file_raw_pixels << ex << ", " << ey << std::endl; // Write ex, ey on raw file
+      os << ex << ", " << ey << "\n"; // Write ex, ey on raw file
     }
-    // Write line for the summary file
     mean_residual /= static_cast<double>(num_this_cam_residuals);
     double median_residual = std::numeric_limits<double>::quiet_NaN();
     if (residual_norms.size() > 0) {
       std::sort(residual_norms.begin(), residual_norms.end());
       median_residual = residual_norms[residual_norms.size()/2];
     }
-    
+    mean_residuals[c]   = mean_residual;
+    median_residuals[c] = median_residual;
+  });
+
+  // Write the lines for the summary file
+  residual_file << "Mean and median norm of residual error and point count for cameras:\n";
+  for (size_t c = 0; c < num_cameras; c++) {
+    std::string name = opt.camera_files[c];
+    if (name == "")
+      name = opt.image_files[c];
     residual_file << name                   << ", "
-                  << mean_residual          << ", "
-                  << median_residual        << ", "
-                  << num_this_cam_residuals << std::endl;
+                  << mean_residuals[c]      << ", "
+                  << median_residuals[c]    << ", "
+                  << cam_residual_counts[c] << std::endl;
   }
+  size_t index = cam_start[num_cameras];
   
   residual_file_raw_pixels.close();
   
@@ -706,12 +871,12 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
 
   // Generate the location based file
   std::string map_prefix = residual_prefix + "_pointmap";
-  std::vector<double> mean_residuals;
+  std::vector<double> mean_point_residuals;
   std::vector<int> num_point_observations;
   compute_mean_residuals_at_xyz(crn,  residuals,  param_storage,
-                                mean_residuals, num_point_observations);
+                                mean_point_residuals, num_point_observations);
 
-  write_residual_map(map_prefix, mean_residuals, num_point_observations,
+  write_residual_map(map_prefix, mean_point_residuals, num_point_observations,
                      param_storage, cnet, opt);
 
 } // End function write_residual_logs
@@ -728,26 +893,14 @@ int add_to_outliers(ControlNetwork & cnet,
                     CRNJ & crn,
                     asp::BAParams & param_storage,
                     Options const& opt,
-                    std::vector<size_t> const& cam_residual_counts,
-                    size_t num_gcp_or_dem_residuals,
-                    size_t num_tri_residuals,
-                    std::vector<vw::Vector3> const& reference_vec, 
-                    ceres::Problem &problem) {
+                    // The residuals without the loss function, so the
+                    // reprojection errors
+                    std::vector<double> const& residuals) {
 
   vw_out() << "Removing pixel outliers in preparation for another solver attempt.\n";
 
   const size_t num_points  = param_storage.num_points();
   const size_t num_cameras = param_storage.num_cameras();
-  
-  // Compute the reprojection error. Hence we should not add the contribution
-  // of the loss function.
-  bool apply_loss_function = false;
-  std::vector<double> residuals;
-  compute_residuals(apply_loss_function,  
-                    opt, param_storage,  cam_residual_counts,  
-                    num_gcp_or_dem_residuals, num_tri_residuals, reference_vec, problem,
-                    // output
-                    residuals);
 
   // Compute the mean residual at each xyz, and how many times that residual is seen
   std::vector<double> mean_residuals;
@@ -1007,29 +1160,49 @@ void initial_filter_by_proj_win(Options             & opt,
   }
 }
 
-int do_ba_ceres_one_pass(Options             & opt,
-                         CRNJ                & crn,
-                         bool                  first_pass,
-                         asp::BAParams       & param_storage, 
-                         asp::BAParams const & orig_parameters,
-                         bool                & convergence_reached,
-                         double              & final_cost) {
+// The Ceres problem for bundle adjustment, and the bookkeeping needed to
+// interpret its residuals. This is kept across passes, so that after
+// outliers are found their residuals can be removed, rather than
+// adding all the residuals again.
+struct BaProblem {
+
+  BaProblem(): num_gcp(0), num_gcp_or_dem_residuals(0), num_tri_residuals(0) {
+    // Make it cheap to remove the residuals of outliers
+    ceres::Problem::Options options;
+    options.enable_fast_removal = true;
+    problem.reset(new ceres::Problem(options));
+  }
+
+  boost::shared_ptr<ceres::Problem> problem;
+
+  // The residual blocks in the order they were added, which is the order
+  // the logs and outlier filtering expect. Removed blocks are erased.
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+
+  std::vector<size_t> cam_residual_counts;
+  int num_gcp, num_gcp_or_dem_residuals, num_tri_residuals;
+
+  // The reference terrain points, and the disparities the residuals for
+  // them refer to
+  std::vector<vw::Vector3> reference_vec;
+  std::vector<ImageView<DispPixelT>> disp_vec;
+  std::vector<ImageViewRef<DispPixelT>> interp_disp;
+};
 
-  ceres::Problem problem;
+/// Add all the residuals to the problem, skipping the outliers
+void build_ba_problem(Options             & opt,
+                      CRNJ                & crn,
+                      asp::TrackStore const& tracks,
+                      asp::BAParams       & param_storage, 
+                      asp::BAParams const & orig_parameters,
+                      BaProblem           & ba_problem) {
+
+  ceres::Problem & problem = *ba_problem.problem;
 
   ControlNetwork & cnet = *opt.cnet;
   const int num_cameras = param_storage.num_cameras();
   const int num_points  = param_storage.num_points();
 
-  if ((int)crn.size() != num_cameras) 
-    vw_throw(ArgumentErr() << "Book-keeping error, the size of CameraRelationNetwork "
-             << "must equal the number of images.\n");
- 
-  convergence_reached = true;
-
-  if (opt.proj_win != BBox2(0, 0, 0, 0) && (!opt.proj_str.empty()))
-    initial_filter_by_proj_win(opt, param_storage, cnet);
-  
   // How many times an xyz point shows up in the problem
   std::vector<int> count_map(num_points);
   for (int i = 0; i < num_points; i++) {
@@ -1078,14 +1251,17 @@ int do_ba_ceres_one_pass(Options             & opt,
   // - Reduce error by making pixel projection consistent with observations.
   
   // Add the various cost functions the solver will optimize over.
-  std::vector<size_t> cam_residual_counts(num_cameras);
-  typedef CameraNode<JFeature>::iterator crn_iter;
+  // The observations are read from the flat track store, in the same
+  // order as in the camera relation network, which is used for outlier
+  // bookkeeping.
+  std::vector<size_t> & cam_residual_counts = ba_problem.cam_residual_counts;
+  cam_residual_counts.resize(num_cameras);
   for (int icam = 0; icam < num_cameras; icam++) { // Camera loop
     cam_residual_counts[icam] = 0;
-    for (crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) { // IP loop
+    for (size_t obs = tracks.cam_begin(icam); obs < tracks.cam_end(icam); obs++) { // IP loop
 
       // The index of the 3D point this IP is for.
-      int ipt = (**fiter).m_point_id;
+      int ipt = tracks.point_index(obs);
       if (param_storage.get_point_outlier(ipt))
         continue; // skip outliers
 
@@ -1134,8 +1310,8 @@ int do_ba_ceres_one_pass(Options             & opt,
 
       // The observed value for the projection of point with index ipt into
       // the camera with index icam.
-      Vector2 observation = (**fiter).m_location;
-      Vector2 pixel_sigma = (**fiter).m_scale;
+      Vector2 observation = tracks.pixel(obs);
+      Vector2 pixel_sigma = tracks.sigma(obs);
 
       // This is a bugfix
       if (pixel_sigma != pixel_sigma) // nan check
@@ -1159,7 +1335,8 @@ int do_ba_ceres_one_pass(Options             & opt,
 
   // Add ground control points or points based on a DEM constraint
   // Error goes up as GCP's move from their input positions.
-  int num_gcp = 0, num_gcp_or_dem_residuals = 0;
+  ba_problem.num_gcp = 0;
+  ba_problem.num_gcp_or_dem_residuals = 0;
   for (int ipt = 0; ipt < num_points; ipt++) {
     if (cnet[ipt].type() != ControlPoint::GroundControlPoint &&
         cnet[ipt].type() != ControlPoint::PointFromDem)
@@ -1169,7 +1346,7 @@ int do_ba_ceres_one_pass(Options             & opt,
       continue; // skip outliers
     
     if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
-      num_gcp++;
+      ba_problem.num_gcp++;
 
     Vector3 observation = cnet[ipt].position();
     Vector3 xyz_sigma   = cnet[ipt].sigma();
@@ -1203,7 +1380,7 @@ int do_ba_ceres_one_pass(Options             & opt,
     double * point  = param_storage.get_point_ptr(ipt);
     problem.AddResidualBlock(cost_function, loss_function, point);
 
-    num_gcp_or_dem_residuals++;
+    ba_problem.num_gcp_or_dem_residuals++;
 
     if (opt.fix_gcp_xyz) 
       problem.SetParameterBlockConstant(point);
@@ -1250,9 +1427,9 @@ int do_ba_ceres_one_pass(Options             & opt,
   // option --unalign-disparity. If there are n images,
   // there must be n-1 disparities, from each image to the next.
   // The doc has more info in the bundle_adjust chapter.
-  std::vector<ImageView<DispPixelT>> disp_vec;
-  std::vector<ImageViewRef<DispPixelT>> interp_disp; 
-  std::vector<vw::Vector3> reference_vec;
+  std::vector<ImageView<DispPixelT>> & disp_vec = ba_problem.disp_vec;
+  std::vector<ImageViewRef<DispPixelT>> & interp_disp = ba_problem.interp_disp;
+  std::vector<vw::Vector3> & reference_vec = ba_problem.reference_vec;
   if (opt.reference_terrain != "") {
     // TODO: Pass these properly
     g_max_disp_error           = opt.max_disp_error;
@@ -1355,7 +1532,7 @@ int do_ba_ceres_one_pass(Options             & opt,
     vw_out() << "Found " << reference_vec.size() << " reference points in range.\n";
   } // End of reference terrain block
 
-  int num_tri_residuals = 0;
+  ba_problem.num_tri_residuals = 0;
   if (opt.tri_weight > 0) {
     // Add triangulation weight to make each triangulated point not move too far
     for (int ipt = 0; ipt < num_points; ipt++) {
@@ -1377,9 +1554,119 @@ int do_ba_ceres_one_pass(Options             & opt,
       ceres::LossFunction* loss_function = get_loss_function(opt, opt.tri_robust_threshold);
       problem.AddResidualBlock(cost_function, loss_function, point);
 
-      num_tri_residuals++;
+      ba_problem.num_tri_residuals++;
     } // End loop through xyz
   } // end adding a triangulation constraint
+
+  problem.GetResidualBlocks(&ba_problem.residual_blocks);
+}
+
+/// Remove from the problem the residuals involving points which were
+/// flagged as outliers since it was built, and update the residual
+/// counts. This has the same result as building the problem again,
+/// without the expense of that.
+void remove_outlier_residuals(Options const& opt,
+                              asp::TrackStore const& tracks,
+                              asp::BAParams & param_storage,
+                              BaProblem & ba_problem) {
+
+  ceres::Problem & problem = *ba_problem.problem;
+  ControlNetwork const& cnet = *opt.cnet;
+  const int num_cameras = param_storage.num_cameras();
+  const int num_points  = param_storage.num_points();
+
+  std::set<ceres::ResidualBlockId> removed;
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    double * point = param_storage.get_point_ptr(ipt);
+    if (!param_storage.get_point_outlier(ipt) || !problem.HasParameterBlock(point))
+      continue;
+    std::vector<ceres::ResidualBlockId> blocks;
+    problem.GetResidualBlocksForParameterBlock(point, &blocks);
+    removed.insert(blocks.begin(), blocks.end());
+    problem.RemoveParameterBlock(point); // also removes its residual blocks
+  }
+  if (removed.empty())
+    return;
+
+  std::vector<ceres::ResidualBlockId> & blocks = ba_problem.residual_blocks;
+  size_t count = 0;
+  for (size_t it = 0; it < blocks.size(); it++) {
+    if (removed.find(blocks[it]) == removed.end())
+      blocks[count++] = blocks[it];
+  }
+  blocks.resize(count);
+
+  // Count the residuals which are left, as when building the problem
+  for (int icam = 0; icam < num_cameras; icam++) {
+    ba_problem.cam_residual_counts[icam] = 0;
+    for (size_t obs = tracks.cam_begin(icam); obs < tracks.cam_end(icam); obs++) {
+      if (!param_storage.get_point_outlier(tracks.point_index(obs)))
+        ba_problem.cam_residual_counts[icam]++;
+    }
+  }
+  ba_problem.num_gcp = 0;
+  ba_problem.num_gcp_or_dem_residuals = 0;
+  ba_problem.num_tri_residuals = 0;
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    if (param_storage.get_point_outlier(ipt))
+      continue;
+    bool is_gcp = (cnet[ipt].type() == ControlPoint::GroundControlPoint);
+    if (is_gcp || cnet[ipt].type() == ControlPoint::PointFromDem) {
+      ba_problem.num_gcp += int(is_gcp);
+      ba_problem.num_gcp_or_dem_residuals++;
+    } else if (opt.tri_weight > 0) {
+      ba_problem.num_tri_residuals++;
+    }
+  }
+
+  vw_out() << "Removed " << removed.size() << " residual blocks for outliers.\n";
+}
+
+int do_ba_ceres_one_pass(Options             & opt,
+                         CRNJ                & crn,
+                         asp::TrackStore const& tracks,
+                         bool                  first_pass,
+                         asp::BAParams       & param_storage, 
+                         asp::BAParams const & orig_parameters,
+                         boost::shared_ptr<BaProblem> & ba_problem,
+                         AsyncResidualLogs   & async_logs,
+                         bool                & convergence_reached,
+                         double              & final_cost) {
+
+  ControlNetwork & cnet = *opt.cnet;
+  const int num_cameras = param_storage.num_cameras();
+  const int num_points  = param_storage.num_points();
+
+  if ((int)crn.size() != num_cameras) 
+    vw_throw(ArgumentErr() << "Book-keeping error, the size of CameraRelationNetwork "
+             << "must equal the number of images.\n");
+  if (tracks.num_cameras() != num_cameras || tracks.num_points() != num_points)
+    vw_throw(ArgumentErr() << "Book-keeping error, the observations must be "
+             << "for all images and points.\n");
+ 
+  convergence_reached = true;
+
+  if (opt.proj_win != BBox2(0, 0, 0, 0) && (!opt.proj_str.empty()))
+    initial_filter_by_proj_win(opt, param_storage, cnet);
+
+  // The problem is built on the first pass, and then only the residuals
+  // of new outliers are removed. With a DEM, the anchor points depend on
+  // the latest points, so then it is built each time.
+  bool have_dem = (!opt.heights_from_dem.empty() || !opt.ref_dem.empty());
+  if (ba_problem.get() == NULL || have_dem) {
+    ba_problem.reset(new BaProblem);
+    build_ba_problem(opt, crn, tracks, param_storage, orig_parameters, *ba_problem);
+  } else {
+    remove_outlier_residuals(opt, tracks, param_storage, *ba_problem);
+  }
+
+  ceres::Problem & problem = *ba_problem->problem;
+  std::vector<ceres::ResidualBlockId> const& residual_blocks = ba_problem->residual_blocks;
+  std::vector<size_t> const& cam_residual_counts = ba_problem->cam_residual_counts;
+  std::vector<vw::Vector3> const& reference_vec  = ba_problem->reference_vec;
+  int num_gcp                  = ba_problem->num_gcp;
+  int num_gcp_or_dem_residuals = ba_problem->num_gcp_or_dem_residuals;
+  int num_tri_residuals        = ba_problem->num_tri_residuals;
   
   const size_t MIN_KML_POINTS = 50;
   size_t kmlPointSkip = 30;
@@ -1402,9 +1689,14 @@ int do_ba_ceres_one_pass(Options             & opt,
     std::string residual_prefix = opt.out_prefix + "-initial_residuals";
     vw_out() << "Writing initial condition files." << std::endl;
     bool apply_loss_function = false;
-    write_residual_logs(residual_prefix, apply_loss_function, opt, param_storage, 
+    std::vector<double> residuals;
+    compute_residuals(apply_loss_function, opt, param_storage,
+                      cam_residual_counts, num_gcp_or_dem_residuals, num_tri_residuals,
+                      reference_vec, problem, residual_blocks,
+                      residuals); // output
+    write_residual_logs(residual_prefix, opt, param_storage, 
                         cam_residual_counts, num_gcp_or_dem_residuals, num_tri_residuals,
-                        reference_vec, cnet, crn, problem);
+                        reference_vec, cnet, crn, residuals);
     
     param_storage.record_points_to_kml(point_kml_path, opt.datum, 
                          kmlPointSkip, "initial_points",
@@ -1428,7 +1720,7 @@ int do_ba_ceres_one_pass(Options             & opt,
 
   // Use a callback function at every iteration, if desired to save the intermediate results
   BaCallback callback(opt, param_storage);
-  if (opt.save_intermediate_cameras) {
+  if (opt.save_intermediate_cameras || opt.checkpoint_every > 0) {
     options.callbacks.push_back(&callback);
     options.update_state_every_iteration = true;
   }
@@ -1445,6 +1737,8 @@ int do_ba_ceres_one_pass(Options             & opt,
   }
   if (num_cameras > 7000)
     options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+  asp::set_solver_backend(opt.solver_backend, opt.solver_mixed_precision,
+                          num_cameras, options);
 
   //options.ordering_type = ceres::SCHUR;
   //options.eta = 1e-3; // FLAGS_eta;
@@ -1455,8 +1749,11 @@ int do_ba_ceres_one_pass(Options             & opt,
   //}
 
   vw_out() << "Starting the Ceres optimizer." << std::endl;
+  asp::record_problem_size(problem);
+  asp::TelemetryTimer solve_timer("bundle_adjust.solve");
   ceres::Solver::Summary summary;
   ceres::Solve(options, &problem, &summary);
+  solve_timer.stop();
   final_cost = summary.final_cost;
   vw_out() << summary.FullReport() << "\n";
   if (summary.termination_type == ceres::NO_CONVERGENCE){
@@ -1465,15 +1762,39 @@ int do_ba_ceres_one_pass(Options             & opt,
     convergence_reached = false;
   }
 
+  // Find the residuals without the loss function, so the reprojection
+  // errors, once, for both the logs and outlier filtering.
+  bool apply_loss_function = false;
+  std::vector<double> residuals;
+  compute_residuals(apply_loss_function, opt, param_storage,
+                    cam_residual_counts, num_gcp_or_dem_residuals, num_tri_residuals,
+                    reference_vec, problem, residual_blocks,
+                    residuals); // output
+
   // Write the condition files after each pass, as we never know which pass will be the last
   // since we may stop the passes prematurely if no more outliers are present.
+  // The previous pass may still be writing them.
+  async_logs.wait();
   vw_out() << "Writing final condition log files." << std::endl;
   std::string residual_prefix = opt.out_prefix + "-final_residuals";
-  bool apply_loss_function = false;
-  write_residual_logs(residual_prefix, apply_loss_function, opt, param_storage,
-                      cam_residual_counts,
-                      num_gcp_or_dem_residuals, num_tri_residuals,
-                      reference_vec, cnet, crn, problem);
+  if (opt.async_residual_logs && !have_dem) {
+    // Copy what changes later. With a DEM, the control network changes
+    // when the next pass is set up, so then this is not done.
+    boost::shared_ptr<asp::BAParams> params_copy(new asp::BAParams(param_storage));
+    std::vector<size_t> counts = cam_residual_counts;
+    std::vector<vw::Vector3> ref_vec = reference_vec;
+    async_logs.start([&opt, &cnet, &crn, residual_prefix, params_copy, counts,
+                      num_gcp_or_dem_residuals, num_tri_residuals, ref_vec, residuals]() {
+      write_residual_logs(residual_prefix, opt, *params_copy, counts,
+                          num_gcp_or_dem_residuals, num_tri_residuals,
+                          ref_vec, cnet, crn, residuals);
+    });
+  } else {
+    write_residual_logs(residual_prefix, opt, param_storage,
+                        cam_residual_counts,
+                        num_gcp_or_dem_residuals, num_tri_residuals,
+                        reference_vec, cnet, crn, residuals);
+  }
   
   std::string point_kml_path = opt.out_prefix + "-final_points.kml";
   std::string url = "http://maps.google.com/mapfiles/kml/shapes/placemark_circle_highlight.png";
@@ -1490,8 +1811,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   if (remove_outliers)
       add_to_outliers(cnet, crn,
                       param_storage,   // in-out
-                      opt, cam_residual_counts, num_gcp_or_dem_residuals,
-                      num_tri_residuals, reference_vec, problem);
+                      opt, residuals);
 
   // Find the cameras with the latest adjustments. Note that we do not modify
   // opt.camera_models, but make copies as needed.
@@ -1513,7 +1833,7 @@ int do_ba_ceres_one_pass(Options             & opt,
       vw::vw_throw(vw::ArgumentErr() << "Could not read a georeference from: "
                    << opt.mapproj_dem << ".\n");
   }
-  outliers.clear(); 
+  std::set<int> outliers;
   for (int i = 0; i < param_storage.num_points(); i++)
     if (param_storage.get_point_outlier(i))
       outliers.insert(i); // update this based on param_storage
@@ -1539,6 +1859,44 @@ int do_ba_ceres_one_pass(Options             & opt,
   return 0;
 } // End function do_ba_ceres_one_pass
 
+// A key identifying the inputs the control network is made from: the
+// images, cameras, input adjustments, match files, and the options
+// used in building it. Files are identified by name, size, and
+// modification time.
+std::uint64_t tracks_key(Options const& opt) {
+
+  std::uint64_t key = 0;
+  auto add_file = [&key](std::string const& file) {
+    key = asp::TrackStore::hash(key, file);
+    if (fs::exists(file)) {
+      key = asp::TrackStore::hash(key, std::to_string(fs::file_size(file)));
+      key = asp::TrackStore::hash(key, std::to_string(fs::last_write_time(file)));
+    }
+  };
+
+  for (size_t it = 0; it < opt.image_files.size(); it++) {
+    add_file(opt.image_files[it]);
+    add_file(opt.camera_files[it]);
+    if (opt.input_prefix != "")
+      add_file(asp::bundle_adjust_file_name(opt.input_prefix, opt.image_files[it],
+                                            opt.camera_files[it]));
+  }
+  for (auto it = opt.match_files.begin(); it != opt.match_files.end(); it++) {
+    key = asp::TrackStore::hash(key, std::to_string(it->first.first) + " " +
+                                std::to_string(it->first.second));
+    add_file(it->second);
+  }
+
+  std::ostringstream os;
+  os.precision(17);
+  os << opt.min_matches << " " << opt.min_triangulation_angle << " "
+     << opt.forced_triangulation_distance << " " << opt.max_pairwise_matches << " "
+     << opt.stereo_session << " " << opt.initial_transform_file;
+  key = asp::TrackStore::hash(key, os.str());
+
+  return key;
+}
+
 /// Use Ceres to do bundle adjustment.
 void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc){
 
@@ -1549,15 +1907,37 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   int num_gcp = 0;
   ControlNetwork & cnet = *(opt.cnet.get()); // alias
   if (!opt.apply_initial_transform_only) {
-    bool triangulate_control_points = true;
-    bool success = vw::ba::build_control_network(triangulate_control_points,
-                                                 cnet, opt.camera_models,
-                                                 opt.image_files,
-                                                 opt.match_files,
-                                                 opt.min_matches,
-                                                 opt.min_triangulation_angle*(M_PI/180.0),
-                                                 opt.forced_triangulation_distance,
-                                                 opt.max_pairwise_matches);
+
+    // Try to reuse the control network from an earlier run with the same inputs
+    bool success = false;
+    std::uint64_t key = 0;
+    if (opt.tracks_file != "") {
+      key = tracks_key(opt);
+      asp::TrackStore cached;
+      if (cached.read(opt.tracks_file, key)) {
+        vw_out() << "Reading the control network from: " << opt.tracks_file << "\n";
+        cached.to_cnet(cnet);
+        success = (cnet.size() > 0);
+      }
+    }
+
+    if (!success) {
+      bool triangulate_control_points = true;
+      success = vw::ba::build_control_network(triangulate_control_points,
+                                              cnet, opt.camera_models,
+                                              opt.image_files,
+                                              opt.match_files,
+                                              opt.min_matches,
+                                              opt.min_triangulation_angle*(M_PI/180.0),
+                                              opt.forced_triangulation_distance,
+                                              opt.max_pairwise_matches);
+      if (success && opt.tracks_file != "") {
+        vw_out() << "Writing: " << opt.tracks_file << "\n";
+        asp::TrackStore tracks;
+        tracks.from_cnet(cnet, opt.image_files.size());
+        tracks.write(opt.tracks_file, key);
+      }
+    }
     if (!success) {
       vw_out() << "Failed to build a control network.\n"
                << " - Consider removing all .vwip and .match files and \n"
@@ -1708,9 +2088,19 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   CRNJ crn;
   crn.from_cnet(cnet);
 
+  // The same observations, in a flat form which is faster to iterate over
+  asp::TrackStore tracks;
+  tracks.from_cnet(cnet, num_cameras);
+
   if (opt.num_ba_passes <= 0)
     vw_throw(ArgumentErr() << "Error: Expecting at least one bundle adjust pass.\n");
   
+  // The problem, built on the first pass and updated on later ones
+  boost::shared_ptr<BaProblem> ba_problem;
+
+  // Writes the residual logs of a pass while the next one is set up
+  AsyncResidualLogs async_logs;
+
   double final_cost;
   for (int pass = 0; pass < opt.num_ba_passes; pass++) {
 
@@ -1721,8 +2111,8 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
 
     bool first_pass = (pass == 0);
     bool convergence_reached = true; // will change
-    do_ba_ceres_one_pass(opt, crn, first_pass,
-                         param_storage, orig_parameters,
+    do_ba_ceres_one_pass(opt, crn, tracks, first_pass,
+                         param_storage, orig_parameters, ba_problem, async_logs,
                          convergence_reached, final_cost);
     
     int num_points_remaining = num_points - param_storage.get_num_outliers();
@@ -1732,6 +2122,10 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
       vw_throw(ArgumentErr() << "Error: Too few points remain after filtering!.\n");
     }
   } // End loop through passes
+  async_logs.wait();
+
+  if (opt.save_camera_covariance && ba_problem.get() != NULL)
+    saveCameraCovariances(opt, param_storage, *ba_problem->problem);
 
   double best_cost = final_cost;
   boost::shared_ptr<asp::BAParams> best_params_ptr(new asp::BAParams(param_storage));
@@ -1758,9 +2152,10 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     // Do another pass of bundle adjustment.
     bool first_pass = true; // this needs more thinking
     bool convergence_reached = true;
-    do_ba_ceres_one_pass(opt, crn, first_pass,
-                         param_storage, orig_parameters,
+    do_ba_ceres_one_pass(opt, crn, tracks, first_pass,
+                         param_storage, orig_parameters, ba_problem, async_logs,
                          convergence_reached, final_cost);
+    async_logs.wait();
     
     // Record the parameters of the best result.
     if (final_cost < best_cost) {
@@ -1978,6 +2373,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Set the maximum number of iterations.") // alias for num-iterations
     ("parameter-tolerance",  po::value(&opt.parameter_tolerance)->default_value(1e-8),
      "Stop when the relative error in the variables being optimized is less than this.")
+    ("solver-backend", po::value(&opt.solver_backend)->default_value("auto"),
+     "The linear solver to use in the optimization. Options: auto, dense_schur, sparse_schur, iterative_schur, iterative_schur_power_series, cuda_dense_schur, cuda_sparse_schur. The default picks one based on the number of cameras, and uses the GPU if Ceres was built with CUDA and one is present.")
+    ("solver-mixed-precision", po::bool_switch(&opt.solver_mixed_precision)->default_value(false)->implicit_value(true),
+     "Factor the Schur complement in single precision and refine the solution in double precision. This is faster, especially on the GPU, but may need more iterations.")
     ("overlap-limit",        po::value(&opt.overlap_limit)->default_value(0),
      "Limit the number of subsequent images to search for matches to the current image to this value. By default match all images.")
     ("overlap-list",         po::value(&opt.overlap_list_file)->default_value(""),
@@ -2029,6 +2428,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
       "How many interest points to detect in each 1024^2 image tile (default: automatic determination). This is before matching. Not all interest points will have a match. See also --matches-per-tile.")
     ("ip-per-image",              po::value(&opt.ip_per_image)->default_value(0),
      "How many interest points to detect in each image (default: automatic determination). It is overridden by --ip-per-tile if provided.")
+    ("ip-cache-dir",         po::value(&opt.ip_cache_dir)->default_value(""),
+     "Store detected interest points in this directory, keyed by the image pixels and the detection options, and reuse them whenever the same image is processed with the same options, including by stereo and pc_align.")
+    ("tracks-file",          po::value(&opt.tracks_file)->default_value(""),
+     "Save the control network, that is, the triangulated points and their observations in the images, to this file, in a compact binary format. A later run with the same images, cameras, match files, and matching options will read it instead of building the control network again from the match files.")
     ("num-passes",           po::value(&opt.num_ba_passes)->default_value(2),
      "How many passes of bundle adjustment to do, with given number of iterations in each pass. For more than one pass, outliers will be removed between passes using --remove-outliers-params, and re-optimization will take place. Residual files and a copy of the match files with the outliers removed (*-clean.match) will be written to disk.")
     ("num-random-passes",           po::value(&opt.num_random_passes)->default_value(0),
@@ -2094,12 +2497,24 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
       "than this. See also --matches-per-tile-params.")
     ("save-cnet-as-csv", po::bool_switch(&opt.save_cnet_as_csv)->default_value(false)->implicit_value(true),
      "Save the control network containing all interest points in the format used by ground control points, so it can be inspected.")
+    ("async-residual-logs", po::bool_switch(&opt.async_residual_logs)->default_value(false)->implicit_value(true),
+     "Write the final residual logs of each pass on a background thread, while outliers are removed and the next pass is set up.")
+    ("save-camera-covariance", po::bool_switch(&opt.save_camera_covariance)->default_value(false)->implicit_value(true),
+     "Save the covariance of the optimized position and orientation of each camera, marginalized over all other variables. Only the blocks for the cameras are computed, using sparse algebra, so this works with many cameras.")
     ("gcp-from-mapprojected-images", po::value(&opt.gcp_from_mapprojected)->default_value(""),
      "Given map-projected versions of the input images, the DEM the were mapprojected onto, and interest point matches among all of these created in stereo_gui, create GCP for the input images to align them better to the DEM. This is experimental and not documented.")
     ("instance-count",      po::value(&opt.instance_count)->default_value(1),
      "The number of bundle_adjustment processes being run in parallel.")
     ("instance-index",      po::value(&opt.instance_index)->default_value(0),
      "The index of this parallel bundle adjustment process.")
+    ("num-partitions",      po::value(&opt.num_partitions)->default_value(1),
+     "Split the cameras into this many groups of cameras which see each other, and solve only for the group given by --partition-index, with the other cameras kept fixed. Only the cameras in the group are written. Used by parallel_bundle_adjust.")
+    ("partition-index",     po::value(&opt.partition_index)->default_value(0),
+     "The index of the group of cameras to solve for, when using --num-partitions.")
+    ("num-matching-threads", po::value(&opt.num_matching_threads)->default_value(1),
+     "Match this many image pairs at the same time, each in its own thread. Pairs sharing an image are not matched at the same time.")
+    ("max-open-images",     po::value(&opt.max_open_images)->default_value(0),
+     "When matching image pairs in parallel, have at most this many images in use at the same time, to limit memory usage. The default is twice --num-matching-threads.")
     ("stop-after-statistics",    po::bool_switch(&opt.stop_after_stats)->default_value(false)->implicit_value(true),
      "Quit after computing image statistics.")
     ("stop-after-matching",    po::bool_switch(&opt.stop_after_matching)->default_value(false)->implicit_value(true),
@@ -2110,6 +2525,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Only use image matches which can be loaded from disk. This implies --force-reuse-match-files.")
     ("save-intermediate-cameras", po::value(&opt.save_intermediate_cameras)->default_value(false)->implicit_value(true),
      "Save the values for the cameras at each iteration.")
+    ("checkpoint-every", po::value(&opt.checkpoint_every)->default_value(0),
+     "Save the values for the cameras every this many iterations, so that a run "
+     "which is killed can be resumed from them with --input-adjustments-prefix. "
+     "Set to 0 to not save them.")
     ("apply-initial-transform-only", po::value(&opt.apply_initial_transform_only)->default_value(false)->implicit_value(true),
      "Apply to the cameras the transform given by --initial-transform. "
      "No iterations, GCP loading, image matching, or report generation "
@@ -2263,6 +2682,18 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw( ArgumentErr() << "Cannot specify both the overlap limit and --match-first-to-last.\n"
               << usage << general_options );
     
+  if (opt.num_matching_threads < 1)
+    vw_throw( ArgumentErr() << "The value of --num-matching-threads must be positive.\n"
+              << usage << general_options );
+  if (opt.checkpoint_every < 0)
+    vw_throw( ArgumentErr() << "The value of --checkpoint-every must be non-negative.\n"
+              << usage << general_options );
+  if (opt.max_open_images == 0)
+    opt.max_open_images = 2 * opt.num_matching_threads;
+  if (opt.max_open_images < 2)
+    vw_throw( ArgumentErr() << "The value of --max-open-images must be at least 2.\n"
+              << usage << general_options );
+
   if (opt.overlap_limit < 0)
     vw_throw( ArgumentErr() << "Must allow search for matches between "
               << "at least each image and its subsequent one.\n" << usage << general_options );
@@ -2523,6 +2954,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_out() << "Initial transform:\n" << opt.initial_transform << std::endl;
   }
 
+  if (opt.num_partitions < 1)
+    vw_throw(ArgumentErr() << "The value of --num-partitions must be positive.\n");
+  if (opt.partition_index < 0 || opt.partition_index >= opt.num_partitions)
+    vw_throw(ArgumentErr() << "The value of --partition-index must be non-negative "
+             << "and less than --num-partitions.\n");
+  if (opt.num_partitions > 1 && opt.camera_type != BaCameraType_Other)
+    vw_throw(ArgumentErr() << "The option --num-partitions is not supported "
+             << "with --inline-adjustments or when solving for intrinsics.\n");
+
   // Parse the indices of cameras not to float
   if (opt.fixed_cameras_indices_str != "") {
     opt.fixed_cameras_indices.clear();
@@ -2621,9 +3061,9 @@ void ba_match_ip(Options & opt, SessionPtr session,
   // Since we computed statistics earlier, this will just be loading files.
   vw::Vector<vw::float32,6> image1_stats, image2_stats;
   image1_stats = asp::gather_stats(masked_image1, image1_path, 
-                                   opt.out_prefix, image1_path);
+                                   opt.out_prefix, image1_path, nodata1);
   image2_stats = asp::gather_stats(masked_image2, image2_path, 
-                                   opt.out_prefix, image2_path);
+                                   opt.out_prefix, image2_path, nodata2);
   
   // Do not save by default .vwip files as those take space and are
   // not needed after a match file is created. If the user wants them,
@@ -2709,7 +3149,7 @@ void matches_from_mapproj_images(int i, int j,
   vw_out() << "Reading: " << map_match_file << std::endl;
   std::vector<ip::InterestPoint> ip1,     ip2;
   std::vector<ip::InterestPoint> ip1_cam, ip2_cam;
-  ip::read_binary_match_file(map_match_file, ip1, ip2);
+  asp::read_match_file(map_match_file, ip1, ip2);
   
   // Undo the map-projection
   for (size_t ip_iter = 0; ip_iter < ip1.size(); ip_iter++) {
@@ -2732,6 +3172,159 @@ void matches_from_mapproj_images(int i, int j,
 
 } // End function matches_from_mapproj_images()
 
+// Match one image pair. This may not always succeed. Unless the matches
+// are external, they are written under a temporary name and renamed when
+// complete, so an interrupted run does not leave a partial match file.
+void match_image_pair(Options & opt, int i, int j, bool external_matches,
+                      std::vector<std::string> const& map_files,
+                      vw::cartography::GeoReference const& dem_georef,
+                      ImageViewRef<PixelMask<double>> & interp_dem,
+                      std::mutex & session_mutex) {
+
+  std::string const& image1_path  = opt.image_files[i];  // alias
+  std::string const& image2_path  = opt.image_files[j];  // alias
+  std::string const& camera1_path = opt.camera_files[i]; // alias
+  std::string const& camera2_path = opt.camera_files[j]; // alias
+  std::string const& match_file   = opt.match_files.at(std::make_pair(i, j)); // alias
+
+  std::string out_match_file = match_file;
+  if (!external_matches) {
+    out_match_file = match_file + ".tmp";
+    if (boost::filesystem::exists(out_match_file))
+      boost::filesystem::remove(out_match_file);
+  }
+
+  try{
+
+    boost::shared_ptr<DiskImageResource> rsrc1;
+    SessionPtr session;
+    {
+      // Set up the stereo session
+      std::lock_guard<std::mutex> lock(session_mutex);
+      rsrc1 = boost::shared_ptr<DiskImageResource>(vw::DiskImageResourcePtr(image1_path));
+      session = SessionPtr(asp::StereoSessionFactory::create(opt.stereo_session, // may change
+                                                             opt, image1_path,  image2_path,
+                                                             camera1_path, camera2_path,
+                                                             opt.out_prefix));
+    }
+
+    if (opt.mapprojected_data == "") 
+      ba_match_ip(opt, session, image1_path, image2_path,
+                  opt.camera_models[i].get(),
+                  opt.camera_models[j].get(),
+                  out_match_file);
+    else
+      matches_from_mapproj_images(i, j, opt, session, map_files, dem_georef, interp_dem,  
+                                  out_match_file);
+
+    if (out_match_file != match_file && boost::filesystem::exists(out_match_file))
+      boost::filesystem::rename(out_match_file, match_file);
+
+    // Compute the coverage fraction
+    std::vector<ip::InterestPoint> ip1, ip2;
+    asp::read_match_file(match_file, ip1, ip2);
+    int right_ip_width = rsrc1->cols() *
+                          static_cast<double>(100-opt.ip_edge_buffer_percent)/100.0;
+    Vector2i ip_size(right_ip_width, rsrc1->rows());
+    double ip_coverage = asp::calc_ip_coverage_fraction(ip2, ip_size);
+    vw_out() << "IP coverage fraction = " << ip_coverage << std::endl;
+  } catch (const std::exception& e){
+    vw_out() << "Could not find interest points between images "
+              << opt.image_files[i] << " and " << opt.image_files[j] << std::endl;
+    vw_out(WarningMessage) << e.what() << std::endl;
+  } //End try/catch
+}
+
+// Match the given image pairs using --num-matching-threads threads. A
+// pair is started only if neither of its images is in use by another
+// pair, which keeps each camera model in one thread, and if the number
+// of images in use stays within --max-open-images.
+void match_image_pairs(Options & opt,
+                       std::vector<std::pair<int,int>> const& pairs,
+                       bool external_matches,
+                       std::vector<std::string> const& map_files,
+                       vw::cartography::GeoReference const& dem_georef,
+                       ImageViewRef<PixelMask<double>> & interp_dem) {
+
+  if (pairs.empty())
+    return;
+
+  int num_threads = std::min(opt.num_matching_threads, int(pairs.size()));
+  if (num_threads > 1 && opt.single_threaded_cameras) {
+    vw_out(WarningMessage) << "These cameras do not support multiple threads. "
+                           << "Matching one image pair at a time.\n";
+    num_threads = 1;
+  }
+
+  // Set this before any threads read it
+  if (opt.save_vwip && opt.vwip_prefix == "")
+    opt.vwip_prefix = opt.out_prefix;
+
+  std::mutex session_mutex;
+  if (num_threads == 1) {
+    for (size_t k = 0; k < pairs.size(); k++)
+      match_image_pair(opt, pairs[k].first, pairs[k].second, external_matches,
+                       map_files, dem_georef, interp_dem, session_mutex);
+    return;
+  }
+
+  vw_out() << "Matching " << pairs.size() << " image pairs using "
+           << num_threads << " threads.\n";
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<bool> started(pairs.size(), false);
+  std::vector<bool> image_in_use(opt.image_files.size(), false);
+  size_t num_started = 0;
+  int num_open = 0;
+
+  auto worker = [&]() {
+    while (1) {
+      size_t k = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (1) {
+          if (num_started == pairs.size())
+            return;
+          // Some pair is always eligible if none is running
+          for (k = 0; k < pairs.size(); k++) {
+            if (!started[k] && !image_in_use[pairs[k].first] &&
+                !image_in_use[pairs[k].second] && num_open + 2 <= opt.max_open_images)
+              break;
+          }
+          if (k < pairs.size())
+            break;
+          cv.wait(lock);
+        }
+        started[k] = true;
+        num_started++;
+        image_in_use[pairs[k].first]  = true;
+        image_in_use[pairs[k].second] = true;
+        num_open += 2;
+        vw_out() << "Matching image pair " << num_started << " out of "
+                 << pairs.size() << ".\n";
+      }
+
+      match_image_pair(opt, pairs[k].first, pairs[k].second, external_matches,
+                       map_files, dem_georef, interp_dem, session_mutex);
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        image_in_use[pairs[k].first]  = false;
+        image_in_use[pairs[k].second] = false;
+        num_open -= 2;
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int it = 0; it < num_threads; it++)
+    threads.push_back(std::thread(worker));
+  for (size_t it = 0; it < threads.size(); it++)
+    threads[it].join();
+}
+
 /// If the user map-projected the images and created matches by hand
 /// from each map-projected image to the DEM it was map-projected onto,
 /// project those matches back into the camera image, and create gcp
@@ -2775,7 +3368,7 @@ void create_gcp_from_mapprojected_images(Options const& opt){
 
     vw_out() << "Reading: " << match_filename << std::endl;
     std::vector<ip::InterestPoint> ip1, ip2;
-    ip::read_binary_match_file(match_filename, ip1, ip2);
+    asp::read_match_file(match_filename, ip1, ip2);
 
     if (matches[num_images].size() > 0 && matches[num_images].size() != ip2.size()) {
       vw_throw(ArgumentErr() << "All match files must have the same number of IP.\n");
@@ -2862,6 +3455,49 @@ void create_gcp_from_mapprojected_images(Options const& opt){
 
 // End map projection functions
 
+// Keep only the part of the problem needed to solve for the cameras in
+// the partition given by opt.partition_index. The pairs of images with
+// matches determine the partitions. Pairs with no camera in this
+// partition are not used, and all cameras not in it are kept fixed.
+void restrict_to_partition(Options & opt) {
+
+  int num_cameras = opt.image_files.size();
+  std::vector<std::pair<int,int>> pairs;
+  for (auto it = opt.match_files.begin(); it != opt.match_files.end(); it++) {
+    if (fs::exists(it->second))
+      pairs.push_back(it->first);
+  }
+  asp::partition_cameras(num_cameras, pairs, opt.num_partitions, opt.camera_partition);
+
+  auto in_partition = [&opt](int icam) {
+    return opt.camera_partition[icam] == opt.partition_index;
+  };
+
+  std::set<int> neighbors;
+  for (auto it = opt.match_files.begin(); it != opt.match_files.end(); ) {
+    int i = it->first.first, j = it->first.second;
+    if (!in_partition(i) && !in_partition(j)) {
+      it = opt.match_files.erase(it);
+      continue;
+    }
+    if (!in_partition(i)) neighbors.insert(i);
+    if (!in_partition(j)) neighbors.insert(j);
+    it++;
+  }
+
+  int num_in_partition = 0;
+  for (int icam = 0; icam < num_cameras; icam++) {
+    if (in_partition(icam))
+      num_in_partition++;
+    else
+      opt.fixed_cameras_indices.insert(icam);
+  }
+
+  vw_out() << "Solving for " << num_in_partition << " cameras in partition "
+           << opt.partition_index << " out of " << opt.num_partitions
+           << ", with " << neighbors.size() << " neighboring cameras kept fixed.\n";
+}
+
 int main(int argc, char* argv[]) {
 
   Options opt;
@@ -2954,7 +3590,7 @@ int main(int argc, char* argv[]) {
         = create_mask_less_or_equal(image_view,  nodata);
 
       // Use caching function call to compute the image statistics.
-      asp::gather_stats(masked_image, image_path, opt.out_prefix, image_path);
+      asp::gather_stats(masked_image, image_path, opt.out_prefix, image_path, nodata);
 
       // Compute and cache the camera footprint bbox
       if (opt.auto_overlap_params != "")
@@ -3054,7 +3690,9 @@ int main(int argc, char* argv[]) {
       asp::listExistingMatchFiles(prefix, existing_files);
     }
     
-    // Process the selected pairs
+    // Find the pairs which need matching. The rest use existing match
+    // files, so a run that was interrupted resumes where it left off.
+    std::vector<std::pair<int,int>> pairs_to_match;
     for (size_t k = 0; k < this_instance_pairs.size(); k++) {
 
       if (opt.apply_initial_transform_only)
@@ -3099,55 +3737,20 @@ int main(int argc, char* argv[]) {
         continue;
       }
 
-      // Read no-data
-      boost::shared_ptr<DiskImageResource>
-        rsrc1(vw::DiskImageResourcePtr(image1_path)),
-        rsrc2(vw::DiskImageResourcePtr(image2_path));
-      if ((rsrc1->channels() > 1) || (rsrc2->channels() > 1))
-        vw_throw(ArgumentErr() << "Error: Input images can only have a single channel!\n\n");
-      float nodata1, nodata2;
-      asp::get_nodata_values(rsrc1, rsrc2, nodata1, nodata2);
-      
-      // Set up the stereo session
-      SessionPtr session(asp::StereoSessionFactory::create(opt.stereo_session, // may change
-                                                           opt, image1_path,  image2_path,
-                                                           camera1_path, camera2_path,
-                                                           opt.out_prefix));
-
-
-      // Find matches between image pairs. This may not always succeed.
-      try{
-
-        if (opt.mapprojected_data == "") 
-          ba_match_ip(opt, session, image1_path, image2_path,
-                      opt.camera_models[i].get(),
-                      opt.camera_models[j].get(),
-                      match_file);
-
-        else
-          matches_from_mapproj_images(i, j, opt, session, map_files, dem_georef, interp_dem,  
-                                      match_file);
-
-        // Compute the coverage fraction
-        std::vector<ip::InterestPoint> ip1, ip2;
-        ip::read_binary_match_file(match_file, ip1, ip2);
-        int right_ip_width = rsrc1->cols() *
-                              static_cast<double>(100-opt.ip_edge_buffer_percent)/100.0;
-        Vector2i ip_size(right_ip_width, rsrc1->rows());
-        double ip_coverage = asp::calc_ip_coverage_fraction(ip2, ip_size);
-        vw_out() << "IP coverage fraction = " << ip_coverage << std::endl;
-      } catch (const std::exception& e){
-        vw_out() << "Could not find interest points between images "
-                  << opt.image_files[i] << " and " << opt.image_files[j] << std::endl;
-        vw_out(WarningMessage) << e.what() << std::endl;
-      } //End try/catch
-    } // End loop through all input image pairs
+      pairs_to_match.push_back(this_instance_pairs[k]);
+    }
+
+    match_image_pairs(opt, pairs_to_match, external_matches,
+                      map_files, dem_georef, interp_dem);
 
     if (opt.stop_after_matching){
       vw_out() << "Quitting after matches computation.\n";
       return 0;
     }
 
+    if (opt.num_partitions > 1)
+      restrict_to_partition(opt);
+
     // All the work happens here! It also writes out the results.
     do_ba_ceres(opt, estimated_camera_gcc);
 
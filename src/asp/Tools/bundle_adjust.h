@@ -60,7 +60,9 @@ struct Options: public asp::BaBaseOptions {
     fixed_image_list;
   int ip_per_tile, ip_per_image, matches_per_tile, ip_edge_buffer_percent;
   double forced_triangulation_distance, overlap_exponent, ip_triangulation_max_error;
-  int    instance_count, instance_index, num_random_passes, ip_num_ransac_iterations;
+  int    instance_count, instance_index, num_random_passes, ip_num_ransac_iterations,
+    num_matching_threads, max_open_images, num_partitions, partition_index,
+    checkpoint_every;
   bool   save_intermediate_cameras, approximate_pinhole_intrinsics,
     init_camera_using_gcp, disable_pinhole_gcp_init,
     transform_cameras_with_shared_gcp, transform_cameras_using_gcp,
@@ -70,7 +72,7 @@ struct Options: public asp::BaBaseOptions {
   BACameraType camera_type;
   std::string datum_str, camera_position_file, initial_transform_file,
     csv_format_str, csv_proj4_str, reference_terrain, disparity_list,
-    proj_str;
+    proj_str, ip_cache_dir, tracks_file;
   double semi_major, semi_minor, position_filter_dist;
   int    num_ba_passes, max_num_reference_points;
   std::string remove_outliers_params_str;
@@ -84,7 +86,7 @@ struct Options: public asp::BaBaseOptions {
     reference_terrain_weight, auto_overlap_buffer;
   bool   skip_rough_homography, enable_rough_homography, disable_tri_filtering,
     enable_tri_filtering, no_datum, individually_normalize, use_llh_error,
-    force_reuse_match_files, save_cnet_as_csv,
+    force_reuse_match_files, save_cnet_as_csv, save_camera_covariance, async_residual_logs,
     enable_correct_velocity_aberration, enable_correct_atmospheric_refraction, dg_use_csm;
   vw::Vector2 elevation_limit;   // Expected range of elevation to limit results to.
   vw::BBox2 lon_lat_limit;       // Limit the triangulated interest points to this lonlat range
@@ -95,6 +97,7 @@ struct Options: public asp::BaBaseOptions {
   vw::Matrix<double> initial_transform;
   std::string   fixed_cameras_indices_str;
   std::set<int> fixed_cameras_indices;
+  std::vector<int> camera_partition; // the partition of each camera, if partitioning
   IntrinsicOptions intrinisc_options;
   vw::Vector2i matches_per_tile_params;
 
@@ -103,7 +106,7 @@ struct Options: public asp::BaBaseOptions {
   Options(): ip_per_tile(0), ip_per_image(0), 
              forced_triangulation_distance(-1), overlap_exponent(0), 
               save_intermediate_cameras(false),
-             fix_gcp_xyz(false), solve_intrinsics(false), camera_type(BaCameraType_Other),
+             checkpoint_every(0), fix_gcp_xyz(false), solve_intrinsics(false), camera_type(BaCameraType_Other),
              semi_major(0), semi_minor(0), position_filter_dist(-1),
              num_ba_passes(2), max_num_reference_points(-1),
              datum(vw::cartography::Datum(asp::UNSPECIFIED_DATUM, "User Specified Spheroid",
@@ -149,6 +152,7 @@ struct Options: public asp::BaBaseOptions {
     asp::stereo_settings().ip_edge_buffer_percent     = ip_edge_buffer_percent;
     asp::stereo_settings().ip_debug_images            = ip_debug_images;
     asp::stereo_settings().ip_normalize_tiles         = ip_normalize_tiles;
+    asp::stereo_settings().ip_cache_dir               = ip_cache_dir;
   }
   
   /// Just parse the string of limits and make sure they are all valid pairs.
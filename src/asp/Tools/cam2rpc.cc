@@ -33,6 +33,8 @@
 #include <asp/Camera/RPCModelGen.h>
 #include <asp/Core/PointUtils.h>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <cstring>
 
@@ -49,7 +51,7 @@ using namespace std;
 using namespace vw::cartography;
 
 struct Options : public vw::GdalWriteOptions {
-  double penalty_weight;
+  double penalty_weight, max_error;
   string image_file, camera_file, output_rpc, stereo_session, bundle_adjust_prefix,
     datum_str, dem_file, target_srs_string;
   bool no_crop, skip_computing_rpc, save_tif, has_output_nodata;
@@ -61,7 +63,7 @@ struct Options : public vw::GdalWriteOptions {
   double gsd;
   int num_samples;
   Datum datum;
-  Options(): penalty_weight(-1.0), no_crop(false),
+  Options(): penalty_weight(-1.0), max_error(0.0), no_crop(false),
              skip_computing_rpc(false), save_tif(false), has_output_nodata(false),
              gsd(-1.0), num_samples(-1) {}
 };
@@ -85,6 +87,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "How many samples to use in each direction in the longitude-latitude-height range.")
     ("penalty-weight",     po::value(&opt.penalty_weight)->default_value(0.03), // check here!
      "A higher penalty weight will result in smaller higher-order RPC coefficients.")
+    ("max-error",     po::value(&opt.max_error)->default_value(0.0),
+     "If positive, start with a coarse set of samples and double their number in each direction, up to --num-samples, until the RPC model agrees with the camera to within this many pixels at points halfway between the samples.")
     ("save-tif-image", po::bool_switch(&opt.save_tif)->default_value(false),
      "Save a TIF version of the input image that approximately corresponds to the input longitude-latitude-height range and which can be used for stereo together with the RPC model.")
     ("input-nodata-value", po::value(&opt.input_nodata_value)->default_value(nan),
@@ -187,6 +191,205 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   }
 }
 
+// The ground points at which to sample the camera, on a lon-lat-height
+// grid or on the DEM. With shift on, use the centers of the grid cells,
+// to check how well an RPC model fits in between the samples.
+void gen_ground_points(Options const& opt, int num_samples, bool shift,
+                       ImageView< PixelMask<double> > const& dem,
+                       GeoReference const& dem_geo,
+                       std::vector<Vector3> & llh) {
+  llh.clear();
+  double s = shift ? 0.5 : 0.0;
+
+  if (opt.dem_file.empty()) {
+    BBox2   const& ll = opt.lon_lat_range; // shortcut
+    Vector2 const& H  = opt.height_range;
+    double delta_lon = (ll.max()[0] - ll.min()[0])/double(num_samples);
+    double delta_lat = (ll.max()[1] - ll.min()[1])/double(num_samples);
+    double delta_ht  = (H[1] - H[0])/double(num_samples);
+    for (double lon = ll.min()[0] + s*delta_lon; lon <= ll.max()[0]; lon += delta_lon) {
+      for (double lat = ll.min()[1] + s*delta_lat; lat <= ll.max()[1]; lat += delta_lat) {
+        for (double ht = H[0] + s*delta_ht; ht <= H[1]; ht += delta_ht)
+          llh.push_back(Vector3(lon, lat, ht));
+      }
+    }
+    return;
+  }
+
+  // If the DEM is too big, we need to skip points. About
+  // 40,000 points should be good enough to determine 78 RPC
+  // coefficients.
+  double delta_col = std::max(1.0, dem.cols()/double(num_samples));
+  double delta_row = std::max(1.0, dem.rows()/double(num_samples));
+  for (double dcol = s*delta_col; dcol < dem.cols(); dcol += delta_col) {
+    for (double drow = s*delta_row; drow < dem.rows(); drow += delta_row) {
+      int col = dcol, row = drow; // cast to int
+      if (!is_valid(dem(col, row))) continue;
+      Vector2 lonlat = dem_geo.pixel_to_lonlat(Vector2(col, row));
+      llh.push_back(Vector3(lonlat[0], lonlat[1], dem(col, row).child()));
+    }
+  }
+}
+
+// Project the ground points into the camera, in parallel unless the
+// camera does not allow it. Keep those which land in the image box and,
+// if check_valid is set, on valid image pixels.
+void project_points(CameraModel const* cam, bool multithreaded, Datum const& datum,
+                    BBox2 const& image_box, bool check_valid,
+                    ImageViewRef< PixelMask<float> > const& input_img,
+                    std::vector<Vector3> & llh, std::vector<Vector2> & pixels) {
+
+  int num = llh.size();
+  std::vector<Vector2> cam_pix(num);
+  double nan = std::numeric_limits<double>::quiet_NaN();
+#pragma omp parallel for schedule(dynamic, 64) if (multithreaded)
+  for (int it = 0; it < num; it++) {
+    Vector3 xyz = datum.geodetic_to_cartesian(llh[it]);
+
+    // Go back to llh. This is a bugfix for the 360 deg offset problem.
+    llh[it] = datum.cartesian_to_geodetic(xyz);
+
+    try {
+      // the point_to_pixel function can be capricious
+      cam_pix[it] = cam->point_to_pixel(xyz);
+    }catch(...){
+      cam_pix[it] = Vector2(nan, nan);
+    }
+  }
+
+  // The image is read in this thread, and the order of the samples is kept
+  int count = 0;
+  pixels.clear();
+  for (int it = 0; it < num; it++) {
+    Vector2 const& pix = cam_pix[it];
+    if (pix != pix || !image_box.contains(pix))
+      continue;
+    if (check_valid && !is_valid(input_img(pix[0], pix[1])))
+      continue;
+    llh[count++] = llh[it];
+    pixels.push_back(pix);
+  }
+  llh.resize(count);
+}
+
+// An RPC model and the boxes it is defined on
+struct RpcFit {
+  BBox2   pixel_box, crop_box;
+  Vector2 shift; // subtracted from camera pixels when cropping
+  BBox3   llh_box;
+  Vector3 llh_scale, llh_offset;
+  Vector2 pixel_scale, pixel_offset;
+  asp::RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
+};
+
+// Find the pixel and lon-lat-height boxes. If cropping, make the pixels
+// relative to the crop box.
+void find_boxes(Options const& opt, BBox2 const& image_box,
+                std::vector<Vector3> const& all_llh,
+                std::vector<Vector2>      & all_pixels,
+                RpcFit & fit) {
+
+  // The pixel box
+  BBox2 pixel_box;
+  for (size_t i = 0; i < all_pixels.size(); i++) 
+    pixel_box.grow(all_pixels[i]);
+
+  // Find the range of lon-lat-heights
+  BBox3 llh_box;
+  for (size_t i = 0; i < all_llh.size(); i++) 
+    llh_box.grow(all_llh[i]);
+
+  // If cropping, adjust the pixels
+  BBox2 crop_box;
+  Vector2 shift;
+  if (!opt.no_crop) {
+    // Cast to int so that we can crop properly
+    pixel_box.min() = floor(pixel_box.min());
+    pixel_box.max() = ceil(pixel_box.max());
+    pixel_box.crop(image_box);
+
+    crop_box = pixel_box; // save it before we modify pixel_box
+
+    // Shift all pixels by the crop corner, including the pixel box itself
+    for (size_t i = 0; i < all_pixels.size(); i++) 
+      all_pixels[i] -= pixel_box.min();
+
+    // Need to first save the corner before subtracting it, otherwise get wrong result
+    shift = pixel_box.min(); 
+    pixel_box -= shift;
+  }
+
+  fit.pixel_box = pixel_box;
+  fit.crop_box  = crop_box;
+  fit.shift     = shift;
+  fit.llh_box   = llh_box;
+}
+
+// Fit an RPC model to the samples, on the boxes found by find_boxes()
+void fit_rpc(Options const& opt, std::vector<Vector3> const& all_llh,
+             std::vector<Vector2> const& all_pixels, RpcFit & fit) {
+
+  BBox3 const& llh_box   = fit.llh_box;   // shortcut
+  BBox2 const& pixel_box = fit.pixel_box; // shortcut
+
+  fit.llh_scale  = (llh_box.max() - llh_box.min())/2.0; // half range
+  fit.llh_offset = (llh_box.max() + llh_box.min())/2.0; // center point
+
+  fit.pixel_scale  = (pixel_box.max() - pixel_box.min())/2.0; // half range 
+  fit.pixel_offset = (pixel_box.max() + pixel_box.min())/2.0; // center point
+
+  vw_out() << "Lon-lat-height box for the RPC approx: " << llh_box   << std::endl;
+  vw_out() << "Camera pixel box for the RPC approx:   " << pixel_box << std::endl;
+
+  Vector<double> normalized_llh;
+  Vector<double> normalized_pixels;
+  int num_total_pts = all_llh.size();
+  normalized_llh.set_size(asp::RPCModel::GEODETIC_COORD_SIZE*num_total_pts);
+  normalized_pixels.set_size(asp::RPCModel::IMAGE_COORD_SIZE*num_total_pts
+                             + asp::RpcSolveLMA::NUM_PENALTY_TERMS);
+  for (size_t i = 0; i < normalized_pixels.size(); i++) {
+    // Important: The extra penalty terms are all set to zero here.
+    normalized_pixels[i] = 0.0; 
+  }
+
+  // Form the arrays of normalized pixels and normalized llh
+  for (int pt = 0; pt < num_total_pts; pt++) {
+    // Normalize the pixel to -1 <> 1 range
+    Vector3 llh_n   = elem_quot(all_llh[pt]    - fit.llh_offset,   fit.llh_scale);
+    Vector2 pixel_n = elem_quot(all_pixels[pt] - fit.pixel_offset, fit.pixel_scale);
+    subvector(normalized_llh, asp::RPCModel::GEODETIC_COORD_SIZE*pt,
+              asp::RPCModel::GEODETIC_COORD_SIZE) = llh_n;
+    subvector(normalized_pixels, asp::RPCModel::IMAGE_COORD_SIZE*pt,
+              asp::RPCModel::IMAGE_COORD_SIZE   ) = pixel_n;
+  }
+
+  std::string output_prefix = "";
+  vw_out() << "Generating the RPC approximation using " << num_total_pts << " point pairs.\n";
+  asp::gen_rpc(// Inputs
+               opt.penalty_weight, output_prefix,
+               normalized_llh, normalized_pixels,
+               fit.llh_scale, fit.llh_offset, fit.pixel_scale, fit.pixel_offset,
+               // Outputs
+               fit.line_num, fit.line_den, fit.samp_num, fit.samp_den);
+}
+
+// The largest distance between where the camera and the RPC model
+// project the given points. The pixels are as returned by the camera.
+double max_fit_error(Datum const& datum, RpcFit const& fit,
+                     std::vector<Vector3> const& llh,
+                     std::vector<Vector2> const& pixels) {
+
+  asp::RPCModel rpc(datum, fit.line_num, fit.line_den, fit.samp_num, fit.samp_den,
+                    fit.pixel_offset, fit.pixel_scale, fit.llh_offset, fit.llh_scale);
+  std::vector<Vector2> rpc_pixels;
+  rpc.geodetics_to_pixels(llh, rpc_pixels);
+
+  double max_err = 0.0;
+  for (size_t it = 0; it < pixels.size(); it++)
+    max_err = std::max(max_err, norm_2(rpc_pixels[it] - (pixels[it] - fit.shift)));
+  return max_err;
+}
+
 int main( int argc, char *argv[] ) {
 
   Options opt;
@@ -258,147 +461,81 @@ int main( int argc, char *argv[] ) {
     if (!opt.image_crop_box.empty()) 
       image_box.crop(opt.image_crop_box);
 
-    // TODO: Merge this code with what is in sfs.cc!
-    // Generate point pairs
-    std::vector<Vector3> all_llh;
-    std::vector<Vector2> all_pixels;
-
-    vw_out() << "Projecting pixels into the camera to generate the RPC model.\n";
-    vw::TerminalProgressCallback tpc("asp", "\t--> ");
-    double inc_amount = 1.0 / double(opt.num_samples);
-
-
     // Mask the input image
     ImageViewRef< PixelMask<float> > input_img
       = create_mask_less_or_equal(disk_view, opt.input_nodata_value);
 
+    ImageView< PixelMask<double> > dem;
+    GeoReference dem_geo;
     if (opt.dem_file.empty()) {
-
       vw_out() << "Using datum: " << opt.datum << std::endl;
-
-      BBox2   & ll = opt.lon_lat_range; // shortcut
-      Vector2 & H  = opt.height_range;
-      double delta_lon = (ll.max()[0] - ll.min()[0])/double(opt.num_samples);
-      double delta_lat = (ll.max()[1] - ll.min()[1])/double(opt.num_samples);
-      double delta_ht  = (H[1] - H[0])/double(opt.num_samples);
-      tpc.report_progress(0);
-      for (double lon = ll.min()[0]; lon <= ll.max()[0]; lon += delta_lon) {
-        for (double lat = ll.min()[1]; lat <= ll.max()[1]; lat += delta_lat) {
-          for (double ht = H[0]; ht <= H[1]; ht += delta_ht) {
-
-            Vector3 llh(lon, lat, ht);
-            Vector3 xyz = opt.datum.geodetic_to_cartesian(llh);
-
-            // Go back to llh. This is a bugfix for the 360 deg offset problem.
-            llh = opt.datum.cartesian_to_geodetic(xyz);
-
-            Vector2 cam_pix = cam->point_to_pixel(xyz);
-            if (image_box.contains(cam_pix)) {
-              all_llh.push_back(llh);
-              all_pixels.push_back(cam_pix);
-            }
-
-          }
-        }
-        tpc.report_incremental_progress(inc_amount);
-      }
-
-    }else{
+    } else {
       vw_out() << "Sampling the surface of the DEM: " << opt.dem_file  << std::endl;
 
       float dem_nodata_val = -std::numeric_limits<float>::max(); 
       vw::read_nodata_val(opt.dem_file, dem_nodata_val);
-      ImageView< PixelMask<double> > dem = create_mask
-        (channel_cast<double>(DiskImageView<float>(opt.dem_file)), dem_nodata_val);
+      dem = create_mask(channel_cast<double>(DiskImageView<float>(opt.dem_file)),
+                        dem_nodata_val);
 
-      GeoReference dem_geo;
       if (!read_georeference(dem_geo, opt.dem_file))
         vw_throw( ArgumentErr() << "Missing georef.\n");
 
       // Get the datum from the DEM
       opt.datum = dem_geo.datum();
-      
-      // If the DEM is too big, we need to skip points. About
-      // 40,000 points should be good enough to determine 78 RPC
-      // coefficients.
-      double delta_col = std::max(1.0, dem.cols()/double(opt.num_samples));
-      double delta_row = std::max(1.0, dem.rows()/double(opt.num_samples));
-      tpc.report_progress(0);
-      for (double dcol = 0; dcol < dem.cols(); dcol += delta_col) {
-        for (double drow = 0; drow < dem.rows(); drow += delta_row) {
-          int col = dcol, row = drow; // cast to int
-
-          if (!is_valid(dem(col, row))) continue;
-
-          Vector2 pix(col, row);
-          Vector2 lonlat = dem_geo.pixel_to_lonlat(pix);
-
-          // Lon lat height
-          Vector3 llh;
-          llh[0] = lonlat[0]; llh[1] = lonlat[1]; llh[2] = dem(col, row).child();
-          Vector3 xyz = opt.datum.geodetic_to_cartesian(llh);
-
-          // Go back to llh. This is a bugfix for the 360 deg offset problem.
-          llh = opt.datum.cartesian_to_geodetic(xyz);
-
-          Vector2 cam_pix;
-          try {
-            // the point_to_pixel function can be capricious
-            cam_pix = cam->point_to_pixel(xyz);
-          }catch(...){
-            continue;
-          }
-
-          if (image_box.contains(cam_pix) && is_valid(input_img(cam_pix[0], cam_pix[1]))) {
-            all_llh.push_back(llh);
-            all_pixels.push_back(cam_pix);
-          }
-
-        }
-        tpc.report_incremental_progress(inc_amount);
-      }
     }
-    tpc.report_finished();
 
-    // The pixel box
-    BBox2 pixel_box;
-    for (size_t i = 0; i < all_pixels.size(); i++) 
-      pixel_box.grow(all_pixels[i]);
-
-    // Find the range of lon-lat-heights
-    BBox3 llh_box;
-    for (size_t i = 0; i < all_llh.size(); i++) 
-      llh_box.grow(all_llh[i]);
-
-    // If cropping, adjust the pixels
-    BBox2 crop_box;
-    if (!opt.no_crop) {
-      // Cast to int so that we can crop properly
-      pixel_box.min() = floor(pixel_box.min());
-      pixel_box.max() = ceil(pixel_box.max());
-      pixel_box.crop(image_box);
-
-      crop_box = pixel_box; // save it before we modify pixel_box
-
-      // Shift all pixels by the crop corner, including the pixel box itself
-      for (size_t i = 0; i < all_pixels.size(); i++) 
-        all_pixels[i] -= pixel_box.min();
-
-      // Need to first save the corner before subtracting it, otherwise get wrong result
-      Vector2 shift = pixel_box.min(); 
-      pixel_box -= shift;
+    // ISIS cameras cannot be used from multiple threads
+    bool multithreaded = !boost::starts_with(session->name(), "isis");
+    bool check_valid   = !opt.dem_file.empty();
+
+    // TODO: Merge this code with what is in sfs.cc!
+    // Generate point pairs. If a maximum error is set, start with fewer
+    // samples, and use more until the RPC model fits well enough in
+    // between them.
+    std::vector<Vector3> all_llh;
+    std::vector<Vector2> all_pixels;
+    RpcFit fit;
+    bool have_fit = false;
+    int num_samples = opt.num_samples;
+    if (opt.max_error > 0)
+      num_samples = std::min(opt.num_samples, std::max(5, opt.num_samples / 8));
+    while (1) {
+
+      vw_out() << "Projecting pixels into the camera to generate the RPC model, using "
+               << num_samples << " samples in each direction.\n";
+      gen_ground_points(opt, num_samples, false, dem, dem_geo, all_llh);
+      project_points(cam.get(), multithreaded, opt.datum, image_box, check_valid,
+                     input_img, all_llh, all_pixels);
+      find_boxes(opt, image_box, all_llh, all_pixels, fit);
+      if (opt.max_error <= 0)
+        break;
+
+      fit_rpc(opt, all_llh, all_pixels, fit);
+      have_fit = true;
+
+      std::vector<Vector3> check_llh;
+      std::vector<Vector2> check_pixels;
+      gen_ground_points(opt, num_samples, true, dem, dem_geo, check_llh);
+      project_points(cam.get(), multithreaded, opt.datum, image_box, check_valid,
+                     input_img, check_llh, check_pixels);
+      double err = max_fit_error(opt.datum, fit, check_llh, check_pixels);
+      vw_out() << "Maximum RPC model error at the check points: " << err << " pixels.\n";
+      if (err <= opt.max_error || num_samples >= opt.num_samples)
+        break;
+
+      num_samples = std::min(2 * num_samples, opt.num_samples);
     }
 
     // We need this line for other tools
     vw_out() << "crop_box "
-             << crop_box.min().x() << ' ' << crop_box.min().y() << ' '
-             << crop_box.max().x() << ' ' << crop_box.max().y() << std::endl;
+             << fit.crop_box.min().x() << ' ' << fit.crop_box.min().y() << ' '
+             << fit.crop_box.max().x() << ' ' << fit.crop_box.max().y() << std::endl;
 
     if (opt.save_tif) {
 
       ImageViewRef< PixelMask<float> > output_img = input_img;
       if (!opt.no_crop) 
-        output_img = crop(input_img, crop_box);
+        output_img = crop(input_img, fit.crop_box);
 
       std::string out_img_file = fs::path(opt.output_rpc).replace_extension("tif").string();
       vw_out() << "Writing: " << out_img_file << std::endl;
@@ -417,47 +554,19 @@ int main( int argc, char *argv[] ) {
     if (opt.skip_computing_rpc) 
       return 0;
 
-    Vector3 llh_scale  = (llh_box.max() - llh_box.min())/2.0; // half range
-    Vector3 llh_offset = (llh_box.max() + llh_box.min())/2.0; // center point
-
-    Vector2 pixel_scale  = (pixel_box.max() - pixel_box.min())/2.0; // half range 
-    Vector2 pixel_offset = (pixel_box.max() + pixel_box.min())/2.0; // center point
-
-    vw_out() << "Lon-lat-height box for the RPC approx: " << llh_box   << std::endl;
-    vw_out() << "Camera pixel box for the RPC approx:   " << pixel_box << std::endl;
-
-    Vector<double> normalized_llh;
-    Vector<double> normalized_pixels;
-    int num_total_pts = all_llh.size();
-    normalized_llh.set_size(asp::RPCModel::GEODETIC_COORD_SIZE*num_total_pts);
-    normalized_pixels.set_size(asp::RPCModel::IMAGE_COORD_SIZE*num_total_pts
-                               + asp::RpcSolveLMA::NUM_PENALTY_TERMS);
-    for (size_t i = 0; i < normalized_pixels.size(); i++) {
-      // Important: The extra penalty terms are all set to zero here.
-      normalized_pixels[i] = 0.0; 
-    }
-
-    // Form the arrays of normalized pixels and normalized llh
-    for (int pt = 0; pt < num_total_pts; pt++) {
-      // Normalize the pixel to -1 <> 1 range
-      Vector3 llh_n   = elem_quot(all_llh[pt]    - llh_offset,   llh_scale);
-      Vector2 pixel_n = elem_quot(all_pixels[pt] - pixel_offset, pixel_scale);
-      subvector(normalized_llh, asp::RPCModel::GEODETIC_COORD_SIZE*pt,
-                asp::RPCModel::GEODETIC_COORD_SIZE) = llh_n;
-      subvector(normalized_pixels, asp::RPCModel::IMAGE_COORD_SIZE*pt,
-                asp::RPCModel::IMAGE_COORD_SIZE   ) = pixel_n;
-    }
-
     // Find the RPC coefficients
-    asp::RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
-    std::string output_prefix = "";
-    vw_out() << "Generating the RPC approximation using " << num_total_pts << " point pairs.\n";
-    asp::gen_rpc(// Inputs
-                 opt.penalty_weight, output_prefix,
-                 normalized_llh, normalized_pixels,
-                 llh_scale, llh_offset, pixel_scale, pixel_offset,
-                 // Outputs
-                 line_num, line_den, samp_num, samp_den);
+    if (!have_fit)
+      fit_rpc(opt, all_llh, all_pixels, fit);
+
+    BBox3 const& llh_box = fit.llh_box; // shortcut
+    Vector3 const& llh_scale    = fit.llh_scale;
+    Vector3 const& llh_offset   = fit.llh_offset;
+    Vector2 const& pixel_scale  = fit.pixel_scale;
+    Vector2 const& pixel_offset = fit.pixel_offset;
+    asp::RPCModel::CoeffVec const& line_num = fit.line_num;
+    asp::RPCModel::CoeffVec const& line_den = fit.line_den;
+    asp::RPCModel::CoeffVec const& samp_num = fit.samp_num;
+    asp::RPCModel::CoeffVec const& samp_den = fit.samp_den;
 
     // TODO: Integrate this with aster2asp existing functionality!
     // Have a generic function for saving WV RPC files. 
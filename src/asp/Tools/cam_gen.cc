@@ -301,7 +301,8 @@ void parse_values(std::string list, std::vector<T> & values){
 struct Options : public vw::GdalWriteOptions {
   std::string image_file, camera_file, lon_lat_values_str, pixel_values_str, datum_str,
     reference_dem, frame_index, gcp_file, camera_type, sample_file, input_camera,
-    stereo_session, bundle_adjust_prefix, parsed_cam_ctr_str, parsed_cam_quat_str;
+    stereo_session, bundle_adjust_prefix, parsed_cam_ctr_str, parsed_cam_quat_str,
+    batch_file;
   double focal_length, pixel_pitch, gcp_std, height_above_datum,
     cam_height, cam_weight, cam_ctr_weight;
   Vector2 optical_center;
@@ -310,120 +311,18 @@ struct Options : public vw::GdalWriteOptions {
   Options(): focal_length(-1), pixel_pitch(-1), gcp_std(1), height_above_datum(0), refine_camera(false), cam_height(0), cam_weight(0), cam_ctr_weight(0), input_pinhole(false) {}
 };
 
-void handle_arguments(int argc, char *argv[], Options& opt) {
-
-  double nan = std::numeric_limits<double>::quiet_NaN();
-  po::options_description general_options("");
-  general_options.add_options()
-    ("output-camera-file,o", po::value(&opt.camera_file), "Specify the output camera file with a .tsai extension.")
-    ("camera-type", po::value(&opt.camera_type)->default_value("pinhole"), "Specify the camera type. Options are: pinhole (default) and opticalbar.")
-    ("lon-lat-values", po::value(&opt.lon_lat_values_str)->default_value(""),
-    "A (quoted) string listing numbers, separated by commas or spaces, "
-    "having the longitude and latitude (alternating and in this "
-    "order) of each image corner or some other list of pixels given "
-    "by ``--pixel-values``. If the corners are used, they are traversed "
-    "in the order (0, 0) (w, 0) (w, h), (0, h) where w and h are the "
-     "image width and height.")
-    ("pixel-values", po::value(&opt.pixel_values_str)->default_value(""), "A (quoted) string listing numbers, separated by commas or spaces, having the column and row (alternating and in this order) of each pixel in the raw image at which the longitude and latitude is known and given by --lon-lat-values. By default this is empty, and will be populated by the image corners traversed as mentioned at the earlier option.")
-    ("reference-dem", po::value(&opt.reference_dem)->default_value(""),
-     "Use this DEM to infer the heights above datum of the image corners.")
-    ("datum", po::value(&opt.datum_str)->default_value(""),
-     "Use this datum to interpret the longitude and latitude, unless a DEM is given. Options: WGS_1984, D_MOON (1,737,400 meters), D_MARS (3,396,190 meters), MOLA (3,396,000 meters), NAD83, WGS72, and NAD27. Also accepted: Earth (=WGS_1984), Mars (=D_MARS), Moon (=D_MOON).")
-    ("height-above-datum", po::value(&opt.height_above_datum)->default_value(0),
-     "Assume this height above datum in meters for the image corners unless read from the DEM.")
-    ("sample-file", po::value(&opt.sample_file)->default_value(""), 
-     "Read in the camera parameters from the example camera file.  Required for opticalbar type.")
-    ("focal-length", po::value(&opt.focal_length)->default_value(0),
-     "The camera focal length.")
-    ("optical-center", po::value(&opt.optical_center)->default_value(Vector2(nan, nan),"NaN NaN"),
-     "The camera optical center. If not specified for pinhole cameras, it will be set to image center (half of image dimensions) times the pixel pitch. The optical bar camera always uses the image center.")
-    ("pixel-pitch", po::value(&opt.pixel_pitch)->default_value(0),
-     "The pixel pitch.")
-    ("refine-camera", po::bool_switch(&opt.refine_camera)->default_value(false),
-     "After a rough initial camera is obtained, refine it using least squares.")
-    ("frame-index", po::value(&opt.frame_index)->default_value(""),
-     "A file used to look up the longitude and latitude of image corners based on the image name, in the format provided by the SkySat video product.")
-    ("gcp-file", po::value(&opt.gcp_file)->default_value(""),
-     "If provided, save the image corner coordinates and heights in the GCP format to this file.")
-    ("gcp-std", po::value(&opt.gcp_std)->default_value(1),
-     "The standard deviation for each GCP pixel, if saving a GCP file. A smaller value suggests a more reliable measurement, hence will be given more weight.")
-    ("cam-height", po::value(&opt.cam_height)->default_value(0),
-     "If both this and --cam-weight are positive, enforce that the output camera is at this height above datum. For SkySat, if not set, read this from the frame index. Highly experimental.")
-    ("cam-weight", po::value(&opt.cam_weight)->default_value(0),
-     "If positive, try to enforce the option --cam-height with this weight (bigger weight means try harder to enforce).")
-    ("cam-ctr-weight", po::value(&opt.cam_ctr_weight)->default_value(0),
-     "If positive, try to enforce that during camera refinement the camera center stays close to the initial value (bigger weight means try harder to enforce this; a value like 1000.0 is good enough).")
-    ("parse-eci", po::bool_switch(&opt.parse_eci)->default_value(false),
-     "Create cameras based on ECI positions and orientations (not working).")
-    ("parse-ecef", po::bool_switch(&opt.parse_ecef)->default_value(false),
-     "Create cameras based on ECEF position (but not orientation).")
-    ("input-camera", po::value(&opt.input_camera)->default_value(""),
-     "Create the output pinhole camera approximating this camera. If with a "
-     "_pinhole.json suffix, read it verbatim, with no refinements or "
-     "taking into account other input options.")
-    ("session-type,t",   po::value(&opt.stereo_session)->default_value(""),
-     "Select the input camera model type. Normally this is auto-detected, but may need to be specified if the input camera model is in XML format. See the doc for options.")
-    ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
-     "Use the camera adjustment obtained by previously running bundle_adjust "
-     "when providing an input camera.");
-  
-  general_options.add(vw::GdalWriteOptionsDescription(opt));
-
-  po::options_description positional("");
-  positional.add_options()
-    ("image-file", po::value(&opt.image_file));
-
-  po::positional_options_description positional_desc;
-  positional_desc.add("image-file",1);
-
-  std::string usage("[options] <image-file> -o <camera-file>");
-  bool allow_unregistered = false;
-  std::vector<std::string> unregistered;
-  po::variables_map vm =
-    asp::check_command_line(argc, argv, opt, general_options, general_options,
-                            positional, positional_desc, usage,
-                            allow_unregistered, unregistered);
-
-  if (opt.image_file.empty())
-    vw_throw( ArgumentErr() << "Missing the input image.\n"
-              << usage << general_options );
-
-  if (opt.camera_file.empty())
-    vw_throw( ArgumentErr() << "Missing the output camera file name.\n"
-              << usage << general_options );
-
-  boost::to_lower(opt.camera_type);
-  
-  if (opt.camera_type != "pinhole" && opt.camera_type != "opticalbar")
-    vw_throw( ArgumentErr() << "Only pinhole and opticalbar cameras are supported.\n");
-  
-  if ((opt.camera_type == "opticalbar") && (opt.sample_file == ""))
-    vw_throw( ArgumentErr() << "opticalbar type must use a sample camera file.\n"
-              << usage << general_options );
+// The options which depend on the image and output camera: look up the
+// corners in the frame index, parse the pixel and lon-lat values, and
+// create the output directory.
+void prepare_image_options(Options & opt) {
 
   std::string ext = get_extension(opt.camera_file);
   if (ext != ".tsai") 
-    vw_throw( ArgumentErr() << "The output camera file must end with .tsai.\n"
-              << usage << general_options );
-
-  opt.input_pinhole = boost::algorithm::ends_with(opt.input_camera, "_pinhole.json");
-  
-  // If we cannot read the data from a DEM, must specify a lot of things.
-  if (!opt.input_pinhole && opt.reference_dem.empty() && opt.datum_str.empty())
-    vw_throw( ArgumentErr() << "Must provide either a reference DEM or a datum.\n"
-              << usage << general_options );
-
-  if (opt.gcp_std <= 0) 
-    vw_throw( ArgumentErr() << "The GCP standard deviation must be positive.\n"
-              << usage << general_options );
+    vw_throw( ArgumentErr() << "The output camera file must end with .tsai.\n");
 
   if (!opt.input_pinhole && opt.frame_index != "" && opt.lon_lat_values_str != "") 
     vw_throw( ArgumentErr() << "Cannot specify both the frame index file "
-	      << "and the lon-lat corners.\n"
-              << usage << general_options );
-
-  if (opt.cam_weight > 0 && opt.cam_ctr_weight > 0)
-    vw::vw_throw(vw::ArgumentErr() << "Cannot enforce the camera center constraint and camera height constraint at the same time.\n");
+	      << "and the lon-lat corners.\n");
 
   if (!opt.input_pinhole && opt.frame_index != "") {
     // Parse the frame index to extract opt.lon_lat_values_str.
@@ -558,6 +457,130 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     }
   }
   
+  // Create the output directory
+  vw::create_out_dir(opt.camera_file);
+
+} // End function prepare_image_options
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  po::options_description general_options("");
+  general_options.add_options()
+    ("output-camera-file,o", po::value(&opt.camera_file), "Specify the output camera file with a .tsai extension.")
+    ("camera-type", po::value(&opt.camera_type)->default_value("pinhole"), "Specify the camera type. Options are: pinhole (default) and opticalbar.")
+    ("lon-lat-values", po::value(&opt.lon_lat_values_str)->default_value(""),
+    "A (quoted) string listing numbers, separated by commas or spaces, "
+    "having the longitude and latitude (alternating and in this "
+    "order) of each image corner or some other list of pixels given "
+    "by ``--pixel-values``. If the corners are used, they are traversed "
+    "in the order (0, 0) (w, 0) (w, h), (0, h) where w and h are the "
+     "image width and height.")
+    ("pixel-values", po::value(&opt.pixel_values_str)->default_value(""), "A (quoted) string listing numbers, separated by commas or spaces, having the column and row (alternating and in this order) of each pixel in the raw image at which the longitude and latitude is known and given by --lon-lat-values. By default this is empty, and will be populated by the image corners traversed as mentioned at the earlier option.")
+    ("reference-dem", po::value(&opt.reference_dem)->default_value(""),
+     "Use this DEM to infer the heights above datum of the image corners.")
+    ("datum", po::value(&opt.datum_str)->default_value(""),
+     "Use this datum to interpret the longitude and latitude, unless a DEM is given. Options: WGS_1984, D_MOON (1,737,400 meters), D_MARS (3,396,190 meters), MOLA (3,396,000 meters), NAD83, WGS72, and NAD27. Also accepted: Earth (=WGS_1984), Mars (=D_MARS), Moon (=D_MOON).")
+    ("height-above-datum", po::value(&opt.height_above_datum)->default_value(0),
+     "Assume this height above datum in meters for the image corners unless read from the DEM.")
+    ("sample-file", po::value(&opt.sample_file)->default_value(""), 
+     "Read in the camera parameters from the example camera file.  Required for opticalbar type.")
+    ("focal-length", po::value(&opt.focal_length)->default_value(0),
+     "The camera focal length.")
+    ("optical-center", po::value(&opt.optical_center)->default_value(Vector2(nan, nan),"NaN NaN"),
+     "The camera optical center. If not specified for pinhole cameras, it will be set to image center (half of image dimensions) times the pixel pitch. The optical bar camera always uses the image center.")
+    ("pixel-pitch", po::value(&opt.pixel_pitch)->default_value(0),
+     "The pixel pitch.")
+    ("refine-camera", po::bool_switch(&opt.refine_camera)->default_value(false),
+     "After a rough initial camera is obtained, refine it using least squares.")
+    ("frame-index", po::value(&opt.frame_index)->default_value(""),
+     "A file used to look up the longitude and latitude of image corners based on the image name, in the format provided by the SkySat video product.")
+    ("gcp-file", po::value(&opt.gcp_file)->default_value(""),
+     "If provided, save the image corner coordinates and heights in the GCP format to this file.")
+    ("gcp-std", po::value(&opt.gcp_std)->default_value(1),
+     "The standard deviation for each GCP pixel, if saving a GCP file. A smaller value suggests a more reliable measurement, hence will be given more weight.")
+    ("cam-height", po::value(&opt.cam_height)->default_value(0),
+     "If both this and --cam-weight are positive, enforce that the output camera is at this height above datum. For SkySat, if not set, read this from the frame index. Highly experimental.")
+    ("cam-weight", po::value(&opt.cam_weight)->default_value(0),
+     "If positive, try to enforce the option --cam-height with this weight (bigger weight means try harder to enforce).")
+    ("cam-ctr-weight", po::value(&opt.cam_ctr_weight)->default_value(0),
+     "If positive, try to enforce that during camera refinement the camera center stays close to the initial value (bigger weight means try harder to enforce this; a value like 1000.0 is good enough).")
+    ("parse-eci", po::bool_switch(&opt.parse_eci)->default_value(false),
+     "Create cameras based on ECI positions and orientations (not working).")
+    ("parse-ecef", po::bool_switch(&opt.parse_ecef)->default_value(false),
+     "Create cameras based on ECEF position (but not orientation).")
+    ("input-camera", po::value(&opt.input_camera)->default_value(""),
+     "Create the output pinhole camera approximating this camera. If with a "
+     "_pinhole.json suffix, read it verbatim, with no refinements or "
+     "taking into account other input options.")
+    ("session-type,t",   po::value(&opt.stereo_session)->default_value(""),
+     "Select the input camera model type. Normally this is auto-detected, but may need to be specified if the input camera model is in XML format. See the doc for options.")
+    ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
+     "Use the camera adjustment obtained by previously running bundle_adjust "
+     "when providing an input camera.")
+    ("batch-file", po::value(&opt.batch_file)->default_value(""),
+     "Make many cameras in one run. Each line of this file has an image, its output "
+     "camera, and optionally the longitude and latitude values of its corners, as for "
+     "--lon-lat-values. If the latter are not given, they are looked up in --frame-index. "
+     "The reference DEM is loaded once, and the cameras are made in parallel. If "
+     "--gcp-file is set, a GCP file is written next to each camera, with the .gcp "
+     "extension.");
+  
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+
+  po::options_description positional("");
+  positional.add_options()
+    ("image-file", po::value(&opt.image_file));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("image-file",1);
+
+  std::string usage("[options] <image-file> -o <camera-file>");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  bool batch = !opt.batch_file.empty();
+  if (batch && (!opt.image_file.empty() || !opt.camera_file.empty() ||
+                !opt.lon_lat_values_str.empty() || !opt.input_camera.empty()))
+    vw_throw( ArgumentErr() << "The option --batch-file cannot be used with an input "
+              << "image, output camera, --lon-lat-values, or --input-camera.\n"
+              << usage << general_options );
+
+  if (!batch && opt.image_file.empty())
+    vw_throw( ArgumentErr() << "Missing the input image.\n"
+              << usage << general_options );
+
+  if (!batch && opt.camera_file.empty())
+    vw_throw( ArgumentErr() << "Missing the output camera file name.\n"
+              << usage << general_options );
+
+  boost::to_lower(opt.camera_type);
+  
+  if (opt.camera_type != "pinhole" && opt.camera_type != "opticalbar")
+    vw_throw( ArgumentErr() << "Only pinhole and opticalbar cameras are supported.\n");
+  
+  if ((opt.camera_type == "opticalbar") && (opt.sample_file == ""))
+    vw_throw( ArgumentErr() << "opticalbar type must use a sample camera file.\n"
+              << usage << general_options );
+
+  opt.input_pinhole = boost::algorithm::ends_with(opt.input_camera, "_pinhole.json");
+  
+  // If we cannot read the data from a DEM, must specify a lot of things.
+  if (!opt.input_pinhole && opt.reference_dem.empty() && opt.datum_str.empty())
+    vw_throw( ArgumentErr() << "Must provide either a reference DEM or a datum.\n"
+              << usage << general_options );
+
+  if (opt.gcp_std <= 0) 
+    vw_throw( ArgumentErr() << "The GCP standard deviation must be positive.\n"
+              << usage << general_options );
+
+  if (opt.cam_weight > 0 && opt.cam_ctr_weight > 0)
+    vw::vw_throw(vw::ArgumentErr() << "Cannot enforce the camera center constraint and camera height constraint at the same time.\n");
+
   // Note that optical center can be negative (for some SkySat products).
   if (!opt.input_pinhole &&
       opt.sample_file == "" &&
@@ -567,9 +590,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 
   if ((opt.parse_eci || opt.parse_ecef) && opt.camera_type == "opticalbar") 
     vw_throw( ArgumentErr() << "Cannot parse ECI/ECEF data for an optical bar camera.\n");
-  
-  // Create the output directory
-  vw::create_out_dir(opt.camera_file);
+
+  // With a batch file, this is done for each image later
+  if (!batch)
+    prepare_image_options(opt);
 
 } // End function handle_arguments
 
@@ -1010,31 +1034,47 @@ vw::Matrix<double> json_mat(json const& j, int rows, int cols) {
 }
 
 // Create a pinhole camera using user-specified options.
-void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
-                         boost::shared_ptr<CameraModel> & out_cam) {
-
+// The reference DEM, read in memory once, and shared by all cameras
+// made in a run
+struct RefDem {
   GeoReference geo;
   ImageView<float> dem;
-  float nodata_value = -std::numeric_limits<float>::max(); 
-  bool has_dem = false;
-  if (opt.reference_dem != "") {
-    dem = DiskImageView<float>(opt.reference_dem);
-    bool ans = read_georeference(geo, opt.reference_dem);
-    if (!ans) 
-      vw_throw( ArgumentErr() << "Could not read the georeference from dem: "
-                << opt.reference_dem << ".\n");
+  float nodata_value;
+  bool has_dem;
+  RefDem(): nodata_value(-std::numeric_limits<float>::max()), has_dem(false) {}
+};
 
-    datum = geo.datum(); // Read this in for completeness
-    has_dem = true;
-    vw::read_nodata_val(opt.reference_dem, nodata_value);
-    vw_out() << "Using nodata value: " << nodata_value << std::endl;
-  }else{
-    datum = vw::cartography::Datum(opt.datum_str); 
+void load_ref_dem(Options const& opt, RefDem & ref) {
+  if (opt.reference_dem == "") {
     vw_out() << "No reference DEM provided. Will use a height of "
              << opt.height_above_datum << " above the datum:\n" 
-             << datum << std::endl;
+             << vw::cartography::Datum(opt.datum_str) << std::endl;
+    return;
   }
 
+  ref.dem = DiskImageView<float>(opt.reference_dem);
+  bool ans = read_georeference(ref.geo, opt.reference_dem);
+  if (!ans) 
+    vw_throw( ArgumentErr() << "Could not read the georeference from dem: "
+              << opt.reference_dem << ".\n");
+
+  ref.has_dem = true;
+  vw::read_nodata_val(opt.reference_dem, ref.nodata_value);
+  vw_out() << "Using nodata value: " << ref.nodata_value << std::endl;
+}
+
+void form_pinhole_camera(Options & opt, RefDem const& ref, vw::cartography::Datum & datum,
+                         boost::shared_ptr<CameraModel> & out_cam) {
+
+  GeoReference const& geo = ref.geo;
+  ImageView<float> const& dem = ref.dem;
+  float nodata_value = ref.nodata_value;
+  bool has_dem = ref.has_dem;
+  if (has_dem)
+    datum = geo.datum(); // Read this in for completeness
+  else
+    datum = vw::cartography::Datum(opt.datum_str); 
+
   // Prepare the DEM for interpolation
   ImageViewRef<PixelMask<float>> interp_dem
     = interpolate(create_mask(dem, nodata_value),
@@ -1240,6 +1280,81 @@ void read_pinhole_from_json(Options const& opt, vw::cartography::Datum & datum,
   pin.set_camera_pose(submatrix(cam2world, 0, 0, 3, 3));
 }
 
+void write_camera(Options const& opt, vw::cartography::Datum const& datum,
+                  boost::shared_ptr<CameraModel> const& out_cam) {
+  vw::Vector3 llh = datum.cartesian_to_geodetic(out_cam->camera_center(Vector2()));
+  vw_out() << "Output camera center lon, lat, and height above datum: " << llh << std::endl;
+  vw_out() << "Writing: " << opt.camera_file << std::endl;
+  if (opt.camera_type == "opticalbar")
+    ((vw::camera::OpticalBarModel*)out_cam.get())->write(opt.camera_file);
+  else 
+    ((vw::camera::PinholeModel*)out_cam.get())->write(opt.camera_file);
+}
+
+// Make the cameras listed in the batch file. The reference DEM is loaded
+// once. The cameras are made in parallel, and a failure for one of them
+// does not stop the others.
+void run_batch(Options const& opt) {
+
+  std::vector<Options> items;
+  std::ifstream ifs(opt.batch_file.c_str());
+  if (!ifs)
+    vw_throw(ArgumentErr() << "Cannot read: " << opt.batch_file << ".\n");
+  std::string line;
+  while (getline(ifs, line, '\n')) {
+    std::vector<std::string> vals;
+    parse_values<std::string>(line, vals);
+    if (vals.empty() || vals[0][0] == '#')
+      continue;
+    if (vals.size() < 2)
+      vw_throw(ArgumentErr() << "Expecting an image and an output camera on line: "
+               << line << "\n");
+
+    Options item = opt;
+    item.image_file  = vals[0];
+    item.camera_file = vals[1];
+    for (size_t it = 2; it < vals.size(); it++)
+      item.lon_lat_values_str += vals[it] + " ";
+    if (item.lon_lat_values_str != "")
+      item.frame_index = "";
+    if (item.gcp_file != "")
+      item.gcp_file = fs::path(item.camera_file).replace_extension(".gcp").string();
+    items.push_back(item);
+  }
+
+  RefDem ref;
+  load_ref_dem(opt, ref);
+
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  vw_out() << "Making " << items.size() << " cameras with " << num_threads
+           << " threads.\n";
+
+  int num_failed = 0;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int it = 0; it < int(items.size()); it++) {
+    try {
+      boost::shared_ptr<CameraModel> out_cam;
+      vw::cartography::Datum datum;
+      prepare_image_options(items[it]);
+      form_pinhole_camera(items[it], ref, datum, out_cam);
+      write_camera(items[it], datum, out_cam);
+    } catch (std::exception const& e) {
+#pragma omp critical
+      {
+        num_failed++;
+        vw_out(ErrorMessage) << "Could not make a camera for: " << items[it].image_file
+                             << ". " << e.what() << "\n";
+      }
+    }
+  }
+
+  if (num_failed > 0)
+    vw_throw(ArgumentErr() << "Failed to make " << num_failed << " out of "
+             << items.size() << " cameras.\n");
+}
+
 int main(int argc, char * argv[]){
   
   Options opt;
@@ -1252,23 +1367,24 @@ int main(int argc, char * argv[]){
 
     // Some of the numbers we print need high precision
     vw_out().precision(17);
+
+    if (!opt.batch_file.empty()) {
+      run_batch(opt);
+      return 0;
+    }
     
     if (!opt.input_pinhole) {
       // Create a pinhole camera using user-specified options.
-      form_pinhole_camera(opt, datum, out_cam);
+      RefDem ref;
+      load_ref_dem(opt, ref);
+      form_pinhole_camera(opt, ref, datum, out_cam);
     } else {
       // Read a pinhole camera from Planet's json file format (*_pinhole.json). Then
       // the WGS84 datum is assumed. Ignore all other input options.
       read_pinhole_from_json(opt, datum, out_cam);
     }
-    
-    vw::Vector3 llh = datum.cartesian_to_geodetic(out_cam->camera_center(Vector2()));
-    vw_out() << "Output camera center lon, lat, and height above datum: " << llh << std::endl;
-    vw_out() << "Writing: " << opt.camera_file << std::endl;
-    if (opt.camera_type == "opticalbar")
-      ((vw::camera::OpticalBarModel*)out_cam.get())->write(opt.camera_file);
-    else 
-      ((vw::camera::PinholeModel*)out_cam.get())->write(opt.camera_file);
+
+    write_camera(opt, datum, out_cam);
     
   } ASP_STANDARD_CATCHES;
   
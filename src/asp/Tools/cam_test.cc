@@ -290,6 +290,13 @@ int main(int argc, char *argv[]) {
     // Iterate over the image
     std::vector<double> ctr_diff, dir_diff, cam1_to_cam2_diff, cam2_to_cam1_diff, dg_vs_csm_diff;
     for (int col = 0; col < image_cols; col += opt.sample_rate) {
+
+      // Shoot rays from each camera along this column, intersect them
+      // with the given height above the datum, and project them into
+      // the other camera. Do the projections for the whole column at
+      // once, which is faster for linescan cameras.
+      std::vector<Vector2> image_pixels;
+      std::vector<Vector3> cam1_ctrs, cam2_ctrs, cam1_dirs, cam2_dirs, xyz1, xyz2;
       for (int row = 0; row < image_rows; row += opt.sample_rate) {
 
         Vector2 image_pix(col + opt.subpixel_offset, row + opt.subpixel_offset);
@@ -297,30 +304,44 @@ int main(int argc, char *argv[]) {
         if (single_pix)
           image_pix = opt.single_pixel;
 
+        image_pixels.push_back(image_pix);
+        cam1_ctrs.push_back(cam1_model->camera_center(image_pix));
+        cam2_ctrs.push_back(cam2_model->camera_center(image_pix));
+        cam1_dirs.push_back(cam1_model->pixel_to_vector(image_pix));
+        cam2_dirs.push_back(cam2_model->pixel_to_vector(image_pix));
+        xyz1.push_back(vw::cartography::datum_intersection(major_axis, minor_axis,
+                                                           cam1_ctrs.back(),
+                                                           cam1_dirs.back()));
+        xyz2.push_back(vw::cartography::datum_intersection(major_axis, minor_axis,
+                                                           cam2_ctrs.back(),
+                                                           cam2_dirs.back()));
+        if (single_pix)
+          break;
+      }
+
+      std::vector<Vector2> cam2_pixels, cam1_pixels;
+      asp::points_to_pixels(cam2_model.get(), xyz1, cam2_pixels);
+      asp::points_to_pixels(cam1_model.get(), xyz2, cam1_pixels);
+
+      for (size_t it = 0; it < image_pixels.size(); it++) {
+
+        Vector2 image_pix = image_pixels[it];
         if (opt.print_per_pixel_results || single_pix)
           vw_out() << "Pixel: " << image_pix << "\n";
 
-        Vector3 cam1_ctr = cam1_model->camera_center(image_pix);
-        Vector3 cam2_ctr = cam2_model->camera_center(image_pix);
-        ctr_diff.push_back(norm_2(cam1_ctr - cam2_ctr));
+        ctr_diff.push_back(norm_2(cam1_ctrs[it] - cam2_ctrs[it]));
 
         if (opt.print_per_pixel_results)
           vw_out() << "Camera center diff: " << ctr_diff.back() << std::endl;
 
-        Vector3 cam1_dir = cam1_model->pixel_to_vector(image_pix);
-        Vector3 cam2_dir = cam2_model->pixel_to_vector(image_pix);
-        dir_diff.push_back(norm_2(cam1_dir - cam2_dir));
+        dir_diff.push_back(norm_2(cam1_dirs[it] - cam2_dirs[it]));
 
         if (opt.print_per_pixel_results)
           vw_out() << "Camera direction diff: " << dir_diff.back() << std::endl;
 
-        // Shoot a ray from the cam1 camera, intersect it with the
-        // given height above datum, and project it back into the cam2
-        // camera.
-        Vector3 xyz = vw::cartography::datum_intersection(major_axis, minor_axis,
-                                                          cam1_ctr, cam1_dir);
-
-        Vector2 cam2_pix = cam2_model->point_to_pixel(xyz);
+        Vector2 cam2_pix = cam2_pixels[it];
+        if (std::isnan(cam2_pix[0]))
+          cam2_pix = cam2_model->point_to_pixel(xyz1[it]); // will throw
         cam1_to_cam2_diff.push_back(norm_2(image_pix - cam2_pix));
 
         if (opt.print_per_pixel_results)
@@ -328,17 +349,14 @@ int main(int argc, char *argv[]) {
 
         if (opt.dg_vs_csm) {
           asp::stereo_settings().dg_use_csm = !asp::stereo_settings().dg_use_csm;
-          Vector2 cam2_pix2 = cam2_model->point_to_pixel(xyz);
+          Vector2 cam2_pix2 = cam2_model->point_to_pixel(xyz1[it]);
           asp::stereo_settings().dg_use_csm = !asp::stereo_settings().dg_use_csm;
           dg_vs_csm_diff.push_back(norm_2(cam2_pix - cam2_pix2));
         }
 
-        // Shoot a ray from the cam2 camera, intersect it with the
-        // given height above the datum, and project it back into the
-        // cam1 camera.
-        xyz = vw::cartography::datum_intersection(major_axis, minor_axis,
-                                                  cam2_ctr, cam2_dir);
-        Vector2 cam1_pix = cam1_model->point_to_pixel(xyz);
+        Vector2 cam1_pix = cam1_pixels[it];
+        if (std::isnan(cam1_pix[0]))
+          cam1_pix = cam1_model->point_to_pixel(xyz2[it]); // will throw
         cam2_to_cam1_diff.push_back(norm_2(image_pix - cam1_pix));
 
         if (opt.print_per_pixel_results)
@@ -346,13 +364,10 @@ int main(int argc, char *argv[]) {
 
         if (opt.dg_vs_csm) {
           asp::stereo_settings().dg_use_csm = !asp::stereo_settings().dg_use_csm;
-          Vector2 cam1_pix2 = cam1_model->point_to_pixel(xyz);
+          Vector2 cam1_pix2 = cam1_model->point_to_pixel(xyz2[it]);
           asp::stereo_settings().dg_use_csm = !asp::stereo_settings().dg_use_csm;
           dg_vs_csm_diff.push_back(norm_2(cam1_pix - cam1_pix2));
         }
-
-        if (single_pix)
-          break;
       }
 
       if (single_pix)
@@ -17,7 +17,8 @@
 
 
 /// Compute the footprint of a camera on a DEM/datum, print it, and optionally
-///  write a KML file.
+///  write a KML file. Many cameras can be passed in as lists, and then their
+///  footprints are found in parallel.
 
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <vw/FileIO/DiskImageView.h>
@@ -27,9 +28,11 @@
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/CameraBBox.h>
 #include <vw/FileIO/KML.h>
+#include <vw/Cartography/shapeFile.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/FileUtils.h>
+#include <asp/Core/CameraFootprint.h>
 
 #include <limits>
 #include <cstring>
@@ -49,7 +52,9 @@ using namespace vw::cartography;
 
 struct Options : public vw::GdalWriteOptions {
   string image_file, camera_file, stereo_session, bundle_adjust_prefix,
-         datum_str, dem_file, target_srs_string, output_kml;
+         datum_str, dem_file, target_srs_string, output_kml, output_shapefile,
+         image_list, camera_list;
+  std::vector<std::string> image_files, camera_files;
   bool quick;
   //BBox2i image_crop_box;
 };
@@ -64,6 +69,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 	     "Use a faster but less accurate computation.")
     ("output-kml", po::value(&opt.output_kml),
      "Create an output KML file at this path.")
+    ("output-shapefile", po::value(&opt.output_shapefile)->default_value(""),
+     "Write the footprint bounding boxes, one polygon per camera, to this shapefile, "
+     "in the output projection.")
+    ("image-list", po::value(&opt.image_list)->default_value(""),
+     "A file containing the list of images, one per line. Their footprints are found "
+     "in parallel. Use with --camera-list.")
+    ("camera-list", po::value(&opt.camera_list)->default_value(""),
+     "A file containing the list of cameras, one per line, matching the images in "
+     "--image-list.")
     ("session-type,t",   po::value(&opt.stereo_session)->default_value(""),
      "Select the stereo session type to use for processing. Usually the program can select this automatically by the file extension, except for xml cameras. See the doc for options.")
     ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
@@ -94,10 +108,29 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 			    allow_unregistered, unregistered);
 
   
-  if ( opt.image_file.empty() )
-    vw_throw( ArgumentErr() << "Missing input image.\n" << usage << general_options );
+  if (opt.image_list != "" || opt.camera_list != "") {
+    if (opt.image_list == "" || opt.camera_list == "")
+      vw_throw(ArgumentErr() << "The options --image-list and --camera-list "
+               << "must be used together.\n");
+    if (!opt.image_file.empty())
+      vw_throw(ArgumentErr() << "Cannot pass in both an image and an image list.\n");
+    asp::read_list(opt.image_list, opt.image_files);
+    asp::read_list(opt.camera_list, opt.camera_files);
+    if (opt.image_files.size() != opt.camera_files.size())
+      vw_throw(ArgumentErr() << "The image and camera lists must have the same "
+               << "number of entries.\n");
+    if (opt.image_files.empty())
+      vw_throw(ArgumentErr() << "The image list is empty.\n");
+  } else {
+    if ( opt.image_file.empty() )
+      vw_throw( ArgumentErr() << "Missing input image.\n" << usage << general_options );
+    if ( opt.camera_file.empty() )
+      vw_throw( ArgumentErr() << "Missing input camera.\n" );
+    opt.image_files.push_back(opt.image_file);
+    opt.camera_files.push_back(opt.camera_file);
+  }
 
-  if (boost::iends_with(opt.image_file, ".cub") && opt.stereo_session == "" )
+  if (boost::iends_with(opt.image_files[0], ".cub") && opt.stereo_session == "" )
     opt.stereo_session = "isis";
 
   // Need this to be able to load adjusted camera models. That will happen
@@ -117,6 +150,36 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   //}
 }
 
+// Find the footprint of one camera. The coordinates are the ground points
+// used to find it, as longitude, latitude, and height.
+void compute_footprint(Options const& opt,
+                       boost::shared_ptr<CameraModel> const& cam,
+                       vw::Vector2i const& image_size,
+                       ImageViewRef<PixelMask<float>> const& dem,
+                       GeoReference const& dem_georef,
+                       GeoReference const& target_georef,
+                       BBox2 & footprint_bbox, float & mean_gsd,
+                       std::vector<Vector3> & coords) {
+
+  mean_gsd = 0;
+  coords.clear();
+  if (opt.dem_file.empty()) { // No DEM available, intersect with the datum.
+    std::vector<Vector2> coords2;
+    footprint_bbox = camera_bbox(target_georef, cam, image_size[0], image_size[1],
+                                 mean_gsd, &coords2);
+    for (size_t i=0; i<coords2.size(); ++i) {
+      Vector3 proj_coord(coords2[i][0], coords2[i][1], 0.0);
+      coords.push_back(target_georef.point_to_geodetic(proj_coord));
+    }
+  } else { // DEM provided, intersect with it.
+    footprint_bbox = asp::fast_camera_bbox(opt.dem_file, dem, dem_georef, target_georef,
+                                           cam, image_size[0], image_size[1], mean_gsd,
+                                           opt.quick, &coords);
+    for (size_t i=0; i<coords.size(); ++i)
+      coords[i] = target_georef.datum().cartesian_to_geodetic(coords[i]);
+  }
+}
+
 int main( int argc, char *argv[] ) {
 
   Options opt;
@@ -124,43 +187,9 @@ int main( int argc, char *argv[] ) {
 
     handle_arguments(argc, argv, opt);
 
-    typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
-    SessionPtr session(asp::StereoSessionFactory::create
-		       (opt.stereo_session, // may change inside
-                        opt,
-                        opt.image_file,  opt.image_file,
-                        opt.camera_file, opt.camera_file,
-                        "",
-                        "",
-                        false) ); // Do not allow promotion from normal to map projected session
-
-    if ( opt.camera_file.empty() )
-      vw_throw( ArgumentErr() << "Missing input camera.\n" );
-
-   
-    boost::shared_ptr<CameraModel> cam = session->camera_model(opt.image_file, opt.camera_file);
-
-    // The input nodata value
-    float input_nodata_value = -std::numeric_limits<float>::max(); 
-    vw::read_nodata_val(opt.image_file, input_nodata_value);
-
-    // Just get the image size
-    vw::Vector2i image_size = vw::file_image_size(opt.image_file);
-
-    //    // The bounding box -> Add this feature in the future!
-    //    BBox2 image_box = bounding_box(input_img);
-    //    if (!opt.image_crop_box.empty()) 
-    //      image_box.crop(opt.image_crop_box);
-    
-    // Perform the computation
-    
-    GeoReference target_georef;
-    
-    BBox2 footprint_bbox;
-    float mean_gsd=0;
-    std::vector<Vector3> coords;
-    if (opt.dem_file.empty()) { // No DEM available, intersect with the datum.
-
+    GeoReference target_georef, dem_georef;
+    ImageViewRef< PixelMask<float> > dem;
+    if (opt.dem_file.empty()) {
       // Initialize the georef/datum
       bool have_user_datum = (opt.datum_str != "");
       cartography::Datum datum(opt.datum_str);
@@ -168,41 +197,85 @@ int main( int argc, char *argv[] ) {
       bool have_input_georef = false;
       asp::set_srs_string(opt.target_srs_string, have_user_datum, datum,
                           have_input_georef, target_georef);
-      vw_out() << "Using georef: " << target_georef << std::endl;
-
-      std::vector<Vector2> coords2;
-      footprint_bbox = camera_bbox(target_georef, cam, image_size[0], image_size[1],
-                                   mean_gsd, &coords2);
-      for (size_t i=0; i<coords2.size(); ++i) {
-        Vector3 proj_coord(coords2[i][0], coords2[i][1], 0.0);
-        coords.push_back(target_georef.point_to_geodetic(proj_coord));
-      }
-      
-    } else { // DEM provided, intersect with it.
-
+    } else {
       // Load the DEM
       float dem_nodata_val = -std::numeric_limits<float>::max(); 
       vw::read_nodata_val(opt.dem_file, dem_nodata_val);
-      ImageViewRef< PixelMask<double> > dem = create_mask
-        (channel_cast<double>(DiskImageView<float>(opt.dem_file)), dem_nodata_val);
-      
-      GeoReference dem_georef;
+      dem = create_mask(DiskImageView<float>(opt.dem_file), dem_nodata_val);
       if (!read_georeference(dem_georef, opt.dem_file))
         vw_throw( ArgumentErr() << "Missing georef.\n");
-
       target_georef = dem_georef; // return box in this projection
-      vw_out() << "Using georef: " << target_georef << std::endl;
-      
-      footprint_bbox = camera_bbox(dem, dem_georef, target_georef, cam,
-                                   image_size[0], image_size[1], mean_gsd, opt.quick, &coords);
-      for (size_t i=0; i<coords.size(); ++i)
-        coords[i] = target_georef.datum().cartesian_to_geodetic(coords[i]);
     }
-    
-    // Print out the results    
-    vw_out() << "Computed footprint bounding box:\n" << footprint_bbox << std::endl;
-    vw_out() << "Computed mean gsd: " << mean_gsd << std::endl;
- 
+    vw_out() << "Using georef: " << target_georef << std::endl;
+
+    // Load the cameras. The session is not thread-safe, so this is serial.
+    int num_cams = opt.image_files.size();
+    std::vector<boost::shared_ptr<CameraModel>> cams(num_cams);
+    std::vector<vw::Vector2i> image_sizes(num_cams);
+    for (int it = 0; it < num_cams; it++) {
+      std::string session_type = opt.stereo_session; // may change inside
+      typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
+      SessionPtr session(asp::StereoSessionFactory::create
+                         (session_type, opt,
+                          opt.image_files[it],  opt.image_files[it],
+                          opt.camera_files[it], opt.camera_files[it],
+                          "",
+                          "",
+                          false) ); // Do not allow promotion from normal to map projected session
+      cams[it] = session->camera_model(opt.image_files[it], opt.camera_files[it]);
+      // Just get the image size
+      image_sizes[it] = vw::file_image_size(opt.image_files[it]);
+    }
+
+    // Perform the computation. ISIS cameras must be used from one thread.
+    std::vector<BBox2> footprint_bboxes(num_cams);
+    std::vector<float> mean_gsds(num_cams, 0);
+    std::vector<std::vector<Vector3>> coords(num_cams);
+    std::vector<std::string> errors(num_cams);
+    bool single_threaded = (opt.stereo_session == "isis");
+#pragma omp parallel for schedule(dynamic, 1) if (!single_threaded && num_cams > 1)
+    for (int it = 0; it < num_cams; it++) {
+      try {
+        compute_footprint(opt, cams[it], image_sizes[it], dem, dem_georef, target_georef,
+                          footprint_bboxes[it], mean_gsds[it], coords[it]);
+      } catch (std::exception const& e) {
+        errors[it] = e.what();
+      }
+    }
+
+    // Print out the results
+    for (int it = 0; it < num_cams; it++) {
+      if (num_cams > 1)
+        vw_out() << "Image: " << opt.image_files[it] << "\n";
+      if (!errors[it].empty()) {
+        if (num_cams == 1)
+          vw_throw(ArgumentErr() << errors[it]);
+        vw_out(WarningMessage) << "Could not find the footprint: " << errors[it] << "\n";
+        continue;
+      }
+      vw_out() << "Computed footprint bounding box:\n" << footprint_bboxes[it] << std::endl;
+      vw_out() << "Computed mean gsd: " << mean_gsds[it] << std::endl;
+    }
+
+    if (opt.output_shapefile != "") {
+      std::vector<vw::geometry::dPoly> polyVec;
+      for (int it = 0; it < num_cams; it++) {
+        BBox2 const& b = footprint_bboxes[it];
+        if (!errors[it].empty() || b.empty())
+          continue;
+        std::vector<double> x = {b.min().x(), b.max().x(), b.max().x(), b.min().x()};
+        std::vector<double> y = {b.min().y(), b.min().y(), b.max().y(), b.max().y()};
+        vw::geometry::dPoly poly;
+        bool isPolyClosed = true;
+        poly.setPolygon(x.size(), vw::geometry::vecPtr(x), vw::geometry::vecPtr(y),
+                        isPolyClosed, "yellow", opt.image_files[it]);
+        polyVec.push_back(poly);
+      }
+      bool has_georef = true;
+      vw_out() << "Writing: " << opt.output_shapefile << std::endl;
+      write_shapefile(opt.output_shapefile, has_georef, target_georef, polyVec);
+    }
+
     if (opt.output_kml == "")
       return 0;
 
@@ -220,8 +293,13 @@ int main( int argc, char *argv[] ) {
                       "http://maps.google.com/mapfiles/kml/shapes/placemark_circle_highlight.png");
     kml.append_stylemap( "placemark", "dot",
                          "dot_highlight" ); 
-    
-    kml.append_line(coords, "intersections", "placemark");
+
+    for (int it = 0; it < num_cams; it++) {
+      if (!errors[it].empty() || coords[it].empty())
+        continue;
+      std::string name = (num_cams > 1) ? opt.image_files[it] : "intersections";
+      kml.append_line(coords[it], name, "placemark");
+    }
     vw_out() << "Writing: " << opt.output_kml << std::endl; 
     kml.close_kml();
     
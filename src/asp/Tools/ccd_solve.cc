@@ -108,53 +108,60 @@ namespace fs = boost::filesystem;
 using namespace vw;
 
 // A Ceres cost function. Measure how discontinuous the disparity is.
+// The difference of disparities at two adjacent columns is read from
+// disk once, rather than each time the cost function is evaluated.
 struct DisparityError {
-  DisparityError(ImageViewRef< PixelMask<Vector2f> > disparity,
-                 int col, int row): m_disparity(disparity), m_col(col), m_row(row) {}
-
-  // takes an array of arrays. Each such array is a parameter block of a
-  // size that is determined at run-time.
-  bool operator()(double const * const * parameters, double * residuals) const {
-    PixelMask<Vector2> disp1 = PixelMask<Vector2>(m_disparity(m_col, m_row))
-      -  PixelMask<Vector2>(Vector2(parameters[0][0], parameters[1][0]));
-    PixelMask<Vector2> disp2 = PixelMask<Vector2>(m_disparity(m_col + 1, m_row))
-      -  PixelMask<Vector2>(Vector2(parameters[2][0], parameters[3][0]));
-
-    PixelMask<Vector2> diff = disp1 - disp2;
-    
-    if (is_valid(diff)) {
-      residuals[0] = diff.child()[0];
-      residuals[1] = diff.child()[1];
-    } else {
-      residuals[0] = 0.0;
-      residuals[1] = 0.0;
-    }
+  DisparityError(Vector2 const& disp_diff): m_disp_diff(disp_diff) {}
+
+  // The parameters are the x and y offsets at the two columns
+  template <typename T>
+  bool operator()(const T* x1, const T* y1, const T* x2, const T* y2,
+                  T* residuals) const {
+    residuals[0] = m_disp_diff[0] - x1[0] + x2[0];
+    residuals[1] = m_disp_diff[1] - y1[0] + y2[0];
     return true;
   }
 
   // Factory to hide the construction of the CostFunction object from the client code.
-  static ceres::CostFunction* Create(ImageViewRef< PixelMask<Vector2f> > disparity,
-                                     int col, int row){
-    ceres::DynamicNumericDiffCostFunction<DisparityError>* cost_function =
-      new ceres::DynamicNumericDiffCostFunction<DisparityError>
-      (new DisparityError(disparity, col, row));
-    
-    // The residual size is always the same.
-    cost_function->SetNumResiduals(2);
-
-    // Set the size of each optimization block
-    cost_function->AddParameterBlock(1);
-    cost_function->AddParameterBlock(1);
-    cost_function->AddParameterBlock(1);
-    cost_function->AddParameterBlock(1);
-    return cost_function;
+  static ceres::CostFunction* Create(Vector2 const& disp_diff) {
+    return new ceres::AutoDiffCostFunction<DisparityError, 2, 1, 1, 1, 1>
+      (new DisparityError(disp_diff));
   }
   
 private:
-  ImageViewRef< PixelMask<Vector2f> > m_disparity;
-  int m_col, m_row;
+  Vector2 m_disp_diff;
 }; // End class DisparityError
 
+// The difference of disparities at adjacent columns, for one sampled row
+struct RowSample {
+  std::vector<Vector2> diff;
+  std::vector<char>    valid;
+};
+
+// Read the sampled rows of a disparity in parallel, and find for each
+// the difference of disparities at adjacent columns. Each row is read
+// whole, which is much faster than reading the pixels one at a time.
+void sample_disparity(ImageViewRef<PixelMask<Vector2f>> const& disparity,
+                      int sample_rate, std::vector<RowSample> & samples) {
+
+  int cols = disparity.cols(), rows = disparity.rows();
+  int num_samples = (rows + sample_rate - 1) / sample_rate;
+  samples.clear();
+  samples.resize(std::max(num_samples, 0));
+
+#pragma omp parallel for schedule(dynamic)
+  for (int it = 0; it < num_samples; it++) {
+    int row = it * sample_rate;
+    ImageView<PixelMask<Vector2f>> line = crop(disparity, BBox2i(0, row, cols, 1));
+    RowSample & sample = samples[it];
+    sample.diff.resize(std::max(cols - 1, 0));
+    sample.valid.resize(std::max(cols - 1, 0));
+    for (int col = 0; col < cols - 1; col++) {
+      sample.valid[col] = is_valid(line(col, 0)) && is_valid(line(col + 1, 0));
+      sample.diff[col]  = Vector2(line(col, 0).child()) - Vector2(line(col + 1, 0).child());
+    }
+  }
+}
 
 // A ceres cost function. Minimize the sum of squares of CCD offsets
 // with given weight
@@ -303,15 +310,9 @@ int main(int argc, char* argv[]) {
     // The ceres problem
     ceres::Problem problem;
 
-    // Keep here handles to the disparities
-    std::vector< ImageViewRef< PixelMask<Vector2f> > > disparity_vec;
-
     // Read the disparities and add them to the problem
-    int count = -1;
     while (dss >> disp_file) {
 
-      count++;
-      
       vw_out() << "Reading " << disp_file << std::endl;
       DiskImageView< PixelMask<Vector2f> >full_disparity(disp_file);
 
@@ -340,15 +341,17 @@ int main(int argc, char* argv[]) {
         vw::vw_throw( vw::ArgumentErr()
                       << "All cropped disparities must have the same number of columns.\n\n");
       
-      disparity_vec.push_back(disparity);
-      
-      int cols = disparity_vec[count].cols(), rows = disparity_vec[count].rows();
+      std::vector<RowSample> samples;
+      sample_disparity(disparity, opt.sample_rate, samples);
     
-      // Make the disparity less discontinuous
+      // Make the disparity less discontinuous. Invalid disparities
+      // contribute nothing.
+      int cols = disparity.cols();
       for (int col = 0; col < cols - 1; col++) {
-        for (int row = 0; row < rows; row += opt.sample_rate) {
-          ceres::CostFunction* cost_function = DisparityError::Create(disparity_vec[count],
-                                                                      col, row);
+        for (size_t it = 0; it < samples.size(); it++) {
+          if (!samples[it].valid[col])
+            continue;
+          ceres::CostFunction* cost_function = DisparityError::Create(samples[it].diff[col]);
           ceres::LossFunction* loss_function = new ceres::CauchyLoss(opt.disparity_threshold);
           problem.AddResidualBlock(cost_function, loss_function,
                                    &x_offset[col], &y_offset[col],
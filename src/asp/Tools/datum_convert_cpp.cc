@@ -23,6 +23,8 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/PointUtils.h>
+#include <asp/Core/GridInterpolation.h>
+#include <asp/Core/InterpolatedTransform.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -33,6 +35,11 @@ using namespace vw;
 using namespace vw::cartography;
 using namespace std;
 
+// The height change between datums is found exactly only on a sparse
+// grid, at two heights, and interpolated in between, linearly in height.
+const double DATUM_HEIGHT_SPAN = 10000.0; // meters
+const double DATUM_HEIGHT_TOL  = 1e-3;    // meters
+
 template <class ImageT>
 class DatumConvertView : public ImageViewBase<DatumConvertView<ImageT>>
 {
@@ -43,6 +50,7 @@ class DatumConvertView : public ImageViewBase<DatumConvertView<ImageT>>
   double              m_nodata_val;
   bool                m_use_gcc_convert;
   bool                m_debug_mode;
+  int                 m_grid_step;
 
 public:
 
@@ -53,13 +61,16 @@ public:
   /// Image view which replaces each input elevation with the elevation
   ///  value of the same location in the output georeference system.
   /// - This view does not do any horizontal movement.
+  /// - With a positive grid step, the height change is found exactly only
+  ///   on a grid with this step, and interpolated in between.
   DatumConvertView(ImageT       const& input_dem,
                    GeoReference const& input_georef,
                    GeoReference const& output_georef,
                    double nodata_val,
-                   bool debug_mode=false):
+                   bool debug_mode=false, int grid_step=0):
     m_input_dem(input_dem), m_input_georef(input_georef), m_output_georef(output_georef), 
-    m_tf(input_georef, output_georef), m_nodata_val(nodata_val), m_use_gcc_convert(false), m_debug_mode(debug_mode) {
+    m_tf(input_georef, output_georef), m_nodata_val(nodata_val), m_use_gcc_convert(false),
+    m_debug_mode(debug_mode), m_grid_step(grid_step) {
     
     // For simple datums with just the ellipsoid size specifed don't use Proj4 to do the
     //  datum conversions, use our ellipsoid calculations instead.  Proj4 does not seem to
@@ -74,6 +85,10 @@ public:
          (proj4_out.find("+datum") == std::string::npos)  ){
       m_use_gcc_convert = true;
     }
+
+    // Print each pixel as it is converted
+    if (m_debug_mode)
+      m_grid_step = 0;
   }
 
   inline int32 cols  () const { return m_input_dem.cols(); }
@@ -82,15 +97,9 @@ public:
 
   inline pixel_accessor origin() const { return pixel_accessor(*this); }
 
-  inline result_type operator()(size_t col, size_t row, size_t p=0) const {
-
-    // Handle nodata
-    if (m_input_dem(col, row) == m_nodata_val)
-      return m_nodata_val;
+  /// The elevation in the output datum at the given pixel and input elevation
+  double convert_height(Vector2 const& input_pixel, double current_height) const {
 
-    // Compute the elevation in the output datum
-    double  current_height  = m_input_dem(col, row);
-    Vector2 input_pixel(col, row);
     Vector2 input_lonlat    = m_input_georef.pixel_to_lonlat(input_pixel);
     Vector3 input_llh(input_lonlat[0], input_lonlat[1], current_height);
 
@@ -117,11 +126,62 @@ public:
     return output_llh[2];
   }
 
+  /// The height change at the given pixel, at zero elevation and at
+  /// DATUM_HEIGHT_SPAN. It is close to linear in between.
+  Vector2 height_changes(int col, int row) const {
+    Vector2 pix(col, row);
+    return Vector2(convert_height(pix, 0.0),
+                   convert_height(pix, DATUM_HEIGHT_SPAN) - DATUM_HEIGHT_SPAN);
+  }
+
+  inline result_type operator()(size_t col, size_t row, size_t p=0) const {
+
+    // Handle nodata
+    if (m_input_dem(col, row) == m_nodata_val)
+      return m_nodata_val;
+
+    // Compute the elevation in the output datum
+    return convert_height(Vector2(col, row), m_input_dem(col, row));
+  }
+
   /// \cond INTERNAL
-  typedef DatumConvertView<typename ImageT::prerasterize_type> prerasterize_type;
+  typedef CropView<ImageView<result_type>> prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-    return prerasterize_type(m_input_dem.prerasterize(bbox), m_input_georef,
-                              m_output_georef, m_nodata_val, m_debug_mode);
+
+    ImageView<double> dem = crop(m_input_dem, bbox);
+    ImageView<result_type> tile(bbox.width(), bbox.height());
+
+    if (m_grid_step <= 0) {
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          if (dem(col, row) == m_nodata_val)
+            tile(col, row) = m_nodata_val;
+          else
+            tile(col, row) = convert_height(Vector2(col + bbox.min().x(),
+                                                    row + bbox.min().y()),
+                                            dem(col, row));
+        }
+      }
+    } else {
+      ImageView<Vector2> changes;
+      asp::interpolate_on_grid(bbox, m_grid_step, DATUM_HEIGHT_TOL,
+                               [this](int col, int row) {
+                                 return height_changes(col, row);
+                               }, changes);
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          double h = dem(col, row);
+          if (h == m_nodata_val) {
+            tile(col, row) = m_nodata_val;
+            continue;
+          }
+          Vector2 const& c = changes(col, row);
+          tile(col, row) = h + c[0] + (c[1] - c[0]) * h / DATUM_HEIGHT_SPAN;
+        }
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
   template <class DestT> inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
     vw::rasterize(prerasterize(bbox), dest, bbox);
@@ -136,8 +196,10 @@ datum_convert(ImageViewBase<ImageT> const& input_dem,
                GeoReference          const& input_georef,
                GeoReference          const& output_georef,
                double                       nodata_val,
-               bool                         debug_mode) {
-  return DatumConvertView<ImageT>(input_dem.impl(), input_georef, output_georef, nodata_val, debug_mode);
+               bool                         debug_mode,
+               int                          grid_step) {
+  return DatumConvertView<ImageT>(input_dem.impl(), input_georef, output_georef, nodata_val,
+                                  debug_mode, grid_step);
 }
 
 
@@ -209,7 +271,8 @@ BBox2 get_output_projected_bbox(GeoReference     const& input_georef,
 struct Options: vw::GdalWriteOptions {
   string input_dem, output_dem, output_datum, input_datum,
          target_srs_string, input_grid, output_info_string;
-  double nodata_value;
+  double nodata_value, transform_grid_tol;
+  int    transform_grid_step;
   bool   keep_bounds, use_double, debug_mode;
 };
 
@@ -231,7 +294,14 @@ void handle_arguments(int argc, char *argv[], Options& opt){
     ("debug-mode",  po::bool_switch(&opt.debug_mode)->default_value(false)->implicit_value(true),
      "Print conversion info for every pixel (to help verify output).")
     ("double", po::bool_switch(&opt.use_double)->default_value(false)->implicit_value(true),
-     "Output using double precision (64 bit) instead of float (32 bit).");
+     "Output using double precision (64 bit) instead of float (32 bit).")
+    ("transform-grid-step", po::value(&opt.transform_grid_step)->default_value(16),
+     "Find the height change between datums and the horizontal shift exactly only on a grid "
+     "with this step, in pixels, and interpolate in between. The grid is refined where the "
+     "interpolation is not accurate enough. Set to 0 to compute each pixel exactly.")
+    ("transform-grid-tol", po::value(&opt.transform_grid_tol)->default_value(0.01),
+     "The largest error in the interpolated horizontal shift, in pixels, when using "
+     "--transform-grid-step. The height change is interpolated to within 1 mm.");
 
   general_options.add(vw::GdalWriteOptionsDescription(opt));
 
@@ -261,6 +331,11 @@ void handle_arguments(int argc, char *argv[], Options& opt){
   if (!opt.output_datum.empty() && !opt.target_srs_string.empty())
     vw_out(WarningMessage) << "Both the output datum and the PROJ.4 string were specified. The former takes precedence.\n";
 
+  if (opt.transform_grid_step < 0)
+    vw_throw(ArgumentErr() << "The value of --transform-grid-step must be non-negative.\n");
+  if (opt.transform_grid_tol <= 0)
+    vw_throw(ArgumentErr() << "The value of --transform-grid-tol must be positive.\n");
+
   if (opt.debug_mode) {  // Debug output is unreadable with multiple threads.
     vw_out() << "Debug mode set, forcing thread count to 1.\n";
     opt.num_threads = 1;
@@ -416,17 +491,28 @@ void do_work(Options const& opt) {
   ImageViewRef<double> dem_new_heights = datum_convert(pixel_cast<double>(dem_img),
                                                        dem_georef,
                                                        output_working_georef,
-                                                       dem_nodata_val, opt.debug_mode);
+                                                       dem_nodata_val, opt.debug_mode,
+                                                       opt.transform_grid_step);
 
   // Apply the horizontal warping to the image on account of the new datum.
-  ImageViewRef<double> output_dem = apply_mask(geo_transform(create_mask(dem_new_heights,
-                                                                         dem_nodata_val),
-                                                             dem_georef, output_working_georef,
-                                                             output_pixel_box.width(),
-                                                             output_pixel_box.height(),
-                                                             ConstantEdgeExtension()
-                                                           ),
-                                               dem_nodata_val);
+  // This transform is smooth, so by default it is found exactly only on a
+  // sparse grid for each tile.
+  GeoTransform geo_trans(dem_georef, output_working_georef);
+  ImageViewRef<PixelMask<double>> masked_heights = create_mask(dem_new_heights, dem_nodata_val);
+  ImageViewRef<double> output_dem;
+  if (opt.transform_grid_step > 0 && !opt.debug_mode)
+    output_dem = apply_mask(transform(masked_heights,
+                                      asp::InterpolatedTransform<GeoTransform>
+                                      (geo_trans, opt.transform_grid_step, opt.transform_grid_tol,
+                                       Vector2i(dem_img.cols(), dem_img.rows())),
+                                      output_pixel_box.width(), output_pixel_box.height(),
+                                      ConstantEdgeExtension(), BilinearInterpolation()),
+                            dem_nodata_val);
+  else
+    output_dem = apply_mask(transform(masked_heights, geo_trans,
+                                      output_pixel_box.width(), output_pixel_box.height(),
+                                      ConstantEdgeExtension(), BilinearInterpolation()),
+                            dem_nodata_val);
 
   vw_out() << "Writing adjusted DEM: " << opt.output_dem << endl;
   
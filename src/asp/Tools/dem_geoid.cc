@@ -31,6 +31,7 @@ extern "C" {
 #include <vw/Image/Interpolation.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/GridInterpolation.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/dll.hpp>
@@ -43,6 +44,8 @@ using namespace std;
 
 /// Image view which adds or subtracts the ellipsoid/geoid difference
 ///  from elevations in a DEM image.
+/// - The geoid is smooth, so for each tile it is found exactly only on a
+///   sparse grid, and interpolated in between.
 template <class ImageT>
 class DemGeoidView : public ImageViewBase<DemGeoidView<ImageT>> {
   ImageT                m_img;    // The DEM
@@ -54,6 +57,8 @@ class DemGeoidView : public ImageViewBase<DemGeoidView<ImageT>> {
   bool     m_reverse_adjustment; // If true, convert from orthometric height to geoid height
   double   m_correction;
   double   m_nodata_val;
+  int      m_grid_step;
+  double   m_grid_tol;
 
 public:
 
@@ -66,13 +71,15 @@ public:
                bool is_egm2008, vector<double> const& egm2008_grid,
                ImageViewRef<PixelMask<double> > const& geoid,
                GeoReference const& geoid_georef, bool reverse_adjustment,
-               double correction, double nodata_val):
+               double correction, double nodata_val,
+               int grid_step, double grid_tol):
     m_img(img), m_georef(georef),
     m_is_egm2008(is_egm2008), m_egm2008_grid(egm2008_grid),
     m_geoid(geoid), m_geoid_georef(geoid_georef),
     m_reverse_adjustment(reverse_adjustment),
     m_correction(correction),
-    m_nodata_val(nodata_val){}
+    m_nodata_val(nodata_val),
+    m_grid_step(grid_step), m_grid_tol(grid_tol){}
 
   inline int32 cols  () const { return m_img.cols(); }
   inline int32 rows  () const { return m_img.rows(); }
@@ -80,12 +87,11 @@ public:
 
   inline pixel_accessor origin() const { return pixel_accessor(*this); }
 
-  inline result_type operator()( size_t col, size_t row, size_t p=0 ) const {
-
-    if ( m_img(col, row, p) == m_nodata_val )
-      return m_nodata_val; // Skip invalid pixels
+  /// The geoid height, with the correction, at a DEM pixel. NaN if the
+  /// geoid is not known there.
+  double geoid_height(Vector2 const& pix) const {
 
-    Vector2 lonlat = m_georef.pixel_to_lonlat(Vector2(col, row));
+    Vector2 lonlat = m_georef.pixel_to_lonlat(pix);
 
     // For testing (see the link to the reference web form belows).
     //lonlat[0] = -121;   lonlat[1] = 37;   // mainland US
@@ -110,27 +116,30 @@ public:
     while( lonlat[0] <   0.0  ) lonlat[0] += 360.0;
     while( lonlat[0] >= 360.0 ) lonlat[0] -= 360.0;
 
-
-
-    result_type geoid_height = 0.0;
+    double height = 0.0;
     if (m_is_egm2008){
       int nr = m_geoid.rows(), 
           nc = m_geoid.cols();
       // Call fortran function from "geoid" mini external library
       egm2008_call_interp_(&nr, &nc, (double*)&m_egm2008_grid[0],
-                           &lonlat[0], &lonlat[1], &geoid_height);
+                           &lonlat[0], &lonlat[1], &height);
     }else{
       // Use our own interpolation into the geoid image
-      Vector2  pix = m_geoid_georef.lonlat_to_pixel(lonlat);
-      PixelMask<double> interp_val = m_geoid(pix[0], pix[1]);
+      Vector2 geoid_pix = m_geoid_georef.lonlat_to_pixel(lonlat);
+      PixelMask<double> interp_val = m_geoid(geoid_pix[0], geoid_pix[1]);
       if (!is_valid(interp_val))
-        return m_nodata_val;
-      geoid_height = interp_val.child();
+        return std::numeric_limits<double>::quiet_NaN();
+      height = interp_val.child();
     }
 
-    geoid_height += m_correction;
+    return height + m_correction;
+  }
+
+  /// Apply the geoid height to a DEM height
+  result_type adjust(double height_above_ellipsoid, double geoid_height) const {
 
-    result_type height_above_ellipsoid = m_img(col, row, p);
+    if (height_above_ellipsoid == m_nodata_val || std::isnan(geoid_height))
+      return m_nodata_val;
 
     // Compute height above the geoid
     // - See the note in the main program about the formula below
@@ -140,13 +149,34 @@ public:
       return height_above_ellipsoid - geoid_height;
   }
 
+  inline result_type operator()( size_t col, size_t row, size_t p=0 ) const {
+
+    if ( m_img(col, row, p) == m_nodata_val )
+      return m_nodata_val; // Skip invalid pixels
+
+    return adjust(m_img(col, row, p), geoid_height(Vector2(col, row)));
+  }
+
   /// \cond INTERNAL
-  typedef DemGeoidView<typename ImageT::prerasterize_type> prerasterize_type;
+  typedef CropView<ImageView<result_type>> prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return prerasterize_type( m_img.prerasterize(bbox), m_georef,
-                              m_is_egm2008, m_egm2008_grid,
-                              m_geoid, m_geoid_georef, m_reverse_adjustment,
-                              m_correction, m_nodata_val );
+
+    ImageView<result_type> dem = crop(m_img, bbox);
+
+    // The geoid height for each pixel of the tile
+    ImageView<double> geoid;
+    asp::interpolate_on_grid(bbox, m_grid_step, m_grid_tol,
+                             [this](int col, int row) {
+                               return geoid_height(Vector2(col, row));
+                             }, geoid);
+
+    ImageView<result_type> tile(bbox.width(), bbox.height());
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++)
+        tile(col, row) = adjust(dem(col, row), geoid(col, row));
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
   template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
     vw::rasterize( prerasterize(bbox), dest, bbox );
@@ -161,17 +191,19 @@ dem_geoid( ImageViewBase<ImageT> const& img, GeoReference const& georef,
            bool is_egm2008, vector<double> & egm2008_grid,
            ImageViewRef<PixelMask<double> > const& geoid,
            GeoReference const& geoid_georef, bool reverse_adjustment,
-           double correction, double nodata_val) {
+           double correction, double nodata_val, int grid_step, double grid_tol) {
   return DemGeoidView<ImageT>( img.impl(), georef,
                                is_egm2008, egm2008_grid,
                                geoid, geoid_georef,
-                               reverse_adjustment, correction, nodata_val );
+                               reverse_adjustment, correction, nodata_val,
+                               grid_step, grid_tol );
 }
 
 /// Parameters for this tool
 struct Options : vw::GdalWriteOptions {
   string dem_path, geoid, out_prefix;
-  double nodata_value;
+  double nodata_value, geoid_grid_tol;
+  int    geoid_grid_step;
   bool   use_double; // Otherwise use float
   bool   reverse_adjustment;
 };
@@ -213,7 +245,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ){
          "Output using double precision (64 bit) instead of float (32 bit).")
     ("reverse-adjustment",
                         po::bool_switch(&opt.reverse_adjustment)->default_value(false)->implicit_value(true),
-        "Go from DEM relative to the geoid to DEM relative to the ellipsoid.");
+        "Go from DEM relative to the geoid to DEM relative to the ellipsoid.")
+    ("geoid-grid-step", po::value(&opt.geoid_grid_step)->default_value(16),
+        "Find the geoid height exactly only on a grid with this spacing, in DEM pixels, and interpolate bilinearly in between. The grid is refined where the interpolation error is more than --geoid-grid-tol. Set to 0 to find the geoid height exactly at each pixel.")
+    ("geoid-grid-tol", po::value(&opt.geoid_grid_tol)->default_value(1e-3),
+        "The largest allowed interpolation error of the geoid height, in meters, when --geoid-grid-step is positive.");
 
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
@@ -236,6 +272,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ){
     vw_throw( ArgumentErr() << "Requires <dem> in order to proceed.\n\n"
               << usage << general_options );
 
+  if (opt.geoid_grid_step < 0 || opt.geoid_grid_tol <= 0)
+    vw_throw(ArgumentErr() << "The value of --geoid-grid-step must be non-negative, "
+             << "and of --geoid-grid-tol positive.\n" << usage << general_options);
+
   boost::to_lower(opt.geoid);
 
   if ( opt.out_prefix.empty() )
@@ -451,7 +491,8 @@ int main( int argc, char *argv[] ) {
     ImageViewRef<double> adj_dem = dem_geoid(dem_img, dem_georef,
                                              is_egm2008, egm2008_grid,
                                              geoid, geoid_georef,
-                                             reverse_adjustment, major_correction, dem_nodata_val);
+                                             reverse_adjustment, major_correction, dem_nodata_val,
+                                             opt.geoid_grid_step, opt.geoid_grid_tol);
 
     string adj_dem_file = opt.out_prefix + "-adj.tif";
     vw_out() << "Writing adjusted DEM: " << adj_dem_file << endl;
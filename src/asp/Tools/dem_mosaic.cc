@@ -31,23 +31,29 @@
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/BigTileWriter.h>
+#include <asp/Core/HoleFilling.h>
+#include <asp/Core/Telemetry.h>
 
 #include <vw/FileIO/DiskImageManager.h>
-#include <vw/Image/InpaintView.h>
 #include <vw/Image/Algorithms2.h>
 #include <vw/Image/Filter.h>
 #include <vw/Cartography/GeoTransform.h>
+#include <vw/Image/BlockRasterize.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/math/special_functions/erf.hpp>
 #include <boost/program_options.hpp>
 #include <boost/filesystem/convenience.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <map>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -55,10 +61,15 @@
 #include <limits>
 #include <algorithm>
 
+#include <gdal.h>
+#include <gdal_priv.h>
+
 using namespace vw; // TODO(oalexan1): Remove this namespace
 using namespace vw::cartography;
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
+namespace bg  = boost::geometry;
+namespace bgi = boost::geometry::index;
 
 // This tool casts all input DEMs to float. The processing is done in double
 // precision though. 
@@ -67,34 +78,27 @@ typedef float RealT;
 // This is used for various tolerances
 double g_tol = 1e-6;
 
-// TODO: Fold modifications into VW!
+// The first and last valid pixel in each row and column of a DEM. The
+// centerline weights are found from these. Rows and columns without
+// valid pixels have the min value past the max value.
+struct CenterlineExtents {
+  std::vector<int>    minValInRow, maxValInRow, minValInCol, maxValInCol;
+  std::vector<double> hCenterLine, hMaxDistArray, vCenterLine, vMaxDistArray;
+};
+
+// Find the centerline extents of an image. If each pixel of the image
+// stands for a block of factor x factor pixels of a larger image of
+// size orig_cols x orig_rows, such as a subsampled DEM, the extents
+// are found for the larger image.
 template<class ImageT>
-void centerline_weights2(ImageT const& img, ImageView<double> & weights,
-                         double hole_fill_value=0, double border_fill_value=-1, 
-                         BBox2i roi=BBox2i()){
+void centerline_extents(ImageT const& img, int factor, int orig_cols, int orig_rows,
+                        CenterlineExtents & ext) {
 
   int numRows = img.rows();
   int numCols = img.cols();
 
-  // Arrays to be returned out of this function
-  std::vector<double> hCenterLine  (numRows, 0);
-  std::vector<double> hMaxDistArray(numRows, 0);
-  std::vector<double> vCenterLine  (numCols, 0);
-  std::vector<double> vMaxDistArray(numCols, 0);
-
-  std::vector<int> minValInRow(numRows, 0);
-  std::vector<int> maxValInRow(numRows, 0);
-  std::vector<int> minValInCol(numCols, 0);
-  std::vector<int> maxValInCol(numCols, 0);
-
-  for (int k = 0; k < numRows; k++){
-    minValInRow[k] = numCols;
-    maxValInRow[k] = 0;
-  }
-  for (int col = 0; col < numCols; col++){
-    minValInCol[col] = numRows;
-    maxValInCol[col] = 0;
-  }
+  std::vector<int> minValInRow(numRows, numCols), maxValInRow(numRows, 0);
+  std::vector<int> minValInCol(numCols, numRows), maxValInCol(numCols, 0);
 
   // Note that we do just a single pass through the image to compute
   // both the horizontal and vertical min/max values.
@@ -112,58 +116,115 @@ void centerline_weights2(ImageT const& img, ImageView<double> & weights,
       if (row > maxValInCol[col]) maxValInCol[col] = row;   
     }
   }
-  
-  // For each row, record central column and the column width
-  for (int row = 0; row < numRows; row++) {
-    hCenterLine   [row] = (minValInRow[row] + maxValInRow[row])/2.0;
-    hMaxDistArray [row] =  maxValInRow[row] - minValInRow[row];
-    if (hMaxDistArray[row] < 0){
-      hMaxDistArray[row]=0;
-    }
+
+  // Go to the pixels of the larger image. A valid block makes all its
+  // pixels valid.
+  ext.minValInRow.assign(orig_rows, orig_cols);
+  ext.maxValInRow.assign(orig_rows, 0);
+  ext.minValInCol.assign(orig_cols, orig_rows);
+  ext.maxValInCol.assign(orig_cols, 0);
+  for (int row = 0; row < orig_rows; row++) {
+    int r = std::min(row/factor, numRows - 1);
+    if (minValInRow[r] > maxValInRow[r]) continue;
+    ext.minValInRow[row] = minValInRow[r] * factor;
+    ext.maxValInRow[row] = std::min(maxValInRow[r] * factor + factor - 1, orig_cols - 1);
+  }
+  for (int col = 0; col < orig_cols; col++) {
+    int c = std::min(col/factor, numCols - 1);
+    if (minValInCol[c] > maxValInCol[c]) continue;
+    ext.minValInCol[col] = minValInCol[c] * factor;
+    ext.maxValInCol[col] = std::min(maxValInCol[c] * factor + factor - 1, orig_rows - 1);
   }
 
   // For each row, record central column and the column width
-  for (int col = 0 ; col < numCols; col++) {
-    vCenterLine   [col] = (minValInCol[col] + maxValInCol[col])/2.0;
-    vMaxDistArray [col] =  maxValInCol[col] - minValInCol[col];
-    if (vMaxDistArray[col] < 0){
-      vMaxDistArray[col]=0;
-    }
+  ext.hCenterLine.resize(orig_rows);
+  ext.hMaxDistArray.resize(orig_rows);
+  for (int row = 0; row < orig_rows; row++) {
+    ext.hCenterLine  [row] = (ext.minValInRow[row] + ext.maxValInRow[row])/2.0;
+    ext.hMaxDistArray[row] = std::max(ext.maxValInRow[row] - ext.minValInRow[row], 0);
   }
 
-  BBox2i output_bbox = roi;
-  if (roi.empty())
-    output_bbox = bounding_box(img);
+  // For each column, record central row and the row width
+  ext.vCenterLine.resize(orig_cols);
+  ext.vMaxDistArray.resize(orig_cols);
+  for (int col = 0 ; col < orig_cols; col++) {
+    ext.vCenterLine  [col] = (ext.minValInCol[col] + ext.maxValInCol[col])/2.0;
+    ext.vMaxDistArray[col] = std::max(ext.maxValInCol[col] - ext.minValInCol[col], 0);
+  }
+}
+
+// Compute the centerline weights of an image from the extents of a
+// larger image containing it, with the image starting at the given
+// offset in the larger image.
+template<class ImageT>
+void centerline_weights2(ImageT const& img, CenterlineExtents const& ext,
+                         vw::Vector2i const& offset, ImageView<double> & weights,
+                         double hole_fill_value=0, double border_fill_value=-1) {
 
-  // Compute the weighting for each pixel in the image
-  weights.set_size(output_bbox.width(), output_bbox.height());
-  fill(weights, 0);
+  weights.set_size(img.cols(), img.rows());
   
-  for (int row = output_bbox.min().y(); row < output_bbox.max().y(); row++){
-    for (int col = output_bbox.min().x(); col < output_bbox.max().x(); col++){
-      bool inner_row = ((row >= minValInCol[col]) && (row <= maxValInCol[col]));
-      bool inner_col = ((col >= minValInRow[row]) && (col <= maxValInRow[row]));
-      bool inner_pixel = inner_row && inner_col;
-      vw::Vector2 pix(col, row);
+  for (int row = 0; row < img.rows(); row++){
+    int orow = row + offset.y();
+    for (int col = 0; col < img.cols(); col++){
+      int ocol = col + offset.x();
       double new_weight = 0; // Invalid pixels usually get zero weight
       if (is_valid(img(col,row))) {
-        double weight_h = compute_line_weights(pix, true,  hCenterLine, hMaxDistArray);
-        double weight_v = compute_line_weights(pix, false, vCenterLine, vMaxDistArray);
+        vw::Vector2 pix(ocol, orow);
+        double weight_h = compute_line_weights(pix, true,  ext.hCenterLine, ext.hMaxDistArray);
+        double weight_v = compute_line_weights(pix, false, ext.vCenterLine, ext.vMaxDistArray);
         new_weight = weight_h*weight_v;
       }
       else { // Invalid pixel
-        if (inner_pixel)
+        bool inner_row = ((orow >= ext.minValInCol[ocol]) && (orow <= ext.maxValInCol[ocol]));
+        bool inner_col = ((ocol >= ext.minValInRow[orow]) && (ocol <= ext.maxValInRow[orow]));
+        if (inner_row && inner_col)
           new_weight = hole_fill_value;
         else // Border pixel
           new_weight = border_fill_value;
       }
-      weights(col-output_bbox.min().x(), row-output_bbox.min().y()) = new_weight;
-      
+      weights(col, row) = new_weight;
     }
   }
 
 } // End function centerline_weights2
 
+// The centerline extents of each input DEM, found once from a
+// subsampled copy of the whole DEM and shared by all tiles. That is
+// faster than finding them for each tile, and the weights do not change
+// from tile to tile.
+class CenterlineCache {
+  vw::Mutex m_mutex;
+  std::map<int, boost::shared_ptr<CenterlineExtents>> m_extents;
+public:
+
+  // The subsampled DEM has at most this many pixels on a side
+  static const int MAX_SIZE = 2048;
+  
+  // Pixels no more than nodata_value are invalid, as in the tiles
+  boost::shared_ptr<CenterlineExtents> get(int dem_index, std::string const& dem_file,
+                                           double nodata_value) {
+    {
+      vw::Mutex::Lock lock(m_mutex);
+      auto it = m_extents.find(dem_index);
+      if (it != m_extents.end())
+        return it->second;
+    }
+
+    // Compute without holding the lock. If two threads get here for the
+    // same DEM, they will get the same result.
+    DiskImageView<RealT> dem(dem_file);
+    int factor = std::max(1, int(ceil(double(std::max(dem.cols(), dem.rows())) / MAX_SIZE)));
+    ImageView<RealT> small_dem = subsample(dem, factor);
+    boost::shared_ptr<CenterlineExtents> ext(new CenterlineExtents);
+    centerline_extents(create_mask_less_or_equal(small_dem, nodata_value),
+                       factor, dem.cols(), dem.rows(), *ext);
+    
+    vw::Mutex::Lock lock(m_mutex);
+    m_extents[dem_index] = ext;
+    return ext;
+  }
+};
+
 // An S-shaped function. Value at 0 is 0. Value at M is M.
 // Flat before 0 and after M. Higher value of L means
 // more flatness at the ends, but higher growth
@@ -315,25 +376,27 @@ std::string processed_proj4(std::string const& srs){
 
 struct Options: vw::GdalWriteOptions {
   std::string dem_list_file, out_prefix, target_srs_string,
-    output_type, tile_list_str, this_dem_as_reference;
+    output_type, tile_list_str, this_dem_as_reference, footprint_index,
+    tile_dem_counts, update_mosaic;
   std::vector<std::string> dem_files;
   double tr, geo_tile_size;
   bool   has_out_nodata, force_projwin;
   double out_nodata_value;
   int    tile_size, tile_index, erode_len, priority_blending_len,
          extra_crop_len, hole_fill_len, block_size, save_dem_weight,
-         fill_num_passes;
+         fill_num_passes, max_dems_per_pixel;
   double weights_exp, weights_blur_sigma, dem_blur_sigma;
   double nodata_threshold, fill_search_radius, fill_power, fill_percent;
   bool   first, last, min, max, block_max, mean, stddev, median, nmad,
     count, tap, save_index_map, use_centerline_weights,
-         first_dem_as_reference, propagate_nodata, no_border_blend;
+         first_dem_as_reference, propagate_nodata, no_border_blend, cog;
   std::set<int> tile_list;
   BBox2 projwin;
   Options(): tr(0), geo_tile_size(0), has_out_nodata(false), force_projwin(false), 
              tile_index(-1), erode_len(0), priority_blending_len(0), extra_crop_len(0),
              hole_fill_len(0), block_size(0), save_dem_weight(-1), 
              fill_search_radius(0), fill_power(0), fill_percent(0), fill_num_passes(0),
+             max_dems_per_pixel(0),
              weights_exp(0), weights_blur_sigma(0.0), dem_blur_sigma(0.0),
              nodata_threshold(std::numeric_limits<double>::quiet_NaN()),
              first(false), last(false), min(false), max(false), block_max(false),
@@ -367,6 +430,86 @@ std::string tile_suffix(Options const& opt){
   return ans;
 }
 
+/// The region of the mosaic being updated which the last input DEM,
+/// with the given box in projected coordinates, can affect. It is grown
+/// to whole blocks of the mosaic file, so that only these are rewritten.
+BBox2i mosaic_update_box(Options const& opt, GeoReference const& mosaic_georef,
+                         BBox2 const& new_dem_proj_box, int bias, int cols, int rows) {
+
+  BBox2i update_box;
+  if (new_dem_proj_box.min().x() > new_dem_proj_box.max().x() ||
+      new_dem_proj_box.min().y() > new_dem_proj_box.max().y())
+    return update_box;
+
+  BBox2 pix_box = custom_point_to_pixel_bbox(mosaic_georef, new_dem_proj_box);
+  update_box = BBox2i(Vector2i(floor(pix_box.min().x()), floor(pix_box.min().y())),
+                      Vector2i(ceil(pix_box.max().x()),  ceil(pix_box.max().y())));
+
+  // The weights of the new DEM reach this far beyond it
+  update_box.expand(bias + opt.priority_blending_len);
+
+  DiskImageResourceGDAL rsrc(opt.update_mosaic);
+  Vector2i block = rsrc.block_read_size();
+  update_box.min() = elem_prod(block, floor(elem_quot(Vector2(update_box.min()), Vector2(block))));
+  update_box.max() = elem_prod(block, ceil (elem_quot(Vector2(update_box.max()), Vector2(block))));
+  update_box.crop(BBox2i(0, 0, cols, rows));
+  
+  return update_box;
+}
+
+/// Overwrite a region of an existing single-band image with the given
+/// image, without rewriting the rest of the file. The region is done in
+/// strips, each computed with multiple threads. GDAL converts the
+/// values to the type of the file.
+void write_in_place(std::string const& file, ImageViewRef<RealT> const& img,
+                    BBox2i const& box, int block_size, int num_threads) {
+
+  GDALDataset * dataset = (GDALDataset*)GDALOpen(file.c_str(), GA_Update);
+  if (dataset == NULL)
+    vw_throw(ArgumentErr() << "Cannot open for updating: " << file << ".\n");
+  if (dataset->GetRasterCount() != 1) {
+    GDALClose(dataset);
+    vw_throw(ArgumentErr() << "Expecting a single-band image: " << file << ".\n");
+  }
+  GDALRasterBand * band = dataset->GetRasterBand(1);
+  if (band->GetOverviewCount() > 0)
+    vw_out(WarningMessage) << "The overviews of " << file << " are not updated. "
+                           << "Run gdaladdo to recreate them.\n";
+  
+  TerminalProgressCallback tpc("asp", "\t--> ");
+  for (int row = 0; row < box.height(); row += block_size) {
+    tpc.report_fractional_progress(row, box.height());
+    BBox2i strip(0, row, box.width(), std::min(block_size, box.height() - row));
+    ImageView<RealT> data = block_rasterize(crop(img, strip),
+                                            Vector2i(block_size, block_size), num_threads);
+    CPLErr err = band->RasterIO(GF_Write, box.min().x(), box.min().y() + row,
+                                data.cols(), data.rows(), data.data(),
+                                data.cols(), data.rows(), GDT_Float32, 0, 0);
+    if (err != CE_None) {
+      GDALClose(dataset);
+      vw_throw(IOErr() << "Failed to write to: " << file << ".\n");
+    }
+  }
+  tpc.report_finished();
+  
+  GDALClose(dataset);
+}
+
+/// Save a tile of the mosaic, computed in blocks of size block_size.
+/// With --cog, write these blocks only once, and add overviews.
+template <class ImageT>
+void save_mosaic_tile(Options & opt, int block_size, std::string const& file,
+                      ImageViewBase<ImageT> const& img, GeoReference const& georef,
+                      double nodata, TerminalProgressCallback const& tpc) {
+  bool has_georef = true, has_nodata = true;
+  if (opt.cog)
+    asp::save_in_big_tiles(block_size, file, img, has_georef, georef,
+                           has_nodata, nodata, opt, tpc, opt.cog);
+  else
+    asp::save_with_temp_big_blocks(block_size, file, img, has_georef, georef,
+                                   has_nodata, nodata, opt, tpc);
+}
+
 /// Class that does the actual image processing work
 class DemMosaicView: public ImageViewBase<DemMosaicView>{
   int m_cols, m_rows, m_bias;
@@ -378,6 +521,7 @@ class DemMosaicView: public ImageViewBase<DemMosaicView>{
   std::vector<vw::BBox2i>          const& m_dem_pixel_bboxes; // alias
   long long int                  & m_num_valid_pixels; // alias, to populate on output
   vw::Mutex                      & m_count_mutex;      // alias, a lock for m_num_valid_pixels
+  CenterlineCache                & m_centerline_cache; // alias, shared by all tiles
 
 public:
   DemMosaicView(int cols, int rows, int bias,
@@ -388,12 +532,13 @@ public:
                 std::vector<double>       const& nodata_values,
                 std::vector<BBox2i>       const& dem_pixel_bboxes,
                 long long int                  & num_valid_pixels,
-                vw::Mutex                      & count_mutex):
+                vw::Mutex                      & count_mutex,
+                CenterlineCache                & centerline_cache):
     m_cols(cols), m_rows(rows), m_bias(bias), m_opt(opt),
     m_imgMgr(imgMgr), m_georefs(georefs),
     m_out_georef(out_georef), m_nodata_values(nodata_values),
     m_dem_pixel_bboxes(dem_pixel_bboxes), m_num_valid_pixels(num_valid_pixels),
-    m_count_mutex(count_mutex) {
+    m_count_mutex(count_mutex), m_centerline_cache(centerline_cache) {
 
     // How many valid pixels we will have
     m_num_valid_pixels = 0;
@@ -473,9 +618,25 @@ public:
     // A vector of images the size of the output tile.
     // - Used for median, nmad, and stddev calculation.
     std::vector<ImageView<double>> tile_vec, weight_vec;
-    std::vector<std::string> dem_vec;
-    if (m_opt.median || m_opt.nmad) // Store each input separately
+    const bool sample_vals = ((m_opt.median || m_opt.nmad) && m_opt.max_dems_per_pixel > 0);
+    if ((m_opt.median || m_opt.nmad) && !sample_vals) // Store each input separately
       tile_vec.reserve(m_imgMgr.size());
+
+    // When sampling the values for the median and nmad, tile_vec[k](c, r)
+    // is the k-th value kept at pixel (c, r), and it came from the DEM
+    // with index sample_dems[k](c, r). There are at most
+    // max_dems_per_pixel of these images, however many DEMs there are.
+    std::vector<ImageView<int>> sample_dems;
+    ImageView<int> num_vals; // number of values seen at each pixel
+    vw::uint64 rand_state = 0x853c49e6748fea9bULL; // for reproducible sampling
+    if (sample_vals) {
+      num_vals.set_size(bbox.width(), bbox.height());
+      fill(num_vals, 0);
+    }
+
+    // For max per block, only the tile with the largest sum so far is kept
+    ImageView<double> block_max_tile;
+    double block_max_sum = -std::numeric_limits<double>::max();
     if (m_opt.stddev) { // Need one working image
       tile_vec.push_back(ImageView<double>(bbox.width(), bbox.height()));
       // Each pixel starts at zero, nodata is handled later
@@ -596,14 +757,8 @@ public:
         }
       }
 
-      // Fill holes. This happens here, in the expanded tile, to
-      // ensure we catch holes which are partially outside the tile
-      // being processed.
-      if (m_opt.hole_fill_len > 0)
-        dem = apply_mask(vw::fill_holes_grass
-                         (create_mask(select_channel(dem, 0), nodata_value),
-                          m_opt.hole_fill_len),
-                         nodata_value);
+      // Holes are filled later, in the whole output tile
+      // (asp/Core/HoleFilling.h), so they need not fit in the expanded tile.
 
       // Fill nodata based on radius. There is a sanity check that ensures we don't
       // do both this and the hole filling above.
@@ -652,10 +807,12 @@ public:
             }
           }
         }
-        // TODO: Generalize this modification and move it to VW!!!
+        // The extents of the whole DEM are found once and shared by all tiles
+        boost::shared_ptr<CenterlineExtents> ext
+          = m_centerline_cache.get(dem_iter, dem_name, nodata_value);
         centerline_weights2
                 (create_mask_less_or_equal(select_channel(dem2, 0), nodata_value),
-                 local_wts, -1.0);
+                 *ext, Vector2i(in_box.min().x(), in_box.min().y()), local_wts, -1.0);
       } // End centerline weights case
 
       // If we don't limit the weights from above, we will have tiling artifacts,
@@ -867,12 +1024,58 @@ public:
         } // End col loop
       } // End row loop
 
-      // For the median option, keep a copy of the output tile for each input DEM!
-      // Also do it for max per block.
+      // For the median option, keep a copy of the output tile for each
+      // input DEM, unless the values are sampled.
       // - This will be memory intensive. 
-      if (m_opt.median || m_opt.nmad || m_opt.block_max) {
+      if ((m_opt.median || m_opt.nmad) && !sample_vals)
         tile_vec.push_back(copy(tile));
-        dem_vec.push_back(dem_name);
+
+      // Keep each value seen so far at a pixel with equal probability
+      // (reservoir sampling), as done in point2dem.
+      if (sample_vals) {
+        for (int c = 0; c < bbox.width(); c++) {
+          for (int r = 0; r < bbox.height(); r++) {
+            if (tile(c, r) == m_opt.out_nodata_value)
+              continue;
+            int pos = num_vals(c, r);
+            num_vals(c, r)++;
+            if (pos >= m_opt.max_dems_per_pixel) {
+              // Use an xorshift generator, as this is called very many times
+              rand_state ^= rand_state << 13;
+              rand_state ^= rand_state >> 7;
+              rand_state ^= rand_state << 17;
+              pos = int(rand_state % vw::uint64(num_vals(c, r)));
+              if (pos >= m_opt.max_dems_per_pixel)
+                continue;
+            }
+            if (pos >= (int)tile_vec.size()) {
+              tile_vec.push_back(ImageView<double>(bbox.width(), bbox.height()));
+              sample_dems.push_back(ImageView<int>(bbox.width(), bbox.height()));
+            }
+            tile_vec[pos](c, r)    = tile(c, r);
+            sample_dems[pos](c, r) = dem_iter;
+          }
+        }
+      }
+
+      // For max per block, find the sum of values in each DEM
+      if (m_opt.block_max) {
+        double tile_sum = 0;
+        for (int c = 0; c < tile.cols(); c++) {
+          for (int r = 0; r < tile.rows(); r++) {
+            if (tile(c, r) != m_opt.out_nodata_value)
+              tile_sum += tile(c, r);
+          }
+        }
+        // The whole purpose of --block-max is to print the sum of
+        // pixels for each mapprojected image/DEM when doing SfS.
+        // The documentation has a longer explanation.
+        vw_out() << "\n" << bbox << " " << dem_name
+                 << " pixel sum: " << tile_sum << std::endl;
+        if (tile_sum > block_max_sum) {
+          block_max_sum  = tile_sum;
+          block_max_tile = copy(tile);
+        }
       }
       
       // For priority blending, need also to keep all tiles, but also the weights
@@ -886,6 +1089,20 @@ public:
       
     } // End iterating over DEMs
 
+    // The values kept for all DEMs, which is what uses the most memory,
+    // for memory profiling. Given back when this tile is done.
+    asp::TelemetryGaugeScope stack_memory(asp::telemetry().gauge("dem_mosaic.tile_stack"));
+    {
+      std::int64_t bytes = 0;
+      for (size_t it = 0; it < tile_vec.size(); it++)
+        bytes += std::int64_t(tile_vec[it].cols()) * tile_vec[it].rows() * sizeof(double);
+      for (size_t it = 0; it < weight_vec.size(); it++)
+        bytes += std::int64_t(weight_vec[it].cols()) * weight_vec[it].rows() * sizeof(double);
+      for (size_t it = 0; it < sample_dems.size(); it++)
+        bytes += std::int64_t(sample_dems[it].cols()) * sample_dems[it].rows() * sizeof(int);
+      stack_memory.set(bytes);
+    }
+
     // Divide by the weights in blend, mean
     if (!noblend || m_opt.mean){
       for (int c = 0; c < bbox.width(); c++){ // Iterate over all pixels!
@@ -919,26 +1136,40 @@ public:
     if (m_opt.median || m_opt.nmad){
       // Init output pixels to nodata
       fill(tile, m_opt.out_nodata_value);
-      std::vector<double> vals, vals_all(tile_vec.size());
+      std::vector<double> vals, vals_copy;
+      std::vector<int> val_dems; // the DEM index for each value
       // Iterate through all pixels
       for (int c = 0; c < bbox.width(); c++){
         for (int r = 0; r < bbox.height(); r++){
           // Compute the median for this pixel
           vals.clear();
-          for (int i = 0; i < (int)tile_vec.size(); i++){
-            ImageView<double> & tile_ref = tile_vec[i];
-            double this_val = tile_ref(c, r);
-            vals_all[i] = this_val; // Record the original order.
-            if (this_val == m_opt.out_nodata_value)
-              continue;
-            vals.push_back(this_val);
+          val_dems.clear();
+          if (sample_vals) {
+            int num = std::min(num_vals(c, r), int(tile_vec.size()));
+            for (int i = 0; i < num; i++) {
+              vals.push_back(tile_vec[i](c, r));
+              val_dems.push_back(sample_dems[i](c, r));
+            }
+          } else {
+            for (int i = 0; i < (int)tile_vec.size(); i++){
+              double this_val = tile_vec[i](c, r);
+              if (this_val == m_opt.out_nodata_value)
+                continue;
+              vals.push_back(this_val);
+              // Here we save the index not in the current array, but
+              // in the full list of DEMs, some of which are likely
+              // skipped in this tile as they don't intersect it.
+              if (m_opt.save_index_map)
+                val_dems.push_back(clip2dem_index[i]);
+            }
           }
           if (vals.empty())
             continue;
+          vals_copy = vals;
           if (m_opt.median)
-            tile(c, r) = math::destructive_median(vals);
+            tile(c, r) = math::destructive_median(vals_copy);
           else
-            tile(c, r) = math::destructive_nmad(vals);
+            tile(c, r) = math::destructive_nmad(vals_copy);
 
           if (!m_opt.save_index_map)
             continue;
@@ -947,14 +1178,10 @@ public:
           // values, so the median value may not equal exactly any of
           // the input values.
           double min_dist = std::numeric_limits<double>::max();
-          for (size_t m = 0; m < vals_all.size(); m++) {
-            double dist = fabs(vals_all[m] - tile(c, r));
+          for (size_t m = 0; m < vals.size(); m++) {
+            double dist = fabs(vals[m] - tile(c, r));
             if (dist < min_dist) {
-	      // Here we save the index not in the current array which
-	      // is m, but in the full list of DEMs, some of which are
-	      // likely skipped in this tile as they don't intersect
-	      // it.
-              index_map(c, r) = clip2dem_index[m];
+              index_map(c, r) = val_dems[m];
               min_dist = dist;
             }
           }
@@ -963,31 +1190,12 @@ public:
       } // End col loop
     } // End median/nmad case
 
-    // For max per block, find the sum of values in each DEM
+    // For max per block, use the DEM with the largest sum of values
     if (m_opt.block_max) {
-      fill(tile, m_opt.out_nodata_value);
-      int num_tiles = tile_vec.size();
-      if (tile_vec.size() != dem_vec.size()) 
-        vw_throw(ArgumentErr() << "Book-keeping error.\n");
-      std::vector<double> tile_sum(num_tiles, 0);
-      for (int i = 0; i < num_tiles; i++) {
-        for (int c = 0; c < tile_vec[i].cols(); c++) {
-          for (int r = 0; r < tile_vec[i].rows(); r++) {
-            if (tile_vec[i](c, r) != m_opt.out_nodata_value) {
-              tile_sum[i] += tile_vec[i](c, r);
-            }
-          }
-        }
-        // The whole purpose of --block-max is to print the sum of
-        // pixels for each mapprojected image/DEM when doing SfS.
-        // The documentation has a longer explanation.
-        vw_out() << "\n" << bbox << " " << dem_vec[i]
-                 << " pixel sum: " << tile_sum[i] << std::endl;
-      }
-      int max_index = std::distance(tile_sum.begin(),
-                                    std::max_element(tile_sum.begin(), tile_sum.end()));
-      if (max_index >= 0 && max_index < num_tiles) 
-        tile = copy(tile_vec[max_index]);
+      if (block_max_tile.cols() == tile.cols() && block_max_tile.rows() == tile.rows())
+        tile = block_max_tile;
+      else
+        fill(tile, m_opt.out_nodata_value);
     }
 
     // For priority blending length.
@@ -1161,6 +1369,96 @@ public:
 }; // End class DemMosaicView
 
 
+// The footprints of the input DEMs depend on the output grid, so
+// they are cached together with a string describing that grid.
+std::string mosaic_georef_key(GeoReference const& georef) {
+  std::ostringstream os;
+  os << std::setprecision(17) << georef.overall_proj4_str();
+  Matrix3x3 T = georef.transform();
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 3; c++)
+      os << " " << T(r, c);
+  os << " " << int(georef.pixel_interpretation());
+  return os.str();
+}
+
+/// Read the DEM footprints saved by an earlier invocation. Return false if
+/// the file does not exist, or it was made for a different output grid or
+/// list of DEMs, or any DEM changed since then.
+bool read_footprint_index(Options             const& opt,
+                          GeoReference        const& mosaic_georef,
+                          BBox2                    & mosaic_bbox,
+                          BBox2                    & first_dem_proj_box,
+                          std::vector<BBox2>       & dem_proj_bboxes,
+                          std::vector<BBox2i>      & dem_pixel_bboxes) {
+
+  if (!fs::exists(opt.footprint_index))
+    return false;
+
+  std::ifstream ifs(opt.footprint_index.c_str());
+  std::string line, key;
+  std::getline(ifs, line); // comment
+  std::getline(ifs, key);
+  if (key != mosaic_georef_key(mosaic_georef))
+    return false;
+
+  std::vector<double> v(4);
+  if (!(ifs >> v[0] >> v[1] >> v[2] >> v[3]))
+    return false;
+  first_dem_proj_box = BBox2(Vector2(v[0], v[1]), Vector2(v[2], v[3]));
+
+  size_t num_dems = 0;
+  if (!(ifs >> num_dems) || num_dems != opt.dem_files.size())
+    return false;
+
+  mosaic_bbox = BBox2();
+  dem_proj_bboxes.resize(num_dems);
+  dem_pixel_bboxes.resize(num_dems);
+  for (size_t dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    std::time_t mtime = 0;
+    int cols = 0, rows = 0;
+    std::string file;
+    if (!(ifs >> mtime >> cols >> rows >> v[0] >> v[1] >> v[2] >> v[3] >> file))
+      return false;
+    if (file != opt.dem_files[dem_iter] || !fs::exists(file) ||
+        fs::last_write_time(file) != mtime)
+      return false;
+    dem_pixel_bboxes[dem_iter] = BBox2i(0, 0, cols, rows);
+    dem_proj_bboxes[dem_iter]  = BBox2(Vector2(v[0], v[1]), Vector2(v[2], v[3]));
+    mosaic_bbox.grow(dem_proj_bboxes[dem_iter]);
+  }
+
+  return true;
+}
+
+/// Save the DEM footprints, to be reused when mosaicking other tiles
+void write_footprint_index(Options             const& opt,
+                           GeoReference        const& mosaic_georef,
+                           BBox2               const& first_dem_proj_box,
+                           std::vector<BBox2>  const& dem_proj_bboxes,
+                           std::vector<BBox2i> const& dem_pixel_bboxes) {
+
+  vw_out() << "Writing: " << opt.footprint_index << "\n";
+  std::ofstream ofs(opt.footprint_index.c_str());
+  ofs << std::setprecision(17);
+  ofs << "# dem_mosaic footprint index: output grid, first DEM box, number of DEMs, "
+      << "then for each DEM its time stamp, size, box in the output projection, "
+      << "and file name\n";
+  ofs << mosaic_georef_key(mosaic_georef) << "\n";
+  ofs << first_dem_proj_box.min().x() << " " << first_dem_proj_box.min().y() << " "
+      << first_dem_proj_box.max().x() << " " << first_dem_proj_box.max().y() << "\n";
+  ofs << opt.dem_files.size() << "\n";
+  for (size_t dem_iter = 0; dem_iter < opt.dem_files.size(); dem_iter++) {
+    BBox2 const& b = dem_proj_bboxes[dem_iter];
+    ofs << fs::last_write_time(opt.dem_files[dem_iter]) << " "
+        << dem_pixel_bboxes[dem_iter].width() << " " << dem_pixel_bboxes[dem_iter].height()
+        << " " << b.min().x() << " " << b.min().y() << " " << b.max().x() << " "
+        << b.max().y() << " " << opt.dem_files[dem_iter] << "\n";
+  }
+  if (!ofs)
+    vw_out(WarningMessage) << "Failed writing: " << opt.footprint_index << "\n";
+}
+
 /// Find the bounding box of all DEMs in the projected space.
 /// - mosaic_bbox is the output bounding box in projected space
 /// - dem_proj_bboxes and dem_pixel_bboxes are the locations of
@@ -1171,6 +1469,17 @@ void load_dem_bounding_boxes(Options       const& opt,
                              std::vector<BBox2> & dem_proj_bboxes,
                              std::vector<BBox2i> & dem_pixel_bboxes) {
 
+  BBox2 first_dem_proj_box;
+  if (opt.footprint_index != "" &&
+      read_footprint_index(opt, mosaic_georef, mosaic_bbox, first_dem_proj_box,
+                           dem_proj_bboxes, dem_pixel_bboxes)) {
+    vw_out() << "Read the bounding boxes of the input DEMs from: "
+             << opt.footprint_index << "\n";
+    if (opt.first_dem_as_reference)
+      mosaic_bbox = first_dem_proj_box;
+    return;
+  }
+
   vw_out() << "Determining the bounding boxes of the input DEMs.\n";
 
   // Initialize the outputs
@@ -1182,7 +1491,6 @@ void load_dem_bounding_boxes(Options       const& opt,
   tpc.report_progress(0);
   double inc_amount = 1.0 / double(opt.dem_files.size());
 
-  BBox2 first_dem_proj_box;
   
   // Loop through all DEMs
   for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++){ 
@@ -1248,6 +1556,10 @@ void load_dem_bounding_boxes(Options       const& opt,
   } // End loop through DEM files
   tpc.report_finished();
 
+  if (opt.footprint_index != "")
+    write_footprint_index(opt, mosaic_georef, first_dem_proj_box,
+                          dem_proj_bboxes, dem_pixel_bboxes);
+
   // If the first dem is used as reference, no matter what use its own box
   if (opt.first_dem_as_reference) 
     mosaic_bbox = first_dem_proj_box;
@@ -1268,6 +1580,14 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "The index of the tile to save (starting from zero). When this program is invoked, it will print out how many tiles are there. Default: save all tiles.")
     ("tile-list",      po::value(&opt.tile_list_str)->default_value(""),
      "List of tile indices (in quotes) to save. A tile index starts from 0.")
+    ("footprint-index", po::value(&opt.footprint_index)->default_value(""),
+     "Save the bounding boxes of the input DEMs in the output projection to this file, and read them from it on later invocations with the same input DEMs and output grid, such as when creating other tiles with --tile-index. This avoids opening all input DEMs each time.")
+    ("tile-dem-counts", po::value(&opt.tile_dem_counts)->default_value(""),
+     "Write to this file the index of each output tile and the number of input DEMs overlapping it, then quit. Used by parallel_dem_mosaic.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Add internal overviews to the output mosaic, computed while it is written, so that it can be viewed efficiently over the network.")
+    ("update-mosaic", po::value(&opt.update_mosaic)->default_value(""),
+     "Update in place this mosaic, which was created with the same options from all input DEMs except the last one. Only the blocks of the mosaic which the last input DEM can affect are recomputed. The output prefix need not be set.")
     ("priority-blending-length", po::value<int>(&opt.priority_blending_len)->default_value(0),
 	   "If positive, keep unmodified values from the earliest available DEM except a band this wide measured in pixels inward of its boundary where blending with subsequent DEMs will happen.")
     ("no-border-blend", po::bool_switch(&opt.no_border_blend)->default_value(false),
@@ -1305,7 +1625,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("count",   po::bool_switch(&opt.count)->default_value(false),
      "Each pixel is set to the number of valid DEM heights at that pixel.")
     ("hole-fill-length",   po::value(&opt.hole_fill_len)->default_value(0),
-	   "Maximum dimensions of a hole in the DEM to fill, in pixels. See also --fill-search-radius.")
+	   "Maximum dimensions of a hole in the DEM to fill, in pixels. The holes are found in the whole output DEM, and are filled with an inverse-distance average of the nearest valid heights around them. See also --fill-search-radius.")
      ("fill-search-radius",   po::value(&opt.fill_search_radius)->default_value(0.0),
       "Fill an invalid pixel with a weighted average of pixel values within this radius in pixels. The weight is 1/(factor * dist^power + 1), where the distance is measured in pixels. See an example in the doc. See also --fill-power, --fill-percent and --fill-num-passes.")
       ("fill-power", po::value(&opt.fill_power)->default_value(8.0),
@@ -1316,6 +1636,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
       "Fill invalid values using --fill-search-radius this many times.")
     ("erode-length",    po::value<int>(&opt.erode_len)->default_value(0),
 	   "Erode the DEM by this many pixels at boundary.")
+    ("max-dems-per-pixel", po::value(&opt.max_dems_per_pixel)->default_value(0),
+     "For --median and --nmad, use for each output pixel at most this many of the DEM values, chosen at random, to bound the memory usage when very many DEMs overlap. The default is to use all values.")
     ("block-max", po::bool_switch(&opt.block_max)->default_value(false),
      "For each block of size --block-size, keep the DEM with the largest sum of values in the block.")
     ("georef-tile-size",    po::value<double>(&opt.geo_tile_size),
@@ -1366,12 +1688,33 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
                              allow_unregistered, unregistered);
 
   // Error checking
+  if (opt.update_mosaic != "") {
+    if (opt.out_prefix == "")
+      opt.out_prefix = opt.update_mosaic;
+    if (opt.out_prefix != opt.update_mosaic)
+      vw_throw(ArgumentErr() << "When updating a mosaic, the output prefix, if set, "
+               << "must be the mosaic.\n" << usage << general_options);
+    if (opt.tr > 0 || opt.target_srs_string != "" || opt.projwin != BBox2() || opt.tap ||
+        opt.tile_index >= 0 || opt.tile_list_str != "" || opt.tile_dem_counts != "")
+      vw_throw(ArgumentErr() << "When updating a mosaic, its grid is used, so the options "
+               << "--tr, --t_srs, --t_projwin, --tap, --tile-index, --tile-list, "
+               << "and --tile-dem-counts cannot be set.\n" << usage << general_options);
+    if (opt.cog)
+      vw_throw(ArgumentErr() << "The option --cog cannot be used when updating a mosaic.\n"
+               << usage << general_options);
+    if (opt.hole_fill_len > 0)
+      vw_throw(ArgumentErr() << "The option --hole-fill-length cannot be used when "
+               << "updating a mosaic.\n" << usage << general_options);
+  }
   if (opt.out_prefix == "")
     vw_throw(ArgumentErr() << "No output prefix was specified.\n"
                            << usage << general_options);
   if (opt.num_threads == 0)
     vw_throw(ArgumentErr() << "The number of threads must be set and positive.\n"
                            << usage << general_options);
+  if (opt.max_dems_per_pixel < 0)
+    vw_throw(ArgumentErr() << "The value of --max-dems-per-pixel must be non-negative.\n"
+                           << usage << general_options);
   if (opt.erode_len < 0)
     vw_throw(ArgumentErr() << "The erode length must not be negative.\n"
                            << usage << general_options);
@@ -1529,7 +1872,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
        << usage << general_options);
 
   // Create the output directory
-  vw::create_out_dir(opt.out_prefix);
+  asp::create_out_dir(opt.out_prefix);
 
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
@@ -1570,7 +1913,11 @@ int main(int argc, char *argv[]) {
     
     // Read nodata from first DEM, unless the user chooses to specify it.
     if (!opt.has_out_nodata){
-      DiskImageResourceGDAL in_rsrc(opt.dem_files[0]);
+      // When updating a mosaic, keep its no-data value
+      std::string nodata_file = opt.dem_files[0];
+      if (opt.update_mosaic != "")
+        nodata_file = opt.update_mosaic;
+      DiskImageResourceGDAL in_rsrc(nodata_file);
       // Since the DEMs have float pixels, we must read the no-data as
       // float as well. (this is a bug fix). Yet we store it in a
       // double, as we will cast the DEM pixels to double as well.
@@ -1593,8 +1940,11 @@ int main(int argc, char *argv[]) {
     if (opt.target_srs_string != "")
       opt.target_srs_string = processed_proj4(opt.target_srs_string);
 
-    // By default the output georef is equal to the first input georef
+    // By default the output georef is equal to the first input georef.
+    // When updating a mosaic, that mosaic's georef is used.
     GeoReference mosaic_georef = read_georef(opt.dem_files[0]);
+    if (opt.update_mosaic != "")
+      mosaic_georef = read_georef(opt.update_mosaic);
 
     if (opt.first_dem_as_reference) {
       if (opt.target_srs_string != "" || opt.tr > 0 || opt.projwin != BBox2()) 
@@ -1714,6 +2064,13 @@ int main(int argc, char *argv[]) {
     vw::Vector2 end_pix = pixel_box.max();
     int cols = (int)round(end_pix[0]); // end_pix is the last pix in the image
     int rows = (int)round(end_pix[1]);
+    if (opt.update_mosaic != "") {
+      // Keep the grid of the mosaic being updated
+      mosaic_georef = read_georef(opt.update_mosaic);
+      DiskImageView<RealT> mosaic(opt.update_mosaic);
+      cols = mosaic.cols();
+      rows = mosaic.rows();
+    }
 
     // Form the mosaic and write it to disk
     vw_out()<< "The size of the mosaic is " << cols << " x " << rows << " pixels.\n";
@@ -1721,8 +2078,8 @@ int main(int argc, char *argv[]) {
 
     // This bias is very important. This is how much we should read from
     // the images beyond the current boundary to avoid tiling artifacts.
-    // The +1 is to ensure extra pixels beyond the hole fill length.
-    int bias = opt.erode_len + opt.extra_crop_len + opt.hole_fill_len
+    // The +1 is to ensure extra pixels beyond the fill search radius.
+    int bias = opt.erode_len + opt.extra_crop_len
       + opt.fill_search_radius
       + 2*std::max(vw::compute_kernel_size(opt.weights_blur_sigma),
                    vw::compute_kernel_size(opt.dem_blur_sigma))
@@ -1754,7 +2111,7 @@ int main(int argc, char *argv[]) {
       return 0;
     }
 
-    if (num_tiles > 1 && write_to_precise_file) 
+    if (num_tiles > 1 && write_to_precise_file && opt.update_mosaic == "") 
       vw_throw(ArgumentErr() << "Cannot fit all mosaic in the given output file name. "
 	       << "Hence specify an output prefix instead, and then multiple "
 	       << "tiles will be created.\n");
@@ -1786,6 +2143,23 @@ int main(int argc, char *argv[]) {
       tile_pixel_bboxes.push_back(tile_box);
     }
 
+    if (opt.update_mosaic != "") {
+      // Recompute, as a single tile, only the blocks of the mosaic
+      // which the last DEM can affect.
+      BBox2i update_box = mosaic_update_box(opt, mosaic_georef, dem_proj_bboxes.back(),
+                                            bias, cols, rows);
+      if (update_box.empty()) {
+        vw_out() << "The last input DEM does not overlap the mosaic. Nothing to update.\n";
+        return 0;
+      }
+      vw_out() << "Updating the region " << update_box << " of: "
+               << opt.update_mosaic << std::endl;
+      start_tile = 0;
+      end_tile   = 1;
+      tile_pixel_bboxes.clear();
+      tile_pixel_bboxes.push_back(update_box);
+    }
+
     // Store the no-data values, pointers to images, and georeferences (for speed).
     vw_out() << "Reading the input DEMs.\n";
     std::vector<double>       nodata_values;
@@ -1795,29 +2169,63 @@ int main(int argc, char *argv[]) {
 
     BBox2i output_dem_box = BBox2i(0, 0, cols, rows); // output DEM box
     
-    // Loop through all DEMs
+    // Find the DEMs intersecting the tiles to save with an R-tree of the
+    // DEM boxes (in output projected coords), rather than checking each
+    // DEM against each tile.
+    typedef bg::model::point<double, 2, bg::cs::cartesian> IndexPoint;
+    typedef bg::model::box<IndexPoint>                     IndexBox;
+    typedef std::pair<IndexBox, int>                       IndexValue;
+    std::vector<IndexValue> index_values;
     for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++){
+      BBox2 const& b = dem_proj_bboxes[dem_iter];
+      if (b.min().x() > b.max().x() || b.min().y() > b.max().y())
+        continue; // may happen after cropping to --t_projwin
+      index_values.push_back(IndexValue(IndexBox(IndexPoint(b.min().x(), b.min().y()),
+                                                 IndexPoint(b.max().x(), b.max().y())),
+                                        dem_iter));
+    }
+    bgi::rtree<IndexValue, bgi::rstar<16>> dem_index(index_values.begin(),
+                                                     index_values.end());
+    std::vector<bool> use_dem(opt.dem_files.size(), false);
+    std::map<int, int> tile_dem_counts;
+    for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
 
-      // Get the DEM bounding box that we previously computed (output projected coords)
-      BBox2 dem_bbox = dem_proj_bboxes[dem_iter];
-
-      // Go through each of the tile bounding boxes and see they intersect this DEM
-      bool use_this_dem = false;
-      for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
-
-        if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
-          continue;
+      if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
+        continue;
         
-        // Get tile bbox in pixels, then convert it to projected coords.
-        BBox2i tile_pixel_box = tile_pixel_bboxes[tile_id - start_tile];
-        BBox2  tile_proj_box  = mosaic_georef.pixel_to_point_bbox(tile_pixel_box);
-
-        if (tile_proj_box.intersects(dem_bbox)) {
-          use_this_dem = true;
-          break;
+      // Get tile bbox in pixels, then convert it to projected coords.
+      BBox2i tile_pixel_box = tile_pixel_bboxes[tile_id - start_tile];
+      BBox2  tile_proj_box  = mosaic_georef.pixel_to_point_bbox(tile_pixel_box);
+
+      std::vector<IndexValue> found;
+      dem_index.query(bgi::intersects(IndexBox(IndexPoint(tile_proj_box.min().x(),
+                                                          tile_proj_box.min().y()),
+                                               IndexPoint(tile_proj_box.max().x(),
+                                                          tile_proj_box.max().y()))),
+                      std::back_inserter(found));
+      int count = 0;
+      for (size_t it = 0; it < found.size(); it++) {
+        if (tile_proj_box.intersects(dem_proj_bboxes[found[it].second])) {
+          use_dem[found[it].second] = true;
+          count++;
         }
       }
-      if (use_this_dem == false)
+      tile_dem_counts[tile_id] = count;
+    }
+
+    if (opt.tile_dem_counts != "") {
+      vw_out() << "Writing: " << opt.tile_dem_counts << "\n";
+      std::ofstream ofs(opt.tile_dem_counts.c_str());
+      ofs << "# tile_index num_overlapping_dems\n";
+      for (auto it = tile_dem_counts.begin(); it != tile_dem_counts.end(); it++)
+        ofs << it->first << " " << it->second << "\n";
+      return 0;
+    }
+
+    // Loop through all DEMs
+    for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++){
+
+      if (!use_dem[dem_iter])
         continue; // Skip to the next DEM if we don't need this one.
 
       // The GeoTransform will hide the messy details of conversions
@@ -1869,6 +2277,9 @@ int main(int argc, char *argv[]) {
       tens *= 10;
     }
     
+    // The centerline extents of the input DEMs, if needed, are shared by all tiles
+    CenterlineCache centerline_cache;
+    
     // Time to generate each of the output tiles
     for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
 
@@ -1898,53 +2309,73 @@ int main(int argc, char *argv[]) {
                              imgMgr, georefs,
                              mosaic_georef, nodata_values,
                              loaded_dem_pixel_bboxes,
-                             num_valid_pixels, count_mutex),
+                             num_valid_pixels, count_mutex,
+                             centerline_cache),
                tile_box);
       GeoReference crop_georef = crop(mosaic_georef, tile_box.min().x(),
 				      tile_box.min().y());
 
+      if (opt.update_mosaic != "") {
+        write_in_place(opt.update_mosaic, out_dem, tile_box, block_size, opt.num_threads);
+        continue;
+      }
+
       // Raster the tile to disk. Optionally cast to int (may be
       // useful for mosaicking ortho images).
-      vw_out() << "Writing: " << dem_tile << std::endl;
-      bool has_georef = true, has_nodata = true;
+      asp::TelemetryTimer write_timer("dem_mosaic.write_tile");
       TerminalProgressCallback tpc("asp", "\t--> ");
+
+      // Fill holes in the whole tile. The holes are found and filled tile
+      // by tile from a temporary file, so a hole of any size is found
+      // whole, and memory use does not depend on the hole size.
+      std::string pre_fill_tile = dem_tile + "-pre-fill.tif";
+      std::string filled_tile = dem_tile + "-filled.tif";
+      if (opt.hole_fill_len > 0) {
+        bool has_georef = true, has_nodata = true;
+        vw_out() << "Writing: " << pre_fill_tile << std::endl;
+        asp::save_with_temp_big_blocks(block_size, pre_fill_tile, out_dem, has_georef,
+                                       crop_georef, has_nodata, opt.out_nodata_value,
+                                       opt, tpc);
+        asp::HoleFillParams params;
+        params.max_dim = opt.hole_fill_len;
+        vw_out() << "Filling holes.\n";
+        vw_out() << "Writing: " << filled_tile << std::endl;
+        asp::fill_dem_holes(pre_fill_tile, filled_tile, opt.out_nodata_value, params,
+                            has_georef, crop_georef, opt, tpc);
+        boost::filesystem::remove(pre_fill_tile);
+        out_dem = DiskImageView<RealT>(filled_tile);
+      }
+
+      vw_out() << "Writing: " << dem_tile << std::endl;
       if (opt.output_type == "Float32") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile, out_dem,
-                                       has_georef, crop_georef,
-                                       has_nodata, opt.out_nodata_value, opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile, out_dem, crop_georef,
+                         opt.out_nodata_value, tpc);
       else if (opt.output_type == "Byte") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile,
-				       per_pixel_filter(out_dem, RoundAndClamp<uint8, RealT>()),
-                                       has_georef, crop_georef,
-                                       has_nodata, vw::round_and_clamp<uint8>(opt.out_nodata_value),
-                                       opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile,
+                         per_pixel_filter(out_dem, RoundAndClamp<uint8, RealT>()),
+                         crop_georef, vw::round_and_clamp<uint8>(opt.out_nodata_value), tpc);
       else if (opt.output_type == "UInt16") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile,
-				       per_pixel_filter(out_dem, RoundAndClamp<uint16, RealT>()),
-                                       has_georef, crop_georef,
-                                       has_nodata, vw::round_and_clamp<uint16>(opt.out_nodata_value),
-                                       opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile,
+                         per_pixel_filter(out_dem, RoundAndClamp<uint16, RealT>()),
+                         crop_georef, vw::round_and_clamp<uint16>(opt.out_nodata_value), tpc);
       else if (opt.output_type == "Int16") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile,
-				       per_pixel_filter(out_dem, RoundAndClamp<int16, RealT>()),
-                                       has_georef, crop_georef,
-                                       has_nodata, vw::round_and_clamp<int16>(opt.out_nodata_value),
-                                       opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile,
+                         per_pixel_filter(out_dem, RoundAndClamp<int16, RealT>()),
+                         crop_georef, vw::round_and_clamp<int16>(opt.out_nodata_value), tpc);
       else if (opt.output_type == "UInt32") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile,
-				       per_pixel_filter(out_dem, RoundAndClamp<uint32, RealT>()),
-                                       has_georef, crop_georef,
-                                       has_nodata, vw::round_and_clamp<uint32>(opt.out_nodata_value),
-                                       opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile,
+                         per_pixel_filter(out_dem, RoundAndClamp<uint32, RealT>()),
+                         crop_georef, vw::round_and_clamp<uint32>(opt.out_nodata_value), tpc);
       else if (opt.output_type == "Int32") 
-        asp::save_with_temp_big_blocks(block_size, dem_tile,
-				       per_pixel_filter(out_dem, RoundAndClamp<int32, RealT>()),
-                                       has_georef, crop_georef,
-                                       has_nodata, vw::round_and_clamp<int32>(opt.out_nodata_value),
-                                       opt, tpc);
+        save_mosaic_tile(opt, block_size, dem_tile,
+                         per_pixel_filter(out_dem, RoundAndClamp<int32, RealT>()),
+                         crop_georef, vw::round_and_clamp<int32>(opt.out_nodata_value), tpc);
       else
         vw_throw(NoImplErr() << "Unsupported output type: " << opt.output_type << ".\n");
 
+      if (opt.hole_fill_len > 0)
+        boost::filesystem::remove(filled_tile);
+
       vw_out() << "Number of valid (not no-data) pixels written: " << num_valid_pixels
                << "."<< std::endl;
       if (num_valid_pixels == 0) {
@@ -17,10 +17,16 @@
 
 
 #include <asp/Core/PointUtils.h>
+#include <asp/Core/CsvParse.h>
+#include <asp/Core/DemDiff.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/GeoTransform.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
 
 using std::endl;
 using std::string;
@@ -33,31 +39,10 @@ using namespace vw::cartography;
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
-// Function to convert a masked geodetic vector to a masked altitude vector
-class MGeodeticToMAltitude : public ReturnFixedType<PixelMask<double>> {
-public:
-  PixelMask<double> operator()(PixelMask<Vector3> const& v) const {
-    if (!is_valid(v)) {
-      return PixelMask<double>();
-    }
-    return PixelMask<double>(v.child()[2]);
-  }
-};
-
-// Function to mask NaN pixels 
-class MaskNaN : public ReturnFixedType<PixelMask<double>> {
-public:
-  PixelMask<double> operator()(PixelMask<double> const& v) const {
-    if (!is_valid(v) || std::isnan(v.child())) {
-      return PixelMask<double>();
-    }
-    return v;
-  }
-};
-
 struct Options : vw::GdalWriteOptions {
   string dem1_file, dem2_file, output_prefix, csv_format_str, csv_proj4_str;
   double nodata_value;
+  int num_hist_bins;
 
   bool use_float, use_absolute;
 };
@@ -75,7 +60,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Output the absolute difference as opposed to just the difference.")
     ("csv-format",     po::value(&opt.csv_format_str)->default_value(""),
      asp::csv_opt_caption().c_str())
-    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.");
+    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.")
+    ("num-hist-bins",  po::value(&opt.num_hist_bins)->default_value(100),
+     "Save a histogram of the differences with this many bins. Set to 0 to not save it.");
   general_options.add(vw::GdalWriteOptionsDescription(opt));
 
   po::options_description positional("");
@@ -103,9 +90,197 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     opt.output_prefix = fs::basename(opt.dem1_file) + "__" + fs::basename(opt.dem2_file);
   }
 
+  if (opt.num_hist_bins < 0)
+    vw_throw(ArgumentErr() << "The number of histogram bins must be non-negative.\n");
+
   vw::create_out_dir(opt.output_prefix);
 }
 
+// Print the statistics of the differences, with each line starting
+// with the given prefix. The median and NMAD are passed in, as they may
+// be found exactly rather than from the sketch.
+void print_diff_stats(std::ostream & os, std::string const& prefix,
+                      asp::DiffStats const& stats, double median, double nmad) {
+  os << prefix << "Max difference:       " << stats.max()     << " meters" << std::endl;
+  os << prefix << "Min difference:       " << stats.min()     << " meters" << std::endl;
+  os << prefix << "Mean difference:      " << stats.mean()    << " meters" << std::endl;
+  os << prefix << "StdDev of difference: " << stats.std_dev() << " meters" << std::endl;
+  os << prefix << "Median difference:    " << median          << " meters" << std::endl;
+  os << prefix << "NMAD of difference:   " << nmad            << " meters" << std::endl;
+  os << prefix << "Number of differences: " << stats.count() << std::endl;
+}
+
+// Save the histogram of the differences, if requested
+void save_diff_hist(Options const& opt, asp::DiffStats const& stats) {
+  if (opt.num_hist_bins == 0)
+    return;
+
+  std::vector<vw::int64> counts;
+  stats.histogram(opt.num_hist_bins, counts);
+  double width = (stats.max() - stats.min()) / opt.num_hist_bins;
+
+  std::string hist_file = opt.output_prefix + "-diff-hist.csv";
+  vw_out() << "Writing histogram: " << hist_file << "\n";
+  std::ofstream ofs(hist_file.c_str());
+  ofs.precision(16);
+  ofs << "# bin start (m), bin end (m), count" << std::endl;
+  for (size_t it = 0; it < counts.size(); it++)
+    ofs << stats.min() + it * width << "," << stats.min() + (it + 1) * width << ","
+        << counts[it] << std::endl;
+}
+
+// Subtract from the first DEM the second one, interpolated into the grid
+// of the first DEM, with bilinear interpolation. This is done one tile
+// at a time. For each tile, the location in the second DEM of the first
+// DEM pixels is found exactly on a grid of nodes and interpolated in
+// between, and the part of the second DEM that is needed is read at
+// once. The statistics of the differences in each tile are passed to a
+// collector, so they are found while the output is written.
+class DemDiffView: public ImageViewBase<DemDiffView> {
+  ImageViewRef<PixelMask<double>> m_dem1, m_dem2;
+  GeoTransform m_gt; // from the second DEM pixels to the first DEM pixels
+  BBox2i m_crop_box; // the output box in the first DEM
+  bool m_use_absolute;
+  double m_nodata;
+  boost::shared_ptr<asp::DiffStatsCollector> m_collector;
+
+public:
+  typedef double pixel_type;
+  typedef double result_type;
+  typedef ProceduralPixelAccessor<DemDiffView> pixel_accessor;
+
+  DemDiffView(ImageViewRef<PixelMask<double>> dem1, ImageViewRef<PixelMask<double>> dem2,
+              GeoTransform const& gt, BBox2i const& crop_box, bool use_absolute,
+              double nodata, boost::shared_ptr<asp::DiffStatsCollector> collector):
+    m_dem1(dem1), m_dem2(dem2), m_gt(gt), m_crop_box(crop_box),
+    m_use_absolute(use_absolute), m_nodata(nodata), m_collector(collector) {}
+
+  inline int32 cols  () const { return m_crop_box.width();  }
+  inline int32 rows  () const { return m_crop_box.height(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline result_type operator()(double/*i*/, double/*j*/, int32/*p*/ = 0) const {
+    vw_throw(NoImplErr() << "DemDiffView::operator()(...) is not implemented");
+    return result_type();
+  }
+
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    // Find the second DEM pixel at every this many first DEM pixels
+    const int step = 16;
+
+    BBox2i box1 = bbox + m_crop_box.min();
+    ImageView<PixelMask<double>> dem1_tile = crop(m_dem1, box1);
+
+    int num_x = (bbox.width()  - 1) / step + 2;
+    int num_y = (bbox.height() - 1) / step + 2;
+    ImageView<Vector2> nodes(num_x, num_y);
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    for (int iy = 0; iy < num_y; iy++) {
+      for (int ix = 0; ix < num_x; ix++) {
+        try {
+          nodes(ix, iy) = m_gt.reverse(Vector2(box1.min().x() + ix * step,
+                                               box1.min().y() + iy * step));
+        } catch (...) {
+          nodes(ix, iy) = Vector2(nan, nan);
+        }
+      }
+    }
+
+    // Interpolate the nodes at the valid pixels, and find the extent in
+    // the second DEM
+    ImageView<Vector2> pix2(bbox.width(), bbox.height());
+    bool has_pix2 = false;
+    Vector2 min2, max2;
+    for (int row = 0; row < bbox.height(); row++) {
+      for (int col = 0; col < bbox.width(); col++) {
+        if (!is_valid(dem1_tile(col, row)))
+          continue;
+        int ix = col / step, iy = row / step;
+        double dx = double(col - ix * step) / step, dy = double(row - iy * step) / step;
+        Vector2 p = (1.0 - dy) * ((1.0 - dx) * nodes(ix, iy)     + dx * nodes(ix + 1, iy)) +
+                    dy         * ((1.0 - dx) * nodes(ix, iy + 1) + dx * nodes(ix + 1, iy + 1));
+        pix2(col, row) = p;
+        if (p != p)
+          continue; // NaN
+        if (!has_pix2) {
+          min2 = p;
+          max2 = p;
+          has_pix2 = true;
+        }
+        for (int c = 0; c < 2; c++) {
+          min2[c] = std::min(min2[c], p[c]);
+          max2[c] = std::max(max2[c], p[c]);
+        }
+      }
+    }
+
+    // Read the needed part of the second DEM, with a margin for the
+    // bilinear stencil
+    BBox2i box2;
+    ImageView<PixelMask<double>> dem2_tile;
+    if (has_pix2) {
+      box2 = BBox2i(Vector2i(floor(min2[0]), floor(min2[1])),
+                    Vector2i(floor(max2[0]) + 2, floor(max2[1]) + 2));
+      box2.crop(bounding_box(m_dem2));
+      if (!box2.empty())
+        dem2_tile = crop(m_dem2, box2);
+    }
+
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    asp::DiffStats stats;
+    for (int row = 0; row < bbox.height(); row++) {
+      for (int col = 0; col < bbox.width(); col++) {
+        tile(col, row) = m_nodata;
+
+        PixelMask<double> h1 = dem1_tile(col, row);
+        if (!is_valid(h1) || std::isnan(h1.child()) || dem2_tile.cols() == 0)
+          continue;
+
+        // Points beyond the last row or column of the second DEM are invalid
+        Vector2 const& p = pix2(col, row);
+        if (!(p[0] >= 0 && p[0] <= m_dem2.cols() - 1 &&
+              p[1] >= 0 && p[1] <= m_dem2.rows() - 1))
+          continue;
+
+        double x = p[0] - box2.min().x(), y = p[1] - box2.min().y();
+        int c0 = floor(x), r0 = floor(y);
+        int c1 = std::min(c0 + 1, dem2_tile.cols() - 1);
+        int r1 = std::min(r0 + 1, dem2_tile.rows() - 1);
+        double dc = x - c0, dr = y - r0;
+        PixelMask<double> const& v00 = dem2_tile(c0, r0);
+        PixelMask<double> const& v10 = dem2_tile(c1, r0);
+        PixelMask<double> const& v01 = dem2_tile(c0, r1);
+        PixelMask<double> const& v11 = dem2_tile(c1, r1);
+        if (!is_valid(v00) || !is_valid(v10) || !is_valid(v01) || !is_valid(v11))
+          continue;
+
+        double h2 = (1.0 - dr) * ((1.0 - dc) * v00.child() + dc * v10.child()) +
+                    dr         * ((1.0 - dc) * v01.child() + dc * v11.child());
+        if (std::isnan(h2))
+          continue;
+
+        double diff = h1.child() - h2;
+        if (m_use_absolute)
+          diff = std::abs(diff);
+        tile(col, row) = diff;
+        stats.add(diff);
+      }
+    }
+    m_collector->add(bbox, stats);
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
 void georef_sanity_checks(GeoReference const& georef1, GeoReference const& georef2){
 
   // We don't support datum changes!
@@ -166,26 +341,12 @@ void dem2dem_diff(Options& opt){
   if (crop_box.empty()) 
     vw_throw(ArgumentErr() << "The two DEMs do not have a common area.\n");
     
-  ImageViewRef<PixelMask<double>> dem2_trans =
-    per_pixel_filter(crop(geo_transform
-                          (per_pixel_filter(dem_to_geodetic
-                                            (create_mask(dem2_disk_image_view, dem2_nodata),
-                                             dem2_georef),
-                                            MGeodeticToMAltitude()),
-                           dem2_georef, dem1_georef,
-                           ValueEdgeExtension<PixelMask<double>>(PixelMask<double>())),
-                          crop_box), MaskNaN());
-  
-  ImageViewRef<double> difference;
-  if (opt.use_absolute) {
-    difference =
-      apply_mask(abs(crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans),
-                 opt.nodata_value);
-  } else {
-    difference =
-      apply_mask(crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans,
-                 opt.nodata_value);
-  }
+  // Difference the DEMs and find the statistics in the same pass
+  boost::shared_ptr<asp::DiffStatsCollector> collector(new asp::DiffStatsCollector);
+  ImageViewRef<double> difference
+    = DemDiffView(create_mask(dem1_disk_image_view, dem1_nodata),
+                  create_mask(dem2_disk_image_view, dem2_nodata),
+                  gt, crop_box, opt.use_absolute, opt.nodata_value, collector);
     
   GeoReference crop_georef = crop(dem1_georef, crop_box);
     
@@ -210,6 +371,17 @@ void dem2dem_diff(Options& opt){
     block_write_image(*rsrc, difference,
                       TerminalProgressCallback("asp", "\t--> Differencing: "));
   }
+
+  asp::DiffStats stats = collector->stats();
+  print_diff_stats(vw_out(), "", stats, stats.median(), stats.nmad());
+
+  std::string stats_file = opt.output_prefix + "-diff-stats.txt";
+  vw_out() << "Writing statistics: " << stats_file << "\n";
+  std::ofstream ofs(stats_file.c_str());
+  ofs.precision(16);
+  print_diff_stats(ofs, "", stats, stats.median(), stats.nmad());
+
+  save_diff_hist(opt, stats);
 }
 
 // From a DEM, subtract a csv file. Reverse the sign is 'reverse' is true.
@@ -259,80 +431,66 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
   GeoReference csv_georef = dem_georef;
   csv_conv.parse_georef(csv_georef);
 
-  std::list<asp::CsvConv::CsvRecord> csv_records;
-  typedef std::list<asp::CsvConv::CsvRecord>::const_iterator RecordIter;
-  csv_conv.read_csv_file(csv_file, csv_records);
-  
-  std::vector<Vector3> csv_llh;
-  for (RecordIter iter = csv_records.begin(); iter != csv_records.end(); iter++) {
-    Vector3 xyz = csv_conv.csv_to_cartesian(*iter, csv_georef);
+  // Read the CSV file with multiple threads, and find the points in the
+  // DEM's datum and in its pixels
+  asp::CsvColumns columns;
+  asp::read_csv_columns(csv_file, csv_conv, 1.0, 0, columns);
+  std::vector<Vector3> csv_xyz;
+  std::vector<Vector2> csv_lonlat;
+  asp::csv_columns_to_cartesian(csv_conv, columns, csv_georef, csv_xyz, csv_lonlat);
+
+  std::int64_t num_pts = csv_xyz.size();
+  std::vector<Vector3> csv_llh(num_pts);
+  std::vector<Vector2> pixels(num_pts, Vector2(-1, -1));
+#pragma omp parallel for
+  for (std::int64_t it = 0; it < num_pts; it++) {
+    Vector3 const& xyz = csv_xyz[it];
     if (xyz == Vector3() || xyz != xyz)
       continue; // invalid point
-    Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz); // use the dem's datum
-    csv_llh.push_back(llh);
+    csv_llh[it] = dem_georef.datum().cartesian_to_geodetic(xyz); // use the dem's datum
+    pixels[it]  = dem_georef.lonlat_to_pixel(subvector(csv_llh[it], 0, 2));
   }
 
-  // We will interpolate into the DEM to find the difference
-  ImageViewRef<PixelMask<double>> interp_dem
-    = interpolate(create_mask(dem, dem_nodata),
-		  BilinearInterpolation(), ConstantEdgeExtension());
+  // Interpolate into the DEM to find the difference. The points are
+  // bucketed by DEM tile, and each tile is read once.
+  std::vector<double> dem_heights;
+  asp::interp_dem_heights(ImageViewRef<PixelMask<double>>(create_mask(dem, dem_nodata)),
+                          pixels, dem_heights);
 
   // Save the diffs
-  int    count     = 0;
-  double diff_min  = std::numeric_limits<double>::max();
-  double diff_max  = -diff_min;
-  double diff_mean = 0.0;
-  double diff_std  = 0.0;
-
+  asp::DiffStats stats;
   std::vector<Vector3> csv_diff;
   std::vector<double> csv_errs;
-  for (size_t it = 0; it < csv_llh.size(); it++) {
+  for (std::int64_t it = 0; it < num_pts; it++) {
 
-    Vector3 llh = csv_llh[it];
-    Vector2 ll  = subvector(llh, 0, 2);
-    Vector2 pix = dem_georef.lonlat_to_pixel(ll);
-    
-    // Check for out of range
-    if (pix[0] < 0 || pix[0] > dem.cols() - 1) continue;
-    if (pix[1] < 0 || pix[1] > dem.rows() - 1) continue;
-    PixelMask<double> dem_ht = interp_dem(pix[0], pix[1]);
-    if (!is_valid(dem_ht))
-      continue;
-
-    double diff = dem_ht.child() - llh[2];
+    if (std::isnan(dem_heights[it]))
+      continue; // outside the DEM or invalid
+
+    Vector3 const& llh = csv_llh[it];
+    double diff = dem_heights[it] - llh[2];
     if (reverse) 
       diff *= -1;
     if (opt.use_absolute)
       diff = std::abs(diff);
 
-    if (diff > diff_max) diff_max = diff;
-    if (diff < diff_min) diff_min = diff;
-
-    diff_mean += diff;
-    diff_std  += diff*diff;
-    count     += 1;
-    csv_diff.push_back(Vector3(ll[0], ll[1], diff));
+    stats.add(diff);
+    csv_diff.push_back(Vector3(llh[0], llh[1], diff));
     csv_errs.push_back(diff);
   }
 
-  if (count > 0) {
-    diff_mean /= count;
-    diff_std = diff_std/count - diff_mean*diff_mean;
-    if (diff_std < 0)
-      diff_std = 0; // just in case, for numerical noise
-    diff_std = std::sqrt(diff_std);
+  // With all the differences at hand, find the median and NMAD exactly
+  double diff_median = 0.0, diff_nmad = 0.0;
+  if (csv_errs.size() > 0) {
+    size_t mid = csv_errs.size()/2;
+    std::nth_element(csv_errs.begin(), csv_errs.begin() + mid, csv_errs.end());
+    diff_median = csv_errs[mid];
+    for (size_t it = 0; it < csv_errs.size(); it++)
+      csv_errs[it] = std::abs(csv_errs[it] - diff_median);
+    std::nth_element(csv_errs.begin(), csv_errs.begin() + mid, csv_errs.end());
+    diff_nmad = 1.4826 * csv_errs[mid];
   }
 
-  double diff_median = 0.0;
-  std::sort(csv_errs.begin(), csv_errs.end());
-  if (csv_errs.size() > 0) 
-    diff_median = csv_errs[csv_errs.size()/2];
-
-  vw_out() << "Max difference:       " << diff_max    << " meters" << std::endl;
-  vw_out() << "Min difference:       " << diff_min    << " meters" << std::endl;
-  vw_out() << "Mean difference:      " << diff_mean   << " meters" << std::endl;
-  vw_out() << "StdDev of difference: " << diff_std    << " meters" << std::endl;
-  vw_out() << "Median difference:    " << diff_median << " meters" << std::endl;
+  print_diff_stats(vw_out(), "", stats, diff_median, diff_nmad);
 
   std::string output_file = opt.output_prefix + "-diff.csv";
   vw_out() << "Writing difference file: " << output_file << "\n";
@@ -340,15 +498,13 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
   outfile.precision(16);
   outfile << "# longitude,latitude, height diff (m)" << std::endl;
   outfile << "# " << dem_georef.datum() << std::endl; // dem's datum
-  outfile << "# Max difference:       " << diff_max    << " meters" << std::endl;
-  outfile << "# Min difference:       " << diff_min    << " meters" << std::endl;
-  outfile << "# Mean difference:      " << diff_mean   << " meters" << std::endl;
-  outfile << "# StdDev of difference: " << diff_std    << " meters" << std::endl;
-  outfile << "# Median difference:    " << diff_median << " meters" << std::endl;
+  print_diff_stats(outfile, "# ", stats, diff_median, diff_nmad);
   for (size_t it = 0; it < csv_diff.size(); it++) {
     Vector3 diff = csv_diff[it];
     outfile << diff[0] << "," << diff[1] << "," << diff[2] << std::endl;
   }
+
+  save_diff_hist(opt, stats);
 }
 
 // Subtract from the first dem the second. One of them can be a CSV file.
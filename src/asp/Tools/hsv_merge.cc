@@ -18,6 +18,7 @@
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/BigTileWriter.h>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -57,6 +58,7 @@ replace_channel( ImageViewBase<Image1T> const& image1,
 struct Options : public vw::GdalWriteOptions {
   std::string input_rgb, input_gray;
   std::string output_file;
+  bool cog;
 };
 
 // Image Operations
@@ -74,8 +76,16 @@ void do_merge(Options const& opt) {
   bool has_nodata = false;
   double nodata = -std::numeric_limits<float>::max(); // smallest float
 
-  block_write_gdal_image( opt.output_file, result, has_georef, georef, has_nodata, nodata, opt,
-                          TerminalProgressCallback("tools.hsv_merge","Writing:") );
+  TerminalProgressCallback tpc("tools.hsv_merge","Writing:");
+  if (opt.cog) {
+    // Write once, with overviews
+    const int big_tile_size = 1024;
+    asp::save_in_big_tiles(big_tile_size, opt.output_file, result, has_georef, georef,
+                           has_nodata, nodata, opt, tpc, opt.cog);
+  } else {
+    block_write_gdal_image( opt.output_file, result, has_georef, georef, has_nodata, nodata,
+                            opt, tpc );
+  }
 }
 
 // Handle input
@@ -86,7 +96,9 @@ int main( int argc, char *argv[] ) {
   try {
     po::options_description general_options("Description: Mimicks hsv_merge.py by Frank Warmerdam and Trent Hare. Use it to combine results from gdaldem.");
     general_options.add_options()
-      ("output-file,o", po::value(&opt.output_file), "Specify the output file.");
+      ("output-file,o", po::value(&opt.output_file), "Specify the output file.")
+      ("cog", po::bool_switch(&opt.cog)->default_value(false),
+       "Add internal overviews to the output image, computed while it is written.");
     general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
     po::options_description positional_options("");
@@ -24,10 +24,15 @@
 #include <vw/Image/PixelTypeInfo.h>
 #include <vw/FileIO/MatrixIO.h>
 #include <vw/Math/Geometry.h>
+#include <vw/Image/AntiAliasing.h>
+#include <vw/Image/BlockRasterize.h>
+#include <vw/Image/Transform.h>
 
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/Ransac.h>
+#include <asp/Core/OpenCVUtils.h>
 
 using namespace vw;
 namespace po = boost::program_options;
@@ -38,11 +43,12 @@ struct Options: vw::GdalWriteOptions {
     input_transform, disparity_params, ecef_transform_type, dem1, dem2;
   bool has_input_nodata_value, has_output_nodata_value;
   double input_nodata_value, output_nodata_value, inlier_threshold;
-  int ip_per_image, num_ransac_iterations, output_data_type;
+  int ip_per_image, num_ransac_iterations, output_data_type, pyramid_levels;
   Options(): has_input_nodata_value(false), has_output_nodata_value(false),
              input_nodata_value (std::numeric_limits<double>::quiet_NaN()),
              output_nodata_value(std::numeric_limits<double>::quiet_NaN()),
-             ip_per_image(0), num_ransac_iterations(0.0), inlier_threshold(0){}
+             ip_per_image(0), num_ransac_iterations(0.0), inlier_threshold(0),
+             pyramid_levels(0){}
 };
 
 
@@ -172,7 +178,7 @@ Matrix<double> do_ransac(std::vector<Vector3> const& ransac_ip1,
   Matrix<double> tf;
   
   try {
-    vw::math::RandomSampleConsensus<FunctorT, vw::math::InterestPointErrorMetric>
+    asp::ParallelRansac<FunctorT, vw::math::InterestPointErrorMetric>
       ransac(FunctorT(), vw::math::InterestPointErrorMetric(),
              opt.num_ransac_iterations, opt.inlier_threshold,
              min_num_output_inliers, reduce_num_inliers_if_no_fit);
@@ -353,6 +359,190 @@ calc_alignment_transform(std::string const& image_file1,
   return tf;
 }
 
+// The transform from the second to the first image, for the images
+// subsampled by the given factor
+Matrix<double> scale_transform(Matrix<double> const& tf, double scale) {
+  Matrix<double> S = identity_matrix(3), S_inv = identity_matrix(3);
+  S(0, 0) = S(1, 1) = scale;
+  S_inv(0, 0) = S_inv(1, 1) = 1.0 / scale;
+  return S * tf * S_inv;
+}
+
+// The image subsampled by 2^level, with no-data pixels not used in
+// averaging. This is evaluated only where needed.
+ImageViewRef<double> pyramid_level(ImageViewRef<double> image, double nodata, int level) {
+  if (level == 0)
+    return image;
+  double scale = 1.0 / double(1 << level);
+  return apply_mask(resample_aa(create_mask(image, nodata), scale), nodata);
+}
+
+// Refine the alignment at a pyramid level. For a grid of windows in the
+// first image, the second image is warped with the current transform,
+// and the remaining shift is found with phase correlation. Each window
+// gives a match at its center. The windows are done in parallel.
+void refine_matches_in_windows(ImageViewRef<double> image1, ImageViewRef<double> image2,
+                               double nodata1, double nodata2,
+                               Matrix<double> const& tf,
+                               std::vector<ip::InterestPoint> & matched_ip1,
+                               std::vector<ip::InterestPoint> & matched_ip2) {
+
+  matched_ip1.clear();
+  matched_ip2.clear();
+
+  const int WIN = 256, GRID = 16;
+  int win_cols = std::min(WIN, image1.cols()), win_rows = std::min(WIN, image1.rows());
+  int num_cols = std::min(GRID, image1.cols() / win_cols);
+  int num_rows = std::min(GRID, image1.rows() / win_rows);
+  std::vector<BBox2i> windows;
+  for (int r = 0; r < num_rows; r++) {
+    int row = ((2 * r + 1) * (image1.rows() - win_rows)) / (2 * num_rows);
+    for (int c = 0; c < num_cols; c++) {
+      int col = ((2 * c + 1) * (image1.cols() - win_cols)) / (2 * num_cols);
+      windows.push_back(BBox2i(col, row, win_cols, win_rows));
+    }
+  }
+
+  PixelMask<double> nodata_mask = PixelMask<double>(); // invalid value for a PixelMask
+  ImageViewRef<PixelMask<double>> warped2
+    = vw::transform(create_mask(image2, nodata2), HomographyTransform(tf),
+                    image1.cols(), image1.rows(),
+                    ValueEdgeExtension<PixelMask<double>>(nodata_mask),
+                    BilinearInterpolation());
+  HomographyTransform T(tf);
+
+  // A window gives no match if it has no-data, if the shift is more than
+  // a quarter of the window, or if the correlation is weak
+  const double MIN_RESPONSE = 0.1;
+  std::vector<bool> found(windows.size(), false);
+  std::vector<Vector2> pix1(windows.size()), pix2(windows.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int w = 0; w < int(windows.size()); w++) {
+    ImageView<double> win1 = crop(image1, windows[w]);
+    ImageView<PixelMask<double>> masked_win2 = crop(warped2, windows[w]);
+    ImageView<double> win2(win1.cols(), win1.rows());
+    bool has_nodata = false;
+    for (int col = 0; col < win1.cols() && !has_nodata; col++) {
+      for (int row = 0; row < win1.rows(); row++) {
+        if (win1(col, row) == nodata1 || std::isnan(win1(col, row)) ||
+            !is_valid(masked_win2(col, row))) {
+          has_nodata = true;
+          break;
+        }
+        win2(col, row) = masked_win2(col, row).child();
+      }
+    }
+    if (has_nodata)
+      continue;
+
+    double response = 0.0;
+    Vector2 shift = asp::phaseCorrelationShift(win1, win2, response);
+    if (response < MIN_RESPONSE || norm_2(shift) > WIN / 4.0)
+      continue;
+
+    // The center of the window in the first image, and where it is in
+    // the second image
+    Vector2 ctr = Vector2(windows[w].min()) + Vector2(win1.cols() - 1, win1.rows() - 1) / 2.0;
+    pix1[w]  = ctr;
+    pix2[w]  = T.reverse(ctr + shift);
+    found[w] = true;
+  }
+
+  for (size_t w = 0; w < windows.size(); w++) {
+    if (!found[w])
+      continue;
+    matched_ip1.push_back(ip::InterestPoint(pix1[w].x(), pix1[w].y()));
+    matched_ip2.push_back(ip::InterestPoint(pix2[w].x(), pix2[w].y()));
+  }
+}
+
+// Find the transform on a coarse pyramid level with interest points,
+// then refine it on each finer level with phase correlation in windows.
+// Only the coarsest level is read fully.
+Matrix<double>
+calc_pyramid_alignment_transform(std::string const& image_file1,
+                                 std::string const& image_file2,
+                                 ImageViewRef<double> image1, ImageViewRef<double> image2,
+                                 double nodata1, double nodata2,
+                                 Options const& opt,
+                                 Matrix<double> & ecef_transform) { // potential output
+
+  int num_levels = opt.pyramid_levels;
+  double factor = double(1 << num_levels);
+  vw_out() << "Finding interest points at pyramid level " << num_levels
+           << " (subsampled by " << factor << ").\n";
+
+  Vector2i block_size(256, 256);
+  int num_threads = vw_settings().default_num_threads();
+  ImageView<double> coarse1
+    = block_rasterize(pyramid_level(image1, nodata1, num_levels), block_size, num_threads);
+  ImageView<double> coarse2
+    = block_rasterize(pyramid_level(image2, nodata2, num_levels), block_size, num_threads);
+
+  // Only the final level saves the matches and finds the ECEF transform.
+  // The inlier threshold is in full-resolution pixels, so it grows with
+  // the level.
+  Options level_opt = opt;
+  level_opt.output_prefix = "";
+  level_opt.ecef_transform_type = "";
+  level_opt.inlier_threshold = opt.inlier_threshold * factor;
+
+  std::vector<ip::InterestPoint> matched_ip1, matched_ip2;
+  find_matches(image_file1, image_file2, coarse1, coarse2,
+               nodata1, nodata2, matched_ip1, matched_ip2, level_opt);
+
+  // Convert to full-resolution pixels
+  std::vector<ip::InterestPoint> * ips[2] = {&matched_ip1, &matched_ip2};
+  for (int s = 0; s < 2; s++) {
+    for (size_t it = 0; it < ips[s]->size(); it++) {
+      ip::InterestPoint & p = (*ips[s])[it];
+      p.x *= factor; p.y *= factor; p.ix *= factor; p.iy *= factor;
+    }
+  }
+  Matrix<double> tf = calc_alignment_transform(image_file1, image_file2,
+                                               matched_ip1, matched_ip2,
+                                               level_opt, ecef_transform);
+
+  const size_t MIN_NUM_MATCHES = 10;
+  for (int level = num_levels - 1; level >= 0; level--) {
+
+    double level_factor = double(1 << level);
+    vw_out() << "Refining the alignment at pyramid level " << level << ".\n";
+    refine_matches_in_windows(pyramid_level(image1, nodata1, level),
+                              pyramid_level(image2, nodata2, level),
+                              nodata1, nodata2,
+                              scale_transform(tf, 1.0 / level_factor),
+                              matched_ip1, matched_ip2);
+    for (int s = 0; s < 2; s++) {
+      for (size_t it = 0; it < ips[s]->size(); it++) {
+        ip::InterestPoint & p = (*ips[s])[it];
+        p.x *= level_factor; p.y *= level_factor;
+      }
+    }
+
+    if (matched_ip1.size() < MIN_NUM_MATCHES) {
+      if (level == 0 && opt.ecef_transform_type != "")
+        vw_throw(ArgumentErr() << "Too few matches at the finest pyramid level "
+                 << "to find the ECEF transform.\n");
+      vw_out(WarningMessage) << "Found only " << matched_ip1.size()
+                             << " matches at pyramid level " << level
+                             << ". Keeping the transform from the previous level.\n";
+      continue;
+    }
+
+    if (level == 0) {
+      level_opt = opt;
+    } else {
+      level_opt.inlier_threshold = opt.inlier_threshold * level_factor;
+    }
+    tf = calc_alignment_transform(image_file1, image_file2,
+                                  matched_ip1, matched_ip2,
+                                  level_opt, ecef_transform);
+  }
+
+  return tf;
+}
+
 void handle_arguments(int argc, char *argv[], Options& opt) {
 
   po::options_description general_options("");
@@ -382,7 +572,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("dem1", po::value(&opt.dem1)->default_value(""), "The DEM associated with the first image. To be used with --ecef-transform-type.")
     ("dem2", po::value(&opt.dem2)->default_value(""), "The DEM associated with the second image. To be used with --ecef-transform-type.")
     ("disparity-params", po::value(&opt.disparity_params)->default_value(""),
-     "Find the alignment transform by using, instead of interest points, a disparity, such as produced by 'parallel_stereo --correlator-mode'. Specify as a string in quotes, in the format: 'disparity.tif num_samples'.");
+     "Find the alignment transform by using, instead of interest points, a disparity, such as produced by 'parallel_stereo --correlator-mode'. Specify as a string in quotes, in the format: 'disparity.tif num_samples'.")
+    ("pyramid-levels", po::value(&opt.pyramid_levels)->default_value(0),
+     "If positive, find interest points in the images subsampled by 2 to this power, then refine the alignment at each finer level with phase correlation in a grid of windows. This is much faster for large images.");
     
   po::options_description positional("");
   positional.add_options()
@@ -417,6 +609,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
              "rigid, similarity, affine, homography.\n" << usage << general_options);    
   }
 
+  if (opt.pyramid_levels < 0 || opt.pyramid_levels > 10)
+    vw_throw(ArgumentErr() << "The value of --pyramid-levels must be between 0 and 10.\n");
+  if (opt.pyramid_levels > 0 && opt.disparity_params != "")
+    vw_throw(ArgumentErr() << "Cannot use both --pyramid-levels and --disparity-params.\n");
+
   if (opt.ecef_transform_type != "") {
     if (opt.ecef_transform_type != "translation" && opt.ecef_transform_type != "rigid" &&
         opt.ecef_transform_type != "similarity") 
@@ -549,14 +746,19 @@ int main(int argc, char *argv[]) {
     Matrix<double> tf, ecef_transform;
     if (opt.input_transform.empty()) {
       std::vector<ip::InterestPoint> matched_ip1, matched_ip2;
-      if (opt.disparity_params == "")
-        find_matches(image_file1, image_file2, image1, image2,  
-                     nodata1, nodata2, matched_ip1, matched_ip2, opt);
-      else
-        find_matches_from_disp(matched_ip1, matched_ip2, opt);
+      if (opt.pyramid_levels > 0) {
+        tf = calc_pyramid_alignment_transform(image_file1, image_file2, image1, image2,
+                                              nodata1, nodata2, opt, ecef_transform);
+      } else {
+        if (opt.disparity_params == "")
+          find_matches(image_file1, image_file2, image1, image2,  
+                       nodata1, nodata2, matched_ip1, matched_ip2, opt);
+        else
+          find_matches_from_disp(matched_ip1, matched_ip2, opt);
       
-      tf = calc_alignment_transform(image_file1, image_file2,  
-                                    matched_ip1, matched_ip2, opt, ecef_transform);
+        tf = calc_alignment_transform(image_file1, image_file2,  
+                                      matched_ip1, matched_ip2, opt, ecef_transform);
+      }
     } else {
       vw_out() << "Reading the alignment transform from: " << opt.input_transform << "\n";
       read_matrix_as_txt(opt.input_transform, tf);
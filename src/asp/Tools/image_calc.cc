@@ -37,6 +37,7 @@
 #include <vw/FileIO/DiskImageUtils.h>
 
 #include <asp/Core/Common.h>
+#include <asp/Core/ExpressionProgram.h>
 #include <asp/Core/Macros.h>
 
 #include <vector>
@@ -123,27 +124,6 @@ void tab(int indent) {
     std::cout << ' ';
 }
 
-// TODO: Are there pixel functions for these?
-template <typename T>
-T manual_min(const std::vector<T> &vec) {
-
-  T minVal = vec[0];
-  for (size_t i=1; i<vec.size(); ++i)
-    if (vec[i] < minVal)
-      minVal = vec[i];
-  return minVal;
-}
-template <typename T>
-T manual_max(const std::vector<T> &vec) {
-
-  T maxVal = vec[0];
-  for (size_t i=1; i<vec.size(); ++i)
-    if (vec[i] > maxVal)
-      maxVal = vec[i];
-  return maxVal;
-}
-
-
 // This type represents an operation performed on one or more inputs.
 struct calc_operation {
 
@@ -207,55 +187,6 @@ struct calc_operation {
       std::vector<calc_operation> temp = inputs[0].inputs;
       inputs = temp;
     }
-
-
-    /// Apply the operation tree to the input parameters and return a result
-    template <typename T>
-    T applyOperation(const std::vector<T> &params) const {
-      // Get the results from each input node.
-      // - This is a recursive call.
-      const size_t numInputs = inputs.size();
-      std::vector<T> inputResults(numInputs);
-      for (size_t i=0; i<numInputs; ++i)
-        inputResults[i] = inputs[i].applyOperation(params);
-
-      // Now perform the operation for this node
-      switch(opType) {
-        // Unary
-        case OP_number:   return T(value);
-        case OP_variable: if (varName >= static_cast<int>(params.size()))
-          vw_throw(ArgumentErr()
-                   << "Unrecognized variable input. Note that the first variable is var_0.\n");
-          return params[varName];
-        if (numInputs < 1)
-          vw_throw(LogicErr() << "Insufficient inputs for this operation.\n");
-        case OP_negate:   return T(-1 * inputResults[0]);
-        case OP_abs:      return T(std::abs(inputResults[0])); // regular abs casts to integer.
-        case OP_sign:     return T(boost::math::sign(inputResults[0]));
-
-        // Binary
-        if (numInputs < 2)
-          vw_throw(LogicErr() << "Insufficient inputs for this operation.\n");
-        case OP_add:      return (inputResults[0] + inputResults[1]);
-        case OP_subtract: return (inputResults[0] - inputResults[1]);
-        case OP_divide:   return (inputResults[0] / inputResults[1]);
-        case OP_multiply: return (inputResults[0] * inputResults[1]);
-        case OP_power:    return (pow(inputResults[0], inputResults[1]));
-
-        // Multi
-        case OP_min:      return manual_min(inputResults); // TODO: Do these functions exist?
-        case OP_max:      return manual_max(inputResults);
-
-        case OP_lt:   return (inputResults[0] <  inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_gt:   return (inputResults[0] >  inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_lte:  return (inputResults[0] <= inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_gte:  return (inputResults[0] >= inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_eq:   return (inputResults[0] == inputResults[1]) ? inputResults[2] : inputResults[3];
-
-        default:
-          vw_throw(LogicErr() << "Unexpected operation type.\n");
-      }
-    }
 };
 
 
@@ -269,6 +200,45 @@ BOOST_FUSION_ADAPT_STRUCT(
     (std::vector<calc_operation>, inputs)
 )
 
+/// Append the operation tree to a program, in postfix order, so that it
+/// can be evaluated over whole image rows
+void compile_operation(calc_operation const& node, asp::ExpressionProgram & program) {
+
+  typedef asp::ExpressionProgram P;
+  if (node.opType == OP_number) {
+    program.push_const(node.value);
+    return;
+  }
+  if (node.opType == OP_variable) {
+    program.push_var(node.varName);
+    return;
+  }
+
+  for (size_t i = 0; i < node.inputs.size(); i++)
+    compile_operation(node.inputs[i], program);
+
+  int num = node.inputs.size();
+  switch (node.opType) {
+    case OP_negate:   program.push_op(P::OP_NEGATE,   num); break;
+    case OP_abs:      program.push_op(P::OP_ABS,      num); break;
+    case OP_sign:     program.push_op(P::OP_SIGN,     num); break;
+    case OP_add:      program.push_op(P::OP_ADD,      num); break;
+    case OP_subtract: program.push_op(P::OP_SUBTRACT, num); break;
+    case OP_divide:   program.push_op(P::OP_DIVIDE,   num); break;
+    case OP_multiply: program.push_op(P::OP_MULTIPLY, num); break;
+    case OP_power:    program.push_op(P::OP_POWER,    num); break;
+    case OP_min:      program.push_op(P::OP_MIN,      num); break;
+    case OP_max:      program.push_op(P::OP_MAX,      num); break;
+    case OP_lt:       program.push_op(P::OP_LT,       num); break;
+    case OP_gt:       program.push_op(P::OP_GT,       num); break;
+    case OP_lte:      program.push_op(P::OP_LTE,      num); break;
+    case OP_gte:      program.push_op(P::OP_GTE,      num); break;
+    case OP_eq:       program.push_op(P::OP_EQ,       num); break;
+    default:
+      vw_throw(LogicErr() << "Unexpected operation type.\n");
+  }
+}
+
 //================================================================================
 // - Boost::Spirit equation parsing
 
@@ -381,7 +351,7 @@ private: // Variables
   std::vector<bool> m_has_nodata_vec;
   std::vector<double> m_nodata_vec; // nodata is always double
   double              m_output_nodata;
-  calc_operation m_operation_tree;
+  asp::ExpressionProgram m_program;
   int m_num_rows;
   int m_num_cols;
   int m_num_channels;
@@ -395,8 +365,7 @@ public: // Functions
                 double outputNodata,
                 calc_operation const& operation_tree):
     m_image_vec(imageVec),   m_has_nodata_vec(has_nodata_vec),
-    m_nodata_vec(nodata_vec), m_output_nodata(outputNodata),
-    m_operation_tree(operation_tree) {
+    m_nodata_vec(nodata_vec), m_output_nodata(outputNodata) {
     const size_t numImages = imageVec.size();
     VW_ASSERT((numImages > 0), ArgumentErr()
               << "ImageCalcView: One or more images required.");
@@ -405,6 +374,9 @@ public: // Functions
     VW_ASSERT((nodata_vec.size() == numImages),
               LogicErr() << "ImageCalcView: Incorrect nodata count passed in.");
 
+    compile_operation(operation_tree, m_program);
+    m_program.validate(numImages);
+
     // Make sure all images are the same size
     m_num_rows     = imageVec[0].rows();
     m_num_cols     = imageVec[0].cols();
@@ -438,52 +410,53 @@ public: // Functions
     // Set up the output image tile
     ImageView<result_type> tile(bbox.width(), bbox.height());
 
-    // TODO: Left to right processing.
-
-    // Set up for pixel calculations
-    const size_t num_images = m_image_vec.size();
-    std::vector<input_pixel_type> input_pixels(num_images);
-    std::vector<double>           input_doubles(num_images);
-
     // Rasterize all the input images at this particular tile
+    const size_t num_images = m_image_vec.size();
     std::vector<ImageView<input_pixel_type> > input_tiles(num_images);
     for (size_t i=0; i<num_images; ++i)
       input_tiles[i] = crop(m_image_vec[i], bbox);
 
-    // Loop through each output pixel and compute each output value
-    for (int c = 0; c < bbox.width(); c++) {
-      for (int r = 0; r < bbox.height(); r++) {
-        // Fetch all the input pixels for this location
-        bool isNodata = false;
-        for (size_t i=0; i<num_images; ++i) {
-          input_pixels[i] = (input_tiles[i])(c,r);
+    // Evaluate the program one row at a time. If any of the input pixels
+    // is nodata, the output is nodata.
+    const int width = bbox.width();
+    std::vector<std::vector<double> > input_rows(num_images, std::vector<double>(width));
+    std::vector<const double*> vars(num_images);
+    for (size_t i=0; i<num_images; ++i)
+      vars[i] = input_rows[i].data();
+    std::vector<double> output_row(width), scratch;
+    std::vector<char> is_nodata(width);
+
+    for (int r = 0; r < bbox.height(); r++) {
 
-          // If any of the input pixels are nodata, the output is nodata.
-          if (m_has_nodata_vec[i] && (m_nodata_vec[i] == input_pixels[i])) {
-            isNodata = true;
+      for (int c = 0; c < width; c++) {
+        bool nodata = false;
+        for (size_t i=0; i<num_images; ++i) {
+          if (m_has_nodata_vec[i] && (m_nodata_vec[i] == input_tiles[i](c, r))) {
+            nodata = true;
             break;
           }
-        } // End image loop
-
-        if (isNodata) { // Output is nodata, move on to the next pixel
-          tile(c, r) = m_output_nodata;
-          continue;
         }
+        is_nodata[c] = nodata;
+      }
 
-        for (int chan=0; chan<m_num_channels; ++chan) {
-          for (size_t i=0; i<num_images; ++i) {
-            input_doubles[i] = input_pixels[i][chan];
-          } // End image loop
-
-          // Apply the operation tree to this pixel and store in the output pixel
-          // TODO(oalexan1): Should we round too, if output is int?
-          double newVal = m_operation_tree.applyOperation<double>(input_doubles);
-          tile(c, r, chan) = clamp_and_cast<output_channel_type>(newVal);
+      for (int chan=0; chan<m_num_channels; ++chan) {
+        for (size_t i=0; i<num_images; ++i) {
+          double * row = input_rows[i].data();
+          for (int c = 0; c < width; c++)
+            row[c] = input_tiles[i](c, r)[chan];
+        }
 
-        } // End channel loop
+        // TODO(oalexan1): Should we round too, if output is int?
+        m_program.evaluate(vars, width, output_row.data(), scratch);
+        for (int c = 0; c < width; c++) {
+          if (is_nodata[c])
+            tile(c, r, chan) = m_output_nodata;
+          else
+            tile(c, r, chan) = clamp_and_cast<output_channel_type>(output_row[c]);
+        }
+      } // End channel loop
 
-      } // End row loop
-    } // End column loop
+    } // End row loop
 
   // Return the tile we created with fake borders to make it look the
   // size of the entire output image
@@ -21,6 +21,9 @@
 /// - Currently supports one line of images.
 
 #include <limits>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <boost/algorithm/string.hpp>
 
 #include <vw/FileIO/DiskImageUtils.h>
@@ -32,6 +35,8 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/BigTileWriter.h>
+#include <asp/Core/MatchFile.h>
 
 using namespace vw;
 namespace po = boost::program_options;
@@ -48,9 +53,9 @@ void fix_tile_multiple(int &size) {
 struct Options: vw::GdalWriteOptions {
   std::vector<std::string> image_files;
   std::string orientation, output_image, output_type, out_prefix;
-  int    overlap_width, band, blend_radius, ip_per_tile;
+  int    overlap_width, band, blend_radius, ip_per_tile, num_matching_threads;
   bool   has_input_nodata_value, has_output_nodata_value, reverse, rotate,
-         use_affine_transform, rotate90, rotate90ccw;
+         use_affine_transform, rotate90, rotate90ccw, cog;
   double input_nodata_value, output_nodata_value;
   Vector2 big_tile_size;
   Options(): has_input_nodata_value(false), has_output_nodata_value(false),
@@ -108,7 +113,7 @@ void match_ip_in_regions(std::string const& image_file1,
     // If the match file already exists, load it instead of finding new points.
     if (boost::filesystem::exists(match_file)) {
       vw_out() << "Reading matched interest points from file: " << match_file << std::endl;
-      ip::read_binary_match_file(match_file, matched_ip1, matched_ip2);
+      asp::read_match_file(match_file, matched_ip1, matched_ip2);
       vw_out() << "Read in " << matched_ip1.size() << " matched IP.\n";
     }
   }
@@ -271,14 +276,51 @@ void compute_all_image_positions(Options const& opt,
   //transforms[0] = boost::shared_ptr<vw::Transform>(new TranslateTransform(0,0));
   bboxes    [0] = output_bbox;
   
+  // Find the transforms between consecutive images. Each pair is
+  // independent, so several can be matched at the same time.
+  std::vector<Matrix<double>> relative_transforms(num_images);
+  int num_threads = std::max(1, std::min(opt.num_matching_threads, int(num_images) - 1));
+  if (num_threads > 1)
+    vw_out() << "Matching " << num_images - 1 << " image pairs using "
+             << num_threads << " threads.
+";
+  std::mutex mutex;
+  size_t next_pair = 1;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    while (1) {
+      size_t i = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next_pair >= num_images || error)
+          return;
+        i = next_pair++;
+      }
+      try {
+        relative_transforms[i]
+          = compute_relative_transform(opt.image_files[i-1], opt.image_files[i], opt);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++)
+    threads.push_back(std::thread(worker));
+  for (int t = 0; t < num_threads; t++)
+    threads[t].join();
+  if (error)
+    std::rethrow_exception(error);
+  
   // This approach only works for serial pairs, if we add another type of
   //  orientation it will need to be changed.
   Matrix<double> last_transform = identity_matrix(3);
   
   for (size_t i=1; i<num_images; ++i) {
 
-    Matrix<double> relative_transform = 
-        compute_relative_transform(opt.image_files[i-1], opt.image_files[i], opt);
+    Matrix<double> const& relative_transform = relative_transforms[i];
 
     image_size = file_image_size(opt.image_files[i]);
 
@@ -520,16 +562,16 @@ void write_selected_image_type(ImageViewRef<float> const& out_img,
   // Set up our output image object
   TerminalProgressCallback tpc("asp", "\t    Mosaic:");
 
-  // Since we blend large portions, it is convenient to use large
-  // tiles upon writing.  Yet, those are hard to process later, for
-  // example, by stereo_gui. So, later we will rewrite the tiles
-  // with smaller blocks.
+  // Since we blend large portions, it is convenient to compute the
+  // mosaic in large tiles. Yet, those are hard to process later, for
+  // example, by stereo_gui. So, the large tiles are written to a file
+  // with the usual smaller blocks.
   int min_tile_size = 2*opt.blend_radius;
   min_tile_size = std::max(opt.raster_tile_size[0], min_tile_size);
   min_tile_size = std::max(opt.raster_tile_size[1], min_tile_size);
   fix_tile_multiple(min_tile_size);
   
-  vw_out() << "Using temporary block size: " << min_tile_size << std::endl;
+  vw_out() << "Blending in tiles of size: " << min_tile_size << std::endl;
   
   bool has_georef = false;
   bool has_nodata = true;
@@ -539,44 +581,45 @@ void write_selected_image_type(ImageViewRef<float> const& out_img,
   
   // Write to disk using the specified output data type.
   if (opt.output_type == "float32") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image, out_img,
-                                   has_georef, georef, has_nodata, output_nodata_value, opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image, out_img,
+                           has_georef, georef, has_nodata, output_nodata_value, opt, tpc,
+                           opt.cog);
   else if (opt.output_type == "byte") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image,
-                                   per_pixel_filter(out_img,
-                                                    RoundAndClamp<uint8, float>()),
-                                   has_georef, georef, has_nodata, 
-                                   vw::round_and_clamp<uint8>(output_nodata_value),
-                                   opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image,
+                           per_pixel_filter(out_img,
+                                            RoundAndClamp<uint8, float>()),
+                           has_georef, georef, has_nodata, 
+                           vw::round_and_clamp<uint8>(output_nodata_value),
+                           opt, tpc, opt.cog);
   else if (opt.output_type == "uint16") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image,
-                                   per_pixel_filter(out_img,
-                                                    RoundAndClamp<uint16, float>()),
-                                   has_georef, georef, has_nodata, 
-                                   vw::round_and_clamp<uint16>(output_nodata_value),
-                                   opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image,
+                           per_pixel_filter(out_img,
+                                            RoundAndClamp<uint16, float>()),
+                           has_georef, georef, has_nodata, 
+                           vw::round_and_clamp<uint16>(output_nodata_value),
+                           opt, tpc, opt.cog);
   else if (opt.output_type == "int16") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image,
-                                   per_pixel_filter(out_img,
-                                                    RoundAndClamp<int16, float>()),
-                                   has_georef, georef, has_nodata, 
-                                   vw::round_and_clamp<int16>(output_nodata_value),
-                                   opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image,
+                           per_pixel_filter(out_img,
+                                            RoundAndClamp<int16, float>()),
+                           has_georef, georef, has_nodata, 
+                           vw::round_and_clamp<int16>(output_nodata_value),
+                           opt, tpc, opt.cog);
   
   else if (opt.output_type == "uint32") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image,
-                                   per_pixel_filter(out_img,
-                                                    RoundAndClamp<uint32, float>()),
-                                   has_georef, georef, has_nodata, 
-                                   vw::round_and_clamp<uint32>(output_nodata_value),
-                                   opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image,
+                           per_pixel_filter(out_img,
+                                            RoundAndClamp<uint32, float>()),
+                           has_georef, georef, has_nodata, 
+                           vw::round_and_clamp<uint32>(output_nodata_value),
+                           opt, tpc, opt.cog);
   else if (opt.output_type == "int32") 
-    asp::save_with_temp_big_blocks(min_tile_size, opt.output_image,
-                                   per_pixel_filter(out_img,
-                                                    RoundAndClamp<int32, float>()),
-                                   has_georef, georef, has_nodata, 
-                                   vw::round_and_clamp<int32>(output_nodata_value),
-                                   opt, tpc);
+    asp::save_in_big_tiles(min_tile_size, opt.output_image,
+                           per_pixel_filter(out_img,
+                                            RoundAndClamp<int32, float>()),
+                           has_georef, georef, has_nodata, 
+                           vw::round_and_clamp<int32>(output_nodata_value),
+                           opt, tpc, opt.cog);
   else
     vw_throw( NoImplErr() << "Unsupported output type: " << opt.output_type << ".\n" );
   
@@ -615,7 +658,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("output-nodata-value", po::value(&opt.output_nodata_value),
      "Nodata value to use on output.")
     ("output-prefix", po::value(&opt.out_prefix)->default_value(""),
-     "If specified, save here the interest point matches used in mosaicking.");
+     "If specified, save here the interest point matches used in mosaicking.")
+    ("num-matching-threads", po::value(&opt.num_matching_threads)->default_value(1),
+     "Match this many pairs of consecutive images at the same time, each in its own thread.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Add internal overviews to the output image, computed while it is written.");
  
   po::options_description positional("");
   positional.add_options()
@@ -646,6 +693,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_out() << "Using blend radius: " << opt.blend_radius << std::endl;
   }
 
+  if (opt.num_matching_threads < 1)
+    vw_throw( ArgumentErr() << "The value of --num-matching-threads must be positive.\n"
+                            << usage << general_options );
+
   int check = 0; // Count the number of rotate options specified.
   if (opt.rotate     ) ++check;
   if (opt.rotate90   ) ++check;
@@ -29,6 +29,7 @@
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Tools/jitter_adjust.h>
+#include <asp/Core/MatchFile.h>
 #include <vw/Core/Stopwatch.h>
 
 // Turn off warnings from eigen
@@ -520,7 +521,7 @@ void jitter_adjust(std::vector<std::string> const& image_files,
   std::vector<Vector2> adjustment_bounds;
   adjustment_bounds.resize(num_cameras);
   std::vector<ip::InterestPoint> ip0, ip1;
-  ip::read_binary_match_file(match_file, ip0, ip1);
+  asp::read_match_file(match_file, ip0, ip1);
   adjustment_bounds[0]
     = find_bounds_from_percentiles(ip0, stereo_settings().piecewise_adjustment_percentiles);
   adjustment_bounds[1]
@@ -33,6 +33,8 @@
 #include <asp/Camera/BundleAdjustCamera.h>
 #include <asp/Camera/JitterSolveCostFuns.h>
 #include <asp/Camera/JitterSolveUtils.h>
+#include <asp/Camera/SolverBackend.h>
+#include <asp/Core/Telemetry.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
@@ -70,7 +72,8 @@ struct Options: public asp::BaBaseOptions {
   int num_anchor_points_extra_lines;
   bool initial_camera_constraint;
   std::map<int, int> orbital_groups;
-  double forced_triangulation_distance;
+  double forced_triangulation_distance, dem_memory_limit_mb;
+  int num_group_passes;
 };
     
 void handle_arguments(int argc, char *argv[], Options& opt) {
@@ -122,8 +125,17 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "the solver focus harder on the larger errors.")
     ("parameter-tolerance",  po::value(&opt.parameter_tolerance)->default_value(1e-12),
      "Stop when the relative error in the variables being optimized is less than this.")
+    ("solver-backend", po::value(&opt.solver_backend)->default_value("auto"),
+     "The linear solver to use in the optimization. Options: auto, dense_schur, sparse_schur, iterative_schur, iterative_schur_power_series, cuda_dense_schur, cuda_sparse_schur. The default (auto) is iterative_schur, or sparse_schur if there are more than 20,000 camera position and orientation samples to optimize. The GPU ones need Ceres built with CUDA.")
+    ("solver-mixed-precision", po::bool_switch(&opt.solver_mixed_precision)->default_value(false)->implicit_value(true),
+     "Factor the Schur complement in single precision and refine the solution in double precision. This is faster, especially on the GPU, but may need more iterations.")
     ("num-iterations",       po::value(&opt.num_iterations)->default_value(500),
      "Set the maximum number of iterations.")
+    ("num-group-passes", po::value(&opt.num_group_passes)->default_value(0),
+     "If positive, solve for the cameras of each orbital group in parallel, with the "
+     "other groups fixed, then alternate, for this many passes. Each image or image list "
+     "is a group. This is faster than one joint solve, but converges well only if the "
+     "groups share few triangulated points. The default is a joint solve.")
     ("tri-weight", po::value(&opt.tri_weight)->default_value(0.0),
      "The weight to give to the constraint that optimized triangulated "
      "points stay close to original triangulated points. A positive "
@@ -178,6 +190,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      po::value(&opt.num_anchor_points_extra_lines)->default_value(0),
      "Start placing anchor points this many lines before first image line "
      "and after last image line.")
+    ("dem-memory-limit-mb", po::value(&opt.dem_memory_limit_mb)->default_value(4096),
+     "Read the DEMs from --heights-from-dem, --reference-dem, and --anchor-dem "
+     "into memory if each takes at most this many megabytes, as float. That "
+     "makes finding the points on them much faster. Otherwise they are read from "
+     "disk as needed.")
     ("rotation-weight", po::value(&opt.rotation_weight)->default_value(0.0),
      "A higher weight will penalize more deviations from the original camera orientations.")
     ("translation-weight", po::value(&opt.translation_weight)->default_value(0.0),
@@ -347,7 +364,7 @@ void compute_residuals(Options const& opt,
   ceres::Problem::EvaluateOptions eval_options;
   eval_options.apply_loss_function = false;
   if (opt.single_threaded_cameras)
-    eval_options.num_threads = 1; // ISIS must be single threaded!
+    eval_options.num_threads = 1; // some cameras must be single threaded
   else
     eval_options.num_threads = opt.num_threads;
   
@@ -703,12 +720,19 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
     double numLinesPerPosition = (numLines - 1.0) * currDtEphem / elapsed_time;
     vw_out() << "Resampled number of lines per position: "
              << numLinesPerPosition << "\n";
+    // Positions and velocities are sampled at the same times, so they
+    // share the interpolation stencils
+    std::vector<asp::LagrangeStencil> stencils;
+    asp::lagrangeStencils(numOldMeas, ls_model->m_t0Ephem, ls_model->m_dtEphem,
+                          asp::posInterpOrder(ls_model),
+                          ls_model->m_t0Ephem, currDtEphem, numNewMeas, stencils);
     std::vector<double> positions(NUM_XYZ_PARAMS * numNewMeas, 0);
     std::vector<double> velocities(NUM_XYZ_PARAMS * numNewMeas, 0);
     for (int ipos = 0; ipos < numNewMeas; ipos++) {
-      double time = ls_model->m_t0Ephem + ipos * currDtEphem;
-      asp::interpPositions(ls_model, time, &positions[NUM_XYZ_PARAMS * ipos]);
-      asp::interpVelocities(ls_model, time, &velocities[NUM_XYZ_PARAMS * ipos]);
+      asp::applyStencil(stencils[ipos], &ls_model->m_positions[0], NUM_XYZ_PARAMS,
+                        &positions[NUM_XYZ_PARAMS * ipos]);
+      asp::applyStencil(stencils[ipos], &ls_model->m_velocities[0], NUM_XYZ_PARAMS,
+                        &velocities[NUM_XYZ_PARAMS * ipos]);
     }
     
     // Overwrite in the model. Time of first tabulated position does not change.
@@ -745,11 +769,14 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
     double numLinesPerOrientation = (numLines - 1.0) * currDtQuat / elapsed_time;
     vw_out() << "Resampled number of lines per orientation: "
              << numLinesPerOrientation << "\n";
+    std::vector<asp::LagrangeStencil> stencils;
+    asp::lagrangeStencils(numOldMeas, ls_model->m_t0Quat, ls_model->m_dtQuat,
+                          asp::quatInterpOrder(ls_model),
+                          ls_model->m_t0Quat, currDtQuat, numNewMeas, stencils);
     std::vector<double> quaternions(NUM_QUAT_PARAMS * numNewMeas, 0);
-    for (int ipos = 0; ipos < numNewMeas; ipos++) {
-      double time = ls_model->m_t0Quat + ipos * currDtQuat;
-      asp::interpQuaternions(ls_model, time, &quaternions[NUM_QUAT_PARAMS * ipos]);
-    }
+    for (int ipos = 0; ipos < numNewMeas; ipos++)
+      asp::applyStencil(stencils[ipos], &ls_model->m_quaternions[0], NUM_QUAT_PARAMS,
+                        &quaternions[NUM_QUAT_PARAMS * ipos]);
     
     // Overwrite in the model. Time of first tabulated orientation does not change.
     ls_model->m_dtQuat = currDtQuat;
@@ -803,52 +830,84 @@ void calcAnchorPoints(Options                              const  & opt,
     int lenx = ceil(double(numSamples) / bin_len); lenx = std::max(1, lenx);
     int leny = ceil(double(numLines + 2 * extra) / bin_len); leny = std::max(1, leny);
 
+    double height_error_tol = 0.001; // 1 mm should be enough
     std::int64_t numAnchorPoints = 0;
+
+    // The columns are done in parallel, and their points appended in order
+    // after that, so the result does not depend on the number of threads.
+    std::vector<std::vector<Vector2>> col_pix_vec(lenx + 1);
+    std::vector<std::vector<Vector3>> col_xyz_vec(lenx + 1);
+    std::string error;
+#pragma omp parallel for schedule(dynamic, 1)
     for (int binx = 0; binx <= lenx; binx++) {
       double posx = binx * bin_len;
-      for (int biny = 0; biny <= leny; biny++) {
-        double posy = biny * bin_len - extra;
-        
-        if (posx > numSamples - 1 || posy < -extra || posy > numLines - 1 + extra) 
-          continue;
-        
-        Vector2 pix(posx, posy);
-        Vector3 xyz_guess(0, 0, 0);
-        
-        bool treat_nodata_as_zero = false;
-        bool has_intersection = false;
-        double height_error_tol = 0.001; // 1 mm should be enough
-        double max_abs_tol      = 1e-14; // abs cost fun change b/w iterations
-        double max_rel_tol      = 1e-14;
-        int num_max_iter        = 50;   // Using many iterations can be very slow
-          
-        Vector3 dem_xyz = vw::cartography::camera_pixel_to_dem_xyz
-          (opt.camera_models[icam]->camera_center(pix),
-           opt.camera_models[icam]->pixel_to_vector(pix),
-           interp_anchor_dem, anchor_georef, treat_nodata_as_zero, has_intersection,
-           height_error_tol, max_abs_tol, max_rel_tol, num_max_iter, xyz_guess);
 
-        if (!has_intersection) 
-          continue;
+      try {
+        // Intersect the rays along this column with the DEM, then project
+        // the intersections back into the camera all at once
+        std::vector<Vector2> pix_vec;
+        std::vector<Vector3> dem_xyz_vec;
+        for (int biny = 0; biny <= leny; biny++) {
+          double posy = biny * bin_len - extra;
+          
+          if (posx > numSamples - 1 || posy < -extra || posy > numLines - 1 + extra) 
+            continue;
+          
+          Vector2 pix(posx, posy);
+          Vector3 xyz_guess(0, 0, 0);
+          
+          bool treat_nodata_as_zero = false;
+          bool has_intersection = false;
+          double max_abs_tol      = 1e-14; // abs cost fun change b/w iterations
+          double max_rel_tol      = 1e-14;
+          int num_max_iter        = 50;   // Using many iterations can be very slow
+            
+          Vector3 dem_xyz = vw::cartography::camera_pixel_to_dem_xyz
+            (opt.camera_models[icam]->camera_center(pix),
+             opt.camera_models[icam]->pixel_to_vector(pix),
+             interp_anchor_dem, anchor_georef, treat_nodata_as_zero, has_intersection,
+             height_error_tol, max_abs_tol, max_rel_tol, num_max_iter, xyz_guess);
+
+          if (!has_intersection) 
+            continue;
+
+          pix_vec.push_back(pix);
+          dem_xyz_vec.push_back(dem_xyz);
+        }
 
-        Vector2 pix_out;
-        try {
-          pix_out = opt.camera_models[icam]->point_to_pixel(dem_xyz);
-        } catch (...) {
-          continue;
+        std::vector<Vector2> pix_out_vec;
+        asp::points_to_pixels(opt.camera_models[icam].get(), dem_xyz_vec, pix_out_vec);
+
+        for (size_t it = 0; it < pix_vec.size(); it++) {
+          Vector2 pix = pix_vec[it], pix_out = pix_out_vec[it];
+          if (std::isnan(pix_out[0]))
+            continue; // could not project
+          if (norm_2(pix - pix_out) > 10 * height_error_tol)
+            continue; // this is likely a bad point
+          col_pix_vec[binx].push_back(pix);
+          col_xyz_vec[binx].push_back(dem_xyz_vec[it]);
         }
-        
-        if (norm_2(pix - pix_out) > 10 * height_error_tol)
-          continue; // this is likely a bad point
+      } catch (std::exception const& e) {
+#pragma omp critical
+        {
+          if (error.empty())
+            error = e.what();
+        }
+      }
+    }
+    if (!error.empty())
+      vw::vw_throw(vw::ArgumentErr() << "Failed to create anchor points: " << error << "\n");
 
-        pixel_vec[icam].push_back(pix);
+    for (int binx = 0; binx <= lenx; binx++) {
+      for (size_t it = 0; it < col_pix_vec[binx].size(); it++) {
+        pixel_vec[icam].push_back(col_pix_vec[binx][it]);
         weight_vec[icam].push_back(opt.anchor_weight);
         isAnchor_vec[icam].push_back(1);
 
         // Create a shared_ptr as we need a pointer per the api to use later
         xyz_vec[icam].push_back(boost::shared_ptr<Vector3>(new Vector3()));
         Vector3 & xyz = *xyz_vec[icam].back().get(); // alias to the element we just made
-        xyz = dem_xyz; // copy the value, but the pointer does not change
+        xyz = col_xyz_vec[binx][it]; // copy the value, but the pointer does not change
         xyz_vec_ptr[icam].push_back(&xyz[0]); // keep the pointer to the first element
         numAnchorPoints++;
       }   
@@ -1400,6 +1459,10 @@ void prepareCsmCameras(Options const& opt,
     if (csm_cam == NULL)
       vw::vw_throw(vw::ArgumentErr() << "Expecting CSM cameras.\n");
 
+    // The model will be modified below, so it must not be shared with
+    // other loaded cameras
+    csm_cam->make_model_unique();
+
     if (!opt.input_prefix.empty()) {
       std::string adjust_file
         = asp::bundle_adjust_file_name(opt.input_prefix, opt.image_files[icam],
@@ -1536,6 +1599,257 @@ void formTriVec(std::vector<Vector3> const& dem_xyz_vec,
   return;
 }
 
+// With more than this many camera parameter blocks, such as for a long
+// linescan strip with dense position and orientation samples, the default
+// is to factor the reduced camera system rather than solve it iteratively.
+const int MAX_CAMERA_BLOCKS_FOR_ITERATIVE_SOLVER = 20000;
+
+// The triangulated and anchor points which are in the problem
+void pointBlocks(std::vector<std::vector<double*>> const& xyz_vec_ptr,
+                 ceres::Problem const& problem,
+                 std::set<double*> & points) {
+  points.clear();
+  for (size_t icam = 0; icam < xyz_vec_ptr.size(); icam++) {
+    for (size_t ipix = 0; ipix < xyz_vec_ptr[icam].size(); ipix++) {
+      double * ptr = xyz_vec_ptr[icam][ipix];
+      if (problem.HasParameterBlock(ptr))
+        points.insert(ptr);
+    }
+  }
+}
+
+// Tell the solver to eliminate the given points first, then solve for the
+// camera parameters. Ceres would otherwise search for such an ordering
+// itself, which is slow for large problems. Within a linescan camera the
+// parameter blocks are listed in time order, as they are stored
+// contiguously, and each observation depends only on a few consecutive
+// samples, so the reduced camera system is block-banded. Return the number
+// of camera parameter blocks.
+int setSolverOrdering(std::set<double*> const& points,
+                      ceres::Problem & problem,
+                      ceres::Solver::Options & options) {
+
+  std::vector<double*> blocks;
+  problem.GetParameterBlocks(&blocks);
+  int num_camera_blocks = int(blocks.size()) - int(points.size());
+
+  // Let the solver decide if there is nothing to eliminate
+  options.linear_solver_ordering.reset();
+  if (points.empty() || num_camera_blocks <= 0)
+    return num_camera_blocks;
+
+  auto ordering = std::make_shared<ceres::ParameterBlockOrdering>();
+  for (size_t it = 0; it < blocks.size(); it++)
+    ordering->AddElementToGroup(blocks[it], points.count(blocks[it]) > 0 ? 0 : 1);
+  options.linear_solver_ordering = ordering;
+
+  return num_camera_blocks;
+}
+
+// Map each camera parameter block to the orbital group of its camera
+void cameraBlockGroups(Options                     const& opt,
+                       std::vector<asp::CsmModel*> const& csm_models,
+                       std::vector<double>              & frame_params,
+                       std::map<double*, int>           & block_group) {
+
+  block_group.clear();
+  for (size_t icam = 0; icam < csm_models.size(); icam++) {
+    auto it = opt.orbital_groups.find(icam);
+    if (it == opt.orbital_groups.end())
+      vw::vw_throw(vw::ArgumentErr()
+                   << "Failed to find the orbital group for camera: " << icam << ".\n");
+    int group = it->second;
+
+    UsgsAstroLsSensorModel * ls_model
+      = dynamic_cast<UsgsAstroLsSensorModel*>((csm_models[icam]->m_gm_model).get());
+    UsgsAstroFrameSensorModel * frame_model
+      = dynamic_cast<UsgsAstroFrameSensorModel*>((csm_models[icam]->m_gm_model).get());
+
+    if (ls_model != NULL) {
+      for (size_t it = 0; it < ls_model->m_quaternions.size(); it += NUM_QUAT_PARAMS)
+        block_group[&ls_model->m_quaternions[it]] = group;
+      for (size_t it = 0; it < ls_model->m_positions.size(); it += NUM_XYZ_PARAMS)
+        block_group[&ls_model->m_positions[it]] = group;
+    } else if (frame_model != NULL) {
+      double * curr_params = &frame_params[icam * (NUM_XYZ_PARAMS + NUM_QUAT_PARAMS)];
+      block_group[curr_params] = group;
+      block_group[curr_params + NUM_XYZ_PARAMS] = group;
+    }
+  }
+}
+
+// Solve for the cameras one orbital group at a time, with the cameras in
+// other groups fixed, for all groups in parallel, then alternate. Each
+// group has its own copy of its cameras and the points they see, so the
+// solves do not interact. The problems for the groups share the cost and
+// loss functions of the full problem, and only read the parameters of the
+// other groups, which change only between passes. After each pass the
+// cameras are updated and a point seen by several groups is set to the
+// mean of their estimates. This converges well only if the groups are
+// weakly coupled through the points.
+void solveByGroup(Options                     const& opt,
+                  std::vector<asp::CsmModel*> const& csm_models,
+                  std::set<double*>           const& points,
+                  ceres::Solver::Options      const& options,
+                  std::vector<double>              & frame_params,
+                  ceres::Problem                   & problem) {
+
+  std::map<double*, int> block_group;
+  cameraBlockGroups(opt, csm_models, frame_params, block_group);
+
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+  problem.GetResidualBlocks(&residual_blocks);
+  int num_res = residual_blocks.size();
+
+  // The groups each residual depends on through its cameras, and the
+  // points of each group
+  std::vector<std::set<int>> res_groups(num_res);
+  std::map<int, std::set<double*>> group_points;
+  std::vector<double*> blocks;
+  for (int ires = 0; ires < num_res; ires++) {
+    problem.GetParameterBlocksForResidualBlock(residual_blocks[ires], &blocks);
+    for (size_t ib = 0; ib < blocks.size(); ib++) {
+      auto it = block_group.find(blocks[ib]);
+      if (it != block_group.end())
+        res_groups[ires].insert(it->second);
+    }
+  }
+  for (int ires = 0; ires < num_res; ires++) {
+    if (res_groups[ires].empty())
+      continue;
+    problem.GetParameterBlocksForResidualBlock(residual_blocks[ires], &blocks);
+    for (size_t ib = 0; ib < blocks.size(); ib++) {
+      if (points.count(blocks[ib]) == 0)
+        continue;
+      for (auto g: res_groups[ires])
+        group_points[g].insert(blocks[ib]);
+    }
+  }
+
+  std::vector<int> groups;
+  for (auto const& p: group_points)
+    groups.push_back(p.first);
+  int num_groups = groups.size();
+  vw_out() << "Solving for " << num_groups << " orbital groups in parallel, in "
+           << opt.num_group_passes << " passes.\n";
+
+  // Share the threads among the groups solved at the same time
+  ceres::Solver::Options group_options = options;
+  group_options.minimizer_progress_to_stdout = false;
+  if (!opt.single_threaded_cameras)
+    group_options.num_threads = std::max(1, opt.num_threads / std::max(1, num_groups));
+
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+
+  for (int pass = 0; pass < opt.num_group_passes; pass++) {
+
+    // The copies of the parameters solved for by each group
+    std::vector<std::map<double*, std::vector<double>>> copies(num_groups);
+    std::vector<ceres::Solver::Summary> summaries(num_groups);
+    bool success = true;
+    std::string error;
+
+    // Some cameras must be used from a single thread
+#pragma omp parallel for schedule(dynamic) if (!opt.single_threaded_cameras)
+    for (int ig = 0; ig < num_groups; ig++) {
+      try {
+        int group = groups[ig];
+        std::set<double*> const& pts = group_points.at(group);
+        auto & group_copies = copies[ig];
+        ceres::Problem group_problem(problem_options);
+        std::set<double*> copied_points;
+        std::vector<double*> res_blocks, vars;
+        for (int ires = 0; ires < num_res; ires++) {
+          problem.GetParameterBlocksForResidualBlock(residual_blocks[ires], &res_blocks);
+          // Use the residuals for the cameras of this group, and the other
+          // ones for its points, such as constraints on the points or
+          // observations of them by other groups
+          bool use = (res_groups[ires].count(group) > 0);
+          for (size_t ib = 0; ib < res_blocks.size() && !use; ib++)
+            use = (pts.count(res_blocks[ib]) > 0);
+          if (!use)
+            continue;
+
+          // Solve for copies of the parameters of this group. The rest are
+          // used as they are, and kept fixed.
+          vars.clear();
+          std::vector<double*> fixed;
+          for (size_t ib = 0; ib < res_blocks.size(); ib++) {
+            double * orig = res_blocks[ib];
+            auto bg = block_group.find(orig);
+            bool own = (pts.count(orig) > 0) ||
+                       (bg != block_group.end() && bg->second == group);
+            if (!own || problem.IsParameterBlockConstant(orig)) {
+              vars.push_back(orig);
+              fixed.push_back(orig);
+              continue;
+            }
+            auto cp = group_copies.find(orig);
+            if (cp == group_copies.end()) {
+              int size = problem.ParameterBlockSize(orig);
+              cp = group_copies.insert(std::make_pair(orig,
+                                         std::vector<double>(orig, orig + size))).first;
+            }
+            vars.push_back(&cp->second[0]);
+            if (pts.count(orig) > 0)
+              copied_points.insert(&cp->second[0]);
+          }
+          group_problem.AddResidualBlock
+            (const_cast<ceres::CostFunction*>
+             (problem.GetCostFunctionForResidualBlock(residual_blocks[ires])),
+             const_cast<ceres::LossFunction*>
+             (problem.GetLossFunctionForResidualBlock(residual_blocks[ires])),
+             vars);
+          for (size_t ib = 0; ib < fixed.size(); ib++)
+            group_problem.SetParameterBlockConstant(fixed[ib]);
+        }
+
+        ceres::Solver::Options curr_options = group_options;
+        setSolverOrdering(copied_points, group_problem, curr_options);
+        ceres::Solve(curr_options, &group_problem, &summaries[ig]);
+      } catch (std::exception const& e) {
+#pragma omp critical
+        {
+          success = false;
+          error = e.what();
+        }
+      }
+    }
+    if (!success)
+      vw::vw_throw(vw::ArgumentErr() << error);
+
+    // Update the cameras, and average the points over the groups
+    std::map<double*, std::vector<double>> point_sums;
+    std::map<double*, int> point_counts;
+    double init_cost = 0.0, final_cost = 0.0;
+    for (int ig = 0; ig < num_groups; ig++) {
+      init_cost  += summaries[ig].initial_cost;
+      final_cost += summaries[ig].final_cost;
+      for (auto const& cp: copies[ig]) {
+        double * orig = cp.first;
+        if (points.count(orig) == 0) {
+          std::copy(cp.second.begin(), cp.second.end(), orig);
+          continue;
+        }
+        auto & sum = point_sums[orig];
+        sum.resize(NUM_XYZ_PARAMS, 0.0);
+        for (int c = 0; c < NUM_XYZ_PARAMS; c++)
+          sum[c] += cp.second[c];
+        point_counts[orig]++;
+      }
+    }
+    for (auto const& ps: point_sums) {
+      for (int c = 0; c < NUM_XYZ_PARAMS; c++)
+        ps.first[c] = ps.second[c] / point_counts[ps.first];
+    }
+
+    vw_out() << "Pass " << pass + 1 << ": sum over groups of initial and final cost: "
+             << init_cost << ", " << final_cost << "\n";
+  }
+}
+
 void run_jitter_solve(int argc, char* argv[]) {
 
   // Parse arguments and perform validation
@@ -1646,20 +1960,20 @@ void run_jitter_solve(int argc, char* argv[]) {
   
   bool have_dem = (!opt.heights_from_dem.empty() || !opt.ref_dem.empty());
 
-  // Create anchor xyz with the help of a DEM in two ways.
-  // TODO(oalexan1): Study how to best pass the DEM to avoid the code
-  // below not being slow. It is not clear if the DEM tiles are cached
-  // when passing around an ImageViewRef.
+  // Create anchor xyz with the help of a DEM in two ways. The DEMs are
+  // interpolated very many times, so read them into memory if not too big.
   std::vector<Vector3> dem_xyz_vec;
   vw::cartography::GeoReference dem_georef, anchor_georef;
   ImageViewRef<PixelMask<double>> interp_dem, interp_anchor_dem;
   if (opt.heights_from_dem != "") {
-    asp::create_interp_dem(opt.heights_from_dem, dem_georef, interp_dem);
+    asp::create_in_memory_interp_dem(opt.heights_from_dem, opt.dem_memory_limit_mb,
+                                     dem_georef, interp_dem);
     asp::update_point_height_from_dem(cnet, outliers, dem_georef, interp_dem,  
                                       // Output
                                       dem_xyz_vec);
   } else if (opt.ref_dem != "") {
-    asp::create_interp_dem(opt.ref_dem, dem_georef, interp_dem);
+    asp::create_in_memory_interp_dem(opt.ref_dem, opt.dem_memory_limit_mb,
+                                     dem_georef, interp_dem);
     asp::calc_avg_intersection_with_dem(cnet, crn, outliers, opt.camera_models,
                                         dem_georef, interp_dem,
                                         // Output
@@ -1667,7 +1981,8 @@ void run_jitter_solve(int argc, char* argv[]) {
   }
   
   if (opt.anchor_dem != "")
-    asp::create_interp_dem(opt.anchor_dem, anchor_georef, interp_anchor_dem);
+    asp::create_in_memory_interp_dem(opt.anchor_dem, opt.dem_memory_limit_mb,
+                                     anchor_georef, interp_anchor_dem);
 
   // Handle the roll/yaw constraint DEM. We already checked that one of thse cases should work
   vw::cartography::GeoReference roll_yaw_georef;
@@ -1788,14 +2103,35 @@ void run_jitter_solve(int argc, char* argv[]) {
   options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
   options.preconditioner_type = ceres::SCHUR_JACOBI;
   options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+  std::set<double*> points;
+  pointBlocks(xyz_vec_ptr, problem, points);
+  int num_camera_blocks = setSolverOrdering(points, problem, options);
+  vw_out() << "Number of camera parameter blocks: " << num_camera_blocks << "\n";
+  if (opt.solver_backend == "auto" &&
+      num_camera_blocks > MAX_CAMERA_BLOCKS_FOR_ITERATIVE_SOLVER) {
+    // The Jacobi preconditioner ignores the coupling between consecutive
+    // samples, so the iterative solver converges slowly. The banded
+    // system is cheap to factor instead.
+    vw_out() << "Using the sparse Schur solver, given the many camera parameters.\n";
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+  }
+  asp::set_solver_backend(opt.solver_backend, opt.solver_mixed_precision,
+                          opt.camera_models.size(), options);
   
   // Solve the problem
   vw_out() << "Starting the Ceres optimizer." << std::endl;
-  ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem, &summary);
-  vw_out() << summary.FullReport() << "\n";
-  if (summary.termination_type == ceres::NO_CONVERGENCE) 
-    vw_out() << "Found a valid solution, but did not reach the actual minimum.\n";
+  asp::record_problem_size(problem);
+  asp::TelemetryTimer solve_timer("jitter_solve.solve");
+  if (opt.num_group_passes > 0) {
+    solveByGroup(opt, csm_models, points, options, frame_params, problem);
+  } else {
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    vw_out() << summary.FullReport() << "\n";
+    if (summary.termination_type == ceres::NO_CONVERGENCE) 
+      vw_out() << "Found a valid solution, but did not reach the actual minimum.\n";
+  }
+  solve_timer.stop();
 
   // With the problem solved, update camera_models based on frame_params
   // (applies only to frame cameras, if any)
@@ -33,6 +33,7 @@
 
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/OpenCVUtils.h>
 #include <asp/Tools/stereo.h>
 
 #include <iomanip>
@@ -76,6 +77,7 @@ struct Parameters : vw::GdalWriteOptions
   int   lrthresh;
   int   correlator_type;
   int   cropWidth;  
+  int   phaseCorrWindow;
 };
 
 
@@ -95,7 +97,8 @@ bool handle_arguments(int argc, char* argv[],
     ("kernel",          po::value(&opt.kernel    )->default_value(Vector2i(15,15)), "Correlation kernel size")
     ("lrthresh",        po::value(&opt.lrthresh  )->default_value(2), "Left/right correspondence threshold")
     ("correlator-type", po::value(&opt.correlator_type)->default_value(0), "0 - Abs difference; 1 - Sq Difference; 2 - NormXCorr")
-    ("affine-subpix", "Enable affine adaptive sub-pixel correlation (slower, but more accurate)");
+    ("affine-subpix", "Enable affine adaptive sub-pixel correlation (slower, but more accurate)")
+    ("phase-corr-window", po::value(&opt.phaseCorrWindow)->default_value(0), "If positive, find the offset of each line by FFT phase correlation of a window of this many lines around it, spanning the crop width, rather than with the correlator. The lines are done in parallel.");
   
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
     
@@ -121,9 +124,93 @@ bool handle_arguments(int argc, char* argv[],
     vw_throw( ArgumentErr() << "Requires <left> and <right> input in order to proceed.\n\n"
               << usage << general_options );
 
+  if (opt.phaseCorrWindow < 0 || opt.phaseCorrWindow == 1)
+    vw_throw( ArgumentErr() << "The phase correlation window must be 0 or at least 2.\n\n"
+              << usage << general_options );
+
   return true;
 }
 
+// Copy a window for phase correlation. Pixels which are not positive
+// are invalid, and are replaced by the mean of the valid ones. Return
+// false if fewer than half are valid.
+bool phaseCorrWindow(ImageView<PixelGray<float> > const& image, BBox2i const& box,
+                     ImageView<double> & win) {
+  win.set_size(box.width(), box.height());
+  double sum = 0.0;
+  int count = 0;
+  for (int row = 0; row < box.height(); row++) {
+    for (int col = 0; col < box.width(); col++) {
+      win(col, row) = image(col + box.min().x(), row + box.min().y());
+      if (win(col, row) > 0) {
+        sum += win(col, row);
+        count++;
+      }
+    }
+  }
+  if (2 * count < box.width() * box.height())
+    return false;
+  double mean = sum / count;
+  for (int row = 0; row < box.height(); row++)
+    for (int col = 0; col < box.width(); col++)
+      if (win(col, row) <= 0)
+        win(col, row) = mean;
+  return true;
+}
+
+// Find the offset of each line by FFT phase correlation of a window of
+// lines around it, with the right window shifted by the center of the
+// search region. The result has one column, with the offset of each line.
+ImageView<PixelMask<Vector2f> >
+phaseCorrelateLines(Parameters const& params,
+                    ImageViewRef<PixelGray<float> > left_image,
+                    ImageViewRef<PixelGray<float> > right_image,
+                    BBox2i const& crop_roi, BBox2i const& searchRegion) {
+
+  // A shift beyond the window, or a weak peak, is not trusted
+  const double MIN_RESPONSE = 0.02;
+
+  Vector2i center = (searchRegion.min() + searchRegion.max()) / 2;
+  ImageView<PixelGray<float> > left  = crop(left_image, crop_roi);
+  ImageView<PixelGray<float> > right = crop(edge_extend(right_image, ZeroEdgeExtension()),
+                                            crop_roi + center);
+
+  int num_rows = left.rows();
+  int hgt = std::min(params.phaseCorrWindow, num_rows);
+  ImageView<PixelMask<Vector2f> > offsets(1, num_rows);
+
+  int num_threads = params.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  vw::TerminalProgressCallback tpc("asp", "\t--> Phase correlation: ");
+  int num_done = 0;
+#pragma omp parallel for schedule(dynamic, 64) num_threads(num_threads)
+  for (int row = 0; row < num_rows; row++) {
+    offsets(0, row).invalidate();
+
+    int start = std::max(0, std::min(row - hgt / 2, num_rows - hgt));
+    BBox2i box(0, start, left.cols(), hgt);
+    ImageView<double> win1, win2;
+    if (phaseCorrWindow(left, box, win1) && phaseCorrWindow(right, box, win2)) {
+      double response = 0.0;
+      Vector2 shift = asp::phaseCorrelationShift(win1, win2, response);
+      if (response >= MIN_RESPONSE &&
+          std::abs(shift[0]) < box.width() / 2 && std::abs(shift[1]) < box.height() / 2)
+        offsets(0, row) = PixelMask<Vector2f>(Vector2f(shift + Vector2(center)));
+    }
+
+#pragma omp critical
+    {
+      num_done++;
+      if (num_done % 1000 == 0)
+        tpc.report_fractional_progress(num_done, num_rows);
+    }
+  }
+  tpc.report_finished();
+
+  return offsets;
+}
+
 bool determineShifts(Parameters & params, 
                      double &dX, double &dY)
 {
@@ -253,6 +340,15 @@ bool determineShifts(Parameters & params,
   else if (params.correlator_type == 2)
     corr_type = CROSS_CORRELATION;
  
+  // With phase correlation, the disparity has one column, with the
+  // offset of each line
+  ImageViewRef<PixelMask<Vector2f> > disparity_map;
+  if (params.phaseCorrWindow > 0) {
+    printf("Running phase correlation...\n");
+    disparity_map = phaseCorrelateLines(params, left_disk_image, right_disk_image,
+                                        crop_roi, searchRegion);
+  } else {
+
   printf("Running stereo correlation...\n");
   
   // Pyramid Correlation works best rasterizing in 1024^2 chunks
@@ -263,8 +359,7 @@ bool determineShifts(Parameters & params,
   int    corr_timeout       = 0;
   int    min_lr_level = 0;
   double seconds_per_op     = 0.0;
-  DiskCacheImageView<PixelMask<Vector2f> >
-    disparity_map
+  disparity_map = DiskCacheImageView<PixelMask<Vector2f> >
     ( stereo::pyramid_correlate( apply_mask(create_mask_less_or_equal(crop(left_disk_image,  crop_roi),0)),
 				 apply_mask(create_mask_less_or_equal(crop(right_disk_image, crop_roi),0)),
 				 constant_view( uint8(255), left_disk_image ),
@@ -274,6 +369,7 @@ bool determineShifts(Parameters & params,
 				 params.kernel,
 				 corr_type, corr_timeout, seconds_per_op,
 				 params.lrthresh, min_lr_level, filter_kernel_size, max_pyramid_levels ) );
+  }
 
   // Compute the mean horizontal and vertical shifts
   // - Currently disparity_map contains the per-pixel shifts
@@ -399,12 +495,15 @@ bool determineShifts(Parameters & params,
     out << "#   Line Spacing:     " << setprecision(1) << 1 << endl;
     out << "#   Columns, Rows:    " << params.kernel[0] << " " << params.kernel[1] << endl;
     out << "#   Corr. Algorithm:  ";
-    switch(params.correlator_type)
-    {
-      case 1:  out << "SQUARED_DIFFERENCE"  << endl; break;
-      case 2:  out << "CROSS_CORRELATION"   << endl; break;
-      default: out << "ABSOLUTE_DIFFERENCE" << endl; break;
-    };
+    if (params.phaseCorrWindow > 0)
+      out << "PHASE_CORRELATION" << endl;
+    else
+      switch(params.correlator_type)
+      {
+        case 1:  out << "SQUARED_DIFFERENCE"  << endl; break;
+        case 2:  out << "CROSS_CORRELATION"   << endl; break;
+        default: out << "ABSOLUTE_DIFFERENCE" << endl; break;
+      };
     if(numValidRows > 0) 
     {
       out << "#   Using IpFind result only:   0" << endl;
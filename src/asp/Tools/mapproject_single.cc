@@ -34,6 +34,10 @@
 #include <asp/Core/Common.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/InterpolatedTransform.h>
+#include <asp/Camera/RPCMapTransform.h>
+#include <asp/Core/CameraFootprint.h>
+#include <asp/Core/BigTileWriter.h>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -47,7 +51,7 @@ struct Options : vw::GdalWriteOptions {
   // Input
   std::string dem_file, image_file, camera_file, output_file, stereo_session,
     bundle_adjust_prefix;
-  bool isQuery, noGeoHeaderInfo, nearest_neighbor, parseOptions, dg_use_csm;
+  bool isQuery, noGeoHeaderInfo, nearest_neighbor, parseOptions, dg_use_csm, cog;
   bool multithreaded_model; // This is set based on the session type.
   bool enable_correct_velocity_aberration, enable_correct_atmospheric_refraction;
   
@@ -56,7 +60,8 @@ struct Options : vw::GdalWriteOptions {
   
   // Settings
   std::string target_srs_string, output_type, metadata;
-  double nodata_value, tr, mpp, ppd, datum_offset;
+  double nodata_value, tr, mpp, ppd, datum_offset, transform_grid_tol;
+  int transform_grid_step;
   BBox2 target_projwin, target_pixelwin;
 };
 
@@ -93,6 +98,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("ot",  po::value(&opt.output_type)->default_value("Float32"), "Output data type, when the input is single channel. Supported types: Byte, UInt16, Int16, UInt32, Int32, Float32. If the output type is a kind of integer, values are rounded and then clamped to the limits of that type. This option will be ignored for multi-channel images, when the output type is set to be the same as the input type.")
     ("nearest-neighbor", po::bool_switch(&opt.nearest_neighbor)->default_value(false),
      "Use nearest neighbor interpolation.  Useful for classification images.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Add internal overviews to the output image, computed while it is written, so that it can be viewed efficiently over the network.")
     ("mo",  po::value(&opt.metadata)->default_value(""), "Write metadata to the output file. Provide as a string in quotes if more than one item, separated by a space, such as 'VAR1=VALUE1 VAR2=VALUE2'. Neither the variable names nor the values should contain spaces.")
     ("no-geoheader-info", po::bool_switch(&opt.noGeoHeaderInfo)->default_value(false),
      "Do not write metadata information in the geoheader. See the doc for more info.")
@@ -102,6 +109,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Turn on atmospheric refraction correction for Optical Bar and non-ISIS linescan cameras. This option impairs the convergence of bundle adjustment.")
     ("dg-use-csm", po::bool_switch(&opt.dg_use_csm)->default_value(false)->implicit_value(true),
      "Use the CSM model with DigitalGlobe linescan cameras (-t dg). No corrections are done for velocity aberration or atmospheric refraction.")
+    ("transform-grid-step", po::value(&opt.transform_grid_step)->default_value(0),
+     "If positive, find the camera pixel for each output pixel exactly only on a grid with this spacing, in output pixels, and interpolate bilinearly in between. The grid is refined where the interpolation error is more than --transform-grid-tol. This is much faster for linescan cameras. A value of 16 is suggested.")
+    ("transform-grid-tol", po::value(&opt.transform_grid_tol)->default_value(0.01),
+     "The largest allowed interpolation error, in camera pixels, when --transform-grid-step is positive.")
     ("parse-options", po::bool_switch(&opt.parseOptions)->default_value(false),
      "Parse the options and print the results. Used by the mapproject script.")
     ;
@@ -139,6 +150,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     opt.camera_file = "";
   }
 
+  if (opt.transform_grid_step < 0 || opt.transform_grid_tol <= 0)
+    vw_throw(ArgumentErr() << "The value of --transform-grid-step must be non-negative, "
+             << "and of --transform-grid-tol positive.\n" << usage << general_options);
+
   if (asp::has_cam_extension(opt.output_file))
     vw_throw(ArgumentErr() << "The output file is a camera. Check your inputs.\n");
 
@@ -297,9 +312,17 @@ void write_parallel_cond(std::string              const& filename,
 
   // ISIS is not thread safe so we must switch out based on what the session is.
   vw_out() << "Writing: " << filename << "\n";
-  if (opt.multithreaded_model) {
-    vw::cartography::block_write_gdal_image(filename, image.impl(), has_georef, georef,
-                                has_nodata, nodata_val, opt, tpc, keywords);
+  if (opt.cog) {
+    // Write with overviews. The camera may not be usable from multiple threads.
+    vw::GdalWriteOptions cog_opt = opt;
+    if (!opt.multithreaded_model)
+      cog_opt.num_threads = 1;
+    int big_tile_size = 1024;
+    asp::save_in_big_tiles(big_tile_size, filename, image.impl(), has_georef, georef,
+                           has_nodata, nodata_val, cog_opt, tpc, opt.cog, keywords);
+  } else if (opt.multithreaded_model) {
+    asp::async_block_write_gdal_image(filename, image.impl(), has_georef, georef,
+                                      has_nodata, nodata_val, opt, tpc, keywords);
   } else {
     vw::cartography::write_gdal_image(filename, image.impl(), has_georef, georef,
                           has_nodata, nodata_val, opt, tpc, keywords);
@@ -389,10 +412,15 @@ void calc_target_geom(// Inputs
   float auto_res = -1.0;  // will be updated
   bool quick = datum_dem; // The non-quick option does not make sense with huge DEMs.
   try {
-    cam_box = camera_bbox(dem, dem_georef,
-                          target_georef, 
-                          camera_model,
-                          image_size.x(), image_size.y(), auto_res, quick);
+    if (datum_dem)
+      cam_box = camera_bbox(dem, dem_georef,
+                            target_georef, 
+                            camera_model,
+                            image_size.x(), image_size.y(), auto_res, quick);
+    else // Use a coarse DEM first, as huge DEMs are slow to intersect
+      cam_box = asp::fast_camera_bbox(opt.dem_file, dem, dem_georef, target_georef,
+                                      camera_model, image_size.x(), image_size.y(),
+                                      auto_res, quick);
   } catch (std::exception const& e) {
     if (opt.target_projwin == BBox2() || calc_target_res) {
       vw_throw( ArgumentErr()
@@ -600,6 +628,82 @@ void project_image_alpha(Options & opt,
 
 }
 
+/// The RPC model, if the camera is an RPC model without adjustments and
+/// each tile can be projected into it at once. Then the result is the
+/// same as with the original transform, except that the DEM is always
+/// interpolated bilinearly.
+asp::RPCModel const* rpc_for_tiles(Options const& opt,
+                                   boost::shared_ptr<camera::CameraModel> const& camera_model) {
+  if (opt.transform_grid_step > 0 || opt.nearest_neighbor)
+    return NULL;
+  return dynamic_cast<asp::RPCModel const*>(camera_model.get());
+}
+
+/// The DEM to use with RPCMapTransform, or an empty string for a datum
+std::string rpc_dem_file(Options const& opt) {
+  if (fs::path(opt.dem_file).extension() != "")
+    return opt.dem_file;
+  return "";
+}
+
+/// Map project with the given transform, or, if --transform-grid-step is
+/// positive, with the transform interpolated from a sparse grid. With an
+/// RPC camera, project each tile into the camera at once.
+template <class ImagePixelT, class Map2CamTransT>
+void project_image_nodata_maybe_interp(Options & opt,
+                                       GeoReference const& dem_georef,
+                                       GeoReference const& target_georef,
+                                       GeoReference const& croppedGeoRef,
+                                       Vector2i     const& virtual_image_size,
+                                       BBox2i       const& croppedImageBB,
+                                       Vector2i     const& image_size,
+                                       boost::shared_ptr<camera::CameraModel> const& camera_model,
+                                       Map2CamTransT const& transform) {
+  asp::RPCModel const* rpc = rpc_for_tiles(opt, camera_model);
+  if (opt.transform_grid_step > 0)
+    project_image_nodata<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                      asp::InterpolatedTransform<Map2CamTransT>
+                                      (transform, opt.transform_grid_step,
+                                       opt.transform_grid_tol, image_size));
+  else if (rpc != NULL)
+    project_image_nodata<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                      asp::RPCMapTransform<Map2CamTransT>
+                                      (transform, rpc, target_georef, dem_georef,
+                                       rpc_dem_file(opt), opt.datum_offset, image_size));
+  else
+    project_image_nodata<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                      transform);
+}
+
+/// Same as above, for images with an alpha channel
+template <class ImagePixelT, class Map2CamTransT>
+void project_image_alpha_maybe_interp(Options & opt,
+                                      GeoReference const& dem_georef,
+                                      GeoReference const& target_georef,
+                                      GeoReference const& croppedGeoRef,
+                                      Vector2i     const& virtual_image_size,
+                                      BBox2i       const& croppedImageBB,
+                                      Vector2i     const& image_size,
+                                      boost::shared_ptr<camera::CameraModel> const& camera_model,
+                                      Map2CamTransT const& transform) {
+  asp::RPCModel const* rpc = rpc_for_tiles(opt, camera_model);
+  if (opt.transform_grid_step > 0)
+    project_image_alpha<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                     camera_model,
+                                     asp::InterpolatedTransform<Map2CamTransT>
+                                     (transform, opt.transform_grid_step,
+                                      opt.transform_grid_tol, image_size));
+  else if (rpc != NULL)
+    project_image_alpha<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                     camera_model,
+                                     asp::RPCMapTransform<Map2CamTransT>
+                                     (transform, rpc, target_georef, dem_georef,
+                                      rpc_dem_file(opt), opt.datum_offset, image_size));
+  else
+    project_image_alpha<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                     camera_model, transform);
+}
+
 // The two "pick" functions below select between the Map2CamTrans and Datum2CamTrans
 // transform classes which will be passed to the image projection function.
 // - TODO: Is there a good reason for the transform classes to be CRTP instead of virtual?
@@ -616,8 +720,10 @@ void project_image_nodata_pick_transform(Options & opt,
   const bool        call_from_mapproject = true;
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
-    return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
-                                             virtual_image_size, croppedImageBB,
+    return project_image_nodata_maybe_interp<ImagePixelT>(opt, dem_georef, target_georef,
+                                             croppedGeoRef,
+                                             virtual_image_size, croppedImageBB, image_size,
+                                             camera_model,
                                              Map2CamTrans(// Converts coordinates in DEM
                                                           // georeference to camera pixels
                                                           camera_model.get(), target_georef,
@@ -626,8 +732,10 @@ void project_image_nodata_pick_transform(Options & opt,
                                                           opt.nearest_neighbor));
   } else {
     // A constant datum elevation was provided
-    return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
-                                             virtual_image_size, croppedImageBB,
+    return project_image_nodata_maybe_interp<ImagePixelT>(opt, dem_georef, target_georef,
+                                             croppedGeoRef,
+                                             virtual_image_size, croppedImageBB, image_size,
+                                             camera_model,
                                              Datum2CamTrans
                                              (// Converts coordinates in DEM
                                               // georeference to camera pixels
@@ -652,8 +760,10 @@ void project_image_alpha_pick_transform(Options & opt,
   const bool        call_from_mapproject = true;
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
-    return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
-                                            virtual_image_size, croppedImageBB, camera_model, 
+    return project_image_alpha_maybe_interp<ImagePixelT>(opt, dem_georef, target_georef,
+                                            croppedGeoRef,
+                                            virtual_image_size, croppedImageBB, image_size,
+                                            camera_model, 
                                             Map2CamTrans(// Converts coordinates in DEM
                                                          // georeference to camera pixels
                                                          camera_model.get(), target_georef,
@@ -662,8 +772,10 @@ void project_image_alpha_pick_transform(Options & opt,
                                                          opt.nearest_neighbor));
   } else {
     // A constant datum elevation was provided
-    return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
-                                            virtual_image_size, croppedImageBB, camera_model, 
+    return project_image_alpha_maybe_interp<ImagePixelT>(opt, dem_georef, target_georef,
+                                            croppedGeoRef,
+                                            virtual_image_size, croppedImageBB, image_size,
+                                            camera_model, 
                                             Datum2CamTrans(// Converts coordinates in DEM
                                                            // georeference to camera pixels
                                                            camera_model.get(), target_georef,
@@ -872,7 +984,7 @@ int main(int argc, char* argv[]) {
     const int num_input_channels = num_channels(image_fmt.pixel_format);
 
     // Prepare output directory
-    vw::create_out_dir(opt.output_file);
+    asp::create_out_dir(opt.output_file);
 
     // Redirect to the correctly typed function to perform the actual map projection.
     // - Must correspond to the type of the input image.
@@ -49,6 +49,9 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
+#include <algorithm>
+#include <limits>
+#include <set>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -201,10 +204,26 @@ struct CustomCompare {
   }
 };
 
-bool vector_less(Eigen::VectorXd const& p, Eigen::VectorXd const& q){
-  for (int i = 0; i < p.size(); i++) {
-    if (p[i] < q[i]) return true;
-    if (p[i] > q[i]) return false;
+// The points in different clouds which were matched to each other, as
+// pairs of (cloud index, point index), sorted by cloud index. A point is
+// usually matched in only a few of the clouds, so this takes much less
+// memory than storing an index, or -1, for every cloud.
+typedef std::vector<std::pair<int, int>> PointTrack;
+
+// Compare tracks as if each were a vector with the point index, or -1,
+// for every cloud. This is the order in the original Matlab code.
+bool track_less(PointTrack const& p, PointTrack const& q){
+  size_t a = 0, b = 0;
+  while (a < p.size() || b < q.size()) {
+    int cp = (a < p.size()) ? p[a].first : std::numeric_limits<int>::max();
+    int cq = (b < q.size()) ? q[b].first : std::numeric_limits<int>::max();
+    int c  = std::min(cp, cq);
+    int vp = (cp == c) ? p[a].second : -1;
+    int vq = (cq == c) ? q[b].second : -1;
+    if (vp < vq) return true;
+    if (vp > vq) return false;
+    if (cp == c) a++;
+    if (cq == c) b++;
   }
   return false;
 }
@@ -299,6 +318,45 @@ void SearchKDTree_double(KDTree_double* tree, const vw::Vector3& input,
   tree->knnSearch(query_mat, indices_mat, dists_mat, nn, flann::SearchParams(ONE_TWO_EIGHT));
 }
 
+// Find the pairs of points in clouds i and j which are each other's
+// nearest neighbor. Each pair is (index in j, index in i). The trees
+// are only read, so this can be called for several pairs at once.
+void find_correspondences(std::vector<vw::Vector3> const& cloud_i,
+                          std::vector<vw::Vector3> const& cloud_j,
+                          KDTree_double * tree_i, KDTree_double * tree_j,
+                          std::vector<std::pair<int, int>> & Corr){
+
+  std::vector<int> match;
+  std::vector<double> dist;
+  typedef std::set<std::pair<int, int>, CustomCompare> PairType;
+
+  // For each point in cloud i, find a match in cloud j
+  PairType Corr1;
+  for (size_t index_i = 0; index_i < cloud_i.size(); index_i++){
+    SearchKDTree_double(tree_j, cloud_i[index_i], match, dist, 1);
+    if (match.empty()) continue; // should not happen
+    int index_j = match[0];
+    Corr1.insert(std::pair<int, int>(index_j, index_i));
+  }
+
+  // Now do it in reverse
+  PairType Corr2;
+  for (size_t index_j = 0; index_j < cloud_j.size(); index_j++){
+    SearchKDTree_double(tree_i, cloud_j[index_j], match, dist, 1);
+    if (match.empty()) continue; // should not happen
+    int index_i = match[0];
+    Corr2.insert(std::pair<int, int>(index_j, index_i));
+  }
+
+  Corr.clear();
+  for (PairType::iterator it = Corr1.begin(); it != Corr1.end(); it++) {
+    PairType::iterator it2 = Corr2.find(*it);
+    if (it2 == Corr2.end()) continue;
+
+    Corr.push_back(*it);
+  }
+}
+
 std::string transform_file(std::string const& out_prefix, int index){
   std::ostringstream os;
   os << out_prefix << "-transform-" << index << ".txt";
@@ -431,6 +489,25 @@ int main(int argc, char *argv[]){
       Trees.push_back(tree);
     }
 
+    // Find the pairs of clouds which overlap, per their bounding boxes.
+    // Only for those the correspondences are searched for.
+    std::vector<vw::BBox3> boxes(numClouds);
+    for (int it = 0; it < numClouds; it++) {
+      for (size_t pt = 0; pt < clouds[it].size(); pt++)
+        boxes[it].grow(clouds[it][pt]);
+    }
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < numClouds; i++) {
+      for (int j = i + 1; j < numClouds; j++) {
+        if (boxes[i].intersects(boxes[j]))
+          pairs.push_back(std::make_pair(i, j));
+      }
+    }
+    vw_out() << "Found " << pairs.size() << " overlapping pairs of clouds, out of "
+             << numClouds * (numClouds - 1) / 2 << ".\n";
+    if (pairs.empty())
+      vw_throw(ArgumentErr() << "No clouds overlap.\n");
+
     std::string errCaption = std::string("Computing the error, defined as the mean of ") +
       "pairwise distances from each cloud to the centroid cloud.\n";
     if (opt.verbose) vw_out() << errCaption;
@@ -467,129 +544,82 @@ int main(int argc, char *argv[]){
       modelSpan[numClouds] = numOfPoints;
 
       // This will record for each point in each cloud which point in
-      // every other cloud is closest to it. This matrix will store the
-      // indices of these points.
-      std::vector<Eigen::VectorXd> CentroidPtsBelMod(numOfPoints);
-      for (size_t row = 0; row < CentroidPtsBelMod.size(); row++) {
-        CentroidPtsBelMod[row] = Eigen::VectorXd(numClouds);
-        for (int cloudIter = 0; cloudIter < numClouds; cloudIter++) {
-          CentroidPtsBelMod[row][cloudIter] = -1;
-        }
-      }
-    
-      for (size_t i = 0; i < numClouds; i++) {
-
-        //spanI = modelSpan(i)+1:modelSpan(i+1); 
-        std::vector<int> spanI;
-        int beg = modelSpan[i], end = modelSpan[i+1] - 1;
-        for (int it = beg; it <= end; it++) spanI.push_back(it);
-        
+      // every other cloud is closest to it.
+      std::vector<PointTrack> tracks(numOfPoints);
+      for (int i = 0; i < numClouds; i++) {
         //CentroidPtsBelMod(spanI,i) = 1:length(spanI);
-        for (size_t it = 0; it < spanI.size(); it++) {
-          CentroidPtsBelMod[spanI[it]][i] = it;
-        }
+        for (int it = 0; it < int(clouds[i].size()); it++)
+          tracks[modelSpan[i] + it].push_back(std::make_pair(i, it));
+      }
 
-        for (size_t j = i + 1; j < numClouds; j++) {
-        
-          //spanJ = modelSpan(j)+1:modelSpan(j+1); 
-          std::vector<int> spanJ;
-          int beg = modelSpan[j], end = modelSpan[j+1] - 1;
-          for (int it = beg; it <= end; it++) spanJ.push_back(it);
-        
-          std::vector<int> match, match2;
-          std::vector<double> dist;
-          typedef std::set<std::pair<int, int>, CustomCompare> PairType;
-
-          // For each point in cloud i, find a match in cloud j
-          PairType Corr1;
-          for (size_t index_i = 0; index_i < clouds[i].size(); index_i++){
-            SearchKDTree_double(Trees[j].get(), clouds[i][index_i], match, dist, 1);
-            if (match.empty()) continue; // should not happen
-            int index_j = match[0];
-            Corr1.insert(std::pair<int, int>(index_j, index_i));
-          }
-
-          // Now do it in reverse
-          PairType Corr2;
-          for (size_t index_j = 0; index_j < clouds[j].size(); index_j++){
-            SearchKDTree_double(Trees[i].get(), clouds[j][index_j], match, dist, 1);
-            if (match.empty()) continue; // should not happen
-            int index_i = match[0];
-            Corr2.insert(std::pair<int, int>(index_j, index_i));
-          }
-
-          std::vector< std::pair<int, int>> Corr;
-          for (PairType::iterator it = Corr1.begin(); it != Corr1.end(); it++) {
-            PairType::iterator it2 = Corr2.find(*it);
-            if (it2 == Corr2.end()) continue;
-
-            Corr.push_back(*it);
-          }
-
-          for (size_t it = 0; it < Corr.size(); it++) {
-            // CentroidPtsBelMod(spanI(Corr(:,2)),j) = Corr(:,1)';
-            CentroidPtsBelMod[spanI[Corr[it].second]][j] = Corr[it].first;
-
-            // CentroidPtsBelMod(spanJ(Corr(:,1)),i) = Corr(:,2)';
-            CentroidPtsBelMod[spanJ[Corr[it].first]][i] = Corr[it].second;
-          }
+      // Find the correspondences for the overlapping pairs, in parallel
+      std::vector<std::vector<std::pair<int, int>>> pairCorr(pairs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+      for (int pairIter = 0; pairIter < int(pairs.size()); pairIter++) {
+        int i = pairs[pairIter].first, j = pairs[pairIter].second;
+        find_correspondences(clouds[i], clouds[j], Trees[i].get(), Trees[j].get(),
+                             pairCorr[pairIter]);
+      }
 
+      // A point has at most one match in any other cloud
+      for (size_t pairIter = 0; pairIter < pairs.size(); pairIter++) {
+        int i = pairs[pairIter].first, j = pairs[pairIter].second;
+        std::vector<std::pair<int, int>> const& Corr = pairCorr[pairIter];
+        for (size_t it = 0; it < Corr.size(); it++) {
+          // CentroidPtsBelMod(spanI(Corr(:,2)),j) = Corr(:,1)';
+          tracks[modelSpan[i] + Corr[it].second].push_back(std::make_pair(j, Corr[it].first));
+          // CentroidPtsBelMod(spanJ(Corr(:,1)),i) = Corr(:,2)';
+          tracks[modelSpan[j] + Corr[it].first].push_back(std::make_pair(i, Corr[it].second));
         }
       }
+      for (size_t row = 0; row < tracks.size(); row++)
+        std::sort(tracks[row].begin(), tracks[row].end());
 
-      std::sort(CentroidPtsBelMod.begin(), CentroidPtsBelMod.end(), vector_less);
+      std::sort(tracks.begin(), tracks.end(), track_less);
 
       // Remove non-unique elements, and remove entries which exist only in one cloud
       int pos = 0;
-      for (size_t row = 0; row < CentroidPtsBelMod.size(); row++) {
-
-        int num_good = 0;
-        for (int cloudIter = 0; cloudIter < CentroidPtsBelMod[row].size(); cloudIter++) {
-          if (CentroidPtsBelMod[row][cloudIter] >= 0)
-            num_good++;
-        }
-        if (num_good < 2) continue;
-        if (row > 0 && CentroidPtsBelMod[row - 1] == CentroidPtsBelMod[row]) 
+      for (size_t row = 0; row < tracks.size(); row++) {
+        if (tracks[row].size() < 2) continue;
+        if (row > 0 && tracks[row - 1] == tracks[row]) 
           continue;
-      
-        CentroidPtsBelMod[pos] = CentroidPtsBelMod[row];
+        if (int(row) != pos)
+          tracks[pos] = tracks[row];
         pos++;
       }
-      CentroidPtsBelMod.resize(pos);
+      tracks.resize(pos);
 
-      // We connected the clouds. Find the average cloud.
-      std::vector<vw::Vector3> centroid(CentroidPtsBelMod.size());
-      for (size_t row = 0; row < CentroidPtsBelMod.size(); row++) {
+      // We connected the clouds. Find the average cloud. Also record for
+      // each cloud its points in the tracks, and the track for each.
+      std::vector<vw::Vector3> centroid(tracks.size());
+      std::vector<std::vector<std::pair<int, int>>> cloudPoints(numClouds);
+      for (size_t row = 0; row < tracks.size(); row++) {
         vw::Vector3 pt(0, 0, 0);
-        int num = 0;
-        for (int cloudIter = 0; cloudIter < CentroidPtsBelMod[row].size(); cloudIter++) {
-          int idx = CentroidPtsBelMod[row][cloudIter];
-          if (idx < 0) continue;
-          vw::Vector3 curr = clouds[cloudIter][idx];
-          pt += curr;
-          num++;
+        for (size_t it = 0; it < tracks[row].size(); it++) {
+          int cloudIter = tracks[row][it].first, idx = tracks[row][it].second;
+          pt += clouds[cloudIter][idx];
+          cloudPoints[cloudIter].push_back(std::make_pair(idx, int(row)));
         }
-        pt /= num;
+        pt /= tracks[row].size();
         centroid[row] = pt;
       }
 
-      double errBefore = 0;
-      errAfter = 0;
-      int numErrors = 0;
-      
-      // Find the transform from each cloud to the centroid, and apply it to each cloud
-      for (size_t cloudIter = 0; cloudIter < numClouds; cloudIter++) {
+      // Find the transform from each cloud to the centroid, and apply it
+      // to each cloud. Given the centroid, these are independent.
+      std::vector<double> cloudErrBefore(numClouds, 0.0), cloudErrAfter(numClouds, 0.0);
+#pragma omp parallel for schedule(dynamic, 1)
+      for (int cloudIter = 0; cloudIter < numClouds; cloudIter++) {
 
         std::vector<Eigen::Vector3d> src, dst; 
         Eigen::Matrix3d rot;
         Eigen::Vector3d trans;
+        std::vector<std::pair<int, int>> const& points = cloudPoints[cloudIter];
+        if (points.size() < 3)
+          continue; // This cloud overlaps with no other, so keep it in place
       
-        for (int row = 0; row < CentroidPtsBelMod.size(); row++) {
-          int pointIter = CentroidPtsBelMod[row][cloudIter];
-          if (pointIter < 0) continue;
-        
-          vw::Vector3 curr = clouds[cloudIter][pointIter];
-          vw::Vector3 ctr  = centroid[row];
+        for (size_t it = 0; it < points.size(); it++) {
+          vw::Vector3 curr = clouds[cloudIter][points[it].first];
+          vw::Vector3 ctr  = centroid[points[it].second];
 
           Eigen::Vector3d p;
           p[0] = curr[0]; p[1] = curr[1]; p[2] = curr[2];
@@ -598,9 +628,7 @@ int main(int argc, char *argv[]){
           p[0] = ctr[0]; p[1] = ctr[1]; p[2] = ctr[2];
           dst.push_back(p);
 
-	  errBefore += norm_2(curr - ctr);
-
-	  numErrors++;
+          cloudErrBefore[cloudIter] += norm_2(curr - ctr);
         }
 	
         computeRigidTransform(src, dst, rot, trans);
@@ -617,15 +645,21 @@ int main(int argc, char *argv[]){
         // Move the clouds to the new location for the next iteration
         apply_transform_to_cloud(clouds[cloudIter], currT);
 
-	// Compute the error after the transform is applied
-        for (int row = 0; row < CentroidPtsBelMod.size(); row++) {
-          int pointIter = CentroidPtsBelMod[row][cloudIter];
-          if (pointIter < 0) continue;
-          vw::Vector3 curr = clouds[cloudIter][pointIter];
-          vw::Vector3 ctr  = centroid[row];
-	  errAfter += norm_2(curr - ctr);
+        // Compute the error after the transform is applied
+        for (size_t it = 0; it < points.size(); it++) {
+          vw::Vector3 curr = clouds[cloudIter][points[it].first];
+          vw::Vector3 ctr  = centroid[points[it].second];
+          cloudErrAfter[cloudIter] += norm_2(curr - ctr);
         }
+      }
 
+      double errBefore = 0;
+      errAfter = 0;
+      int numErrors = 0;
+      for (int cloudIter = 0; cloudIter < numClouds; cloudIter++) {
+        errBefore += cloudErrBefore[cloudIter];
+        errAfter  += cloudErrAfter[cloudIter];
+        numErrors += cloudPoints[cloudIter].size();
       }
 
       errBefore /= numErrors;
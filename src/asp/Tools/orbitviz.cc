@@ -26,12 +26,16 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Sessions/CameraUtils.h>
 
 #if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
 #include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/Core/MatchFile.h>
 #endif
 
 #include <iomanip>
+#include <fstream>
+#include <sstream>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
@@ -57,6 +61,7 @@ struct Options : public vw::GdalWriteOptions {
   double model_scale; ///< Size scaling applied to 3D models
   int    linescan_line; ///< Show the camera position at this line
   int    linescan_sample;
+  int    lod_group_size; ///< Cameras per level-of-detail group, if positive
 
   // Output
   std::string out_file;
@@ -133,7 +138,7 @@ size_t get_files_from_solver_folder(std::string                 const& solver_fo
   const size_t MIN_MATCHES = 30; // This is the default value, but it could be made an option.
   std::vector<ip::InterestPoint> ip1, ip2;
   for (size_t m=0; m<num_matches; ++m) {
-    vw::ip::read_binary_match_file(solver_folder+ "/"+match_files[m], ip1, ip2);
+    asp::read_match_file(solver_folder+ "/"+match_files[m], ip1, ip2);
     //std::cout << "Read " << ip1.size() << " matches from file " << match_files[m] << std::endl;
     if (ip1.size() < MIN_MATCHES)
       match_files[m] = "";
@@ -190,6 +195,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
           "Load the results from a run of the camera-solve tool. The only positional argument must be the path to the camera-solve output folder.")
     ("write-csv", po::bool_switch(&opt.write_csv)->default_value(false),
      "Write a csv file with the orbital data.")
+    ("lod-group-size", po::value(&opt.lod_group_size)->default_value(0),
+     "If positive, write the cameras in groups of this many, each in its own kml file. The output kml file links to them, and Google Earth loads a group only when its region is in view and large enough on screen. Use with many cameras.")
     ("bundle-adjust-prefix",    po::value(&opt.bundle_adjust_prefix),
      "Use the camera adjustment obtained by previously running bundle_adjust with this output prefix.");
   general_options.add(vw::GdalWriteOptionsDescription(opt));
@@ -209,11 +216,156 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                              positional, positional_desc, usage,
                              allow_unregistered, unregistered  );
 
+  if (opt.lod_group_size < 0)
+    vw_throw(ArgumentErr() << "The value of --lod-group-size must be non-negative.\n"
+             << usage << general_options);
+
   // Need this to be able to load adjusted camera models. That will happen
   // in the stereo session.
   asp::stereo_settings().bundle_adjust_prefix = opt.bundle_adjust_prefix;
 }
 
+/// Add the styles of the camera placemarks
+void append_camera_styles(Options const& opt, KMLFile & kml) {
+  if ( opt.path_to_outside_model.empty() ) {
+    // Placemark Style
+    kml.append_style( "plane", "", 1.2,
+                      "http://maps.google.com/mapfiles/kml/shapes/airports.png", 
+                      opt.hide_labels);
+    kml.append_style( "plane_highlight", "", 1.4,
+                      "http://maps.google.com/mapfiles/kml/shapes/airports.png");
+    kml.append_stylemap( "camera_placemark", "plane",
+                         "plane_highlight" );
+  }
+}
+
+/// Add the placemarks of the cameras in the range [begin, end)
+void append_camera_placemarks(Options const& opt, 
+                              std::vector<std::string> const& image_files,
+                              std::vector<Vector3> const& camera_positions,
+                              std::vector<Quat> const& camera_poses,
+                              size_t begin, size_t end, KMLFile & kml) {
+  for (size_t i = begin; i < end; i++) {
+    Vector3 const& lon_lat_alt = camera_positions[i];
+    std::string display_name = strip_directory(image_files[i]);
+    if (!opt.path_to_outside_model.empty()) {
+      kml.append_model( opt.path_to_outside_model,
+                        lon_lat_alt.x(), lon_lat_alt.y(),
+                        inverse(camera_poses[i]),
+                        display_name, "",
+                        lon_lat_alt[2], opt.model_scale );
+    } else {
+      kml.append_placemark( lon_lat_alt.x(), lon_lat_alt.y(),
+                            display_name, "", "camera_placemark",
+                            lon_lat_alt[2], true );
+    }
+  }
+}
+
+/// Draw lines between camera positions representing camera
+/// pairs with match files.
+void append_match_lines(std::vector<std::vector<int>> const& matched_cameras,
+                        std::vector<Vector3> const& camera_positions,
+                        KMLFile & kml) {
+  const std::string style_id = "ip_match_style";
+  kml.append_line_style(style_id, "FF00FF00", 1.0); // Green line with default size
+  std::vector<Vector3> line_ends(2);
+  for (size_t i=0; i<matched_cameras.size(); ++i) {
+    line_ends[0] = camera_positions[i];
+    for (size_t j=0; j<matched_cameras[i].size(); ++j) {
+      int index = matched_cameras[i][j];
+      line_ends[1] = camera_positions[index];
+      kml.append_line(line_ends, "", style_id);
+    }
+  }
+}
+
+/// Write the cameras in groups, each to its own kml file, and a top-level
+/// kml file with a network link to each group. A link has a region
+/// bounding the cameras of its group, so Google Earth loads the group
+/// only when that region is in view and large enough on screen. The
+/// lines between matched cameras, if any, go to a separate linked file.
+void write_lod_groups(Options const& opt, 
+                      std::vector<std::string> const& image_files,
+                      std::vector<Vector3> const& camera_positions,
+                      std::vector<Quat> const& camera_poses,
+                      std::vector<std::vector<int>> const& matched_cameras) {
+
+  std::string group_prefix = fs::path(opt.out_file).replace_extension("").string();
+  std::string title = strip_directory_and_extension(opt.out_file);
+
+  std::ofstream ofs(opt.out_file.c_str());
+  if (!ofs.good())
+    vw_throw(IOErr() << "Cannot write: " << opt.out_file << "\n");
+  ofs << std::setprecision(12);
+  ofs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+      << "<Document>\n"
+      << "  <name>" << title << "</name>\n";
+
+  // Pad the region a bit, so a group with a single camera is not empty
+  const double PAD_DEG = 1e-3;
+  const int MIN_LOD_PIXELS = 128;
+  size_t num_cameras = camera_positions.size();
+  for (size_t begin = 0, group = 0; begin < num_cameras;
+       begin += opt.lod_group_size, group++) {
+    size_t end = std::min(num_cameras, begin + size_t(opt.lod_group_size));
+
+    // Write the group kml file
+    std::ostringstream os;
+    os << group_prefix << "-group" << group << ".kml";
+    std::string group_file = os.str();
+    {
+      KMLFile kml(group_file, title + " group " + vw::num_to_str(group));
+      append_camera_styles(opt, kml);
+      append_camera_placemarks(opt, image_files, camera_positions, camera_poses,
+                               begin, end, kml);
+      kml.close_kml();
+    }
+
+    // The region bounding the cameras in the group
+    BBox2 box;
+    for (size_t i = begin; i < end; i++)
+      box.grow(subvector(camera_positions[i], 0, 2));
+    box.expand(PAD_DEG);
+
+    ofs << "  <NetworkLink>\n"
+        << "    <name>" << strip_directory(image_files[begin]) << "</name>\n"
+        << "    <Region>\n"
+        << "      <LatLonAltBox>\n"
+        << "        <north>" << box.max().y() << "</north>\n"
+        << "        <south>" << box.min().y() << "</south>\n"
+        << "        <east>"  << box.max().x() << "</east>\n"
+        << "        <west>"  << box.min().x() << "</west>\n"
+        << "      </LatLonAltBox>\n"
+        << "      <Lod><minLodPixels>" << MIN_LOD_PIXELS << "</minLodPixels></Lod>\n"
+        << "    </Region>\n"
+        << "    <Link>\n"
+        << "      <href>" << strip_directory(group_file) << "</href>\n"
+        << "      <viewRefreshMode>onRegion</viewRefreshMode>\n"
+        << "    </Link>\n"
+        << "  </NetworkLink>\n";
+  }
+
+  if (!matched_cameras.empty()) {
+    std::string match_file = group_prefix + "-matches.kml";
+    {
+      KMLFile kml(match_file, title + " matches");
+      append_match_lines(matched_cameras, camera_positions, kml);
+      kml.close_kml();
+    }
+    ofs << "  <NetworkLink>\n"
+        << "    <name>matches</name>\n"
+        << "    <Link><href>" << strip_directory(match_file) << "</href></Link>\n"
+        << "  </NetworkLink>\n";
+  }
+
+  ofs << "</Document>\n"
+      << "</kml>\n";
+  if (!ofs.good())
+    vw_throw(IOErr() << "Failed writing: " << opt.out_file << "\n");
+}
+
 int main(int argc, char* argv[]) {
 
   Options opt;
@@ -239,36 +391,17 @@ int main(int argc, char* argv[]) {
     if ( image_files.empty() )
       vw_throw( ArgumentErr() << "No image files detected.\n" );
     
-    std::string first_image = image_files[0];
-    std::string first_camera = first_image;
-    if (!camera_files.empty()) 
-      first_camera = camera_files[0];
-    typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
-    SessionPtr session
-      (asp::StereoSessionFactory::create(opt.stereo_session, // may change inside
-                                         opt,
-                                         first_image, first_image,
-                                         first_camera, first_camera
-                                         ) );
+    // Load the cameras, on multiple threads if the session allows it
+    std::string stereo_session = opt.stereo_session;
+    bool single_threaded_cameras = false;
+    bool approximate_pinhole_intrinsics = false;
+    std::vector<boost::shared_ptr<camera::CameraModel>> cameras;
+    asp::load_cameras(image_files, camera_files, "", opt, approximate_pinhole_intrinsics,
+                      stereo_session, single_threaded_cameras, cameras);
 
     // Prepare output directory
     vw::create_out_dir(opt.out_file);
     
-    // Create the KML file. The KML title comes from the output file name.
-    KMLFile kml( opt.out_file, strip_directory_and_extension(opt.out_file));
-
-    // Style listing
-    if ( opt.path_to_outside_model.empty() ) {
-      // Placemark Style
-      kml.append_style( "plane", "", 1.2,
-                        "http://maps.google.com/mapfiles/kml/shapes/airports.png", 
-                        opt.hide_labels);
-      kml.append_style( "plane_highlight", "", 1.4,
-                        "http://maps.google.com/mapfiles/kml/shapes/airports.png");
-      kml.append_stylemap( "camera_placemark", "plane",
-                           "plane_highlight" );
-    }
-
     // Load up the datum
     cartography::Datum datum(opt.datum);
     vw_out() << "Using datum: " << datum << std::endl;
@@ -284,20 +417,12 @@ int main(int argc, char* argv[]) {
     
     Vector2 camera_pixel(opt.linescan_sample, opt.linescan_line);
 
-    // Building Camera Models and then writing to KML
+    // Find the camera positions and poses
     std::vector<Vector3> camera_positions(num_cameras);
+    std::vector<Quat> camera_poses(num_cameras);
     for (size_t i=0; i < num_cameras; i++) {
-      boost::shared_ptr<camera::CameraModel> current_camera;
-
-      // This is so clumsy, a new stereo session needs to be loaded for each
-      // input camera.
-      SessionPtr session
-        (asp::StereoSessionFactory::create(opt.stereo_session, // may change inside
-                                           opt,
-                                           image_files[i],  image_files[i],
-                                           camera_files[i], camera_files[i]
-                                           ) );
-      current_camera = session->camera_model(image_files[i], camera_files[i]);
+      boost::shared_ptr<camera::CameraModel> const& current_camera = cameras[i];
+      Vector3 xyz = current_camera->camera_center(camera_pixel);
 
       if ( opt.write_csv ) {
         csv_handle << image_files[i] << ", ";
@@ -311,47 +436,36 @@ int main(int argc, char* argv[]) {
         }
 #endif
 
-        Vector3 xyz = current_camera->camera_center(camera_pixel);
         csv_handle << std::setprecision(12);
         csv_handle << xyz[0] << ", "
                    << xyz[1] << ", " << xyz[2] << "\n";
       } // End csv write condition
       
       // Compute and record the GDC coordinates
-      Vector3 lon_lat_alt = datum.cartesian_to_geodetic(
-                                current_camera->camera_center(camera_pixel));
-      camera_positions[i] = lon_lat_alt;
-
-      // Adding Placemarks
-      std::string display_name = strip_directory(image_files[i]);
-      if (!opt.path_to_outside_model.empty()) {
-        kml.append_model( opt.path_to_outside_model,
-                          lon_lat_alt.x(), lon_lat_alt.y(),
-                          inverse(current_camera->camera_pose(camera_pixel)),
-                          display_name, "",
-                          lon_lat_alt[2], opt.model_scale );
-      } else {
-        kml.append_placemark( lon_lat_alt.x(), lon_lat_alt.y(),
-                              display_name, "", "camera_placemark",
-                              lon_lat_alt[2], true );
-      }
-      
+      camera_positions[i] = datum.cartesian_to_geodetic(xyz);
+      if (!opt.path_to_outside_model.empty())
+        camera_poses[i] = current_camera->camera_pose(camera_pixel);
     } // End loop through cameras
 
-    // Draw lines between camera positions representing camera
-    //  pairs with match files.
-    const std::string style_id = "ip_match_style";
-    kml.append_line_style(style_id, "FF00FF00", 1.0); // Green line with default size
-    std::vector<Vector3> line_ends(2);
-    for (size_t i=0; i<matched_cameras.size(); ++i) {
-      line_ends[0] = camera_positions[i];
-      for (size_t j=0; j<matched_cameras[i].size(); ++j) {
-        int index = matched_cameras[i][j];
-        line_ends[1] = camera_positions[index];
-        kml.append_line(line_ends, "", style_id);
+    if (opt.lod_group_size > 0) {
+      vw_out() << "Writing: " << opt.out_file << std::endl; 
+      write_lod_groups(opt, image_files, camera_positions, camera_poses,
+                       matched_cameras);
+      if (opt.write_csv){
+        vw_out() << "Writing: " << csv_file << std::endl;
+        csv_handle.close();
       }
+      return 0;
     }
 
+    // Create the KML file. The KML title comes from the output file name.
+    KMLFile kml( opt.out_file, strip_directory_and_extension(opt.out_file));
+    append_camera_styles(opt, kml);
+    append_camera_placemarks(opt, image_files, camera_positions, camera_poses,
+                             0, num_cameras, kml);
+
+    append_match_lines(matched_cameras, camera_positions, kml);
+
 
     // Put the Writing: messages here, so that they show up after all other info.
     vw_out() << "Writing: " << opt.out_file << std::endl; 
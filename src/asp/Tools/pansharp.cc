@@ -28,6 +28,8 @@ using namespace vw::cartography;
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/BigTileWriter.h>
+#include <asp/Core/InterpolatedTransform.h>
 #include <asp/Camera/RPC_XML.h>
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
@@ -87,6 +89,8 @@ T ycbcrToRgb(T const& ycbcr, double min_val, double max_val) {
 /// - This takes a gray and an RGB image as input and generates an RGB image as output.
 /// - This operation is not particularly useful unless the gray image is higher
 ///   resolution than the RGB image.
+/// - For each tile the inputs are rasterized once, so the color image is
+///   resampled a tile at a time, then the color transform is applied.
 template <class ImageGrayT, class ImageColorT, typename DataTypeT>
 class PanSharpView : public ImageViewBase<PanSharpView<ImageGrayT, ImageColorT, DataTypeT> > {
 
@@ -97,9 +101,8 @@ public: // Definitions
 
 private: // Variables
 
-  // TODO: These should be Ref views and masked?
-  ImageGrayT  const& m_gray_image;
-  ImageColorT const& m_color_image;
+  ImageGrayT  m_gray_image;
+  ImageColorT m_color_image;
 
   DataTypeT m_output_nodata;
   DataTypeT m_min_val;
@@ -160,26 +163,26 @@ public: // Functions
     // Set up the output image tile
     ImageView<result_type> tile(bbox.width(), bbox.height());
 
+    // Read and resample the inputs for this tile in one go, rather than
+    // evaluating the views pixel by pixel
+    ImageView<typename ImageGrayT::pixel_type>  gray_tile  = crop(m_gray_image,  bbox);
+    ImageView<typename ImageColorT::pixel_type> color_tile = crop(m_color_image, bbox);
+
     // Loop through each output pixels and compute each output value
-    for (int c = 0; c < bbox.width(); c++) {
-      int source_c = c + bbox.min()[0];
-      for (int r = 0; r < bbox.height(); r++) {
-        int source_r = r + bbox.min()[1];
+    for (int r = 0; r < bbox.height(); r++) {
+      for (int c = 0; c < bbox.width(); c++) {
 
         // Check for a masked pixel
-        if ( !is_valid(m_gray_image (source_c, source_r)) ||
-             !is_valid(m_color_image(source_c, source_r))  ) {
+        if ( !is_valid(gray_tile(c, r)) || !is_valid(color_tile(c, r)) ) {
           tile(c, r) = m_output_nodata;
           continue;
         }
 
         // Pass the two input pixels into the conversion function
-        //result_type output_pixel = convert_pixel(m_gray_image(source_c, r), m_color_image(source_c, r));
-        tile(c,r) = convert_pixel(m_gray_image (source_c, source_r),
-                                  m_color_image(source_c, source_r));
+        tile(c, r) = convert_pixel(gray_tile(c, r), color_tile(c, r));
 
-      } // End row loop
-    } // End column loop
+      } // End column loop
+    } // End row loop
 
     // Return the tile we created with fake borders to make it look the size of the entire output image
     return prerasterize_type(tile,
@@ -220,8 +223,10 @@ struct Options : vw::GdalWriteOptions {
          output_file;
   double nodata_value,
          min_value,
-         max_value;
-  bool has_nodata;
+         max_value,
+         transform_grid_tol;
+  int transform_grid_step;
+  bool has_nodata, cog;
 };
 
 const double DEFAULT_NODATA = -std::numeric_limits<double>::max();
@@ -239,7 +244,13 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("color-xml", po::value(&opt.color_xml_file)->default_value(""),
              "Path to a WV XML file for the color image.  Can be used to obtain the geo data.")
     ("nodata-value", po::value(&opt.nodata_value)->default_value(DEFAULT_NODATA),
-             "The no-data value to use, unless present in the color image header.");
+             "The no-data value to use, unless present in the color image header.")
+    ("transform-grid-step", po::value(&opt.transform_grid_step)->default_value(16),
+             "Find the color image pixel for each output pixel exactly only on a grid with this spacing, in output pixels, and interpolate bilinearly in between. The grid is refined where the interpolation error is more than --transform-grid-tol. Set to 0 to find each pixel exactly.")
+    ("transform-grid-tol", po::value(&opt.transform_grid_tol)->default_value(0.01),
+             "The largest allowed interpolation error, in color image pixels, when --transform-grid-step is positive.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+             "Add internal overviews to the output image, computed while it is written.");
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
   po::options_description positional("");
@@ -269,6 +280,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if (opt.min_value > opt.max_value)
     vw_throw( ArgumentErr() << "The minimum value cannot be greater than the maximum value!\n\n");
 
+  if (opt.transform_grid_step < 0 || opt.transform_grid_tol <= 0)
+    vw_throw(ArgumentErr() << "The value of --transform-grid-step must be non-negative, "
+             << "and of --transform-grid-tol positive.\n" << usage << general_options);
+
   // Determine if the user entered a nodata value
   opt.has_nodata = vm.count("output-nodata-value");
 
@@ -308,39 +323,57 @@ void load_inputs_and_process(Options           & opt,
 
   // Processing is done on doubles to handle nodata values, then converted to the desired output type.
 
-  // Generate a view of the color image from the pixel coordinate system of the gray image
+  // Generate a view of the color image from the pixel coordinate system of the gray image.
+  // The georeference transform is smooth, so by default it is found exactly only on a
+  // sparse grid for each tile.
   typedef PixelMask<PixelRGB<double> > PixelRGBMaskD;
   typedef PixelMask<PixelRGB<T     > > PixelRGBMask;
-  ImageViewRef<PixelRGBMaskD> color_trans =
-    crop(geo_transform( create_mask(pixel_cast<PixelRGBMaskD>(color_img),
-                                                  color_nodata),
-                        color_georef, gray_georef,
-                        ValueEdgeExtension<PixelRGBMaskD>(PixelRGBMaskD()) ),
-         crop_box );
-
+  GeoTransform geo_trans(color_georef, gray_georef);
+  ImageViewRef<PixelRGBMaskD> color_masked
+    = create_mask(pixel_cast<PixelRGBMaskD>(color_img), color_nodata);
+  ValueEdgeExtension<PixelRGBMaskD> edge_ext = ValueEdgeExtension<PixelRGBMaskD>(PixelRGBMaskD());
+  ImageViewRef<PixelRGBMaskD> color_trans;
+  if (opt.transform_grid_step > 0)
+    color_trans = crop(transform(color_masked,
+                                 asp::InterpolatedTransform<GeoTransform>
+                                 (geo_trans, opt.transform_grid_step, opt.transform_grid_tol,
+                                  Vector2i(color_img.cols(), color_img.rows())),
+                                 gray_img.cols(), gray_img.rows(),
+                                 edge_ext, BilinearInterpolation()),
+                       crop_box);
+  else
+    color_trans = crop(transform(color_masked, geo_trans, gray_img.cols(), gray_img.rows(),
+                                 edge_ext, BilinearInterpolation()),
+                       crop_box);
 
   // WorldView convention is to mask <= a value, but this may not be a universal standard!
   // - create_mask_less_or_equal seems to break on PixelRGB types.
-
+  ImageViewRef<PixelRGBMask> output_img
+    = pixel_cast<PixelRGBMask>(apply_mask(pansharp_view(crop(create_mask_less_or_equal
+                                                             (pixel_cast<double>(gray_img),
+                                                              gray_nodata),
+                                                             crop_box),
+                                                        color_trans,
+                                                        opt.nodata_value,
+                                                        opt.min_value,
+                                                        opt.max_value),
+                                          opt.nodata_value));
+
+  // The output is written in the gray coordinate system
   vw_out() << "Writing: " << opt.output_file << std::endl;
-  vw::cartography::block_write_gdal_image( opt.output_file,
-                               // The final output image is set up in these few lines:
-                               pixel_cast<PixelRGBMask>
-                               (apply_mask(pansharp_view
-                                           (crop(create_mask_less_or_equal
-                                                 (pixel_cast<double>(gray_img),
-                                                  gray_nodata),
-                                                 crop_box),
-                                            color_trans,
-                                            opt.nodata_value,
-                                            opt.min_value,
-                                            opt.max_value),
-                                           opt.nodata_value)
-                                ),
-                               true, gray_georef, // The output is written in the gray coordinate system
-                               opt.has_nodata, opt.nodata_value,
-                               opt,
-                               TerminalProgressCallback("pansharp","\t--> Writing:"));
+  TerminalProgressCallback tpc("pansharp","\t--> Writing:");
+  if (opt.cog) {
+    // Write once, with overviews
+    const int big_tile_size = 1024;
+    asp::save_in_big_tiles(big_tile_size, opt.output_file, output_img,
+                           true, gray_georef, opt.has_nodata, opt.nodata_value,
+                           opt, tpc, opt.cog);
+  } else {
+    vw::cartography::block_write_gdal_image(opt.output_file, output_img,
+                                            true, gray_georef,
+                                            opt.has_nodata, opt.nodata_value,
+                                            opt, tpc);
+  }
 }
 
 int main( int argc, char *argv[] ) {
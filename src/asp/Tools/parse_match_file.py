@@ -134,6 +134,65 @@ def write_match_file(outfile, im1_ip, im2_ip):
     return
         
 
+# The fields of an interest point record in a binary match file, before
+# the descriptor values
+IP_RECORD_FIELDS = [('x', '<f4'), ('y', '<f4'), ('ix', '<i4'), ('iy', '<i4'),
+                    ('orientation', '<f4'), ('scale', '<f4'), ('interest', '<f4'),
+                    ('polarity', 'i1'), ('octave', '<u4'), ('scale_lvl', '<u4'),
+                    ('ndesc', '<u8')]
+
+def read_match_file_fast(match_file):
+    """
+    Read a binary match file in one pass, as numpy record arrays for
+    the two images. All descriptors must have the same length.
+    """
+    print("Reading: " + match_file)
+    data = np.fromfile(match_file, dtype=np.uint8)
+    size1, size2 = np.frombuffer(data[0:16].tobytes(), dtype='<u8')
+    size1, size2 = int(size1), int(size2)
+    ndesc = 0
+    if size1 + size2 > 0:
+        ndesc = int(np.frombuffer(data[16+37:16+45].tobytes(), dtype='<u8')[0])
+    dtype = np.dtype(IP_RECORD_FIELDS + [('desc', '<f4', (ndesc,))])
+    if len(data) != 16 + (size1 + size2) * dtype.itemsize:
+        raise Exception("The descriptors in " + match_file + " differ in length.")
+    recs = np.frombuffer(data[16:].tobytes(), dtype=dtype)
+    if np.any(recs['ndesc'] != ndesc):
+        raise Exception("The descriptors in " + match_file + " differ in length.")
+    return recs[0:size1], recs[size1:size1+size2]
+
+def write_match_file_v2(outfile, ip1, ip2, save_descriptors):
+    """
+    Write the matches in the compact match file format version 2, which
+    is laid out by column, with the pixels first. See asp/Core/MatchFile.h.
+    """
+    if len(ip1) != len(ip2):
+        raise Exception("The left and right interest points differ in number.")
+
+    print("Writing: " + outfile)
+    num = len(ip1)
+    desc_len = 0
+    if save_descriptors and num > 0:
+        desc_len = ip1['desc'].shape[1]
+
+    with open(outfile, 'wb') as out:
+        out.write(b'ASPMATCH')
+        out.write(struct.pack('<qqq', 2, num, desc_len))
+        for ip in [ip1, ip2]:
+            out.write(np.stack([ip['x'], ip['y']], axis=1).astype('<f4').tobytes())
+        for ip in [ip1, ip2]:
+            out.write(np.stack([ip['ix'], ip['iy']], axis=1).astype('<i4').tobytes())
+        for ip in [ip1, ip2]:
+            out.write(np.stack([ip['orientation'], ip['scale'], ip['interest']],
+                               axis=1).astype('<f4').tobytes())
+        for ip in [ip1, ip2]:
+            out.write(np.stack([ip['octave'], ip['scale_lvl']], axis=1).astype('<u4').tobytes())
+        for ip in [ip1, ip2]:
+            if desc_len > 0:
+                out.write(ip['desc'].astype('<f4').tobytes())
+        for ip in [ip1, ip2]:
+            out.write((ip['polarity'] != 0).astype(np.uint8).tobytes())
+
 if __name__ == '__main__':
 
     #Set up arguments
@@ -142,10 +201,20 @@ if __name__ == '__main__':
     parser.add_argument('outfile', type=str, help='Path to the output file.')
     parser.add_argument('-rev', dest='rev', help='Convert a text file into an ASP match file.',
                         action='store_true')
+    parser.add_argument('-v2', dest='v2',
+                        help='Convert a binary match file to the compact binary format ' +
+                        'version 2, which ASP tools read with memory mapping.',
+                        action='store_true')
+    parser.add_argument('-no-descriptors', dest='no_descriptors',
+                        help='With -v2, do not save the descriptors.',
+                        action='store_true')
     args = parser.parse_args()
 
-    
-    if args.rev==False:
+    if args.v2:
+        im1_ip, im2_ip = read_match_file_fast(args.infile)
+        write_match_file_v2(args.outfile, im1_ip, im2_ip, not args.no_descriptors)
+
+    elif args.rev==False:
 
         # Read match file
         im1_ip, im2_ip = read_match_file(args.infile)
@@ -58,6 +58,7 @@
 #pragma GCC diagnostic pop
 
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Math/EulerAngles.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/Datum.h>
@@ -69,15 +70,22 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/IpCache.h>
+#include <asp/Core/PointCloudCache.h>
+#include <asp/Core/NnGpu.h>
 #include <asp/Tools/pc_align_utils.h>
+#include <asp/Core/MatchFile.h>
+#include <asp/Core/Telemetry.h>
 
 #include <limits>
 #include <cstring>
+#include <set>
 #include <thread>
 #include <omp.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/noncopyable.hpp>
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
 
@@ -98,12 +106,14 @@ struct Options : public vw::GdalWriteOptions {
   // Input
   string reference, source, init_transform_file, alignment_method, config_file,
     datum, csv_format_str, csv_proj4_str, match_file, hillshade_options,
-    ipfind_options, ipmatch_options, fgr_options;
+    ipfind_options, ipmatch_options, fgr_options, ip_cache_dir, reference_cache,
+    source_list, nn_backend;
   Vector2 initial_transform_ransac_params;
   PointMatcher<RealT>::Matrix init_transform;
   int    num_iter,
          max_num_reference_points,
-         max_num_source_points;
+         max_num_source_points,
+         num_parallel_sources;
   double diff_translation_err,
          diff_rotation_err,
          max_disp,
@@ -150,6 +160,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                                  "The type of iterative closest point method to use. [point-to-plane, point-to-point, similarity-point-to-plane, similarity-point-to-point, fgr, least-squares, similarity-least-squares]")
     ("highest-accuracy",         po::bool_switch(&opt.highest_accuracy)->default_value(false)->implicit_value(true),
                                  "Compute with highest accuracy for point-to-plane (can be much slower).")
+    ("nn-backend",               po::value(&opt.nn_backend)->default_value("cpu"),
+                                 "How to find the nearest reference points in the matching step of the point-to-plane and point-to-point methods and their similarity variants. Options: 'cpu' (a KD-tree), 'gpu' (brute-force search on the GPU, if ASP was built with CUDA). If no GPU is found, the CPU is used.")
     ("csv-format",               po::value(&opt.csv_format_str)->default_value(""), asp::csv_opt_caption().c_str())
     ("csv-proj4",                po::value(&opt.csv_proj4_str)->default_value(""),
                                  "The PROJ.4 string to use to interpret the entries in input CSV files.")
@@ -176,6 +188,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("initial-transform-from-hillshading", po::value(&opt.hillshading_transform)->default_value(""), "If both input clouds are DEMs, find interest point matches among their hillshaded versions, and use them to compute an initial transform to apply to the source cloud before proceeding with alignment. Specify here the type of transform, as one of: 'similarity' (rotation + translation + scale), 'rigid' (rotation + translation) or 'translation'. See the options further down for tuning this.")
     ("hillshade-options", po::value(&opt.hillshade_options)->default_value("--azimuth 300 --elevation 20 --align-to-georef"), "Options to pass to the hillshade program when computing the transform from hillshading.")
     ("ipfind-options", po::value(&opt.ipfind_options)->default_value("--ip-per-image 1000000 --interest-operator sift --descriptor-generator sift"), "Options to pass to the ipfind program when computing the transform from hillshading.")
+    ("source-list", po::value(&opt.source_list)->default_value(""), "Align each of the clouds in this list, one per line, to the reference, which is loaded only once. The outputs for each source have the output prefix followed by a dash and the source name without the extension. Then no source should be passed on the command line.")
+    ("num-parallel-sources", po::value(&opt.num_parallel_sources)->default_value(1), "With --source-list, align this many sources in parallel. The messages printed for them will be interleaved.")
+    ("reference-cache", po::value(&opt.reference_cache)->default_value(""), "Save to this file the points sampled from the whole reference cloud, with their longitude and latitude, and in later runs with the same reference and options, memory-map it rather than read the reference again. The points within the region of interest are then picked from it. Use a large --max-num-reference-points when the cache is created, as it covers the whole reference.")
+    ("ip-cache-dir", po::value(&opt.ip_cache_dir)->default_value(""), "Store the interest points found in the hillshaded DEMs in this directory, keyed by the hillshade pixels and --ipfind-options, and reuse them when the same DEM is aligned again. This directory can be shared with stereo and bundle_adjust.")
     ("ipmatch-options", po::value(&opt.ipmatch_options)->default_value("--inlier-threshold 100 --ransac-iterations 10000 --ransac-constraint similarity"), "Options to pass to the ipmatch program when computing the transform from hillshading.")
     ("match-file", po::value(&opt.match_file)->default_value(""), "Compute a translation + rotation + scale transform from the source to the reference point cloud using manually selected point correspondences from the reference to the source (obtained for example using stereo_gui). It may be desired to change --initial-transform-ransac-params if it rejects as outliers some manual matches.")
     ("initial-transform-ransac-params", po::value(&opt.initial_transform_ransac_params)->default_value(Vector2(10000, 1.0), "num_iter factor"),
@@ -212,9 +228,21 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                              positional, positional_desc, usage,
                              allow_unregistered, unregistered );
 
-  if ( opt.reference.empty() || opt.source.empty() )
+  if ( opt.reference.empty() || (opt.source.empty() && opt.source_list.empty()) )
     vw_throw( ArgumentErr() << "Missing input files.\n" << usage << general_options );
 
+  if (!opt.source.empty() && !opt.source_list.empty())
+    vw_throw( ArgumentErr() << "Cannot specify both a source cloud and --source-list.\n"
+              << usage << general_options );
+
+  if (!opt.source_list.empty() && !opt.match_file.empty())
+    vw_throw( ArgumentErr() << "A match file cannot be used with --source-list.\n"
+              << usage << general_options );
+
+  if (opt.num_parallel_sources < 1)
+    vw_throw( ArgumentErr() << "The number of parallel sources must be positive.\n"
+              << usage << general_options );
+
   if ( opt.out_prefix.empty() )
     vw_throw( ArgumentErr() << "Missing output prefix.\n" << usage << general_options );
 
@@ -294,6 +322,18 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 	      << usage << general_options );
   }
   
+  if (opt.nn_backend != "cpu" && opt.nn_backend != "gpu")
+    vw_throw( ArgumentErr() << "The value of --nn-backend must be 'cpu' or 'gpu'.\n"
+	      << usage << general_options );
+
+  if (opt.nn_backend == "gpu" &&
+      opt.alignment_method != "point-to-plane"            &&
+      opt.alignment_method != "point-to-point"            &&
+      opt.alignment_method != "similarity-point-to-point" &&
+      opt.alignment_method != "similarity-point-to-plane")
+    vw_throw( ArgumentErr() << "The option --nn-backend gpu is only applicable to point-to-plane, point-to-point, similarity-point-to-point, and similarity-point-to-plane alignment.\n"
+	      << usage << general_options );
+
   if ( (opt.alignment_method == "least-squares" ||
 	opt.alignment_method == "similarity-least-squares")
        && asp::get_cloud_type(opt.reference) != "DEM")
@@ -471,37 +511,51 @@ void save_errors(DP const& point_cloud,
 
 /// Like PM::ICP::filterGrossOutliersAndCalcErrors, except comparing to a DEM instead.
 /// - The point cloud is in GCC coordinates with point_cloud_shift subtracted from each point.
+/// - The DEM must be masked but not interpolated, as it is sampled by tile.
 /// - The output is put in the "errors" vector for each point.
 /// - If there is a problem computing the point error, a very large number is used as a flag.
 void calcErrorsWithDem(DP          const& point_cloud,
                        vw::Vector3 const& point_cloud_shift,
                        vw::cartography::GeoReference        const& georef,
-                       vw::ImageViewRef< PixelMask<float> > const& dem,
+                       vw::ImageViewRef< PixelMask<float> > const& masked_dem,
                        std::vector<double> &errors) {
 
-  // Initialize output error storage
+  // Initialize output error storage. It holds the point heights until the DEM
+  // heights are known, so no per-thread storage is needed.
   const std::int64_t num_pts = point_cloud.features.cols();
   errors.resize(num_pts);
+  std::vector<Vector2> pixels(num_pts);
 
-  // Loop through every point in the point cloud
-  double dem_height_here;
+  // Find the DEM pixel and height above datum of every point
+#pragma omp parallel for
   for (std::int64_t i = 0; i < num_pts; i++){
     // Extract and un-shift the point to get the real GCC coordinate
     Vector3 gcc_coord = get_cloud_gcc_coord(point_cloud, point_cloud_shift, i);
 
     // Convert from GDC to GCC
     Vector3 llh = georef.datum().cartesian_to_geodetic(gcc_coord); // lon-lat-height
+    errors[i] = llh[2];
 
-    // Interpolate the point at this location
-    if (!interp_dem_height(dem, georef, llh, dem_height_here)) {
-      // If we did not intersect the DEM, record a flag error value here.
-      errors[i] = BIG_NUMBER;
-    }
-    else { // Success, the error is the absolute height difference
-      errors[i] = std::abs(llh[2] - dem_height_here);
+    // Convert the lon/lat location into a pixel in the DEM. A pixel
+    // outside the DEM will be flagged below.
+    try {
+      pixels[i] = georef.lonlat_to_pixel(subvector(llh, 0, 2));
+    } catch(...) {
+      pixels[i] = Vector2(-1, -1);
     }
+  }
 
-  } // End loop through all points
+  // Interpolate the DEM at these locations, reading it one tile at a time
+  std::vector<double> dem_heights;
+  interp_dem_heights(masked_dem, pixels, dem_heights);
+
+#pragma omp parallel for
+  for (std::int64_t i = 0; i < num_pts; i++){
+    if (std::isnan(dem_heights[i]))
+      errors[i] = BIG_NUMBER; // Did not intersect the DEM, record a flag error value here
+    else
+      errors[i] = std::abs(errors[i] - dem_heights[i]); // Absolute height difference
+  }
 
 }
 
@@ -757,34 +811,47 @@ least_squares_alignment(DP const& source_point_cloud, // Should not be modified
 /// Filters out all points from point_cloud with an error entry higher than cutoff
 void filterPointsByError(DP & point_cloud, PointMatcher<RealT>::Matrix &errors, double cutoff) {
 
-  DP input_copy = point_cloud; // Make a copy of the input DP object
-
   // Init LPM data structure
-  const int input_point_count = point_cloud.features.cols();
+  const std::int64_t input_point_count = point_cloud.features.cols();
   if (errors.cols() != input_point_count)
     vw_throw( LogicErr() << "Error: error size does not match point count size!\n");
-  point_cloud.features.conservativeResize(DIM+1, input_point_count);
-  point_cloud.featureLabels = form_labels<double>(DIM);
-
-  // Loop through all the input points and copy them to the output if they pass the test
-  std::int64_t points_count = 0;
-  for (std::int64_t col = 0; col < input_point_count; ++col) {
 
-    if (errors(0,col) > cutoff) {
-      //vw_out() << "Throwing out point " << col << " for having error " << errors(0,col) << "\n";
-      continue; // Error too high, don't add this point
+  // Count the points passing the test in each chunk, then copy each chunk to
+  // its offset in the output. Only the features are copied, not the whole DP object.
+  const std::int64_t chunk_size = 65536;
+  const std::int64_t num_chunks = (input_point_count + chunk_size - 1) / chunk_size;
+  std::vector<std::int64_t> chunk_start(num_chunks + 1, 0);
+#pragma omp parallel for
+  for (std::int64_t chunk = 0; chunk < num_chunks; chunk++) {
+    std::int64_t end = std::min(input_point_count, (chunk + 1) * chunk_size);
+    for (std::int64_t col = chunk * chunk_size; col < end; col++) {
+      if (errors(0, col) <= cutoff)
+        chunk_start[chunk + 1]++;
     }
+  }
+  for (std::int64_t chunk = 0; chunk < num_chunks; chunk++)
+    chunk_start[chunk + 1] += chunk_start[chunk];
 
-    // Copy this point to the output LPM structure
-    for (std::int64_t row = 0; row < DIM; row++)
-      point_cloud.features(row, points_count) = input_copy.features(row, col);
-    point_cloud.features(DIM, points_count) = 1; // Extend to be a homogenous coordinate
-    ++points_count; // Update output point count
-
-  } // End loop through points
+  PointMatcher<RealT>::Matrix input_features = point_cloud.features;
+  const std::int64_t points_count = chunk_start[num_chunks];
+  point_cloud.features.resize(DIM+1, points_count);
+  point_cloud.featureLabels = form_labels<double>(DIM);
 
-  // Finalize the LPM data structure
-  point_cloud.features.conservativeResize(Eigen::NoChange, points_count);
+#pragma omp parallel for
+  for (std::int64_t chunk = 0; chunk < num_chunks; chunk++) {
+    std::int64_t out_col = chunk_start[chunk];
+    std::int64_t end = std::min(input_point_count, (chunk + 1) * chunk_size);
+    for (std::int64_t col = chunk * chunk_size; col < end; col++) {
+      if (errors(0, col) > cutoff)
+        continue; // Error too high, don't add this point
+
+      // Copy this point to the output LPM structure
+      for (std::int64_t row = 0; row < DIM; row++)
+        point_cloud.features(row, out_col) = input_features(row, col);
+      point_cloud.features(DIM, out_col) = 1; // Extend to be a homogenous coordinate
+      ++out_col;
+    }
+  }
 
 }
 
@@ -796,15 +863,13 @@ void update_best_error(std::vector<double>         const& dem_errors,
   std::int64_t num_points = lpm_errors.cols();
   if (dem_errors.size() != static_cast<size_t>(num_points))
     vw_throw( LogicErr() << "Error: error size does not match point count size!\n");
-  //vw_out() << "Updating error...\n";
 
   // Loop through points
+#pragma omp parallel for
   for (std::int64_t col = 0; col < num_points; col++){
     // Use the DEM error if it is less
-    if (dem_errors[col] < lpm_errors(0,col)) {
-      //vw_out() << "DEM error = " << dem_errors[col] << ", LPM error = " << lpm_errors(0,col) << std::endl;
+    if (dem_errors[col] < lpm_errors(0,col))
       lpm_errors(0, col) = dem_errors[col];
-    }
   }
 
 }
@@ -816,7 +881,7 @@ double compute_registration_error(DP          const& ref_point_cloud,
                                   PM::ICP          & pm_icp_object, // Must already be initialized
                                   vw::Vector3 const& shift,
                                   vw::cartography::GeoReference        const& dem_georef,
-                                  vw::ImageViewRef< PixelMask<float> > const& dem_ref,
+                                  vw::ImageViewRef< PixelMask<float> > const& masked_dem,
                                   Options const& opt,
                                   PointMatcher<RealT>::Matrix &error_matrix) {
   Stopwatch sw;
@@ -830,7 +895,7 @@ double compute_registration_error(DP          const& ref_point_cloud,
   if (opt.use_dem_distances()) {
     // Compute the distance from each point to the DEM
     std::vector<double> dem_errors;
-    calcErrorsWithDem(source_point_cloud, shift, dem_georef, dem_ref, dem_errors);
+    calcErrorsWithDem(source_point_cloud, shift, dem_georef, masked_dem, dem_errors);
 
     // For each point use the lower of the two calculated errors.
     update_best_error(dem_errors, error_matrix);
@@ -844,13 +909,68 @@ double compute_registration_error(DP          const& ref_point_cloud,
   return sw.elapsed_seconds();
 }
 
+/// A libpointmatcher matcher which finds the nearest reference points on
+/// the GPU, used with --nn-backend gpu. The reference points are kept on
+/// the device, so init() is called only once per reference.
+struct GpuKnnMatcher: public PM::Matcher {
+  GpuKnnMatcher(int knn, double max_dist): m_knn(knn), m_max_dist(max_dist) {}
+
+  virtual void init(const DP& filteredReference) {
+    std::string error;
+    if (!m_nn.set_reference(filteredReference.features, error))
+      vw_throw( ArgumentErr() << "GPU nearest-neighbor search failed: " << error << "\n");
+  }
+
+  virtual PM::Matches findClosests(const DP& filteredReading) {
+    PM::Matches::Dists dists;
+    PM::Matches::Ids ids;
+    std::string error;
+    if (!m_nn.find(filteredReading.features, m_knn, m_max_dist, dists, ids, error))
+      vw_throw( ArgumentErr() << "GPU nearest-neighbor search failed: " << error << "\n");
+    return PM::Matches(dists, ids);
+  }
+
+  int m_knn;
+  double m_max_dist;
+  asp::GpuNearestNeighbors m_nn;
+};
+
+/// Replace the matcher of the ICP object with one running on the GPU. The
+/// number of neighbors and maximum distance are taken from the matcher
+/// being replaced, so the results agree with the KD-tree up to floating
+/// point differences. Returns false and prints a warning if no GPU can be used.
+bool use_gpu_matcher(PM::ICP & icp, DP const& ref_point_cloud) {
+
+  std::string reason;
+  if (!asp::nn_gpu_available(reason)) {
+    vw_out(WarningMessage) << "Cannot use the GPU for the nearest-neighbor search. "
+                           << reason << " Using the CPU.\n";
+    return false;
+  }
+
+  int knn = 1;
+  double max_dist = std::numeric_limits<double>::infinity();
+  if (icp.matcher) {
+    try {
+      knn = atoi(icp.matcher->getParamValueString("knn").c_str());
+    } catch (...) {}
+    try {
+      max_dist = atof(icp.matcher->getParamValueString("maxDist").c_str());
+    } catch (...) {}
+  }
+
+  icp.matcher.reset(new GpuKnnMatcher(knn, max_dist));
+  icp.matcher->init(ref_point_cloud);
+  return true;
+}
+
 /// Points in source_point_cloud farther than opt.max_disp from the reference cloud are deleted.
 void filter_source_cloud(DP          const& ref_point_cloud,
                          DP               & source_point_cloud,
                          PM::ICP          & pm_icp_object, // Must already be initialized
                          vw::Vector3 const& shift,
                          vw::cartography::GeoReference        const& dem_georef,
-                         vw::ImageViewRef< PixelMask<float> > const& dem_ref,
+                         vw::ImageViewRef< PixelMask<float> > const& masked_dem,
                          Options const& opt) {
 
   // Filter gross outliers
@@ -865,7 +985,7 @@ void filter_source_cloud(DP          const& ref_point_cloud,
     if (opt.use_dem_distances()) {
       // Compute the registration error using the best available means
       compute_registration_error(ref_point_cloud, source_point_cloud, pm_icp_object, shift,
-                                 dem_georef, dem_ref, opt, error_matrix);
+                                 dem_georef, masked_dem, opt, error_matrix);
 
       filterPointsByError(source_point_cloud, error_matrix, opt.max_disp);
     } else { // LPM only method
@@ -944,15 +1064,40 @@ std::string find_matches_from_hillshading(Options & opt, std::string const& curr
   ans = vw::exec_cmd(cmd.c_str());
   vw_out() << ans << std::endl;
 
-  // IP find
-  cmd = ipfind_path + " " + opt.ipfind_options + " " + ref_hillshade + " " + source_hillshade;
-  vw_out() << cmd << std::endl;
-  ans = vw::exec_cmd(cmd.c_str());
-  vw_out() << ans << std::endl;
-
-  // IP match
+  // IP find. Run it only on the hillshades whose ip are not in the cache.
   std::string ref_ip    = fs::path(ref_hillshade).replace_extension(".vwip").string();
   std::string source_ip = fs::path(source_hillshade).replace_extension(".vwip").string();
+  std::vector<std::string> hillshades = {ref_hillshade, source_hillshade};
+  std::vector<std::string> ip_files   = {ref_ip, source_ip};
+  std::vector<std::string> cache_keys(hillshades.size());
+  std::vector<bool> need_ipfind(hillshades.size(), true);
+  std::string ipfind_images;
+  for (size_t it = 0; it < hillshades.size(); it++) {
+    if (opt.ip_cache_dir != "") {
+      cache_keys[it] = asp::ip_cache_key(asp::image_file_hash(hillshades[it]),
+                                         "ipfind " + opt.ipfind_options);
+      need_ipfind[it] = !asp::ip_cache_fetch_file(opt.ip_cache_dir, cache_keys[it],
+                                                  ip_files[it]);
+    }
+    if (need_ipfind[it])
+      ipfind_images += " " + hillshades[it];
+  }
+
+  if (ipfind_images != "") {
+    cmd = ipfind_path + " " + opt.ipfind_options + ipfind_images;
+    vw_out() << cmd << std::endl;
+    ans = vw::exec_cmd(cmd.c_str());
+    vw_out() << ans << std::endl;
+
+    if (opt.ip_cache_dir != "") {
+      for (size_t it = 0; it < hillshades.size(); it++) {
+        if (need_ipfind[it] && fs::exists(ip_files[it]))
+          asp::ip_cache_store_file(opt.ip_cache_dir, cache_keys[it], ip_files[it]);
+      }
+    }
+  }
+
+  // IP match
 
   cmd = ipmatch_path + " " + opt.ipmatch_options + " "
     + ref_hillshade + " " + ref_ip + " " + source_hillshade + " " + source_ip + " -o "
@@ -981,7 +1126,7 @@ initial_transform_from_match_file(std::string const& ref_file,
 
   vector<vw::ip::InterestPoint> ref_ip, source_ip;
   vw_out() << "Reading match file: " << match_file << "\n";
-  vw::ip::read_binary_match_file(match_file, ref_ip, source_ip);
+  asp::read_match_file(match_file, ref_ip, source_ip);
 
   DiskImageView<float> ref(ref_file);
   vw::cartography::GeoReference ref_geo;
@@ -1164,6 +1309,487 @@ void adjust_and_intersect_ref_source_boxes(BBox2 & ref_box, BBox2 & source_box,
   adjust_lonlat_bbox(source, source_box);
 }
 
+// Create the reference cache if it does not exist or is out of date,
+// and memory-map it.
+void load_reference_cache(Options const& opt, GeoReference const& geo,
+                          asp::CsvConv const& csv_conv, asp::PointCloudCache & ref_cache) {
+
+  std::ostringstream os;
+  os << std::setprecision(17) << geo.datum() << ' ' << opt.csv_format_str << ' '
+     << opt.csv_proj4_str << ' ' << opt.max_num_reference_points;
+  std::uint64_t key = asp::PointCloudCache::make_key(opt.reference, os.str());
+  if (ref_cache.read(opt.reference_cache, key)) {
+    vw_out() << "Using the reference cache: " << opt.reference_cache << std::endl;
+    return;
+  }
+
+  vw_out() << "Creating the reference cache: " << opt.reference_cache << std::endl;
+  DP all_ref;
+  Vector3 cache_shift;
+  bool calc_shift = true, is_lola_rdr_format = false;
+  double median_longitude = 0.0;
+  load_cloud(opt.reference, opt.max_num_reference_points, BBox2(),
+             calc_shift, cache_shift, geo, csv_conv, is_lola_rdr_format,
+             median_longitude, opt.verbose, all_ref);
+  vw::create_out_dir(opt.reference_cache);
+  asp::PointCloudCache::write(opt.reference_cache, key, all_ref.features,
+                              cache_shift, geo.datum(), median_longitude,
+                              is_lola_rdr_format);
+  if (!ref_cache.read(opt.reference_cache, key))
+    vw_throw(IOErr() << "Failed to read back: " << opt.reference_cache << "\n");
+}
+
+// Align one source cloud to the reference. If the reference cache is
+// not NULL, the reference points are taken from it.
+void align_source(Options opt, std::string const& prog_name,
+                  GeoReference const& geo, asp::CsvConv const& csv_conv,
+                  asp::PointCloudCache const* ref_cache) {
+
+  // Use hillshading to create a match file
+  if (opt.hillshading_transform != "" && opt.match_file == "")
+    opt.match_file = find_matches_from_hillshading(opt, prog_name);
+  
+  // Create a transform based on a match file, either automatically generated, or
+  // user-made (normally with stereo_gui).
+  if (opt.match_file != "") {
+    if (opt.hillshading_transform == "") 
+      opt.hillshading_transform = "similarity";
+    opt.init_transform = initial_transform_from_match_file(opt.reference, opt.source,
+                                                           opt.match_file,
+                                                           opt.hillshading_transform,
+                                                           opt.initial_transform_ransac_params);
+  }
+
+  // We will use ref_box to bound the source points, and vice-versa.
+  // Decide how many samples to pick to estimate these boxes.
+  asp::TelemetryTimer sw0("pc_align.intersect_boxes");
+  int num_sample_pts = std::max(4000000,
+                                std::max(opt.max_num_source_points,
+                                         opt.max_num_reference_points)/4);
+  num_sample_pts = std::min(9000000, num_sample_pts); // avoid being slow
+  
+  // Compute GDC bounding box of the source and reference clouds.
+  vw_out() << "Computing the intersection of the bounding boxes "
+           << "of the reference and source points using " 
+           << num_sample_pts << " sample points.\n";
+  BBox2 ref_box, source_box, trans_ref_box, trans_source_box;
+
+  PointMatcher<RealT>::Matrix inv_init_trans = opt.init_transform.inverse();
+  if (ref_cache != NULL) {
+    DoubleMatrix sample;
+    Vector3 cache_shift;
+    ref_cache->load(BBox2(), num_sample_pts, cache_shift, sample);
+    for (int row = 0; row < DIM; row++)
+      sample.row(row).array() += cache_shift[row];
+    calc_extended_lonlat_bbox(geo, sample, ref_cache->median_longitude(),
+                              opt.max_disp, inv_init_trans, ref_box, trans_ref_box);
+  } else {
+    calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
+                              opt.reference, opt.max_disp, inv_init_trans,
+                              ref_box, trans_ref_box);
+  }
+  calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
+                            opt.source, opt.max_disp, opt.init_transform,
+                            source_box, trans_source_box);
+
+  // When boxes are huge, it is hard to do the optimization of intersecting
+  // them, as they may differ not by 0 or 360, but by 180. Better do nothing
+  // in that case. The solution may degrade a bit, as we may load points
+  // not in the intersection of the boxes, but at least it won't be wrong.
+  // In this case, there is a chance the boxes were computed wrong anyway.
+  if (ref_box.width() > 180.0 || source_box.width() > 180.0) {
+    vw_out() << "Warning: Your input point clouds are spread over more than half the planet. "
+             << "It is suggested that they be cropped, to get more accurate results. "
+             << "Giving up on estimating their bounding boxes and filtering outliers "
+             << "based on them.\n";
+    ref_box = BBox2();
+    source_box = BBox2();
+  }
+  
+  vw_out() << "Reference box: " << ref_box << std::endl;
+  vw_out() << "Source box:    " << source_box << std::endl;
+  
+  if (!ref_box.empty() && !source_box.empty()) {
+    adjust_and_intersect_ref_source_boxes(ref_box, trans_source_box, opt.reference, opt.source);
+    adjust_and_intersect_ref_source_boxes(trans_ref_box, source_box, opt.reference, opt.source);
+  }
+  
+  vw_out() << "Intersection reference box:  " << ref_box    << std::endl;
+  vw_out() << "Intersection source    box:  " << source_box << std::endl;
+  
+  sw0.stop();
+  vw_out() << "Intersection of bounding boxes took " << sw0.elapsed_seconds() << " [s]" << endl;
+
+  // Load the point clouds. We will shift both point clouds by the
+  // centroid of the first one to bring them closer to origin.
+
+  // Load the subsampled reference point cloud.
+  Vector3 shift;
+  bool   calc_shift = true; // Shift points so the first point is (0,0,0)
+  bool   is_lola_rdr_format = false;   // may get overwritten
+  double mean_ref_longitude    = 0.0;  // may get overwritten
+  double mean_source_longitude = 0.0;  // may get overwritten
+  asp::TelemetryTimer sw1("pc_align.load_reference");
+  DP ref_point_cloud;
+  if (ref_cache != NULL) {
+    ref_point_cloud.featureLabels = form_labels<RealT>(DIM);
+    ref_cache->load(ref_box, opt.max_num_reference_points, shift,
+                    ref_point_cloud.features);
+    is_lola_rdr_format = ref_cache->is_lola_rdr_format();
+    mean_ref_longitude = ref_cache->median_longitude();
+    if (ref_point_cloud.features.cols() == 0)
+      vw_throw(ArgumentErr() << "The reference cache: " << opt.reference_cache
+               << " has no points in the region of interest.\n");
+    if (opt.verbose)
+      vw_out() << "Loaded points: " << ref_point_cloud.features.cols() << std::endl;
+  } else {
+    load_cloud(opt.reference, opt.max_num_reference_points, ref_box,
+               calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
+               mean_ref_longitude, opt.verbose, ref_point_cloud);
+  }
+  sw1.stop();
+  if (opt.verbose)
+    vw_out() << "Loading the reference point cloud took "
+             << sw1.elapsed_seconds() << " [s]" << endl;
+  //ref_point_cloud.save(outputBaseFile + "_ref.vtk");
+
+  // Load the subsampled source point cloud. If the user wants
+  // to filter gross outliers in the source points based on
+  // max_disp, load a lot more points than asked, filter based on
+  // max_disp, then resample to the number desired by the user.
+  int num_source_pts = opt.max_num_source_points;
+  if (opt.max_disp > 0.0)
+    num_source_pts = max(num_source_pts, 50000000);
+  calc_shift = false; // Use the same shift used for the reference point cloud
+  asp::TelemetryTimer sw2("pc_align.load_source");
+  DP source_point_cloud;
+  load_cloud(opt.source, num_source_pts, source_box, 
+	      calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
+	      mean_source_longitude, opt.verbose, source_point_cloud);
+  sw2.stop();
+  if (opt.verbose)
+    vw_out() << "Loading the source point cloud took "
+             << sw2.elapsed_seconds() << " [s]" << endl;
+
+  // So far we shifted by first point in reference point cloud to reduce
+  // the magnitude of all loaded points. Now that we have loaded all
+  // points, shift one more time, to place the centroid of the
+  // reference at the origin.
+  // Note: If this code is ever converting to using floats,
+  // the operation below needs to be re-implemented to be accurate.
+  int numRefPts = ref_point_cloud.features.cols();
+  Eigen::VectorXd meanRef = ref_point_cloud.features.rowwise().sum() / numRefPts;
+  ref_point_cloud.features.topRows(DIM).colwise()    -= meanRef.head(DIM);
+  source_point_cloud.features.topRows(DIM).colwise() -= meanRef.head(DIM);
+  for (int row = 0; row < DIM; row++)
+    shift[row] += meanRef(row); // Update the shift variable as well as the points
+  if (opt.verbose)
+    vw_out() << "Data shifted internally by subtracting: " << shift << std::endl;
+
+  // The point clouds are shifted, so shift the initial transform as well.
+  PointMatcher<RealT>::Matrix initT = apply_shift(opt.init_transform, shift);
+
+  // If the reference point cloud came from a DEM, also load the data in DEM format.
+  // The masked DEM is sampled by tile when computing errors, while the
+  // interpolated one is used by the least squares cost functions.
+  cartography::GeoReference dem_georef;
+  vw::ImageViewRef< PixelMask<float> > reference_dem_ref, reference_masked_dem;
+  if (opt.use_dem_distances()) {
+    vw_out() << "Loading reference as DEM." << endl;
+    // Load the dem, then wrap it inside an ImageViewRef object.
+    // - This is done because the actual DEM type cannot be created without being initialized.
+    reference_masked_dem = load_masked_dem(opt.reference, dem_georef);
+    InterpolationReadyDem reference_dem(interpolate(reference_masked_dem));
+    reference_dem_ref.reset(reference_dem);
+  }
+
+  // Now all of the input data is loaded.
+
+  // Filter the reference and initialize the reference tree
+  double elapsed_time;
+  PM::ICP icp; // LibpointMatcher object
+
+  asp::TelemetryTimer sw3("pc_align.build_tree");
+  if (opt.verbose)
+    vw_out() << "Building the reference cloud tree." << endl;
+  icp.initRefTree(ref_point_cloud, alignment_method_fallback(opt.alignment_method),
+		    opt.highest_accuracy, false /*opt.verbose*/);
+  sw3.stop();
+  if (opt.verbose)
+    vw_out() << "Reference point cloud processing took " << sw3.elapsed_seconds() << " [s]\n";
+
+  // Apply the initial guess transform to the source point cloud.
+  apply_transform_to_cloud(initT, source_point_cloud);
+  
+  PointMatcher<RealT>::Matrix beg_errors;
+  if (opt.max_disp > 0.0){
+    // Filter gross outliers
+    filter_source_cloud(ref_point_cloud, source_point_cloud, icp,
+                        shift, dem_georef, reference_masked_dem, opt);
+  }
+  
+  random_pc_subsample(opt.max_num_source_points, source_point_cloud.features);
+  vw_out() << "Reducing number of source points to "
+           << source_point_cloud.features.cols() << endl;
+
+  // Write the point cloud to disk for debugging
+  //debug_save_point_cloud(ref_point_cloud, geo, shift, "ref.csv");
+  //dump_bin("ref.bin", ref_point_cloud);
+
+  // Make the libpointmatcher error message clearer
+  std::string libpointmatcher_error = "no point to minimize";
+  std::string pc_align_error = std::string
+    ("This likely means that the clouds are too far. Consider increasing the "
+     "--max-displacement value to something somewhat larger than the expected "
+     "length of the displacement that may be needed to align the clouds.\n");
+  
+  try {
+    elapsed_time = compute_registration_error(ref_point_cloud, source_point_cloud, icp,
+                                              shift, dem_georef, reference_masked_dem,
+                                              opt, beg_errors);
+  } catch(std::exception const& e) {
+    std::string error = e.what();
+    if (error.find(libpointmatcher_error) != std::string::npos)
+      error += ".\n" + pc_align_error; // clarify the error
+    vw_throw(ArgumentErr() << error);
+  }
+  
+  calc_stats("Input", beg_errors);
+  if (opt.verbose)
+    vw_out() << "Initial error computation took " << elapsed_time << " [s]" << endl;
+
+  // Compute the transformation to align the source to reference.
+  asp::TelemetryTimer sw4("pc_align.alignment");
+  PointMatcher<RealT>::Matrix Id = PointMatcher<RealT>::Matrix::Identity(DIM + 1, DIM + 1);
+  if (opt.config_file == ""){
+    // Read the options from the command line
+    icp.setParams(opt.out_prefix, opt.num_iter, opt.outlier_ratio,
+                  (2.0*M_PI/360.0)*opt.diff_rotation_err, // convert to radians
+                  opt.diff_translation_err, alignment_method_fallback(opt.alignment_method),
+                  false/*opt.verbose*/);
+  }else{
+    vw_out() << "Will read the options from: " << opt.config_file << endl;
+    ifstream ifs(opt.config_file.c_str());
+    if (!ifs.good())
+      vw_throw( ArgumentErr() << "Cannot open configuration file: "
+                << opt.config_file << "\n" );
+    icp.loadFromYaml(ifs);
+  }
+
+  // The matcher is replaced after the parameters are set, as that
+  // creates a new one. The reference was filtered in place by initRefTree().
+  if (opt.nn_backend == "gpu" && opt.num_iter > 0)
+    use_gpu_matcher(icp, ref_point_cloud);
+
+  // We bypass calling ICP if the user explicitely asks for 0 iterations.
+  PointMatcher<RealT>::Matrix T = Id;
+  if (opt.num_iter > 0){
+    if (opt.alignment_method == "fgr") {
+      T = fgr_alignment(source_point_cloud, ref_point_cloud, opt);
+    } else if (opt.alignment_method == "point-to-plane" ||
+               opt.alignment_method == "point-to-point" ||
+               opt.alignment_method == "similarity-point-to-point" ||
+               opt.alignment_method == "similarity-point-to-plane") {
+      // Use libpointmatcher
+      try {
+        T = icp(source_point_cloud, ref_point_cloud, Id, opt.compute_translation_only);
+      } catch(std::exception const& e) {
+        std::string error = e.what();
+        if (error.find(libpointmatcher_error) != std::string::npos)
+          error += ".\n" + pc_align_error; // clarify the error
+        vw_throw(ArgumentErr() << error);
+      }
+      
+      vw_out() << "Match ratio: "
+		 << icp.errorMinimizer->getWeightedPointUsedRatio() << endl;
+    }else if (opt.alignment_method == "least-squares" ||
+              opt.alignment_method == "similarity-least-squares"){
+      /// Compute alignment using least squares
+	T = least_squares_alignment(source_point_cloud, shift,
+				    dem_georef, reference_dem_ref, opt);
+    }else
+      vw_throw( ArgumentErr() << "Unknown alignment method: " << opt.alignment_method);
+  }
+  sw4.stop();
+  if (opt.verbose)
+    vw_out() << "Alignment took " << sw4.elapsed_seconds() << " [s]" << endl;
+
+  // Transform the source to make it close to reference.
+  DP trans_source_point_cloud(source_point_cloud);
+  apply_transform_to_cloud(T, trans_source_point_cloud);
+
+  // Calculate by how much points move as result of T
+  double max_obtained_disp = calc_max_displacment(source_point_cloud, trans_source_point_cloud);
+  Vector3 source_ctr_vec, source_ctr_llh;
+  Vector3 trans_xyz, trans_ned, trans_llh;
+  vw::Matrix3x3 NedToEcef;
+  calc_translation_vec(initT, source_point_cloud, trans_source_point_cloud, shift,
+			 geo.datum(), source_ctr_vec, source_ctr_llh,
+                       trans_xyz, trans_ned, trans_llh, NedToEcef);
+
+  // For each point, compute the distance to the nearest reference point.
+  PointMatcher<RealT>::Matrix end_errors;
+  elapsed_time = compute_registration_error(ref_point_cloud, trans_source_point_cloud, icp,
+                                            shift, dem_georef, reference_masked_dem, opt,
+					      end_errors);
+  calc_stats("Output", end_errors);
+  if (opt.verbose)
+    vw_out() << "Final error computation took " << elapsed_time << " [s]" << endl;
+
+  // We must apply to T the initial guess transform
+  PointMatcher<RealT>::Matrix combinedT = T*initT;
+
+  // Go back to the original coordinate system, undoing the shift
+  PointMatcher<RealT>::Matrix globalT = apply_shift(combinedT, -shift);
+
+  // Print statistics
+  vw_out() << std::setprecision(16)
+           << "Alignment transform (origin is planet center):" << endl << globalT << endl;
+  vw_out() << std::setprecision(8); // undo the higher precision
+
+  vw_out() << "Centroid of source points (Cartesian, meters): " << source_ctr_vec << std::endl;
+  // Swap lat and lon, as we want to print lat first
+  std::swap(source_ctr_llh[0], source_ctr_llh[1]);
+  vw_out() << "Centroid of source points (lat,lon,z): " << source_ctr_llh << std::endl;
+  vw_out() << std::endl;
+
+  vw_out() << "Translation vector (Cartesian, meters): " << trans_xyz << std::endl;
+  vw_out() << "Translation vector (North-East-Down, meters): "
+           << trans_ned << std::endl;
+  vw_out() << "Translation vector magnitude (meters): " << norm_2(trans_xyz)
+           << std::endl;
+  vw::vw_out() << "Maximum displacement of points between the source "
+               << "cloud with any initial transform applied to it and the "
+               << "source cloud after alignment to the reference: " 
+               << max_obtained_disp << " m" << std::endl;
+  if (opt.max_disp > 0 && opt.max_disp < max_obtained_disp) {
+    vw_out() << "Warning: The input --max-displacement value is smaller than the "
+             << "final observed displacement. It may be advised to increase the former "
+             << "and rerun the tool.\n";
+  }
+
+  // Swap lat and lon, as we want to print lat first
+  std::swap(trans_llh[0], trans_llh[1]);
+  vw_out() << "Translation vector (lat,lon,z): " << trans_llh << std::endl;
+  vw_out() << std::endl;
+
+  Matrix3x3 rot;
+  for (int r = 0; r < DIM; r++)
+    for (int c = 0; c < DIM; c++)
+      rot(r, c) = globalT(r, c);
+
+  double scale = pow(det(rot), 1.0/3.0);
+  for (int r = 0; r < DIM; r++)
+    for (int c = 0; c < DIM; c++)
+      rot(r, c) /= scale;
+
+  // Subtract one before printing the scale, to see a lot of digits of precision
+  vw_out() << "Transform scale - 1 = " << (scale-1.0) << std::endl;
+  
+  Matrix3x3 rot_NED = inverse(NedToEcef) * rot * NedToEcef;
+ 
+  Vector3 euler_angles = math::rotation_matrix_to_euler_xyz(rot) * 180/M_PI;
+  Vector3 euler_angles_NED = math::rotation_matrix_to_euler_xyz(rot_NED) * 180/M_PI;
+  Vector3 axis_angles = math::matrix_to_axis_angle(rot) * 180/M_PI;
+  vw_out() << "Euler angles (degrees): " << euler_angles  << endl;
+  vw_out() << "Euler angles (North-East-Down, degrees): " << euler_angles_NED  << endl;
+  vw_out() << "Axis of rotation and angle (degrees): "
+           << axis_angles/norm_2(axis_angles) << ' '
+           << norm_2(axis_angles) << endl;
+
+  
+  asp::TelemetryTimer sw5("pc_align.write_output");
+  write_transforms(opt, globalT);
+
+  if (opt.save_trans_ref){
+    string trans_ref_prefix = opt.out_prefix + "-trans_reference";
+    save_trans_point_cloud(opt, opt.reference, trans_ref_prefix,
+                           geo, csv_conv, globalT.inverse());
+  }
+
+  if (opt.save_trans_source){
+    string trans_source_prefix = opt.out_prefix + "-trans_source";
+    save_trans_point_cloud(opt, opt.source, trans_source_prefix,
+                           geo, csv_conv, globalT);
+  }
+
+  save_errors(source_point_cloud, beg_errors,  opt.out_prefix + "-beg_errors.csv",
+              shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
+  save_errors(trans_source_point_cloud, end_errors,  opt.out_prefix + "-end_errors.csv",
+              shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
+
+  if (opt.verbose) vw_out() << "Writing: " << opt.out_prefix
+    + "-iterationInfo.csv" << std::endl;
+
+  sw5.stop();
+  if (opt.verbose) vw_out() << "Saving to disk took "
+                            << sw5.elapsed_seconds() << " [s]" << endl;
+}
+
+// Align one source in batch mode, recording any failure
+class AlignSourceTask: public vw::Task, private boost::noncopyable {
+  Options m_opt;
+  std::string m_prog_name;
+  GeoReference const& m_geo;
+  asp::CsvConv const& m_csv_conv;
+  asp::PointCloudCache const* m_ref_cache;
+  int & m_num_failed;
+  vw::Mutex & m_mutex;
+
+public:
+  AlignSourceTask(Options const& opt, std::string const& prog_name,
+                  GeoReference const& geo, asp::CsvConv const& csv_conv,
+                  asp::PointCloudCache const* ref_cache,
+                  int & num_failed, vw::Mutex & mutex):
+    m_opt(opt), m_prog_name(prog_name), m_geo(geo), m_csv_conv(csv_conv),
+    m_ref_cache(ref_cache), m_num_failed(num_failed), m_mutex(mutex) {}
+
+  void operator()() {
+    vw_out() << "Aligning: " << m_opt.source << std::endl;
+    try {
+      align_source(m_opt, m_prog_name, m_geo, m_csv_conv, m_ref_cache);
+    } catch (std::exception const& e) {
+      vw::Mutex::Lock lock(m_mutex);
+      vw_out(vw::WarningMessage) << "Failed to align: " << m_opt.source << ". "
+                                 << e.what() << std::endl;
+      m_num_failed++;
+    }
+  }
+};
+
+// Align each source in the list to the reference, with the outputs of
+// each having the output prefix followed by the source name
+void align_sources(Options const& opt, std::vector<std::string> const& sources,
+                   std::string const& prog_name, GeoReference const& geo,
+                   asp::CsvConv const& csv_conv, asp::PointCloudCache const* ref_cache) {
+
+  std::set<std::string> prefixes;
+  std::vector<Options> source_opts(sources.size(), opt);
+  for (size_t it = 0; it < sources.size(); it++) {
+    source_opts[it].source = sources[it];
+    source_opts[it].out_prefix = opt.out_prefix + "-"
+      + boost::filesystem::path(sources[it]).stem().string();
+    if (!prefixes.insert(source_opts[it].out_prefix).second)
+      vw_throw(ArgumentErr() << "The sources in: " << opt.source_list
+               << " must have distinct names, as the outputs are named after them.\n");
+  }
+
+  int num_failed = 0;
+  vw::Mutex mutex;
+  FifoWorkQueue queue(opt.num_parallel_sources);
+  for (size_t it = 0; it < sources.size(); it++) {
+    boost::shared_ptr<AlignSourceTask>
+      task(new AlignSourceTask(source_opts[it], prog_name, geo, csv_conv,
+                               ref_cache, num_failed, mutex));
+    queue.add_task(task);
+  }
+  queue.join_all();
+
+  if (num_failed > 0)
+    vw_throw(ArgumentErr() << "Failed to align " << num_failed << " out of "
+             << sources.size() << " sources.\n");
+}
+
 int main( int argc, char *argv[] ) {
 
   // Mandatory line for Eigen
@@ -1173,39 +1799,34 @@ int main( int argc, char *argv[] ) {
   try {
     handle_arguments(argc, argv, opt);
 
-    // Set the number of threads for OpenMP. 
+    // Set the number of threads for OpenMP. The sources aligned in
+    // parallel share the cores.
     int processor_count = std::thread::hardware_concurrency();
     omp_set_dynamic(0);
-    omp_set_num_threads(processor_count);
+    omp_set_num_threads(std::max(processor_count / opt.num_parallel_sources, 1));
     
     // Parse the csv format string and csv projection string
     asp::CsvConv csv_conv;
     csv_conv.parse_csv_format(opt.csv_format_str, opt.csv_proj4_str);
 
+    // The sources to align
+    std::vector<std::string> sources;
+    if (opt.source_list != "")
+      asp::read_list(opt.source_list, sources);
+    else
+      sources.push_back(opt.source);
+    if (sources.empty())
+      vw_throw(ArgumentErr() << "No sources were found in: " << opt.source_list << "\n");
+
     // Try to read the georeference/datum info
     GeoReference geo;
     std::vector<std::string> clouds;
     clouds.push_back(opt.reference);
-    clouds.push_back(opt.source);
+    clouds.insert(clouds.end(), sources.begin(), sources.end());
     read_georef(clouds, opt.datum, opt.csv_proj4_str,  
                 opt.semi_major_axis, opt.semi_minor_axis,  
                 opt.csv_format_str,  csv_conv, geo);
 
-    // Use hillshading to create a match file
-    if (opt.hillshading_transform != "" && opt.match_file == "")
-      opt.match_file = find_matches_from_hillshading(opt, argv[0]);
-    
-    // Create a transform based on a match file, either automatically generated, or
-    // user-made (normally with stereo_gui).
-    if (opt.match_file != "") {
-      if (opt.hillshading_transform == "") 
-        opt.hillshading_transform = "similarity";
-      opt.init_transform = initial_transform_from_match_file(opt.reference, opt.source,
-                                                             opt.match_file,
-                                                             opt.hillshading_transform,
-                                                             opt.initial_transform_ransac_params);
-    }
-
     // See if to apply an initial north-east-down translation relative
     // to the point cloud centroid, and/or a rotation around the axis
     // going from the planet center to the centroid. The rotation
@@ -1231,345 +1852,21 @@ int main( int argc, char *argv[] ) {
           * opt.init_transform;
     }
 
-    // We will use ref_box to bound the source points, and vice-versa.
-    // Decide how many samples to pick to estimate these boxes.
-    Stopwatch sw0;
-    sw0.start();
-    int num_sample_pts = std::max(4000000,
-                                  std::max(opt.max_num_source_points,
-                                           opt.max_num_reference_points)/4);
-    num_sample_pts = std::min(9000000, num_sample_pts); // avoid being slow
-    
-    // Compute GDC bounding box of the source and reference clouds.
-    vw_out() << "Computing the intersection of the bounding boxes "
-             << "of the reference and source points using " 
-             << num_sample_pts << " sample points.\n";
-    BBox2 ref_box, source_box, trans_ref_box, trans_source_box;
-
-    PointMatcher<RealT>::Matrix inv_init_trans = opt.init_transform.inverse();
-    calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                              opt.reference, opt.max_disp, inv_init_trans,
-                              ref_box, trans_ref_box);
-    calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                              opt.source, opt.max_disp, opt.init_transform,
-                              source_box, trans_source_box);
-
-    // When boxes are huge, it is hard to do the optimization of intersecting
-    // them, as they may differ not by 0 or 360, but by 180. Better do nothing
-    // in that case. The solution may degrade a bit, as we may load points
-    // not in the intersection of the boxes, but at least it won't be wrong.
-    // In this case, there is a chance the boxes were computed wrong anyway.
-    if (ref_box.width() > 180.0 || source_box.width() > 180.0) {
-      vw_out() << "Warning: Your input point clouds are spread over more than half the planet. "
-               << "It is suggested that they be cropped, to get more accurate results. "
-               << "Giving up on estimating their bounding boxes and filtering outliers "
-               << "based on them.\n";
-      ref_box = BBox2();
-      source_box = BBox2();
-    }
-    
-    vw_out() << "Reference box: " << ref_box << std::endl;
-    vw_out() << "Source box:    " << source_box << std::endl;
-    
-    if (!ref_box.empty() && !source_box.empty()) {
-      adjust_and_intersect_ref_source_boxes(ref_box, trans_source_box, opt.reference, opt.source);
-      adjust_and_intersect_ref_source_boxes(trans_ref_box, source_box, opt.reference, opt.source);
-    }
-    
-    vw_out() << "Intersection reference box:  " << ref_box    << std::endl;
-    vw_out() << "Intersection source    box:  " << source_box << std::endl;
-    
-    sw0.stop();
-    vw_out() << "Intersection of bounding boxes took " << sw0.elapsed_seconds() << " [s]" << endl;
-
-    // Load the point clouds. We will shift both point clouds by the
-    // centroid of the first one to bring them closer to origin.
-
-    // Load the subsampled reference point cloud.
-    Vector3 shift;
-    bool   calc_shift = true; // Shift points so the first point is (0,0,0)
-    bool   is_lola_rdr_format = false;   // may get overwritten
-    double mean_ref_longitude    = 0.0;  // may get overwritten
-    double mean_source_longitude = 0.0;  // may get overwritten
-    Stopwatch sw1;
-    sw1.start();
-    DP ref_point_cloud;
-    load_cloud(opt.reference, opt.max_num_reference_points, ref_box,
-               calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-               mean_ref_longitude, opt.verbose, ref_point_cloud);
-    sw1.stop();
-    if (opt.verbose)
-      vw_out() << "Loading the reference point cloud took "
-               << sw1.elapsed_seconds() << " [s]" << endl;
-    //ref_point_cloud.save(outputBaseFile + "_ref.vtk");
-
-    // Load the subsampled source point cloud. If the user wants
-    // to filter gross outliers in the source points based on
-    // max_disp, load a lot more points than asked, filter based on
-    // max_disp, then resample to the number desired by the user.
-    int num_source_pts = opt.max_num_source_points;
-    if (opt.max_disp > 0.0)
-      num_source_pts = max(num_source_pts, 50000000);
-    calc_shift = false; // Use the same shift used for the reference point cloud
-    Stopwatch sw2;
-    sw2.start();
-    DP source_point_cloud;
-    load_cloud(opt.source, num_source_pts, source_box, 
-	      calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-	      mean_source_longitude, opt.verbose, source_point_cloud);
-    sw2.stop();
-    if (opt.verbose)
-      vw_out() << "Loading the source point cloud took "
-               << sw2.elapsed_seconds() << " [s]" << endl;
-
-    // So far we shifted by first point in reference point cloud to reduce
-    // the magnitude of all loaded points. Now that we have loaded all
-    // points, shift one more time, to place the centroid of the
-    // reference at the origin.
-    // Note: If this code is ever converting to using floats,
-    // the operation below needs to be re-implemented to be accurate.
-    int numRefPts = ref_point_cloud.features.cols();
-    Eigen::VectorXd meanRef = ref_point_cloud.features.rowwise().sum() / numRefPts;
-    ref_point_cloud.features.topRows(DIM).colwise()    -= meanRef.head(DIM);
-    source_point_cloud.features.topRows(DIM).colwise() -= meanRef.head(DIM);
-    for (int row = 0; row < DIM; row++)
-      shift[row] += meanRef(row); // Update the shift variable as well as the points
-    if (opt.verbose)
-      vw_out() << "Data shifted internally by subtracting: " << shift << std::endl;
-
-    // The point clouds are shifted, so shift the initial transform as well.
-    PointMatcher<RealT>::Matrix initT = apply_shift(opt.init_transform, shift);
-
-    // If the reference point cloud came from a DEM, also load the data in DEM format.
-    cartography::GeoReference dem_georef;
-    vw::ImageViewRef< PixelMask<float> > reference_dem_ref;
-    if (opt.use_dem_distances()) {
-      vw_out() << "Loading reference as DEM." << endl;
-      // Load the dem, then wrap it inside an ImageViewRef object.
-      // - This is done because the actual DEM type cannot be created without being initialized.
-      InterpolationReadyDem reference_dem(load_interpolation_ready_dem(opt.reference, dem_georef));
-      reference_dem_ref.reset(reference_dem);
-    }
-
-    // Now all of the input data is loaded.
-
-    // Filter the reference and initialize the reference tree
-    double elapsed_time;
-    PM::ICP icp; // LibpointMatcher object
-
-    Stopwatch sw3;
-    if (opt.verbose)
-      vw_out() << "Building the reference cloud tree." << endl;
-    sw3.start();
-    icp.initRefTree(ref_point_cloud, alignment_method_fallback(opt.alignment_method),
-		    opt.highest_accuracy, false /*opt.verbose*/);
-    sw3.stop();
-    if (opt.verbose)
-      vw_out() << "Reference point cloud processing took " << sw3.elapsed_seconds() << " [s]\n";
-
-    // Apply the initial guess transform to the source point cloud.
-    apply_transform_to_cloud(initT, source_point_cloud);
-    
-    PointMatcher<RealT>::Matrix beg_errors;
-    if (opt.max_disp > 0.0){
-      // Filter gross outliers
-      filter_source_cloud(ref_point_cloud, source_point_cloud, icp,
-                          shift, dem_georef, reference_dem_ref, opt);
-    }
-    
-    random_pc_subsample(opt.max_num_source_points, source_point_cloud.features);
-    vw_out() << "Reducing number of source points to "
-             << source_point_cloud.features.cols() << endl;
-
-    // Write the point cloud to disk for debugging
-    //debug_save_point_cloud(ref_point_cloud, geo, shift, "ref.csv");
-    //dump_bin("ref.bin", ref_point_cloud);
-
-    // Make the libpointmatcher error message clearer
-    std::string libpointmatcher_error = "no point to minimize";
-    std::string pc_align_error = std::string
-      ("This likely means that the clouds are too far. Consider increasing the "
-       "--max-displacement value to something somewhat larger than the expected "
-       "length of the displacement that may be needed to align the clouds.\n");
-    
-    try {
-      elapsed_time = compute_registration_error(ref_point_cloud, source_point_cloud, icp,
-                                                shift, dem_georef, reference_dem_ref,
-                                                opt, beg_errors);
-    } catch(std::exception const& e) {
-      std::string error = e.what();
-      if (error.find(libpointmatcher_error) != std::string::npos)
-        error += ".\n" + pc_align_error; // clarify the error
-      vw_throw(ArgumentErr() << error);
-    }
-    
-    calc_stats("Input", beg_errors);
-    if (opt.verbose)
-      vw_out() << "Initial error computation took " << elapsed_time << " [s]" << endl;
-
-    // Compute the transformation to align the source to reference.
-    Stopwatch sw4;
-    sw4.start();
-    PointMatcher<RealT>::Matrix Id = PointMatcher<RealT>::Matrix::Identity(DIM + 1, DIM + 1);
-    if (opt.config_file == ""){
-      // Read the options from the command line
-      icp.setParams(opt.out_prefix, opt.num_iter, opt.outlier_ratio,
-                    (2.0*M_PI/360.0)*opt.diff_rotation_err, // convert to radians
-                    opt.diff_translation_err, alignment_method_fallback(opt.alignment_method),
-                    false/*opt.verbose*/);
-    }else{
-      vw_out() << "Will read the options from: " << opt.config_file << endl;
-      ifstream ifs(opt.config_file.c_str());
-      if (!ifs.good())
-        vw_throw( ArgumentErr() << "Cannot open configuration file: "
-                  << opt.config_file << "\n" );
-      icp.loadFromYaml(ifs);
-    }
-
-    // We bypass calling ICP if the user explicitely asks for 0 iterations.
-    PointMatcher<RealT>::Matrix T = Id;
-    if (opt.num_iter > 0){
-      if (opt.alignment_method == "fgr") {
-        T = fgr_alignment(source_point_cloud, ref_point_cloud, opt);
-      } else if (opt.alignment_method == "point-to-plane" ||
-                 opt.alignment_method == "point-to-point" ||
-                 opt.alignment_method == "similarity-point-to-point" ||
-                 opt.alignment_method == "similarity-point-to-plane") {
-        // Use libpointmatcher
-        try {
-          T = icp(source_point_cloud, ref_point_cloud, Id, opt.compute_translation_only);
-        } catch(std::exception const& e) {
-          std::string error = e.what();
-          if (error.find(libpointmatcher_error) != std::string::npos)
-            error += ".\n" + pc_align_error; // clarify the error
-          vw_throw(ArgumentErr() << error);
-        }
-        
-        vw_out() << "Match ratio: "
-		 << icp.errorMinimizer->getWeightedPointUsedRatio() << endl;
-      }else if (opt.alignment_method == "least-squares" ||
-                opt.alignment_method == "similarity-least-squares"){
-        /// Compute alignment using least squares
-	T = least_squares_alignment(source_point_cloud, shift,
-				    dem_georef, reference_dem_ref, opt);
-      }else
-        vw_throw( ArgumentErr() << "Unknown alignment method: " << opt.alignment_method);
-    }
-    sw4.stop();
-    if (opt.verbose)
-      vw_out() << "Alignment took " << sw4.elapsed_seconds() << " [s]" << endl;
-
-    // Transform the source to make it close to reference.
-    DP trans_source_point_cloud(source_point_cloud);
-    apply_transform_to_cloud(T, trans_source_point_cloud);
-
-    // Calculate by how much points move as result of T
-    double max_obtained_disp = calc_max_displacment(source_point_cloud, trans_source_point_cloud);
-    Vector3 source_ctr_vec, source_ctr_llh;
-    Vector3 trans_xyz, trans_ned, trans_llh;
-    vw::Matrix3x3 NedToEcef;
-    calc_translation_vec(initT, source_point_cloud, trans_source_point_cloud, shift,
-			 geo.datum(), source_ctr_vec, source_ctr_llh,
-                         trans_xyz, trans_ned, trans_llh, NedToEcef);
-
-    // For each point, compute the distance to the nearest reference point.
-    PointMatcher<RealT>::Matrix end_errors;
-    elapsed_time = compute_registration_error(ref_point_cloud, trans_source_point_cloud, icp,
-                                              shift, dem_georef, reference_dem_ref, opt,
-					      end_errors);
-    calc_stats("Output", end_errors);
-    if (opt.verbose)
-      vw_out() << "Final error computation took " << elapsed_time << " [s]" << endl;
-
-    // We must apply to T the initial guess transform
-    PointMatcher<RealT>::Matrix combinedT = T*initT;
-
-    // Go back to the original coordinate system, undoing the shift
-    PointMatcher<RealT>::Matrix globalT = apply_shift(combinedT, -shift);
-
-    // Print statistics
-    vw_out() << std::setprecision(16)
-             << "Alignment transform (origin is planet center):" << endl << globalT << endl;
-    vw_out() << std::setprecision(8); // undo the higher precision
-
-    vw_out() << "Centroid of source points (Cartesian, meters): " << source_ctr_vec << std::endl;
-    // Swap lat and lon, as we want to print lat first
-    std::swap(source_ctr_llh[0], source_ctr_llh[1]);
-    vw_out() << "Centroid of source points (lat,lon,z): " << source_ctr_llh << std::endl;
-    vw_out() << std::endl;
-
-    vw_out() << "Translation vector (Cartesian, meters): " << trans_xyz << std::endl;
-    vw_out() << "Translation vector (North-East-Down, meters): "
-             << trans_ned << std::endl;
-    vw_out() << "Translation vector magnitude (meters): " << norm_2(trans_xyz)
-             << std::endl;
-    vw::vw_out() << "Maximum displacement of points between the source "
-                 << "cloud with any initial transform applied to it and the "
-                 << "source cloud after alignment to the reference: " 
-                 << max_obtained_disp << " m" << std::endl;
-    if (opt.max_disp > 0 && opt.max_disp < max_obtained_disp) {
-      vw_out() << "Warning: The input --max-displacement value is smaller than the "
-               << "final observed displacement. It may be advised to increase the former "
-               << "and rerun the tool.\n";
-    }
-
-    // Swap lat and lon, as we want to print lat first
-    std::swap(trans_llh[0], trans_llh[1]);
-    vw_out() << "Translation vector (lat,lon,z): " << trans_llh << std::endl;
-    vw_out() << std::endl;
-
-    Matrix3x3 rot;
-    for (int r = 0; r < DIM; r++)
-      for (int c = 0; c < DIM; c++)
-        rot(r, c) = globalT(r, c);
-
-    double scale = pow(det(rot), 1.0/3.0);
-    for (int r = 0; r < DIM; r++)
-      for (int c = 0; c < DIM; c++)
-        rot(r, c) /= scale;
-
-    // Subtract one before printing the scale, to see a lot of digits of precision
-    vw_out() << "Transform scale - 1 = " << (scale-1.0) << std::endl;
-    
-    Matrix3x3 rot_NED = inverse(NedToEcef) * rot * NedToEcef;
-   
-    Vector3 euler_angles = math::rotation_matrix_to_euler_xyz(rot) * 180/M_PI;
-    Vector3 euler_angles_NED = math::rotation_matrix_to_euler_xyz(rot_NED) * 180/M_PI;
-    Vector3 axis_angles = math::matrix_to_axis_angle(rot) * 180/M_PI;
-    vw_out() << "Euler angles (degrees): " << euler_angles  << endl;
-    vw_out() << "Euler angles (North-East-Down, degrees): " << euler_angles_NED  << endl;
-    vw_out() << "Axis of rotation and angle (degrees): "
-             << axis_angles/norm_2(axis_angles) << ' '
-             << norm_2(axis_angles) << endl;
-
-    
-    Stopwatch sw5;
-    sw5.start();
-    write_transforms(opt, globalT);
-
-    if (opt.save_trans_ref){
-      string trans_ref_prefix = opt.out_prefix + "-trans_reference";
-      save_trans_point_cloud(opt, opt.reference, trans_ref_prefix,
-                             geo, csv_conv, globalT.inverse());
-    }
-
-    if (opt.save_trans_source){
-      string trans_source_prefix = opt.out_prefix + "-trans_source";
-      save_trans_point_cloud(opt, opt.source, trans_source_prefix,
-                             geo, csv_conv, globalT);
+    // The reference points are loaded once for all sources when in
+    // batch mode, so a cache is always used then.
+    if (opt.source_list != "" && opt.reference_cache == "")
+      opt.reference_cache = opt.out_prefix + "-reference-cache.bin";
+    asp::PointCloudCache ref_cache;
+    asp::PointCloudCache const* ref_cache_ptr = NULL;
+    if (opt.reference_cache != "") {
+      load_reference_cache(opt, geo, csv_conv, ref_cache);
+      ref_cache_ptr = &ref_cache;
     }
 
-    save_errors(source_point_cloud, beg_errors,  opt.out_prefix + "-beg_errors.csv",
-                shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
-    save_errors(trans_source_point_cloud, end_errors,  opt.out_prefix + "-end_errors.csv",
-                shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
-
-    if (opt.verbose) vw_out() << "Writing: " << opt.out_prefix
-      + "-iterationInfo.csv" << std::endl;
-
-    sw5.stop();
-    if (opt.verbose) vw_out() << "Saving to disk took "
-                              << sw5.elapsed_seconds() << " [s]" << endl;
+    if (opt.source_list == "")
+      align_source(opt, argv[0], geo, csv_conv, ref_cache_ptr);
+    else
+      align_sources(opt, sources, argv[0], geo, csv_conv, ref_cache_ptr);
 
   } ASP_STANDARD_CATCHES;
 
@@ -50,6 +50,7 @@
 #define __PC_ALIGN_UTILS_H__
 
 #include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/Manipulation.h>
 #include <vw/Cartography/Datum.h>
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/PointImageManipulation.h>
@@ -58,6 +59,7 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/EigenUtils.h>
+#include <asp/Core/DemDiff.h>
 
 // Turn off warnings about things we can't control
 #pragma GCC diagnostic push
@@ -67,6 +69,7 @@
 
 #include <limits>
 #include <cstring>
+#include <vector>
 
 #include <pointmatcher/PointMatcher.h>
 
@@ -131,6 +134,15 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
                                PointMatcher<RealT>::Matrix const transform,
                                vw::BBox2 & out_box, 
                                vw::BBox2 & trans_out_box);
+
+/// Same as above, but with the sample points already loaded, and not shifted
+void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
+                               DoubleMatrix const& points,
+                               double median_longitude,
+                               double max_disp,
+                               PointMatcher<RealT>::Matrix const transform,
+                               vw::BBox2 & out_box, 
+                               vw::BBox2 & trans_out_box);
   
 /// Compute the mean value of an std::vector out to a length
 double calc_mean(std::vector<double> const& errs, int len);
@@ -234,6 +246,10 @@ typedef vw::InterpolationView< vw::EdgeExtensionView< vw::ImageViewRef< vw::Pixe
                                                       vw::ConstantEdgeExtension>,
                                vw::BilinearInterpolation> InterpolationReadyDem;
 
+/// Load a DEM from disk with its no-data value masked, without interpolation.
+vw::ImageViewRef< vw::PixelMask<float> > load_masked_dem(std::string const& dem_path,
+                                                         vw::cartography::GeoReference& georef);
+
 /// Get ready to interpolate points on a DEM existing on disk.
 InterpolationReadyDem load_interpolation_ready_dem(std::string                  const& dem_path,
                                                    vw::cartography::GeoReference     & georef);
@@ -293,6 +293,25 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
              calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
              median_longitude, verbose, points);
 
+  calc_extended_lonlat_bbox(geo, points.features, median_longitude, max_disp, transform,
+                            out_box, trans_out_box);
+}
+
+// Same as above, but with the sample points already loaded, and not shifted
+void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
+                               DoubleMatrix const& points,
+                               double median_longitude,
+                               double max_disp,
+                               PointMatcher<RealT>::Matrix const transform,
+                               vw::BBox2 & out_box, 
+                               vw::BBox2 & trans_out_box) {
+
+  // Initialize
+  out_box       = vw::BBox2();
+  trans_out_box = vw::BBox2();
+  if (max_disp < 0.0 || geo.datum().name() == UNSPECIFIED_DATUM || points.cols() == 0)
+    return;
+
   bool has_transform = (transform != PointMatcher<RealT>::Matrix::Identity(DIM + 1, DIM + 1));
 
   // For the first point, figure out how much shift in lonlat a small
@@ -301,7 +320,7 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
   vw::Vector3 p1;
   vw::BBox2   box1, box1_trans;
   for (int row = 0; row < DIM; row++)
-    p1[row] = points.features(row, 0);
+    p1[row] = points(row, 0);
 
   for (int x = -1; x <= 1; x += 2){
     for (int y = -1; y <= 1; y += 2){
@@ -330,10 +349,10 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
 
   // Make a box around each point the size of the box we computed earlier and 
   //  keep growing the output bounding box.
-  for (int col = 0; col < points.features.cols(); col++){
+  for (int col = 0; col < points.cols(); col++){
     vw::Vector3 p;
     for (int row = 0; row < DIM; row++)
-      p[row] = points.features(row, col);
+      p[row] = points(row, col);
 
     vw::Vector3 q   = p;
     vw::Vector3 llh = geo.datum().cartesian_to_geodetic(q);
@@ -708,8 +727,8 @@ void save_trans_point_cloud(vw::GdalWriteOptions const& opt,
 
 
 
-InterpolationReadyDem load_interpolation_ready_dem(std::string                  const& dem_path,
-                                                   vw::cartography::GeoReference     & georef) {
+vw::ImageViewRef< vw::PixelMask<float> > load_masked_dem(std::string const& dem_path,
+                                                         vw::cartography::GeoReference& georef) {
   // Load the georeference from the DEM
   bool has_georef = vw::cartography::read_georeference( georef, dem_path );
   if (!has_georef)
@@ -723,9 +742,14 @@ InterpolationReadyDem load_interpolation_ready_dem(std::string
     if (dem_rsrc->has_nodata_read())
       nodata = dem_rsrc->nodata_read();
   }
-  
+
+  return create_mask(dem, nodata);
+}
+
+InterpolationReadyDem load_interpolation_ready_dem(std::string                  const& dem_path,
+                                                   vw::cartography::GeoReference     & georef) {
   // Set up interpolation + mask view of the DEM
-  vw::ImageViewRef< vw::PixelMask<float> > masked_dem = create_mask(dem, nodata);
+  vw::ImageViewRef< vw::PixelMask<float> > masked_dem = load_masked_dem(dem_path, georef);
   return InterpolationReadyDem(interpolate(masked_dem));
 }
 
@@ -38,6 +38,7 @@
 
 #include <vw/FileIO/DiskImageUtils.h>
 #include <vw/FileIO/MatrixIO.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/Image/DistanceFunction.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Cartography/GeoReference.h>
@@ -145,105 +146,179 @@ void applyAffineTransform(ImageView<Vector<double, 4>> & pc, vw::Matrix<double>
   if (T.rows() != 4 && T.cols() != 4 && T(3, 3) != 1.0)
     vw_throw(ArgumentErr() << "Expecting a 4x4 affine transform.");
 
-  for (int col = 0; col < pc.cols(); col++) {
-    for (int row = 0; row < pc.rows(); row++) {
-      
-      if (subvector(pc(col, row), 0, 3) == Vector3())
+  vw::Matrix3x3 R = submatrix(T, 0, 0, 3, 3);
+  Vector3 t(T(0, 3), T(1, 3), T(2, 3));
+
+#pragma omp parallel for
+  for (int row = 0; row < pc.rows(); row++) {
+    for (int col = 0; col < pc.cols(); col++) {
+      Vector<double, 4> & P = pc(col, row); // alias
+      if (P[0] == 0.0 && P[1] == 0.0 && P[2] == 0.0)
         continue; // outlier
-      
-      // Create homogeneous coordinates
-      Vector<double, 4> Q;
-      subvector(Q, 0, 3) = subvector(pc(col, row), 0, 3);
-      Q[3] = 1; 
-        
-      // Apply transform
-      Q = T * Q;
-
-      // Copy back
-      subvector(pc(col, row), 0, 3) = subvector(Q, 0, 3);
+      subvector(P, 0, 3) = R * subvector(P, 0, 3) + t;
     }
   }
 }
 
-// Find the surface normal at a given pixel based on the 3x3 neighborhood.
-// Return true on success.
-bool surfaceNormal(ImageView<Vector<double, 4>> const& point_image,
-                   int col, int row, Vector3 & N) {
+// Find the surface normal at a given pixel from central differences of
+// its immediate neighbors, falling back to one-sided differences where a
+// neighbor is missing. Also find the surface resolution, which is the
+// largest distance to a valid immediate neighbor, or 0 if fewer than three
+// of these are valid. Return false if the normal could not be found.
+bool surfaceNormalAndRes(ImageView<Vector<double, 4>> const& point_image,
+                         int col, int row, Vector3 & N, double & surface_res) {
 
-  // Initialize the output
   N = Vector3();
+  surface_res = 0.0;
+
+  Vector3 P = subvector(point_image(col, row), 0, 3);
+
+  // The neighbors to the left, right, top, and bottom
+  int offset_x[] = {-1, 1, 0, 0};
+  int offset_y[] = {0, 0, -1, 1};
+  Vector3 nbr[4];
+  bool valid[4];
+  int count = 0;
+  double dist = 0.0;
+  for (int it = 0; it < 4; it++) {
+    int c = col + offset_x[it], r = row + offset_y[it];
+    valid[it] = (c >= 0 && c < point_image.cols() && r >= 0 && r < point_image.rows() &&
+                 point_image(c, r) != Vector<double, 4>());
+    if (!valid[it])
+      continue;
+    nbr[it] = subvector(point_image(c, r), 0, 3);
+    dist = std::max(dist, norm_2(P - nbr[it]));
+    count++;
+  }
 
-  // Find the nearby points
-  std::vector<Eigen::Vector3d> near_points;
-  for (int c = col - 1; c <= col + 1; c++) {
-    for (int r = row - 1; r <= row + 1; r++) {
-      if (c < 0 || c >= point_image.cols()) 
-        continue;
-      if (r < 0 || r >= point_image.rows()) 
-        continue;
-      
-      Vector<double, 4> const& Q = point_image(c, r);
-      if (Q == Vector<double, 4>()) 
-        continue; // outlier
-
-      near_points.push_back(Eigen::Vector3d(Q[0], Q[1], Q[2]));
-    }
+  if (count >= 3)
+    surface_res = dist;
+
+  // The tangent vectors along the rows and columns
+  Vector3 tangent[2];
+  for (int dir = 0; dir < 2; dir++) {
+    int lo = 2 * dir, hi = 2 * dir + 1;
+    if (valid[lo] && valid[hi])
+      tangent[dir] = nbr[hi] - nbr[lo];
+    else if (valid[hi])
+      tangent[dir] = nbr[hi] - P;
+    else if (valid[lo])
+      tangent[dir] = P - nbr[lo];
+    else
+      return false;
   }
-  
-  if (near_points.size() < 5) 
-    return false;
-  
-  Eigen::Vector3d plane_normal, centroid;
-  asp::bestFitPlane(near_points, centroid, plane_normal);
-  N = Vector3(plane_normal[0], plane_normal[1], plane_normal[2]);
 
-  if (N != N) 
-    return false; // NaN
-  
+  N = cross_prod(tangent[0], tangent[1]);
+  double len = norm_2(N);
+  if (len == 0.0 || len != len)
+    return false; // degenerate or NaN
+
+  N /= len;
   return true;
 }
 
-// Estimate surface resolution by looking at four immediate neighbors. 
-// Return 0 if at least 2 neighbors are missing or the current point.
-void estimate_surface_res(ImageView<Vector<double, 4>> const& point_image,
-                          ImageView<float> & surface_res) {
+// The angle in degrees between two lines, given by their directions
+double lineAngle(Vector3 const& a, Vector3 const& b) {
+  // Use abs as the directions can point either way
+  double prod = std::abs(dot_prod(a, b) / norm_2(a) / norm_2(b));
+  return acos(prod) * (180.0 / M_PI);
+}
+
+// Apply all filters to the points in a tile, in a single pass, and find
+// the clean points, their texture, and weight. The points are in camera
+// coordinates. The weight is not yet adjusted for the blending distance.
+void filterTile(Options const& opt, BBox2i const& tile,
+                ImageView<Vector<double, 4>> const& point_image,
+                ImageView<float> const& texture,
+                bool has_texture_nodata, float texture_nodata,
+                ImageView<Vector<double, 4>> & clean_points,
+                ImageView<float> & out_texture,
+                ImageView<float> & weight) {
 
-  int offset_x[] = {-1, 0, 0, 1};
-  int offset_y[] = {0, -1, 1, 0};
-  
-  surface_res = ImageView<float>(point_image.cols(), point_image.rows());
-  for (int col = 0; col < surface_res.cols(); col++) {
-    for (int row = 0; row < surface_res.rows(); row++) {
+  // Camera direction, in camera's coordinate system
+  Vector3 cam_dir(0.0, 0.0, 1.0);
+
+  bool use_normal = (opt.max_camera_ray_to_surface_normal_angle > 0 ||
+                     opt.max_camera_dir_to_surface_normal_angle > 0);
+  bool use_res = (opt.reliable_surface_resolution > 0);
 
-      surface_res(col, row) = 0.0;
+  for (int row = tile.min().y(); row < tile.max().y(); row++) {
+    for (int col = tile.min().x(); col < tile.max().x(); col++) {
+
+      weight(col, row) = 0.0;
+      out_texture(col, row) = 0.0;
+      clean_points(col, row) = Vector<double, 4>();
 
       Vector<double, 4> const& P = point_image(col, row); // alias
-      if (P == Vector<double, 4>()) 
+      if (subvector(P, 0, 3) == Vector3() ||
+          (has_texture_nodata && texture(col, row) == texture_nodata) ||
+          (opt.max_valid_triangulation_error > 0 && P[3] > opt.max_valid_triangulation_error)) {
+        continue; // outlier
+      }
+
+      // The first 3 coordinates of P
+      Vector3 Q = subvector(P, 0, 3);
+      double dist = norm_2(Q);
+
+      if (opt.max_distance_from_camera > 0 && dist > opt.max_distance_from_camera)
         continue; // outlier
 
-      int count = 0;
-      double dist = 0.0;
-      for (int it = 0; it < 4; it++) {
-        int c = col + offset_x[it];
-        int r = row + offset_y[it];
+      // All points are given equal weight for now
+      double wt = 1.0;
+      if (opt.distance_from_camera_weight_power > 0) {
+        if (dist == 0.0)
+          continue; // outlier
+        wt = 1.0 / pow(dist, opt.distance_from_camera_weight_power);
+      }
 
-        if (c < 0 || c >= point_image.cols()) 
-          continue;
-        if (r < 0 || r >= point_image.rows()) 
-          continue;
+      // The normal and surface resolution share the neighbors
+      Vector3 N;
+      double surface_res = 0.0;
+      bool has_normal = false;
+      if (use_normal || use_res)
+        has_normal = surfaceNormalAndRes(point_image, col, row, N, surface_res);
 
-        Vector<double, 4> const& Q = point_image(c, r); // alias
-        if (Q == Vector<double, 4>()) 
+      if (use_normal) {
+        if (!has_normal)
           continue; // outlier
 
-        dist = std::max(dist, norm_2(subvector(P, 0, 3) - subvector(Q, 0, 3)));
-        count++;
+        double angle = 0.0, max_angle = 0.0;
+        if (opt.max_camera_ray_to_surface_normal_angle > 0) {
+          angle = lineAngle(Q, N);
+          max_angle = opt.max_camera_ray_to_surface_normal_angle;
+        } else {
+          angle = lineAngle(cam_dir, N);
+          max_angle = opt.max_camera_dir_to_surface_normal_angle;
+        }
+        if (std::isnan(angle) || std::isinf(angle) || angle > max_angle)
+          continue; // outlier, or something went wrong
       }
 
-      if (count < 3)
-        continue; // too few neighbors
+      if (opt.max_camera_dir_to_camera_ray_angle > 0) {
+        double angle = lineAngle(Q, cam_dir);
+        if (std::isnan(angle) || std::isinf(angle))
+          continue; // something went wrong
+
+        if (angle > opt.max_camera_dir_to_camera_ray_angle)
+          continue; // outlier
+      }
 
-      surface_res(col, row) = dist;
+      if (use_res) {
+        if (surface_res <= 0)
+          wt = 0.0;
+        else
+          wt *= exp(-surface_res / opt.reliable_surface_resolution);
+      }
+
+      // The input texture is usually between 0 and 1.
+      // TODO(oalexan1): What is the max color?
+      double t = 255.0 * texture(col, row);
+      if (t <= 0.0) t = 1.0;  // Ensure a positive value for the color
+
+      // Note how we add back the triangulation error
+      clean_points(col, row) = Vector<double, 4>(Q[0], Q[1], Q[2], P[3]);
+      out_texture(col, row) = t;
+      weight(col, row) = wt;
     }
   }
 }
@@ -308,136 +383,38 @@ int main(int argc, char *argv[]) {
     // Transform the cloud to camera coordinates (if world2cam is read)
     applyAffineTransform(point_image, world2cam);
 
+    // Apply the filters tile by tile, with multiple threads
     ImageView<float> weight(point_image.cols(), point_image.rows());
     ImageView<float> out_texture(point_image.cols(), point_image.rows());
     ImageView<Vector<double, 4>> clean_points(point_image.cols(), point_image.rows());
-    for (int col = 0; col < point_image.cols(); col++) {
-      for (int row = 0; row < point_image.rows(); row++) {
-        weight(col, row) = 0.0;
-        out_texture(col, row) = 0.0;
-        clean_points(col, row) = Vector<double, 4>();
-      }
-    }
-
-    ImageView<float> surface_res;
-    if (opt.reliable_surface_resolution > 0) 
-      estimate_surface_res(point_image, surface_res);
-
-    // Camera direction, in camera's coordinate system
-    Vector3 cam_dir(0.0, 0.0, 1.0);
-
-    for (int col = 0; col < point_image.cols(); col++) {
-      for (int row = 0; row < point_image.rows(); row++) {
-        
-        Vector<double, 4> const& P = point_image(col, row); // alias
-        if (subvector(P, 0, 3) == Vector3() ||
-            (has_texture_nodata && texture(col, row) == texture_nodata) ||
-            (opt.max_valid_triangulation_error > 0 && P[3] > opt.max_valid_triangulation_error)) {
-          continue; // outlier
-        }
-
-        // The first 3 coordinates of P
-        Vector3 Q = subvector(P, 0, 3);
-
-        if (opt.max_distance_from_camera > 0 &&
-            norm_2(Q) > opt.max_distance_from_camera) {
-          continue; // outlier
-        }
-        
-        // All points are given equal weight for now
-        double wt = 1.0;
-        if (opt.distance_from_camera_weight_power > 0) {
-          double dist = norm_2(Q);
-          if (dist == 0.0) 
-            continue; // outlier
-          
-          wt = 1.0 / pow(dist, opt.distance_from_camera_weight_power);
-        }
-
-        if (opt.max_camera_ray_to_surface_normal_angle > 0 ||
-            opt.max_camera_dir_to_surface_normal_angle > 0) {
-
-          // Find the surface normal
-          Vector3 N;
-          if (!surfaceNormal(point_image, col, row, N))
-            continue; // outlier
-            
-          if (opt.max_camera_ray_to_surface_normal_angle > 0) {
-            // Use abs as the normal can point in either direction
-            double prod = std::abs(dot_prod(Q, N) / norm_2(Q) / norm_2(N));
-            double angle = acos(prod) * (180.0 / M_PI);
-            if (std::isnan(angle) || std::isinf(angle) ||
-                angle > opt.max_camera_ray_to_surface_normal_angle)
-              continue; // something went wrong
-            
-          } else if (opt.max_camera_dir_to_surface_normal_angle > 0) {
-            double prod = std::abs(dot_prod(cam_dir, N) / norm_2(cam_dir) / norm_2(N));
-            double angle = acos(prod) * (180.0 / M_PI);
-            if (std::isnan(angle) || std::isinf(angle) ||
-                angle > opt.max_camera_dir_to_surface_normal_angle)
-              continue; // something went wrong
-          }
-        }
-        
-        if (opt.max_camera_dir_to_camera_ray_angle > 0) {
-
-          double prod = std::abs(dot_prod(Q, cam_dir)/ norm_2(Q) / norm_2(cam_dir));
-          double angle = acos(prod) * (180.0 / M_PI);
-          if (std::isnan(angle) || std::isinf(angle))
-            continue; // something went wrong
-          
-          if (angle > opt.max_camera_dir_to_camera_ray_angle) 
-            continue; // outlier
-        }
-        
-        // The input texture is usually between 0 and 1.
-        // TODO(oalexan1): What is the max color?
-        double t = 255.0 * texture(col, row);
-        if (t <= 0.0) t = 1.0;  // Ensure a positive value for the color
-
-        // Note how we add back the triangulation error
-        clean_points(col, row) = Vector<double, 4>(Q[0], Q[1], Q[2], P[3]);
-        out_texture(col, row) = t;
-        weight(col, row) = wt;
-      }
-    }
+    const int tile_size = 256;
+    std::vector<BBox2i> tiles = subdivide_bbox(point_image, tile_size, tile_size);
+#pragma omp parallel for schedule(dynamic)
+    for (int it = 0; it < int(tiles.size()); it++)
+      filterTile(opt, tiles[it], point_image, texture, has_texture_nodata, texture_nodata,
+                 clean_points, out_texture, weight);
 
     if (opt.blending_dist > 0 && opt.blending_power > 0) {
       ImageView<int> mask(clean_points.cols(), clean_points.rows());
-      for (int col = 0; col < clean_points.cols(); col++) {
-        for (int row = 0; row < clean_points.rows(); row++) {
+#pragma omp parallel for
+      for (int row = 0; row < clean_points.rows(); row++) {
+        for (int col = 0; col < clean_points.cols(); col++) {
           mask(col, row) = (subvector(clean_points(col, row), 0, 3) != Vector3());
         }
       }
       ImageView<double> dist;
       vw::bounded_dist(mask, opt.blending_dist, dist);
-      
+
       // Adjust the weight by the normalized distance raised to given power
-      for (int col = 0; col < dist.cols(); col++) {
-        for (int row = 0; row < dist.rows(); row++) {
-          dist(col, row) = pow(dist(col, row) / opt.blending_dist, opt.blending_power);
-          weight(col, row) *= dist(col, row);
+#pragma omp parallel for
+      for (int row = 0; row < dist.rows(); row++) {
+        for (int col = 0; col < dist.cols(); col++) {
+          weight(col, row) *= pow(dist(col, row) / opt.blending_dist, opt.blending_power);
         }
       }
 
     }
 
-    if (opt.reliable_surface_resolution > 0) {
-      for (int col = 0; col < weight.cols(); col++) {
-        for (int row = 0; row < weight.rows(); row++) {
-          if (weight(col, row) <= 0) 
-            continue;
-          
-          if (surface_res(col, row) <= 0) {
-            weight(col, row) = 0.0;
-            continue;
-          }
-
-          weight(col, row) *= exp(-surface_res(col, row) / opt.reliable_surface_resolution);
-        }
-      }
-    }
-    
     if (!opt.transform_to_camera_coordinates)
       applyAffineTransform(clean_points, cam2world); // convert back to world
     
@@ -19,18 +19,23 @@
 /// \file pc_merge.cc
 ///
 /// A simple tool to merge multiple point cloud files into a single file. The clouds
-/// can have 1 channel (plain raster images) or 3 to 6 channels.
+/// can have 1 channel (plain raster images) or 3 to 6 channels. With
+/// --spatial-order, the points are reordered so that nearby points are in
+/// the same blocks of the output.
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/PointUtils.h>
+#include <asp/Core/PointCloudStats.h>
 #include <asp/Core/OrthoRasterizer.h>
+#include <asp/Core/CloudReorder.h>
 
 #include <vw/Core/Stopwatch.h>
 #include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
+#include <cstdio>
 #include <limits>
 
 using namespace vw;
@@ -45,11 +50,13 @@ struct Options : vw::GdalWriteOptions {
 
   // Settings
   bool  write_double;  ///< If true, output file is double instead of float
+  bool  spatial_order; ///< If true, reorder the points by location
+  double memory_limit_mb;
 
   // Output
   std::string out_file;
 
-  Options() : write_double(false) {}
+  Options() : write_double(false), spatial_order(false), memory_limit_mb(0) {}
 };
 
 
@@ -58,7 +65,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description general_options("General Options");
   general_options.add_options()
     ("output-file,o",  po::value(&opt.out_file)->default_value(""),        "Specify the output file.")
-    ("write-double,d", po::value(&opt.write_double)->default_value(false), "Write a double precision output file.");
+    ("write-double,d", po::value(&opt.write_double)->default_value(false), "Write a double precision output file.")
+    ("spatial-order", po::bool_switch(&opt.spatial_order)->default_value(false)->implicit_value(true),
+     "Reorder the points so that each block of the output holds points which are close on the ground, along a Morton (Z-order) curve. Then point2dem reads fewer blocks for each of its tiles. The input layout is not kept. Needs temporary disk space about twice the size of the merged cloud, next to the output file. Not supported for single-channel inputs.")
+    ("memory-limit-mb", po::value(&opt.memory_limit_mb)->default_value(4096),
+     "With --spatial-order, sort at most this many megabytes of points in memory at a time.");
 
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
@@ -86,6 +97,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw( ArgumentErr() << "The output file must be specified!\n"
               << usage << general_options );
 
+  if (opt.spatial_order && opt.memory_limit_mb <= 0)
+    vw_throw( ArgumentErr() << "The value of --memory-limit-mb must be positive.\n"
+              << usage << general_options );
+
   vw::create_out_dir(opt.out_file);
 }
 
@@ -114,6 +129,17 @@ Vector3 determine_output_shift(std::vector<std::string> const& pc_files, Options
 
   // As an approximation, compute the mean shift vector of the input files.
   // - If none of the input files have a shift, the output file will be written as a double.
+  // - If all files have statistics, weight the shifts by the number of points.
+  std::vector<double> weights(pc_files.size(), 1.0);
+  for (size_t i=0; i<pc_files.size(); ++i) {
+    asp::CloudStats stats;
+    if (!asp::read_cloud_stats(pc_files[i], stats)) {
+      weights = std::vector<double>(pc_files.size(), 1.0);
+      break;
+    }
+    weights[i] = double(stats.num_valid());
+  }
+  
   vw::Vector3 shift(0,0,0), shiftIn;
   double shift_count = 0;
   for (size_t i=0; i<pc_files.size(); ++i) {
@@ -122,15 +148,14 @@ Vector3 determine_output_shift(std::vector<std::string> const& pc_files, Options
     boost::shared_ptr<vw::DiskImageResource> rsrc( new vw::DiskImageResourceGDAL(pc_files[i]) );
     if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str)){
       //std::cout << "shift string = " << shift_str << std::endl;
-      shift += asp::str_to_vec<vw::Vector3>(shift_str);
-      shift_count += 1.0;
+      shift += weights[i] * asp::str_to_vec<vw::Vector3>(shift_str);
+      shift_count += weights[i];
     }
   }
-  if (shift_count < 0.9) // If no shifts read, don't use a shift.
+  if (shift_count <= 0) // If no shifts read, don't use a shift.
     return Vector3(0,0,0);
 
   // Compute the mean shift
-  // - It would be more accurate to weight the shift according to the number of input points
   shift /= shift_count;
   return shift;
 }
@@ -165,6 +190,15 @@ do_work(Vector3 const& shift, Options const& opt) {
   const int spacing = ASP_MAX_SUBBLOCK_SIZE;
   ImageViewRef<PixelT> merged_cloud = asp::form_point_cloud_composite<PixelT>(opt.pointcloud_files, spacing);
 
+  // Sort the points by location, out of core, and lay them out so that
+  // each point2dem sub-block holds consecutive points along the curve.
+  std::string tmp_prefix = opt.out_file + "-tmp", sorted_file = tmp_prefix + "-sorted.bin";
+  if (opt.spatial_order) {
+    std::int64_t num_points = asp::sort_cloud_spatially(merged_cloud, opt.memory_limit_mb,
+                                                        tmp_prefix, sorted_file);
+    merged_cloud = asp::SortedCloudView<PixelT>(sorted_file, num_points, spacing);
+  }
+
   // See if we can pull a georeference from somewhere. Of course it will be wrong
   // when applied to the merged cloud, but it will at least have the correct datum
   // and projection.
@@ -192,6 +226,9 @@ do_work(Vector3 const& shift, Options const& opt) {
                                      merged_cloud,
                                      has_georef, georef, has_nodata, nodata,
                                      opt, TerminalProgressCallback("asp", "\t--> Merging: "));
+
+  if (opt.spatial_order)
+    std::remove(sorted_file.c_str());
 }
 
 //-----------------------------------------------------------------------------------
@@ -204,6 +241,9 @@ int main( int argc, char *argv[] ) {
 
     // Determine the number of channels
     int num_channels = check_num_channels(opt.pointcloud_files);
+    if (opt.spatial_order && num_channels == 1)
+      vw_throw( ArgumentErr() << "The option --spatial-order needs point clouds, "
+                << "not single-channel images.\n" );
 
     // Determine the output shift (if any)
     Vector3 shift = determine_output_shift(opt.pointcloud_files, opt);
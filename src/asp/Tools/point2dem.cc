@@ -25,10 +25,11 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/OutlierProcessing.h>
+#include <asp/Core/BigTileWriter.h>
+#include <asp/Core/Telemetry.h>
 
 #include <vw/Image/AntiAliasing.h>
 #include <vw/Image/InpaintView.h>
-#include <vw/Core/Stopwatch.h>
 #include <vw/Core/StringUtils.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Mosaic/ImageComposite.h>
@@ -38,6 +39,7 @@
 
 #include <boost/math/special_functions/fpclassify.hpp>
 
+#include <algorithm>
 #include <limits>
 
 using namespace vw;
@@ -74,7 +76,8 @@ struct Options : vw::GdalWriteOptions {
   double      lon_offset, lat_offset, height_offset;
   size_t      utm_zone;
   ProjectionType projection;
-  bool        has_alpha, do_normalize, do_ortho, do_error, propagate_errors, no_dem;
+  bool        has_alpha, do_normalize, do_ortho, do_error, propagate_errors, no_dem,
+              aggregate_coarser_dems, stream_las, cog;
   double      rounding_error;
   std::string target_srs_string;
   BBox2       target_projwin;
@@ -86,6 +89,7 @@ struct Options : vw::GdalWriteOptions {
   int         erode_len;
   std::string csv_format_str, csv_proj4_str, filter;
   double      search_radius_factor, sigma_factor, default_grid_size_multiplier;
+  int         max_points_per_cell;
   bool        use_surface_sampling;
   bool        has_las_or_csv_or_pcd;
   Vector2i    max_output_size;
@@ -101,7 +105,7 @@ struct Options : vw::GdalWriteOptions {
     dem_hole_fill_len(0), ortho_hole_fill_len(0), ortho_hole_fill_extra_len(0),
     remove_outliers_with_pct(true), use_tukey_outlier_removal(false),
     max_valid_triangulation_error(0),
-    erode_len(0), search_radius_factor(0), sigma_factor(0),
+    erode_len(0), search_radius_factor(0), sigma_factor(0), max_points_per_cell(0),
     default_grid_size_multiplier(1.0), use_surface_sampling(false),
     has_las_or_csv_or_pcd(false), max_output_size(9999999, 9999999), input_is_projected(false){}
 };
@@ -131,7 +135,7 @@ void parse_input_clouds_textures(std::vector<std::string> const& files,
 
   // Ensure that files exist
   for (int i = 0; i < num; i++){
-    if (!fs::exists(files[i])){
+    if (!asp::path_exists(files[i])){
       vw_throw(ArgumentErr() << "File does not exist: " << files[i] << ".\n");
     }
   }
@@ -200,8 +204,7 @@ void las_or_csv_or_pcd_to_tifs(Options& opt, cartography::Datum const& datum,
   if (!opt.has_las_or_csv_or_pcd)
     return;
 
-  Stopwatch sw;
-  sw.start();
+  asp::TelemetryTimer sw("point2dem.convert_to_tif");
 
   // Error checking for CSV
   int num_files = opt.pointcloud_files.size();
@@ -270,6 +273,8 @@ void las_or_csv_or_pcd_to_tifs(Options& opt, cartography::Datum const& datum,
 
     if (!asp::is_las_or_csv_or_pcd(opt.pointcloud_files[i])) // Skip tif files
       continue;
+    if (opt.stream_las && asp::is_las(opt.pointcloud_files[i])) // Will be read directly
+      continue;
     std::string in_file = opt.pointcloud_files[i];
     std::string stem    = fs::path(in_file).stem().string();
     std::string suffix;
@@ -410,8 +415,14 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("erode-length",   po::value<int>(&opt.erode_len)->default_value(0),
             "Erode input point clouds by this many pixels at boundary (after outliers are removed, but before filling in holes).")
     ("csv-format",     po::value(&opt.csv_format_str)->default_value(""), asp::csv_opt_caption().c_str())
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Add internal overviews to the output tif images, computed while they are written, so that they can be viewed efficiently over the network.")
+    ("stream-las", po::bool_switch(&opt.stream_las)->default_value(false),
+     "Read LAS and LAZ files directly, rather than first converting them to temporary tif files. This saves disk space and I/O, but the points may be read more than once if the cache is not large enough (option --cache-size-mb).")
     ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV files, if those files contain Easting and Northing fields. If not specified, --t_srs will be used.")
     ("filter",      po::value(&opt.filter)->default_value("weighted_average"), "The filter to apply to the heights of the cloud points within a given circular neighborhood when gridding (its radius is controlled via --search-radius-factor). Options: weighted_average (default), min, max, mean, median, stddev, count (number of points), nmad (= 1.4826 * median(abs(X - median(X)))), n-pct (where n is a real value between 0 and 100, for example, 80-pct, meaning, 80th percentile). Except for the default, the name of the filter will be added to the obtained DEM file name, e.g., output-min-DEM.tif.")
+    ("max-points-per-cell", po::value(&opt.max_points_per_cell)->default_value(0),
+     "For the median, stddev, nmad, and percentile filters, use for each DEM grid point at most this many of the nearby points, chosen at random, to bound the memory usage for very dense clouds. The default is to use all points.")
     ("rounding-error", po::value(&opt.rounding_error)->default_value(asp::APPROX_ONE_MM),
      "How much to round the output DEM and errors, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10.")
     ("search-radius-factor", po::value(&opt.search_radius_factor)->default_value(0.0),
@@ -425,6 +436,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Use the older algorithm, interpret the point cloud as a surface made up of triangles and interpolate into it (prone to aliasing).")
     ("fsaa",   po::value<int>(&opt.fsaa)->default_value(1),            "Oversampling amount to perform antialiasing (obsolete).")
     ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.")
+    ("aggregate-coarser-dems", po::bool_switch(&opt.aggregate_coarser_dems)->default_value(false),
+     "If several DEM spacings are specified, grid the cloud only at the finest one, and form the DEMs at the spacings which are integer multiples of it by averaging the finest DEM over each grid cell. This is much faster. Other outputs are still produced from the cloud.")
     ("input-is-projected", po::bool_switch(&opt.input_is_projected)->default_value(false), "Input data is already in projected coordinates.");
 
   general_options.add(manipulation_options);
@@ -504,6 +517,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
                            << "is obsolete, it will be removed in future versions.\n";
   }
 
+  if (opt.max_points_per_cell < 0)
+    vw_throw(ArgumentErr() << "The value of --max-points-per-cell must be non-negative.\n");
+
   if (opt.use_surface_sampling && opt.filter != "weighted_average")
     vw_throw(ArgumentErr() << "Cannot use surface "
                             << "sampling with any filter of point cloud points.\n");
@@ -572,7 +588,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   }
 
   // Create the output directory
-  vw::create_out_dir(opt.out_prefix);
+  asp::create_out_dir(opt.out_prefix);
 
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
@@ -691,6 +707,17 @@ namespace asp{
                                                   ErrorToNED(georef));
   }
 
+  /// The name of an output image, such as <prefix>-DEM.tif.
+  std::string output_image_file(Options const& opt, std::string const& imgName) {
+    // Append a tag if desired to compute the min, max, etc. Later on, in OrthoRasterizer
+    // we do a full validation of opt.filter.
+    std::string tag = "";
+    if (opt.filter != "weighted_average")
+      tag = "-" + opt.filter; 
+
+    return opt.out_prefix + tag + "-" + imgName + "." + opt.output_file_type;
+  }
+
   /// Write an image to disk while handling some common options.
   template<class ImageT>
   void save_image(Options& opt, ImageT img, GeoReference const& georef,
@@ -709,21 +736,19 @@ namespace asp{
     int block_size = nextpow2(2.0*hole_fill_len);
     block_size = std::max(256, block_size);
 
-    // Append a tag if desired to compute the min, max, etc. Later on, in OrthoRasterizer
-    // we do a full validation of opt.filter.
-    std::string tag = "";
-    if (opt.filter != "weighted_average")
-      tag = "-" + opt.filter; 
-
-    std::string output_file = opt.out_prefix + tag + "-" + imgName
-      + "." + opt.output_file_type;
+    std::string output_file = output_image_file(opt, imgName);
     vw_out() << "Writing: " << output_file << "\n";
-    TerminalProgressCallback tpc("asp", imgName + ": ");
+    asp::StatusProgressCallback tpc("asp", imgName + ": ");
     if (opt.output_file_type == "tif") {
       bool has_georef = true, has_nodata = true;
-      asp::save_with_temp_big_blocks(block_size, output_file, img,
-                                     has_georef, georef,
-                                     has_nodata, opt.nodata_value, opt, tpc);
+      if (opt.cog) // write once, with overviews
+        asp::save_in_big_tiles(block_size, output_file, img,
+                               has_georef, georef,
+                               has_nodata, opt.nodata_value, opt, tpc, opt.cog);
+      else
+        asp::save_with_temp_big_blocks(block_size, output_file, img,
+                                       has_georef, georef,
+                                       has_nodata, opt.nodata_value, opt, tpc);
     }
     else
       vw::cartography::write_gdal_image(output_file, img, georef, opt, tpc);
@@ -838,31 +863,109 @@ namespace asp{
       (image.impl(), RoundImagePixelsSkipNoData<typename ImageT::pixel_type>(scale, nodata));
   }
 
-} // end namespace asp
+  /// Form a DEM whose grid spacing is an integer multiple of the
+  /// spacing of a given DEM, with its grid points being a subset of
+  /// the grid points of the given DEM. The height at each coarse grid
+  /// point is the average of the valid heights of the fine DEM over
+  /// the area of the coarse grid cell. For an even ratio the fine
+  /// points on the cell boundary are shared with the neighboring
+  /// cells, so they get half the weight. A cell less than half of
+  /// which is covered by valid heights is set to no-data.
+  template <class ImageT>
+  class AggregateDemView: public ImageViewBase<AggregateDemView<ImageT>> {
+    ImageT m_fine_dem;
+    int m_ratio, m_col_offset, m_row_offset, m_cols, m_rows;
+    double m_nodata_value;
 
-void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
-                               Options& opt,
-                               cartography::GeoReference& georef,
-                               ImageViewRef<double> const& error_image,
-                               double estim_max_error,
-                               std::int64_t * num_invalid_pixels) {
+  public:
+    typedef PixelGray<float> pixel_type;
+    typedef pixel_type result_type;
+    typedef ProceduralPixelAccessor<AggregateDemView> pixel_accessor;
+
+    AggregateDemView(ImageViewBase<ImageT> const& fine_dem, int ratio,
+                     int col_offset, int row_offset, int cols, int rows,
+                     double nodata_value):
+      m_fine_dem(fine_dem.impl()), m_ratio(ratio), m_col_offset(col_offset),
+      m_row_offset(row_offset), m_cols(cols), m_rows(rows),
+      m_nodata_value(nodata_value) {}
+
+    inline int32 cols  () const { return m_cols; }
+    inline int32 rows  () const { return m_rows; }
+    inline int32 planes() const { return 1; }
 
-  vw_out() << "\t-- Starting DEM rasterization --\n";
-  vw_out() << "\t--> DEM spacing: " <<     rasterizer.spacing() << " pt/px\n";
-  vw_out() << "\t             or: " << 1.0/rasterizer.spacing() << " px/pt\n";
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
 
-  // TODO: Maybe put a warning or check here if the size is too big
+    inline result_type operator()(size_t i, size_t j, size_t p=0) const {
+      vw_throw(NoImplErr() << "AggregateDemView::operator()(...) is not implemented");
+      return result_type();
+    }
 
-  // Now we are ready to specify the affine transform.
-  georef.set_transform(rasterizer.geo_transform());
+    typedef CropView<ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
-  // If the user requested FSAA, we temporarily increase the
-  // resolution, apply a blur, then resample to the original
-  // resolution. This results in a DEM with less antialiasing.  Note
-  // that the georef above is set with the spacing before resolution
-  // is increased, which will be the final spacing as well.
-  if (opt.fsaa > 1)
-    rasterizer.set_spacing(rasterizer.spacing() / double(opt.fsaa));
+      int half = m_ratio/2;
+      bool is_even = (m_ratio % 2 == 0);
+
+      // The fine DEM pixels contributing to this tile
+      BBox2i fine_box(m_col_offset + m_ratio*bbox.min().x() - half,
+                      m_row_offset + m_ratio*bbox.min().y() - half,
+                      m_ratio*(bbox.width() - 1) + 2*half + 1,
+                      m_ratio*(bbox.height() - 1) + 2*half + 1);
+      fine_box.crop(bounding_box(m_fine_dem));
+
+      ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      fill(tile, pixel_type(m_nodata_value));
+      if (fine_box.empty())
+        return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+
+      ImageView<typename ImageT::pixel_type> fine_tile = crop(m_fine_dem, fine_box);
+
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          int fine_col = m_col_offset + m_ratio*(bbox.min().x() + col);
+          int fine_row = m_row_offset + m_ratio*(bbox.min().y() + row);
+
+          double sum = 0.0, valid_wt = 0.0, total_wt = 0.0;
+          for (int dr = -half; dr <= half; dr++) {
+            for (int dc = -half; dc <= half; dc++) {
+              double wt = 1.0;
+              if (is_even && std::abs(dc) == half) wt *= 0.5;
+              if (is_even && std::abs(dr) == half) wt *= 0.5;
+              total_wt += wt;
+
+              Vector2i pix(fine_col + dc, fine_row + dr);
+              if (!fine_box.contains(pix))
+                continue;
+              double val = fine_tile(pix.x() - fine_box.min().x(),
+                                     pix.y() - fine_box.min().y());
+              if (val == m_nodata_value || std::isnan(val))
+                continue;
+              sum      += wt * val;
+              valid_wt += wt;
+            }
+          }
+
+          if (valid_wt > 0.0 && valid_wt >= 0.5 * total_wt)
+            tile(col, row) = pixel_type(sum / valid_wt);
+        }
+      }
+
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT> inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // end namespace asp
+
+// Set the georeference transform of the DEM produced by the rasterizer
+// at its current spacing.
+void set_dem_georef(asp::OrthoRasterizerView& rasterizer, Options const& opt,
+                    cartography::GeoReference& georef) {
+
+  georef.set_transform(rasterizer.geo_transform());
 
   // If the user specified the ULLR .. update the georeference
   // transform here. The generate_fsaa_raster will be responsible
@@ -883,6 +986,31 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
     transform(1,2) -= 0.5 * transform(1,1);
     georef.set_transform(transform);
   }
+}
+
+void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
+                               Options& opt,
+                               cartography::GeoReference& georef,
+                               ImageViewRef<double> const& error_image,
+                               double estim_max_error,
+                               std::int64_t * num_invalid_pixels) {
+
+  vw_out() << "\t-- Starting DEM rasterization --\n";
+  vw_out() << "\t--> DEM spacing: " <<     rasterizer.spacing() << " pt/px\n";
+  vw_out() << "\t             or: " << 1.0/rasterizer.spacing() << " px/pt\n";
+
+  // TODO: Maybe put a warning or check here if the size is too big
+
+  // Now we are ready to specify the affine transform. Note that the
+  // georef is set with the spacing before the resolution is
+  // increased for FSAA below, which will be the final spacing as well.
+  set_dem_georef(rasterizer, opt, georef);
+
+  // If the user requested FSAA, we temporarily increase the
+  // resolution, apply a blur, then resample to the original
+  // resolution. This results in a DEM with less antialiasing.
+  if (opt.fsaa > 1)
+    rasterizer.set_spacing(rasterizer.spacing() / double(opt.fsaa));
 
   // Do not round the DEM heights for small bodies
   if (georef.datum().semi_major_axis() <= asp::MIN_RADIUS_FOR_ROUNDING ||
@@ -897,8 +1025,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   Vector2 tile_size(vw_settings().default_tile_size(),
                     vw_settings().default_tile_size());
   if (!opt.no_dem){
-    Stopwatch sw2;
-    sw2.start();
+    asp::TelemetryTimer sw2("point2dem.write_dem");
     ImageViewRef< PixelGray<float> > dem
       = asp::round_image_pixels_skip_nodata(rasterizer_fsaa, opt.rounding_error,
                                             opt.nodata_value);
@@ -1046,8 +1173,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   // This must be at the end, as we may be messing with the point
   // image in irreversible ways.
   if (opt.do_ortho) {
-    Stopwatch sw3;
-    sw3.start();
+    asp::TelemetryTimer sw3("point2dem.write_ortho");
     ImageViewRef<PixelGray<float>> texture
       = asp::form_point_cloud_composite<PixelGray<float>>
       (opt.texture_files, ASP_MAX_SUBBLOCK_SIZE);
@@ -1125,6 +1251,61 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
 } // End do_software_rasterization
 
 
+// Form the DEM at the current spacing of the rasterizer by averaging
+// the finest DEM, which must have been written already, over each grid
+// cell. This is much faster than gridding the cloud again. Return
+// false if the grids are not compatible, so the cloud must be gridded.
+bool aggregate_coarser_dem(asp::OrthoRasterizerView& rasterizer,
+                           Options& opt,
+                           cartography::GeoReference& georef,
+                           double fine_spacing,
+                           Matrix3x3 const& fine_transform,
+                           std::string const& fine_dem_file) {
+
+  double spacing = rasterizer.spacing();
+  double ratio   = spacing / fine_spacing;
+  int    iratio  = int(round(ratio));
+
+  // The grid points of this DEM must be among those of the fine DEM.
+  // That is so if the spacings are integer multiples, as the grids
+  // are snapped to multiples of the spacing.
+  Matrix3x3 transform = rasterizer.geo_transform();
+  double col_offset = (transform(0,2) - fine_transform(0,2)) / fine_spacing;
+  double row_offset = (fine_transform(1,2) - transform(1,2)) / fine_spacing;
+  double tol = 1e-6;
+  if (iratio < 2 || std::abs(ratio - iratio) > tol * ratio ||
+      std::abs(col_offset - round(col_offset)) > 1e-3 ||
+      std::abs(row_offset - round(row_offset)) > 1e-3) {
+    vw_out() << "The DEM spacing " << spacing << " is not an integer multiple of "
+             << fine_spacing << ". Gridding the cloud at this spacing.\n";
+    return false;
+  }
+
+  vw_out() << "\t-- Forming the DEM by averaging the finest DEM --\n";
+  vw_out() << "\t--> DEM spacing: " << spacing << " pt/px\n";
+  set_dem_georef(rasterizer, opt, georef);
+
+  DiskImageView<float> fine_dem(fine_dem_file);
+  ImageViewRef<PixelGray<float>> dem = asp::round_image_pixels_skip_nodata
+    (asp::AggregateDemView<DiskImageView<float>>(fine_dem, iratio,
+                                                 int(round(col_offset)),
+                                                 int(round(row_offset)),
+                                                 rasterizer.cols(), rasterizer.rows(),
+                                                 opt.nodata_value),
+     opt.rounding_error, opt.nodata_value);
+
+  Vector2i dem_size = bounding_box(dem).size();
+  vw_out()<< "Creating output file that is " << dem_size << " px.\n";
+  if ((dem_size[0] > opt.max_output_size[0]) || (dem_size[1] > opt.max_output_size[1]))
+    vw_throw(ArgumentErr()
+              << "Requested DEM size is too large, max allowed output size is "
+              << opt.max_output_size << " pixels.\n");
+
+  int hole_fill_len = 0;
+  asp::save_image(opt, dem, georef, hole_fill_len, "DEM");
+  return true;
+}
+
 // Wrapper for do_software_rasterization that goes through all spacing values
 void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_points,
                                              Options& opt,
@@ -1140,8 +1321,7 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
     outlier_removal_method = asp::TUKEY_OUTLIER_METHOD; // takes precedence
   
   // Perform the slow initialization that can be shared by all output resolutions
-  Stopwatch sw1;
-  sw1.start();
+  asp::TelemetryTimer sw1("point2dem.init_rasterizer");
   vw::Mutex count_mutex; // Need to pass in by pointer due to C++ class restrictions
   
   // Need to pass in by pointer because we can't get back the number from
@@ -1167,11 +1347,34 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
   rasterizer.set_use_alpha(opt.has_alpha);
   rasterizer.set_use_minz_as_default(false);
   rasterizer.set_default_value(opt.nodata_value);
+  rasterizer.set_max_cell_values(opt.max_points_per_cell);
 
   std::string base_out_prefix = opt.out_prefix;
 
+  // Go from the finest to the coarsest spacing, so that the coarser
+  // DEMs can be formed from the finest one if desired.
+  std::vector<size_t> order(opt.dem_spacing.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&opt](size_t a, size_t b) {
+      return opt.dem_spacing[a] < opt.dem_spacing[b]; });
+
+  bool aggregate = opt.aggregate_coarser_dems;
+  if (aggregate && order.size() > 1 && (opt.no_dem || opt.fsaa != 1 || opt.target_projwin != BBox2())) {
+    vw_out(WarningMessage) << "Cannot use --aggregate-coarser-dems with --no-dem, "
+                           << "--fsaa, or --t_projwin. Gridding the cloud at each spacing.\n";
+    aggregate = false;
+  }
+
+  double fine_spacing = 0.0;
+  Matrix3x3 fine_transform;
+  std::string fine_dem_file;
+  bool has_other_outputs = (opt.do_error || opt.propagate_errors ||
+                            opt.do_normalize || opt.do_ortho);
+
   // Call the function for each dem spacing
-  for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
+  for (size_t k = 0; k < order.size(); k++) {
+    size_t i = order[k];
     double this_spacing = opt.dem_spacing[i];
 
     // Required second init step for each spacing
@@ -1182,6 +1385,27 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
       opt.out_prefix = base_out_prefix;
     else // Write later iterations to a different path.
       opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
+
+    num_invalid_pixels = 0;
+    if (k == 0) {
+      fine_spacing   = rasterizer.spacing();
+      fine_transform = rasterizer.geo_transform();
+      fine_dem_file  = asp::output_image_file(opt, "DEM");
+    } else if (aggregate &&
+               aggregate_coarser_dem(rasterizer, opt, georef, fine_spacing,
+                                     fine_transform, fine_dem_file)) {
+      // The DEM was made without gridding the cloud. Grid the cloud
+      // only if other outputs are needed.
+      if (has_other_outputs) {
+        bool no_dem = opt.no_dem;
+        opt.no_dem = true;
+        do_software_rasterization(rasterizer, opt, georef, error_image,
+                                  estim_max_error, &num_invalid_pixels);
+        opt.no_dem = no_dem;
+      }
+      continue;
+    }
+
     do_software_rasterization(rasterizer, opt, georef, error_image,
                               estim_max_error, &num_invalid_pixels);
   } // End loop through spacings
@@ -1292,7 +1516,12 @@ int main(int argc, char *argv[]) {
     // average location of the points. If the average location has a
     // negative x value (think in ECEF coordinates) then we should
     // be using [0,360].
-    double avg_lon = asp::find_avg_lon(point_image);
+    // Without a rotation the statistics saved with the clouds can be used.
+    double avg_lon = 0;
+    if (opt.phi_rot == 0 && opt.omega_rot == 0 && opt.kappa_rot == 0)
+      avg_lon = asp::find_avg_lon(point_image, opt.pointcloud_files);
+    else
+      avg_lon = asp::find_avg_lon(point_image);
 
     // TODO: Do we need the recenter code now that we have this?
     // TODO: Modify other code so we don't have to handle this one special case!
@@ -36,8 +36,11 @@
 
 #include <vw/Cartography/PointImageManipulation.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Math/Statistics.h>
 
+#include <boost/noncopyable.hpp>
+
 using namespace vw;
 namespace po = boost::program_options;
 
@@ -251,6 +254,78 @@ void find_error_image_and_do_stats(Options& opt, ImageViewRef<double> & error_im
            << opt.max_valid_triangulation_error << "." << std::endl;
 }
 
+// The valid points in a tile of the cloud which are not outliers, and
+// their scaled triangulation errors, if needed
+struct LasTile {
+  std::vector<Vector3>       points;
+  std::vector<std::uint16_t> intensities;
+  long long int              num_total_points;
+  LasTile(): num_total_points(0) {}
+};
+
+// Convert a tile of the cloud to points to save in the LAS file. The
+// projection is applied to the whole tile when it is rasterized.
+class ConvertTileTask: public Task, private boost::noncopyable {
+  ImageViewRef<Vector3> const& m_point_image;
+  ImageViewRef<double>  const& m_error_image;
+  BBox2i m_box;
+  Options const& m_opt;
+  bool m_is_geodetic;
+  LasTile & m_tile;
+
+public:
+  ConvertTileTask(ImageViewRef<Vector3> const& point_image,
+                  ImageViewRef<double>  const& error_image,
+                  BBox2i const& box, Options const& opt, bool is_geodetic,
+                  LasTile & tile):
+    m_point_image(point_image), m_error_image(error_image), m_box(box), m_opt(opt),
+    m_is_geodetic(is_geodetic), m_tile(tile) {}
+
+  void operator()() {
+    ImageView<Vector3> points = crop(m_point_image, m_box);
+
+    bool use_errors = (m_error_image.cols() > 0 && m_error_image.rows() > 0 &&
+                       (m_opt.max_valid_triangulation_error > 0.0 ||
+                        m_opt.triangulation_error_factor > 0.0));
+    ImageView<double> errors;
+    if (use_errors)
+      errors = crop(m_error_image, m_box);
+
+    m_tile = LasTile();
+    for (int row = 0; row < points.rows(); row++) {
+      for (int col = 0; col < points.cols(); col++) {
+
+        Vector3 const& point = points(col, row);
+
+        // Skip no-data points
+        bool is_good = ( (!m_is_geodetic && point != vw::Vector3()) ||
+                         (m_is_geodetic  && !boost::math::isnan(point.z())) );
+        if (!is_good) continue;
+
+        m_tile.num_total_points++;
+
+        if (use_errors && m_opt.max_valid_triangulation_error > 0.0 &&
+            errors(col, row) > m_opt.max_valid_triangulation_error)
+          continue;
+
+        m_tile.points.push_back(point);
+
+        if (use_errors && m_opt.triangulation_error_factor > 0.0) {
+          // Scale the triangulation error, clamp it, and save it as
+          // uint16.  The LAS 1.2 format has no fields (apart from the
+          // taken already x, y, and z) with 32-bit values, so uint16
+          // is all one can do.
+          double scaled_error = m_opt.triangulation_error_factor * errors(col, row);
+          scaled_error = round(scaled_error);
+          scaled_error = std::max(scaled_error, 0.0); // should not be necessary
+          scaled_error = std::min(scaled_error, double(std::numeric_limits<std::uint16_t>::max()));
+          m_tile.intensities.push_back(std::uint16_t(scaled_error));
+        }
+      }
+    }
+  }
+};
+
 int main( int argc, char *argv[] ) {
   
   // TODO(oalexan1): need to understand what is the optimal strategy
@@ -342,49 +417,45 @@ int main( int argc, char *argv[] ) {
     TerminalProgressCallback tpc("asp", "\t--> ");
     long long int num_total_points = 0;
     long long int num_kept_points = 0;
-    
-    for (int row = 0; row < point_image.rows(); row++){
-      tpc.report_fractional_progress(row, point_image.rows());
-      for (int col = 0; col < point_image.cols(); col++){
-
-        Vector3 point = point_image(col, row);
-
-        // Skip no-data points
-        bool is_good = ( (!is_geodetic && point != vw::Vector3()) ||
-                         (is_geodetic  && !boost::math::isnan(point.z())) );
-        if (!is_good) continue;
 
-        num_total_points++;
-        
-        if (opt.max_valid_triangulation_error > 0.0 &&
-            error_image(col, row) > opt.max_valid_triangulation_error) 
-          continue;
-
-        num_kept_points++;
-#if 0
-        // For comparison later with las2txt.
-        std::cout.precision(16);
-        std::cout << "\npoint " << point[0] << ' ' << point[1] << ' '
-                  << point[2] << std::endl;
-#endif
-
-        liblas::Point las_point(&header);
-        las_point.SetCoordinates(point[0], point[1], point[2]);
+    // The tiles are converted with multiple threads, a batch at a time.
+    // While one batch is converted, the previous one is written, in order,
+    // as the writer and the compression are not thread-safe.
+    const int tile_size = 256;
+    std::vector<BBox2i> boxes = subdivide_bbox(point_image, tile_size, tile_size);
+    int num_threads = vw_settings().default_num_threads();
+    size_t batch_size = 4 * std::max(num_threads, 1);
+    std::vector<LasTile> curr, next;
+    liblas::Point las_point(&header);
+    for (size_t start = 0; start < boxes.size() + batch_size; start += batch_size) {
+      size_t end = std::min(start + batch_size, boxes.size());
+      next.clear();
+      if (start < end)
+        next.resize(end - start);
+      FifoWorkQueue queue(num_threads);
+      for (size_t it = start; it < end; it++) {
+        boost::shared_ptr<ConvertTileTask>
+          task(new ConvertTileTask(point_image, error_image, boxes[it], opt, is_geodetic,
+                                   next[it - start]));
+        queue.add_task(task);
+      }
 
-        if (opt.triangulation_error_factor > 0.0) {
-          // Scale the triangulation error, clamp it, and save it as
-          // uint16.  The LAS 1.2 format has no fields (apart from the
-          // taken already x, y, and z) with 32-bit values, so uint16
-          // is all one can do.
-          double scaled_error = opt.triangulation_error_factor * error_image(col, row);
-          scaled_error = round(scaled_error);
-          scaled_error = std::max(scaled_error, 0.0); // should not be necessary
-          scaled_error = std::min(scaled_error, double(std::numeric_limits<std::uint16_t>::max()));
-          las_point.SetIntensity(std::uint16_t(scaled_error));
+      // Write the previous batch
+      for (size_t it = 0; it < curr.size(); it++) {
+        LasTile const& tile = curr[it];
+        num_total_points += tile.num_total_points;
+        num_kept_points  += tile.points.size();
+        for (size_t p = 0; p < tile.points.size(); p++) {
+          las_point.SetCoordinates(tile.points[p][0], tile.points[p][1], tile.points[p][2]);
+          if (!tile.intensities.empty())
+            las_point.SetIntensity(tile.intensities[p]);
+          writer.WritePoint(las_point);
         }
-          
-        writer.WritePoint(las_point);
       }
+      tpc.report_fractional_progress(std::min(start, boxes.size()), boxes.size());
+
+      queue.join_all();
+      curr.swap(next);
     }
     tpc.report_finished();
 
@@ -27,6 +27,12 @@
 #include <math.h>
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
 #include <vw/Image/Transform.h>
 #include <vw/Cartography/PointImageManipulation.h>
 #include <vw/Image/MaskViews.h>
@@ -45,7 +51,7 @@ struct Options : vw::GdalWriteOptions {
   std::string pointcloud_filename, texture_file_name;
 
   // Settings
-  int point_cloud_step_size, texture_step_size, precision;
+  int point_cloud_step_size, texture_step_size, precision, lod_tile_size, num_lod_levels;
   bool center;
 
   // Output
@@ -206,6 +212,352 @@ void save_mesh(std::string const& output_prefix,
   face_progress.report_finished();
 }
 
+// A tile of the tiled mesh. Level 0 is the coarsest. A tile at level l
+// samples the cloud with a step of 2^(num_levels - 1 - l), so that each
+// tile has about lod_tile_size^2 vertices, and it has as children the four
+// tiles of level l + 1 covering the same area.
+struct MeshTile {
+  int level, col, row;
+  bool has_content;
+  BBox3 box;             // of its vertices and of those of its descendants
+  double edge_length;    // the mean length of its horizontal triangle edges
+  std::vector<int> children;
+  MeshTile(): level(0), col(0), row(0), has_content(false), edge_length(0.0) {}
+};
+
+// The file of a tile, relative to the tileset directory
+std::string mesh_tile_file(MeshTile const& tile) {
+  std::ostringstream os;
+  os << tile.level << "/" << tile.col << "_" << tile.row << ".glb";
+  return os.str();
+}
+
+std::string json_str(std::string const& s) {
+  std::string out = "\"";
+  for (char c: s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+std::string json_num(double val) {
+  if (!std::isfinite(val))
+    return "0";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", val);
+  return buf;
+}
+
+template <class T>
+void append_bytes(std::vector<char> & buf, T const& val) {
+  const char* p = reinterpret_cast<const char*>(&val);
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+// Write a binary glTF file with a textured triangle mesh. The vertices
+// are relative to the given center, which becomes the translation of the
+// node. As 3D Tiles rotates glTF content from y-up to z-up, the ECEF
+// coordinates (x, y, z) are stored as (x, z, -y).
+void write_glb(std::string const& file, std::string const& image_uri,
+               Vector3 const& center, std::vector<Vector3> const& vertices,
+               std::vector<Vector2> const& tex_coords,
+               std::vector<uint32> const& indices) {
+
+  std::vector<char> bin;
+  Vector3 pmin, pmax;
+  for (size_t it = 0; it < vertices.size(); it++) {
+    Vector3 P = vertices[it] - center;
+    float p[3] = {float(P[0]), float(P[2]), float(-P[1])};
+    for (int c = 0; c < 3; c++) {
+      append_bytes(bin, p[c]);
+      pmin[c] = (it == 0) ? p[c] : std::min(pmin[c], double(p[c]));
+      pmax[c] = (it == 0) ? p[c] : std::max(pmax[c], double(p[c]));
+    }
+  }
+  size_t pos_len = bin.size();
+  for (size_t it = 0; it < tex_coords.size(); it++) {
+    append_bytes(bin, float(tex_coords[it][0]));
+    append_bytes(bin, float(tex_coords[it][1]));
+  }
+  size_t tex_len = bin.size() - pos_len;
+  for (size_t it = 0; it < indices.size(); it++)
+    append_bytes(bin, indices[it]);
+  size_t ind_len = bin.size() - pos_len - tex_len;
+
+  std::ostringstream js;
+  js << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"point2mesh\"},"
+     << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+     << "\"nodes\":[{\"mesh\":0,\"translation\":["
+     << json_num(center[0]) << "," << json_num(center[2]) << ","
+     << json_num(-center[1]) << "]}],"
+     << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},"
+     << "\"indices\":2,\"material\":0}]}],"
+     << "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":0},"
+     << "\"metallicFactor\":0,\"roughnessFactor\":1},\"doubleSided\":true}],"
+     << "\"textures\":[{\"source\":0}],"
+     << "\"images\":[{\"uri\":" << json_str(image_uri) << "}],"
+     << "\"buffers\":[{\"byteLength\":" << bin.size() << "}],"
+     << "\"bufferViews\":["
+     << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << pos_len << ",\"target\":34962},"
+     << "{\"buffer\":0,\"byteOffset\":" << pos_len << ",\"byteLength\":" << tex_len
+     << ",\"target\":34962},"
+     << "{\"buffer\":0,\"byteOffset\":" << pos_len + tex_len << ",\"byteLength\":" << ind_len
+     << ",\"target\":34963}],"
+     << "\"accessors\":["
+     << "{\"bufferView\":0,\"componentType\":5126,\"count\":" << vertices.size()
+     << ",\"type\":\"VEC3\",\"min\":[" << json_num(pmin[0]) << "," << json_num(pmin[1]) << ","
+     << json_num(pmin[2]) << "],\"max\":[" << json_num(pmax[0]) << "," << json_num(pmax[1])
+     << "," << json_num(pmax[2]) << "]},"
+     << "{\"bufferView\":1,\"componentType\":5126,\"count\":" << tex_coords.size()
+     << ",\"type\":\"VEC2\"},"
+     << "{\"bufferView\":2,\"componentType\":5125,\"count\":" << indices.size()
+     << ",\"type\":\"SCALAR\"}]}";
+
+  // Both chunks are padded to 4 bytes, the JSON with spaces
+  std::string json = js.str();
+  while (json.size() % 4 != 0)
+    json += ' ';
+  while (bin.size() % 4 != 0)
+    bin.push_back(0);
+
+  std::vector<char> glb;
+  append_bytes(glb, uint32(0x46546C67)); // "glTF"
+  append_bytes(glb, uint32(2));
+  append_bytes(glb, uint32(12 + 8 + json.size() + 8 + bin.size()));
+  append_bytes(glb, uint32(json.size()));
+  append_bytes(glb, uint32(0x4E4F534A)); // "JSON"
+  glb.insert(glb.end(), json.begin(), json.end());
+  append_bytes(glb, uint32(bin.size()));
+  append_bytes(glb, uint32(0x004E4942)); // "BIN"
+  glb.insert(glb.end(), bin.begin(), bin.end());
+
+  std::ofstream ofs(file.c_str(), std::ios::binary);
+  ofs.write(&glb[0], glb.size());
+  if (!ofs)
+    vw_throw(IOErr() << "Failed writing: " << file << "\n");
+}
+
+// Triangulate the samples of a tile as in save_mesh() and write the tile,
+// if it has any triangles. Only the cloud samples of this tile are read.
+void save_mesh_tile(std::string const& tiles_dir, std::string const& image_uri,
+                    ImageViewRef<Vector3> point_cloud, int lod_tile_size,
+                    int num_levels, MeshTile & tile) {
+
+  int step = 1 << (num_levels - 1 - tile.level);
+  ImageViewRef<Vector3> sub = vw::subsample(point_cloud, step);
+
+  // Include the first samples of the neighboring tiles, so that the
+  // tiles of a level meet without gaps
+  BBox2i box(tile.col * lod_tile_size, tile.row * lod_tile_size,
+             lod_tile_size + 1, lod_tile_size + 1);
+  box.crop(bounding_box(sub));
+  if (box.empty())
+    return;
+  ImageView<Vector3> cloud = crop(sub, box);
+
+  int cloud_cols = point_cloud.cols(), cloud_rows = point_cloud.rows();
+  std::vector<Vector3> vertices;
+  std::vector<Vector2> tex_coords;
+  std::vector<uint32> indices;
+  std::vector<int> pix_to_vertex(cloud.cols() * cloud.rows(), -1);
+  double edge_sum = 0.0;
+  int num_edges = 0;
+
+  auto add = [&](int col, int row) {
+    int k = row * cloud.cols() + col;
+    if (pix_to_vertex[k] < 0) {
+      pix_to_vertex[k] = vertices.size();
+      vertices.push_back(cloud(col, row));
+      tile.box.grow(cloud(col, row));
+      // The texture mapping of save_mesh(), with v flipped, as in glTF
+      // the origin of the texture is at the upper-left
+      double u = double((box.min().x() + col) * step) / cloud_cols;
+      double v = double((box.min().y() + row) * step + 1) / cloud_rows;
+      tex_coords.push_back(Vector2(u, v));
+    }
+    indices.push_back(pix_to_vertex[k]);
+  };
+
+  for (int row = 0; row < cloud.rows() - 1; row++) {
+    for (int col = 0; col < cloud.cols() - 1; col++) {
+      Vector3 UL = cloud(col, row),     UR = cloud(col + 1, row);
+      Vector3 LL = cloud(col, row + 1), LR = cloud(col + 1, row + 1);
+
+      if (is_valid_pt(UL) && is_valid_pt(LL) && is_valid_pt(UR)) {
+        add(col, row); add(col, row + 1); add(col + 1, row);
+        edge_sum += norm_2(UR - UL);
+        num_edges++;
+      }
+      if (is_valid_pt(UR) && is_valid_pt(LL) && is_valid_pt(LR)) {
+        add(col + 1, row); add(col, row + 1); add(col + 1, row + 1);
+        edge_sum += norm_2(LR - LL);
+        num_edges++;
+      }
+    }
+  }
+
+  if (indices.empty())
+    return;
+
+  tile.has_content = true;
+  tile.edge_length = edge_sum / num_edges;
+  std::string file = tiles_dir + "/" + mesh_tile_file(tile);
+  boost::filesystem::create_directories(boost::filesystem::path(file).parent_path());
+  write_glb(file, image_uri, tile.box.center(), vertices, tex_coords, indices);
+}
+
+// Write a tile and its descendants which have content or descendants
+// with content to the tileset, in the 3D Tiles format. The geometric
+// error of a tile is the spacing of its samples, which is the error made
+// by showing it instead of its children. Return false if nothing was written.
+bool write_tile_json(std::ostream & os, std::vector<MeshTile> const& tiles, int index,
+                     std::string const& indent, bool is_root) {
+  MeshTile const& tile = tiles[index];
+  if (tile.box.empty())
+    return false;
+
+  Vector3 c = tile.box.center(), h = (tile.box.max() - tile.box.min()) / 2.0;
+  for (int it = 0; it < 3; it++)
+    h[it] = std::max(h[it], 1e-3);
+
+  os << indent << "{\"boundingVolume\": {\"box\": ["
+     << json_num(c[0]) << ", " << json_num(c[1]) << ", " << json_num(c[2]) << ", "
+     << json_num(h[0]) << ", 0, 0, 0, " << json_num(h[1]) << ", 0, 0, 0, "
+     << json_num(h[2]) << "]},\n";
+  os << indent << " \"geometricError\": "
+     << json_num(tile.children.empty() ? 0.0 : tile.edge_length);
+  if (is_root)
+    os << ",\n" << indent << " \"refine\": \"REPLACE\"";
+  if (tile.has_content)
+    os << ",\n" << indent << " \"content\": {\"uri\": " << json_str(mesh_tile_file(tile)) << "}";
+
+  bool first = true;
+  for (size_t it = 0; it < tile.children.size(); it++) {
+    if (tiles[tile.children[it]].box.empty())
+      continue;
+    os << (first ? ",\n" + indent + " \"children\": [\n" : ",\n");
+    write_tile_json(os, tiles, tile.children[it], indent + "  ", false);
+    first = false;
+  }
+  if (!first)
+    os << "\n" << indent << " ]";
+  os << "}";
+  return true;
+}
+
+// Write the mesh as tiles in a hierarchy of levels of detail, each tile
+// a binary glTF file, with a 3D Tiles tileset.json that a web viewer such
+// as CesiumJS can stream. Coarser levels are made by taking every other
+// sample of the finer ones. The tiles are made in parallel, and each reads
+// only its own part of the cloud, so the whole mesh is never in memory.
+void save_tiled_mesh(Options const& opt, std::string const& output_prefix_no_dir,
+                     ImageViewRef<Vector3> point_cloud) {
+
+  int T = opt.lod_tile_size;
+  int num_levels = opt.num_lod_levels;
+  if (num_levels <= 0) {
+    // Enough levels for the coarsest one to be a single tile
+    num_levels = 1;
+    while (double(T) * (1 << (num_levels - 1)) < std::max(point_cloud.cols(),
+                                                          point_cloud.rows()) - 1)
+      num_levels++;
+  }
+
+  // The tiles of all levels, coarsest first
+  std::vector<MeshTile> tiles;
+  std::vector<int> level_start(num_levels + 1, 0);
+  std::vector<int> level_cols(num_levels), level_rows(num_levels);
+  for (int level = 0; level < num_levels; level++) {
+    int step = 1 << (num_levels - 1 - level);
+    int num_samples_x = (point_cloud.cols() - 1) / step + 1;
+    int num_samples_y = (point_cloud.rows() - 1) / step + 1;
+    level_cols[level] = std::max((num_samples_x - 1 + T - 1) / T, 1);
+    level_rows[level] = std::max((num_samples_y - 1 + T - 1) / T, 1);
+    level_start[level] = tiles.size();
+    for (int row = 0; row < level_rows[level]; row++) {
+      for (int col = 0; col < level_cols[level]; col++) {
+        MeshTile tile;
+        tile.level = level; tile.col = col; tile.row = row;
+        tiles.push_back(tile);
+      }
+    }
+  }
+  level_start[num_levels] = tiles.size();
+  for (int level = 0; level + 1 < num_levels; level++) {
+    for (int it = level_start[level]; it < level_start[level + 1]; it++) {
+      for (int dr = 0; dr < 2; dr++) {
+        for (int dc = 0; dc < 2; dc++) {
+          int col = 2 * tiles[it].col + dc, row = 2 * tiles[it].row + dr;
+          if (col < level_cols[level + 1] && row < level_rows[level + 1])
+            tiles[it].children.push_back(level_start[level + 1]
+                                         + row * level_cols[level + 1] + col);
+        }
+      }
+    }
+  }
+
+  std::string tiles_dir = opt.output_prefix + "-tiles";
+  boost::filesystem::create_directories(tiles_dir);
+  std::string image_uri = "../../" + output_prefix_no_dir + ".png";
+  vw_out() << "Writing " << tiles.size() << " tiles in " << num_levels
+           << " levels of detail to: " << tiles_dir << "\n";
+
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  TerminalProgressCallback tpc("asp", "\tTiles:   ");
+  int num_done = 0;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int it = 0; it < int(tiles.size()); it++) {
+    save_mesh_tile(tiles_dir, image_uri, point_cloud, T, num_levels, tiles[it]);
+#pragma omp critical
+    {
+      num_done++;
+      tpc.report_fractional_progress(num_done, tiles.size());
+    }
+  }
+  tpc.report_finished();
+
+  // The boxes of the tiles also enclose those of their descendants. A
+  // tile without content must still have an error, or its children would
+  // never be shown.
+  for (int it = int(tiles.size()) - 1; it >= 0; it--) {
+    double child_error = 0.0;
+    for (size_t c = 0; c < tiles[it].children.size(); c++) {
+      tiles[it].box.grow(tiles[tiles[it].children[c]].box);
+      child_error = std::max(child_error, tiles[tiles[it].children[c]].edge_length);
+    }
+    if (tiles[it].edge_length <= 0.0)
+      tiles[it].edge_length = 2.0 * child_error;
+  }
+
+  // A root tile without content above the coarsest level
+  MeshTile root;
+  root.level = -1;
+  for (int it = level_start[0]; it < level_start[1]; it++) {
+    root.children.push_back(it);
+    root.box.grow(tiles[it].box);
+    root.edge_length = std::max(root.edge_length, 2.0 * tiles[it].edge_length);
+  }
+  if (root.box.empty())
+    vw_throw(ArgumentErr() << "No valid triangles were found in the cloud.\n");
+  tiles.push_back(root);
+
+  std::string tileset_file = tiles_dir + "/tileset.json";
+  vw_out() << "Writing: " << tileset_file << "\n";
+  std::ofstream ofs(tileset_file.c_str());
+  ofs << "{\"asset\": {\"version\": \"1.1\", \"generator\": \"point2mesh\"},\n";
+  ofs << " \"geometricError\": " << json_num(root.edge_length) << ",\n";
+  ofs << " \"root\":\n";
+  write_tile_json(ofs, tiles, tiles.size() - 1, "  ", true);
+  ofs << "\n}\n";
+  ofs.close();
+  if (!ofs)
+    vw_throw(IOErr() << "Failed writing: " << tileset_file << "\n");
+}
+
 void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description general_options("");
   general_options.add_options()
@@ -218,7 +570,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("center", po::bool_switch(&opt.center)->default_value(false),
      "Let the origin be the midpoint of the bounding box of the cloud. Use this option if you are experiencing numerical precision issues.")
     ("precision", po::value(&opt.precision)->default_value(17),
-     "How many digits of precision to save.");
+     "How many digits of precision to save.")
+    ("lod-tile-size", po::value(&opt.lod_tile_size)->default_value(0),
+     "If positive, write the mesh as tiles with levels of detail, in the 3D Tiles format, "
+     "rather than as a single .obj file. Each tile has about this many samples of the "
+     "subsampled cloud on each side.")
+    ("num-lod-levels", po::value(&opt.num_lod_levels)->default_value(0),
+     "The number of levels of detail with --lod-tile-size. Each level is made of every other "
+     "sample of the next finer one. If 0, use enough levels for the coarsest to be one tile.");
   
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
@@ -256,6 +615,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw(ArgumentErr() << "Precision must be positive.\n"
              << usage << general_options);
 
+  if (opt.lod_tile_size < 0 || opt.num_lod_levels < 0 || opt.num_lod_levels > 20)
+    vw_throw(ArgumentErr() << "The values of --lod-tile-size and --num-lod-levels "
+             << "must be non-negative, and the latter at most 20.\n"
+             << usage << general_options);
+
+  if (opt.lod_tile_size > 0 && opt.center)
+    vw_out(WarningMessage) << "Ignoring --center, as tiled meshes are in ECEF.\n";
+
   // It is useful to have this to make the p
   if (opt.point_cloud_step_size % opt.texture_step_size != 0) 
     vw_throw(ArgumentErr() << "--point-cloud-step-size must be a multiple "
@@ -309,7 +676,7 @@ int main(int argc, char *argv[]){
     
     // Centering option (helpful if you are experiencing round-off error)
     Vector3 C(0, 0, 0);
-    if (opt.center) {
+    if (opt.center && opt.lod_tile_size <= 0) {
       bool is_geodetic = false; // raw xyz values
       BBox3 bbox = asp::pointcloud_bbox(point_cloud, is_geodetic);
       vw_out() << "\t--> Setting as the origin the bounding box midpoint.\n";
@@ -332,12 +699,15 @@ int main(int argc, char *argv[]){
     boost::filesystem::path p(opt.output_prefix);
     std::string output_prefix_no_dir = p.filename().string();
   
-    save_mesh(opt.output_prefix, output_prefix_no_dir,
-              point_cloud, C, opt.precision);
-    
-    save_texture(opt.output_prefix, texture_image);
-    
-    save_mtl(opt.output_prefix, output_prefix_no_dir);
+    if (opt.lod_tile_size > 0) {
+      save_tiled_mesh(opt, output_prefix_no_dir, point_cloud);
+      save_texture(opt.output_prefix, texture_image);
+    } else {
+      save_mesh(opt.output_prefix, output_prefix_no_dir,
+                point_cloud, C, opt.precision);
+      save_texture(opt.output_prefix, texture_image);
+      save_mtl(opt.output_prefix, output_prefix_no_dir);
+    }
     
   } ASP_STANDARD_CATCHES;
 
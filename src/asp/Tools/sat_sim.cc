@@ -130,6 +130,9 @@ void handle_arguments(int argc, char *argv[], asp::SatSimOptions& opt) {
     ("dem-height-error-tol", po::value(&opt.dem_height_error_tol)->default_value(0.001),
      "When intersecting a ray with a DEM, use this as the height error tolerance "
      "(measured in meters). It is expected that the default will be always good enough.")
+    ("ray-trace", po::bool_switch(&opt.ray_trace)->default_value(false)->implicit_value(true),
+     "Create the images by intersecting a ray from each pixel with the DEM, rather "
+     "than by projecting the DEM into the image. This is slower.")
     ;
   general_options.add(vw::GdalWriteOptionsDescription(opt));
 
@@ -93,15 +93,23 @@
 #include <asp/Camera/CsmModel.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/SfsGpu.h>
 #include <asp/Core/SfsImageProc.h>
+#include <asp/Core/PagedImage.h>
 #include <asp/Camera/RPCModelGen.h>
+#include <asp/Camera/SolverBackend.h>
+#include <asp/Core/Telemetry.h>
 
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
 
+#include <atomic>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include<sys/types.h>
 
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -114,7 +122,7 @@
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
-int g_num_locks = 0;
+std::atomic<int> g_num_exact_calls(0); // calls to the exact camera models
 int g_warning_count = 0;
 int g_max_warning_count = 1000;
 const size_t g_num_model_coeffs = 16;
@@ -189,8 +197,12 @@ namespace vw { namespace camera {
     bool m_use_rpc_approximation, m_use_semi_approx;
     vw::Mutex& m_camera_mutex;
     Vector2 m_uncompValue;
-    mutable int m_begX, m_endX, m_begY, m_endY;
-    mutable bool m_compute_mean, m_stop_growing_range;
+    // The range of computed table entries. This grows as needed while
+    // other threads use the table, so the range is updated only after
+    // the new entries are computed.
+    mutable std::atomic<int> m_begX, m_endX, m_begY, m_endY;
+    mutable bool m_compute_mean;
+    mutable std::atomic<bool> m_stop_growing_range;
     mutable int m_count;
     boost::shared_ptr<asp::RPCModel> m_rpc_model;
     
@@ -401,9 +413,9 @@ namespace vw { namespace camera {
       return true;
     }
     
-    void comp_entries_in_table() const{
-      for (int x = m_begX; x <= m_endX; x++) {
-        for (int y = m_begY; y <= m_endY; y++) {
+    void comp_entries_in_table(int begX, int endX, int begY, int endY) const{
+      for (int x = begX; x <= endX; x++) {
+        for (int y = begY; y <= endY; y++) {
       
           // This will be useful when we invoke this function repeatedly
           if (m_point_to_pix_mat(x, y).child() != m_uncompValue) {
@@ -447,6 +459,52 @@ namespace vw { namespace camera {
       }
       
     }
+
+    // Grow the range of computed table entries to contain the given
+    // position in the table. Other threads may be reading the table
+    // meanwhile, so the new entries are computed before the range is
+    // updated.
+    void grow_table(double x, double y) const {
+      vw::Mutex::Lock lock(m_camera_mutex);
+
+      // Another thread may have grown the table already
+      int begX = m_begX, endX = m_endX, begY = m_begY, endY = m_endY;
+      if (m_stop_growing_range ||
+          !(x < begX || x >= endX-1 || y < begY || y >= endY-1))
+        return;
+
+      if (g_warning_count < g_max_warning_count) {
+        g_warning_count++;
+        vw_out(WarningMessage) << "Pixel outside of computed range. "
+                               << "Growing the computed table." << std::endl;
+        vw_out(WarningMessage) << "Start table: " << begX << ' ' << begY << ' '
+                               << endX << ' ' << endY << std::endl;
+      }
+
+      // If we have to expand, do it by a lot
+      int extrax = std::max(10, int(0.1*(endX - begX)));
+      int extray = std::max(10, int(0.1*(endY - begY)));
+
+      int new_begX = std::max(0, std::min(begX, int(floor(x))) - extrax);
+      int new_begY = std::max(0, std::min(begY, int(floor(y))) - extray);
+      int new_endX = std::min(m_pixel_to_vec_mat.cols()-1, std::max(endX, int(ceil(x))) + extrax);
+      int new_endY = std::min(m_pixel_to_vec_mat.rows()-1, std::max(endY, int(ceil(y))) + extray);
+
+      if (g_warning_count < g_max_warning_count) {
+        vw_out(WarningMessage) << "Updated table: " << new_begX << ' ' << new_begY << ' '
+                               << new_endX << ' ' << new_endY << std::endl;
+      }
+
+      // Avoid an infinite loop if we can't grow the table
+      if (new_begX == begX && new_begY == begY && new_endX == endX && new_endY == endY) {
+        m_stop_growing_range = true;
+        return;
+      }
+
+      comp_entries_in_table(new_begX, new_endX, new_begY, new_endY);
+      m_begX = new_begX; m_endX = new_endX;
+      m_begY = new_begY; m_endY = new_endY;
+    }
     
   public:
 
@@ -574,7 +632,7 @@ namespace vw { namespace camera {
       // the camera to the ground. Invalid values will be masked.
       m_count = 0;
       m_mean_dir = Vector3();
-      comp_entries_in_table();
+      comp_entries_in_table(m_begX, m_endX, m_begY, m_endY);
       m_mean_dir /= std::max(1, m_count);
       m_mean_dir = m_mean_dir/norm_2(m_mean_dir);
       m_compute_mean = false; // done computing the mean
@@ -610,8 +668,7 @@ namespace vw { namespace camera {
     virtual Vector2 point_to_pixel(Vector3 const& xyz) const{
 
       if (m_use_semi_approx){
-        vw::Mutex::Lock lock(m_camera_mutex);
-        g_num_locks++;
+        g_num_exact_calls++;
         return m_exact_unadjusted_camera->point_to_pixel(xyz);
       }
       
@@ -637,12 +694,14 @@ namespace vw { namespace camera {
         if (norm_2(S) <= major_radius) {
           // should not happen. Return the exact solution.
           {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "3D point is inside the planet.\n";
+            {
+              vw::Mutex::Lock lock(m_camera_mutex);
+              if (g_warning_count < g_max_warning_count) {
+                g_warning_count++;
+                vw_out(WarningMessage) << "3D point is inside the planet.\n";
+              }
             }
+            g_num_exact_calls++;
             return m_exact_unadjusted_camera->point_to_pixel(xyz);
           }
         }
@@ -663,59 +722,23 @@ namespace vw { namespace camera {
 
         // If we are not out of range, but we need to expand the computed table, do that
         if (!m_stop_growing_range && !out_of_range && out_of_comp_range) {
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of computed range. "
-                                   << "Growing the computed table." << std::endl;
-            vw_out(WarningMessage) << "Start table: " << m_begX << ' ' << m_begY << ' '
-                                   << m_endX << ' ' << m_endY << std::endl;
-          }
-          
-          // If we have to expand, do it by a lot
-          int extrax = std::max(10, int(0.1*(m_endX - m_begX)));
-          int extray = std::max(10, int(0.1*(m_endY - m_begY)));
-
-          int old_begX = m_begX, old_begY = m_begY;
-          int old_endX = m_endX, old_endY = m_endY;
-
-          m_begX = std::min(m_begX, int(floor(x))) - extrax; m_begX = std::max(0, m_begX);
-          m_begY = std::min(m_begY, int(floor(y))) - extray; m_begY = std::max(0, m_begY);
-      
-          m_endX = std::max(m_endX, int(ceil(x))) + extrax;
-          m_endX = std::min(m_pixel_to_vec_mat.cols()-1, m_endX);
-
-          m_endY = std::max(m_endY, int(ceil(y))) + extray;
-          m_endY = std::min(m_pixel_to_vec_mat.rows()-1, m_endY);
-      
-          if (g_warning_count < g_max_warning_count) {
-            vw_out(WarningMessage) << "Updated table: " << m_begX << ' ' << m_begY << ' '
-                                   << m_endX << ' ' << m_endY << std::endl;
-          }
-          comp_entries_in_table();
-
-          // Update this
+          grow_table(x, y);
           out_of_comp_range = (x < m_begX || x >= m_endX-1 ||
                                y < m_begY || y >= m_endY-1);
-
-          // Avoid an infinite loop if we can't grow the table
-          if (old_begX == m_begX && old_begY == m_begY &&
-              old_endX == m_endX && old_endY == m_endY ) {
-            m_stop_growing_range = true;
-          }
         }
 
         if (out_of_range || out_of_comp_range){
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
-                                   << x << ' ' << y << ' '
-                                   << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
-                                   << std::endl;
+          {
+            vw::Mutex::Lock lock(m_camera_mutex);
+            if (g_warning_count < g_max_warning_count) {
+              g_warning_count++;
+              vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
+                                     << x << ' ' << y << ' '
+                                     << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
+                                     << std::endl;
+            }
           }
+          g_num_exact_calls++;
           return m_exact_unadjusted_camera->point_to_pixel(xyz);
         }
         PixelMask<Vector3> masked_dir = pixel_to_vec_interp(x, y);
@@ -726,13 +749,15 @@ namespace vw { namespace camera {
           pix = masked_pix.child();
         }else{
           {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "Invalid ground to camera direction: "
-                                     << masked_dir << ' ' << masked_pix << std::endl;
+            {
+              vw::Mutex::Lock lock(m_camera_mutex);
+              if (g_warning_count < g_max_warning_count) {
+                g_warning_count++;
+                vw_out(WarningMessage) << "Invalid ground to camera direction: "
+                                       << masked_dir << ' ' << masked_pix << std::endl;
+              }
             }
+            g_num_exact_calls++;
             return m_exact_unadjusted_camera->point_to_pixel(xyz);
           }
         }
@@ -747,8 +772,7 @@ namespace vw { namespace camera {
     virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
 
       if (m_use_semi_approx) {
-        vw::Mutex::Lock lock(m_camera_mutex);
-        g_num_locks++;
+        g_num_exact_calls++;
         return this->exact_unadjusted_camera()->pixel_to_vector(pix);
       }
 
@@ -756,21 +780,22 @@ namespace vw { namespace camera {
         return m_rpc_model->pixel_to_vector(pix);
       }
       
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
-      if (g_warning_count < g_max_warning_count) {
-        g_warning_count++;
-        vw_out(WarningMessage) << "Invoked exact camera model pixel_to_vector for pixel: "
-                               << pix << std::endl;
+      {
+        vw::Mutex::Lock lock(m_camera_mutex);
+        if (g_warning_count < g_max_warning_count) {
+          g_warning_count++;
+          vw_out(WarningMessage) << "Invoked exact camera model pixel_to_vector for pixel: "
+                                 << pix << std::endl;
+        }
       }
+      g_num_exact_calls++;
       return this->exact_unadjusted_camera()->pixel_to_vector(pix);
     }
 
     virtual Vector3 camera_center(Vector2 const& pix) const{
       // It is tricky to approximate the camera center
       //if (m_use_rpc_approximation){
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
+      g_num_exact_calls++;
       //vw_out(WarningMessage) << "Invoked the camera center function for pixel: "
       //                       << pix << std::endl;
       return this->exact_unadjusted_camera()->camera_center(pix);
@@ -795,26 +820,30 @@ namespace vw { namespace camera {
       
       {
         // Failed to interpolate
-        vw::Mutex::Lock lock(m_camera_mutex);
-        g_num_locks++;
-        if (g_warning_count < g_max_warning_count) {
-          g_warning_count++;
-          vw_out(WarningMessage) << "Invoked the camera center function for pixel: "
-                                 << pix << std::endl;
+        {
+          vw::Mutex::Lock lock(m_camera_mutex);
+          if (g_warning_count < g_max_warning_count) {
+            g_warning_count++;
+            vw_out(WarningMessage) << "Invoked the camera center function for pixel: "
+                                   << pix << std::endl;
+          }
         }
+        g_num_exact_calls++;
         return this->exact_unadjusted_camera()->camera_center(pix);
       }
 
     }
 
     virtual Quat camera_pose(Vector2 const& pix) const{
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
-      if (g_warning_count < g_max_warning_count) {
-        g_warning_count++;
-        vw_out(WarningMessage) << "Invoked the camera pose function for pixel: "
-                               << pix << std::endl;
+      {
+        vw::Mutex::Lock lock(m_camera_mutex);
+        if (g_warning_count < g_max_warning_count) {
+          g_warning_count++;
+          vw_out(WarningMessage) << "Invoked the camera pose function for pixel: "
+                                 << pix << std::endl;
+        }
       }
+      g_num_exact_calls++;
       return this->exact_unadjusted_camera()->camera_pose(pix);
     }
 
@@ -1010,12 +1039,14 @@ namespace vw { namespace camera {
         if (norm_2(S) <= major_radius) {
           // should not happen. Return the exact solution.
           {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "3D point is inside the planet.\n";
+            {
+              vw::Mutex::Lock lock(m_camera_mutex);
+              if (g_warning_count < g_max_warning_count) {
+                g_warning_count++;
+                vw_out(WarningMessage) << "3D point is inside the planet.\n";
+              }
             }
+            g_num_exact_calls++;
             return m_exact_adjusted_camera.point_to_pixel(xyz);
           }
         }
@@ -1034,15 +1065,17 @@ namespace vw { namespace camera {
         // If out of range, return the exact result. This should be very slow.
         // The hope is that it will be very rare.
         if (out_of_range){
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
-                                   << x << ' ' << y << ' '
-                                   << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
-                                   << std::endl;
+          {
+            vw::Mutex::Lock lock(m_camera_mutex);
+            if (g_warning_count < g_max_warning_count) {
+              g_warning_count++;
+              vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
+                                     << x << ' ' << y << ' '
+                                     << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
+                                     << std::endl;
+            }
           }
+          g_num_exact_calls++;
           return m_exact_adjusted_camera.point_to_pixel(xyz);
         }
         
@@ -1053,13 +1086,15 @@ namespace vw { namespace camera {
           pix = masked_pix.child();
         }else{
           {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "Invalid ground to camera direction: "
-                                     << masked_dir << ' ' << masked_pix << std::endl;
+            {
+              vw::Mutex::Lock lock(m_camera_mutex);
+              if (g_warning_count < g_max_warning_count) {
+                g_warning_count++;
+                vw_out(WarningMessage) << "Invalid ground to camera direction: "
+                                       << masked_dir << ' ' << masked_pix << std::endl;
+              }
             }
+            g_num_exact_calls++;
             return m_exact_adjusted_camera.point_to_pixel(xyz);
           }
         }
@@ -1073,13 +1108,15 @@ namespace vw { namespace camera {
 
     virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
 
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
-      if (g_warning_count < g_max_warning_count) {
-        g_warning_count++;
-        vw_out(WarningMessage) << "Invoked exact camera model pixel_to_vector for pixel: "
-                               << pix << std::endl;
+      {
+        vw::Mutex::Lock lock(m_camera_mutex);
+        if (g_warning_count < g_max_warning_count) {
+          g_warning_count++;
+          vw_out(WarningMessage) << "Invoked exact camera model pixel_to_vector for pixel: "
+                                 << pix << std::endl;
+        }
       }
+      g_num_exact_calls++;
       // TODO(oalexan1): Put here the exact adjusted camera!
       return this->exact_unadjusted_camera()->pixel_to_vector(pix);
     }
@@ -1087,27 +1124,268 @@ namespace vw { namespace camera {
     virtual Vector3 camera_center(Vector2 const& pix) const{
       // It is tricky to approximate the camera center
       // TODO(oalexan1): Must apply the adjustment here?
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
+      g_num_exact_calls++;
       // TODO(oalexan1): Put here the exact adjusted camera!
       return this->exact_unadjusted_camera()->camera_center(pix);
     }
 
     virtual Quat camera_pose(Vector2 const& pix) const{
       // TODO(oalexan1): Must apply the adjustment here?!!!
-      vw::Mutex::Lock lock(m_camera_mutex);
-      g_num_locks++;
-      if (g_warning_count < g_max_warning_count) {
-        g_warning_count++;
-        vw_out(WarningMessage) << "Invoked the camera pose function for pixel: "
-                               << pix << std::endl;
+      {
+        vw::Mutex::Lock lock(m_camera_mutex);
+        if (g_warning_count < g_max_warning_count) {
+          g_warning_count++;
+          vw_out(WarningMessage) << "Invoked the camera pose function for pixel: "
+                                 << pix << std::endl;
+        }
       }
+      g_num_exact_calls++;
       // TODO(oalexan1): Put here the exact adjusted camera!
       return this->exact_unadjusted_camera()->camera_pose(pix);
     }
 
   };
   
+  // Tabulate the point_to_pixel() function of an unadjusted camera at
+  // a sparse grid of nodes of a DEM, at the DEM heights, together with
+  // the derivative of the pixel with respect to the height. A point is
+  // projected by interpolating the values at the four nodes around it
+  // and correcting them linearly for the difference of the point
+  // height from the node heights. The camera center is tabulated on
+  // a coarse grid in the image. The values are stored as float32,
+  // relative to an origin pixel. If a point is outside the table, or
+  // near an invalid node, the exact camera is used.
+  //
+  // As this approximates an unadjusted camera, it is to be wrapped in
+  // an AdjustedCameraModel, and then the adjustments can still change.
+  class LookupTableCameraModel: public CameraModel {
+
+    struct Node {
+      float col, row;   // pixel, relative to m_origin
+      float dcol, drow; // derivative of the pixel with respect to the height
+      float height;
+      bool  valid;
+    };
+
+    boost::shared_ptr<CameraModel> m_exact_camera;
+    GeoReference m_geo;
+    int m_spacing, m_numx, m_numy;
+    std::vector<Node> m_nodes;
+    Vector2 m_origin;
+
+    // The camera centers, on a grid in the image
+    BBox2 m_center_box;
+    double m_center_grid;
+    int m_center_numx, m_center_numy;
+    std::vector<Vector3> m_centers;
+
+    Node const& node(int x, int y) const {
+      return m_nodes[size_t(y) * m_numx + x];
+    }
+
+    // Compute the table nodes with indices y in [beg, end)
+    void comp_nodes(ImageView<double> const& dem, double nodata_val,
+                    double height_step, int beg, int end) {
+      for (int y = beg; y < end; y++) {
+        for (int x = 0; x < m_numx; x++) {
+          Node & n = m_nodes[size_t(y) * m_numx + x];
+          n.valid = false;
+          // Nodes past the last DEM row or column use the height there
+          int col = x * m_spacing, row = y * m_spacing;
+          double ht = dem(std::min(col, dem.cols() - 1), std::min(row, dem.rows() - 1));
+          if (ht == nodata_val)
+            continue;
+          Vector2 ll = m_geo.pixel_to_lonlat(Vector2(col, row));
+          try {
+            // The derivative is the secant over the expected range of heights
+            Vector2 pix = m_exact_camera->point_to_pixel
+              (m_geo.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], ht)));
+            Vector2 pix_up = m_exact_camera->point_to_pixel
+              (m_geo.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], ht + height_step)));
+            Vector2 pix_dn = m_exact_camera->point_to_pixel
+              (m_geo.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], ht - height_step)));
+            Vector2 deriv = (pix_up - pix_dn) / (2.0 * height_step);
+            if (pix != pix || deriv != deriv) // NaN
+              continue;
+            pix -= m_origin;
+            n.col  = pix[0];   n.row  = pix[1];
+            n.dcol = deriv[0]; n.drow = deriv[1];
+            n.height = ht;
+            n.valid = true;
+          } catch (...) {
+            // The point does not project into the camera
+          }
+        }
+      }
+    }
+
+    // Interpolate in the table. Return false if not possible.
+    bool interp_pixel(Vector3 const& xyz, Vector2 & pix) const {
+      Vector3 llh = m_geo.datum().cartesian_to_geodetic(xyz);
+      Vector2 dem_pix = m_geo.lonlat_to_pixel(subvector(llh, 0, 2));
+      double x = dem_pix.x() / m_spacing, y = dem_pix.y() / m_spacing;
+      if (!(x >= 0 && y >= 0 && x <= m_numx - 1 && y <= m_numy - 1))
+        return false;
+      int ix = std::min(int(x), m_numx - 2), iy = std::min(int(y), m_numy - 2);
+      double wx = x - ix, wy = y - iy;
+      double col = 0.0, row = 0.0;
+      for (int dy = 0; dy < 2; dy++) {
+        for (int dx = 0; dx < 2; dx++) {
+          Node const& n = node(ix + dx, iy + dy);
+          if (!n.valid)
+            return false;
+          double w  = (dx == 0 ? 1.0 - wx : wx) * (dy == 0 ? 1.0 - wy : wy);
+          double dh = llh[2] - n.height;
+          col += w * (n.col + n.dcol * dh);
+          row += w * (n.row + n.drow * dh);
+        }
+      }
+      pix = m_origin + Vector2(col, row);
+      return true;
+    }
+
+  public:
+
+    // Build the table with nodes every given number of DEM pixels
+    LookupTableCameraModel(boost::shared_ptr<CameraModel> exact_unadjusted_camera,
+                           ImageView<double> const& dem, GeoReference const& geo,
+                           double nodata_val, int spacing, double height_range,
+                           int num_threads):
+      m_exact_camera(exact_unadjusted_camera), m_geo(geo),
+      m_spacing(std::max(spacing, 1)) {
+
+      if (dynamic_cast<AdjustedCameraModel*>(exact_unadjusted_camera.get()) != NULL)
+        vw_throw(ArgumentErr()
+                 << "LookupTableCameraModel: Expecting an unadjusted camera model.\n");
+      if (dem.cols() <= 0 || dem.rows() <= 0)
+        vw_throw(ArgumentErr() << "LookupTableCameraModel: Expecting a non-empty DEM.\n");
+
+      // The last node is at or past the last DEM pixel
+      m_numx = std::max(2, (dem.cols() - 1 + m_spacing - 1) / m_spacing + 1);
+      m_numy = std::max(2, (dem.rows() - 1 + m_spacing - 1) / m_spacing + 1);
+      m_nodes.resize(size_t(m_numx) * m_numy);
+
+      // Keep the pixels small, so they are precise as float32
+      m_origin = Vector2();
+      try {
+        Vector2 ll = m_geo.pixel_to_lonlat(Vector2(dem.cols() / 2, dem.rows() / 2));
+        m_origin = m_exact_camera->point_to_pixel
+          (m_geo.datum().geodetic_to_cartesian
+           (Vector3(ll[0], ll[1], dem(dem.cols() / 2, dem.rows() / 2))));
+        if (m_origin != m_origin)
+          m_origin = Vector2();
+      } catch (...) {}
+
+      double height_step = std::max(height_range, 1.0);
+      num_threads = std::max(1, std::min(num_threads, m_numy));
+      std::vector<std::thread> threads;
+      for (int it = 0; it < num_threads; it++) {
+        int beg = (long long)m_numy * it / num_threads;
+        int end = (long long)m_numy * (it + 1) / num_threads;
+        threads.push_back(std::thread(&LookupTableCameraModel::comp_nodes, this,
+                                      std::cref(dem), nodata_val, height_step, beg, end));
+      }
+      for (size_t it = 0; it < threads.size(); it++)
+        threads[it].join();
+
+      // Tabulate the camera center over the image region the nodes
+      // project to, and a bit more
+      for (size_t it = 0; it < m_nodes.size(); it++) {
+        if (m_nodes[it].valid)
+          m_center_box.grow(m_origin + Vector2(m_nodes[it].col, m_nodes[it].row));
+      }
+      m_center_numx = m_center_numy = 0;
+      if (m_center_box.empty())
+        return;
+      double extra = 0.25 * std::max(m_center_box.width(), m_center_box.height()) + 1.0;
+      m_center_box.expand(extra);
+      int max_size = 64;
+      m_center_grid = std::max(m_center_box.width(), m_center_box.height()) / max_size;
+      m_center_numx = int(ceil(m_center_box.width()  / m_center_grid)) + 1;
+      m_center_numy = int(ceil(m_center_box.height() / m_center_grid)) + 1;
+      m_centers.resize(size_t(m_center_numx) * m_center_numy);
+      for (int y = 0; y < m_center_numy; y++) {
+        for (int x = 0; x < m_center_numx; x++)
+          m_centers[size_t(y) * m_center_numx + x] = m_exact_camera->camera_center
+            (m_center_box.min() + m_center_grid * Vector2(x, y));
+      }
+    }
+
+    // Number of DEM pixels between nodes
+    int spacing() const { return m_spacing; }
+
+    // The largest difference between the table and the exact camera, in
+    // pixels, at up to 100 x 100 points half-way between the nodes, at
+    // the DEM height, and above and below it by the given amount.
+    double max_error(ImageView<double> const& dem, double nodata_val,
+                     double height_range) const {
+      double max_err = 0.0;
+      int stepx = std::max(1, (m_numx - 1) / 100), stepy = std::max(1, (m_numy - 1) / 100);
+      for (int y = 0; y < m_numy - 1; y += stepy) {
+        for (int x = 0; x < m_numx - 1; x += stepx) {
+          double col = (x + 0.5) * m_spacing, row = (y + 0.5) * m_spacing;
+          double ht = dem(std::min(int(col), dem.cols() - 1),
+                          std::min(int(row), dem.rows() - 1));
+          if (ht == nodata_val)
+            continue;
+          Vector2 ll = m_geo.pixel_to_lonlat(Vector2(col, row));
+          for (int k = -1; k <= 1; k++) {
+            Vector3 xyz = m_geo.datum().geodetic_to_cartesian
+              (Vector3(ll[0], ll[1], ht + k * height_range));
+            Vector2 pix;
+            if (!interp_pixel(xyz, pix))
+              continue; // will use the exact camera
+            try {
+              Vector2 exact_pix = m_exact_camera->point_to_pixel(xyz);
+              if (exact_pix == exact_pix)
+                max_err = std::max(max_err, norm_2(pix - exact_pix));
+            } catch (...) {}
+          }
+        }
+      }
+      return max_err;
+    }
+
+    virtual Vector2 point_to_pixel(Vector3 const& xyz) const {
+      Vector2 pix;
+      if (interp_pixel(xyz, pix))
+        return pix;
+      g_num_exact_calls++;
+      return m_exact_camera->point_to_pixel(xyz);
+    }
+
+    virtual Vector3 camera_center(Vector2 const& pix) const {
+      if (m_center_numx > 0) {
+        double x = (pix.x() - m_center_box.min().x()) / m_center_grid;
+        double y = (pix.y() - m_center_box.min().y()) / m_center_grid;
+        if (x >= 0 && y >= 0 && x <= m_center_numx - 1 && y <= m_center_numy - 1) {
+          int ix = std::min(int(x), m_center_numx - 2);
+          int iy = std::min(int(y), m_center_numy - 2);
+          double wx = x - ix, wy = y - iy;
+          size_t k = size_t(iy) * m_center_numx + ix;
+          return (1.0 - wy) * ((1.0 - wx) * m_centers[k] + wx * m_centers[k + 1])
+            + wy * ((1.0 - wx) * m_centers[k + m_center_numx]
+                    + wx * m_centers[k + m_center_numx + 1]);
+        }
+      }
+      g_num_exact_calls++;
+      return m_exact_camera->camera_center(pix);
+    }
+
+    virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
+      g_num_exact_calls++;
+      return m_exact_camera->pixel_to_vector(pix);
+    }
+
+    virtual Quat camera_pose(Vector2 const& pix) const {
+      g_num_exact_calls++;
+      return m_exact_camera->camera_pose(pix);
+    }
+
+    virtual ~LookupTableCameraModel(){}
+    virtual std::string type() const{ return "LookupTable"; }
+  };
+  
 }}
 
 // Get the memory usage for the given process. This is for debugging, not used
@@ -1157,24 +1435,28 @@ void compute_image_stats(ImageT const& I1, ImageT const& I2,
 }
 
 struct Options : public vw::GdalWriteOptions {
-  std::string input_dems_str, image_list, camera_list, out_prefix, stereo_session, bundle_adjust_prefix;
+  std::string input_dems_str, image_list, camera_list, out_prefix, stereo_session, bundle_adjust_prefix,
+    solver_backend;
   std::vector<std::string> input_dems, input_images, input_cameras;
-  std::string shadow_thresholds, custom_shadow_threshold_list, max_valid_image_vals, skip_images_str, image_exposure_prefix, model_coeffs_prefix, model_coeffs, image_haze_prefix, sun_positions_list;
+  std::string shadow_thresholds, custom_shadow_threshold_list, max_valid_image_vals, skip_images_str, image_exposure_prefix, model_coeffs_prefix, model_coeffs, image_haze_prefix, sun_positions_list, cache_dir;
   std::vector<float> shadow_threshold_vec, max_valid_image_vals_vec;
   std::vector<double> image_exposures_vec;
   std::vector<std::vector<double>> image_haze_vec;
   std::vector<double> model_coeffs_vec;
   std::vector<std::set<int>> skip_images;
   int max_iterations, max_coarse_iterations, reflectance_type, coarse_levels,
-    blending_dist, min_blend_size, num_haze_coeffs;
+    multigrid_cycles, multigrid_smoothing_iterations,
+    blending_dist, min_blend_size, num_haze_coeffs, camera_lookup_spacing,
+    checkpoint_every;
   bool float_albedo, float_exposure, float_cameras, float_all_cameras, model_shadows,
     save_computed_intensity_only, estimate_slope_errors, estimate_height_errors,
     compute_exposures_only,
     save_dem_with_nodata, use_approx_camera_models, use_approx_adjusted_camera_models,
-    use_rpc_approximation, use_semi_approx,
+    use_rpc_approximation, use_semi_approx, use_camera_lookup_tables,
     crop_input_images, allow_borderline_data, float_dem_at_boundary, boundary_fix,
     fix_dem, float_reflectance_model, float_sun_position, query, save_sparingly,
-    float_haze;
+    float_haze, solver_mixed_precision, precompute_shadows, compress_images,
+    robust_exposure_fit, use_gpu_solver;
     
   double smoothness_weight, steepness_factor, curvature_in_shadow,
     curvature_in_shadow_weight,
@@ -1183,13 +1465,16 @@ struct Options : public vw::GdalWriteOptions {
     nodata_val, initial_dem_constraint_weight, albedo_constraint_weight,
     albedo_robust_threshold,
     camera_position_step_size, rpc_penalty_weight, rpc_max_error,
+    camera_lookup_max_error, camera_lookup_height_range,
     unreliable_intensity_threshold, robust_threshold, shadow_threshold;
   vw::BBox2 crop_win;
   vw::Vector2 height_error_params;
   
   Options():max_iterations(0), max_coarse_iterations(0), reflectance_type(0),
-            coarse_levels(0), blending_dist(0), blending_power(2.0),
-            min_blend_size(0), num_haze_coeffs(0),
+            coarse_levels(0), multigrid_cycles(0), multigrid_smoothing_iterations(0),
+            blending_dist(0), blending_power(2.0),
+            min_blend_size(0), num_haze_coeffs(0), camera_lookup_spacing(0),
+            checkpoint_every(0),
             float_albedo(false), float_exposure(false), float_cameras(false),
             float_all_cameras(false),
             model_shadows(false), 
@@ -1202,11 +1487,14 @@ struct Options : public vw::GdalWriteOptions {
             use_approx_adjusted_camera_models(false),
             use_rpc_approximation(false),
             use_semi_approx(false),
+            use_camera_lookup_tables(false),
             crop_input_images(false),
             allow_borderline_data(false), 
             float_dem_at_boundary(false), boundary_fix(false), fix_dem(false),
             float_reflectance_model(false), float_sun_position(false),
             query(false), save_sparingly(false), float_haze(false),
+            solver_mixed_precision(false), precompute_shadows(false), compress_images(false),
+            robust_exposure_fit(false), use_gpu_solver(false),
             smoothness_weight(0), steepness_factor(1.0),
             curvature_in_shadow(0), curvature_in_shadow_weight(0.0),
             lit_curvature_dist(0.0), shadow_curvature_dist(0.0),
@@ -1215,6 +1503,7 @@ struct Options : public vw::GdalWriteOptions {
             albedo_constraint_weight(0.0), albedo_robust_threshold(0.0),
             camera_position_step_size(1.0), rpc_penalty_weight(0.0),
             rpc_max_error(0.0),
+            camera_lookup_max_error(0.0), camera_lookup_height_range(0.0),
             unreliable_intensity_threshold(0.0),
             crop_win(BBox2i(0, 0, 0, 0)){}
 };
@@ -1275,6 +1564,28 @@ computeLambertianReflectanceFromNormal(Vector3 sunPos, Vector3 xyz,
   return reflectance;
 }
 
+// Find the cosines of the angles between the surface normal and the
+// directions to the sun (mu_0) and to the viewer (mu), and between
+// these two directions (the phase angle). This is shared by the
+// reflectance models below.
+inline void reflectanceCosines(Vector3 const& sunPos, Vector3 const& viewPos,
+                               Vector3 const& xyz, Vector3 const& normal,
+                               double & mu_0, double & mu, double & cos_alpha) {
+
+  double len = dot_prod(normal, normal);
+  if (abs(len - 1.0) > 1.0e-4){
+    std::cerr << "Error: Expecting unit normal in the reflectance computation, in "
+              << __FILE__ << " at line " << __LINE__ << std::endl;
+    exit(1);
+  }
+
+  // Sun and viewer coordinates relative to the xyz point on the Moon surface
+  Vector3 sunDirection  = normalize(sunPos - xyz);
+  Vector3 viewDirection = normalize(viewPos - xyz);
+  mu_0      = dot_prod(sunDirection, normal);
+  mu        = dot_prod(viewDirection, normal);
+  cos_alpha = dot_prod(sunDirection, viewDirection);
+}
 
 double computeLunarLambertianReflectanceFromNormal(Vector3 const& sunPos,
                                                    Vector3 const& viewPos,
@@ -1287,17 +1598,10 @@ double computeLunarLambertianReflectanceFromNormal(Vector3 const& sunPos,
   double reflectance;
   double L;
 
-  double len = dot_prod(normal, normal);
-  if (abs(len - 1.0) > 1.0e-4){
-    std::cerr << "Error: Expecting unit normal in the reflectance computation, in "
-              << __FILE__ << " at line " << __LINE__ << std::endl;
-    exit(1);
-  }
-
-  //compute /mu_0 = cosine of the angle between the light direction and the surface normal.
-  //sun coordinates relative to the xyz point on the Moon surface
-  Vector3 sunDirection = normalize(sunPos-xyz);
-  double mu_0 = dot_prod(sunDirection, normal);
+  // mu_0 and mu are the cosines of the angles between the normal and the
+  // directions to the sun and viewer. Alpha is the phase angle.
+  double mu_0, mu, cos_alpha;
+  reflectanceCosines(sunPos, viewPos, xyz, normal, mu_0, mu, cos_alpha);
 
   //double tol = 0.3;
   //if (mu_0 < tol){
@@ -1305,16 +1609,7 @@ double computeLunarLambertianReflectanceFromNormal(Vector3 const& sunPos,
   //  return 0.0;
   // }
 
-  //compute  /mu = cosine of the angle between the viewer direction and the surface normal.
-  //viewer coordinates relative to the xyz point on the Moon surface
-  Vector3 viewDirection = normalize(viewPos-xyz);
-  double mu = dot_prod(viewDirection,normal);
-
-  //compute the phase angle (alpha) between the viewing direction and the light source direction
   double deg_alpha;
-  double cos_alpha;
-
-  cos_alpha = dot_prod(sunDirection, viewDirection);
   if ((cos_alpha > 1)||(cos_alpha< -1)){
     printf("cos_alpha error\n");
   }
@@ -1333,7 +1628,7 @@ double computeLunarLambertianReflectanceFromNormal(Vector3 const& sunPos,
   double B = reflectance_model_coeffs[2]; // 0.000242;//0.242*1e-3;
   double C = reflectance_model_coeffs[3]; // -0.00000146;//-1.46*1e-6;
 
-  L = O + A*deg_alpha + B*deg_alpha*deg_alpha + C*deg_alpha*deg_alpha*deg_alpha;
+  L = O + deg_alpha*(A + deg_alpha*(B + deg_alpha*C));
  
   //printf(" deg_alpha = %f, L = %f\n", deg_alpha, L);
 
@@ -1398,27 +1693,10 @@ double computeHapkeReflectanceFromNormal(Vector3 const& sunPos,
                                          double & alpha,
                                          const double * reflectance_model_coeffs) {
 
-  double len = dot_prod(normal, normal);
-  if (abs(len - 1.0) > 1.0e-4){
-    std::cerr << "Error: Expecting unit normal in the reflectance computation, in "
-              << __FILE__ << " at line " << __LINE__ << std::endl;
-    exit(1);
-  }
-
-  //compute mu_0 = cosine of the angle between the light direction and the surface normal.
-  //sun coordinates relative to the xyz point on the Moon surface
-  Vector3 sunDirection = normalize(sunPos-xyz);
-  double mu_0 = dot_prod(sunDirection, normal);
-
-  //compute mu = cosine of the angle between the viewer direction and the surface normal.
-  //viewer coordinates relative to the xyz point on the Moon surface
-  Vector3 viewDirection = normalize(viewPos-xyz);
-  double mu = dot_prod(viewDirection,normal);
-
-  //compute the phase angle (g) between the viewing direction and the light source direction
-  // in radians
-  double cos_g = dot_prod(sunDirection, viewDirection);
-  double g = acos(cos_g);  // phase angle in radians
+  // The cosines of the angles between the normal and the directions
+  // to the sun and viewer, and of the phase angle (g)
+  double mu_0, mu, cos_g;
+  reflectanceCosines(sunPos, viewPos, xyz, normal, mu_0, mu, cos_g);
 
   // Hapke params
   double omega = std::abs(reflectance_model_coeffs[0]); // also known as w
@@ -1430,16 +1708,19 @@ double computeHapkeReflectanceFromNormal(Vector3 const& sunPos,
 
   double J = 1.0; // does not matter, we'll factor out the constant scale as camera exposures anyway
   
-  // The P(g) term
+  // The P(g) term. Use x*sqrt(x) rather than pow(x, 1.5).
+  double Pp = 1.0 + 2.0*b*cos_g + b*b, Pm = 1.0 - 2.0*b*cos_g + b*b;
   double Pg 
-    = (1.0 - c) * (1.0 - b*b) / pow(1.0 + 2.0*b*cos_g + b*b, 1.5)
-    + c         * (1.0 - b*b) / pow(1.0 - 2.0*b*cos_g + b*b, 1.5);
+    = (1.0 - c) * (1.0 - b*b) / (Pp * sqrt(Pp))
+    + c         * (1.0 - b*b) / (Pm * sqrt(Pm));
     
-  // The B(g) term
-  double Bg = B0 / ( 1.0 + (1.0/h)*tan(g/2.0) );
+  // The B(g) term. Here tan(g/2) is found from cos(g), without acos().
+  double tan_half_g = sqrt((1.0 - cos_g) / (1.0 + cos_g));
+  double Bg = B0 / ( 1.0 + (1.0/h)*tan_half_g );
 
-  double H_mu0 = (1.0 + 2*mu_0) / (1.0 + 2*mu_0 * sqrt(1.0 - omega));
-  double H_mu  = (1.0 + 2*mu  ) / (1.0 + 2*mu   * sqrt(1.0 - omega));
+  double sqrt_one_minus_omega = sqrt(1.0 - omega);
+  double H_mu0 = (1.0 + 2*mu_0) / (1.0 + 2*mu_0 * sqrt_one_minus_omega);
+  double H_mu  = (1.0 + 2*mu  ) / (1.0 + 2*mu   * sqrt_one_minus_omega);
 
   // The reflectance
   double R = (J*omega/4.0/M_PI) * ( mu_0/(mu_0+mu) ) * ( (1.0 + Bg)*Pg + H_mu0*H_mu - 1.0 );
@@ -1460,22 +1741,10 @@ double computeCharonReflectanceFromNormal(Vector3 const& sunPos,
                                           double & alpha,
                                           const double * reflectance_model_coeffs) {
 
-  double len = dot_prod(normal, normal);
-  if (abs(len - 1.0) > 1.0e-4){
-    std::cerr << "Error: Expecting unit normal in the reflectance computation, in "
-              << __FILE__ << " at line " << __LINE__ << std::endl;
-    exit(1);
-  }
-
-  //compute mu_0 = cosine of the angle between the light direction and the surface normal.
-  //sun coordinates relative to the xyz point on the Moon surface
-  Vector3 sunDirection = normalize(sunPos-xyz);
-  double mu_0 = dot_prod(sunDirection, normal);
-
-  //compute mu = cosine of the angle between the viewer direction and the surface normal.
-  //viewer coordinates relative to the xyz point on the Moon surface
-  Vector3 viewDirection = normalize(viewPos-xyz);
-  double mu = dot_prod(viewDirection,normal);
+  // The cosines of the angles between the normal and the directions
+  // to the sun and viewer. The phase angle is not needed.
+  double mu_0, mu, cos_alpha;
+  reflectanceCosines(sunPos, viewPos, xyz, normal, mu_0, mu, cos_alpha);
 
   // Charon model params
   double A       = std::abs(reflectance_model_coeffs[0]); // albedo 
@@ -1500,35 +1769,12 @@ double computeArbitraryLambertianReflectanceFromNormal(Vector3 const& sunPos,
                                                        const double * reflectance_model_coeffs) {
   double reflectance;
 
-  double len = dot_prod(normal, normal);
-  if (abs(len - 1.0) > 1.0e-4){
-    std::cerr << "Error: Expecting unit normal in the reflectance computation, in "
-              << __FILE__ << " at line " << __LINE__ << std::endl;
-    exit(1);
-  }
-
-  //compute /mu_0 = cosine of the angle between the light direction and the surface normal.
-  //sun coordinates relative to the xyz point on the Moon surface
-  //Vector3 sunDirection = -normalize(sunPos-xyz);
-  Vector3 sunDirection = normalize(sunPos-xyz);
-  double mu_0 = dot_prod(sunDirection, normal);
-
-  //double tol = 0.3;
-  //if (mu_0 < tol){
-  //  // Sun is too low, reflectance is too close to 0, the albedo will be inaccurate
-  //  return 0.0;
-  // }
-
-  //compute  /mu = cosine of the angle between the viewer direction and the surface normal.
-  //viewer coordinates relative to the xyz point on the Moon surface
-  Vector3 viewDirection = normalize(viewPos-xyz);
-  double mu = dot_prod(viewDirection,normal);
+  // mu_0 and mu are the cosines of the angles between the normal and the
+  // directions to the sun and viewer. Alpha is the phase angle.
+  double mu_0, mu, cos_alpha;
+  reflectanceCosines(sunPos, viewPos, xyz, normal, mu_0, mu, cos_alpha);
 
-  //compute the phase angle (alpha) between the viewing direction and the light source direction
   double deg_alpha;
-  double cos_alpha;
-
-  cos_alpha = dot_prod(sunDirection,viewDirection);
   if ((cos_alpha > 1)||(cos_alpha< -1)){
     printf("cos_alpha error\n");
   }
@@ -1560,12 +1806,12 @@ double computeArbitraryLambertianReflectanceFromNormal(Vector3 const& sunPos,
   double F2 = reflectance_model_coeffs[14]; 
   double G2 = reflectance_model_coeffs[15]; 
   
-  double L1 = O1 + A1*deg_alpha + B1*deg_alpha*deg_alpha + C1*deg_alpha*deg_alpha*deg_alpha;
-  double K1 = D1 + E1*deg_alpha + F1*deg_alpha*deg_alpha + G1*deg_alpha*deg_alpha*deg_alpha;
+  double L1 = O1 + deg_alpha*(A1 + deg_alpha*(B1 + deg_alpha*C1));
+  double K1 = D1 + deg_alpha*(E1 + deg_alpha*(F1 + deg_alpha*G1));
   if (K1 == 0) K1 = 1;
     
-  double L2 = O2 + A2*deg_alpha + B2*deg_alpha*deg_alpha + C2*deg_alpha*deg_alpha*deg_alpha;
-  double K2 = D2 + E2*deg_alpha + F2*deg_alpha*deg_alpha + G2*deg_alpha*deg_alpha*deg_alpha;
+  double L2 = O2 + deg_alpha*(A2 + deg_alpha*(B2 + deg_alpha*C2));
+  double K2 = D2 + deg_alpha*(E2 + deg_alpha*(F2 + deg_alpha*G2));
   if (K2 == 0) K2 = 1;
   
   //printf(" deg_alpha = %f, L = %f\n", deg_alpha, L);
@@ -1982,6 +2228,7 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
                                     BBox2i       const & crop_box,
                                     MaskedImgT   const & image,
                                     DoubleImgT   const & blend_weight,
+                                    ImageView<float> const & shadow_mask,
                                     CameraModel  const * camera,
                                     double       const * scaled_sun_posn,
                                     PixelMask<double>  & reflectance,
@@ -2117,9 +2364,14 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   }
 
   if (model_shadows) {
-    bool inShadow = asp::isInShadow(col, row, local_model_params.sunPosition,
-                                    dem, max_dem_height, gridx, gridy,
-                                    geo);
+    // Use the precomputed shadows, if available
+    bool inShadow = false;
+    if (shadow_mask.cols() == dem.cols() && shadow_mask.rows() == dem.rows())
+      inShadow = (shadow_mask(col, row) > 0);
+    else
+      inShadow = asp::isInShadow(col, row, local_model_params.sunPosition,
+                                 dem, max_dem_height, gridx, gridy,
+                                 geo);
 
     if (inShadow) {
       // The reflectance is valid, it is just zero
@@ -2190,6 +2442,7 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
                                     BBox2i const& crop_box,
                                     MaskedImgT const  & image,
                                     DoubleImgT const  & blend_weight,
+                                    ImageView<float> const & shadow_mask,
                                     CameraModel const * camera,
                                     double     const  * scaled_sun_posn,
                                     ImageView<PixelMask<double>> & reflectance,
@@ -2242,7 +2495,7 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
                                      model_shadows, max_dem_height,
                                      gridx, gridy,
                                      model_params, global_params,
-                                     crop_box, image, blend_weight, camera,
+                                     crop_box, image, blend_weight, shadow_mask, camera,
                                      scaled_sun_posn, 
                                      reflectance(col, row), intensity(col, row),
                                      ground_weight(col, row),
@@ -2355,6 +2608,7 @@ std::vector<ModelParams>               const * g_model_params = NULL;
 std::vector<std::vector<BBox2i>>       const * g_crop_boxes = NULL;
 std::vector<std::vector<MaskedImgT>>   const * g_masked_images = NULL;
 std::vector<std::vector<DoubleImgT>>   const * g_blend_weights = NULL;
+std::vector<std::vector<ImageView<float>>>   * g_shadow_masks = NULL;
 std::vector<std::vector<boost::shared_ptr<CameraModel>> > * g_cameras = NULL;
 double                                       * g_dem_nodata_val = NULL;
 float                                        * g_img_nodata_val = NULL;
@@ -2376,6 +2630,97 @@ double                                       * g_reflectance_model_coeffs = NULL
 // 1 meter than by a tiny fraction of one millimeter).
 double g_position_scale_factor = 1e+6;
 
+// The name of a file in which to cache a quantity for an image and DEM clip
+std::string cache_file_name(Options const& opt, int dem_iter, int image_iter,
+                            std::string const& suffix) {
+  return opt.cache_dir + "/" + fs::path(opt.input_images[image_iter]).stem().string()
+    + "-clip" + vw::num_to_str(dem_iter) + "-" + suffix + ".cache";
+}
+
+// Find which DEM grid points are in shadow, for each image. If
+// use_cache is true, and there is a cache directory, use the shadows
+// saved there if they were found for the same DEM and sun position,
+// and save them if not.
+void computeShadowMasks(Options const& opt,
+                        std::vector<ImageView<double>> const& dems,
+                        std::vector<GeoReference> const& geos,
+                        std::vector<ModelParams> const& model_params,
+                        std::vector<double> const& scaled_sun_posns,
+                        double gridx, double gridy, bool use_cache,
+                        std::vector<std::vector<ImageView<float>>> & shadow_masks) {
+
+  use_cache = use_cache && !opt.cache_dir.empty();
+  int num_images = opt.input_images.size();
+  for (size_t dem_iter = 0; dem_iter < dems.size(); dem_iter++) {
+
+    std::uint64_t dem_key = 0;
+    if (use_cache) {
+      ImageView<double> const& dem = dems[dem_iter]; // alias
+      std::ostringstream os;
+      os.precision(17);
+      os << geos[dem_iter];
+      std::string geo_str = os.str();
+      dem_key = asp::hashBytes(0, geo_str.data(), geo_str.size());
+      dem_key = asp::hashBytes(dem_key, dem.data(),
+                               sizeof(double) * dem.cols() * dem.rows());
+    }
+
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+        continue;
+
+      Vector3 sun_pos;
+      for (int it = 0; it < 3; it++)
+        sun_pos[it] = scaled_sun_posns[3*image_iter + it]
+          * model_params[image_iter].sunPosition[it];
+
+      std::string cache_file;
+      std::uint64_t key = 0;
+      if (use_cache) {
+        cache_file = cache_file_name(opt, dem_iter, image_iter, "shadows");
+        key = asp::hashBytes(dem_key, &sun_pos[0], 3 * sizeof(double));
+        ImageView<double> cached;
+        if (asp::readCachedImage(cache_file, key, cached)) {
+          vw_out() << "Read cached shadows: " << cache_file << "\n";
+          shadow_masks[dem_iter][image_iter] = pixel_cast<float>(cached);
+          continue;
+        }
+      }
+
+      asp::areInShadow(sun_pos, dems[dem_iter], gridx, gridy, geos[dem_iter],
+                       shadow_masks[dem_iter][image_iter]);
+
+      if (use_cache) {
+        vw_out() << "Writing: " << cache_file << "\n";
+        asp::writeCachedImage(cache_file, key,
+                              copy(pixel_cast<double>(shadow_masks[dem_iter][image_iter])));
+      }
+    }
+  }
+}
+
+// With --compress-images, replace an in-memory image crop and its
+// blending weights with compact stores of float16 blocks. Return the
+// memory they use, in bytes.
+std::size_t compressImage(Options const& opt, MaskedImgT & image, DoubleImgT & weight) {
+
+  if (!opt.compress_images)
+    return 0;
+
+  std::size_t size = 0;
+  if (image.cols() > 0 && image.rows() > 0) {
+    asp::PagedImageView<PixelMask<float>> paged = asp::paged_masked_image(image);
+    size += paged.store()->memory_usage();
+    image = paged;
+  }
+  if (weight.cols() > 0 && weight.rows() > 0) {
+    asp::PagedImageView<double> paged = asp::paged_image<double>(weight);
+    size += paged.store()->memory_usage();
+    weight = paged;
+  }
+  return size;
+}
+
 class SfsCallback: public ceres::IterationCallback {
 public:
   virtual ceres::CallbackReturnType operator()
@@ -2386,6 +2731,12 @@ public:
     vw_out() << "Finished iteration: " << g_iter << std::endl;
     // callTop();
 
+    // Update the shadows for the new DEM
+    if (g_opt->model_shadows && g_opt->precompute_shadows && !g_opt->use_gpu_solver &&
+        !g_final_iter)
+      computeShadowMasks(*g_opt, *g_dem, *g_geo, *g_model_params, *g_scaled_sun_posns,
+                         *g_gridx, *g_gridy, false, *g_shadow_masks);
+
     if (!g_opt->save_computed_intensity_only)
       save_exposures(g_opt->out_prefix, g_opt->input_images, *g_exposures);
 
@@ -2484,9 +2835,14 @@ public:
         fill(dem_nodata, *g_dem_nodata_val);
       }
         
+      // With --save-sparingly, still save the DEM and albedo every
+      // --checkpoint-every iterations, to be able to resume from them
+      bool checkpoint = (g_opt->checkpoint_every > 0 && g_iter % g_opt->checkpoint_every == 0);
+
       bool has_georef = true, has_nodata = true;
       TerminalProgressCallback tpc("asp", ": ");
-      if ( (!g_opt->save_sparingly || g_final_iter) && !g_opt->save_computed_intensity_only ) {
+      if ( (!g_opt->save_sparingly || g_final_iter || checkpoint) &&
+           !g_opt->save_computed_intensity_only ) {
         std::string out_dem_file = g_opt->out_prefix + "-DEM"
           + iter_str + ".tif";
         vw_out() << "Writing: " << out_dem_file << std::endl;
@@ -2495,7 +2851,7 @@ public:
                                *g_opt, tpc);
       }
       
-      if ((!g_opt->save_sparingly || (g_final_iter && g_opt->float_albedo)) &&
+      if ((!g_opt->save_sparingly || ((g_final_iter || checkpoint) && g_opt->float_albedo)) &&
           !g_opt->save_computed_intensity_only ) {
         std::string out_albedo_file = g_opt->out_prefix + "-comp-albedo"
           + iter_str + ".tif";
@@ -2568,6 +2924,7 @@ public:
                                        (*g_crop_boxes)[dem_iter][image_iter],
                                        (*g_masked_images)[dem_iter][image_iter],
                                        (*g_blend_weights)[dem_iter][image_iter],
+                                       (*g_shadow_masks)[dem_iter][image_iter],
                                        (*g_cameras)[dem_iter][image_iter].get(),
                                        &(*g_scaled_sun_posns)[3*image_iter],
                                        reflectance, intensity, ground_weight, 
@@ -2717,6 +3074,7 @@ calc_intensity_residual(const F* const exposure,
                         BBox2i                                    m_crop_box,
                         MaskedImgT                        const & m_image,          // alias
                         DoubleImgT                        const & m_blend_weight,   // alias
+                        ImageView<float>                  const & m_shadow_mask,    // alias
                         boost::shared_ptr<CameraModel>    const & m_camera,         // alias
                         F* residuals) {
   
@@ -2781,7 +3139,7 @@ calc_intensity_residual(const F* const exposure,
                                      m_model_shadows, m_max_dem_height,
                                      m_gridx, m_gridy,
                                      m_model_params,  m_global_params,
-                                     m_crop_box, m_image, m_blend_weight, camera,
+                                     m_crop_box, m_image, m_blend_weight, m_shadow_mask, camera,
                                      scaled_sun_posn,
                                      reflectance, intensity, ground_weight, reflectance_model_coeffs);
       
@@ -2826,6 +3184,7 @@ struct IntensityError {
                  BBox2i const& crop_box,
                  MaskedImgT const& image,
                  DoubleImgT const& blend_weight,
+                 ImageView<float> const& shadow_mask,
                  double * scaled_sun_posn, 
                  boost::shared_ptr<CameraModel> const& camera):
     m_col(col), m_row(row), m_dem(dem), m_geo(geo),
@@ -2837,6 +3196,7 @@ struct IntensityError {
     m_model_params(model_params),
     m_crop_box(crop_box),
     m_image(image), m_blend_weight(blend_weight),
+    m_shadow_mask(shadow_mask),
     m_scaled_sun_posn(scaled_sun_posn),
     m_camera(camera) {}
 
@@ -2878,6 +3238,7 @@ struct IntensityError {
                                    m_crop_box,  
                                    m_image,           // alias
                                    m_blend_weight,    // alias
+                                   m_shadow_mask,     // alias
                                    m_camera,          // alias
                                    residuals);
   }
@@ -2896,6 +3257,7 @@ struct IntensityError {
                                      BBox2i const& crop_box,
                                      MaskedImgT const& image,
                                      DoubleImgT const& blend_weight,
+                                     ImageView<float> const& shadow_mask,
                                      double * scaled_sun_posn, 
                                      boost::shared_ptr<CameraModel> const& camera){
     return (new ceres::NumericDiffCostFunction<IntensityError,
@@ -2906,7 +3268,7 @@ struct IntensityError {
                                 max_dem_height,
                                 gridx, gridy,
                                 global_params, model_params,
-                                crop_box, image, blend_weight, scaled_sun_posn, camera)));
+                                crop_box, image, blend_weight, shadow_mask, scaled_sun_posn, camera)));
   }
 
   int m_col, m_row;
@@ -2921,6 +3283,7 @@ struct IntensityError {
   BBox2i                                    m_crop_box;
   MaskedImgT                        const & m_image;          // alias
   DoubleImgT                        const & m_blend_weight;   // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
   double                                  * m_scaled_sun_posn;   //  pointer
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
 };
@@ -2944,6 +3307,7 @@ struct IntensityErrorFloatDemOnly {
                              BBox2i const& crop_box,
                              MaskedImgT const& image,
                              DoubleImgT const& blend_weight,
+                             ImageView<float> const& shadow_mask,
                              double * scaled_sun_posn, 
                              boost::shared_ptr<CameraModel> const& camera):
     m_col(col), m_row(row), m_dem(dem),
@@ -2958,6 +3322,7 @@ struct IntensityErrorFloatDemOnly {
     m_model_params(model_params),
     m_crop_box(crop_box),
     m_image(image), m_blend_weight(blend_weight),
+    m_shadow_mask(shadow_mask),
     m_scaled_sun_posn(scaled_sun_posn),
     m_camera(camera) {}
 
@@ -2992,6 +3357,7 @@ struct IntensityErrorFloatDemOnly {
                                    m_crop_box,  
                                    m_image,           // alias
                                    m_blend_weight,    // alias
+                                   m_shadow_mask,     // alias
                                    m_camera,          // alias
                                    residuals);
   }
@@ -3015,6 +3381,7 @@ struct IntensityErrorFloatDemOnly {
                                      BBox2i const& crop_box,
                                      MaskedImgT const& image,
                                      DoubleImgT const& blend_weight,
+                                     ImageView<float> const& shadow_mask,
                                      double * scaled_sun_posn, 
                                      boost::shared_ptr<CameraModel> const& camera){
     return (new ceres::NumericDiffCostFunction<IntensityErrorFloatDemOnly,
@@ -3028,7 +3395,7 @@ struct IntensityErrorFloatDemOnly {
                                             max_dem_height,
                                             gridx, gridy,
                                             global_params, model_params,
-                                            crop_box, image, blend_weight, scaled_sun_posn,
+                                            crop_box, image, blend_weight, shadow_mask, scaled_sun_posn,
                                             camera)));
   }
 
@@ -3049,6 +3416,7 @@ struct IntensityErrorFloatDemOnly {
   BBox2i                                    m_crop_box;
   MaskedImgT                        const & m_image;          // alias
   DoubleImgT                        const & m_blend_weight;   // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
   double                                  * m_scaled_sun_posn;   // pointer
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
 };
@@ -3069,6 +3437,7 @@ struct IntensityErrorFixedMost {
                           BBox2i const& crop_box,
                           MaskedImgT const& image,
                           DoubleImgT const& blend_weight,
+                          ImageView<float> const& shadow_mask,
                           boost::shared_ptr<CameraModel> const& camera):
     m_col(col), m_row(row), m_dem(dem),
     m_albedo(albedo), m_reflectance_model_coeffs(reflectance_model_coeffs), 
@@ -3081,6 +3450,7 @@ struct IntensityErrorFixedMost {
     m_model_params(model_params),
     m_crop_box(crop_box),
     m_image(image), m_blend_weight(blend_weight),
+    m_shadow_mask(shadow_mask),
     m_camera(camera) {}
 
   // See SmoothnessError() for the definitions of bottom, top, etc.
@@ -3118,6 +3488,7 @@ struct IntensityErrorFixedMost {
                                    m_crop_box,  
                                    m_image,  // alias
                                    m_blend_weight,  // alias
+                                   m_shadow_mask,   // alias
                                    m_camera,  // alias
                                    residuals);
   }
@@ -3138,6 +3509,7 @@ struct IntensityErrorFixedMost {
                                      BBox2i const& crop_box,
                                      MaskedImgT const& image,
                                      DoubleImgT const& blend_weight,
+                                     ImageView<float> const& shadow_mask,
                                      boost::shared_ptr<CameraModel> const& camera){
     return (new ceres::NumericDiffCostFunction<IntensityErrorFixedMost,
             ceres::CENTRAL, 1, 1, g_max_num_haze_coeffs, 6, 3>
@@ -3147,7 +3519,7 @@ struct IntensityErrorFixedMost {
                                          max_dem_height,
                                          gridx, gridy,
                                          global_params, model_params,
-                                         crop_box, image, blend_weight, camera)));
+                                         crop_box, image, blend_weight, shadow_mask, camera)));
   }
 
   int m_col, m_row;
@@ -3164,6 +3536,7 @@ struct IntensityErrorFixedMost {
   BBox2i                                    m_crop_box;
   MaskedImgT                        const & m_image;          // alias
   DoubleImgT                        const & m_blend_weight;   // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
 };
 
@@ -3182,6 +3555,7 @@ struct IntensityErrorPQ {
                    BBox2i const& crop_box,
                    MaskedImgT const& image,
                    DoubleImgT const& blend_weight,
+                   ImageView<float> const& shadow_mask,
                    boost::shared_ptr<CameraModel> const& camera):
     m_col(col), m_row(row), m_dem(dem), m_geo(geo),
     m_model_shadows(model_shadows),
@@ -3192,6 +3566,7 @@ struct IntensityErrorPQ {
     m_model_params(model_params),
     m_crop_box(crop_box),
     m_image(image), m_blend_weight(blend_weight),
+    m_shadow_mask(shadow_mask),
     m_camera(camera) {}
   
   // See SmoothnessError() for the definitions of bottom, top, etc.
@@ -3226,6 +3601,7 @@ struct IntensityErrorPQ {
                                    m_crop_box,  
                                    m_image,           // alias
                                    m_blend_weight,    // alias
+                                   m_shadow_mask,     // alias
                                    m_camera,          // alias
                                    residuals);
   }
@@ -3244,6 +3620,7 @@ struct IntensityErrorPQ {
                                      BBox2i const& crop_box,
                                      MaskedImgT const& image,
                                      DoubleImgT const& blend_weight,
+                                     ImageView<float> const& shadow_mask,
                                      boost::shared_ptr<CameraModel> const& camera){
     return (new ceres::NumericDiffCostFunction<IntensityErrorPQ,
             ceres::CENTRAL, 1, 1, g_max_num_haze_coeffs, 1, 2, 1, 6, 3, g_num_model_coeffs>
@@ -3253,7 +3630,7 @@ struct IntensityErrorPQ {
                                   max_dem_height,
                                   gridx, gridy,
                                   global_params, model_params,
-                                  crop_box, image, blend_weight, camera)));
+                                  crop_box, image, blend_weight, shadow_mask, camera)));
   }
 
   int m_col, m_row;
@@ -3268,6 +3645,7 @@ struct IntensityErrorPQ {
   BBox2i                                    m_crop_box;
   MaskedImgT                        const & m_image;          // alias
   DoubleImgT                        const & m_blend_weight;   // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
 };
 
@@ -3644,6 +4022,12 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Prefix for output filenames.")
     ("max-iterations,n", po::value(&opt.max_iterations)->default_value(10),
      "Set the maximum number of iterations.")
+    ("solver-backend", po::value(&opt.solver_backend)->default_value("auto"),
+     "The linear solver to use in the optimization. Options: auto, dense_schur, sparse_schur, iterative_schur, iterative_schur_power_series, cuda_dense_schur, cuda_sparse_schur. The default (auto) is sparse_schur. The GPU ones need Ceres built with CUDA.")
+    ("solver-mixed-precision", po::bool_switch(&opt.solver_mixed_precision)->default_value(false)->implicit_value(true),
+     "Factor the Schur complement in single precision and refine the solution in double precision. This is faster, especially on the GPU, but may need more iterations.")
+    ("use-gpu-solver", po::bool_switch(&opt.use_gpu_solver)->default_value(false)->implicit_value(true),
+     "Optimize the DEM with a matrix-free Gauss-Newton solver using conjugate gradient, with the residuals and their derivatives evaluated on the GPU, rather than with Ceres. The cameras are linearized at the start of each iteration. Works only when the DEM alone is floated, with the Lambertian, Lunar-Lambertian, or Hapke models. Uses CPU threads if ASP was built without CUDA or no device is found.")
     ("reflectance-type", po::value(&opt.reflectance_type)->default_value(1),
      "Reflectance type (0 = Lambertian, 1 = Lunar-Lambert, 2 = Hapke, 3 = Experimental extension of Lunar-Lambert, 4 = Charon model (a variation of Lunar-Lambert)).")
     ("smoothness-weight", po::value(&opt.smoothness_weight)->default_value(0.04),
@@ -3662,8 +4046,14 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Float the camera pose for each image, including the first one. Experimental. It is suggested to avoid this option.")
     ("model-shadows",   po::bool_switch(&opt.model_shadows)->default_value(false)->implicit_value(true),
      "Model the fact that some points on the DEM are in the shadow (occluded from the Sun).")
+    ("precompute-shadows",   po::bool_switch(&opt.precompute_shadows)->default_value(false)->implicit_value(true),
+     "With --model-shadows, find the points in shadow for all images at the start and after each iteration, rather than each time a residual is evaluated. This is much faster.")
+    ("cache-dir", po::value(&opt.cache_dir)->default_value(""),
+     "Save in this directory the blending weights and, with --precompute-shadows, the shadows for the input DEM, and read them in later runs with the same inputs, rather than computing them again.")
     ("compute-exposures-only",   po::bool_switch(&opt.compute_exposures_only)->default_value(false)->implicit_value(true),
      "Quit after saving the exposures. This should be done once for a big DEM, before using these for small sub-clips without recomputing them.")
+    ("robust-exposure-fit",   po::bool_switch(&opt.robust_exposure_fit)->default_value(false)->implicit_value(true),
+     "With --compute-exposures-only, find each exposure with a least squares fit of the sampled image intensities to the simulated ones, with the Cauchy loss if --robust-threshold is positive, rather than as the ratio of their means.")
 
     ("save-computed-intensity-only",   po::bool_switch(&opt.save_computed_intensity_only)->default_value(false)->implicit_value(true),
      "Save the computed (simulated) image intensities for given DEM, "
@@ -3706,14 +4096,28 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "The RPC penalty weight to use to keep the higher-order RPC coefficients small, if the RPC model approximation is used. Higher penalty weight results in smaller such coefficients.")
     ("rpc-max-error", po::value(&opt.rpc_max_error)->default_value(2),
      "Skip the current camera if the maximum error between a camera model and its RPC approximation is larger than this.")
+    ("use-camera-lookup-tables",   po::bool_switch(&opt.use_camera_lookup_tables)->default_value(false)->implicit_value(true),
+     "For each image and DEM clip, tabulate the projection of the DEM grid points into the camera, and the derivative of that with respect to the height, and interpolate in that table instead of invoking the camera. Works with any cameras. Cannot be used with --use-approx-camera-models.")
+    ("camera-lookup-spacing", po::value(&opt.camera_lookup_spacing)->default_value(8),
+     "With --use-camera-lookup-tables, start with table nodes this many DEM pixels apart. This is halved until the table error is no more than --camera-lookup-max-error.")
+    ("camera-lookup-max-error", po::value(&opt.camera_lookup_max_error)->default_value(0.01),
+     "With --use-camera-lookup-tables, the largest allowed difference, in pixels, between the table and the exact camera.")
+    ("camera-lookup-height-range", po::value(&opt.camera_lookup_height_range)->default_value(10.0),
+     "With --use-camera-lookup-tables, the table must be accurate for heights this far above and below the input DEM, in meters.")
     ("use-semi-approx",   po::bool_switch(&opt.use_semi_approx)->default_value(false)->implicit_value(true),
      "This is an undocumented experiment.")
     ("coarse-levels", po::value(&opt.coarse_levels)->default_value(0),
      "Solve the problem on a grid coarser than the original by a factor of 2 to this power, then refine the solution on finer grids. It is suggested to not use this option.")
     ("max-coarse-iterations", po::value(&opt.max_coarse_iterations)->default_value(10),
      "How many iterations to do at levels of resolution coarser than the final result.")
+    ("multigrid-cycles", po::value(&opt.multigrid_cycles)->default_value(0),
+     "With --coarse-levels and --use-gpu-solver, after going from the coarsest to the finest level, do this many multigrid V-cycles. Each restricts the DEM and the gradient to the coarser levels, solves there with the coarse grid correction, and adds the change back to the finer levels.")
+    ("multigrid-smoothing-iterations", po::value(&opt.multigrid_smoothing_iterations)->default_value(2),
+     "In a multigrid V-cycle, do this many iterations at each level other than the coarsest, both before going to the coarser level and after returning from it. At the coarsest level do --max-coarse-iterations.")
     ("crop-input-images",   po::bool_switch(&opt.crop_input_images)->default_value(false)->implicit_value(true),
      "Crop the images to a region that was computed to be large enough, and keep them fully in memory, for speed.")
+    ("compress-images",   po::bool_switch(&opt.compress_images)->default_value(false)->implicit_value(true),
+     "With --crop-input-images, keep the image crops and blending weights in memory in small blocks of float16 values, which are converted back as needed. This uses about half the memory or less, with a relative error in these values under 0.05%.")
     ("blending-dist", po::value(&opt.blending_dist)->default_value(0),
      "Give less weight to image pixels close to no-data or boundary values. Enabled only when crop-input-images is true, for performance reasons. Blend over this many pixels.")
     ("blending-power", po::value(&opt.blending_power)->default_value(2.0),
@@ -3780,6 +4184,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "smoothness weight to a very small value.")
     ("save-sparingly",   po::bool_switch(&opt.save_sparingly)->default_value(false)->implicit_value(true),
      "Avoid saving any results except the adjustments and the DEM, as that's a lot of files.")
+    ("checkpoint-every", po::value(&opt.checkpoint_every)->default_value(0),
+     "With --save-sparingly, still save the DEM, and the albedo if floated, every this "
+     "many iterations, so that a run which is killed can be resumed from them, with "
+     "--image-exposures-prefix for the exposures. Set to 0 to not save them.")
     ("camera-position-step-size", po::value(&opt.camera_position_step_size)->default_value(1.0),
      "Larger step size will result in more aggressiveness in varying the camera position if it is being floated (which may result in a better solution or in divergence).");
 
@@ -3845,6 +4253,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw( ArgumentErr() << "The number of iterations must be non-negative.\n"
               << usage << general_options );
 
+  if (opt.checkpoint_every < 0)
+    vw_throw( ArgumentErr() << "The value of --checkpoint-every must be non-negative.\n"
+              << usage << general_options );
+
   if (opt.input_images.empty())
     vw_throw( ArgumentErr() << "Missing input images.\n"
               << usage << general_options );
@@ -3869,6 +4281,17 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   if (opt.use_rpc_approximation) 
     vw_throw(ArgumentErr() << "The RPC approximation is broken.\n");
 
+  if (opt.use_camera_lookup_tables) {
+    if (opt.use_approx_camera_models)
+      vw_throw(ArgumentErr() << "Cannot use both --use-camera-lookup-tables and "
+               << "--use-approx-camera-models.\n");
+    if (opt.camera_lookup_spacing <= 0)
+      vw_throw(ArgumentErr() << "The camera lookup spacing must be positive.\n");
+    if (opt.camera_lookup_max_error <= 0.0 || opt.camera_lookup_height_range < 0.0)
+      vw_throw(ArgumentErr() << "The camera lookup max error must be positive, "
+               << "and the height range must be non-negative.\n");
+  }
+
   // When we use approximate cameras, and the cameras are fixed, use an approximation
   // for the adjusted camera rather than for the unadjusted one. This uses less memory.
   if (opt.use_approx_camera_models && !opt.float_cameras &&
@@ -3889,19 +4312,35 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 
   if (opt.steepness_factor <= 0.0) 
     vw_throw(ArgumentErr() << "The steepness factor must be positive.\n");    
+
+  if (opt.use_gpu_solver) {
+    if (opt.float_albedo || opt.float_exposure || opt.float_cameras ||
+        opt.float_all_cameras || opt.float_dem_at_boundary || opt.boundary_fix ||
+        opt.fix_dem || opt.float_reflectance_model || opt.float_haze ||
+        opt.integrability_weight > 0 || opt.curvature_in_shadow_weight > 0)
+      vw_throw(ArgumentErr() << "The option --use-gpu-solver can be used only when the "
+               << "DEM alone is floated, without the integrability constraint or "
+               << "curvature in shadow.\n");
+    if (opt.reflectance_type < 0 || opt.reflectance_type > 2)
+      vw_throw(ArgumentErr() << "The option --use-gpu-solver supports only the "
+               << "Lambertian, Lunar-Lambertian, and Hapke reflectance models.\n");
+  }
       
   if (opt.compute_exposures_only){
     if (opt.use_approx_camera_models ||
         opt.use_approx_adjusted_camera_models ||
         opt.use_rpc_approximation ||
         opt.crop_input_images ||
-        opt.use_semi_approx) {
+        opt.use_semi_approx ||
+        opt.use_camera_lookup_tables) {
       vw_out(WarningMessage) << "When computing exposures only, not using approximate "
                              << "camera models or cropping input images.\n";
       opt.use_approx_camera_models = false;
+      opt.use_camera_lookup_tables = false;
       opt.use_approx_adjusted_camera_models = false;
       opt.use_rpc_approximation = false;
       opt.crop_input_images = false;
+      opt.compress_images = false;
       opt.use_semi_approx = false;
       opt.blending_dist = 0;
       opt.allow_borderline_data = false;
@@ -3920,6 +4359,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw( ArgumentErr()
               << "Using cropped input images implies that the cameras are not floated.\n" );
 
+  if (opt.compress_images && !opt.crop_input_images)
+    vw_throw(ArgumentErr() << "Option --compress-images needs option "
+             << "--crop-input-images.\n");
+
   if (opt.allow_borderline_data && !opt.crop_input_images)
     vw_throw(ArgumentErr() << "Option --allow-borderline-data needs option "
              << "--crop-input-images.\n");
@@ -3932,8 +4375,14 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw::vw_throw(vw::ArgumentErr() << "Option --allow-borderline-data cannot be "
                  << "used with multiple coarseness levels.\n");
   
+  if (opt.precompute_shadows && !opt.model_shadows)
+    vw_out(WarningMessage) << "The option --precompute-shadows has no effect without "
+                           << "--model-shadows.\n";
+
   // Create the output directory
   vw::create_out_dir(opt.out_prefix);
+  if (!opt.cache_dir.empty())
+    fs::create_directories(opt.cache_dir);
 
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
@@ -4148,6 +4597,13 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw(ArgumentErr() << "Expecting a positive value for camera-position-step-size.\n");
   }
 
+  if (opt.multigrid_cycles < 0 || opt.multigrid_smoothing_iterations < 0)
+    vw_throw(ArgumentErr() << "The number of multigrid cycles and smoothing iterations "
+             << "must be non-negative.\n");
+  if (opt.multigrid_cycles > 0 && (!opt.use_gpu_solver || opt.coarse_levels <= 0))
+    vw_throw(ArgumentErr() << "The option --multigrid-cycles needs --use-gpu-solver "
+             << "and a positive value of --coarse-levels.\n");
+
   if (opt.coarse_levels < 0) {
     vw_throw(ArgumentErr() << "Expecting the number of levels to be non-negative.\n");
   }
@@ -4213,12 +4669,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     if (opt.use_approx_camera_models ||
         opt.use_approx_adjusted_camera_models ||
         opt.use_rpc_approximation ||
-        opt.crop_input_images) {
+        opt.crop_input_images ||
+        opt.use_camera_lookup_tables) {
       vw_out(WarningMessage) << "Not using approximate camera models or cropping input images.\n";
       opt.use_approx_camera_models = false;
+      opt.use_camera_lookup_tables = false;
       opt.use_approx_adjusted_camera_models = false;
       opt.use_rpc_approximation = false;
       opt.crop_input_images = false;
+      opt.compress_images = false;
       opt.use_semi_approx = false;
     }
     
@@ -4234,6 +4693,391 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   
 }
 
+// The matrix-free solver of --use-gpu-solver, for the DEM clips at one
+// coarseness level. Only the DEM heights are optimized. Before each
+// iteration the cameras are linearized at the current heights: for each
+// DEM pixel and image, find the projection into the image crop, its
+// derivative with respect to the height, the camera center, the blending
+// weight, and if in shadow. The residuals are then evaluated in bulk, on
+// the GPU if available. The data that does not change between iterations,
+// and the solver state, are kept, so multigrid can return to a level
+// cheaply. Each DEM clip is solved on its own. The results are saved
+// after each iteration only if there is one clip.
+class MatrixFreeSfs {
+public:
+
+  // Set the inputs at this level. They must stay valid while this is used.
+  void setInputs(Options const& opt, std::vector<GeoReference> const& geo,
+                 double smoothness_weight, double gridx, double gridy,
+                 std::vector<std::vector<BBox2i>>     const& crop_boxes,
+                 std::vector<std::vector<MaskedImgT>> const& masked_images,
+                 std::vector<std::vector<DoubleImgT>> const& blend_weights,
+                 GlobalParams const& global_params,
+                 std::vector<ModelParams> const& model_params,
+                 std::vector<ImageView<double>> const& orig_dems,
+                 std::vector<ImageView<double>> const& albedos,
+                 std::vector<std::vector<boost::shared_ptr<CameraModel>>> const& cameras,
+                 std::vector<double> const& exposures,
+                 std::vector<std::vector<double>> const& haze,
+                 std::vector<double> const& scaled_sun_posns,
+                 std::vector<double> const& reflectance_model_coeffs,
+                 std::vector<ImageView<double>> & dems) {
+    m_opt = &opt; m_geo = &geo;
+    m_smoothness_weight = smoothness_weight; m_gridx = gridx; m_gridy = gridy;
+    m_crop_boxes = &crop_boxes; m_masked_images = &masked_images;
+    m_blend_weights = &blend_weights; m_global_params = &global_params;
+    m_model_params = &model_params; m_orig_dems = &orig_dems; m_albedos = &albedos;
+    m_cameras = &cameras; m_exposures = &exposures; m_haze = &haze;
+    m_scaled_sun_posns = &scaled_sun_posns;
+    m_reflectance_model_coeffs = &reflectance_model_coeffs;
+    m_dems = &dems;
+    m_clips.resize(dems.size());
+  }
+
+  // Do the given number of iterations for each clip. If not NULL, the
+  // linear terms, one per clip, are the multigrid coarse grid corrections.
+  void solve(int num_iterations, std::vector<ImageView<double>> const* linear_terms,
+             SfsCallback & callback) {
+
+    int num_dems = m_dems->size();
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      ImageView<double> & dem = (*m_dems)[dem_iter]; // alias
+      if (dem.cols() < 3 || dem.rows() < 3)
+        continue;
+      setUpClip(dem_iter);
+      auto linearize = [&](asp::cuda::SfsGpuProblem & prob) {
+        this->linearize(dem_iter, linear_terms, prob);
+      };
+      auto iteration_done = [&]() {
+        if (num_dems == 1) {
+          ceres::IterationSummary summary;
+          callback(summary);
+        }
+      };
+      vw_out() << "Optimizing clip " << dem_iter << " with the matrix-free solver.\n";
+      m_clips[dem_iter].solver->solve(num_iterations, &dem(0, 0), linearize, iteration_done);
+    }
+  }
+
+  // The gradient of the cost for each clip at the current heights. It is
+  // zero at the boundary, which is fixed.
+  void gradient(std::vector<ImageView<double>> const* linear_terms,
+                std::vector<ImageView<double>> & grads) {
+    int num_dems = m_dems->size();
+    grads.resize(num_dems);
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      ImageView<double> const& dem = (*m_dems)[dem_iter]; // alias
+      grads[dem_iter].set_size(dem.cols(), dem.rows());
+      fill(grads[dem_iter], 0.0);
+      if (dem.cols() < 3 || dem.rows() < 3)
+        continue;
+      setUpClip(dem_iter);
+      auto linearize = [&](asp::cuda::SfsGpuProblem & prob) {
+        this->linearize(dem_iter, linear_terms, prob);
+      };
+      m_clips[dem_iter].solver->gradient(linearize, &grads[dem_iter](0, 0));
+    }
+  }
+
+  // The cost for a clip at the current heights
+  double cost(int dem_iter, std::vector<ImageView<double>> const* linear_terms) {
+    setUpClip(dem_iter);
+    auto linearize = [&](asp::cuda::SfsGpuProblem & prob) {
+      this->linearize(dem_iter, linear_terms, prob);
+    };
+    return m_clips[dem_iter].solver->cost(linearize);
+  }
+
+private:
+
+  struct Clip {
+    std::vector<double> xyz0, up;
+    std::vector<int> image_ids;
+    std::vector<asp::cuda::SfsGpuImage> images;
+    std::vector<std::vector<float>> vals, lin;
+    std::vector<std::vector<std::uint8_t>> shadows;
+    std::vector<ImageView<float>> shadow_masks;
+    boost::shared_ptr<asp::SfsMatrixFreeSolver> solver;
+  };
+
+  // Find the data for a clip which does not change between iterations
+  void setUpClip(int dem_iter) {
+
+    using namespace asp::cuda;
+
+    Clip & clip = m_clips[dem_iter]; // alias
+    if (clip.solver)
+      return;
+
+    Options const& opt = *m_opt; // alias
+    ImageView<double> const& dem = (*m_dems)[dem_iter]; // alias
+    GeoReference const& geo = (*m_geo)[dem_iter]; // alias
+    int cols = dem.cols(), rows = dem.rows();
+    std::size_t num = std::size_t(cols) * rows;
+
+    // The DEM points are xyz0 + height * up
+    clip.xyz0.resize(3 * num);
+    clip.up.resize(3 * num);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
+        Vector3 p0 = geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], 0));
+        Vector3 p1 = geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], 1));
+        std::size_t idx = std::size_t(row) * cols + col;
+        for (int c = 0; c < 3; c++) {
+          clip.xyz0[3 * idx + c] = p0[c];
+          clip.up  [3 * idx + c] = p1[c] - p0[c];
+        }
+      }
+    }
+
+    // The images used with this clip, with the invalid pixels set to NaN
+    int num_images = opt.input_images.size();
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) == opt.skip_images[dem_iter].end() &&
+          !(*m_crop_boxes)[dem_iter][image_iter].empty())
+        clip.image_ids.push_back(image_iter);
+    }
+    int num_used = clip.image_ids.size();
+    clip.images.resize(num_used);
+    clip.vals.resize(num_used);
+    clip.lin.resize(num_used);
+    clip.shadows.resize(num_used);
+    clip.shadow_masks.resize(num_used);
+    for (int k = 0; k < num_used; k++) {
+      int image_iter = clip.image_ids[k];
+      ImageView<PixelMask<float>> img = (*m_masked_images)[dem_iter][image_iter];
+      clip.vals[k].resize(std::size_t(img.cols()) * img.rows());
+      for (int row = 0; row < img.rows(); row++) {
+        for (int col = 0; col < img.cols(); col++)
+          clip.vals[k][std::size_t(row) * img.cols() + col]
+            = is_valid(img(col, row)) ? img(col, row).child()
+            : std::numeric_limits<float>::quiet_NaN();
+      }
+      clip.lin[k].resize(SFS_GPU_LIN_SIZE * num);
+      if (opt.model_shadows)
+        clip.shadows[k].resize(num);
+
+      SfsGpuImage & gimg = clip.images[k]; // alias
+      gimg.cols = img.cols();
+      gimg.rows = img.rows();
+      gimg.vals = &clip.vals[k][0];
+      gimg.lin  = &clip.lin[k][0];
+      gimg.shadow = opt.model_shadows ? &clip.shadows[k][0] : NULL;
+      for (int c = 0; c < 3; c++)
+        gimg.sun[c] = (*m_scaled_sun_posns)[3*image_iter + c]
+          * (*m_model_params)[image_iter].sunPosition[c];
+      gimg.exposure = (*m_exposures)[image_iter];
+      std::vector<double> const& haze = (*m_haze)[image_iter]; // alias
+      for (int c = 0; c < SFS_GPU_NUM_HAZE_COEFFS; c++)
+        gimg.haze[c] = (c < int(haze.size())) ? haze[c] : 0.0;
+
+      // The camera centers are stored relative to this one, in single precision
+      Vector3 cam_ref;
+      if (m_global_params->reflectanceType != LAMBERT) {
+        try {
+          cam_ref = (*m_cameras)[dem_iter][image_iter]->camera_center
+            ((*m_crop_boxes)[dem_iter][image_iter].min());
+        } catch (...) {}
+      }
+      for (int c = 0; c < 3; c++)
+        gimg.cam_ref[c] = cam_ref[c];
+    }
+
+    clip.solver.reset(new asp::SfsMatrixFreeSolver(opt.use_gpu_solver, opt.num_threads));
+  }
+
+  // Linearize the cameras for a clip at the current heights, and fill in the problem
+  void linearize(int dem_iter, std::vector<ImageView<double>> const* linear_terms,
+                 asp::cuda::SfsGpuProblem & prob) {
+
+    using namespace asp::cuda;
+
+    Options const& opt = *m_opt; // alias
+    Clip & clip = m_clips[dem_iter]; // alias
+    ImageView<double> & dem = (*m_dems)[dem_iter]; // alias
+    int cols = dem.cols(), rows = dem.rows();
+    int num_used = clip.image_ids.size();
+    bool lambert = (m_global_params->reflectanceType == LAMBERT);
+
+    // The shadows at the current heights
+    if (opt.model_shadows) {
+      for (int k = 0; k < num_used; k++) {
+        Vector3 sun_pos(clip.images[k].sun[0], clip.images[k].sun[1], clip.images[k].sun[2]);
+        asp::areInShadow(sun_pos, dem, m_gridx, m_gridy, (*m_geo)[dem_iter],
+                         clip.shadow_masks[k]);
+        for (int row = 0; row < rows; row++) {
+          for (int col = 0; col < cols; col++)
+            clip.shadows[k][std::size_t(row) * cols + col] = (clip.shadow_masks[k](col, row) > 0);
+        }
+      }
+    }
+
+    int num_threads = std::max(1, opt.num_threads);
+    std::atomic<int> next_row(0);
+    std::vector<std::exception_ptr> errors(num_threads);
+    auto process_rows = [&](int thread_id) {
+      try {
+        for (int row = next_row++; row < rows; row = next_row++) {
+          for (int k = 0; k < num_used; k++) {
+            int image_iter = clip.image_ids[k];
+            CameraModel const* camera = (*m_cameras)[dem_iter][image_iter].get();
+            BBox2i const& crop_box = (*m_crop_boxes)[dem_iter][image_iter]; // alias
+            DoubleImgT const& blend_weight = (*m_blend_weights)[dem_iter][image_iter]; // alias
+            for (int col = 0; col < cols; col++) {
+              std::size_t idx = std::size_t(row) * cols + col;
+              float * l = &clip.lin[k][SFS_GPU_LIN_SIZE * idx];
+              for (int c = 0; c < SFS_GPU_LIN_SIZE; c++)
+                l[c] = 0.0;
+
+              // The projection and its derivative, with central differences
+              // over one meter
+              Vector3 xyz, dir;
+              for (int c = 0; c < 3; c++) {
+                dir[c] = clip.up[3 * idx + c];
+                xyz[c] = clip.xyz0[3 * idx + c] + dem(col, row) * dir[c];
+              }
+              Vector2 pix, dpix;
+              Vector3 cam_ctr;
+              try {
+                pix = camera->point_to_pixel(xyz);
+                dpix = camera->point_to_pixel(xyz + 0.5 * dir)
+                  - camera->point_to_pixel(xyz - 0.5 * dir);
+                if (!lambert)
+                  cam_ctr = camera->camera_center(pix);
+              } catch (...) {
+                continue;
+              }
+              pix -= crop_box.min();
+              if (pix[0] < 0 || pix[0] >= clip.images[k].cols - 1 ||
+                  pix[1] < 0 || pix[1] >= clip.images[k].rows - 1)
+                continue;
+
+              // The blending weight, as in computeReflectanceAndIntensity()
+              double weight = 1.0;
+              if (g_blend_weight_is_ground_weight) {
+                weight = blend_weight(col, row);
+              } else if (blend_weight.cols() > 0 && blend_weight.rows() > 0) {
+                int ix = int(pix[0]), iy = int(pix[1]);
+                double fx = pix[0] - ix, fy = pix[1] - iy;
+                weight = (1 - fx) * (1 - fy) * blend_weight(ix, iy)
+                  + fx * (1 - fy) * blend_weight(ix + 1, iy)
+                  + (1 - fx) * fy * blend_weight(ix, iy + 1)
+                  + fx * fy * blend_weight(ix + 1, iy + 1);
+              }
+
+              l[0] = pix[0];
+              l[1] = pix[1];
+              l[2] = dpix[0];
+              l[3] = dpix[1];
+              if (!lambert) {
+                for (int c = 0; c < 3; c++)
+                  l[4 + c] = cam_ctr[c] - clip.images[k].cam_ref[c];
+              }
+              l[7] = weight;
+            }
+          }
+        }
+      } catch (...) {
+        errors[thread_id] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int it = 0; it < num_threads; it++)
+      threads.push_back(std::thread(process_rows, it));
+    for (size_t it = 0; it < threads.size(); it++)
+      threads[it].join();
+    for (int it = 0; it < num_threads; it++) {
+      if (errors[it])
+        std::rethrow_exception(errors[it]);
+    }
+
+    SfsGpuParams & p = prob.params; // alias
+    p.cols = cols;
+    p.rows = rows;
+    p.reflectance_type = m_global_params->reflectanceType;
+    for (int c = 0; c < SFS_GPU_NUM_MODEL_COEFFS; c++)
+      p.model_coeffs[c] = (c < int(m_reflectance_model_coeffs->size())) ?
+        (*m_reflectance_model_coeffs)[c] : 0.0;
+    p.phase_coeff_c1 = m_global_params->phaseCoeffC1;
+    p.phase_coeff_c2 = m_global_params->phaseCoeffC2;
+    p.num_haze_coeffs = opt.num_haze_coeffs;
+    p.steepness_factor = opt.steepness_factor;
+    p.gridx = m_gridx;
+    p.gridy = m_gridy;
+    p.smoothness_weight = m_smoothness_weight;
+    p.gradient_weight = opt.gradient_weight;
+    p.initial_dem_constraint_weight = std::max(opt.initial_dem_constraint_weight, 0.0);
+    p.robust_threshold = opt.robust_threshold;
+    p.unreliable_intensity_threshold = opt.unreliable_intensity_threshold;
+    p.max_cg_iterations = 100;
+    p.cg_tolerance = 1.0e-3;
+
+    prob.heights      = &dem(0, 0);
+    prob.orig_heights = &(*m_orig_dems)[dem_iter](0, 0);
+    prob.linear_term  = (linear_terms != NULL) ? &(*linear_terms)[dem_iter](0, 0) : NULL;
+    prob.albedo       = &(*m_albedos)[dem_iter](0, 0);
+    prob.xyz0         = &clip.xyz0[0];
+    prob.up           = &clip.up[0];
+    prob.num_images   = num_used;
+    prob.images       = clip.images.empty() ? NULL : &clip.images[0];
+  }
+
+  Options                                         const * m_opt = NULL;
+  std::vector<GeoReference>                       const * m_geo = NULL;
+  double m_smoothness_weight = 0.0, m_gridx = 0.0, m_gridy = 0.0;
+  std::vector<std::vector<BBox2i>>                const * m_crop_boxes = NULL;
+  std::vector<std::vector<MaskedImgT>>            const * m_masked_images = NULL;
+  std::vector<std::vector<DoubleImgT>>            const * m_blend_weights = NULL;
+  GlobalParams                                    const * m_global_params = NULL;
+  std::vector<ModelParams>                        const * m_model_params = NULL;
+  std::vector<ImageView<double>>                  const * m_orig_dems = NULL;
+  std::vector<ImageView<double>>                  const * m_albedos = NULL;
+  std::vector<std::vector<boost::shared_ptr<CameraModel>>> const * m_cameras = NULL;
+  std::vector<double>                             const * m_exposures = NULL;
+  std::vector<std::vector<double>>                const * m_haze = NULL;
+  std::vector<double>                             const * m_scaled_sun_posns = NULL;
+  std::vector<double>                             const * m_reflectance_model_coeffs = NULL;
+  std::vector<ImageView<double>>                        * m_dems = NULL;
+  std::vector<Clip> m_clips;
+};
+
+// Tell the solver to eliminate first the heights at every third grid point
+// in each direction. No residual involves two grid points more than two
+// pixels apart, so these form an independent set. The grid is the same for
+// each DEM clip and each tile, so this is found from it, rather than by the
+// solver searching the graph of the problem, which is slow for large grids.
+void setGridSolverOrdering(std::vector<ImageView<double>> & dems,
+                           ceres::Problem & problem,
+                           ceres::Solver::Options & options) {
+
+  std::vector<double*> blocks;
+  problem.GetParameterBlocks(&blocks);
+
+  auto ordering = std::make_shared<ceres::ParameterBlockOrdering>();
+  size_t num_eliminated = 0;
+  for (size_t it = 0; it < blocks.size(); it++) {
+    int group = 1;
+    for (size_t dem_iter = 0; dem_iter < dems.size(); dem_iter++) {
+      int cols = dems[dem_iter].cols();
+      std::ptrdiff_t offset = blocks[it] - dems[dem_iter].data();
+      if (offset < 0 || offset >= std::ptrdiff_t(cols) * dems[dem_iter].rows())
+        continue;
+      if ((offset % cols) % 3 == 1 && (offset / cols) % 3 == 1)
+        group = 0;
+      break;
+    }
+    if (group == 0)
+      num_eliminated++;
+    ordering->AddElementToGroup(blocks[it], group);
+  }
+
+  // Let the solver decide if there is nothing to eliminate or keep
+  if (num_eliminated == 0 || num_eliminated == blocks.size())
+    return;
+  options.linear_solver_ordering = ordering;
+}
+
 // Run sfs at a given coarseness level
 void run_sfs_level(// Fixed inputs
                    int num_iterations, Options & opt,
@@ -4257,7 +5101,10 @@ void run_sfs_level(// Fixed inputs
                    std::vector< std::vector<double>> & haze,
                    std::vector<double> & scaled_sun_posns,
                    std::vector<double> & adjustments,
-                   std::vector<double> & reflectance_model_coeffs){
+                   std::vector<double> & reflectance_model_coeffs,
+                   // Used with --use-gpu-solver
+                   MatrixFreeSfs & matrix_free,
+                   std::vector<ImageView<double>> const* linear_terms){
 
   int num_images = opt.input_images.size();
   int num_dems   = dems.size();
@@ -4290,6 +5137,16 @@ void run_sfs_level(// Fixed inputs
   }
   g_max_dem_height = &max_dem_height;
 
+  // Find the shadows once, rather than each time a residual is evaluated.
+  // They are updated after each iteration. The matrix-free solver finds
+  // them itself.
+  std::vector<std::vector<ImageView<float>>>
+    shadow_masks(num_dems, std::vector<ImageView<float>>(num_images));
+  if (opt.model_shadows && opt.precompute_shadows && !opt.use_gpu_solver)
+    computeShadowMasks(opt, dems, geo, model_params, scaled_sun_posns, gridx, gridy,
+                       true, shadow_masks);
+  g_shadow_masks = &shadow_masks;
+
   // See if a given image is used in at least one clip or skipped in
   // all of them
   std::vector<bool> use_image(num_images, false);
@@ -4325,6 +5182,36 @@ void run_sfs_level(// Fixed inputs
     }
   }
 
+  // A bunch of global variables to use in the callback
+  g_dem            = &dems;
+  g_pq             = &pq;
+  g_albedo         = &albedos;
+  g_geo            = &geo;
+  g_global_params  = &global_params;
+  g_model_params   = &model_params;
+  g_crop_boxes     = &crop_boxes;
+  g_masked_images  = &masked_images;
+  g_blend_weights  = &blend_weights;
+  g_cameras        = &cameras;
+  g_iter           = -1; // reset the iterations for each level
+  g_final_iter     = false;
+
+  SfsCallback callback;
+
+  if (opt.use_gpu_solver) {
+    matrix_free.setInputs(opt, geo, smoothness_weight, gridx, gridy,
+                          crop_boxes, masked_images, blend_weights, global_params,
+                          model_params, orig_dems, albedos, cameras, exposures, haze,
+                          scaled_sun_posns, reflectance_model_coeffs, dems);
+    matrix_free.solve(num_iterations, linear_terms, callback);
+
+    // Save the final results
+    g_final_iter = true;
+    ceres::IterationSummary callback_summary;
+    callback(callback_summary);
+    return;
+  }
+
   // Use a simpler cost function if only the DEM is floated. Not sure how much
   // of speedup that gives.
   bool float_dem_only = true;
@@ -4336,6 +5223,21 @@ void run_sfs_level(// Fixed inputs
   }
   
   std::set<int> use_dem, use_albedo; // to avoid a crash in Ceres when a param is fixed but not set
+
+  // These terms do not depend on the grid point, so each is created once
+  // and shared by all residual blocks. The problem deletes each one once.
+  ceres::CostFunction* cost_function_sm =
+    SmoothnessError::Create(smoothness_weight, gridx, gridy);
+  ceres::CostFunction* cost_function_grad = NULL;
+  if (opt.gradient_weight > 0.0)
+    cost_function_grad = GradientError::Create(opt.gradient_weight, gridx, gridy);
+  ceres::CostFunction* cost_function_int = NULL;
+  ceres::CostFunction* cost_function_sm_pq = NULL;
+  if (opt.integrability_weight > 0) {
+    cost_function_int = IntegrabilityError::Create(opt.integrability_weight, gridx, gridy);
+    if (opt.smoothness_weight_pq > 0)
+      cost_function_sm_pq = SmoothnessErrorPQ::Create(opt.smoothness_weight_pq, gridx, gridy);
+  }
   
   for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
@@ -4375,6 +5277,7 @@ void run_sfs_level(// Fixed inputs
                                                  crop_boxes[dem_iter][image_iter],
                                                  masked_images[dem_iter][image_iter],
                                                  blend_weights[dem_iter][image_iter],
+                                                 shadow_masks[dem_iter][image_iter],
                                                  &scaled_sun_posns[3*image_iter], // sun positions
                                                  cameras[dem_iter][image_iter]);
             problem.AddResidualBlock(cost_function_img, loss_function_img,
@@ -4397,6 +5300,7 @@ void run_sfs_level(// Fixed inputs
                                      crop_boxes[dem_iter][image_iter],
                                      masked_images[dem_iter][image_iter],
                                      blend_weights[dem_iter][image_iter],
+                                     shadow_masks[dem_iter][image_iter],
                                      &scaled_sun_posns[3*image_iter], // sun positions
                                      cameras[dem_iter][image_iter]);
             problem.AddResidualBlock(cost_function_img, loss_function_img,
@@ -4425,6 +5329,7 @@ void run_sfs_level(// Fixed inputs
                                        crop_boxes[dem_iter][image_iter],
                                        masked_images[dem_iter][image_iter],
                                        blend_weights[dem_iter][image_iter],
+                                       shadow_masks[dem_iter][image_iter],
                                        cameras[dem_iter][image_iter]);
             problem.AddResidualBlock(cost_function_img, loss_function_img,
                                      &exposures[image_iter],          // exposure
@@ -4449,8 +5354,6 @@ void run_sfs_level(// Fixed inputs
           // Smoothness penalty. We always add this, even if the weight is 0,
           // to make Ceres not complain about blocks not being set. 
           ceres::LossFunction* loss_function_sm = NULL;
-          ceres::CostFunction* cost_function_sm =
-            SmoothnessError::Create(smoothness_weight, gridx, gridy);
           problem.AddResidualBlock(cost_function_sm, loss_function_sm,
                                    &dems[dem_iter](col-1, row+1),  // bottom left
                                    &dems[dem_iter](col, row+1),    // bottom 
@@ -4481,8 +5384,6 @@ void run_sfs_level(// Fixed inputs
           // Add gradient weight
           if (opt.gradient_weight > 0.0) {
             ceres::LossFunction* loss_function_grad = NULL;
-            ceres::CostFunction* cost_function_grad =
-              GradientError::Create(opt.gradient_weight, gridx, gridy);
             problem.AddResidualBlock(cost_function_grad, loss_function_grad,
                                      &dems[dem_iter](col,   row+1),  // bottom 
                                      &dems[dem_iter](col-1, row),    // left
@@ -4493,8 +5394,6 @@ void run_sfs_level(// Fixed inputs
         
           if (opt.integrability_weight > 0) {
             ceres::LossFunction* loss_function_int = NULL;
-            ceres::CostFunction* cost_function_int =
-              IntegrabilityError::Create(opt.integrability_weight, gridx, gridy);
             problem.AddResidualBlock(cost_function_int, loss_function_int,
                                      &dems[dem_iter](col,   row+1),   // bottom
                                      &dems[dem_iter](col-1, row),     // left
@@ -4504,8 +5403,6 @@ void run_sfs_level(// Fixed inputs
 
             if (opt.smoothness_weight_pq > 0) {
               ceres::LossFunction* loss_function_sm_pq = NULL;
-              ceres::CostFunction* cost_function_sm_pq =
-                SmoothnessErrorPQ::Create(opt.smoothness_weight_pq, gridx, gridy);
               problem.AddResidualBlock(cost_function_sm_pq, loss_function_sm_pq,
                                        &pq[dem_iter](col, row+1)[0],  // bottom 
                                        &pq[dem_iter](col-1, row)[0],  // left
@@ -4648,14 +5545,9 @@ void run_sfs_level(// Fixed inputs
     }
   }
   
-  if (opt.num_threads > 1 &&
-      opt.stereo_session == "isis"  &&
-      !opt.use_approx_camera_models &&
-      !opt.use_approx_adjusted_camera_models) {
-    vw_out() << "Using exact ISIS camera models. Can run with only a single thread.\n";
-    opt.num_threads = 1;
-  }
-
+  // ISIS camera models keep an ISIS camera for each thread using them,
+  // and the approximate models share the tables they compute, so the
+  // residuals can be evaluated with any number of threads.
   vw_out() << "Using: " << opt.num_threads << " thread(s).\n";
 
   ceres::Solver::Options options;
@@ -4665,32 +5557,26 @@ void run_sfs_level(// Fixed inputs
   options.minimizer_progress_to_stdout = 1;
   options.num_threads = opt.num_threads;
   options.linear_solver_type = ceres::SPARSE_SCHUR;
+  asp::set_solver_backend(opt.solver_backend, opt.solver_mixed_precision,
+                          opt.input_images.size(), options);
+
+  // With only the DEM floated, all parameter blocks are on the grid
+  if (float_dem_only)
+    setGridSolverOrdering(dems, problem, options);
 
   // Use a callback function at every iteration
-  SfsCallback callback;
   options.callbacks.push_back(&callback);
   options.update_state_every_iteration = true;
 
-  // A bunch of global variables to use in the callback
-  g_dem            = &dems;
-  g_pq             = &pq;
-  g_albedo         = &albedos;
-  g_geo            = &geo;
-  g_global_params  = &global_params;
-  g_model_params   = &model_params;
-  g_crop_boxes     = &crop_boxes;
-  g_masked_images  = &masked_images;
-  g_blend_weights  = &blend_weights;
-  g_cameras        = &cameras;
-  g_iter           = -1; // reset the iterations for each level
-  g_final_iter     = false;
-
   // Solve the problem if asked to do iterations. Otherwise
   // just keep the DEM at the initial guess, while saving
   // all the output data as if iterations happened.
+  asp::record_problem_size(problem);
+  asp::TelemetryTimer solve_timer("sfs.solve");
   ceres::Solver::Summary summary;
   if (options.max_num_iterations > 0)
     ceres::Solve(options, &problem, &summary);
+  solve_timer.stop();
 
   // Save the final results
   g_final_iter = true;
@@ -4933,6 +5819,182 @@ void setUpModelParams(GlobalParams & global_params, Options & opt) {
   }
 }
 
+// Find the exposure for an image and DEM clip from the sampled
+// intensities and reflectances. This is the ratio of their means, or,
+// if fit is true, the least squares fit of exposure * reflectance to the
+// intensity, with the Cauchy loss if the robust threshold is positive.
+double estimateExposure(std::vector<double> const& intensity,
+                        std::vector<double> const& reflectance,
+                        bool fit, double robust_threshold) {
+
+  double imgsum = 0.0, refsum = 0.0;
+  for (size_t it = 0; it < intensity.size(); it++) {
+    imgsum += intensity[it];
+    refsum += reflectance[it];
+  }
+  double exposure = imgsum/refsum;
+  if (!fit)
+    return exposure;
+
+  // Iteratively reweighted least squares, starting from the ratio of
+  // the means. Without a robust threshold, one iteration gives the
+  // least squares solution.
+  int num_iter = (robust_threshold > 0) ? 20 : 1;
+  for (int iter = 0; iter < num_iter; iter++) {
+    double num = 0.0, den = 0.0;
+    for (size_t it = 0; it < intensity.size(); it++) {
+      double w = 1.0;
+      if (robust_threshold > 0) {
+        double r = (intensity[it] - exposure * reflectance[it]) / robust_threshold;
+        w = 1.0 / (1.0 + r * r);
+      }
+      num += w * intensity[it] * reflectance[it];
+      den += w * reflectance[it] * reflectance[it];
+    }
+    if (den <= 0)
+      break;
+    exposure = num / den;
+  }
+  return exposure;
+}
+
+// Find the exposures only, without loading the images in memory or
+// forming full-size reflectance and intensity images. The DEM is
+// sampled at about 200 rows and columns, as otherwise, and the images
+// are processed in parallel. Images with no valid exposure are skipped.
+void computeExposuresOnly(Options & opt,
+                          std::vector<ImageView<double>> const& dems,
+                          std::vector<GeoReference> const& geos,
+                          std::vector<std::vector<boost::shared_ptr<CameraModel>>>
+                          const& cameras,
+                          std::vector<ModelParams> const& model_params,
+                          GlobalParams const& global_params,
+                          double dem_nodata_val) {
+
+  int num_dems = dems.size();
+  int num_images = opt.input_images.size();
+
+  double gridx, gridy;
+  compute_grid_sizes_in_meters(dems[0], geos[0], dem_nodata_val, gridx, gridy);
+
+  std::vector<double> max_dem_height(num_dems, -std::numeric_limits<double>::max());
+  if (opt.model_shadows) {
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      for (int col = 0; col < dems[dem_iter].cols(); col++) {
+        for (int row = 0; row < dems[dem_iter].rows(); row++)
+          max_dem_height[dem_iter] = std::max(max_dem_height[dem_iter],
+                                              dems[dem_iter](col, row));
+      }
+    }
+  }
+
+  // The exposure for each image and clip. Zero means invalid.
+  std::vector<std::vector<double>> exposures(num_images, std::vector<double>(num_dems, 0));
+  std::vector<std::string> logs(num_images);
+  std::vector<std::exception_ptr> errors(num_images);
+  std::atomic<int> next_image(0);
+
+  auto process_images = [&]() {
+    int image_iter;
+    while ((image_iter = next_image++) < num_images) {
+      try {
+        std::ostringstream os;
+        std::string img_file = opt.input_images[image_iter];
+        float img_nodata_val = -std::numeric_limits<float>::max();
+        vw::read_nodata_val(img_file, img_nodata_val);
+        DiskImageView<float> img(img_file);
+        MaskedImgT masked_img
+          = create_pixel_range_mask2(img,
+                                     std::max(img_nodata_val,
+                                              opt.shadow_threshold_vec[image_iter]),
+                                     opt.max_valid_image_vals_vec[image_iter]);
+        BBox2i crop_box = bounding_box(img);
+        double scaled_sun_posn[3] = {1.0, 1.0, 1.0};
+
+        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+          if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+            continue;
+
+          ImageView<double> const& dem = dems[dem_iter]; // alias
+          int sample_col_rate = std::max((int)round(dem.cols()/200.0), 1);
+          int sample_row_rate = std::max((int)round(dem.rows()/200.0), 1);
+
+          std::vector<double> intensity, reflectance;
+          for (int col = 1; col < dem.cols() - 1; col += sample_col_rate) {
+            for (int row = 1; row < dem.rows() - 1; row += sample_row_rate) {
+              PixelMask<double> refl, intens;
+              double ground_weight = 0.0;
+              computeReflectanceAndIntensity(dem(col-1, row), dem(col, row), dem(col+1, row),
+                                             dem(col, row+1), dem(col, row-1),
+                                             false, 0, 0, col, row, dem, geos[dem_iter],
+                                             opt.model_shadows, max_dem_height[dem_iter],
+                                             gridx, gridy,
+                                             model_params[image_iter], global_params,
+                                             crop_box, masked_img, DoubleImgT(),
+                                             ImageView<float>(), // no precomputed shadows
+                                             cameras[dem_iter][image_iter].get(),
+                                             scaled_sun_posn, refl, intens, ground_weight,
+                                             &opt.model_coeffs_vec[0]);
+              if (is_valid(refl) && is_valid(intens)) {
+                intensity.push_back(intens.child());
+                reflectance.push_back(refl.child());
+              }
+            }
+          }
+
+          double exposure = estimateExposure(intensity, reflectance,
+                                             opt.robust_exposure_fit, opt.robust_threshold);
+          os << "Local exposure for image " << image_iter << " and clip "
+             << dem_iter << ": " << exposure << "\n";
+          double big = 1e+100; // There's no way image exposure can be bigger than this
+          if (0 < exposure && exposure < big)
+            exposures[image_iter][dem_iter] = exposure;
+        }
+        logs[image_iter] = os.str();
+      } catch (...) {
+        errors[image_iter] = std::current_exception();
+      }
+    }
+  };
+
+  int num_threads = std::max(1, std::min(opt.num_threads, num_images));
+  vw_out() << "Computing exposures using " << num_threads << " thread(s).\n";
+  std::vector<std::thread> threads;
+  for (int it = 0; it < num_threads; it++)
+    threads.push_back(std::thread(process_images));
+  for (size_t it = 0; it < threads.size(); it++)
+    threads[it].join();
+  for (int image_iter = 0; image_iter < num_images; image_iter++) {
+    if (errors[image_iter])
+      std::rethrow_exception(errors[image_iter]);
+  }
+
+  // For each image, pick the median exposure over all clips
+  opt.image_exposures_vec.assign(num_images, 0);
+  for (int image_iter = 0; image_iter < num_images; image_iter++) {
+    vw_out() << logs[image_iter];
+    std::vector<double> exposures_per_dem;
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+        continue;
+      if (exposures[image_iter][dem_iter] > 0) {
+        exposures_per_dem.push_back(exposures[image_iter][dem_iter]);
+      } else {
+        opt.skip_images[dem_iter].insert(image_iter);
+        vw_out() << "Skip image " << image_iter << " for clip " << dem_iter << std::endl;
+      }
+    }
+    int len = exposures_per_dem.size();
+    if (len > 0) {
+      std::sort(exposures_per_dem.begin(), exposures_per_dem.end());
+      opt.image_exposures_vec[image_iter] =
+        0.5*(exposures_per_dem[(len-1)/2] + exposures_per_dem[len/2]);
+    }
+    vw_out() << "Image exposure for " << opt.input_images[image_iter] << ' '
+             << opt.image_exposures_vec[image_iter] << std::endl;
+  }
+}
+
 int main(int argc, char* argv[]) {
   
   Stopwatch sw_total;
@@ -5172,6 +6234,13 @@ int main(int argc, char* argv[]) {
       }
     }
     
+    if (opt.compute_exposures_only) {
+      computeExposuresOnly(opt, dems[0], geos[0], cameras, model_params, global_params,
+                           dem_nodata_val);
+      save_exposures(opt.out_prefix, opt.input_images, opt.image_exposures_vec);
+      return 0;
+    }
+
     // Prepare for working at multiple levels
     int factor = 2;
     std::vector<int> factors;
@@ -5193,12 +6262,63 @@ int main(int argc, char* argv[]) {
       }
     }
     
-    // Ensure that no two threads can access an ISIS camera at the same time.
-    // Declare the lock here, as we want it to live until the end of the program. 
+    // Ensure that no two threads grow the tables of approximate cameras,
+    // or print their warnings, at the same time. Declare the lock here,
+    // as we want it to live until the end of the program.
     vw::Mutex camera_mutex;
 
     // callTop();
     
+    // Replace the cameras with lookup tables. Keep the adjustments, so
+    // they can still be floated. This comes before estimating the crop
+    // boxes, so that can use the tables.
+    if (opt.use_camera_lookup_tables) {
+      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+        for (int image_iter = 0; image_iter < num_images; image_iter++) {
+          if (opt.skip_images[dem_iter].find(image_iter)
+              != opt.skip_images[dem_iter].end()) continue;
+
+          AdjustedCameraModel * adj_cam
+            = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+          if (adj_cam == NULL)
+            vw_throw(ArgumentErr() << "Expecting an adjusted camera model.\n");
+          boost::shared_ptr<CameraModel> exact_camera = adj_cam->unadjusted_model();
+
+          vw_out() << "Creating a camera lookup table for "
+                   << opt.input_cameras[image_iter] << " and clip "
+                   << opt.input_dems[dem_iter] << ".\n";
+          Stopwatch sw;
+          sw.start();
+
+          // Make the nodes denser until the table is accurate enough
+          boost::shared_ptr<LookupTableCameraModel> table;
+          double err = 0.0;
+          for (int spacing = opt.camera_lookup_spacing; ; spacing /= 2) {
+            table = boost::shared_ptr<LookupTableCameraModel>
+              (new LookupTableCameraModel(exact_camera, dems[0][dem_iter], geos[0][dem_iter],
+                                          dem_nodata_val, spacing,
+                                          opt.camera_lookup_height_range,
+                                          opt.num_threads));
+            err = table->max_error(dems[0][dem_iter], dem_nodata_val,
+                                   opt.camera_lookup_height_range);
+            if (err <= opt.camera_lookup_max_error || spacing <= 1)
+              break;
+          }
+          sw.stop();
+          vw_out() << "Lookup table node spacing in DEM pixels: " << table->spacing()
+                   << ". Max error in pixels: " << err << ". Elapsed time: "
+                   << sw.elapsed_seconds() << " s.\n";
+          if (err > opt.camera_lookup_max_error)
+            vw_out(WarningMessage) << "The camera lookup table error is larger than "
+                                   << "--camera-lookup-max-error.\n";
+
+          cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>
+            (new AdjustedCameraModel(table, adj_cam->translation(), adj_cam->rotation(),
+                                     adj_cam->pixel_offset(), adj_cam->scale()));
+        }
+      }
+    }
+
     // If to use approximate camera models or to crop input images
     if (opt.use_approx_camera_models || opt.use_approx_adjusted_camera_models) {
 
@@ -5447,6 +6567,10 @@ int main(int argc, char* argv[]) {
     }
     
     float img_nodata_val = -std::numeric_limits<float>::max();
+    std::size_t compressed_size = 0;
+    // The images cropped in memory, as counted in the memory budget
+    asp::TelemetryGaugeScope image_memory(asp::telemetry().gauge("sfs.images"));
+    std::int64_t image_bytes = 0;
     for (int image_iter = 0; image_iter < num_images; image_iter++){
       for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
       
@@ -5472,11 +6596,53 @@ int main(int argc, char* argv[]) {
 
             // Compute blending weights only when cropping the
             // images. Otherwise the weights are too huge.
-            if (opt.blending_dist > 0)
-              blend_weights_vec[0][dem_iter][image_iter]
-                = asp::blendingWeights(masked_images_vec[0][dem_iter][image_iter],
-                                       opt.blending_dist, opt.blending_power,
-                                       opt.min_blend_size);
+            if (opt.blending_dist > 0) {
+              // The weights depend on the image, its crop box, and the
+              // values of the options below
+              std::string cache_file;
+              std::uint64_t key = 0;
+              ImageView<double> weights;
+              bool cached = false;
+              if (!opt.cache_dir.empty()) {
+                std::ostringstream os;
+                os.precision(17);
+                os << fs::absolute(img_file).string() << ' ' << fs::file_size(img_file) << ' '
+                   << fs::last_write_time(img_file) << ' '
+                   << crop_boxes[0][dem_iter][image_iter] << ' ' << img_nodata_val << ' '
+                   << shadow_thresh << ' ' << opt.max_valid_image_vals_vec[image_iter] << ' '
+                   << opt.blending_dist << ' ' << opt.blending_power << ' '
+                   << opt.min_blend_size;
+                std::string str = os.str();
+                key = asp::hashBytes(0, str.data(), str.size());
+                cache_file = cache_file_name(opt, dem_iter, image_iter, "blend-weights");
+                cached = asp::readCachedImage(cache_file, key, weights);
+                if (cached)
+                  vw_out() << "Read cached blending weights: " << cache_file << "\n";
+              }
+              if (!cached) {
+                weights = asp::blendingWeights(masked_images_vec[0][dem_iter][image_iter],
+                                               opt.blending_dist, opt.blending_power,
+                                               opt.min_blend_size);
+                if (!opt.cache_dir.empty()) {
+                  vw_out() << "Writing: " << cache_file << "\n";
+                  asp::writeCachedImage(cache_file, key, weights);
+                }
+              }
+              blend_weights_vec[0][dem_iter][image_iter] = weights;
+            }
+            std::size_t size = compressImage(opt, masked_images_vec[0][dem_iter][image_iter],
+                                             blend_weights_vec[0][dem_iter][image_iter]);
+            compressed_size += size;
+            if (!opt.compress_images) {
+              auto const& img = masked_images_vec[0][dem_iter][image_iter];
+              size = std::size_t(img.cols()) * img.rows() * sizeof(PixelMask<float>);
+              if (opt.blending_dist > 0) {
+                auto const& wts = blend_weights_vec[0][dem_iter][image_iter];
+                size += std::size_t(wts.cols()) * wts.rows() * sizeof(double);
+              }
+            }
+            image_bytes += size;
+            image_memory.set(image_bytes);
           }
         }else{
           masked_images_vec[0][dem_iter][image_iter]
@@ -5487,6 +6653,9 @@ int main(int argc, char* argv[]) {
       }
     }
     g_img_nodata_val = &img_nodata_val;
+    if (opt.compress_images)
+      vw_out() << "Memory used by the compressed images and weights: "
+               << compressed_size / (1024.0 * 1024.0) << " MB.\n";
 
     // Copy sun positions to an array
     std::vector<double> scaled_sun_posns(3*num_images);
@@ -5564,6 +6733,7 @@ int main(int argc, char* argv[]) {
                                        crop_boxes[0][dem_iter][image_iter],
                                        masked_images_vec[0][dem_iter][image_iter],
                                        blend_weights_vec[0][dem_iter][image_iter],
+                                       ImageView<float>(), // no precomputed shadows
                                        cameras[dem_iter][image_iter].get(),
                                        &scaled_sun_posns[3*image_iter],
                                        reflectance, intensity, ground_weight,
@@ -5622,12 +6792,6 @@ int main(int argc, char* argv[]) {
         opt.image_haze_vec.push_back(haze_vec);
       }
     }
-    if (opt.compute_exposures_only) {
-      save_exposures(opt.out_prefix, opt.input_images, opt.image_exposures_vec);
-      // all done
-      return 0;
-    }
-
     // Need to compute the valid data image to be able to find the grid points always
     // in shadow, so when this image is zero.
     ImageView<int> lit_image_mask;
@@ -5701,6 +6865,7 @@ int main(int argc, char* argv[]) {
                                        crop_boxes[0][0][image_iter],
                                        masked_images_vec[0][0][image_iter],
                                        blend_weights_vec[0][0][image_iter],
+                                       ImageView<float>(), // no precomputed shadows
                                        cameras[0][image_iter].get(),
                                        &scaled_sun_posns[3*image_iter],
                                        reflectance, meas_intensity, ground_weight,
@@ -5883,6 +7048,8 @@ int main(int argc, char* argv[]) {
 
             // Overwrite the blending weights with ground weights
             blend_weights_vec[0][dem_iter][image_iter] = copy(ground_weights[image_iter]);
+            compressImage(opt, masked_images_vec[0][dem_iter][image_iter],
+                          blend_weights_vec[0][dem_iter][image_iter]);
           }
         }
       }
@@ -6102,23 +7269,16 @@ int main(int argc, char* argv[]) {
             ImageView<double> memory_weight = copy(DiskImageView<double>(sub_weight));
             blend_weights_vec[level][dem_iter][image_iter] = memory_weight;
           }
-        
+
+          if (opt.crop_input_images)
+            compressImage(opt, masked_images_vec[level][dem_iter][image_iter],
+                          blend_weights_vec[level][dem_iter][image_iter]);
         }
       }
     }
     
-    // Start going from the coarsest to the finest level
-    for (int level = levels; level >= 0; level--) {
-
-      g_level = level;
-
-      int num_iterations;
-      if (level == 0)
-        num_iterations = opt.max_iterations;
-      else
-        num_iterations = opt.max_coarse_iterations;
-
-      // Scale the cameras
+    // Scale the cameras for the given level
+    auto scale_cameras = [&](int level) {
       for (int image_iter = 0; image_iter < num_images; image_iter++) {
         for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
           
@@ -6134,7 +7294,15 @@ int main(int argc, char* argv[]) {
           }
         }
       }
-      
+    };
+
+    // Run the solver at a level. With multigrid, the linear terms are the
+    // coarse grid corrections.
+    std::vector<MatrixFreeSfs> matrix_free(levels+1);
+    auto run_level = [&](int level, int num_iterations,
+                         std::vector<ImageView<double>> const* linear_terms) {
+      g_level = level;
+      scale_cameras(level);
       run_sfs_level(// Fixed inputs
                     num_iterations, opt, geos[level],
                     opt.smoothness_weight*factors[level]*factors[level],
@@ -6148,7 +7316,21 @@ int main(int argc, char* argv[]) {
                     opt.image_exposures_vec,
                     opt.image_haze_vec,
                     scaled_sun_posns,
-                    adjustments, opt.model_coeffs_vec);
+                    adjustments, opt.model_coeffs_vec,
+                    // Used with --use-gpu-solver
+                    matrix_free[level], linear_terms);
+    };
+    
+    // Start going from the coarsest to the finest level
+    for (int level = levels; level >= 0; level--) {
+
+      int num_iterations;
+      if (level == 0)
+        num_iterations = opt.max_iterations;
+      else
+        num_iterations = opt.max_coarse_iterations;
+
+      run_level(level, num_iterations, NULL);
 
       // TODO: Study this. Discarding the coarse DEM and exposure so
       // keeping only the cameras seem to work better.
@@ -6165,10 +7347,84 @@ int main(int argc, char* argv[]) {
       
     }
 
+    // Multigrid V-cycles with the full approximation scheme. The objective
+    // at a coarser level gets the linear term tau = grad_coarse(R u) -
+    // R grad_fine(u), where R is restriction, and u is the finer DEM. Then
+    // the coarse solution does not move if the finer DEM is optimal, and
+    // otherwise its change from R u approximates the finer correction,
+    // which is interpolated back.
+    if (opt.multigrid_cycles > 0 && levels == 0)
+      vw_out(WarningMessage) << "Not doing multigrid cycles, as there are no "
+                             << "coarse levels.\n";
+    std::vector<std::vector<ImageView<double>>> taus(levels+1), restricted(levels+1);
+    for (int cycle = 0; cycle < opt.multigrid_cycles && levels > 0; cycle++) {
+
+      vw_out() << "Multigrid cycle " << cycle << ".\n";
+
+      for (int level = 0; level < levels; level++) {
+        std::vector<ImageView<double>> const* tau = (level > 0) ? &taus[level] : NULL;
+        run_level(level, opt.multigrid_smoothing_iterations, tau);
+
+        std::vector<ImageView<double>> fine_grads, coarse_grads;
+        matrix_free[level].gradient(tau, fine_grads);
+        restricted[level+1].resize(num_dems);
+        taus[level+1].resize(num_dems);
+        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+          ImageView<double> & coarse_dem = dems[level+1][dem_iter]; // alias
+          asp::restrictToCoarseGrid(dems[level][dem_iter], coarse_dem);
+          restricted[level+1][dem_iter] = copy(coarse_dem);
+          taus[level+1][dem_iter].set_size(coarse_dem.cols(), coarse_dem.rows());
+          asp::restrictToCoarseGrid(fine_grads[dem_iter], taus[level+1][dem_iter]);
+        }
+
+        scale_cameras(level+1);
+        matrix_free[level+1].gradient(NULL, coarse_grads);
+        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++)
+          taus[level+1][dem_iter] = copy(coarse_grads[dem_iter] - taus[level+1][dem_iter]);
+      }
+
+      run_level(levels, opt.max_coarse_iterations, &taus[levels]);
+
+      for (int level = levels - 1; level >= 0; level--) {
+
+        // The cost is mostly bounded, so the linear term can move the
+        // coarse solution far. Hence halve the correction until the
+        // cost decreases, as in MG/OPT.
+        std::vector<ImageView<double>> const* tau = (level > 0) ? &taus[level] : NULL;
+        scale_cameras(level);
+        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+          ImageView<double> & dem = dems[level][dem_iter]; // alias
+          if (dem.cols() < 3 || dem.rows() < 3)
+            continue;
+          ImageView<double> correction
+            = copy(dems[level+1][dem_iter] - restricted[level+1][dem_iter]);
+          ImageView<double> start = copy(dem);
+          double start_cost = matrix_free[level].cost(dem_iter, tau);
+          double step = 1.0;
+          const int max_num_halvings = 6;
+          for (int it = 0; it <= max_num_halvings; it++) {
+            dem = copy(start);
+            asp::addCoarseGridCorrection(copy(step * correction), dem);
+            if (matrix_free[level].cost(dem_iter, tau) < start_cost)
+              break;
+            step /= 2.0;
+          }
+          if (step < std::pow(0.5, max_num_halvings)) {
+            dem = copy(start);
+            step = 0.0;
+          }
+          vw_out() << "Coarse grid correction step at level " << level
+                   << " for clip " << dem_iter << ": " << step << "\n";
+        }
+
+        run_level(level, opt.multigrid_smoothing_iterations, tau);
+      }
+    }
+
   } ASP_STANDARD_CATCHES;
   
-  VW_OUT(DebugMessage, "asp") << "Number of times we used the global lock: "
-                              << g_num_locks << std::endl;
+  VW_OUT(DebugMessage, "asp") << "Number of times we used the exact camera models: "
+                              << g_num_exact_calls << std::endl;
 
   sw_total.stop();
   vw_out() << "Total elapsed time: " << sw_total.elapsed_seconds() << " s." << std::endl;
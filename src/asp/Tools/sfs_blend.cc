@@ -44,6 +44,7 @@
 #include <vw/Cartography/GeoTransform.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/SfsImageProc.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/math/special_functions/erf.hpp>
@@ -74,30 +75,32 @@ struct Options: vw::GdalWriteOptions {
              shadow_blend_length(0.0), min_blend_size(0.0) {}
 };
 
-// The workhorse of this code, do the blending
-class SfsBlendView: public ImageViewBase<SfsBlendView>{
+// The workhorse of this code, find the blending weight. This is
+// evaluated tile by tile, with each tile expanded by a margin so that
+// the distance to the light-shadow boundary, which is capped at the
+// blending lengths, and the blur, are the same as if the whole image
+// was processed at once.
+class SfsBlendWeightView: public ImageViewBase<SfsBlendWeightView>{
   
   ImageViewRef<float> m_sfs_dem, m_lola_dem, m_image_mosaic;
   float m_sfs_nodata, m_lola_nodata, m_weight_nodata;
   int m_extra;
-  bool m_save_weight;
   Options const& m_opt;
   
   typedef float PixelT;
   
 public:
-  SfsBlendView(ImageViewRef<float> sfs_dem, ImageViewRef<float> lola_dem,
-               ImageViewRef<float> image_mosaic,
-               float sfs_nodata, float lola_nodata, float weight_nodata, int extra,
-               bool save_weight, Options const& opt):
+  SfsBlendWeightView(ImageViewRef<float> sfs_dem, ImageViewRef<float> lola_dem,
+                     ImageViewRef<float> image_mosaic,
+                     float sfs_nodata, float lola_nodata, float weight_nodata, int extra,
+                     Options const& opt):
     m_sfs_dem(sfs_dem), m_lola_dem(lola_dem), m_image_mosaic(image_mosaic),
     m_sfs_nodata(sfs_nodata), m_lola_nodata(lola_nodata),
-    m_weight_nodata(weight_nodata), m_extra(extra),
-    m_save_weight(save_weight), m_opt(opt) {}
+    m_weight_nodata(weight_nodata), m_extra(extra), m_opt(opt) {}
 
   typedef PixelT pixel_type;
   typedef PixelT result_type;
-  typedef ProceduralPixelAccessor<SfsBlendView> pixel_accessor;
+  typedef ProceduralPixelAccessor<SfsBlendWeightView> pixel_accessor;
   
   inline int32 cols() const { return m_sfs_dem.cols(); }
   inline int32 rows() const { return m_sfs_dem.rows(); }
@@ -106,7 +109,7 @@ public:
   inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
   
   inline pixel_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "SfsBlendView::operator()(...) is not implemented");
+    vw_throw(NoImplErr() << "SfsBlendWeightView::operator()(...) is not implemented");
     return pixel_type();
   }
   
@@ -117,10 +120,11 @@ public:
     biased_box.expand(m_extra);
     biased_box.crop(bounding_box(m_sfs_dem));
 
-    // Make crops in memory (from references)
-    ImageView<pixel_type> sfs_dem_crop = crop(m_sfs_dem, biased_box);
-    ImageView<pixel_type> lola_dem_crop = crop(m_lola_dem, biased_box);
+    // Only the mosaic is needed in the margin. The DEMs are used just
+    // to find where there is no data.
     ImageView<pixel_type> image_mosaic_crop = crop(m_image_mosaic, biased_box);
+    ImageView<pixel_type> sfs_dem_crop = crop(m_sfs_dem, bbox);
+    ImageView<pixel_type> lola_dem_crop = crop(m_lola_dem, bbox);
 
     // The mask of lit pixels
     ImageView< PixelMask<pixel_type> > mask = create_mask_less_or_equal(image_mosaic_crop,
@@ -154,70 +158,35 @@ public:
     // zero at the light-shadow boundary
     ImageView<pixel_type> shadow_grass_dist = vw::grassfire(inv_mask, no_zero_at_border);
 
-    // Find the clamped signed distance to the boundary. Note that our
-    // boundary is in fact two pixel wide at the light-shadow
+    // The boundary is in fact two pixel wide at the light-shadow
     // interface, given how lit_grass_dist and shadow_grass_dist are
-    // defined as the negation of each other. The boundary is the set
-    // of pixels where both of these are <= 1.
-    ImageView<float> dist_to_bd;
-    dist_to_bd.set_size(sfs_dem_crop.cols(), sfs_dem_crop.rows());
-    for (int col = 0; col < sfs_dem_crop.cols(); col++) {
-      
-      for (int row = 0; row < sfs_dem_crop.rows(); row++) {
-
-        if (lit_grass_dist(col, row) > 1.5*m_opt.lit_blend_length) {
-          // Too far in the lit region
-          dist_to_bd(col, row) = m_opt.lit_blend_length; // clamp at the blending length
-          continue;
-        }
-        
-        if (shadow_grass_dist(col, row) > 1.5*m_opt.shadow_blend_length) {
-          // Too far in the shadow region
-          dist_to_bd(col, row) = -m_opt.shadow_blend_length;
-          continue;
-        }
-        
-        // Find the shortest Euclidean distance to the no-data region.
-        double max_dist = std::max(m_opt.lit_blend_length, m_opt.shadow_blend_length);
-        double signed_dist = 0.0;
-        if (lit_grass_dist(col, row) > 0) {
-          signed_dist = m_opt.lit_blend_length;
-        } else if (shadow_grass_dist(col, row) > 0) {
-          signed_dist = -m_opt.shadow_blend_length;
-        }
-        
-        for (int col2 = std::max(0.0, col - max_dist);
-             col2 <= std::min(sfs_dem_crop.cols() - 1.0, col + max_dist);
-             col2++) {
-
-          // Estimate the range of rows for the circle with given radius
-          // at given col value.
-          double ht_val = ceil(sqrt(double(max_dist * max_dist) -
-                                    double((col - col2) * (col - col2))));
-          
-          for (int row2 = std::max(0.0, row - ht_val);
-               row2 <= std::min(sfs_dem_crop.rows() - 1.0, row + ht_val);
-               row2++) {
-
-            if (lit_grass_dist(col2, row2) > 1 || shadow_grass_dist(col2, row2) > 1) 
-              continue; // not at the boundary
-
-            // See if the current point is closer than anything so far
-            double curr_dist = sqrt( double(col - col2) * (col - col2) +
-                                     double(row - row2) * (row - row2) );
-            if (lit_grass_dist(col, row) > 0) {
-              if (curr_dist < signed_dist) 
-                signed_dist = curr_dist;
-            } else if (shadow_grass_dist(col, row) > 0) {
-              if (curr_dist < -signed_dist) 
-                signed_dist = -curr_dist;
-            }
-            
-          }
-        }
+    // defined as the negation of each other. It is the set of pixels
+    // where both of these are <= 1. Find the Euclidean distance to
+    // it. The margin is bigger than the blending lengths, so a
+    // boundary pixel closer than those to a pixel in the tile is in
+    // the expanded tile.
+    ImageView<unsigned char> is_bd(image_mosaic_crop.cols(), image_mosaic_crop.rows());
+    for (int col = 0; col < is_bd.cols(); col++) {
+      for (int row = 0; row < is_bd.rows(); row++)
+        is_bd(col, row) = (lit_grass_dist(col, row) <= 1 && shadow_grass_dist(col, row) <= 1);
+    }
+    double max_dist = std::max(m_opt.lit_blend_length, m_opt.shadow_blend_length);
+    ImageView<float> euclid_dist;
+    asp::distanceToNonzero(is_bd, max_dist, euclid_dist);
 
-        // The closest we've got
-        dist_to_bd(col, row) = signed_dist;
+    // Find the clamped signed distance to the boundary
+    ImageView<float> dist_to_bd;
+    dist_to_bd.set_size(image_mosaic_crop.cols(), image_mosaic_crop.rows());
+    for (int col = 0; col < dist_to_bd.cols(); col++) {
+      for (int row = 0; row < dist_to_bd.rows(); row++) {
+        if (lit_grass_dist(col, row) > 0)
+          dist_to_bd(col, row) = std::min(m_opt.lit_blend_length,
+                                          double(euclid_dist(col, row)));
+        else if (shadow_grass_dist(col, row) > 0)
+          dist_to_bd(col, row) = -std::min(m_opt.shadow_blend_length,
+                                           double(euclid_dist(col, row)));
+        else
+          dist_to_bd(col, row) = 0.0;
       }
     }
 
@@ -225,45 +194,95 @@ public:
     if (m_opt.weight_blur_sigma > 0)
       dist_to_bd = vw::gaussian_filter(dist_to_bd, m_opt.weight_blur_sigma);
 
-    // Do the blending
-    ImageView<float> blended_dem;
-    blended_dem.set_size(sfs_dem_crop.cols(), sfs_dem_crop.rows());
-    for (int col = 0; col < sfs_dem_crop.cols(); col++) {
-      for (int row = 0; row < sfs_dem_crop.rows(); row++) {
+    // Find the weight in the tile without the margin
+    Vector2i offset = bbox.min() - biased_box.min();
+    ImageView<float> weight;
+    weight.set_size(bbox.width(), bbox.height());
+    for (int col = 0; col < weight.cols(); col++) {
+      for (int row = 0; row < weight.rows(); row++) {
 
-        if (!m_save_weight)
-          blended_dem(col, row) = m_sfs_nodata;
-        else
-          blended_dem(col, row) = m_weight_nodata;
+        weight(col, row) = m_weight_nodata;
+        if (lola_dem_crop(col, row) == m_lola_nodata) 
+          continue;
 
         // The signed distance to the boundary is modified so that the smallest
         // value is 0, the largest is 1, and in a band close to the boundary it
         // transitions from 0 to 1.
-        float weight = (dist_to_bd(col, row) + m_opt.shadow_blend_length) /
+        float wt = (dist_to_bd(col + offset.x(), row + offset.y())
+                    + m_opt.shadow_blend_length) /
           (m_opt.shadow_blend_length + m_opt.lit_blend_length);
 
         // These are not strictly necessary but enforce them
-        if (weight > 1.0)
-          weight = 1.0;
-        if (weight < 1e-7) // take into account the float error 
-          weight = 0.0;
+        if (wt > 1.0)
+          wt = 1.0;
+        if (wt < 1e-7) // take into account the float error 
+          wt = 0.0;
           
         // Handle no-data values. These are not meant to happen, but do this just in case.
         if (sfs_dem_crop(col, row) == m_sfs_nodata)
-          weight = 0.0; // Use LOLA
-        
-        if (lola_dem_crop(col, row) == m_lola_nodata) 
-          continue;
+          wt = 0.0; // Use LOLA
+
+        weight(col, row) = wt;
+      }
+    }
+    
+    return prerasterize_type(weight, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+// Blend the SfS and LOLA DEMs with a weight that is already computed
+class SfsBlendView: public ImageViewBase<SfsBlendView>{
+  
+  ImageViewRef<float> m_sfs_dem, m_lola_dem, m_weight;
+  float m_sfs_nodata, m_weight_nodata;
+  
+  typedef float PixelT;
+  
+public:
+  SfsBlendView(ImageViewRef<float> sfs_dem, ImageViewRef<float> lola_dem,
+               ImageViewRef<float> weight, float sfs_nodata, float weight_nodata):
+    m_sfs_dem(sfs_dem), m_lola_dem(lola_dem), m_weight(weight),
+    m_sfs_nodata(sfs_nodata), m_weight_nodata(weight_nodata) {}
 
-        if (!m_save_weight) 
+  typedef PixelT pixel_type;
+  typedef PixelT result_type;
+  typedef ProceduralPixelAccessor<SfsBlendView> pixel_accessor;
+  
+  inline int32 cols() const { return m_sfs_dem.cols(); }
+  inline int32 rows() const { return m_sfs_dem.rows(); }
+  inline int32 planes() const { return 1; }
+  
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+  
+  inline pixel_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "SfsBlendView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+  
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    ImageView<pixel_type> sfs_dem_crop = crop(m_sfs_dem, bbox);
+    ImageView<pixel_type> lola_dem_crop = crop(m_lola_dem, bbox);
+    ImageView<pixel_type> blended_dem = crop(m_weight, bbox);
+    for (int col = 0; col < blended_dem.cols(); col++) {
+      for (int row = 0; row < blended_dem.rows(); row++) {
+        float weight = blended_dem(col, row);
+        if (weight == m_weight_nodata)
+          blended_dem(col, row) = m_sfs_nodata;
+        else
           blended_dem(col, row)
             = weight * sfs_dem_crop(col, row) + (1.0 - weight) * lola_dem_crop(col, row);
-        else
-          blended_dem(col, row) = weight;
       }
     }
     
-    return prerasterize_type(blended_dem, -biased_box.min().x(), -biased_box.min().y(),
+    return prerasterize_type(blended_dem, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows());
   }
 
@@ -550,32 +569,29 @@ int main(int argc, char *argv[]) {
     int block_size = 256 + 2 * extra;
     block_size = 16*ceil(block_size/16.0); // internal constraint
 
-    vw_out() << "Writing: " << opt.output_dem << std::endl;
-    bool has_georef = true, has_nodata = true;
-    TerminalProgressCallback tpc("asp", ": ");
-    float weight_nodata = -1.0;
-    bool save_weight = false;
-    asp::save_with_temp_big_blocks(block_size,
-                                   opt.output_dem,
-                                   SfsBlendView(sfs_dem, lola_dem, image_mosaic,
-                                                sfs_nodata, lola_nodata, weight_nodata,
-                                                extra, save_weight, opt),
-                                   has_georef, sfs_georef,
-                                   has_nodata, sfs_nodata, opt, tpc);
-
-    // Write the weight. Have to rerun the same logic due to ASP's limitations,
-    // it cannot write two large files at the same time.
+    // Write the weight first. ASP cannot write two large files at the
+    // same time, so the blended DEM is then found from the weight on
+    // disk, rather than by computing the weight again.
     vw_out() << "Writing the blending weight: "
              << opt.output_weight << std::endl;
-    save_weight = true;
+    bool has_georef = true, has_nodata = true;
+    float weight_nodata = -1.0;
+    TerminalProgressCallback tpc("asp", ": ");
     asp::save_with_temp_big_blocks(block_size,
                                    opt.output_weight,
-                                   SfsBlendView(sfs_dem, lola_dem, image_mosaic,
-                                                sfs_nodata, lola_nodata, weight_nodata,
-                                                extra, save_weight, opt),
+                                   SfsBlendWeightView(sfs_dem, lola_dem, image_mosaic,
+                                                      sfs_nodata, lola_nodata,
+                                                      weight_nodata, extra, opt),
                                    has_georef, sfs_georef,
                                    has_nodata, weight_nodata, opt, tpc);
-    
+
+    vw_out() << "Writing: " << opt.output_dem << std::endl;
+    DiskImageView<float> weight(opt.output_weight);
+    block_write_gdal_image(opt.output_dem,
+                           SfsBlendView(sfs_dem, lola_dem, weight,
+                                        sfs_nodata, weight_nodata),
+                           has_georef, sfs_georef, has_nodata, sfs_nodata, opt,
+                           TerminalProgressCallback("asp", ": "));
     
   } ASP_STANDARD_CATCHES;
 
@@ -23,6 +23,7 @@
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/Camera/LinescanPleiadesModel.h>
 #include <asp/Core/AspStringUtils.h>
+#include <asp/Core/SgmGpu.h>
 
 #include <vw/Cartography/PointImageManipulation.h>
 #include <vw/Stereo/StereoView.h>
@@ -39,25 +40,140 @@
 #include <boost/accumulators/statistics.hpp>
 #pragma GCC diagnostic pop
 
+#include <iostream>
+#include <sstream>
+
 using namespace vw;
 using namespace vw::cartography;
 
 namespace asp {
 
+  // Split the positional arguments into the output prefix and the rest,
+  // without touching the disk. The input DEM, if present, is last, and
+  // it is an image, unlike the output prefix.
+  bool split_out_prefix(std::vector<std::string> const& files,
+                        std::vector<std::string> & inputs, std::string & out_prefix) {
+    inputs = files;
+    out_prefix.clear();
+    std::string dem;
+    if (!inputs.empty() && asp::has_image_extension(inputs.back())) {
+      dem = inputs.back();
+      inputs.pop_back();
+    }
+    if (inputs.empty())
+      return false;
+    out_prefix = inputs.back();
+    inputs.pop_back();
+    if (!dem.empty())
+      inputs.push_back(dem);
+    return true;
+  }
+
+  // Load the settings snapshot saved by stereo_pprc, if it was made with
+  // the same positional arguments and the same stereo.default.
+  // stereo_pprc itself always resolves the settings from scratch.
+  void load_settings_snapshot(std::string const& prog_name,
+                              std::vector<std::string> const& files,
+                              bool verbose, ASPGlobalOptions & opt) {
+    opt.snapshot = SettingsSnapshot();
+    if (prog_name.find("stereo_pprc") != std::string::npos)
+      return;
+
+    std::vector<std::string> inputs;
+    std::string out_prefix;
+    if (!split_out_prefix(files, inputs, out_prefix))
+      return;
+
+    SettingsSnapshot snap;
+    std::string file = settings_snapshot_file(out_prefix);
+    if (!read_settings_snapshot(file, snap))
+      return;
+    if (snap.input_files != inputs ||
+        snap.stereo_default_filename != opt.stereo_default_filename ||
+        snap.stereo_default_time != stereo_default_time(opt.stereo_default_filename))
+      return;
+
+    snap.valid = true;
+    opt.snapshot = snap;
+    if (verbose)
+      vw_out() << "Using the settings snapshot: " << file << "\n";
+  }
+
+  // The size of L.tif, or (-1, -1) if it does not exist yet
+  Vector2i L_image_size(ASPGlobalOptions const& opt) {
+    if (opt.snapshot.valid)
+      return opt.snapshot.L_size;
+    if (!fs::exists(opt.out_prefix + "-L.tif"))
+      return Vector2i(-1, -1);
+    DiskImageView<PixelGray<float>> L_img(opt.out_prefix + "-L.tif");
+    return Vector2i(L_img.cols(), L_img.rows());
+  }
+
+  void save_settings_snapshot(ASPGlobalOptions const& opt) {
+
+    // Start with the inputs and stereo.default options found when parsing
+    SettingsSnapshot snap = opt.snapshot;
+    snap.valid = false;
+    snap.stereo_default_filename = opt.stereo_default_filename;
+    snap.stereo_default_time = stereo_default_time(opt.stereo_default_filename);
+
+    std::string file = settings_snapshot_file(opt.out_prefix);
+    try {
+      boost::shared_ptr<vw::DiskImageResource>
+        left_rsrc(vw::DiskImageResourcePtr(opt.in_file1)),
+        right_rsrc(vw::DiskImageResourcePtr(opt.in_file2));
+      snap.left_size      = Vector2i(left_rsrc->cols(),  left_rsrc->rows());
+      snap.right_size     = Vector2i(right_rsrc->cols(), right_rsrc->rows());
+      snap.left_channels  = left_rsrc->channels();
+      snap.right_channels = right_rsrc->channels();
+
+      GeoReference georef1, georef2;
+      snap.has_georef1 = vw::cartography::read_georeference(georef1, opt.in_file1);
+      snap.has_georef2 = vw::cartography::read_georeference(georef2, opt.in_file2);
+      if (snap.has_georef1)
+        snap.proj4_str1 = georef1.overall_proj4_str();
+      if (snap.has_georef2)
+        snap.proj4_str2 = georef2.overall_proj4_str();
+      if (!opt.input_dem.empty()) {
+        std::string cam_tag = "CAMERA_MODEL_TYPE";
+        snap.left_cam_type  = vw::cartography::read_header_string(opt.in_file1, cam_tag);
+        snap.right_cam_type = vw::cartography::read_header_string(opt.in_file2, cam_tag);
+      }
+
+      // stereo_pprc does not load a snapshot, so this looks at the disk
+      snap.L_size        = L_image_size(opt);
+      snap.has_L_cropped = fs::exists(opt.out_prefix + "-L-cropped.tif");
+      snap.has_R_cropped = fs::exists(opt.out_prefix + "-R-cropped.tif");
+
+      write_settings_snapshot(file, snap);
+    } catch (std::exception const& e) {
+      // The later stages will then resolve the settings on their own
+      vw_out(WarningMessage) << "Could not save the settings snapshot: "
+                             << file << ". " << e.what() << "\n";
+      return;
+    }
+    vw_out() << "Saved the settings snapshot: " << file << "\n";
+  }
+
   // Transform the crop window to be in reference to L.tif
   BBox2i transformed_crop_win(ASPGlobalOptions const& opt){
 
     BBox2i b = stereo_settings().left_image_crop_win;
-    boost::shared_ptr<vw::DiskImageResource> rsrc = 
-            vw::DiskImageResourcePtr(opt.in_file1);
-    DiskImageView<PixelGray<float>> left_image(rsrc);
-    BBox2i full_box = bounding_box(left_image);
+    BBox2i full_box;
+    if (opt.snapshot.valid) {
+      full_box = BBox2i(0, 0, opt.snapshot.left_size[0], opt.snapshot.left_size[1]);
+    } else {
+      boost::shared_ptr<vw::DiskImageResource> rsrc = 
+              vw::DiskImageResourcePtr(opt.in_file1);
+      DiskImageView<PixelGray<float>> left_image(rsrc);
+      full_box = bounding_box(left_image);
+    }
+    Vector2i L_size = L_image_size(opt);
     if (b == BBox2i(0, 0, 0, 0)){
 
       // No box was provided. Use the full box.
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
-        DiskImageView<PixelGray<float>> L_img(opt.out_prefix+"-L.tif");
-        b = bounding_box(L_img);
+      if (L_size[0] >= 0) {
+        b = BBox2i(0, 0, L_size[0], L_size[1]);
       }else{
         b = full_box; // To not have an empty box
       }
@@ -73,10 +189,9 @@ namespace asp {
         b = HomographyTransform(align_left_matrix).forward_bbox(b);
       }
 
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
+      if (L_size[0] >= 0) {
         // Intersect with L.tif which is the transformed and processed left image
-        DiskImageView<PixelGray<float>> L_img(opt.out_prefix+"-L.tif");
-        b.crop(bounding_box(L_img));
+        b.crop(BBox2i(0, 0, L_size[0], L_size[1]));
       }
 
     }
@@ -147,8 +262,21 @@ namespace asp {
     // Extract all the positional elements
     std::vector<std::string> images, cameras;
     std::string input_dem;
-    if (!parse_multiview_cmd_files(files, images, cameras, output_prefix, input_dem))
+    if (opt.snapshot.valid) {
+      // Already resolved by stereo_pprc, no need to check the files again
+      std::vector<std::string> inputs;
+      split_out_prefix(files, inputs, output_prefix);
+      SettingsSnapshot const& snap = opt.snapshot; // alias
+      images.push_back(snap.in_file1);
+      images.push_back(snap.in_file2);
+      if (!snap.cam_file1.empty() || !snap.cam_file2.empty()) {
+        cameras.push_back(snap.cam_file1);
+        cameras.push_back(snap.cam_file2);
+      }
+      input_dem = snap.input_dem;
+    } else if (!parse_multiview_cmd_files(files, images, cameras, output_prefix, input_dem)) {
       vw_throw(ArgumentErr() << "Missing all of the correct input files.\n\n" << usage);
+    }
 
     int num_pairs = (int)images.size() - 1;
     if (num_pairs <= 0)
@@ -277,6 +405,11 @@ namespace asp {
     if (opt.session->do_bathymetry() && stereo_settings().propagate_errors) 
       vw_throw(ArgumentErr() << "Error propagation is not implemented when "
                << "bathymetry is modeled.\n");
+
+    if (stereo_settings().compact_point_cloud &&
+        stereo_settings().save_double_precision_point_cloud)
+      vw_throw(ArgumentErr() << "Cannot use --compact-point-cloud with "
+               << "--save-double-precision-point-cloud.\n");
     
     if (stereo_settings().propagate_errors && 
         stereo_settings().compute_error_vector) 
@@ -291,8 +424,11 @@ namespace asp {
   // Parse data needed for error propagation
   void setup_error_propagation(ASPGlobalOptions const& opt) {
     
-    // A bugfix for the propagated errors not being saved with enough digits
-    if (stereo_settings().point_cloud_rounding_error > 0) {
+    // A bugfix for the propagated errors not being saved with enough digits.
+    // A compact cloud rounds the errors separately, so needs no fix.
+    if (stereo_settings().compact_point_cloud) {
+      // Nothing to do
+    } else if (stereo_settings().point_cloud_rounding_error > 0) {
       vw_out(WarningMessage) << "Option --point-cloud-rounding-error is set to " <<
         stereo_settings().point_cloud_rounding_error << " meters. If too coarse, "
         "it may create artifacts in the propagated horizontal and vertical errors.\n";
@@ -441,6 +577,26 @@ namespace asp {
                                                    positional_desc, usage,
                                                    allow_unregistered, unregistered);
 
+    // The positional arguments given on the command line
+    std::vector<std::string> cmd_files;
+    if (is_multiview) {
+      if (vm.count("input-files") != 0)
+        cmd_files = vm["input-files"].as<std::vector<std::string>>();
+    } else {
+      std::string const* fields[] = {&opt.in_file1, &opt.in_file2, &opt.cam_file1,
+                                     &opt.cam_file2, &opt.out_prefix, &opt.input_dem};
+      for (size_t it = 0; it < sizeof(fields)/sizeof(fields[0]); it++) {
+        if (!fields[it]->empty())
+          cmd_files.push_back(*fields[it]);
+      }
+    }
+
+    // After stereo_pprc, the stereo.default options and the checks on the
+    // input files come from the snapshot it saved.
+    std::string prog_name = extract_prog_name(argv[0]);
+    bool print_warnings = is_multiview; // print warnings just first time
+    load_settings_snapshot(prog_name, cmd_files, print_warnings, opt);
+
     // Read the config file
     try {
       // The user can specify the positional input from the
@@ -449,12 +605,24 @@ namespace asp {
       cfg_options.add(positional_options);
       cfg_options.add(generate_config_file_options(opt));
 
+      po::parsed_options cfg_parsed(&cfg_options);
+      if (opt.snapshot.valid) {
+        for (size_t it = 0; it < opt.snapshot.config_options.size(); it++)
+          cfg_parsed.options.push_back(po::option(opt.snapshot.config_options[it].first,
+                                                  opt.snapshot.config_options[it].second));
+      } else {
+        cfg_parsed = parse_asp_config_file(print_warnings, opt.stereo_default_filename,
+                                           cfg_options);
+        // Keep these for stereo_pprc to save
+        opt.snapshot.config_options.clear();
+        for (size_t it = 0; it < cfg_parsed.options.size(); it++)
+          opt.snapshot.config_options.push_back(std::make_pair(cfg_parsed.options[it].string_key,
+                                                               cfg_parsed.options[it].value));
+      }
+
       // Append the options from the config file. Do not overwrite the
       // options already set on the command line.
-      bool print_warnings = is_multiview; // print warnings just first time
-      po::store(parse_asp_config_file(print_warnings,
-                                      opt.stereo_default_filename,
-                                      cfg_options), vm);
+      po::store(cfg_parsed, vm);
       po::notify(vm);
     } catch (po::error const& e) {
       vw::vw_throw(vw::ArgumentErr() << "Error parsing configuration file:\n" << e.what() << "\n");
@@ -517,14 +685,35 @@ namespace asp {
     if (!opt.cam_file2.empty())  files.push_back(opt.cam_file2);
     if (!opt.out_prefix.empty()) files.push_back(opt.out_prefix);
     if (!opt.input_dem.empty())  files.push_back(opt.input_dem);
-    if (!parse_multiview_cmd_files(files, // inputs
-                                   images, cameras, opt.out_prefix, opt.input_dem)) // outputs
-      vw_throw(ArgumentErr() << "Missing all of the correct input files.\n\n" << usage);
-
-    opt.in_file1 = "";  if (images.size() >= 1)  opt.in_file1  = images[0];
-    opt.in_file2 = "";  if (images.size() >= 2)  opt.in_file2  = images[1];
-    opt.cam_file1 = ""; if (cameras.size() >= 1) opt.cam_file1 = cameras[0];
-    opt.cam_file2 = ""; if (cameras.size() >= 2) opt.cam_file2 = cameras[1];
+    SettingsSnapshot & snap = opt.snapshot; // alias
+    if (snap.valid) {
+      // Already resolved by stereo_pprc, no need to check the files again
+      std::vector<std::string> inputs;
+      split_out_prefix(files, inputs, opt.out_prefix);
+      opt.in_file1  = snap.in_file1;
+      opt.in_file2  = snap.in_file2;
+      opt.cam_file1 = snap.cam_file1;
+      opt.cam_file2 = snap.cam_file2;
+      opt.input_dem = snap.input_dem;
+    } else {
+      if (!parse_multiview_cmd_files(files, // inputs
+                                     images, cameras, opt.out_prefix, opt.input_dem)) // outputs
+        vw_throw(ArgumentErr() << "Missing all of the correct input files.\n\n" << usage);
+
+      opt.in_file1 = "";  if (images.size() >= 1)  opt.in_file1  = images[0];
+      opt.in_file2 = "";  if (images.size() >= 2)  opt.in_file2  = images[1];
+      opt.cam_file1 = ""; if (cameras.size() >= 1) opt.cam_file1 = cameras[0];
+      opt.cam_file2 = ""; if (cameras.size() >= 2) opt.cam_file2 = cameras[1];
+
+      // Record how the files were resolved, for stereo_pprc to save
+      std::string out_prefix;
+      split_out_prefix(cmd_files, snap.input_files, out_prefix);
+      snap.in_file1  = opt.in_file1;
+      snap.in_file2  = opt.in_file2;
+      snap.cam_file1 = opt.cam_file1;
+      snap.cam_file2 = opt.cam_file2;
+      snap.input_dem = opt.input_dem;
+    }
 
     if (opt.in_file1.empty() || opt.in_file2.empty() || opt.out_prefix.empty())
       vw_throw(ArgumentErr() << "Missing all of the correct input files.\n\n" << usage);
@@ -534,7 +723,6 @@ namespace asp {
 
     // Turn on logging to file, except for stereo_parse, as that one is called
     // all the time.
-    std::string prog_name = extract_prog_name(argv[0]);
     if (prog_name.find("stereo_parse") == std::string::npos) 
       asp::log_to_file(argc, argv, opt.stereo_default_filename, opt.out_prefix);
     
@@ -558,13 +746,24 @@ namespace asp {
       = BBox2i(bt.min().x(), bt.min().y(), bt.max().x(), bt.max().y());
 
     // Ensure the crop windows are always contained in the images.
-    boost::shared_ptr<vw::DiskImageResource> left_resource, right_resource;
-    left_resource  = vw::DiskImageResourcePtr(opt.in_file1);
-    right_resource = vw::DiskImageResourcePtr(opt.in_file2);
-    DiskImageView<float> left_image(left_resource);
-    DiskImageView<float> right_image(right_resource);
-    stereo_settings().left_image_crop_win.crop (bounding_box(left_image));
-    stereo_settings().right_image_crop_win.crop(bounding_box(right_image));
+    BBox2i left_box, right_box;
+    int left_channels = 0, right_channels = 0;
+    if (snap.valid) {
+      left_box  = BBox2i(0, 0, snap.left_size[0],  snap.left_size[1]);
+      right_box = BBox2i(0, 0, snap.right_size[0], snap.right_size[1]);
+      left_channels  = snap.left_channels;
+      right_channels = snap.right_channels;
+    } else {
+      boost::shared_ptr<vw::DiskImageResource> left_resource, right_resource;
+      left_resource  = vw::DiskImageResourcePtr(opt.in_file1);
+      right_resource = vw::DiskImageResourcePtr(opt.in_file2);
+      left_box  = BBox2i(0, 0, left_resource->cols(),  left_resource->rows());
+      right_box = BBox2i(0, 0, right_resource->cols(), right_resource->rows());
+      left_channels  = left_resource->channels();
+      right_channels = right_resource->channels();
+    }
+    stereo_settings().left_image_crop_win.crop (left_box);
+    stereo_settings().right_image_crop_win.crop(right_box);
 
     bool crop_left  = (stereo_settings().left_image_crop_win  != BBox2i(0, 0, 0, 0));
     bool crop_right = (stereo_settings().right_image_crop_win != BBox2i(0, 0, 0, 0));
@@ -583,10 +782,9 @@ namespace asp {
         stereo_settings().trans_crop_win = transformed_crop_win(opt);
 
       // Intersect with L.tif which is the transformed and processed left image.
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
-        DiskImageView<PixelGray<float>> L_img(opt.out_prefix+"-L.tif");
-        stereo_settings().trans_crop_win.crop(bounding_box(L_img));
-      }
+      Vector2i L_size = L_image_size(opt);
+      if (L_size[0] >= 0)
+        stereo_settings().trans_crop_win.crop(BBox2i(0, 0, L_size[0], L_size[1]));
     } else {
       // If left_image_crop_win is specified, as can be see in
       // StereoSession::preprocessing_hook(), we actually
@@ -595,18 +793,20 @@ namespace asp {
       // cropped image. So we just use it as it is. If it is not defined, 
       // we set it to the entire cropped image.
       if (stereo_settings().trans_crop_win == BBox2i(0, 0, 0, 0)) {
-        stereo_settings().trans_crop_win = bounding_box(left_image);
-        if ( fs::exists(opt.out_prefix+"-L.tif") ){
-          DiskImageView<PixelGray<float>> L_img(opt.out_prefix+"-L.tif");
-          stereo_settings().trans_crop_win = bounding_box(L_img);
-        }
+        stereo_settings().trans_crop_win = left_box;
+        Vector2i L_size = L_image_size(opt);
+        if (L_size[0] >= 0)
+          stereo_settings().trans_crop_win = BBox2i(0, 0, L_size[0], L_size[1]);
       }
     } // End crop checking case
 
+    bool has_L_cropped = snap.valid ? snap.has_L_cropped :
+      fs::exists(opt.out_prefix + "-L-cropped.tif");
+    bool has_R_cropped = snap.valid ? snap.has_R_cropped :
+      fs::exists(opt.out_prefix + "-R-cropped.tif");
+
     // If not using crop wins but the crop image exists, then things won't go well.
-    if (!crop_left && !crop_right &&
-        (fs::exists(opt.out_prefix+"-L-cropped.tif") ||
-         fs::exists(opt.out_prefix+"-R-cropped.tif"))) 
+    if (!crop_left && !crop_right && (has_L_cropped || has_R_cropped))
       vw_throw(ArgumentErr() << "The current output prefix '" << opt.out_prefix
                << "' has an old run which used --left-image-crop-win, "
                << "but the current run does not. Results will be incorrect. "
@@ -618,8 +818,7 @@ namespace asp {
     // could be anything. We'll regenerate any of those anyway soon.
     if ((stereo_settings().trans_crop_win.width () <= 0 ||
          stereo_settings().trans_crop_win.height() <= 0) &&
-        !fs::exists(opt.out_prefix+"-L-cropped.tif")     &&
-        !fs::exists(opt.out_prefix+"-R-cropped.tif") ){
+        !has_L_cropped && !has_R_cropped) {
       vw_throw(ArgumentErr() << "Invalid region for doing stereo.\n\n"
                << usage << general_options);
     }
@@ -643,7 +842,7 @@ namespace asp {
                << "--max-disp-spread.\n\n" << usage << general_options);
 
     // Verify that there is only one channel per input image
-    if ( (left_resource->channels() > 1) || (right_resource->channels() > 1) )
+    if (left_channels > 1 || right_channels > 1)
       vw_throw(ArgumentErr() << "Error: Input images can only have a single channel.\n\n"
                << usage << general_options);
 
@@ -764,6 +963,17 @@ namespace asp {
           << "the corr kernel size must be between 3 and 9 (inclusive).\n");
     }
 
+    // The GPU engine must have been compiled in. Whether a device is present
+    // is checked only in stereo_corr, as the head node may not have one.
+    if (asp::is_sgm_gpu_alg(stereo_settings().stereo_algorithm)) {
+#if !defined(ASP_HAVE_PKG_CUDA) || ASP_HAVE_PKG_CUDA != 1
+      vw_throw(ArgumentErr() << "The asp_sgm_gpu algorithm requires ASP to be built "
+               << "with -DASP_ENABLE_CUDA=ON.\n");
+#endif
+      if (stereo_settings().sgm_gpu_num_paths != 8 && stereo_settings().sgm_gpu_num_paths != 16)
+        vw_throw(ArgumentErr() << "The value of --sgm-gpu-num-paths must be 8 or 16.\n");
+    }
+
     bool using_tiles = (stereo_alg > vw::stereo::VW_CORRELATION_BM ||
                         stereo_settings().alignment_method == "local_epipolar");
     if (!using_tiles) {
@@ -808,10 +1018,12 @@ namespace asp {
     // The last thing we do before we get started is to copy the
     // stereo.default settings over into the results directory so that
     // we have a record of the most recent stereo.default that was used
-    // with this data set.
-    asp::stereo_settings().write_copy(argc, argv,
-                                      opt.stereo_default_filename,
-                                      opt.out_prefix + "-stereo.default");
+    // with this data set. With a snapshot, the copy made by stereo_pprc
+    // is kept.
+    if (!opt.snapshot.valid)
+      asp::stereo_settings().write_copy(argc, argv,
+                                        opt.stereo_default_filename,
+                                        opt.out_prefix + "-stereo.default");
   }
 
   // Register Session types
@@ -858,16 +1070,28 @@ namespace asp {
 
     // Must use map-projected images if input DEM is provided
     GeoReference georef1, georef2;
-    bool has_georef1 = vw::cartography::read_georeference(georef1, opt.in_file1);
-    bool has_georef2 = vw::cartography::read_georeference(georef2, opt.in_file2);
+    bool has_georef1 = false, has_georef2 = false;
+    std::string proj4_str1, proj4_str2;
+    if (opt.snapshot.valid) {
+      has_georef1 = opt.snapshot.has_georef1;
+      has_georef2 = opt.snapshot.has_georef2;
+      proj4_str1  = opt.snapshot.proj4_str1;
+      proj4_str2  = opt.snapshot.proj4_str2;
+    } else {
+      has_georef1 = vw::cartography::read_georeference(georef1, opt.in_file1);
+      has_georef2 = vw::cartography::read_georeference(georef2, opt.in_file2);
+      if (has_georef1)
+        proj4_str1 = georef1.overall_proj4_str();
+      if (has_georef2)
+        proj4_str2 = georef2.overall_proj4_str();
+    }
     if (dem_provided && (!has_georef1 || !has_georef2)){
       vw_throw(ArgumentErr() << "The images are not map-projected, "
                 << "cannot use the provided DEM: " << opt.input_dem << "\n");
     }
 
     // If the images are map-projected, they need to use the same projection.
-    if (dem_provided &&
-        georef1.overall_proj4_str() != georef2.overall_proj4_str()){
+    if (dem_provided && proj4_str1 != proj4_str2){
       vw_throw(ArgumentErr() << "The left and right images must use the same projection.\n");
     }
 
@@ -879,9 +1103,11 @@ namespace asp {
     if (has_georef1 && has_georef2 && !dem_provided &&
         (opt.cam_file1 != opt.in_file1) && (opt.cam_file2 != opt.in_file2) &&
         !opt.cam_file1.empty() && !opt.cam_file2.empty() ) {
-        
-      vw_out() << "Georef 1: " << georef1 << std::endl;
-      vw_out() << "Georef 2: " << georef1 << std::endl;
+
+      if (!opt.snapshot.valid) {
+        vw_out() << "Georef 1: " << georef1 << std::endl;
+        vw_out() << "Georef 2: " << georef1 << std::endl;
+      }
       
       vw_out(WarningMessage) << "It appears that the input images are "
                              << "map-projected. In that case a DEM needs to be "
@@ -906,9 +1132,15 @@ namespace asp {
       // Given session XmapY make sure that the mapprojected images were
       // done with camera Y. Normally X equals Y, with the exceptions
       // of dgmaprpc, spot5maprpc, and astermaprpc.
-      std::string cam_tag = "CAMERA_MODEL_TYPE";
-      std::string l_cam_type = vw::cartography::read_header_string(opt.in_file1, cam_tag);
-      std::string r_cam_type = vw::cartography::read_header_string(opt.in_file2, cam_tag);
+      std::string l_cam_type, r_cam_type;
+      if (opt.snapshot.valid) {
+        l_cam_type = opt.snapshot.left_cam_type;
+        r_cam_type = opt.snapshot.right_cam_type;
+      } else {
+        std::string cam_tag = "CAMERA_MODEL_TYPE";
+        l_cam_type = vw::cartography::read_header_string(opt.in_file1, cam_tag);
+        r_cam_type = vw::cartography::read_header_string(opt.in_file2, cam_tag);
+      }
 
       // Extract the 'rpc' from 'rpcmaprpc' and 'dgmaprc', and 'pinhole' from 'pinholemappinhole'
       std::string tri_cam_type, mapproj_cam_type; 
@@ -1168,5 +1400,48 @@ namespace asp {
     // An external stereo algorithm
     return vw::stereo::VW_CORRELATION_OTHER;
   }
+
+  // Run as a persistent worker, reading tiles from standard input
+  void run_as_worker(std::function<void(std::string const& tile_prefix)> process_tile) {
+
+    // Each tile starts from the settings as they were after parsing the
+    // arguments, as processing a tile can modify them. The crop window is
+    // at this stage the full L.tif region, as no --trans-crop-win was passed.
+    StereoSettings orig_settings = stereo_settings();
+    BBox2i full_box = orig_settings.trans_crop_win;
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+
+      boost::trim(line);
+      if (line.empty())
+        continue;
+      if (line == "quit")
+        break;
+
+      int status = 0;
+      std::istringstream is(line);
+      std::string tile_prefix;
+      int x = 0, y = 0, w = 0, h = 0;
+      if (!(is >> tile_prefix >> x >> y >> w >> h)) {
+        vw_out(ErrorMessage) << "Could not parse tile job: " << line << "\n";
+        status = 1;
+      } else {
+        stereo_settings() = orig_settings;
+        BBox2i box(x, y, w, h);
+        box.crop(full_box);
+        stereo_settings().trans_crop_win = box;
+        try {
+          process_tile(tile_prefix);
+        } catch (std::exception const& e) {
+          vw_out(ErrorMessage) << "Processing tile " << tile_prefix << " failed: "
+                               << e.what() << "\n";
+          status = 1;
+        }
+      }
+
+      std::cout << WORKER_DONE_TAG << " " << status << std::endl; // this flushes
+    }
+  }
   
 } // end namespace asp
@@ -44,6 +44,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #else
 #include <ctime>
+#include <functional>
 #endif
 
 namespace po = boost::program_options;
@@ -81,6 +82,11 @@ namespace asp {
                         std::vector<std::string> & unregistered,
                         std::string & usage, bool exit_early = false);
 
+  /// Save what was resolved when parsing the options and checking the input
+  /// files, for the later stages and their tiles to load instead. Called
+  /// by stereo_pprc once L.tif is written. Failure is not fatal.
+  void save_settings_snapshot(ASPGlobalOptions const& opt);
+
   /// Register DiskImageResource types that are not included in Vision Workbench.
   void stereo_register_sessions();
 
@@ -96,6 +102,19 @@ namespace asp {
   // external algorithms will have to examine closer the algorithm
   // string. This function has a Python analog in parallel_stereo.
   vw::stereo::CorrelationAlgorithm stereo_alg_to_num(std::string alg);
+
+  /// The line a persistent worker prints after each tile, followed by the
+  /// status (0 for success). Must be kept in sync with parallel_stereo.
+  const std::string WORKER_DONE_TAG = "asp_worker_done";
+
+  /// Run as a persistent worker, with --worker-mode. The options and cameras
+  /// are loaded once. Then tiles are read from standard input, one per line,
+  /// as "tile_prefix xoff yoff xsize ysize". For each one the stereo settings
+  /// are restored to their values at startup, the crop window is set, and
+  /// process_tile() is called with the tile output prefix. After each tile
+  /// the line WORKER_DONE_TAG and a status is printed. Stop at end of input
+  /// or when the line "quit" is read.
+  void run_as_worker(std::function<void(std::string const& tile_prefix)> process_tile);
   
 } // end namespace vw
 
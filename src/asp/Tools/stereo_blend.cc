@@ -34,6 +34,11 @@
 // tiles which overlap with the inner area of the current tile, and
 // blend the results.
 
+// With --blend-all-tiles, as invoked by parallel_stereo, this is done
+// for all tiles in one pass, ordered by tile row, so each tile is read
+// only once. Otherwise only the tile for the given output prefix is
+// blended, which reads its neighbors as well.
+
 #include <vw/Image/ImageMath.h>
 #include <vw/FileIO/DiskImageUtils.h>
 
@@ -41,6 +46,8 @@
 #include <asp/Tools/stereo.h>
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
+
 using namespace vw;
 using namespace vw::stereo;
 using namespace asp;
@@ -54,8 +61,9 @@ const int NUM_NEIGHBORS = 8;
 
 // Enum for the tiles. We count later on on the fact that the
 // neighbors have indices in [0, 7]. TILE_M is the main tile and the
-// others are its neighbors.
-enum TilePosition {TILE_M = -1,
+// others are its neighbors. TILE_NONE is for a tile which does not touch
+// the main tile.
+enum TilePosition {TILE_NONE = -2, TILE_M = -1,
                    TILE_TL = 0, TILE_T = 1, TILE_TR = 2,
                    TILE_L  = 3,             TILE_R  = 4,
                    TILE_BL = 5, TILE_B = 6, TILE_BR = 7};
@@ -84,6 +92,56 @@ BBox2i bbox_from_folder(std::string const& s, std::string const& in_file) {
   return BBox2i(x, y, width, height);
 }
 
+/// The position of a tile relative to the main tile, given their boxes
+/// without padding. Tiles which do not touch the main tile get TILE_NONE.
+TilePosition neighbor_position(BBox2i const& main_bbox, BBox2i const& bbox) {
+
+  if (bbox.max().x() == main_bbox.min().x()) { // Tiles one column to left
+    if (bbox.max().y() == main_bbox.min().y()) return TILE_TL;
+    if (bbox.min().y() == main_bbox.min().y()) return TILE_L;
+    if (bbox.min().y() == main_bbox.max().y()) return TILE_BL;
+  }
+
+  if (bbox.min().x() == main_bbox.max().x()) { // Tiles one column to right
+    if (bbox.max().y() == main_bbox.min().y()) return TILE_TR;
+    if (bbox.min().y() == main_bbox.min().y()) return TILE_R;
+    if (bbox.min().y() == main_bbox.max().y()) return TILE_BR;
+  }
+
+  if (bbox.min().x() == main_bbox.min().x()) { // Tiles in same column
+    if (bbox.max().y() == main_bbox.min().y()) return TILE_T;
+    if (bbox.min().y() == main_bbox.max().y()) return TILE_B;
+  }
+
+  return TILE_NONE;
+}
+
+/// Read the list of tile directories made by parallel_stereo
+std::vector<std::string> read_dir_list(std::string const& out_prefix) {
+
+  // This must be sync-ed up with parallel_stereo.
+  std::vector<std::string> folder_list;
+  std::string dir;
+  std::string dirList = out_prefix + "-dirList.txt";
+  std::ifstream ifs(dirList.c_str());
+  while (ifs >> dir){
+    folder_list.push_back(dir);
+  }
+  ifs.close();
+  if (folder_list.empty()) 
+    vw_throw(ArgumentErr() << "Something is corrupted. Found an empty file: "
+             << dirList << ".\n");
+
+  return folder_list;
+}
+
+/// The path to a given file in a tile directory
+std::string tile_file(std::string const& folder, std::string const& file) {
+  // Note that the folder already has the output prefix relative to the
+  // directory parallel_stereo runs in.
+  return folder + "/" + extract_process_folder_bbox_string(folder, file) + "-" + file;
+}
+
 // Load an image and form its weights
 bool load_image_and_weights(std::string const& file_path,
                             ImageView<MaskedPixType> & image, WeightsType & weights,
@@ -203,26 +261,8 @@ void fill_blend_options(ASPGlobalOptions const& opt, std::string const& in_file,
   
   blend_opt.main_path = opt.out_prefix + "-" + in_file;
 
-  // Get the top level output folder for parallel_stereo
-  boost::filesystem::path parallel_stereo_folder(opt.out_prefix);
-
-  // This wrong, as it assumes that out_prefix always looks like path1/path2.
-  // What if it is path1/path2/path3. 
-  parallel_stereo_folder = parallel_stereo_folder.parent_path().parent_path();
-
-  // This must be sync-ed up with parallel_stereo. Read the list of
-  // dirs that parallel_stereo made.
-  std::vector<std::string> folder_list;
-  std::string dir;
-  std::string dirList = opt.out_prefix + "-dirList.txt";
-  std::ifstream ifs(dirList.c_str());
-  while (ifs >> dir){
-    folder_list.push_back(dir);
-  }
-  ifs.close();
-  if (folder_list.empty()) 
-    vw_throw(ArgumentErr() << "Something is corrupted. Found an empty file: "
-             << dirList << ".\n");
+  // Read the list of dirs that parallel_stereo made
+  std::vector<std::string> folder_list = read_dir_list(opt.out_prefix);
   
   // Get the main tile bbox from the subfolder name
   boost::filesystem::path mpath(blend_opt.main_path);
@@ -237,62 +277,18 @@ void fill_blend_options(ASPGlobalOptions const& opt, std::string const& in_file,
   // Figure out where each folder goes
   for (size_t i = 0; i < folder_list.size(); i++) {
     BBox2i bbox = bbox_from_folder(folder_list[i], in_file);
+    const std::string abs_path = tile_file(folder_list[i], in_file);
 
-    std::string bbox_string = extract_process_folder_bbox_string(folder_list[i], in_file);
-    
-    // Note that folder_list[i] already has the output prefix relative to the
-    // directory parallel_stereo runs in.
-    const std::string abs_path =
-      folder_list[i] + "/" + bbox_string + "-" + in_file;
-
-    if (bbox.max().x() == main_bbox.min().x()) { // Tiles one column to left
-      if (bbox.max().y() == main_bbox.min().y()) { // Top left
-        blend_opt.neib_path[TILE_TL] = abs_path;
-        blend_opt.neib_roi [TILE_TL] = bbox;
-        continue;
-      }
-      if (bbox.min().y() == main_bbox.min().y()) { // Left
-        blend_opt.neib_path[TILE_L] = abs_path;
-        blend_opt.neib_roi [TILE_L] = bbox;
-        continue;
-      }
-      if (bbox.min().y() == main_bbox.max().y()) { // Bot left
-        blend_opt.neib_path[TILE_BL] = abs_path;
-        blend_opt.neib_roi [TILE_BL] = bbox;
-        continue;
-      }
-    } // End left tiles
-    
-    if (bbox.min().x() == main_bbox.max().x()) { // Tiles one column to right
-      if (bbox.max().y() == main_bbox.min().y()) { // Top right
-        blend_opt.neib_path[TILE_TR] = abs_path;
-        blend_opt.neib_roi [TILE_TR] = bbox;
-        continue;
-      }
-      if (bbox.min().y() == main_bbox.min().y()) { // Right
-        blend_opt.neib_path[TILE_R] = abs_path;
-        blend_opt.neib_roi [TILE_R] = bbox;
-        continue;
-      }
-      if (bbox.min().y() == main_bbox.max().y()) { // Bot right
-        blend_opt.neib_path[TILE_BR] = abs_path;
-        blend_opt.neib_roi [TILE_BR] = bbox;
-        continue;
-      }
-    } // End right tiles
-    
-    if (bbox.min().x() == main_bbox.min().x()) { // Tiles in same column
-      if (bbox.max().y() == main_bbox.min().y()) { // Top
-        blend_opt.neib_path[TILE_T] = abs_path;
-        blend_opt.neib_roi [TILE_T] = bbox;
-        continue;
-      }
-      if (bbox.min().y() == main_bbox.max().y()) { // Bottom
-        blend_opt.neib_path[TILE_B] = abs_path;
-        blend_opt.neib_roi [TILE_B] = bbox;
-        continue;
-      }
-    }
+    // parallel_stereo does not process tiles with no valid data
+    if (!boost::filesystem::exists(abs_path))
+      continue;
+
+    TilePosition pos = neighbor_position(main_bbox, bbox);
+    if (pos == TILE_NONE)
+      continue;
+
+    blend_opt.neib_path[pos] = abs_path;
+    blend_opt.neib_roi [pos] = bbox;
   }
 
   // Compute the padded box for each neighbor
@@ -321,6 +317,71 @@ bool invalid_image(ImageView<MaskedPixType> const& image) {
   return true;
 }
 
+/// Start a blended tile as invalid and zero, with zero weights. It will be
+/// used to accumulate the weighted disparities.
+void init_blend(BBox2i const& roi, ImageView<MaskedPixType> & output_image,
+                WeightsType & output_weights) {
+  output_image.set_size(roi.width(), roi.height());
+  output_weights.set_size(roi.width(), roi.height());
+  for (int col = 0; col < output_image.cols(); col++) {
+    for (int row = 0; row < output_image.rows(); row++) {
+      output_image(col, row) = MaskedPixType(); 
+      output_image(col, row).invalidate();
+      output_weights(col, row) = 0.0; 
+    }
+  }
+}
+
+/// Add to the blended tile with region of interest roi the weighted
+/// pixels of an image whose extent in the full image is image_box.
+/// Padded tiles can overlap only partially with the region of interest,
+/// so only the overlap is visited.
+void accumulate_blend(ImageView<MaskedPixType> const& image, WeightsType const& weights,
+                      BBox2i const& image_box, BBox2i const& roi,
+                      ImageView<MaskedPixType> & output_image,
+                      WeightsType & output_weights) {
+
+  if (!image_box.intersects(roi))
+    return;
+  BBox2i box = image_box;
+  box.crop(roi);
+
+  for (int col = box.min().x(); col < box.max().x(); col++) {
+    for (int row = box.min().y(); row < box.max().y(); row++) {
+
+      // Convert the pixel to the coordinate systems of the image and the output
+      int ic = col - image_box.min().x(), ir = row - image_box.min().y();
+      int oc = col - roi.min().x(),       orow = row - roi.min().y();
+
+      if (!is_valid(image(ic, ir)) || weights(ic, ir) <= 0.0) 
+        continue; // No useful info
+
+      output_image(oc, orow).validate();
+      output_image(oc, orow)   += weights(ic, ir) * image(ic, ir);
+      output_weights(oc, orow) += weights(ic, ir);
+    }
+  }
+}
+
+/// Divide the accumulated disparities by the accumulated weights
+void normalize_blend(ImageView<MaskedPixType> & output_image,
+                     WeightsType const& output_weights) {
+  for (int col = 0; col < output_image.cols(); col++) {
+    for (int row = 0; row < output_image.rows(); row++) {
+      
+      if (!is_valid(output_image(col, row)))
+        continue;
+      
+      if (output_weights(col, row) <= 0) {
+        output_image(col, row).invalidate();
+        continue;
+      }
+      
+      output_image(col, row) /= output_weights(col, row);
+    }
+  }
+}
+
 /// Blend the borders of the main tile using the neighboring
 /// tiles.
 /// While all the main tile and neighbor tiles have padding, we will save
@@ -336,23 +397,10 @@ ImageView<MaskedPixType> tile_blend(ASPGlobalOptions const& opt,
   has_nodata = false;
   nodata_value = -32768.0;
 
-  // Start the output image as invalid and zero. It will be used to
-  // accumulate the weighted disparities.
-  ImageView<MaskedPixType> output_image(blend_opt.main_roi.width(), blend_opt.main_roi.height()); 
-  for (int col = 0; col < output_image.cols(); col++) {
-    for (int row = 0; row < output_image.rows(); row++) {
-      output_image(col, row) = MaskedPixType(); 
-      output_image(col, row).invalidate();
-    }
-  }
-  
-  // Accumulate here the weights
-  WeightsType output_weights(blend_opt.main_roi.width(), blend_opt.main_roi.height());
-  for (int col = 0; col < output_weights.cols(); col++) {
-    for (int row = 0; row < output_weights.rows(); row++) {
-      output_weights(col, row) = 0.0; 
-    }
-  }
+  // Start the output image as invalid and zero, and accumulate here the weights
+  ImageView<MaskedPixType> output_image;
+  WeightsType output_weights;
+  init_blend(blend_opt.main_roi, output_image, output_weights);
 
   // Add the contribution from the main tile and neighboring tiles. Note
   // that i = -1 corresponds to the main tile.
@@ -405,47 +453,51 @@ ImageView<MaskedPixType> tile_blend(ASPGlobalOptions const& opt,
     }
 
     // Do the blending, either with the main or neighboring tiles
-    for (int col = 0; col < output_image.cols(); col++) {
-      for (int row = 0; row < output_image.rows(); row++) {
-
-        // Convert the given pixel to the coordinate system of the full image
-        Vector2 pix = Vector2(col, row) + blend_opt.main_roi.min();
-
-        // Convert the pixel to the coordinate system of the current padded tile
-        pix = pix - padded_box.min();
-
-        // Padded tiles can overlap only partially with the central region of the main
-        // tile. If not in the overlap region, skip the work.
-        if (!vw::bounding_box(image).contains(pix)) 
-          continue;
+    accumulate_blend(image, weights, padded_box, blend_opt.main_roi,
+                     output_image, output_weights);
+  }
+  
+  normalize_blend(output_image, output_weights);
+  
+  return output_image;
+}
 
-        if (!is_valid(image(pix[0], pix[1])) || weights(pix[0], pix[1]) <= 0.0) 
-          continue; // No useful info
+/// Write a blended tile, as a disparity or as a single-channel image
+void write_blended_tile(ASPGlobalOptions const& opt, std::string const& out_file,
+                        ImageView<MaskedPixType> const& blended_disp,
+                        int num_channels, bool has_nodata, float nodata,
+                        bool has_left_georef,
+                        cartography::GeoReference const& left_georef) {
 
-        output_image(col, row).validate();
-        output_image(col, row)   += weights(pix[0], pix[1]) * image(pix[0], pix[1]);
-        output_weights(col, row) += weights(pix[0], pix[1]);
-      }
-    }
+  // Sanity check
+  if (num_channels == 1 && !has_nodata) {
+    vw_throw(ArgumentErr() << "stereo_blend: For a single-channel image "
+             << "expecting to have a no-data value in order to keep track of invalid pixels.");
   }
-  
-  // Normalize
-  for (int col = 0; col < output_image.cols(); col++) {
-    for (int row = 0; row < output_image.rows(); row++) {
-      
-      if (!is_valid(output_image(col, row)))
-        continue;
-      
-      if (output_weights(col, row) <= 0) {
-        output_image(col, row).invalidate();
-        continue;
+
+  vw_out() << "Writing: " << out_file << "\n";
+  if (num_channels == 3) {
+    // Write the blended disparity
+    vw::cartography::block_write_gdal_image(out_file, blended_disp,
+                                            has_left_georef, left_georef,
+                                            has_nodata, nodata, opt,
+                                            TerminalProgressCallback("asp", "\t--> Blending :"));
+  } else if (num_channels == 1) {
+    // Write a single-channel image with no-data
+    ImageView<float> image(blended_disp.cols(), blended_disp.rows());
+    for (int col = 0; col < image.cols(); col++) {
+      for (int row = 0; row < image.rows(); row++) {
+        if (is_valid(blended_disp(col, row))) 
+          image(col, row) = blended_disp(col, row).child()[0];
+        else
+          image(col, row) = nodata;
       }
-      
-      output_image(col, row) /= output_weights(col, row);
     }
+    vw::cartography::block_write_gdal_image(out_file, image,
+                                            has_left_georef, left_georef,
+                                            has_nodata, nodata, opt,
+                                            TerminalProgressCallback("asp", "\t--> Blending:"));
   }
-  
-  return output_image;
 }
 
 void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
@@ -469,35 +521,159 @@ void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
                                                      // These will change
                                                      num_channels, has_nodata, nodata);
 
-  // Sanity check
-  if (num_channels == 1 && !has_nodata) {
-    vw_throw(ArgumentErr() << "stereo_blend: For a single-channel image "
-             << "expecting to have a no-data value in order to keep track of invalid pixels.");
+  write_blended_tile(opt, opt.out_prefix + "-" + out_file, blended_disp,
+                     num_channels, has_nodata, nodata, has_left_georef, left_georef);
+}
+
+// A tile when blending all tiles in one pass. The blend is accumulated
+// in place, then normalized and written.
+struct BlendTile {
+  std::string in_path, out_path;
+  BBox2i      roi, padded;      // the region of interest, without and with padding
+  ImageView<MaskedPixType> blend;
+  WeightsType weights;
+  bool        has_valid_roi;    // if the tile has valid pixels without its padding
+  int         num_channels;
+  bool        has_nodata;
+  float       nodata_value;
+};
+
+// The weighted padding of a tile below its region of interest, which is
+// kept until the tiles of the next tile row are blended
+struct BlendStrip {
+  BBox2i roi, box;              // the tile region of interest and the strip extent
+  ImageView<MaskedPixType> image;
+  WeightsType weights;
+};
+
+/// Blend all tiles made by parallel_stereo in one pass. The tiles are
+/// visited by tile row, and each is read from disk only once, rather
+/// than once for itself and once for each of its neighbors. It is added
+/// to its own blend and to those of its neighbors in the same and the
+/// previous tile row, and its bottom padding is kept in memory for the
+/// next tile row. A tile row is written once the row below it was read,
+/// so at most two tile rows of blends and one of padding are kept.
+void blend_all_tiles(ASPGlobalOptions const& opt, std::string const& in_file,
+                     std::string const& out_file) {
+
+  BlendOptions blend_opt;
+  std::string left_image = opt.out_prefix + "-L.tif";
+  Vector2i full_image_size = file_image_size(left_image);
+  blend_opt.full_box = BBox2i(0, 0, full_image_size.x(), full_image_size.y());
+  blend_opt.pad_size = stereo_settings().sgm_collar_size;
+
+  cartography::GeoReference left_georef;
+  bool has_left_georef = read_georeference(left_georef, left_image);
+
+  // The tiles with data, sorted by tile row, and then by column
+  std::vector<std::string> folder_list = read_dir_list(opt.out_prefix);
+  std::vector<BlendTile> tiles;
+  for (size_t i = 0; i < folder_list.size(); i++) {
+    BlendTile tile;
+    tile.in_path = tile_file(folder_list[i], in_file);
+
+    // parallel_stereo does not process tiles with no valid data
+    if (!boost::filesystem::exists(tile.in_path))
+      continue;
+
+    tile.out_path      = tile_file(folder_list[i], out_file);
+    tile.roi           = bbox_from_folder(folder_list[i], in_file);
+    tile.padded        = blend_opt.add_padding(tile.roi);
+    tile.has_valid_roi = false;
+    tile.num_channels  = 1;
+    tile.has_nodata    = false;
+    tile.nodata_value  = -32768.0;
+    check_size(tile.padded, tile.in_path);
+    tiles.push_back(tile);
+  }
+  std::sort(tiles.begin(), tiles.end(), [](BlendTile const& a, BlendTile const& b) {
+      if (a.roi.min().y() != b.roi.min().y())
+        return a.roi.min().y() < b.roi.min().y();
+      return a.roi.min().x() < b.roi.min().x();
+    });
+
+  std::vector<std::vector<BlendTile>> rows;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    if (rows.empty() || rows.back()[0].roi.min().y() != tiles[i].roi.min().y())
+      rows.push_back(std::vector<BlendTile>());
+    rows.back().push_back(tiles[i]);
   }
+  tiles.clear();
+
+  std::vector<BlendStrip> strips;
+  for (size_t r = 0; r <= rows.size(); r++) {
+
+    if (r < rows.size()) {
+      std::vector<BlendTile> & row = rows[r];
+      for (size_t t = 0; t < row.size(); t++)
+        init_blend(row[t].roi, row[t].blend, row[t].weights);
+
+      // The padding of the tiles in the previous row reaching into this row
+      for (size_t s = 0; s < strips.size(); s++) {
+        for (size_t t = 0; t < row.size(); t++) {
+          if (neighbor_position(row[t].roi, strips[s].roi) != TILE_NONE)
+            accumulate_blend(strips[s].image, strips[s].weights, strips[s].box,
+                             row[t].roi, row[t].blend, row[t].weights);
+        }
+      }
+      strips.clear();
+
+      for (size_t t = 0; t < row.size(); t++) {
+        BlendTile & tile = row[t];
+        ImageView<MaskedPixType> image;
+        WeightsType weights;
+        load_image_and_weights(tile.in_path, image, weights,
+                               tile.num_channels, tile.has_nodata, tile.nodata_value);
+        tile.has_valid_roi = !invalid_image(crop(image, tile.roi - tile.padded.min()));
+
+        // The tile itself, and its neighbors in this and the previous row
+        accumulate_blend(image, weights, tile.padded, tile.roi, tile.blend, tile.weights);
+        for (size_t n = 0; n < row.size(); n++) {
+          if (n != t && neighbor_position(row[n].roi, tile.roi) != TILE_NONE)
+            accumulate_blend(image, weights, tile.padded, row[n].roi,
+                             row[n].blend, row[n].weights);
+        }
+        for (size_t n = 0; r > 0 && n < rows[r-1].size(); n++) {
+          BlendTile & prev = rows[r-1][n];
+          if (neighbor_position(prev.roi, tile.roi) != TILE_NONE)
+            accumulate_blend(image, weights, tile.padded, prev.roi,
+                             prev.blend, prev.weights);
+        }
 
-  std::string full_out_file = opt.out_prefix + "-" + out_file;
-  vw_out() << "Writing: " << full_out_file << "\n";
-  if (num_channels == 3) {
-    // Write the blended disparity
-    vw::cartography::block_write_gdal_image(full_out_file, blended_disp,
-                                            has_left_georef, left_georef,
-                                            has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Blending :"));
-  } else if (num_channels == 1) {
-    // Write a single-channel image with no-data
-    ImageView<float> image(blended_disp.cols(), blended_disp.rows());
-    for (int col = 0; col < image.cols(); col++) {
-      for (int row = 0; row < image.rows(); row++) {
-        if (is_valid(blended_disp(col, row))) 
-          image(col, row) = blended_disp(col, row).child()[0];
-        else
-          image(col, row) = nodata;
+        // Keep the padding below the tile for the next row
+        int strip_height = tile.padded.max().y() - tile.roi.max().y();
+        if (strip_height > 0) {
+          BlendStrip strip;
+          strip.roi     = tile.roi;
+          strip.box     = BBox2i(tile.padded.min().x(), tile.roi.max().y(),
+                                 tile.padded.width(), strip_height);
+          strip.image   = crop(image, strip.box - tile.padded.min());
+          strip.weights = crop(weights, strip.box - tile.padded.min());
+          strips.push_back(strip);
+        }
       }
     }
-    vw::cartography::block_write_gdal_image(full_out_file, image,
-                                            has_left_georef, left_georef,
-                                            has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Blending:"));
+
+    // The previous row got the contributions of all its neighbors
+    if (r == 0)
+      continue;
+    std::vector<BlendTile> & prev_row = rows[r-1];
+    for (size_t t = 0; t < prev_row.size(); t++) {
+      BlendTile & tile = prev_row[t];
+
+      // If there are no valid pixels in the tile without its padding,
+      // write an invalid blended tile.
+      if (!tile.has_valid_roi)
+        init_blend(tile.roi, tile.blend, tile.weights);
+
+      normalize_blend(tile.blend, tile.weights);
+      write_blended_tile(opt, tile.out_path, tile.blend, tile.num_channels,
+                         tile.has_nodata, tile.nodata_value, has_left_georef, left_georef);
+
+      // Free the memory
+      tile.blend   = ImageView<MaskedPixType>();
+      tile.weights = WeightsType();
+    }
   }
 }
 
@@ -526,17 +702,27 @@ int main(int argc, char* argv[]) {
     std::string in_file =  "Dnosym.tif";
 
     string out_file = "B.tif";
-    if (stereo_settings().subpixel_mode > 6){
+    if (stereo_settings().subpixel_mode > 6 && stereo_settings().subpixel_mode <= 12){
       // No further subpixel refinement, skip to the -RD output.
       out_file = "RD.tif";
     }
-    stereo_blending(opt, in_file, out_file);
+
+    // Either blend all tiles in one pass, when invoked with the top-level
+    // output prefix, or blend the tile for the given tile prefix.
+    bool all_tiles = stereo_settings().blend_all_tiles;
+    if (all_tiles)
+      blend_all_tiles(opt, in_file, out_file);
+    else
+      stereo_blending(opt, in_file, out_file);
 
     // See if to also blend L-R disp differences
     if (stereo_settings().save_lr_disp_diff) {
       in_file  = "L-R-disp-diff.tif";
       out_file = "L-R-disp-diff-blend.tif";
-      stereo_blending(opt, in_file, out_file);
+      if (all_tiles)
+        blend_all_tiles(opt, in_file, out_file);
+      else
+        stereo_blending(opt, in_file, out_file);
     }
     
     vw_out() << "\n[ " << current_posix_time_string() << " ] : BLENDING FINISHED\n";
@@ -24,14 +24,23 @@
 #include <vw/Core/StringUtils.h>
 #include <vw/InterestPoint/Matcher.h>
 #include <vw/Stereo/Correlation.h>
+#include <vw/Image/BlockRasterize.h>
 
 #include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/ShmBlockCache.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
 #include <asp/Core/LocalAlignment.h>
+#include <asp/Core/SgmGpu.h>
+#include <asp/Core/AsyncPrefetcher.h>
 #include <asp/Sessions/StereoSession.h>
+#include <asp/Camera/RPCModel.h>
 #include <asp/Tools/stereo.h>
+#include <asp/Core/MatchFile.h>
+#include <asp/Core/Telemetry.h>
+#include <asp/Core/Trace.h>
+#include <asp/Core/ProgressStatus.h>
 
 #include <boost/process.hpp>
 #include <boost/process/env.hpp>
@@ -91,6 +100,106 @@ void read_search_range_from_D_sub(std::string const& d_sub_file, ASPGlobalOption
   vw_out() << "\t--> Full-res search range based on D_sub: " << search_range << "\n";
 }
 
+// The tiles in which D_sub is found on multiple threads, and the padding
+// of each tile for SGM and MGM, so that the tiles agree at their seams.
+// These are in the pixels of the subsampled images.
+const int D_SUB_TILE_SIZE   = 256;
+const int D_SUB_SGM_PADDING = 64;
+
+/// Rasterize the low-resolution correlation view on multiple threads, a
+/// tile at a time. Each tile builds its own pyramid, so the search range
+/// is narrowed level by level for each part of the image separately. For
+/// SGM and MGM each tile is correlated with padding which is then discarded.
+ImageView<PixelMask<Vector2f>>
+threaded_lowres_correlation(ImageViewRef<PixelMask<Vector2f>> const& corr_view,
+                            vw::stereo::CorrelationAlgorithm stereo_alg) {
+
+  int padding = 0;
+  if (stereo_alg != vw::stereo::VW_CORRELATION_BM)
+    padding = D_SUB_SGM_PADDING;
+
+  BBox2i full_box = bounding_box(corr_view);
+  std::vector<BBox2i> tiles = subdivide_bbox(corr_view, D_SUB_TILE_SIZE, D_SUB_TILE_SIZE);
+  int num_threads = std::max(1, int(vw_settings().default_num_threads()));
+  vw_out() << "Finding D_sub in " << tiles.size() << " tiles using "
+           << num_threads << " threads.\n";
+
+  ImageView<PixelMask<Vector2f>> d_sub(corr_view.cols(), corr_view.rows());
+  TerminalProgressCallback tpc("asp", "\t--> Low-resolution correlation: ");
+  tpc.report_progress(0);
+  int num_done = 0;
+  std::string error;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (size_t it = 0; it < tiles.size(); it++) {
+    try {
+      BBox2i padded_box = tiles[it];
+      padded_box.expand(padding);
+      padded_box.crop(full_box);
+      ImageView<PixelMask<Vector2f>> padded_tile = crop(corr_view, padded_box);
+      crop(d_sub, tiles[it])
+        = crop(padded_tile, tiles[it] - padded_box.min());
+    } catch (std::exception const& e) {
+#pragma omp critical
+      error = e.what();
+    }
+#pragma omp critical
+    {
+      num_done++;
+      tpc.report_progress(double(num_done) / tiles.size());
+    }
+  }
+  tpc.report_finished();
+
+  if (error != "")
+    vw_throw(ArgumentErr() << "Low-resolution correlation failed. " << error);
+
+  return d_sub;
+}
+
+/// Find D_sub with asp_sgm_gpu, for the whole subsampled images at once.
+/// Returns false if the GPU cannot handle it, and then the CPU will be used.
+bool gpu_lowres_correlation(ImageViewRef<PixelGray<float>> left_sub,
+                            ImageViewRef<PixelGray<float>> right_sub,
+                            ImageViewRef<uint8> left_mask_sub,
+                            ImageViewRef<uint8> right_mask_sub,
+                            BBox2 const& search_range, Vector2i const& kernel_size,
+                            ImageView<PixelMask<Vector2f>> & d_sub) {
+
+  BBox2i search_box(floor(search_range.min()), ceil(search_range.max()));
+  Vector2i half_kernel = kernel_size / 2;
+  BBox2i left_box = bounding_box(left_sub);
+  left_box.expand(half_kernel);
+  BBox2i right_box(left_box.min() + search_box.min(),
+                   left_box.max() + search_box.max());
+
+  ImageView<PixelGray<float>> left
+    = crop(edge_extend(left_sub, ConstantEdgeExtension()), left_box);
+  ImageView<PixelGray<float>> right
+    = crop(edge_extend(right_sub, ConstantEdgeExtension()), right_box);
+  ImageView<vw::uint8> left_mask
+    = crop(edge_extend(left_mask_sub, ZeroEdgeExtension()), left_box);
+  ImageView<vw::uint8> right_mask
+    = crop(edge_extend(right_mask_sub, ZeroEdgeExtension()), right_box);
+
+  bool subpixel = (get_sgm_subpixel_mode() != SemiGlobalMatcher::SUBPIXEL_NONE);
+  int lr_threshold = -1; // no left-right check
+  if (stereo_settings().xcorr_threshold >= 0)
+    lr_threshold = int(round(stereo_settings().xcorr_threshold));
+  ImageView<PixelMask<Vector2f>> padded_disp;
+  std::string error;
+  if (!asp::sgm_gpu_correlate(left, right, left_mask, right_mask, search_box,
+                              kernel_size, stereo_settings().cost_mode,
+                              stereo_settings().sgm_gpu_num_paths, subpixel,
+                              lr_threshold, padded_disp, error)) {
+    vw_out(WarningMessage) << "Cannot find D_sub on the GPU. " << error
+                           << " Using the CPU instead.\n";
+    return false;
+  }
+
+  d_sub = crop(padded_disp, BBox2i(half_kernel, half_kernel + Vector2i(left_sub.cols(), left_sub.rows())));
+  return true;
+}
+
 /// Produces the low-resolution disparity file D_sub
 void produce_lowres_disparity(ASPGlobalOptions & opt) {
 
@@ -165,9 +274,10 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
       blob_filter_area = 0;
     }
 
-    // Process the entire D_sub in memory as it is small enough
-    int collar_size = 0; // Since there won't be tiles as the all the processing is done at once
-    ImageView<PixelMask<Vector2f>> d_sub =
+    // D_sub is small enough to be kept in memory. It is found in tiles, on
+    // multiple threads, or on the GPU with asp_sgm_gpu.
+    int collar_size = 0; // The tiles are handled by threaded_lowres_correlation()
+    ImageViewRef<PixelMask<Vector2f>> corr_view =
       vw::stereo::pyramid_correlate
       (// Compute image correlation using the PyramidCorrelationView class
        left_sub, right_sub, left_mask_sub, right_mask_sub,
@@ -178,6 +288,14 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
        collar_size, sgm_subpixel_mode, sgm_search_buffer, stereo_settings().corr_memory_limit_mb,
        blob_filter_area, lr_disp_diff, region_ul, stereo_settings().stereo_debug);
 
+    ImageView<PixelMask<Vector2f>> d_sub;
+    bool done_on_gpu = false;
+    if (asp::is_sgm_gpu_alg(stereo_settings().stereo_algorithm))
+      done_on_gpu = gpu_lowres_correlation(left_sub, right_sub, left_mask_sub, right_mask_sub,
+                                           search_range, kernel_size, d_sub);
+    if (!done_on_gpu)
+      d_sub = threaded_lowres_correlation(corr_view, stereo_alg);
+
     if (stereo_settings().rm_quantile_multiple <= 0.0) {
       // Filter D_sub using thresholds (the default)
       d_sub = rm_outliers_using_thresh
@@ -239,8 +357,21 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
 
     // Use a DEM to get the low-res disparity
     boost::shared_ptr<camera::CameraModel> left_camera_model, right_camera_model;
-    opt.session->camera_models(left_camera_model, right_camera_model);
-    produce_dem_disparity(opt, left_camera_model, right_camera_model, opt.session->name());
+    opt.session->instrumented_camera_models(left_camera_model, right_camera_model,
+                                            "stereo_corr.dem_seed");
+
+    // An RPC right camera projects the points of each tile at once
+    BatchPointToPixel right_batch_point_to_pixel;
+    boost::shared_ptr<asp::RPCModel> right_rpc
+      = boost::dynamic_pointer_cast<asp::RPCModel>(right_camera_model);
+    if (right_rpc)
+      right_batch_point_to_pixel = [right_rpc](std::vector<Vector3> const& points,
+                                               std::vector<Vector2> & pixels) {
+        right_rpc->points_to_pixels(points, pixels);
+      };
+
+    produce_dem_disparity(opt, left_camera_model, right_camera_model, opt.session->name(),
+                          right_batch_point_to_pixel);
     
   }else if (stereo_settings().seed_mode == 3) {
     // D_sub is already generated by now by sparse_disp
@@ -417,7 +548,7 @@ BBox2 approximate_search_range(ASPGlobalOptions & opt, std::string const& match_
     vw_throw(ArgumentErr() << "Missing IP file: " << match_filename);
   
   vw_out() << "\t    * Loading match file: " << match_filename << "\n";
-  ip::read_binary_match_file(match_filename, in_left_ip, in_right_ip);
+  asp::read_match_file(match_filename, in_left_ip, in_right_ip);
 
   // TODO(oalexan1): Add here filter_ip_using_cameras, but take into account
   // that the datum may not exist!
@@ -708,6 +839,11 @@ class SeededCorrelatorView: public ImageViewBase<SeededCorrelatorView> {
   int      m_corr_timeout;
   double   m_seconds_per_op;
   Vector2  m_region_ul; // the upper-left corner of the region containing all pixels to process
+
+  // Reading ahead
+  boost::shared_ptr<asp::AsyncPrefetcher> m_prefetcher;
+  BBox2i   m_prefetch_region;
+  int      m_prefetch_tile_size, m_prefetch_ahead;
 public:
 
   // Set these input types here instead of making them template arguments
@@ -733,7 +869,8 @@ public:
     m_sub_disp(sub_disp.impl()), m_sub_disp_spread(sub_disp_spread.impl()),
     m_kernel_size(kernel_size),  m_cost_mode(cost_mode),
     m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op),
-    m_region_ul(region_ul), m_lr_disp_diff(lr_disp_diff) {
+    m_region_ul(region_ul), m_lr_disp_diff(lr_disp_diff),
+    m_prefetch_tile_size(0), m_prefetch_ahead(0) {
     m_upscale_factor[0] = double(m_left_image.cols()) / m_sub_disp.cols();
     m_upscale_factor[1] = double(m_left_image.rows()) / m_sub_disp.rows();
     m_seed_bbox = bounding_box(m_sub_disp);
@@ -755,14 +892,51 @@ public:
     return pixel_type();
   }
 
-  /// Does the work
-  typedef CropView<ImageView<pixel_type>> prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+  /// Correlate a tile with asp_sgm_gpu. The left region is padded by half the
+  /// census window and the right region also covers the search range. Returns
+  /// false if the GPU cannot handle this tile, and then the CPU will be used.
+  bool gpu_correlate(BBox2i const& bbox, BBox2 const& search_range,
+                     ImageView<pixel_type> & disp) const {
+
+    BBox2i search_box(floor(search_range.min()), ceil(search_range.max()));
+    Vector2i half_kernel = m_kernel_size / 2;
+    BBox2i left_box = bbox;
+    left_box.expand(half_kernel);
+    BBox2i right_box(left_box.min() + search_box.min(),
+                     left_box.max() + search_box.max());
+
+    ImageView<PixelGray<float>> left
+      = crop(edge_extend(m_left_image, ConstantEdgeExtension()), left_box);
+    ImageView<PixelGray<float>> right
+      = crop(edge_extend(m_right_image, ConstantEdgeExtension()), right_box);
+    ImageView<vw::uint8> left_mask
+      = crop(edge_extend(m_left_mask, ZeroEdgeExtension()), left_box);
+    ImageView<vw::uint8> right_mask
+      = crop(edge_extend(m_right_mask, ZeroEdgeExtension()), right_box);
+
+    bool subpixel = (get_sgm_subpixel_mode() != SemiGlobalMatcher::SUBPIXEL_NONE);
+    int lr_threshold = -1; // no left-right check
+    if (stereo_settings().xcorr_threshold >= 0)
+      lr_threshold = int(round(stereo_settings().xcorr_threshold));
+    ImageView<pixel_type> padded_disp;
+    std::string error;
+    if (!asp::sgm_gpu_correlate(left, right, left_mask, right_mask, search_box,
+                                m_kernel_size, stereo_settings().cost_mode,
+                                stereo_settings().sgm_gpu_num_paths, subpixel,
+                                lr_threshold, padded_disp, error)) {
+      vw_out(WarningMessage) << "Cannot correlate tile " << bbox << " on the GPU. "
+                             << error << " Using the CPU instead.\n";
+      return false;
+    }
 
-    vw::stereo::CorrelationAlgorithm stereo_alg
-      = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
+    disp = crop(padded_disp, BBox2i(half_kernel, half_kernel + bbox.size()));
+    return true;
+  }
+
+  /// The search range for a tile, based on D_sub and its spread if
+  /// seeding is used.
+  BBox2 tile_search_range(BBox2i const& bbox, bool verbose) const {
     
-    // User strategies
     BBox2 local_search_range;
     if (stereo_settings().seed_mode > 0) {
 
@@ -772,8 +946,28 @@ public:
       seed_bbox.expand(1);
       seed_bbox.crop(m_seed_bbox);
       // Get the disparity range in d_sub corresponding to this tile.
-      VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
-      DispSeedImageType disparity_in_box = crop(m_sub_disp, seed_bbox);
+      if (verbose)
+        VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
+      ImageView<PixelMask<Vector2f>> disparity_in_box = crop(m_sub_disp, seed_bbox);
+
+      // If D_sub has no valid values near this tile, there is nothing to
+      // search for. Return an empty range, so the tile is skipped
+      // without reading the right image.
+      bool has_valid = false;
+      for (int col = 0; col < disparity_in_box.cols() && !has_valid; col++) {
+        for (int row = 0; row < disparity_in_box.rows(); row++) {
+          if (is_valid(disparity_in_box(col, row))) {
+            has_valid = true;
+            break;
+          }
+        }
+      }
+      if (!has_valid) {
+        if (verbose)
+          VW_OUT(DebugMessage, "stereo") << "No valid D_sub values for tile: "
+                                         << bbox << "\n";
+        return BBox2();
+      }
 
       local_search_range = stereo::get_disparity_range(disparity_in_box);
 
@@ -809,18 +1003,111 @@ public:
       if ((stereo_settings().corr_search_limit.min() != Vector2i()) || 
           (stereo_settings().corr_search_limit.max() != Vector2i())) {     
         local_search_range.crop(stereo_settings().corr_search_limit);
-        vw_out() << "\t--> Local search range constrained to: "
-                 << local_search_range << "\n";
+        if (verbose)
+          vw_out() << "\t--> Local search range constrained to: "
+                   << local_search_range << "\n";
       }
 
-      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
-                                     << bbox << ") local search range "
-                                     << local_search_range << " vs "
-                                     << stereo_settings().search_range << "\n";
+      if (verbose)
+        VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
+                                       << bbox << ") local search range "
+                                       << local_search_range << " vs "
+                                       << stereo_settings().search_range << "\n";
 
     } else{ // seed mode == 0
       local_search_range = stereo_settings().search_range;
-      VW_OUT(DebugMessage,"stereo") << "Searching with " << stereo_settings().search_range << "\n";
+      if (verbose)
+        VW_OUT(DebugMessage,"stereo") << "Searching with " << stereo_settings().search_range << "\n";
+    }
+
+    return local_search_range;
+  }
+
+  /// Correlation tiles are processed in raster order, and the next tiles
+  /// after this one are already being worked on by the other threads. So
+  /// read ahead the images for the tile that many positions later.
+  void prefetch_later_tile(BBox2i const& bbox) const {
+    if (!m_prefetcher)
+      return;
+
+    int tile_size = m_prefetch_tile_size;
+    Vector2i num_tiles((m_prefetch_region.width()  + tile_size - 1) / tile_size,
+                       (m_prefetch_region.height() + tile_size - 1) / tile_size);
+    Vector2i tile_index = elem_quot(bbox.min() - m_prefetch_region.min(), tile_size);
+    int64_t later = int64_t(tile_index.y()) * num_tiles.x() + tile_index.x() + m_prefetch_ahead;
+    if (later >= int64_t(num_tiles.x()) * num_tiles.y())
+      return;
+
+    Vector2i later_min = m_prefetch_region.min()
+      + tile_size * Vector2i(later % num_tiles.x(), later / num_tiles.x());
+    BBox2i later_box(later_min, later_min + Vector2i(tile_size, tile_size));
+    later_box.crop(m_prefetch_region);
+    BBox2 search_range = tile_search_range(later_box, false);
+    if (search_range.empty())
+      return;
+    BBox2i search_box(floor(search_range.min()), ceil(search_range.max()));
+
+    // Expand by the kernel and the filter used by the correlator. The right
+    // box also covers the search range. This need not be exact.
+    const int rm_half_kernel = 5;
+    BBox2i left_box = later_box;
+    left_box.expand(std::max(m_kernel_size[0], m_kernel_size[1]) / 2 + rm_half_kernel);
+    BBox2i right_box(left_box.min() + search_box.min(),
+                     left_box.max() + search_box.max());
+
+    ImageType left_image  = m_left_image,  right_image = m_right_image;
+    MaskType  left_mask   = m_left_mask,   right_mask  = m_right_mask;
+    m_prefetcher->request(later, [=]() {
+        asp::prefetch_region(left_image,  left_box);
+        asp::prefetch_region(left_mask,   left_box);
+        asp::prefetch_region(right_image, right_box);
+        asp::prefetch_region(right_mask,  right_box);
+      });
+  }
+
+  /// Read ahead the images on a separate thread. Tiles of given size are
+  /// expected to cover the region in raster order, with this many of them
+  /// processed at the same time.
+  void enable_prefetch(BBox2i const& region, int tile_size, int num_threads) {
+    m_prefetcher.reset(new asp::AsyncPrefetcher(std::max(num_threads, 1)));
+    m_prefetch_region    = region;
+    m_prefetch_tile_size = tile_size;
+    m_prefetch_ahead     = std::max(num_threads, 1);
+  }
+
+  /// Does the work
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    vw::stereo::CorrelationAlgorithm stereo_alg
+      = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
+    
+    // Read ahead the data for a later tile while this one is processed
+    prefetch_later_tile(bbox);
+
+    // User strategies
+    BBox2 local_search_range = tile_search_range(bbox, true);
+
+    // No disparity can be found in this tile, such as when D_sub has no
+    // valid values there, or the search range limit excludes them all
+    if (local_search_range.empty()) {
+      ImageView<pixel_type> empty_disp(bbox.width(), bbox.height());
+      for (int col = 0; col < empty_disp.cols(); col++)
+        for (int row = 0; row < empty_disp.rows(); row++)
+          empty_disp(col, row).invalidate();
+      return CropView<ImageView<result_type>>(empty_disp,
+                                              -bbox.min().x(), -bbox.min().y(),
+                                              cols(), rows());
+    }
+
+    // The GPU engine works on the whole tile at once and does not need the
+    // pyramid, as the search range is already narrowed down by D_sub.
+    if (asp::is_sgm_gpu_alg(stereo_settings().stereo_algorithm)) {
+      ImageView<pixel_type> gpu_disp;
+      if (gpu_correlate(bbox, local_search_range, gpu_disp))
+        return CropView<ImageView<result_type>>(gpu_disp,
+                                                -bbox.min().x(), -bbox.min().y(),
+                                                cols(), rows());
     }
 
     SemiGlobalMatcher::SgmSubpixelMode sgm_subpixel_mode = get_sgm_subpixel_mode();
@@ -862,7 +1149,26 @@ public:
 
   template <class DestT>
   inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
+    static asp::TelemetryHistogram & tile_seconds
+      = asp::telemetry().histogram("stereo_corr.tile_seconds");
+    static asp::TelemetryCounter & num_pixels
+      = asp::telemetry().counter("stereo_corr.pixels");
+    static asp::TelemetryCounter & num_valid_pixels
+      = asp::telemetry().counter("stereo_corr.valid_pixels");
+    auto start = std::chrono::steady_clock::now();
+    asp::TraceScope trace("correlate_tile", "task", bbox);
+    prerasterize_type disp = prerasterize(bbox);
+    vw::rasterize(disp, dest, bbox);
+    tile_seconds.add(std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                   - start).count());
+
+    // The cropped view is indexed in the coordinates of the full image
+    std::int64_t num_valid = 0;
+    for (int row = bbox.min().y(); row < bbox.max().y(); row++)
+      for (int col = bbox.min().x(); col < bbox.max().x(); col++)
+        num_valid += is_valid(disp(col, row));
+    num_pixels.add(bbox.area());
+    num_valid_pixels.add(num_valid);
   }
 }; // End class SeededCorrelatorView
 
@@ -895,14 +1201,22 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
              << stereo_settings().search_range << "\n";
   }
 
+  // For the per-tile report of parallel_stereo
+  asp::telemetry().set_value("stereo_corr.search_range_width",
+                             stereo_settings().search_range.width());
+  asp::telemetry().set_value("stereo_corr.search_range_height",
+                             stereo_settings().search_range.height());
+
   // Load up for the actual native resolution processing
 
   std::string left_image_file = opt.out_prefix + "-L.tif";
   std::string right_image_file = opt.out_prefix + "-R.tif";
   
+  // With --shm-block-cache, the processes on this machine share the blocks read
+  bool use_shm = stereo_settings().shm_block_cache;
   boost::shared_ptr<DiskImageResource>
-    left_rsrc (vw::DiskImageResourcePtr(left_image_file)),
-    right_rsrc(vw::DiskImageResourcePtr(right_image_file));
+    left_rsrc (asp::open_with_shm_cache(left_image_file, use_shm)),
+    right_rsrc(asp::open_with_shm_cache(right_image_file, use_shm));
 
   // Load the normalized images.
   DiskImageView<PixelGray<float>> left_disk_image(left_rsrc), right_disk_image(right_rsrc);
@@ -964,12 +1278,19 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
 
   // Set up the reference to the stereo disparity code
   // - Processing is limited to left_trans_crop_win for use with parallel_stereo.
-  ImageViewRef<PixelMask<Vector2f>> fullres_disparity =
-    crop(SeededCorrelatorView(left_disk_image, right_disk_image, Lmask, Rmask,
-                              sub_disp, sub_disp_spread, kernel_size, 
-                              cost_mode, corr_timeout, seconds_per_op,
-                              region_ul, lr_disp_diff_ptr), 
-         left_trans_crop_win);
+  SeededCorrelatorView correlator(left_disk_image, right_disk_image, Lmask, Rmask,
+                                  sub_disp, sub_disp_spread, kernel_size, 
+                                  cost_mode, corr_timeout, seconds_per_op,
+                                  region_ul, lr_disp_diff_ptr);
+
+  // Read ahead the images for later tiles. This helps only if there is
+  // more than one tile.
+  int tile_size = opt.raster_tile_size[0];
+  if (!stereo_settings().disable_corr_prefetch && tile_size > 0 &&
+      (left_trans_crop_win.width() > tile_size || left_trans_crop_win.height() > tile_size))
+    correlator.enable_prefetch(left_trans_crop_win, tile_size, opt.num_threads);
+
+  ImageViewRef<PixelMask<Vector2f>> fullres_disparity = crop(correlator, left_trans_crop_win);
 
   // With SGM, we must do the entire image chunk as one
   // tile. Otherwise, if it gets done in smaller tiles, there will be
@@ -1031,7 +1352,9 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
     vw::cartography::block_write_gdal_image(d_file, result,
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Correlation :"));
+                                            StatusProgressCallback("asp", "\t--> Correlation :",
+                                                                   double(result.cols()) *
+                                                                   result.rows()));
 
   } else {
     // Otherwise cast back to integer results to save on storage space.
@@ -1039,7 +1362,10 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
                                             pixel_cast<PixelMask<Vector2i>>(fullres_disparity),
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Correlation :"));
+                                            StatusProgressCallback
+                                            ("asp", "\t--> Correlation :",
+                                             double(fullres_disparity.cols()) *
+                                             fullres_disparity.rows()));
   }
 
   if (stereo_settings().save_lr_disp_diff) {
@@ -1076,8 +1402,10 @@ void save_disparity(ASPGlobalOptions& opt,
   vw::cartography::block_write_gdal_image(out_disp_file, unaligned_disp_2d,
                                           has_georef, georef,
                                           has_nodata, nodata, opt,
-                                          TerminalProgressCallback
-                                          ("asp", "\t--> Correlation :"));
+                                          StatusProgressCallback
+                                          ("asp", "\t--> Correlation :",
+                                           double(unaligned_disp_2d.cols()) *
+                                           unaligned_disp_2d.rows()));
 }
 
 // Write an empty disparity of given dimensions
@@ -1438,77 +1766,103 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
       std::string plugin_path = it1->second;
       std::string plugin_lib = it2->second;
 
-      // Set up the environemnt
-      bp::environment e = boost::this_process::environment();
-      e["LD_LIBRARY_PATH"] = plugin_lib;   // For Linux
-      e["DYLD_LIBRARY_PATH"] = plugin_lib; // For OSX
-      vw_out() << "Path to libraries: " << plugin_lib << std::endl;
-      for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++) {
-        e[it->first] = it->second;
-      }
+      if (asp::is_stereo_plugin_library(plugin_path)) {
+        // The plugin is a shared library. Pass the aligned tiles to it in
+        // memory, and get the disparity back the same way. Its library
+        // dependencies must be found via its rpath, and the
+        // environmental variables are set for this process.
+        for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++)
+          setenv(it->first.c_str(), it->second.c_str(), 1);
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        vw_out() << plugin_path << " " << options << std::endl;
+        try {
+          ImageView<float> left_tile  = DiskImageView<float>(left_aligned_file);
+          ImageView<float> right_tile = DiskImageView<float>(right_aligned_file);
+          ImageView<float> local_disp;
+          asp::call_stereo_plugin_library(plugin_path, options, left_tile, right_tile,
+                                          local_disp);
+          aligned_disp = local_disp;
+        } catch(std::exception const& e){
+          // If this tile fails, write an empty disparity
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
+      } else {
+
+        // Set up the environemnt
+        bp::environment e = boost::this_process::environment();
+        e["LD_LIBRARY_PATH"] = plugin_lib;   // For Linux
+        e["DYLD_LIBRARY_PATH"] = plugin_lib; // For OSX
+        vw_out() << "Path to libraries: " << plugin_lib << std::endl;
+        for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++) {
+          e[it->first] = it->second;
+        }
       
-      // Call an external program which will write the disparity to disk
-      std::string cmd = plugin_path + " " + options + " " 
-        + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
+        // Call an external program which will write the disparity to disk
+        std::string cmd = plugin_path + " " + options + " " 
+          + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
       
-      if (alg_name == "msmw" || alg_name == "msmw2") {
-        // Need to provide the output mask
-        cmd += " " + mask_file;
-      }
+        if (alg_name == "msmw" || alg_name == "msmw2") {
+          // Need to provide the output mask
+          cmd += " " + mask_file;
+        }
 
-      int timeout = stereo_settings().corr_timeout;
+        int timeout = stereo_settings().corr_timeout;
 
-      if (env_vars != "") 
-        vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
 
-      vw_out() << cmd << std::endl;
+        vw_out() << cmd << std::endl;
 
-      // Use boost::process to run the given process with timeout.
-      bp::child c(cmd, e);
-      std::error_code ec;
-      if (!c.wait_for(std::chrono::seconds(timeout), ec)) {
-        vw_out() << "\n" << "Timeout reached. Process terminated after "
-                 << timeout << " seconds. See the --corr-timeout option.\n";
-        c.terminate(ec);
-      }      
+        // Use boost::process to run the given process with timeout.
+        bp::child c(cmd, e);
+        std::error_code ec;
+        if (!c.wait_for(std::chrono::seconds(timeout), ec)) {
+          vw_out() << "\n" << "Timeout reached. Process terminated after "
+                   << timeout << " seconds. See the --corr-timeout option.\n";
+          c.terminate(ec);
+        }      
         
-      // Read the disparity from disk. This may fail, for example, the
-      // disparity may time out or it may not have good data. In that
-      // case just make an empty disparity, as we don't want
-      // the processing of the full image to fail because of a tile.
-      try {
-        aligned_disp = DiskImageView<float>(aligned_disp_file);
-      } catch(std::exception const& e){
-        // If this tile fails, write an empty disparity
-        vw_out() << e.what() << std::endl;
-        save_empty_disparity(opt, tile_crop_win, out_disp_file);
-        return;
-      }
+        // Read the disparity from disk. This may fail, for example, the
+        // disparity may time out or it may not have good data. In that
+        // case just make an empty disparity, as we don't want
+        // the processing of the full image to fail because of a tile.
+        try {
+          aligned_disp = DiskImageView<float>(aligned_disp_file);
+        } catch(std::exception const& e){
+          // If this tile fails, write an empty disparity
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
       
-      if (alg_name == "msmw" || alg_name == "msmw2") {
-        // TODO(oalexan1): Make this into a function
-        // Apply the mask, which for this algorithm is stored separately.
-        // For that need to read things in memory.
-        ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
-        DiskImageView<vw::uint8> mask(mask_file);
-
-        if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
-          vw_throw(ArgumentErr() << "Expecting that the following images would "
-                   << "have the same dimensions: "
-                   << aligned_disp_file << ' ' << mask_file << ".\n");
+        if (alg_name == "msmw" || alg_name == "msmw2") {
+          // TODO(oalexan1): Make this into a function
+          // Apply the mask, which for this algorithm is stored separately.
+          // For that need to read things in memory.
+          ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
+          DiskImageView<vw::uint8> mask(mask_file);
+
+          if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
+            vw_throw(ArgumentErr() << "Expecting that the following images would "
+                     << "have the same dimensions: "
+                     << aligned_disp_file << ' ' << mask_file << ".\n");
           
-        float nan = std::numeric_limits<float>::quiet_NaN();
-        for (int col = 0; col < local_disp.cols(); col++) {
-          for (int row = 0; row < local_disp.rows(); row++) {
-            if (mask(col, row) != 0) 
-              local_disp(col, row) = aligned_disp(col, row);
-            else
-              local_disp(col, row) = nan;
+          float nan = std::numeric_limits<float>::quiet_NaN();
+          for (int col = 0; col < local_disp.cols(); col++) {
+            for (int row = 0; row < local_disp.rows(); row++) {
+              if (mask(col, row) != 0) 
+                local_disp(col, row) = aligned_disp(col, row);
+              else
+                local_disp(col, row) = nan;
+            }
           }
-        }
         
-        // Assign the image we just made to the handle
-        aligned_disp = local_disp;
+          // Assign the image we just made to the handle
+          aligned_disp = local_disp;
+        }
       }
     }
 
@@ -1599,6 +1953,29 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
 
 } // End function stereo_correlation_1D
 
+// Run correlation for the current crop window, with the algorithm
+// appropriate for the alignment method.
+void stereo_correlation(ASPGlobalOptions& opt) {
+
+  if (stereo_settings().alignment_method == "local_epipolar") {
+    // Need to have the low-res 2D disparity to later guide the
+    // per-tile correlation. Use here the ASP MGM algorithm as the
+    // most reliable one, unless we do good old block-matching
+    if (stereo_settings().compute_low_res_disparity_only) {
+      if (stereo_settings().stereo_algorithm != "asp_bm")
+        stereo_settings().stereo_algorithm = "asp_mgm";
+      stereo_correlation_2D(opt);
+      return;
+    }
+    // This will be invoked per-tile.
+    stereo_correlation_1D(opt);
+  } else {
+    // Do 2D correlation. The first time this is invoked it will
+    // compute the low-res disparity unless told not to.
+    stereo_correlation_2D(opt);
+  }
+}
+
 int main(int argc, char* argv[]) {
 
   try {
@@ -1663,22 +2040,16 @@ int main(int argc, char* argv[]) {
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : Stage 1 --> CORRELATION\n";
 
-    if (stereo_settings().alignment_method == "local_epipolar") {
-      // Need to have the low-res 2D disparity to later guide the
-      // per-tile correlation. Use here the ASP MGM algorithm as the
-      // most reliable one, unless we do good old block-matching
-      if (stereo_settings().compute_low_res_disparity_only) {
-        if (stereo_settings().stereo_algorithm != "asp_bm")
-          stereo_settings().stereo_algorithm = "asp_mgm";
-        stereo_correlation_2D(opt);
-        return 0;
-      }
-      // This will be invoked per-tile.
-      stereo_correlation_1D(opt);
+    if (stereo_settings().worker_mode) {
+      // Load the options once, then correlate the tiles read from stdin
+      ASPGlobalOptions orig_opt = opt;
+      asp::run_as_worker([&orig_opt](std::string const& tile_prefix) {
+        ASPGlobalOptions tile_opt = orig_opt;
+        tile_opt.out_prefix = tile_prefix;
+        stereo_correlation(tile_opt);
+      });
     } else {
-      // Do 2D correlation. The first time this is invoked it will
-      // compute the low-res disparity unless told not to.
-      stereo_correlation_2D(opt);
+      stereo_correlation(opt);
     }
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : CORRELATION FINISHED\n";
@@ -19,14 +19,17 @@
 /// \file stereo_fltr.cc
 ///
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/disparity_refinement.h>
 
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Stereo/Algorithms.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Image/BlobIndex.h>
 #include <vw/Image/ErodeView.h>
-#include <vw/Image/InpaintView.h>
+#include <vw/Image/BlockRasterize.h>
 
+#include <asp/Core/BlobRemoval.h>
+#include <asp/Core/HoleFilling.h>
 #include <asp/Core/ThreadedEdgeMask.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Gotcha/CBatchProc.h>
@@ -34,6 +37,7 @@
 #include <xercesc/util/PlatformUtils.hpp>
 
 #include <boost/dll.hpp>
+#include <boost/filesystem.hpp>
 
 using namespace vw;
 using namespace asp;
@@ -135,69 +139,6 @@ texture_aware_disparity_filter( ImageViewBase<ImageT    > const& img,
                      texture_smooth_range, texture_max, max_smooth_kernel_size);
 }
 
-// Erode blobs from given image by iterating through tiles, biasing
-// each tile by a factor of blob size, removing blobs in the tile,
-// then shrinking the tile back. The bias is necessary to help avoid
-// fragmenting (and then unnecessarily removing) blobs.
-template <class ImageT>
-class PerTileErode: public ImageViewBase<PerTileErode<ImageT> >{
-  ImageT m_img;
-public:
-  PerTileErode( ImageViewBase<ImageT>   const& img):
-    m_img(img.impl()){}
-
-  // Image View interface
-  typedef typename ImageT::pixel_type pixel_type;
-  typedef pixel_type                  result_type;
-  typedef ProceduralPixelAccessor<PerTileErode> pixel_accessor;
-
-  inline int32 cols  () const { return m_img.cols(); }
-  inline int32 rows  () const { return m_img.rows(); }
-  inline int32 planes() const { return 1; }
-
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
-  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "PerTileErode::operator()(...) is not implemented");
-    return pixel_type();
-  }
-
-  typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-
-    int area = stereo_settings().erode_max_size;
-
-    // We look a beyond the current tile, to avoid cutting blobs
-    // if possible. Skinny blobs will be cut though.
-    int bias = 2*int(ceil(sqrt(double(area))));
-
-    BBox2i bbox2 = bbox;
-    bbox2.expand(bias);
-    bbox2.crop(bounding_box(m_img));
-    ImageView<pixel_type> tile_img = crop(m_img, bbox2);
-
-    int tile_size = max(bbox2.width(), bbox2.height()); // don't subsplit
-    BlobIndexThreaded smallBlobIndex(tile_img, area, tile_size);
-    ImageView<pixel_type> clean_tile_img = applyErodeView(tile_img,
-                                                          smallBlobIndex);
-    return prerasterize_type(clean_tile_img,
-                             -bbox2.min().x(), -bbox2.min().y(),
-                             cols(), rows() );
-  }
-
-  template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
-  }
-};
-
-template <class ImageT>
-PerTileErode<ImageT>
-per_tile_erode( ImageViewBase<ImageT> const& img) {
-  typedef PerTileErode<ImageT> return_type;
-  return return_type( img.impl() );
-}
-
 // Run several cleanup passes with desired cleanup mode.
 template <class ViewT>
 struct MultipleDisparityCleanUp {
@@ -230,39 +171,36 @@ struct MultipleDisparityCleanUp {
   }
 };
 
+// Write the good pixel map, sub-sampled so that the user can actually view it
 template <class ImageT>
-void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
-                                   ASPGlobalOptions const& opt) {
-  // Write Good Pixel Map
-  // Sub-sampling so that the user can actually view it.
-  double sub_scale = double( min( inputview.impl().cols(),
-                                inputview.impl().rows() ) ) / 2048.0;
+void write_good_pixel_map(ImageViewBase<ImageT> const& disp,
+                          bool has_left_georef,
+                          cartography::GeoReference const& left_georef,
+                          ASPGlobalOptions const& opt) {
+
+  double sub_scale = double( min( disp.impl().cols(),
+                                disp.impl().rows() ) ) / 2048.0;
   if (sub_scale < 1) // Don't use a sub_scale less than one.
     sub_scale = 1;
 
-  // Write out the good pixel map
   std::string goodPixelFile = opt.out_prefix + "-GoodPixelMap.tif";
   vw_out() << "Writing: " << goodPixelFile << std::endl;
   ImageViewRef<  PixelRGB<uint8> > goodPixelImage
     = subsample(apply_mask
                 (copy_mask
-                 (stereo::missing_pixel_image(inputview.impl()),
+                 (stereo::missing_pixel_image(disp.impl()),
                   create_mask(DiskImageView<vw::uint8>(opt.out_prefix+"-lMask.tif"), 0)
                   )
                  ), sub_scale);
 
-  // Determine if we can attach geo information to the output image
-  cartography::GeoReference left_georef;
-  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
   bool has_nodata = false;
   double nodata = -32768.0;
-
   vw::cartography::GeoReference good_pixel_georef;
   if (has_left_georef) {
     // Account for scale. Note that goodPixelImage is not guaranteed to respect
     // the sub_scale factor above, hence this calculation.
-    double good_pixel_scale = 0.5*( double(goodPixelImage.cols())/inputview.impl().cols()
-                                    + double(goodPixelImage.rows())/inputview.impl().rows());
+    double good_pixel_scale = 0.5*( double(goodPixelImage.cols())/disp.impl().cols()
+                                    + double(goodPixelImage.rows())/disp.impl().rows());
     good_pixel_georef = resample(left_georef, good_pixel_scale);
   }
 
@@ -270,93 +208,76 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
     ( goodPixelFile, goodPixelImage, has_left_georef, good_pixel_georef,
       has_nodata, nodata,
       opt, TerminalProgressCallback("asp", "\t--> Good pixel map: ") );
+}
 
-  bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
+// Write F.tif, and the good pixel map of the disparity before hole
+// filling and blob removal. The filtering pipeline in the input view is
+// expensive, so it is rasterized once, to F.tif or to a temporary file
+// if holes are to be filled or small blobs removed, and the good pixel
+// map is made from that file. Hole filling and blob removal are done per
+// tile, with the holes and blobs merged across tiles
+// (asp/Core/HoleFilling.h, asp/Core/BlobRemoval.h).
+template <class ImageT>
+void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
+                                   ASPGlobalOptions const& opt) {
 
-  string outF = opt.out_prefix + "-F.tif";
+  // Determine if we can attach geo information to the output image
+  cartography::GeoReference left_georef;
+  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+  bool has_nodata = false;
+  double nodata = -32768.0;
 
-  // Fill holes
-  if(stereo_settings().enable_fill_holes) {
-    // Generate a list of blobs below a maximum size
-    // - This requires the entire input image to be read in
-    //    and produces a single blob list for the entire image.
-    vw_out() << "\t--> Filling holes with inpainting method.\n";
-    BlobIndexThreaded smallHoleIndex( invert_mask( inputview.impl() ),
-                                      stereo_settings().fill_hole_max_size,
-                                      vw::vw_settings().default_tile_size(),
-                                      vw::vw_settings().default_num_threads()
-                                      );
-    vw_out() << "\t    * Identified " << smallHoleIndex.num_blobs() << " holes\n";
-    bool use_grassfire = true;
-    typename ImageT::pixel_type default_inpaint_val;
-
-
-    if (!removeSmallBlobs) { // Skip small blob removal
-      // Write out the image to disk, filling in the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   inpaint(inputview.impl(), smallHoleIndex,
-                                           use_grassfire, default_inpaint_val),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
-    }
-    else { // Add small blob removal step
-      // Write out the image to disk, filling in and removing blobs in the process
-      // - Blob removal is done second to make sure inner-blob holes are removed.
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   per_tile_erode
-                                   (inpaint(inputview.impl(),
-                                            smallHoleIndex,
-                                            use_grassfire,
-                                            default_inpaint_val) ),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
-    }
+  bool fillHoles = stereo_settings().enable_fill_holes;
+  bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
 
-  } else { // No hole filling
-    if (!removeSmallBlobs) { // Skip small blob removal
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF, inputview.impl(),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp", "\t--> Filtering: ") );
-    }
-    else { // Add small blob removal step
-      vw_out() << "\t--> Removing small blobs.\n";
-      // Write out the image to disk, removing the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image(outF, per_tile_erode(inputview.impl()),
-                                  has_left_georef, left_georef,
-                                  has_nodata, nodata, opt,
-                                  TerminalProgressCallback
-                                  ("asp","\t--> Filtering: ") );
-    }
+  string outF = opt.out_prefix + "-F.tif";
+  string preFillF = opt.out_prefix + "-F-pre-fill.tif";
+  string preErodeF = opt.out_prefix + "-F-pre-erode.tif";
+  string filledF = removeSmallBlobs ? preErodeF : outF;
+  string filterF = fillHoles ? preFillF : filledF;
+
+  vw_out() << "Writing: " << filterF << endl;
+  vw::cartography::block_write_gdal_image( filterF, inputview.impl(),
+                               has_left_georef, left_georef,
+                               has_nodata, nodata, opt,
+                               TerminalProgressCallback
+                               ("asp", "\t--> Filtering: ") );
+
+  write_good_pixel_map(DiskImageView<typename ImageT::pixel_type>(filterF),
+                       has_left_georef, left_georef, opt);
+
+  // Fill holes. Blob removal is done second to make sure inner-blob
+  // holes are removed.
+  if (fillHoles) {
+    vw_out() << "\t--> Filling holes.\n";
+    vw_out() << "Writing: " << filledF << endl;
+    asp::HoleFillParams params;
+    params.max_area = stereo_settings().fill_hole_max_size;
+    asp::fill_disparity_holes(preFillF, filledF, params,
+                              has_left_georef, left_georef, opt,
+                              TerminalProgressCallback("asp","\t--> Filling: "));
+    boost::filesystem::remove(preFillF);
+  }
 
-  } // End no hole filling case
+  if (removeSmallBlobs) {
+    vw_out() << "\t--> Removing small blobs.\n";
+    vw_out() << "Writing: " << outF << endl;
+    asp::remove_small_disparity_blobs(preErodeF, outF, stereo_settings().erode_max_size,
+                                      has_left_georef, left_georef, opt,
+                                      TerminalProgressCallback("asp","\t--> Filtering: "));
+    boost::filesystem::remove(preErodeF);
+  }
 } //end write_good_pixel_and_filtered
 
-void stereo_filtering(ASPGlobalOptions& opt) {
+/// Filter the refined disparity, which is either read from disk or
+/// kept in memory, and write GoodPixelMap.tif and F.tif.
+template <class DispImageT>
+void filter_disparity(DispImageT const& disparity_disk_image, ASPGlobalOptions& opt) {
 
-  string post_correlation_fname;
-  opt.session->pre_filtering_hook(opt.out_prefix+"-RD.tif",
-                                  post_correlation_fname);
+  typedef DispImageT input_type;
 
   try {
 
-    // Rasterize the results so far to a temporary file on disk.
-    // This file is deleted once we complete the second half of the
-    // disparity map filtering process.
-
-    // Apply filtering for high frequencies
-    typedef DiskImageView<PixelMask<Vector2f> > input_type;
-    input_type disparity_disk_image(post_correlation_fname);
-
     // Applying additional clipping from the edge. We make new
     // mask files to avoid a weird and tricky segfault due to ownership issues.
     DiskImageView<vw::uint8> left_mask ( opt.out_prefix+"-lMask.tif" );
@@ -441,13 +362,63 @@ void stereo_filtering(ASPGlobalOptions& opt) {
     vw_throw( ArgumentErr() << "\nUnable to start at filtering stage -- could not read input files.\n"
               << e.what() << "\nExiting.\n\n" );
   }
+} // end filter_disparity()
+
+void stereo_filtering(ASPGlobalOptions& opt) {
+
+  if (!stereo_settings().fuse_refinement_and_filtering) {
+    // Filter RD.tif, as written by stereo_rfne
+    string post_correlation_fname;
+    opt.session->pre_filtering_hook(opt.out_prefix+"-RD.tif",
+                                    post_correlation_fname);
+    boost::shared_ptr<DiskImageView<PixelMask<Vector2f>>> disparity_disk_image;
+    try {
+      disparity_disk_image.reset(new DiskImageView<PixelMask<Vector2f>>(post_correlation_fname));
+    } catch (IOErr const& e) {
+      vw_throw( ArgumentErr() << "\nUnable to start at filtering stage -- could not read input files.\n"
+                << e.what() << "\nExiting.\n\n" );
+    }
+    filter_disparity(*disparity_disk_image, opt);
+    return;
+  }
+
+  // Do the refinement here, and keep its result in memory. Filtering
+  // makes several passes over the refined disparity, so it must be
+  // rasterized once rather than recomputed on each pass.
+  if (stereo_settings().mask_flatfield)
+    vw_throw(ArgumentErr() << "The option --fuse-refinement-and-filtering cannot be "
+             << "used with --mask-flatfield.\n");
+
+  // Refinement uses smaller tiles
+  ASPGlobalOptions rfne_opt = opt;
+  int ts = ASPGlobalOptions::rfne_tile_size();
+  rfne_opt.raster_tile_size = Vector2i(ts, ts);
+
+  vw_out() << "\t--> Refining the disparity in memory without writing RD.tif.\n";
+  ImageViewRef<PixelMask<Vector2f>> refined_view = asp::refined_disparity_view(rfne_opt);
+  double mb = double(refined_view.cols()) * refined_view.rows()
+    * sizeof(PixelMask<Vector2f>) / (1024.0 * 1024.0);
+  vw_out() << "\t--> Memory needed for the refined disparity: " << mb << " MB.\n";
+
+  ImageView<PixelMask<Vector2f>> refined_disp
+    = block_rasterize(refined_view, rfne_opt.raster_tile_size,
+                      vw::vw_settings().default_num_threads());
+  filter_disparity(refined_disp, opt);
 } // end stereo_filtering()
 
 void gotcha_disparity_refinement(ASPGlobalOptions& opt) {
 
-  // Apply Gotcha on tiles of size 1024
-  opt.raster_tile_size = Vector2i(ASPGlobalOptions::corr_tile_size(),
-                                  ASPGlobalOptions::corr_tile_size());
+  // Apply Gotcha on tiles of size 4096. Each tile is refined with
+  // several threads, with the regions grown concurrently, so fewer and
+  // larger tiles are done at once. Then the overlap of the tiles is a
+  // smaller fraction of the work.
+  int tile_size = 4 * ASPGlobalOptions::corr_tile_size();
+  opt.raster_tile_size = Vector2i(tile_size, tile_size);
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw::vw_settings().default_num_threads();
+  int threads_per_tile = std::min(std::max(num_threads, 1), 4);
+  opt.num_threads = std::max(num_threads / threads_per_tile, 1);
 
   // Use this much padding to ensure that the tiles processed by Gotcha overlap,
   // to avoid help avoid seams.
@@ -492,7 +463,8 @@ void gotcha_disparity_refinement(ASPGlobalOptions& opt) {
   block_write_gdal_image(disp_file,
                          gotcha::gotcha_refine(filtered_disparity,  
                                                left_image, right_image,
-                                               padding, stereo_settings().casp_go_param_file),
+                                               padding, stereo_settings().casp_go_param_file,
+                                               threads_per_tile),
                          has_left_georef, left_georef,
                          has_nodata, nodata, opt,
                          TerminalProgressCallback("asp","\t  Gotcha:  "));
@@ -38,6 +38,7 @@
 #include <asp/Core/DemDisparity.h>
 #include <asp/GUI/MainWindow.h>
 #include <asp/GUI/GuiUtilities.h>
+#include <asp/GUI/TileServer.h>
 #include <xercesc/util/PlatformUtils.hpp>
 #include <omp.h>
 #include <thread>
@@ -250,6 +251,8 @@ void readImageNames(std::vector<std::string> const& all_files,
         is_image = true; // will load it in the same struct as for images
       }else if (vw::gui::hasCsv(file)) {
         is_image = true; // will load it in the same struct as for images
+      }else if (vw::gui::isTileServerUrl(file)) {
+        is_image = true; // an image on a tile server
       }else if (has_cam_extension(file)) {
         // We will get here for all cameras except .cub, which
         // is both an image and a camera and was picked up by
@@ -295,28 +298,23 @@ int main(int argc, char** argv) {
     readImageNames(all_files, images, output_prefix);
 
     if (stereo_settings().create_image_pyramids_only) {
-      // Just create the image pyramids and exit. 
+      // Just create the image pyramids and exit. A hillshaded image is
+      // found on the fly from the pyramid of the DEM, so it needs no
+      // pyramid of its own.
       for (size_t i = 0; i < images.size(); i++) {
         vw::gui::imageData img;
         img.read(images[i], opt);
-        if (stereo_settings().hillshade) {
-          // Create hillshaded images. 
-          std::string hillshaded_file;
-          bool have_gui = false; // so we don't use a pop up before the gui got started
-          bool success = vw::gui::write_hillshade(opt,
-                                                  have_gui,
-                                                  stereo_settings().hillshade_azimuth,
-                                                  stereo_settings().hillshade_elevation,
-                                                  images[i],
-                                                  // Output
-                                                  hillshaded_file);
-          if (success) // build the pyramids
-            img.read(hillshaded_file, opt, vw::gui::HILLSHADED_VIEW);
-        }
       }
       return 0;
     }
 
+    if (stereo_settings().tile_server_port > 0) {
+      // Serve the images to other stereo_gui instances, without a GUI
+      QCoreApplication app(argc, argv);
+      vw::gui::runTileServer(images, stereo_settings().tile_server_port, opt);
+      return 0;
+    }
+
     // Create the application. Must be done before trying to read
     // images as that call uses pop-ups. Must not happen before
     // building image pyramids as that does not need a gui.
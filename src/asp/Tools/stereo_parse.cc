@@ -26,6 +26,9 @@
 #include <vw/Stereo/CorrelationView.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/ValidBlockMask.h>
+#include <asp/Core/SgmGpu.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace vw;
@@ -89,6 +92,50 @@ void find_tile_at_loc(std::string const& tile_at_loc, ASPGlobalOptions const& op
     vw_out() << "No tile found at location.\n"; 
 }
 
+// Estimate the cost of correlating each tile in given list, and save
+// it as the valid pixel fraction and search range area for each tile.
+// Also save if the tile has any valid data.
+void estimate_tile_costs(std::string const& tile_list, ASPGlobalOptions const& opt) {
+
+  std::vector<BBox2i> tiles;
+  std::ifstream ifs(tile_list.c_str());
+  if (!ifs.good())
+    vw_throw(ArgumentErr() << "Could not read: " << tile_list << "\n");
+  int x, y, w, h;
+  while (ifs >> x >> y >> w >> h)
+    tiles.push_back(BBox2i(x, y, w, h));
+
+  std::vector<double> valid_fraction;
+  std::vector<Vector2> search_size;
+  bool have_search = asp::estimate_tile_costs(opt, tiles, valid_fraction, search_size);
+  std::vector<bool> has_data;
+  asp::tiles_with_data(opt.out_prefix, tiles, has_data);
+
+  // The memory needed for correlation. It is not known without D_sub,
+  // and then -1 is written.
+  vw::stereo::CorrelationAlgorithm stereo_alg
+    = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
+  bool using_gpu = asp::is_sgm_gpu_alg(stereo_settings().stereo_algorithm);
+
+  std::string cost_file = opt.out_prefix + "-tile-costs.txt";
+  vw_out() << "Writing: " << cost_file << "\n";
+  std::ofstream ofs(cost_file.c_str());
+  ofs.precision(17);
+  for (size_t it = 0; it < tiles.size(); it++) {
+    double search_area = search_size[it].x() * search_size[it].y();
+    double memory_mb = -1.0;
+    if (have_search)
+      memory_mb = asp::corr_tile_memory_mb(stereo_alg, using_gpu, tiles[it].size(),
+                                           search_size[it],
+                                           stereo_settings().sgm_collar_size,
+                                           stereo_settings().corr_memory_limit_mb);
+    ofs << tiles[it].min().x() << " " << tiles[it].min().y() << " "
+        << tiles[it].width()   << " " << tiles[it].height()  << " "
+        << valid_fraction[it]  << " " << search_area         << " "
+        << int(has_data[it])   << " " << memory_mb           << "\n";
+  }
+}
+
 int main(int argc, char* argv[]) {
 
   try {
@@ -110,6 +157,12 @@ int main(int argc, char* argv[]) {
       find_tile_at_loc(stereo_settings().tile_at_loc, opt);
       return 1;
     }
+
+    if (!stereo_settings().tile_cost_list.empty()) {
+      // Used by parallel_stereo to decide in which order to process the tiles
+      estimate_tile_costs(stereo_settings().tile_cost_list, opt);
+      return 0;
+    }
     
     vw_out() << "in_file1,"        << opt.in_file1        << endl;
     vw_out() << "in_file2,"        << opt.in_file2        << endl;
@@ -203,6 +256,9 @@ int main(int argc, char* argv[]) {
     vw_out() << "save_lr_disp_diff," << stereo_settings().save_lr_disp_diff << std::endl;
 
     vw_out() << "correlator_mode," << stereo_settings().correlator_mode << endl;
+
+    vw_out() << "fuse_refinement_and_filtering,"
+             << stereo_settings().fuse_refinement_and_filtering << endl;
     
     // This block of code should be in its own executable but I am
     // reluctant to create one just for it. This functionality will be
@@ -31,8 +31,11 @@
 #include <vw/Math/Functors.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/ValidBlockMask.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Core/MatchFile.h>
+#include <asp/Core/PreprocCache.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace vw;
@@ -208,6 +211,24 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
   bool  has_nodata    = true;
   float output_nodata = -32768.0;
 
+  // The valid block mask is found while writing the left mask, if the
+  // masks are rebuilt
+  asp::ValidBlockAccumulator valid_blocks_accum(left_image.cols(), left_image.rows(),
+                                                asp::VALID_BLOCK_SIZE);
+  std::string valid_blocks_file = asp::valid_block_mask_file(opt.out_prefix);
+
+  // The products which depend only on the left image may be shared with
+  // other stereo runs, such as the other pairs of a multiview run.
+  std::string cache_dir = stereo_settings().preprocess_cache_dir;
+  std::string left_cache_key;
+  if (!skip_img_norm)
+    left_cache_key = opt.session->left_preprocessing_cache_key(adjust_left_image_size);
+  std::vector<std::string> mask_cache_names, mask_cache_files;
+  mask_cache_names.push_back("lMask.tif");
+  mask_cache_files.push_back(left_mask_file);
+  mask_cache_names.push_back("lValidBlocks.tif");
+  mask_cache_files.push_back(valid_blocks_file);
+  bool left_mask_cached = false;
 
   if (!rebuild) {
     vw_out() << "\t--> Using cached masks.\n";
@@ -215,6 +236,10 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
 
     vw_out() << "\t--> Generating image masks... \n";
 
+    left_mask_cached = (left_cache_key != "" &&
+                        asp::preproc_cache_fetch(cache_dir, left_cache_key,
+                                                 mask_cache_names, mask_cache_files));
+
     Stopwatch sw;
     sw.start();
 
@@ -264,21 +289,25 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
       // Declare a fixed proportion of low-value pixels to be no-data.
       math::CDFAccumulator< PixelGray<float> > left_cdf (1024, 1024),
                                                right_cdf(1024, 1024);
-      for_each_pixel(left_image,  left_cdf );
+      if (!left_mask_cached) {
+        for_each_pixel(left_image, left_cdf);
+        left_threshold = left_cdf.quantile(nodata_fraction);
+      }
       for_each_pixel(right_image, right_cdf);
-      left_threshold  = left_cdf.quantile (nodata_fraction);
       right_threshold = right_cdf.quantile(nodata_fraction);
     }
 
     // The blob holders must not go out of scope while masks are being written.
     BlobHolder LB, RB;
     // TODO(oalexan1): Wipe this code.
-    if ( !std::isnan(left_threshold) && !std::isnan(right_threshold) ){
+    if (!std::isnan(left_threshold)) {
       ImageViewRef< PixelMask<uint8> > left_thresh_mask
         = LB.mask_and_fill_holes(left_image,  left_threshold);
+      left_mask  = intersect_mask(left_mask,  left_thresh_mask );
+    }
+    if (!std::isnan(right_threshold)) {
       ImageViewRef< PixelMask<uint8> > right_thresh_mask
         = RB.mask_and_fill_holes(right_image, right_threshold);
-      left_mask  = intersect_mask(left_mask,  left_thresh_mask );
       right_mask = intersect_mask(right_mask, right_thresh_mask);
     }
 
@@ -336,7 +365,10 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                bounding_box(left_mask));
 
       vw::cartography::block_write_gdal_image(left_mask_file,
-                                  apply_mask(intersect_mask(left_mask, warped_right_mask)),
+                                  asp::MaskWithValidBlocksView
+                                  (copy_mask(left_image,
+                                             intersect_mask(left_mask, warped_right_mask)),
+                                   valid_blocks_accum),
                                   has_left_georef, left_georef,
                                   has_nodata, output_nodata,
                                   opt, TerminalProgressCallback("asp", "\t    Mask L: ")
@@ -351,10 +383,13 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
       // TODO: Even so, the trick above with intersecting the masks will still work,
       // if the images are map-projected (such as with cam2map-ed cubes),
       // but this would require careful research.
-      vw::cartography::block_write_gdal_image(left_mask_file, apply_mask(left_mask),
-                                   has_left_georef, left_georef,
-                                   has_nodata, output_nodata,
-                                   opt, TerminalProgressCallback("asp", "\t Mask L: ") );
+      if (!left_mask_cached)
+        vw::cartography::block_write_gdal_image(left_mask_file,
+                                     asp::MaskWithValidBlocksView(copy_mask(left_image, left_mask),
+                                                                  valid_blocks_accum),
+                                     has_left_georef, left_georef,
+                                     has_nodata, output_nodata,
+                                     opt, TerminalProgressCallback("asp", "\t Mask L: ") );
       vw::cartography::block_write_gdal_image( right_mask_file, apply_mask(right_mask),
                                    has_right_georef, right_georef,
                                    has_nodata, output_nodata,
@@ -366,6 +401,35 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                                << sw.elapsed_seconds() << " s." << std::endl;
   } // End creating masks
 
+  // A coarse mask of blocks in L.tif with valid and textured pixels. It is
+  // used by parallel_stereo to skip the tiles having no data, without
+  // starting a process for them.
+  bool left_mask_written = rebuild && !left_mask_cached;
+  if (left_mask_written || !fs::exists(valid_blocks_file) ||
+      !is_latest_timestamp(valid_blocks_file, in_file_list)) {
+    vw_out() << "Writing: " << valid_blocks_file << "\n";
+    ImageViewRef<uint8> valid_blocks;
+    if (left_mask_written) {
+      // Found when the left mask was written
+      valid_blocks = valid_blocks_accum.mask();
+    } else {
+      DiskImageView<uint8> left_mask(left_mask_file);
+      valid_blocks = asp::ValidBlockMaskView(left_image, left_mask, asp::VALID_BLOCK_SIZE);
+    }
+    // Each output tile of the valid block mask reads a large input region,
+    // so use small output tiles.
+    vw::GdalWriteOptions opt_small_tiles = opt;
+    opt_small_tiles.raster_tile_size = Vector2i(16, 16);
+    bool has_blocks_georef = false, has_blocks_nodata = false;
+    vw::cartography::block_write_gdal_image(valid_blocks_file, valid_blocks,
+                                            has_blocks_georef, left_georef,
+                                            has_blocks_nodata, output_nodata,
+                                            opt_small_tiles,
+                                            TerminalProgressCallback("asp", "\t    Valid blocks: "));
+  }
+  if (left_mask_written && left_cache_key != "")
+    asp::preproc_cache_store(cache_dir, left_cache_key, mask_cache_names, mask_cache_files);
+
 
   std::string lsub  = opt.out_prefix+"-L_sub.tif";
   std::string rsub  = opt.out_prefix+"-R_sub.tif";
@@ -423,6 +487,23 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     if (sub_tile_size > vw_settings().default_tile_size())
       sub_tile_size = vw_settings().default_tile_size();
     Vector2 sub_tile_size_vec(sub_tile_size, sub_tile_size);
+
+    // The subsampled left image depends on the right image only via the scale
+    std::string sub_cache_key;
+    if (left_cache_key != "") {
+      std::ostringstream os;
+      os.precision(17);
+      os << left_cache_key << " sub " << sub_scale << "\n";
+      sub_cache_key = asp::preproc_cache_key(os.str());
+    }
+    std::vector<std::string> sub_cache_names, sub_cache_files;
+    sub_cache_names.push_back("L_sub.tif");
+    sub_cache_files.push_back(lsub);
+    sub_cache_names.push_back("lMask_sub.tif");
+    sub_cache_files.push_back(lmsub);
+    bool left_sub_cached = (sub_cache_key != "" &&
+                            asp::preproc_cache_fetch(cache_dir, sub_cache_key,
+                                                     sub_cache_names, sub_cache_files));
     vw_out() << "\t--> Creating previews. Subsampling by " << sub_scale
              << " by using a tile of size " << sub_tile_size << " and "
              << sub_threads << " threads.\n";
@@ -439,21 +520,23 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     if (sub_scale > 0.5) {
       // When we are near the pixel input to output ratio, standard
       // interpolation gives the best possible results.
-      left_sub_image  = block_rasterize(resample(copy_mask(left_image,  create_mask(left_mask)),
-                                                 sub_scale), 
-                                        sub_tile_size_vec, sub_threads);
+      if (!left_sub_cached)
+        left_sub_image  = block_rasterize(resample(copy_mask(left_image,  create_mask(left_mask)),
+                                                   sub_scale), 
+                                          sub_tile_size_vec, sub_threads);
       right_sub_image = block_rasterize(resample(copy_mask(right_image, create_mask(right_mask)),
                                                  sub_scale), 
                                         sub_tile_size_vec, sub_threads);
     } else {
       // When we heavily reduce the image size, super sampling seems
       // like the best approach. The method below should be equivalent.
-      left_sub_image
-        = block_rasterize
-        (cache_tile_aware_render(resample_aa(copy_mask(left_image,create_mask(left_mask)),
-                                             sub_scale),
-                                 Vector2i(256,256) * sub_scale),
-         sub_tile_size_vec, sub_threads);
+      if (!left_sub_cached)
+        left_sub_image
+          = block_rasterize
+          (cache_tile_aware_render(resample_aa(copy_mask(left_image,create_mask(left_mask)),
+                                               sub_scale),
+                                   Vector2i(256,256) * sub_scale),
+           sub_tile_size_vec, sub_threads);
       right_sub_image
         = block_rasterize
         (cache_tile_aware_render(resample_aa(copy_mask(right_image,create_mask(right_mask)),
@@ -467,7 +550,7 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     opt_nopred.gdal_options["PREDICTOR"] = "1";
 
     vw::cartography::GeoReference left_sub_georef, right_sub_georef;
-    if (has_left_georef) {
+    if (has_left_georef && !left_sub_cached) {
       // Account for scale.
       double left_scale = 0.5*( double(left_sub_image.cols())/left_image.cols()
                               + double(left_sub_image.rows())/left_image.rows());
@@ -480,28 +563,33 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
       right_sub_georef = resample(right_georef, right_scale);
     }
 
-    vw::cartography::block_write_gdal_image
-      ( lsub, apply_mask(left_sub_image, output_nodata),
-        has_left_georef, left_sub_georef,
-        has_nodata, output_nodata,
-        opt_nopred, TerminalProgressCallback("asp", "\t    Sub L: ") );
+    if (!left_sub_cached)
+      vw::cartography::block_write_gdal_image
+        ( lsub, apply_mask(left_sub_image, output_nodata),
+          has_left_georef, left_sub_georef,
+          has_nodata, output_nodata,
+          opt_nopred, TerminalProgressCallback("asp", "\t    Sub L: ") );
     vw::cartography::block_write_gdal_image
       ( rsub, apply_mask(right_sub_image, output_nodata),
         has_right_georef, right_sub_georef,
         has_nodata, output_nodata,
         opt_nopred, TerminalProgressCallback("asp", "\t    Sub R: ") );
-    vw::cartography::block_write_gdal_image
-      ( lmsub,
-        channel_cast_rescale<uint8>(select_channel(left_sub_image, 1)),
-        has_left_georef, left_sub_georef,
-        has_nodata, output_nodata,
-        opt_nopred, TerminalProgressCallback("asp", "\t    Sub L Mask: ") );
+    if (!left_sub_cached)
+      vw::cartography::block_write_gdal_image
+        ( lmsub,
+          channel_cast_rescale<uint8>(select_channel(left_sub_image, 1)),
+          has_left_georef, left_sub_georef,
+          has_nodata, output_nodata,
+          opt_nopred, TerminalProgressCallback("asp", "\t    Sub L Mask: ") );
     vw::cartography::block_write_gdal_image
       ( rmsub,
         channel_cast_rescale<uint8>(select_channel(right_sub_image, 1)),
         has_right_georef, right_sub_georef,
         has_nodata, output_nodata,
         opt_nopred, TerminalProgressCallback("asp", "\t    Sub R Mask: ") );
+
+    if (sub_cache_key != "" && !left_sub_cached)
+      asp::preproc_cache_store(cache_dir, sub_cache_key, sub_cache_names, sub_cache_files);
   } // End try/catch to see if the subsampled images have content
 
   if (skip_img_norm && stereo_settings().subpixel_mode == 2){
@@ -528,10 +616,12 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
 
     Vector6f left_stats  = gather_stats(pixel_cast<PixelMask<float>>(left_masked_image), 
                                         "left",
-                                        opt.out_prefix, left_image_file);
+                                        opt.out_prefix, left_image_file,
+                                        left_no_data_value);
     Vector6f right_stats = gather_stats(pixel_cast<PixelMask<float>>(right_masked_image), 
                                         "right",
-                                        opt.out_prefix, right_image_file);
+                                        opt.out_prefix, right_image_file,
+                                        right_no_data_value);
     std::string   left_stats_file  = opt.out_prefix + "-lStats.tif";
     std::string   right_stats_file = opt.out_prefix + "-rStats.tif";
 
@@ -571,11 +661,12 @@ void estimate_convergence_angle(ASPGlobalOptions const& opt) {
   
   std::vector<ip::InterestPoint> left_ip, right_ip;
   // vw_out() << "Reading binary match file: " << match_filename << std::endl;
-  ip::read_binary_match_file(match_filename, left_ip, right_ip);
+  asp::read_match_file(match_filename, left_ip, right_ip);
 
   std::vector<double> sorted_angles;
   boost::shared_ptr<camera::CameraModel> left_cam, right_cam;
-  opt.session->camera_models(left_cam, right_cam);
+  opt.session->instrumented_camera_models(left_cam, right_cam,
+                                          "stereo_pprc.convergence_angles");
   asp::convergence_angles(left_cam.get(), right_cam.get(), left_ip, right_ip, sorted_angles);
 
   if (sorted_angles.empty()) {
@@ -622,6 +713,10 @@ int main(int argc, char* argv[]) {
 
     stereo_preprocessing(adjust_left_image_size, opt);
 
+    // The later stages will not need to parse stereo.default and check
+    // the input files again
+    asp::save_settings_snapshot(opt);
+
     estimate_convergence_angle(opt);
     
     vw_out() << "\n[ " << current_posix_time_string() << " ] : PREPROCESSING FINISHED \n";
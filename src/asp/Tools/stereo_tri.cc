@@ -28,15 +28,20 @@
 #include <asp/Sessions/StereoSessionASTER.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/ApproxCameraModel.h>
+#include <asp/Camera/InstrumentedCameraModel.h>
 #include <asp/Core/DisparityProcessing.h>
 #include <asp/Core/Bathymetry.h>
+#include <asp/Core/PointCloudStats.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
 #include <asp/Core/IpMatchingAlgs.h>
 #include <asp/Camera/Covariance.h>
+#include <asp/Core/ProgressStatus.h>
 
 #include <vw/Camera/CameraModel.h>
+#include <vw/Camera/PinholeModel.h>
 #include <vw/Stereo/StereoView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Image/Filter.h>
@@ -116,8 +121,19 @@ public:
   /// - p is not actually used here, it should always be zero!
   inline result_type operator()( size_t i, size_t j, size_t p=0 ) const {
 
-    // For each input image, de-warp the pixel in to the native camera coordinates
+    // Read the disparities at this pixel first. If none is valid there
+    // is nothing to triangulate, and the left pixel need not be de-warped
+    // nor its ray found. This is most of the image for some inputs.
+    // The disparities of a tile are in memory, so reading them twice is cheap.
     int num_disp = m_disparity_maps.size();
+    bool has_valid = false;
+    for (int c = 0; c < num_disp && !has_valid; c++)
+      has_valid = is_valid(m_disparity_maps[c](i,j,p));
+    if (!has_valid)
+      return pixel_type(); // The zero vector, it means that there is no valid data
+
+    // For each input image, de-warp the pixel in to the native camera coordinates.
+    // The left ray is found once in the stereo model and used with all the others.
     std::vector<Vector2> pixVec(num_disp + 1);
     pixVec[0] = m_transforms[0]->reverse(Vector2(i,j)); // De-warp "left" pixel
     for (int c = 0; c < num_disp; c++){
@@ -230,6 +246,17 @@ public:
 
 private:
 
+  // If any pixel in this disparity is valid
+  bool has_valid_disparity(ImageView<DPixelT> const& disparity) const {
+    for (int col = 0; col < disparity.cols(); col++) {
+      for (int row = 0; row < disparity.rows(); row++) {
+        if (is_valid(disparity(col, row)))
+          return true;
+      }
+    }
+    return false;
+  }
+
   // Find the region associated with the right image that we need to bring in memory
   // based on the disparity 
   BBox2i calc_right_bbox(BBox2i const& left_bbox, ImageView<DPixelT> const& disparity) const {
@@ -299,25 +326,39 @@ private:
     for (size_t i = 0; i < transforms.size(); ++i)
       transforms_copy[i] = vw::cartography::mapproj_trans_copy(transforms[i]);
 
-    // As a side effect, this call makes transforms_copy create a local cache we want later
-    transforms_copy[0]->reverse_bbox(bbox); 
     if (transforms_copy.size() != m_disparity_maps.size() + 1){
       vw_throw( ArgumentErr() << "In multi-view triangulation, "
                 << "the number of disparities must be one less "
                 << "than the number of images." );
     }
 
+    // We explicitly bring in-memory the disparities for the current
+    // box to speed up processing later, and then we pretend this is
+    // the entire image by virtually enlarging it using a CropView.
+    // This is done for all disparities before caching the transforms,
+    // as the transform for a disparity with no valid pixels in this box
+    // is never used, and caching it is expensive.
+    std::vector<ImageView<DPixelT>> clips(m_disparity_maps.size());
+    bool any_valid = false;
+    for (int p = 0; p < (int)m_disparity_maps.size(); p++) {
+      clips[p] = crop(m_disparity_maps[p], bbox);
+      if (has_valid_disparity(clips[p]))
+        any_valid = true;
+    }
+
+    // As a side effect, this call makes transforms_copy create a local cache we want later
+    if (any_valid)
+      transforms_copy[0]->reverse_bbox(bbox); 
+
     std::vector<ImageViewRef<DPixelT>> disparity_cropviews;
     for (int p = 0; p < (int)m_disparity_maps.size(); p++){
 
-      // We explicitly bring in-memory the disparities for the current
-      // box to speed up processing later, and then we pretend this is
-      // the entire image by virtually enlarging it using a CropView.
-
-      ImageView<DPixelT> clip(crop(m_disparity_maps[p], bbox));
+      ImageView<DPixelT> const& clip = clips[p];
       ImageViewRef<DPixelT> cropview_clip = crop(clip, -bbox.min().x(), -bbox.min().y(),
                                                  cols(), rows());
       disparity_cropviews.push_back(cropview_clip);
+      if (!has_valid_disparity(clip))
+        continue; // Nothing to triangulate with this disparity
 
       // Calculate the bbox necessary to bring things into memory
       BBox2i right_bbox = calc_right_bbox(bbox, clip);
@@ -372,6 +413,49 @@ stereo_triangulation(std::vector<DispImageType> const& disparities,
 }
 
 
+// Approximate the rays of the cameras other than pinhole on a grid in
+// each image, per --approx-rays-tol. The new cameras are kept in
+// ray_cameras. Return the pointers to the cameras to triangulate with.
+// With map-projected images the extent of the raw images is not known
+// here, so the exact cameras are used.
+std::vector<const vw::camera::CameraModel*>
+approxRayCameras(std::vector<boost::shared_ptr<camera::CameraModel>> const& cameras,
+                 std::vector<std::string> const& image_files,
+                 vw::cartography::Datum const& datum, bool is_map_projected,
+                 std::vector<boost::shared_ptr<camera::CameraModel>> & ray_cameras) {
+
+  ray_cameras = cameras;
+  double tol = is_map_projected ? 0.0 : stereo_settings().approx_rays_tol;
+  for (size_t c = 0; c < cameras.size() && tol > 0; c++) {
+    // Pinhole rays are fast already
+    boost::shared_ptr<camera::CameraModel> ucam = camera::unadjusted_model(cameras[c]);
+    if (dynamic_cast<camera::PinholeModel*>(ucam.get()) != NULL)
+      continue;
+
+    // Disparities can go a little outside the image
+    BBox2i image_box = bounding_box(DiskImageView<float>(image_files[c]));
+    image_box.expand(std::max(image_box.width(), image_box.height()) / 20);
+
+    boost::shared_ptr<asp::ApproxCameraModel> approx
+      (new asp::ApproxCameraModel(cameras[c], datum, image_box, tol));
+    if (approx->pixel_to_vector_error() < 0) {
+      vw_out() << "Could not approximate the rays of camera " << c
+               << " within " << tol << " pixels. Using the exact camera.\n";
+      continue;
+    }
+    ray_cameras[c] = approx;
+  }
+
+  // Count and time the camera calls of triangulation, if requested
+  for (size_t c = 0; c < ray_cameras.size(); c++)
+    ray_cameras[c] = asp::instrument_camera(ray_cameras[c], "stereo_tri.triangulation");
+
+  std::vector<const vw::camera::CameraModel*> ptrs;
+  for (size_t c = 0; c < ray_cameras.size(); c++)
+    ptrs.push_back(ray_cameras[c].get());
+  return ptrs;
+}
+
 // TODO(oalexan1): Move some of these functions to a class or something!
   
 // ImageView operator that takes the last three elements of a vector
@@ -412,24 +496,67 @@ void save_point_cloud(Vector3 const& shift, ImageT const& point_cloud,
     keywords["BAND6"] = "VerticalStdDev";
   }
 
-  if (opt.session->supports_multi_threading()){
+  // Record the statistics of the cloud as its tiles are written, so
+  // that later tools need not scan it.
+  boost::shared_ptr<asp::CloudStatsCollector> stats(new asp::CloudStatsCollector);
+  bool error_is_vector = stereo_settings().compute_error_vector;
+
+  // The compact format needs a shift, so that the points fit in integers
+  bool compact = stereo_settings().compact_point_cloud;
+  if (compact && shift == Vector3()) {
+    vw_out(WarningMessage) << "The point cloud center is not known. Cannot use "
+                           << "--compact-point-cloud.\n";
+    compact = false;
+  }
+
+  // Each pixel of the cloud is a point
+  asp::StatusProgressCallback tpc("asp", "\t--> Triangulating: ",
+                                  double(point_cloud.cols()) * point_cloud.rows(),
+                                  "points");
+
+  if (compact) {
+    double point_scale
+      = asp::get_rounding_error(shift, stereo_settings().point_cloud_rounding_error);
+    double error_scale = stereo_settings().compact_point_cloud_error_rounding;
+    if (error_scale <= 0.0)
+      error_scale = point_scale;
+    vw_out() << "Writing a compact point cloud, with the points rounded to "
+             << point_scale << " meters and the errors to " << error_scale << " meters.\n";
+    if (opt.session->supports_multi_threading())
+      asp::block_write_compact_gdal_image
+        (point_cloud_file, shift, point_scale, error_scale,
+         asp::collect_cloud_stats(point_cloud, error_is_vector, stats),
+         has_georef, georef,
+         opt, tpc,
+         keywords);
+    else
+      asp::write_compact_gdal_image
+        (point_cloud_file, shift, point_scale, error_scale,
+         asp::collect_cloud_stats(point_cloud, error_is_vector, stats),
+         has_georef, georef,
+         opt, tpc,
+         keywords);
+  } else if (opt.session->supports_multi_threading()){
     asp::block_write_approx_gdal_image
       (point_cloud_file, shift,
        stereo_settings().point_cloud_rounding_error,
-       point_cloud,
+       asp::collect_cloud_stats(point_cloud, error_is_vector, stats),
        has_georef, georef, has_nodata, nodata,
-       opt, TerminalProgressCallback("asp", "\t--> Triangulating: "),
+       opt, tpc,
        keywords);
   }else{
     // ISIS does not support multi-threading
     asp::write_approx_gdal_image
       (point_cloud_file, shift,
        stereo_settings().point_cloud_rounding_error,
-       point_cloud,
+       asp::collect_cloud_stats(point_cloud, error_is_vector, stats),
        has_georef, georef, has_nodata, nodata,
-       opt, TerminalProgressCallback("asp", "\t--> Triangulating: "),
+       opt, tpc,
        keywords);
   }
+
+  asp::write_cloud_stats(asp::cloud_stats_file(point_cloud_file),
+                         stats->stats(Vector2i(point_cloud.cols(), point_cloud.rows())));
 }
 
 // TODO(oalexan1): Move this to some low-level utils file  
@@ -724,6 +851,14 @@ void stereo_triangulation(std::string const& output_prefix,
     for (int c = 0; c < num_cams; c++)
       camera_ptrs.push_back(cameras[c].get());
 
+    // The stereo model finds the rays through the pixels. For cameras
+    // where that is slow, such as linescan, interpolate them on a grid.
+    // The exact cameras are still used for error propagation.
+    std::vector<boost::shared_ptr<camera::CameraModel>> ray_cameras;
+    std::vector<const vw::camera::CameraModel*> ray_camera_ptrs
+      = approxRayCameras(cameras, image_files, opt_vec[0].session->get_georef().datum(),
+                         is_map_projected, ray_cameras);
+
     // Convert the angle tol to be in terms of dot product and pass it
     // to the stereo model.
     double angle_tol = vw::stereo::StereoModel::robust_1_minus_cos
@@ -744,9 +879,10 @@ void stereo_triangulation(std::string const& output_prefix,
     // the regular stereo model and bathy stereo model can have
     // different interfaces and the former need not know about the
     // latter. Templates are avoided too.
-    vw::stereo::StereoModel stereo_model(camera_ptrs, stereo_settings().use_least_squares,
+    vw::stereo::StereoModel stereo_model(ray_camera_ptrs, stereo_settings().use_least_squares,
                                          angle_tol);
-    asp::BathyStereoModel bathy_stereo_model(camera_ptrs, stereo_settings().use_least_squares,
+    asp::BathyStereoModel bathy_stereo_model(ray_camera_ptrs,
+                                             stereo_settings().use_least_squares,
                                              angle_tol);
     
     // See if to return all triangulated points, the ones where bathy correction took
@@ -900,7 +1036,19 @@ int main(int argc, char* argv[]) {
     // Internal Processes
     //---------------------------------------------------------
 
-    asp::stereo_triangulation(output_prefix, opt_vec);
+    if (asp::stereo_settings().worker_mode) {
+      // Load the cameras once, then triangulate the tiles read from stdin
+      if (opt_vec.size() != 1)
+        vw_throw(ArgumentErr() << "The --worker-mode option does not support multiview.\n");
+      std::vector<asp::ASPGlobalOptions> orig_opt_vec = opt_vec;
+      asp::run_as_worker([&orig_opt_vec](std::string const& tile_prefix) {
+        std::vector<asp::ASPGlobalOptions> tile_opt_vec = orig_opt_vec;
+        tile_opt_vec[0].out_prefix = tile_prefix;
+        asp::stereo_triangulation(tile_prefix, tile_opt_vec);
+      });
+    } else {
+      asp::stereo_triangulation(output_prefix, opt_vec);
+    }
 
     vw_out() << "\n[ " << asp::current_posix_time_string() << " ] : TRIANGULATION FINISHED \n";
 
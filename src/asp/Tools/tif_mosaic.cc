@@ -149,7 +149,7 @@ void fix_seams_using_ip(std::vector<ImageData> & img_data){
 /// is comma-separated.
 void parseImgData(std::string data, int band,
                   bool has_input_nodata_value, double input_nodata_value,
-                  bool fix_seams,
+                  bool fix_seams, bool blend,
                   int& dst_cols, int& dst_rows,
                   std::vector<ImageData> & img_data){
 
@@ -197,9 +197,10 @@ void parseImgData(std::string data, int band,
 
   // Later images will be on top of earlier images. For that
   // reason, reduce each image to the part it does not overlap with later images.
+  // When blending, the overlaps are kept.
   for (int k = (int)img_data.size()-1; k >= 0; k--){ // Go down from last image to first
 
-    for (int l = k - 1; l >= 0; l--){ // Go down all images before (below) this one
+    for (int l = k - 1; l >= 0 && !blend; l--){ // Go down all images before (below) this one
 
       img_data[l].dst_box.max().y() = std::min( img_data[l].dst_box.max().y(),
                                                 img_data[k].dst_box.min().y() );
@@ -238,14 +239,15 @@ private:
   std::vector<ImageData> m_img_data;
   double m_scale;
   double m_output_nodata_value;
+  bool m_blend;
 
 public:
   TifMosaicView(int dst_cols, int dst_rows, std::vector<ImageData> & img_data,
-                double scale, double output_nodata_value):
+                double scale, double output_nodata_value, bool blend):
     m_dst_cols((int)(scale*dst_cols)),
     m_dst_rows((int)(scale*dst_rows)),
     m_img_data(img_data), m_scale(scale),
-    m_output_nodata_value(output_nodata_value){}
+    m_output_nodata_value(output_nodata_value), m_blend(blend){}
 
   typedef float      pixel_type;
   typedef pixel_type result_type;
@@ -284,6 +286,7 @@ public:
     std::vector<InterpT> crop_vec(m_img_data.size(),
                                   InterpT(ImageT())); // Image data but expanded a bit for interpolation's sake
     int extra = BilinearInterpolation::pixel_buffer;
+    std::vector<int> active; // the images seen in this tile, in increasing order
     // Loop through the input images
     for (int k = 0; k < (int)m_img_data.size(); k++){
       BBox2 box = m_img_data[k].dst_box;
@@ -303,6 +306,7 @@ public:
                 (crop(edge_extend(m_img_data[k].src_img, ConstantEdgeExtension()),
                       box),
                  m_img_data[k].nodata_value));
+      active.push_back(k);
     }
 
     ImageView<pixel_type> tile(bbox.width(), bbox.height());
@@ -325,8 +329,11 @@ public:
 
         // See which src image we end up in. Start from the later
         // images, as those are on top. Stop when we find an image
-        // with a valid pixel at given location.
-        for (int k = (int)m_img_data.size()-1; k >= 0; k--){
+        // with a valid pixel at given location. When blending, use all
+        // of them, with weights decreasing towards the edges of each.
+        double sum = 0.0, wsum = 0.0;
+        for (int a = (int)active.size()-1; a >= 0; a--){
+          int k = active[a];
           Vector2 src_pix = m_img_data[k].transform.reverse(dst_pix);
           if (!src_vec[k].contains(src_pix))
             continue;
@@ -336,12 +343,27 @@ public:
           src_pix += elem_diff(extra, src_vec[k].min());
 
           masked_pixel_type r = crop_vec[k](src_pix[0], src_pix[1] );
-          if (is_valid(r)){
+          if (!is_valid(r))
+            continue;
+
+          if (!m_blend){
             tile(col, row) = r.child();
             break;
           }
+
+          BBox2 const& dst_box = m_img_data[k].dst_box;
+          double dist = std::min(std::min(dst_pix.x() - dst_box.min().x(),
+                                          dst_box.max().x() - dst_pix.x()),
+                                 std::min(dst_pix.y() - dst_box.min().y(),
+                                          dst_box.max().y() - dst_pix.y()));
+          double w = std::max(dist, 0.0) + 1e-6; // so that the sum is positive
+          sum  += w * r.child();
+          wsum += w;
         } // image stack iteration
 
+        if (m_blend && wsum > 0.0)
+          tile(col, row) = sum / wsum;
+
       } // col iteration
     } // row iteration
 
@@ -358,7 +380,7 @@ public:
 struct Options : vw::GdalWriteOptions {
   std::string img_data, output_image, output_type;
   int band;
-  bool has_input_nodata_value, has_output_nodata_value, fix_seams;
+  bool has_input_nodata_value, has_output_nodata_value, fix_seams, blend;
   double percent, input_nodata_value, output_nodata_value;
   Options(): band(0), has_input_nodata_value(false), has_output_nodata_value(false),
              input_nodata_value (std::numeric_limits<double>::quiet_NaN()),
@@ -382,7 +404,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("reduce-percent", po::value(&opt.percent)->default_value(100.0),
      "Reduce resolution using this percentage.")
     ("fix-seams",   po::bool_switch(&opt.fix_seams)->default_value(false),
-     "Fix seams in the output mosaic due to inconsistencies between image and camera data using interest point matching.");
+     "Fix seams in the output mosaic due to inconsistencies between image and camera data using interest point matching.")
+    ("blend",   po::bool_switch(&opt.blend)->default_value(false),
+     "Blend the images where they overlap, with weights decreasing linearly towards the edges of each image. By default, later images are on top of earlier ones.");
 
   po::options_description positional("");
   po::positional_options_description positional_desc;
@@ -424,7 +448,7 @@ int main( int argc, char *argv[] ) {
     std::vector<ImageData> img_data;
     parseImgData(opt.img_data, opt.band,
                  opt.has_input_nodata_value, opt.input_nodata_value,
-                 opt.fix_seams, dst_cols, dst_rows, img_data);
+                 opt.fix_seams, opt.blend, dst_cols, dst_rows, img_data);
     if ( dst_cols <= 0 || dst_rows <= 0 || img_data.empty() )
       vw_throw( ArgumentErr() << "Invalid input data.\n");
 
@@ -440,7 +464,7 @@ int main( int argc, char *argv[] ) {
     TerminalProgressCallback tpc("asp", "\t    Mosaic:");
     ImageViewRef<float> out_img = TifMosaicView(dst_cols, dst_rows,
                                                 img_data, scale,
-                                                output_nodata_value);
+                                                output_nodata_value, opt.blend);
     
     // Write to disk using the specified output data type.
     if (opt.output_type == "Float32") 
@@ -538,6 +538,45 @@ void get_offsets(int tdi, bool is_wv01, bool is_forward,
   }
 }
 
+// Resample a tile, with each column shifted by its own amount, using
+// bilinear interpolation and constant edge extension. Since a column
+// has the same shift for all rows, the interpolation weights and pixel
+// offsets are found once per column, and the tile is traversed row by
+// row. The shifts are indexed by the column in the full image.
+template <class PixelT>
+void shift_columns(ImageView<PixelT> const& img, BBox2i const& img_box,
+                   BBox2i const& bbox,
+                   std::vector<double> const& shiftx,
+                   std::vector<double> const& shifty,
+                   ImageView<PixelT> & tile) {
+
+  int w = img.cols(), h = img.rows(), num_cols = bbox.width();
+  std::vector<int> x0(num_cols), x1(num_cols), yoff(num_cols);
+  std::vector<double> wx(num_cols), wy(num_cols);
+  for (int c = 0; c < num_cols; c++) {
+    int col = c + bbox.min().x();
+    double x  = col - img_box.min().x() + shiftx[col];
+    double fx = std::floor(x), fy = std::floor(shifty[col]);
+    wx[c]   = x - fx;
+    wy[c]   = shifty[col] - fy;
+    x0[c]   = std::min(std::max(int(fx), 0), w - 1);
+    x1[c]   = std::min(std::max(int(fx) + 1, 0), w - 1);
+    yoff[c] = int(fy);
+  }
+
+  tile.set_size(num_cols, bbox.height());
+  for (int r = 0; r < bbox.height(); r++) {
+    int row = r + bbox.min().y() - img_box.min().y();
+    for (int c = 0; c < num_cols; c++) {
+      int y0 = std::min(std::max(row + yoff[c], 0), h - 1);
+      int y1 = std::min(std::max(row + yoff[c] + 1, 0), h - 1);
+      double a = wx[c], b = wy[c];
+      tile(c, r) = PixelT(((1 - a) * (1 - b)) * img(x0[c], y0) + (a * (1 - b)) * img(x1[c], y0)
+                          + ((1 - a) * b) * img(x0[c], y1) + (a * b) * img(x1[c], y1));
+    }
+  }
+}
+
 // Apply WorldView corrections to each vertical block as high as the image
 // corresponding to one CCD sensor.
 template <class ImageT>
@@ -547,6 +586,9 @@ class WVPerBlockCorrectView: public ImageViewBase<WVPerBlockCorrectView<ImageT>>
   bool m_is_wv01, m_is_forward, m_no_correction;
   double m_pitch_ratio;
   std::vector<double> m_posx, m_ccdx, m_posy, m_ccdy;
+
+  // The accumulated corrections for each column
+  std::vector<double> m_shiftx, m_shifty;
   
   typedef typename ImageT::pixel_type PixelT;
 
@@ -571,6 +613,18 @@ public:
               m_posy.size() == m_ccdy.size(),
               ArgumentErr() << "wv_correct: Expecting the arrays of positions "
               << "and offsets to have the same sizes.");
+
+    // Accumulate the corrections up to each column, once for all tiles
+    m_shiftx.resize(m_img.cols(), 0.0);
+    m_shifty.resize(m_img.cols(), 0.0);
+    if (m_ccdx.size() > 0) {
+      for (int col = 0; col < m_img.cols(); col++) {
+        for (size_t t = 0; t < m_ccdx.size(); t++)
+          if (m_posx[t] < col) m_shiftx[col] -= m_ccdx[t];
+        for (size_t t = 0; t < m_ccdy.size(); t++)
+          if (m_posy[t] < col) m_shifty[col] -= m_ccdy[t];
+      }
+    }
   }
   
   typedef PixelT pixel_type;
@@ -600,37 +654,8 @@ public:
     biased_box.crop(bounding_box(m_img));
     
     ImageView<result_type> cropped_img = crop(m_img, biased_box);
-    InterpolationView<EdgeExtensionView< ImageView<result_type>,
-      ConstantEdgeExtension >, BilinearInterpolation> interp_img
-      = interpolate(cropped_img, BilinearInterpolation(),
-                    ConstantEdgeExtension());
-
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-
-      // Accumulate the corrections up to the current column
-      double valx = 0, valy = 0;
-      if (m_ccdx.size() > 0){
-        valx = 0.0;
-        for (size_t t = 0; t < m_ccdx.size(); t++){
-          if (m_posx[t] < col){
-            valx -= m_ccdx[t];
-          }
-        }
-        valy = 0.0;
-        for (size_t t = 0; t < m_ccdy.size(); t++){
-          if (m_posy[t] < col){
-            valy -= m_ccdy[t];
-          }
-        }
-      }
-      
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        tile(col - bbox.min().x(), row - bbox.min().y() )
-          = interp_img(col - biased_box.min().x() + valx,
-                       row - biased_box.min().y() + valy);
-      }
-    }
+    ImageView<result_type> tile;
+    shift_columns(cropped_img, biased_box, bbox, m_shiftx, m_shifty, tile);
     
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );
@@ -680,6 +705,11 @@ public:
       // vw_throw( ArgumentErr() << "Expecting as many corrections as columns.\n" );
     }
 
+    // The corrections are subtracted
+    for (size_t col = 0; col < m_dx.size(); col++) {
+      m_dx[col] = -m_dx[col];
+      m_dy[col] = -m_dy[col];
+    }
   }
   
   typedef PixelT pixel_type;
@@ -707,23 +737,10 @@ public:
     biased_box.expand(bias);
     biased_box.crop(bounding_box(m_img));
     
+    // Note that the same correction is used for an entire column
     ImageView<result_type> cropped_img = crop(m_img, biased_box);
-    InterpolationView<EdgeExtensionView< ImageView<result_type>,
-      ConstantEdgeExtension >, BilinearInterpolation> interp_img
-      = interpolate(cropped_img, BilinearInterpolation(),
-                    ConstantEdgeExtension());
-
-    
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
-        // Note that the same correction is used for an entire column
-        tile(col - bbox.min().x(), row - bbox.min().y() )
-          = interp_img(col - biased_box.min().x() - m_dx[col],
-                       row - biased_box.min().y() - m_dy[col]);
-      }
-    }
+    ImageView<result_type> tile;
+    shift_columns(cropped_img, biased_box, bbox, m_dx, m_dy, tile);
 
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );
@@ -36,6 +36,54 @@ namespace po = boost::program_options;
 // two text files (x and y values), with as many entries as there
 // were columns in the disparity.
 
+// The disparity is read in blocks of columns, each spanning all rows,
+// rather than a column at a time, and the columns in a block are
+// averaged in parallel.
+const int COL_BLOCK_SIZE = 256;
+
+// Average the valid values in one column, after removing outliers.
+// Return false if there are not enough values.
+bool column_average(std::vector<double> & px, std::vector<double> & py,
+                    Vector2 const& remove_outliers_params,
+                    double & avg_x, double & avg_y) {
+
+  avg_x = 0;
+  avg_y = 0;
+
+  std::sort(px.begin(), px.end());
+  std::sort(py.begin(), py.end());
+      
+  // Being too strict with outlier removal can cause trouble
+  double pct_factor     = remove_outliers_params[0]/100.0;
+  double outlier_factor = remove_outliers_params[1];
+      
+  double bx = 0, ex = 0, by = 0, ey = 0;
+  if (!vw::math::find_outlier_brackets(px, pct_factor, outlier_factor, bx, ex))
+    return false;
+  if (!vw::math::find_outlier_brackets(py, pct_factor, outlier_factor, by, ey))
+    return false;
+
+  // The x and y values were sorted separately, so each is compared
+  // only with the brackets for its own axis.
+  int len = px.size();
+  int num_valid = 0;
+  for (int k = 0; k < len; k++){
+
+    if (px[k] < bx || px[k] > ex || py[k] < by || py[k] > ey) continue;
+
+    num_valid++;
+    avg_x += px[k];
+    avg_y += py[k];
+  }
+      
+  if (num_valid > 0){
+    avg_x /= num_valid;
+    avg_y /= num_valid;
+  }
+
+  return true;
+}
+
 struct Options : vw::GdalWriteOptions {
   std::string disparity, dx, dy;
   int beg_row, end_row;
@@ -106,46 +154,28 @@ int main( int argc, char *argv[] ){
 
     std::vector<double> Dx(cols, 0), Dy(cols, 0);
     
-    for (int col = col_start; col < col_stop; col++){
-      disp_progress.report_progress((col - col_start) * disp_progress_mult);
-
-      std::vector<double> px, py;
-      for (int row = beg_row; row < end_row; row++){
-        PixelMask<Vector2f> p = D(col, row);
-        if (!is_valid(p)) continue;
-        px.push_back(p.child()[0]);
-        py.push_back(p.child()[1]);
-      }
-
-      std::sort(px.begin(), px.end());
-      std::sort(py.begin(), py.end());
-      
-      // Being too strict with outlier removal can cause trouble
-      double pct_factor     = opt.remove_outliers_params[0]/100.0;
-      double outlier_factor = opt.remove_outliers_params[1];
-      
-      double bx = 0, ex = 0, by = 0, ey = 0;
-      if (!vw::math::find_outlier_brackets(px, pct_factor, outlier_factor, bx, ex))
-        continue;
-      if (!vw::math::find_outlier_brackets(py, pct_factor, outlier_factor, by, ey))
-        continue;
-
-      int len = px.size();
-      int num_valid = 0;
-      Dx[col] = 0;
-      Dy[col] = 0;
-      for (int k = 0; k < len; k++){
-
-        if (px[k] < bx || px[k] > ex || py[k] < by || py[k] > ey) continue;
-
-        num_valid++;
-        Dx[col] += px[k];
-        Dy[col] += py[k];
-      }
-      
-      if (num_valid > 0){
-        Dx[col] /= num_valid;
-        Dy[col] /= num_valid;
+    for (int beg_col = col_start; beg_col < col_stop; beg_col += COL_BLOCK_SIZE) {
+      disp_progress.report_progress((beg_col - col_start) * disp_progress_mult);
+
+      int end_col = std::min(beg_col + COL_BLOCK_SIZE, col_stop);
+      ImageView<PixelMask<Vector2f>> block
+        = crop(D, BBox2i(beg_col, beg_row, end_col - beg_col, end_row - beg_row));
+
+#pragma omp parallel for schedule(dynamic)
+      for (int col = beg_col; col < end_col; col++){
+        std::vector<double> px, py;
+        for (int row = 0; row < block.rows(); row++){
+          PixelMask<Vector2f> p = block(col - beg_col, row);
+          if (!is_valid(p)) continue;
+          px.push_back(p.child()[0]);
+          py.push_back(p.child()[1]);
+        }
+
+        double avg_x = 0, avg_y = 0;
+        if (column_average(px, py, opt.remove_outliers_params, avg_x, avg_y)) {
+          Dx[col] = avg_x;
+          Dy[col] = avg_y;
+        }
       }
     }
     
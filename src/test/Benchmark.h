@@ -0,0 +1,116 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Benchmark.h
+///
+/// A small harness for microbenchmarks, with an interface modeled on
+/// Google Benchmark. A benchmark does its setup, then runs its timed
+/// loop while State::keep_running() is true. The number of iterations
+/// is picked so that a run takes at least a minimum time, and the run
+/// is repeated several times. The median time per iteration is
+/// reported, which is robust to an occasional slow run. The inputs are
+/// fixed, so the times can be compared among builds.
+
+#ifndef __ASP_TEST_BENCHMARK_H__
+#define __ASP_TEST_BENCHMARK_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+namespace bench {
+
+  class State {
+  public:
+    explicit State(std::int64_t iterations):
+      m_iterations(iterations), m_count(0), m_items(0), m_seconds(0.0) {}
+
+    /// The timer starts at the first call and stops when this returns false
+    bool keep_running() {
+      if (m_count == 0)
+        m_start = std::chrono::steady_clock::now();
+      if (m_count < m_iterations) {
+        m_count++;
+        return true;
+      }
+      m_seconds += seconds_since_start();
+      return false;
+    }
+
+    /// Exclude work in the timed loop from the time, such as resetting an output
+    void pause_timing()  { m_seconds += seconds_since_start(); }
+    void resume_timing() { m_start = std::chrono::steady_clock::now(); }
+
+    /// The number of items, such as pixels or points, processed in all
+    /// iterations. Used to report the time per item.
+    void set_items_processed(std::int64_t items) { m_items = items; }
+
+    std::int64_t iterations() const { return m_iterations; }
+    std::int64_t items_processed() const { return m_items; }
+    double seconds() const { return m_seconds; }
+
+  private:
+    double seconds_since_start() const {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                           - m_start).count();
+    }
+
+    std::int64_t m_iterations, m_count, m_items;
+    double m_seconds;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+  typedef void (*BenchmarkFunc)(State & state);
+
+  struct Benchmark {
+    std::string name;
+    BenchmarkFunc func;
+  };
+
+  /// All registered benchmarks, in the order of registration
+  inline std::vector<Benchmark> & registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+  }
+
+  inline bool register_benchmark(std::string const& name, BenchmarkFunc func) {
+    Benchmark b;
+    b.name = name;
+    b.func = func;
+    registry().push_back(b);
+    return true;
+  }
+
+  /// Keep the compiler from optimizing away a result that is not used
+  template <class T>
+  inline void do_not_optimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+}} // end namespace asp::bench
+
+/// Define and register a benchmark. The body gets a State named 'state'.
+#define ASP_BENCHMARK(name)                                                    \
+  static void asp_benchmark_##name(asp::bench::State & state);                \
+  static const bool asp_benchmark_##name##_registered __attribute__((unused)) = \
+    asp::bench::register_benchmark(#name, asp_benchmark_##name);               \
+  static void asp_benchmark_##name(asp::bench::State & state)
+
+#endif // __ASP_TEST_BENCHMARK_H__
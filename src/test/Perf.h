@@ -0,0 +1,79 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Perf.h
+///
+/// Helpers for the performance tests. These are gtest tests in files
+/// named TestPerf*.cxx, with test cases named Perf*, which fail if a
+/// change makes the code do much more work on fixed inputs. They check
+/// operation counts, such as solver iterations or camera calls, which
+/// do not depend on the machine, and time budgets, which are generous.
+/// The time budgets are multiplied by the value of the environment
+/// variable ASP_PERF_TIME_SCALE, if set. A value of 0 turns off the time
+/// checks, which is useful on loaded or slow machines, and in debug
+/// builds.
+///
+/// These tests have the ctest label 'perf'. Run only them with
+/// 'ctest -L perf', or skip them with 'ctest -LE perf'.
+
+#ifndef __ASP_TEST_PERF_H__
+#define __ASP_TEST_PERF_H__
+
+#include <chrono>
+#include <cstdlib>
+
+namespace asp {
+namespace perf {
+
+  /// The factor by which to multiply the time budgets
+  inline double time_scale() {
+    const char * val = getenv("ASP_PERF_TIME_SCALE");
+    if (val == NULL || val[0] == '\0')
+      return 1.0;
+    return atof(val);
+  }
+
+  /// Measure the wall time of a block, from construction
+  class Timer {
+  public:
+    Timer(): m_start(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                           - m_start).count();
+    }
+  private:
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+}} // end namespace asp::perf
+
+/// Check that a count of operations is within its budget
+#define EXPECT_OPS_WITHIN_BUDGET(count, budget)                               \
+  EXPECT_LE((count), (budget)) << "The operation count " #count               \
+                               << " is over its budget."
+
+/// Check that a time in seconds is within its budget, scaled by
+/// ASP_PERF_TIME_SCALE. Skipped if that is 0.
+#define EXPECT_TIME_WITHIN_BUDGET(seconds, budget)                            \
+  if (asp::perf::time_scale() <= 0)                                           \
+    ;                                                                         \
+  else                                                                        \
+    EXPECT_LE((seconds), (budget) * asp::perf::time_scale())                  \
+      << "Over the time budget. Set ASP_PERF_TIME_SCALE to allow more time."
+
+#endif // __ASP_TEST_PERF_H__
@@ -0,0 +1,123 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+// The main function for the microbenchmarks. Usage:
+//
+//   benchmark_exe [--filter <substring>] [--repetitions <n>] [--min-time <seconds>]
+//
+// Each benchmark matching the filter is run as many times as given, and
+// the median and minimum time per iteration are printed.
+
+#include <test/Benchmark.h>
+#include <vw/Core/Settings.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+  // Run a benchmark with the given number of iterations. Return the time
+  // per iteration, in nanoseconds, and the time per item, if known.
+  double run_once(asp::bench::BenchmarkFunc func, std::int64_t iterations,
+                  double & seconds, double & ns_per_item) {
+    asp::bench::State state(iterations);
+    func(state);
+    seconds = state.seconds();
+    ns_per_item = 0.0;
+    if (state.items_processed() > 0)
+      ns_per_item = 1e9 * seconds / double(state.items_processed());
+    return 1e9 * seconds / double(iterations);
+  }
+
+  double median(std::vector<double> vals) {
+    std::sort(vals.begin(), vals.end());
+    int n = vals.size();
+    if (n % 2 == 1)
+      return vals[n / 2];
+    return 0.5 * (vals[n / 2 - 1] + vals[n / 2]);
+  }
+
+}
+
+int main(int argc, char **argv) {
+
+  // Disable the user's config file
+  vw::vw_settings().set_rc_filename("");
+
+  std::string filter;
+  int repetitions = 5;
+  double min_time = 0.2;
+  for (int it = 1; it < argc; it++) {
+    std::string arg = argv[it];
+    if (arg == "--filter" && it + 1 < argc) {
+      filter = argv[++it];
+    } else if (arg == "--repetitions" && it + 1 < argc) {
+      repetitions = std::max(1, atoi(argv[++it]));
+    } else if (arg == "--min-time" && it + 1 < argc) {
+      min_time = std::max(0.0, atof(argv[++it]));
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--filter <substring>] "
+                << "[--repetitions <n>] [--min-time <seconds>]\n";
+      return 1;
+    }
+  }
+
+  // The sample data is found relative to this directory
+  fs::current_path(fs::path(BENCHMARK_DATADIR));
+
+  printf("%-40s %14s %14s %14s %12s\n", "Benchmark", "Median ns", "Min ns",
+         "Median ns/item", "Iterations");
+  for (auto const& b: asp::bench::registry()) {
+    if (!filter.empty() && b.name.find(filter) == std::string::npos)
+      continue;
+
+    // Grow the number of iterations until a run takes long enough.
+    // This also warms up the caches.
+    std::int64_t iterations = 1;
+    double seconds = 0.0, ns_per_item = 0.0;
+    while (true) {
+      run_once(b.func, iterations, seconds, ns_per_item);
+      if (seconds >= min_time || iterations >= 1000000000)
+        break;
+      double factor = 10.0;
+      if (seconds > 0.0)
+        factor = std::min(10.0, std::max(1.5, 1.2 * min_time / seconds));
+      iterations = std::int64_t(iterations * factor) + 1;
+    }
+
+    std::vector<double> times, item_times;
+    for (int r = 0; r < repetitions; r++) {
+      times.push_back(run_once(b.func, iterations, seconds, ns_per_item));
+      item_times.push_back(ns_per_item);
+    }
+
+    printf("%-40s %14.1f %14.1f %14.2f %12lld\n", b.name.c_str(), median(times),
+           *std::min_element(times.begin(), times.end()), median(item_times),
+           (long long)iterations);
+    fflush(stdout);
+  }
+
+  return 0;
+}